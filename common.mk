@@ -3,7 +3,7 @@
 AM_CPPFLAGS = -DSQLITE_OMIT_LOAD_EXTENSION=1
 AM_CPPFLAGS += -isystem "$(top_srcdir)" -I"$(top_srcdir)/src" -I"$(top_builddir)/src"
 AM_CPPFLAGS += $(libsodium_CFLAGS) $(xdrpp_CFLAGS) $(libmedida_CFLAGS)	\
-	$(soci_CFLAGS) $(sqlite3_CFLAGS) $(libasio_CFLAGS)
+	$(soci_CFLAGS) $(sqlite3_CFLAGS) $(libasio_CFLAGS) $(zlib_CFLAGS)
 AM_CPPFLAGS += -isystem "$(top_srcdir)/lib"			\
 	-isystem "$(top_srcdir)/lib/autocheck/include"		\
 	-isystem "$(top_srcdir)/lib/cereal/include"		\
@@ -13,3 +13,11 @@ AM_CPPFLAGS += -isystem "$(top_srcdir)/lib"			\
 if USE_POSTGRES
 AM_CPPFLAGS += -DUSE_POSTGRES=1 $(libpq_CFLAGS)
 endif # USE_POSTGRES
+
+if USE_TRACING
+AM_CPPFLAGS += -DUSE_TRACING=1
+endif # USE_TRACING
+
+if USE_JEMALLOC
+AM_CPPFLAGS += -DUSE_JEMALLOC=1 $(jemalloc_CFLAGS)
+endif # USE_JEMALLOC
@@ -9,6 +9,9 @@
 //
 
 #include "connection.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <utility>
 #include <vector>
 #include "connection_manager.hpp"
@@ -50,13 +53,33 @@ connection::do_read()
         if (!ec)
         {
             request_parser::result_type result;
-            std::tie(result, std::ignore) = request_parser_.parse(
-                request_, buffer_.data(), buffer_.data() + bytes_transferred);
+            char* end = buffer_.data() + bytes_transferred;
+            char* rest;
+            std::tie(result, rest) =
+                request_parser_.parse(request_, buffer_.data(), end);
 
             if (result == request_parser::good)
             {
-                request_handler_.handle_request(request_, reply_);
-                do_write();
+                std::size_t length = 0;
+                for (auto const& h : request_.headers)
+                {
+                    std::string name = h.name;
+                    std::transform(name.begin(), name.end(), name.begin(),
+                                   ::tolower);
+                    if (name == "content-length")
+                    {
+                        length = std::strtoul(h.value.c_str(), nullptr, 10);
+                    }
+                }
+                if (length > max_body_size)
+                {
+                    reply_ = reply::stock_reply(reply::bad_request);
+                    do_write();
+                    return;
+                }
+                request_.body.assign(
+                    rest, std::min<std::size_t>(end - rest, length));
+                do_read_body(length);
             }
             else if (result == request_parser::bad)
             {
@@ -75,6 +98,40 @@ connection::do_read()
     });
 }
 
+void
+connection::do_read_body(std::size_t length)
+{
+    if (request_.body.size() >= length)
+    {
+        handle_request();
+        return;
+    }
+    auto self(shared_from_this());
+    socket_.async_read_some(asio::buffer(buffer_),
+                            [this, self, length](asio::error_code ec,
+                                                 std::size_t bytes_transferred)
+                            {
+        if (!ec)
+        {
+            request_.body.append(buffer_.data(),
+                                 std::min(bytes_transferred,
+                                          length - request_.body.size()));
+            do_read_body(length);
+        }
+        else if (ec != asio::error::operation_aborted)
+        {
+            connection_manager_.stop(shared_from_this());
+        }
+    });
+}
+
+void
+connection::handle_request()
+{
+    request_handler_.handle_request(request_, reply_);
+    do_write();
+}
+
 void
 connection::do_write()
 {
@@ -49,6 +49,12 @@ private:
   /// Perform an asynchronous read operation.
   void do_read();
 
+  /// Read the rest of the content of a request whose headers are parsed.
+  void do_read_body(std::size_t length);
+
+  /// Handle the complete request.
+  void handle_request();
+
   /// Perform an asynchronous write operation.
   void do_write();
 
@@ -64,6 +70,9 @@ private:
   /// Buffer for incoming data.
   std::array<char, 8192> buffer_;
 
+  /// Largest content accepted.
+  static const std::size_t max_body_size = 32 * 1024 * 1024;
+
   /// The incoming request.
   request request_;
 
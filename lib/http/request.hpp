@@ -26,6 +26,8 @@ struct request
   int http_version_major;
   int http_version_minor;
   std::vector<header> headers;
+  /// The content, of Content-Length bytes.
+  std::string body;
 };
 
 } // namespace server
@@ -53,10 +53,26 @@ void server::add404(routeHandler callback)
 
 void
 server::addRoute(const std::string& routeName, routeHandler callback)
+{
+    mRoutes[routeName] = [callback](const std::string& params,
+                                    const std::string&, std::string& ret) {
+        callback(params, ret);
+    };
+}
+
+void
+server::addBodyRoute(const std::string& routeName, bodyRouteHandler callback)
 {
     mRoutes[routeName] = callback;
 }
 
+void
+server::setContentType(const std::string& routeName,
+                       const std::string& contentType)
+{
+    mContentTypes[routeName] = contentType;
+}
+
 void
 server::do_accept()
 {
@@ -112,20 +128,23 @@ server::handle_request(const request& req, reply& rep)
 
     if (mRoutes.find(command) != mRoutes.end())
     {
-        mRoutes[command](params, rep.content);
+        mRoutes[command](params, req.body, rep.content);
 
+        auto contentType = mContentTypes.find(command);
         rep.status = reply::ok;
         rep.headers.resize(2);
         rep.headers[0].name = "Content-Length";
         rep.headers[0].value = std::to_string(rep.content.size());
         rep.headers[1].name = "Content-Type";
-        rep.headers[1].value = "application/json";
+        rep.headers[1].value = contentType != mContentTypes.end()
+                                   ? contentType->second
+                                   : "application/json";
     }
     else
     {
         if(mRoutes.find("404") != mRoutes.end())
         {
-            mRoutes["404"](params, rep.content);
+            mRoutes["404"](params, req.body, rep.content);
 
             rep.status = reply::ok;
             rep.headers.resize(2);
@@ -30,6 +30,9 @@ class server
 
 public:
     typedef std::function<void(const std::string&, std::string&)> routeHandler;
+    /// Also given the content of the request.
+    typedef std::function<void(const std::string&, const std::string&,
+                               std::string&)> bodyRouteHandler;
     server(const server&) = delete;
     server& operator=(const server&) = delete;
 
@@ -42,7 +45,12 @@ public:
     ~server();
 
     void addRoute(const std::string& routeName, routeHandler callback);
+    void addBodyRoute(const std::string& routeName,
+                      bodyRouteHandler callback);
     void add404(routeHandler callback);
+    // replies of the route are application/json otherwise
+    void setContentType(const std::string& routeName,
+                        const std::string& contentType);
 
     void handle_request(const request& req, reply& rep);
 
@@ -71,7 +79,8 @@ private:
     /// The next socket to be accepted.
     asio::ip::tcp::socket socket_;
 
-    std::map<std::string, routeHandler> mRoutes;
+    std::map<std::string, bodyRouteHandler> mRoutes;
+    std::map<std::string, std::string> mContentTypes;
 };
 
 } // namespace server
@@ -8,6 +8,7 @@
 #include "util/asio.h"
 #include "bucket/Bucket.h"
 #include "bucket/BucketApplicator.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "bucket/BucketOutputIterator.h"
@@ -25,13 +26,22 @@
 #include "lib/util/format.h"
 #include "main/Application.h"
 #include "medida/medida.h"
+#include "util/BloomFilter.h"
+#include "util/BoundedQueue.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/MemoryUsage.h"
 #include "util/TmpDir.h"
+#include "util/Tracing.h"
 #include "util/XDRStream.h"
 #include "xdrpp/message.h"
+#include <algorithm>
 #include <cassert>
+#include <exception>
+#include <fstream>
 #include <future>
+#include <regex>
+#include <thread>
 
 namespace stellar
 {
@@ -47,10 +57,22 @@ Bucket::Bucket(std::string const& filename, Hash const& hash)
     }
 }
 
+Bucket::Bucket(Hash const& hash,
+               std::shared_ptr<std::vector<BucketEntry> const> entries,
+               size_t size)
+    : mHash(hash), mEntries(entries), mSize(size)
+{
+    assert(mEntries && !mEntries->empty());
+}
+
 Bucket::Bucket()
 {
 }
 
+Bucket::~Bucket()
+{
+}
+
 Hash const&
 Bucket::getHash() const
 {
@@ -66,17 +88,179 @@ Bucket::getFilename() const
 bool
 Bucket::containsBucketIdentity(BucketEntry const& id) const
 {
+    auto key = id.type() == LIVEENTRY ? LedgerEntryKey(id.liveEntry())
+                                      : id.deadEntry();
+    return getBucketEntry(key) != nullptr;
+}
+
+void
+Bucket::loadIndex() const
+{
+    if (!mKeyFilter)
+    {
+        std::vector<uint64_t> hashes;
+        auto index = BucketIndex::build(mFilename, &hashes);
+        mKeyFilter = std::make_unique<BloomFilter>(hashes);
+        if (!mIndex)
+        {
+            mIndex = BucketIndex::load(mFilename);
+        }
+        if (!mIndex)
+        {
+            index->save(mFilename);
+            mIndex = std::move(index);
+        }
+    }
+    else
+    {
+        loadSparseIndex();
+    }
+}
+
+void
+Bucket::loadSparseIndex() const
+{
+    if (!mIndex)
+    {
+        mIndex = BucketIndex::load(mFilename);
+        if (!mIndex)
+        {
+            mIndex = BucketIndex::build(mFilename);
+            mIndex->save(mFilename);
+        }
+    }
+}
+
+void
+Bucket::setKeyFilter(std::unique_ptr<BloomFilter> filter) const
+{
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mKeyFilter)
+    {
+        mKeyFilter = std::move(filter);
+    }
+}
+
+void
+Bucket::setIndex(std::unique_ptr<BucketIndex> index) const
+{
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mIndex)
+    {
+        mIndex = std::move(index);
+    }
+}
+
+std::shared_ptr<BucketEntry>
+Bucket::getBucketEntry(LedgerKey const& key) const
+{
+    BucketEntry target;
+    target.type(DEADENTRY);
+    target.deadEntry() = key;
     BucketEntryIdCmp cmp;
-    BucketInputIterator iter(shared_from_this());
-    while (iter)
+
+    if (mEntries)
     {
-        if (!(cmp(*iter, id) || cmp(id, *iter)))
+        auto it = std::lower_bound(mEntries->begin(), mEntries->end(), target,
+                                   cmp);
+        if (it == mEntries->end() || cmp(target, *it))
         {
-            return true;
+            return nullptr;
         }
-        ++iter;
+        return std::make_shared<BucketEntry>(*it);
+    }
+
+    if (mFilename.empty())
+    {
+        return nullptr;
+    }
+
+    uint64_t offset;
+    {
+        std::lock_guard<std::mutex> lock(mIndexMutex);
+        loadIndex();
+        if (!mKeyFilter->mayContain(BucketIndex::keyHash(key)) ||
+            !mIndex->lookup(key, offset))
+        {
+            return nullptr;
+        }
+    }
+
+    XDRInputFileStream in;
+    in.open(mFilename);
+    in.seek(offset);
+    auto be = std::make_shared<BucketEntry>();
+    for (size_t i = 0; i < BucketIndex::STRIDE && in.readOne(*be); i++)
+    {
+        if (cmp(target, *be))
+        {
+            break;
+        }
+        if (!cmp(*be, target))
+        {
+            return be;
+        }
+    }
+    return nullptr;
+}
+
+uint64_t
+Bucket::getScanOffset(LedgerKey const& key) const
+{
+    uint64_t offset = 0;
+    if (!mFilename.empty())
+    {
+        std::lock_guard<std::mutex> lock(mIndexMutex);
+        loadSparseIndex();
+        if (!mIndex->lookup(key, offset))
+        {
+            offset = 0;
+        }
+    }
+    return offset;
+}
+
+bool
+Bucket::getKeyRange(LedgerKey& first, LedgerKey& last) const
+{
+    auto key = [](BucketEntry const& e) {
+        return e.type() == LIVEENTRY ? LedgerEntryKey(e.liveEntry())
+                                     : e.deadEntry();
+    };
+    if (mEntries)
+    {
+        first = key(mEntries->front());
+        last = key(mEntries->back());
+        return true;
+    }
+    if (mFilename.empty())
+    {
+        return false;
     }
-    return false;
+
+    std::lock_guard<std::mutex> lock(mIndexMutex);
+    if (!mKeyRange)
+    {
+        loadSparseIndex();
+        if (mIndex->size() == 0)
+        {
+            return false;
+        }
+        XDRInputFileStream in;
+        in.open(mFilename);
+        in.seek(mIndex->lastOffset());
+        BucketEntry be;
+        auto range = std::make_unique<std::pair<LedgerKey, LedgerKey>>();
+        range->first = mIndex->firstKey();
+        while (in.readOne(be))
+        {
+            range->second = key(be);
+        }
+        mKeyRange = std::move(range);
+    }
+    first = mKeyRange->first;
+    last = mKeyRange->second;
+    return true;
 }
 
 std::pair<size_t, size_t>
@@ -112,67 +296,205 @@ Bucket::apply(Database& db) const
 std::shared_ptr<Bucket>
 Bucket::fresh(BucketManager& bucketManager,
               std::vector<LedgerEntry> const& liveEntries,
-              std::vector<LedgerKey> const& deadEntries)
+              std::vector<LedgerKey> const& deadEntries, bool inMemory)
 {
-    std::vector<BucketEntry> live, dead, combined;
-    live.reserve(liveEntries.size());
-    dead.reserve(deadEntries.size());
+    return fresh(bucketManager, std::vector<LedgerEntry>(liveEntries),
+                 std::vector<LedgerKey>(deadEntries), inMemory);
+}
 
-    for (auto const& e : liveEntries)
+std::shared_ptr<Bucket>
+Bucket::fresh(BucketManager& bucketManager,
+              std::vector<LedgerEntry>&& liveEntries,
+              std::vector<LedgerKey>&& deadEntries, bool inMemory)
+{
+    std::vector<BucketEntry> live, dead;
+    live.resize(liveEntries.size());
+    dead.resize(deadEntries.size());
+
+    for (size_t i = 0; i < liveEntries.size(); i++)
     {
-        BucketEntry ce;
-        ce.type(LIVEENTRY);
-        ce.liveEntry() = e;
-        live.push_back(ce);
+        live[i].type(LIVEENTRY);
+        live[i].liveEntry() = std::move(liveEntries[i]);
     }
-
-    for (auto const& e : deadEntries)
+    for (size_t i = 0; i < deadEntries.size(); i++)
     {
-        BucketEntry ce;
-        ce.type(DEADENTRY);
-        ce.deadEntry() = e;
-        dead.push_back(ce);
+        dead[i].type(DEADENTRY);
+        dead[i].deadEntry() = std::move(deadEntries[i]);
     }
+    liveEntries.clear();
+    deadEntries.clear();
 
     std::sort(live.begin(), live.end(), BucketEntryIdCmp());
 
     std::sort(dead.begin(), dead.end(), BucketEntryIdCmp());
 
-    BucketOutputIterator liveOut(bucketManager.getTmpDir(), true);
-    BucketOutputIterator deadOut(bucketManager.getTmpDir(), true);
+    auto liveOut = inMemory ? std::make_unique<BucketOutputIterator>(true)
+                            : std::make_unique<BucketOutputIterator>(
+                                  bucketManager.getTmpDir(), true);
+    auto deadOut = inMemory ? std::make_unique<BucketOutputIterator>(true)
+                            : std::make_unique<BucketOutputIterator>(
+                                  bucketManager.getTmpDir(), true);
     for (auto const& e : live)
     {
-        liveOut.put(e);
+        liveOut->put(e);
     }
     for (auto const& e : dead)
     {
-        deadOut.put(e);
+        deadOut->put(e);
+    }
+
+    auto liveBucket = liveOut->getBucket(bucketManager);
+    auto deadBucket = deadOut->getBucket(bucketManager);
+    return Bucket::merge(bucketManager, liveBucket, deadBucket, {}, true,
+                         nullptr, inMemory);
+}
+
+namespace
+{
+LedgerKey
+entryKey(BucketEntry const& e)
+{
+    return e.type() == LIVEENTRY ? LedgerEntryKey(e.liveEntry())
+                                 : e.deadEntry();
+}
+
+BucketEntry
+deadEntry(LedgerKey const& key)
+{
+    BucketEntry e;
+    e.type(DEADENTRY);
+    e.deadEntry() = key;
+    return e;
+}
+
+// Iterator over a shadow, which merged entries are looked up in, in order.
+// Entries after the last key of the shadow are not compared with it, and
+// long runs of its entries before the one looked up are jumped over with
+// the bucket's index rather than read.
+class ShadowIterator
+{
+    // entries stepped over before trying to jump
+    static size_t const JUMP_AFTER = BucketIndex::STRIDE;
+
+    std::shared_ptr<Bucket const> mBucket;
+    BucketInputIterator mIter;
+    BucketEntry mLast;
+    BucketEntrySortKey mLastKey;
+    bool mPastLast{false};
+
+    void
+    jumpTo(BucketEntry const& entry)
+    {
+        auto key = entryKey(entry);
+        if (mBucket->isInMemory() ||
+            mBucket->getScanOffset(key) > mIter.pos())
+        {
+            mIter.seek(key);
+        }
+    }
+
+  public:
+    ShadowIterator(std::shared_ptr<Bucket> const& bucket)
+        : mBucket(bucket), mIter(bucket)
+    {
+        LedgerKey first, last;
+        if (bucket->getKeyRange(first, last))
+        {
+            mLast = deadEntry(last);
+            mLastKey = BucketEntrySortKey(mLast);
+        }
+        else
+        {
+            mPastLast = true;
+        }
+    }
+
+    // Whether the shadow has an entry for the key of `entry`, which must
+    // not be before the ones previously looked up.
+    bool
+    shadows(BucketEntry const& entry, BucketEntrySortKey const& key)
+    {
+        BucketEntrySortKeyCmp cmp;
+        if (mPastLast || cmp(mLast, mLastKey, entry, key))
+        {
+            mPastLast = true;
+            return false;
+        }
+        // Advance the shadow while it's less than the candidate
+        size_t stepped = 0;
+        while (mIter && cmp(*mIter, mIter.sortKey(), entry, key))
+        {
+            if (++stepped == JUMP_AFTER)
+            {
+                jumpTo(entry);
+                continue;
+            }
+            ++mIter;
+        }
+        // We have stepped forward to the point that either the shadow is
+        // exhausted, or else its entry >= entry; we now check the opposite
+        // direction to see if we have equality.
+        return mIter && !cmp(entry, key, *mIter, mIter.sortKey());
+    }
+
+    void
+    seek(LedgerKey const& key)
+    {
+        mIter.seek(key);
+    }
+};
+
+// The shadows with keys in the range of the merged buckets, the others
+// cannot shadow any of their entries.
+std::vector<std::shared_ptr<Bucket>>
+overlappingShadows(std::vector<std::shared_ptr<Bucket>> const& inputs,
+                   std::vector<std::shared_ptr<Bucket>> const& shadows)
+{
+    LedgerEntryIdCmp cmp;
+    bool any = false;
+    LedgerKey lo, hi;
+    for (auto const& b : inputs)
+    {
+        LedgerKey first, last;
+        if (b->getKeyRange(first, last))
+        {
+            if (!any || cmp(first, lo))
+            {
+                lo = first;
+            }
+            if (!any || cmp(hi, last))
+            {
+                hi = last;
+            }
+            any = true;
+        }
     }
 
-    auto liveBucket = liveOut.getBucket(bucketManager);
-    auto deadBucket = deadOut.getBucket(bucketManager);
-    return Bucket::merge(bucketManager, liveBucket, deadBucket);
+    std::vector<std::shared_ptr<Bucket>> res;
+    for (auto const& s : shadows)
+    {
+        LedgerKey first, last;
+        if (any && s->getKeyRange(first, last) && !cmp(last, lo) &&
+            !cmp(hi, first))
+        {
+            res.push_back(s);
+        }
+    }
+    return res;
+}
 }
 
 inline void
 maybePut(BucketOutputIterator& out, BucketEntry const& entry,
-         std::vector<BucketInputIterator>& shadowIterators)
+         BucketEntrySortKey const& key,
+         std::vector<ShadowIterator>& shadowIterators)
 {
-    BucketEntryIdCmp cmp;
     for (auto& si : shadowIterators)
     {
-        // Advance the shadowIterator while it's less than the candidate
-        while (si && cmp(*si, entry))
+        if (si.shadows(entry, key))
         {
-            ++si;
-        }
-        // We have stepped si forward to the point that either si is exhausted,
-        // or else *si >= entry; we now check the opposite direction to see if
-        // we have equality.
-        if (si && !cmp(entry, *si))
-        {
-            // If so, then entry is shadowed in at least one level and we will
-            // not be doing a 'put'; we return early. There is no need to
+            // The entry is shadowed in at least one level and we will not be
+            // doing a 'put'; we return early. There is no need to
             // advance the other iterators, they will advance as and if
             // necessary in future calls to maybePut.
             return;
@@ -182,63 +504,425 @@ maybePut(BucketOutputIterator& out, BucketEntry const& entry,
     out.put(entry);
 }
 
-std::shared_ptr<Bucket>
-Bucket::merge(BucketManager& bucketManager,
-              std::shared_ptr<Bucket> const& oldBucket,
-              std::shared_ptr<Bucket> const& newBucket,
-              std::vector<std::shared_ptr<Bucket>> const& shadows,
-              bool keepDeadEntries)
+namespace
 {
-    // This is the key operation in the scheme: merging two (read-only)
-    // buckets together into a new 3rd bucket, while calculating its hash,
-    // in a single pass.
+// Merges whose two main inputs add up to at least this many bytes run as a
+// pipeline: each input is read and decoded on its own thread, and the output
+// is hashed and written on another, leaving the calling thread to compare
+// and shadow entries.
+size_t const PIPELINE_MIN_INPUT_BYTES = 4 * 1024 * 1024;
+size_t const READ_BATCH_SIZE = 1024;
+size_t const READ_QUEUE_DEPTH = 8;
 
-    assert(oldBucket);
-    assert(newBucket);
+// the entries read ahead by the pipelined merges
+MemoryCounter gMergeBuffers;
 
-    BucketInputIterator oi(oldBucket);
-    BucketInputIterator ni(newBucket);
+size_t
+bucketFileSize(Bucket const& b)
+{
+    if (b.getFilename().empty())
+    {
+        return 0;
+    }
+    std::ifstream in(b.getFilename(),
+                     std::ifstream::ate | std::ifstream::binary);
+    return in ? static_cast<size_t>(in.tellg()) : 0;
+}
 
-    std::vector<BucketInputIterator> shadowIterators(shadows.begin(),
-                                                     shadows.end());
+// Same interface as BucketInputIterator, fed by a reader thread.
+class PrefetchingInputIterator : NonMovableOrCopyable
+{
+    struct Batch
+    {
+        std::vector<BucketEntry> mEntries;
+        std::vector<BucketEntrySortKey> mKeys;
+        // accounted to gMergeBuffers, kept when the entries are moved out
+        int64_t mBytes{0};
+        int64_t mObjects{0};
+    };
 
-    auto timer = bucketManager.getMergeTimer().TimeScope();
-    BucketOutputIterator out(bucketManager.getTmpDir(), keepDeadEntries);
+    BoundedQueue<Batch> mBatches;
+    Batch mBatch;
+    size_t mPos{0};
+    bool mDone{false};
+    std::exception_ptr mError;
+    std::thread mReader;
 
-    BucketEntryIdCmp cmp;
+    static void
+    account(Batch& batch)
+    {
+        if (!MemoryCounter::gEnabled)
+        {
+            return;
+        }
+        batch.mBytes = batch.mEntries.capacity() * sizeof(BucketEntry) +
+                       batch.mKeys.capacity() * sizeof(BucketEntrySortKey);
+        for (auto const& e : batch.mEntries)
+        {
+            batch.mBytes += xdr::xdr_size(e);
+        }
+        batch.mObjects = batch.mEntries.size();
+        gMergeBuffers.add(batch.mBytes, batch.mObjects);
+    }
+
+    static void
+    release(Batch& batch)
+    {
+        if (batch.mBytes != 0)
+        {
+            gMergeBuffers.add(-batch.mBytes, -batch.mObjects);
+            batch.mBytes = 0;
+            batch.mObjects = 0;
+        }
+        batch.mEntries.clear();
+        batch.mKeys.clear();
+    }
+
+    void
+    nextBatch()
+    {
+        while (mPos >= mBatch.mEntries.size())
+        {
+            release(mBatch);
+            mPos = 0;
+            if (!mBatches.pop(mBatch))
+            {
+                mDone = true;
+                if (mError)
+                {
+                    std::rethrow_exception(mError);
+                }
+                return;
+            }
+        }
+    }
+
+  public:
+    // Starts after `resumeAfter` when given one, skipping the entries up to
+    // and including its key.
+    PrefetchingInputIterator(std::shared_ptr<Bucket const> bucket,
+                             medida::Meter& readMeter,
+                             BucketEntry const* resumeAfter = nullptr)
+        : mBatches(READ_QUEUE_DEPTH)
+    {
+        std::shared_ptr<BucketEntry const> after;
+        if (resumeAfter)
+        {
+            after = std::make_shared<BucketEntry const>(*resumeAfter);
+        }
+        mReader = std::thread([this, bucket, &readMeter, after]() {
+            try
+            {
+                Batch batch;
+                batch.mEntries.reserve(READ_BATCH_SIZE);
+                batch.mKeys.reserve(READ_BATCH_SIZE);
+                BucketInputIterator in(bucket);
+                if (after)
+                {
+                    BucketEntryIdCmp cmp;
+                    in.seek(entryKey(*after));
+                    while (in && !cmp(*after, *in))
+                    {
+                        ++in;
+                    }
+                }
+                for (; in; ++in)
+                {
+                    batch.mEntries.emplace_back(*in);
+                    batch.mKeys.emplace_back(in.sortKey());
+                    if (batch.mEntries.size() == READ_BATCH_SIZE)
+                    {
+                        readMeter.Mark(batch.mEntries.size());
+                        account(batch);
+                        if (!mBatches.push(std::move(batch)))
+                        {
+                            release(batch);
+                            return;
+                        }
+                        batch = Batch();
+                        batch.mEntries.reserve(READ_BATCH_SIZE);
+                        batch.mKeys.reserve(READ_BATCH_SIZE);
+                    }
+                }
+                if (!batch.mEntries.empty())
+                {
+                    readMeter.Mark(batch.mEntries.size());
+                    account(batch);
+                    if (!mBatches.push(std::move(batch)))
+                    {
+                        release(batch);
+                    }
+                }
+            }
+            catch (...)
+            {
+                // read by the consumer once the queue is closed and drained
+                mError = std::current_exception();
+            }
+            mBatches.close();
+        });
+        try
+        {
+            nextBatch();
+        }
+        catch (...)
+        {
+            mReader.join();
+            throw;
+        }
+    }
+
+    ~PrefetchingInputIterator()
+    {
+        mBatches.close();
+        mReader.join();
+        release(mBatch);
+        while (mBatches.pop(mBatch))
+        {
+            release(mBatch);
+        }
+    }
+
+    operator bool() const
+    {
+        return !mDone;
+    }
+
+    BucketEntry const& operator*()
+    {
+        return mBatch.mEntries[mPos];
+    }
+
+    BucketEntrySortKey const&
+    sortKey() const
+    {
+        return mBatch.mKeys[mPos];
+    }
+
+    PrefetchingInputIterator& operator++()
+    {
+        ++mPos;
+        nextBatch();
+        return *this;
+    }
+};
+
+template <typename InputIterator>
+void
+mergeInputs(InputIterator& oi, InputIterator& ni, BucketOutputIterator& out,
+            std::vector<ShadowIterator>& shadowIterators,
+            medida::Meter* mergeMeter)
+{
+    BucketEntrySortKeyCmp cmp;
+    size_t merged = 0;
     while (oi || ni)
     {
         if (!ni)
         {
             // Out of new entries, take old entries.
-            maybePut(out, *oi, shadowIterators);
+            maybePut(out, *oi, oi.sortKey(), shadowIterators);
             ++oi;
         }
         else if (!oi)
         {
             // Out of old entries, take new entries.
-            maybePut(out, *ni, shadowIterators);
+            maybePut(out, *ni, ni.sortKey(), shadowIterators);
             ++ni;
         }
-        else if (cmp(*oi, *ni))
+        else if (cmp(*oi, oi.sortKey(), *ni, ni.sortKey()))
         {
             // Next old-entry has smaller key, take it.
-            maybePut(out, *oi, shadowIterators);
+            maybePut(out, *oi, oi.sortKey(), shadowIterators);
             ++oi;
         }
-        else if (cmp(*ni, *oi))
+        else if (cmp(*ni, ni.sortKey(), *oi, oi.sortKey()))
         {
             // Next new-entry has smaller key, take it.
-            maybePut(out, *ni, shadowIterators);
+            maybePut(out, *ni, ni.sortKey(), shadowIterators);
             ++ni;
         }
         else
         {
             // Old and new are for the same key, take new.
-            maybePut(out, *ni, shadowIterators);
+            maybePut(out, *ni, ni.sortKey(), shadowIterators);
             ++oi;
             ++ni;
         }
+        if (mergeMeter && ++merged == READ_BATCH_SIZE)
+        {
+            mergeMeter->Mark(merged);
+            merged = 0;
+        }
+    }
+    if (mergeMeter && merged != 0)
+    {
+        mergeMeter->Mark(merged);
+    }
+}
+}
+
+MemoryUsage
+Bucket::getMergeBufferMemoryUsage()
+{
+    return gMergeBuffers.get();
+}
+
+std::string
+Bucket::partialMergeFilename(std::string const& bucketDir,
+                             std::vector<std::string> const& inputHashes,
+                             bool keepDeadEntries)
+{
+    auto hasher = SHA256::create();
+    for (auto const& h : inputHashes)
+    {
+        hasher->add(h);
+    }
+    hasher->add(keepDeadEntries ? "keep-dead" : "drop-dead");
+    return bucketDir + "/merge-" + binToHex(hasher->finish()) + ".partial";
+}
+
+bool
+Bucket::isPartialMergeFilename(std::string const& name)
+{
+    static std::regex re("^merge-[a-z0-9]{64}\\.partial$");
+    return std::regex_match(name, re);
+}
+
+std::shared_ptr<Bucket>
+Bucket::merge(BucketManager& bucketManager,
+              std::shared_ptr<Bucket> const& oldBucket,
+              std::shared_ptr<Bucket> const& newBucket,
+              std::vector<std::shared_ptr<Bucket>> const& shadows,
+              bool keepDeadEntries, RateLimiter* writeLimiter,
+              bool inMemory)
+{
+    TRACE_ZONE("Bucket::merge");
+    // This is the key operation in the scheme: merging two (read-only)
+    // buckets together into a new 3rd bucket, while calculating its hash,
+    // in a single pass.
+
+    assert(oldBucket);
+    assert(newBucket);
+
+    auto overlapping = overlappingShadows({oldBucket, newBucket}, shadows);
+    std::vector<ShadowIterator> shadowIterators(overlapping.begin(),
+                                                overlapping.end());
+
+    auto timer = bucketManager.getMergeTimer().TimeScope();
+
+    if (inMemory)
+    {
+        BucketInputIterator oi(oldBucket);
+        BucketInputIterator ni(newBucket);
+        BucketOutputIterator out(keepDeadEntries);
+        mergeInputs(oi, ni, out, shadowIterators, nullptr);
+        return out.getBucket(bucketManager);
+    }
+
+    if (bucketFileSize(*oldBucket) + bucketFileSize(*newBucket) >=
+        PIPELINE_MIN_INPUT_BYTES)
+    {
+        std::vector<std::string> inputHashes{binToHex(oldBucket->getHash()),
+                                             binToHex(newBucket->getHash())};
+        for (auto const& s : shadows)
+        {
+            inputHashes.push_back(binToHex(s->getHash()));
+        }
+        auto partial = partialMergeFilename(bucketManager.getBucketDir(),
+                                            inputHashes, keepDeadEntries);
+
+        auto& meters = bucketManager.getMergeStageMeters();
+        std::unique_ptr<BucketEntry> last;
+        BucketOutputIterator out(partial, keepDeadEntries, last,
+                                 &meters.mWrite, writeLimiter);
+        if (last)
+        {
+            CLOG(INFO, "Bucket") << "Resuming merge from " << partial;
+            auto key = entryKey(*last);
+            for (auto& si : shadowIterators)
+            {
+                si.seek(key);
+            }
+        }
+        {
+            PrefetchingInputIterator oi(oldBucket, meters.mRead, last.get());
+            PrefetchingInputIterator ni(newBucket, meters.mRead, last.get());
+            mergeInputs(oi, ni, out, shadowIterators, &meters.mMerge);
+        }
+        return out.getBucket(bucketManager);
+    }
+
+    BucketInputIterator oi(oldBucket);
+    BucketInputIterator ni(newBucket);
+    BucketOutputIterator out(bucketManager.getTmpDir(), keepDeadEntries,
+                             nullptr, writeLimiter);
+    mergeInputs(oi, ni, out, shadowIterators, nullptr);
+    return out.getBucket(bucketManager);
+}
+
+std::shared_ptr<Bucket>
+Bucket::mergeAll(BucketManager& bucketManager,
+                 std::vector<std::shared_ptr<Bucket>> const& buckets,
+                 std::vector<std::shared_ptr<Bucket>> const& shadows,
+                 bool keepDeadEntries)
+{
+    std::vector<BucketInputIterator> inputs(buckets.begin(), buckets.end());
+
+    auto overlapping = overlappingShadows(buckets, shadows);
+    std::vector<ShadowIterator> shadowIterators(overlapping.begin(),
+                                                overlapping.end());
+
+    auto timer = bucketManager.getMergeTimer().TimeScope();
+    BucketOutputIterator out(bucketManager.getTmpDir(), keepDeadEntries);
+
+    // Min-heap of the inputs that still have entries, ordered by their
+    // current entry and then by input index, so that among keywise-equal
+    // entries the one from the newest bucket comes out first.
+    BucketEntrySortKeyCmp cmp;
+    auto heapCmp = [&](size_t a, size_t b) {
+        auto& ia = inputs[a];
+        auto& ib = inputs[b];
+        if (cmp(*ib, ib.sortKey(), *ia, ia.sortKey()))
+        {
+            return true;
+        }
+        return !cmp(*ia, ia.sortKey(), *ib, ib.sortKey()) && b < a;
+    };
+    std::vector<size_t> heap;
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        if (inputs[i])
+        {
+            heap.push_back(i);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), heapCmp);
+
+    auto advanceTop = [&]() {
+        std::pop_heap(heap.begin(), heap.end(), heapCmp);
+        auto i = heap.back();
+        heap.pop_back();
+        ++inputs[i];
+        if (inputs[i])
+        {
+            heap.push_back(i);
+            std::push_heap(heap.begin(), heap.end(), heapCmp);
+        }
+    };
+
+    while (!heap.empty())
+    {
+        BucketEntry entry = *inputs[heap.front()];
+        auto key = inputs[heap.front()].sortKey();
+        maybePut(out, entry, key, shadowIterators);
+        advanceTop();
+        // Skip the older versions of the same key.
+        while (!heap.empty() &&
+               !cmp(entry, key, *inputs[heap.front()],
+                    inputs[heap.front()].sortKey()))
+        {
+            advanceTop();
+        }
     }
     return out.getBucket(bucketManager);
 }
@@ -293,16 +977,11 @@ checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
     }
 
     // Step 2: merge all buckets into a single super-bucket.
-    auto i = buckets.begin();
-    assert(i != buckets.end());
-    std::shared_ptr<Bucket> superBucket = *i;
-    while (++i != buckets.end())
+    std::shared_ptr<Bucket> superBucket;
     {
         auto mergeTimer =
             metrics.NewTimer({"bucket", "checkdb", "merge"}).TimeScope();
-        assert(superBucket);
-        assert(*i);
-        superBucket = Bucket::merge(bucketManager, *i, superBucket);
+        superBucket = Bucket::mergeAll(bucketManager, buckets);
         assert(superBucket);
     }
 
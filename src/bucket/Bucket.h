@@ -7,9 +7,13 @@
 #include "bucket/LedgerCmp.h"
 #include "crypto/Hex.h"
 #include "overlay/StellarXDR.h"
+#include "util/MemoryUsage.h"
 #include "util/NonCopyable.h"
 #include "util/XDRStream.h"
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace medida
 {
@@ -30,9 +34,12 @@ namespace stellar
  * merged in sorted order, and all elements are hashed while being added.
  */
 
+class BloomFilter;
+class BucketIndex;
 class BucketManager;
 class BucketList;
 class Database;
+class RateLimiter;
 
 class Bucket : public std::enable_shared_from_this<Bucket>,
                public NonMovableOrCopyable
@@ -41,6 +48,23 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     std::string const mFilename;
     Hash const mHash;
 
+    // The sorted entries of a bucket kept in memory, which has no file (see
+    // IN_MEMORY_SHALLOW_BUCKETS), and their size once serialized.
+    std::shared_ptr<std::vector<BucketEntry> const> const mEntries;
+    size_t const mSize{0};
+
+    // Sparse index and key filter for point lookups. The filter is set when
+    // the bucket is written; otherwise both are loaded or built on first use.
+    mutable std::mutex mIndexMutex;
+    mutable std::unique_ptr<BucketIndex> mIndex;
+    mutable std::unique_ptr<BloomFilter> mKeyFilter;
+    // the first and last keys, once asked for
+    mutable std::unique_ptr<std::pair<LedgerKey, LedgerKey>> mKeyRange;
+
+    // loads or builds the index and key filter, or only the index
+    void loadIndex() const;
+    void loadSparseIndex() const;
+
   public:
     // Create an empty bucket. The empty bucket has hash '000000...' and its
     // filename is the empty string.
@@ -51,13 +75,58 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     // needs to ensure that.
     Bucket(std::string const& filename, Hash const& hash);
 
+    // Construct a bucket kept in memory, with the given (non-empty and
+    // sorted) entries, which serialize to `size` bytes hashing to `hash`.
+    Bucket(Hash const& hash,
+           std::shared_ptr<std::vector<BucketEntry> const> entries,
+           size_t size);
+
+    ~Bucket();
+
     Hash const& getHash() const;
     std::string const& getFilename() const;
 
+    bool
+    isInMemory() const
+    {
+        return mEntries != nullptr;
+    }
+    // The entries of a bucket kept in memory, null for the others.
+    std::shared_ptr<std::vector<BucketEntry> const> const&
+    getEntries() const
+    {
+        return mEntries;
+    }
+    size_t
+    getInMemorySize() const
+    {
+        return mSize;
+    }
+
     // Returns true if a BucketEntry that is key-wise identical to the given
     // BucketEntry exists in the bucket. For testing.
     bool containsBucketIdentity(BucketEntry const& id) const;
 
+    // Return the entry (live or dead) for `key` in the bucket, or nullptr if
+    // the bucket has none. Uses the bucket's key filter to skip most absent
+    // keys, then its sparse index, which is persisted next to the bucket file
+    // the first time it is needed.
+    std::shared_ptr<BucketEntry> getBucketEntry(LedgerKey const& key) const;
+
+    // Return the offset in the bucket file where a scan for the entries not
+    // before `key` has to start, using the bucket's sparse index: at most
+    // BucketIndex::STRIDE entries before `key` are read from there.
+    uint64_t getScanOffset(LedgerKey const& key) const;
+
+    // Set `first` and `last` to the first and last keys of the bucket,
+    // returns false if it is empty. Read with the sparse index, and cached.
+    bool getKeyRange(LedgerKey& first, LedgerKey& last) const;
+
+    // Install a key filter or index built while writing or verifying the
+    // bucket file, unless the bucket already has one.
+    void setKeyFilter(std::unique_ptr<BloomFilter> filter) const;
+    void setIndex(std::unique_ptr<BucketIndex> index) const;
+
     // Return the count of live and dead BucketEntries in the bucket. For
     // testing.
     std::pair<size_t, size_t> countLiveAndDeadEntries() const;
@@ -70,23 +139,58 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
 
     // Create a fresh bucket from a given vector of live LedgerEntries and
     // dead LedgerEntryKeys. The bucket will be sorted, hashed, and adopted
-    // in the provided BucketManager.
+    // in the provided BucketManager, kept in memory if `inMemory`.
     static std::shared_ptr<Bucket>
     fresh(BucketManager& bucketManager,
           std::vector<LedgerEntry> const& liveEntries,
-          std::vector<LedgerKey> const& deadEntries);
+          std::vector<LedgerKey> const& deadEntries, bool inMemory = false);
+    // Same, moving the entries into the bucket entries instead of copying
+    // them.
+    static std::shared_ptr<Bucket>
+    fresh(BucketManager& bucketManager, std::vector<LedgerEntry>&& liveEntries,
+          std::vector<LedgerKey>&& deadEntries, bool inMemory = false);
 
     // Merge two buckets together, producing a fresh one. Entries in `oldBucket`
     // are overridden in the fresh bucket by keywise-equal entries in
     // `newBucket`. Entries are inhibited from the fresh bucket by keywise-equal
-    // entries in any of the buckets in the provided `shadows` vector.
+    // entries in any of the buckets in the provided `shadows` vector. When
+    // given a `writeLimiter`, output bytes are accounted to it.
+    //
+    // Large merges write to their `partialMergeFilename` in the bucket
+    // directory, and resume from what it holds when restarted after being
+    // interrupted. With `inMemory`, the output is kept in memory instead.
     static std::shared_ptr<Bucket>
     merge(BucketManager& bucketManager,
           std::shared_ptr<Bucket> const& oldBucket,
           std::shared_ptr<Bucket> const& newBucket,
           std::vector<std::shared_ptr<Bucket>> const& shadows =
               std::vector<std::shared_ptr<Bucket>>(),
-          bool keepDeadEntries = true);
+          bool keepDeadEntries = true, RateLimiter* writeLimiter = nullptr,
+          bool inMemory = false);
+
+    // Merge any number of buckets together in a single pass, producing a
+    // fresh one. `buckets` is ordered from newest to oldest: entries in a
+    // bucket are overridden by keywise-equal entries in any bucket before it.
+    // Shadows and dead entries are handled as in `merge` above. Produces the
+    // same bucket as chaining `merge` calls from oldest to newest, without
+    // writing out the intermediate buckets.
+    static std::shared_ptr<Bucket>
+    mergeAll(BucketManager& bucketManager,
+             std::vector<std::shared_ptr<Bucket>> const& buckets,
+             std::vector<std::shared_ptr<Bucket>> const& shadows =
+                 std::vector<std::shared_ptr<Bucket>>(),
+             bool keepDeadEntries = true);
+
+    // the entries that the merges in progress, in the process, read ahead
+    static MemoryUsage getMergeBufferMemoryUsage();
+
+    // The file a merge of the buckets of `inputHashes` (old, new, then the
+    // shadows, in hex) writes its output to while running.
+    static std::string
+    partialMergeFilename(std::string const& bucketDir,
+                         std::vector<std::string> const& inputHashes,
+                         bool keepDeadEntries);
+    static bool isPartialMergeFilename(std::string const& name);
 };
 
 void checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
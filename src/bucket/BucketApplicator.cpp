@@ -5,15 +5,30 @@
 #include "util/asio.h"
 #include "bucket/BucketApplicator.h"
 #include "bucket/Bucket.h"
+#include "database/PostgresCopyWriter.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/DataFrame.h"
+#include "ledger/InflationVoteTally.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerEntryCache.h"
+#include "ledger/OfferFrame.h"
+#include "ledger/OrderBook.h"
+#include "ledger/TrustFrame.h"
 #include "util/Logging.h"
+#include <exception>
+#include <functional>
+#include <future>
 
 namespace stellar
 {
 
 BucketApplicator::BucketApplicator(Database& db,
-                                   std::shared_ptr<const Bucket> bucket)
-    : mDb(db), mBucketIter(bucket)
+                                   std::shared_ptr<const Bucket> bucket,
+                                   bool allowBulkLoad)
+    : mDb(db)
+    , mBucket(bucket)
+    , mBucketIter(bucket)
+    , mAllowBulkLoad(allowBulkLoad)
 {
 }
 
@@ -22,33 +37,266 @@ BucketApplicator::operator bool() const
     return (bool)mBucketIter;
 }
 
+static char const* const kLedgerEntryTables[] = {"accounts", "signers",
+                                                  "trustlines", "offers",
+                                                  "accountdata"};
+
+bool
+BucketApplicator::canBulkLoad()
+{
+    if (mDb.isSqlite())
+    {
+        return false;
+    }
+    for (auto table : kLedgerEntryTables)
+    {
+        int found = 0;
+        mDb.getSession() << "SELECT COUNT(*) FROM (SELECT 1 FROM " << table
+                         << " LIMIT 1) AS t",
+            soci::into(found);
+        if (found != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+BucketApplicator::bulkLoad()
+{
+    // One pass over the bucket per table, as a connection can only run one
+    // COPY at a time. Tables are empty, so dead entries have nothing to
+    // delete and live entries cannot collide.
+    typedef std::function<void(PostgresCopyWriter&, LedgerEntry const&)>
+        RowWriter;
+    auto bucket = mBucket;
+    auto copyPass = [bucket](soci::session& sess, char const* table,
+                             char const* columns, RowWriter const& writeRows) {
+        PostgresCopyWriter writer(sess, table, columns);
+        for (BucketInputIterator it(bucket); it; ++it)
+        {
+            auto const& entry = *it;
+            if (entry.type() == LIVEENTRY)
+            {
+                writeRows(writer, entry.liveEntry());
+            }
+        }
+        return writer.finish();
+    };
+
+    // Each table is loaded on a pooled session of its own, concurrently
+    // with the others, in a transaction that also drops its secondary
+    // indexes before the load and rebuilds them after it (rather than
+    // maintaining them row by row; primary keys stay in place). Tables
+    // hold disjoint entry types, so the loads never touch the same rows or
+    // indexes. A table whose load fails is left empty, with its indexes in
+    // place, while the others may be loaded; advance() then applies the
+    // whole bucket row by row.
+    auto& pool = mDb.getPool();
+    auto load = [&pool, copyPass](char const* table, char const* columns,
+                                  RowWriter writeRows) {
+        return std::async(std::launch::async, [=, &pool]() {
+            soci::session sess(pool);
+            soci::transaction sqlTx(sess);
+
+            std::vector<std::string> names, indexDefs;
+            std::string name, def;
+            std::string tableName(table);
+            soci::statement st =
+                (sess.prepare << "SELECT indexname, indexdef FROM pg_indexes "
+                                 "WHERE schemaname = current_schema() AND "
+                                 "tablename = :t AND indexname NOT IN "
+                                 "(SELECT conname FROM pg_constraint)",
+                 soci::into(name), soci::into(def), soci::use(tableName));
+            st.execute(true);
+            while (st.got_data())
+            {
+                names.emplace_back(name);
+                indexDefs.emplace_back(def);
+                st.fetch();
+            }
+            for (auto const& n : names)
+            {
+                sess << "DROP INDEX " << n;
+            }
+
+            auto rows = copyPass(sess, table, columns, writeRows);
+            for (auto const& d : indexDefs)
+            {
+                sess << d;
+            }
+            sqlTx.commit();
+            return rows;
+        });
+    };
+
+    // only reads settings of mDb, from the loading threads
+    auto& db = mDb;
+    std::vector<std::future<size_t>> loads;
+    loads.emplace_back(
+        load("accounts", AccountFrame::kSQLCopyColumns,
+             [&db](PostgresCopyWriter& w, LedgerEntry const& le) {
+                 if (le.data.type() == ACCOUNT)
+                 {
+                     AccountFrame(le).copyTo(w, db);
+                 }
+             }));
+    loads.emplace_back(
+        load("signers", AccountFrame::kSQLSignerCopyColumns,
+             [](PostgresCopyWriter& w, LedgerEntry const& le) {
+                 if (le.data.type() == ACCOUNT)
+                 {
+                     AccountFrame(le).copySignersTo(w);
+                 }
+             }));
+    loads.emplace_back(load("trustlines", TrustFrame::kSQLCopyColumns,
+                            [](PostgresCopyWriter& w, LedgerEntry const& le) {
+                                if (le.data.type() == TRUSTLINE)
+                                {
+                                    TrustFrame(le).copyTo(w);
+                                }
+                            }));
+    loads.emplace_back(load("offers", OfferFrame::kSQLCopyColumns,
+                            [](PostgresCopyWriter& w, LedgerEntry const& le) {
+                                if (le.data.type() == OFFER)
+                                {
+                                    OfferFrame(le).copyTo(w);
+                                }
+                            }));
+    loads.emplace_back(load("accountdata", DataFrame::kSQLCopyColumns,
+                            [](PostgresCopyWriter& w, LedgerEntry const& le) {
+                                if (le.data.type() == DATA)
+                                {
+                                    DataFrame(le).copyTo(w);
+                                }
+                            }));
+
+    // all loads are waited for before the first error is thrown
+    size_t rows = 0;
+    std::exception_ptr error;
+    for (auto& l : loads)
+    {
+        try
+        {
+            rows += l.get();
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    // even a failed load may have filled some of the tables
+    mDb.getEntryCache().clear();
+    if (auto orderBook = mDb.getOrderBook())
+    {
+        orderBook->clear();
+    }
+    if (auto tally = mDb.getInflationVoteTally())
+    {
+        tally->clear();
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    CLOG(INFO, "Bucket") << "Bucket-apply: bulk loaded " << rows
+                         << " rows in " << loads.size() << " tables";
+
+    while (mBucketIter)
+    {
+        ++mBucketIter;
+        ++mSize;
+    }
+}
+
 void
 BucketApplicator::advance()
 {
+    if (mAllowBulkLoad)
+    {
+        // only decided once, before anything is applied
+        mAllowBulkLoad = false;
+        if (canBulkLoad())
+        {
+            try
+            {
+                bulkLoad();
+                return;
+            }
+            catch (std::exception& e)
+            {
+                // tables that did load are overwritten row by row
+                CLOG(WARNING, "Bucket")
+                    << "Bucket-apply: bulk load failed, applying row by row: "
+                    << e.what();
+            }
+        }
+    }
+
     soci::transaction sqlTx(mDb.getSession());
+
+    // Accounts and offers have single-column keys: every entry of those
+    // types in this chunk is deleted with a few multi-key statements, after
+    // which live entries are plain inserts. This avoids the existence check
+    // and the per-entry UPDATE or DELETE of storeAddOrChange / storeDelete.
+    // Bucket entries have unique keys, so the order of operations within a
+    // chunk does not matter.
+    std::vector<LedgerKey> accountKeys, offerKeys;
+    std::vector<EntryFrame::pointer> inserts;
+
     while (mBucketIter)
     {
-        LedgerHeader lh;
-        LedgerDelta delta(lh, mDb, false);
-
         auto const& entry = *mBucketIter;
-        if (entry.type() == LIVEENTRY)
+        bool live = entry.type() == LIVEENTRY;
+        LedgerKey key =
+            live ? LedgerEntryKey(entry.liveEntry()) : entry.deadEntry();
+        if (key.type() == ACCOUNT || key.type() == OFFER)
         {
-            EntryFrame::pointer ep = EntryFrame::FromXDR(entry.liveEntry());
-            ep->storeAddOrChange(delta, mDb);
+            (key.type() == ACCOUNT ? accountKeys : offerKeys).push_back(key);
+            if (live)
+            {
+                inserts.emplace_back(EntryFrame::FromXDR(entry.liveEntry()));
+            }
         }
         else
         {
-            EntryFrame::storeDelete(delta, mDb, entry.deadEntry());
+            LedgerHeader lh;
+            LedgerDelta delta(lh, mDb, false);
+            if (live)
+            {
+                EntryFrame::FromXDR(entry.liveEntry())
+                    ->storeAddOrChange(delta, mDb);
+            }
+            else
+            {
+                EntryFrame::storeDelete(delta, mDb, key);
+            }
+            // No-op, just to avoid needless rollback.
+            delta.commit();
         }
         ++mBucketIter;
-        // No-op, just to avoid needless rollback.
-        delta.commit();
         if ((++mSize & 0xff) == 0xff)
         {
             break;
         }
     }
+
+    AccountFrame::storeDeleteBatch(mDb, accountKeys);
+    OfferFrame::storeDeleteBatch(mDb, offerKeys);
+    for (auto const& ep : inserts)
+    {
+        LedgerHeader lh;
+        LedgerDelta delta(lh, mDb, false);
+        ep->storeAdd(delta, mDb);
+        delta.commit();
+    }
     sqlTx.commit();
     mDb.clearPreparedStatementCache();
 
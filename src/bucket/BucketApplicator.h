@@ -19,14 +19,29 @@ class Database;
 // progress. Used during history catchup to split up the task of applying
 // bucket into scheduler-friendly, bite-sized pieces.
 
+//
+// When `allowBulkLoad` is set and, at the time the first entries are applied,
+// the database is PostgreSQL and the ledger entry tables are all empty (as is
+// the case when catching up a fresh node), the whole bucket is instead loaded
+// with COPY: each table, that is each entry type, concurrently on a pooled
+// session of its own and in a transaction of its own, its secondary indexes
+// being dropped before the load and rebuilt after it. Should any of these
+// loads fail, the bucket is applied row by row instead.
+
 class BucketApplicator
 {
     Database& mDb;
+    std::shared_ptr<const Bucket> mBucket;
     BucketInputIterator mBucketIter;
     size_t mSize{0};
+    bool mAllowBulkLoad;
+
+    bool canBulkLoad();
+    void bulkLoad();
 
   public:
-    BucketApplicator(Database& db, std::shared_ptr<const Bucket> bucket);
+    BucketApplicator(Database& db, std::shared_ptr<const Bucket> bucket,
+                     bool allowBulkLoad = false);
     operator bool() const;
     void advance();
 };
@@ -0,0 +1,290 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Throughput benchmarks for the bucket operations behind ledger close and
+// catchup. They are hidden; run them with `stellar-core --test
+// [bucketbench]`. Each run appends one row per bucket size to a
+// entries-vs-...csv file in the current directory, see ScaleReporter.
+// The [perf] one records its measurements to the perf results, see
+// PerfResults.
+
+#include "bucket/Bucket.h"
+#include "bucket/BucketInputIterator.h"
+#include "bucket/BucketManager.h"
+#include "bucket/LedgerCmp.h"
+#include "database/Database.h"
+#include "ledger/EntryFrame.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/PerfResults.h"
+#include "test/ScaleReporter.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Logging.h"
+#include "util/Math.h"
+
+#include <chrono>
+
+using namespace stellar;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+// entries are written to fresh buckets in batches of this size
+size_t const BATCH_SIZE = 100000;
+
+double
+entriesPerSecond(size_t entries, Clock::duration d)
+{
+    return entries / std::chrono::duration<double>(d).count();
+}
+
+// Random entry, with a mix of entry types roughly matching the public
+// network: mostly accounts and trustlines, fewer offers and data entries.
+LedgerEntry
+generateEntry()
+{
+    LedgerEntry le;
+    auto r = rand_uniform<int>(0, 99);
+    if (r < 50)
+    {
+        le.data.type(ACCOUNT);
+        le.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+    }
+    else if (r < 80)
+    {
+        le.data.type(TRUSTLINE);
+        le.data.trustLine() = LedgerTestUtils::generateValidTrustLineEntry(5);
+    }
+    else if (r < 95)
+    {
+        le.data.type(OFFER);
+        le.data.offer() = LedgerTestUtils::generateValidOfferEntry(5);
+    }
+    else
+    {
+        le.data.type(DATA);
+        le.data.data() = LedgerTestUtils::generateValidDataEntry(5);
+    }
+    return le;
+}
+
+// Builds a bucket of any size without holding its entries in memory: entries
+// go to fresh buckets of BATCH_SIZE entries, which are merged like the digits
+// of a binary counter so that every entry goes through O(log(n)) merges.
+class BucketBuilder
+{
+    BucketManager& mBucketManager;
+    // mSlots[i] is empty or a bucket of about 2^i batches, newer buckets
+    // are in lower slots
+    std::vector<std::shared_ptr<Bucket>> mSlots;
+    std::vector<LedgerEntry> mLive;
+    std::vector<LedgerKey> mDead;
+
+    void
+    flush()
+    {
+        if (mLive.empty() && mDead.empty())
+        {
+            return;
+        }
+        auto start = Clock::now();
+        auto b = Bucket::fresh(mBucketManager, mLive, mDead);
+        mFreshTime += Clock::now() - start;
+        mFreshEntries += mLive.size() + mDead.size();
+        mLive.clear();
+        mDead.clear();
+
+        size_t i = 0;
+        for (; i < mSlots.size() && mSlots[i]; ++i)
+        {
+            b = Bucket::merge(mBucketManager, mSlots[i], b);
+            mSlots[i].reset();
+        }
+        if (i == mSlots.size())
+        {
+            mSlots.emplace_back();
+        }
+        mSlots[i] = b;
+    }
+
+  public:
+    Clock::duration mFreshTime{0};
+    size_t mFreshEntries{0};
+
+    explicit BucketBuilder(BucketManager& bm) : mBucketManager(bm)
+    {
+    }
+
+    void
+    addLive(LedgerEntry const& e)
+    {
+        mLive.emplace_back(e);
+        if (mLive.size() + mDead.size() >= BATCH_SIZE)
+        {
+            flush();
+        }
+    }
+
+    void
+    addDead(LedgerKey const& k)
+    {
+        mDead.emplace_back(k);
+        if (mLive.size() + mDead.size() >= BATCH_SIZE)
+        {
+            flush();
+        }
+    }
+
+    std::shared_ptr<Bucket>
+    finish()
+    {
+        flush();
+        std::shared_ptr<Bucket> res = std::make_shared<Bucket>();
+        for (auto const& b : mSlots)
+        {
+            if (b)
+            {
+                res = Bucket::merge(mBucketManager, b, res);
+            }
+        }
+        mSlots.clear();
+        return res;
+    }
+};
+
+size_t
+countEntries(std::shared_ptr<Bucket> const& b)
+{
+    auto counts = b->countLiveAndDeadEntries();
+    return counts.first + counts.second;
+}
+
+// the buckets merged by the benchmarks
+struct MergeInputs
+{
+    std::shared_ptr<Bucket> mOld;
+    std::shared_ptr<Bucket> mNew;
+    std::shared_ptr<Bucket> mShadow;
+    // of writing the older bucket to fresh buckets
+    double mFreshRate;
+};
+
+MergeInputs
+makeMergeInputs(BucketManager& bm, size_t n)
+{
+    CLOG(INFO, "Bucket") << "Generating bucket of " << n << " entries";
+    BucketBuilder oldBuilder(bm);
+    for (size_t i = 0; i < n; ++i)
+    {
+        oldBuilder.addLive(generateEntry());
+    }
+    auto oldBucket = oldBuilder.finish();
+
+    // The newer bucket updates one in 8 entries of the older one and
+    // deletes one in 64, as many brand new entries as updates are added
+    // to it. The shadow holds one in 16 of the older entries.
+    BucketBuilder newBuilder(bm);
+    BucketBuilder shadowBuilder(bm);
+    size_t i = 0;
+    for (BucketInputIterator in(oldBucket); in; ++in, ++i)
+    {
+        auto const& e = (*in).liveEntry();
+        if (i % 8 == 0)
+        {
+            auto updated = e;
+            updated.lastModifiedLedgerSeq++;
+            newBuilder.addLive(updated);
+            newBuilder.addLive(generateEntry());
+        }
+        else if (i % 64 == 1)
+        {
+            newBuilder.addDead(LedgerEntryKey(e));
+        }
+        if (i % 16 == 2)
+        {
+            shadowBuilder.addLive(e);
+        }
+    }
+    return {oldBucket, newBuilder.finish(), shadowBuilder.finish(),
+            entriesPerSecond(oldBuilder.mFreshEntries, oldBuilder.mFreshTime)};
+}
+
+void
+runMergeBench(std::vector<size_t> const& sizes)
+{
+    ScaleReporter r({"entries", "freshrate", "mergerate", "shadowmergerate",
+                     "applyrate"});
+
+    for (auto n : sizes)
+    {
+        VirtualClock clock;
+        Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        auto& bm = app->getBucketManager();
+
+        auto inputs = makeMergeInputs(bm, n);
+        auto oldBucket = inputs.mOld;
+        auto newBucket = inputs.mNew;
+        auto shadow = inputs.mShadow;
+        auto mergedEntries = countEntries(oldBucket) + countEntries(newBucket);
+
+        CLOG(INFO, "Bucket") << "Merging " << mergedEntries << " entries";
+        auto start = Clock::now();
+        Bucket::merge(bm, oldBucket, newBucket);
+        auto mergeTime = Clock::now() - start;
+
+        start = Clock::now();
+        Bucket::merge(bm, oldBucket, newBucket, {shadow});
+        auto shadowMergeTime = Clock::now() - start;
+
+        auto appliedEntries = countEntries(newBucket);
+        CLOG(INFO, "Bucket") << "Applying " << appliedEntries << " entries";
+        start = Clock::now();
+        newBucket->apply(app->getDatabase());
+        auto applyTime = Clock::now() - start;
+
+        r.write({static_cast<double>(n), inputs.mFreshRate,
+                 entriesPerSecond(mergedEntries, mergeTime),
+                 entriesPerSecond(mergedEntries, shadowMergeTime),
+                 entriesPerSecond(appliedEntries, applyTime)});
+    }
+}
+}
+
+TEST_CASE("bucket merge bench", "[bucketbench][!hide]")
+{
+    runMergeBench({10000, 100000, 1000000});
+}
+
+TEST_CASE("large bucket merge bench", "[bucketbench][long][!hide]")
+{
+    runMergeBench({10000000, 50000000});
+}
+
+TEST_CASE("bucket merge perf", "[bucketbench][perf][!hide]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    auto& bm = app->getBucketManager();
+
+    auto inputs = makeMergeInputs(bm, 100000);
+    auto mergedEntries = countEntries(inputs.mOld) + countEntries(inputs.mNew);
+    auto mergeRate = [&](std::vector<std::shared_ptr<Bucket>> const& shadows) {
+        auto start = Clock::now();
+        Bucket::merge(bm, inputs.mOld, inputs.mNew, shadows);
+        return entriesPerSecond(mergedEntries, Clock::now() - start);
+    };
+    measurePerf("bucket.merge", "entries/s", PerfDirection::HIGHER_IS_BETTER,
+                [&]() { return mergeRate({}); });
+    measurePerf("bucket.merge.shadowed", "entries/s",
+                PerfDirection::HIGHER_IS_BETTER,
+                [&]() { return mergeRate({inputs.mShadow}); });
+}
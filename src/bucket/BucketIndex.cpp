@@ -0,0 +1,171 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketIndex.h"
+#include "bucket/LedgerCmp.h"
+#include "ledger/EntryFrame.h"
+#include "util/BloomFilter.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace stellar
+{
+
+namespace
+{
+LedgerKey
+bucketEntryKey(BucketEntry const& e)
+{
+    return e.type() == LIVEENTRY ? LedgerEntryKey(e.liveEntry())
+                                 : e.deadEntry();
+}
+}
+
+std::string
+BucketIndex::indexFilename(std::string const& bucketFilename)
+{
+    return bucketFilename + ".index";
+}
+
+uint64_t
+BucketIndex::keyHash(LedgerKey const& key)
+{
+    return BloomFilter::hash(xdr::xdr_to_opaque(key));
+}
+
+std::unique_ptr<BucketIndex>
+BucketIndex::build(std::string const& bucketFilename,
+                   std::vector<uint64_t>* keyHashes, SHA256* hasher)
+{
+    auto res = std::make_unique<BucketIndex>();
+    XDRInputFileStream in;
+    in.open(bucketFilename);
+    BucketEntry e;
+    for (size_t n = 0;; n++)
+    {
+        auto offset = in.pos();
+        if (!in.readOne(e, hasher))
+        {
+            break;
+        }
+        if (n % STRIDE == 0 || keyHashes)
+        {
+            auto key = bucketEntryKey(e);
+            if (keyHashes)
+            {
+                keyHashes->push_back(keyHash(key));
+            }
+            if (n % STRIDE == 0)
+            {
+                res->mEntries.emplace_back(key, offset);
+            }
+        }
+    }
+    return res;
+}
+
+std::unique_ptr<BucketIndex>
+BucketIndex::load(std::string const& bucketFilename)
+{
+    auto filename = indexFilename(bucketFilename);
+    if (!fs::exists(filename))
+    {
+        return nullptr;
+    }
+    try
+    {
+        auto res = std::make_unique<BucketIndex>();
+        XDRInputFileStream in;
+        in.open(filename);
+        LedgerKey key;
+        uint64_t offset;
+        while (in.readOne(key))
+        {
+            if (!in.readOne(offset))
+            {
+                throw std::runtime_error("truncated bucket index");
+            }
+            res->mEntries.emplace_back(key, offset);
+        }
+        return res;
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket") << "Ignoring bucket index " << filename << ": "
+                                << e.what();
+        return nullptr;
+    }
+}
+
+void
+BucketIndex::save(std::string const& bucketFilename) const
+{
+    // written under a temporary name, so that a crash never leaves a partial
+    // index behind
+    auto filename = indexFilename(bucketFilename);
+    auto tmpFilename = filename + ".tmp";
+    {
+        XDROutputFileStream out(true);
+        out.open(tmpFilename);
+        for (auto const& e : mEntries)
+        {
+            out.writeOne(e.first);
+            out.writeOne(e.second);
+        }
+    }
+    if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0)
+    {
+        CLOG(WARNING, "Bucket") << "Failed to save bucket index " << filename;
+        std::remove(tmpFilename.c_str());
+    }
+}
+
+void
+BucketIndex::append(LedgerKey const& key, uint64_t offset)
+{
+    mEntries.emplace_back(key, offset);
+}
+
+bool
+BucketIndex::lookup(LedgerKey const& key, uint64_t& offset) const
+{
+    // first indexed key strictly greater than `key`: the entry before it is
+    // the last indexed key not greater than `key`
+    LedgerEntryIdCmp cmp;
+    auto it = std::upper_bound(
+        mEntries.begin(), mEntries.end(), key,
+        [&](LedgerKey const& k, std::pair<LedgerKey, uint64_t> const& e) {
+            return cmp(k, e.first);
+        });
+    if (it == mEntries.begin())
+    {
+        return false;
+    }
+    offset = (--it)->second;
+    return true;
+}
+
+LedgerKey const&
+BucketIndex::firstKey() const
+{
+    return mEntries.front().first;
+}
+
+uint64_t
+BucketIndex::lastOffset() const
+{
+    return mEntries.back().second;
+}
+
+size_t
+BucketIndex::size() const
+{
+    return mEntries.size();
+}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Sparse index over the (sorted) entries of a bucket file: the key and file
+ * offset of every STRIDE-th entry. Finding a key then takes a binary search
+ * in memory followed by reading at most STRIDE entries from the file.
+ *
+ * Indexes are persisted next to their bucket, in `indexFilename(bucket)`, as
+ * a sequence of XDR (LedgerKey, offset) pairs. As a bucket file never changes
+ * once adopted, an index file found on disk is always valid for it.
+ */
+class SHA256;
+
+class BucketIndex : NonCopyable
+{
+    std::vector<std::pair<LedgerKey, uint64_t>> mEntries;
+
+  public:
+    static size_t const STRIDE = 256;
+
+    static std::string indexFilename(std::string const& bucketFilename);
+
+    // Hash of `key` for the bucket key filters, see BloomFilter.
+    static uint64_t keyHash(LedgerKey const& key);
+
+    // Scan `bucketFilename` to build its index. When `keyHashes` is provided,
+    // the keyHash of every entry is appended to it along the way, and when
+    // `hasher` is, the contents of the file are added to it.
+    static std::unique_ptr<BucketIndex>
+    build(std::string const& bucketFilename,
+          std::vector<uint64_t>* keyHashes = nullptr,
+          SHA256* hasher = nullptr);
+
+    // Load the index persisted for `bucketFilename`, returns nullptr if there
+    // is none or it cannot be read.
+    static std::unique_ptr<BucketIndex>
+    load(std::string const& bucketFilename);
+
+    // Persist the index of `bucketFilename`.
+    void save(std::string const& bucketFilename) const;
+
+    // Index the entry of `key` at `offset`, for indexes built while writing
+    // the bucket file: called for every STRIDE-th entry, in order.
+    void append(LedgerKey const& key, uint64_t offset);
+
+    // Set `offset` to where a scan for `key` has to start. Returns false if
+    // `key` sorts before every entry of the bucket.
+    bool lookup(LedgerKey const& key, uint64_t& offset) const;
+
+    // The key of the first entry of the bucket, and the offset of the last
+    // indexed one: the last entry of the bucket is at most STRIDE entries
+    // after it. Only for non-empty indexes.
+    LedgerKey const& firstKey() const;
+    uint64_t lastOffset() const;
+
+    size_t size() const;
+};
+}
@@ -5,8 +5,14 @@
 #include "bucket/BucketInputIterator.h"
 #include "bucket/Bucket.h"
 
+#include <algorithm>
+
 namespace stellar
 {
+
+// Bucket files are large and only ever read sequentially.
+static size_t const BUCKET_READ_BUFFER_SIZE = 2 * 1024 * 1024;
+
 /**
  * Helper class that reads from the file underlying a bucket, keeping the bucket
  * alive for the duration of its existence.
@@ -14,7 +20,11 @@ namespace stellar
 void
 BucketInputIterator::loadEntry()
 {
-    if (mIn.readOne(mEntry))
+    if (mEntries)
+    {
+        mEntryPtr = mNext < mEntries->size() ? &(*mEntries)[mNext++] : nullptr;
+    }
+    else if (mIn.readOne(mEntry))
     {
         mEntryPtr = &mEntry;
     }
@@ -22,6 +32,10 @@ BucketInputIterator::loadEntry()
     {
         mEntryPtr = nullptr;
     }
+    if (mEntryPtr)
+    {
+        mKey = BucketEntrySortKey(*mEntryPtr);
+    }
 }
 
 BucketInputIterator::operator bool() const
@@ -35,9 +49,17 @@ BucketEntry const& BucketInputIterator::operator*()
 }
 
 BucketInputIterator::BucketInputIterator(std::shared_ptr<Bucket const> bucket)
-    : mBucket(bucket), mEntryPtr(nullptr)
+    : mBucket(bucket)
+    , mEntryPtr(nullptr)
+    , mIn(0, bucket->isInMemory() ? 0 : BUCKET_READ_BUFFER_SIZE)
+    , mEntries(bucket->getEntries().get())
+    , mNext(0)
 {
-    if (!mBucket->getFilename().empty())
+    if (mEntries)
+    {
+        loadEntry();
+    }
+    else if (!mBucket->getFilename().empty())
     {
         CLOG(TRACE, "Bucket") << "BucketInputIterator opening file to read: "
                               << mBucket->getFilename();
@@ -53,7 +75,7 @@ BucketInputIterator::~BucketInputIterator()
 
 BucketInputIterator& BucketInputIterator::operator++()
 {
-    if (mIn)
+    if (mEntries || mIn)
     {
         loadEntry();
     }
@@ -63,4 +85,37 @@ BucketInputIterator& BucketInputIterator::operator++()
     }
     return *this;
 }
+
+void
+BucketInputIterator::seek(LedgerKey const& key)
+{
+    if (!mEntryPtr)
+    {
+        return;
+    }
+    BucketEntry target;
+    target.type(DEADENTRY);
+    target.deadEntry() = key;
+    BucketEntryIdCmp cmp;
+    if (mEntries)
+    {
+        mNext = std::lower_bound(mEntries->begin(), mEntries->end(), target,
+                                 cmp) -
+                mEntries->begin();
+        loadEntry();
+        return;
+    }
+    mIn.seek(mBucket->getScanOffset(key));
+    loadEntry();
+    while (mEntryPtr && cmp(*mEntryPtr, target))
+    {
+        ++(*this);
+    }
+}
+
+uint64_t
+BucketInputIterator::pos()
+{
+    return mBucket->getFilename().empty() ? 0 : mIn.pos();
+}
 }
@@ -9,6 +9,7 @@
 #include "xdr/Stellar-ledger.h"
 
 #include <memory>
+#include <vector>
 
 namespace stellar
 {
@@ -27,6 +28,13 @@ class BucketInputIterator
     XDRInputFileStream mIn;
     BucketEntry mEntry;
 
+    // The entries of a bucket kept in memory, and the next one to load.
+    std::vector<BucketEntry> const* mEntries;
+    size_t mNext;
+
+    // of the current entry
+    BucketEntrySortKey mKey;
+
     void loadEntry();
 
   public:
@@ -34,10 +42,24 @@ class BucketInputIterator
 
     BucketEntry const& operator*();
 
+    BucketEntrySortKey const&
+    sortKey() const
+    {
+        return mKey;
+    }
+
     BucketInputIterator(std::shared_ptr<Bucket const> bucket);
 
     ~BucketInputIterator();
 
     BucketInputIterator& operator++();
+
+    // Skip to the first entry whose key is not before `key`, using the
+    // bucket's index to avoid reading the file from the start.
+    void seek(LedgerKey const& key);
+
+    // Offset in the bucket file of the entry after the current one, 0 for a
+    // bucket kept in memory.
+    uint64_t pos();
 };
 }
@@ -9,7 +9,9 @@
 #include "crypto/Hex.h"
 #include "crypto/Random.h"
 #include "crypto/SHA.h"
+#include "ledger/LedgerManager.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "util/Logging.h"
 #include "util/XDRStream.h"
 #include "util/types.h"
@@ -23,15 +25,22 @@ BucketLevel::BucketLevel(uint32_t i)
     , mCurr(std::make_shared<Bucket>())
     , mSnap(std::make_shared<Bucket>())
 {
+    rehash();
 }
 
-uint256
-BucketLevel::getHash() const
+void
+BucketLevel::rehash()
 {
     auto hsh = SHA256::create();
     hsh->add(mCurr->getHash());
     hsh->add(mSnap->getHash());
-    return hsh->finish();
+    mHash = hsh->finish();
+}
+
+uint256 const&
+BucketLevel::getHash() const
+{
+    return mHash;
 }
 
 FutureBucket const&
@@ -69,12 +78,14 @@ BucketLevel::setCurr(std::shared_ptr<Bucket> b)
 {
     mNextCurr.clear();
     mCurr = b;
+    rehash();
 }
 
 void
 BucketLevel::setSnap(std::shared_ptr<Bucket> b)
 {
     mSnap = b;
+    rehash();
 }
 
 void
@@ -120,7 +131,8 @@ BucketLevel::prepare(Application& app, uint32_t currLedger,
     }
 
     mNextCurr = FutureBucket(app, curr, snap, shadows,
-                             BucketList::keepDeadEntries(mLevel));
+                             BucketList::keepDeadEntries(mLevel),
+                             BucketList::mergePriority(currLedger, mLevel));
     assert(mNextCurr.isMerging());
 }
 
@@ -129,6 +141,7 @@ BucketLevel::snap()
 {
     mSnap = mCurr;
     mCurr = std::make_shared<Bucket>();
+    rehash();
     // CLOG(DEBUG, "Bucket") << "level " << mLevel << " set mSnap to "
     //            << mSnap->getEntries().size() << " elements";
     // CLOG(DEBUG, "Bucket") << "level " << mLevel << " reset mCurr to "
@@ -283,15 +296,43 @@ BucketList::oldestLedgerInSnap(uint32_t ledger, uint32_t level)
     return count + 1;
 }
 
-uint256
+Hash const&
 BucketList::getHash() const
 {
-    auto hsh = SHA256::create();
+    bool dirty = mHashedLevels.size() != mLevels.size();
+    for (size_t i = 0; !dirty && i < mLevels.size(); ++i)
+    {
+        dirty = mHashedLevels[i] != mLevels[i].getHash();
+    }
+    if (dirty)
+    {
+        mHashedLevels.clear();
+        auto hsh = SHA256::create();
+        for (auto const& lev : mLevels)
+        {
+            mHashedLevels.emplace_back(lev.getHash());
+            hsh->add(lev.getHash());
+        }
+        mHash = hsh->finish();
+    }
+    return mHash;
+}
+
+std::shared_ptr<BucketEntry>
+BucketList::getBucketEntry(LedgerKey const& key) const
+{
     for (auto const& lev : mLevels)
     {
-        hsh->add(lev.getHash());
+        for (auto const& b : {lev.getCurr(), lev.getSnap()})
+        {
+            auto e = b->getBucketEntry(key);
+            if (e)
+            {
+                return e;
+            }
+        }
     }
-    return hsh->finish();
+    return nullptr;
 }
 
 bool
@@ -313,6 +354,24 @@ BucketList::keepDeadEntries(uint32_t level)
     return level < BucketList::kNumLevels - 1;
 }
 
+bool
+BucketList::keepInMemory(Application& app, uint32_t level)
+{
+    return app.getConfig().IN_MEMORY_SHALLOW_BUCKETS &&
+           level < BucketList::kInMemoryLevels;
+}
+
+MergePriority
+BucketList::mergePriority(uint32_t currLedger, uint32_t level)
+{
+    if (level == 0)
+    {
+        return MergePriority{level, currLedger};
+    }
+    return MergePriority{level,
+                         currLedger + BucketList::levelHalf(level - 1)};
+}
+
 BucketLevel const&
 BucketList::getLevel(uint32_t i) const
 {
@@ -329,6 +388,16 @@ void
 BucketList::addBatch(Application& app, uint32_t currLedger,
                      std::vector<LedgerEntry> const& liveEntries,
                      std::vector<LedgerKey> const& deadEntries)
+{
+    addBatch(app, currLedger, [&app, &liveEntries, &deadEntries]() {
+        return Bucket::fresh(app.getBucketManager(), liveEntries, deadEntries,
+                             keepInMemory(app, 0));
+    });
+}
+
+void
+BucketList::addBatch(Application& app, uint32_t currLedger,
+                     std::function<std::shared_ptr<Bucket>()> const& fresh)
 {
     assert(currLedger > 0);
 
@@ -415,23 +484,22 @@ BucketList::addBatch(Application& app, uint32_t currLedger,
     }
 
     assert(shadows.size() == 0);
-    mLevels[0].prepare(
-        app, currLedger,
-        Bucket::fresh(app.getBucketManager(), liveEntries, deadEntries),
-        shadows);
+    mLevels[0].prepare(app, currLedger, fresh(), shadows);
     mLevels[0].commit();
 }
 
 void
 BucketList::restartMerges(Application& app)
 {
+    auto lcl = app.getLedgerManager().getLastClosedLedgerNum();
     for (uint32_t i = 0; i < static_cast<uint32>(mLevels.size()); i++)
     {
         auto& level = mLevels[i];
         auto& next = level.getNext();
         if (next.hasHashes() && !next.isLive())
         {
-            next.makeLive(app, keepDeadEntries(i));
+            next.makeLive(app, keepDeadEntries(i),
+                          mergePriority(lcl, i));
             if (next.isMerging())
             {
                 CLOG(INFO, "Bucket")
@@ -7,6 +7,7 @@
 #include "bucket/FutureBucket.h"
 #include "overlay/StellarXDR.h"
 #include "xdrpp/message.h"
+#include <functional>
 #include <future>
 
 namespace stellar
@@ -247,10 +248,14 @@ class BucketLevel
     FutureBucket mNextCurr;
     std::shared_ptr<Bucket> mCurr;
     std::shared_ptr<Bucket> mSnap;
+    // hash of (curr, snap), recomputed whenever either of them changes
+    uint256 mHash;
+
+    void rehash();
 
   public:
     BucketLevel(uint32_t i);
-    uint256 getHash() const;
+    uint256 const& getHash() const;
     FutureBucket const& getNext() const;
     FutureBucket& getNext();
     std::shared_ptr<Bucket> getCurr() const;
@@ -289,6 +294,11 @@ class BucketList
     static uint32_t mask(uint32_t v, uint32_t m);
     std::vector<BucketLevel> mLevels;
 
+    // Level hashes mHash was last computed from; getHash only rehashes when
+    // one of them changed.
+    mutable std::vector<uint256> mHashedLevels;
+    mutable Hash mHash;
+
   public:
     // Number of bucket levels in the bucketlist. Every bucketlist in the system
     // will have this many levels and it effectively gets wired-in to the
@@ -324,6 +334,16 @@ class BucketList
     // Returns true if at given `level` dead entries should be kept.
     static bool keepDeadEntries(uint32_t level);
 
+    // Levels whose buckets are kept in memory with IN_MEMORY_SHALLOW_BUCKETS
+    // (merges into them produce buckets kept in memory).
+    static uint32_t const kInMemoryLevels = 2;
+    static bool keepInMemory(Application& app, uint32_t level);
+
+    // Returns the scheduling priority of a merge into `level` started at
+    // `currLedger`: its deadline is the next ledger at which level - 1
+    // spills, when the merge is committed.
+    static MergePriority mergePriority(uint32_t currLedger, uint32_t level);
+
     // Create a new BucketList with every `kNumLevels` levels, each with
     // an empty bucket in `curr` and `snap`.
     BucketList();
@@ -337,7 +357,14 @@ class BucketList
     // Return a cumulative hash of the entire bucketlist; this is the hash of
     // the concatenation of each level's hash, each of which in turn is the hash
     // of the concatenation of the hashes of the `curr` and `snap` buckets.
-    Hash getHash() const;
+    // Level hashes are cached, and the cumulative hash is only recomputed
+    // when a level changed since the last call.
+    Hash const& getHash() const;
+
+    // Return the newest entry (live or dead) for `key` across the curr and
+    // snap buckets of every level, or nullptr if no bucket has one. Most
+    // buckets not containing `key` are skipped by their key filter.
+    std::shared_ptr<BucketEntry> getBucketEntry(LedgerKey const& key) const;
 
     // Restart any merges that might be running on background worker threads,
     // merging buckets between levels. This needs to be called after forcing a
@@ -353,5 +380,10 @@ class BucketList
     void addBatch(Application& app, uint32_t currLedger,
                   std::vector<LedgerEntry> const& liveEntries,
                   std::vector<LedgerKey> const& deadEntries);
+
+    // Same, with the level 0 bucket of the batch obtained from `fresh`, which
+    // is only called once the levels that spill have been handled.
+    void addBatch(Application& app, uint32_t currLedger,
+                  std::function<std::shared_ptr<Bucket>()> const& fresh);
 };
 }
@@ -7,18 +7,33 @@
 #include "bucket/Bucket.h"
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
+#include <future>
 #include <memory>
 
 #include "medida/timer_context.h"
 
+namespace medida
+{
+class Meter;
+}
+
 namespace stellar
 {
 
 class Application;
 class BucketList;
+class BucketMergeScheduler;
 struct LedgerHeader;
 struct HistoryArchiveState;
 
+// Throughput of each stage of a pipelined bucket merge, see Bucket::merge.
+struct MergeStageMeters
+{
+    medida::Meter& mRead;  // entries read from the inputs
+    medida::Meter& mMerge; // entries merged
+    medida::Meter& mWrite; // bytes hashed and written
+};
+
 /**
  * BucketManager is responsible for maintaining a collection of Buckets of
  * ledger entries (each sorted, de-duplicated and identified by hash) and,
@@ -47,6 +62,12 @@ class BucketManager : NonMovableOrCopyable
     static std::unique_ptr<BucketManager> create(Application&);
     static void dropAll(Application& app);
 
+    // Reads the local state saved in @p bucketDir by storeLocalState, returns
+    // false if there is none or if it is inconsistent.
+    static bool loadLocalState(std::string const& bucketDir,
+                               HistoryArchiveState& has,
+                               LedgerHeaderHistoryEntry& lcl);
+
     virtual ~BucketManager()
     {
     }
@@ -55,6 +76,11 @@ class BucketManager : NonMovableOrCopyable
     virtual BucketList& getBucketList() = 0;
 
     virtual medida::Timer& getMergeTimer() = 0;
+    virtual MergeStageMeters& getMergeStageMeters() = 0;
+
+    // Every merge of the BucketList goes through this scheduler; see
+    // FutureBucket.
+    virtual BucketMergeScheduler& getMergeScheduler() = 0;
 
     // Get a reference to a persistent bucket (in the BucketManager's bucket
     // directory), from the BucketManager's shared bucket-set.
@@ -71,6 +97,21 @@ class BucketManager : NonMovableOrCopyable
     adoptFileAsBucket(std::string const& filename, uint256 const& hash,
                       size_t nObjects = 0, size_t nBytes = 0) = 0;
 
+    // Same for a bucket kept in memory (see IN_MEMORY_SHALLOW_BUCKETS): if
+    // `hash` names an existing bucket return it, otherwise a new bucket
+    // holding `entries`, which serialize to `nBytes` bytes. Threadsafe as
+    // well.
+    virtual std::shared_ptr<Bucket> adoptEntriesAsBucket(
+        uint256 const& hash,
+        std::shared_ptr<std::vector<BucketEntry> const> entries,
+        size_t nBytes) = 0;
+
+    // Write the buckets named by `hashes` (in hex) that are kept in memory to
+    // the bucket directory, as adoptFileAsBucket does, for them to be
+    // published or found at the next start.
+    virtual void
+    materializeBuckets(std::vector<std::string> const& hashes) = 0;
+
     // Return a bucket by hash if we have it, else return nullptr.
     virtual std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) = 0;
 
@@ -78,13 +119,35 @@ class BucketManager : NonMovableOrCopyable
     // not immediately cause the buckets to delete themselves, if someone else
     // is using them via a shared_ptr<>, but the BucketManager will no longer
     // independently keep them alive.
+    //
+    // Only the buckets created since the last call, and the ones the
+    // BucketList stopped referencing, are looked at, along with the ones
+    // reported by bucketsReleased.
     virtual void forgetUnreferencedBuckets() = 0;
 
+    // Called when the buckets of `hashes` (in hex) stop being referenced by
+    // something else than the BucketList (a state in the publish queue), for
+    // forgetUnreferencedBuckets to look at them again.
+    virtual void bucketsReleased(std::vector<std::string> const& hashes) = 0;
+
     // Feed a new batch of entries to the bucket list.
     virtual void addBatch(Application& app, uint32_t currLedger,
                           std::vector<LedgerEntry> const& liveEntries,
                           std::vector<LedgerKey> const& deadEntries) = 0;
 
+    // Start building, on a thread of its own, the fresh bucket of a batch of
+    // entries: it does not depend on the bucket list, so it can be sorted,
+    // hashed and written while the ledger is still being committed ...
+    virtual std::shared_future<std::shared_ptr<Bucket>>
+    startFreshBucket(std::vector<LedgerEntry> liveEntries,
+                     std::vector<LedgerKey> deadEntries) = 0;
+
+    // ... and feed it to the bucket list: the levels that spill are handled
+    // first, it is only waited for when added to level 0.
+    virtual void
+    addBatch(Application& app, uint32_t currLedger,
+             std::shared_future<std::shared_ptr<Bucket>> fresh) = 0;
+
     // Update the given LedgerHeader's bucketListHash to reflect the current
     // state of the bucket list.
     virtual void snapshotLedger(LedgerHeader& currentHeader) = 0;
@@ -94,10 +157,30 @@ class BucketManager : NonMovableOrCopyable
     virtual std::vector<std::string>
     checkForMissingBucketsFiles(HistoryArchiveState const& has) = 0;
 
+    // Start checking the hashes of the files of the buckets of `has` that are
+    // in the bucket directory, in parallel on the history I/O workers. The
+    // result gets the hashes of the ones that do not match, whose files are
+    // then removed (so that they count as missing); the others are loaded,
+    // with the index built while checking them.
+    virtual std::future<std::vector<std::string>>
+    verifyBucketFiles(HistoryArchiveState const& has) = 0;
+
+    // Remove the file of a bucket found not to match its hash, with its
+    // index and its link in the shared store, so that it counts as missing
+    // and is downloaded again; the bucket itself is kept, and gets the new
+    // file once adopted. Safe to call from any thread.
+    virtual void removeCorruptBucketFile(std::string const& bucketHexHash) = 0;
+
     // Restart from a saved state: find and attach all buckets in `has`, set
     // current BL.
     virtual void assumeState(HistoryArchiveState const& has) = 0;
 
+    // Saves @p has and the matching @p lcl along with the buckets, so that
+    // ledger state can be restored from the bucket directory alone, should
+    // the database be lost (see restoreFromBuckets).
+    virtual void storeLocalState(HistoryArchiveState const& has,
+                                 LedgerHeaderHistoryEntry const& lcl) = 0;
+
     // Ensure all needed buckets are retained
     virtual void shutdown() = 0;
 };
@@ -3,20 +3,34 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "bucket/BucketManagerImpl.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketList.h"
+#include "bucket/BucketMergeScheduler.h"
+#include "bucket/BucketOutputIterator.h"
 #include "crypto/Hex.h"
+#include "crypto/Random.h"
+#include "crypto/SHA.h"
+#include "history/HistoryArchive.h"
 #include "history/HistoryManager.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/StellarXDR.h"
+#include "util/BloomFilter.h"
 #include "util/Fs.h"
+#include "util/Gzip.h"
 #include "util/Logging.h"
 #include "util/TmpDir.h"
+#include "util/XDRStream.h"
 #include "util/types.h"
+#include "xdrpp/marshal.h"
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 #include <map>
 #include <regex>
 #include <set>
+#include <thread>
 
 #include "medida/counter.h"
 #include "medida/meter.h"
@@ -61,7 +75,20 @@ BucketManagerImpl::BucketManagerImpl(Application& app)
     , mBucketByteInsert(
           app.getMetrics().NewMeter({"bucket", "byte", "insert"}, "byte"))
     , mBucketAddBatch(app.getMetrics().NewTimer({"bucket", "batch", "add"}))
+    , mBucketFreshWait(
+          app.getMetrics().NewTimer({"bucket", "batch", "fresh-wait"}))
+    , mBucketMaterialize(app.getMetrics().NewMeter(
+          {"bucket", "memory", "materialize"}, "bucket"))
     , mBucketSnapMerge(app.getMetrics().NewTimer({"bucket", "snap", "merge"}))
+    , mMergeStageMeters{
+          app.getMetrics().NewMeter({"bucket", "merge", "read"}, "entry"),
+          app.getMetrics().NewMeter({"bucket", "merge", "merge"}, "entry"),
+          app.getMetrics().NewMeter({"bucket", "merge", "write"}, "byte")}
+    , mMergeScheduler(std::make_unique<BucketMergeScheduler>(
+          app, std::thread::hardware_concurrency(),
+          app.getConfig().MAX_CONCURRENT_DEEP_BUCKET_MERGES,
+          uint64_t(app.getConfig().DEEP_BUCKET_MERGE_WRITE_RATE_MB) * 1024 *
+              1024))
     , mSharedBucketsSize(
           app.getMetrics().NewCounter({"bucket", "memory", "shared"}))
 
@@ -72,6 +99,10 @@ const std::string BucketManagerImpl::kLockFilename = "stellar-core.lock";
 
 namespace
 {
+// the state of the last closed ledger, see storeLocalState
+std::string const kLocalHASFilename = "last-closed-ledger.json";
+std::string const kLocalHeaderFilename = "last-closed-ledger.xdr";
+
 std::string
 bucketBasename(std::string const& bucketHexHash)
 {
@@ -81,7 +112,8 @@ bucketBasename(std::string const& bucketHexHash)
 bool
 isBucketFile(std::string const& name)
 {
-    static std::regex re("^bucket-[a-z0-9]{64}\\.xdr(\\.gz)?$");
+    static std::regex re(
+        "^bucket-[a-z0-9]{64}\\.xdr(\\.gz|\\.index(\\.tmp)?)?$");
     return std::regex_match(name, re);
 };
 
@@ -90,6 +122,12 @@ extractFromFilename(std::string const& name)
 {
     return hexToBin256(name.substr(7, 64));
 };
+
+bool
+hasBucketFile(std::shared_ptr<Bucket> const& b)
+{
+    return b && !b->isInMemory() && fs::exists(b->getFilename());
+}
 }
 
 std::string
@@ -105,6 +143,61 @@ BucketManagerImpl::bucketFilename(Hash const& hash)
     return bucketFilename(binToHex(hash));
 }
 
+std::string
+BucketManagerImpl::sharedBucketFilename(std::string const& bucketHexHash)
+{
+    auto const& dir = mApp.getConfig().SHARED_BUCKET_DIR_PATH;
+    if (dir.empty())
+    {
+        return std::string();
+    }
+    return dir + "/" + bucketBasename(bucketHexHash);
+}
+
+void
+BucketManagerImpl::addToSharedStore(std::string const& filename,
+                                    Hash const& hash)
+{
+    auto shared = sharedBucketFilename(binToHex(hash));
+    if (shared.empty() || fs::exists(shared))
+    {
+        return;
+    }
+    auto const& dir = mApp.getConfig().SHARED_BUCKET_DIR_PATH;
+    if (!fs::exists(dir))
+    {
+        fs::mkpath(dir);
+    }
+    // link under a temporary name first so that other instances never see a
+    // partial file; a failure only means this bucket is not shared
+    auto tmp = shared + "." + std::to_string(fs::getCurrentPid()) + ".tmp";
+    if (fs::hardLink(filename, tmp))
+    {
+        if (std::rename(tmp.c_str(), shared.c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+        }
+    }
+}
+
+bool
+BucketManagerImpl::linkFromSharedStore(std::string const& bucketHexHash)
+{
+    auto shared = sharedBucketFilename(bucketHexHash);
+    if (shared.empty() || !fs::exists(shared))
+    {
+        return false;
+    }
+    auto canonicalName = bucketFilename(bucketHexHash);
+    if (fs::hardLink(shared, canonicalName))
+    {
+        CLOG(DEBUG, "Bucket") << "Linked bucket file " << canonicalName
+                              << " from shared store";
+        return true;
+    }
+    return fs::exists(canonicalName);
+}
+
 std::string const&
 BucketManagerImpl::getTmpDir()
 {
@@ -159,19 +252,69 @@ BucketManagerImpl::getMergeTimer()
     return mBucketSnapMerge;
 }
 
+MergeStageMeters&
+BucketManagerImpl::getMergeStageMeters()
+{
+    return mMergeStageMeters;
+}
+
+BucketMergeScheduler&
+BucketManagerImpl::getMergeScheduler()
+{
+    return *mMergeScheduler;
+}
+
+std::string
+BucketManagerImpl::compressBucketFile(std::string const& filename)
+{
+    // in the tmp dir, not left behind by a crash
+    auto compressed = getTmpDir() + "/" + binToHex(randomBytes(8)) + ".blocks";
+    try
+    {
+        gz::compressBlockFile(filename, compressed);
+    }
+    catch (std::exception& e)
+    {
+        CLOG(WARNING, "Bucket") << "Keeping bucket file " << filename
+                                << " uncompressed: " << e.what();
+        std::remove(compressed.c_str());
+        return filename;
+    }
+    std::remove(filename.c_str());
+    return compressed;
+}
+
 std::shared_ptr<Bucket>
 BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
                                      uint256 const& hash, size_t nObjects,
                                      size_t nBytes)
 {
+    std::string source = filename;
+    if (mApp.getConfig().COMPRESS_BUCKET_FILES && !gz::isBlockFile(filename))
+    {
+        // not under the lock, which merges and ledger close need
+        bool exists;
+        {
+            std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+            auto b = getBucketByHash(hash);
+            exists = hasBucketFile(b);
+        }
+        if (!exists)
+        {
+            source = compressBucketFile(filename);
+        }
+    }
+
     std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
     // Check to see if we have an existing bucket (either in-memory or on-disk)
+    // with a file: a bucket kept in memory is replaced by the file, one whose
+    // file was removed as corrupt gets this one
     std::shared_ptr<Bucket> b = getBucketByHash(hash);
-    if (b)
+    if (hasBucketFile(b))
     {
-        CLOG(DEBUG, "Bucket") << "Deleting bucket file " << filename
+        CLOG(DEBUG, "Bucket") << "Deleting bucket file " << source
                               << " that is redundant with existing bucket";
-        std::remove(filename.c_str());
+        std::remove(source.c_str());
     }
     else
     {
@@ -179,31 +322,82 @@ BucketManagerImpl::adoptFileAsBucket(std::string const& filename,
         mBucketByteInsert.Mark(nBytes);
         std::string canonicalName = bucketFilename(hash);
         CLOG(DEBUG, "Bucket")
-            << "Adopting bucket file " << filename << " as " << canonicalName;
-        if (rename(filename.c_str(), canonicalName.c_str()) != 0)
+            << "Adopting bucket file " << source << " as " << canonicalName;
+        if (rename(source.c_str(), canonicalName.c_str()) != 0)
         {
             std::string err("Failed to rename bucket :");
             err += strerror(errno);
             // it seems there is a race condition with external systems
             // retry after sleeping for a second works around the problem
             std::this_thread::sleep_for(std::chrono::seconds(1));
-            if (rename(filename.c_str(), canonicalName.c_str()) != 0)
+            if (rename(source.c_str(), canonicalName.c_str()) != 0)
             {
                 // if rename fails again, surface the original error
                 throw std::runtime_error(err);
             }
         }
 
-        b = std::make_shared<Bucket>(canonicalName, hash);
+        addToSharedStore(canonicalName, hash);
+
+        if (!b || b->isInMemory())
         {
-            mSharedBuckets.insert(std::make_pair(hash, b));
+            b = std::make_shared<Bucket>(canonicalName, hash);
+            mSharedBuckets[hash] = b;
             mSharedBucketsSize.set_count(mSharedBuckets.size());
+            mCollectCandidates.insert(hash);
         }
     }
     assert(b);
     return b;
 }
 
+std::shared_ptr<Bucket>
+BucketManagerImpl::adoptEntriesAsBucket(
+    uint256 const& hash,
+    std::shared_ptr<std::vector<BucketEntry> const> entries, size_t nBytes)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    std::shared_ptr<Bucket> b = getBucketByHash(hash);
+    if (!b)
+    {
+        CLOG(DEBUG, "Bucket") << "Keeping bucket " << hexAbbrev(hash)
+                              << " in memory";
+        b = std::make_shared<Bucket>(hash, entries, nBytes);
+        mSharedBuckets.insert(std::make_pair(hash, b));
+        mSharedBucketsSize.set_count(mSharedBuckets.size());
+        mCollectCandidates.insert(hash);
+    }
+    return b;
+}
+
+void
+BucketManagerImpl::materializeBuckets(std::vector<std::string> const& hashes)
+{
+    for (auto const& h : hashes)
+    {
+        std::shared_ptr<Bucket> b;
+        {
+            std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+            auto i = mSharedBuckets.find(hexToBin256(h));
+            if (i == mSharedBuckets.end() || !i->second->isInMemory())
+            {
+                continue;
+            }
+            b = i->second;
+        }
+        CLOG(DEBUG, "Bucket") << "Writing bucket " << hexAbbrev(b->getHash())
+                              << " kept in memory";
+        BucketOutputIterator out(getTmpDir(), true);
+        for (auto const& e : *b->getEntries())
+        {
+            out.put(e);
+        }
+        auto written = out.getBucket(*this);
+        assert(written->getHash() == b->getHash());
+        mBucketMaterialize.Mark();
+    }
+}
+
 std::shared_ptr<Bucket>
 BucketManagerImpl::getBucketByHash(uint256 const& hash)
 {
@@ -221,7 +415,7 @@ BucketManagerImpl::getBucketByHash(uint256 const& hash)
         return i->second;
     }
     std::string canonicalName = bucketFilename(hash);
-    if (fs::exists(canonicalName))
+    if (fs::exists(canonicalName) || linkFromSharedStore(binToHex(hash)))
     {
         CLOG(TRACE, "Bucket")
             << "BucketManager::getBucketByHash(" << binToHex(hash)
@@ -229,13 +423,14 @@ BucketManagerImpl::getBucketByHash(uint256 const& hash)
         auto p = std::make_shared<Bucket>(canonicalName, hash);
         mSharedBuckets.insert(std::make_pair(hash, p));
         mSharedBucketsSize.set_count(mSharedBuckets.size());
+        mCollectCandidates.insert(hash);
         return p;
     }
     return std::shared_ptr<Bucket>();
 }
 
 std::set<Hash>
-BucketManagerImpl::getReferencedBuckets() const
+BucketManagerImpl::getBucketListReferences() const
 {
     auto referenced = std::set<Hash>{};
     for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
@@ -248,6 +443,13 @@ BucketManagerImpl::getReferencedBuckets() const
             referenced.insert(hexToBin256(h));
         }
     }
+    return referenced;
+}
+
+std::set<Hash>
+BucketManagerImpl::getReferencedBuckets() const
+{
+    auto referenced = getBucketListReferences();
 
     // Implicitly retain any buckets that are referenced by a state in
     // the publish queue.
@@ -288,20 +490,61 @@ BucketManagerImpl::cleanupStaleFiles()
             std::remove(fullName.c_str());
         }
     }
+
+    // Partial outputs of merges that are no longer to be run
+    std::set<std::string> merging;
+    for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        auto const& next = mBucketList.getLevel(i).getNext();
+        merging.insert(next.getPartialMergeFilename(
+            getBucketDir(), BucketList::keepDeadEntries(i)));
+    }
+    for (auto f : fs::findfiles(getBucketDir(), Bucket::isPartialMergeFilename))
+    {
+        auto fullName = getBucketDir() + "/" + f;
+        if (merging.find(fullName) == std::end(merging))
+        {
+            std::remove(fullName.c_str());
+        }
+    }
 }
 
 void
 BucketManagerImpl::forgetUnreferencedBuckets()
 {
     std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
-    auto referenced = getReferencedBuckets();
 
-    for (auto i = mSharedBuckets.begin(); i != mSharedBuckets.end();)
+    // the buckets the BucketList let go of since the last time
+    auto referenced = getBucketListReferences();
+    std::set_difference(
+        mBucketListReferences.begin(), mBucketListReferences.end(),
+        referenced.begin(), referenced.end(),
+        std::inserter(mCollectCandidates, mCollectCandidates.end()));
+    mBucketListReferences = referenced;
+    if (mCollectCandidates.empty())
+    {
+        return;
+    }
+
+    // Implicitly retain any buckets that are referenced by a state in
+    // the publish queue (kept in memory by the HistoryManager).
+    for (auto const& h :
+         mApp.getHistoryManager().getBucketsReferencedByPublishQueue())
+    {
+        referenced.insert(hexToBin256(h));
+    }
+
+    for (auto c = mCollectCandidates.begin(); c != mCollectCandidates.end();)
     {
-        // Standard says map iterators other than the one you're erasing remain
-        // valid.
-        auto j = i;
-        ++i;
+        auto hash = *c;
+        auto j = mSharedBuckets.find(hash);
+        if (j == mSharedBuckets.end() ||
+            referenced.find(hash) != referenced.end())
+        {
+            // referenced buckets are candidates again once released
+            c = mCollectCandidates.erase(c);
+            continue;
+        }
 
         // Only drop buckets if the bucketlist has forgotten them _and_
         // no other in-progress structures (worker threads, shadow lists)
@@ -313,8 +556,12 @@ BucketManagerImpl::forgetUnreferencedBuckets()
         // we're the first and last to know about it. Otherwise buckets might
         // race on deleting the underlying file from one another.
 
-        if (referenced.find(j->first) == referenced.end() &&
-            j->second.use_count() == 1)
+        if (j->second.use_count() != 1)
+        {
+            ++c;
+            continue;
+        }
+        c = mCollectCandidates.erase(c);
         {
             auto filename = j->second->getFilename();
             CLOG(TRACE, "Bucket")
@@ -326,6 +573,8 @@ BucketManagerImpl::forgetUnreferencedBuckets()
                 std::remove(filename.c_str());
                 auto gzfilename = filename + ".gz";
                 std::remove(gzfilename.c_str());
+                auto indexfilename = BucketIndex::indexFilename(filename);
+                std::remove(indexfilename.c_str());
             }
             mSharedBuckets.erase(j);
         }
@@ -333,6 +582,16 @@ BucketManagerImpl::forgetUnreferencedBuckets()
     mSharedBucketsSize.set_count(mSharedBuckets.size());
 }
 
+void
+BucketManagerImpl::bucketsReleased(std::vector<std::string> const& hashes)
+{
+    std::lock_guard<std::recursive_mutex> lock(mBucketMutex);
+    for (auto const& h : hashes)
+    {
+        mCollectCandidates.insert(hexToBin256(h));
+    }
+}
+
 void
 BucketManagerImpl::addBatch(Application& app, uint32_t currLedger,
                             std::vector<LedgerEntry> const& liveEntries,
@@ -342,6 +601,34 @@ BucketManagerImpl::addBatch(Application& app, uint32_t currLedger,
     mBucketList.addBatch(app, currLedger, liveEntries, deadEntries);
 }
 
+std::shared_future<std::shared_ptr<Bucket>>
+BucketManagerImpl::startFreshBucket(std::vector<LedgerEntry> liveEntries,
+                                    std::vector<LedgerKey> deadEntries)
+{
+    // not on the workers, which may all be busy merging
+    auto live = std::make_shared<std::vector<LedgerEntry>>(
+        std::move(liveEntries));
+    auto dead = std::make_shared<std::vector<LedgerKey>>(
+        std::move(deadEntries));
+    bool inMemory = BucketList::keepInMemory(mApp, 0);
+    return std::async(std::launch::async, [this, live, dead, inMemory]() {
+               return Bucket::fresh(*this, std::move(*live), std::move(*dead),
+                                    inMemory);
+           })
+        .share();
+}
+
+void
+BucketManagerImpl::addBatch(Application& app, uint32_t currLedger,
+                            std::shared_future<std::shared_ptr<Bucket>> fresh)
+{
+    auto timer = mBucketAddBatch.TimeScope();
+    mBucketList.addBatch(app, currLedger, [this, &fresh]() {
+        auto waitTime = mBucketFreshWait.TimeScope();
+        return fresh.get();
+    });
+}
+
 // updates the given LedgerHeader to reflect the current state of the bucket
 // list
 void
@@ -385,12 +672,104 @@ BucketManagerImpl::checkForMissingBucketsFiles(HistoryArchiveState const& has)
     std::copy_if(buckets.begin(), buckets.end(), std::back_inserter(result),
                  [&](std::string b) {
                      auto filename = bucketFilename(b);
-                     return !isZero(hexToBin256(b)) && !fs::exists(filename);
+                     return !isZero(hexToBin256(b)) &&
+                            !fs::exists(filename) && !linkFromSharedStore(b);
                  });
 
     return result;
 }
 
+std::future<std::vector<std::string>>
+BucketManagerImpl::verifyBucketFiles(HistoryArchiveState const& has)
+{
+    struct Verification
+    {
+        std::mutex mMutex;
+        size_t mRemaining{0};
+        std::vector<std::string> mCorrupt;
+        std::promise<std::vector<std::string>> mDone;
+    };
+    auto v = std::make_shared<Verification>();
+    auto res = v->mDone.get_future();
+
+    std::set<std::string> hashes;
+    for (auto const& b : has.allBuckets())
+    {
+        auto filename = bucketFilename(b);
+        if (!isZero(hexToBin256(b)) && fs::exists(filename))
+        {
+            hashes.insert(b);
+        }
+    }
+    if (hashes.empty())
+    {
+        v->mDone.set_value({});
+        return res;
+    }
+
+    v->mRemaining = hashes.size();
+    auto& io = mApp.getWorkerIOService(Application::WORKER_POOL_HISTORY_IO);
+    for (auto const& b : hashes)
+    {
+        auto filename = bucketFilename(b);
+        io.post([this, v, b, filename]() {
+            auto hash = hexToBin256(b);
+            auto hasher = SHA256::create();
+            std::vector<uint64_t> keyHashes;
+            std::unique_ptr<BucketIndex> index;
+            try
+            {
+                index = BucketIndex::build(filename, &keyHashes, hasher.get());
+            }
+            catch (std::exception& e)
+            {
+                CLOG(WARNING, "Bucket")
+                    << "Failed reading " << filename << ": " << e.what();
+            }
+            bool ok = index && hasher->finish() == hash;
+            if (ok)
+            {
+                index->save(filename);
+                auto bucket = getBucketByHash(hash);
+                bucket->setKeyFilter(std::make_unique<BloomFilter>(keyHashes));
+                bucket->setIndex(std::move(index));
+            }
+            else
+            {
+                CLOG(WARNING, "Bucket")
+                    << "Bucket file " << filename << " does not match its hash";
+                removeCorruptBucketFile(b);
+            }
+
+            std::lock_guard<std::mutex> lock(v->mMutex);
+            if (!ok)
+            {
+                v->mCorrupt.push_back(b);
+            }
+            if (--v->mRemaining == 0)
+            {
+                std::sort(v->mCorrupt.begin(), v->mCorrupt.end());
+                v->mDone.set_value(v->mCorrupt);
+            }
+        });
+    }
+    return res;
+}
+
+void
+BucketManagerImpl::removeCorruptBucketFile(std::string const& bucketHexHash)
+{
+    auto filename = bucketFilename(bucketHexHash);
+    std::remove(filename.c_str());
+    std::remove(BucketIndex::indexFilename(filename).c_str());
+    // the shared store has the same contents, which would be linked again
+    auto shared = sharedBucketFilename(bucketHexHash);
+    if (!shared.empty())
+    {
+        std::remove(shared.c_str());
+    }
+}
+
 void
 BucketManagerImpl::assumeState(HistoryArchiveState const& has)
 {
@@ -412,10 +791,84 @@ BucketManagerImpl::assumeState(HistoryArchiveState const& has)
     cleanupStaleFiles();
 }
 
+void
+BucketManagerImpl::storeLocalState(HistoryArchiveState const& has,
+                                   LedgerHeaderHistoryEntry const& lcl)
+{
+    // written under temporary names and renamed, the header first:
+    // loadLocalState notices if a crash left them out of step
+    auto const& dir = getBucketDir();
+    auto headerFile = dir + "/" + kLocalHeaderFilename;
+    auto hasFile = dir + "/" + kLocalHASFilename;
+    {
+        XDROutputFileStream out;
+        out.open(headerFile + ".tmp");
+        out.writeOne(lcl);
+    }
+    {
+        std::ofstream out(hasFile + ".tmp");
+        out << has.toString();
+    }
+    if (std::rename((headerFile + ".tmp").c_str(), headerFile.c_str()) != 0 ||
+        std::rename((hasFile + ".tmp").c_str(), hasFile.c_str()) != 0)
+    {
+        CLOG(WARNING, "Bucket") << "Failed to save local state in " << dir;
+    }
+}
+
+bool
+BucketManager::loadLocalState(std::string const& bucketDir,
+                              HistoryArchiveState& has,
+                              LedgerHeaderHistoryEntry& lcl)
+{
+    auto headerFile = bucketDir + "/" + kLocalHeaderFilename;
+    auto hasFile = bucketDir + "/" + kLocalHASFilename;
+    if (!fs::exists(headerFile) || !fs::exists(hasFile))
+    {
+        CLOG(ERROR, "Bucket") << "No local state in " << bucketDir;
+        return false;
+    }
+    try
+    {
+        XDRInputFileStream in;
+        in.open(headerFile);
+        if (!in.readOne(lcl))
+        {
+            throw std::runtime_error("empty " + headerFile);
+        }
+        std::ifstream hasIn(hasFile);
+        std::string hasString((std::istreambuf_iterator<char>(hasIn)),
+                              std::istreambuf_iterator<char>());
+        has.fromString(hasString);
+    }
+    catch (std::exception& e)
+    {
+        CLOG(ERROR, "Bucket") << "Failed to read local state in " << bucketDir
+                              << ": " << e.what();
+        return false;
+    }
+
+    if (sha256(xdr::xdr_to_opaque(lcl.header)) != lcl.hash ||
+        has.currentLedger != lcl.header.ledgerSeq ||
+        has.getBucketListHash() != lcl.header.bucketListHash)
+    {
+        CLOG(ERROR, "Bucket") << "Inconsistent local state in " << bucketDir;
+        return false;
+    }
+    return true;
+}
+
 void
 BucketManagerImpl::shutdown()
 {
     // forgetUnreferencedBuckets does what we want - it retains needed buckets
     forgetUnreferencedBuckets();
+    // ... but the ones kept in memory have to be written for the next start
+    std::vector<std::string> referenced;
+    for (auto const& h : getReferencedBuckets())
+    {
+        referenced.emplace_back(binToHex(h));
+    }
+    materializeBuckets(referenced);
 }
 }
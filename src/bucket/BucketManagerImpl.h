@@ -43,12 +43,39 @@ class BucketManagerImpl : public BucketManager
     medida::Meter& mBucketObjectInsert;
     medida::Meter& mBucketByteInsert;
     medida::Timer& mBucketAddBatch;
+    medida::Timer& mBucketFreshWait;
+    medida::Meter& mBucketMaterialize;
     medida::Timer& mBucketSnapMerge;
+    MergeStageMeters mMergeStageMeters;
+    std::unique_ptr<BucketMergeScheduler> mMergeScheduler;
     medida::Counter& mSharedBucketsSize;
 
+    // Buckets forgetUnreferencedBuckets has to look at: the ones created or
+    // released since it last ran, and the ones it could not drop as they
+    // were still used; the others are referenced by the BucketList or the
+    // publish queue.
+    std::set<Hash> mCollectCandidates;
+    // what the BucketList referenced when forgetUnreferencedBuckets last ran
+    std::set<Hash> mBucketListReferences;
+
+    std::set<Hash> getBucketListReferences() const;
     std::set<Hash> getReferencedBuckets() const;
     void cleanupStaleFiles();
 
+    // Shared bucket store (SHARED_BUCKET_DIR_PATH) support: the name of a
+    // bucket in the store, or empty if there is no store, ...
+    std::string sharedBucketFilename(std::string const& bucketHexHash);
+    // ... hard link an adopted bucket into the store ...
+    void addToSharedStore(std::string const& filename, Hash const& hash);
+    // ... and hard link a bucket from the store into the bucket dir, returns
+    // true if the bucket is now in the bucket dir.
+    bool linkFromSharedStore(std::string const& bucketHexHash);
+
+    // COMPRESS_BUCKET_FILES support: compress a bucket file about to be
+    // adopted, returns the compressed file, or `filename` if it could not be
+    // compressed.
+    std::string compressBucketFile(std::string const& filename);
+
   protected:
     void calculateSkipValues(LedgerHeader& currentHeader);
     std::string bucketFilename(std::string const& bucketHexHash);
@@ -61,21 +88,39 @@ class BucketManagerImpl : public BucketManager
     std::string const& getBucketDir() override;
     BucketList& getBucketList() override;
     medida::Timer& getMergeTimer() override;
+    MergeStageMeters& getMergeStageMeters() override;
+    BucketMergeScheduler& getMergeScheduler() override;
     std::shared_ptr<Bucket> adoptFileAsBucket(std::string const& filename,
                                               uint256 const& hash,
                                               size_t nObjects,
                                               size_t nBytes) override;
+    std::shared_ptr<Bucket> adoptEntriesAsBucket(
+        uint256 const& hash,
+        std::shared_ptr<std::vector<BucketEntry> const> entries,
+        size_t nBytes) override;
+    void materializeBuckets(std::vector<std::string> const& hashes) override;
     std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) override;
 
     void forgetUnreferencedBuckets() override;
+    void bucketsReleased(std::vector<std::string> const& hashes) override;
     void addBatch(Application& app, uint32_t currLedger,
                   std::vector<LedgerEntry> const& liveEntries,
                   std::vector<LedgerKey> const& deadEntries) override;
+    std::shared_future<std::shared_ptr<Bucket>>
+    startFreshBucket(std::vector<LedgerEntry> liveEntries,
+                     std::vector<LedgerKey> deadEntries) override;
+    void addBatch(Application& app, uint32_t currLedger,
+                  std::shared_future<std::shared_ptr<Bucket>> fresh) override;
     void snapshotLedger(LedgerHeader& currentHeader) override;
 
     std::vector<std::string>
     checkForMissingBucketsFiles(HistoryArchiveState const& has) override;
+    std::future<std::vector<std::string>>
+    verifyBucketFiles(HistoryArchiveState const& has) override;
+    void removeCorruptBucketFile(std::string const& bucketHexHash) override;
     void assumeState(HistoryArchiveState const& has) override;
+    void storeLocalState(HistoryArchiveState const& has,
+                         LedgerHeaderHistoryEntry const& lcl) override;
     void shutdown() override;
 };
 
@@ -0,0 +1,84 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "bucket/BucketMergeScheduler.h"
+#include "main/Application.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+BucketMergeScheduler::BucketMergeScheduler(Application& app, size_t maxMerges,
+                                           size_t maxDeepMerges,
+                                           uint64_t deepWriteBytesPerSec)
+    : mApp(app)
+    , mMaxMerges(std::max<size_t>(maxMerges, 1))
+    , mMaxDeepMerges(std::max<size_t>(maxDeepMerges, 1))
+    , mDeepWriteLimiter(deepWriteBytesPerSec)
+    , mQueuedMerges(
+          app.getMetrics().NewCounter({"bucket", "merge", "queued"}))
+    , mRunningMerges(
+          app.getMetrics().NewCounter({"bucket", "merge", "running"}))
+{
+}
+
+void
+BucketMergeScheduler::schedule(MergePriority priority, Merge merge)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQueue.emplace(
+        std::make_tuple(priority.mDeadline, priority.mLevel, mSubmitted++),
+        std::move(merge));
+    dispatch();
+}
+
+void
+BucketMergeScheduler::dispatch()
+{
+    for (auto it = mQueue.begin();
+         it != mQueue.end() && mRunning < mMaxMerges;)
+    {
+        bool deep = std::get<1>(it->first) >= DEEP_MERGE_LEVEL;
+        if (deep && mRunningDeep >= mMaxDeepMerges)
+        {
+            ++it;
+            continue;
+        }
+
+        auto merge = std::move(it->second);
+        it = mQueue.erase(it);
+        ++mRunning;
+        if (deep)
+        {
+            ++mRunningDeep;
+        }
+        auto& workers =
+            mApp.getWorkerIOService(Application::WORKER_POOL_BUCKET_MERGE);
+        workers.post([this, deep, merge]() {
+            merge(deep ? &mDeepWriteLimiter : nullptr);
+            std::lock_guard<std::mutex> lock(mMutex);
+            --mRunning;
+            if (deep)
+            {
+                --mRunningDeep;
+            }
+            dispatch();
+        });
+    }
+    mQueuedMerges.set_count(mQueue.size());
+    mRunningMerges.set_count(mRunning);
+}
+
+size_t
+BucketMergeScheduler::getQueueSize()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mQueue.size();
+}
+}
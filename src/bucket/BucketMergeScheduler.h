@@ -0,0 +1,76 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "util/RateLimiter.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace medida
+{
+class Counter;
+}
+
+namespace stellar
+{
+
+class Application;
+
+// What a bucket merge is needed for: the BucketList level whose next curr it
+// produces, and the ledger at which BucketLevel::commit will wait for it.
+struct MergePriority
+{
+    uint32_t mLevel;
+    uint32_t mDeadline;
+};
+
+/**
+ * Runs bucket merges on the worker threads in order of deadline (then level),
+ * rather than in submission order, so that the small merges the next ledger
+ * close blocks on never queue up behind large ones.
+ *
+ * At most one merge per worker thread runs at a time, and at most
+ * `maxDeepMerges` of them can be deep (level DEEP_MERGE_LEVEL or more),
+ * which keeps workers free for shallow merges. Deep merges are also handed a
+ * RateLimiter for the bytes they write.
+ */
+class BucketMergeScheduler : NonMovableOrCopyable
+{
+  public:
+    typedef std::function<void(RateLimiter* writeLimiter)> Merge;
+    static uint32_t const DEEP_MERGE_LEVEL = 5;
+
+  private:
+    Application& mApp;
+    size_t const mMaxMerges;
+    size_t const mMaxDeepMerges;
+    RateLimiter mDeepWriteLimiter;
+    medida::Counter& mQueuedMerges;
+    medida::Counter& mRunningMerges;
+
+    std::mutex mMutex;
+    // (deadline, level, submission order) -> merge
+    std::map<std::tuple<uint32_t, uint32_t, uint64_t>, Merge> mQueue;
+    uint64_t mSubmitted{0};
+    size_t mRunning{0};
+    size_t mRunningDeep{0};
+
+    // Called with mMutex held.
+    void dispatch();
+
+  public:
+    BucketMergeScheduler(Application& app, size_t maxMerges,
+                         size_t maxDeepMerges, uint64_t deepWriteBytesPerSec);
+
+    void schedule(MergePriority priority, Merge merge);
+
+    size_t getQueueSize();
+};
+}
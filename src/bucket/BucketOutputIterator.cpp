@@ -4,12 +4,31 @@
 
 #include "bucket/BucketOutputIterator.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Random.h"
+#include "ledger/EntryFrame.h"
+#include "util/BloomFilter.h"
+#include "util/Fs.h"
+
+#include "medida/meter.h"
+
+#include <stdexcept>
 
 namespace stellar
 {
 
+static size_t const BUCKET_WRITE_BUFFER_SIZE = 2 * 1024 * 1024;
+
+// Size of the chunks handed to the writer thread, and how many of them can be
+// in flight, when pipelined.
+static size_t const WRITE_CHUNK_SIZE = 256 * 1024;
+static size_t const WRITE_QUEUE_DEPTH = 8;
+
+// Entries of a file being resumed that claim more bytes than this are
+// garbage left by a crash (no ledger entry comes close).
+static unsigned int const MAX_RESUMED_ENTRY_SIZE = 16 * 1024 * 1024;
+
 namespace
 {
 std::string
@@ -31,17 +50,198 @@ randomBucketName(std::string const& tmpDir)
 /**
  * Helper class that points to an output tempfile. Absorbs BucketEntries and
  * hashes them while writing to either destination. Produces a Bucket when done.
+ *
+ * The file is written durably: once adopted, the bucket may be referenced by
+ * the persisted bucket list.
  */
 BucketOutputIterator::BucketOutputIterator(std::string const& tmpDir,
-                                           bool keepDeadEntries)
+                                           bool keepDeadEntries,
+                                           medida::Meter* writeMeter,
+                                           RateLimiter* writeLimiter)
     : mFilename(randomBucketName(tmpDir))
+    , mOut(true, BUCKET_WRITE_BUFFER_SIZE)
+    , mBuf(nullptr)
+    , mHasher(SHA256::create())
+    , mIndex(std::make_unique<BucketIndex>())
+    , mKeepDeadEntries(keepDeadEntries)
+    , mWriteLimiter(writeLimiter)
+{
+    start(false, writeMeter);
+}
+
+BucketOutputIterator::BucketOutputIterator(std::string const& filename,
+                                           bool keepDeadEntries,
+                                           std::unique_ptr<BucketEntry>& last,
+                                           medida::Meter* writeMeter,
+                                           RateLimiter* writeLimiter)
+    : mFilename(filename)
+    , mOut(true, BUCKET_WRITE_BUFFER_SIZE)
     , mBuf(nullptr)
     , mHasher(SHA256::create())
+    , mIndex(std::make_unique<BucketIndex>())
     , mKeepDeadEntries(keepDeadEntries)
+    , mWriteLimiter(writeLimiter)
+{
+    last.reset();
+    if (fs::exists(mFilename))
+    {
+        recover(last);
+    }
+    start(true, writeMeter);
+}
+
+BucketOutputIterator::BucketOutputIterator(bool keepDeadEntries)
+    : mOut(false, 0)
+    , mBuf(nullptr)
+    , mHasher(SHA256::create())
+    , mKeepDeadEntries(keepDeadEntries)
+    , mEntries(std::make_shared<std::vector<BucketEntry>>())
+    , mWriteLimiter(nullptr)
+{
+}
+
+void
+BucketOutputIterator::recover(std::unique_ptr<BucketEntry>& last)
+{
+    XDRInputFileStream in(MAX_RESUMED_ENTRY_SIZE);
+    in.open(mFilename);
+    std::vector<char> buf;
+    BucketEntry e;
+    try
+    {
+        while (in.readOne(e))
+        {
+            buf.clear();
+            XDROutputFileStream::serialize(e, buf);
+            if ((last && !mCmp(*last, e)) ||
+                (!mKeepDeadEntries && e.type() == DEADENTRY) ||
+                mBytesPut + buf.size() != in.pos())
+            {
+                break;
+            }
+            mHasher->add(ByteSlice(buf.data(), buf.size()));
+            indexEntry(e, mBytesPut);
+            mBytesPut += buf.size();
+            mObjectsPut++;
+            if (!last)
+            {
+                last = std::make_unique<BucketEntry>();
+            }
+            *last = e;
+        }
+    }
+    catch (std::exception&)
+    {
+        // the entry being written when it was interrupted
+    }
+    in.close();
+    if (!fs::truncate(mFilename, mBytesPut))
+    {
+        throw std::runtime_error("failed to truncate bucket file " +
+                                 mFilename);
+    }
+    CLOG(DEBUG, "Bucket") << "Resuming " << mFilename << " after "
+                          << mObjectsPut << " entries";
+}
+
+void
+BucketOutputIterator::start(bool append, medida::Meter* writeMeter)
 {
     CLOG(TRACE, "Bucket") << "BucketOutputIterator opening file to write: "
                           << mFilename;
-    mOut.open(mFilename);
+    mOut.open(mFilename, append);
+
+    if (writeMeter)
+    {
+        mChunks = std::make_unique<BoundedQueue<std::vector<char>>>(
+            WRITE_QUEUE_DEPTH);
+        mChunk.reserve(WRITE_CHUNK_SIZE);
+        mWriter = std::thread([this, writeMeter]() {
+            std::vector<char> chunk;
+            while (mChunks->pop(chunk))
+            {
+                mHasher->add(ByteSlice(chunk.data(), chunk.size()));
+                if (!mOut.writeBytes(chunk.data(), chunk.size()))
+                {
+                    mWriteFailed = true;
+                }
+                writeMeter->Mark(chunk.size());
+                if (mWriteLimiter)
+                {
+                    mWriteLimiter->consume(chunk.size());
+                }
+            }
+        });
+    }
+}
+
+BucketOutputIterator::~BucketOutputIterator()
+{
+    finishWriter();
+}
+
+void
+BucketOutputIterator::finishWriter()
+{
+    if (mWriter.joinable())
+    {
+        mChunks->close();
+        mWriter.join();
+    }
+}
+
+void
+BucketOutputIterator::indexEntry(BucketEntry const& e, uint64_t offset)
+{
+    auto key =
+        e.type() == LIVEENTRY ? LedgerEntryKey(e.liveEntry()) : e.deadEntry();
+    mKeyHashes.push_back(BucketIndex::keyHash(key));
+    if (mObjectsPut % BucketIndex::STRIDE == 0)
+    {
+        mIndex->append(key, offset);
+    }
+}
+
+void
+BucketOutputIterator::write(BucketEntry const& e)
+{
+    auto offset = mBytesPut;
+    if (mEntries)
+    {
+        mSerialized.clear();
+        XDROutputFileStream::serialize(e, mSerialized);
+        mHasher->add(ByteSlice(mSerialized.data(), mSerialized.size()));
+        mBytesPut += mSerialized.size();
+        mEntries->emplace_back(e);
+    }
+    else if (mChunks)
+    {
+        auto before = mChunk.size();
+        XDROutputFileStream::serialize(e, mChunk);
+        mBytesPut += mChunk.size() - before;
+        if (mChunk.size() >= WRITE_CHUNK_SIZE)
+        {
+            mChunks->push(std::move(mChunk));
+            mChunk = std::vector<char>();
+            mChunk.reserve(WRITE_CHUNK_SIZE);
+        }
+    }
+    else
+    {
+        auto before = mBytesPut;
+        mOut.writeOne(e, mHasher.get(), &mBytesPut);
+        mUnlimitedBytes += mBytesPut - before;
+        if (mWriteLimiter && mUnlimitedBytes >= WRITE_CHUNK_SIZE)
+        {
+            mWriteLimiter->consume(mUnlimitedBytes);
+            mUnlimitedBytes = 0;
+        }
+    }
+    if (!mEntries)
+    {
+        indexEntry(e, offset);
+    }
+    mObjectsPut++;
 }
 
 void
@@ -63,8 +263,7 @@ BucketOutputIterator::put(BucketEntry const& e)
         // merely replace (same identity), the buffered entry.
         if (mCmp(*mBuf, e))
         {
-            mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-            mObjectsPut++;
+            write(*mBuf);
         }
     }
     else
@@ -79,13 +278,40 @@ BucketOutputIterator::put(BucketEntry const& e)
 std::shared_ptr<Bucket>
 BucketOutputIterator::getBucket(BucketManager& bucketManager)
 {
-    assert(mOut);
     if (mBuf)
     {
-        mOut.writeOne(*mBuf, mHasher.get(), &mBytesPut);
-        mObjectsPut++;
+        write(*mBuf);
         mBuf.reset();
     }
+    if (mEntries)
+    {
+        if (mObjectsPut == 0)
+        {
+            return std::make_shared<Bucket>();
+        }
+        mEntries->shrink_to_fit();
+        return bucketManager.adoptEntriesAsBucket(mHasher->finish(), mEntries,
+                                                  mBytesPut);
+    }
+    if (mChunks)
+    {
+        if (!mChunk.empty())
+        {
+            mChunks->push(std::move(mChunk));
+        }
+        finishWriter();
+        if (mWriteFailed)
+        {
+            throw std::runtime_error("failed to write bucket file " +
+                                     mFilename);
+        }
+    }
+    else if (mWriteLimiter && mUnlimitedBytes > 0)
+    {
+        mWriteLimiter->consume(mUnlimitedBytes);
+        mUnlimitedBytes = 0;
+    }
+    assert(mOut);
 
     mOut.close();
     if (mObjectsPut == 0 || mBytesPut == 0)
@@ -96,7 +322,10 @@ BucketOutputIterator::getBucket(BucketManager& bucketManager)
         std::remove(mFilename.c_str());
         return std::make_shared<Bucket>();
     }
-    return bucketManager.adoptFileAsBucket(mFilename, mHasher->finish(),
-                                           mObjectsPut, mBytesPut);
+    auto b = bucketManager.adoptFileAsBucket(mFilename, mHasher->finish(),
+                                             mObjectsPut, mBytesPut);
+    b->setKeyFilter(std::make_unique<BloomFilter>(mKeyHashes));
+    b->setIndex(std::move(mIndex));
+    return b;
 }
 }
@@ -5,33 +5,97 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "bucket/LedgerCmp.h"
+#include "util/BoundedQueue.h"
+#include "util/NonCopyable.h"
+#include "util/RateLimiter.h"
 #include "util/XDRStream.h"
 #include "xdr/Stellar-ledger.h"
 
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+}
 
 namespace stellar
 {
 
 class Bucket;
+class BucketIndex;
 class BucketManager;
 
 // Helper class that writes new elements to a file and returns a bucket
 // when finished.
-class BucketOutputIterator
+//
+// When given a `writeMeter`, hashing and writing run on a separate writer
+// thread: put() only serializes entries into chunks, which are handed over
+// through a bounded queue, and the meter counts the bytes written.
+//
+// When given a `writeLimiter`, every byte written is accounted to it, in
+// chunks of at most WRITE_CHUNK_SIZE bytes.
+//
+// The key filter and sparse index of a bucket file are built while it is
+// written, and handed to the bucket.
+//
+// Written to a given file instead of a temporary one, it resumes what an
+// interrupted writer left in that file: the durable stream flushes and
+// syncs it every XDROutputFileStream::SYNC_INTERVAL bytes, which is as much
+// as a restart loses.
+//
+// Constructed without a file, it keeps the entries in memory and produces a
+// bucket kept in memory, with the hash it would have as a file.
+class BucketOutputIterator : NonMovableOrCopyable
 {
     std::string mFilename;
     XDROutputFileStream mOut;
     BucketEntryIdCmp mCmp;
     std::unique_ptr<BucketEntry> mBuf;
     std::unique_ptr<SHA256> mHasher;
+    std::vector<uint64_t> mKeyHashes;
+    std::unique_ptr<BucketIndex> mIndex;
     size_t mBytesPut{0};
     size_t mObjectsPut{0};
     bool mKeepDeadEntries{true};
 
+    // Only used when kept in memory.
+    std::shared_ptr<std::vector<BucketEntry>> mEntries;
+    std::vector<char> mSerialized;
+
+    // Writer stage, only used when pipelined.
+    std::unique_ptr<BoundedQueue<std::vector<char>>> mChunks;
+    std::vector<char> mChunk;
+    std::thread mWriter;
+    std::atomic<bool> mWriteFailed{false};
+
+    RateLimiter* mWriteLimiter;
+    size_t mUnlimitedBytes{0};
+
+    void start(bool append, medida::Meter* writeMeter);
+    void recover(std::unique_ptr<BucketEntry>& last);
+    void write(BucketEntry const& e);
+    void indexEntry(BucketEntry const& e, uint64_t offset);
+    void finishWriter();
+
   public:
-    BucketOutputIterator(std::string const& tmpDir, bool keepDeadEntries);
+    BucketOutputIterator(std::string const& tmpDir, bool keepDeadEntries,
+                         medida::Meter* writeMeter = nullptr,
+                         RateLimiter* writeLimiter = nullptr);
+
+    // Writes to `filename`, keeping the entries it already has as long as
+    // they are complete and in order (the rest is cut off); `last` gets the
+    // last of them, or null, for the caller to put the ones after it.
+    BucketOutputIterator(std::string const& filename, bool keepDeadEntries,
+                         std::unique_ptr<BucketEntry>& last,
+                         medida::Meter* writeMeter = nullptr,
+                         RateLimiter* writeLimiter = nullptr);
+
+    explicit BucketOutputIterator(bool keepDeadEntries);
+    ~BucketOutputIterator();
 
     void put(BucketEntry const& e);
 
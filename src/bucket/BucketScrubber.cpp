@@ -0,0 +1,258 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/BucketScrubber.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
+#include "crypto/Hex.h"
+#include "crypto/SHA.h"
+#include "history/HistoryArchive.h"
+#include "history/HistoryManager.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "util/types.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+namespace stellar
+{
+
+size_t const BucketScrubber::CHUNK_SIZE = 1024 * 1024;
+
+namespace
+{
+// between the end of a pass and the start of the next one
+std::chrono::seconds const PASS_INTERVAL(60);
+}
+
+struct BucketScrubber::Scrub
+{
+    std::shared_ptr<Bucket> mBucket;
+    XDRInputFileStream mIn;
+    std::unique_ptr<SHA256> mHasher{SHA256::create()};
+    bool mOpen{false};
+    bool mFailed{false};
+
+    explicit Scrub(std::shared_ptr<Bucket> const& b) : mBucket(b)
+    {
+    }
+
+    // Hashes the next CHUNK_SIZE bytes of the file (or what is left),
+    // returns how many were read; @p done is set at the end of the file.
+    size_t
+    readChunk(bool& done)
+    {
+        uint64_t start = 0;
+        try
+        {
+            if (!mOpen)
+            {
+                mIn.open(mBucket->getFilename());
+                mOpen = true;
+            }
+            start = mIn.pos();
+            BucketEntry e;
+            while (mIn.pos() - start < CHUNK_SIZE)
+            {
+                if (!mIn.readOne(e, mHasher.get()))
+                {
+                    done = true;
+                    break;
+                }
+            }
+            return static_cast<size_t>(mIn.pos() - start);
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "Bucket") << "Failed reading "
+                                    << mBucket->getFilename() << ": "
+                                    << e.what();
+            mFailed = true;
+            done = true;
+            return 0;
+        }
+    }
+};
+
+BucketScrubber::BucketScrubber(Application& app)
+    : mApp{app}
+    , mTimer{app}
+    , mBytes{app.getMetrics().NewMeter({"bucket", "scrub", "bytes"}, "byte")}
+    , mBuckets{
+          app.getMetrics().NewMeter({"bucket", "scrub", "buckets"}, "bucket")}
+    , mPasses{app.getMetrics().NewMeter({"bucket", "scrub", "passes"}, "pass")}
+    , mFailures{
+          app.getMetrics().NewMeter({"bucket", "scrub", "failures"}, "bucket")}
+    , mRepairFailures{app.getMetrics().NewMeter(
+          {"bucket", "scrub", "repair-failures"}, "repair")}
+{
+}
+
+void
+BucketScrubber::start()
+{
+    if (mApp.getConfig().BUCKET_SCRUB_BYTES_PER_SECOND > 0)
+    {
+        scheduleChunk(std::chrono::microseconds(0));
+    }
+}
+
+uint64_t
+BucketScrubber::getCompletedPasses() const
+{
+    return mCompletedPasses;
+}
+
+uint64_t
+BucketScrubber::getFailureCount() const
+{
+    return mFailures.count();
+}
+
+void
+BucketScrubber::scheduleChunk(std::chrono::microseconds delay)
+{
+    mTimer.expires_from_now(delay);
+    mTimer.async_wait([this]() { runNextChunk(); },
+                      VirtualTimer::onFailureNoop);
+}
+
+bool
+BucketScrubber::startNextBucket()
+{
+    auto& bl = mApp.getBucketManager().getBucketList();
+    for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        auto const& level = bl.getLevel(i);
+        for (auto const& b : {level.getCurr(), level.getSnap()})
+        {
+            if (isZero(b->getHash()) || b->isInMemory() ||
+                mScrubbed.find(b->getHash()) != mScrubbed.end() ||
+                !fs::exists(b->getFilename()))
+            {
+                continue;
+            }
+            mScrub = std::make_shared<Scrub>(b);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+BucketScrubber::runNextChunk()
+{
+    if (!mScrub && !startNextBucket())
+    {
+        CLOG(INFO, "Bucket") << "Bucket scrubbing completed a pass over "
+                             << mScrubbed.size() << " buckets";
+        mScrubbed.clear();
+        ++mCompletedPasses;
+        mPasses.Mark();
+
+        // buckets whose repair failed are still missing
+        HistoryArchiveState has(
+            mApp.getLedgerManager().getLastClosedLedgerNum(),
+            mApp.getBucketManager().getBucketList());
+        if (!mApp.getBucketManager().checkForMissingBucketsFiles(has).empty())
+        {
+            repairMissingBuckets();
+        }
+        scheduleChunk(PASS_INTERVAL);
+        return;
+    }
+
+    std::weak_ptr<Scrub> weak = mScrub;
+    auto& clock = mApp.getClock();
+    auto& workers = mApp.getWorkerIOService(Application::WORKER_POOL_MISC);
+    workers.post([this, &clock, weak]() {
+        size_t bytes = 0;
+        bool done = false;
+        {
+            auto scrub = weak.lock();
+            if (!scrub)
+            {
+                return;
+            }
+            bytes = scrub->readChunk(done);
+        }
+        clock.postToMain(
+            [this, weak, bytes, done]() {
+                if (weak.lock())
+                {
+                    onChunkDone(bytes, done);
+                }
+            },
+            "bucket-scrub");
+    });
+}
+
+void
+BucketScrubber::onChunkDone(size_t bytes, bool done)
+{
+    mBytes.Mark(bytes);
+    if (done)
+    {
+        auto const& hash = mScrub->mBucket->getHash();
+        mScrubbed.insert(hash);
+        mBuckets.Mark();
+        if (mScrub->mFailed || mScrub->mHasher->finish() != hash)
+        {
+            auto hexHash = binToHex(hash);
+            CLOG(ERROR, "Bucket")
+                << "Bucket file " << mScrub->mBucket->getFilename()
+                << " does not match its hash, downloading it again";
+            mFailures.Mark();
+            mApp.getBucketManager().removeCorruptBucketFile(hexHash);
+            repairMissingBuckets();
+        }
+        mScrub.reset();
+    }
+
+    // the rate is averaged over the chunks: the next one waits for as long
+    // as reading this one should have taken
+    auto rate = mApp.getConfig().BUCKET_SCRUB_BYTES_PER_SECOND;
+    scheduleChunk(std::chrono::microseconds(
+        static_cast<uint64_t>(bytes) * 1000000 / rate));
+}
+
+void
+BucketScrubber::repairMissingBuckets()
+{
+    if (mRepairing)
+    {
+        mRepairAgain = true;
+        return;
+    }
+    mRepairing = true;
+    mRepairAgain = false;
+    HistoryArchiveState has(mApp.getLedgerManager().getLastClosedLedgerNum(),
+                            mApp.getBucketManager().getBucketList());
+    mApp.getHistoryManager().downloadMissingBuckets(
+        has, [this](asio::error_code const& ec) {
+            mRepairing = false;
+            if (ec)
+            {
+                CLOG(ERROR, "Bucket")
+                    << "Could not download the missing buckets again: "
+                    << ec.message();
+                mRepairFailures.Mark();
+            }
+            else
+            {
+                CLOG(INFO, "Bucket") << "Downloaded the missing buckets again";
+            }
+            if (mRepairAgain)
+            {
+                repairMissingBuckets();
+            }
+        });
+}
+}
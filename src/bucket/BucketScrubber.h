@@ -0,0 +1,89 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/Timer.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <set>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+class Bucket;
+
+/**
+ * Rehashes the files of the buckets of the bucket list in the background,
+ * so that a file corrupted on disk is noticed before a merge, an apply or a
+ * publish needs it: the current and snap bucket of every level is read in
+ * turn, a chunk at a time on a worker thread, chunks being spaced so that no
+ * more than BUCKET_SCRUB_BYTES_PER_SECOND are read on average. Once every
+ * bucket was checked, a pass is complete and the next one starts over.
+ *
+ * The file of a bucket that does not match its hash is removed (see
+ * BucketManager::removeCorruptBucketFile) and the buckets missing from the
+ * bucket list are downloaded again from the history archives, as when
+ * starting with missing buckets.
+ *
+ * Buckets kept in memory have no file to check. Sizes are counted in the
+ * uncompressed contents of compressed files (see COMPRESS_BUCKET_FILES).
+ */
+class BucketScrubber
+{
+  public:
+    explicit BucketScrubber(Application& app);
+
+    // start scrubbing according to app.getConfig()
+    void start();
+
+    // Number of passes over the whole bucket list completed.
+    uint64_t getCompletedPasses() const;
+
+    // Number of buckets found not to match their hash.
+    uint64_t getFailureCount() const;
+
+    // Bytes read per chunk.
+    static size_t const CHUNK_SIZE;
+
+  private:
+    Application& mApp;
+    VirtualTimer mTimer;
+
+    // the bucket being checked; the chunk running on a worker thread holds
+    // it, and only a weak reference to the scrubber
+    struct Scrub;
+    std::shared_ptr<Scrub> mScrub;
+
+    // buckets checked during this pass
+    std::set<Hash> mScrubbed;
+    uint64_t mCompletedPasses{0};
+
+    // whether RepairMissingBucketsWork is running, and whether more files
+    // were removed since it started
+    bool mRepairing{false};
+    bool mRepairAgain{false};
+
+    medida::Meter& mBytes;
+    medida::Meter& mBuckets;
+    medida::Meter& mPasses;
+    medida::Meter& mFailures;
+    medida::Meter& mRepairFailures;
+
+    void scheduleChunk(std::chrono::microseconds delay);
+    void runNextChunk();
+    void onChunkDone(size_t bytes, bool done);
+    bool startNextBucket();
+    void repairMissingBuckets();
+};
+}
@@ -7,31 +7,53 @@
 // else.
 #include "util/asio.h"
 #include "bucket/Bucket.h"
+#include "bucket/BucketApplicator.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketInputIterator.h"
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "bucket/BucketManagerImpl.h"
+#include "bucket/BucketMergeScheduler.h"
+#include "bucket/BucketOutputIterator.h"
+#include "bucket/BucketScrubber.h"
 #include "bucket/LedgerCmp.h"
+#include "catchup/RestoreFromBuckets.h"
 #include "crypto/Hex.h"
+#include "crypto/SHA.h"
 #include "database/Database.h"
 #include "herder/LedgerCloseData.h"
+#include "history/HistoryArchive.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/InflationVoteTally.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTestUtils.h"
+#include "ledger/OfferFrame.h"
+#include "ledger/OrderBook.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
+#include "main/PersistentState.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
+#include "simulation/LoadGenerator.h"
+#include "test/TestAccount.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
 #include "util/Fs.h"
+#include "util/Gzip.h"
 #include "util/Logging.h"
+#include "util/Math.h"
 #include "util/Timer.h"
 #include "util/TmpDir.h"
+#include "util/XDROperators.h"
 #include "util/types.h"
 #include "xdrpp/autocheck.h"
 #include <algorithm>
+#include <fstream>
 #include <future>
+#include <map>
 
 using namespace stellar;
 
@@ -283,6 +305,74 @@ TEST_CASE("bucket list", "[bucket]")
     }
 }
 
+TEST_CASE("bucket list hash caching", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    auto uncachedHash = [](BucketList const& bl) {
+        auto bhsh = SHA256::create();
+        for (uint32_t j = 0; j < BucketList::kNumLevels; ++j)
+        {
+            auto const& lev = bl.getLevel(j);
+            auto lhsh = SHA256::create();
+            lhsh->add(lev.getCurr()->getHash());
+            lhsh->add(lev.getSnap()->getHash());
+            bhsh->add(lhsh->finish());
+        }
+        return bhsh->finish();
+    };
+
+    BucketList bl;
+    REQUIRE(bl.getHash() == uncachedHash(bl));
+    autocheck::generator<std::vector<LedgerKey>> deadGen;
+    for (uint32_t i = 1; i < 70; ++i)
+    {
+        app->getClock().crank(false);
+        bl.addBatch(*app, i, LedgerTestUtils::generateValidLedgerEntries(8),
+                    deadGen(5));
+        REQUIRE(bl.getHash() == uncachedHash(bl));
+    }
+
+    SECTION("levels replaced directly are rehashed")
+    {
+        auto& lev = bl.getLevel(3);
+        lev.setSnap(lev.getCurr());
+        REQUIRE(bl.getHash() == uncachedHash(bl));
+        lev.setCurr(std::make_shared<Bucket>());
+        REQUIRE(bl.getHash() == uncachedHash(bl));
+    }
+}
+
+TEST_CASE("bucket list with fresh buckets started ahead", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    BucketList sync, ahead;
+    autocheck::generator<std::vector<LedgerKey>> deadGen;
+    for (uint32_t i = 1; i < 70; ++i)
+    {
+        app->getClock().crank(false);
+        auto live = LedgerTestUtils::generateValidLedgerEntries(8);
+        auto dead = deadGen(5);
+        auto fresh = bm.startFreshBucket(live, dead);
+        bool levelsFirst = false;
+        ahead.addBatch(*app, i, [&]() {
+            // spills are prepared before the bucket is waited for
+            levelsFirst = !BucketList::levelShouldSpill(i, 0) ||
+                          isZero(ahead.getLevel(0).getCurr()->getHash());
+            return fresh.get();
+        });
+        sync.addBatch(*app, i, live, dead);
+        REQUIRE(levelsFirst);
+        REQUIRE(ahead.getHash() == sync.getHash());
+    }
+}
+
 TEST_CASE("bucket list shadowing", "[bucket]")
 {
     VirtualClock clock;
@@ -577,7 +667,7 @@ TEST_CASE("merging bucket entries", "[bucket]")
         }
         std::shared_ptr<Bucket> b1 =
             Bucket::fresh(app->getBucketManager(), live, dead);
-        std::random_shuffle(live.begin(), live.end());
+        rand_shuffle(live.begin(), live.end());
         size_t liveCount = live.size();
         for (auto& e : live)
         {
@@ -593,6 +683,60 @@ TEST_CASE("merging bucket entries", "[bucket]")
             Bucket::merge(app->getBucketManager(), b1, b2);
         CHECK(countEntries(b3) == liveCount);
     }
+
+    SECTION("k-way merge matches chained two-way merges")
+    {
+        auto& bm = app->getBucketManager();
+        std::vector<LedgerEntry> entries(50);
+        for (auto& e : entries)
+        {
+            e = LedgerTestUtils::generateValidLedgerEntry(10);
+        }
+        // oldest first; every bucket updates or deletes some of the entries
+        std::vector<std::shared_ptr<Bucket>> buckets;
+        for (int i = 0; i < 5; i++)
+        {
+            std::vector<LedgerEntry> live;
+            std::vector<LedgerKey> dead;
+            for (auto& e : entries)
+            {
+                if (flip())
+                {
+                    if (flip())
+                    {
+                        dead.push_back(LedgerEntryKey(e));
+                    }
+                    else
+                    {
+                        e.lastModifiedLedgerSeq = i + 1;
+                        live.push_back(e);
+                    }
+                }
+            }
+            buckets.push_back(Bucket::fresh(bm, live, dead));
+        }
+
+        auto chained = buckets.front();
+        for (size_t i = 1; i < buckets.size(); i++)
+        {
+            chained = Bucket::merge(bm, chained, buckets[i]);
+        }
+        std::reverse(buckets.begin(), buckets.end());
+        auto fused = Bucket::mergeAll(bm, buckets);
+        CHECK(fused->getHash() == chained->getHash());
+
+        std::vector<std::shared_ptr<Bucket>> shadows{buckets.front()};
+        buckets.erase(buckets.begin());
+        std::reverse(buckets.begin(), buckets.end());
+        chained = buckets.front();
+        for (size_t i = 1; i < buckets.size(); i++)
+        {
+            chained = Bucket::merge(bm, chained, buckets[i], shadows, false);
+        }
+        std::reverse(buckets.begin(), buckets.end());
+        fused = Bucket::mergeAll(bm, buckets, shadows, false);
+        CHECK(fused->getHash() == chained->getHash());
+    }
 }
 
 static void
@@ -614,7 +758,7 @@ clearFutures(Application::pointer app, BucketList& bl)
     size_t waiting = 0, finished = 0;
     for (size_t i = 0; i < n; ++i)
     {
-        app->getWorkerIOService().post([&] {
+        app->getWorkerIOService(Application::WORKER_POOL_MISC).post([&] {
             std::unique_lock<std::mutex> lock(mutex);
             if (++waiting == n)
             {
@@ -634,6 +778,571 @@ clearFutures(Application::pointer app, BucketList& bl)
     }
 }
 
+TEST_CASE("bucket point lookups", "[bucket][bucketindex]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    std::vector<LedgerEntry> live(BucketIndex::STRIDE * 3 + 10);
+    std::vector<LedgerKey> dead;
+    for (auto& e : live)
+    {
+        e = LedgerTestUtils::generateValidLedgerEntry(5);
+    }
+    for (size_t i = 0; i < 20; i++)
+    {
+        dead.emplace_back(
+            LedgerEntryKey(LedgerTestUtils::generateValidLedgerEntry(5)));
+    }
+    auto b = Bucket::fresh(app->getBucketManager(), live, dead);
+    auto indexFile = BucketIndex::indexFilename(b->getFilename());
+    REQUIRE(!fs::exists(indexFile));
+
+    std::vector<BucketEntry> entries;
+    for (BucketInputIterator iter(b); iter; ++iter)
+    {
+        entries.emplace_back(*iter);
+    }
+    auto checkAll = [&](Bucket const& bucket) {
+        for (auto const& e : entries)
+        {
+            auto key = e.type() == LIVEENTRY ? LedgerEntryKey(e.liveEntry())
+                                             : e.deadEntry();
+            auto found = bucket.getBucketEntry(key);
+            REQUIRE(found);
+            REQUIRE(*found == e);
+        }
+    };
+    checkAll(*b);
+    REQUIRE(fs::exists(indexFile));
+
+    LedgerEntry missing;
+    missing.data.type(ACCOUNT);
+    missing.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+    bool known = std::any_of(
+        entries.begin(), entries.end(), [&](BucketEntry const& e) {
+            return e.type() == LIVEENTRY &&
+                   LedgerEntryKey(e.liveEntry()) == LedgerEntryKey(missing);
+        });
+    if (!known)
+    {
+        REQUIRE(!b->getBucketEntry(LedgerEntryKey(missing)));
+    }
+
+    SECTION("persisted index is reused")
+    {
+        auto index = BucketIndex::load(b->getFilename());
+        REQUIRE(index);
+        REQUIRE(index->size() ==
+                (entries.size() + BucketIndex::STRIDE - 1) /
+                    BucketIndex::STRIDE);
+        Bucket reopened(b->getFilename(), b->getHash());
+        checkAll(reopened);
+    }
+}
+
+TEST_CASE("bucket list point lookups", "[bucket][bucketindex]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    BucketList bl;
+
+    // latest version of every key, nullptr once deleted
+    std::map<LedgerKey, std::shared_ptr<LedgerEntry>, LedgerEntryIdCmp> state;
+    for (uint32_t i = 1; i < 70; ++i)
+    {
+        app->getClock().crank(false);
+        auto live = LedgerTestUtils::generateValidLedgerEntries(8);
+        std::vector<LedgerKey> dead;
+        // update or delete a couple of older entries
+        size_t n = 0;
+        for (auto& kv : state)
+        {
+            if (!kv.second || n++ % 7 != i % 7)
+            {
+                continue;
+            }
+            if (n % 2 == 0)
+            {
+                dead.emplace_back(kv.first);
+            }
+            else
+            {
+                auto e = *kv.second;
+                e.lastModifiedLedgerSeq = i;
+                live.emplace_back(e);
+            }
+        }
+        for (auto const& e : live)
+        {
+            state[LedgerEntryKey(e)] = std::make_shared<LedgerEntry>(e);
+        }
+        for (auto const& k : dead)
+        {
+            state[k] = nullptr;
+        }
+        bl.addBatch(*app, i, live, dead);
+    }
+
+    for (auto const& kv : state)
+    {
+        auto be = bl.getBucketEntry(kv.first);
+        REQUIRE(be);
+        if (kv.second)
+        {
+            REQUIRE(be->type() == LIVEENTRY);
+            REQUIRE(be->liveEntry() == *kv.second);
+        }
+        else
+        {
+            REQUIRE(be->type() == DEADENTRY);
+        }
+    }
+
+    LedgerEntry absent;
+    absent.data.type(ACCOUNT);
+    absent.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+    if (state.find(LedgerEntryKey(absent)) == state.end())
+    {
+        REQUIRE(!bl.getBucketEntry(LedgerEntryKey(absent)));
+    }
+}
+
+TEST_CASE("compressed bucket files", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0));
+    cfg.COMPRESS_BUCKET_FILES = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    VirtualClock plainClock;
+    Application::pointer plainApp =
+        createTestApplication(plainClock, getTestConfig(1));
+    auto& plainBm = plainApp->getBucketManager();
+
+    auto live = LedgerTestUtils::generateValidLedgerEntries(2000);
+    std::vector<LedgerKey> dead;
+    auto b = Bucket::fresh(bm, live, dead);
+    auto plain = Bucket::fresh(plainBm, live, dead);
+    REQUIRE(gz::isBlockFile(b->getFilename()));
+    REQUIRE(!gz::isBlockFile(plain->getFilename()));
+    REQUIRE(b->getHash() == plain->getHash());
+
+    // read through, and from the index
+    REQUIRE(b->countLiveAndDeadEntries() == plain->countLiveAndDeadEntries());
+    for (size_t i = 0; i < live.size(); i += 97)
+    {
+        auto key = LedgerEntryKey(live[i]);
+        auto e = b->getBucketEntry(key);
+        REQUIRE(e);
+        REQUIRE(*e == *plain->getBucketEntry(key));
+    }
+
+    // merged from compressed inputs, to the same hash
+    auto more = LedgerTestUtils::generateValidLedgerEntries(500);
+    REQUIRE(Bucket::merge(bm, b, Bucket::fresh(bm, more, dead))->getHash() ==
+            Bucket::merge(plainBm, plain, Bucket::fresh(plainBm, more, dead))
+                ->getHash());
+}
+
+TEST_CASE("merging with shadows out of range", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto entries = LedgerTestUtils::generateValidLedgerEntries(3000);
+    auto idCmp = [](LedgerEntry const& a, LedgerEntry const& b) {
+        return LedgerEntryIdCmp{}(a.data, b.data);
+    };
+    std::sort(entries.begin(), entries.end(), idCmp);
+    entries.erase(std::unique(entries.begin(), entries.end(),
+                              [&](LedgerEntry const& a, LedgerEntry const& b) {
+                                  return !idCmp(a, b);
+                              }),
+                  entries.end());
+    REQUIRE(entries.size() > 2500);
+
+    std::vector<LedgerKey> noDead;
+    auto slice = [&](size_t from, size_t to) {
+        return std::vector<LedgerEntry>(entries.begin() + from,
+                                        entries.begin() + to);
+    };
+    auto n = entries.size();
+    // the merged entries start past most of the first shadow, the second one
+    // is entirely before them
+    auto merged = Bucket::fresh(bm, slice(1900, n), noDead);
+    auto shadow = Bucket::fresh(bm, slice(0, 2000), noDead);
+    auto before = Bucket::fresh(bm, slice(0, 1000), noDead);
+
+    LedgerKey first, last;
+    REQUIRE(merged->getKeyRange(first, last));
+    REQUIRE(first == LedgerEntryKey(entries[1900]));
+    REQUIRE(last == LedgerEntryKey(entries[n - 1]));
+    REQUIRE(!std::make_shared<Bucket>()->getKeyRange(first, last));
+
+    BucketEntry shadowed, kept;
+    shadowed.type(LIVEENTRY);
+    shadowed.liveEntry() = entries[1950];
+    kept.type(LIVEENTRY);
+    kept.liveEntry() = entries[2050];
+    for (bool inMemory : {false, true})
+    {
+        auto res = Bucket::merge(bm, merged, std::make_shared<Bucket>(),
+                                 {before, shadow}, true, nullptr, inMemory);
+        REQUIRE(res->countLiveAndDeadEntries().first == n - 2000);
+        REQUIRE(!res->containsBucketIdentity(shadowed));
+        REQUIRE(res->containsBucketIdentity(kept));
+    }
+}
+
+TEST_CASE("bucket entry sort keys", "[bucket]")
+{
+    // few accounts, for entries to tie on them
+    std::vector<AccountID> accounts;
+    for (auto const& a : LedgerTestUtils::generateValidAccountEntries(3))
+    {
+        accounts.push_back(a.accountID);
+    }
+
+    std::vector<BucketEntry> entries;
+    auto liveEntries = LedgerTestUtils::generateValidLedgerEntries(300);
+    for (size_t i = 0; i < liveEntries.size(); ++i)
+    {
+        auto& d = liveEntries[i].data;
+        auto const& account = accounts[i % accounts.size()];
+        switch (d.type())
+        {
+        case ACCOUNT:
+            d.account().accountID = account;
+            break;
+        case TRUSTLINE:
+            d.trustLine().accountID = account;
+            break;
+        case OFFER:
+            d.offer().sellerID = account;
+            d.offer().offerID -= 1000;
+            break;
+        case DATA:
+            d.data().accountID = account;
+            break;
+        }
+        BucketEntry e;
+        if (i % 2 == 0)
+        {
+            e.type(LIVEENTRY);
+            e.liveEntry() = liveEntries[i];
+        }
+        else
+        {
+            e.type(DEADENTRY);
+            e.deadEntry() = LedgerEntryKey(liveEntries[i]);
+        }
+        entries.push_back(e);
+    }
+    // names tied on their padded prefix
+    for (auto const& name : {std::string("a"), std::string("a\0", 2)})
+    {
+        BucketEntry e;
+        e.type(DEADENTRY);
+        e.deadEntry().type(DATA);
+        e.deadEntry().data().accountID = accounts[0];
+        e.deadEntry().data().dataName = name;
+        entries.push_back(e);
+    }
+
+    BucketEntryIdCmp idCmp;
+    BucketEntrySortKeyCmp keyCmp;
+    std::vector<BucketEntrySortKey> keys;
+    for (auto const& e : entries)
+    {
+        keys.emplace_back(e);
+    }
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        for (size_t j = 0; j < entries.size(); ++j)
+        {
+            REQUIRE(keyCmp(entries[i], keys[i], entries[j], keys[j]) ==
+                    idCmp(entries[i], entries[j]));
+        }
+    }
+}
+
+TEST_CASE("bucket entry sort keys of large offer IDs", "[bucket]")
+{
+    auto seller = LedgerTestUtils::generateValidAccountEntry(5).accountID;
+    uint64_t const half = uint64_t(1) << 63;
+    std::vector<BucketEntry> entries;
+    for (uint64_t id : {uint64_t(0), uint64_t(1), half - 1, half, half + 1,
+                        UINT64_MAX - 1, UINT64_MAX})
+    {
+        BucketEntry e;
+        e.type(DEADENTRY);
+        e.deadEntry().type(OFFER);
+        e.deadEntry().offer().sellerID = seller;
+        e.deadEntry().offer().offerID = id;
+        entries.push_back(e);
+    }
+
+    // in increasing order of offer IDs, on both sides of 2^63
+    BucketEntryIdCmp idCmp;
+    BucketEntrySortKeyCmp keyCmp;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        BucketEntrySortKey ki(entries[i]);
+        for (size_t j = 0; j < entries.size(); ++j)
+        {
+            BucketEntrySortKey kj(entries[j]);
+            REQUIRE(idCmp(entries[i], entries[j]) == (i < j));
+            REQUIRE(keyCmp(entries[i], ki, entries[j], kj) == (i < j));
+        }
+    }
+}
+
+TEST_CASE("pipelined bucket output", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    std::vector<BucketEntry> entries(5000);
+    for (auto& e : entries)
+    {
+        e.type(LIVEENTRY);
+        e.liveEntry() = LedgerTestUtils::generateValidLedgerEntry(10);
+    }
+    std::sort(entries.begin(), entries.end(), BucketEntryIdCmp());
+
+    BucketOutputIterator serial(bm.getTmpDir(), true);
+    medida::Meter& writeMeter = bm.getMergeStageMeters().mWrite;
+    auto writtenBefore = writeMeter.count();
+    BucketOutputIterator pipelined(bm.getTmpDir(), true, &writeMeter);
+    for (auto const& e : entries)
+    {
+        serial.put(e);
+        pipelined.put(e);
+    }
+    auto b1 = serial.getBucket(bm);
+    auto b2 = pipelined.getBucket(bm);
+    REQUIRE(b1->getHash() == b2->getHash());
+    REQUIRE(writeMeter.count() - writtenBefore ==
+            static_cast<int64_t>(fileSize(b1->getFilename())));
+}
+
+TEST_CASE("resumed bucket output", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    std::vector<BucketEntry> entries(2000);
+    for (auto& e : entries)
+    {
+        e.type(LIVEENTRY);
+        e.liveEntry() = LedgerTestUtils::generateValidLedgerEntry(10);
+    }
+    std::sort(entries.begin(), entries.end(), BucketEntryIdCmp());
+    entries.erase(std::unique(entries.begin(), entries.end(),
+                              [](BucketEntry const& a, BucketEntry const& b) {
+                                  return !BucketEntryIdCmp()(a, b);
+                              }),
+                  entries.end());
+
+    BucketOutputIterator fresh(bm.getTmpDir(), true);
+    for (auto const& e : entries)
+    {
+        fresh.put(e);
+    }
+    auto expected = fresh.getBucket(bm);
+
+    auto partial = Bucket::partialMergeFilename(
+        bm.getBucketDir(), {binToHex(expected->getHash())}, true);
+    REQUIRE(Bucket::isPartialMergeFilename(
+        partial.substr(bm.getBucketDir().size() + 1)));
+
+    auto resume = [&](size_t bytes) {
+        {
+            // what an interrupted writer left, cut in the middle of an entry
+            std::ifstream in(expected->getFilename(), std::ios::binary);
+            std::vector<char> buf(bytes);
+            in.read(buf.data(), bytes);
+            std::ofstream out(partial, std::ios::binary);
+            out.write(buf.data(), bytes);
+        }
+        std::unique_ptr<BucketEntry> last;
+        medida::Meter& writeMeter = bm.getMergeStageMeters().mWrite;
+        BucketOutputIterator out(partial, true, last, &writeMeter);
+        auto next = entries.begin();
+        if (last)
+        {
+            next = std::upper_bound(entries.begin(), entries.end(), *last,
+                                    BucketEntryIdCmp());
+            REQUIRE(next != entries.begin());
+            REQUIRE(*(next - 1) == *last);
+        }
+        for (; next != entries.end(); ++next)
+        {
+            out.put(*next);
+        }
+        return out.getBucket(bm);
+    };
+
+    auto size = static_cast<size_t>(fileSize(expected->getFilename()));
+    for (auto bytes : {size_t(0), size_t(3), size / 3, size / 2 + 1, size})
+    {
+        auto b = resume(bytes);
+        REQUIRE(b->getHash() == expected->getHash());
+        REQUIRE(!fs::exists(partial));
+    }
+}
+
+TEST_CASE("verify bucket files", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto good =
+        Bucket::fresh(bm, LedgerTestUtils::generateValidLedgerEntries(20), {});
+    auto bad =
+        Bucket::fresh(bm, LedgerTestUtils::generateValidLedgerEntries(20), {});
+    HistoryArchiveState has;
+    has.currentBuckets[0].curr = binToHex(good->getHash());
+    has.currentBuckets[0].snap = binToHex(bad->getHash());
+    REQUIRE(bm.verifyBucketFiles(has).get().empty());
+
+    {
+        // flip a byte in the middle of the file
+        auto size = static_cast<std::streamoff>(fileSize(bad->getFilename()));
+        auto mid = size / 2;
+        std::fstream f(bad->getFilename(),
+                       std::ios::in | std::ios::out | std::ios::binary);
+        f.seekg(mid);
+        char c;
+        f.get(c);
+        f.seekp(mid);
+        f.put(static_cast<char>(c ^ 1));
+    }
+    REQUIRE(bm.verifyBucketFiles(has).get() ==
+            std::vector<std::string>{binToHex(bad->getHash())});
+    REQUIRE(fs::exists(good->getFilename()));
+    REQUIRE(!fs::exists(bad->getFilename()));
+    REQUIRE(bm.checkForMissingBucketsFiles(has) ==
+            std::vector<std::string>{binToHex(bad->getHash())});
+}
+
+TEST_CASE("bucket scrubbing", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.BUCKET_SCRUB_BYTES_PER_SECOND = 1024 * 1024 * 1024;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    auto good =
+        Bucket::fresh(bm, LedgerTestUtils::generateValidLedgerEntries(20), {});
+    auto bad =
+        Bucket::fresh(bm, LedgerTestUtils::generateValidLedgerEntries(20), {});
+    auto& level = bm.getBucketList().getLevel(0);
+    level.setCurr(good);
+    level.setSnap(bad);
+
+    BucketScrubber scrubber(*app);
+    scrubber.start();
+    auto runPass = [&]() {
+        auto passes = scrubber.getCompletedPasses();
+        while (scrubber.getCompletedPasses() == passes)
+        {
+            clock.crank(true);
+        }
+    };
+
+    SECTION("intact")
+    {
+        runPass();
+        runPass();
+        REQUIRE(scrubber.getFailureCount() == 0);
+        REQUIRE(fs::exists(good->getFilename()));
+        REQUIRE(fs::exists(bad->getFilename()));
+    }
+
+    SECTION("corrupted")
+    {
+        {
+            // flip a byte in the middle of the file
+            auto size =
+                static_cast<std::streamoff>(fileSize(bad->getFilename()));
+            auto mid = size / 2;
+            std::fstream f(bad->getFilename(),
+                           std::ios::in | std::ios::out | std::ios::binary);
+            f.seekg(mid);
+            char c;
+            f.get(c);
+            f.seekp(mid);
+            f.put(static_cast<char>(c ^ 1));
+        }
+        runPass();
+        REQUIRE(scrubber.getFailureCount() == 1);
+        REQUIRE(fs::exists(good->getFilename()));
+        REQUIRE(!fs::exists(bad->getFilename()));
+
+        HistoryArchiveState has(1, bm.getBucketList());
+        REQUIRE(bm.checkForMissingBucketsFiles(has) ==
+                std::vector<std::string>{binToHex(bad->getHash())});
+    }
+}
+
+TEST_CASE("bucket merge scheduling", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    // a single merge slot, so that queued merges run one at a time
+    BucketMergeScheduler sched(*app, 1, 1, 0);
+    std::promise<void> unblock;
+    std::shared_future<void> unblocked(unblock.get_future());
+    std::mutex mutex;
+    std::vector<uint32_t> order;
+    std::vector<bool> limited;
+    std::promise<void> done;
+
+    auto record = [&](uint32_t level, uint32_t deadline) {
+        sched.schedule(MergePriority{level, deadline},
+                       [&, level](RateLimiter* limiter) {
+                           std::lock_guard<std::mutex> lock(mutex);
+                           order.push_back(level);
+                           limited.push_back(limiter != nullptr);
+                           if (order.size() == 4)
+                           {
+                               done.set_value();
+                           }
+                       });
+    };
+
+    sched.schedule(MergePriority{1, 0},
+                   [unblocked](RateLimiter*) { unblocked.wait(); });
+    record(7, 1000);
+    record(3, 100);
+    record(2, 10);
+    record(1, 10);
+    REQUIRE(sched.getQueueSize() == 4);
+
+    unblock.set_value();
+    done.get_future().wait();
+    // let the last merge finish its bookkeeping before the scheduler goes
+    app->joinAllThreads();
+    REQUIRE(order == std::vector<uint32_t>{1, 2, 3, 7});
+    REQUIRE(limited == std::vector<bool>{false, false, false, true});
+}
+
 TEST_CASE("bucketmanager ownership", "[bucket]")
 {
     VirtualClock clock;
@@ -701,6 +1410,126 @@ TEST_CASE("bucketmanager ownership", "[bucket]")
     CHECK(!fs::exists(filename));
 }
 
+TEST_CASE("bucketmanager collects buckets still in use later", "[bucket]")
+{
+    VirtualClock clock;
+    Config const& cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    std::vector<LedgerEntry> live(
+        LedgerTestUtils::generateValidLedgerEntries(10));
+    std::vector<LedgerKey> dead{};
+
+    auto b1 = Bucket::fresh(bm, live, dead);
+    auto filename = b1->getFilename();
+
+    // in use, so not dropped by this collection...
+    bm.forgetUnreferencedBuckets();
+    CHECK(fs::exists(filename));
+    CHECK(b1.use_count() == 2);
+
+    // ...nor the ones after while it is
+    live[0] = LedgerTestUtils::generateValidLedgerEntry(10);
+    auto b2 = Bucket::fresh(bm, live, dead);
+    b2.reset();
+    bm.forgetUnreferencedBuckets();
+    CHECK(fs::exists(filename));
+
+    // but by the first one once released
+    b1.reset();
+    bm.forgetUnreferencedBuckets();
+    CHECK(!fs::exists(filename));
+}
+
+TEST_CASE("shallow buckets kept in memory", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0));
+    cfg.IN_MEMORY_SHALLOW_BUCKETS = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& bm = app->getBucketManager();
+
+    VirtualClock fileClock;
+    Application::pointer fileApp =
+        createTestApplication(fileClock, getTestConfig(1));
+
+    BucketList inMemory, onFile;
+    autocheck::generator<std::vector<LedgerKey>> deadGen;
+    for (uint32_t i = 1; i < 140; ++i)
+    {
+        app->getClock().crank(false);
+        fileApp->getClock().crank(false);
+        auto live = LedgerTestUtils::generateValidLedgerEntries(8);
+        auto dead = deadGen(5);
+        inMemory.addBatch(*app, i, live, dead);
+        onFile.addBatch(*fileApp, i, live, dead);
+        REQUIRE(inMemory.getHash() == onFile.getHash());
+    }
+    clearFutures(app, inMemory);
+
+    for (uint32_t j = 0; j < BucketList::kNumLevels; ++j)
+    {
+        auto const& lev = inMemory.getLevel(j);
+        for (auto const& b : {lev.getCurr(), lev.getSnap()})
+        {
+            if (isZero(b->getHash()))
+            {
+                continue;
+            }
+            REQUIRE(b->isInMemory() == (j < BucketList::kInMemoryLevels));
+            REQUIRE(b->getFilename().empty() == b->isInMemory());
+        }
+    }
+
+    auto b = inMemory.getLevel(0).getCurr();
+    REQUIRE(b->isInMemory());
+    BucketEntry first = *BucketInputIterator(b);
+    auto key = first.type() == LIVEENTRY ? LedgerEntryKey(first.liveEntry())
+                                         : first.deadEntry();
+    REQUIRE(b->getBucketEntry(key));
+    REQUIRE(*b->getBucketEntry(key) == first);
+
+    // written out when needed, to the file the bucket would have had
+    bm.materializeBuckets({binToHex(b->getHash())});
+    auto written = bm.getBucketByHash(b->getHash());
+    REQUIRE(!written->isInMemory());
+    REQUIRE(fs::exists(written->getFilename()));
+    REQUIRE(written->countLiveAndDeadEntries() ==
+            b->countLiveAndDeadEntries());
+}
+
+TEST_CASE("shared bucket store", "[bucket]")
+{
+    TmpDir shared("shared-buckets");
+    Config cfg0(getTestConfig(0));
+    Config cfg1(getTestConfig(1));
+    cfg0.SHARED_BUCKET_DIR_PATH = shared.getName() + "/store";
+    cfg1.SHARED_BUCKET_DIR_PATH = cfg0.SHARED_BUCKET_DIR_PATH;
+
+    VirtualClock clock;
+    Application::pointer app0 = createTestApplication(clock, cfg0);
+    Application::pointer app1 = createTestApplication(clock, cfg1);
+
+    auto live = LedgerTestUtils::generateValidLedgerEntries(20);
+    auto b0 = Bucket::fresh(app0->getBucketManager(), live, {});
+    auto hexHash = binToHex(b0->getHash());
+    auto sharedName =
+        cfg0.SHARED_BUCKET_DIR_PATH + "/bucket-" + hexHash + ".xdr";
+    REQUIRE(fs::exists(sharedName));
+
+    HistoryArchiveState has;
+    has.currentBuckets.at(0).curr = hexHash;
+    REQUIRE(app1->getBucketManager().checkForMissingBucketsFiles(has).empty());
+
+    auto b1 = app1->getBucketManager().getBucketByHash(b0->getHash());
+    REQUIRE(b1);
+    REQUIRE(b1->getFilename() != b0->getFilename());
+    REQUIRE(fs::exists(b1->getFilename()));
+    REQUIRE(b1->countLiveAndDeadEntries() ==
+            std::make_pair(live.size(), size_t(0)));
+}
+
 TEST_CASE("single entry bubbling up", "[bucket][bucketbubble]")
 {
     VirtualClock clock;
@@ -895,6 +1724,182 @@ TEST_CASE("bucket persistence over app restart", "[bucket][bucketpersist]")
     }
 }
 
+TEST_CASE("restore database from buckets", "[bucket][bucketpersist]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+
+    LedgerHeaderHistoryEntry lcl;
+    auto alice = txtest::getAccount("alice");
+    {
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        auto root = TestAccount::createRoot(*app);
+        auto tx = root.tx({txtest::createAccount(alice.getPublicKey(),
+                                                 app->getLedgerManager()
+                                                     .getMinBalance(0))});
+        txtest::closeLedgerOn(*app, 2, 1, 1, 2018, {tx});
+        txtest::closeLedgerOn(*app, 3, 2, 1, 2018);
+        lcl = app->getLedgerManager().getLastClosedLedgerHeader();
+    }
+
+    SECTION("restores the last closed ledger")
+    {
+        SECTION("from the bucket directory")
+        {
+        }
+        SECTION("resuming an interrupted restore")
+        {
+            auto savedDir = cfg.BUCKET_DIR_PATH + "-restore";
+            REQUIRE(std::rename(cfg.BUCKET_DIR_PATH.c_str(),
+                                savedDir.c_str()) == 0);
+        }
+        auto app = restoreFromBuckets(clock, cfg);
+        REQUIRE(app);
+        auto& lm = app->getLedgerManager();
+        REQUIRE(lm.getLastClosedLedgerHeader().hash == lcl.hash);
+        REQUIRE(txtest::loadAccount(alice.getPublicKey(), *app, true));
+        REQUIRE(!fs::exists(cfg.BUCKET_DIR_PATH + "-restore"));
+    }
+
+    SECTION("fails without a saved ledger state")
+    {
+        auto xdrFile = cfg.BUCKET_DIR_PATH + "/last-closed-ledger.xdr";
+        std::remove(xdrFile.c_str());
+        REQUIRE(!restoreFromBuckets(clock, cfg));
+    }
+}
+
+TEST_CASE("restore from buckets on start", "[bucket][bucketpersist]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE));
+
+    LedgerHeaderHistoryEntry lcl;
+    std::vector<LedgerEntry> entries;
+    auto alice = txtest::getAccount("alice");
+    auto bob = txtest::getAccount("bob");
+    {
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        auto root = TestAccount::createRoot(*app);
+        auto minBalance = app->getLedgerManager().getMinBalance(0);
+        auto tx1 = root.tx(
+            {txtest::createAccount(alice.getPublicKey(), minBalance * 10)});
+        txtest::closeLedgerOn(*app, 2, 1, 1, 2018, {tx1});
+        auto tx2 = root.tx(
+            {txtest::createAccount(bob.getPublicKey(), minBalance * 10),
+             txtest::payment(alice.getPublicKey(), 1000)});
+        txtest::closeLedgerOn(*app, 3, 2, 1, 2018, {tx2});
+        txtest::closeLedgerOn(*app, 4, 3, 1, 2018);
+        lcl = app->getLedgerManager().getLastClosedLedgerHeader();
+        for (auto const& k : {root.getPublicKey(), alice.getPublicKey(),
+                              bob.getPublicKey()})
+        {
+            entries.emplace_back(txtest::loadAccount(k, *app)->mEntry);
+        }
+    }
+
+    cfg.RESTORE_FROM_BUCKETS_ON_START = true;
+
+    SECTION("restores the last closed ledger and its entries")
+    {
+        SECTION("into the database")
+        {
+        }
+        SECTION("with in-memory ledger state")
+        {
+            cfg.IN_MEMORY_LEDGER_STATE = true;
+            cfg.IN_MEMORY_ORDER_BOOK = true;
+        }
+        auto app = createApplicationOnStart(clock, cfg);
+        REQUIRE(app);
+        app->start();
+        auto& lm = app->getLedgerManager();
+        REQUIRE(lm.getLastClosedLedgerHeader().hash == lcl.hash);
+        REQUIRE(app->getBucketManager().getBucketList().getHash() ==
+                lcl.header.bucketListHash);
+        for (auto const& e : entries)
+        {
+            REQUIRE(EntryFrame::checkAgainstDatabase(e, app->getDatabase())
+                        .empty());
+            auto account =
+                txtest::loadAccount(e.data.account().accountID, *app);
+            REQUIRE(account->getBalance() == e.data.account().balance);
+            REQUIRE(account->getSeqNum() == e.data.account().seqNum);
+        }
+    }
+
+    SECTION("starts from the genesis ledger without a saved ledger state")
+    {
+        auto xdrFile = cfg.BUCKET_DIR_PATH + "/last-closed-ledger.xdr";
+        std::remove(xdrFile.c_str());
+        auto app = createApplicationOnStart(clock, cfg);
+        REQUIRE(app);
+        app->start();
+        REQUIRE(app->getLedgerManager().getLastClosedLedgerNum() ==
+                LedgerManager::GENESIS_LEDGER_SEQ);
+        REQUIRE(!txtest::loadAccount(alice.getPublicKey(), *app, false));
+    }
+
+    SECTION("requires an in-memory database")
+    {
+        cfg.DATABASE = SecretValue{"sqlite3://" + cfg.BUCKET_DIR_PATH +
+                                   "-on-disk.db"};
+        REQUIRE_THROWS_AS(createApplicationOnStart(clock, cfg),
+                          std::runtime_error);
+    }
+}
+
+TEST_CASE("recover ledgers lost by relaxed commits", "[bucket][bucketpersist]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    cfg.MANAGED_SQLITE = true;
+    cfg.DATABASE_DURABILITY = Config::DB_DURABILITY_RELAXED;
+
+    LedgerHeaderHistoryEntry kept, lost;
+    auto alice = txtest::getAccount("alice");
+    {
+        auto app = createTestApplication(clock, cfg);
+        app->start();
+        auto root = TestAccount::createRoot(*app);
+        txtest::closeLedgerOn(*app, 2, 1, 1, 2018);
+        kept = app->getLedgerManager().getLastClosedLedgerHeader();
+        auto tx = root.tx({txtest::createAccount(alice.getPublicKey(),
+                                                 app->getLedgerManager()
+                                                     .getMinBalance(0))});
+        txtest::closeLedgerOn(*app, 3, 2, 1, 2018, {tx});
+        lost = app->getLedgerManager().getLastClosedLedgerHeader();
+
+        // as if the commit of ledger 3 never reached the disk
+        auto& sess = app->getDatabase().getSession();
+        sess << "DELETE FROM accounts WHERE lastmodified = 3";
+        sess << "DELETE FROM ledgerheaders WHERE ledgerseq = 3";
+        app->getPersistentState().setState(PersistentState::kLastClosedLedger,
+                                           binToHex(kept.hash));
+    }
+
+    auto app = Application::create(clock, cfg, false);
+    SECTION("replays them from the buckets")
+    {
+        recoverLostLedgers(*app);
+        REQUIRE(app->getLedgerManager().getLastClosedLedgerHeader().hash ==
+                lost.hash);
+        REQUIRE(txtest::loadAccount(alice.getPublicKey(), *app, true));
+    }
+
+    SECTION("leaves the database as it is without a saved ledger state")
+    {
+        auto xdrFile = cfg.BUCKET_DIR_PATH + "/last-closed-ledger.xdr";
+        std::remove(xdrFile.c_str());
+        recoverLostLedgers(*app);
+        REQUIRE(app->getPersistentState().getState(
+                    PersistentState::kLastClosedLedger) ==
+                binToHex(kept.hash));
+    }
+}
+
 TEST_CASE("BucketList sizeOf* and oldestLedgerIn* relations", "[bucket][count]")
 {
     std::default_random_engine gen;
@@ -1039,7 +2044,7 @@ TEST_CASE("checkdb succeeding", "[bucket][checkdb]")
     std::vector<stellar::LedgerKey> emptySet;
 
     // Create accounts
-    app->generateLoad(true, 1000, 0, 0, 1000, 100, false);
+    app->generateLoad(LoadGenMode::CREATE, 1000, 0, 0, 1000, 100, false);
     auto& m = app->getMetrics();
     while (m.NewMeter({"loadgen", "run", "complete"}, "run").count() == 0)
     {
@@ -1109,6 +2114,299 @@ TEST_CASE("bucket apply", "[bucket]")
     REQUIRE(count == 1);
 }
 
+TEST_CASE("bucket apply overwrites existing entries", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    std::vector<LedgerEntry> live, noLive;
+    std::vector<LedgerKey> noDead;
+    for (int i = 0; i < 300; i++)
+    {
+        LedgerEntry e;
+        e.data.type(i % 2 ? ACCOUNT : OFFER);
+        if (e.data.type() == ACCOUNT)
+        {
+            e.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+        }
+        else
+        {
+            e.data.offer() = LedgerTestUtils::generateValidOfferEntry(5);
+            e.data.offer().offerID = i + 1;
+        }
+        live.emplace_back(e);
+    }
+
+    auto& db = app->getDatabase();
+    Bucket::fresh(app->getBucketManager(), live, noDead)->apply(db);
+
+    // same keys, new values (including signers)
+    std::vector<LedgerKey> dead;
+    for (auto& e : live)
+    {
+        if (e.data.type() == ACCOUNT)
+        {
+            auto id = e.data.account().accountID;
+            e.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+            e.data.account().accountID = id;
+        }
+        else
+        {
+            e.data.offer().amount = e.data.offer().amount / 2 + 1;
+        }
+    }
+    Bucket::fresh(app->getBucketManager(), live, noDead)->apply(db);
+    for (auto const& e : live)
+    {
+        REQUIRE(EntryFrame::checkAgainstDatabase(e, db).empty());
+        dead.emplace_back(LedgerEntryKey(e));
+    }
+
+    Bucket::fresh(app->getBucketManager(), noLive, dead)->apply(db);
+    auto& sess = db.getSession();
+    REQUIRE(AccountFrame::countObjects(sess) == 1 /* root account */);
+    REQUIRE(OfferFrame::countObjects(sess) == 0);
+}
+
+#ifdef USE_POSTGRES
+// entries of every type, offers with distinct ids
+static std::vector<LedgerEntry>
+generateBulkLoadEntries(int n)
+{
+    std::vector<LedgerEntry> live;
+    for (int i = 0; i < n; i++)
+    {
+        LedgerEntry e;
+        e.data.type(static_cast<LedgerEntryType>(i % 4));
+        switch (e.data.type())
+        {
+        case ACCOUNT:
+            e.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+            break;
+        case TRUSTLINE:
+            e.data.trustLine() =
+                LedgerTestUtils::generateValidTrustLineEntry(5);
+            break;
+        case OFFER:
+            e.data.offer() = LedgerTestUtils::generateValidOfferEntry(5);
+            e.data.offer().offerID = i + 1;
+            break;
+        case DATA:
+            e.data.data() = LedgerTestUtils::generateValidDataEntry(5);
+            break;
+        }
+        live.emplace_back(e);
+    }
+    return live;
+}
+
+static char const* const kBulkLoadTables[] = {"accounts", "signers",
+                                              "trustlines", "offers",
+                                              "accountdata"};
+
+// empties the ledger entry tables, and whatever caches their content
+static void
+clearBulkLoadTables(Database& db)
+{
+    for (auto table : kBulkLoadTables)
+    {
+        db.getSession() << "DELETE FROM " << table;
+    }
+    db.getEntryCache().clear();
+    if (auto orderBook = db.getOrderBook())
+    {
+        orderBook->clear();
+    }
+    if (auto tally = db.getInflationVoteTally())
+    {
+        tally->clear();
+    }
+}
+
+// every row of the table, as text, in a stable order
+static std::string
+dumpTable(Database& db, std::string const& table)
+{
+    std::string rows;
+    soci::indicator ind;
+    db.getSession() << "SELECT string_agg(t::text, E'\\n' ORDER BY t::text) "
+                       "FROM "
+                    << table << " t",
+        soci::into(rows, ind);
+    return ind == soci::i_ok ? rows : std::string();
+}
+
+// definitions of the indexes of the table, in a stable order
+static std::string
+dumpIndexes(Database& db, std::string const& table)
+{
+    std::string defs;
+    soci::indicator ind;
+    db.getSession() << "SELECT string_agg(indexdef, E'\\n' ORDER BY "
+                       "indexname) FROM pg_indexes WHERE schemaname = "
+                       "current_schema() AND tablename = :t",
+        soci::into(defs, ind), soci::use(table);
+    return ind == soci::i_ok ? defs : std::string();
+}
+
+TEST_CASE("bucket apply with bulk load", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_POSTGRESQL));
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto& sess = db.getSession();
+    sess << "DELETE FROM accounts";
+    sess << "DELETE FROM signers";
+    db.getEntryCache().clear();
+
+    auto countIndexes = [&]() {
+        int n = 0;
+        sess << "SELECT COUNT(*) FROM pg_indexes WHERE schemaname = "
+                "current_schema()",
+            soci::into(n);
+        return n;
+    };
+    auto indexesBefore = countIndexes();
+
+    auto live = generateBulkLoadEntries(100);
+    std::vector<LedgerKey> noDead;
+
+    auto bucket = Bucket::fresh(app->getBucketManager(), live, noDead);
+    BucketApplicator applicator(db, bucket, true);
+    while (applicator)
+    {
+        applicator.advance();
+    }
+
+    for (auto const& e : live)
+    {
+        REQUIRE(EntryFrame::checkAgainstDatabase(e, db).empty());
+    }
+    REQUIRE(countIndexes() == indexesBefore);
+
+    SECTION("tables are not empty anymore: regular apply")
+    {
+        for (auto& e : live)
+        {
+            if (e.data.type() == OFFER)
+            {
+                e.data.offer().amount = e.data.offer().amount / 2 + 1;
+            }
+        }
+        bucket = Bucket::fresh(app->getBucketManager(), live, noDead);
+        BucketApplicator applicator2(db, bucket, true);
+        while (applicator2)
+        {
+            applicator2.advance();
+        }
+        for (auto const& e : live)
+        {
+            REQUIRE(EntryFrame::checkAgainstDatabase(e, db).empty());
+        }
+    }
+}
+TEST_CASE("bucket bulk load matches row by row apply", "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_POSTGRESQL));
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto live = generateBulkLoadEntries(200);
+    std::vector<LedgerKey> noDead;
+    auto bucket = Bucket::fresh(app->getBucketManager(), live, noDead);
+
+    auto applyAndDump = [&](bool allowBulkLoad) {
+        clearBulkLoadTables(db);
+        BucketApplicator applicator(db, bucket, allowBulkLoad);
+        while (applicator)
+        {
+            applicator.advance();
+        }
+        std::map<std::string, std::pair<std::string, std::string>> res;
+        for (auto table : kBulkLoadTables)
+        {
+            res[table] =
+                std::make_pair(dumpTable(db, table), dumpIndexes(db, table));
+        }
+        return res;
+    };
+
+    std::map<std::string, std::string> indexesBefore;
+    for (auto table : kBulkLoadTables)
+    {
+        indexesBefore[table] = dumpIndexes(db, table);
+    }
+
+    auto bulk = applyAndDump(true);
+    auto rowByRow = applyAndDump(false);
+    for (auto table : kBulkLoadTables)
+    {
+        INFO(table);
+        REQUIRE(!bulk[table].first.empty());
+        REQUIRE(bulk[table].first == rowByRow[table].first);
+        REQUIRE(bulk[table].second == rowByRow[table].second);
+        REQUIRE(bulk[table].second == indexesBefore[table]);
+    }
+}
+
+TEST_CASE("bucket bulk load failure falls back to row by row apply",
+          "[bucket]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_POSTGRESQL));
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto& sess = db.getSession();
+    clearBulkLoadTables(db);
+
+    std::map<std::string, std::string> indexesBefore;
+    for (auto table : kBulkLoadTables)
+    {
+        indexesBefore[table] = dumpIndexes(db, table);
+    }
+    REQUIRE(!indexesBefore["trustlines"].empty());
+
+    // refuses COPY into trustlines, but not the inserts of the regular apply
+    sess << "CREATE OR REPLACE FUNCTION test_refuse_copy() RETURNS trigger "
+            "AS $$ BEGIN IF current_query() LIKE 'COPY%' THEN RAISE "
+            "EXCEPTION 'COPY refused'; END IF; RETURN NULL; END $$ "
+            "LANGUAGE plpgsql";
+    sess << "CREATE TRIGGER test_refuse_copy BEFORE INSERT ON trustlines "
+            "FOR EACH STATEMENT EXECUTE PROCEDURE test_refuse_copy()";
+
+    auto live = generateBulkLoadEntries(100);
+    std::vector<LedgerKey> noDead;
+    auto bucket = Bucket::fresh(app->getBucketManager(), live, noDead);
+    BucketApplicator applicator(db, bucket, true);
+    while (applicator)
+    {
+        applicator.advance();
+    }
+
+    sess << "DROP TRIGGER test_refuse_copy ON trustlines";
+    sess << "DROP FUNCTION test_refuse_copy()";
+
+    for (auto const& e : live)
+    {
+        REQUIRE(EntryFrame::checkAgainstDatabase(e, db).empty());
+    }
+    for (auto table : kBulkLoadTables)
+    {
+        INFO(table);
+        REQUIRE(dumpIndexes(db, table) == indexesBefore[table]);
+    }
+}
+#endif
+
 TEST_CASE("bucket apply bench", "[bucketbench][!hide]")
 {
     auto runtest = [](Config::TestDbMode mode) {
@@ -8,6 +8,7 @@
 #include "util/asio.h"
 
 #include "bucket/Bucket.h"
+#include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "bucket/FutureBucket.h"
 #include "crypto/Hex.h"
@@ -23,7 +24,7 @@ FutureBucket::FutureBucket(Application& app,
                            std::shared_ptr<Bucket> const& curr,
                            std::shared_ptr<Bucket> const& snap,
                            std::vector<std::shared_ptr<Bucket>> const& shadows,
-                           bool keepDeadEntries)
+                           bool keepDeadEntries, MergePriority priority)
     : mState(FB_LIVE_INPUTS)
     , mInputCurrBucket(curr)
     , mInputSnapBucket(snap)
@@ -40,7 +41,7 @@ FutureBucket::FutureBucket(Application& app,
     {
         mInputShadowBucketHashes.push_back(binToHex(b->getHash()));
     }
-    startMerge(app, keepDeadEntries);
+    startMerge(app, keepDeadEntries, priority);
 }
 
 void
@@ -244,7 +245,8 @@ FutureBucket::getOutputHash() const
 }
 
 void
-FutureBucket::startMerge(Application& app, bool keepDeadEntries)
+FutureBucket::startMerge(Application& app, bool keepDeadEntries,
+                         MergePriority priority)
 {
     // NB: startMerge starts with FutureBucket in a half-valid state; the inputs
     // are live but the merge is not yet running. So you can't call checkState()
@@ -265,15 +267,18 @@ FutureBucket::startMerge(Application& app, bool keepDeadEntries)
                           << " with snap=" << hexAbbrev(snap->getHash());
 
     BucketManager& bm = app.getBucketManager();
+    bool inMemory = BucketList::keepInMemory(app, priority.mLevel);
 
-    using task_t = std::packaged_task<std::shared_ptr<Bucket>()>;
-    std::shared_ptr<task_t> task =
-        std::make_shared<task_t>([curr, snap, &bm, shadows, keepDeadEntries]() {
+    using task_t = std::packaged_task<std::shared_ptr<Bucket>(RateLimiter*)>;
+    std::shared_ptr<task_t> task = std::make_shared<task_t>(
+        [curr, snap, &bm, shadows, keepDeadEntries,
+         inMemory](RateLimiter* limiter) {
             CLOG(TRACE, "Bucket")
                 << "Worker merging curr=" << hexAbbrev(curr->getHash())
                 << " with snap=" << hexAbbrev(snap->getHash());
 
-            auto res = Bucket::merge(bm, curr, snap, shadows, keepDeadEntries);
+            auto res = Bucket::merge(bm, curr, snap, shadows, keepDeadEntries,
+                                     limiter, inMemory);
 
             CLOG(TRACE, "Bucket")
                 << "Worker finished merging curr=" << hexAbbrev(curr->getHash())
@@ -283,12 +288,14 @@ FutureBucket::startMerge(Application& app, bool keepDeadEntries)
         });
 
     mOutputBucket = task->get_future().share();
-    app.getWorkerIOService().post(bind(&task_t::operator(), task));
+    bm.getMergeScheduler().schedule(
+        priority, [task](RateLimiter* limiter) { (*task)(limiter); });
     checkState();
 }
 
 void
-FutureBucket::makeLive(Application& app, bool keepDeadEntries)
+FutureBucket::makeLive(Application& app, bool keepDeadEntries,
+                       MergePriority priority)
 {
     checkState();
     assert(!isLive());
@@ -314,7 +321,7 @@ FutureBucket::makeLive(Application& app, bool keepDeadEntries)
             mInputShadowBuckets.push_back(b);
         }
         mState = FB_LIVE_INPUTS;
-        startMerge(app, keepDeadEntries);
+        startMerge(app, keepDeadEntries, priority);
         assert(isLive());
     }
 }
@@ -341,4 +348,20 @@ FutureBucket::getHashes() const
     }
     return hashes;
 }
+
+std::string
+FutureBucket::getPartialMergeFilename(std::string const& bucketDir,
+                                      bool keepDeadEntries) const
+{
+    if (mState != FB_HASH_INPUTS && mState != FB_LIVE_INPUTS)
+    {
+        return std::string();
+    }
+    // as Bucket::merge(curr, snap, shadows) names it
+    std::vector<std::string> inputs{mInputCurrBucketHash,
+                                    mInputSnapBucketHash};
+    inputs.insert(inputs.end(), mInputShadowBucketHashes.begin(),
+                  mInputShadowBucketHashes.end());
+    return Bucket::partialMergeFilename(bucketDir, inputs, keepDeadEntries);
+}
 }
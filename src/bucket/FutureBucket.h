@@ -4,6 +4,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "bucket/BucketMergeScheduler.h"
 #include "overlay/StellarXDR.h"
 #include <cereal/cereal.hpp>
 #include <future>
@@ -73,7 +74,8 @@ class FutureBucket
 
     void checkHashesMatch() const;
     void checkState() const;
-    void startMerge(Application& app, bool keepDeadEntries);
+    void startMerge(Application& app, bool keepDeadEntries,
+                    MergePriority priority);
 
     void clearInputs();
     void clearOutput();
@@ -83,7 +85,7 @@ class FutureBucket
     FutureBucket(Application& app, std::shared_ptr<Bucket> const& curr,
                  std::shared_ptr<Bucket> const& snap,
                  std::vector<std::shared_ptr<Bucket>> const& shadows,
-                 bool keepDeadEntries);
+                 bool keepDeadEntries, MergePriority priority);
 
     FutureBucket() = default;
     FutureBucket(FutureBucket const& other) = default;
@@ -115,11 +117,17 @@ class FutureBucket
     std::shared_ptr<Bucket> resolve();
 
     // Precondition: !isLive(); transitions from FB_HASH_FOO to FB_LIVE_FOO
-    void makeLive(Application& app, bool keepDeadEntries);
+    void makeLive(Application& app, bool keepDeadEntries,
+                  MergePriority priority);
 
     // Return all hashes referenced by this future.
     std::vector<std::string> getHashes() const;
 
+    // The partial output file of the merge this future is (or will be, once
+    // made live) running, or an empty string when it has no inputs.
+    std::string getPartialMergeFilename(std::string const& bucketDir,
+                                        bool keepDeadEntries) const;
+
     template <class Archive>
     void
     load(Archive& ar)
@@ -0,0 +1,135 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/LedgerCmp.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+namespace
+{
+// Appends to the bytes of a key, dropping what does not fit.
+class KeyWriter
+{
+    std::array<uint8_t, 56>& mBytes;
+    size_t mPos{0};
+    bool mTruncated{false};
+
+  public:
+    explicit KeyWriter(std::array<uint8_t, 56>& bytes) : mBytes(bytes)
+    {
+    }
+
+    void
+    put(uint8_t const* data, size_t size)
+    {
+        auto n = std::min(size, mBytes.size() - mPos);
+        std::copy(data, data + n, mBytes.begin() + mPos);
+        mPos += n;
+        mTruncated = mTruncated || n != size;
+    }
+
+    // the enums and unions discriminants of the identities are small and
+    // not negative
+    void
+    putByte(int32_t b)
+    {
+        auto v = static_cast<uint8_t>(b);
+        put(&v, 1);
+    }
+
+    void
+    putAccount(AccountID const& a)
+    {
+        putByte(a.type());
+        put(a.ed25519().data(), a.ed25519().size());
+    }
+
+    // big endian, to order like the (unsigned) values
+    void
+    putUint64(uint64_t u)
+    {
+        uint8_t bytes[8];
+        for (int i = 7; i >= 0; --i)
+        {
+            bytes[i] = static_cast<uint8_t>(u);
+            u >>= 8;
+        }
+        put(bytes, sizeof(bytes));
+    }
+
+    void
+    putAsset(Asset const& a)
+    {
+        putByte(a.type());
+        switch (a.type())
+        {
+        case ASSET_TYPE_NATIVE:
+            break;
+        case ASSET_TYPE_CREDIT_ALPHANUM4:
+            put(a.alphaNum4().assetCode.data(),
+                a.alphaNum4().assetCode.size());
+            putAccount(a.alphaNum4().issuer);
+            break;
+        case ASSET_TYPE_CREDIT_ALPHANUM12:
+            put(a.alphaNum12().assetCode.data(),
+                a.alphaNum12().assetCode.size());
+            putAccount(a.alphaNum12().issuer);
+            break;
+        }
+    }
+
+    bool
+    truncated() const
+    {
+        return mTruncated;
+    }
+};
+
+template <typename T>
+bool
+fillKey(std::array<uint8_t, 56>& bytes, T const& e)
+{
+    KeyWriter w(bytes);
+    w.putByte(e.type());
+    switch (e.type())
+    {
+    case ACCOUNT:
+        w.putAccount(e.account().accountID);
+        return !w.truncated();
+    case TRUSTLINE:
+        w.putAccount(e.trustLine().accountID);
+        w.putAsset(e.trustLine().asset);
+        return !w.truncated();
+    case OFFER:
+        w.putAccount(e.offer().sellerID);
+        w.putUint64(e.offer().offerID);
+        return !w.truncated();
+    case DATA:
+    {
+        w.putAccount(e.data().accountID);
+        auto const& name = e.data().dataName;
+        w.put(reinterpret_cast<uint8_t const*>(name.data()), name.size());
+        // padded with zeros, which names may end with too
+        return false;
+    }
+    }
+    return false;
+}
+}
+
+BucketEntrySortKey::BucketEntrySortKey() : mComplete(false)
+{
+    mBytes.fill(0);
+}
+
+BucketEntrySortKey::BucketEntrySortKey(BucketEntry const& e)
+    : BucketEntrySortKey()
+{
+    mComplete = e.type() == LIVEENTRY ? fillKey(mBytes, e.liveEntry().data)
+                                      : fillKey(mBytes, e.deadEntry());
+}
+}
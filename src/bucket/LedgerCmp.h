@@ -8,6 +8,10 @@
 #include "overlay/StellarXDR.h"
 #include "util/XDROperators.h"
 
+#include <array>
+#include <cstdint>
+#include <cstring>
+
 namespace stellar
 {
 /**
@@ -125,4 +129,44 @@ struct BucketEntryIdCmp
         }
     }
 };
+
+/**
+ * A fixed-width prefix of the identity of a BucketEntry, bytewise comparable:
+ * the entry type, account, then offer ID, asset or data name, as many bytes
+ * of them as fit. Two keys that differ order their entries like
+ * BucketEntryIdCmp; equal keys only mean equal identities when complete (for
+ * accounts, offers and native trustlines), the entries have to be compared
+ * otherwise.
+ *
+ * Computed once per entry read by the iterators of a merge, which then
+ * compare entries with BucketEntrySortKeyCmp.
+ */
+struct BucketEntrySortKey
+{
+    std::array<uint8_t, 56> mBytes;
+    bool mComplete;
+
+    BucketEntrySortKey();
+    explicit BucketEntrySortKey(BucketEntry const& e);
+};
+
+struct BucketEntrySortKeyCmp
+{
+    bool
+    operator()(BucketEntry const& a, BucketEntrySortKey const& ak,
+               BucketEntry const& b, BucketEntrySortKey const& bk) const
+    {
+        int c = std::memcmp(ak.mBytes.data(), bk.mBytes.data(),
+                            ak.mBytes.size());
+        if (c != 0)
+        {
+            return c < 0;
+        }
+        if (ak.mComplete && bk.mComplete)
+        {
+            return false;
+        }
+        return BucketEntryIdCmp{}(a, b);
+    }
+};
 }
@@ -7,6 +7,8 @@
 #include "bucket/BucketApplicator.h"
 #include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
+#include "catchup/CatchupManager.h"
+#include "catchup/DownloadBucketsWork.h"
 #include "crypto/Hex.h"
 #include "crypto/SecretKey.h"
 #include "history/HistoryArchive.h"
@@ -22,16 +24,41 @@
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
+#include <chrono>
+
 namespace stellar
 {
 
+std::chrono::milliseconds const ApplyBucketsWork::APPLY_TIME_SLICE(50);
+
 ApplyBucketsWork::ApplyBucketsWork(
     Application& app, WorkParent& parent,
-    std::map<std::string, std::shared_ptr<Bucket>> const& buckets,
+    std::map<std::string, std::shared_ptr<Bucket>>& buckets,
     HistoryArchiveState const& applyState)
+    : ApplyBucketsWork(app, parent, buckets, applyState, {}, nullptr)
+{
+}
+
+ApplyBucketsWork::ApplyBucketsWork(
+    Application& app, WorkParent& parent,
+    std::map<std::string, std::shared_ptr<Bucket>>& buckets,
+    HistoryArchiveState const& applyState,
+    std::vector<std::string> hashesToDownload, TmpDir const& downloadDir)
+    : ApplyBucketsWork(app, parent, buckets, applyState,
+                       std::move(hashesToDownload), &downloadDir)
+{
+}
+
+ApplyBucketsWork::ApplyBucketsWork(
+    Application& app, WorkParent& parent,
+    std::map<std::string, std::shared_ptr<Bucket>>& buckets,
+    HistoryArchiveState const& applyState,
+    std::vector<std::string> hashesToDownload, TmpDir const* downloadDir)
     : Work(app, parent, std::string("apply-buckets"))
     , mBuckets(buckets)
     , mApplyState(applyState)
+    , mHashesToDownload(std::move(hashesToDownload))
+    , mDownloadDir(downloadDir)
     , mApplying(false)
     , mLevel(BucketList::kNumLevels - 1)
     , mBucketApplyStart(app.getMetrics().NewMeter(
@@ -65,20 +92,72 @@ ApplyBucketsWork::getBucket(std::string const& hash)
     return b;
 }
 
+bool
+ApplyBucketsWork::haveBucket(std::string const& hash)
+{
+    return mBuckets.find(hash) != mBuckets.end() ||
+           mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
+}
+
+bool
+ApplyBucketsWork::canStartLevel()
+{
+    if (!mDownloadBucketsWork ||
+        mDownloadBucketsWork->getState() == WORK_SUCCESS)
+    {
+        return true;
+    }
+    if (mLevel == 0)
+    {
+        return false;
+    }
+    HistoryStateBucket const& i = mApplyState.currentBuckets.at(mLevel);
+    return haveBucket(i.snap) && haveBucket(i.curr);
+}
+
+std::string
+ApplyBucketsWork::getStatus() const
+{
+    if (mState == WORK_RUNNING && mDownloadBucketsWork &&
+        mDownloadBucketsWork->getState() != WORK_SUCCESS)
+    {
+        return fmt::format("downloading buckets, applying level {:d}",
+                           mLevel);
+    }
+    return Work::getStatus();
+}
+
 void
 ApplyBucketsWork::onReset()
 {
     mLevel = BucketList::kNumLevels - 1;
     mApplying = false;
+    mLevelStarted = false;
+    mWaitingForDownload = false;
     mSnapBucket.reset();
     mCurrBucket.reset();
     mSnapApplicator.reset();
     mCurrApplicator.reset();
+    clearChildren();
+    mDownloadBucketsWork.reset();
 }
 
 void
 ApplyBucketsWork::onStart()
 {
+    if (mDownloadDir && !mDownloadBucketsWork)
+    {
+        mDownloadBucketsWork = addWork<DownloadBucketsWork>(
+            mBuckets, mHashesToDownload, *mDownloadDir);
+        // this work is not pending, so it does not advance its children
+        mDownloadBucketsWork->advance();
+    }
+}
+
+void
+ApplyBucketsWork::startLevel()
+{
+    mLevelStarted = true;
     auto& level = getBucketLevel(mLevel);
     HistoryStateBucket const& i = mApplyState.currentBuckets.at(mLevel);
 
@@ -104,8 +183,8 @@ ApplyBucketsWork::onStart()
     if (mApplying || applySnap)
     {
         mSnapBucket = getBucket(i.snap);
-        mSnapApplicator =
-            std::make_unique<BucketApplicator>(mApp.getDatabase(), mSnapBucket);
+        mSnapApplicator = std::make_unique<BucketApplicator>(
+            mApp.getDatabase(), mSnapBucket, true);
         CLOG(DEBUG, "History") << "ApplyBuckets : starting level[" << mLevel
                                << "].snap = " << i.snap;
         mApplying = true;
@@ -114,8 +193,8 @@ ApplyBucketsWork::onStart()
     if (mApplying || applyCurr)
     {
         mCurrBucket = getBucket(i.curr);
-        mCurrApplicator =
-            std::make_unique<BucketApplicator>(mApp.getDatabase(), mCurrBucket);
+        mCurrApplicator = std::make_unique<BucketApplicator>(
+            mApp.getDatabase(), mCurrBucket, true);
         CLOG(DEBUG, "History") << "ApplyBuckets : starting level[" << mLevel
                                << "].curr = " << i.curr;
         mApplying = true;
@@ -126,24 +205,46 @@ ApplyBucketsWork::onStart()
 void
 ApplyBucketsWork::onRun()
 {
+    if (anyChildFatalFailure())
+    {
+        scheduleFatalFailure();
+        return;
+    }
+    if (anyChildRaiseFailure())
+    {
+        scheduleFailure();
+        return;
+    }
+    if (!mLevelStarted)
+    {
+        if (!canStartLevel())
+        {
+            // run again by notify() once more buckets are there
+            CLOG(DEBUG, "History") << "ApplyBuckets : level[" << mLevel
+                                   << "] waiting for downloads";
+            mWaitingForDownload = true;
+            return;
+        }
+        startLevel();
+    }
+
     // The structure of these if statements is motivated by the following:
     // 1. mCurrApplicator should never be advanced if mSnapApplicator is
     //    not false. Otherwise it is possible for curr to modify the
     //    database when the invariants for snap are checked.
     // 2. There is no reason to advance mSnapApplicator or mCurrApplicator
     //    if there is nothing to be applied.
-    if (mSnapApplicator)
+    BucketApplicator* applicator =
+        mSnapApplicator ? mSnapApplicator.get() : mCurrApplicator.get();
+    if (applicator)
     {
-        if (*mSnapApplicator)
+        // Each advance() only applies a few hundred entries; going through
+        // the work scheduler between every one of them dominates the apply
+        // time of large buckets, so keep going for a time slice.
+        auto deadline = std::chrono::steady_clock::now() + APPLY_TIME_SLICE;
+        while (*applicator && std::chrono::steady_clock::now() < deadline)
         {
-            mSnapApplicator->advance();
-        }
-    }
-    else if (mCurrApplicator)
-    {
-        if (*mCurrApplicator)
-        {
-            mCurrApplicator->advance();
+            applicator->advance();
         }
     }
     scheduleSuccess();
@@ -179,12 +280,18 @@ ApplyBucketsWork::onSuccess()
         mBucketApplySuccess.Mark();
     }
 
+    // deeper levels, applied first, are by far the biggest: this is a
+    // pessimistic measure of the throughput
+    mApp.getCatchupManager().reportProgress(
+        "apply-buckets", BucketList::kNumLevels - mLevel,
+        BucketList::kNumLevels);
     if (mLevel != 0)
     {
         --mLevel;
+        mLevelStarted = false;
         CLOG(DEBUG, "History")
             << "ApplyBuckets : starting next level: " << mLevel;
-        return WORK_PENDING;
+        return WORK_RUNNING;
     }
 
     CLOG(DEBUG, "History") << "ApplyBuckets : done, restarting merges";
@@ -205,4 +312,20 @@ ApplyBucketsWork::onFailureRaise()
     mBucketApplyFailure.Mark();
     Work::onFailureRaise();
 }
+
+void
+ApplyBucketsWork::notify(std::string const& child)
+{
+    if (mChildren.find(child) == mChildren.end())
+    {
+        CLOG(WARNING, "Work")
+            << "ApplyBucketsWork notified by unknown child " << child;
+        return;
+    }
+    if (mWaitingForDownload)
+    {
+        mWaitingForDownload = false;
+        scheduleRun();
+    }
+}
 }
@@ -5,6 +5,9 @@
 #pragma once
 
 #include "work/Work.h"
+#include <chrono>
+#include <string>
+#include <vector>
 
 namespace medida
 {
@@ -18,16 +21,38 @@ class BucketApplicator;
 class BucketLevel;
 class BucketList;
 class Bucket;
+class DownloadBucketsWork;
+class TmpDir;
 struct HistoryArchiveState;
 struct LedgerHeaderHistoryEntry;
 
+/**
+ * Applies the buckets of a HistoryArchiveState to the database, deepest
+ * level first, then assumes it as the bucket list.
+ *
+ * During catchup, it also downloads the buckets that are not there (with a
+ * DownloadBucketsWork child, which fetches the deepest levels first), and
+ * each level is applied as soon as its buckets are there, while the
+ * downloads of the next levels go on. The last level waits for all the
+ * downloads, as the outputs of pending merges are needed to assume the
+ * state.
+ */
 class ApplyBucketsWork : public Work
 {
-    std::map<std::string, std::shared_ptr<Bucket>> const& mBuckets;
+    // how long each run of the work keeps applying bucket entries
+    static std::chrono::milliseconds const APPLY_TIME_SLICE;
+
+    std::map<std::string, std::shared_ptr<Bucket>>& mBuckets;
     const HistoryArchiveState& mApplyState;
+    std::vector<std::string> const mHashesToDownload;
+    TmpDir const* const mDownloadDir;
+    std::shared_ptr<DownloadBucketsWork> mDownloadBucketsWork;
 
     bool mApplying;
     uint32_t mLevel;
+    // whether the applicators of mLevel were made
+    bool mLevelStarted{false};
+    bool mWaitingForDownload{false};
     std::shared_ptr<Bucket const> mSnapBucket;
     std::shared_ptr<Bucket const> mCurrBucket;
     std::unique_ptr<BucketApplicator> mSnapApplicator;
@@ -38,20 +63,37 @@ class ApplyBucketsWork : public Work
     medida::Meter& mBucketApplyFailure;
 
     std::shared_ptr<Bucket const> getBucket(std::string const& bucketHash);
+    bool haveBucket(std::string const& bucketHash);
+    bool canStartLevel();
+    void startLevel();
     BucketLevel& getBucketLevel(uint32_t level);
 
+    ApplyBucketsWork(Application& app, WorkParent& parent,
+                     std::map<std::string, std::shared_ptr<Bucket>>& buckets,
+                     HistoryArchiveState const& applyState,
+                     std::vector<std::string> hashesToDownload,
+                     TmpDir const* downloadDir);
+
   public:
-    ApplyBucketsWork(
-        Application& app, WorkParent& parent,
-        std::map<std::string, std::shared_ptr<Bucket>> const& buckets,
-        HistoryArchiveState const& applyState);
+    ApplyBucketsWork(Application& app, WorkParent& parent,
+                     std::map<std::string, std::shared_ptr<Bucket>>& buckets,
+                     HistoryArchiveState const& applyState);
+    // downloads the buckets of @p hashesToDownload to @p downloadDir first,
+    // in that order
+    ApplyBucketsWork(Application& app, WorkParent& parent,
+                     std::map<std::string, std::shared_ptr<Bucket>>& buckets,
+                     HistoryArchiveState const& applyState,
+                     std::vector<std::string> hashesToDownload,
+                     TmpDir const& downloadDir);
     ~ApplyBucketsWork();
 
+    std::string getStatus() const override;
     void onReset() override;
     void onStart() override;
     void onRun() override;
     Work::State onSuccess() override;
     void onFailureRetry() override;
     void onFailureRaise() override;
+    void notify(std::string const& child) override;
 };
 }
@@ -3,14 +3,21 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/ApplyLedgerChainWork.h"
+#include "catchup/CatchupManager.h"
+#include "crypto/SecretKey.h"
 #include "herder/LedgerCloseData.h"
 #include "history/FileTransferInfo.h"
+#include "history/HistoryCache.h"
 #include "history/HistoryManager.h"
+#include "historywork/GetAndUnzipRemoteFileWork.h"
 #include "historywork/Progress.h"
 #include "ledger/CheckpointRange.h"
 #include "ledger/LedgerManager.h"
 #include "lib/xdrpp/xdrpp/printer.h"
 #include "main/Application.h"
+#include "transactions/TransactionFrame.h"
+#include "util/SamplingProfiler.h"
+#include "util/XDRStream.h"
 #include "util/format.h"
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
@@ -18,6 +25,79 @@
 namespace stellar
 {
 
+namespace
+{
+struct DecodedLedger
+{
+    LedgerHeaderHistoryEntry mHeader;
+    // hashed; the empty set when the checkpoint has no transactions for
+    // this ledger
+    TxSetFramePtr mTxSet;
+};
+
+// Reads the ledgers of a checkpoint and their transaction sets, verifying
+// the signatures of the transactions from ledger @p firstToApply: older
+// ones are only checked to knit up with the LCL.
+std::vector<DecodedLedger>
+decodeCheckpoint(Hash const& networkID, std::string const& hdrFile,
+                 std::string const& txFile, uint32_t firstToApply)
+{
+    XDRInputFileStream hdrIn;
+    XDRInputFileStream txIn;
+    hdrIn.open(hdrFile);
+    txIn.open(txFile);
+
+    std::vector<DecodedLedger> res;
+    TransactionHistoryEntry txEntry;
+    bool haveTx = txIn.readOne(txEntry);
+    LedgerHeaderHistoryEntry hHeader;
+    while (hdrIn.readOne(hHeader))
+    {
+        auto seq = hHeader.header.ledgerSeq;
+        // in ledger order, ledgers without transactions have no entry
+        while (haveTx && txEntry.ledgerSeq < seq)
+        {
+            haveTx = txIn.readOne(txEntry);
+        }
+        DecodedLedger ledger;
+        ledger.mHeader = hHeader;
+        if (haveTx && txEntry.ledgerSeq == seq)
+        {
+            ledger.mTxSet =
+                std::make_shared<TxSetFrame>(networkID, txEntry.txSet);
+        }
+        else
+        {
+            // a set that applies is on the LCL, checked when applying
+            ledger.mTxSet =
+                std::make_shared<TxSetFrame>(hHeader.header.previousLedgerHash);
+        }
+        ledger.mTxSet->getContentsHash();
+
+        if (seq >= firstToApply)
+        {
+            std::vector<PubKeyUtils::SigToVerify> sigs;
+            for (auto const& tx : ledger.mTxSet->mTransactions)
+            {
+                tx->getContentsHash();
+                tx->getSignaturesToVerify(sigs);
+            }
+            PubKeyUtils::verifySigBatch(sigs);
+        }
+        res.emplace_back(std::move(ledger));
+    }
+    return res;
+}
+}
+
+struct ApplyLedgerChainWork::DecodedCheckpoint
+{
+    std::vector<DecodedLedger> mLedgers;
+    // set by the worker when decoding failed
+    std::string mError;
+    bool mReady{false};
+};
+
 ApplyLedgerChainWork::ApplyLedgerChainWork(
     Application& app, WorkParent& parent, TmpDir const& downloadDir,
     LedgerRange range, LedgerHeaderHistoryEntry& lastApplied)
@@ -27,12 +107,25 @@ ApplyLedgerChainWork::ApplyLedgerChainWork(
     , mCurrSeq(
           mApp.getHistoryManager().checkpointContainingLedger(mRange.first()))
     , mLastApplied(lastApplied)
+    , mNextDownload(mCurrSeq)
+    , mDownloadCached(app.getMetrics().NewMeter(
+          {"history", "download-transactions", "cached"}, "event"))
+    , mDownloadStart(app.getMetrics().NewMeter(
+          {"history", "download-transactions", "start"}, "event"))
+    , mDownloadSuccess(app.getMetrics().NewMeter(
+          {"history", "download-transactions", "success"}, "event"))
+    , mDownloadFailure(app.getMetrics().NewMeter(
+          {"history", "download-transactions", "failure"}, "event"))
     , mApplyLedgerStart(app.getMetrics().NewMeter(
           {"history", "apply-ledger", "start"}, "event"))
     , mApplyLedgerSkip(app.getMetrics().NewMeter(
           {"history", "apply-ledger", "skip"}, "event"))
     , mApplyLedgerSuccess(app.getMetrics().NewMeter(
           {"history", "apply-ledger", "success"}, "event"))
+    , mApplyTransactions(app.getMetrics().NewMeter(
+          {"history", "apply-ledger", "transaction"}, "transaction"))
+    , mApplyOperations(app.getMetrics().NewMeter(
+          {"history", "apply-ledger", "operation"}, "operation"))
     , mApplyLedgerFailureInvalidHash(app.getMetrics().NewMeter(
           {"history", "apply-ledger", "failure-invalid-hash"}, "event"))
     , mApplyLedgerFailurePastCurrent(app.getMetrics().NewMeter(
@@ -73,68 +166,183 @@ ApplyLedgerChainWork::onReset()
                           << " transaction-history files from LCL "
                           << LedgerManager::ledgerAbbrev(
                                  lm.getLastClosedLedgerHeader());
-    mCurrSeq =
-        mApp.getHistoryManager().checkpointContainingLedger(mRange.first());
-    mHdrIn.close();
-    mTxIn.close();
+    // on retries, checkpoints applied before (and their files) are skipped
+    auto first = std::max(
+        mRange.first(),
+        std::min(lm.getLastClosedLedgerNum() + 1, mRange.last()));
+    mCurrSeq = hm.checkpointContainingLedger(first);
+    mNextDownload = mCurrSeq;
+    mDecoded.clear();
+    mCurrent.reset();
+    mNextLedger = 0;
+    mWaitingForDecode = false;
+    mWaitingForDownload = false;
+    mDownloading.clear();
+    mDownloaded.clear();
+    clearChildren();
 }
 
 void
-ApplyLedgerChainWork::openCurrentInputFiles()
-{
-    mHdrIn.close();
-    mTxIn.close();
-    FileTransferInfo hi(mDownloadDir, HISTORY_FILE_TYPE_LEDGER, mCurrSeq);
-    FileTransferInfo ti(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS, mCurrSeq);
-    CLOG(DEBUG, "History") << "Replaying ledger headers from "
-                           << hi.localPath_nogz();
-    CLOG(DEBUG, "History") << "Replaying transactions from "
-                           << ti.localPath_nogz();
-    mHdrIn.open(hi.localPath_nogz());
-    mTxIn.open(ti.localPath_nogz());
-    mTxHistoryEntry = TransactionHistoryEntry();
-}
-
-TxSetFramePtr
-ApplyLedgerChainWork::getCurrentTxSet()
+ApplyLedgerChainWork::startDownloads()
 {
-    auto& lm = mApp.getLedgerManager();
-    auto seq = lm.getCurrentLedgerHeader().ledgerSeq;
-
-    do
+    auto& hm = mApp.getHistoryManager();
+    auto last = hm.checkpointContainingLedger(mRange.last());
+    auto maxRunning =
+        std::max<size_t>(1, mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES);
+    auto maxAhead = mCurrSeq + DOWNLOAD_AHEAD * maxRunning *
+                                   hm.getCheckpointFrequency();
+    while (mNextDownload <= last && mNextDownload < maxAhead &&
+           mDownloading.size() < maxRunning)
     {
-        if (mTxHistoryEntry.ledgerSeq < seq)
+        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS,
+                            mNextDownload);
+        if (fs::exists(ft.localPath_nogz()))
         {
             CLOG(DEBUG, "History")
-                << "Skipping txset for ledger " << mTxHistoryEntry.ledgerSeq;
+                << "already have transactions for checkpoint "
+                << mNextDownload;
+            mDownloadCached.Mark();
+            mDownloaded.insert(mNextDownload);
         }
-        else if (mTxHistoryEntry.ledgerSeq > seq)
+        else
         {
-            break;
+            CLOG(DEBUG, "History")
+                << "Downloading and unzipping transactions for checkpoint "
+                << mNextDownload;
+            auto getAndUnzip = addWork<GetAndUnzipRemoteFileWork>(ft);
+            mDownloading.insert(
+                std::make_pair(getAndUnzip->getUniqueName(), mNextDownload));
+            mDownloadStart.Mark();
+            // this work is not pending, so it does not advance its children
+            getAndUnzip->advance();
         }
-        else
+        mNextDownload += hm.getCheckpointFrequency();
+    }
+}
+
+void
+ApplyLedgerChainWork::startDecoding()
+{
+    auto& hm = mApp.getHistoryManager();
+    auto last = hm.checkpointContainingLedger(mRange.last());
+    auto firstToApply = mApp.getLedgerManager().getLastClosedLedgerNum() + 1;
+    for (uint32_t i = 0; i <= DECODE_AHEAD; ++i)
+    {
+        auto checkpoint = mCurrSeq + i * hm.getCheckpointFrequency();
+        if (checkpoint > last ||
+            mDownloaded.find(checkpoint) == mDownloaded.end() ||
+            mDecoded.find(checkpoint) != mDecoded.end())
         {
-            assert(mTxHistoryEntry.ledgerSeq == seq);
-            CLOG(DEBUG, "History") << "Loaded txset for ledger " << seq;
-            return std::make_shared<TxSetFrame>(mApp.getNetworkID(),
-                                                mTxHistoryEntry.txSet);
+            continue;
         }
-    } while (mTxIn && mTxIn.readOne(mTxHistoryEntry));
 
-    CLOG(DEBUG, "History") << "Using empty txset for ledger " << seq;
-    return std::make_shared<TxSetFrame>(lm.getLastClosedLedgerHeader().hash);
+        FileTransferInfo hi(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
+                            checkpoint);
+        FileTransferInfo ti(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS,
+                            checkpoint);
+        CLOG(DEBUG, "History") << "Decoding ledger headers from "
+                               << hi.localPath_nogz() << " and transactions "
+                               << "from " << ti.localPath_nogz();
+        auto decoded = std::make_shared<DecodedCheckpoint>();
+        mDecoded[checkpoint] = decoded;
+        std::weak_ptr<DecodedCheckpoint> weak = decoded;
+        auto& clock = mApp.getClock();
+        auto networkID = mApp.getNetworkID();
+        auto hdrFile = hi.localPath_nogz();
+        auto txFile = ti.localPath_nogz();
+        auto& workers =
+            mApp.getWorkerIOService(Application::WORKER_POOL_HISTORY_IO);
+        workers.post([this, &clock, weak, networkID, hdrFile, txFile,
+                      firstToApply, checkpoint]() {
+            std::vector<DecodedLedger> ledgers;
+            std::string error;
+            try
+            {
+                ledgers = decodeCheckpoint(networkID, hdrFile, txFile,
+                                           firstToApply);
+            }
+            catch (std::exception& e)
+            {
+                error = e.what();
+            }
+            {
+                auto decoded = weak.lock();
+                if (!decoded)
+                {
+                    return;
+                }
+                decoded->mLedgers = std::move(ledgers);
+                decoded->mError = error;
+            }
+            clock.postToMain(
+                [this, weak, checkpoint]() {
+                    auto decoded = weak.lock();
+                    if (decoded)
+                    {
+                        decoded->mReady = true;
+                        onDecoded(checkpoint);
+                    }
+                },
+                "catchup.decode");
+        });
+    }
+}
+
+void
+ApplyLedgerChainWork::onDecoded(uint32_t checkpoint)
+{
+    CLOG(DEBUG, "History") << "Decoded checkpoint " << checkpoint;
+    if (mWaitingForDecode && checkpoint == mCurrSeq)
+    {
+        mWaitingForDecode = false;
+        scheduleRun();
+    }
+}
+
+void
+ApplyLedgerChainWork::openCurrentCheckpoint()
+{
+    auto i = mDecoded.find(mCurrSeq);
+    assert(i != mDecoded.end() && i->second->mReady);
+    if (!i->second->mError.empty())
+    {
+        throw std::runtime_error(fmt::format(
+            "could not read checkpoint {:d}: {:s}", mCurrSeq,
+            i->second->mError));
+    }
+    CLOG(DEBUG, "History") << "Replaying checkpoint " << mCurrSeq;
+    mCurrent = i->second;
+    mNextLedger = 0;
+    mAppliedWholeCheckpoint = true;
+}
+
+void
+ApplyLedgerChainWork::closeCurrentCheckpoint()
+{
+    mCurrent.reset();
+    mDecoded.erase(mCurrSeq);
+    // applied, no need to keep it around
+    FileTransferInfo ti(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS, mCurrSeq);
+    if (mAppliedWholeCheckpoint)
+    {
+        mApp.getHistoryManager().getCache().add(ti.baseName_nogz(),
+                                                ti.localPath_nogz());
+    }
+    std::remove(ti.localPath_nogz().c_str());
+    mDownloaded.erase(mCurrSeq);
 }
 
 bool
 ApplyLedgerChainWork::applyHistoryOfSingleLedger()
 {
-    LedgerHeaderHistoryEntry hHeader;
-    LedgerHeader& header = hHeader.header;
-
-    if (!mHdrIn || !mHdrIn.readOne(hHeader))
+    PROFILE_PHASE("catchup-apply");
+    if (mNextLedger == mCurrent->mLedgers.size())
     {
         return false;
     }
+    auto const& ledger = mCurrent->mLedgers[mNextLedger++];
+    auto const& hHeader = ledger.mHeader;
+    auto const& header = hHeader.header;
 
     mApplyLedgerStart.Mark();
 
@@ -148,6 +356,7 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
         CLOG(DEBUG, "History")
             << "Catchup skipping old ledger " << header.ledgerSeq;
         mApplyLedgerSkip.Mark();
+        mAppliedWholeCheckpoint = false;
         return true;
     }
 
@@ -167,6 +376,7 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
         CLOG(DEBUG, "History") << "Catchup at 1-before LCL ("
                                << header.ledgerSeq << "), hash correct";
         mApplyLedgerSkip.Mark();
+        mAppliedWholeCheckpoint = false;
         return true;
     }
 
@@ -184,6 +394,7 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
         CLOG(DEBUG, "History")
             << "Catchup at LCL=" << header.ledgerSeq << ", hash correct";
         mApplyLedgerSkip.Mark();
+        mAppliedWholeCheckpoint = false;
         return true;
     }
 
@@ -207,7 +418,7 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
             LedgerManager::ledgerAbbrev(lclHeader)));
     }
 
-    auto txset = getCurrentTxSet();
+    auto txset = ledger.mTxSet;
     CLOG(DEBUG, "History") << "Ledger " << header.ledgerSeq << " has "
                            << txset->size() << " transactions";
 
@@ -243,30 +454,85 @@ ApplyLedgerChainWork::applyHistoryOfSingleLedger()
 
     mApplyLedgerSuccess.Mark();
     mLastApplied = hHeader;
+
+    size_t operations = 0;
+    for (auto const& tx : txset->mTransactions)
+    {
+        operations += tx->getOperations().size();
+    }
+    mApplyTransactions.Mark(txset->size());
+    mApplyOperations.Mark(operations);
+    mAppliedTransactions += txset->size();
+    mAppliedOperations += operations;
+    auto& cm = mApp.getCatchupManager();
+    cm.reportProgress("apply-ledgers", header.ledgerSeq - mRange.first() + 1,
+                      mRange.last() - mRange.first() + 1);
+    cm.reportProgress("apply-transactions", mAppliedTransactions, 0);
+    cm.reportProgress("apply-operations", mAppliedOperations, 0);
     return true;
 }
 
 void
 ApplyLedgerChainWork::onStart()
 {
-    openCurrentInputFiles();
+    startDownloads();
 }
 
 void
 ApplyLedgerChainWork::onRun()
 {
+    if (anyChildFatalFailure())
+    {
+        scheduleFatalFailure();
+        return;
+    }
+    if (anyChildRaiseFailure())
+    {
+        scheduleFailure();
+        return;
+    }
+
     try
     {
+        if (!mCurrent)
+        {
+            if (mDownloaded.find(mCurrSeq) == mDownloaded.end())
+            {
+                // run again by notify() once it is there
+                CLOG(DEBUG, "History") << "Waiting for transactions of "
+                                       << "checkpoint " << mCurrSeq;
+                mWaitingForDownload = true;
+                return;
+            }
+            startDecoding();
+            auto i = mDecoded.find(mCurrSeq);
+            if (!i->second->mReady)
+            {
+                // run again by onDecoded() once it is done
+                CLOG(DEBUG, "History")
+                    << "Waiting for checkpoint " << mCurrSeq << " to decode";
+                mWaitingForDecode = true;
+                return;
+            }
+            openCurrentCheckpoint();
+            // decoded while this one applies
+            startDecoding();
+        }
         if (!applyHistoryOfSingleLedger())
         {
+            closeCurrentCheckpoint();
             mCurrSeq += mApp.getHistoryManager().getCheckpointFrequency();
-            openCurrentInputFiles();
+            startDownloads();
         }
         scheduleSuccess();
     }
     catch (std::runtime_error& e)
     {
         CLOG(ERROR, "History") << "Replay failed: " << e.what();
+        // in case the file came from there
+        FileTransferInfo ti(mDownloadDir, HISTORY_FILE_TYPE_TRANSACTIONS,
+                            mCurrSeq);
+        mApp.getHistoryManager().getCache().remove(ti.baseName_nogz());
         scheduleFailure();
     }
 }
@@ -285,4 +551,53 @@ ApplyLedgerChainWork::onSuccess()
 
     return WORK_RUNNING;
 }
+
+void
+ApplyLedgerChainWork::notify(std::string const& child)
+{
+    auto i = mChildren.find(child);
+    if (i == mChildren.end())
+    {
+        CLOG(WARNING, "Work")
+            << "ApplyLedgerChainWork notified by unknown child " << child;
+        return;
+    }
+
+    switch (i->second->getState())
+    {
+    case Work::WORK_SUCCESS:
+    {
+        mDownloadSuccess.Mark();
+        auto checkpoint = mDownloading.find(child);
+        assert(checkpoint != mDownloading.end());
+        CLOG(DEBUG, "History") << "Finished download of transactions for "
+                               << "checkpoint " << checkpoint->second;
+        mDownloaded.insert(checkpoint->second);
+        mDownloading.erase(checkpoint);
+        mChildren.erase(i);
+        startDownloads();
+        if (mCurrent)
+        {
+            startDecoding();
+        }
+        break;
+    }
+    case Work::WORK_FAILURE_RETRY:
+    case Work::WORK_FAILURE_FATAL:
+    case Work::WORK_FAILURE_RAISE:
+        mDownloadFailure.Mark();
+        break;
+    default:
+        break;
+    }
+
+    mApp.getCatchupManager().logAndUpdateCatchupStatus(true);
+    if (mWaitingForDownload &&
+        (mDownloaded.find(mCurrSeq) != mDownloaded.end() ||
+         anyChildRaiseFailure() || anyChildFatalFailure()))
+    {
+        mWaitingForDownload = false;
+        scheduleRun();
+    }
+}
 }
@@ -6,11 +6,14 @@
 
 #include "herder/TxSetFrame.h"
 #include "ledger/LedgerRange.h"
-#include "util/XDRStream.h"
 #include "work/Work.h"
 #include "xdr/Stellar-SCP.h"
 #include "xdr/Stellar-ledger.h"
 
+#include <map>
+#include <memory>
+#include <set>
+
 namespace medida
 {
 class Meter;
@@ -29,6 +32,18 @@ struct LedgerHeaderHistoryEntry;
  * used to read transactions that will be used and ledger files are used to
  * check if ledger hashes are matching.
  *
+ * Transaction files are downloaded by this work itself, in parallel with
+ * applying: at most MAX_CONCURRENT_SUBPROCESSES downloads run at once, no more
+ * than DOWNLOAD_AHEAD times that many checkpoints past the one being applied,
+ * and the file of each checkpoint is deleted once it has been applied. Ledger
+ * files must be downloaded (and verified) beforehand.
+ *
+ * Checkpoints are decoded on a history I/O worker: their ledger headers are
+ * read, the transaction sets built and hashed and the signatures of the
+ * transactions to apply verified (ending up in the signature cache). The
+ * checkpoint after the one being applied is decoded while it applies, so
+ * that the main thread only checks and closes ledgers.
+ *
  * In each run it skips or applies transactions from one ledger. Skipping occurs
  * when ledger to by applied is older than LCL from local ledger. At LCL
  * boundary checks are made
@@ -47,25 +62,56 @@ class ApplyLedgerChainWork : public Work
     TmpDir const& mDownloadDir;
     LedgerRange mRange;
     uint32_t mCurrSeq;
-    XDRInputFileStream mHdrIn;
-    XDRInputFileStream mTxIn;
-    TransactionHistoryEntry mTxHistoryEntry;
     LedgerHeaderHistoryEntry& mLastApplied;
 
+    // checkpoints being decoded or decoded, by checkpoint; the worker
+    // decoding one only holds a weak reference to it
+    struct DecodedCheckpoint;
+    std::map<uint32_t, std::shared_ptr<DecodedCheckpoint>> mDecoded;
+    // the checkpoint being applied, and the index of its next ledger
+    std::shared_ptr<DecodedCheckpoint> mCurrent;
+    size_t mNextLedger{0};
+    bool mWaitingForDecode{false};
+    // no ledger of the current checkpoint was skipped, so its transactions
+    // file is fully verified once applied (and can go to the HistoryCache)
+    bool mAppliedWholeCheckpoint{false};
+    // since the start of the work, for the catchup progress
+    uint64_t mAppliedTransactions{0};
+    uint64_t mAppliedOperations{0};
+
+    // transaction downloads, by child work name
+    std::map<std::string, uint32_t> mDownloading;
+    std::set<uint32_t> mDownloaded;
+    uint32_t mNextDownload;
+    bool mWaitingForDownload{false};
+
+    medida::Meter& mDownloadCached;
+    medida::Meter& mDownloadStart;
+    medida::Meter& mDownloadSuccess;
+    medida::Meter& mDownloadFailure;
     medida::Meter& mApplyLedgerStart;
     medida::Meter& mApplyLedgerSkip;
     medida::Meter& mApplyLedgerSuccess;
+    medida::Meter& mApplyTransactions;
+    medida::Meter& mApplyOperations;
     medida::Meter& mApplyLedgerFailureInvalidHash;
     medida::Meter& mApplyLedgerFailurePastCurrent;
     medida::Meter& mApplyLedgerFailureInvalidLCLHash;
     medida::Meter& mApplyLedgerFailureInvalidTxSetHash;
     medida::Meter& mApplyLedgerFailureInvalidResultHash;
 
-    TxSetFramePtr getCurrentTxSet();
-    void openCurrentInputFiles();
+    void startDownloads();
+    void startDecoding();
+    void onDecoded(uint32_t checkpoint);
+    void openCurrentCheckpoint();
+    void closeCurrentCheckpoint();
     bool applyHistoryOfSingleLedger();
 
   public:
+    static uint32_t const DOWNLOAD_AHEAD = 2;
+    // checkpoints decoded past the one being applied
+    static uint32_t const DECODE_AHEAD = 1;
+
     ApplyLedgerChainWork(Application& app, WorkParent& parent,
                          TmpDir const& downloadDir, LedgerRange range,
                          LedgerHeaderHistoryEntry& lastApplied);
@@ -75,5 +121,6 @@ class ApplyLedgerChainWork : public Work
     void onStart() override;
     void onRun() override;
     Work::State onSuccess() override;
+    void notify(std::string const& child) override;
 };
 }
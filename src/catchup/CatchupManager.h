@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/CatchupWork.h"
+#include "lib/json/json.h"
 #include <functional>
 #include <memory>
 #include <system_error>
@@ -36,6 +37,17 @@ class CatchupManager
     // Return status of catchup for or empty string, if no catchup in progress
     virtual std::string getStatus() const = 0;
 
+    // Called by the works of a catchup as they progress: @p done of the
+    // @p total items of @p phase are done (@p total is 0 if not known in
+    // advance).
+    virtual void reportProgress(std::string const& phase, uint64_t done,
+                                uint64_t total) = 0;
+
+    // Return the progress of the catchup in progress, per phase: items done,
+    // throughput and estimated time to completion. Null if no catchup is in
+    // progress.
+    virtual Json::Value getJsonInfo() const = 0;
+
     // Return the number of times the process has commenced catchup.
     virtual uint64_t getCatchupStartCount() const = 0;
 
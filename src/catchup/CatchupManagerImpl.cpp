@@ -11,6 +11,7 @@
 #include "catchup/CatchupWork.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
+#include "medida/counter.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "util/Logging.h"
@@ -36,6 +37,7 @@ CatchupManagerImpl::CatchupManagerImpl(Application& app)
           app.getMetrics().NewMeter({"history", "catchup", "success"}, "event"))
     , mCatchupFailure(
           app.getMetrics().NewMeter({"history", "catchup", "failure"}, "event"))
+    , mCatchupETA(app.getMetrics().NewCounter({"history", "catchup", "eta"}))
 {
 }
 
@@ -47,6 +49,7 @@ void
 CatchupManagerImpl::historyCaughtup()
 {
     mCatchupWork.reset();
+    mCatchupETA.set_count(0);
 }
 
 void
@@ -60,6 +63,7 @@ CatchupManagerImpl::catchupHistory(CatchupConfiguration catchupConfiguration,
     }
 
     mCatchupStart.Mark();
+    mProgress.clear();
 
     mCatchupWork = mApp.getWorkManager().addWork<CatchupWork>(
         catchupConfiguration, manualCatchup, handler, Work::RETRY_NEVER);
@@ -72,6 +76,74 @@ CatchupManagerImpl::getStatus() const
     return mCatchupWork ? mCatchupWork->getStatus() : std::string{};
 }
 
+double
+CatchupManagerImpl::getRate(PhaseProgress const& progress)
+{
+    auto elapsed = std::chrono::duration<double>(progress.mLastReport -
+                                                 progress.mFirstReport);
+    if (elapsed.count() <= 0 || progress.mDone <= progress.mFirstDone)
+    {
+        return 0;
+    }
+    return (progress.mDone - progress.mFirstDone) / elapsed.count();
+}
+
+void
+CatchupManagerImpl::reportProgress(std::string const& phase, uint64_t done,
+                                   uint64_t total)
+{
+    auto now = mApp.getClock().now();
+    auto it = mProgress.find(phase);
+    if (it == mProgress.end())
+    {
+        PhaseProgress progress{done, total, done, now, now};
+        it = mProgress.emplace(phase, progress).first;
+    }
+    auto& progress = it->second;
+    progress.mDone = done;
+    progress.mTotal = total;
+    progress.mLastReport = now;
+
+    auto rate = getRate(progress);
+    if (total != 0 && rate > 0)
+    {
+        auto left = done < total ? total - done : 0;
+        mCatchupETA.set_count(static_cast<int64_t>(left / rate));
+    }
+}
+
+Json::Value
+CatchupManagerImpl::getJsonInfo() const
+{
+    Json::Value info;
+    if (!mCatchupWork)
+    {
+        return info;
+    }
+    for (auto const& p : mProgress)
+    {
+        auto const& progress = p.second;
+        auto& phase = info[p.first];
+        phase["done"] = static_cast<Json::UInt64>(progress.mDone);
+        auto rate = getRate(progress);
+        phase["per_second"] = rate;
+        if (progress.mTotal != 0)
+        {
+            phase["total"] = static_cast<Json::UInt64>(progress.mTotal);
+            if (progress.mDone >= progress.mTotal)
+            {
+                phase["eta"] = 0;
+            }
+            else if (rate > 0)
+            {
+                phase["eta"] = static_cast<Json::UInt64>(
+                    (progress.mTotal - progress.mDone) / rate);
+            }
+        }
+    }
+    return info;
+}
+
 uint64_t
 CatchupManagerImpl::getCatchupStartCount() const
 {
@@ -5,10 +5,13 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/CatchupManager.h"
+#include "util/Timer.h"
+#include <map>
 #include <memory>
 
 namespace medida
 {
+class Counter;
 class Meter;
 }
 
@@ -23,9 +26,25 @@ class CatchupManagerImpl : public CatchupManager
     Application& mApp;
     std::shared_ptr<Work> mCatchupWork;
 
+    struct PhaseProgress
+    {
+        uint64_t mDone;
+        uint64_t mTotal;
+        // throughput is measured from the first report of the phase
+        uint64_t mFirstDone;
+        VirtualClock::time_point mFirstReport;
+        VirtualClock::time_point mLastReport;
+    };
+    std::map<std::string, PhaseProgress> mProgress;
+
     medida::Meter& mCatchupStart;
     medida::Meter& mCatchupSuccess;
     medida::Meter& mCatchupFailure;
+    // estimated seconds left in the phase last reported
+    medida::Counter& mCatchupETA;
+
+    // items per second, 0 if not measured yet
+    static double getRate(PhaseProgress const& progress);
 
   public:
     CatchupManagerImpl(Application& app);
@@ -39,6 +58,10 @@ class CatchupManagerImpl : public CatchupManager
 
     std::string getStatus() const override;
 
+    void reportProgress(std::string const& phase, uint64_t done,
+                        uint64_t total) override;
+    Json::Value getJsonInfo() const override;
+
     uint64_t getCatchupStartCount() const override;
     uint64_t getCatchupSuccessCount() const override;
     uint64_t getCatchupFailureCount() const override;
@@ -6,7 +6,6 @@
 #include "catchup/ApplyBucketsWork.h"
 #include "catchup/ApplyLedgerChainWork.h"
 #include "catchup/CatchupConfiguration.h"
-#include "catchup/DownloadBucketsWork.h"
 #include "catchup/VerifyLedgerChainWork.h"
 #include "history/FileTransferInfo.h"
 #include "history/HistoryManager.h"
@@ -51,18 +50,10 @@ CatchupWork::getStatus() const
         {
             return mApplyTransactionsWork->getStatus();
         }
-        else if (mDownloadTransactionsWork)
-        {
-            return mDownloadTransactionsWork->getStatus();
-        }
         else if (mApplyBucketsWork)
         {
             return mApplyBucketsWork->getStatus();
         }
-        else if (mDownloadBucketsWork)
-        {
-            return mDownloadBucketsWork->getStatus();
-        }
         else if (mGetBucketsHistoryArchiveStateWork)
         {
             return mGetBucketsHistoryArchiveStateWork->getStatus();
@@ -113,9 +104,7 @@ CatchupWork::onReset()
     mDownloadLedgersWork.reset();
     mVerifyLedgersWork.reset();
     mGetBucketsHistoryArchiveStateWork.reset();
-    mDownloadBucketsWork.reset();
     mApplyBucketsWork.reset();
-    mDownloadTransactionsWork.reset();
     mApplyTransactionsWork.reset();
 
     mLastClosedLedgerAtReset = mApp.getLedgerManager().getLastClosedLedgerNum();
@@ -204,23 +193,6 @@ CatchupWork::downloadBucketsHistoryArchiveState(uint32_t atCheckpoint)
     return true;
 }
 
-bool
-CatchupWork::downloadBuckets()
-{
-    if (mDownloadBucketsWork)
-    {
-        assert(mDownloadBucketsWork->getState() == WORK_SUCCESS);
-        return false;
-    }
-
-    CLOG(INFO, "History") << "Catchup downloading and verifying buckets";
-    std::vector<std::string> hashes =
-        mApplyBucketsRemoteState.differingBuckets(mLocalState);
-    mDownloadBucketsWork =
-        addWork<DownloadBucketsWork>(mBuckets, hashes, *mDownloadDir);
-    return true;
-}
-
 bool
 CatchupWork::applyBuckets()
 {
@@ -250,28 +222,14 @@ CatchupWork::applyBuckets()
                         LedgerManager::ledgerAbbrev(lcl)));
     }
 
-    CLOG(INFO, "History") << "Catchup applying buckets for state "
+    // downloaded while applying
+    CLOG(INFO, "History") << "Catchup downloading, verifying and applying "
+                             "buckets for state "
                           << LedgerManager::ledgerAbbrev(mFirstVerified);
-    mApplyBucketsWork =
-        addWork<ApplyBucketsWork>(mBuckets, mApplyBucketsRemoteState);
-
-    return true;
-}
-
-bool
-CatchupWork::downloadTransactions(CheckpointRange const& range)
-{
-    if (mDownloadTransactionsWork)
-    {
-        assert(mDownloadTransactionsWork->getState() == WORK_SUCCESS);
-        return false;
-    }
-
-    CLOG(INFO, "History") << "Catchup downloading transactions for range ["
-                          << range.first() << ".." << range.last() << "]";
-
-    mDownloadTransactionsWork = addWork<BatchDownloadWork>(
-        range, HISTORY_FILE_TYPE_TRANSACTIONS, *mDownloadDir);
+    std::vector<std::string> hashes =
+        mApplyBucketsRemoteState.differingBuckets(mLocalState);
+    mApplyBucketsWork = addWork<ApplyBucketsWork>(
+        mBuckets, mApplyBucketsRemoteState, hashes, *mDownloadDir);
 
     return true;
 }
@@ -285,7 +243,9 @@ CatchupWork::applyTransactions(LedgerRange const& range)
         return false;
     }
 
-    CLOG(INFO, "History") << "Catchup applying transactions for range ["
+    // transactions are downloaded while applying them
+    CLOG(INFO, "History") << "Catchup downloading and applying transactions "
+                             "for range ["
                           << range.first() << ".." << range.last() << "]";
 
     mApplyTransactionsWork =
@@ -339,11 +299,6 @@ CatchupWork::onSuccess()
             mApplyBucketsRemoteState = mRemoteState;
         }
 
-        if (downloadBuckets())
-        {
-            return WORK_PENDING;
-        }
-
         if (applyBuckets())
         {
             return WORK_PENDING;
@@ -363,11 +318,6 @@ CatchupWork::onSuccess()
                               << checkpointRange.first() << " not needed";
     }
 
-    if (downloadTransactions(checkpointRange))
-    {
-        return WORK_PENDING;
-    }
-
     if (applyTransactions(ledgerRange))
     {
         return WORK_PENDING;
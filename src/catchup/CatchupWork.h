@@ -50,7 +50,10 @@ using CatchupRange = std::pair<LedgerRange, bool>;
 //
 // Then, depending on configuration, it can download, verify and apply buckets
 // (as in MINIMAL and RECENT catchups), and then download and apply
-// transactions (as in COMPLETE and RECENT catchups).
+// transactions (as in COMPLETE and RECENT catchups). The buckets of a level
+// and the transactions of a checkpoint are applied as soon as they are
+// downloaded, while the next ones are still downloading (see
+// ApplyBucketsWork and ApplyLedgerChainWork).
 //
 // After that, catchup is done and node can replay buffered ledgers and take
 // part in consensus protocol.
@@ -117,9 +120,7 @@ class CatchupWork : public BucketDownloadWork
     std::shared_ptr<Work> mDownloadLedgersWork;
     std::shared_ptr<Work> mVerifyLedgersWork;
     std::shared_ptr<Work> mGetBucketsHistoryArchiveStateWork;
-    std::shared_ptr<Work> mDownloadBucketsWork;
     std::shared_ptr<Work> mApplyBucketsWork;
-    std::shared_ptr<Work> mDownloadTransactionsWork;
     std::shared_ptr<Work> mApplyTransactionsWork;
     LedgerHeaderHistoryEntry mFirstVerified;
     LedgerHeaderHistoryEntry mLastVerified;
@@ -132,9 +133,7 @@ class CatchupWork : public BucketDownloadWork
     bool verifyLedgers(LedgerRange const& range);
     bool alreadyHaveBucketsHistoryArchiveState(uint32_t atCheckpoint) const;
     bool downloadBucketsHistoryArchiveState(uint32_t atCheckpoint);
-    bool downloadBuckets();
     bool applyBuckets();
-    bool downloadTransactions(CheckpointRange const& range);
     bool applyTransactions(LedgerRange const& range);
 };
 }
@@ -3,13 +3,18 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/DownloadBucketsWork.h"
+#include "bucket/BucketManager.h"
+#include "catchup/CatchupManager.h"
 #include "history/FileTransferInfo.h"
 #include "historywork/GetAndUnzipRemoteFileWork.h"
 #include "historywork/VerifyBucketWork.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
+#include <algorithm>
+
 namespace stellar
 {
 
@@ -49,9 +54,27 @@ void
 DownloadBucketsWork::onReset()
 {
     clearChildren();
+    mNextHash = 0;
+    mRunning = 0;
+    startDownloads();
+}
 
-    for (auto const& hash : mHashes)
+void
+DownloadBucketsWork::startDownloads()
+{
+    auto maxRunning =
+        std::max<size_t>(1, mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES);
+    while (mNextHash < mHashes.size() && mRunning < maxRunning)
     {
+        auto const& hash = mHashes[mNextHash++];
+        // possibly hard linked from the shared bucket store
+        auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
+        if (b)
+        {
+            mBuckets[hash] = b;
+            continue;
+        }
+
         FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_BUCKET, hash);
         // Each bucket gets its own work-chain of
         // download->gunzip->verify
@@ -60,6 +83,7 @@ DownloadBucketsWork::onReset()
                                                 hexToBin256(hash));
         verify->addWork<GetAndUnzipRemoteFileWork>(ft);
         mDownloadBucketStart.Mark();
+        ++mRunning;
     }
 }
 
@@ -78,6 +102,12 @@ DownloadBucketsWork::notify(std::string const& child)
     {
     case Work::WORK_SUCCESS:
         mDownloadBucketSuccess.Mark();
+        --mRunning;
+        startDownloads();
+        mApp.getCatchupManager().reportProgress(
+            "download-buckets", mBuckets.size(), mHashes.size());
+        // so that it can apply the bucket without waiting for the others
+        notifyParent();
         break;
     case Work::WORK_FAILURE_RETRY:
     case Work::WORK_FAILURE_FATAL:
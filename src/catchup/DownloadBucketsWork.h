@@ -17,16 +17,31 @@ namespace stellar
 class Bucket;
 class TmpDir;
 
+/**
+ * Downloads and verifies the buckets of `hashes` that are not in the bucket
+ * directory (or the shared bucket store) already, into `buckets`.
+ *
+ * Downloads start in the order of `hashes`, at most
+ * MAX_CONCURRENT_SUBPROCESSES at a time: given in the order of
+ * HistoryArchiveState::differingBuckets, the biggest buckets, those of the
+ * deepest levels, start first, and they arrive in the order ApplyBucketsWork
+ * applies them. The parent is notified every time a bucket is there.
+ */
 class DownloadBucketsWork : public Work
 {
-    std::map<std::string, std::shared_ptr<Bucket>> mBuckets;
+    std::map<std::string, std::shared_ptr<Bucket>>& mBuckets;
     std::vector<std::string> mHashes;
     TmpDir const& mDownloadDir;
+    // next of mHashes to start, and downloads started but not done
+    size_t mNextHash{0};
+    size_t mRunning{0};
 
     medida::Meter& mDownloadBucketStart;
     medida::Meter& mDownloadBucketSuccess;
     medida::Meter& mDownloadBucketFailure;
 
+    void startDownloads();
+
   public:
     DownloadBucketsWork(Application& app, WorkParent& parent,
                         std::map<std::string, std::shared_ptr<Bucket>>& buckets,
@@ -0,0 +1,212 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "catchup/ReplayLedgers.h"
+#include "crypto/Hex.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
+#include "history/FileTransferInfo.h"
+#include "history/HistoryManager.h"
+#include "ledger/ApplyProfiler.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "transactions/TransactionFrame.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "util/format.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/stats/snapshot.h"
+#include "medida/timer.h"
+
+#include <chrono>
+
+namespace stellar
+{
+
+namespace
+{
+std::string
+checkpointFile(std::string const& dir, std::string const& type,
+               uint32_t checkpoint)
+{
+    return dir + "/" + fs::baseName(type, fs::hexStr(checkpoint), "xdr");
+}
+
+// adds the operation stats of the last ledger closed to @p totals
+void
+addOperationStats(Json::Value& totals, Json::Value const& profile)
+{
+    auto const& ops = profile["operations"];
+    for (auto const& name : ops.getMemberNames())
+    {
+        auto& total = totals[name];
+        total["count"] =
+            total["count"].asUInt64() + ops[name]["count"].asUInt64();
+        total["time_ms"] =
+            total["time_ms"].asDouble() + ops[name]["time_ms"].asDouble();
+        total["queries"] =
+            total["queries"].asUInt64() + ops[name]["queries"].asUInt64();
+    }
+}
+}
+
+Json::Value
+replayLedgers(Application& app, std::string const& dir)
+{
+    auto& lm = app.getLedgerManager();
+    auto& hm = app.getHistoryManager();
+    auto& txApply =
+        app.getMetrics().NewTimer({"ledger", "transaction", "apply"});
+    txApply.Clear();
+
+    Json::Value res;
+    auto& perLedger = res["ledgers"];
+    perLedger = Json::arrayValue;
+    Json::Value opTotals = Json::objectValue;
+    uint64_t nTxs = 0;
+    uint64_t nOps = 0;
+    std::chrono::nanoseconds total{0};
+
+    struct ReplayingGuard
+    {
+        LedgerManager& mLedgerManager;
+        ~ReplayingGuard()
+        {
+            mLedgerManager.setReplayingHistory(false);
+        }
+    } guard{lm};
+    lm.setReplayingHistory(true);
+    auto checkpoint =
+        hm.checkpointContainingLedger(lm.getLastClosedLedgerNum() + 1);
+    for (;; checkpoint += hm.getCheckpointFrequency())
+    {
+        auto headersFile =
+            checkpointFile(dir, HISTORY_FILE_TYPE_LEDGER, checkpoint);
+        auto txsFile =
+            checkpointFile(dir, HISTORY_FILE_TYPE_TRANSACTIONS, checkpoint);
+        if (!fs::exists(headersFile))
+        {
+            break;
+        }
+        XDRInputFileStream headersIn;
+        XDRInputFileStream txsIn;
+        headersIn.open(headersFile);
+        TransactionHistoryEntry txEntry;
+        bool haveTxs = false;
+        if (fs::exists(txsFile))
+        {
+            txsIn.open(txsFile);
+            haveTxs = txsIn.readOne(txEntry);
+        }
+        CLOG(INFO, "History") << "Replaying checkpoint " << checkpoint
+                              << " from " << headersFile;
+
+        LedgerHeaderHistoryEntry hHeader;
+        while (headersIn.readOne(hHeader))
+        {
+            auto const& header = hHeader.header;
+            auto const& lcl = lm.getLastClosedLedgerHeader();
+            if (header.ledgerSeq <= lcl.header.ledgerSeq)
+            {
+                if (header.ledgerSeq == lcl.header.ledgerSeq &&
+                    hHeader.hash != lcl.hash)
+                {
+                    throw std::runtime_error(fmt::format(
+                        "replay of {:s} at LCL {:s} disagreed on hash",
+                        LedgerManager::ledgerAbbrev(hHeader),
+                        LedgerManager::ledgerAbbrev(lcl)));
+                }
+                continue;
+            }
+            if (header.ledgerSeq != lm.getLedgerNum() ||
+                header.previousLedgerHash != lcl.hash)
+            {
+                throw std::runtime_error(fmt::format(
+                    "replay of {:s} does not follow LCL {:s}",
+                    LedgerManager::ledgerAbbrev(hHeader),
+                    LedgerManager::ledgerAbbrev(lcl)));
+            }
+
+            while (haveTxs && txEntry.ledgerSeq < header.ledgerSeq)
+            {
+                haveTxs = txsIn.readOne(txEntry);
+            }
+            auto txSet =
+                haveTxs && txEntry.ledgerSeq == header.ledgerSeq
+                    ? std::make_shared<TxSetFrame>(app.getNetworkID(),
+                                                   txEntry.txSet)
+                    : std::make_shared<TxSetFrame>(lcl.hash);
+            if (txSet->getContentsHash() != header.scpValue.txSetHash)
+            {
+                throw std::runtime_error(fmt::format(
+                    "replay txset hash differs for ledger {:d}: {:s}, "
+                    "expected {:s}",
+                    header.ledgerSeq, hexAbbrev(txSet->getContentsHash()),
+                    hexAbbrev(header.scpValue.txSetHash)));
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            lm.closeLedger(
+                LedgerCloseData(header.ledgerSeq, txSet, header.scpValue));
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            // the work posted by the close, such as the database checkpoint
+            while (app.getClock().crank(false) > 0)
+                ;
+
+            if (lm.getLastClosedLedgerHeader().hash != hHeader.hash)
+            {
+                throw std::runtime_error(fmt::format(
+                    "replay of {:s} produced mismatched ledger hash {:s}",
+                    LedgerManager::ledgerAbbrev(hHeader),
+                    LedgerManager::ledgerAbbrev(
+                        lm.getLastClosedLedgerHeader())));
+            }
+
+            size_t ops = 0;
+            for (auto const& tx : txSet->mTransactions)
+            {
+                ops += tx->getOperations().size();
+            }
+            Json::Value ledger;
+            ledger["ledger"] = header.ledgerSeq;
+            ledger["transactions"] = static_cast<Json::UInt64>(txSet->size());
+            ledger["operations"] = static_cast<Json::UInt64>(ops);
+            ledger["ms"] =
+                std::chrono::duration<double, std::milli>(elapsed).count();
+            perLedger.append(ledger);
+            addOperationStats(opTotals, lm.getApplyProfiler().getJsonInfo());
+            nTxs += txSet->size();
+            nOps += ops;
+            total += elapsed;
+        }
+    }
+
+    auto totalMs = std::chrono::duration<double, std::milli>(total).count();
+    res["transactions"] = static_cast<Json::UInt64>(nTxs);
+    res["operations"] = static_cast<Json::UInt64>(nOps);
+    res["total_ms"] = totalMs;
+    res["history_stored"] = !app.getConfig().CATCHUP_REPLAY_ONLY;
+    if (totalMs > 0)
+    {
+        res["ledgers_per_second"] = perLedger.size() * 1000.0 / totalMs;
+        res["transactions_per_second"] = nTxs * 1000.0 / totalMs;
+    }
+
+    auto snapshot = txApply.GetSnapshot();
+    auto& perTx = res["transaction_apply"];
+    perTx["count"] = static_cast<Json::UInt64>(txApply.count());
+    perTx["mean_ms"] = txApply.mean();
+    perTx["p50_ms"] = snapshot.getMedian();
+    perTx["p99_ms"] = snapshot.get99thPercentile();
+    perTx["max_ms"] = txApply.max();
+
+    res["operation_apply"] = opTotals;
+    CLOG(INFO, "History") << "Replayed " << perLedger.size() << " ledgers, "
+                          << nTxs << " transactions in " << totalMs << " ms";
+    return res;
+}
+}
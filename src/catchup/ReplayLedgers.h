@@ -0,0 +1,32 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+
+#include <string>
+
+namespace stellar
+{
+
+class Application;
+
+// Replays on @p app, as fast as possible and without network access, the
+// ledgers after its LCL found in the checkpoint files of @p dir: the
+// ledger-<hex>.xdr and transactions-<hex>.xdr files of a history archive
+// (unzipped), flat in @p dir, as ApplyLedgerChainWork reads them from its
+// download directory. Replaying stops at the first checkpoint missing its
+// ledger file. This gives a benchmark that is reproducible from a corpus of
+// real ledgers and the bucket state they start from (see
+// restoreFromBuckets).
+//
+// Each ledger must follow the previous one and reproduce the hash of its
+// header in the files, otherwise std::runtime_error is thrown. With
+// CATCHUP_REPLAY_ONLY, the transaction history is not stored.
+//
+// Returns a report of the time spent: per ledger, per transaction and per
+// operation type (see ApplyProfiler).
+Json::Value replayLedgers(Application& app, std::string const& dir);
+}
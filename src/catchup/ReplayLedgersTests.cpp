@@ -0,0 +1,107 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "catchup/ReplayLedgers.h"
+#include "database/Database.h"
+#include "history/FileTransferInfo.h"
+#include "history/HistoryManager.h"
+#include "ledger/LedgerHeaderFrame.h"
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "transactions/TransactionFrame.h"
+#include "util/Fs.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+namespace
+{
+// writes the checkpoint files of the ledgers closed by @p app to @p dir
+void
+writeCheckpoint(Application& app, std::string const& dir)
+{
+    auto& db = app.getDatabase();
+    auto lcl = app.getLedgerManager().getLastClosedLedgerNum();
+    auto checkpoint = app.getHistoryManager().checkpointContainingLedger(lcl);
+    auto file = [&](char const* type) {
+        return dir + "/" + fs::baseName(type, fs::hexStr(checkpoint), "xdr");
+    };
+
+    XDROutputFileStream headersOut;
+    XDROutputFileStream txsOut;
+    XDROutputFileStream resultsOut;
+    headersOut.open(file(HISTORY_FILE_TYPE_LEDGER));
+    txsOut.open(file(HISTORY_FILE_TYPE_TRANSACTIONS));
+    resultsOut.open(file(HISTORY_FILE_TYPE_RESULTS));
+    LedgerHeaderFrame::copyLedgerHeadersToStream(db, db.getSession(), 1, lcl,
+                                                 headersOut);
+    TransactionFrame::copyTransactionsToStream(app.getNetworkID(), db,
+                                               db.getSession(), 1, lcl,
+                                               txsOut, resultsOut);
+}
+}
+
+TEST_CASE("replay ledgers from checkpoint files", "[catchup]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig(0));
+    auto root = TestAccount::createRoot(*app);
+    auto a1 = getAccount("A");
+
+    closeLedgerOn(*app, 2, 1, 1, 2018,
+                  {root.tx({createAccount(a1.getPublicKey(), 1000000000)})});
+    closeLedgerOn(*app, 3, 2, 1, 2018);
+    for (uint32_t ledger = 4; ledger < 7; ledger++)
+    {
+        closeLedgerOn(*app, ledger, ledger, 1, 2018,
+                      {root.tx({payment(a1.getPublicKey(), 1000)})});
+    }
+
+    auto dir = app->getTmpDirManager().tmpDir("replay");
+    writeCheckpoint(*app, dir.getName());
+
+    auto cfg = getTestConfig(1);
+    VirtualClock replayClock;
+    SECTION("storing history")
+    {
+        auto replayApp = createTestApplication(replayClock, cfg);
+        auto res = replayLedgers(*replayApp, dir.getName());
+        REQUIRE(replayApp->getLedgerManager().getLastClosedLedgerHeader() ==
+                app->getLedgerManager().getLastClosedLedgerHeader());
+        REQUIRE(res["ledgers"].size() == 5);
+        REQUIRE(res["transactions"].asUInt64() == 4);
+        REQUIRE(res["transaction_apply"]["count"].asUInt64() == 4);
+        REQUIRE(res["operation_apply"]["payment"]["count"].asUInt64() == 3);
+        REQUIRE(res["history_stored"].asBool());
+        REQUIRE(TransactionFrame::getTransactionHistoryResults(
+                    replayApp->getDatabase(), 4)
+                    .results.size() == 1);
+    }
+    SECTION("replay only")
+    {
+        cfg.CATCHUP_REPLAY_ONLY = true;
+        auto replayApp = createTestApplication(replayClock, cfg);
+        auto res = replayLedgers(*replayApp, dir.getName());
+        REQUIRE(replayApp->getLedgerManager().getLastClosedLedgerHeader() ==
+                app->getLedgerManager().getLastClosedLedgerHeader());
+        REQUIRE(!res["history_stored"].asBool());
+        REQUIRE(TransactionFrame::getTransactionHistoryResults(
+                    replayApp->getDatabase(), 4)
+                    .results.empty());
+    }
+    SECTION("mismatched ledger")
+    {
+        auto replayApp = createTestApplication(replayClock, cfg);
+        closeLedgerOn(*replayApp, 2, 1, 1, 2018);
+        REQUIRE_THROWS_AS(replayLedgers(*replayApp, dir.getName()),
+                          std::runtime_error);
+    }
+}
@@ -0,0 +1,168 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "catchup/RestoreFromBuckets.h"
+#include "bucket/BucketManager.h"
+#include "catchup/ApplyBucketsWork.h"
+#include "crypto/Hex.h"
+#include "history/HistoryArchive.h"
+#include "ledger/LedgerHeaderFrame.h"
+#include "ledger/LedgerManager.h"
+#include "main/Config.h"
+#include "main/PersistentState.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "work/WorkManager.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+namespace stellar
+{
+
+Application::pointer
+restoreFromBuckets(VirtualClock& clock, Config const& cfg)
+{
+    auto const& bucketDir = cfg.BUCKET_DIR_PATH;
+    // creating a new database empties the bucket directory
+    auto savedDir = bucketDir + "-restore";
+    HistoryArchiveState has;
+    LedgerHeaderHistoryEntry lcl;
+    if (!fs::exists(savedDir))
+    {
+        if (!BucketManager::loadLocalState(bucketDir, has, lcl))
+        {
+            return nullptr;
+        }
+        if (std::rename(bucketDir.c_str(), savedDir.c_str()) != 0)
+        {
+            LOG(ERROR) << "Failed to move " << bucketDir << " to " << savedDir;
+            return nullptr;
+        }
+    }
+    else
+    {
+        LOG(INFO) << "Resuming restore from " << savedDir;
+    }
+    if (!BucketManager::loadLocalState(savedDir, has, lcl))
+    {
+        return nullptr;
+    }
+
+    LOG(INFO) << "Restoring ledger state of "
+              << LedgerManager::ledgerAbbrev(lcl) << " from " << savedDir;
+    auto app = Application::create(clock, cfg, true);
+
+    // linked rather than moved, savedDir stays complete until the end
+    auto isBucket = [](std::string const& name) {
+        return name.compare(0, 7, "bucket-") == 0;
+    };
+    for (auto const& name : fs::findfiles(savedDir, isBucket))
+    {
+        auto from = savedDir + "/" + name;
+        auto to = bucketDir + "/" + name;
+        if (!fs::hardLink(from, to))
+        {
+            LOG(ERROR) << "Failed to link " << from << " to " << to;
+            return nullptr;
+        }
+    }
+    auto missing = app->getBucketManager().checkForMissingBucketsFiles(has);
+    if (!missing.empty())
+    {
+        LOG(ERROR) << missing.size() << " buckets are missing in " << savedDir
+                   << ", use a catchup instead";
+        return nullptr;
+    }
+
+    std::map<std::string, std::shared_ptr<Bucket>> buckets;
+    auto work =
+        app->getWorkManager().executeWork<ApplyBucketsWork>(buckets, has);
+    if (work->getState() != Work::WORK_SUCCESS)
+    {
+        LOG(ERROR) << "Failed to apply buckets";
+        return nullptr;
+    }
+    app->getLedgerManager().setLastClosedLedger(lcl);
+
+    fs::deltree(savedDir);
+    LOG(INFO) << "Restored ledger state of "
+              << LedgerManager::ledgerAbbrev(lcl);
+    return app;
+}
+
+Application::pointer
+createApplicationOnStart(VirtualClock& clock, Config const& cfg)
+{
+    if (!cfg.RESTORE_FROM_BUCKETS_ON_START)
+    {
+        return Application::create(clock, cfg, false);
+    }
+    if (cfg.DATABASE.value != "sqlite3://:memory:")
+    {
+        throw std::runtime_error("RESTORE_FROM_BUCKETS_ON_START requires "
+                                 "DATABASE=\"sqlite3://:memory:\"");
+    }
+    // the in-memory database starts empty, the ledger state the previous
+    // run left in the buckets is put back into it
+    auto app = restoreFromBuckets(clock, cfg);
+    if (!app)
+    {
+        LOG(WARNING) << "Could not restore the ledger state from "
+                     << cfg.BUCKET_DIR_PATH
+                     << ", starting from the genesis ledger";
+        app = Application::create(clock, cfg, true);
+    }
+    return app;
+}
+
+void
+recoverLostLedgers(Application& app)
+{
+    auto const& bucketDir = app.getConfig().BUCKET_DIR_PATH;
+    auto lastLedger = app.getPersistentState().getState(
+        PersistentState::kLastClosedLedger);
+    if (lastLedger.empty())
+    {
+        return;
+    }
+    auto header = LedgerHeaderFrame::loadByHash(hexToBin256(lastLedger),
+                                                app.getDatabase());
+    HistoryArchiveState has;
+    LedgerHeaderHistoryEntry lcl;
+    if (!header || !BucketManager::loadLocalState(bucketDir, has, lcl) ||
+        lcl.header.ledgerSeq <= header->mHeader.ledgerSeq)
+    {
+        return;
+    }
+
+    auto first = header->mHeader.ledgerSeq + 1;
+    auto last = lcl.header.ledgerSeq;
+    LOG(WARNING) << "Ledgers " << first << " to " << last
+                 << " were lost by the database";
+    auto missing = app.getBucketManager().checkForMissingBucketsFiles(has);
+    if (!missing.empty())
+    {
+        LOG(WARNING) << missing.size() << " buckets are missing in "
+                     << bucketDir << ", catching up from "
+                     << LedgerManager::ledgerAbbrev(header);
+        return;
+    }
+
+    LOG(INFO) << "Recovering the ledger state of "
+              << LedgerManager::ledgerAbbrev(lcl) << " from " << bucketDir;
+    std::map<std::string, std::shared_ptr<Bucket>> buckets;
+    auto work =
+        app.getWorkManager().executeWork<ApplyBucketsWork>(buckets, has);
+    if (work->getState() != Work::WORK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to apply buckets of " +
+                                 LedgerManager::ledgerAbbrev(lcl));
+    }
+    app.getLedgerManager().setLastClosedLedger(lcl);
+    LOG(WARNING) << "Recovered " << LedgerManager::ledgerAbbrev(lcl)
+                 << ", the transactions of ledgers " << first << " to "
+                 << last << " are not in the database";
+}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/Application.h"
+
+namespace stellar
+{
+
+class Config;
+class VirtualClock;
+
+// Rebuilds the database of @p cfg (lost or corrupted) from its bucket
+// directory alone, with no network access: the buckets referenced by the
+// local state saved there on every ledger close (see
+// BucketManager::storeLocalState) are applied to a new database, and that
+// state's ledger becomes the LCL. Transaction history and publish queue are
+// not restored; the node then catches up from that ledger as usual.
+//
+// The buckets are set aside in BUCKET_DIR_PATH-restore while this runs, and
+// taken from there if a previous attempt was interrupted. Returns the
+// application or nullptr (with the reason logged) on failure.
+Application::pointer restoreFromBuckets(VirtualClock& clock, Config const& cfg);
+
+// The application a node starts with. With RESTORE_FROM_BUCKETS_ON_START, its
+// in-memory database is rebuilt by restoreFromBuckets, or created anew at the
+// genesis ledger when that fails; otherwise the database of @p cfg is opened
+// as it is. Throws std::runtime_error if RESTORE_FROM_BUCKETS_ON_START is set
+// with another DATABASE than "sqlite3://:memory:".
+Application::pointer createApplicationOnStart(VirtualClock& clock,
+                                              Config const& cfg);
+
+// With DATABASE_DURABILITY=RELAXED, the last ledgers closed before a crash
+// may be missing from the database of @p app (not started yet) while the
+// local state saved in its bucket directory has them: the database is then
+// brought to that state's ledger by applying its buckets. The transactions
+// of the lost ledgers are not restored, as with a catchup applying buckets.
+// When buckets are missing, the database is left as it is and the node
+// catches up from its last closed ledger. Throws std::runtime_error if
+// applying the buckets fails.
+void recoverLostLedgers(Application& app);
+}
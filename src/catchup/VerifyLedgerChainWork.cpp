@@ -3,7 +3,9 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "catchup/VerifyLedgerChainWork.h"
+#include "catchup/CatchupManager.h"
 #include "history/FileTransferInfo.h"
+#include "history/HistoryCache.h"
 #include "historywork/Progress.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
@@ -12,6 +14,9 @@
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
+#include <algorithm>
+#include <thread>
+
 namespace stellar
 {
 
@@ -99,6 +104,127 @@ VerifyLedgerChainWork::getStatus() const
     return Work::getStatus();
 }
 
+struct VerifyLedgerChainWork::CheckpointVerification
+{
+    std::string mPath;
+    uint32_t mCheckpoint;
+    uint32_t mLastLedger;
+    // earlier ledgers in the file are harmless prehistory
+    uint32_t mMinLedger;
+
+    // set on the worker thread
+    HistoryManager::LedgerVerificationStatus mStatus{
+        HistoryManager::VERIFY_STATUS_OK};
+    // first ledger of the chain (when it did not start from a known one)
+    // and last ledger read
+    LedgerHeaderHistoryEntry mFirst;
+    LedgerHeaderHistoryEntry mLast;
+    uint64_t mVerifiedCount{0};
+    uint64_t mOldCount{0};
+
+    // set on the main thread
+    bool mDone{false};
+
+    void verify(LedgerHeaderHistoryEntry prev);
+};
+
+void
+VerifyLedgerChainWork::CheckpointVerification::verify(
+    LedgerHeaderHistoryEntry prev)
+{
+    XDRInputFileStream hdrIn;
+    LedgerHeaderHistoryEntry curr;
+
+    CLOG(DEBUG, "History") << "Verifying ledger headers from " << mPath
+                           << " starting from ledger "
+                           << LedgerManager::ledgerAbbrev(prev);
+
+    try
+    {
+        hdrIn.open(mPath);
+        while (hdrIn && hdrIn.readOne(curr))
+        {
+            if (curr.header.ledgerVersion >
+                Config::CURRENT_LEDGER_PROTOCOL_VERSION)
+            {
+                mStatus = HistoryManager::VERIFY_STATUS_ERR_BAD_LEDGER_VERSION;
+                return;
+            }
+
+            if (curr.header.ledgerSeq < mMinLedger)
+            {
+                mOldCount++;
+                continue;
+            }
+
+            if (prev.header.ledgerSeq == 0)
+            {
+                // When we have no previous state to connect up with
+                // (eg. starting somewhere mid-chain like in CATCHUP_MINIMAL,
+                // or in any checkpoint but the first one) we just accept the
+                // first chain entry we see. We will verify the chain
+                // continuously from here, the previous checkpoint and the
+                // live network.
+                prev = curr;
+                mFirst = curr;
+                mVerifiedCount++;
+                continue;
+            }
+
+            uint32_t expectedSeq = prev.header.ledgerSeq + 1;
+            if (curr.header.ledgerSeq < expectedSeq)
+            {
+                // Harmless prehistory
+                mOldCount++;
+                continue;
+            }
+            else if (curr.header.ledgerSeq > expectedSeq)
+            {
+                CLOG(ERROR, "History")
+                    << "History chain overshot expected ledger seq "
+                    << expectedSeq << ", got " << curr.header.ledgerSeq
+                    << " instead";
+                mStatus = HistoryManager::VERIFY_STATUS_ERR_OVERSHOT;
+                return;
+            }
+            auto linkResult = verifyLedgerHistoryLink(prev.hash, curr);
+            if (linkResult != HistoryManager::VERIFY_STATUS_OK)
+            {
+                mStatus = linkResult;
+                return;
+            }
+            mVerifiedCount++;
+            prev = curr;
+
+            if (curr.header.ledgerSeq == mLastLedger)
+            {
+                break;
+            }
+        }
+    }
+    catch (std::runtime_error& e)
+    {
+        CLOG(ERROR, "History") << "Failed reading " << mPath << ": "
+                               << e.what();
+        mStatus = HistoryManager::VERIFY_STATUS_ERR_MISSING_ENTRIES;
+        return;
+    }
+
+    if (curr.header.ledgerSeq != mCheckpoint &&
+        curr.header.ledgerSeq != mLastLedger)
+    {
+        // We can end at mCheckpoint if history chain file was valid
+        // Or we can end at mLastLedger if history chain file was valid and we
+        // reached last ledger that we should check.
+        // Any other ledger here means that file is corrupted.
+        CLOG(ERROR, "History") << "History chain did not end with "
+                               << mCheckpoint << " or " << mLastLedger;
+        mStatus = HistoryManager::VERIFY_STATUS_ERR_MISSING_ENTRIES;
+        return;
+    }
+    mLast = curr;
+}
+
 void
 VerifyLedgerChainWork::onReset()
 {
@@ -117,104 +243,138 @@ VerifyLedgerChainWork::onReset()
     }
     mCurrCheckpoint =
         mApp.getHistoryManager().checkpointContainingLedger(mRange.first());
+    mNextToVerify = mCurrCheckpoint;
+    mVerifying.clear();
+    mGeneration++;
+    mStatus = HistoryManager::VERIFY_STATUS_OK;
 }
 
-HistoryManager::LedgerVerificationStatus
-VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
+void
+VerifyLedgerChainWork::startVerifications()
 {
-    FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
-                        mCurrCheckpoint);
-    XDRInputFileStream hdrIn;
-    hdrIn.open(ft.localPath_nogz());
-
-    LedgerHeaderHistoryEntry prev = mLastVerified;
-    LedgerHeaderHistoryEntry curr;
+    auto& hm = mApp.getHistoryManager();
+    auto firstCheckpoint = hm.checkpointContainingLedger(mRange.first());
+    auto lastCheckpoint = hm.checkpointContainingLedger(mRange.last());
+    // enough to keep all worker threads busy
+    size_t maxVerifying =
+        2 * std::max(1u, std::thread::hardware_concurrency());
 
-    CLOG(DEBUG, "History") << "Verifying ledger headers from "
-                           << ft.localPath_nogz() << " starting from ledger "
-                           << LedgerManager::ledgerAbbrev(prev);
-
-    while (hdrIn && hdrIn.readOne(curr))
+    std::weak_ptr<VerifyLedgerChainWork> weak(
+        std::static_pointer_cast<VerifyLedgerChainWork>(shared_from_this()));
+    auto& app = mApp;
+    auto generation = mGeneration;
+    while (mNextToVerify <= lastCheckpoint &&
+           mVerifying.size() < maxVerifying)
     {
-        if (curr.header.ledgerVersion > Config::CURRENT_LEDGER_PROTOCOL_VERSION)
-        {
-            mVerifyLedgerFailureLedgerVersion.Mark();
-            return HistoryManager::VERIFY_STATUS_ERR_BAD_LEDGER_VERSION;
-        }
+        auto v = std::make_shared<CheckpointVerification>();
+        v->mPath = FileTransferInfo(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
+                                    mNextToVerify)
+                       .localPath_nogz();
+        v->mCheckpoint = mNextToVerify;
+        v->mLastLedger = mRange.last();
 
-        if (prev.header.ledgerSeq == 0)
+        // only the first checkpoint connects to an already known ledger,
+        // the others are linked to their predecessor in verified()
+        LedgerHeaderHistoryEntry prev;
+        if (mNextToVerify == firstCheckpoint)
         {
-            // When we have no previous state to connect up with
-            // (eg. starting somewhere mid-chain like in CATCHUP_MINIMAL)
-            // we just accept the first chain entry we see. We will
-            // verify the chain continuously from here, and against the
-            // live network.
-            prev = curr;
-            mVerifyLedgerSuccess.Mark();
-            continue;
+            prev = mLastVerified;
+            v->mMinLedger = 0;
         }
-
-        uint32_t expectedSeq = prev.header.ledgerSeq + 1;
-        if (curr.header.ledgerSeq < expectedSeq)
+        else
         {
-            // Harmless prehistory
-            mVerifyLedgerSuccessOld.Mark();
-            continue;
+            v->mMinLedger = mNextToVerify + 1 - hm.getCheckpointFrequency();
         }
-        else if (curr.header.ledgerSeq > expectedSeq)
+
+        mVerifying[mNextToVerify] = v;
+        auto& workers =
+            app.getWorkerIOService(Application::WORKER_POOL_CRYPTO_VERIFY);
+        workers.post([&app, weak, v, prev, generation]() {
+            v->verify(prev);
+            app.getClock().postToMain(
+                [weak, v, generation]() {
+                    v->mDone = true;
+                    auto self = weak.lock();
+                    if (self)
+                    {
+                        self->verified(generation);
+                    }
+                },
+                "catchup.verify");
+        });
+        mNextToVerify += hm.getCheckpointFrequency();
+    }
+}
+
+HistoryManager::LedgerVerificationStatus
+VerifyLedgerChainWork::linkCheckpoint(CheckpointVerification const& v)
+{
+    mVerifyLedgerSuccessOld.Mark(v.mOldCount);
+    mVerifyLedgerSuccess.Mark(v.mVerifiedCount);
+    switch (v.mStatus)
+    {
+    case HistoryManager::VERIFY_STATUS_OK:
+        break;
+    case HistoryManager::VERIFY_STATUS_ERR_BAD_LEDGER_VERSION:
+        mVerifyLedgerFailureLedgerVersion.Mark();
+        return v.mStatus;
+    case HistoryManager::VERIFY_STATUS_ERR_OVERSHOT:
+        mVerifyLedgerFailureOvershot.Mark();
+        return v.mStatus;
+    case HistoryManager::VERIFY_STATUS_ERR_MISSING_ENTRIES:
+        mVerifyLedgerChainFailureEnd.Mark();
+        return v.mStatus;
+    default:
+        mVerifyLedgerFailureLink.Mark();
+        return v.mStatus;
+    }
+
+    auto& hm = mApp.getHistoryManager();
+    auto firstCheckpoint = hm.checkpointContainingLedger(mRange.first());
+    if (v.mCheckpoint != firstCheckpoint)
+    {
+        // the boundary link, the rest of the chain was verified by a worker
+        uint32_t expectedSeq = mLastVerified.header.ledgerSeq + 1;
+        if (v.mFirst.header.ledgerSeq != expectedSeq)
         {
             CLOG(ERROR, "History")
-                << "History chain overshot expected ledger seq " << expectedSeq
-                << ", got " << curr.header.ledgerSeq << " instead";
+                << "History chain overshot expected ledger seq "
+                << expectedSeq << ", got " << v.mFirst.header.ledgerSeq
+                << " instead";
             mVerifyLedgerFailureOvershot.Mark();
             return HistoryManager::VERIFY_STATUS_ERR_OVERSHOT;
         }
-        auto linkResult = verifyLedgerHistoryLink(prev.hash, curr);
+        auto linkResult = verifyLedgerHistoryLink(mLastVerified.hash, v.mFirst);
         if (linkResult != HistoryManager::VERIFY_STATUS_OK)
         {
             mVerifyLedgerFailureLink.Mark();
             return linkResult;
         }
-        mVerifyLedgerSuccess.Mark();
-        prev = curr;
-
-        if (curr.header.ledgerSeq == mRange.last())
-        {
-            break;
-        }
-    }
-
-    if (curr.header.ledgerSeq != mCurrCheckpoint &&
-        curr.header.ledgerSeq != mRange.last())
-    {
-        // We can end at mCurrCheckpoint if history chain file was valid
-        // Or we can end at mRange.last() if history chain file was valid and we
-        // reached last ledger that we should check.
-        // Any other ledger here means that file is corrupted.
-        CLOG(ERROR, "History") << "History chain did not end with "
-                               << mCurrCheckpoint << " or " << mRange.last();
-        mVerifyLedgerChainFailureEnd.Mark();
-        return HistoryManager::VERIFY_STATUS_ERR_MISSING_ENTRIES;
     }
 
     auto status = HistoryManager::VERIFY_STATUS_OK;
-    if (curr.header.ledgerSeq == mRange.last())
+    if (v.mLast.header.ledgerSeq == mRange.last())
     {
         CLOG(INFO, "History") << "Verifying catchup candidate "
-                              << curr.header.ledgerSeq << " with LedgerManager";
-        status = mApp.getLedgerManager().verifyCatchupCandidate(curr,
-                                                                mManualCatchup);
+                              << v.mLast.header.ledgerSeq
+                              << " with LedgerManager";
+        status = mApp.getLedgerManager().verifyCatchupCandidate(
+            v.mLast, mManualCatchup);
     }
 
     if (status == HistoryManager::VERIFY_STATUS_OK)
     {
         mVerifyLedgerChainSuccess.Mark();
-        if (mCurrCheckpoint ==
-            mApp.getHistoryManager().checkpointContainingLedger(mRange.first()))
+        auto freq = hm.getCheckpointFrequency();
+        auto lastCheckpoint = hm.checkpointContainingLedger(mRange.last());
+        mApp.getCatchupManager().reportProgress(
+            "verify-ledgers", (v.mCheckpoint - firstCheckpoint) / freq + 1,
+            (lastCheckpoint - firstCheckpoint) / freq + 1);
+        if (v.mCheckpoint == firstCheckpoint)
         {
-            mFirstVerified = curr;
+            mFirstVerified = v.mLast;
         }
-        mLastVerified = curr;
+        mLastVerified = v.mLast;
     }
     else
     {
@@ -224,30 +384,90 @@ VerifyLedgerChainWork::verifyHistoryOfSingleCheckpoint()
     return status;
 }
 
-Work::State
-VerifyLedgerChainWork::onSuccess()
+void
+VerifyLedgerChainWork::verified(uint32_t generation)
 {
-    mApp.getCatchupManager().logAndUpdateCatchupStatus(true);
+    if (generation != mGeneration || getState() != WORK_RUNNING)
+    {
+        return;
+    }
 
-    if (mCurrCheckpoint >
-        mApp.getHistoryManager().checkpointContainingLedger(mRange.last()))
+    auto it = mVerifying.find(mCurrCheckpoint);
+    while (it != mVerifying.end() && it->second->mDone)
     {
-        throw std::runtime_error("Verification overshot target ledger");
+        auto v = it->second;
+        mVerifying.erase(it);
+        mStatus = linkCheckpoint(*v);
+        if (mStatus != HistoryManager::VERIFY_STATUS_OK ||
+            mLastVerified.header.ledgerSeq == mRange.last())
+        {
+            // done, later results are of no use
+            mGeneration++;
+            mVerifying.clear();
+            scheduleSuccess();
+            return;
+        }
+        mCurrCheckpoint += mApp.getHistoryManager().getCheckpointFrequency();
+        it = mVerifying.find(mCurrCheckpoint);
     }
+    mApp.getCatchupManager().logAndUpdateCatchupStatus(true);
+    startVerifications();
+}
 
-    // This is in onSuccess rather than onRun, so we can force a FAILURE_RAISE.
-    switch (verifyHistoryOfSingleCheckpoint())
+void
+VerifyLedgerChainWork::updateCache()
+{
+    auto& hm = mApp.getHistoryManager();
+    auto& cache = hm.getCache();
+    if (!cache.isEnabled())
     {
-    case HistoryManager::VERIFY_STATUS_OK:
-        if (mLastVerified.header.ledgerSeq == mRange.last())
+        return;
+    }
+    auto firstCheckpoint = hm.checkpointContainingLedger(mRange.first());
+    auto lastCheckpoint = hm.checkpointContainingLedger(mRange.last());
+    for (auto checkpoint = firstCheckpoint; checkpoint <= lastCheckpoint;
+         checkpoint += hm.getCheckpointFrequency())
+    {
+        FileTransferInfo ft(mDownloadDir, HISTORY_FILE_TYPE_LEDGER,
+                            checkpoint);
+        if (mStatus != HistoryManager::VERIFY_STATUS_OK)
+        {
+            cache.remove(ft.baseName_nogz());
+        }
+        // the ledgers of the first checkpoint before the LCL and of the last
+        // one after the range are not verified
+        else if (checkpoint != firstCheckpoint && checkpoint <= mRange.last())
         {
-            CLOG(INFO, "History") << "History chain [" << mRange.first() << ","
-                                  << mRange.last() << "] verified";
-            return WORK_SUCCESS;
+            cache.add(ft.baseName_nogz(), ft.localPath_nogz());
         }
+    }
+}
 
-        mCurrCheckpoint += mApp.getHistoryManager().getCheckpointFrequency();
-        return WORK_RUNNING;
+void
+VerifyLedgerChainWork::onStart()
+{
+    startVerifications();
+}
+
+void
+VerifyLedgerChainWork::onRun()
+{
+    // Do nothing: verifications were started in onStart().
+}
+
+Work::State
+VerifyLedgerChainWork::onSuccess()
+{
+    mApp.getCatchupManager().logAndUpdateCatchupStatus(true);
+    updateCache();
+
+    // This is in onSuccess rather than onRun, so we can force a FAILURE_RAISE.
+    switch (mStatus)
+    {
+    case HistoryManager::VERIFY_STATUS_OK:
+        CLOG(INFO, "History") << "History chain [" << mRange.first() << ","
+                              << mRange.last() << "] verified";
+        return WORK_SUCCESS;
     case HistoryManager::VERIFY_STATUS_ERR_BAD_LEDGER_VERSION:
         CLOG(ERROR, "History") << "Catchup material failed verification - "
                                   "unsupported ledger version, propagating "
@@ -8,6 +8,9 @@
 #include "ledger/LedgerRange.h"
 #include "work/Work.h"
 
+#include <map>
+#include <memory>
+
 namespace medida
 {
 class Meter;
@@ -19,11 +22,30 @@ namespace stellar
 class TmpDir;
 struct LedgerHeaderHistoryEntry;
 
+/**
+ * Verifies the hash chain of downloaded ledger header files, from the last
+ * closed ledger (if any) up to the end of the range, which is checked against
+ * LedgerManager::verifyCatchupCandidate.
+ *
+ * The chain inside each checkpoint file is verified on worker threads, a few
+ * checkpoints at once; the main thread then links each checkpoint to the
+ * previous one, in order, so the whole chain is anchored just as if it was
+ * verified ledger by ledger.
+ */
 class VerifyLedgerChainWork : public Work
 {
+    // what a worker thread found in one checkpoint file
+    struct CheckpointVerification;
+
     TmpDir const& mDownloadDir;
     LedgerRange mRange;
     uint32_t mCurrCheckpoint;
+    uint32_t mNextToVerify;
+    // checkpoints being verified (or verified but not linked yet)
+    std::map<uint32_t, std::shared_ptr<CheckpointVerification>> mVerifying;
+    // incremented on each reset, to ignore results of previous attempts
+    uint32_t mGeneration{0};
+    HistoryManager::LedgerVerificationStatus mStatus;
     bool mManualCatchup;
     LedgerHeaderHistoryEntry& mFirstVerified;
     LedgerHeaderHistoryEntry& mLastVerified;
@@ -37,7 +59,13 @@ class VerifyLedgerChainWork : public Work
     medida::Meter& mVerifyLedgerChainFailure;
     medida::Meter& mVerifyLedgerChainFailureEnd;
 
-    HistoryManager::LedgerVerificationStatus verifyHistoryOfSingleCheckpoint();
+    void startVerifications();
+    void verified(uint32_t generation);
+    HistoryManager::LedgerVerificationStatus
+    linkCheckpoint(CheckpointVerification const& verification);
+    // adds the verified ledger files to the HistoryCache, or drops them from
+    // it when verification failed (they may have come from there)
+    void updateCache();
 
   public:
     VerifyLedgerChainWork(Application& app, WorkParent& parent,
@@ -48,6 +76,8 @@ class VerifyLedgerChainWork : public Work
     ~VerifyLedgerChainWork();
     std::string getStatus() const override;
     void onReset() override;
+    void onStart() override;
+    void onRun() override;
     Work::State onSuccess() override;
 };
 }
@@ -10,11 +10,20 @@
 #include "crypto/StrKey.h"
 #include "lib/catch.hpp"
 #include "test/test.h"
+#include "util/Decoder.h"
 #include "util/Logging.h"
+#include "util/ShardedMetrics.h"
+#include <atomic>
 #include <autocheck/autocheck.hpp>
+#include <chrono>
+#include <functional>
 #include <map>
 #include <regex>
 #include <sodium.h>
+#include <thread>
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 
 using namespace stellar;
 
@@ -64,6 +73,16 @@ TEST_CASE("hex tests", "[crypto]")
             return v == dec;
         },
         20);
+
+    // Every length around the 16 bytes the vector encoder works on.
+    for (size_t n = 0; n < 80; n++)
+    {
+        auto v = randomBytes(n);
+        std::vector<char> ref(n * 2 + 1);
+        sodium_bin2hex(ref.data(), ref.size(), v.data(), v.size());
+        REQUIRE(binToHex(v) == std::string(ref.data()));
+        REQUIRE(hexAbbrev(v) == std::string(ref.data()).substr(0, 6));
+    }
 }
 
 static std::map<std::string, std::string> sha256TestVectors = {
@@ -103,6 +122,60 @@ TEST_CASE("Stateful SHA256 tests", "[crypto]")
     }
 }
 
+TEST_CASE("SHA256 backend agrees with libsodium", "[crypto]")
+{
+    LOG(INFO) << "SHA256 backend: " << getSHA256Backend();
+
+    // around the block size and the padding boundaries
+    std::vector<std::vector<uint8_t>> msgs;
+    for (size_t size : {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 1000, 4099})
+    {
+        std::vector<uint8_t> msg(size);
+        randombytes_buf(msg.data(), msg.size());
+        msgs.emplace_back(msg);
+    }
+
+    std::vector<uint256> expected;
+    for (auto const& msg : msgs)
+    {
+        uint256 out;
+        crypto_hash_sha256(out.data(), msg.data(), msg.size());
+        expected.emplace_back(out);
+    }
+
+    for (size_t i = 0; i < msgs.size(); i++)
+    {
+        REQUIRE(sha256(msgs[i]) == expected[i]);
+
+        // in uneven pieces
+        auto h = SHA256::create();
+        for (size_t j = 0; j < msgs[i].size(); j += 7 + j % 61)
+        {
+            auto n = std::min(msgs[i].size() - j, 7 + j % 61);
+            h->add(ByteSlice(msgs[i].data() + j, n));
+        }
+        REQUIRE(h->finish() == expected[i]);
+    }
+
+    SECTION("misuse after finish")
+    {
+        auto h = SHA256::create();
+        h->add(msgs[1]);
+        REQUIRE(h->finish() == expected[1]);
+        REQUIRE_THROWS_AS(h->finish(), std::runtime_error);
+        REQUIRE_THROWS_AS(h->add(msgs[1]), std::runtime_error);
+        h->reset();
+        h->add(msgs[1]);
+        REQUIRE(h->finish() == expected[1]);
+    }
+
+    // odd count, to also have a message hashed alone
+    std::vector<ByteSlice> slices(msgs.begin(), msgs.end() - 1);
+    auto hashes = sha256Multi(slices);
+    REQUIRE(hashes ==
+            std::vector<uint256>(expected.begin(), expected.end() - 1));
+}
+
 TEST_CASE("HMAC test vector", "[crypto]")
 {
     HmacSha256Key k;
@@ -115,6 +188,16 @@ TEST_CASE("HMAC test vector", "[crypto]")
     auto v = hmacSha256(k, s);
     REQUIRE(h == v.mac);
     REQUIRE(hmacSha256Verify(v, k, s));
+
+    SECTION("with prefix")
+    {
+        std::string str(s);
+        for (size_t i = 0; i <= str.size(); i += 5)
+        {
+            auto w = hmacSha256(k, str.substr(0, i), str.substr(i));
+            REQUIRE(h == w.mac);
+        }
+    }
 }
 
 TEST_CASE("HKDF test vector", "[crypto]")
@@ -156,6 +239,139 @@ TEST_CASE("sign tests", "[crypto]")
     CHECK(!PubKeyUtils::verifySig(pk, sig, msg));
 }
 
+TEST_CASE("verify signature cache", "[crypto]")
+{
+    medida::MetricsRegistry metrics;
+    ShardedMetrics sharded(metrics);
+    PubKeyUtils::VerifySigCacheMeters meters{
+        sharded.NewMeter({"crypto", "verify", "hit"}, "signature"),
+        sharded.NewMeter({"crypto", "verify", "miss"}, "signature"),
+        sharded.NewMeter({"crypto", "verify", "total"}, "signature")};
+
+    // the meters must not outlive the registry
+    struct MetersGuard
+    {
+        PubKeyUtils::VerifySigCacheMeters const* mMeters;
+        ~MetersGuard()
+        {
+            PubKeyUtils::clearVerifySigCacheMeters(mMeters);
+            PubKeyUtils::setVerifySigCacheSize(
+                PubKeyUtils::DEFAULT_VERIFY_SIG_CACHE_SIZE);
+        }
+    } guard{&meters};
+    PubKeyUtils::setVerifySigCacheMeters(&meters);
+    PubKeyUtils::clearVerifySigCache();
+
+    auto sk = SecretKey::random();
+    auto pk = sk.getPublicKey();
+    auto sig = sk.sign(std::string("hello"));
+
+    SECTION("hit and miss meters")
+    {
+        REQUIRE(PubKeyUtils::verifySig(pk, sig, std::string("hello")));
+        REQUIRE(PubKeyUtils::verifySig(pk, sig, std::string("hello")));
+        REQUIRE(!PubKeyUtils::verifySig(pk, sig, std::string("hello!")));
+        REQUIRE(!PubKeyUtils::verifySig(pk, sig, std::string("hello!")));
+        REQUIRE(meters.mHit.count() == 2);
+        REQUIRE(meters.mMiss.count() == 2);
+        REQUIRE(meters.mTotal.count() == 4);
+        REQUIRE(PubKeyUtils::getVerifySigCacheSize() == 2);
+    }
+
+    SECTION("capacity")
+    {
+        PubKeyUtils::setVerifySigCacheSize(64);
+        for (int i = 0; i < 1000; i++)
+        {
+            PubKeyUtils::verifySig(pk, sig, std::to_string(i));
+        }
+        REQUIRE(PubKeyUtils::getVerifySigCacheSize() <= 64);
+        REQUIRE(PubKeyUtils::getVerifySigCacheSize() > 0);
+    }
+
+    SECTION("concurrent verification")
+    {
+        size_t const nbThreads = 4;
+        size_t const nbSigs = 200;
+        std::vector<std::string> msgs;
+        std::vector<Signature> sigs;
+        for (size_t i = 0; i < nbSigs; i++)
+        {
+            msgs.emplace_back(std::to_string(i));
+            sigs.emplace_back(sk.sign(msgs.back()));
+        }
+
+        std::vector<std::thread> threads;
+        std::atomic<size_t> verified{0};
+        for (size_t t = 0; t < nbThreads; t++)
+        {
+            threads.emplace_back([&]() {
+                for (size_t i = 0; i < nbSigs; i++)
+                {
+                    if (PubKeyUtils::verifySig(pk, sigs[i], msgs[i]))
+                    {
+                        ++verified;
+                    }
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        REQUIRE(verified == nbThreads * nbSigs);
+        REQUIRE(meters.mTotal.count() == nbThreads * nbSigs);
+        REQUIRE(meters.mHit.count() + meters.mMiss.count() ==
+                nbThreads * nbSigs);
+        REQUIRE(meters.mMiss.count() >= nbSigs);
+        REQUIRE(PubKeyUtils::getVerifySigCacheSize() == nbSigs);
+    }
+}
+
+TEST_CASE("batch signature verification", "[crypto]")
+{
+    PubKeyUtils::clearVerifySigCache();
+
+    std::vector<SecretKey> keys;
+    std::vector<PublicKey> pubs;
+    std::vector<std::string> msgs;
+    std::vector<Signature> sigs;
+    for (int i = 0; i < 100; i++)
+    {
+        keys.emplace_back(SecretKey::random());
+        pubs.emplace_back(keys.back().getPublicKey());
+        msgs.emplace_back(std::to_string(i));
+        sigs.emplace_back(keys.back().sign(msgs.back()));
+    }
+    // a bad signature, a signature by the wrong key and a truncated one
+    sigs[10][4] ^= 1;
+    sigs[20] = keys[21].sign(msgs[20]);
+    sigs[30].resize(32);
+
+    auto check = [&]() {
+        std::vector<PubKeyUtils::SigToVerify> batch;
+        for (size_t i = 0; i < sigs.size(); i++)
+        {
+            batch.emplace_back(
+                PubKeyUtils::SigToVerify{pubs[i], sigs[i], msgs[i]});
+        }
+        auto res = PubKeyUtils::verifySigBatch(batch);
+        REQUIRE(res.size() == sigs.size());
+        for (size_t i = 0; i < sigs.size(); i++)
+        {
+            REQUIRE(res[i] == PubKeyUtils::verifySig(pubs[i], sigs[i],
+                                                     msgs[i]));
+            REQUIRE(res[i] == (i != 10 && i != 20 && i != 30));
+        }
+    };
+
+    // first from scratch, then from the cache
+    check();
+    REQUIRE(PubKeyUtils::getVerifySigCacheSize() == sigs.size() - 1);
+    check();
+    REQUIRE(PubKeyUtils::verifySigBatch({}).empty());
+}
+
 struct SignVerifyTestcase
 {
     SecretKey key;
@@ -208,6 +424,72 @@ TEST_CASE("sign and verify benchmarking", "[crypto-bench][bench][!hide]")
     }
 }
 
+TEST_CASE("public key StrKeys", "[crypto]")
+{
+    // many more keys than the cache has room for, each rendered twice
+    std::vector<PublicKey> keys;
+    for (size_t i = 0; i < 2000; i++)
+    {
+        keys.emplace_back(SecretKey::random().getPublicKey());
+    }
+    for (int round = 0; round < 2; round++)
+    {
+        for (auto const& k : keys)
+        {
+            auto s = KeyUtils::toStrKey(k);
+            REQUIRE(s == strKey::toStrKey(strKey::STRKEY_PUBKEY_ED25519,
+                                          k.ed25519())
+                             .value);
+            REQUIRE(KeyUtils::fromStrKey<PublicKey>(s) == k);
+        }
+    }
+}
+
+TEST_CASE("hex and StrKey benchmarking", "[crypto-bench][bench][!hide]")
+{
+    size_t n = 1000000;
+    auto hash = sha256(randomBytes(32));
+    auto key = SecretKey::random().getPublicKey();
+    auto measure = [n](std::string const& name,
+                       std::function<void()> const& f) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            f();
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+        LOG(INFO) << name << ": " << ns / n << " ns";
+    };
+
+    LOG(INFO) << "Benchmarking " << n << " encodings";
+    size_t total = 0;
+    measure("binToHex", [&]() { total += binToHex(hash).size(); });
+    measure("sodium_bin2hex", [&]() {
+        char hex[65];
+        sodium_bin2hex(hex, sizeof(hex), hash.data(), hash.size());
+        total += hex[0];
+    });
+    measure("strKey::toStrKey", [&]() {
+        total += strKey::toStrKey(strKey::STRKEY_PUBKEY_ED25519, key.ed25519())
+                     .value.size();
+    });
+    measure("decoder::encode_b32", [&]() {
+        std::vector<uint8_t> v(key.ed25519().begin(), key.ed25519().end());
+        v.insert(v.begin(), strKey::STRKEY_PUBKEY_ED25519 << 3);
+        v.resize(v.size() + 2);
+        total += decoder::encode_b32(v).size();
+    });
+    measure("KeyUtils::toStrKey (cached)",
+            [&]() { total += KeyUtils::toStrKey(key).size(); });
+    auto s = KeyUtils::toStrKey(key);
+    measure("KeyUtils::fromStrKey", [&]() {
+        total += KeyUtils::fromStrKey<PublicKey>(s).ed25519()[0];
+    });
+    LOG(DEBUG) << total;
+}
+
 TEST_CASE("StrKey tests", "[crypto]")
 {
     std::regex b32("^([A-Z2-7])+$");
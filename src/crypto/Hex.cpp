@@ -5,25 +5,85 @@
 #include "crypto/Hex.h"
 #include <sodium.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define STELLAR_HEX_SSSE3
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 namespace stellar
 {
 
+namespace
+{
+
+char const HEX_DIGITS[] = "0123456789abcdef";
+
+void
+encodeScalar(uint8_t const* bin, size_t n, char* hex)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        hex[2 * i] = HEX_DIGITS[bin[i] >> 4];
+        hex[2 * i + 1] = HEX_DIGITS[bin[i] & 0x0f];
+    }
+}
+
+#ifdef STELLAR_HEX_SSSE3
+
+// 16 bytes at a time: the nibbles index a table of the digits
+__attribute__((target("ssse3"))) void
+encodeSsse3(uint8_t const* bin, size_t n, char* hex)
+{
+    auto const digits =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(HEX_DIGITS));
+    auto const mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        auto in = _mm_loadu_si128(reinterpret_cast<__m128i const*>(bin + i));
+        auto hi = _mm_shuffle_epi8(
+            digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+        auto lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+        auto out = reinterpret_cast<__m128i*>(hex + 2 * i);
+        _mm_storeu_si128(out, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(hi, lo));
+    }
+    encodeScalar(bin + i, n - i, hex + 2 * i);
+}
+
+bool
+cpuHasSsse3()
+{
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3);
+}
+
+#endif
+
+typedef void (*EncodeFn)(uint8_t const* bin, size_t n, char* hex);
+
+EncodeFn
+getEncode()
+{
+#ifdef STELLAR_HEX_SSSE3
+    static EncodeFn const encode = cpuHasSsse3() ? encodeSsse3 : encodeScalar;
+    return encode;
+#else
+    return encodeScalar;
+#endif
+}
+}
+
 std::string
 binToHex(ByteSlice const& bin)
 {
-    // NB: C++ standard says we can't go modifying the contents of a std::string
-    // just by const_cast'ing away const on .data(), so we use a vector<char> to
-    // write to.
-    if (bin.empty())
-        return "";
-    std::vector<char> hex(bin.size() * 2 + 1, '\0');
-    if (sodium_bin2hex(hex.data(), hex.size(), bin.data(), bin.size()) !=
-        hex.data())
+    std::string hex(bin.size() * 2, '\0');
+    if (!bin.empty())
     {
-        throw std::runtime_error(
-            "error in stellar::binToHex(std::vector<uint8_t>)");
+        getEncode()(bin.data(), bin.size(), &hex[0]);
     }
-    return std::string(hex.begin(), hex.end() - 1);
+    return hex;
 }
 
 std::string
@@ -34,7 +94,9 @@ hexAbbrev(ByteSlice const& bin)
     {
         sz = 3;
     }
-    return binToHex(ByteSlice(bin.data(), sz));
+    std::string hex(sz * 2, '\0');
+    encodeScalar(bin.data(), sz, &hex[0]);
+    return hex;
 }
 
 std::vector<uint8_t>
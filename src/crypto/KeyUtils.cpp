@@ -9,6 +9,37 @@
 namespace stellar
 {
 
+namespace
+{
+
+struct StrKeyCacheSlot
+{
+    bool mValid{false};
+    uint256 mKey;
+    std::string mStrKey;
+};
+
+// direct mapped: keys are uniformly random, so their first bytes are as good
+// a slot index as any
+size_t const STRKEY_CACHE_SLOTS = 256;
+}
+
+std::string
+KeyUtils::toStrKey(PublicKey const& key)
+{
+    static thread_local StrKeyCacheSlot cache[STRKEY_CACHE_SLOTS];
+    auto const& value = key.ed25519();
+    auto& slot = cache[value[0] % STRKEY_CACHE_SLOTS];
+    if (!slot.mValid || slot.mKey != value)
+    {
+        slot.mStrKey =
+            strKey::toStrKey(strKey::STRKEY_PUBKEY_ED25519, value).value;
+        slot.mKey = value;
+        slot.mValid = true;
+    }
+    return slot.mStrKey;
+}
+
 size_t
 KeyUtils::getKeyVersionSize(strKey::StrKeyVersionByte keyVersion)
 {
@@ -37,6 +37,10 @@ template <typename T> struct KeyFunctions
 namespace KeyUtils
 {
 
+// Public keys (node and account IDs) are rendered from a small per-thread
+// cache, as the same few keys show up in logs and JSON over and over.
+std::string toStrKey(PublicKey const& key);
+
 template <typename T>
 typename std::enable_if<!std::is_same<T, SecretKey>::value, std::string>::type
 toStrKey(T const& key)
@@ -4,16 +4,104 @@
 
 #include "crypto/SHA.h"
 #include "crypto/ByteSlice.h"
+#include "crypto/SHAHardware.h"
 #include "util/NonCopyable.h"
+#include <cstring>
 #include <sodium.h>
 
 namespace stellar
 {
 
+namespace
+{
+using shahw::BLOCK_SIZE;
+
+uint32_t const INITIAL_STATE[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                   0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                   0x1f83d9ab, 0x5be0cd19};
+
+// copies the last @p len bytes (less than a block) of a message of
+// @p total bytes to @p tail followed by the padding, returns the number of
+// blocks written
+size_t
+padTail(uint8_t const* data, size_t len, uint64_t total,
+        uint8_t tail[2 * BLOCK_SIZE])
+{
+    size_t blocks = len + 9 > BLOCK_SIZE ? 2 : 1;
+    std::memset(tail, 0, blocks * BLOCK_SIZE);
+    if (len != 0)
+    {
+        std::memcpy(tail, data, len);
+    }
+    tail[len] = 0x80;
+    uint64_t bits = total * 8;
+    for (size_t i = 0; i < 8; i++)
+    {
+        tail[blocks * BLOCK_SIZE - 1 - i] =
+            static_cast<uint8_t>(bits >> (8 * i));
+    }
+    return blocks;
+}
+
+uint256
+toDigest(uint32_t const state[8])
+{
+    uint256 out;
+    for (size_t i = 0; i < 8; i++)
+    {
+        for (size_t j = 0; j < 4; j++)
+        {
+            out[4 * i + j] = static_cast<uint8_t>(state[i] >> (24 - 8 * j));
+        }
+    }
+    return out;
+}
+
+// a message being hashed in one go with the instructions of the CPU
+struct Lane
+{
+    uint32_t mState[8];
+    uint8_t const* mData;
+    size_t mFullBlocks;
+    uint8_t mTail[2 * BLOCK_SIZE];
+    size_t mBlocks;
+
+    explicit Lane(ByteSlice const& bin)
+        : mData(bin.data()), mFullBlocks(bin.size() / BLOCK_SIZE)
+    {
+        std::memcpy(mState, INITIAL_STATE, sizeof(mState));
+        auto full = mFullBlocks * BLOCK_SIZE;
+        mBlocks = mFullBlocks +
+                  padTail(mData + full, bin.size() - full, bin.size(), mTail);
+    }
+
+    uint8_t const*
+    getBlock(size_t i) const
+    {
+        return i < mFullBlocks ? mData + i * BLOCK_SIZE
+                               : mTail + (i - mFullBlocks) * BLOCK_SIZE;
+    }
+};
+
+uint256
+sha256Hardware(shahw::CompressFn compress, ByteSlice const& bin)
+{
+    Lane lane(bin);
+    compress(lane.mState, lane.mData, lane.mFullBlocks);
+    compress(lane.mState, lane.mTail, lane.mBlocks - lane.mFullBlocks);
+    return toDigest(lane.mState);
+}
+}
+
 // Plain SHA256
 uint256
 sha256(ByteSlice const& bin)
 {
+    if (auto compress = shahw::getCompress())
+    {
+        return sha256Hardware(compress, bin);
+    }
+
     uint256 out;
     if (crypto_hash_sha256(out.data(), bin.data(), bin.size()) != 0)
     {
@@ -22,6 +110,64 @@ sha256(ByteSlice const& bin)
     return out;
 }
 
+std::vector<uint256>
+sha256Multi(std::vector<ByteSlice> const& bins)
+{
+    std::vector<uint256> res;
+    res.reserve(bins.size());
+    auto compress = shahw::getCompress();
+    auto compress2 = shahw::getCompress2();
+    size_t i = 0;
+    if (compress2)
+    {
+        for (; i + 1 < bins.size(); i += 2)
+        {
+            Lane a(bins[i]);
+            Lane b(bins[i + 1]);
+            auto both = std::min(a.mBlocks, b.mBlocks);
+            for (size_t j = 0; j < both; j++)
+            {
+                compress2(a.mState, a.getBlock(j), b.mState, b.getBlock(j));
+            }
+            auto& longer = a.mBlocks > b.mBlocks ? a : b;
+            for (size_t j = both; j < longer.mBlocks; j++)
+            {
+                compress(longer.mState, longer.getBlock(j), 1);
+            }
+            res.emplace_back(toDigest(a.mState));
+            res.emplace_back(toDigest(b.mState));
+        }
+    }
+    for (; i < bins.size(); i++)
+    {
+        res.emplace_back(sha256(bins[i]));
+    }
+    return res;
+}
+
+char const*
+getSHA256Backend()
+{
+    return shahw::getName();
+}
+
+// incremental SHA256 with the instructions of the CPU
+class HardwareSHA256Impl : public SHA256, NonCopyable
+{
+    shahw::CompressFn const mCompress;
+    uint32_t mState[8];
+    uint8_t mBuffer[BLOCK_SIZE];
+    size_t mBuffered;
+    uint64_t mLength;
+    bool mFinished;
+
+  public:
+    explicit HardwareSHA256Impl(shahw::CompressFn compress);
+    void reset() override;
+    void add(ByteSlice const& bin) override;
+    uint256 finish() override;
+};
+
 class SHA256Impl : public SHA256, NonCopyable
 {
     crypto_hash_sha256_state mState;
@@ -37,9 +183,80 @@ class SHA256Impl : public SHA256, NonCopyable
 std::unique_ptr<SHA256>
 SHA256::create()
 {
+    if (auto compress = shahw::getCompress())
+    {
+        return std::make_unique<HardwareSHA256Impl>(compress);
+    }
     return std::make_unique<SHA256Impl>();
 }
 
+HardwareSHA256Impl::HardwareSHA256Impl(shahw::CompressFn compress)
+    : mCompress(compress)
+{
+    reset();
+}
+
+void
+HardwareSHA256Impl::reset()
+{
+    std::memcpy(mState, INITIAL_STATE, sizeof(mState));
+    mBuffered = 0;
+    mLength = 0;
+    mFinished = false;
+}
+
+void
+HardwareSHA256Impl::add(ByteSlice const& bin)
+{
+    if (mFinished)
+    {
+        throw std::runtime_error("adding bytes to finished SHA256");
+    }
+    auto data = bin.data();
+    auto size = bin.size();
+    mLength += size;
+    if (size == 0)
+    {
+        return;
+    }
+    if (mBuffered != 0)
+    {
+        auto n = std::min(size, BLOCK_SIZE - mBuffered);
+        std::memcpy(mBuffer + mBuffered, data, n);
+        mBuffered += n;
+        data += n;
+        size -= n;
+        if (mBuffered < BLOCK_SIZE)
+        {
+            return;
+        }
+        mCompress(mState, mBuffer, 1);
+        mBuffered = 0;
+    }
+    auto blocks = size / BLOCK_SIZE;
+    mCompress(mState, data, blocks);
+    data += blocks * BLOCK_SIZE;
+    size -= blocks * BLOCK_SIZE;
+    if (size != 0)
+    {
+        std::memcpy(mBuffer, data, size);
+        mBuffered = size;
+    }
+}
+
+uint256
+HardwareSHA256Impl::finish()
+{
+    if (mFinished)
+    {
+        throw std::runtime_error("finishing already-finished SHA256");
+    }
+    mFinished = true;
+    uint8_t tail[2 * BLOCK_SIZE];
+    mCompress(mState, tail, padTail(mBuffer, mBuffered, mLength, tail));
+    return toDigest(mState);
+}
+
 SHA256Impl::SHA256Impl() : mFinished(false)
 {
     reset();
@@ -77,6 +294,7 @@ SHA256Impl::finish()
     {
         throw std::runtime_error("finishing already-finished SHA256");
     }
+    mFinished = true;
     if (crypto_hash_sha256_final(&mState, out.data()) != 0)
     {
         throw std::runtime_error("error from crypto_hash_sha256_final");
@@ -97,6 +315,24 @@ hmacSha256(HmacSha256Key const& key, ByteSlice const& bin)
     return out;
 }
 
+HmacSha256Mac
+hmacSha256(HmacSha256Key const& key, ByteSlice const& prefix,
+           ByteSlice const& bin)
+{
+    HmacSha256Mac out;
+    crypto_auth_hmacsha256_state state;
+    if (crypto_auth_hmacsha256_init(&state, key.key.data(),
+                                    key.key.size()) != 0 ||
+        crypto_auth_hmacsha256_update(&state, prefix.data(), prefix.size()) !=
+            0 ||
+        crypto_auth_hmacsha256_update(&state, bin.data(), bin.size()) != 0 ||
+        crypto_auth_hmacsha256_final(&state, out.mac.data()) != 0)
+    {
+        throw std::runtime_error("error from crypto_auth_hmacsha256");
+    }
+    return out;
+}
+
 bool
 hmacSha256Verify(HmacSha256Mac const& hmac, HmacSha256Key const& key,
                  ByteSlice const& bin)
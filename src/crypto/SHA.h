@@ -7,6 +7,7 @@
 #include "crypto/ByteSlice.h"
 #include "xdr/Stellar-types.h"
 #include <memory>
+#include <vector>
 
 namespace stellar
 {
@@ -14,6 +15,15 @@ namespace stellar
 // Plain SHA256
 uint256 sha256(ByteSlice const& bin);
 
+// SHA256 of each of @p bins; with the SHA extensions of x86, messages are
+// hashed two at a time for a better throughput on small inputs such as
+// transactions.
+std::vector<uint256> sha256Multi(std::vector<ByteSlice> const& bins);
+
+// CPU instructions the SHA256 functions (but not HMAC, which stays with
+// libsodium) rely on: "sha-ni", "armv8" or "none"
+char const* getSHA256Backend();
+
 // SHA256 in incremental mode, for large inputs.
 class SHA256
 {
@@ -28,6 +38,10 @@ class SHA256
 // HMAC-SHA256 (keyed)
 HmacSha256Mac hmacSha256(HmacSha256Key const& key, ByteSlice const& bin);
 
+// HMAC-SHA256 of prefix followed by bin, without concatenating them.
+HmacSha256Mac hmacSha256(HmacSha256Key const& key, ByteSlice const& prefix,
+                         ByteSlice const& bin);
+
 // Use this rather than HMAC-output ==, to avoid timing leaks.
 bool hmacSha256Verify(HmacSha256Mac const& hmac, HmacSha256Key const& key,
                       ByteSlice const& bin);
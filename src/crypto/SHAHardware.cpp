@@ -0,0 +1,261 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SHAHardware.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define STELLAR_SHA_NI
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+// the instructions are only emitted when the compiler targets them
+#define STELLAR_SHA_ARMV8
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+namespace stellar
+{
+namespace shahw
+{
+
+namespace
+{
+
+#if defined(STELLAR_SHA_NI) || defined(STELLAR_SHA_ARMV8)
+alignas(16) uint32_t const K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+#endif
+
+#ifdef STELLAR_SHA_NI
+
+#define STELLAR_SHA_NI_TARGET __attribute__((target("sha,sse4.1")))
+
+// the rounds work on the state as ABEF and CDGH
+STELLAR_SHA_NI_TARGET inline void
+loadState(uint32_t const state[8], __m128i& abef, __m128i& cdgh)
+{
+    auto dcba = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&state[0]));
+    auto hgfe = _mm_loadu_si128(reinterpret_cast<__m128i const*>(&state[4]));
+    auto cdab = _mm_shuffle_epi32(dcba, 0xB1);
+    auto efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+    abef = _mm_alignr_epi8(cdab, efgh, 8);
+    cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+}
+
+STELLAR_SHA_NI_TARGET inline void
+storeState(uint32_t state[8], __m128i abef, __m128i cdgh)
+{
+    auto feba = _mm_shuffle_epi32(abef, 0x1B);
+    auto dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    auto dcba = _mm_blend_epi16(feba, dchg, 0xF0);
+    auto hgfe = _mm_alignr_epi8(dchg, feba, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), dcba);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), hgfe);
+}
+
+// message words 4i to 4i+3, computed from the previous ones in w
+STELLAR_SHA_NI_TARGET inline __m128i
+schedule(__m128i const* w, uint8_t const* block, int i)
+{
+    if (i < 4)
+    {
+        auto const mask =
+            _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+        return _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + 16 * i)),
+            mask);
+    }
+    auto x = _mm_sha256msg1_epu32(w[i - 4], w[i - 3]);
+    x = _mm_add_epi32(x, _mm_alignr_epi8(w[i - 1], w[i - 2], 4));
+    return _mm_sha256msg2_epu32(x, w[i - 1]);
+}
+
+STELLAR_SHA_NI_TARGET inline void
+rounds(__m128i& abef, __m128i& cdgh, __m128i w, int i)
+{
+    auto msg = _mm_add_epi32(
+        w, _mm_load_si128(reinterpret_cast<__m128i const*>(&K[4 * i])));
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0E));
+}
+
+STELLAR_SHA_NI_TARGET void
+compressShaNi(uint32_t state[8], uint8_t const* blocks, size_t n)
+{
+    __m128i abef, cdgh;
+    loadState(state, abef, cdgh);
+    for (; n > 0; n--, blocks += BLOCK_SIZE)
+    {
+        auto abefSave = abef;
+        auto cdghSave = cdgh;
+        __m128i w[16];
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = schedule(w, blocks, i);
+            rounds(abef, cdgh, w[i], i);
+        }
+        abef = _mm_add_epi32(abef, abefSave);
+        cdgh = _mm_add_epi32(cdgh, cdghSave);
+    }
+    storeState(state, abef, cdgh);
+}
+
+STELLAR_SHA_NI_TARGET void
+compress2ShaNi(uint32_t stateA[8], uint8_t const* blockA, uint32_t stateB[8],
+               uint8_t const* blockB)
+{
+    __m128i abefA, cdghA, abefB, cdghB;
+    loadState(stateA, abefA, cdghA);
+    loadState(stateB, abefB, cdghB);
+    auto abefSaveA = abefA;
+    auto cdghSaveA = cdghA;
+    auto abefSaveB = abefB;
+    auto cdghSaveB = cdghB;
+    __m128i wA[16], wB[16];
+    for (int i = 0; i < 16; i++)
+    {
+        wA[i] = schedule(wA, blockA, i);
+        wB[i] = schedule(wB, blockB, i);
+        rounds(abefA, cdghA, wA[i], i);
+        rounds(abefB, cdghB, wB[i], i);
+    }
+    storeState(stateA, _mm_add_epi32(abefA, abefSaveA),
+               _mm_add_epi32(cdghA, cdghSaveA));
+    storeState(stateB, _mm_add_epi32(abefB, abefSaveB),
+               _mm_add_epi32(cdghB, cdghSaveB));
+}
+
+bool
+cpuHasShaNi()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1))
+    {
+        return false;
+    }
+    if (__get_cpuid_max(0, nullptr) < 7)
+    {
+        return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1u << 29)) != 0;
+}
+
+#endif
+
+#ifdef STELLAR_SHA_ARMV8
+
+void
+compressArmv8(uint32_t state[8], uint8_t const* blocks, size_t n)
+{
+    auto abcd = vld1q_u32(&state[0]);
+    auto efgh = vld1q_u32(&state[4]);
+    for (; n > 0; n--, blocks += BLOCK_SIZE)
+    {
+        auto abcdSave = abcd;
+        auto efghSave = efgh;
+        uint32x4_t w[16];
+        for (int i = 0; i < 16; i++)
+        {
+            if (i < 4)
+            {
+                w[i] = vreinterpretq_u32_u8(
+                    vrev32q_u8(vld1q_u8(blocks + 16 * i)));
+            }
+            else
+            {
+                w[i] = vsha256su1q_u32(vsha256su0q_u32(w[i - 4], w[i - 3]),
+                                       w[i - 2], w[i - 1]);
+            }
+            auto msg = vaddq_u32(w[i], vld1q_u32(&K[4 * i]));
+            auto prev = abcd;
+            abcd = vsha256hq_u32(abcd, efgh, msg);
+            efgh = vsha256h2q_u32(efgh, prev, msg);
+        }
+        abcd = vaddq_u32(abcd, abcdSave);
+        efgh = vaddq_u32(efgh, efghSave);
+    }
+    vst1q_u32(&state[0], abcd);
+    vst1q_u32(&state[4], efgh);
+}
+
+bool
+cpuHasArmv8Sha2()
+{
+#if defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+    // built for the extensions, which every 64 bit Apple CPU has
+    return true;
+#endif
+}
+
+#endif
+
+struct Backend
+{
+    CompressFn mCompress{nullptr};
+    Compress2Fn mCompress2{nullptr};
+    char const* mName{"none"};
+
+    Backend()
+    {
+#if defined(STELLAR_SHA_NI)
+        if (cpuHasShaNi())
+        {
+            mCompress = compressShaNi;
+            mCompress2 = compress2ShaNi;
+            mName = "sha-ni";
+        }
+#elif defined(STELLAR_SHA_ARMV8)
+        if (cpuHasArmv8Sha2())
+        {
+            mCompress = compressArmv8;
+            mName = "armv8";
+        }
+#endif
+    }
+};
+
+Backend const&
+getBackend()
+{
+    static Backend const backend;
+    return backend;
+}
+}
+
+CompressFn
+getCompress()
+{
+    return getBackend().mCompress;
+}
+
+Compress2Fn
+getCompress2()
+{
+    return getBackend().mCompress2;
+}
+
+char const*
+getName()
+{
+    return getBackend().mName;
+}
+}
+}
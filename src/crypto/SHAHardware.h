@@ -0,0 +1,40 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstddef>
+#include <cstdint>
+
+namespace stellar
+{
+
+// SHA-256 compression with the instructions of the CPU, used by SHA.cpp in
+// place of libsodium when they are available (SHA extensions on x86,
+// cryptography extensions on ARMv8). Support is detected once, at first
+// use.
+namespace shahw
+{
+
+size_t const BLOCK_SIZE = 64;
+
+// runs the compression function over the @p n blocks at @p blocks,
+// updating @p state (the eight words of the hash, in order)
+typedef void (*CompressFn)(uint32_t state[8], uint8_t const* blocks,
+                           size_t n);
+
+// the compression function of this CPU, nullptr if it has none
+CompressFn getCompress();
+
+// same, for two independent states and blocks at once, so that the latency
+// of the instructions of one run is hidden by the other; nullptr if not
+// available (even when getCompress is not)
+typedef void (*Compress2Fn)(uint32_t stateA[8], uint8_t const* blockA,
+                            uint32_t stateB[8], uint8_t const* blockB);
+Compress2Fn getCompress2();
+
+// "sha-ni", "armv8" or "none"
+char const* getName();
+}
+}
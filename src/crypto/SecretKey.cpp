@@ -11,11 +11,15 @@
 #include "transactions/SignatureUtils.h"
 #include "util/HashOfHash.h"
 #include "util/lrucache.hpp"
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <sodium.h>
 #include <type_traits>
 
+#include "util/ShardedMetrics.h"
+
 namespace stellar
 {
 
@@ -25,12 +29,37 @@ namespace stellar
 // to the state of the process; caching its results centrally
 // makes all signature-verification in the program faster and
 // has no effect on correctness.
+//
+// Verification may run on worker threads: the cache is split in shards
+// (picked by the first byte of the key, itself a hash), each behind its own
+// mutex, so that concurrent lookups rarely wait on each other.
 
-static std::mutex gVerifySigCacheMutex;
-static cache::lru_cache<Hash, bool> gVerifySigCache(0xffff);
-static std::unique_ptr<SHA256> gHasher = SHA256::create();
-static uint64_t gVerifyCacheHit = 0;
-static uint64_t gVerifyCacheMiss = 0;
+namespace
+{
+size_t const VERIFY_SIG_CACHE_SHARDS = 16;
+
+struct VerifySigCacheShard
+{
+    std::mutex mMutex;
+    cache::lru_cache<Hash, bool> mCache{
+        PubKeyUtils::DEFAULT_VERIFY_SIG_CACHE_SIZE / VERIFY_SIG_CACHE_SHARDS};
+    size_t mMaxSize{PubKeyUtils::DEFAULT_VERIFY_SIG_CACHE_SIZE /
+                    VERIFY_SIG_CACHE_SHARDS};
+};
+}
+
+static std::array<VerifySigCacheShard, VERIFY_SIG_CACHE_SHARDS>
+    gVerifySigCache;
+static std::atomic<PubKeyUtils::VerifySigCacheMeters const*>
+    gVerifySigCacheMeters{nullptr};
+// each thread hashes cache keys with its own hasher
+static thread_local std::unique_ptr<SHA256> gHasher = SHA256::create();
+
+static VerifySigCacheShard&
+verifySigCacheShard(Hash const& cacheKey)
+{
+    return gVerifySigCache[cacheKey[0] % VERIFY_SIG_CACHE_SHARDS];
+}
 
 static Hash
 verifySigCacheKey(PublicKey const& key, Signature const& signature,
@@ -187,18 +216,64 @@ SecretKey::fromStrKeySeed(std::string const& strKeySeed)
 void
 PubKeyUtils::clearVerifySigCache()
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.clear();
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        shard.mCache.clear();
+    }
 }
 
 void
-PubKeyUtils::flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses)
+PubKeyUtils::setVerifySigCacheSize(size_t entries)
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    hits = gVerifyCacheHit;
-    misses = gVerifyCacheMiss;
-    gVerifyCacheHit = 0;
-    gVerifyCacheMiss = 0;
+    auto shardSize = std::max<size_t>(1, entries / VERIFY_SIG_CACHE_SHARDS);
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        if (shard.mMaxSize != shardSize)
+        {
+            shard.mCache = cache::lru_cache<Hash, bool>(shardSize);
+            shard.mMaxSize = shardSize;
+        }
+    }
+}
+
+size_t
+PubKeyUtils::getVerifySigCacheSize()
+{
+    size_t res = 0;
+    for (auto& shard : gVerifySigCache)
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        res += shard.mCache.size();
+    }
+    return res;
+}
+
+MemoryUsage
+PubKeyUtils::getVerifySigCacheMemoryUsage()
+{
+    // a result is a node of the list of the LRU and one of its map, which
+    // both hold the key
+    size_t const perEntry = 2 * MemoryUsage::NODE_OVERHEAD + 2 * sizeof(Hash) +
+                            sizeof(bool) + sizeof(void*);
+    MemoryUsage res;
+    auto entries = getVerifySigCacheSize();
+    res.mBytes = entries * perEntry;
+    res.mObjects = entries;
+    return res;
+}
+
+void
+PubKeyUtils::setVerifySigCacheMeters(VerifySigCacheMeters const* meters)
+{
+    gVerifySigCacheMeters = meters;
+}
+
+void
+PubKeyUtils::clearVerifySigCacheMeters(VerifySigCacheMeters const* meters)
+{
+    gVerifySigCacheMeters.compare_exchange_strong(meters, nullptr);
 }
 
 std::string
@@ -279,25 +354,110 @@ PubKeyUtils::verifySig(PublicKey const& key, Signature const& signature,
     }
 
     auto cacheKey = verifySigCacheKey(key, signature, bin);
+    auto& shard = verifySigCacheShard(cacheKey);
+    auto meters = gVerifySigCacheMeters.load();
+    if (meters)
+    {
+        meters->mTotal.Mark();
+    }
 
     {
-        std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-        if (gVerifySigCache.exists(cacheKey))
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        if (shard.mCache.exists(cacheKey))
         {
-            ++gVerifyCacheHit;
-            return gVerifySigCache.get(cacheKey);
+            if (meters)
+            {
+                meters->mHit.Mark();
+            }
+            return shard.mCache.get(cacheKey);
         }
     }
+    if (meters)
+    {
+        meters->mMiss.Mark();
+    }
 
-    ++gVerifyCacheMiss;
     bool ok =
         (crypto_sign_verify_detached(signature.data(), bin.data(), bin.size(),
                                      key.ed25519().data()) == 0);
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.put(cacheKey, ok);
+    std::lock_guard<std::mutex> guard(shard.mMutex);
+    shard.mCache.put(cacheKey, ok);
     return ok;
 }
 
+std::vector<bool>
+PubKeyUtils::verifySigBatch(std::vector<SigToVerify> const& sigs)
+{
+    std::vector<bool> res(sigs.size(), false);
+    std::vector<Hash> cacheKeys(sigs.size());
+    std::array<std::vector<size_t>, VERIFY_SIG_CACHE_SHARDS> byShard;
+    size_t total = 0;
+    for (size_t i = 0; i < sigs.size(); i++)
+    {
+        assert(sigs[i].mKey.type() == PUBLIC_KEY_TYPE_ED25519);
+        if (sigs[i].mSignature.size() != 64)
+        {
+            continue;
+        }
+        cacheKeys[i] =
+            verifySigCacheKey(sigs[i].mKey, sigs[i].mSignature, sigs[i].mBin);
+        byShard[cacheKeys[i][0] % VERIFY_SIG_CACHE_SHARDS].emplace_back(i);
+        ++total;
+    }
+
+    std::vector<size_t> misses;
+    for (size_t s = 0; s < VERIFY_SIG_CACHE_SHARDS; s++)
+    {
+        if (byShard[s].empty())
+        {
+            continue;
+        }
+        auto& shard = gVerifySigCache[s];
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        for (auto i : byShard[s])
+        {
+            if (shard.mCache.exists(cacheKeys[i]))
+            {
+                res[i] = shard.mCache.get(cacheKeys[i]);
+            }
+            else
+            {
+                misses.emplace_back(i);
+            }
+        }
+    }
+
+    auto meters = gVerifySigCacheMeters.load();
+    if (meters)
+    {
+        meters->mTotal.Mark(total);
+        meters->mHit.Mark(total - misses.size());
+        meters->mMiss.Mark(misses.size());
+    }
+
+    for (auto i : misses)
+    {
+        auto const& sig = sigs[i];
+        res[i] = (crypto_sign_verify_detached(
+                      sig.mSignature.data(), sig.mBin.data(), sig.mBin.size(),
+                      sig.mKey.ed25519().data()) == 0);
+    }
+
+    // misses are grouped by shard, in shard order
+    for (auto it = misses.begin(); it != misses.end();)
+    {
+        auto& shard = verifySigCacheShard(cacheKeys[*it]);
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        for (; it != misses.end() &&
+               &verifySigCacheShard(cacheKeys[*it]) == &shard;
+             ++it)
+        {
+            shard.mCache.put(cacheKeys[*it], res[*it]);
+        }
+    }
+    return res;
+}
+
 PublicKey
 PubKeyUtils::random()
 {
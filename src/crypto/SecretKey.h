@@ -4,20 +4,23 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "crypto/ByteSlice.h"
 #include "crypto/KeyUtils.h"
+#include "util/MemoryUsage.h"
 #include "util/XDROperators.h"
 #include "xdr/Stellar-types.h"
 
 #include <array>
 #include <functional>
 #include <ostream>
+#include <vector>
 
 namespace stellar
 {
 
-class ByteSlice;
 struct SecretValue;
 struct SignerKey;
+class ShardedMeter;
 
 class SecretKey
 {
@@ -101,8 +104,43 @@ namespace PubKeyUtils
 bool verifySig(PublicKey const& key, Signature const& signature,
                ByteSlice const& bin);
 
+// One signature to check with verifySigBatch; the key, signature and bytes
+// referred to must outlive the call.
+struct SigToVerify
+{
+    PublicKey const& mKey;
+    Signature const& mSignature;
+    ByteSlice mBin;
+};
+
+// Same as calling verifySig on each of `sigs`: element i of the result tells
+// whether `sigs[i]` is valid. libsodium has no batch verification, so the
+// signatures missing from the cache are still checked one by one; what is
+// saved is the cache locking, done once per shard for the whole batch.
+std::vector<bool> verifySigBatch(std::vector<SigToVerify> const& sigs);
+
+// The results of verifySig are cached for the whole process, see
+// SecretKey.cpp.
+size_t const DEFAULT_VERIFY_SIG_CACHE_SIZE = 262144;
+
 void clearVerifySigCache();
-void flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses);
+// Changes the number of results kept, dropping them all if it differs.
+void setVerifySigCacheSize(size_t entries);
+// Number of results currently cached.
+size_t getVerifySigCacheSize();
+MemoryUsage getVerifySigCacheMemoryUsage();
+
+// Meters marked on every lookup of the cache. As the cache is shared by all
+// the applications of the process, it reports to the last one that set its
+// meters, until that one clears them.
+struct VerifySigCacheMeters
+{
+    ShardedMeter& mHit;
+    ShardedMeter& mMiss;
+    ShardedMeter& mTotal;
+};
+void setVerifySigCacheMeters(VerifySigCacheMeters const* meters);
+void clearVerifySigCacheMeters(VerifySigCacheMeters const* meters);
 
 PublicKey random();
 }
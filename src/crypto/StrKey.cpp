@@ -11,6 +11,66 @@ namespace stellar
 {
 namespace strKey
 {
+
+namespace
+{
+
+char const B32_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+// Base32 of whole groups of 5 bytes (8 digits), the case of every key;
+// anything else goes through decoder::encode_b32 / decode_b32, which also
+// deal with padding and stray characters.
+void
+encodeGroups(uint8_t const* bin, size_t groups, char* out)
+{
+    for (size_t g = 0; g < groups; g++, bin += 5, out += 8)
+    {
+        uint64_t v = 0;
+        for (int i = 0; i < 5; i++)
+        {
+            v = (v << 8) | bin[i];
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            out[i] = B32_DIGITS[(v >> (35 - 5 * i)) & 0x1f];
+        }
+    }
+}
+
+// false if a character is not a base32 digit
+bool
+decodeGroups(char const* in, size_t groups, uint8_t* out)
+{
+    for (size_t g = 0; g < groups; g++, in += 8, out += 5)
+    {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            char c = in[i];
+            uint64_t d;
+            if (c >= 'A' && c <= 'Z')
+            {
+                d = c - 'A';
+            }
+            else if (c >= '2' && c <= '7')
+            {
+                d = c - '2' + 26;
+            }
+            else
+            {
+                return false;
+            }
+            v = (v << 5) | d;
+        }
+        for (int i = 0; i < 5; i++)
+        {
+            out[i] = static_cast<uint8_t>(v >> (32 - 8 * i));
+        }
+    }
+    return true;
+}
+}
+
 // Encode a version byte and ByteSlice into StrKey
 SecretValue
 toStrKey(uint8_t ver, ByteSlice const& bin)
@@ -27,7 +87,15 @@ toStrKey(uint8_t ver, ByteSlice const& bin)
     toEncode.emplace_back(static_cast<uint8_t>(crc & 0xFF));
 
     std::string res;
-    res = decoder::encode_b32(toEncode);
+    if (toEncode.size() % 5 == 0)
+    {
+        res.resize(toEncode.size() / 5 * 8);
+        encodeGroups(toEncode.data(), toEncode.size() / 5, &res[0]);
+    }
+    else
+    {
+        res = decoder::encode_b32(toEncode);
+    }
     return SecretValue{res};
 }
 
@@ -42,7 +110,12 @@ bool
 fromStrKey(std::string const& strKey, uint8_t& outVersion,
            std::vector<uint8_t>& decoded)
 {
-    decoder::decode_b32(strKey, decoded);
+    decoded.resize(strKey.size() / 8 * 5);
+    if (strKey.size() % 8 != 0 ||
+        !decodeGroups(strKey.data(), strKey.size() / 8, decoded.data()))
+    {
+        decoder::decode_b32(strKey, decoded);
+    }
     if (decoded.size() < 3)
     {
         return false;
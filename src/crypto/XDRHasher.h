@@ -0,0 +1,139 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SHA.h"
+#include "util/NonCopyable.h"
+#include "xdrpp/marshal.h"
+#include <cstring>
+#include <type_traits>
+
+namespace stellar
+{
+
+/**
+ * XDR archive (used as xdr::xdr_put is) that feeds what it serializes to a
+ * SHA256, in chunks of up to BUFFER_SIZE bytes, rather than writing it to a
+ * buffer of the size of the whole object.
+ */
+class XDRSHA256 : NonMovableOrCopyable
+{
+  public:
+    static size_t const BUFFER_SIZE = 256;
+
+    explicit XDRSHA256(SHA256& hasher) : mHasher(hasher)
+    {
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<
+        uint32_t, typename xdr::xdr_traits<T>::uint_type>::value>::type
+    operator()(T t)
+    {
+        put32(xdr::xdr_traits<T>::to_uint(t));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_same<
+        uint64_t, typename xdr::xdr_traits<T>::uint_type>::value>::type
+    operator()(T t)
+    {
+        auto v = xdr::xdr_traits<T>::to_uint(t);
+        put32(static_cast<uint32_t>(v >> 32));
+        put32(static_cast<uint32_t>(v));
+    }
+
+    template <typename T>
+    typename std::enable_if<xdr::xdr_traits<T>::is_bytes>::type
+    operator()(T const& t)
+    {
+        if (xdr::xdr_traits<T>::variable_nelem)
+        {
+            put32(static_cast<uint32_t>(t.size()));
+        }
+        putBytes(t.data(), t.size());
+    }
+
+    template <typename T>
+    typename std::enable_if<xdr::xdr_traits<T>::is_class ||
+                            xdr::xdr_traits<T>::is_container>::type
+    operator()(T const& t)
+    {
+        xdr::xdr_traits<T>::save(*this, t);
+    }
+
+    // hash of everything serialized so far
+    uint256
+    finish()
+    {
+        flush();
+        return mHasher.finish();
+    }
+
+  private:
+    SHA256& mHasher;
+    uint8_t mBuffer[BUFFER_SIZE];
+    size_t mBuffered{0};
+
+    void
+    flush()
+    {
+        if (mBuffered != 0)
+        {
+            mHasher.add(ByteSlice(mBuffer, mBuffered));
+            mBuffered = 0;
+        }
+    }
+
+    void
+    put32(uint32_t v)
+    {
+        if (mBuffered + 4 > BUFFER_SIZE)
+        {
+            flush();
+        }
+        mBuffer[mBuffered++] = static_cast<uint8_t>(v >> 24);
+        mBuffer[mBuffered++] = static_cast<uint8_t>(v >> 16);
+        mBuffer[mBuffered++] = static_cast<uint8_t>(v >> 8);
+        mBuffer[mBuffered++] = static_cast<uint8_t>(v);
+    }
+
+    // with the padding to a multiple of 4 bytes
+    void
+    putBytes(void const* data, size_t size)
+    {
+        auto padding = (4 - size % 4) % 4;
+        if (mBuffered + size + padding > BUFFER_SIZE)
+        {
+            flush();
+            if (size + padding > BUFFER_SIZE)
+            {
+                mHasher.add(ByteSlice(data, size));
+                size = 0;
+            }
+        }
+        if (size != 0)
+        {
+            std::memcpy(mBuffer + mBuffered, data, size);
+            mBuffered += size;
+        }
+        std::memset(mBuffer + mBuffered, 0, padding);
+        mBuffered += padding;
+    }
+};
+
+// same as sha256(xdr::xdr_to_opaque(args...)), without serializing args
+// into a buffer of their own
+template <typename... Args>
+uint256
+xdrSha256(Args const&... args)
+{
+    static thread_local auto hasher = SHA256::create();
+    hasher->reset();
+    XDRSHA256 ar(*hasher);
+    xdr::xdr_argpack_archive(ar, args...);
+    return ar.finish();
+}
+}
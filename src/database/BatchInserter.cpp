@@ -0,0 +1,91 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/BatchInserter.h"
+#include "database/Database.h"
+#include "database/DatabaseUtils.h"
+#include "database/PostgresCopyWriter.h"
+
+#include <stdexcept>
+
+namespace stellar
+{
+
+BatchInserter::BatchInserter(Database& db, std::string const& table,
+                             std::vector<std::string> const& columns)
+    : mDb(db), mTable(table), mColumns(columns)
+{
+}
+
+void
+BatchInserter::addRow(std::vector<std::string> row)
+{
+    if (row.size() != mColumns.size())
+    {
+        throw std::invalid_argument("wrong number of values for " + mTable);
+    }
+    mRows.emplace_back(std::move(row));
+}
+
+size_t
+BatchInserter::size() const
+{
+    return mRows.size();
+}
+
+size_t
+BatchInserter::flush()
+{
+    auto n = mRows.size();
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    std::string columns;
+    for (auto const& c : mColumns)
+    {
+        columns += (columns.empty() ? "" : ", ") + c;
+    }
+
+    auto timer = mDb.getInsertTimer(mTable);
+    if (!mDb.isSqlite())
+    {
+        PostgresCopyWriter writer(mDb, mTable, columns);
+        for (auto const& row : mRows)
+        {
+            for (auto const& v : row)
+            {
+                writer.addString(v);
+            }
+            writer.endRow();
+        }
+        writer.finish();
+    }
+    else
+    {
+        DatabaseUtils::forEachRowBatch(n, [&](size_t begin, size_t end) {
+            auto prep = mDb.getPreparedStatement(
+                "INSERT INTO " + mTable + " (" + columns + ") VALUES " +
+                DatabaseUtils::makeValuesClause(end - begin, mColumns.size()));
+            auto& st = prep.statement();
+            for (auto i = begin; i < end; i++)
+            {
+                for (auto& v : mRows[i])
+                {
+                    st.exchange(soci::use(v));
+                }
+            }
+            st.define_and_bind();
+            st.execute(true);
+            if (st.get_affected_rows() != static_cast<long long>(end - begin))
+            {
+                throw std::runtime_error("Could not update data in SQL");
+            }
+        });
+    }
+    mRows.clear();
+    return n;
+}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+class Database;
+
+/**
+ * Rows to insert into a table, on the main session of `db`, that nothing
+ * reads back before the enclosing transaction commits: instead of one
+ * statement (and one round trip) per row, they are buffered and written by
+ * `flush`, with a single COPY on PostgreSQL and multi-row INSERT statements
+ * on SQLite.
+ *
+ * Values are passed as text, and converted to the types of their columns
+ * by the database.
+ */
+class BatchInserter
+{
+    Database& mDb;
+    std::string mTable;
+    std::vector<std::string> mColumns;
+    std::vector<std::vector<std::string>> mRows;
+
+  public:
+    BatchInserter(Database& db, std::string const& table,
+                  std::vector<std::string> const& columns);
+
+    // `row` has one value per column
+    void addRow(std::vector<std::string> row);
+
+    size_t size() const;
+
+    // Write the buffered rows and return how many there were.
+    size_t flush();
+};
+}
@@ -5,6 +5,8 @@
 #include "database/Database.h"
 #include "crypto/Hex.h"
 #include "database/DatabaseConnectionString.h"
+#include "database/HistoryPartitions.h"
+#include "ledger/LedgerEntryCache.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/StellarXDR.h"
@@ -21,17 +23,21 @@
 #include "ledger/DataFrame.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/OfferFrame.h"
+#include "ledger/InflationVoteTally.h"
+#include "ledger/OrderBook.h"
 #include "ledger/TrustFrame.h"
 #include "main/ExternalQueue.h"
 #include "main/PersistentState.h"
 #include "overlay/BanManager.h"
 #include "overlay/OverlayManager.h"
+#include "overlay/PeerTable.h"
 #include "transactions/TransactionFrame.h"
 
 #include "medida/counter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 
+#include <cctype>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
@@ -54,7 +60,18 @@ using namespace std;
 
 bool Database::gDriversRegistered = false;
 
-static unsigned long const SCHEMA_VERSION = 7;
+static unsigned long const SCHEMA_VERSION = 10;
+
+// Capacity of each per-LedgerEntryType partition of the entry cache: the
+// cache holds up to 4 * 4096 entries, where the single LRU it replaced held
+// 4096 of all types.
+static size_t const ENTRY_CACHE_PARTITION_SIZE = 4096;
+
+size_t const Database::STATEMENT_CACHE_SIZE = 1024;
+
+// Page cache and memory map sizes used in MANAGED_SQLITE mode.
+static int64_t const SQLITE_CACHE_SIZE_KB = 64 * 1024;
+static int64_t const SQLITE_MMAP_SIZE = 256 * 1024 * 1024;
 
 static void
 setSerializable(soci::session& sess)
@@ -80,9 +97,16 @@ Database::Database(Application& app)
     : mApp(app)
     , mQueryMeter(
           app.getMetrics().NewMeter({"database", "query", "exec"}, "query"))
+    , mStatements(STATEMENT_CACHE_SIZE)
     , mStatementsSize(
           app.getMetrics().NewCounter({"database", "memory", "statements"}))
-    , mEntryCache(4096)
+    , mCheckpointTimer(
+          app.getMetrics().NewTimer({"database", "checkpoint", "wal"}))
+    , mEntryCache(std::make_unique<LedgerEntryCache>(
+          app.getMetrics(), ENTRY_CACHE_PARTITION_SIZE))
+    , mLedgerHeaderCache(app.getConfig().LEDGER_HEADER_CACHE_SIZE)
+    , mStoreAccountXDR(app.getConfig().ACCOUNT_ENTRY_XDR)
+    , mCompressTxHistory(app.getConfig().COMPRESS_TX_HISTORY)
     , mExcludedQueryTime(0)
     , mExcludedTotalTime(0)
     , mLastIdleQueryTime(0)
@@ -100,11 +124,46 @@ Database::Database(Application& app)
         // busy_timeout gives room for external processes
         // that may lock the database for some time
         mSession << "PRAGMA busy_timeout = 10000";
+        if (app.getConfig().MANAGED_SQLITE)
+        {
+            // safe with WAL: a crash may lose the last transactions, but
+            // cannot corrupt the database
+            mSession << "PRAGMA synchronous = NORMAL";
+            mSession << "PRAGMA cache_size = -" << SQLITE_CACHE_SIZE_KB;
+            mSession << "PRAGMA mmap_size = " << SQLITE_MMAP_SIZE;
+            // checkpoints are run by checkpoint(), between ledgers
+            mSession << "PRAGMA wal_autocheckpoint = 0";
+        }
     }
     else
     {
         setSerializable(mSession);
     }
+
+    auto const& config = app.getConfig();
+    mCanRelaxCommits =
+        config.DATABASE_DURABILITY == Config::DB_DURABILITY_RELAXED &&
+        (!isSqlite() || config.MANAGED_SQLITE);
+    if (config.IN_MEMORY_ORDER_BOOK || config.ORDER_BOOK_CACHE)
+    {
+        mOrderBook = std::make_unique<OrderBook>(
+            *this, !config.IN_MEMORY_ORDER_BOOK,
+            app.getMetrics().NewMeter({"ledger", "order-book", "pair-load"},
+                                      "pair"),
+            app.getMetrics().NewCounter({"ledger", "order-book", "offers"}));
+    }
+    if (config.INFLATION_VOTE_TALLY)
+    {
+        mInflationVoteTally = std::make_unique<InflationVoteTally>();
+    }
+    if (config.IN_MEMORY_PEER_TABLE)
+    {
+        mPeerTable = std::make_unique<PeerTable>();
+    }
+}
+
+Database::~Database()
+{
 }
 
 void
@@ -158,6 +217,33 @@ Database::applySchemaUpgrade(unsigned long vers)
                     "CHECK (sellingliabilities >= 0)";
         break;
 
+    case 8:
+        mSession << "ALTER TABLE peers ADD latency INT NOT NULL DEFAULT 0";
+        mSession << "ALTER TABLE peers ADD throughput INT NOT NULL DEFAULT 0";
+        break;
+
+    case 9:
+        // indexes matching the filters and the order of the best offers
+        // queries, so that they stop at the LIMIT instead of sorting every
+        // offer of one side of the book; queries on a native side use their
+        // partial index
+        mSession << "CREATE INDEX bestofferindex ON offers (sellingissuer, "
+                    "sellingassetcode, buyingissuer, buyingassetcode, price, "
+                    "offerid)";
+        mSession << "CREATE INDEX bestoffersellingnativeindex ON offers "
+                    "(buyingissuer, buyingassetcode, price, offerid) "
+                    "WHERE sellingissuer IS NULL";
+        mSession << "CREATE INDEX bestofferbuyingnativeindex ON offers "
+                    "(sellingissuer, sellingassetcode, price, offerid) "
+                    "WHERE buyingissuer IS NULL";
+        mSession << "CREATE INDEX offersbyseller ON offers (sellerid)";
+        break;
+
+    case 10:
+        // base64 XDR of the LedgerEntry, when ACCOUNT_ENTRY_XDR is set
+        mSession << "ALTER TABLE accounts ADD ledgerentry TEXT";
+        break;
+
     default:
         throw std::runtime_error("Unknown DB schema version");
         break;
@@ -184,6 +270,29 @@ Database::upgradeToCurrentSchema()
         putSchemaVersion(vers);
     }
     assert(vers == SCHEMA_VERSION);
+
+    auto checkpoints = mApp.getConfig().HISTORY_PARTITION_CHECKPOINTS;
+    if (isSqlite())
+    {
+        if (checkpoints != 0)
+        {
+            CLOG(WARNING, "Database")
+                << "HISTORY_PARTITION_CHECKPOINTS is ignored with SQLite";
+        }
+    }
+    else if (checkpoints != 0)
+    {
+        mHistoryPartitions = std::make_unique<HistoryPartitions>(
+            mSession,
+            checkpoints * mApp.getHistoryManager().getCheckpointFrequency());
+        mHistoryPartitions->upgrade();
+    }
+    else if (HistoryPartitions::isPartitioned(mSession,
+                                              HistoryPartitions::TABLES[0]))
+    {
+        throw std::runtime_error("History tables are partitioned, "
+                                 "HISTORY_PARTITION_CHECKPOINTS must be set");
+    }
 }
 
 void
@@ -219,10 +328,17 @@ Database::getAppSchemaVersion()
     return SCHEMA_VERSION;
 }
 
+void
+Database::addEntityType(std::string const& entityName)
+{
+    std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+    mEntityTypes.insert(entityName);
+}
+
 medida::TimerContext
 Database::getInsertTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    addEntityType(entityName);
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "insert", entityName})
@@ -232,7 +348,7 @@ Database::getInsertTimer(std::string const& entityName)
 medida::TimerContext
 Database::getSelectTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    addEntityType(entityName);
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "select", entityName})
@@ -242,7 +358,7 @@ Database::getSelectTimer(std::string const& entityName)
 medida::TimerContext
 Database::getDeleteTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    addEntityType(entityName);
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "delete", entityName})
@@ -252,7 +368,7 @@ Database::getDeleteTimer(std::string const& entityName)
 medida::TimerContext
 Database::getUpdateTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    addEntityType(entityName);
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "update", entityName})
@@ -278,6 +394,55 @@ Database::isSqlite() const
            std::string::npos;
 }
 
+bool
+Database::storesAccountXDR() const
+{
+    return mStoreAccountXDR;
+}
+
+bool
+Database::compressesTxHistory() const
+{
+    return mCompressTxHistory;
+}
+
+void
+Database::checkpoint()
+{
+    if (!isSqlite() || !mApp.getConfig().MANAGED_SQLITE)
+    {
+        return;
+    }
+    auto timer = mCheckpointTimer.TimeScope();
+    int busy = 0, logFrames = 0, checkpointedFrames = 0;
+    mSession << "PRAGMA wal_checkpoint(PASSIVE)", soci::into(busy),
+        soci::into(logFrames), soci::into(checkpointedFrames);
+    CLOG(DEBUG, "Database") << "WAL checkpoint: " << checkpointedFrames << "/"
+                            << logFrames << " frames";
+}
+
+void
+Database::setRelaxedCommits(bool relaxed)
+{
+    if (!mCanRelaxCommits || relaxed == mCommitsRelaxed)
+    {
+        return;
+    }
+    if (!isSqlite())
+    {
+        // for this session only, RESET goes back to the server's setting
+        mSession << (relaxed ? "SET synchronous_commit = off"
+                             : "RESET synchronous_commit");
+    }
+    mCommitsRelaxed = relaxed;
+}
+
+bool
+Database::commitsRelaxed() const
+{
+    return mCommitsRelaxed;
+}
+
 bool
 Database::canUsePool() const
 {
@@ -289,12 +454,17 @@ Database::clearPreparedStatementCache()
 {
     // Flush all prepared statements; in sqlite they represent open cursors
     // and will conflict with any DROP TABLE commands issued below
-    for (auto st : mStatements)
+    mStatements.erase_if([](CachedStatement const& st) {
+        st.mStatement->clean_up(true);
+        return true;
+    });
+    mStatementsSize.set_count(mStatements.size());
+
+    for (auto const& st : mNativeStatements)
     {
-        st.second->clean_up(true);
+        mSession << "DEALLOCATE " << st.second;
     }
-    mStatements.clear();
-    mStatementsSize.set_count(mStatements.size());
+    mNativeStatements.clear();
 }
 
 void
@@ -311,11 +481,14 @@ Database::initialize()
     TrustFrame::dropAll(*this);
     OverlayManager::dropAll(*this);
     PersistentState::dropAll(*this);
+    mApp.getPersistentState().clearCache();
     ExternalQueue::dropAll(*this);
     LedgerHeaderFrame::dropAll(*this);
     TransactionFrame::dropAll(*this);
     HistoryManager::dropAll(*this);
+    mApp.getHistoryManager().clearPublishQueueCache();
     BucketManager::dropAll(mApp);
+    mHistoryPartitions.reset();
     putSchemaVersion(1);
 }
 
@@ -358,10 +531,86 @@ Database::getPool()
     return *mPool;
 }
 
-cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>&
+size_t const Database::READONLY_POOL_SIZE = 2;
+
+bool
+Database::hasReadOnlyReplica() const
+{
+    return !mApp.getConfig().DATABASE_READONLY.value.empty();
+}
+
+soci::connection_pool&
+Database::getReadOnlyPool()
+{
+    std::lock_guard<std::mutex> lock(mReadOnlyPoolMutex);
+    if (!mReadOnlyPool)
+    {
+        auto const& c = mApp.getConfig().DATABASE_READONLY;
+        if (!hasReadOnlyReplica())
+        {
+            throw std::runtime_error("DATABASE_READONLY is not set");
+        }
+        LOG(INFO) << "Establishing " << READONLY_POOL_SIZE
+                  << "-entry read-only connection pool to: "
+                  << removePasswordFromConnectionString(c.value);
+        auto pool = std::make_unique<soci::connection_pool>(READONLY_POOL_SIZE);
+        for (size_t i = 0; i < READONLY_POOL_SIZE; ++i)
+        {
+            pool->at(i).open(c.value);
+        }
+        mReadOnlyPool = std::move(pool);
+    }
+    return *mReadOnlyPool;
+}
+
+Database::EntryCache&
 Database::getEntryCache()
 {
-    return mEntryCache;
+    return *mEntryCache;
+}
+
+LedgerHeaderCache&
+Database::getLedgerHeaderCache()
+{
+    return mLedgerHeaderCache;
+}
+
+OrderBook*
+Database::getOrderBook()
+{
+    return mOrderBook.get();
+}
+
+InflationVoteTally*
+Database::getInflationVoteTally()
+{
+    return mInflationVoteTally.get();
+}
+
+HistoryPartitions*
+Database::getHistoryPartitions()
+{
+    return mHistoryPartitions.get();
+}
+
+PeerTable*
+Database::getPeerTable()
+{
+    return mPeerTable.get();
+}
+
+void
+Database::ensureHistoryPartitions(uint32_t ledgerSeq)
+{
+    if (mHistoryPartitions)
+    {
+        auto size = mHistoryPartitions->getPartitionSize();
+        mHistoryPartitions->ensurePartitionFor(ledgerSeq);
+        if (ledgerSeq <= UINT32_MAX - size)
+        {
+            mHistoryPartitions->ensurePartitionFor(ledgerSeq + size);
+        }
+    }
 }
 
 class SQLLogContext : NonCopyable
@@ -400,25 +649,94 @@ class SQLLogContext : NonCopyable
     }
 };
 
+StatementContext::StatementContext(std::shared_ptr<soci::statement> stmt,
+                                   medida::Timer* timer,
+                                   std::chrono::steady_clock::time_point start)
+    : mStmt(stmt), mTimer(timer), mStart(start)
+{
+    mStmt->clean_up(false);
+}
+
+StatementContext::StatementContext(StatementContext&& other)
+    : mStmt(std::move(other.mStmt)), mTimer(other.mTimer), mStart(other.mStart)
+{
+    other.mStmt.reset();
+    other.mTimer = nullptr;
+}
+
+StatementContext::~StatementContext()
+{
+    if (mStmt)
+    {
+        mStmt->clean_up(false);
+    }
+    if (mTimer)
+    {
+        mTimer->Update(std::chrono::steady_clock::now() - mStart);
+    }
+}
+
+std::string
+Database::normalizeQuery(std::string const& query)
+{
+    std::string res;
+    res.reserve(query.size());
+    bool space = false;
+    for (auto c : query)
+    {
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            space = !res.empty();
+        }
+        else
+        {
+            if (space)
+            {
+                res.push_back(' ');
+                space = false;
+            }
+            res.push_back(c);
+        }
+    }
+    return res;
+}
+
 StatementContext
 Database::getPreparedStatement(std::string const& query)
 {
-    auto i = mStatements.find(query);
-    std::shared_ptr<soci::statement> p;
-    if (i == mStatements.end())
+    auto start = std::chrono::steady_clock::now();
+    if (!mStatements.exists(query))
     {
-        p = std::make_shared<soci::statement>(mSession);
-        p->alloc();
-        p->prepare(query);
-        mStatements.insert(std::make_pair(query, p));
+        CachedStatement cs;
+        cs.mStatement = std::make_shared<soci::statement>(mSession);
+        cs.mStatement->alloc();
+        cs.mStatement->prepare(query);
+        cs.mTimer = &mApp.getMetrics().NewTimer(
+            {"database", "statement", normalizeQuery(query)});
+        // an evicted statement is closed once its last user is done with it
+        mStatements.put(query, cs);
         mStatementsSize.set_count(mStatements.size());
     }
-    else
+    auto const& cs = mStatements.get(query);
+    return StatementContext(cs.mStatement, cs.mTimer, start);
+}
+
+std::string
+Database::getNativeStatementName(std::string const& query, bool& isNew)
+{
+    auto it = mNativeStatements.find(query);
+    isNew = it == mNativeStatements.end();
+    if (isNew)
     {
-        p = i->second;
+        return "native_" + std::to_string(mNativeStatements.size());
     }
-    StatementContext sc(p);
-    return sc;
+    return it->second;
+}
+
+void
+Database::addNativeStatement(std::string const& query, std::string const& name)
+{
+    mNativeStatements.emplace(query, name);
 }
 
 std::shared_ptr<SQLLogContext>
@@ -437,10 +755,15 @@ std::chrono::nanoseconds
 Database::totalQueryTime() const
 {
     std::vector<std::string> qtypes = {"insert", "delete", "select", "update"};
+    std::set<std::string> entityTypes;
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        entityTypes = mEntityTypes;
+    }
     std::chrono::nanoseconds nsq(0);
     for (auto const& q : qtypes)
     {
-        for (auto const& e : mEntityTypes)
+        for (auto const& e : entityTypes)
         {
             auto& timer = mApp.getMetrics().NewTimer({"database", q, e});
             uint64_t sumns = static_cast<uint64_t>(
@@ -449,6 +772,9 @@ Database::totalQueryTime() const
             nsq += std::chrono::nanoseconds(sumns);
         }
     }
+    nsq += std::chrono::nanoseconds(static_cast<uint64_t>(
+        mCheckpointTimer.sum() *
+        static_cast<double>(mCheckpointTimer.duration_unit().count())));
     return nsq;
 }
 
@@ -497,6 +823,23 @@ Database::recentIdleDbPercent()
     return idlePercent;
 }
 
+uint32_t
+Database::idleDbPercentSince(std::chrono::nanoseconds queryTime,
+                             VirtualClock::time_point since) const
+{
+    auto query = totalQueryTime() - queryTime;
+    auto total = mApp.getClock().now() - since;
+    if (total <= std::chrono::nanoseconds::zero())
+    {
+        return 100;
+    }
+    if (query >= total)
+    {
+        return 0;
+    }
+    return static_cast<uint32_t>(100 - (100 * query.count()) / total.count());
+}
+
 DBTimeExcluder::DBTimeExcluder(Application& app)
     : mApp(app)
     , mStartQueryTime(app.getDatabase().totalQueryTime())
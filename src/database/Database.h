@@ -9,6 +9,10 @@
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
 #include "util/lrucache.hpp"
+#include "ledger/LedgerHeaderCache.h"
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <set>
 #include <soci.h>
 #include <string>
@@ -23,34 +27,36 @@ class Counter;
 namespace stellar
 {
 class Application;
+class HistoryPartitions;
+class InflationVoteTally;
+class LedgerEntryCache;
+class OrderBook;
+class PeerTable;
 class SQLLogContext;
 
 /**
  * Helper class for borrowing a SOCI prepared statement handle into a local
  * scope and cleaning it up once done with it. Returned by
  * Database::getPreparedStatement below.
+ *
+ * When given a timer, the time between preparing (or fetching from the cache)
+ * the statement and the end of the scope -- that is, prepare, execute and
+ * every fetch -- is recorded into it.
  */
 class StatementContext : NonCopyable
 {
     std::shared_ptr<soci::statement> mStmt;
+    medida::Timer* mTimer;
+    std::chrono::steady_clock::time_point mStart;
 
   public:
-    StatementContext(std::shared_ptr<soci::statement> stmt) : mStmt(stmt)
-    {
-        mStmt->clean_up(false);
-    }
-    StatementContext(StatementContext&& other)
-    {
-        mStmt = other.mStmt;
-        other.mStmt.reset();
-    }
-    ~StatementContext()
-    {
-        if (mStmt)
-        {
-            mStmt->clean_up(false);
-        }
-    }
+    StatementContext(std::shared_ptr<soci::statement> stmt,
+                     medida::Timer* timer = nullptr,
+                     std::chrono::steady_clock::time_point start =
+                         std::chrono::steady_clock::now());
+    StatementContext(StatementContext&& other);
+    ~StatementContext();
+
     soci::statement&
     statement()
     {
@@ -88,21 +94,48 @@ class Database : NonMovableOrCopyable
     medida::Meter& mQueryMeter;
     soci::session mSession;
     std::unique_ptr<soci::connection_pool> mPool;
+    std::unique_ptr<soci::connection_pool> mReadOnlyPool;
+    std::mutex mReadOnlyPoolMutex;
 
-    std::map<std::string, std::shared_ptr<soci::statement>> mStatements;
+    // Prepared statements, by query text, along with the latency timer of
+    // their normalized query text.
+    struct CachedStatement
+    {
+        std::shared_ptr<soci::statement> mStatement;
+        medida::Timer* mTimer;
+    };
+    cache::lru_cache<std::string, CachedStatement> mStatements;
     medida::Counter& mStatementsSize;
-
-    cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>
-        mEntryCache;
+    medida::Timer& mCheckpointTimer;
+
+    // Names of the statements prepared with libpq by PostgresBinaryQuery on
+    // the main connection, by query text.
+    std::map<std::string, std::string> mNativeStatements;
+
+    std::unique_ptr<LedgerEntryCache> mEntryCache;
+    LedgerHeaderCache mLedgerHeaderCache;
+    std::unique_ptr<OrderBook> mOrderBook;
+    std::unique_ptr<InflationVoteTally> mInflationVoteTally;
+    std::unique_ptr<HistoryPartitions> mHistoryPartitions;
+    std::unique_ptr<PeerTable> mPeerTable;
+    bool const mStoreAccountXDR;
+    bool const mCompressTxHistory;
+    // DATABASE_DURABILITY is RELAXED, and the database can make use of it
+    bool mCanRelaxCommits{false};
+    bool mCommitsRelaxed{false};
 
     // Helpers for maintaining the total query time and calculating
-    // idle percentage.
+    // idle percentage. Timers are also taken from worker threads (with
+    // pooled sessions), hence the mutex.
     std::set<std::string> mEntityTypes;
+    mutable std::mutex mEntityTypesMutex;
     std::chrono::nanoseconds mExcludedQueryTime;
     std::chrono::nanoseconds mExcludedTotalTime;
     std::chrono::nanoseconds mLastIdleQueryTime;
     VirtualClock::time_point mLastIdleTotalTime;
 
+    void addEntityType(std::string const& entityName);
+
     static bool gDriversRegistered;
     static void registerDrivers();
     void applySchemaUpgrade(unsigned long vers);
@@ -111,6 +144,7 @@ class Database : NonMovableOrCopyable
     // Instantiate object and connect to app.getConfig().DATABASE;
     // if there is a connection error, this will throw.
     Database(Application& app);
+    ~Database();
 
     // Return a crude meter of total queries to the db, for use in
     // overlay/LoadManager.
@@ -131,6 +165,14 @@ class Database : NonMovableOrCopyable
     // excluded above via `excludeTime`.
     uint32_t recentIdleDbPercent();
 
+    // Return the percent of the time since `since` that the database has
+    // been idle, `queryTime` being the totalQueryTime() at `since`. Unlike
+    // recentIdleDbPercent, this does not start a new measurement, so that
+    // background jobs can measure their own periods without disturbing the
+    // load manager.
+    uint32_t idleDbPercentSince(std::chrono::nanoseconds queryTime,
+                                VirtualClock::time_point since) const;
+
     // Return a logging helper that will capture all SQL statements made
     // on the main connection while active, and will log those statements
     // to the process' log for diagnostics. For testing and perf tuning.
@@ -139,13 +181,29 @@ class Database : NonMovableOrCopyable
     // Return a helper object that borrows, from the Database, a prepared
     // statement handle for the provided query. The prepared statement handle
     // is ceated if necessary before borrowing, and reset (unbound from data)
-    // when the statement context is destroyed.
+    // when the statement context is destroyed. At most STATEMENT_CACHE_SIZE
+    // handles are kept, least recently used ones are closed first.
+    //
+    // Time spent using the statement is recorded in the timer
+    // {"database", "statement", normalizeQuery(query)}.
     StatementContext getPreparedStatement(std::string const& query);
+    static size_t const STATEMENT_CACHE_SIZE;
+
+    // Query text with whitespace runs collapsed, used to name the per-query
+    // timers above.
+    static std::string normalizeQuery(std::string const& query);
 
     // Purge all cached prepared statements, closing their handles with the
     // database.
     void clearPreparedStatementCache();
 
+    // Name of the libpq prepared statement of `query` on the main
+    // connection, for PostgresBinaryQuery; `isNew` is set if the statement is
+    // not prepared yet, in which case it must be prepared under that name
+    // then recorded with addNativeStatement.
+    std::string getNativeStatementName(std::string const& query, bool& isNew);
+    void addNativeStatement(std::string const& query, std::string const& name);
+
     // Return metric-gathering timers for various families of SQL operation.
     // These timers automatically count the time they are alive for,
     // so only acquire them immediately before executing an SQL statement.
@@ -162,6 +220,29 @@ class Database : NonMovableOrCopyable
     // Return true if the Database target is SQLite, otherwise false.
     bool isSqlite() const;
 
+    // Return true if ACCOUNT_ENTRY_XDR is set: accounts are stored with the
+    // XDR of their entry.
+    bool storesAccountXDR() const;
+
+    // Return true if COMPRESS_TX_HISTORY is set: transactions are stored
+    // compressed in the history tables.
+    bool compressesTxHistory() const;
+
+    // With MANAGED_SQLITE, SQLite does not checkpoint its write-ahead log on
+    // its own: this runs a (passive) checkpoint, and is meant to be called
+    // between ledger closes. Does nothing otherwise. The time spent is
+    // accounted as query time.
+    void checkpoint();
+
+    // With DATABASE_DURABILITY=RELAXED, lets the transactions committed from
+    // now on not wait for the disk (@p relaxed), or wait for it again; to be
+    // called between transactions. On PostgreSQL, they are committed with
+    // synchronous_commit=off. SQLite (with MANAGED_SQLITE) does not sync its
+    // write-ahead log on commit anyway, but on checkpoints: those are to be
+    // skipped while commitsRelaxed(). Does nothing otherwise.
+    void setRelaxedCommits(bool relaxed);
+    bool commitsRelaxed() const;
+
     // Return true if a connection pool is available for worker threads
     // to read from the database through, otherwise false.
     bool canUsePool() const;
@@ -189,12 +270,47 @@ class Database : NonMovableOrCopyable
     // threads. Throws an error if !canUsePool().
     soci::connection_pool& getPool();
 
+    // Return true if DATABASE_READONLY is set, otherwise false.
+    bool hasReadOnlyReplica() const;
+
+    // Access the SOCI connection pool to DATABASE_READONLY, for read-only
+    // work that does not need the latest data, from any thread. Throws an
+    // error if !hasReadOnlyReplica().
+    soci::connection_pool& getReadOnlyPool();
+    static size_t const READONLY_POOL_SIZE;
+
     // Access the LedgerEntry cache. Note: clients are responsible for
     // invalidating entries in this cache as they perform statements
     // against the database. It's kept here only for ease of access.
-    typedef cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>
-        EntryCache;
+    typedef LedgerEntryCache EntryCache;
     EntryCache& getEntryCache();
+
+    // Access the last closed ledger headers, kept by LedgerManager.
+    LedgerHeaderCache& getLedgerHeaderCache();
+
+    // Access the resident order book, or nullptr if IN_MEMORY_ORDER_BOOK
+    // is not set. Like the entry cache, it is maintained by OfferFrame.
+    OrderBook* getOrderBook();
+
+    // Access the resident tally of inflation votes, or nullptr if
+    // INFLATION_VOTE_TALLY is not set. It is maintained by LedgerDelta.
+    InflationVoteTally* getInflationVoteTally();
+
+    // Access the partitions of the history tables, or nullptr if
+    // HISTORY_PARTITION_CHECKPOINTS is not set.
+    HistoryPartitions* getHistoryPartitions();
+
+    // Access the resident peers table, or nullptr if IN_MEMORY_PEER_TABLE is
+    // not set. It is maintained by PeerRecord and flushed by the overlay.
+    PeerTable* getPeerTable();
+
+    // With partitioned history tables, create the partitions holding the
+    // history of `ledgerSeq` and of the partition after it, so that SCP
+    // history saved a bit ahead of the ledger being closed has a partition
+    // too. Must be called outside any transaction, before writing history:
+    // partitions are created in transactions of their own, that must not
+    // be rolled back. Does nothing otherwise.
+    void ensureHistoryPartitions(uint32_t ledgerSeq);
 };
 
 class DBTimeExcluder : NonCopyable
@@ -4,16 +4,30 @@
 
 #include "util/asio.h"
 #include "crypto/Hex.h"
+#include "database/BatchInserter.h"
 #include "database/Database.h"
+#include "database/HistoryPartitions.h"
+#include "database/PostgresBinaryQuery.h"
+#include "history/HistoryManager.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/OfferFrame.h"
+#include "ledger/TrustFrame.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "main/PersistentState.h"
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
 #include "util/TmpDir.h"
+#include <cctype>
 #include <random>
+#include <sstream>
 
 using namespace stellar;
 
@@ -187,6 +201,120 @@ TEST_CASE("sqlite MVCC test", "[db]")
     checkMVCCIsolation(app);
 }
 
+TEST_CASE("managed sqlite checkpoints", "[db]")
+{
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    cfg.MANAGED_SQLITE = true;
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    int autoCheckpoint = -1, synchronous = -1;
+    db.getSession() << "PRAGMA wal_autocheckpoint", soci::into(autoCheckpoint);
+    db.getSession() << "PRAGMA synchronous", soci::into(synchronous);
+    REQUIRE(autoCheckpoint == 0);
+    REQUIRE(synchronous == 1 /* NORMAL */);
+
+    auto& timer =
+        app->getMetrics().NewTimer({"database", "checkpoint", "wal"});
+    auto before = timer.count();
+    auto queryTime = db.totalQueryTime();
+    db.checkpoint();
+    REQUIRE(timer.count() == before + 1);
+    REQUIRE(db.totalQueryTime() >= queryTime);
+}
+
+TEST_CASE("prepared statement cache", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    REQUIRE(Database::normalizeQuery("  SELECT a,\n\t  b FROM  t  ") ==
+            "SELECT a, b FROM t");
+
+    SECTION("per query timers")
+    {
+        auto& timer = app->getMetrics().NewTimer(
+            {"database", "statement", "SELECT :v1 + 1"});
+        auto before = timer.count();
+        for (int i = 0; i < 3; i++)
+        {
+            int v = i, res = 0;
+            auto prep = db.getPreparedStatement("SELECT   :v1\n + 1");
+            auto& st = prep.statement();
+            st.exchange(soci::use(v));
+            st.exchange(soci::into(res));
+            st.define_and_bind();
+            st.execute(true);
+            REQUIRE(res == i + 1);
+        }
+        REQUIRE(timer.count() == before + 3);
+    }
+
+    SECTION("bounded size")
+    {
+        auto& size = app->getMetrics().NewCounter(
+            {"database", "memory", "statements"});
+        for (size_t i = 0; i < Database::STATEMENT_CACHE_SIZE + 10; i++)
+        {
+            db.getPreparedStatement("SELECT " + std::to_string(i));
+        }
+        REQUIRE(size.count() == Database::STATEMENT_CACHE_SIZE);
+        db.clearPreparedStatementCache();
+        REQUIRE(size.count() == 0);
+    }
+}
+
+static void
+batchInserterTest(Application::pointer app)
+{
+    auto& session = app->getDatabase().getSession();
+    session << "DROP TABLE IF EXISTS test";
+    session << "CREATE TABLE test (x INT, s TEXT)";
+
+    soci::transaction tx(session);
+    BatchInserter inserter(app->getDatabase(), "test", {"x", "s"});
+    // more than one batch, and a remainder that is not a power of two
+    int const n = 150;
+    for (int i = 0; i < n; i++)
+    {
+        inserter.addRow({std::to_string(i), "a\tb\n" + std::to_string(i)});
+    }
+    REQUIRE_THROWS_AS(inserter.addRow({"1"}), std::invalid_argument);
+    REQUIRE(inserter.size() == n);
+    REQUIRE(inserter.flush() == n);
+    REQUIRE(inserter.flush() == 0);
+    tx.commit();
+
+    int count = 0, sum = 0;
+    session << "SELECT COUNT(*), SUM(x) FROM test", soci::into(count),
+        soci::into(sum);
+    REQUIRE(count == n);
+    REQUIRE(sum == n * (n - 1) / 2);
+    std::string s;
+    session << "SELECT s FROM test WHERE x = 42", soci::into(s);
+    REQUIRE(s == "a\tb\n42");
+}
+
+TEST_CASE("binary query placeholders", "[db]")
+{
+    CHECK(PostgresBinaryQuery::numberPlaceholders(
+              "SELECT a::text FROM t WHERE b = :id AND c = ':x' AND d = :d2") ==
+          "SELECT a::text FROM t WHERE b = $1 AND c = ':x' AND d = $2");
+}
+
+TEST_CASE("batch inserter", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    batchInserterTest(app);
+}
+
 #ifdef USE_POSTGRES
 TEST_CASE("postgres smoketest", "[db]")
 {
@@ -226,11 +354,106 @@ TEST_CASE("postgres smoketest", "[db]")
             tx.commit();
         }
 
+        SECTION("batch inserter")
+        {
+            batchInserterTest(app);
+        }
+
         SECTION("postgres MVCC test")
         {
             app->getDatabase().getSession() << "drop table if exists test";
             checkMVCCIsolation(app);
         }
+
+        SECTION("binary query")
+        {
+            auto& db = app->getDatabase();
+            session << "drop table if exists test";
+            session << "create table test (a smallint, b integer, c bigint, "
+                       "d text)";
+            session << "insert into test values (-2, -70000, -5000000000, "
+                       "'x'), (3, NULL, 4, '')";
+            for (int i = 0; i < 2; ++i)
+            {
+                PostgresBinaryQuery q(
+                    db, "select a, b, c, d from test where a < :v order by a",
+                    {"10"});
+                REQUIRE(q.rows() == 2);
+                CHECK(q.getInt(0, 0) == -2);
+                CHECK(q.getInt(0, 1) == -70000);
+                CHECK(q.getInt(0, 2) == -5000000000);
+                CHECK(q.getString(0, 3) == "x");
+                CHECK(q.isNull(1, 1));
+                CHECK(q.getInt(1, 2) == 4);
+                CHECK(q.getString(1, 3).empty());
+            }
+            db.clearPreparedStatementCache();
+            PostgresBinaryQuery q(
+                db, "select a, b, c, d from test where a < :v order by a",
+                {"0"});
+            CHECK(q.rows() == 1);
+        }
+    }
+    catch (soci::soci_error& err)
+    {
+        std::string what(err.what());
+
+        if (what.find("Cannot establish connection") != std::string::npos)
+        {
+            LOG(WARNING) << "Cannot connect to postgres server " << what;
+        }
+        else
+        {
+            LOG(ERROR) << "DB error: " << what;
+            REQUIRE(0);
+        }
+    }
+}
+
+TEST_CASE("postgres history partitions", "[db]")
+{
+    Config cfg(getTestConfig(0, Config::TESTDB_POSTGRESQL));
+    cfg.HISTORY_PARTITION_CHECKPOINTS = 2;
+    VirtualClock clock;
+    try
+    {
+        Application::pointer app = createTestApplication(clock, cfg);
+        auto& db = app->getDatabase();
+        auto partitions = db.getHistoryPartitions();
+        REQUIRE(partitions);
+        for (auto const& t : HistoryPartitions::TABLES)
+        {
+            REQUIRE(HistoryPartitions::isPartitioned(db.getSession(), t));
+        }
+        auto size = partitions->getPartitionSize();
+        REQUIRE(size == 2 * app->getHistoryManager().getCheckpointFrequency());
+
+        // the genesis ledger is in the partition of the existing rows
+        REQUIRE(partitions->getPartitions().size() == 1);
+        REQUIRE(partitions->getPartitions().begin()->second == size);
+
+        db.ensureHistoryPartitions(3 * size + 1);
+        REQUIRE(partitions->getPartitions() ==
+                (std::map<uint32_t, uint32_t>{{0, size},
+                                              {3 * size, 4 * size},
+                                              {4 * size, 5 * size}}));
+        // fills the gap, without overlapping
+        partitions->ensurePartitionFor(size + 1);
+        partitions->ensurePartitionFor(size + 2);
+        REQUIRE(partitions->getPartitions().size() == 4);
+        REQUIRE(partitions->getPartitions().at(size) == 2 * size);
+
+        int rows = 0;
+        db.getSession() << "SELECT COUNT(*) FROM ledgerheaders",
+            soci::into(rows);
+        REQUIRE(rows == 1);
+
+        REQUIRE(partitions->dropPartitionsUpTo(2 * size - 2) == 1);
+        REQUIRE(partitions->dropPartitionsUpTo(2 * size - 1) == 1);
+        REQUIRE(partitions->getPartitions().begin()->first == 3 * size);
+        db.getSession() << "SELECT COUNT(*) FROM ledgerheaders",
+            soci::into(rows);
+        REQUIRE(rows == 0);
     }
     catch (soci::soci_error& err)
     {
@@ -324,6 +547,156 @@ TEST_CASE("postgres performance", "[db][pgperf][!hide]")
 
 #endif
 
+// Runs the lookups done while applying transactions and returns the queries
+// they sent, as logged by soci.
+static std::vector<std::string>
+captureHotQueries(Application::pointer app)
+{
+    auto& db = app->getDatabase();
+    db.clearPreparedStatementCache();
+    std::ostringstream log;
+    db.getSession().set_log_stream(&log);
+
+    auto account = txtest::getAccount("a").getPublicKey();
+    auto issuer = txtest::getAccount("issuer");
+    auto native = txtest::makeNativeAsset();
+    auto usd = txtest::makeAsset(issuer, "USD");
+    auto eur = txtest::makeAsset(issuer, "EUR");
+    std::vector<OfferFrame::pointer> offers;
+    OfferFrame::loadBestOffers(5, 0, usd, eur, offers, db);
+    OfferFrame::loadBestOffers(5, 0, native, usd, offers, db);
+    OfferFrame::loadBestOffers(5, 0, usd, native, offers, db);
+    OfferFrame::loadOffersByAccountAndAsset(account, usd, db);
+    OfferFrame::loadOffer(account, 1, db);
+    AccountFrame::loadAccount(account, db);
+    TrustFrame::loadTrustLine(account, usd, db);
+    std::vector<TrustFrame::pointer> lines;
+    TrustFrame::loadLines(account, lines, db);
+    db.getSession().set_log_stream(nullptr);
+
+    std::vector<std::string> res;
+    std::istringstream in(log.str());
+    std::string line;
+    while (std::getline(in, line))
+    {
+        auto query = Database::normalizeQuery(line);
+        if (query.compare(0, 6, "SELECT") == 0)
+        {
+            res.emplace_back(query);
+        }
+    }
+    REQUIRE(res.size() >= 8);
+    return res;
+}
+
+static std::vector<std::string>
+explainQuery(Database& db, std::string const& query)
+{
+    auto& sess = db.getSession();
+    std::vector<std::string> res;
+    if (db.isSqlite())
+    {
+        soci::rowset<soci::row> rs =
+            (sess.prepare << "EXPLAIN QUERY PLAN " << query);
+        for (auto const& r : rs)
+        {
+            // the detail is the last column in every version of SQLite
+            res.emplace_back(r.get<std::string>(r.size() - 1));
+        }
+        return res;
+    }
+
+    // postgres wants positional parameters and values for them
+    std::string positional;
+    std::string values;
+    size_t n = 0;
+    for (size_t i = 0; i < query.size(); i++)
+    {
+        if (query[i] == ':' && i + 1 < query.size() &&
+            (std::isalpha(query[i + 1]) || query[i + 1] == '_'))
+        {
+            positional += "$" + std::to_string(++n);
+            values += (n == 1 ? "'1'" : ",'1'");
+            while (i + 1 < query.size() &&
+                   (std::isalnum(query[i + 1]) || query[i + 1] == '_'))
+            {
+                i++;
+            }
+        }
+        else
+        {
+            positional += query[i];
+        }
+    }
+    sess << "PREPARE hotquery AS " << positional;
+    {
+        soci::rowset<std::string> rs =
+            (sess.prepare << "EXPLAIN EXECUTE hotquery"
+                          << (n == 0 ? "" : "(" + values + ")"));
+        res.assign(rs.begin(), rs.end());
+    }
+    sess << "DEALLOCATE hotquery";
+    return res;
+}
+
+// Fails on a hot query scanning a whole table, or sorting the rows it
+// pages through with LIMIT instead of reading them from an index.
+static void
+checkHotQueryPlans(Application::pointer app)
+{
+    auto& db = app->getDatabase();
+    auto queries = captureHotQueries(app);
+    if (!db.isSqlite())
+    {
+        // so that tiny test tables do not make scans look cheap
+        db.getSession() << "SET enable_seqscan = off";
+    }
+    for (auto const& query : queries)
+    {
+        auto paged = query.find("LIMIT") != std::string::npos;
+        for (auto const& step : explainQuery(db, query))
+        {
+            INFO(query << " -> " << step);
+            if (db.isSqlite())
+            {
+                REQUIRE(step.compare(0, 4, "SCAN") != 0);
+                REQUIRE(!(paged && step.find("TEMP B-TREE") !=
+                                       std::string::npos));
+            }
+            else
+            {
+                REQUIRE(step.find("Seq Scan") == std::string::npos);
+                REQUIRE(!(paged && step.find("Sort") != std::string::npos));
+            }
+        }
+    }
+    if (!db.isSqlite())
+    {
+        db.getSession() << "RESET enable_seqscan";
+    }
+}
+
+TEST_CASE("hot query plans use indexes", "[db]")
+{
+    VirtualClock clock;
+    SECTION("sqlite")
+    {
+        Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        checkHotQueryPlans(app);
+    }
+#ifdef USE_POSTGRES
+    SECTION("postgres")
+    {
+        Config const& cfg = getTestConfig(0, Config::TESTDB_POSTGRESQL);
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+        checkHotQueryPlans(app);
+    }
+#endif
+}
+
 TEST_CASE("schema test", "[db]")
 {
     Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
@@ -337,3 +710,41 @@ TEST_CASE("schema test", "[db]")
     auto av = db.getAppSchemaVersion();
     REQUIRE(dbv == av);
 }
+
+TEST_CASE("persistent state cache", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& session = app->getDatabase().getSession();
+    auto& ps = app->getPersistentState();
+    auto stored = [&]() {
+        std::string res;
+        session << "SELECT state FROM storestate WHERE statename = "
+                   "'ledgerupgrades'",
+            soci::into(res);
+        return res;
+    };
+
+    ps.setState(PersistentState::kLedgerUpgrades, "a");
+    REQUIRE(stored() == "a");
+
+    // changed behind its back: reads and unchanged writes are served from
+    // memory
+    session << "UPDATE storestate SET state = 'b' WHERE statename = "
+               "'ledgerupgrades'";
+    REQUIRE(ps.getState(PersistentState::kLedgerUpgrades) == "a");
+    ps.setState(PersistentState::kLedgerUpgrades, "a");
+    REQUIRE(stored() == "b");
+
+    ps.setState(PersistentState::kLedgerUpgrades, "c");
+    REQUIRE(stored() == "c");
+
+    session << "UPDATE storestate SET state = 'd' WHERE statename = "
+               "'ledgerupgrades'";
+    ps.clearCache();
+    REQUIRE(ps.getState(PersistentState::kLedgerUpgrades) == "d");
+}
@@ -8,7 +8,7 @@ namespace stellar
 {
 namespace DatabaseUtils
 {
-void
+bool
 deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq, uint32_t count,
                        std::string const& tableName,
                        std::string const& ledgerSeqColumn)
@@ -28,7 +28,45 @@ deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq, uint32_t count,
         uint64 m = static_cast<uint32>(m64);
         sess << "DELETE FROM " << tableName << " WHERE " << ledgerSeqColumn
              << " <= " << m;
+        return m == ledgerSeq;
     }
+    return true;
+}
+
+std::string
+makeInClause(size_t n)
+{
+    std::string res = "(";
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i != 0)
+        {
+            res += ", ";
+        }
+        res += ":k" + std::to_string(i);
+    }
+    res += ")";
+    return res;
+}
+
+std::string
+makeValuesClause(size_t rows, size_t columns)
+{
+    std::string res;
+    for (size_t i = 0; i < rows; i++)
+    {
+        res += i == 0 ? "(" : ", (";
+        for (size_t j = 0; j < columns; j++)
+        {
+            if (j != 0)
+            {
+                res += ", ";
+            }
+            res += ":r" + std::to_string(i) + "_" + std::to_string(j);
+        }
+        res += ")";
+    }
+    return res;
+}
 }
 }
-}
\ No newline at end of file
@@ -5,13 +5,71 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "Database.h"
+#include <algorithm>
+#include <string>
+#include <vector>
 
 namespace stellar
 {
 namespace DatabaseUtils
 {
-void deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
+// Delete the rows of `tableName` for the `count` oldest ledgers it has,
+// stopping at `ledgerSeq`. Returns true if no row up to `ledgerSeq` is
+// left.
+bool deleteOldEntriesHelper(soci::session& sess, uint32_t ledgerSeq,
                             uint32_t count, std::string const& tableName,
                             std::string const& ledgerSeqColumn);
+
+// Number of keys bound into each `IN (...)` query by multi-key loaders.
+size_t const BATCH_LOAD_SIZE = 64;
+
+// Return a placeholder list "(:k0, :k1, ..., :kN)" suitable for an
+// `IN` clause with `n` bound values.
+std::string makeInClause(size_t n);
+
+// Return a row list "(:r0_0, ..., :r0_C), ..., (:rN_0, ..., :rN_C)" suitable
+// for a multi-row `VALUES` clause of `rows` rows of `columns` values.
+std::string makeValuesClause(size_t rows, size_t columns);
+
+// Split the rows [0, `count`) in batches for multi-row statements and call
+// `f(begin, end)` on each: batches of BATCH_LOAD_SIZE rows, then powers of
+// two for what is left, so that only a few prepared statements are needed.
+template <typename F>
+void
+forEachRowBatch(size_t count, F f)
+{
+    size_t begin = 0;
+    while (begin < count)
+    {
+        size_t size = BATCH_LOAD_SIZE;
+        while (size > count - begin)
+        {
+            size /= 2;
+        }
+        f(begin, begin + size);
+        begin += size;
+    }
+}
+
+// Split `keys` in batches of exactly BATCH_LOAD_SIZE elements and call `f`
+// on each. The last batch is padded by repeating its last key, so that all
+// batches share a single prepared statement. Does nothing if `keys` is empty.
+template <typename T, typename F>
+void
+forEachKeyBatch(std::vector<T> const& keys, F f)
+{
+    std::vector<T> batch;
+    batch.reserve(BATCH_LOAD_SIZE);
+    for (size_t i = 0; i < keys.size(); i += BATCH_LOAD_SIZE)
+    {
+        auto end = std::min(keys.size(), i + BATCH_LOAD_SIZE);
+        batch.assign(keys.begin() + i, keys.begin() + end);
+        while (batch.size() < BATCH_LOAD_SIZE)
+        {
+            batch.emplace_back(batch.back());
+        }
+        f(batch);
+    }
+}
 }
 }
@@ -0,0 +1,219 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/HistoryPartitions.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <soci.h>
+#include <stdexcept>
+
+namespace stellar
+{
+
+std::vector<std::string> const HistoryPartitions::TABLES = {
+    "txhistory", "txfeehistory", "scphistory", "ledgerheaders"};
+
+namespace
+{
+std::string
+partitionName(std::string const& table, uint32_t first, uint32_t end)
+{
+    return table + "_" + std::to_string(first) + "_" + std::to_string(end);
+}
+
+// The constraints and indexes of the partitioned tables. Unique constraints
+// must include the partition key: ledgerheaders.ledgerhash, the primary key
+// of the unpartitioned table, only gets an index.
+std::vector<std::string>
+getIndexes(std::string const& table)
+{
+    if (table == "ledgerheaders")
+    {
+        return {"ALTER TABLE ledgerheaders ADD UNIQUE (ledgerseq)",
+                "CREATE INDEX ON ledgerheaders (ledgerhash)"};
+    }
+    else if (table == "scphistory")
+    {
+        return {"CREATE INDEX ON scphistory (ledgerseq)"};
+    }
+    else
+    {
+        return {"ALTER TABLE " + table +
+                " ADD PRIMARY KEY (ledgerseq, txindex)"};
+    }
+}
+}
+
+HistoryPartitions::HistoryPartitions(soci::session& sess,
+                                     uint32_t partitionSize)
+    : mSession(sess), mPartitionSize(partitionSize)
+{
+    if (mPartitionSize == 0)
+    {
+        throw std::invalid_argument("partition size must be positive");
+    }
+}
+
+bool
+HistoryPartitions::isPartitioned(soci::session& sess, std::string const& table)
+{
+    int count = 0;
+    sess << "SELECT COUNT(*) FROM pg_partitioned_table p "
+            "JOIN pg_class c ON c.oid = p.partrelid WHERE c.relname = :t",
+        soci::into(count), soci::use(table);
+    return count != 0;
+}
+
+void
+HistoryPartitions::upgrade()
+{
+    {
+        soci::transaction tx(mSession);
+        std::vector<std::string> tables;
+        uint32_t maxLedger = 0;
+        for (auto const& t : TABLES)
+        {
+            if (!isPartitioned(mSession, t))
+            {
+                int max = 0;
+                mSession << "SELECT COALESCE(MAX(ledgerseq), 0) FROM " << t,
+                    soci::into(max);
+                maxLedger = std::max(maxLedger, static_cast<uint32_t>(max));
+                tables.emplace_back(t);
+            }
+        }
+        if (!tables.empty())
+        {
+            // the existing rows go to a first partition, up to the end of the
+            // partition holding the last ledger
+            auto end = (maxLedger / mPartitionSize + 1) * mPartitionSize;
+            CLOG(INFO, "Database") << "Partitioning history tables by "
+                                   << mPartitionSize << " ledgers";
+            for (auto const& t : tables)
+            {
+                partitionTable(t, end);
+            }
+        }
+        tx.commit();
+    }
+    loadPartitions();
+}
+
+void
+HistoryPartitions::partitionTable(std::string const& table, uint32_t end)
+{
+    auto part = partitionName(table, 0, end);
+    mSession << "ALTER TABLE " << table << " RENAME TO " << part;
+    mSession << "CREATE TABLE " << table << " (LIKE " << part
+             << " INCLUDING DEFAULTS INCLUDING CONSTRAINTS)"
+                " PARTITION BY RANGE (ledgerseq)";
+    for (auto const& index : getIndexes(table))
+    {
+        mSession << index;
+    }
+    mSession << "ALTER TABLE " << table << " ATTACH PARTITION " << part
+             << " FOR VALUES FROM (MINVALUE) TO (" << end << ")";
+}
+
+void
+HistoryPartitions::loadPartitions()
+{
+    mPartitions.clear();
+    auto prefix = TABLES.front() + "_";
+    soci::rowset<std::string> rs =
+        (mSession.prepare << "SELECT c.relname FROM pg_inherits i "
+                             "JOIN pg_class c ON c.oid = i.inhrelid "
+                             "JOIN pg_class p ON p.oid = i.inhparent "
+                             "WHERE p.relname = :t",
+         soci::use(TABLES.front()));
+    for (auto const& name : rs)
+    {
+        auto sep = name.find('_', prefix.size());
+        if (name.compare(0, prefix.size(), prefix) != 0 ||
+            sep == std::string::npos)
+        {
+            throw std::runtime_error("Unexpected history partition " + name);
+        }
+        auto first =
+            std::stoul(name.substr(prefix.size(), sep - prefix.size()));
+        auto end = std::stoul(name.substr(sep + 1));
+        mPartitions[static_cast<uint32_t>(first)] = static_cast<uint32_t>(end);
+    }
+}
+
+void
+HistoryPartitions::createPartition(uint32_t first, uint32_t end)
+{
+    soci::transaction tx(mSession);
+    for (auto const& t : TABLES)
+    {
+        mSession << "CREATE TABLE " << partitionName(t, first, end)
+                 << " PARTITION OF " << t << " FOR VALUES FROM (" << first
+                 << ") TO (" << end << ")";
+    }
+    tx.commit();
+    mPartitions[first] = end;
+}
+
+void
+HistoryPartitions::ensurePartitionFor(uint32_t ledgerSeq)
+{
+    auto next = mPartitions.upper_bound(ledgerSeq);
+    uint64_t first = ledgerSeq / mPartitionSize * mPartitionSize;
+    uint64_t end = first + mPartitionSize;
+    if (next != mPartitions.begin())
+    {
+        auto prev = std::prev(next);
+        if (ledgerSeq < prev->second)
+        {
+            return;
+        }
+        first = std::max<uint64_t>(first, prev->second);
+    }
+    if (next != mPartitions.end())
+    {
+        end = std::min<uint64_t>(end, next->first);
+    }
+    end = std::min<uint64_t>(end, UINT32_MAX);
+    createPartition(static_cast<uint32_t>(first), static_cast<uint32_t>(end));
+}
+
+size_t
+HistoryPartitions::dropPartitionsUpTo(uint32_t ledgerSeq)
+{
+    size_t dropped = 0;
+    auto it = mPartitions.begin();
+    while (it != mPartitions.end() &&
+           it->second <= static_cast<uint64_t>(ledgerSeq) + 1)
+    {
+        {
+            soci::transaction tx(mSession);
+            for (auto const& t : TABLES)
+            {
+                mSession << "DROP TABLE "
+                         << partitionName(t, it->first, it->second);
+            }
+            tx.commit();
+        }
+        CLOG(DEBUG, "History") << "Dropped history partition [" << it->first
+                               << ", " << it->second << ")";
+        it = mPartitions.erase(it);
+        dropped++;
+    }
+    return dropped;
+}
+
+uint32_t
+HistoryPartitions::getPartitionSize() const
+{
+    return mPartitionSize;
+}
+
+std::map<uint32_t, uint32_t> const&
+HistoryPartitions::getPartitions() const
+{
+    return mPartitions;
+}
+}
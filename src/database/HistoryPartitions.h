@@ -0,0 +1,70 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace soci
+{
+class session;
+}
+
+namespace stellar
+{
+
+/**
+ * Range partitioning by ledgerseq of the history tables (txhistory,
+ * txfeehistory, scphistory and ledgerheaders) on PostgreSQL, with
+ * HISTORY_PARTITION_CHECKPOINTS: old history is then deleted by dropping
+ * whole partitions instead of row by row.
+ *
+ * All tables share the same partitions, created on demand aligned on
+ * multiples of the partition size, and named <table>_<first>_<end> where
+ * [first, end) are the ledgers they hold. Converting existing tables keeps
+ * their rows in a first partition holding every ledger up to the current
+ * one.
+ */
+class HistoryPartitions : NonMovableOrCopyable
+{
+  public:
+    static std::vector<std::string> const TABLES;
+
+    HistoryPartitions(soci::session& sess, uint32_t partitionSize);
+
+    // true if `table` is a partitioned table
+    static bool isPartitioned(soci::session& sess, std::string const& table);
+
+    // Partition the history tables if they are not yet, and load the
+    // partitions they have.
+    void upgrade();
+
+    // Create the partition that the history rows of `ledgerSeq` go to, if
+    // there is none yet.
+    void ensurePartitionFor(uint32_t ledgerSeq);
+
+    // Drop the partitions only holding ledgers up to `ledgerSeq`, returns
+    // how many were dropped.
+    size_t dropPartitionsUpTo(uint32_t ledgerSeq);
+
+    uint32_t getPartitionSize() const;
+
+    // the ranges of ledgers of the partitions: first -> end
+    std::map<uint32_t, uint32_t> const& getPartitions() const;
+
+  private:
+    soci::session& mSession;
+    uint32_t const mPartitionSize;
+    std::map<uint32_t, uint32_t> mPartitions;
+
+    void partitionTable(std::string const& table, uint32_t end);
+    void createPartition(uint32_t first, uint32_t end);
+    void loadPartitions();
+};
+}
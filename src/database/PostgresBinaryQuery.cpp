@@ -0,0 +1,167 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/PostgresBinaryQuery.h"
+#include "database/Database.h"
+
+#ifdef USE_POSTGRES
+#include "soci-postgresql.h"
+#include <libpq-fe.h>
+#endif
+
+#include <cctype>
+#include <stdexcept>
+
+namespace stellar
+{
+
+std::string
+PostgresBinaryQuery::numberPlaceholders(std::string const& sql)
+{
+    std::string res;
+    res.reserve(sql.size());
+    int n = 0;
+    bool quoted = false;
+    for (size_t i = 0; i < sql.size(); ++i)
+    {
+        char c = sql[i];
+        if (c == '\'')
+        {
+            quoted = !quoted;
+        }
+        // skips '::' casts
+        else if (c == ':' && !quoted && i + 1 < sql.size() &&
+                 (std::isalnum(static_cast<unsigned char>(sql[i + 1])) ||
+                  sql[i + 1] == '_') &&
+                 (i == 0 || sql[i - 1] != ':'))
+        {
+            res += "$" + std::to_string(++n);
+            while (i + 1 < sql.size() &&
+                   (std::isalnum(static_cast<unsigned char>(sql[i + 1])) ||
+                    sql[i + 1] == '_'))
+            {
+                ++i;
+            }
+            continue;
+        }
+        res.push_back(c);
+    }
+    return res;
+}
+
+PostgresBinaryQuery::PostgresBinaryQuery(
+    Database& db, std::string const& sql,
+    std::vector<std::string> const& params)
+    : mResult(nullptr), mRows(0)
+{
+#ifdef USE_POSTGRES
+    if (db.isSqlite())
+    {
+        throw std::runtime_error(
+            "Binary queries require a PostgreSQL database");
+    }
+    auto be = static_cast<soci::postgresql_session_backend*>(
+        db.getSession().get_backend());
+    PGconn* conn = be->conn_;
+
+    bool isNew;
+    auto name = db.getNativeStatementName(sql, isNew);
+    if (isNew)
+    {
+        auto pgSql = numberPlaceholders(sql);
+        PGresult* res = PQprepare(conn, name.c_str(), pgSql.c_str(),
+                                  static_cast<int>(params.size()), nullptr);
+        bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+        if (!ok)
+        {
+            throw std::runtime_error("Could not prepare " + pgSql + ": " +
+                                     PQerrorMessage(conn));
+        }
+        db.addNativeStatement(sql, name);
+    }
+
+    std::vector<char const*> values;
+    values.reserve(params.size());
+    for (auto const& p : params)
+    {
+        values.push_back(p.c_str());
+    }
+    // text parameters, binary results
+    PGresult* res = PQexecPrepared(conn, name.c_str(),
+                                   static_cast<int>(values.size()),
+                                   values.data(), nullptr, nullptr, 1);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+    {
+        std::string error = PQresultErrorMessage(res);
+        PQclear(res);
+        throw std::runtime_error("Query " + sql + " failed: " + error);
+    }
+    mResult = res;
+    mRows = PQntuples(res);
+#else
+    throw std::runtime_error("Binary queries require PostgreSQL support");
+#endif
+}
+
+PostgresBinaryQuery::~PostgresBinaryQuery()
+{
+#ifdef USE_POSTGRES
+    if (mResult)
+    {
+        PQclear(static_cast<PGresult*>(mResult));
+    }
+#endif
+}
+
+char const*
+PostgresBinaryQuery::value(int row, int col, int& length) const
+{
+#ifdef USE_POSTGRES
+    auto res = static_cast<PGresult*>(mResult);
+    length = PQgetlength(res, row, col);
+    return PQgetvalue(res, row, col);
+#else
+    length = 0;
+    return nullptr;
+#endif
+}
+
+bool
+PostgresBinaryQuery::isNull(int row, int col) const
+{
+#ifdef USE_POSTGRES
+    return PQgetisnull(static_cast<PGresult*>(mResult), row, col) != 0;
+#else
+    return true;
+#endif
+}
+
+int64_t
+PostgresBinaryQuery::getInt(int row, int col) const
+{
+    int length;
+    auto bytes = reinterpret_cast<unsigned char const*>(value(row, col, length));
+    if (length != 2 && length != 4 && length != 8)
+    {
+        throw std::runtime_error("Not an integer column");
+    }
+    uint64_t v = 0;
+    for (int i = 0; i < length; ++i)
+    {
+        v = (v << 8) | bytes[i];
+    }
+    // sign extension of the narrower types
+    int shift = 64 - 8 * length;
+    return static_cast<int64_t>(v << shift) >> shift;
+}
+
+std::string
+PostgresBinaryQuery::getString(int row, int col) const
+{
+    int length;
+    auto bytes = value(row, col, length);
+    return std::string(bytes, length);
+}
+}
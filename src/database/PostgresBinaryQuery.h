@@ -0,0 +1,59 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+class Database;
+
+/**
+ * Runs a query on the main session of a PostgreSQL database with libpq,
+ * getting its results in binary format, for the hot loads of single entries
+ * where soci's conversions of the text results are a large share of the
+ * time: integers come as network order words, text as its bytes.
+ *
+ * The query is written as for soci, with :name placeholders bound in order
+ * to `params` (passed as text), so that callers can share the text of their
+ * soci query. It is prepared the first time it is run and kept, as are
+ * soci's, until Database::clearPreparedStatementCache.
+ *
+ * Throws if `db` is not a PostgreSQL database (or stellar-core was built
+ * without PostgreSQL support), or if the query fails.
+ */
+class PostgresBinaryQuery : NonMovableOrCopyable
+{
+    void* mResult; // PGresult
+    int mRows;
+
+    char const* value(int row, int col, int& length) const;
+
+  public:
+    // `sql` with its :name placeholders replaced by $1, $2...
+    static std::string numberPlaceholders(std::string const& sql);
+
+    PostgresBinaryQuery(Database& db, std::string const& sql,
+                        std::vector<std::string> const& params);
+    ~PostgresBinaryQuery();
+
+    int
+    rows() const
+    {
+        return mRows;
+    }
+
+    bool isNull(int row, int col) const;
+
+    // a SMALLINT, INT or BIGINT column
+    int64_t getInt(int row, int col) const;
+
+    // a TEXT or VARCHAR column
+    std::string getString(int row, int col) const;
+};
+}
@@ -0,0 +1,201 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/PostgresCopyWriter.h"
+#include "database/Database.h"
+#include "util/Logging.h"
+
+#ifdef USE_POSTGRES
+#include "soci-postgresql.h"
+#include <libpq-fe.h>
+#endif
+
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace stellar
+{
+
+// size of the chunks handed to libpq
+static size_t const COPY_BUFFER_SIZE = 1 << 20;
+
+#ifdef USE_POSTGRES
+static PGconn*
+getConn(void* conn)
+{
+    return static_cast<PGconn*>(conn);
+}
+#endif
+
+PostgresCopyWriter::PostgresCopyWriter(Database& db, std::string const& table,
+                                       std::string const& columns)
+    : PostgresCopyWriter(db.getSession(), table, columns)
+{
+}
+
+PostgresCopyWriter::PostgresCopyWriter(soci::session& sess,
+                                       std::string const& table,
+                                       std::string const& columns)
+    : mConn(nullptr), mRowStarted(false), mDone(false), mRows(0)
+{
+#ifdef USE_POSTGRES
+    if (sess.get_backend_name() != "postgresql")
+    {
+        throw std::runtime_error("COPY requires a PostgreSQL database");
+    }
+    auto be =
+        static_cast<soci::postgresql_session_backend*>(sess.get_backend());
+    mConn = be->conn_;
+
+    std::string sql = "COPY " + table + " (" + columns + ") FROM STDIN";
+    PGresult* res = PQexec(getConn(mConn), sql.c_str());
+    bool ok = PQresultStatus(res) == PGRES_COPY_IN;
+    PQclear(res);
+    if (!ok)
+    {
+        throw std::runtime_error(std::string("Could not start ") + sql + ": " +
+                                 PQerrorMessage(getConn(mConn)));
+    }
+    mBuffer.reserve(COPY_BUFFER_SIZE + 4096);
+#else
+    throw std::runtime_error("COPY requires PostgreSQL support");
+#endif
+}
+
+PostgresCopyWriter::~PostgresCopyWriter()
+{
+#ifdef USE_POSTGRES
+    if (!mDone && mConn)
+    {
+        PQputCopyEnd(getConn(mConn), "aborted");
+        PQclear(PQgetResult(getConn(mConn)));
+    }
+#endif
+}
+
+void
+PostgresCopyWriter::flush()
+{
+#ifdef USE_POSTGRES
+    if (!mBuffer.empty() &&
+        PQputCopyData(getConn(mConn), mBuffer.data(),
+                      static_cast<int>(mBuffer.size())) != 1)
+    {
+        throw std::runtime_error(std::string("COPY failed: ") +
+                                 PQerrorMessage(getConn(mConn)));
+    }
+#endif
+    mBuffer.clear();
+}
+
+void
+PostgresCopyWriter::startField()
+{
+    if (mRowStarted)
+    {
+        mBuffer.push_back('\t');
+    }
+    mRowStarted = true;
+}
+
+void
+PostgresCopyWriter::addString(std::string const& s)
+{
+    startField();
+    // text format escapes, see "File Formats" in the COPY documentation
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '\\':
+            mBuffer += "\\\\";
+            break;
+        case '\n':
+            mBuffer += "\\n";
+            break;
+        case '\r':
+            mBuffer += "\\r";
+            break;
+        case '\t':
+            mBuffer += "\\t";
+            break;
+        default:
+            mBuffer.push_back(c);
+        }
+    }
+}
+
+void
+PostgresCopyWriter::addInt(int64_t v)
+{
+    startField();
+    mBuffer += std::to_string(v);
+}
+
+void
+PostgresCopyWriter::addUInt(uint64_t v)
+{
+    startField();
+    mBuffer += std::to_string(v);
+}
+
+void
+PostgresCopyWriter::addDouble(double v)
+{
+    startField();
+    std::ostringstream oss;
+    oss << std::setprecision(std::numeric_limits<double>::max_digits10) << v;
+    mBuffer += oss.str();
+}
+
+void
+PostgresCopyWriter::addNull()
+{
+    startField();
+    mBuffer += "\\N";
+}
+
+void
+PostgresCopyWriter::endRow()
+{
+    mBuffer.push_back('\n');
+    mRowStarted = false;
+    ++mRows;
+    if (mBuffer.size() >= COPY_BUFFER_SIZE)
+    {
+        flush();
+    }
+}
+
+size_t
+PostgresCopyWriter::finish()
+{
+    flush();
+    mDone = true;
+#ifdef USE_POSTGRES
+    auto conn = getConn(mConn);
+    if (PQputCopyEnd(conn, nullptr) != 1)
+    {
+        throw std::runtime_error(std::string("COPY failed: ") +
+                                 PQerrorMessage(conn));
+    }
+    std::string error;
+    while (PGresult* res = PQgetResult(conn))
+    {
+        if (PQresultStatus(res) != PGRES_COMMAND_OK)
+        {
+            error = PQresultErrorMessage(res);
+        }
+        PQclear(res);
+    }
+    if (!error.empty())
+    {
+        throw std::runtime_error("COPY failed: " + error);
+    }
+#endif
+    return mRows;
+}
+}
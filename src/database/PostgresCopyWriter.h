@@ -0,0 +1,61 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include <cstdint>
+#include <string>
+
+namespace soci
+{
+class session;
+}
+
+namespace stellar
+{
+class Database;
+
+/**
+ * Streams rows into a table of a PostgreSQL database with
+ * "COPY table (columns) FROM STDIN", on the main session of `db` or on a
+ * given session (say, a pooled one).
+ *
+ * Rows are built field by field (`add...` then `endRow`), buffered and sent
+ * in large chunks. `finish` must be called to complete the COPY; destroying
+ * an unfinished writer aborts it, which fails the enclosing transaction.
+ *
+ * No other statement may be issued on the session while a writer is alive.
+ * Throws if the session is not to a PostgreSQL database (or stellar-core
+ * was built without PostgreSQL support).
+ */
+class PostgresCopyWriter : NonMovableOrCopyable
+{
+    void* mConn; // PGconn
+    std::string mBuffer;
+    bool mRowStarted;
+    bool mDone;
+    size_t mRows;
+
+    void flush();
+    void startField();
+
+  public:
+    PostgresCopyWriter(Database& db, std::string const& table,
+                       std::string const& columns);
+    PostgresCopyWriter(soci::session& sess, std::string const& table,
+                       std::string const& columns);
+    ~PostgresCopyWriter();
+
+    void addString(std::string const& s);
+    void addInt(int64_t v);
+    void addUInt(uint64_t v);
+    void addDouble(double v);
+    void addNull();
+    void endRow();
+
+    // Complete the COPY and return the number of rows written.
+    size_t finish();
+};
+}
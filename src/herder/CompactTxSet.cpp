@@ -0,0 +1,141 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/CompactTxSet.h"
+#include "crypto/SHA.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace stellar
+{
+
+uint64_t
+shortTxID(Hash const& txSetHash, Hash const& txFullHash)
+{
+    auto hasher = SHA256::create();
+    hasher->add(txSetHash);
+    hasher->add(txFullHash);
+    auto h = hasher->finish();
+    uint64_t res = 0;
+    for (size_t i = 0; i < sizeof(res); i++)
+    {
+        res = (res << 8) | h[i];
+    }
+    return res;
+}
+
+std::vector<TransactionFramePtr>
+getCompactOrder(TxSetFrame const& txSet)
+{
+    auto res = txSet.mTransactions;
+    std::sort(res.begin(), res.end(),
+              [](TransactionFramePtr const& a, TransactionFramePtr const& b) {
+                  return a->getFullHash() < b->getFullHash();
+              });
+    return res;
+}
+
+void
+toCompactXDR(TxSetFrame const& txSet, CompactTxSet& compact)
+{
+    compact.txSetHash = txSet.getContentsHash();
+    compact.previousLedgerHash = txSet.previousLedgerHash();
+    compact.shortTxIDs.clear();
+    for (auto const& tx : getCompactOrder(txSet))
+    {
+        compact.shortTxIDs.emplace_back(
+            shortTxID(compact.txSetHash, tx->getFullHash()));
+    }
+}
+
+TxSetReconstruction::TxSetReconstruction(
+    CompactTxSet const& compact, std::vector<TransactionFramePtr> const& known)
+    : mHash(compact.txSetHash)
+    , mPreviousLedgerHash(compact.previousLedgerHash)
+    , mShortIDs(compact.shortTxIDs.begin(), compact.shortTxIDs.end())
+    , mTransactions(compact.shortTxIDs.size())
+{
+    // ids shared by several known transactions are left to the peer
+    std::unordered_map<uint64_t, TransactionFramePtr> byID;
+    for (auto const& tx : known)
+    {
+        auto it = byID.emplace(shortTxID(mHash, tx->getFullHash()), tx);
+        if (!it.second && it.first->second &&
+            it.first->second->getFullHash() != tx->getFullHash())
+        {
+            it.first->second.reset();
+        }
+    }
+    for (size_t i = 0; i < mShortIDs.size(); i++)
+    {
+        auto it = byID.find(mShortIDs[i]);
+        if (it != byID.end())
+        {
+            mTransactions[i] = it->second;
+        }
+    }
+}
+
+std::vector<uint32_t>
+TxSetReconstruction::getMissing() const
+{
+    std::vector<uint32_t> res;
+    for (size_t i = 0; i < mTransactions.size(); i++)
+    {
+        if (!mTransactions[i])
+        {
+            res.emplace_back(static_cast<uint32_t>(i));
+        }
+    }
+    return res;
+}
+
+bool
+TxSetReconstruction::addMissing(std::vector<TransactionFramePtr> const& txs)
+{
+    auto missing = getMissing();
+    if (missing.size() != txs.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+        mTransactions[missing[i]] = txs[i];
+    }
+    return true;
+}
+
+TxSetFramePtr
+TxSetReconstruction::getTxSet() const
+{
+    auto res = std::make_shared<TxSetFrame>(mPreviousLedgerHash);
+    for (auto const& tx : mTransactions)
+    {
+        if (!tx)
+        {
+            return nullptr;
+        }
+        res->add(tx);
+    }
+    res->sortForHash();
+    if (res->getContentsHash() != mHash)
+    {
+        return nullptr;
+    }
+    return res;
+}
+
+bool
+TxSetReconstruction::retry()
+{
+    if (mRetried)
+    {
+        return false;
+    }
+    mRetried = true;
+    std::fill(mTransactions.begin(), mTransactions.end(), nullptr);
+    return true;
+}
+}
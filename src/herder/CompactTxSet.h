@@ -0,0 +1,71 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/TxSetFrame.h"
+#include "overlay/StellarXDR.h"
+
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Compact transaction sets (COMPACT_TX_SET): most of the transactions of a
+ * set being fetched were flooded to the node already, so a peer that
+ * supports it answers GET_TX_SET with the short ids of the transactions only.
+ * The node rebuilds the set from its pending transactions and asks for the
+ * ones it does not know (GET_TX_SET_TXS, answered with TX_SET_TXS).
+ */
+
+// The short id of a transaction in the compact form of the set hashing to
+// @p txSetHash: the first 8 bytes of the SHA256 of both hashes. Ids depend on
+// the set so that transactions cannot be crafted ahead of time to collide.
+uint64_t shortTxID(Hash const& txSetHash, Hash const& txFullHash);
+
+// The transactions of @p txSet in the order of its compact form, by full
+// hash.
+std::vector<TransactionFramePtr> getCompactOrder(TxSetFrame const& txSet);
+
+void toCompactXDR(TxSetFrame const& txSet, CompactTxSet& compact);
+
+// A transaction set being rebuilt from its compact form.
+class TxSetReconstruction
+{
+    Hash mHash;
+    Hash mPreviousLedgerHash;
+    std::vector<uint64_t> mShortIDs;
+    // null for the transactions still missing
+    std::vector<TransactionFramePtr> mTransactions;
+    bool mRetried{false};
+
+  public:
+    // Fills in the transactions of @p compact that are in @p known.
+    TxSetReconstruction(CompactTxSet const& compact,
+                        std::vector<TransactionFramePtr> const& known);
+
+    Hash const&
+    getHash() const
+    {
+        return mHash;
+    }
+
+    // indexes of the transactions missing
+    std::vector<uint32_t> getMissing() const;
+
+    // Fills in the missing transactions, in the order of getMissing().
+    // Returns false if there are not as many as missing.
+    bool addMissing(std::vector<TransactionFramePtr> const& txs);
+
+    // Returns the set once no transaction is missing, null if it does not
+    // hash to getHash() (a transaction known locally had the short id of
+    // another one).
+    TxSetFramePtr getTxSet() const;
+
+    // Forgets every transaction, to get them all from the peer instead of
+    // trusting the ones known locally. Returns false if done already.
+    bool retry();
+};
+}
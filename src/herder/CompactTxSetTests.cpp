@@ -0,0 +1,82 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/CompactTxSet.h"
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+
+#include <algorithm>
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+TEST_CASE("compact tx set reconstruction", "[herder][compacttxset]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a = root.create("a", 5000000000);
+
+    TxSetFrame txSet(app->getLedgerManager().getLastClosedLedgerHeader().hash);
+    std::vector<TransactionFramePtr> known;
+    for (int i = 0; i < 5; i++)
+    {
+        auto tx = a.tx({payment(root, 1)});
+        txSet.add(tx);
+        if (i % 2 == 0)
+        {
+            known.emplace_back(tx);
+        }
+    }
+    // known transactions that are not in the set do not matter
+    known.emplace_back(root.tx({payment(a, 1)}));
+
+    CompactTxSet compact;
+    toCompactXDR(txSet, compact);
+    REQUIRE(compact.txSetHash == txSet.getContentsHash());
+    REQUIRE(compact.shortTxIDs.size() == 5);
+
+    auto ordered = getCompactOrder(txSet);
+    TxSetReconstruction reconstruction(compact, known);
+    auto missing = reconstruction.getMissing();
+    REQUIRE(missing.size() == 2);
+    std::vector<TransactionFramePtr> missingTxs;
+    for (auto i : missing)
+    {
+        REQUIRE(std::find(known.begin(), known.end(), ordered[i]) ==
+                known.end());
+        missingTxs.emplace_back(ordered[i]);
+    }
+    REQUIRE(!reconstruction.getTxSet());
+
+    SECTION("missing transactions fill it in")
+    {
+        REQUIRE(!reconstruction.addMissing({missingTxs[0]}));
+        REQUIRE(reconstruction.addMissing(missingTxs));
+        REQUIRE(reconstruction.getMissing().empty());
+        auto rebuilt = reconstruction.getTxSet();
+        REQUIRE(rebuilt);
+        REQUIRE(rebuilt->getContentsHash() == txSet.getContentsHash());
+    }
+
+    SECTION("a wrong transaction is retried from scratch once")
+    {
+        auto other = root.tx({payment(a, 2)});
+        REQUIRE(reconstruction.addMissing({missingTxs[0], other}));
+        REQUIRE(!reconstruction.getTxSet());
+
+        REQUIRE(reconstruction.retry());
+        REQUIRE(reconstruction.getMissing().size() == 5);
+        REQUIRE(reconstruction.addMissing(ordered));
+        REQUIRE(reconstruction.getTxSet());
+        REQUIRE(!reconstruction.retry());
+    }
+}
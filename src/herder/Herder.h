@@ -10,10 +10,13 @@
 #include "overlay/Peer.h"
 #include "overlay/StellarXDR.h"
 #include "scp/SCP.h"
+#include "util/HashOfHash.h"
+#include "util/MemoryUsage.h"
 #include "util/Timer.h"
 #include <functional>
 #include <memory>
 #include <string>
+#include <unordered_set>
 
 namespace stellar
 {
@@ -96,6 +99,9 @@ class Herder
     // the current reality as best as possible.
     virtual void syncMetrics() = 0;
 
+    // adds the memory held by the herder and SCP to @p report
+    virtual void addMemoryUsage(MemoryUsageReport& report) const = 0;
+
     virtual void bootstrap() = 0;
 
     // restores Herder's state from disk
@@ -106,21 +112,49 @@ class Herder
     virtual bool recvTxSet(Hash const& hash, TxSetFrame const& txset) = 0;
     // We are learning about a new transaction.
     virtual TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) = 0;
+    // Same as recvTransaction for each of @p txs in turn, within a single
+    // database transaction; returns their statuses, in the same order.
+    virtual std::vector<TransactionSubmitStatus>
+    recvTransactions(std::vector<TransactionFramePtr> const& txs) = 0;
+    // Same as recvTransaction, but may verify the signatures of `tx` on a
+    // worker thread first. `onResult` is always called on the main thread,
+    // and transactions are handed to recvTransaction in the order they were
+    // received.
+    virtual void recvTransactionAsync(
+        TransactionFramePtr tx,
+        std::function<void(TransactionSubmitStatus)> onResult) = 0;
     virtual void peerDoesntHave(stellar::MessageType type,
                                 uint256 const& itemID, Peer::pointer peer) = 0;
-    virtual TxSetFramePtr getTxSet(Hash const& hash) = 0;
+    virtual TxSetFrameConstPtr getTxSet(Hash const& hash) = 0;
+    // Return true if the tx set identified by @p hash is being fetched.
+    virtual bool isTxSetWanted(Hash const& hash) const = 0;
+    // the transactions received and not applied yet, that compact tx sets
+    // are rebuilt from
+    virtual std::vector<TransactionFramePtr> getPendingTransactions() const = 0;
     virtual SCPQuorumSetPtr getQSet(Hash const& qSetHash) = 0;
 
     // We are learning about a new envelope.
     virtual EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope) = 0;
+    // Same as recvSCPEnvelope, but may verify the signature of `envelope` on
+    // a worker thread first. Envelopes are handed to recvSCPEnvelope in the
+    // order they were received.
+    virtual void recvSCPEnvelopeAsync(SCPEnvelope const& envelope) = 0;
 
     // We are learning about a new fully-fetched envelope.
     virtual EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope,
                                            const SCPQuorumSet& qset,
                                            TxSetFrame txset) = 0;
 
-    // a peer needs our SCP state
-    virtual void sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer) = 0;
+    // a peer needs our SCP state from ledgerSeq (0 for the oldest slot we
+    // have), except the envelopes with the hashes in `known` it already has
+    virtual void
+    sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer,
+                       std::unordered_set<Hash> const& known) = 0;
+
+    // the hashes of the envelopes of our SCP state from ledgerSeq, at most
+    // `limit` of them (the latest slots first), for a peer to skip them
+    virtual std::vector<Hash> getSCPStateHashes(uint32 ledgerSeq,
+                                                size_t limit) = 0;
 
     // returns the latest known ledger seq using consensus information
     // and local state
@@ -132,6 +166,10 @@ class Herder
 
     virtual void triggerNextLedger(uint32_t ledgerSeqToTrigger) = 0;
 
+    // validity of the transactions of transaction sets built on the last
+    // closed ledger, see TxSetFrame::checkValid
+    virtual TxValidityMemo& getTxValidityMemo() = 0;
+
     // lookup a nodeID in config and in SCP messages
     virtual bool resolveNodeID(std::string const& s, PublicKey& retKey) = 0;
 
@@ -140,6 +178,10 @@ class Herder
     // gets the upgrades that are scheduled by this node
     virtual std::string getUpgradesJson() = 0;
 
+    // Stops what the herder runs in the background (a quorum intersection
+    // check), as the worker threads are about to be joined.
+    virtual void shutdown() = 0;
+
     virtual ~Herder()
     {
     }
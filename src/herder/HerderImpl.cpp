@@ -6,6 +6,7 @@
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
+#include "crypto/XDRHasher.h"
 #include "herder/HerderPersistence.h"
 #include "herder/HerderUtils.h"
 #include "herder/LedgerCloseData.h"
@@ -19,8 +20,11 @@
 #include "scp/LocalNode.h"
 #include "scp/Slot.h"
 #include "util/Logging.h"
+#include "util/SamplingProfiler.h"
 #include "util/StatusManager.h"
 #include "util/Timer.h"
+#include "util/Tracing.h"
+#include "util/XDROperators.h"
 
 #include "medida/counter.h"
 #include "medida/meter.h"
@@ -29,7 +33,9 @@
 #include "util/XDRStream.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
 #include <ctime>
+#include <thread>
 #include <lib/util/format.h>
 
 using namespace std;
@@ -43,6 +49,10 @@ Herder::create(Application& app)
     return std::make_unique<HerderImpl>(app);
 }
 
+// bounds of the interval between two rebroadcasts of our latest messages
+static std::chrono::seconds const REBROADCAST_MIN_INTERVAL(2);
+static std::chrono::seconds const REBROADCAST_MAX_INTERVAL(32);
+
 HerderImpl::SCPMetrics::SCPMetrics(Application& app)
     : mLostSync(app.getMetrics().NewMeter({"scp", "sync", "lost"}, "sync"))
     , mBallotExpire(
@@ -51,11 +61,20 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewMeter({"scp", "envelope", "emit"}, "envelope"))
     , mEnvelopeReceive(
           app.getMetrics().NewMeter({"scp", "envelope", "receive"}, "envelope"))
+    , mEnvelopeVerifyAhead(app.getMetrics().NewMeter(
+          {"scp", "envelope", "verify-ahead"}, "envelope"))
+    , mStateSkipped(
+          app.getMetrics().NewMeter({"scp", "state", "skipped"}, "envelope"))
+    , mEnvelopeResend(
+          app.getMetrics().NewMeter({"scp", "envelope", "resend"}, "envelope"))
 
     , mKnownSlotsSize(
           app.getMetrics().NewCounter({"scp", "memory", "known-slots"}))
     , mCumulativeStatements(app.getMetrics().NewCounter(
           {"scp", "memory", "cumulative-statements"}))
+    , mSlotsBytes(app.getMetrics().NewCounter({"scp", "memory", "slots-bytes"}))
+    , mLargestSlotBytes(app.getMetrics().NewCounter(
+          {"scp", "memory", "largest-slot-bytes"}))
 
     , mHerderPendingTxs0(
           app.getMetrics().NewCounter({"herder", "pending-txs", "age0"}))
@@ -69,13 +88,13 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
 }
 
 HerderImpl::HerderImpl(Application& app)
-    : mPendingTransactions(4)
-    , mPendingEnvelopes(app, *this)
+    : mPendingEnvelopes(app, *this)
     , mHerderSCPDriver(app, *this, mUpgrades, mPendingEnvelopes)
     , mLastSlotSaved(0)
     , mTrackingTimer(app)
     , mTriggerTimer(app)
     , mRebroadcastTimer(app)
+    , mRebroadcastInterval(REBROADCAST_MIN_INTERVAL)
     , mApp(app)
     , mLedgerManager(app.getLedgerManager())
     , mSCPMetrics(app)
@@ -87,6 +106,13 @@ HerderImpl::HerderImpl(Application& app)
 
 HerderImpl::~HerderImpl()
 {
+    shutdown();
+}
+
+void
+HerderImpl::shutdown()
+{
+    *mQuorumIntersectionState.mInterrupt = true;
 }
 
 Herder::State
@@ -107,6 +133,14 @@ HerderImpl::syncMetrics()
     mHerderSCPDriver.syncMetrics();
 }
 
+void
+HerderImpl::addMemoryUsage(MemoryUsageReport& report) const
+{
+    report["herder.pending-transactions"] += mTransactionQueue.getMemoryUsage();
+    mPendingEnvelopes.addMemoryUsage(report);
+    report["scp.slots"] += mHerderSCPDriver.getSCP().getMemoryUsage();
+}
+
 std::string
 HerderImpl::getStateHuman() const
 {
@@ -134,34 +168,10 @@ HerderImpl::updateSCPCounters()
     mSCPMetrics.mKnownSlotsSize.set_count(getSCP().getKnownSlotsCount());
     mSCPMetrics.mCumulativeStatements.set_count(
         getSCP().getCumulativeStatemtCount());
-}
-
-static uint64_t
-countTxs(HerderImpl::AccountTxMap const& acc)
-{
-    uint64_t sz = 0;
-    for (auto const& a : acc)
-    {
-        sz += a.second->mTransactions.size();
-    }
-    return sz;
-}
-
-static std::shared_ptr<HerderImpl::TxMap>
-findOrAdd(HerderImpl::AccountTxMap& acc, AccountID const& aid)
-{
-    std::shared_ptr<HerderImpl::TxMap> txmap = nullptr;
-    auto i = acc.find(aid);
-    if (i == acc.end())
-    {
-        txmap = std::make_shared<HerderImpl::TxMap>();
-        acc.insert(std::make_pair(aid, txmap));
-    }
-    else
-    {
-        txmap = i->second;
-    }
-    return txmap;
+    size_t largest = 0;
+    auto usage = getSCP().getMemoryUsage(&largest);
+    mSCPMetrics.mSlotsBytes.set_count(usage.mBytes);
+    mSCPMetrics.mLargestSlotBytes.set_count(largest);
 }
 
 void
@@ -178,7 +188,8 @@ HerderImpl::valueExternalized(uint64 slotIndex, StellarValue const& value)
         CLOG(DEBUG, "Herder") << "HerderSCPDriver::valueExternalized"
                               << " txSet: " << hexAbbrev(value.txSetHash);
 
-    TxSetFramePtr externalizedSet = mPendingEnvelopes.getTxSet(value.txSetHash);
+    TxSetFrameConstPtr externalizedSet =
+        mPendingEnvelopes.getTxSet(value.txSetHash);
 
     // trigger will be recreated when the ledger is closed
     // we do not want it to trigger while downloading the current set
@@ -224,13 +235,64 @@ HerderImpl::valueExternalized(uint64 slotIndex, StellarValue const& value)
     trackingHeartBeat();
 }
 
+void
+HerderImpl::missedValueExternalized(uint64 slotIndex,
+                                    StellarValue const& value)
+{
+    TxSetFrameConstPtr externalizedSet =
+        mPendingEnvelopes.getTxSet(value.txSetHash);
+    if (!externalizedSet)
+    {
+        CLOG(DEBUG, "Herder") << "Missing tx set of ledger " << slotIndex;
+        return;
+    }
+
+    CLOG(INFO, "Herder") << "Got consensus of missed ledger " << slotIndex;
+    mApp.getHerderPersistence().saveSCPHistory(
+        static_cast<uint32>(slotIndex),
+        getSCP().getExternalizingState(slotIndex));
+
+    LedgerCloseData ledgerData(static_cast<uint32>(slotIndex),
+                               externalizedSet, value);
+    mLedgerManager.valueExternalized(ledgerData);
+}
+
 void
 HerderImpl::rebroadcast()
 {
-    for (auto const& e :
-         getSCP().getLatestMessagesSend(mLedgerManager.getLedgerNum()))
+    // the floodgate only sends our messages to the peers that do not have
+    // them; they are sent again to the peers that are behind (that sent us
+    // nothing for their slot, and may have dropped them), less and less
+    // often while they do not change
+    auto envs = getSCP().getLatestMessagesSend(mLedgerManager.getLedgerNum());
+    if (envs == mLastRebroadcast)
     {
-        broadcast(e);
+        mRebroadcastInterval =
+            std::min(mRebroadcastInterval * 2, REBROADCAST_MAX_INTERVAL);
+    }
+    else
+    {
+        mRebroadcastInterval = REBROADCAST_MIN_INTERVAL;
+        mLastRebroadcast = envs;
+    }
+    if (!mApp.getConfig().MANUAL_CLOSE)
+    {
+        for (auto const& e : envs)
+        {
+            StellarMessage m;
+            m.type(SCP_MESSAGE);
+            m.envelope() = e;
+            auto slotIndex = e.statement.slotIndex;
+            mApp.getOverlayManager().rebroadcastMessage(
+                m, [this, slotIndex](Peer::pointer const& peer) {
+                    if (peer->getLatestSCPSlot() < slotIndex)
+                    {
+                        mSCPMetrics.mEnvelopeResend.Mark();
+                        return true;
+                    }
+                    return false;
+                });
+        }
     }
     startRebroadcastTimer();
 }
@@ -256,7 +318,7 @@ HerderImpl::broadcast(SCPEnvelope const& e)
 void
 HerderImpl::startRebroadcastTimer()
 {
-    mRebroadcastTimer.expires_from_now(std::chrono::seconds(2));
+    mRebroadcastTimer.expires_from_now(mRebroadcastInterval);
 
     mRebroadcastTimer.async_wait(std::bind(&HerderImpl::rebroadcast, this),
                                  &VirtualTimer::onFailureNoop);
@@ -278,63 +340,46 @@ HerderImpl::emitEnvelope(SCPEnvelope const& envelope)
     broadcast(envelope);
 
     // this resets the re-broadcast timer
+    mRebroadcastInterval = REBROADCAST_MIN_INTERVAL;
     startRebroadcastTimer();
 }
 
-void
-HerderImpl::TxMap::addTx(TransactionFramePtr tx)
+Herder::TransactionSubmitStatus
+HerderImpl::recvTransaction(TransactionFramePtr tx)
 {
-    auto const& h = tx->getFullHash();
-    if (mTransactions.find(h) != mTransactions.end())
-    {
-        return;
-    }
-    mTransactions.insert(std::make_pair(h, tx));
-    mMaxSeq = std::max(tx->getSeqNum(), mMaxSeq);
-    mTotalFees += tx->getFee();
+    soci::transaction sqltx(mApp.getDatabase().getSession());
+    mApp.getDatabase().setCurrentTransactionReadOnly();
+    return queueTransaction(tx);
 }
 
-void
-HerderImpl::TxMap::recalculate()
+std::vector<Herder::TransactionSubmitStatus>
+HerderImpl::recvTransactions(std::vector<TransactionFramePtr> const& txs)
 {
-    mMaxSeq = 0;
-    mTotalFees = 0;
-    for (auto const& pair : mTransactions)
+    soci::transaction sqltx(mApp.getDatabase().getSession());
+    mApp.getDatabase().setCurrentTransactionReadOnly();
+    std::vector<TransactionSubmitStatus> res;
+    res.reserve(txs.size());
+    for (auto const& tx : txs)
     {
-        mMaxSeq = std::max(pair.second->getSeqNum(), mMaxSeq);
-        mTotalFees += pair.second->getFee();
+        res.emplace_back(queueTransaction(tx));
     }
+    return res;
 }
 
 Herder::TransactionSubmitStatus
-HerderImpl::recvTransaction(TransactionFramePtr tx)
+HerderImpl::queueTransaction(TransactionFramePtr tx)
 {
-    soci::transaction sqltx(mApp.getDatabase().getSession());
-    mApp.getDatabase().setCurrentTransactionReadOnly();
-
     auto const& acc = tx->getSourceID();
     auto const& txID = tx->getFullHash();
 
     // determine if we have seen this tx before and if not if it has the right
     // seq num
-    int64_t totFee = tx->getFee();
-    SequenceNumber highSeq = 0;
-
-    for (auto& map : mPendingTransactions)
+    if (mTransactionQueue.contains(tx))
     {
-        auto i = map.find(acc);
-        if (i != map.end())
-        {
-            auto& txmap = i->second;
-            auto j = txmap->mTransactions.find(txID);
-            if (j != txmap->mTransactions.end())
-            {
-                return TX_STATUS_DUPLICATE;
-            }
-            totFee += txmap->mTotalFees;
-            highSeq = std::max(highSeq, txmap->mMaxSeq);
-        }
+        return TX_STATUS_DUPLICATE;
     }
+    int64_t totFee = tx->getFee() + mTransactionQueue.getTotalFees(acc);
+    SequenceNumber highSeq = mTransactionQueue.getMaxSeq(acc);
 
     if (!tx->checkValid(mApp, highSeq))
     {
@@ -351,15 +396,68 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
         CLOG(TRACE, "Herder") << "recv transaction " << hexAbbrev(txID)
                               << " for " << KeyUtils::toShortString(acc);
 
-    auto txmap = findOrAdd(mPendingTransactions[0], acc);
-    txmap->addTx(tx);
+    mTransactionQueue.add(tx);
 
     return TX_STATUS_PENDING;
 }
 
+void
+HerderImpl::recvTransactionAsync(
+    TransactionFramePtr tx,
+    std::function<void(TransactionSubmitStatus)> onResult)
+{
+    if (!mApp.getConfig().BACKGROUND_TX_SIG_VERIFICATION)
+    {
+        onResult(recvTransaction(tx));
+        return;
+    }
+
+    // computes the hashes on this thread: they are cached lazily
+    tx->getFullHash();
+    tx->getContentsHash();
+
+    auto pending = std::make_shared<PendingTxVerification>();
+    pending->mTx = tx;
+    pending->mOnResult = onResult;
+    mPendingVerifications.emplace_back(pending);
+
+    // the worker only holds a weak reference: if the herder goes away in the
+    // meantime, the queue is destroyed with it and the result is dropped
+    std::weak_ptr<PendingTxVerification> weak = pending;
+    Application& app = mApp;
+    auto& workers =
+        app.getWorkerIOService(Application::WORKER_POOL_CRYPTO_VERIFY);
+    workers.post([this, &app, tx, weak]() {
+        tx->preverifySignatures();
+        app.getClock().postToMain(
+            [this, weak]() {
+                auto p = weak.lock();
+                if (p)
+                {
+                    p->mVerified = true;
+                    processVerifiedTransactions();
+                }
+            },
+            "herder.tx.verify");
+    });
+}
+
+void
+HerderImpl::processVerifiedTransactions()
+{
+    while (!mPendingVerifications.empty() &&
+           mPendingVerifications.front()->mVerified)
+    {
+        auto p = mPendingVerifications.front();
+        mPendingVerifications.pop_front();
+        p->mOnResult(recvTransaction(p->mTx));
+    }
+}
+
 Herder::EnvelopeStatus
 HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
 {
+    TRACE_ZONE("HerderImpl::recvSCPEnvelope");
     if (mApp.getConfig().MANUAL_CLOSE)
     {
         return Herder::ENVELOPE_STATUS_DISCARDED;
@@ -416,15 +514,43 @@ HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
     auto status = mPendingEnvelopes.recvSCPEnvelope(envelope);
     if (status == Herder::ENVELOPE_STATUS_READY)
     {
+        if (mHerderSCPDriver.trackingSCP() &&
+            envelope.statement.slotIndex >
+                mHerderSCPDriver.nextConsensusLedgerIndex())
+        {
+            verifyEnvelopeAhead(envelope);
+        }
         processSCPQueue();
     }
     return status;
 }
 
+void
+HerderImpl::verifyEnvelopeAhead(SCPEnvelope const& envelope)
+{
+    // already checked before reaching PendingEnvelopes
+    if (mApp.getConfig().BACKGROUND_TX_SIG_VERIFICATION)
+    {
+        return;
+    }
+
+    mSCPMetrics.mEnvelopeVerifyAhead.Mark();
+    auto networkID = mApp.getNetworkID();
+    auto& workers =
+        mApp.getWorkerIOService(Application::WORKER_POOL_CRYPTO_VERIFY);
+    workers.post([envelope, networkID]() {
+        // the result is cached for when SCP processes the envelope
+        PubKeyUtils::verifySig(envelope.statement.nodeID, envelope.signature,
+                               xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_SCP,
+                                                  envelope.statement));
+    });
+}
+
 Herder::EnvelopeStatus
 HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope,
                             const SCPQuorumSet& qset, TxSetFrame txset)
 {
+    txset.sortForHash();
     mPendingEnvelopes.addTxSet(txset.getContentsHash(),
                                envelope.statement.slotIndex,
                                std::make_shared<TxSetFrame>(txset));
@@ -433,23 +559,111 @@ HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope,
 }
 
 void
-HerderImpl::sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer)
+HerderImpl::recvSCPEnvelopeAsync(SCPEnvelope const& envelope)
 {
-    if (getSCP().empty())
+    // envelopes PendingEnvelopes knows about already cost nothing to process
+    // (their signature, if still needed, is in the cache)
+    if (!mApp.getConfig().BACKGROUND_TX_SIG_VERIFICATION ||
+        mPendingEnvelopes.isKnown(envelope))
+    {
+        recvSCPEnvelope(envelope);
+        return;
+    }
+
+    // duplicates of an envelope being verified are dropped: it will be
+    // processed once verified
+    auto hash = xdrSha256(envelope);
+    if (!mEnvelopesBeingVerified.insert(hash))
     {
         return;
     }
 
+    auto pending = std::make_shared<PendingEnvelopeVerification>();
+    pending->mEnvelope = envelope;
+    pending->mHash = hash;
+    mPendingEnvelopeVerifications.emplace_back(pending);
+
+    // same lifetime rules as recvTransactionAsync
+    std::weak_ptr<PendingEnvelopeVerification> weak = pending;
+    Application& app = mApp;
+    auto const& networkID = mApp.getNetworkID();
+    auto& workers =
+        app.getWorkerIOService(Application::WORKER_POOL_CRYPTO_VERIFY);
+    workers.post([this, &app, weak, envelope, networkID]() {
+        bool valid = PubKeyUtils::verifySig(
+            envelope.statement.nodeID, envelope.signature,
+            xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_SCP,
+                               envelope.statement));
+        app.getClock().postToMain(
+            [this, weak, valid]() {
+                auto p = weak.lock();
+                if (p)
+                {
+                    p->mVerified = true;
+                    p->mValid = valid;
+                    processVerifiedEnvelopes();
+                }
+            },
+            "herder.scp.verify");
+    });
+}
+
+void
+HerderImpl::processVerifiedEnvelopes()
+{
+    while (!mPendingEnvelopeVerifications.empty() &&
+           mPendingEnvelopeVerifications.front()->mVerified)
+    {
+        auto p = mPendingEnvelopeVerifications.front();
+        mPendingEnvelopeVerifications.pop_front();
+        mEnvelopesBeingVerified.erase(p->mHash);
+        if (p->mValid)
+        {
+            recvSCPEnvelope(p->mEnvelope);
+        }
+        else
+        {
+            // SCP would reject it, do not fetch anything for it
+            CLOG(DEBUG, "Herder")
+                << "Dropping envelope with invalid signature from "
+                << mApp.getConfig().toShortString(
+                       p->mEnvelope.statement.nodeID);
+        }
+    }
+}
+
+bool
+HerderImpl::getSCPStateRange(uint32 ledgerSeq, uint32& minSeq,
+                             uint32& maxSeq)
+{
+    if (getSCP().empty())
+    {
+        return false;
+    }
+
     if (getSCP().getLowSlotIndex() > std::numeric_limits<uint32_t>::max() ||
         getSCP().getHighSlotIndex() >= std::numeric_limits<uint32_t>::max())
     {
-        return;
+        return false;
     }
 
-    auto minSeq =
+    minSeq =
         std::max(ledgerSeq, static_cast<uint32_t>(getSCP().getLowSlotIndex()));
-    auto maxSeq = static_cast<uint32_t>(getSCP().getHighSlotIndex());
+    maxSeq = static_cast<uint32_t>(getSCP().getHighSlotIndex());
+    return minSeq <= maxSeq;
+}
 
+void
+HerderImpl::sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer,
+                               std::unordered_set<Hash> const& known)
+{
+    uint32 minSeq, maxSeq;
+    if (!getSCPStateRange(ledgerSeq, minSeq, maxSeq))
+    {
+        return;
+    }
+
+    size_t skipped = 0;
     for (uint32_t seq = minSeq; seq <= maxSeq; seq++)
     {
         auto const& envelopes = getSCP().getCurrentState(seq);
@@ -461,6 +675,11 @@ HerderImpl::sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer)
 
             for (auto const& e : envelopes)
             {
+                if (!known.empty() && known.find(xdrSha256(e)) != known.end())
+                {
+                    skipped++;
+                    continue;
+                }
                 StellarMessage m;
                 m.type(SCP_MESSAGE);
                 m.envelope() = e;
@@ -468,6 +687,36 @@ HerderImpl::sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer)
             }
         }
     }
+    mSCPMetrics.mStateSkipped.Mark(skipped);
+}
+
+std::vector<Hash>
+HerderImpl::getSCPStateHashes(uint32 ledgerSeq, size_t limit)
+{
+    std::vector<Hash> res;
+    uint32 minSeq, maxSeq;
+    if (!getSCPStateRange(ledgerSeq, minSeq, maxSeq))
+    {
+        return res;
+    }
+
+    // the latest slots are the ones a peer is the most likely to send back
+    for (uint32_t seq = maxSeq; seq >= minSeq && res.size() < limit; seq--)
+    {
+        for (auto const& e : getSCP().getCurrentState(seq))
+        {
+            if (res.size() == limit)
+            {
+                break;
+            }
+            res.emplace_back(xdrSha256(e));
+        }
+        if (seq == 0)
+        {
+            break;
+        }
+    }
+    return res;
 }
 
 void
@@ -487,6 +736,16 @@ HerderImpl::processSCPQueue()
     }
     else
     {
+        // slots purged on externalize otherwise: drop the ones fallen out of
+        // the bracket of recvSCPEnvelope as catchup closes ledgers
+        uint32_t minLedgerSeq = getCurrentLedgerSeq();
+        if (minLedgerSeq > MAX_SLOTS_TO_REMEMBER)
+        {
+            minLedgerSeq -= MAX_SLOTS_TO_REMEMBER;
+            getSCP().purgeSlots(minLedgerSeq);
+            mPendingEnvelopes.eraseBelow(minLedgerSeq);
+        }
+
         // we don't know which ledger we're in
         // try to consume the messages from the queue
         // starting from the smallest slot
@@ -506,6 +765,7 @@ HerderImpl::processSCPQueue()
 void
 HerderImpl::processSCPQueueUpToIndex(uint64 slotIndex)
 {
+    PROFILE_PHASE("scp");
     while (true)
     {
         SCPEnvelope env;
@@ -534,6 +794,11 @@ HerderImpl::ledgerClosed()
 
     mApp.getOverlayManager().ledgerClosed(lastIndex);
 
+    if (mApp.getConfig().QUORUM_INTERSECTION_CHECKER)
+    {
+        checkQuorumIntersection();
+    }
+
     uint64_t nextIndex = mHerderSCPDriver.nextConsensusLedgerIndex();
 
     // process any statements up to this slot (this may trigger externalize)
@@ -586,44 +851,7 @@ HerderImpl::ledgerClosed()
 void
 HerderImpl::removeReceivedTxs(std::vector<TransactionFramePtr> const& dropTxs)
 {
-    for (auto& m : mPendingTransactions)
-    {
-        if (m.empty())
-        {
-            continue;
-        }
-
-        std::set<std::shared_ptr<TxMap>> toRecalculate;
-
-        for (auto const& tx : dropTxs)
-        {
-            auto const& acc = tx->getSourceID();
-            auto const& txID = tx->getFullHash();
-            auto i = m.find(acc);
-            if (i != m.end())
-            {
-                auto& txs = i->second->mTransactions;
-                auto j = txs.find(txID);
-                if (j != txs.end())
-                {
-                    txs.erase(j);
-                    if (txs.empty())
-                    {
-                        m.erase(i);
-                    }
-                    else
-                    {
-                        toRecalculate.insert(i->second);
-                    }
-                }
-            }
-        }
-
-        for (auto txm : toRecalculate)
-        {
-            txm->recalculate();
-        }
-    }
+    mTransactionQueue.remove(dropTxs);
 }
 
 bool
@@ -636,7 +864,71 @@ bool
 HerderImpl::recvTxSet(Hash const& hash, const TxSetFrame& t)
 {
     TxSetFramePtr txset(new TxSetFrame(t));
-    return mPendingEnvelopes.recvTxSet(hash, txset);
+    txset->sortForHash();
+    if (!mApp.getConfig().BACKGROUND_TX_SIG_VERIFICATION ||
+        txset->size() == 0)
+    {
+        return mPendingEnvelopes.recvTxSet(hash, txset);
+    }
+
+    if (!mPendingEnvelopes.isTxSetWanted(hash))
+    {
+        return false;
+    }
+    if (mPendingTxSetVerifications.find(hash) ==
+        mPendingTxSetVerifications.end())
+    {
+        verifyTxSetSignatures(hash, txset);
+    }
+    return true;
+}
+
+void
+HerderImpl::verifyTxSetSignatures(Hash const& hash, TxSetFrameConstPtr txSet)
+{
+    // computes the hashes on this thread: they are cached lazily
+    for (auto const& tx : txSet->mTransactions)
+    {
+        tx->getContentsHash();
+    }
+
+    // the results of the checks end up in the signature cache, so that
+    // validating the set on the main thread does not verify them again
+    size_t nbBatches = std::min<size_t>(
+        txSet->size(), std::max(1u, std::thread::hardware_concurrency()));
+    auto pending = std::make_shared<PendingTxSetVerification>();
+    pending->mTxSet = txSet;
+    pending->mRemainingBatches = nbBatches;
+    mPendingTxSetVerifications[hash] = pending;
+
+    // same lifetime rules as recvTransactionAsync
+    std::weak_ptr<PendingTxSetVerification> weak = pending;
+    Application& app = mApp;
+    auto& workers =
+        app.getWorkerIOService(Application::WORKER_POOL_CRYPTO_VERIFY);
+    for (size_t i = 0; i < nbBatches; i++)
+    {
+        workers.post(
+            [this, &app, txSet, hash, weak, i, nbBatches]() {
+                auto const& txs = txSet->mTransactions;
+                std::vector<PubKeyUtils::SigToVerify> sigs;
+                for (size_t j = i; j < txs.size(); j += nbBatches)
+                {
+                    txs[j]->getSignaturesToVerify(sigs);
+                }
+                PubKeyUtils::verifySigBatch(sigs);
+                app.getClock().postToMain(
+                    [this, hash, weak]() {
+                        auto p = weak.lock();
+                        if (p && --p->mRemainingBatches == 0)
+                        {
+                            mPendingTxSetVerifications.erase(hash);
+                            mPendingEnvelopes.recvTxSet(hash, p->mTxSet);
+                        }
+                    },
+                    "herder.txset.verify");
+            });
+    }
 }
 
 void
@@ -646,12 +938,24 @@ HerderImpl::peerDoesntHave(MessageType type, uint256 const& itemID,
     mPendingEnvelopes.peerDoesntHave(type, itemID, peer);
 }
 
-TxSetFramePtr
+TxSetFrameConstPtr
 HerderImpl::getTxSet(Hash const& hash)
 {
     return mPendingEnvelopes.getTxSet(hash);
 }
 
+bool
+HerderImpl::isTxSetWanted(Hash const& hash) const
+{
+    return mPendingEnvelopes.isTxSetWanted(hash);
+}
+
+std::vector<TransactionFramePtr>
+HerderImpl::getPendingTransactions() const
+{
+    return mTransactionQueue.getTransactions();
+}
+
 SCPQuorumSetPtr
 HerderImpl::getQSet(Hash const& qSetHash)
 {
@@ -678,20 +982,16 @@ HerderImpl::getCurrentLedgerSeq() const
     return res;
 }
 
+TxValidityMemo&
+HerderImpl::getTxValidityMemo()
+{
+    return mTxValidityMemo;
+}
+
 SequenceNumber
 HerderImpl::getMaxSeqInPendingTxs(AccountID const& acc)
 {
-    SequenceNumber highSeq = 0;
-    for (auto const& m : mPendingTransactions)
-    {
-        auto i = m.find(acc);
-        if (i == m.end())
-        {
-            continue;
-        }
-        highSeq = std::max(i->second->mMaxSeq, highSeq);
-    }
-    return highSeq;
+    return mTransactionQueue.getMaxSeq(acc);
 }
 
 // called to take a position during the next round
@@ -707,28 +1007,34 @@ HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
     }
     updateSCPCounters();
 
-    // our first choice for this round's set is all the tx we have collected
-    // during last ledger close
+    // our choice for this round's set is the best pending transactions that
+    // fit in a set, in surge pricing order; invalid ones are dropped from the
+    // queue and replaced by the next best ones until the set is valid
     auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
-    auto proposedSet = std::make_shared<TxSetFrame>(lcl.hash);
-
-    for (auto const& m : mPendingTransactions)
+    auto maxTxSetSize = mLedgerManager.getMaxTxSetSize();
+    if (mTransactionQueue.size() > maxTxSetSize)
     {
-        for (auto const& pair : m)
+        CLOG(WARNING, "Herder")
+            << "surge pricing in effect! " << mTransactionQueue.size();
+    }
+    TxSetFramePtr proposedSet;
+    for (;;)
+    {
+        proposedSet = std::make_shared<TxSetFrame>(lcl.hash);
+        for (auto const& tx : mTransactionQueue.getBest(maxTxSetSize))
         {
-            for (auto const& tx : pair.second->mTransactions)
-            {
-                proposedSet->add(tx.second);
-            }
+            proposedSet->add(tx);
+        }
+        std::vector<TransactionFramePtr> removed;
+        proposedSet->trimInvalid(mApp, removed);
+        removeReceivedTxs(removed);
+        if (removed.empty() ||
+            mTransactionQueue.size() == proposedSet->size())
+        {
+            break;
         }
     }
 
-    std::vector<TransactionFramePtr> removed;
-    proposedSet->trimInvalid(mApp, removed);
-    removeReceivedTxs(removed);
-
-    proposedSet->surgePricingFilter(mLedgerManager);
-
     if (!proposedSet->checkValid(mApp))
     {
         throw std::runtime_error("wanting to emit an invalid txSet");
@@ -862,6 +1168,7 @@ HerderImpl::getJsonInfo(size_t limit)
 
     ret["scp"] = getSCP().getJsonInfo(limit);
     ret["queue"] = mPendingEnvelopes.getJsonInfo(limit);
+    ret["timing"] = mHerderSCPDriver.getJsonTimingInfo(limit);
     return ret;
 }
 
@@ -871,6 +1178,169 @@ HerderImpl::getJsonQuorumInfo(NodeID const& id, bool summary, uint64 index)
     Json::Value ret;
     ret["node"] = mApp.getConfig().toStrKey(id);
     ret["slots"] = getSCP().getJsonQuorumInfo(id, summary, index);
+    if (mApp.getConfig().QUORUM_INTERSECTION_CHECKER &&
+        id == getSCP().getLocalNodeID())
+    {
+        ret["transitive"] = getJsonQuorumIntersectionInfo();
+    }
+    return ret;
+}
+
+QuorumIntersectionChecker::QuorumMap
+HerderImpl::getCurrentQuorumMap()
+{
+    // latest quorum set hash of every node, newer slots first
+    std::map<NodeID, Hash> hashes;
+    if (!getSCP().empty())
+    {
+        auto low = getSCP().getLowSlotIndex();
+        for (auto i = getSCP().getHighSlotIndex() + 1; i-- > low;)
+        {
+            for (auto const& e : getSCP().getCurrentState(i))
+            {
+                hashes.insert(std::make_pair(
+                    e.statement.nodeID,
+                    Slot::getCompanionQuorumSetHashFromStatement(
+                        e.statement)));
+            }
+        }
+    }
+
+    QuorumIntersectionChecker::QuorumMap res;
+    std::vector<NodeID> toVisit;
+    auto const& localID = getSCP().getLocalNodeID();
+    res[localID] =
+        std::make_shared<SCPQuorumSet>(getSCP().getLocalQuorumSet());
+    toVisit.emplace_back(localID);
+    while (!toVisit.empty())
+    {
+        auto qSet = res[toVisit.back()];
+        toVisit.pop_back();
+        LocalNode::forAllNodes(*qSet, [&](NodeID const& n) {
+            if (res.find(n) != res.end())
+            {
+                return;
+            }
+            auto h = hashes.find(n);
+            auto nQSet = h == hashes.end()
+                             ? SCPQuorumSetPtr()
+                             : mPendingEnvelopes.getQSet(h->second);
+            res[n] = nQSet;
+            if (nQSet)
+            {
+                toVisit.emplace_back(n);
+            }
+        });
+    }
+    return res;
+}
+
+void
+HerderImpl::checkQuorumIntersection()
+{
+    auto& state = mQuorumIntersectionState;
+    if (state.mChecking)
+    {
+        // picked up again on the next ledger close
+        return;
+    }
+
+    auto qmap = getCurrentQuorumMap();
+    std::map<NodeID, Hash> hashes;
+    for (auto const& q : qmap)
+    {
+        hashes[q.first] =
+            q.second ? sha256(xdr::xdr_to_opaque(*q.second)) : Hash();
+    }
+    if (state.mChecked && hashes == state.mCheckedQuorumMap)
+    {
+        return;
+    }
+    state.mCheckedQuorumMap = hashes;
+    startQuorumIntersectionCheck(std::move(qmap));
+}
+
+void
+HerderImpl::startQuorumIntersectionCheck(
+    QuorumIntersectionChecker::QuorumMap qmap)
+{
+    auto& state = mQuorumIntersectionState;
+    state.mChecking = true;
+
+    auto ledger = mLedgerManager.getLastClosedLedgerNum();
+    auto interrupt = state.mInterrupt;
+    CLOG(DEBUG, "Herder") << "Checking quorum intersection of "
+                          << qmap.size() << " nodes";
+    auto& app = mApp;
+    auto& workers = app.getWorkerIOService(Application::WORKER_POOL_MISC);
+    workers.post([this, &app, qmap, interrupt, ledger]() {
+        auto checker =
+            std::make_shared<QuorumIntersectionChecker>(qmap, interrupt.get());
+        bool ok;
+        try
+        {
+            ok = checker->networkEnjoysQuorumIntersection();
+        }
+        catch (QuorumIntersectionChecker::InterruptedError&)
+        {
+            return;
+        }
+        app.getClock().postToMain(
+            [this, checker, ok, interrupt, ledger]() {
+                if (*interrupt)
+                {
+                    return;
+                }
+                auto& state = mQuorumIntersectionState;
+                state.mChecking = false;
+                state.mChecked = true;
+                state.mLastCheckLedger = ledger;
+                state.mNodeCount = checker->getNodeCount();
+                state.mPotentialSplit = checker->getPotentialSplit();
+                if (ok)
+                {
+                    state.mLastGoodLedger = ledger;
+                }
+                else
+                {
+                    CLOG(WARNING, "Herder")
+                        << "Transitive quorum of " << state.mNodeCount
+                        << " nodes does not enjoy quorum intersection";
+                }
+                state.mEnjoysIntersection = ok;
+            },
+            "herder.quorum");
+    });
+}
+
+Json::Value
+HerderImpl::getJsonQuorumIntersectionInfo() const
+{
+    auto const& state = mQuorumIntersectionState;
+    Json::Value ret;
+    if (!state.mChecked)
+    {
+        ret["intersection"] = "pending";
+        return ret;
+    }
+    ret["intersection"] = state.mEnjoysIntersection;
+    ret["node_count"] = static_cast<Json::UInt64>(state.mNodeCount);
+    ret["last_check_ledger"] = state.mLastCheckLedger;
+    ret["last_good_ledger"] = state.mLastGoodLedger;
+    if (!state.mEnjoysIntersection)
+    {
+        auto& split = ret["potential_split"];
+        for (auto const* q :
+             {&state.mPotentialSplit.first, &state.mPotentialSplit.second})
+        {
+            Json::Value nodes(Json::arrayValue);
+            for (auto const& n : *q)
+            {
+                nodes.append(mApp.getConfig().toShortString(n));
+            }
+            split.append(nodes);
+        }
+    }
     return ret;
 }
 
@@ -886,7 +1356,7 @@ HerderImpl::persistSCPState(uint64 slot)
 
     // saves SCP messages and related data (transaction sets, quorum sets)
     xdr::xvector<SCPEnvelope> latestEnvs;
-    std::map<Hash, TxSetFramePtr> txSets;
+    std::map<Hash, TxSetFrameConstPtr> txSets;
     std::map<Hash, SCPQuorumSetPtr> quorumSets;
 
     for (auto const& e : getSCP().getLatestMessagesSend(slot))
@@ -1048,29 +1518,20 @@ void
 HerderImpl::updatePendingTransactions(
     std::vector<TransactionFramePtr> const& applied)
 {
-    // remove all these tx from mPendingTransactions
+    // remove all these tx from the queue
     removeReceivedTxs(applied);
 
-    // drop the highest level
-    mPendingTransactions.erase(--mPendingTransactions.end());
-
-    // shift entries up
-    mPendingTransactions.emplace_front();
+    // age the queue, dropping the oldest transactions
+    mTransactionQueue.shift();
 
     // rebroadcast entries, sorted in apply-order to maximize chances of
     // propagation
     {
         Hash h;
         TxSetFrame toBroadcast(h);
-        for (auto const& l : mPendingTransactions)
+        for (auto const& tx : mTransactionQueue.getTransactions())
         {
-            for (auto const& pair : l)
-            {
-                for (auto const& tx : pair.second->mTransactions)
-                {
-                    toBroadcast.add(tx.second);
-                }
-            }
+            toBroadcast.add(tx);
         }
         for (auto tx : toBroadcast.sortForApply())
         {
@@ -1079,10 +1540,10 @@ HerderImpl::updatePendingTransactions(
         }
     }
 
-    mSCPMetrics.mHerderPendingTxs0.set_count(countTxs(mPendingTransactions[0]));
-    mSCPMetrics.mHerderPendingTxs1.set_count(countTxs(mPendingTransactions[1]));
-    mSCPMetrics.mHerderPendingTxs2.set_count(countTxs(mPendingTransactions[2]));
-    mSCPMetrics.mHerderPendingTxs3.set_count(countTxs(mPendingTransactions[3]));
+    mSCPMetrics.mHerderPendingTxs0.set_count(mTransactionQueue.size(0));
+    mSCPMetrics.mHerderPendingTxs1.set_count(mTransactionQueue.size(1));
+    mSCPMetrics.mHerderPendingTxs2.set_count(mTransactionQueue.size(2));
+    mSCPMetrics.mHerderPendingTxs3.set_count(mTransactionQueue.size(3));
 }
 
 void
@@ -1096,6 +1557,16 @@ HerderImpl::herderOutOfSync()
     mSCPMetrics.mLostSync.Mark();
     mHerderSCPDriver.lostSync();
 
+    // peers remember the last MAX_SLOTS_TO_REMEMBER slots: after a short
+    // gap, what they externalized is enough to close the ledgers missed (see
+    // missedValueExternalized) before a catchup from the archives starts
+    auto seq = mLedgerManager.getLastClosedLedgerNum() + 1;
+    for (auto const& peer :
+         mApp.getOverlayManager().getAuthenticatedPeers())
+    {
+        peer.second->sendGetScpState(seq);
+    }
+
     processSCPQueue();
 }
 }
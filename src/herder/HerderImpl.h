@@ -7,12 +7,16 @@
 #include "PendingEnvelopes.h"
 #include "herder/Herder.h"
 #include "herder/HerderSCPDriver.h"
+#include "herder/QuorumIntersectionChecker.h"
+#include "herder/TransactionQueue.h"
 #include "herder/Upgrades.h"
+#include "util/FlatHashMap.h"
+#include "util/HashOfHash.h"
 #include "util/Timer.h"
 #include "util/XDROperators.h"
+#include <atomic>
 #include <deque>
 #include <memory>
-#include <unordered_map>
 #include <vector>
 
 namespace medida
@@ -41,6 +45,7 @@ class HerderImpl : public Herder
     std::string getStateHuman() const override;
 
     void syncMetrics() override;
+    void addMemoryUsage(MemoryUsageReport& report) const override;
 
     // Bootstraps the HerderImpl if we're creating a new Network
     void bootstrap() override;
@@ -55,22 +60,37 @@ class HerderImpl : public Herder
     }
 
     void valueExternalized(uint64 slotIndex, StellarValue const& value);
+    // @p slotIndex externalized while tracking a later slot, but is not
+    // closed yet: it is handed to the LedgerManager, which is catching up
+    void missedValueExternalized(uint64 slotIndex, StellarValue const& value);
     void emitEnvelope(SCPEnvelope const& envelope);
 
     TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) override;
+    std::vector<TransactionSubmitStatus>
+    recvTransactions(std::vector<TransactionFramePtr> const& txs) override;
+
+    void recvTransactionAsync(
+        TransactionFramePtr tx,
+        std::function<void(TransactionSubmitStatus)> onResult) override;
 
     EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope) override;
     EnvelopeStatus recvSCPEnvelope(SCPEnvelope const& envelope,
                                    const SCPQuorumSet& qset,
                                    TxSetFrame txset) override;
+    void recvSCPEnvelopeAsync(SCPEnvelope const& envelope) override;
 
-    void sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer) override;
+    void sendSCPStateToPeer(uint32 ledgerSeq, Peer::pointer peer,
+                            std::unordered_set<Hash> const& known) override;
+    std::vector<Hash> getSCPStateHashes(uint32 ledgerSeq,
+                                        size_t limit) override;
 
     bool recvSCPQuorumSet(Hash const& hash, const SCPQuorumSet& qset) override;
     bool recvTxSet(Hash const& hash, const TxSetFrame& txset) override;
     void peerDoesntHave(MessageType type, uint256 const& itemID,
                         Peer::pointer peer) override;
-    TxSetFramePtr getTxSet(Hash const& hash) override;
+    TxSetFrameConstPtr getTxSet(Hash const& hash) override;
+    bool isTxSetWanted(Hash const& hash) const override;
+    std::vector<TransactionFramePtr> getPendingTransactions() const override;
     SCPQuorumSetPtr getQSet(Hash const& qSetHash) override;
 
     void processSCPQueue();
@@ -81,6 +101,8 @@ class HerderImpl : public Herder
 
     void triggerNextLedger(uint32_t ledgerSeqToTrigger) override;
 
+    TxValidityMemo& getTxValidityMemo() override;
+
     void setUpgrades(Upgrades::UpgradeParameters const& upgrades) override;
     std::string getUpgradesJson() override;
 
@@ -90,17 +112,17 @@ class HerderImpl : public Herder
     Json::Value getJsonQuorumInfo(NodeID const& id, bool summary,
                                   uint64 index) override;
 
-    struct TxMap
-    {
-        SequenceNumber mMaxSeq{0};
-        int64_t mTotalFees{0};
-        std::unordered_map<Hash, TransactionFramePtr> mTransactions;
-        void addTx(TransactionFramePtr);
-        void recalculate();
-    };
-    typedef std::unordered_map<AccountID, std::shared_ptr<TxMap>> AccountTxMap;
+    void shutdown() override;
+
+    // Checks the quorum intersection of @p qmap on a worker thread, as done
+    // on ledger close for the current quorum map (see getCurrentQuorumMap).
+    void
+    startQuorumIntersectionCheck(QuorumIntersectionChecker::QuorumMap qmap);
 
   private:
+    // recvTransaction, within a database transaction
+    TransactionSubmitStatus queueTransaction(TransactionFramePtr tx);
+
     void ledgerClosed();
     void removeReceivedTxs(std::vector<TransactionFramePtr> const& txs);
 
@@ -112,11 +134,72 @@ class HerderImpl : public Herder
 
     void processSCPQueueUpToIndex(uint64 slotIndex);
 
-    // 0- tx we got during ledger close
-    // 1- one ledger ago. rebroadcast
-    // 2- two ledgers ago. rebroadcast
-    // ...
-    std::deque<AccountTxMap> mPendingTransactions;
+    // transactions received over the last TransactionQueue::MAX_AGE ledgers,
+    // the ones older than the current ledger are rebroadcast
+    TransactionQueue mTransactionQueue;
+
+    TxValidityMemo mTxValidityMemo;
+
+    // transactions whose signatures are being verified on a worker thread,
+    // in arrival order
+    struct PendingTxVerification
+    {
+        TransactionFramePtr mTx;
+        std::function<void(TransactionSubmitStatus)> mOnResult;
+        bool mVerified{false};
+    };
+    std::deque<std::shared_ptr<PendingTxVerification>> mPendingVerifications;
+    void processVerifiedTransactions();
+
+    // transaction sets whose signatures are being verified on worker
+    // threads, by hash; they are handed to PendingEnvelopes once every batch
+    // is done
+    struct PendingTxSetVerification
+    {
+        TxSetFrameConstPtr mTxSet;
+        size_t mRemainingBatches;
+    };
+    FlatHashMap<Hash, std::shared_ptr<PendingTxSetVerification>>
+        mPendingTxSetVerifications;
+    void verifyTxSetSignatures(Hash const& hash, TxSetFrameConstPtr txSet);
+
+    // SCP envelopes whose signature is being verified on a worker thread, in
+    // arrival order, and their hashes to drop duplicates
+    struct PendingEnvelopeVerification
+    {
+        SCPEnvelope mEnvelope;
+        Hash mHash;
+        bool mVerified{false};
+        bool mValid{false};
+    };
+    std::deque<std::shared_ptr<PendingEnvelopeVerification>>
+        mPendingEnvelopeVerifications;
+    FlatHashSet<Hash> mEnvelopesBeingVerified;
+    void processVerifiedEnvelopes();
+
+    // quorum intersection of the transitive quorum of the local node, checked
+    // on a worker thread whenever it changes (see QUORUM_INTERSECTION_CHECKER)
+    struct QuorumIntersectionState
+    {
+        // quorum set hash of every node of the last map sent to a check
+        std::map<NodeID, Hash> mCheckedQuorumMap;
+        bool mChecking{false};
+        bool mChecked{false};
+        bool mEnjoysIntersection{false};
+        uint32 mLastCheckLedger{0};
+        uint32 mLastGoodLedger{0};
+        size_t mNodeCount{0};
+        std::pair<std::vector<NodeID>, std::vector<NodeID>> mPotentialSplit;
+        // raised on shutdown, stops a running check
+        std::shared_ptr<std::atomic<bool>> mInterrupt{
+            std::make_shared<std::atomic<bool>>(false)};
+    };
+    QuorumIntersectionState mQuorumIntersectionState;
+    // quorum sets of the nodes transitively reachable from the local node,
+    // from the latest statements of each node (nullptr if unknown)
+    QuorumIntersectionChecker::QuorumMap getCurrentQuorumMap();
+    void checkQuorumIntersection();
+    Json::Value getJsonQuorumIntersectionInfo() const;
 
     void
     updatePendingTransactions(std::vector<TransactionFramePtr> const& applied);
@@ -139,6 +222,13 @@ class HerderImpl : public Herder
     // restores SCP state based on the last messages saved on disk
     void restoreSCPState();
 
+    // checks the signature of an envelope that waits for its slot on a
+    // worker thread, so that SCP finds the result in the cache
+    void verifyEnvelopeAhead(SCPEnvelope const& envelope);
+
+    // the slots of our SCP state from ledgerSeq, false if there are none
+    bool getSCPStateRange(uint32 ledgerSeq, uint32& minSeq, uint32& maxSeq);
+
     // saves upgrade parameters
     void persistUpgrades();
     void restoreUpgrades();
@@ -151,6 +241,10 @@ class HerderImpl : public Herder
     VirtualTimer mTriggerTimer;
 
     VirtualTimer mRebroadcastTimer;
+    // doubled by every rebroadcast of the same messages, reset when they
+    // change or we emit a new one
+    std::chrono::seconds mRebroadcastInterval;
+    std::vector<SCPEnvelope> mLastRebroadcast;
 
     Application& mApp;
     LedgerManager& mLedgerManager;
@@ -163,6 +257,13 @@ class HerderImpl : public Herder
 
         medida::Meter& mEnvelopeEmit;
         medida::Meter& mEnvelopeReceive;
+        // envelopes for a later slot than the next one, ready before the
+        // ledger closes, whose signature is checked in the background
+        medida::Meter& mEnvelopeVerifyAhead;
+        // envelopes of our state not sent to a peer that had them
+        medida::Meter& mStateSkipped;
+        // envelopes sent again by rebroadcast to peers that are behind
+        medida::Meter& mEnvelopeResend;
 
         // Counters for stuff in parent class (SCP)
         // that we monitor on a best-effort basis from
@@ -172,6 +273,9 @@ class HerderImpl : public Herder
         // Counters for things reached-through the
         // SCP maps: Slots and Nodes
         medida::Counter& mCumulativeStatements;
+        // estimated memory held by the slots, and by the largest of them
+        medida::Counter& mSlotsBytes;
+        medida::Counter& mLargestSlotBytes;
 
         // Pending tx buffer sizes
         medida::Counter& mHerderPendingTxs0;
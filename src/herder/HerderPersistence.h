@@ -29,15 +29,22 @@ class HerderPersistence
     {
     }
 
+    // Stage the SCP messages of ledger `seq`. They are written, in a few
+    // multi-row statements, once the current ledger close is over, and at
+    // the latest by the next call to saveSCPHistory or flush.
     virtual void saveSCPHistory(uint32_t seq,
                                 std::vector<SCPEnvelope> const& envs) = 0;
 
+    // Write the staged SCP messages to the database, if any. Must not be
+    // called within a transaction.
+    virtual void flush() = 0;
+
     static size_t copySCPHistoryToStream(Database& db, soci::session& sess,
                                          uint32_t ledgerSeq,
                                          uint32_t ledgerCount,
                                          XDROutputFileStream& scpHistory);
     static void dropAll(Database& db);
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
+    static bool deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
                                  uint32_t count);
 };
 }
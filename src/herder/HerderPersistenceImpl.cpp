@@ -24,7 +24,8 @@ HerderPersistence::create(Application& app)
     return std::make_unique<HerderPersistenceImpl>(app);
 }
 
-HerderPersistenceImpl::HerderPersistenceImpl(Application& app) : mApp(app)
+HerderPersistenceImpl::HerderPersistenceImpl(Application& app)
+    : mApp(app), mFlushTimer(app)
 {
 }
 
@@ -41,8 +42,43 @@ HerderPersistenceImpl::saveSCPHistory(uint32_t seq,
         return;
     }
 
-    auto usedQSets = std::unordered_map<Hash, SCPQuorumSetPtr>{};
+    // the history of the previous ledger is written before the next one is
+    // staged
+    flush();
+
+    auto ledger = std::make_unique<PendingLedger>();
+    ledger->mSeq = seq;
+    for (auto const& e : envs)
+    {
+        auto const& qHash =
+            Slot::getCompanionQuorumSetHashFromStatement(e.statement);
+        ledger->mQSets.insert(
+            std::make_pair(qHash, mApp.getHerder().getQSet(qHash)));
+
+        ledger->mNodeIDs.emplace_back(KeyUtils::toStrKey(e.statement.nodeID));
+        ledger->mEnvelopes.emplace_back(
+            decoder::encode_b64(xdr::xdr_to_opaque(e)));
+    }
+    mPending = std::move(ledger);
+
+    // written once the ledger close that follows is over
+    mFlushTimer.expires_from_now(std::chrono::seconds(0));
+    mFlushTimer.async_wait([this]() { flush(); },
+                           &VirtualTimer::onFailureNoop);
+}
+
+void
+HerderPersistenceImpl::flush()
+{
+    if (!mPending)
+    {
+        return;
+    }
+    auto ledger = std::move(mPending);
+    mFlushTimer.cancel();
+
     auto& db = mApp.getDatabase();
+    db.ensureHistoryPartitions(ledger->mSeq);
 
     soci::transaction txscope(db.getSession());
 
@@ -51,92 +87,134 @@ HerderPersistenceImpl::saveSCPHistory(uint32_t seq,
             "DELETE FROM scphistory WHERE ledgerseq =:l");
 
         auto& st = prepClean.statement();
-        st.exchange(soci::use(seq));
+        st.exchange(soci::use(ledger->mSeq));
         st.define_and_bind();
         {
             auto timer = db.getDeleteTimer("scphistory");
             st.execute(true);
         }
     }
-    for (auto const& e : envs)
-    {
-        auto const& qHash =
-            Slot::getCompanionQuorumSetHashFromStatement(e.statement);
-        usedQSets.insert(
-            std::make_pair(qHash, mApp.getHerder().getQSet(qHash)));
 
-        std::string nodeIDStrKey = KeyUtils::toStrKey(e.statement.nodeID);
+    DatabaseUtils::forEachRowBatch(
+        ledger->mEnvelopes.size(), [&](size_t begin, size_t end) {
+            auto prepEnv = db.getPreparedStatement(
+                "INSERT INTO scphistory (nodeid, ledgerseq, envelope) "
+                "VALUES " +
+                DatabaseUtils::makeValuesClause(end - begin, 3));
 
-        auto envelopeBytes(xdr::xdr_to_opaque(e));
+            auto& st = prepEnv.statement();
+            for (auto i = begin; i < end; i++)
+            {
+                st.exchange(soci::use(ledger->mNodeIDs[i]));
+                st.exchange(soci::use(ledger->mSeq));
+                st.exchange(soci::use(ledger->mEnvelopes[i]));
+            }
+            st.define_and_bind();
+            {
+                auto timer = db.getInsertTimer("scphistory");
+                st.execute(true);
+            }
+            if (st.get_affected_rows() != static_cast<long long>(end - begin))
+            {
+                throw std::runtime_error("Could not update data in SQL");
+            }
+        });
 
-        std::string envelopeEncoded;
-        envelopeEncoded = decoder::encode_b64(envelopeBytes);
+    saveQuorumSets(*ledger);
 
-        auto prepEnv =
-            db.getPreparedStatement("INSERT INTO scphistory "
-                                    "(nodeid, ledgerseq, envelope) VALUES "
-                                    "(:n, :l, :e)");
+    txscope.commit();
+}
 
-        auto& st = prepEnv.statement();
-        st.exchange(soci::use(nodeIDStrKey));
-        st.exchange(soci::use(seq));
-        st.exchange(soci::use(envelopeEncoded));
+void
+HerderPersistenceImpl::saveQuorumSets(PendingLedger const& ledger)
+{
+    auto& db = mApp.getDatabase();
+    auto const inClause =
+        DatabaseUtils::makeInClause(DatabaseUtils::BATCH_LOAD_SIZE);
+
+    std::vector<std::string> hashes;
+    for (auto const& p : ledger.mQSets)
+    {
+        hashes.emplace_back(binToHex(p.first));
+    }
+
+    // quorum sets already stored only get their last ledger updated
+    std::set<std::string> existing;
+    DatabaseUtils::forEachKeyBatch(hashes, [&](std::vector<std::string>& b) {
+        auto prep = db.getPreparedStatement(
+            "SELECT qsethash FROM scpquorums WHERE qsethash IN " + inClause);
+        auto& st = prep.statement();
+        std::string hash;
+        st.exchange(soci::into(hash));
+        for (auto& h : b)
+        {
+            st.exchange(soci::use(h));
+        }
         st.define_and_bind();
         {
-            auto timer = db.getInsertTimer("scphistory");
+            auto timer = db.getSelectTimer("scpquorums");
             st.execute(true);
         }
-        if (st.get_affected_rows() != 1)
+        while (st.got_data())
         {
-            throw std::runtime_error("Could not update data in SQL");
+            existing.insert(hash);
+            st.fetch();
         }
-    }
-
-    for (auto const& p : usedQSets)
-    {
-        std::string qSetH = binToHex(p.first);
-
-        auto prepUpQSet =
-            db.getPreparedStatement("UPDATE scpquorums SET "
-                                    "lastledgerseq = :l WHERE qsethash = :h");
-
-        auto& stUp = prepUpQSet.statement();
-        stUp.exchange(soci::use(seq));
-        stUp.exchange(soci::use(qSetH));
-        stUp.define_and_bind();
+    });
+
+    std::vector<std::string> updates(existing.begin(), existing.end());
+    uint32_t seq = ledger.mSeq;
+    DatabaseUtils::forEachKeyBatch(updates, [&](std::vector<std::string>& b) {
+        auto prep = db.getPreparedStatement(
+            "UPDATE scpquorums SET lastledgerseq = :l WHERE qsethash IN " +
+            inClause);
+        auto& st = prep.statement();
+        st.exchange(soci::use(seq));
+        for (auto& h : b)
         {
-            auto timer = db.getInsertTimer("scpquorums");
-            stUp.execute(true);
+            st.exchange(soci::use(h));
         }
-        if (stUp.get_affected_rows() != 1)
+        st.define_and_bind();
         {
-            auto qSetBytes(xdr::xdr_to_opaque(*p.second));
-
-            std::string qSetEncoded;
-            qSetEncoded = decoder::encode_b64(qSetBytes);
-
-            auto prepInsQSet = db.getPreparedStatement(
-                "INSERT INTO scpquorums "
-                "(qsethash, lastledgerseq, qset) VALUES "
-                "(:h, :l, :v);");
+            auto timer = db.getInsertTimer("scpquorums");
+            st.execute(true);
+        }
+    });
 
-            auto& stIns = prepInsQSet.statement();
-            stIns.exchange(soci::use(qSetH));
-            stIns.exchange(soci::use(seq));
-            stIns.exchange(soci::use(qSetEncoded));
-            stIns.define_and_bind();
+    std::vector<std::string> insertHashes, insertQSets;
+    for (auto const& p : ledger.mQSets)
+    {
+        auto hash = binToHex(p.first);
+        if (existing.find(hash) == existing.end())
+        {
+            insertHashes.emplace_back(hash);
+            insertQSets.emplace_back(
+                decoder::encode_b64(xdr::xdr_to_opaque(*p.second)));
+        }
+    }
+    DatabaseUtils::forEachRowBatch(
+        insertHashes.size(), [&](size_t begin, size_t end) {
+            auto prep = db.getPreparedStatement(
+                "INSERT INTO scpquorums (qsethash, lastledgerseq, qset) "
+                "VALUES " +
+                DatabaseUtils::makeValuesClause(end - begin, 3));
+            auto& st = prep.statement();
+            for (auto i = begin; i < end; i++)
+            {
+                st.exchange(soci::use(insertHashes[i]));
+                st.exchange(soci::use(seq));
+                st.exchange(soci::use(insertQSets[i]));
+            }
+            st.define_and_bind();
             {
                 auto timer = db.getInsertTimer("scpquorums");
-                stIns.execute(true);
+                st.execute(true);
             }
-            if (stIns.get_affected_rows() != 1)
+            if (st.get_affected_rows() != static_cast<long long>(end - begin))
             {
                 throw std::runtime_error("Could not update data in SQL");
             }
-        }
-    }
-
-    txscope.commit();
+        });
 }
 
 size_t
@@ -266,13 +344,14 @@ HerderPersistence::dropAll(Database& db)
                        ")";
 }
 
-void
-HerderPersistence::deleteOldEntries(Database& db, uint32_t ledgerSeq,
+bool
+HerderPersistence::deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
                                     uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "scphistory", "ledgerseq");
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "scpquorums", "lastledgerseq");
+    bool done = DatabaseUtils::deleteOldEntriesHelper(
+        sess, ledgerSeq, count, "scphistory", "ledgerseq");
+    done &= DatabaseUtils::deleteOldEntriesHelper(
+        sess, ledgerSeq, count, "scpquorums", "lastledgerseq");
+    return done;
 }
 }
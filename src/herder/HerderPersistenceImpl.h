@@ -5,10 +5,18 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "herder/HerderPersistence.h"
+#include "overlay/StellarXDR.h"
+#include "util/HashOfHash.h"
+#include "util/Timer.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
 
 namespace stellar
 {
 class Application;
+typedef std::shared_ptr<SCPQuorumSet> SCPQuorumSetPtr;
 
 class HerderPersistenceImpl : public HerderPersistence
 {
@@ -19,8 +27,22 @@ class HerderPersistenceImpl : public HerderPersistence
 
     void saveSCPHistory(uint32_t seq,
                         std::vector<SCPEnvelope> const& envs) override;
+    void flush() override;
 
   private:
+    // the SCP history of a ledger, encoded for the database
+    struct PendingLedger
+    {
+        uint32_t mSeq;
+        std::vector<std::string> mNodeIDs;
+        std::vector<std::string> mEnvelopes;
+        std::unordered_map<Hash, SCPQuorumSetPtr> mQSets;
+    };
+
     Application& mApp;
+    std::unique_ptr<PendingLedger> mPending;
+    VirtualTimer mFlushTimer;
+
+    void saveQuorumSets(PendingLedger const& ledger);
 };
 }
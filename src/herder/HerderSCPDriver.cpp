@@ -10,6 +10,7 @@
 #include "herder/LedgerCloseData.h"
 #include "herder/PendingEnvelopes.h"
 #include "ledger/LedgerManager.h"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "scp/SCP.h"
 #include "util/Logging.h"
@@ -32,6 +33,8 @@ HerderSCPDriver::SCPMetrics::SCPMetrics(Application& app)
     , mValueValid(app.getMetrics().NewMeter({"scp", "value", "valid"}, "value"))
     , mValueInvalid(
           app.getMetrics().NewMeter({"scp", "value", "invalid"}, "value"))
+    , mTxSetCheck(
+          app.getMetrics().NewMeter({"scp", "value", "txset-check"}, "value"))
     , mValueExternalize(
           app.getMetrics().NewMeter({"scp", "value", "externalize"}, "value"))
     , mQuorumHeard(
@@ -57,9 +60,18 @@ HerderSCPDriver::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewTimer({"scp", "timing", "nominated"}))
     , mPrepareToExternalize(
           app.getMetrics().NewTimer({"scp", "timing", "externalized"}))
+    , mPrepareToConfirmPrepared(
+          app.getMetrics().NewTimer({"scp", "timing", "confirmed-prepared"}))
+    , mConfirmPreparedToAcceptCommit(
+          app.getMetrics().NewTimer({"scp", "timing", "accepted-commit"}))
+    , mAcceptCommitToExternalize(app.getMetrics().NewTimer(
+          {"scp", "timing", "commit-externalized"}))
 {
 }
 
+size_t const HerderSCPDriver::KEPT_SLOT_TIMINGS = 100;
+size_t const HerderSCPDriver::MAX_VALIDATION_CACHE_ENTRIES = 1000;
+
 HerderSCPDriver::HerderSCPDriver(Application& app, HerderImpl& herder,
                                  Upgrades const& upgrades,
                                  PendingEnvelopes& pendingEnvelopes)
@@ -179,9 +191,100 @@ HerderSCPDriver::isSlotCompatibleWithCurrentState(uint64_t slotIndex) const
     return res;
 }
 
+bool
+HerderSCPDriver::decodeValue(uint64_t slotIndex, Value const& value,
+                             StellarValue& b)
+{
+    auto& values = mSlotValidation[slotIndex].mValues;
+    auto it = values.find(value);
+    if (it == values.end())
+    {
+        optional<StellarValue> decoded;
+        try
+        {
+            decoded = make_optional<StellarValue>();
+            xdr::xdr_from_opaque(value, *decoded);
+        }
+        catch (...)
+        {
+            decoded.reset();
+        }
+        if (values.size() >= MAX_VALIDATION_CACHE_ENTRIES)
+        {
+            if (decoded)
+            {
+                b = *decoded;
+            }
+            return !!decoded;
+        }
+        it = values.emplace(value, decoded).first;
+    }
+    if (!it->second)
+    {
+        return false;
+    }
+    b = *it->second;
+    return true;
+}
+
+bool
+HerderSCPDriver::checkTxSetValid(uint64_t slotIndex, TxSetFrame const& txSet)
+{
+    auto& slot = mSlotValidation[slotIndex];
+    auto const& lclHash = mLedgerManager.getLastClosedLedgerHeader().hash;
+    if (slot.mLCLHash != lclHash)
+    {
+        slot.mTxSetValid.clear();
+        slot.mLCLHash = lclHash;
+    }
+    auto const& hash = txSet.getContentsHash();
+    auto it = slot.mTxSetValid.find(hash);
+    if (it != slot.mTxSetValid.end())
+    {
+        return it->second;
+    }
+    mSCPMetrics.mTxSetCheck.Mark();
+    bool res = txSet.checkValid(mApp);
+    if (slot.mTxSetValid.size() < MAX_VALIDATION_CACHE_ENTRIES)
+    {
+        slot.mTxSetValid.emplace(hash, res);
+    }
+    return res;
+}
+
+bool
+HerderSCPDriver::isTxSetKnownValid(uint64_t slotIndex,
+                                   Hash const& txSetHash) const
+{
+    auto slot = mSlotValidation.find(slotIndex);
+    if (slot == mSlotValidation.end() ||
+        slot->second.mLCLHash !=
+            mLedgerManager.getLastClosedLedgerHeader().hash)
+    {
+        return false;
+    }
+    auto it = slot->second.mTxSetValid.find(txSetHash);
+    return it != slot->second.mTxSetValid.end() && it->second;
+}
+
+size_t
+HerderSCPDriver::getCachedValuesCount(uint64_t slotIndex) const
+{
+    auto slot = mSlotValidation.find(slotIndex);
+    return slot == mSlotValidation.end() ? 0 : slot->second.mValues.size();
+}
+
+size_t
+HerderSCPDriver::getCachedTxSetsCount(uint64_t slotIndex) const
+{
+    auto slot = mSlotValidation.find(slotIndex);
+    return slot == mSlotValidation.end() ? 0
+                                         : slot->second.mTxSetValid.size();
+}
+
 SCPDriver::ValidationLevel
 HerderSCPDriver::validateValueHelper(uint64_t slotIndex,
-                                     StellarValue const& b) const
+                                     StellarValue const& b)
 {
     uint64_t lastCloseTime;
 
@@ -245,7 +348,7 @@ HerderSCPDriver::validateValueHelper(uint64_t slotIndex,
 
     // we are fully synced up
 
-    TxSetFramePtr txSet = mPendingEnvelopes.getTxSet(txSetHash);
+    TxSetFrameConstPtr txSet = mPendingEnvelopes.getTxSet(txSetHash);
 
     SCPDriver::ValidationLevel res;
 
@@ -256,7 +359,7 @@ HerderSCPDriver::validateValueHelper(uint64_t slotIndex,
 
         res = SCPDriver::kInvalidValue;
     }
-    else if (!txSet->checkValid(mApp))
+    else if (!checkTxSetValid(slotIndex, *txSet))
     {
         if (Logging::logDebug("Herder"))
             CLOG(DEBUG, "Herder") << "HerderSCPDriver::validateValue"
@@ -281,11 +384,7 @@ HerderSCPDriver::validateValue(uint64_t slotIndex, Value const& value,
                                bool nomination)
 {
     StellarValue b;
-    try
-    {
-        xdr::xdr_from_opaque(value, b);
-    }
-    catch (...)
+    if (!decodeValue(slotIndex, value, b))
     {
         mSCPMetrics.mValueInvalid.Mark();
         return SCPDriver::kInvalidValue;
@@ -337,11 +436,7 @@ Value
 HerderSCPDriver::extractValidValue(uint64_t slotIndex, Value const& value)
 {
     StellarValue b;
-    try
-    {
-        xdr::xdr_from_opaque(value, b);
-    }
-    catch (...)
+    if (!decodeValue(slotIndex, value, b))
     {
         return Value();
     }
@@ -456,7 +551,11 @@ HerderSCPDriver::combineCandidates(uint64_t slotIndex,
         candidateValues.emplace_back();
         StellarValue& sv = candidateValues.back();
 
-        xdr::xdr_from_opaque(c, sv);
+        if (!decodeValue(slotIndex, c, sv))
+        {
+            // candidates were validated
+            throw std::runtime_error("malformed candidate value");
+        }
         candidatesHash ^= sha256(c);
 
         // max closeTime
@@ -513,10 +612,11 @@ HerderSCPDriver::combineCandidates(uint64_t slotIndex,
     TxSetFramePtr bestTxSet;
     {
         Hash highest;
-        TxSetFramePtr highestTxSet;
+        TxSetFrameConstPtr highestTxSet;
         for (auto const& sv : candidateValues)
         {
-            TxSetFramePtr cTxSet = mPendingEnvelopes.getTxSet(sv.txSetHash);
+            TxSetFrameConstPtr cTxSet =
+                mPendingEnvelopes.getTxSet(sv.txSetHash);
 
             if (cTxSet && cTxSet->previousLedgerHash() == lcl.hash)
             {
@@ -545,8 +645,11 @@ HerderSCPDriver::combineCandidates(uint64_t slotIndex,
 
     std::vector<TransactionFramePtr> removed;
 
-    // just to be sure
-    bestTxSet->trimInvalid(mApp, removed);
+    // just to be sure, unless validating the candidates just checked it
+    if (!isTxSetKnownValid(slotIndex, bestTxSet->getContentsHash()))
+    {
+        bestTxSet->trimInvalid(mApp, removed);
+    }
     comp.txSetHash = bestTxSet->getContentsHash();
 
     if (removed.size() != 0)
@@ -574,18 +677,8 @@ HerderSCPDriver::valueExternalized(uint64_t slotIndex, Value const& value)
     {
         it = mSCPTimers.erase(it);
     }
-
-    if (slotIndex <= mApp.getHerder().getCurrentLedgerSeq())
-    {
-        // externalize may trigger on older slots:
-        //  * when the current instance starts up
-        //  * when getting back in sync (a gap potentially opened)
-        // in both cases it's safe to just ignore those as we're already
-        // tracking a more recent state
-        CLOG(DEBUG, "Herder")
-            << "Ignoring old ledger externalize " << slotIndex;
-        return;
-    }
+    mSlotValidation.erase(mSlotValidation.begin(),
+                          mSlotValidation.upper_bound(slotIndex));
 
     StellarValue b;
     try
@@ -602,6 +695,25 @@ HerderSCPDriver::valueExternalized(uint64_t slotIndex, Value const& value)
         abort();
     }
 
+    if (slotIndex <= mApp.getHerder().getCurrentLedgerSeq())
+    {
+        // externalize may trigger on older slots:
+        //  * when the current instance starts up
+        //  * when getting back in sync (a gap potentially opened)
+        // in both cases it's safe to just ignore those as we're already
+        // tracking a more recent state, unless the LedgerManager is still
+        // missing the ledger to catch up without the history archives
+        if (slotIndex > mLedgerManager.getLastClosedLedgerNum() &&
+            mLedgerManager.getState() == LedgerManager::LM_CATCHING_UP_STATE)
+        {
+            mHerder.missedValueExternalized(slotIndex, b);
+            return;
+        }
+        CLOG(DEBUG, "Herder")
+            << "Ignoring old ledger externalize " << slotIndex;
+        return;
+    }
+
     // log information from older ledger to increase the chances that
     // all messages made it
     if (slotIndex > 2)
@@ -657,7 +769,7 @@ HerderSCPDriver::logQuorumInformation(uint64_t index)
 
 void
 HerderSCPDriver::nominate(uint64_t slotIndex, StellarValue const& value,
-                          TxSetFramePtr proposedSet,
+                          TxSetFrameConstPtr proposedSet,
                           StellarValue const& previousValue)
 {
     mCurrentValue = xdr::xdr_to_opaque(value);
@@ -719,6 +831,49 @@ HerderSCPDriver::acceptedBallotPrepared(uint64_t slotIndex,
                                         SCPBallot const& ballot)
 {
     mSCPMetrics.mAcceptedBallotPrepared.Mark();
+    prepareLedgerClose(slotIndex, ballot.value);
+}
+
+void
+HerderSCPDriver::prepareLedgerClose(uint64_t slotIndex, Value const& value)
+{
+    if (!mLedgerManager.isSynced() ||
+        slotIndex != mLedgerManager.getLedgerNum())
+    {
+        return;
+    }
+
+    StellarValue b;
+    try
+    {
+        xdr::xdr_from_opaque(value, b);
+    }
+    catch (...)
+    {
+        return;
+    }
+    if (slotIndex == mLedgerClosePreparedSlot &&
+        b.txSetHash == mLedgerClosePreparedTxSet)
+    {
+        return;
+    }
+    auto txSet = mPendingEnvelopes.getTxSet(b.txSetHash);
+    if (!txSet)
+    {
+        return;
+    }
+    mLedgerClosePreparedSlot = slotIndex;
+    mLedgerClosePreparedTxSet = b.txSetHash;
+
+    // not from within SCP: the envelope that prepared the ballot is handled
+    // (and possibly forwarded) first
+    mApp.getClock().getIOService().post([this, slotIndex, txSet]() {
+        if (mLedgerManager.isSynced() &&
+            slotIndex == mLedgerManager.getLedgerNum())
+        {
+            mLedgerManager.prepareLedgerClose(*txSet);
+        }
+    });
 }
 
 void
@@ -726,12 +881,24 @@ HerderSCPDriver::confirmedBallotPrepared(uint64_t slotIndex,
                                          SCPBallot const& ballot)
 {
     mSCPMetrics.mConfirmedBallotPrepared.Mark();
+    auto& timing = mSCPExecutionTimes[slotIndex];
+    if (!timing.mConfirmPrepared)
+    {
+        timing.mConfirmPrepared =
+            make_optional<VirtualClock::time_point>(mApp.getClock().now());
+    }
 }
 
 void
 HerderSCPDriver::acceptedCommit(uint64_t slotIndex, SCPBallot const& ballot)
 {
     mSCPMetrics.mAcceptedCommit.Mark();
+    auto& timing = mSCPExecutionTimes[slotIndex];
+    if (!timing.mAcceptCommit)
+    {
+        timing.mAcceptCommit =
+            make_optional<VirtualClock::time_point>(mApp.getClock().now());
+    }
 }
 
 optional<VirtualClock::time_point>
@@ -784,6 +951,8 @@ HerderSCPDriver::recordSCPExecutionMetrics(uint64_t slotIndex)
     }
 
     auto& SCPTiming = SCPTimingIt->second;
+    SCPTiming.mExternalize =
+        make_optional<VirtualClock::time_point>(externalizeStart);
 
     auto recordTiming = [&](VirtualClock::time_point start,
                             VirtualClock::time_point end, medida::Timer& timer,
@@ -812,6 +981,30 @@ HerderSCPDriver::recordSCPExecutionMetrics(uint64_t slotIndex)
                      mSCPMetrics.mPrepareToExternalize, "Prepare");
     }
 
+    // Compute the phases of the ballot protocol
+    if (SCPTiming.mPrepareStart && SCPTiming.mConfirmPrepared)
+    {
+        recordTiming(*SCPTiming.mPrepareStart, *SCPTiming.mConfirmPrepared,
+                     mSCPMetrics.mPrepareToConfirmPrepared, "Confirm prepared");
+    }
+    if (SCPTiming.mConfirmPrepared && SCPTiming.mAcceptCommit)
+    {
+        recordTiming(*SCPTiming.mConfirmPrepared, *SCPTiming.mAcceptCommit,
+                     mSCPMetrics.mConfirmPreparedToAcceptCommit,
+                     "Accept commit");
+    }
+    if (SCPTiming.mAcceptCommit)
+    {
+        recordTiming(*SCPTiming.mAcceptCommit, externalizeStart,
+                     mSCPMetrics.mAcceptCommitToExternalize, "Commit");
+    }
+
+    mSCPTimingHistory.emplace_back(slotIndex, SCPTiming);
+    if (mSCPTimingHistory.size() > KEPT_SLOT_TIMINGS)
+    {
+        mSCPTimingHistory.pop_front();
+    }
+
     // Clean up timings map
     auto it = mSCPExecutionTimes.begin();
     while (it != mSCPExecutionTimes.end() && it->first < slotIndex)
@@ -820,6 +1013,39 @@ HerderSCPDriver::recordSCPExecutionMetrics(uint64_t slotIndex)
     }
 }
 
+Json::Value
+HerderSCPDriver::getJsonTimingInfo(size_t limit) const
+{
+    auto phase = [](Json::Value& slot, char const* name,
+                    optional<VirtualClock::time_point> const& start,
+                    optional<VirtualClock::time_point> const& end) {
+        if (start && end)
+        {
+            slot[name] =
+                std::chrono::duration<double, std::milli>(*end - *start)
+                    .count();
+        }
+    };
+
+    Json::Value res(Json::arrayValue);
+    for (auto it = mSCPTimingHistory.rbegin();
+         it != mSCPTimingHistory.rend() && res.size() < limit; ++it)
+    {
+        auto const& t = it->second;
+        Json::Value slot;
+        slot["index"] = static_cast<Json::UInt64>(it->first);
+        phase(slot, "nominate_ms", t.mNominationStart, t.mPrepareStart);
+        phase(slot, "prepare_ms", t.mPrepareStart, t.mConfirmPrepared);
+        phase(slot, "confirm_ms", t.mConfirmPrepared, t.mAcceptCommit);
+        phase(slot, "commit_ms", t.mAcceptCommit, t.mExternalize);
+        phase(slot, "total_ms",
+              t.mNominationStart ? t.mNominationStart : t.mPrepareStart,
+              t.mExternalize);
+        res.append(slot);
+    }
+    return res;
+}
+
 void
 HerderSCPDriver::clearSCPExecutionEvents()
 {
@@ -9,6 +9,9 @@
 #include "scp/SCPDriver.h"
 #include "xdr/Stellar-ledger.h"
 
+#include <deque>
+#include <map>
+
 namespace medida
 {
 class Counter;
@@ -86,6 +89,11 @@ class HerderSCPDriver : public SCPDriver
     {
         return mSCP;
     }
+    SCP const&
+    getSCP() const
+    {
+        return mSCP;
+    }
 
     void recordSCPExecutionMetrics(uint64_t slotIndex);
     void recordSCPEvent(uint64_t slotIndex, bool isNomination);
@@ -118,7 +126,8 @@ class HerderSCPDriver : public SCPDriver
     // Submit a value to consider for slotIndex
     // previousValue is the value from slotIndex-1
     void nominate(uint64_t slotIndex, StellarValue const& value,
-                  TxSetFramePtr proposedSet, StellarValue const& previousValue);
+                  TxSetFrameConstPtr proposedSet,
+                  StellarValue const& previousValue);
 
     SCPQuorumSetPtr getQSet(Hash const& qSetHash) override;
 
@@ -137,6 +146,18 @@ class HerderSCPDriver : public SCPDriver
 
     optional<VirtualClock::time_point> getPrepareStart(uint64_t slotIndex);
 
+    // the number of externalized slots whose phase timings are kept
+    static size_t const KEPT_SLOT_TIMINGS;
+
+    // phase timings of the last @p limit externalized slots, most recent
+    // first
+    Json::Value getJsonTimingInfo(size_t limit) const;
+
+    // values and transaction sets whose validation is cached for
+    // @p slotIndex
+    size_t getCachedValuesCount(uint64_t slotIndex) const;
+    size_t getCachedTxSetsCount(uint64_t slotIndex) const;
+
   private:
     Application& mApp;
     HerderImpl& mHerder;
@@ -153,6 +174,8 @@ class HerderSCPDriver : public SCPDriver
 
         medida::Meter& mValueValid;
         medida::Meter& mValueInvalid;
+        // transaction sets checked, rather than found in mSlotValidation
+        medida::Meter& mTxSetCheck;
 
         medida::Meter& mValueExternalize;
 
@@ -173,6 +196,11 @@ class HerderSCPDriver : public SCPDriver
         medida::Timer& mNominateToPrepare;
         medida::Timer& mPrepareToExternalize;
 
+        // Timers for the phases of the ballot protocol
+        medida::Timer& mPrepareToConfirmPrepared;
+        medida::Timer& mConfirmPreparedToAcceptCommit;
+        medida::Timer& mAcceptCommitToExternalize;
+
         SCPMetrics(Application& app);
     };
 
@@ -182,16 +210,30 @@ class HerderSCPDriver : public SCPDriver
     {
         optional<VirtualClock::time_point> mNominationStart;
         optional<VirtualClock::time_point> mPrepareStart;
+        // first transitions of the ballot protocol
+        optional<VirtualClock::time_point> mConfirmPrepared;
+        optional<VirtualClock::time_point> mAcceptCommit;
+        optional<VirtualClock::time_point> mExternalize;
     };
 
     // Map of time points for each slot to measure key protocol metrics:
     // * nomination to first prepare
-    // * first prepare to externalize
+    // * first prepare to externalize, and its phases
     std::map<uint64_t, SCPTiming> mSCPExecutionTimes;
 
+    // timings of the last KEPT_SLOT_TIMINGS externalized slots, oldest first
+    std::deque<std::pair<uint64_t, SCPTiming>> mSCPTimingHistory;
+
     uint32_t mLedgerSeqNominating;
     Value mCurrentValue;
 
+    // slot and transaction set the last prepareLedgerClose was for
+    uint64_t mLedgerClosePreparedSlot{0};
+    Hash mLedgerClosePreparedTxSet;
+    // once a ballot for the next ledger is prepared, its transaction set is
+    // likely the one to apply
+    void prepareLedgerClose(uint64_t slotIndex, Value const& value);
+
     // timers used by SCP
     // indexed by slotIndex, timerID
     std::map<uint64_t, std::map<int, std::unique_ptr<VirtualTimer>>> mSCPTimers;
@@ -211,8 +253,34 @@ class HerderSCPDriver : public SCPDriver
 
     void stateChanged();
 
-    SCPDriver::ValidationLevel
-    validateValueHelper(uint64_t slotIndex, StellarValue const& sv) const;
+    // What validating values taught about a slot, which SCP would otherwise
+    // relearn for every envelope carrying the same value: the values seen,
+    // decoded, and the validity of the transaction sets checked against the
+    // LCL (the expensive part). Only what does not depend on the time or on
+    // the transaction sets received is kept. Slots are dropped once
+    // externalized.
+    struct SlotValidation
+    {
+        // by value; none when malformed
+        std::map<Value, optional<StellarValue>> mValues;
+        // hash of the LCL the transaction sets were checked against
+        Hash mLCLHash;
+        std::map<Hash, bool> mTxSetValid;
+    };
+    std::map<uint64_t, SlotValidation> mSlotValidation;
+
+    // entries kept per slot in each map of SlotValidation, in case a peer
+    // sends many distinct values
+    static size_t const MAX_VALIDATION_CACHE_ENTRIES;
+
+    // false if @p value is malformed
+    bool decodeValue(uint64_t slotIndex, Value const& value, StellarValue& b);
+    bool checkTxSetValid(uint64_t slotIndex, TxSetFrame const& txSet);
+    // whether a transaction set is known to be valid against the LCL
+    bool isTxSetKnownValid(uint64_t slotIndex, Hash const& txSetHash) const;
+
+    SCPDriver::ValidationLevel validateValueHelper(uint64_t slotIndex,
+                                                   StellarValue const& sv);
 
     // returns true if the local instance is in a state compatible with
     // this slot
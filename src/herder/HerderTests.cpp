@@ -3,6 +3,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "herder/HerderImpl.h"
+#include "herder/HerderPersistence.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "scp/SCP.h"
@@ -12,15 +13,21 @@
 #include "test/TestUtils.h"
 #include "test/test.h"
 
+#include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "database/Database.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "main/CommandHandler.h"
 #include "overlay/OverlayManager.h"
 #include "test/TxTests.h"
+#include "util/Math.h"
 
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "xdrpp/marshal.h"
 
 using namespace stellar;
@@ -222,6 +229,161 @@ TEST_CASE("recvTx", "[herder]")
 {
 }
 
+TEST_CASE("recvTx with background signature verification", "[herder]")
+{
+    Config cfg(getTestConfig());
+    cfg.BACKGROUND_TX_SIG_VERIFICATION = true;
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto const minBalance = app->getLedgerManager().getMinBalance(0);
+
+    // consecutive sequence numbers: results must come back in order
+    std::vector<TransactionFramePtr> txs;
+    for (int i = 0; i < 10; i++)
+    {
+        txs.emplace_back(root.tx({createAccount(
+            getAccount(std::to_string(i).c_str()).getPublicKey(),
+            minBalance)}));
+    }
+    // bad signature
+    auto badTx = root.tx({payment(root.getPublicKey(), 1)});
+    badTx->getEnvelope().signatures[0].signature.back() ^= 1;
+    txs.emplace_back(badTx);
+
+    std::vector<Herder::TransactionSubmitStatus> results;
+    for (auto const& tx : txs)
+    {
+        app->getHerder().recvTransactionAsync(
+            tx, [&results](Herder::TransactionSubmitStatus status) {
+                results.emplace_back(status);
+            });
+    }
+    // nothing happens before the worker is done
+    REQUIRE(results.empty());
+
+    while (results.size() < txs.size())
+    {
+        clock.crank(true);
+    }
+    for (size_t i = 0; i < txs.size() - 1; i++)
+    {
+        REQUIRE(results[i] == Herder::TX_STATUS_PENDING);
+    }
+    REQUIRE(results.back() == Herder::TX_STATUS_ERROR);
+    REQUIRE(badTx->getResultCode() == txBAD_AUTH);
+}
+
+TEST_CASE("recvTxSet with background signature verification", "[herder]")
+{
+    Config cfg(getTestConfig());
+    cfg.BACKGROUND_TX_SIG_VERIFICATION = true;
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& herder = static_cast<HerderImpl&>(app->getHerder());
+    auto root = TestAccount::createRoot(*app);
+    auto const minBalance = app->getLedgerManager().getMinBalance(0);
+
+    auto txSet = std::make_shared<TxSetFrame>(
+        app->getLedgerManager().getLastClosedLedgerHeader().hash);
+    for (int i = 0; i < 20; i++)
+    {
+        txSet->add(root.tx({createAccount(
+            getAccount(std::to_string(i).c_str()).getPublicKey(),
+            minBalance)}));
+    }
+    txSet->sortForHash();
+    auto const& hash = txSet->getContentsHash();
+
+    // not asked for: dropped right away
+    REQUIRE(!herder.recvTxSet(hash, *txSet));
+
+    // herder must want the TxSet before receiving it
+    auto sv = StellarValue{hash, 100, emptyUpgradeSteps, 0};
+    auto envelope = SCPEnvelope{};
+    envelope.statement.slotIndex = herder.getCurrentLedgerSeq();
+    envelope.statement.pledges.type(SCP_ST_PREPARE);
+    envelope.statement.pledges.prepare().ballot.value =
+        xdr::xdr_to_opaque(sv);
+    envelope.signature =
+        root.getSecretKey().sign(xdr::xdr_to_opaque(envelope.statement));
+    REQUIRE(herder.recvSCPEnvelope(envelope) ==
+            Herder::ENVELOPE_STATUS_FETCHING);
+
+    REQUIRE(herder.recvTxSet(hash, *txSet));
+    // a duplicate does not start another verification
+    REQUIRE(herder.recvTxSet(hash, *txSet));
+    // nothing happens before the workers are done
+    REQUIRE(!herder.getTxSet(hash));
+
+    while (!herder.getTxSet(hash))
+    {
+        clock.crank(true);
+    }
+    REQUIRE(herder.getTxSet(hash)->checkValid(*app));
+}
+
+TEST_CASE("recvSCPEnvelope with background signature verification",
+          "[herder]")
+{
+    Config cfg(getTestConfig());
+    cfg.BACKGROUND_TX_SIG_VERIFICATION = true;
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& herder = static_cast<HerderImpl&>(app->getHerder());
+    auto& received = app->getMetrics().NewMeter(
+        {"scp", "envelope", "receive"}, "envelope");
+    auto root = TestAccount::createRoot(*app);
+
+    auto makeEnvelope = [&](uint64_t closeTime) {
+        auto sv = StellarValue{sha256(std::to_string(closeTime)), closeTime,
+                               emptyUpgradeSteps, 0};
+        auto envelope = SCPEnvelope{};
+        envelope.statement.slotIndex = herder.getCurrentLedgerSeq();
+        envelope.statement.pledges.type(SCP_ST_PREPARE);
+        envelope.statement.pledges.prepare().ballot.value =
+            xdr::xdr_to_opaque(sv);
+        envelope.signature = root.getSecretKey().sign(xdr::xdr_to_opaque(
+            app->getNetworkID(), ENVELOPE_TYPE_SCP, envelope.statement));
+        return envelope;
+    };
+
+    auto good = makeEnvelope(100);
+    auto bad = makeEnvelope(200);
+    bad.signature.back() ^= 1;
+    auto after = makeEnvelope(300);
+
+    herder.recvSCPEnvelopeAsync(good);
+    herder.recvSCPEnvelopeAsync(good);
+    herder.recvSCPEnvelopeAsync(bad);
+    herder.recvSCPEnvelopeAsync(after);
+    // nothing happens before the workers are done
+    REQUIRE(received.count() == 0);
+
+    while (received.count() < 2)
+    {
+        clock.crank(true);
+    }
+    // the duplicate was dropped, and so was the envelope with a bad signature
+    // before anything was fetched for it
+    REQUIRE(received.count() == 2);
+
+    // known envelopes are handled right away
+    herder.recvSCPEnvelopeAsync(after);
+    REQUIRE(received.count() == 3);
+    REQUIRE(herder.recvSCPEnvelope(good) ==
+            Herder::ENVELOPE_STATUS_FETCHING);
+}
+
 TEST_CASE("txset", "[herder]")
 {
     Config cfg(getTestConfig());
@@ -281,6 +443,36 @@ TEST_CASE("txset", "[herder]")
         }
     }
 
+    SECTION("contents hash and apply order")
+    {
+        auto const& hash = txSet->getContentsHash();
+        auto const& applyOrder = txSet->sortForApply();
+        REQUIRE(applyOrder.size() == nbAccounts * nbTransactions);
+
+        // neither depends on the order of the transactions in the set
+        TxSetFrame shuffled(*txSet);
+        std::reverse(shuffled.mTransactions.begin(),
+                     shuffled.mTransactions.end());
+        TxSetFrame rebuilt(shuffled.previousLedgerHash());
+        for (auto const& tx : shuffled.mTransactions)
+        {
+            rebuilt.add(tx);
+        }
+        REQUIRE(rebuilt.getContentsHash() == hash);
+        REQUIRE(rebuilt.sortForApply() == applyOrder);
+
+        // sets read from the wire are in hash order
+        TransactionSet xdrSet;
+        rebuilt.toXDR(xdrSet);
+        TxSetFrame fromWire(app->getNetworkID(), xdrSet);
+        REQUIRE(fromWire.checkValid(*app));
+        REQUIRE(fromWire.getContentsHash() == hash);
+
+        // removing a transaction changes both
+        rebuilt.removeTx(rebuilt.mTransactions.front());
+        REQUIRE(rebuilt.getContentsHash() != hash);
+        REQUIRE(rebuilt.sortForApply().size() == applyOrder.size() - 1);
+    }
     SECTION("order check")
     {
         txSet->sortForHash();
@@ -302,6 +494,50 @@ TEST_CASE("txset", "[herder]")
             txSet->trimInvalid(*app, removed);
             REQUIRE(txSet->checkValid(*app));
         }
+        SECTION("validity memo")
+        {
+            REQUIRE(txSet->checkValid(*app));
+
+            auto& memo = app->getHerder().getTxValidityMemo();
+            auto const& first = transactions[0][0];
+            TxValidityMemo::Result res;
+            REQUIRE(memo.lookup(*first, 0, res));
+            REQUIRE(res.mCode == txSUCCESS);
+            REQUIRE(!memo.lookup(*first, first->getSeqNum(), res));
+
+            // closing a ledger keeps the results of untouched accounts
+            auto lcl = app->getLedgerManager().getLastClosedLedgerHeader();
+            LedgerHeader before = lcl.header;
+            before.ledgerSeq++;
+            before.previousLedgerHash = lcl.hash;
+            LedgerHeaderHistoryEntry next;
+            next.header = before;
+            next.hash = sha256("next");
+            memo.ledgerClosed(before, next, {root.getPublicKey()});
+            REQUIRE(memo.lookup(*first, 0, res));
+
+            // but not of the ones it changed
+            before.previousLedgerHash = next.hash;
+            next.hash = sha256("after next");
+            memo.ledgerClosed(before, next, {sourceAccount.getPublicKey()});
+            REQUIRE(!memo.lookup(*first, 0, res));
+
+            // a result computed against another ledger is not used
+            memo.setLedger(Hash{});
+            REQUIRE(!memo.lookup(*first, 0, res));
+            REQUIRE(txSet->checkValid(*app));
+
+            // nor is a result recorded with another previous sequence number
+            auto const& second = transactions[0][1];
+            memo.put(*second, TxValidityMemo::Result{0, txBAD_SEQ, 0});
+            REQUIRE(txSet->checkValid(*app));
+
+            // but a matching one is
+            memo.put(*second,
+                     TxValidityMemo::Result{first->getSeqNum(), txBAD_SEQ, 0});
+            REQUIRE(!txSet->checkValid(*app));
+            REQUIRE(second->getResultCode() == txBAD_SEQ);
+        }
     }
     SECTION("invalid tx")
     {
@@ -415,8 +651,8 @@ TEST_CASE("surge", "[herder]")
         {
             txSet->add(root.tx({payment(destAccount, n + 10)}));
         }
-        random_shuffle(txSet->mTransactions.begin(),
-                       txSet->mTransactions.end());
+        rand_shuffle(txSet->mTransactions.begin(),
+                     txSet->mTransactions.end());
         txSet->sortForHash();
         txSet->surgePricingFilter(lm);
         REQUIRE(txSet->mTransactions.size() == 5);
@@ -743,6 +979,127 @@ TEST_CASE("SCP Driver", "[herder]")
     }
 }
 
+TEST_CASE("SCP Driver validation cache", "[herder]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto& herder = static_cast<HerderImpl&>(app->getHerder());
+    auto& driver = herder.getHerderSCPDriver();
+    auto& lm = app->getLedgerManager();
+    auto& txSetChecks =
+        app->getMetrics().NewMeter({"scp", "value", "txset-check"}, "value");
+    auto root = TestAccount::createRoot(*app);
+
+    auto const lcl = lm.getLastClosedLedgerHeader();
+    auto const slot = lcl.header.ledgerSeq + 1;
+
+    // a value for a transaction set the herder has received
+    auto makeValue = [&](Hash const& previousLedgerHash) {
+        auto txSet = std::make_shared<TxSetFrame>(previousLedgerHash);
+        txSet->sortForHash();
+        auto sv = StellarValue{txSet->getContentsHash(),
+                               lcl.header.scpValue.closeTime + 1,
+                               emptyUpgradeSteps, 0};
+        auto v = xdr::xdr_to_opaque(sv);
+
+        auto envelope = SCPEnvelope{};
+        envelope.statement.slotIndex = herder.getCurrentLedgerSeq();
+        envelope.statement.pledges.type(SCP_ST_PREPARE);
+        envelope.statement.pledges.prepare().ballot.value = v;
+        envelope.signature =
+            root.getSecretKey().sign(xdr::xdr_to_opaque(envelope.statement));
+        REQUIRE(herder.recvSCPEnvelope(envelope) ==
+                Herder::ENVELOPE_STATUS_FETCHING);
+        REQUIRE(herder.recvTxSet(txSet->getContentsHash(), *txSet));
+        return v;
+    };
+
+    auto v = makeValue(lcl.hash);
+
+    SECTION("checks a transaction set once per slot")
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            REQUIRE(driver.validateValue(slot, v, false) ==
+                    SCPDriver::kFullyValidatedValue);
+        }
+        REQUIRE(txSetChecks.count() == 1);
+        REQUIRE(driver.getCachedValuesCount(slot) == 1);
+        REQUIRE(driver.getCachedTxSetsCount(slot) == 1);
+
+        // malformed values are remembered too
+        auto malformed = v;
+        malformed.resize(v.size() / 2);
+        REQUIRE(driver.validateValue(slot, malformed, false) ==
+                SCPDriver::kInvalidValue);
+        REQUIRE(driver.getCachedValuesCount(slot) == 2);
+        REQUIRE(txSetChecks.count() == 1);
+    }
+
+    SECTION("a new LCL invalidates the transaction sets checked")
+    {
+        REQUIRE(driver.validateValue(slot, v, false) ==
+                SCPDriver::kFullyValidatedValue);
+        REQUIRE(txSetChecks.count() == 1);
+
+        // same sequence number, other hash: the transaction set no longer
+        // follows the LCL
+        auto other = lcl;
+        other.hash = sha256("other LCL");
+        lm.setLastClosedLedger(other);
+        REQUIRE(driver.validateValue(slot, v, false) ==
+                SCPDriver::kInvalidValue);
+        REQUIRE(txSetChecks.count() == 2);
+        REQUIRE(driver.getCachedTxSetsCount(slot) == 1);
+
+        lm.setLastClosedLedger(lcl);
+        REQUIRE(driver.validateValue(slot, v, false) ==
+                SCPDriver::kFullyValidatedValue);
+        REQUIRE(txSetChecks.count() == 3);
+    }
+
+    SECTION("slots are dropped once externalized")
+    {
+        REQUIRE(driver.validateValue(slot, v, false) ==
+                SCPDriver::kFullyValidatedValue);
+        REQUIRE(driver.getCachedValuesCount(slot) == 1);
+
+        while (lm.getLastClosedLedgerNum() < slot)
+        {
+            clock.crank(true);
+        }
+        REQUIRE(driver.getCachedValuesCount(slot) == 0);
+        REQUIRE(driver.getCachedTxSetsCount(slot) == 0);
+    }
+
+    SECTION("caches at most 1000 entries per slot")
+    {
+        size_t const maxEntries = 1000;
+        std::vector<Value> values;
+        for (size_t i = 0; i <= maxEntries; i++)
+        {
+            // transaction sets for other ledgers, all invalid
+            values.emplace_back(makeValue(sha256(std::to_string(i))));
+            REQUIRE(driver.validateValue(slot, values.back(), false) ==
+                    SCPDriver::kInvalidValue);
+        }
+        REQUIRE(driver.getCachedValuesCount(slot) == maxEntries);
+        REQUIRE(driver.getCachedTxSetsCount(slot) == maxEntries);
+        REQUIRE(txSetChecks.count() == maxEntries + 1);
+
+        // values past the limit are still validated, just not remembered
+        REQUIRE(driver.validateValue(slot, v, false) ==
+                SCPDriver::kFullyValidatedValue);
+        REQUIRE(driver.validateValue(slot, values.back(), false) ==
+                SCPDriver::kInvalidValue);
+        REQUIRE(txSetChecks.count() == maxEntries + 3);
+        REQUIRE(driver.getCachedValuesCount(slot) == maxEntries);
+        REQUIRE(driver.getCachedTxSetsCount(slot) == maxEntries);
+    }
+}
+
 TEST_CASE("SCP State", "[herder]")
 {
     SecretKey nodeKeys[3];
@@ -1015,6 +1372,122 @@ TEST_CASE("quick restart", "[herder][quickRestart]")
     simulation->stopAllNodes();
 }
 
+TEST_CASE("prepare ledger close during balloting", "[herder]")
+{
+    auto mode = Simulation::OVER_LOOPBACK;
+    auto networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    auto sim = Topologies::core(3, 1.0, mode, networkID, [](int i) {
+        return getTestConfig(i, Config::TESTDB_IN_MEMORY_SQLITE);
+    });
+    sim->startAllNodes();
+    sim->crankUntil([&]() { return sim->haveAllExternalized(4, 1); },
+                    std::chrono::seconds(20), false);
+
+    // ballots are prepared from messages of the other nodes, before
+    // externalizing: every node gets to warm its caches ahead
+    for (auto const& node : sim->getNodes())
+    {
+        auto& prepared = node->getMetrics().NewMeter(
+            {"ledger", "ledger", "close-prepared"}, "ledger");
+        REQUIRE(prepared.count() != 0);
+    }
+}
+
+TEST_CASE("SCP phase timings", "[herder]")
+{
+    auto mode = Simulation::OVER_LOOPBACK;
+    auto networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    auto sim = Topologies::core(3, 1.0, mode, networkID, [](int i) {
+        return getTestConfig(i, Config::TESTDB_IN_MEMORY_SQLITE);
+    });
+    sim->startAllNodes();
+    sim->crankUntil([&]() { return sim->haveAllExternalized(5, 1); },
+                    std::chrono::seconds(20), false);
+
+    for (auto const& node : sim->getNodes())
+    {
+        auto timing = node->getHerder().getJsonInfo(2)["timing"];
+        REQUIRE(timing.size() == 2);
+        auto const& last = timing[0];
+        REQUIRE(last["index"].asUInt64() > timing[1]["index"].asUInt64());
+        // a node may skip a phase, when messages of the others get it past
+        // it at once
+        REQUIRE(last.isMember("commit_ms"));
+        REQUIRE(last.isMember("total_ms"));
+        for (auto const& phase : {"nominate_ms", "prepare_ms", "confirm_ms",
+                                  "commit_ms"})
+        {
+            REQUIRE(last.get(phase, 0).asDouble() >= 0);
+            REQUIRE(last.get(phase, 0).asDouble() <=
+                    last["total_ms"].asDouble());
+        }
+    }
+}
+
+TEST_CASE("SCP history is written after ledger close", "[herder]")
+{
+    Config cfg(getTestConfig());
+    // no ledger gets closed on its own
+    cfg.MANUAL_CLOSE = true;
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& herder = static_cast<HerderImpl&>(app->getHerder());
+    auto& persistence = app->getHerderPersistence();
+    auto& sess = app->getDatabase().getSession();
+    auto qSetHash = herder.getSCP().getLocalNode()->getQuorumSetHash();
+
+    auto makeEnvelopes = [&](uint32_t seq, int n) {
+        std::vector<SCPEnvelope> res;
+        for (int i = 0; i < n; i++)
+        {
+            SCPEnvelope e;
+            e.statement.slotIndex = seq;
+            e.statement.nodeID = SecretKey::random().getPublicKey();
+            e.statement.pledges.type(SCP_ST_EXTERNALIZE);
+            e.statement.pledges.externalize().commitQuorumSetHash = qSetHash;
+            res.emplace_back(e);
+        }
+        return res;
+    };
+    auto countRows = [&](uint32_t seq) {
+        int n = 0;
+        sess << "SELECT COUNT(*) FROM scphistory WHERE ledgerseq = :l",
+            soci::into(n), soci::use(seq);
+        return n;
+    };
+    auto lastQSetLedger = [&]() {
+        int seq = 0;
+        std::string hash = binToHex(qSetHash);
+        sess << "SELECT lastledgerseq FROM scpquorums WHERE qsethash = :h",
+            soci::into(seq), soci::use(hash);
+        return seq;
+    };
+
+    uint32_t seq = 100;
+    persistence.saveSCPHistory(seq, makeEnvelopes(seq, 150));
+    REQUIRE(countRows(seq) == 0);
+    persistence.flush();
+    REQUIRE(countRows(seq) == 150);
+    REQUIRE(lastQSetLedger() == seq);
+
+    // saving a ledger again replaces its messages, and saving the next one
+    // writes the previous one first
+    persistence.saveSCPHistory(seq, makeEnvelopes(seq, 3));
+    persistence.saveSCPHistory(seq + 1, makeEnvelopes(seq + 1, 5));
+    REQUIRE(countRows(seq) == 3);
+    REQUIRE(countRows(seq + 1) == 0);
+
+    // the write is scheduled on its own too
+    for (int i = 0; i < 10 && countRows(seq + 1) == 0; i++)
+    {
+        clock.crank(false);
+    }
+    REQUIRE(countRows(seq + 1) == 5);
+    REQUIRE(lastQSetLedger() == seq + 1);
+}
+
 TEST_CASE("In quorum filtering", "[herder]")
 {
     auto mode = Simulation::OVER_LOOPBACK;
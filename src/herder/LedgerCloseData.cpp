@@ -13,7 +13,8 @@ using namespace std;
 namespace stellar
 {
 
-LedgerCloseData::LedgerCloseData(uint32_t ledgerSeq, TxSetFramePtr txSet,
+LedgerCloseData::LedgerCloseData(uint32_t ledgerSeq,
+                                 TxSetFrameConstPtr txSet,
                                  StellarValue const& v)
     : mLedgerSeq(ledgerSeq), mTxSet(txSet), mValue(v)
 {
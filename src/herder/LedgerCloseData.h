@@ -21,7 +21,7 @@ namespace stellar
 class LedgerCloseData
 {
   public:
-    LedgerCloseData(uint32_t ledgerSeq, TxSetFramePtr txSet,
+    LedgerCloseData(uint32_t ledgerSeq, TxSetFrameConstPtr txSet,
                     StellarValue const& v);
 
     uint32_t
@@ -29,7 +29,7 @@ class LedgerCloseData
     {
         return mLedgerSeq;
     }
-    TxSetFramePtr
+    TxSetFrameConstPtr
     getTxSet() const
     {
         return mTxSet;
@@ -42,7 +42,7 @@ class LedgerCloseData
 
   private:
     uint32_t mLedgerSeq;
-    TxSetFramePtr mTxSet;
+    TxSetFrameConstPtr mTxSet;
     StellarValue mValue;
 };
 
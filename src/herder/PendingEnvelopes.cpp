@@ -108,7 +108,7 @@ PendingEnvelopes::discardSCPEnvelopesWithQSet(Hash hash)
 
 void
 PendingEnvelopes::addTxSet(Hash hash, uint64 lastSeenSlotIndex,
-                           TxSetFramePtr txset)
+                           TxSetFrameConstPtr txset)
 {
     CLOG(TRACE, "Herder") << "Add TxSet " << hexAbbrev(hash);
 
@@ -117,7 +117,7 @@ PendingEnvelopes::addTxSet(Hash hash, uint64 lastSeenSlotIndex,
 }
 
 bool
-PendingEnvelopes::recvTxSet(Hash hash, TxSetFramePtr txset)
+PendingEnvelopes::recvTxSet(Hash hash, TxSetFrameConstPtr txset)
 {
     CLOG(TRACE, "Herder") << "Got TxSet " << hexAbbrev(hash);
 
@@ -131,6 +131,12 @@ PendingEnvelopes::recvTxSet(Hash hash, TxSetFramePtr txset)
     return true;
 }
 
+bool
+PendingEnvelopes::isTxSetWanted(Hash const& hash) const
+{
+    return mTxSetFetcher.getLastSeenSlotIndex(hash) != 0;
+}
+
 bool
 PendingEnvelopes::isNodeInQuorum(NodeID const& node)
 {
@@ -270,6 +276,25 @@ PendingEnvelopes::isDiscarded(SCPEnvelope const& envelope) const
     return discarded != discardedSet.end();
 }
 
+bool
+PendingEnvelopes::isKnown(SCPEnvelope const& envelope) const
+{
+    auto envelopes = mEnvelopes.find(envelope.statement.slotIndex);
+    if (envelopes == mEnvelopes.end())
+    {
+        return false;
+    }
+
+    auto const& slot = envelopes->second;
+    return slot.mDiscardedEnvelopes.find(envelope) !=
+               slot.mDiscardedEnvelopes.end() ||
+           slot.mFetchingEnvelopes.find(envelope) !=
+               slot.mFetchingEnvelopes.end() ||
+           std::find(slot.mProcessedEnvelopes.begin(),
+                     slot.mProcessedEnvelopes.end(),
+                     envelope) != slot.mProcessedEnvelopes.end();
+}
+
 void
 PendingEnvelopes::envelopeReady(SCPEnvelope const& envelope)
 {
@@ -430,7 +455,7 @@ PendingEnvelopes::slotClosed(uint64 slotIndex)
     }
 }
 
-TxSetFramePtr
+TxSetFrameConstPtr
 PendingEnvelopes::getTxSet(Hash const& hash)
 {
     if (mTxSetCache.exists(hash))
@@ -438,7 +463,7 @@ PendingEnvelopes::getTxSet(Hash const& hash)
         return mTxSetCache.get(hash).second;
     }
 
-    return TxSetFramePtr();
+    return TxSetFrameConstPtr();
 }
 
 SCPQuorumSetPtr
@@ -452,6 +477,57 @@ PendingEnvelopes::getQSet(Hash const& hash)
     return SCPQuorumSetPtr();
 }
 
+void
+PendingEnvelopes::addMemoryUsage(MemoryUsageReport& report) const
+{
+    auto& envelopes = report["herder.pending-envelopes"];
+    for (auto const& kv : mEnvelopes)
+    {
+        auto const& slot = kv.second;
+        envelopes.mBytes += MemoryUsage::NODE_OVERHEAD + sizeof(kv);
+        for (auto const& e : slot.mProcessedEnvelopes)
+        {
+            envelopes.add(xdrMemoryUsage(e));
+        }
+        for (auto const& e : slot.mReadyEnvelopes)
+        {
+            envelopes.add(xdrMemoryUsage(e));
+        }
+        for (auto const& e : slot.mDiscardedEnvelopes)
+        {
+            envelopes.add(MemoryUsage::NODE_OVERHEAD + xdrMemoryUsage(e));
+        }
+        for (auto const& e : slot.mFetchingEnvelopes)
+        {
+            envelopes.add(MemoryUsage::NODE_OVERHEAD + xdrMemoryUsage(e));
+        }
+    }
+
+    // an LRU entry is a node of its list and one of its map
+    size_t const perCacheEntry = 2 * MemoryUsage::NODE_OVERHEAD +
+                                 2 * sizeof(Hash) + 2 * sizeof(void*);
+    auto& caches = report["herder.fetch-caches"];
+    mQsetCache.for_each([&](Hash const&, SCPQuorumSetPtr const& qset) {
+        caches.add(perCacheEntry + (qset ? xdrMemoryUsage(*qset) : 0));
+    });
+    // the transactions of the sets may also be in the transaction queue,
+    // in which case they are counted twice
+    mTxSetCache.for_each([&](Hash const&, TxSetFramCacheItem const& item) {
+        size_t bytes = perCacheEntry + sizeof(item);
+        if (item.second)
+        {
+            bytes += sizeof(TxSetFrame);
+            for (auto const& tx : item.second->mTransactions)
+            {
+                bytes += tx->getMemoryUsage();
+            }
+        }
+        caches.add(bytes);
+    });
+    caches += mTxSetFetcher.getMemoryUsage();
+    caches += mQuorumSetFetcher.getMemoryUsage();
+}
+
 Json::Value
 PendingEnvelopes::getJsonInfo(size_t limit)
 {
@@ -4,6 +4,7 @@
 #include "lib/json/json.h"
 #include "lib/util/lrucache.hpp"
 #include "overlay/ItemFetcher.h"
+#include "util/MemoryUsage.h"
 #include <autocheck/function.hpp>
 #include <map>
 #include <medida/medida.h>
@@ -47,7 +48,7 @@ class PendingEnvelopes
     ItemFetcher mTxSetFetcher;
     ItemFetcher mQuorumSetFetcher;
 
-    using TxSetFramCacheItem = std::pair<uint64, TxSetFramePtr>;
+    using TxSetFramCacheItem = std::pair<uint64, TxSetFrameConstPtr>;
     // all the txsets we have learned about per ledger#
     cache::lru_cache<Hash, TxSetFramCacheItem> mTxSetCache;
 
@@ -97,7 +98,8 @@ class PendingEnvelopes
      * recvSCPEnvelope which in turn may cause calls to @see recvSCPEnvelope
      * in PendingEnvelopes.
      */
-    void addTxSet(Hash hash, uint64 lastSeenSlotIndex, TxSetFramePtr txset);
+    void addTxSet(Hash hash, uint64 lastSeenSlotIndex,
+                  TxSetFrameConstPtr txset);
 
     /**
      * Check if @p txset identified by @p hash was requested before from peers.
@@ -106,13 +108,20 @@ class PendingEnvelopes
      *
      * Return true if TxSet useful (was asked for).
      */
-    bool recvTxSet(Hash hash, TxSetFramePtr txset);
+    bool recvTxSet(Hash hash, TxSetFrameConstPtr txset);
+
+    // Return true if @p txset identified by @p hash was requested before
+    // from peers, @see recvTxSet.
+    bool isTxSetWanted(Hash const& hash) const;
     void discardSCPEnvelope(SCPEnvelope const& envelope);
 
     void peerDoesntHave(MessageType type, Hash const& itemID,
                         Peer::pointer peer);
 
     bool isDiscarded(SCPEnvelope const& envelope) const;
+    // Return true if @p envelope was discarded, is being fetched or was
+    // processed already.
+    bool isKnown(SCPEnvelope const& envelope) const;
     bool isFullyFetched(SCPEnvelope const& envelope);
     void startFetch(SCPEnvelope const& envelope);
     void stopFetch(SCPEnvelope const& envelope);
@@ -130,7 +139,11 @@ class PendingEnvelopes
 
     Json::Value getJsonInfo(size_t limit);
 
-    TxSetFramePtr getTxSet(Hash const& hash);
+    // the envelopes as "herder.pending-envelopes", the caches and fetchers
+    // of their tx sets and quorum sets as "herder.fetch-caches"
+    void addMemoryUsage(MemoryUsageReport& report) const;
+
+    TxSetFrameConstPtr getTxSet(Hash const& hash);
     SCPQuorumSetPtr getQSet(Hash const& hash);
 };
 }
@@ -0,0 +1,325 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/QuorumIntersectionChecker.h"
+#include "util/XDROperators.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace stellar
+{
+
+static size_t
+countNodes(QuorumIntersectionChecker::NodeSet const& nodes)
+{
+    return std::count(nodes.begin(), nodes.end(), true);
+}
+
+QuorumIntersectionChecker::QuorumIntersectionChecker(
+    QuorumMap const& qmap, std::atomic<bool> const* interrupt)
+    : mInterrupt(interrupt)
+    , mMainComponentSize(0)
+    , mMaxQuorumSize(0)
+    , mSearchSteps(0)
+{
+    std::map<NodeID, int> indices;
+    for (auto const& q : qmap)
+    {
+        if (q.second)
+        {
+            indices[q.first] = static_cast<int>(mNodes.size());
+            mNodes.emplace_back(Node{q.first, CompiledQuorumSet(*q.second),
+                                     std::vector<int>()});
+        }
+    }
+    for (auto& n : mNodes)
+    {
+        for (auto const& id : n.mQSet.getNodes())
+        {
+            auto it = indices.find(id);
+            n.mIndices.emplace_back(it == indices.end() ? -1 : it->second);
+        }
+    }
+}
+
+bool
+QuorumIntersectionChecker::isSliceSatisfied(size_t node,
+                                            NodeSet const& nodes) const
+{
+    auto const& n = mNodes[node];
+    return n.mQSet.isQuorumSlice(n.mQSet.selectIndices([&](size_t i) {
+        return n.mIndices[i] >= 0 && nodes[n.mIndices[i]];
+    }));
+}
+
+QuorumIntersectionChecker::NodeSet
+QuorumIntersectionChecker::contractToMaximalQuorum(NodeSet nodes) const
+{
+    // greatest fixpoint: removing a node never helps another one
+    bool changed;
+    do
+    {
+        changed = false;
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            if (nodes[i] && !isSliceSatisfied(i, nodes))
+            {
+                nodes[i] = false;
+                changed = true;
+            }
+        }
+    } while (changed);
+    return nodes;
+}
+
+bool
+QuorumIntersectionChecker::isAQuorum(NodeSet const& nodes) const
+{
+    bool empty = true;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i])
+        {
+            if (!isSliceSatisfied(i, nodes))
+            {
+                return false;
+            }
+            empty = false;
+        }
+    }
+    return !empty;
+}
+
+std::vector<QuorumIntersectionChecker::NodeSet>
+QuorumIntersectionChecker::getStronglyConnectedComponents() const
+{
+    // Tarjan's algorithm, over the edges n -> m for every m in the quorum
+    // set of n
+    std::vector<NodeSet> res;
+    std::vector<int> index(mNodes.size(), -1);
+    std::vector<int> lowLink(mNodes.size(), 0);
+    NodeSet onStack(mNodes.size(), false);
+    std::vector<size_t> stack;
+    int nextIndex = 0;
+
+    std::function<void(size_t)> strongConnect = [&](size_t v) {
+        index[v] = lowLink[v] = nextIndex++;
+        stack.emplace_back(v);
+        onStack[v] = true;
+        for (auto w : mNodes[v].mIndices)
+        {
+            if (w < 0)
+            {
+                continue;
+            }
+            if (index[w] < 0)
+            {
+                strongConnect(w);
+                lowLink[v] = std::min(lowLink[v], lowLink[w]);
+            }
+            else if (onStack[w])
+            {
+                lowLink[v] = std::min(lowLink[v], index[w]);
+            }
+        }
+        if (lowLink[v] == index[v])
+        {
+            NodeSet component(mNodes.size(), false);
+            size_t w;
+            do
+            {
+                w = stack.back();
+                stack.pop_back();
+                onStack[w] = false;
+                component[w] = true;
+            } while (w != v);
+            res.emplace_back(std::move(component));
+        }
+    };
+
+    for (size_t v = 0; v < mNodes.size(); v++)
+    {
+        if (index[v] < 0)
+        {
+            strongConnect(v);
+        }
+    }
+    return res;
+}
+
+void
+QuorumIntersectionChecker::setSplit(NodeSet const& a, NodeSet const& b)
+{
+    mSplit.first.clear();
+    mSplit.second.clear();
+    for (size_t i = 0; i < mNodes.size(); i++)
+    {
+        if (a[i])
+        {
+            mSplit.first.emplace_back(mNodes[i].mNodeID);
+        }
+        if (b[i])
+        {
+            mSplit.second.emplace_back(mNodes[i].mNodeID);
+        }
+    }
+}
+
+// Looks for a quorum Q with committed <= Q <= committed + remaining and at
+// most mMaxQuorumSize nodes, such that the other nodes still contain a
+// quorum.
+bool
+QuorumIntersectionChecker::search(NodeSet const& committed,
+                                  size_t committedSize,
+                                  NodeSet const& remaining)
+{
+    if (mInterrupt && mInterrupt->load())
+    {
+        throw InterruptedError();
+    }
+    mSearchSteps++;
+
+    if (committedSize > mMaxQuorumSize)
+    {
+        return false;
+    }
+
+    size_t n = mNodes.size();
+    NodeSet candidates(n, false);
+    for (size_t i = 0; i < n; i++)
+    {
+        candidates[i] = committed[i] || remaining[i];
+    }
+    auto maxQuorum = contractToMaximalQuorum(candidates);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (committed[i] && !maxQuorum[i])
+        {
+            // committed cannot be extended into a quorum
+            return false;
+        }
+    }
+
+    if (committedSize != 0 && isAQuorum(committed))
+    {
+        NodeSet complement(n, false);
+        for (size_t i = 0; i < n; i++)
+        {
+            complement[i] = !committed[i];
+        }
+        auto other = contractToMaximalQuorum(complement);
+        if (countNodes(other) != 0)
+        {
+            setSplit(committed, other);
+            return true;
+        }
+        // the complement of any extension of committed is even smaller
+        return false;
+    }
+
+    // only nodes of maxQuorum can be added, pick the one that appears the
+    // most in the quorum sets of the committed nodes (or of maxQuorum)
+    NodeSet rest(n, false);
+    for (size_t i = 0; i < n; i++)
+    {
+        rest[i] = maxQuorum[i] && !committed[i];
+    }
+    auto const& sources = committedSize != 0 ? committed : maxQuorum;
+    std::vector<size_t> refs(n, 0);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (sources[i])
+        {
+            for (auto w : mNodes[i].mIndices)
+            {
+                if (w >= 0 && rest[w])
+                {
+                    refs[w]++;
+                }
+            }
+        }
+    }
+    int next = -1;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (rest[i] && (next < 0 || refs[i] > refs[next]))
+        {
+            next = static_cast<int>(i);
+        }
+    }
+    if (next < 0)
+    {
+        return false;
+    }
+
+    rest[next] = false;
+    NodeSet withNext = committed;
+    withNext[next] = true;
+    return search(withNext, committedSize + 1, rest) ||
+           search(committed, committedSize, rest);
+}
+
+bool
+QuorumIntersectionChecker::networkEnjoysQuorumIntersection()
+{
+    mSplit.first.clear();
+    mSplit.second.clear();
+    mSearchSteps = 0;
+    mMainComponentSize = 0;
+
+    // two components that both contain a quorum give two disjoint quorums
+    NodeSet mainComponent;
+    NodeSet mainQuorum;
+    for (auto const& component : getStronglyConnectedComponents())
+    {
+        auto q = contractToMaximalQuorum(component);
+        if (countNodes(q) != 0)
+        {
+            if (!mainQuorum.empty())
+            {
+                setSplit(mainQuorum, q);
+                return false;
+            }
+            mainComponent = component;
+            mainQuorum = q;
+        }
+    }
+    if (mainQuorum.empty())
+    {
+        // no quorum at all
+        return true;
+    }
+
+    // of two disjoint minimal quorums, one has at most half of the nodes
+    mMainComponentSize = countNodes(mainComponent);
+    mMaxQuorumSize = mMainComponentSize / 2;
+    NodeSet none(mNodes.size(), false);
+    return !search(none, 0, mainComponent);
+}
+
+std::pair<std::vector<NodeID>, std::vector<NodeID>> const&
+QuorumIntersectionChecker::getPotentialSplit() const
+{
+    return mSplit;
+}
+
+size_t
+QuorumIntersectionChecker::getNodeCount() const
+{
+    return mNodes.size();
+}
+
+size_t
+QuorumIntersectionChecker::getMainComponentSize() const
+{
+    return mMainComponentSize;
+}
+
+size_t
+QuorumIntersectionChecker::getSearchSteps() const
+{
+    return mSearchSteps;
+}
+}
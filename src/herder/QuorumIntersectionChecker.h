@@ -0,0 +1,97 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "scp/CompiledQuorumSet.h"
+#include "scp/SCP.h"
+#include "util/NonCopyable.h"
+
+#include <atomic>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace stellar
+{
+/**
+ * Checks that every two quorums of a network intersect.
+ *
+ * The network is given as the quorum set of each node; nodes without a
+ * known quorum set (nullptr, or only referenced by other quorum sets) are
+ * assumed to never be part of a quorum.
+ *
+ * The search follows the usual reduction: quorums only exist within
+ * strongly connected components of the "appears in the quorum set of"
+ * graph, and if only one component contains a quorum then every minimal
+ * quorum lies within it. There, a branch-and-bound search enumerates the
+ * candidate quorums of at most half its size, looking for one whose
+ * complement still contains a quorum. A branch is cut as soon as the
+ * nodes committed so far cannot be extended into a quorum, or already are
+ * one (the complement of a superset is smaller).
+ *
+ * The search is exponential in the worst case; it can be interrupted from
+ * another thread through the flag given to the constructor, in which case
+ * networkEnjoysQuorumIntersection throws InterruptedError.
+ */
+class QuorumIntersectionChecker : NonMovableOrCopyable
+{
+  public:
+    typedef std::map<NodeID, SCPQuorumSetPtr> QuorumMap;
+    typedef std::vector<bool> NodeSet;
+
+    class InterruptedError : public std::runtime_error
+    {
+      public:
+        InterruptedError() : std::runtime_error("interrupted")
+        {
+        }
+    };
+
+    explicit QuorumIntersectionChecker(
+        QuorumMap const& qmap, std::atomic<bool> const* interrupt = nullptr);
+
+    bool networkEnjoysQuorumIntersection();
+
+    // two disjoint quorums, set when networkEnjoysQuorumIntersection
+    // returned false
+    std::pair<std::vector<NodeID>, std::vector<NodeID>> const&
+    getPotentialSplit() const;
+
+    // number of nodes with a known quorum set
+    size_t getNodeCount() const;
+    // size of the strongly connected component the search ran in
+    size_t getMainComponentSize() const;
+    // number of branches explored
+    size_t getSearchSteps() const;
+
+  private:
+    struct Node
+    {
+        NodeID mNodeID;
+        CompiledQuorumSet mQSet;
+        // index in mNodes of each node of mQSet, -1 if unknown
+        std::vector<int> mIndices;
+    };
+
+    std::vector<Node> mNodes;
+    std::atomic<bool> const* mInterrupt;
+    std::pair<std::vector<NodeID>, std::vector<NodeID>> mSplit;
+    size_t mMainComponentSize;
+    size_t mMaxQuorumSize;
+    size_t mSearchSteps;
+
+    bool isSliceSatisfied(size_t node, NodeSet const& nodes) const;
+
+    // largest quorum contained in nodes (empty if none)
+    NodeSet contractToMaximalQuorum(NodeSet nodes) const;
+    bool isAQuorum(NodeSet const& nodes) const;
+
+    std::vector<NodeSet> getStronglyConnectedComponents() const;
+    bool search(NodeSet const& committed, size_t committedSize,
+                NodeSet const& remaining);
+    void setSplit(NodeSet const& a, NodeSet const& b);
+};
+}
@@ -0,0 +1,233 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SecretKey.h"
+#include "herder/HerderImpl.h"
+#include "herder/QuorumIntersectionChecker.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "scp/LocalNode.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/XDROperators.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace stellar;
+
+namespace
+{
+std::vector<NodeID>
+makeNodes(size_t n)
+{
+    std::vector<NodeID> res;
+    for (size_t i = 0; i < n; i++)
+    {
+        res.emplace_back(SecretKey::random().getPublicKey());
+    }
+    return res;
+}
+
+SCPQuorumSetPtr
+makeQSet(uint32 threshold, std::vector<NodeID> const& validators)
+{
+    auto res = std::make_shared<SCPQuorumSet>();
+    res->threshold = threshold;
+    for (auto const& v : validators)
+    {
+        res->validators.emplace_back(v);
+    }
+    return res;
+}
+
+bool
+isQuorum(QuorumIntersectionChecker::QuorumMap const& qmap,
+         std::vector<NodeID> const& nodes)
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+    for (auto const& n : nodes)
+    {
+        auto q = qmap.find(n);
+        if (q == qmap.end() || !q->second ||
+            !LocalNode::isQuorumSlice(*q->second, nodes))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+checkSplit(QuorumIntersectionChecker const& checker,
+           QuorumIntersectionChecker::QuorumMap const& qmap)
+{
+    auto const& split = checker.getPotentialSplit();
+    REQUIRE(isQuorum(qmap, split.first));
+    REQUIRE(isQuorum(qmap, split.second));
+    for (auto const& n : split.first)
+    {
+        REQUIRE(std::find(split.second.begin(), split.second.end(), n) ==
+                split.second.end());
+    }
+}
+}
+
+TEST_CASE("quorum intersection", "[herder][quorumintersection]")
+{
+    auto nodes = makeNodes(6);
+    QuorumIntersectionChecker::QuorumMap qmap;
+
+    SECTION("3 of 4")
+    {
+        std::vector<NodeID> four(nodes.begin(), nodes.begin() + 4);
+        for (auto const& n : four)
+        {
+            qmap[n] = makeQSet(3, four);
+        }
+        QuorumIntersectionChecker checker(qmap);
+        REQUIRE(checker.networkEnjoysQuorumIntersection());
+        REQUIRE(checker.getMainComponentSize() == 4);
+    }
+
+    SECTION("2 of 4 splits")
+    {
+        std::vector<NodeID> four(nodes.begin(), nodes.begin() + 4);
+        for (auto const& n : four)
+        {
+            qmap[n] = makeQSet(2, four);
+        }
+        QuorumIntersectionChecker checker(qmap);
+        REQUIRE(!checker.networkEnjoysQuorumIntersection());
+        checkSplit(checker, qmap);
+    }
+
+    SECTION("two disconnected groups")
+    {
+        std::vector<NodeID> a(nodes.begin(), nodes.begin() + 3);
+        std::vector<NodeID> b(nodes.begin() + 3, nodes.end());
+        for (auto const& n : a)
+        {
+            qmap[n] = makeQSet(2, a);
+        }
+        for (auto const& n : b)
+        {
+            qmap[n] = makeQSet(3, b);
+        }
+        QuorumIntersectionChecker checker(qmap);
+        REQUIRE(!checker.networkEnjoysQuorumIntersection());
+        checkSplit(checker, qmap);
+    }
+
+    SECTION("nodes without quorum sets")
+    {
+        // 2 of 4 would split, but two of the nodes are unknown
+        std::vector<NodeID> four(nodes.begin(), nodes.begin() + 4);
+        qmap[nodes[0]] = makeQSet(2, four);
+        qmap[nodes[1]] = makeQSet(2, four);
+        qmap[nodes[2]] = nullptr;
+        QuorumIntersectionChecker checker(qmap);
+        REQUIRE(checker.getNodeCount() == 2);
+        REQUIRE(checker.networkEnjoysQuorumIntersection());
+    }
+
+    SECTION("no quorum")
+    {
+        for (auto const& n : nodes)
+        {
+            qmap[n] = makeQSet(7, nodes);
+        }
+        QuorumIntersectionChecker checker(qmap);
+        REQUIRE(checker.networkEnjoysQuorumIntersection());
+    }
+
+    SECTION("interrupted")
+    {
+        for (auto const& n : nodes)
+        {
+            qmap[n] = makeQSet(4, nodes);
+        }
+        std::atomic<bool> interrupt{true};
+        QuorumIntersectionChecker checker(qmap, &interrupt);
+        REQUIRE_THROWS_AS(checker.networkEnjoysQuorumIntersection(),
+                          QuorumIntersectionChecker::InterruptedError);
+    }
+}
+
+TEST_CASE("quorum intersection of organizations",
+          "[herder][quorumintersection]")
+{
+    // 7 organizations of 3 validators, every validator requires 2 of 3 of
+    // its own organization and a threshold of the organizations
+    size_t const orgCount = 7;
+    std::vector<std::vector<NodeID>> orgs;
+    for (size_t i = 0; i < orgCount; i++)
+    {
+        orgs.emplace_back(makeNodes(3));
+    }
+
+    auto build = [&](uint32 orgThreshold) {
+        SCPQuorumSet q;
+        q.threshold = orgThreshold;
+        for (auto const& org : orgs)
+        {
+            q.innerSets.emplace_back(*makeQSet(2, org));
+        }
+        QuorumIntersectionChecker::QuorumMap qmap;
+        for (auto const& org : orgs)
+        {
+            for (auto const& n : org)
+            {
+                qmap[n] = std::make_shared<SCPQuorumSet>(q);
+            }
+        }
+        return qmap;
+    };
+
+    SECTION("5 of 7 organizations intersect")
+    {
+        auto qmap = build(5);
+        QuorumIntersectionChecker checker(qmap);
+        REQUIRE(checker.networkEnjoysQuorumIntersection());
+        REQUIRE(checker.getMainComponentSize() == 21);
+    }
+
+    SECTION("3 of 7 organizations split")
+    {
+        auto qmap = build(3);
+        QuorumIntersectionChecker checker(qmap);
+        REQUIRE(!checker.networkEnjoysQuorumIntersection());
+        checkSplit(checker, qmap);
+    }
+}
+
+TEST_CASE("quorum intersection check interrupted by shutdown",
+          "[herder][quorumintersection]")
+{
+    // every half of the nodes is a candidate: far too many to go through
+    auto nodes = makeNodes(64);
+    QuorumIntersectionChecker::QuorumMap qmap;
+    for (auto const& n : nodes)
+    {
+        qmap[n] = makeQSet(33, nodes);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        VirtualClock clock;
+        Config cfg(getTestConfig());
+        cfg.QUORUM_INTERSECTION_CHECKER = true;
+        auto app = createTestApplication(clock, cfg);
+        auto& herder = static_cast<HerderImpl&>(app->getHerder());
+        herder.startQuorumIntersectionCheck(qmap);
+        // let the worker thread start on it
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // destroying the application joins the worker threads
+    }
+    REQUIRE(std::chrono::steady_clock::now() - start <
+            std::chrono::seconds(30));
+}
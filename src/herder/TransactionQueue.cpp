@@ -0,0 +1,226 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/TransactionQueue.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace stellar
+{
+
+bool
+TransactionQueue::FeeOrder::operator()(FeeKey const& a, FeeKey const& b) const
+{
+    if (a.first != b.first)
+    {
+        return a.first > b.first;
+    }
+    return a.second < b.second;
+}
+
+TransactionQueue::TransactionQueue() : mGenerations(MAX_AGE)
+{
+}
+
+double
+TransactionQueue::feeRate(TransactionFramePtr const& tx)
+{
+    // proportional to TransactionFrame::getFeeRatio, without depending on the
+    // base fee of the current ledger
+    auto ops = std::max<size_t>(tx->getOperations().size(), 1);
+    return static_cast<double>(tx->getFee()) / ops;
+}
+
+TransactionQueue::FeeKey
+TransactionQueue::feeKey(AccountID const& acc, AccountTxs const& txs)
+{
+    return std::make_pair(*txs.mFeeRates.begin(), acc);
+}
+
+TransactionQueue::Generation&
+TransactionQueue::getGeneration(uint64_t generation)
+{
+    assert(generation <= mGeneration && mGeneration - generation < MAX_AGE);
+    return mGenerations[mGenerations.size() - 1 - (mGeneration - generation)];
+}
+
+bool
+TransactionQueue::contains(TransactionFramePtr const& tx) const
+{
+    auto acc = mAccounts.find(tx->getSourceID());
+    if (acc == mAccounts.end())
+    {
+        return false;
+    }
+    auto const& txs = acc->second.mTransactions;
+    return txs.find(std::make_pair(tx->getSeqNum(), tx->getFullHash())) !=
+           txs.end();
+}
+
+SequenceNumber
+TransactionQueue::getMaxSeq(AccountID const& acc) const
+{
+    auto it = mAccounts.find(acc);
+    if (it == mAccounts.end())
+    {
+        return 0;
+    }
+    return it->second.mTransactions.rbegin()->first.first;
+}
+
+int64_t
+TransactionQueue::getTotalFees(AccountID const& acc) const
+{
+    auto it = mAccounts.find(acc);
+    return it == mAccounts.end() ? 0 : it->second.mTotalFees;
+}
+
+void
+TransactionQueue::add(TransactionFramePtr tx)
+{
+    auto const& acc = tx->getSourceID();
+    auto& txs = mAccounts[acc];
+    if (!txs.mTransactions.empty())
+    {
+        mByFee.erase(feeKey(acc, txs));
+    }
+
+    Entry e{tx, mGeneration, tx->getFee(), feeRate(tx)};
+    auto res = txs.mTransactions.emplace(
+        std::make_pair(tx->getSeqNum(), tx->getFullHash()), e);
+    assert(res.second);
+    txs.mFeeRates.insert(e.mFeeRate);
+    txs.mTotalFees += e.mFee;
+    mByFee.insert(feeKey(acc, txs));
+
+    auto& gen = mGenerations.back();
+    gen.mTransactions.emplace_back(tx);
+    ++gen.mSize;
+    ++mSize;
+}
+
+void
+TransactionQueue::removeTx(TransactionFramePtr const& tx,
+                           uint64_t const* generation)
+{
+    auto const& acc = tx->getSourceID();
+    auto it = mAccounts.find(acc);
+    if (it == mAccounts.end())
+    {
+        return;
+    }
+    auto& txs = it->second;
+    auto entry = txs.mTransactions.find(
+        std::make_pair(tx->getSeqNum(), tx->getFullHash()));
+    if (entry == txs.mTransactions.end() ||
+        (generation && entry->second.mGeneration != *generation))
+    {
+        return;
+    }
+
+    --getGeneration(entry->second.mGeneration).mSize;
+    --mSize;
+    mByFee.erase(feeKey(acc, txs));
+    txs.mFeeRates.erase(txs.mFeeRates.find(entry->second.mFeeRate));
+    txs.mTotalFees -= entry->second.mFee;
+    txs.mTransactions.erase(entry);
+    if (txs.mTransactions.empty())
+    {
+        mAccounts.erase(it);
+    }
+    else
+    {
+        mByFee.insert(feeKey(acc, txs));
+    }
+}
+
+void
+TransactionQueue::remove(std::vector<TransactionFramePtr> const& txs)
+{
+    for (auto const& tx : txs)
+    {
+        removeTx(tx);
+    }
+}
+
+void
+TransactionQueue::shift()
+{
+    auto oldest = mGeneration + 1 - MAX_AGE;
+    auto expired = std::move(mGenerations.front().mTransactions);
+    for (auto const& tx : expired)
+    {
+        removeTx(tx, &oldest);
+    }
+    assert(mGenerations.front().mSize == 0);
+    mGenerations.pop_front();
+    mGenerations.emplace_back();
+    ++mGeneration;
+}
+
+std::vector<TransactionFramePtr>
+TransactionQueue::getBest(size_t max) const
+{
+    std::vector<TransactionFramePtr> res;
+    for (auto it = mByFee.begin(); it != mByFee.end() && res.size() < max;
+         ++it)
+    {
+        auto const& txs = mAccounts.find(it->second)->second.mTransactions;
+        for (auto tx = txs.begin(); tx != txs.end() && res.size() < max; ++tx)
+        {
+            res.emplace_back(tx->second.mTx);
+        }
+    }
+    return res;
+}
+
+std::vector<TransactionFramePtr>
+TransactionQueue::getTransactions() const
+{
+    return getBest(mSize);
+}
+
+size_t
+TransactionQueue::size() const
+{
+    return mSize;
+}
+
+size_t
+TransactionQueue::size(uint32_t age) const
+{
+    assert(age < MAX_AGE);
+    return mGenerations[mGenerations.size() - 1 - age].mSize;
+}
+
+MemoryUsage
+TransactionQueue::getMemoryUsage() const
+{
+    // in mAccounts and mByFee
+    size_t const perAccount = 2 * MemoryUsage::NODE_OVERHEAD +
+                              sizeof(AccountID) + sizeof(AccountTxs) +
+                              sizeof(FeeKey);
+    // in mTransactions and mFeeRates of its account
+    size_t const perTx = 2 * MemoryUsage::NODE_OVERHEAD +
+                         sizeof(std::pair<SequenceNumber, Hash>) +
+                         sizeof(Entry) + sizeof(double);
+
+    MemoryUsage res;
+    for (auto const& acc : mAccounts)
+    {
+        res.mBytes += perAccount;
+        for (auto const& kv : acc.second.mTransactions)
+        {
+            res.add(perTx + kv.second.mTx->getMemoryUsage());
+        }
+    }
+    // the pointers of the generations, some to transactions gone already
+    for (auto const& g : mGenerations)
+    {
+        res.mBytes += g.mTransactions.capacity() * sizeof(TransactionFramePtr);
+    }
+    return res;
+}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "transactions/TransactionFrame.h"
+#include "util/MemoryUsage.h"
+#include "util/XDROperators.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Transactions received from the network and not applied yet.
+ *
+ * Transactions are kept in a sequence number ordered chain per source
+ * account, and accounts are indexed by the lowest fee per operation among
+ * their transactions. This is the order surge pricing ranks transactions in
+ * (see TxSetFrame::surgePricingFilter), so the best N transactions can be
+ * picked in O(N) without sorting the whole queue, and adding or removing a
+ * transaction costs O(log(n)).
+ *
+ * Every transaction remembers the generation (ledger) it was received in;
+ * `shift` starts a new generation and drops the transactions that have been
+ * pending for MAX_AGE generations.
+ */
+class TransactionQueue
+{
+  public:
+    static uint32_t const MAX_AGE = 4;
+
+  private:
+    struct Entry
+    {
+        TransactionFramePtr mTx;
+        uint64_t mGeneration;
+        // as of when the transaction was added
+        int64_t mFee;
+        double mFeeRate;
+    };
+
+    struct AccountTxs
+    {
+        // (seqnum, full hash) -> transaction
+        std::map<std::pair<SequenceNumber, Hash>, Entry> mTransactions;
+        std::multiset<double> mFeeRates;
+        int64_t mTotalFees{0};
+    };
+
+    typedef std::pair<double, AccountID> FeeKey;
+    struct FeeOrder
+    {
+        bool operator()(FeeKey const& a, FeeKey const& b) const;
+    };
+
+    struct Generation
+    {
+        // may contain transactions removed since then
+        std::vector<TransactionFramePtr> mTransactions;
+        size_t mSize{0};
+    };
+
+    std::unordered_map<AccountID, AccountTxs> mAccounts;
+    // best fee rate first
+    std::set<FeeKey, FeeOrder> mByFee;
+    // oldest first, mGenerations.back() is generation mGeneration
+    std::deque<Generation> mGenerations;
+    uint64_t mGeneration{0};
+    size_t mSize{0};
+
+    static double feeRate(TransactionFramePtr const& tx);
+    static FeeKey feeKey(AccountID const& acc, AccountTxs const& txs);
+
+    Generation& getGeneration(uint64_t generation);
+    // removes `tx` if it is in the queue and, when `generation` is given,
+    // was received in it
+    void removeTx(TransactionFramePtr const& tx,
+                  uint64_t const* generation = nullptr);
+
+  public:
+    TransactionQueue();
+
+    bool contains(TransactionFramePtr const& tx) const;
+
+    // highest sequence number and total fees of the transactions of `acc`,
+    // 0 if it has none
+    SequenceNumber getMaxSeq(AccountID const& acc) const;
+    int64_t getTotalFees(AccountID const& acc) const;
+
+    // Precondition: !contains(tx)
+    void add(TransactionFramePtr tx);
+    void remove(std::vector<TransactionFramePtr> const& txs);
+
+    void shift();
+
+    // Up to `max` transactions, taking whole accounts (in sequence number
+    // order) by decreasing fee rate, and the first transactions of the
+    // account that does not fit entirely.
+    std::vector<TransactionFramePtr> getBest(size_t max) const;
+    std::vector<TransactionFramePtr> getTransactions() const;
+
+    size_t size() const;
+    // number of transactions received `age` generations ago
+    size_t size(uint32_t age) const;
+
+    MemoryUsage getMemoryUsage() const;
+};
+}
@@ -0,0 +1,100 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "herder/TransactionQueue.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+TEST_CASE("transaction queue", "[herder][txqueue]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a = root.create("a", 5000000000);
+    auto b = root.create("b", 5000000000);
+
+    auto makeTx = [&](TestAccount& acc, uint32_t feeMultiplier) {
+        auto tx = acc.tx({payment(root, 1)});
+        tx->getEnvelope().tx.fee *= feeMultiplier;
+        return tx;
+    };
+
+    TransactionQueue queue;
+    std::vector<TransactionFramePtr> aTxs, bTxs;
+    for (int i = 0; i < 3; i++)
+    {
+        aTxs.emplace_back(makeTx(a, 2));
+        bTxs.emplace_back(makeTx(b, 3));
+    }
+    // a single cheaper transaction brings the whole chain of b down
+    bTxs.emplace_back(makeTx(b, 1));
+
+    // out of order on purpose
+    for (int i = 2; i >= 0; i--)
+    {
+        queue.add(aTxs[i]);
+        queue.add(bTxs[i]);
+    }
+    queue.add(bTxs[3]);
+
+    REQUIRE(queue.size() == 7);
+    REQUIRE(queue.contains(aTxs[0]));
+    REQUIRE(queue.getMaxSeq(a.getPublicKey()) == aTxs[2]->getSeqNum());
+    REQUIRE(queue.getTotalFees(b.getPublicKey()) ==
+            3 * bTxs[0]->getFee() + bTxs[3]->getFee());
+
+    SECTION("best transactions by account fee rate then seqnum")
+    {
+        REQUIRE(queue.getBest(4) ==
+                std::vector<TransactionFramePtr>{aTxs[0], aTxs[1], aTxs[2],
+                                                 bTxs[0]});
+        queue.remove({bTxs[3]});
+        REQUIRE(queue.getBest(4) ==
+                std::vector<TransactionFramePtr>{bTxs[0], bTxs[1], bTxs[2],
+                                                 aTxs[0]});
+        REQUIRE(queue.getTransactions().size() == 6);
+    }
+
+    SECTION("remove")
+    {
+        queue.remove({aTxs[0], aTxs[1], aTxs[2]});
+        REQUIRE(!queue.contains(aTxs[0]));
+        REQUIRE(queue.getMaxSeq(a.getPublicKey()) == 0);
+        REQUIRE(queue.getTotalFees(a.getPublicKey()) == 0);
+        REQUIRE(queue.size() == 4);
+        REQUIRE(queue.getBest(10).size() == 4);
+    }
+
+    SECTION("aging")
+    {
+        REQUIRE(queue.size(0) == 7);
+        queue.shift();
+        auto tx = makeTx(a, 1);
+        queue.add(tx);
+        REQUIRE(queue.size(0) == 1);
+        REQUIRE(queue.size(1) == 7);
+
+        queue.remove({aTxs[0]});
+        REQUIRE(queue.size(1) == 6);
+
+        for (uint32_t i = 1; i < TransactionQueue::MAX_AGE; i++)
+        {
+            queue.shift();
+        }
+        REQUIRE(queue.size() == 1);
+        REQUIRE(queue.contains(tx));
+        queue.shift();
+        REQUIRE(queue.size() == 0);
+        REQUIRE(queue.getBest(10).empty());
+    }
+}
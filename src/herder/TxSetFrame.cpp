@@ -7,6 +7,7 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "database/Database.h"
+#include "herder/Herder.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -23,20 +24,28 @@ namespace stellar
 using namespace std;
 
 TxSetFrame::TxSetFrame(Hash const& previousLedgerHash)
-    : mHashIsValid(false), mPreviousLedgerHash(previousLedgerHash)
+    : mHashIsValid(false)
+    , mApplyOrderIsValid(false)
+    , mPreviousLedgerHash(previousLedgerHash)
 {
 }
 
 TxSetFrame::TxSetFrame(Hash const& networkID, TransactionSet const& xdrSet)
     : mHashIsValid(false)
+    , mApplyOrderIsValid(false)
+    , mTransactions(
+          TransactionFrame::makeTransactionsFromWire(networkID, xdrSet.txs))
 {
-    for (auto const& txEnvelope : xdrSet.txs)
-    {
-        TransactionFramePtr tx =
-            TransactionFrame::makeTransactionFromWire(networkID, txEnvelope);
-        mTransactions.push_back(tx);
-    }
     mPreviousLedgerHash = xdrSet.previousLedgerHash;
+    sortForHash();
+}
+
+void
+TxSetFrame::invalidate()
+{
+    mHashIsValid = false;
+    mApplyOrderIsValid = false;
+    mApplyOrder.clear();
 }
 
 static bool
@@ -52,8 +61,11 @@ HashTxSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
 void
 TxSetFrame::sortForHash()
 {
-    std::sort(mTransactions.begin(), mTransactions.end(), HashTxSorter);
-    mHashIsValid = false;
+    if (!std::is_sorted(mTransactions.begin(), mTransactions.end(),
+                        HashTxSorter))
+    {
+        std::sort(mTransactions.begin(), mTransactions.end(), HashTxSorter);
+    }
 }
 
 // We want to XOR the tx hash with the set hash.
@@ -89,9 +101,14 @@ SeqSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
     * transactions for an account are sorted by sequence number (ascending)
     * the order between accounts is randomized
 */
-std::vector<TransactionFramePtr>
-TxSetFrame::sortForApply()
+std::vector<TransactionFramePtr> const&
+TxSetFrame::sortForApply() const
 {
+    if (mApplyOrderIsValid)
+    {
+        return mApplyOrder;
+    }
+
     vector<TransactionFramePtr> retList;
 
     vector<vector<TransactionFramePtr>> txBatches(4);
@@ -117,11 +134,11 @@ TxSetFrame::sortForApply()
 
     retList.clear();
 
+    // randomize each batch using the hash of the transaction set
+    // as a way to randomize even more
+    ApplyTxSorter s(getContentsHash());
     for (auto& batch : txBatches)
     {
-        // randomize each batch using the hash of the transaction set
-        // as a way to randomize even more
-        ApplyTxSorter s(getContentsHash());
         std::sort(batch.begin(), batch.end(), s);
         for (auto tx : batch)
         {
@@ -129,7 +146,9 @@ TxSetFrame::sortForApply()
         }
     }
 
-    return retList;
+    mApplyOrder = std::move(retList);
+    mApplyOrderIsValid = true;
+    return mApplyOrder;
 }
 
 struct SurgeSorter
@@ -152,6 +171,80 @@ struct SurgeSorter
     }
 };
 
+TxValidityMemo::TxValidityMemo() : mResults(MEMO_SIZE)
+{
+}
+
+void
+TxValidityMemo::setLedger(Hash const& lclHash)
+{
+    if (lclHash != mLedgerHash)
+    {
+        mResults.clear();
+        mLedgerHash = lclHash;
+    }
+}
+
+bool
+TxValidityMemo::lookup(TransactionFrame const& tx, SequenceNumber lastSeq,
+                       Result& res)
+{
+    auto const& h = tx.getFullHash();
+    if (!mResults.exists(h))
+    {
+        return false;
+    }
+    res = mResults.get(h).mResult;
+    return res.mLastSeq == lastSeq;
+}
+
+void
+TxValidityMemo::put(TransactionFrame const& tx, Result const& res)
+{
+    Entry e;
+    e.mResult = res;
+    e.mAccounts.emplace_back(tx.getSourceID());
+    for (auto const& op : tx.getEnvelope().tx.operations)
+    {
+        if (op.sourceAccount)
+        {
+            e.mAccounts.emplace_back(*op.sourceAccount);
+        }
+    }
+    e.mTimeBound = static_cast<bool>(tx.getEnvelope().tx.timeBounds);
+    mResults.put(tx.getFullHash(), e);
+}
+
+void
+TxValidityMemo::ledgerClosed(LedgerHeader const& before,
+                             LedgerHeaderHistoryEntry const& lcl,
+                             std::unordered_set<AccountID> const& touched)
+{
+    auto const& after = lcl.header;
+    if (before.previousLedgerHash != mLedgerHash ||
+        before.baseFee != after.baseFee ||
+        before.baseReserve != after.baseReserve ||
+        before.ledgerVersion != after.ledgerVersion)
+    {
+        mResults.clear();
+    }
+    else
+    {
+        // the close time moved: time bounds are checked again
+        mResults.erase_if([&touched](Entry const& e) {
+            if (e.mTimeBound)
+            {
+                return true;
+            }
+            return std::any_of(e.mAccounts.begin(), e.mAccounts.end(),
+                               [&touched](AccountID const& id) {
+                                   return touched.find(id) != touched.end();
+                               });
+        });
+    }
+    mLedgerHash = lcl.hash;
+}
+
 void
 TxSetFrame::surgePricingFilter(LedgerManager const& lm)
 {
@@ -191,7 +284,7 @@ TxSetFrame::checkOrTrim(
     std::function<bool(TransactionFramePtr, SequenceNumber)>
         processInvalidTxLambda,
     std::function<bool(std::vector<TransactionFramePtr> const&)>
-        processInsufficientBalance)
+        processInsufficientBalance) const
 {
     map<AccountID, vector<TransactionFramePtr>> accountTxMap;
 
@@ -209,6 +302,10 @@ TxSetFrame::checkOrTrim(
         lastHash = tx->getFullHash();
     }
 
+    auto& lm = app.getLedgerManager();
+    auto& memo = app.getHerder().getTxValidityMemo();
+    memo.setLedger(lm.getLastClosedLedgerHeader().hash);
+
     for (auto& item : accountTxMap)
     {
         // order by sequence number
@@ -217,9 +314,24 @@ TxSetFrame::checkOrTrim(
         TransactionFramePtr lastTx;
         SequenceNumber lastSeq = 0;
         int64_t totFee = 0;
+        int64_t availableBalance = 0;
         for (auto& tx : item.second)
         {
-            if (!tx->checkValid(app, lastSeq))
+            TxValidityMemo::Result res;
+            if (memo.lookup(*tx, lastSeq, res))
+            {
+                tx->getResult().result.code(res.mCode);
+            }
+            else
+            {
+                bool valid = tx->checkValid(app, lastSeq);
+                res.mLastSeq = lastSeq;
+                res.mCode = valid ? txSUCCESS : tx->getResultCode();
+                res.mAvailableBalance =
+                    valid ? tx->getSourceAccount().getAvailableBalance(lm) : 0;
+                memo.put(*tx, res);
+            }
+            if (res.mCode != txSUCCESS)
             {
                 if (processInvalidTxLambda(tx, lastSeq))
                     continue;
@@ -230,12 +342,12 @@ TxSetFrame::checkOrTrim(
 
             lastTx = tx;
             lastSeq = tx->getSeqNum();
+            availableBalance = res.mAvailableBalance;
         }
         if (lastTx)
         {
             // make sure account can pay the fee for all these tx
-            auto const& source = lastTx->getSourceAccount();
-            if (source.getAvailableBalance(app.getLedgerManager()) < totFee)
+            if (availableBalance < totFee)
             {
                 if (!processInsufficientBalance(item.second))
                     return false;
@@ -279,7 +391,7 @@ TxSetFrame::trimInvalid(Application& app,
 // the fees of all the tx it has submitted in this set
 // check seq num
 bool
-TxSetFrame::checkValid(Application& app)
+TxSetFrame::checkValid(Application& app) const
 {
     // Establish read-only transaction for duration of checkValid
     soci::transaction sqltx(app.getDatabase().getSession());
@@ -332,21 +444,34 @@ TxSetFrame::removeTx(TransactionFramePtr tx)
 {
     auto it = std::find(mTransactions.begin(), mTransactions.end(), tx);
     if (it != mTransactions.end())
+    {
         mTransactions.erase(it);
-    mHashIsValid = false;
+        invalidate();
+    }
 }
 
-Hash
-TxSetFrame::getContentsHash()
+Hash const&
+TxSetFrame::getContentsHash() const
 {
     if (!mHashIsValid)
     {
-        sortForHash();
+        // the hash is over the transactions in hash order, whatever the
+        // order of mTransactions
+        auto const* txs = &mTransactions;
+        vector<TransactionFramePtr> sorted;
+        if (!std::is_sorted(mTransactions.begin(), mTransactions.end(),
+                            HashTxSorter))
+        {
+            sorted = mTransactions;
+            std::sort(sorted.begin(), sorted.end(), HashTxSorter);
+            txs = &sorted;
+        }
+
         auto hasher = SHA256::create();
         hasher->add(mPreviousLedgerHash);
-        for (unsigned int n = 0; n < mTransactions.size(); n++)
+        for (auto const& tx : *txs)
         {
-            hasher->add(xdr::xdr_to_opaque(mTransactions[n]->getEnvelope()));
+            hasher->add(xdr::xdr_to_opaque(tx->getEnvelope()));
         }
         mHash = hasher->finish();
         mHashIsValid = true;
@@ -357,7 +482,7 @@ TxSetFrame::getContentsHash()
 Hash&
 TxSetFrame::previousLedgerHash()
 {
-    mHashIsValid = false;
+    invalidate();
     return mPreviousLedgerHash;
 }
 
@@ -368,7 +493,7 @@ TxSetFrame::previousLedgerHash() const
 }
 
 void
-TxSetFrame::toXDR(TransactionSet& txSet)
+TxSetFrame::toXDR(TransactionSet& txSet) const
 {
     txSet.txs.resize(xdr::size32(mTransactions.size()));
     for (unsigned int n = 0; n < mTransactions.size(); n++)
@@ -4,8 +4,13 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "lib/util/lrucache.hpp"
 #include "overlay/StellarXDR.h"
 #include "transactions/TransactionFrame.h"
+#include "util/HashOfHash.h"
+
+#include <unordered_set>
+#include <vector>
 
 namespace stellar
 {
@@ -13,20 +18,88 @@ class Application;
 
 class TxSetFrame;
 typedef std::shared_ptr<TxSetFrame> TxSetFramePtr;
+typedef std::shared_ptr<TxSetFrame const> TxSetFrameConstPtr;
+
+// Outcome of TransactionFrame::checkValid for transactions validated as part
+// of transaction sets on top of a given last closed ledger. Nominated sets
+// mostly contain the same transactions, so this saves validating (and loading
+// the source account of) each of them for every set.
+//
+// A transaction's validity also depends on the sequence number it is checked
+// against (the previous transaction of its account in the set), which is
+// recorded as well: a different one is a miss.
+//
+// Closing a ledger only invalidates the results of the transactions that
+// involve an account the ledger changed, or that have time bounds: the others
+// are carried over to the new last closed ledger (see ledgerClosed).
+class TxValidityMemo
+{
+  public:
+    static size_t const MEMO_SIZE = 50000;
+
+    struct Result
+    {
+        SequenceNumber mLastSeq;
+        TransactionResultCode mCode;
+        // available balance of the source account, when valid
+        int64_t mAvailableBalance;
+    };
+
+  private:
+    struct Entry
+    {
+        Result mResult;
+        // source accounts of the transaction and of its operations
+        std::vector<AccountID> mAccounts;
+        bool mTimeBound;
+    };
 
+    Hash mLedgerHash;
+    cache::lru_cache<Hash, Entry> mResults;
+
+  public:
+    TxValidityMemo();
+
+    // Forget everything if `lclHash` is not the ledger the memo is for.
+    void setLedger(Hash const& lclHash);
+
+    // Called when `lcl` got closed on top of the ledger the memo is for,
+    // `before` being its header before upgrades and `touched` the accounts
+    // whose entries (or trust lines, offers, data) it changed: results that
+    // may differ on top of `lcl` are forgotten, the others kept for it.
+    // Changing the fee, the reserve or the protocol version forgets
+    // everything.
+    void ledgerClosed(LedgerHeader const& before,
+                      LedgerHeaderHistoryEntry const& lcl,
+                      std::unordered_set<AccountID> const& touched);
+
+    bool lookup(TransactionFrame const& tx, SequenceNumber lastSeq,
+                Result& res);
+    void put(TransactionFrame const& tx, Result const& res);
+};
+
+// Once built, transaction sets are shared as TxSetFrameConstPtr (between
+// PendingEnvelopes, HerderSCPDriver and LedgerCloseData): the contents hash
+// and apply order are then computed at most once per set.
 class TxSetFrame
 {
-    bool mHashIsValid;
-    Hash mHash;
+    // Neither depends on the order of mTransactions, only on which
+    // transactions are in the set: adding or removing one drops them.
+    mutable bool mHashIsValid;
+    mutable Hash mHash;
+    mutable bool mApplyOrderIsValid;
+    mutable std::vector<TransactionFramePtr> mApplyOrder;
 
     Hash mPreviousLedgerHash;
 
+    void invalidate();
+
     bool
     checkOrTrim(Application& app,
                 std::function<bool(TransactionFramePtr, SequenceNumber)>
                     processInvalidTxLambda,
                 std::function<bool(std::vector<TransactionFramePtr> const&)>
-                    processLastInvalidTxLambda);
+                    processLastInvalidTxLambda) const;
 
   public:
     std::vector<TransactionFramePtr> mTransactions;
@@ -39,16 +112,18 @@ class TxSetFrame
     TxSetFrame(Hash const& networkID, TransactionSet const& xdrSet);
 
     // returns the hash of this tx set
-    Hash getContentsHash();
+    Hash const& getContentsHash() const;
 
     Hash& previousLedgerHash();
     Hash const& previousLedgerHash() const;
 
+    // puts mTransactions in the canonical (hash) order, which checkValid
+    // requires; sets built from the wire are sorted on construction
     void sortForHash();
 
-    std::vector<TransactionFramePtr> sortForApply();
+    std::vector<TransactionFramePtr> const& sortForApply() const;
 
-    bool checkValid(Application& app);
+    bool checkValid(Application& app) const;
     void trimInvalid(Application& app,
                      std::vector<TransactionFramePtr>& trimmed);
     void surgePricingFilter(LedgerManager const& lm);
@@ -59,15 +134,15 @@ class TxSetFrame
     add(TransactionFramePtr tx)
     {
         mTransactions.push_back(tx);
-        mHashIsValid = false;
+        invalidate();
     }
 
     size_t
-    size()
+    size() const
     {
         return mTransactions.size();
     }
 
-    void toXDR(TransactionSet& set);
+    void toXDR(TransactionSet& set) const;
 };
 } // namespace stellar
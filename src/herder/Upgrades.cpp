@@ -7,6 +7,7 @@
 #include "database/DatabaseUtils.h"
 #include "ledger/AccountFrame.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/OfferFrame.h"
 #include "ledger/TrustFrame.h"
@@ -382,13 +383,17 @@ Upgrades::storeUpgradeHistory(LedgerManager& ledgerManager,
     }
 }
 
-void
-Upgrades::deleteOldEntries(Database& db, uint32_t ledgerSeq, uint32_t count)
+bool
+Upgrades::deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                           uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "upgradehistory", "ledgerseq");
+    return DatabaseUtils::deleteOldEntriesHelper(sess, ledgerSeq, count,
+                                                 "upgradehistory", "ledgerseq");
 }
 
+// offers loaded at once by prepareLiabilities
+static size_t const PREPARE_LIABILITIES_BATCH_SIZE = 1000;
+
 static void
 addLiabilities(std::map<Asset, std::unique_ptr<int64_t>>& liabilities,
                AccountID const& accountID, Asset const& asset, int64_t delta)
@@ -578,6 +583,10 @@ updateOffer(
 // It is essential to note that the excess liabilities are determined only
 // using the initial result of step (1), so it does not matter what order the
 // offers are processed.
+//
+// The offers are streamed one account at a time (see
+// OfferFrame::loadOffersBySeller), so that an order book of any size fits in
+// memory.
 static void
 prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
 {
@@ -585,13 +594,11 @@ prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
 
     auto& db = ledgerManager.getDatabase();
     db.getEntryCache().clear();
-    auto offersByAccount = OfferFrame::loadAllOffers(db);
-
     uint64_t nChangedAccounts = 0;
     uint64_t nChangedTrustLines = 0;
     std::map<UpdateOfferResult, uint64_t> nUpdatedOffers;
-    for (auto& accountOffers : offersByAccount)
-    {
+    auto processSeller = [&](AccountID const& sellerID,
+                             std::vector<OfferFrame::pointer> const& offers) {
         // The purpose of std::unique_ptr here is to have a special value
         // (nullptr) to indicate that an integer overflow would have occured.
         // Overflow is possible here because existing offers were not
@@ -599,7 +606,7 @@ prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
         // handled in what follows.
         std::map<Asset, std::unique_ptr<int64_t>> initialBuyingLiabilities;
         std::map<Asset, std::unique_ptr<int64_t>> initialSellingLiabilities;
-        for (auto const& offerFrame : accountOffers.second)
+        for (auto const& offerFrame : offers)
         {
             auto const& offer = offerFrame->getOffer();
             addLiabilities(initialBuyingLiabilities, offer.sellerID,
@@ -608,8 +615,7 @@ prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
                            offer.selling, offerFrame->getSellingLiabilities());
         }
 
-        auto accountFrame =
-            AccountFrame::loadAccount(ld, accountOffers.first, db);
+        auto accountFrame = AccountFrame::loadAccount(ld, sellerID, db);
         if (!accountFrame)
         {
             throw std::runtime_error("account does not exist");
@@ -623,7 +629,7 @@ prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
         int64_t balanceAboveReserve = balance - minBalance;
 
         std::map<Asset, Liabilities> liabilities;
-        for (auto const& offerFrame : accountOffers.second)
+        for (auto const& offerFrame : offers)
         {
             auto offerID = offerFrame->getOfferID();
             auto res = updateOffer(*offerFrame, balance, balanceAboveReserve,
@@ -685,8 +691,8 @@ prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
             }
             else
             {
-                auto trustFrame = TrustFrame::loadTrustLine(accountOffers.first,
-                                                            asset, db, &ld);
+                auto trustFrame =
+                    TrustFrame::loadTrustLine(sellerID, asset, db, &ld);
                 int64_t deltaSelling =
                     liab.selling -
                     trustFrame->getSellingLiabilities(ledgerManager);
@@ -719,7 +725,9 @@ prepareLiabilities(LedgerManager& ledgerManager, LedgerDelta& ld)
             ++nChangedAccounts;
         }
         accountFrame->storeChange(ld, db);
-    }
+    };
+    OfferFrame::loadOffersBySeller(PREPARE_LIABILITIES_BATCH_SIZE,
+                                   processSeller, db);
 
     db.getEntryCache().clear();
     CLOG(INFO, "Ledger") << "prepareLiabilities completed with "
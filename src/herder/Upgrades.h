@@ -12,6 +12,11 @@
 #include <stdint.h>
 #include <vector>
 
+namespace soci
+{
+class session;
+}
+
 namespace stellar
 {
 class Config;
@@ -91,7 +96,7 @@ class Upgrades
                                     LedgerUpgrade const& upgrade,
                                     LedgerEntryChanges const& changes,
                                     int index);
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
+    static bool deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
                                  uint32_t count);
 
   private:
@@ -0,0 +1,184 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "history/CheckpointIndex.h"
+#include "history/FileTransferInfo.h"
+#include "lib/json/json.h"
+#include "overlay/StellarXDR.h"
+#include "util/Gzip.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace stellar
+{
+
+namespace
+{
+
+template <typename T, typename F>
+void
+indexRecords(std::string const& filename, F ledgerSeq,
+             std::vector<CheckpointIndex::Entry>& entries)
+{
+    XDRInputFileStream in;
+    in.open(filename);
+    T record;
+    auto offset = in.pos();
+    while (in && in.readOne(record))
+    {
+        auto next = in.pos();
+        auto seq = ledgerSeq(record);
+        if (!entries.empty() && entries.back().mLedgerSeq >= seq)
+        {
+            throw std::runtime_error("ledgers out of order in " + filename);
+        }
+        entries.push_back({seq, offset, static_cast<uint32_t>(next - offset)});
+        offset = next;
+    }
+}
+}
+
+uint32_t const CheckpointIndex::VERSION;
+
+CheckpointIndex
+CheckpointIndex::build(std::string const& type, std::string const& filename,
+                       std::string const& bgzFile)
+{
+    CheckpointIndex res;
+    if (type == HISTORY_FILE_TYPE_LEDGER)
+    {
+        indexRecords<LedgerHeaderHistoryEntry>(
+            filename,
+            [](LedgerHeaderHistoryEntry const& e) {
+                return e.header.ledgerSeq;
+            },
+            res.mEntries);
+    }
+    else if (type == HISTORY_FILE_TYPE_TRANSACTIONS)
+    {
+        indexRecords<TransactionHistoryEntry>(
+            filename,
+            [](TransactionHistoryEntry const& e) { return e.ledgerSeq; },
+            res.mEntries);
+    }
+    else if (type == HISTORY_FILE_TYPE_RESULTS)
+    {
+        indexRecords<TransactionHistoryResultEntry>(
+            filename,
+            [](TransactionHistoryResultEntry const& e) { return e.ledgerSeq; },
+            res.mEntries);
+    }
+    else if (type == HISTORY_FILE_TYPE_SCP)
+    {
+        indexRecords<SCPHistoryEntry>(
+            filename,
+            [](SCPHistoryEntry const& e) {
+                return e.v0().ledgerMessages.ledgerSeq;
+            },
+            res.mEntries);
+    }
+    else
+    {
+        throw std::runtime_error("no index for " + type + " files");
+    }
+
+    res.mBlockSize = gz::BLOCK_FILE_BLOCK_SIZE;
+    res.mMemberSizes = gz::compressBlockFile(filename, bgzFile);
+    return res;
+}
+
+void
+CheckpointIndex::save(std::string const& filename) const
+{
+    Json::Value root;
+    root["version"] = VERSION;
+    root["block_size"] = Json::UInt64(mBlockSize);
+    auto& members = root["members"] = Json::Value(Json::arrayValue);
+    for (auto s : mMemberSizes)
+    {
+        members.append(s);
+    }
+    auto& ledgers = root["ledgers"] = Json::Value(Json::arrayValue);
+    for (auto const& e : mEntries)
+    {
+        Json::Value entry(Json::arrayValue);
+        entry.append(e.mLedgerSeq);
+        entry.append(Json::UInt64(e.mOffset));
+        entry.append(e.mSize);
+        ledgers.append(entry);
+    }
+
+    std::ofstream out(filename);
+    out << Json::FastWriter().write(root);
+    out.close();
+    if (!out)
+    {
+        throw std::runtime_error("could not write " + filename);
+    }
+}
+
+void
+CheckpointIndex::load(std::string const& filename)
+{
+    std::ifstream in(filename);
+    Json::Value root;
+    if (!in || !Json::Reader().parse(in, root) || !root.isObject() ||
+        root["version"].asUInt() != VERSION)
+    {
+        throw std::runtime_error("not a checkpoint index: " + filename);
+    }
+
+    CheckpointIndex res;
+    res.mBlockSize = root["block_size"].asUInt64();
+    for (auto const& s : root["members"])
+    {
+        res.mMemberSizes.emplace_back(s.asUInt());
+    }
+    for (auto const& e : root["ledgers"])
+    {
+        res.mEntries.push_back(
+            {e[0].asUInt(), e[1].asUInt64(), e[2].asUInt()});
+    }
+
+    // entries must be sorted and within the members
+    auto contentsSize = res.mBlockSize * res.mMemberSizes.size();
+    for (size_t i = 0; i < res.mEntries.size(); i++)
+    {
+        auto const& e = res.mEntries[i];
+        if (res.mBlockSize == 0 || e.mSize == 0 ||
+            e.mOffset + e.mSize > contentsSize ||
+            (i != 0 && res.mEntries[i - 1].mLedgerSeq >= e.mLedgerSeq))
+        {
+            throw std::runtime_error("invalid checkpoint index: " + filename);
+        }
+    }
+    *this = std::move(res);
+}
+
+CheckpointIndex::Entry const*
+CheckpointIndex::find(uint32_t ledgerSeq) const
+{
+    auto it = std::lower_bound(mEntries.begin(), mEntries.end(), ledgerSeq,
+                               [](Entry const& e, uint32_t seq) {
+                                   return e.mLedgerSeq < seq;
+                               });
+    return it != mEntries.end() && it->mLedgerSeq == ledgerSeq ? &*it
+                                                               : nullptr;
+}
+
+CheckpointIndex::Range
+CheckpointIndex::getRange(Entry const& entry) const
+{
+    auto first = entry.mOffset / mBlockSize;
+    auto last = (entry.mOffset + entry.mSize - 1) / mBlockSize;
+    Range res{0, 0, first * mBlockSize};
+    for (size_t i = 0; i <= last && i < mMemberSizes.size(); i++)
+    {
+        (i < first ? res.mFileOffset : res.mFileSize) += mMemberSizes[i];
+    }
+    return res;
+}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/XDRStream.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Index of a checkpoint file (ledger headers, transactions, results or SCP
+ * messages), published with PUBLISH_CHECKPOINT_INDEXES so that the entry of
+ * one ledger can be read without downloading and inflating the whole file.
+ *
+ * Next to `<type>-<hex>.xdr.gz`, the archive then holds a block compressed
+ * variant of the file, `<type>-<hex>.xdr.bgz` (see gz::compressBlockFile),
+ * and its index, `<type>-<hex>.xdr.idx`, a JSON object:
+ *
+ *   {"version": 1, "block_size": 65536, "members": [sizes of the members],
+ *    "ledgers": [[ledger, offset, size], ...]}
+ *
+ * locating the XDR record of every ledger in the uncompressed contents. A
+ * reader fetches the index, then only the members of the variant holding the
+ * record, with a range request (see GetIndexedLedgerWork).
+ *
+ * Files hold at most one record per ledger: ledgers without transactions
+ * have none in the transactions and results files. The SCP messages of a
+ * ledger may refer to quorum sets only found in the records before it.
+ */
+struct CheckpointIndex
+{
+    static uint32_t const VERSION = 1;
+
+    struct Entry
+    {
+        uint32_t mLedgerSeq;
+        uint64_t mOffset;
+        uint32_t mSize;
+    };
+
+    // whole members of the block compressed file
+    struct Range
+    {
+        uint64_t mFileOffset;
+        uint64_t mFileSize;
+        // offset in the contents of the start of the first member
+        uint64_t mStart;
+    };
+
+    uint64_t mBlockSize{0};
+    std::vector<uint32_t> mMemberSizes;
+    // by ledger
+    std::vector<Entry> mEntries;
+
+    // Writes the block compressed variant of the checkpoint file @p filename,
+    // of type @p type (one of the HISTORY_FILE_TYPE_*, but buckets), to
+    // @p bgzFile and returns its index. Throws std::runtime_error.
+    static CheckpointIndex build(std::string const& type,
+                                 std::string const& filename,
+                                 std::string const& bgzFile);
+
+    void save(std::string const& filename) const;
+    // Throws std::runtime_error if @p filename is not an index.
+    void load(std::string const& filename);
+
+    // the entry of ledger @p ledgerSeq, nullptr if there is none
+    Entry const* find(uint32_t ledgerSeq) const;
+
+    // the members of the block compressed file holding @p entry
+    Range getRange(Entry const& entry) const;
+
+    // Reads the record of @p entry from @p filename, the block compressed
+    // file or the members of it starting at the contents offset @p start.
+    // Throws std::runtime_error.
+    template <typename T>
+    static void
+    readEntry(std::string const& filename, uint64_t start, Entry const& entry,
+              T& out)
+    {
+        XDRInputFileStream in;
+        in.open(filename);
+        in.seek(entry.mOffset - start);
+        if (!in.readOne(out))
+        {
+            throw std::runtime_error("no entry for ledger " +
+                                     std::to_string(entry.mLedgerSeq) +
+                                     " in " + filename);
+        }
+    }
+};
+}
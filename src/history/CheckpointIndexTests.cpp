@@ -0,0 +1,99 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "history/CheckpointIndex.h"
+#include "history/FileTransferInfo.h"
+#include "lib/catch.hpp"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
+
+#include <fstream>
+
+using namespace stellar;
+
+TEST_CASE("checkpoint index", "[history][checkpointindex]")
+{
+    TmpDir dir("checkpointindex");
+    auto filename = dir.getName() + "/transactions-0000003f.xdr";
+    auto bgzFilename = filename + ".bgz";
+    auto indexFilename = filename + ".idx";
+
+    // ledgers of various sizes, some without transactions, many across
+    // block boundaries
+    std::vector<TransactionHistoryEntry> entries;
+    for (uint32_t seq = 2; seq < 64; seq += 1 + seq % 3)
+    {
+        TransactionHistoryEntry e;
+        e.ledgerSeq = seq;
+        e.txSet.txs.resize(200 * (seq % 7));
+        for (size_t i = 0; i < e.txSet.txs.size(); i++)
+        {
+            e.txSet.txs[i].tx.seqNum = seq * 1000 + i;
+        }
+        entries.emplace_back(e);
+    }
+    {
+        XDROutputFileStream out;
+        out.open(filename);
+        for (auto const& e : entries)
+        {
+            out.writeOne(e);
+        }
+    }
+
+    auto index = CheckpointIndex::build(HISTORY_FILE_TYPE_TRANSACTIONS,
+                                        filename, bgzFilename);
+    REQUIRE(index.mEntries.size() == entries.size());
+    REQUIRE(index.mMemberSizes.size() > 2);
+    REQUIRE(index.find(3) == nullptr);
+    REQUIRE(index.find(64) == nullptr);
+
+    index.save(indexFilename);
+    CheckpointIndex loaded;
+    loaded.load(indexFilename);
+    REQUIRE(loaded.mBlockSize == index.mBlockSize);
+    REQUIRE(loaded.mMemberSizes == index.mMemberSizes);
+    REQUIRE(loaded.mEntries.size() == index.mEntries.size());
+
+    std::ifstream bgz(bgzFilename, std::ios::binary);
+    std::string bgzContents((std::istreambuf_iterator<char>(bgz)),
+                            std::istreambuf_iterator<char>());
+    for (auto const& e : entries)
+    {
+        auto entry = loaded.find(e.ledgerSeq);
+        REQUIRE(entry);
+
+        // from the whole file
+        TransactionHistoryEntry read;
+        CheckpointIndex::readEntry(bgzFilename, 0, *entry, read);
+        REQUIRE(read == e);
+
+        // from only the members holding it, as a range request gets them
+        auto range = loaded.getRange(*entry);
+        REQUIRE(range.mFileOffset + range.mFileSize <= bgzContents.size());
+        REQUIRE(range.mFileSize < bgzContents.size());
+        auto part = dir.getName() + "/part";
+        {
+            std::ofstream out(part, std::ios::binary | std::ios::trunc);
+            out << bgzContents.substr(range.mFileOffset, range.mFileSize);
+        }
+        read = TransactionHistoryEntry{};
+        CheckpointIndex::readEntry(part, range.mStart, *entry, read);
+        REQUIRE(read == e);
+    }
+
+    SECTION("invalid index")
+    {
+        {
+            std::ofstream out(indexFilename);
+            out << "{\"version\": 1, \"block_size\": 65536, \"members\": "
+                   "[100], \"ledgers\": [[2, 0, 70000]]}";
+        }
+        REQUIRE_THROWS_AS(loaded.load(indexFilename), std::runtime_error);
+        REQUIRE_THROWS_AS(
+            CheckpointIndex::build(HISTORY_FILE_TYPE_BUCKET, filename,
+                                   bgzFilename),
+            std::runtime_error);
+    }
+}
@@ -51,6 +51,12 @@ class FileTransferInfo
     {
     }
 
+    std::string const&
+    getType() const
+    {
+        return mType;
+    }
+
     bool
     getBucketHashName(std::string& hash) const
     {
@@ -77,6 +83,18 @@ class FileTransferInfo
     {
         return mLocalPath + ".gz.tmp";
     }
+    // the block compressed variant and index of checkpoint files (see
+    // CheckpointIndex)
+    std::string
+    localPath_bgz() const
+    {
+        return mLocalPath + ".bgz";
+    }
+    std::string
+    localPath_idx() const
+    {
+        return mLocalPath + ".idx";
+    }
 
     std::string
     baseName_nogz() const
@@ -104,5 +122,15 @@ class FileTransferInfo
     {
         return fs::remoteName(mType, mHexDigits, "xdr.gz");
     }
+    std::string
+    remoteName_bgz() const
+    {
+        return fs::remoteName(mType, mHexDigits, "xdr.bgz");
+    }
+    std::string
+    remoteName_idx() const
+    {
+        return fs::remoteName(mType, mHexDigits, "xdr.idx");
+    }
 };
 }
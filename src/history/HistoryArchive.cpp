@@ -7,6 +7,7 @@
 // else.
 #include "util/asio.h"
 #include "history/HistoryArchive.h"
+#include "history/HistoryArchiveClient.h"
 #include "bucket/Bucket.h"
 #include "bucket/BucketList.h"
 #include "crypto/Hex.h"
@@ -21,6 +22,8 @@
 #include <cereal/archives/json.hpp>
 #include <cereal/cereal.hpp>
 #include <cereal/types/vector.hpp>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
 
 #include <chrono>
 #include <fstream>
@@ -293,19 +296,33 @@ HistoryArchiveState::HistoryArchiveState(uint32_t ledgerSeq,
     }
 }
 
-HistoryArchive::HistoryArchive(HistoryArchiveConfiguration const& config)
+HistoryArchive::HistoryArchive(Application& app,
+                               HistoryArchiveConfiguration const& config)
     : mConfig(config)
+    , mDownloadBytes(app.getMetrics().NewMeter(
+          {"history", "archive-" + config.mName, "download-bytes"}, "byte"))
+    , mDownloadFailures(app.getMetrics().NewMeter(
+          {"history", "archive-" + config.mName, "download-failure"}, "event"))
 {
+    if (!mConfig.mURL.empty())
+    {
+        mClient = std::make_shared<HistoryArchiveClient>(app, mConfig.mURL,
+                                                         mConfig.mConnections);
+    }
 }
 
 HistoryArchive::~HistoryArchive()
 {
+    if (mClient)
+    {
+        mClient->shutdown();
+    }
 }
 
 bool
 HistoryArchive::hasGetCmd() const
 {
-    return !mConfig.mGetCmd.empty();
+    return !mConfig.mGetCmd.empty() || mClient;
 }
 
 bool
@@ -364,12 +381,36 @@ HistoryArchive::markFailure()
     mFailure++;
 }
 
+void
+HistoryArchive::markDownloaded(uint64_t bytes,
+                               std::chrono::microseconds duration)
+{
+    mConsecutiveFailures = 0;
+    mDownloadBytes.Mark(bytes);
+    // tiny files say more about latency than throughput
+    if (bytes < 4096 || duration.count() <= 0)
+    {
+        return;
+    }
+    auto sample = bytes * 1000000.0 / duration.count();
+    mThroughput =
+        mThroughput == 0 ? sample : mThroughput + (sample - mThroughput) / 4;
+}
+
+void
+HistoryArchive::markDownloadFailed()
+{
+    mConsecutiveFailures++;
+    mDownloadFailures.Mark();
+}
+
 Json::Value
 HistoryArchive::getJsonInfo() const
 {
     Json::Value result;
     result["success"] = mSuccess;
     result["failure"] = mFailure;
+    result["throughput"] = static_cast<Json::UInt64>(mThroughput);
     return result;
 }
 }
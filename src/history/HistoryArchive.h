@@ -9,6 +9,7 @@
 #include "xdr/Stellar-types.h"
 
 #include <cereal/cereal.hpp>
+#include <chrono>
 #include <lib/json/json.h>
 #include <memory>
 #include <string>
@@ -24,12 +25,18 @@ namespace Json
 class Value;
 }
 
+namespace medida
+{
+class Meter;
+}
+
 namespace stellar
 {
 
 class Application;
 class BucketList;
 class Bucket;
+class HistoryArchiveClient;
 
 struct HistoryStateBucket
 {
@@ -137,8 +144,11 @@ struct HistoryArchiveState
 class HistoryArchive : public std::enable_shared_from_this<HistoryArchive>
 {
   public:
-    explicit HistoryArchive(HistoryArchiveConfiguration const& config);
+    HistoryArchive(Application& app,
+                   HistoryArchiveConfiguration const& config);
     ~HistoryArchive();
+    // true if files can be downloaded, with a get command or the built-in
+    // client
     bool hasGetCmd() const;
     bool hasPutCmd() const;
     bool hasMkdirCmd() const;
@@ -150,14 +160,48 @@ class HistoryArchive : public std::enable_shared_from_this<HistoryArchive>
                            std::string const& remote) const;
     std::string mkdirCmd(std::string const& remoteDir) const;
 
+    // client to download files with, for archives configured with a url
+    // (nullptr otherwise)
+    std::shared_ptr<HistoryArchiveClient> const&
+    getClient() const
+    {
+        return mClient;
+    }
+
     void markSuccess();
     void markFailure();
 
+    // records a download of @p bytes that took @p duration, to estimate the
+    // throughput of the archive
+    void markDownloaded(uint64_t bytes, std::chrono::microseconds duration);
+    // records a failed download attempt
+    void markDownloadFailed();
+
+    // estimated download throughput, in bytes per second (0 if unknown)
+    double
+    getThroughput() const
+    {
+        return mThroughput;
+    }
+
+    // failed download attempts since the last successful one
+    uint32_t
+    getConsecutiveFailures() const
+    {
+        return mConsecutiveFailures;
+    }
+
     Json::Value getJsonInfo() const;
 
   private:
     HistoryArchiveConfiguration mConfig;
+    std::shared_ptr<HistoryArchiveClient> mClient;
     uint32_t mSuccess{0};
     uint32_t mFailure{0};
+    double mThroughput{0};
+    uint32_t mConsecutiveFailures{0};
+
+    medida::Meter& mDownloadBytes;
+    medida::Meter& mDownloadFailures;
 };
 }
@@ -0,0 +1,783 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "history/HistoryArchiveClient.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace stellar
+{
+
+using asio::ip::tcp;
+
+std::chrono::milliseconds const HistoryArchiveClient::DEFAULT_TIMEOUT =
+    std::chrono::seconds(30);
+
+// size of the reads of response bodies
+static size_t const READ_BUFFER_SIZE = 64 * 1024;
+
+struct HistoryArchiveClient::Request
+{
+    std::string mRemote;
+    std::string mLocal;
+    Handler mHandler;
+    // bytes of mLocal already downloaded, by a previous attempt
+    uint64_t mOffset{0};
+    // the part of mRemote to download, all of it if mRangeSize is 0
+    uint64_t mRangeStart{0};
+    uint64_t mRangeSize{0};
+    size_t mAttempts{0};
+};
+
+namespace
+{
+
+struct ResponseHeaders
+{
+    std::string mVersion;
+    unsigned int mStatus{0};
+    // header names are lower case
+    std::map<std::string, std::string> mFields;
+
+    bool
+    has(std::string const& name) const
+    {
+        return mFields.find(name) != mFields.end();
+    }
+
+    std::string
+    get(std::string const& name) const
+    {
+        auto it = mFields.find(name);
+        return it == mFields.end() ? std::string{} : it->second;
+    }
+};
+
+std::string
+toLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+std::string
+trim(std::string const& s)
+{
+    auto b = s.find_first_not_of(" \t\r");
+    if (b == std::string::npos)
+    {
+        return {};
+    }
+    auto e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
+
+bool
+parseResponseHeaders(std::string const& text, ResponseHeaders& res)
+{
+    std::istringstream in(text);
+    std::string line;
+    if (!std::getline(in, line))
+    {
+        return false;
+    }
+    std::istringstream status(line);
+    if (!(status >> res.mVersion >> res.mStatus) ||
+        res.mVersion.compare(0, 5, "HTTP/") != 0)
+    {
+        return false;
+    }
+    while (std::getline(in, line))
+    {
+        auto colon = line.find(':');
+        if (colon != std::string::npos)
+        {
+            res.mFields[toLower(trim(line.substr(0, colon)))] =
+                trim(line.substr(colon + 1));
+        }
+    }
+    return true;
+}
+
+asio::error_code
+statusError(unsigned int status)
+{
+    return std::make_error_code(status == 404
+                                    ? std::errc::no_such_file_or_directory
+                                    : std::errc::protocol_error);
+}
+}
+
+// One keep-alive connection, requests are written as soon as they are sent
+// to it and responses read in order.
+class HistoryArchiveClient::Connection
+    : public std::enable_shared_from_this<Connection>
+{
+    std::weak_ptr<HistoryArchiveClient> mClient;
+    tcp::resolver mResolver;
+    tcp::socket mSocket;
+    bool mConnected{false};
+    bool mClosed{false};
+
+    // fails the connection when the oldest request makes no progress
+    VirtualTimer mDeadline;
+    std::chrono::milliseconds const mTimeout;
+
+    // requests sent, oldest first, and their part not written out yet
+    std::deque<std::shared_ptr<Request>> mSent;
+    std::deque<std::string> mWriteQueue;
+    bool mWriting{false};
+
+    // the response to mSent.front() being read
+    asio::streambuf mHeaderBuffer;
+    std::vector<char> mReadBuffer;
+    ResponseHeaders mHeaders;
+    asio::error_code mResult;
+    std::ofstream mOut;
+    uint64_t mRemaining{0};
+    bool mUntilEOF{false};
+    bool mKeepAlive{true};
+
+    void startWrite();
+    // restarts the deadline, stops it if the connection is idle
+    void armDeadline();
+    void readHeaders();
+    void onHeaders(size_t n);
+    void readBody();
+    void consumeBody(char const* data, size_t n);
+    void finishResponse();
+
+  public:
+    Connection(VirtualClock& clock, std::weak_ptr<HistoryArchiveClient> client,
+               std::chrono::milliseconds timeout)
+        : mClient(client)
+        , mResolver(clock.getIOService())
+        , mSocket(clock.getIOService())
+        , mDeadline(clock)
+        , mTimeout(timeout)
+    {
+    }
+
+    void connect(std::string const& host, unsigned short port);
+    void send(std::shared_ptr<Request> req, std::string data);
+    // gives the requests without a response back to the client
+    void close(asio::error_code const& ec);
+
+    bool
+    isClosed() const
+    {
+        return mClosed;
+    }
+
+    size_t
+    getLoad() const
+    {
+        return mSent.size();
+    }
+};
+
+void
+HistoryArchiveClient::Connection::connect(std::string const& host,
+                                          unsigned short port)
+{
+    auto self = shared_from_this();
+    armDeadline();
+    tcp::resolver::query query(host, std::to_string(port));
+    mResolver.async_resolve(query, [self](asio::error_code const& ec,
+                                          tcp::resolver::iterator it) {
+        if (self->mClosed)
+        {
+            return;
+        }
+        if (ec)
+        {
+            self->close(ec);
+            return;
+        }
+        asio::async_connect(
+            self->mSocket, it,
+            [self](asio::error_code const& ec, tcp::resolver::iterator) {
+                if (self->mClosed)
+                {
+                    return;
+                }
+                if (ec)
+                {
+                    self->close(ec);
+                    return;
+                }
+                self->mConnected = true;
+                self->armDeadline();
+                self->startWrite();
+                self->readHeaders();
+            });
+    });
+}
+
+void
+HistoryArchiveClient::Connection::send(std::shared_ptr<Request> req,
+                                       std::string data)
+{
+    mSent.emplace_back(std::move(req));
+    mWriteQueue.emplace_back(std::move(data));
+    if (mConnected && mSent.size() == 1)
+    {
+        // was idle
+        armDeadline();
+    }
+    startWrite();
+}
+
+void
+HistoryArchiveClient::Connection::armDeadline()
+{
+    if (mClosed || (mConnected && mSent.empty()))
+    {
+        mDeadline.cancel();
+        return;
+    }
+    std::weak_ptr<Connection> weak = shared_from_this();
+    mDeadline.expires_from_now(mTimeout);
+    mDeadline.async_wait(
+        [weak]() {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->close(std::make_error_code(std::errc::timed_out));
+            }
+        },
+        VirtualTimer::onFailureNoop);
+}
+
+void
+HistoryArchiveClient::Connection::startWrite()
+{
+    if (!mConnected || mClosed || mWriting || mWriteQueue.empty())
+    {
+        return;
+    }
+    mWriting = true;
+    auto self = shared_from_this();
+    // deque elements stay in place while others are added
+    asio::async_write(mSocket, asio::buffer(mWriteQueue.front()),
+                      [self](asio::error_code const& ec, size_t) {
+                          self->mWriting = false;
+                          if (self->mClosed)
+                          {
+                              return;
+                          }
+                          if (ec)
+                          {
+                              self->close(ec);
+                              return;
+                          }
+                          self->mWriteQueue.pop_front();
+                          self->startWrite();
+                      });
+}
+
+void
+HistoryArchiveClient::Connection::readHeaders()
+{
+    auto self = shared_from_this();
+    asio::async_read_until(mSocket, mHeaderBuffer, "\r\n\r\n",
+                           [self](asio::error_code const& ec, size_t n) {
+                               if (self->mClosed)
+                               {
+                                   return;
+                               }
+                               if (ec)
+                               {
+                                   // also the server closing an idle
+                                   // connection
+                                   self->close(ec);
+                                   return;
+                               }
+                               self->onHeaders(n);
+                           });
+}
+
+void
+HistoryArchiveClient::Connection::onHeaders(size_t n)
+{
+    auto begin = asio::buffers_begin(mHeaderBuffer.data());
+    std::string text(begin, begin + n);
+    mHeaderBuffer.consume(n);
+    armDeadline();
+
+    mHeaders = ResponseHeaders{};
+    if (mSent.empty() || !parseResponseHeaders(text, mHeaders))
+    {
+        close(std::make_error_code(std::errc::protocol_error));
+        return;
+    }
+    auto& req = *mSent.front();
+
+    mKeepAlive = toLower(mHeaders.get("connection")) != "close" &&
+                 (mHeaders.mVersion != "HTTP/1.0" ||
+                  toLower(mHeaders.get("connection")) == "keep-alive");
+    if (mHeaders.has("transfer-encoding") &&
+        toLower(mHeaders.get("transfer-encoding")) != "identity")
+    {
+        // can't tell where the body ends
+        CLOG(WARNING, "History") << "Unsupported transfer encoding for "
+                                 << req.mRemote;
+        mResult = std::make_error_code(std::errc::not_supported);
+        mKeepAlive = false;
+        finishResponse();
+        return;
+    }
+    mUntilEOF = !mHeaders.has("content-length");
+    mRemaining = 0;
+    if (!mUntilEOF)
+    {
+        try
+        {
+            mRemaining = std::stoull(mHeaders.get("content-length"));
+        }
+        catch (std::exception&)
+        {
+            close(std::make_error_code(std::errc::protocol_error));
+            return;
+        }
+    }
+
+    mResult = asio::error_code{};
+    auto rangeStart =
+        "bytes " + std::to_string(req.mRangeStart + req.mOffset) + "-";
+    if ((mHeaders.mStatus == 200 && req.mRangeSize == 0) ||
+        (mHeaders.mStatus == 206 &&
+         (req.mOffset != 0 || req.mRangeSize != 0) &&
+         mHeaders.get("content-range").compare(0, rangeStart.size(),
+                                               rangeStart) == 0))
+    {
+        if (mHeaders.mStatus == 200)
+        {
+            // the whole file, even if the rest was asked for
+            req.mOffset = 0;
+        }
+        mOut.open(req.mLocal, std::ios::binary |
+                                  (req.mOffset == 0 ? std::ios::trunc
+                                                    : std::ios::app));
+        if (!mOut)
+        {
+            mResult = std::make_error_code(std::errc::io_error);
+        }
+    }
+    else if (mHeaders.mStatus == 200)
+    {
+        // the whole file rather than the range asked for
+        CLOG(WARNING, "History") << "No range support for " << req.mRemote;
+        mResult = std::make_error_code(std::errc::not_supported);
+    }
+    else
+    {
+        CLOG(DEBUG, "History") << "HTTP status " << mHeaders.mStatus
+                               << " for " << req.mRemote;
+        mResult = mHeaders.mStatus == 206
+                      ? std::make_error_code(std::errc::protocol_error)
+                      : statusError(mHeaders.mStatus);
+    }
+
+    // the end of the headers buffer may already hold some of the body
+    size_t size = mHeaderBuffer.size();
+    if (!mUntilEOF)
+    {
+        size = static_cast<size_t>(std::min<uint64_t>(size, mRemaining));
+    }
+    if (size != 0)
+    {
+        auto data = asio::buffers_begin(mHeaderBuffer.data());
+        std::string body(data, data + size);
+        consumeBody(body.data(), size);
+        mHeaderBuffer.consume(size);
+    }
+    if (!mUntilEOF && mRemaining == 0)
+    {
+        finishResponse();
+    }
+    else
+    {
+        readBody();
+    }
+}
+
+void
+HistoryArchiveClient::Connection::consumeBody(char const* data, size_t n)
+{
+    if (mOut.is_open() && !mResult)
+    {
+        mOut.write(data, n);
+        if (!mOut)
+        {
+            mResult = std::make_error_code(std::errc::io_error);
+        }
+        else
+        {
+            mSent.front()->mOffset += n;
+        }
+    }
+    if (!mUntilEOF)
+    {
+        mRemaining -= n;
+    }
+}
+
+void
+HistoryArchiveClient::Connection::readBody()
+{
+    mReadBuffer.resize(READ_BUFFER_SIZE);
+    auto self = shared_from_this();
+    mSocket.async_read_some(
+        asio::buffer(mReadBuffer),
+        [self](asio::error_code const& ec, size_t n) {
+            if (self->mClosed)
+            {
+                return;
+            }
+            if (ec)
+            {
+                if (ec == asio::error::eof && self->mUntilEOF)
+                {
+                    self->mKeepAlive = false;
+                    self->finishResponse();
+                }
+                else
+                {
+                    self->close(ec);
+                }
+                return;
+            }
+
+            self->armDeadline();
+            auto used = n;
+            if (!self->mUntilEOF)
+            {
+                used = static_cast<size_t>(
+                    std::min<uint64_t>(used, self->mRemaining));
+            }
+            self->consumeBody(self->mReadBuffer.data(), used);
+            if (used < n)
+            {
+                // start of the next pipelined response
+                auto extra = n - used;
+                auto dst = self->mHeaderBuffer.prepare(extra);
+                asio::buffer_copy(
+                    dst, asio::buffer(self->mReadBuffer.data() + used, extra));
+                self->mHeaderBuffer.commit(extra);
+            }
+
+            if (!self->mUntilEOF && self->mRemaining == 0)
+            {
+                self->finishResponse();
+            }
+            else
+            {
+                self->readBody();
+            }
+        });
+}
+
+void
+HistoryArchiveClient::Connection::finishResponse()
+{
+    auto req = mSent.front();
+    mSent.pop_front();
+    mOut.close();
+    if (!mResult && mOut.fail())
+    {
+        mResult = std::make_error_code(std::errc::io_error);
+    }
+
+    auto client = mClient.lock();
+    if (client)
+    {
+        client->finish(req, mResult);
+    }
+    if (!mKeepAlive)
+    {
+        close(asio::error_code{});
+        return;
+    }
+    armDeadline();
+    readHeaders();
+    if (client)
+    {
+        client->dispatch();
+    }
+}
+
+void
+HistoryArchiveClient::Connection::close(asio::error_code const& ec)
+{
+    if (mClosed)
+    {
+        return;
+    }
+    mClosed = true;
+    mDeadline.cancel();
+    asio::error_code ignored;
+    mResolver.cancel();
+    mSocket.close(ignored);
+    mOut.close();
+
+    auto sent = std::move(mSent);
+    mSent.clear();
+    auto client = mClient.lock();
+    if (!client)
+    {
+        return;
+    }
+    if (ec)
+    {
+        CLOG(DEBUG, "History") << "HTTP connection to " << client->mHost
+                               << " failed: " << ec.message();
+    }
+    // back to the front of the queue, in the same order
+    for (auto it = sent.rbegin(); it != sent.rend(); ++it)
+    {
+        client->requeue(*it, ec);
+    }
+    client->dispatch();
+}
+
+bool
+HistoryArchiveClient::parseURL(std::string const& url, std::string& host,
+                               unsigned short& port, std::string& path)
+{
+    static std::string const scheme = "http://";
+    if (toLower(url.substr(0, scheme.size())) != scheme)
+    {
+        return false;
+    }
+    auto rest = url.substr(scheme.size());
+    auto slash = rest.find('/');
+    auto authority = rest.substr(0, slash);
+    path = slash == std::string::npos ? std::string{} : rest.substr(slash);
+    while (!path.empty() && path.back() == '/')
+    {
+        path.pop_back();
+    }
+
+    auto colon = authority.find(':');
+    host = authority.substr(0, colon);
+    port = 80;
+    if (colon != std::string::npos)
+    {
+        auto portStr = authority.substr(colon + 1);
+        if (portStr.empty() ||
+            portStr.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+        auto p = std::stoul(portStr);
+        if (p == 0 || p > UINT16_MAX)
+        {
+            return false;
+        }
+        port = static_cast<unsigned short>(p);
+    }
+    return !host.empty();
+}
+
+HistoryArchiveClient::HistoryArchiveClient(Application& app,
+                                           std::string const& url,
+                                           size_t connections,
+                                           std::chrono::milliseconds timeout)
+    : mApp(app)
+    , mMaxConnections(std::max<size_t>(connections, 1))
+    , mTimeout(timeout)
+    , mRequestMeter(
+          app.getMetrics().NewMeter({"history", "http", "request"}, "request"))
+    , mRetryMeter(
+          app.getMetrics().NewMeter({"history", "http", "retry"}, "request"))
+    , mFailureMeter(
+          app.getMetrics().NewMeter({"history", "http", "failure"}, "request"))
+    , mConnectMeter(app.getMetrics().NewMeter({"history", "http", "connect"},
+                                              "connection"))
+{
+    if (!parseURL(url, mHost, mPort, mPath))
+    {
+        throw std::invalid_argument("invalid history archive url: " + url);
+    }
+}
+
+HistoryArchiveClient::~HistoryArchiveClient()
+{
+    shutdown();
+}
+
+void
+HistoryArchiveClient::getFile(std::string const& remote,
+                              std::string const& local, Handler handler)
+{
+    auto req = std::make_shared<Request>();
+    req->mRemote = remote;
+    req->mLocal = local;
+    req->mHandler = std::move(handler);
+    mRequestMeter.Mark();
+    mQueue.emplace_back(req);
+    dispatch();
+}
+
+void
+HistoryArchiveClient::getFileRange(std::string const& remote, uint64_t offset,
+                                   uint64_t size, std::string const& local,
+                                   Handler handler)
+{
+    if (size == 0)
+    {
+        std::ofstream(local, std::ios::binary | std::ios::trunc);
+        mApp.getClock().getIOService().post(
+            [handler]() { handler(asio::error_code{}); });
+        return;
+    }
+    auto req = std::make_shared<Request>();
+    req->mRemote = remote;
+    req->mLocal = local;
+    req->mHandler = std::move(handler);
+    req->mRangeStart = offset;
+    req->mRangeSize = size;
+    mRequestMeter.Mark();
+    mQueue.emplace_back(req);
+    dispatch();
+}
+
+std::string
+HistoryArchiveClient::formatRequest(Request const& req) const
+{
+    std::ostringstream out;
+    out << "GET " << mPath << "/" << req.mRemote << " HTTP/1.1\r\n";
+    out << "Host: " << mHost;
+    if (mPort != 80)
+    {
+        out << ":" << mPort;
+    }
+    out << "\r\n";
+    out << "Accept: */*\r\n";
+    out << "Connection: keep-alive\r\n";
+    if (req.mRangeSize != 0)
+    {
+        out << "Range: bytes=" << req.mRangeStart + req.mOffset << "-"
+            << req.mRangeStart + req.mRangeSize - 1 << "\r\n";
+    }
+    else if (req.mOffset != 0)
+    {
+        out << "Range: bytes=" << req.mOffset << "-\r\n";
+    }
+    out << "\r\n";
+    return out.str();
+}
+
+void
+HistoryArchiveClient::dispatch()
+{
+    if (mShutdown)
+    {
+        return;
+    }
+    mConnections.erase(
+        std::remove_if(mConnections.begin(), mConnections.end(),
+                       [](std::shared_ptr<Connection> const& c) {
+                           return c->isClosed();
+                       }),
+        mConnections.end());
+
+    while (!mQueue.empty())
+    {
+        // the least busy connection, a new one rather than pipelining
+        std::shared_ptr<Connection> conn;
+        for (auto const& c : mConnections)
+        {
+            if (c->getLoad() < PIPELINE_DEPTH &&
+                (!conn || c->getLoad() < conn->getLoad()))
+            {
+                conn = c;
+            }
+        }
+        if ((!conn || conn->getLoad() != 0) &&
+            mConnections.size() < mMaxConnections)
+        {
+            conn = std::make_shared<Connection>(mApp.getClock(),
+                                                shared_from_this(), mTimeout);
+            mConnections.emplace_back(conn);
+            mConnectMeter.Mark();
+            conn->connect(mHost, mPort);
+        }
+        if (!conn)
+        {
+            break;
+        }
+
+        auto req = mQueue.front();
+        mQueue.pop_front();
+        conn->send(req, formatRequest(*req));
+    }
+}
+
+void
+HistoryArchiveClient::requeue(std::shared_ptr<Request> const& req,
+                              asio::error_code const& ec)
+{
+    if (mShutdown)
+    {
+        finish(req, asio::error::operation_aborted);
+        return;
+    }
+    if (ec && ++req->mAttempts >= MAX_ATTEMPTS)
+    {
+        finish(req, ec);
+        return;
+    }
+    mRetryMeter.Mark();
+    mQueue.emplace_front(req);
+}
+
+void
+HistoryArchiveClient::finish(std::shared_ptr<Request> const& req,
+                             asio::error_code const& ec)
+{
+    if (ec)
+    {
+        mFailureMeter.Mark();
+    }
+    // from the top of the stack, handlers may start other downloads
+    auto handler = req->mHandler;
+    mApp.getClock().getIOService().post([handler, ec]() { handler(ec); });
+}
+
+void
+HistoryArchiveClient::shutdown()
+{
+    if (mShutdown)
+    {
+        return;
+    }
+    mShutdown = true;
+    auto connections = std::move(mConnections);
+    mConnections.clear();
+    for (auto const& c : connections)
+    {
+        c->close(asio::error::operation_aborted);
+    }
+    auto queue = std::move(mQueue);
+    mQueue.clear();
+    for (auto const& req : queue)
+    {
+        finish(req, asio::error::operation_aborted);
+    }
+}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Built-in client for history archives served over HTTP, used instead of a
+ * `get` command by archives configured with a `url` (see HistoryArchive).
+ *
+ * Files are downloaded over at most `connections` keep-alive connections to
+ * the server, each of them with up to PIPELINE_DEPTH pipelined requests;
+ * requests beyond that wait in a queue. A connection that fails gives its
+ * requests back to the queue, and a download interrupted in its body resumes
+ * where it stopped with a range request. A connection is dropped, as failed,
+ * when it is not connected or does not receive any of the response to its
+ * oldest request within the timeout. A request is given up after
+ * MAX_ATTEMPTS failed connections.
+ *
+ * Responses need a Content-Length or to end with the connection, as static
+ * file servers and cloud storages do. There is no TLS support.
+ */
+class HistoryArchiveClient
+    : public std::enable_shared_from_this<HistoryArchiveClient>,
+      public NonMovableOrCopyable
+{
+  public:
+    typedef std::function<void(asio::error_code const&)> Handler;
+
+    static size_t const PIPELINE_DEPTH = 4;
+    static size_t const MAX_ATTEMPTS = 3;
+    static std::chrono::milliseconds const DEFAULT_TIMEOUT;
+
+    // splits a `http://host[:port][/path]` url, returns false if it is not
+    // one (path is returned without trailing slash)
+    static bool parseURL(std::string const& url, std::string& host,
+                         unsigned short& port, std::string& path);
+
+    // throws std::invalid_argument if @p url can't be parsed
+    HistoryArchiveClient(Application& app, std::string const& url,
+                         size_t connections,
+                         std::chrono::milliseconds timeout = DEFAULT_TIMEOUT);
+    ~HistoryArchiveClient();
+
+    // downloads @p remote (a path relative to the url) to the file
+    // @p local, @p handler is then called from the main thread
+    void getFile(std::string const& remote, std::string const& local,
+                 Handler handler);
+
+    // downloads the @p size bytes at @p offset in @p remote to the file
+    // @p local, with a range request; fails with std::errc::not_supported
+    // if the server ignores ranges
+    void getFileRange(std::string const& remote, uint64_t offset,
+                      uint64_t size, std::string const& local,
+                      Handler handler);
+
+    // drops all connections, pending requests fail
+    void shutdown();
+
+    size_t
+    getConnectionsCount() const
+    {
+        return mConnections.size();
+    }
+
+  private:
+    struct Request;
+    class Connection;
+
+    Application& mApp;
+    std::string mHost;
+    unsigned short mPort;
+    std::string mPath;
+    size_t const mMaxConnections;
+    std::chrono::milliseconds const mTimeout;
+    bool mShutdown{false};
+
+    std::deque<std::shared_ptr<Request>> mQueue;
+    std::vector<std::shared_ptr<Connection>> mConnections;
+
+    medida::Meter& mRequestMeter;
+    medida::Meter& mRetryMeter;
+    medida::Meter& mFailureMeter;
+    medida::Meter& mConnectMeter;
+
+    std::string formatRequest(Request const& req) const;
+    void dispatch();
+    // a connection gave @p req back after an error (or after the server
+    // closed it, if @p ec is not set)
+    void requeue(std::shared_ptr<Request> const& req,
+                 asio::error_code const& ec);
+    void finish(std::shared_ptr<Request> const& req,
+                asio::error_code const& ec);
+};
+}
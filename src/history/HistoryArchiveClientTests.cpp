@@ -0,0 +1,367 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "history/HistoryArchiveClient.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+#include "util/Timer.h"
+#include "util/TmpDir.h"
+
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+using namespace stellar;
+using asio::ip::tcp;
+
+namespace
+{
+
+// Serves mFiles over keep-alive connections, answering pipelined requests
+// in order; range requests are honored unless mIgnoreRanges.
+class TestHttpServer
+{
+    asio::io_service& mIO;
+    tcp::acceptor mAcceptor;
+
+    void
+    accept()
+    {
+        auto socket = std::make_shared<tcp::socket>(mIO);
+        mAcceptor.async_accept(*socket,
+                               [this, socket](asio::error_code const& ec) {
+                                   if (ec)
+                                   {
+                                       return;
+                                   }
+                                   mConnections++;
+                                   serve(socket,
+                                         std::make_shared<asio::streambuf>());
+                                   accept();
+                               });
+    }
+
+    void
+    serve(std::shared_ptr<tcp::socket> socket,
+          std::shared_ptr<asio::streambuf> buf)
+    {
+        asio::async_read_until(
+            *socket, *buf, "\r\n\r\n",
+            [this, socket, buf](asio::error_code const& ec, size_t n) {
+                if (ec)
+                {
+                    return;
+                }
+                auto begin = asio::buffers_begin(buf->data());
+                std::string request(begin, begin + n);
+                buf->consume(n);
+                respond(socket, buf, request);
+            });
+    }
+
+    void
+    respond(std::shared_ptr<tcp::socket> socket,
+            std::shared_ptr<asio::streambuf> buf, std::string const& request)
+    {
+        std::istringstream in(request);
+        std::string method, path;
+        in >> method >> path;
+        mRequests.push_back(path);
+        if (mSilent)
+        {
+            // keeps the connection open, without answering
+            mSilentSockets.emplace_back(socket);
+            return;
+        }
+
+        // bytes=offset-[last]
+        bool partial = false;
+        size_t offset = 0;
+        size_t last = std::string::npos;
+        auto range = request.find("Range: bytes=");
+        if (range != std::string::npos && !mIgnoreRanges)
+        {
+            partial = true;
+            auto spec = request.substr(range + 13);
+            offset = std::stoul(spec);
+            auto end = spec.substr(spec.find('-') + 1);
+            if (!end.empty() && std::isdigit(end[0]))
+            {
+                last = std::stoul(end);
+            }
+        }
+
+        auto response = std::make_shared<std::string>();
+        bool cut = false;
+        auto file = mFiles.find(path);
+        if (file == mFiles.end())
+        {
+            *response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        }
+        else
+        {
+            auto const& content = file->second;
+            last = std::min(last, content.size() - 1);
+            auto body = content.substr(offset, last + 1 - offset);
+            *response = partial ? "HTTP/1.1 206 Partial Content\r\n"
+                                : "HTTP/1.1 200 OK\r\n";
+            *response +=
+                "Content-Length: " + std::to_string(body.size()) + "\r\n";
+            if (partial)
+            {
+                *response += "Content-Range: bytes " + std::to_string(offset) +
+                             "-" + std::to_string(last) + "/" +
+                             std::to_string(content.size()) + "\r\n";
+            }
+            *response += "\r\n";
+            if (mCutNextResponse)
+            {
+                mCutNextResponse = false;
+                cut = true;
+                body.resize(body.size() / 2);
+            }
+            *response += body;
+        }
+
+        asio::async_write(*socket, asio::buffer(*response),
+                          [this, socket, buf, response,
+                           cut](asio::error_code const& ec, size_t) {
+                              if (ec)
+                              {
+                                  return;
+                              }
+                              if (cut)
+                              {
+                                  socket->close();
+                                  return;
+                              }
+                              serve(socket, buf);
+                          });
+    }
+
+  public:
+    std::map<std::string, std::string> mFiles;
+    std::vector<std::string> mRequests;
+    size_t mConnections{0};
+    // sends half of the next body, then drops the connection
+    bool mCutNextResponse{false};
+    bool mIgnoreRanges{false};
+    // reads requests but never answers them
+    bool mSilent{false};
+    std::vector<std::shared_ptr<tcp::socket>> mSilentSockets;
+
+    explicit TestHttpServer(asio::io_service& io)
+        : mIO(io)
+        , mAcceptor(io, tcp::endpoint(asio::ip::address_v4::loopback(), 0))
+    {
+        accept();
+    }
+
+    unsigned short
+    getPort() const
+    {
+        return mAcceptor.local_endpoint().port();
+    }
+};
+
+std::string
+readFile(std::string const& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+}
+}
+
+TEST_CASE("history archive url", "[history][httpclient]")
+{
+    std::string host, path;
+    unsigned short port;
+    REQUIRE(HistoryArchiveClient::parseURL("http://example.com", host, port,
+                                           path));
+    REQUIRE(host == "example.com");
+    REQUIRE(port == 80);
+    REQUIRE(path == "");
+
+    REQUIRE(HistoryArchiveClient::parseURL("http://127.0.0.1:8080/a/b/", host,
+                                           port, path));
+    REQUIRE(host == "127.0.0.1");
+    REQUIRE(port == 8080);
+    REQUIRE(path == "/a/b");
+
+    REQUIRE(!HistoryArchiveClient::parseURL("https://example.com/a", host,
+                                            port, path));
+    REQUIRE(!HistoryArchiveClient::parseURL("http://example.com:x/a", host,
+                                            port, path));
+    REQUIRE(!HistoryArchiveClient::parseURL("http:///a", host, port, path));
+}
+
+TEST_CASE("history archive client", "[history][httpclient]")
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto app = createTestApplication(clock, getTestConfig());
+    auto dir = app->getTmpDirManager().tmpDir("httpclient");
+
+    TestHttpServer server(clock.getIOService());
+    for (size_t i = 0; i < 10; i++)
+    {
+        server.mFiles["/archive/file-" + std::to_string(i)] =
+            std::string(1000 * i * i, static_cast<char>('a' + i));
+    }
+
+    auto url = "http://127.0.0.1:" + std::to_string(server.getPort()) +
+               "/archive/";
+    std::map<std::string, asio::error_code> results;
+    auto getFile = [&](HistoryArchiveClient& client, std::string const& name) {
+        client.getFile(name, dir.getName() + "/" + name,
+                       [&results, name](asio::error_code const& ec) {
+                           results[name] = ec;
+                       });
+    };
+    auto waitFor = [&](size_t n) {
+        while (results.size() < n)
+        {
+            clock.crank(true);
+        }
+    };
+
+    SECTION("pipelines requests over the connections")
+    {
+        size_t connections = 0;
+        SECTION("one connection")
+        {
+            connections = 1;
+        }
+        SECTION("several connections")
+        {
+            connections = 3;
+        }
+        auto client =
+            std::make_shared<HistoryArchiveClient>(*app, url, connections);
+        for (size_t i = 0; i < 10; i++)
+        {
+            getFile(*client, "file-" + std::to_string(i));
+        }
+        waitFor(10);
+
+        REQUIRE(server.mConnections == connections);
+        REQUIRE(server.mRequests.size() == 10);
+        for (size_t i = 0; i < 10; i++)
+        {
+            auto name = "file-" + std::to_string(i);
+            REQUIRE(!results[name]);
+            REQUIRE(readFile(dir.getName() + "/" + name) ==
+                    server.mFiles["/archive/" + name]);
+        }
+    }
+
+    SECTION("missing file")
+    {
+        auto client = std::make_shared<HistoryArchiveClient>(*app, url, 1);
+        getFile(*client, "missing");
+        getFile(*client, "file-3");
+        waitFor(2);
+        REQUIRE(results["missing"] ==
+                std::make_error_code(std::errc::no_such_file_or_directory));
+        REQUIRE(!results["file-3"]);
+        // the connection survives errors
+        REQUIRE(server.mConnections == 1);
+    }
+
+    SECTION("resumes interrupted downloads")
+    {
+        auto client = std::make_shared<HistoryArchiveClient>(*app, url, 1);
+        server.mCutNextResponse = true;
+        getFile(*client, "file-9");
+        waitFor(1);
+        REQUIRE(!results["file-9"]);
+        REQUIRE(server.mConnections == 2);
+        REQUIRE(server.mRequests.size() == 2);
+        REQUIRE(readFile(dir.getName() + "/file-9") ==
+                server.mFiles["/archive/file-9"]);
+    }
+
+    SECTION("downloads ranges")
+    {
+        auto client = std::make_shared<HistoryArchiveClient>(*app, url, 1);
+        auto getRange = [&](std::string const& name, uint64_t offset,
+                            uint64_t size) {
+            client->getFileRange("file-9", offset, size,
+                                 dir.getName() + "/" + name,
+                                 [&results, name](asio::error_code const& ec) {
+                                     results[name] = ec;
+                                 });
+        };
+        auto const& content = server.mFiles["/archive/file-9"];
+
+        getRange("start", 0, 100);
+        getRange("middle", 5000, 2345);
+        getRange("empty", 5000, 0);
+        waitFor(3);
+        REQUIRE(!results["start"]);
+        REQUIRE(readFile(dir.getName() + "/start") == content.substr(0, 100));
+        REQUIRE(!results["middle"]);
+        REQUIRE(readFile(dir.getName() + "/middle") ==
+                content.substr(5000, 2345));
+        REQUIRE(!results["empty"]);
+        REQUIRE(readFile(dir.getName() + "/empty").empty());
+
+        // a range resumes where it was interrupted
+        server.mCutNextResponse = true;
+        getRange("resumed", 1000, 50000);
+        waitFor(4);
+        REQUIRE(!results["resumed"]);
+        REQUIRE(readFile(dir.getName() + "/resumed") ==
+                content.substr(1000, 50000));
+
+        server.mIgnoreRanges = true;
+        getRange("ignored", 1000, 10);
+        waitFor(5);
+        REQUIRE(results["ignored"] ==
+                std::make_error_code(std::errc::not_supported));
+    }
+
+    SECTION("times out on a server that never answers")
+    {
+        auto client = std::make_shared<HistoryArchiveClient>(
+            *app, url, 1, std::chrono::milliseconds(100));
+        // idle connections don't time out
+        getFile(*client, "file-1");
+        waitFor(1);
+        REQUIRE(!results["file-1"]);
+        VirtualTimer timer(clock);
+        bool waited = false;
+        timer.expires_from_now(std::chrono::milliseconds(300));
+        timer.async_wait([&waited]() { waited = true; },
+                         &VirtualTimer::onFailureNoop);
+        while (!waited)
+        {
+            clock.crank(true);
+        }
+        REQUIRE(server.mConnections == 1);
+
+        server.mSilent = true;
+        getFile(*client, "file-2");
+        waitFor(2);
+        REQUIRE(results["file-2"] ==
+                std::make_error_code(std::errc::timed_out));
+        // on the idle connection, then on a new one for each retry
+        size_t const attempts = HistoryArchiveClient::MAX_ATTEMPTS;
+        REQUIRE(server.mConnections == attempts);
+        REQUIRE(server.mRequests.size() == 1 + attempts);
+    }
+
+    SECTION("gives up once the server is gone")
+    {
+        auto client = std::make_shared<HistoryArchiveClient>(
+            *app, "http://127.0.0.1:1/archive", 1);
+        getFile(*client, "file-1");
+        waitFor(1);
+        REQUIRE(results["file-1"]);
+    }
+}
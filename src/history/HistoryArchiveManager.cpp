@@ -12,7 +12,9 @@
 #include "util/Math.h"
 #include "work/WorkManager.h"
 
+#include <algorithm>
 #include <lib/json/json.h>
+#include <random>
 #include <vector>
 
 namespace stellar
@@ -21,8 +23,8 @@ namespace stellar
 HistoryArchiveManager::HistoryArchiveManager(Application& app) : mApp{app}
 {
     for (auto const& archiveConfiguration : mApp.getConfig().HISTORY)
-        mArchives.push_back(
-            std::make_shared<HistoryArchive>(archiveConfiguration.second));
+        mArchives.push_back(std::make_shared<HistoryArchive>(
+            app, archiveConfiguration.second));
 }
 
 bool
@@ -85,6 +87,14 @@ HistoryArchiveManager::checkSensibleConfig() const
             << "' has 'put' and 'get' commands, will be read and written";
     }
 
+    if (mApp.getConfig().CATCHUP_REPLAY_ONLY && !readWriteArchives.empty())
+    {
+        CLOG(FATAL, "History") << "CATCHUP_REPLAY_ONLY is set, checkpoints "
+                                  "published after a catchup would miss "
+                                  "transactions";
+        badArchives = true;
+    }
+
     for (auto const& a : readOnlyArchives)
     {
         CLOG(INFO, "History")
@@ -114,7 +124,8 @@ HistoryArchiveManager::checkSensibleConfig() const
 }
 
 std::shared_ptr<HistoryArchive>
-HistoryArchiveManager::selectRandomReadableHistoryArchive() const
+HistoryArchiveManager::selectRandomReadableHistoryArchive(
+    std::shared_ptr<HistoryArchive> const& avoid) const
 {
     std::vector<std::shared_ptr<HistoryArchive>> archives;
 
@@ -149,10 +160,39 @@ HistoryArchiveManager::selectRandomReadableHistoryArchive() const
     }
     else
     {
-        std::uniform_int_distribution<size_t> dist(0, archives.size() - 1);
+        if (avoid)
+        {
+            archives.erase(std::remove(archives.begin(), archives.end(), avoid),
+                           archives.end());
+        }
+
+        // archives with no estimate yet get the average of the known ones,
+        // so that they are tried too
+        double known = 0;
+        size_t knownCount = 0;
+        for (auto const& a : archives)
+        {
+            if (a->getThroughput() > 0)
+            {
+                known += a->getThroughput();
+                knownCount++;
+            }
+        }
+        double unknown = knownCount == 0 ? 1 : known / knownCount;
+
+        std::vector<double> weights;
+        for (auto const& a : archives)
+        {
+            auto weight = a->getThroughput() > 0 ? a->getThroughput() : unknown;
+            auto failures = std::min<uint32_t>(a->getConsecutiveFailures(), 16);
+            weights.push_back(weight / (1 << failures));
+        }
+        std::discrete_distribution<size_t> dist(weights.begin(),
+                                                weights.end());
         size_t i = dist(gRandomEngine);
-        CLOG(DEBUG, "History") << "Fetching from readable history archive #"
-                               << i << ", '" << archives[i]->getName() << "'";
+        CLOG(DEBUG, "History") << "Fetching from readable history archive '"
+                               << archives[i]->getName() << "' ("
+                               << archives[i]->getThroughput() << " B/s)";
         return archives[i];
     }
 }
@@ -27,8 +27,11 @@ class HistoryArchiveManager
     bool checkSensibleConfig() const;
 
     // Select any readable history archive. If there are more than one,
-    // select one at random.
-    std::shared_ptr<HistoryArchive> selectRandomReadableHistoryArchive() const;
+    // select one at random, weighted by their estimated throughput and
+    // avoiding the ones that recently failed (and @p avoid if there are
+    // others), so that downloads are spread over all archives.
+    std::shared_ptr<HistoryArchive> selectRandomReadableHistoryArchive(
+        std::shared_ptr<HistoryArchive> const& avoid = nullptr) const;
 
     // Initialize a named history archive by writing
     // .well-known/stellar-history.json to it.
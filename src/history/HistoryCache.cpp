@@ -0,0 +1,188 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "history/HistoryCache.h"
+#include "crypto/Hex.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+namespace stellar
+{
+
+namespace
+{
+
+// files are linked or copied under a temporary name first, so that other
+// instances never see a partial file
+bool
+linkOrCopy(std::string const& from, std::string const& to)
+{
+    auto tmp = to + "." + std::to_string(fs::getCurrentPid()) + ".tmp";
+    std::remove(tmp.c_str());
+    if (!fs::hardLink(from, tmp))
+    {
+        std::ifstream in(from, std::ifstream::binary);
+        std::ofstream out(tmp, std::ofstream::binary);
+        out << in.rdbuf();
+        out.close();
+        if (!in || !out)
+        {
+            std::remove(tmp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), to.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool
+isTmpFile(std::string const& name)
+{
+    return name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0;
+}
+}
+
+HistoryCache::HistoryCache(Application& app)
+    : mMaxSize(static_cast<uint64_t>(app.getConfig().HISTORY_CACHE_SIZE_MB)
+               << 20)
+    , mHit(app.getMetrics().NewMeter({"history", "cache", "hit"}, "file"))
+    , mMiss(app.getMetrics().NewMeter({"history", "cache", "miss"}, "file"))
+    , mAdd(app.getMetrics().NewMeter({"history", "cache", "add"}, "file"))
+    , mEvict(app.getMetrics().NewMeter({"history", "cache", "evict"}, "file"))
+{
+    auto const& dir = app.getConfig().HISTORY_CACHE_DIR_PATH;
+    if (dir.empty())
+    {
+        return;
+    }
+    // checkpoint files of different networks have the same names
+    mDir = dir + "/" + binToHex(app.getNetworkID()).substr(0, 16);
+    if (!fs::exists(mDir) && !fs::mkpath(mDir))
+    {
+        throw std::runtime_error("can't create history cache directory " +
+                                 mDir);
+    }
+    evict();
+}
+
+std::string
+HistoryCache::cachePath(std::string const& baseName) const
+{
+    return mDir + "/" + baseName;
+}
+
+bool
+HistoryCache::fetch(std::string const& baseName, std::string const& path)
+{
+    if (!isEnabled())
+    {
+        return false;
+    }
+    auto cached = cachePath(baseName);
+    if (!fs::exists(cached) || !linkOrCopy(cached, path))
+    {
+        mMiss.Mark();
+        return false;
+    }
+    fs::touch(cached);
+    CLOG(DEBUG, "History") << "Found " << baseName << " in history cache";
+    mHit.Mark();
+    return true;
+}
+
+void
+HistoryCache::add(std::string const& baseName, std::string const& path)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    auto cached = cachePath(baseName);
+    if (fs::exists(cached))
+    {
+        fs::touch(cached);
+        return;
+    }
+    uint64_t size;
+    int64_t mtime;
+    if (!fs::fileInfo(path, size, mtime) || !linkOrCopy(path, cached))
+    {
+        CLOG(WARNING, "History") << "Failed to add " << path
+                                 << " to history cache";
+        return;
+    }
+    // a hard linked file keeps its modification time
+    fs::touch(cached);
+    mAdd.Mark();
+    mSize += size;
+    if (mSize > mMaxSize)
+    {
+        evict();
+    }
+}
+
+void
+HistoryCache::remove(std::string const& baseName)
+{
+    if (isEnabled())
+    {
+        std::remove(cachePath(baseName).c_str());
+    }
+}
+
+void
+HistoryCache::evict()
+{
+    // (mtime, size, name)
+    std::vector<std::tuple<int64_t, uint64_t, std::string>> files;
+    mSize = 0;
+    for (auto const& name : fs::findfiles(
+             mDir, [](std::string const& n) { return !isTmpFile(n); }))
+    {
+        uint64_t size;
+        int64_t mtime;
+        if (fs::fileInfo(cachePath(name), size, mtime))
+        {
+            files.emplace_back(mtime, size, name);
+            mSize += size;
+        }
+    }
+    if (mSize <= mMaxSize)
+    {
+        return;
+    }
+
+    // down to 90% of the limit, so that eviction does not run on every add
+    std::sort(files.begin(), files.end());
+    auto target = mMaxSize / 10 * 9;
+    for (auto const& f : files)
+    {
+        if (mSize <= target)
+        {
+            break;
+        }
+        CLOG(DEBUG, "History") << "Evicting " << std::get<2>(f)
+                               << " from history cache";
+        std::remove(cachePath(std::get<2>(f)).c_str());
+        mSize -= std::get<1>(f);
+        mEvict.Mark();
+    }
+}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstdint>
+#include <string>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Optional persistent cache of verified history files, in
+ * HISTORY_CACHE_DIR_PATH. It survives rebuilds of a node and can be shared
+ * by the nodes of a host: downloads consult it before going to the network.
+ *
+ * Files are kept uncompressed under their archive base name (for instance
+ * `ledger-0000003f.xdr`), in a directory per network. Only files that were
+ * verified are added: buckets once their hash is checked, ledger headers once
+ * their chain is verified and transactions once all of their ledgers were
+ * applied. Files are hard linked in and out of the cache when possible, so a
+ * hit costs no copy.
+ *
+ * The last modification time of a file is its last use: when the cache grows
+ * over HISTORY_CACHE_SIZE_MB, the least recently used files are evicted.
+ */
+class HistoryCache : public NonMovableOrCopyable
+{
+    std::string mDir;
+    uint64_t const mMaxSize;
+    // estimate of mDir's size, only refreshed by evict() since other
+    // instances can use mDir
+    uint64_t mSize{0};
+
+    medida::Meter& mHit;
+    medida::Meter& mMiss;
+    medida::Meter& mAdd;
+    medida::Meter& mEvict;
+
+    std::string cachePath(std::string const& baseName) const;
+    void evict();
+
+  public:
+    explicit HistoryCache(Application& app);
+
+    bool
+    isEnabled() const
+    {
+        return !mDir.empty();
+    }
+
+    // Makes @p path a copy of the cached file @p baseName, returns false if
+    // it is not cached.
+    bool fetch(std::string const& baseName, std::string const& path);
+
+    // Adds the verified file @p path to the cache, as @p baseName.
+    void add(std::string const& baseName, std::string const& path);
+
+    // Drops @p baseName from the cache (if it turns out to be invalid).
+    void remove(std::string const& baseName);
+};
+}
@@ -179,6 +179,7 @@ class BucketList;
 class Config;
 class Database;
 class HistoryArchive;
+class HistoryCache;
 struct StateSnapshot;
 
 class HistoryManager
@@ -270,6 +271,10 @@ class HistoryManager
     // queue.
     virtual std::vector<std::string> getBucketsReferencedByPublishQueue() = 0;
 
+    // The publish queue is mirrored in memory, read from the database on
+    // first use: forget it once the publishqueue table is recreated.
+    virtual void clearPublishQueueCache() = 0;
+
     // Callback from Publication, indicates that a given snapshot was
     // published. The `success` parameter indicates whether _all_ the
     // configured archives published correctly; if so the snapshot
@@ -287,8 +292,13 @@ class HistoryManager
     // Return the HistoryArchiveState of the LedgerManager's LCL
     virtual HistoryArchiveState getLastClosedHistoryArchiveState() const = 0;
 
-    // Infer a quorum set by reading SCP messages in history archives.
-    virtual InferredQuorum inferQuorum() = 0;
+    // Infer a quorum set by reading SCP messages in history archives. With a
+    // @p stateFile, the quorum inferred last time is read from it, extended
+    // with the checkpoints published since, and written back.
+    virtual InferredQuorum inferQuorum(std::string const& stateFile) = 0;
+
+    // Return the persistent cache of verified history files.
+    virtual HistoryCache& getCache() = 0;
 
     // Return the name of the HistoryManager's tmpdir (used for storing files in
     // transit).
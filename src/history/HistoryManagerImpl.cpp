@@ -12,8 +12,10 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "herder/HerderImpl.h"
+#include "herder/HerderPersistence.h"
 #include "history/HistoryArchive.h"
 #include "history/HistoryArchiveManager.h"
+#include "history/HistoryCache.h"
 #include "history/HistoryManagerImpl.h"
 #include "history/StateSnapshot.h"
 #include "historywork/FetchRecentQsetsWork.h"
@@ -149,17 +151,60 @@ HistoryManagerImpl::logAndUpdatePublishStatus()
     }
 }
 
+std::map<uint32_t, std::string> const&
+HistoryManagerImpl::getPublishQueue() const
+{
+    if (!mPublishQueueLoaded)
+    {
+        uint32_t ledger;
+        std::string state;
+        auto prep = mApp.getDatabase().getPreparedStatement(
+            "SELECT ledger, state FROM publishqueue;");
+        auto& st = prep.statement();
+        st.exchange(soci::into(ledger));
+        st.exchange(soci::into(state));
+        st.define_and_bind();
+        st.execute(true);
+        PublishQueueBuckets::BucketCount buckets;
+        while (st.got_data())
+        {
+            HistoryArchiveState has;
+            has.fromString(state);
+            for (auto const& b : has.allBuckets())
+            {
+                buckets[b]++;
+            }
+            mPublishQueueStates[ledger] = state;
+            st.fetch();
+        }
+        mPublishQueueBuckets.setBuckets(buckets);
+        mPublishQueueLoaded = true;
+    }
+    return mPublishQueueStates;
+}
+
+void
+HistoryManagerImpl::clearPublishQueueCache()
+{
+    mPublishQueueStates.clear();
+    mPublishQueueBuckets.setBuckets({});
+    mPublishQueueLoaded = false;
+}
+
 size_t
 HistoryManagerImpl::publishQueueLength() const
 {
-    uint32_t count;
-    auto prep = mApp.getDatabase().getPreparedStatement(
-        "SELECT count(ledger) FROM publishqueue;");
-    auto& st = prep.statement();
-    st.exchange(soci::into(count));
-    st.define_and_bind();
-    st.execute(true);
-    return count;
+    return getPublishQueue().size();
+}
+
+HistoryCache&
+HistoryManagerImpl::getCache()
+{
+    if (!mCache)
+    {
+        mCache = std::make_unique<HistoryCache>(mApp);
+    }
+    return *mCache;
 }
 
 string const&
@@ -189,48 +234,36 @@ HistoryManagerImpl::getLastClosedHistoryArchiveState() const
 }
 
 InferredQuorum
-HistoryManagerImpl::inferQuorum()
+HistoryManagerImpl::inferQuorum(std::string const& stateFile)
 {
     InferredQuorum iq;
+    if (!stateFile.empty() && iq.load(stateFile))
+    {
+        CLOG(INFO, "History") << "Extending the quorum inferred in "
+                              << stateFile << " up to checkpoint "
+                              << iq.mLastCheckpoint;
+    }
     CLOG(INFO, "History") << "Starting FetchRecentQsetsWork";
-    mApp.getWorkManager().executeWork<FetchRecentQsetsWork>(iq);
+    auto work = mApp.getWorkManager().executeWork<FetchRecentQsetsWork>(iq);
+    if (!stateFile.empty() && work->getState() == Work::WORK_SUCCESS)
+    {
+        iq.save(stateFile);
+    }
     return iq;
 }
 
 uint32_t
 HistoryManagerImpl::getMinLedgerQueuedToPublish()
 {
-    uint32_t seq;
-    soci::indicator minIndicator;
-    auto prep = mApp.getDatabase().getPreparedStatement(
-        "SELECT min(ledger) FROM publishqueue;");
-    auto& st = prep.statement();
-    st.exchange(soci::into(seq, minIndicator));
-    st.define_and_bind();
-    st.execute(true);
-    if (minIndicator == soci::indicator::i_ok)
-    {
-        return seq;
-    }
-    return 0;
+    auto const& queue = getPublishQueue();
+    return queue.empty() ? 0 : queue.begin()->first;
 }
 
 uint32_t
 HistoryManagerImpl::getMaxLedgerQueuedToPublish()
 {
-    uint32_t seq;
-    soci::indicator maxIndicator;
-    auto prep = mApp.getDatabase().getPreparedStatement(
-        "SELECT max(ledger) FROM publishqueue;");
-    auto& st = prep.statement();
-    st.exchange(soci::into(seq, maxIndicator));
-    st.define_and_bind();
-    st.execute(true);
-    if (maxIndicator == soci::indicator::i_ok)
-    {
-        return seq;
-    }
-    return 0;
+    auto const& queue = getPublishQueue();
+    return queue.empty() ? 0 : queue.rbegin()->first;
 }
 
 bool
@@ -261,7 +294,12 @@ HistoryManagerImpl::queueCurrentHistory()
 
     auto ledger = has.currentLedger;
     CLOG(DEBUG, "History") << "Queueing publish state for ledger " << ledger;
+    // the buckets kept in memory are published from, and found again after a
+    // restart in, the bucket directory
+    mApp.getBucketManager().materializeBuckets(has.allBuckets());
     auto state = has.toString();
+    // loaded before the new state is in the table, not to count it twice
+    getPublishQueue();
     auto timer = mApp.getDatabase().getInsertTimer("publishqueue");
     auto prep = mApp.getDatabase().getPreparedStatement(
         "INSERT INTO publishqueue (ledger, state) VALUES (:lg, :st);");
@@ -280,6 +318,7 @@ HistoryManagerImpl::queueCurrentHistory()
     // merges-in-progress, avoid restarting them.
 
     mPublishQueue.Mark();
+    mPublishQueueStates[ledger] = state;
     mPublishQueueBuckets.addBuckets(has.allBuckets());
     takeSnapshotAndPublish(has);
 }
@@ -294,6 +333,8 @@ HistoryManagerImpl::takeSnapshotAndPublish(HistoryArchiveState const& has)
     }
     auto ledgerSeq = has.currentLedger;
     CLOG(DEBUG, "History") << "Activating publish for ledger " << ledgerSeq;
+    // the snapshot includes the SCP messages of the checkpoint ledger
+    mApp.getHerderPersistence().flush();
     auto snap = std::make_shared<StateSnapshot>(mApp, has);
 
     mPublishStart.Mark();
@@ -304,71 +345,33 @@ HistoryManagerImpl::takeSnapshotAndPublish(HistoryArchiveState const& has)
 size_t
 HistoryManagerImpl::publishQueuedHistory()
 {
-    std::string state;
-
-    auto prep = mApp.getDatabase().getPreparedStatement(
-        "SELECT state FROM publishqueue"
-        " ORDER BY ledger ASC LIMIT 1;");
-    auto& st = prep.statement();
-    soci::indicator stateIndicator;
-    st.exchange(soci::into(state, stateIndicator));
-    st.define_and_bind();
-    st.execute(true);
-    if (st.got_data() && stateIndicator == soci::indicator::i_ok)
+    auto const& queue = getPublishQueue();
+    if (queue.empty())
     {
-        HistoryArchiveState has;
-        has.fromString(state);
-        takeSnapshotAndPublish(has);
-        return 1;
+        return 0;
     }
-    return 0;
+    HistoryArchiveState has;
+    has.fromString(queue.begin()->second);
+    takeSnapshotAndPublish(has);
+    return 1;
 }
 
 std::vector<HistoryArchiveState>
 HistoryManagerImpl::getPublishQueueStates()
 {
     std::vector<HistoryArchiveState> states;
-    std::string state;
-    auto prep = mApp.getDatabase().getPreparedStatement(
-        "SELECT state FROM publishqueue;");
-    auto& st = prep.statement();
-    st.exchange(soci::into(state));
-    st.define_and_bind();
-    st.execute(true);
-    while (st.got_data())
+    for (auto const& s : getPublishQueue())
     {
         states.emplace_back();
-        states.back().fromString(state);
-        st.fetch();
+        states.back().fromString(s.second);
     }
     return states;
 }
 
-PublishQueueBuckets::BucketCount
-HistoryManagerImpl::loadBucketsReferencedByPublishQueue()
-{
-    auto states = getPublishQueueStates();
-    PublishQueueBuckets::BucketCount result{};
-    for (auto const& s : states)
-    {
-        auto sb = s.allBuckets();
-        for (auto const& b : sb)
-        {
-            result[b]++;
-        }
-    }
-    return result;
-}
-
 std::vector<std::string>
 HistoryManagerImpl::getBucketsReferencedByPublishQueue()
 {
-    if (!mPublishQueueBucketsFilled)
-    {
-        mPublishQueueBuckets.setBuckets(loadBucketsReferencedByPublishQueue());
-        mPublishQueueBucketsFilled = true;
-    }
-
+    getPublishQueue();
     std::vector<std::string> buckets;
     for (auto const& s : mPublishQueueBuckets.map())
     {
@@ -399,6 +402,8 @@ HistoryManagerImpl::historyPublished(
     if (success)
     {
         this->mPublishSuccess.Mark();
+        // loaded while the published state is still in the table
+        getPublishQueue();
         auto timer = mApp.getDatabase().getDeleteTimer("publishqueue");
         auto prep = mApp.getDatabase().getPreparedStatement(
             "DELETE FROM publishqueue WHERE ledger = :lg;");
@@ -407,7 +412,9 @@ HistoryManagerImpl::historyPublished(
         st.define_and_bind();
         st.execute(true);
 
+        mPublishQueueStates.erase(ledgerSeq);
         mPublishQueueBuckets.removeBuckets(originalBuckets);
+        mApp.getBucketManager().bucketsReleased(originalBuckets);
     }
     else
     {
@@ -7,6 +7,7 @@
 #include "bucket/PublishQueueBuckets.h"
 #include "history/HistoryManager.h"
 #include "util/TmpDir.h"
+#include <map>
 #include <memory>
 
 namespace medida
@@ -24,9 +25,14 @@ class HistoryManagerImpl : public HistoryManager
 {
     Application& mApp;
     std::unique_ptr<TmpDir> mWorkDir;
+    std::unique_ptr<HistoryCache> mCache;
     std::shared_ptr<Work> mPublishWork;
-    PublishQueueBuckets mPublishQueueBuckets;
-    bool mPublishQueueBucketsFilled{false};
+
+    // the publishqueue table (states by ledger) and the buckets they
+    // reference, loaded on first use then kept up to date
+    mutable std::map<uint32_t, std::string> mPublishQueueStates;
+    mutable PublishQueueBuckets mPublishQueueBuckets;
+    mutable bool mPublishQueueLoaded{false};
 
     medida::Meter& mPublishSkip;
     medida::Meter& mPublishQueue;
@@ -35,7 +41,7 @@ class HistoryManagerImpl : public HistoryManager
     medida::Meter& mPublishSuccess;
     medida::Meter& mPublishFailure;
 
-    PublishQueueBuckets::BucketCount loadBucketsReferencedByPublishQueue();
+    std::map<uint32_t, std::string> const& getPublishQueue() const;
 
   public:
     HistoryManagerImpl(Application& app);
@@ -67,6 +73,8 @@ class HistoryManagerImpl : public HistoryManager
 
     std::vector<std::string> getBucketsReferencedByPublishQueue() override;
 
+    void clearPublishQueueCache() override;
+
     std::vector<HistoryArchiveState> getPublishQueueStates();
 
     void historyPublished(uint32_t ledgerSeq,
@@ -79,7 +87,9 @@ class HistoryManagerImpl : public HistoryManager
 
     HistoryArchiveState getLastClosedHistoryArchiveState() const override;
 
-    InferredQuorum inferQuorum() override;
+    InferredQuorum inferQuorum(std::string const& stateFile) override;
+
+    HistoryCache& getCache() override;
 
     std::string const& getTmpDir() override;
 
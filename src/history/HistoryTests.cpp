@@ -3,11 +3,19 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "bucket/BucketManager.h"
+#include "catchup/CatchupManager.h"
 #include "catchup/CatchupWorkTests.h"
+#include "crypto/Hex.h"
+#include "crypto/Random.h"
+#include "crypto/SHA.h"
+#include "database/Database.h"
+#include "history/HistoryArchive.h"
 #include "history/HistoryArchiveManager.h"
+#include "history/HistoryCache.h"
 #include "history/HistoryManager.h"
 #include "history/HistoryTestsUtils.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
+#include "historywork/GetIndexedLedgerWork.h"
 #include "historywork/GunzipFileWork.h"
 #include "historywork/GzipFileWork.h"
 #include "historywork/PutHistoryArchiveStateWork.h"
@@ -18,10 +26,15 @@
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Fs.h"
+#include "util/TmpDir.h"
+#include "util/types.h"
 #include "work/WorkManager.h"
 
 #include <lib/catch.hpp>
 #include <lib/util/format.h>
+#include <medida/counter.h>
+#include <medida/meter.h>
+#include <medida/metrics_registry.h>
 
 using namespace stellar;
 using namespace historytestutils;
@@ -101,6 +114,117 @@ TEST_CASE("History publish", "[history]")
     catchupSimulation.generateAndPublishInitialHistory(1);
 }
 
+namespace
+{
+// a second writable archive next to the "test" one
+class MirroredHistoryConfigurator : public TmpDirHistoryConfigurator
+{
+    TmpDirManager mMirrorTmp;
+    TmpDir mMirror;
+
+  public:
+    MirroredHistoryConfigurator()
+        : mMirrorTmp("archtmp-mirror-" + binToHex(randomBytes(8)))
+        , mMirror(mMirrorTmp.tmpDir("archive"))
+    {
+    }
+
+    std::string
+    getMirrorDirName() const
+    {
+        return mMirror.getName();
+    }
+
+    Config&
+    configure(Config& cfg, bool writable) const override
+    {
+        TmpDirHistoryConfigurator::configure(cfg, writable);
+        std::string d = mMirror.getName();
+        cfg.HISTORY["mirror"] = HistoryArchiveConfiguration{
+            "mirror", "cp " + d + "/{0} {1}",
+            writable ? "cp {0} " + d + "/{1}" : "",
+            writable ? "mkdir -p " + d + "/{0}" : ""};
+        return cfg;
+    }
+};
+}
+
+TEST_CASE("History publish to several archives", "[history]")
+{
+    auto configurator = std::make_shared<MirroredHistoryConfigurator>();
+    CatchupSimulation catchupSimulation{configurator};
+
+    catchupSimulation.generateAndPublishInitialHistory(2);
+    REQUIRE(catchupSimulation.getApp()
+                .getHistoryManager()
+                .getPublishSuccessCount() == 2);
+
+    std::vector<HistoryArchiveState> states;
+    for (auto const& dir : {configurator->getArchiveDirName(),
+                            configurator->getMirrorDirName()})
+    {
+        states.emplace_back();
+        auto& has = states.back();
+        has.load(dir + "/" + HistoryArchiveState::wellKnownRemoteName());
+        for (auto const& hash : has.allBuckets())
+        {
+            if (isZero(hexToBin256(hash)))
+            {
+                continue;
+            }
+            REQUIRE(fs::exists(dir + "/" +
+                               fs::remoteName("bucket", hash, "xdr.gz")));
+        }
+    }
+    REQUIRE(states[0].currentLedger != 0);
+    REQUIRE(states[0].currentLedger == states[1].currentLedger);
+    REQUIRE(states[0].allBuckets() == states[1].allBuckets());
+}
+
+namespace
+{
+class IndexedHistoryConfigurator : public TmpDirHistoryConfigurator
+{
+  public:
+    Config&
+    configure(Config& cfg, bool writable) const override
+    {
+        TmpDirHistoryConfigurator::configure(cfg, writable);
+        cfg.PUBLISH_CHECKPOINT_INDEXES = true;
+        return cfg;
+    }
+};
+}
+
+TEST_CASE("History publish with checkpoint indexes", "[history]")
+{
+    auto configurator = std::make_shared<IndexedHistoryConfigurator>();
+    CatchupSimulation catchupSimulation{configurator};
+    catchupSimulation.generateAndPublishInitialHistory(1);
+
+    auto& app = catchupSimulation.getApp();
+    auto checkpoint = app.getHistoryManager().getCheckpointFrequency() - 1;
+    for (auto type : {HISTORY_FILE_TYPE_LEDGER, HISTORY_FILE_TYPE_TRANSACTIONS,
+                      HISTORY_FILE_TYPE_RESULTS})
+    {
+        for (auto suffix : {"xdr.gz", "xdr.bgz", "xdr.idx"})
+        {
+            REQUIRE(fs::exists(
+                configurator->getArchiveDirName() + "/" +
+                fs::remoteName(type, fs::hexStr(checkpoint), suffix)));
+        }
+    }
+
+    auto& wm = app.getWorkManager();
+    auto ledger = wm.executeWork<GetIndexedLedgerWork>(
+        HISTORY_FILE_TYPE_LEDGER, checkpoint - 1);
+    REQUIRE(ledger->getState() == Work::WORK_SUCCESS);
+    LedgerHeaderHistoryEntry entry;
+    REQUIRE(ledger->getEntry(entry));
+    REQUIRE(entry.header.ledgerSeq == checkpoint - 1);
+    REQUIRE(entry.hash == sha256(xdr::xdr_to_opaque(entry.header)));
+}
+
 static std::string
 resumeModeName(uint32_t count)
 {
@@ -168,6 +292,235 @@ TEST_CASE("Full history catchup", "[history][historycatchup]")
     }
 }
 
+TEST_CASE("Full history catchup, one download at a time",
+          "[history][historycatchup]")
+{
+    CatchupSimulation catchupSimulation{};
+
+    catchupSimulation.generateAndPublishInitialHistory(5);
+
+    uint32_t initLedger =
+        catchupSimulation.getApp().getLedgerManager().getLastClosedLedgerNum() -
+        2;
+
+    // transactions are applied while the next checkpoints download, at most
+    // ApplyLedgerChainWork::DOWNLOAD_AHEAD checkpoints ahead
+    auto cfg = getTestConfig(1);
+    cfg.CATCHUP_COMPLETE = true;
+    cfg.MAX_CONCURRENT_SUBPROCESSES = 1;
+    auto app = createTestApplication(
+        catchupSimulation.getClock(),
+        catchupSimulation.getHistoryConfigurator().configure(cfg, false));
+    app->start();
+    REQUIRE(catchupSimulation.catchupApplication(
+        initLedger, std::numeric_limits<uint32_t>::max(), false, app));
+}
+
+TEST_CASE("catchup progress", "[history][historycatchup]")
+{
+    CatchupSimulation catchupSimulation{};
+
+    catchupSimulation.generateAndPublishInitialHistory(2);
+
+    uint32_t initLedger =
+        catchupSimulation.getApp().getLedgerManager().getLastClosedLedgerNum() -
+        2;
+
+    auto cfg = getTestConfig(1);
+    cfg.CATCHUP_COMPLETE = true;
+    auto app = createTestApplication(
+        catchupSimulation.getClock(),
+        catchupSimulation.getHistoryConfigurator().configure(cfg, false));
+    app->start();
+
+    auto& cm = app->getCatchupManager();
+    auto& eta = app->getMetrics().NewCounter({"history", "catchup", "eta"});
+    auto& clock = catchupSimulation.getClock();
+
+    SECTION("estimates the time left from the throughput")
+    {
+        cm.reportProgress("test", 10, 100);
+        clock.setCurrentTime(clock.now() + std::chrono::seconds(30));
+        cm.reportProgress("test", 40, 100);
+        REQUIRE(eta.count() == 60);
+    }
+
+    SECTION("counts applied transactions and operations")
+    {
+        REQUIRE(catchupSimulation.catchupApplication(
+            initLedger, std::numeric_limits<uint32_t>::max(), false, app));
+        auto& txs = app->getMetrics().NewMeter(
+            {"history", "apply-ledger", "transaction"}, "transaction");
+        auto& ops = app->getMetrics().NewMeter(
+            {"history", "apply-ledger", "operation"}, "operation");
+        REQUIRE(txs.count() != 0);
+        REQUIRE(ops.count() >= txs.count());
+        // no catchup in progress any more
+        REQUIRE(eta.count() == 0);
+        REQUIRE(cm.getJsonInfo().empty());
+    }
+}
+
+TEST_CASE("Full history catchup, replay only", "[history][historycatchup]")
+{
+    CatchupSimulation catchupSimulation{};
+
+    catchupSimulation.generateAndPublishInitialHistory(3);
+
+    uint32_t initLedger =
+        catchupSimulation.getApp().getLedgerManager().getLastClosedLedgerNum() -
+        2;
+
+    auto cfg = getTestConfig(1);
+    cfg.CATCHUP_COMPLETE = true;
+    cfg.CATCHUP_REPLAY_ONLY = true;
+    auto app = createTestApplication(
+        catchupSimulation.getClock(),
+        catchupSimulation.getHistoryConfigurator().configure(cfg, false));
+    app->start();
+    REQUIRE(catchupSimulation.catchupApplication(
+        initLedger, std::numeric_limits<uint32_t>::max(), false, app));
+
+    // same state, but no transactions stored for the replayed ledgers
+    auto& sess = app->getDatabase().getSession();
+    int txs = -1, fees = -1;
+    sess << "SELECT COUNT(*) FROM txhistory WHERE ledgerseq <= :seq",
+        soci::into(txs), soci::use(initLedger);
+    sess << "SELECT COUNT(*) FROM txfeehistory WHERE ledgerseq <= :seq",
+        soci::into(fees), soci::use(initLedger);
+    REQUIRE(txs == 0);
+    REQUIRE(fees == 0);
+}
+
+TEST_CASE("Full history catchup, from history cache",
+          "[history][historycatchup]")
+{
+    CatchupSimulation catchupSimulation{};
+    catchupSimulation.generateAndPublishInitialHistory(3);
+    uint32_t initLedger =
+        catchupSimulation.getApp().getLedgerManager().getLastClosedLedgerNum() -
+        2;
+
+    TmpDir cacheDir("historycache");
+    auto catchup = [&](int instance) {
+        auto cfg = getTestConfig(instance);
+        cfg.CATCHUP_COMPLETE = true;
+        cfg.HISTORY_CACHE_DIR_PATH = cacheDir.getName();
+        auto app = createTestApplication(
+            catchupSimulation.getClock(),
+            catchupSimulation.getHistoryConfigurator().configure(cfg, false));
+        app->start();
+        REQUIRE(catchupSimulation.catchupApplication(
+            initLedger, std::numeric_limits<uint32_t>::max(), false, app));
+        auto& metrics = app->getMetrics();
+        return std::make_pair(
+            metrics.NewMeter({"history", "cache", "add"}, "file").count(),
+            metrics.NewMeter({"history", "cache", "hit"}, "file").count());
+    };
+
+    auto first = catchup(1);
+    REQUIRE(first.first > 0);
+    REQUIRE(first.second == 0);
+
+    // a rebuilt node finds the verified files in the cache
+    auto second = catchup(2);
+    REQUIRE(second.second == first.first);
+    REQUIRE(second.first == 0);
+}
+
+TEST_CASE("history cache eviction", "[history]")
+{
+    VirtualClock clock;
+    TmpDir cacheDir("historycache");
+    auto cfg = getTestConfig();
+    cfg.HISTORY_CACHE_DIR_PATH = cacheDir.getName();
+    cfg.HISTORY_CACHE_SIZE_MB = 1;
+    auto app = createTestApplication(clock, cfg);
+    auto& cache = app->getHistoryManager().getCache();
+    REQUIRE(cache.isEnabled());
+
+    auto dir = app->getTmpDirManager().tmpDir("files");
+    auto local = dir.getName() + "/file";
+    for (int i = 0; i < 4; i++)
+    {
+        {
+            std::ofstream out(local, std::ofstream::binary);
+            out << std::string(400 * 1024, static_cast<char>('a' + i));
+        }
+        cache.add("file-" + std::to_string(i), local);
+        std::remove(local.c_str());
+    }
+
+    // the least recently added ones went away
+    REQUIRE(!cache.fetch("file-0", local));
+    REQUIRE(!cache.fetch("file-1", local));
+    REQUIRE(cache.fetch("file-2", local));
+    REQUIRE(cache.fetch("file-3", local));
+    std::ifstream in(local, std::ifstream::binary);
+    std::string content((std::istreambuf_iterator<char>(in)),
+                        std::istreambuf_iterator<char>());
+    REQUIRE(content == std::string(400 * 1024, 'd'));
+
+    cache.remove("file-3");
+    REQUIRE(!cache.fetch("file-3", local));
+}
+
+TEST_CASE("readable archive selection", "[history]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    for (auto name : {"fast", "slow"})
+    {
+        cfg.HISTORY[name] =
+            HistoryArchiveConfiguration{name, "cp {0} {1}", "", ""};
+    }
+    auto app = createTestApplication(clock, cfg);
+    auto& am = app->getHistoryArchiveManager();
+    auto fast = am.getHistoryArchive("fast");
+    auto slow = am.getHistoryArchive("slow");
+
+    auto pick = [&](size_t n) {
+        std::map<std::string, size_t> picks;
+        for (size_t i = 0; i < n; i++)
+        {
+            picks[am.selectRandomReadableHistoryArchive()->getName()]++;
+        }
+        return picks;
+    };
+
+    fast->markDownloaded(10000000, std::chrono::seconds(1));
+    slow->markDownloaded(1000000, std::chrono::seconds(1));
+    REQUIRE(fast->getThroughput() == 10000000);
+
+    SECTION("weighted by throughput")
+    {
+        auto picks = pick(1000);
+        REQUIRE(picks["slow"] > 0);
+        REQUIRE(picks["fast"] > 5 * picks["slow"]);
+    }
+
+    SECTION("away from failing archives")
+    {
+        for (size_t i = 0; i < 8; i++)
+        {
+            fast->markDownloadFailed();
+        }
+        auto picks = pick(1000);
+        REQUIRE(picks["slow"] > 5 * picks["fast"]);
+
+        fast->markDownloaded(10000000, std::chrono::seconds(1));
+        REQUIRE(fast->getConsecutiveFailures() == 0);
+    }
+
+    SECTION("retries go to another archive")
+    {
+        for (size_t i = 0; i < 100; i++)
+        {
+            REQUIRE(am.selectRandomReadableHistoryArchive(fast) == slow);
+        }
+    }
+}
+
 TEST_CASE("History publish queueing", "[history][historydelay][historycatchup]")
 {
     CatchupSimulation catchupSimulation{};
@@ -424,6 +777,19 @@ TEST_CASE("persist publish queue", "[history]")
         // checkpoint still queued.
         CHECK(hm0.getPublishSuccessCount() == 0);
         CHECK(hm0.getMinLedgerQueuedToPublish() == 7);
+
+        // the queue kept in memory matches the table
+        uint32_t count = 0, maxLedger = 0;
+        app0->getDatabase().getSession()
+            << "SELECT count(ledger), max(ledger) FROM publishqueue;",
+            soci::into(count), soci::into(maxLedger);
+        CHECK(hm0.publishQueueLength() == count);
+        CHECK(hm0.getMaxLedgerQueuedToPublish() == maxLedger);
+        hm0.clearPublishQueueCache();
+        CHECK(hm0.publishQueueLength() == count);
+        CHECK(hm0.getMinLedgerQueuedToPublish() == 7);
+        CHECK(hm0.getMaxLedgerQueuedToPublish() == maxLedger);
+
         while (clock.cancelAllEvents() ||
                app0->getProcessManager().getNumRunningProcesses() > 0)
         {
@@ -1,6 +1,11 @@
 #include "history/InferredQuorum.h"
+#include "crypto/Hex.h"
+#include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
-#include "util/BitsetEnumerator.h"
+#include "herder/QuorumIntersectionChecker.h"
+#include "lib/json/json.h"
+#include "util/Decoder.h"
+#include "util/Fs.h"
 #include "util/Logging.h"
 #include "xdrpp/marshal.h"
 #include <fstream>
@@ -78,82 +83,100 @@ InferredQuorum::notePubKey(PublicKey const& pk)
     mPubKeys[pk]++;
 }
 
-static std::shared_ptr<BitsetEnumerator>
-makeQsetEnumerator(SCPQuorumSet const& qset,
-                   std::unordered_map<PublicKey, size_t> const& nodeNumbers)
+void
+InferredQuorum::merge(InferredQuorum const& other)
 {
-    std::vector<std::shared_ptr<BitsetEnumerator>> innerEnums;
-    for (auto const& v : qset.validators)
+    mQsets.insert(other.mQsets.begin(), other.mQsets.end());
+    for (auto const& h : other.mQsetHashes)
     {
-        auto i = nodeNumbers.find(v);
-        assert(i != nodeNumbers.end());
-        innerEnums.push_back(ConstantEnumerator::bitNumber(i->second));
+        noteQsetHash(h.first, h.second);
     }
-    for (auto const& s : qset.innerSets)
+    for (auto const& pk : other.mPubKeys)
     {
-        innerEnums.push_back(makeQsetEnumerator(s, nodeNumbers));
+        mPubKeys[pk.first] += pk.second;
     }
-    return std::make_shared<SelectionEnumerator>(
-        std::make_shared<PermutationEnumerator>(qset.threshold,
-                                                innerEnums.size()),
-        innerEnums);
+    mLastCheckpoint = std::max(mLastCheckpoint, other.mLastCheckpoint);
 }
 
-static std::shared_ptr<BitsetEnumerator>
-makeSliceEnumerator(InferredQuorum const& iq, PublicKey const& pk,
-                    std::unordered_map<PublicKey, size_t> const& nodeNumbers)
+bool
+InferredQuorum::load(std::string const& filename)
 {
-    // Enumerating a slice is the cartesian product enumeration of a
-    // constant enumerator (for the node itself) and a selection enumerator
-    // that does n-of-k for its validators and subqsets.
-    std::vector<std::shared_ptr<BitsetEnumerator>> innerEnums;
-
-    auto i = nodeNumbers.find(pk);
-    assert(i != nodeNumbers.end());
-    innerEnums.push_back(ConstantEnumerator::bitNumber(i->second));
-
-    auto qsh = iq.mQsetHashes.find(pk);
-    assert(qsh != iq.mQsetHashes.end());
-
-    auto qs = iq.mQsets.find(qsh->second);
-    assert(qs != iq.mQsets.end());
+    if (!fs::exists(filename))
+    {
+        return false;
+    }
+    std::ifstream in(filename);
+    Json::Value root;
+    if (!in || !Json::Reader().parse(in, root))
+    {
+        throw std::runtime_error("could not parse " + filename);
+    }
 
-    innerEnums.push_back(makeQsetEnumerator(qs->second, nodeNumbers));
-    return std::make_shared<CartesianProductEnumerator>(innerEnums);
+    InferredQuorum res;
+    res.mLastCheckpoint = root["last_checkpoint"].asUInt();
+    for (auto const& q : root["qsets"])
+    {
+        std::vector<uint8_t> bin;
+        decoder::decode_b64(q.asString(), bin);
+        SCPQuorumSet qset;
+        xdr::xdr_from_opaque(bin, qset);
+        res.mQsets.emplace(sha256(bin), qset);
+    }
+    auto const& hashes = root["qset_hashes"];
+    for (auto const& node : hashes.getMemberNames())
+    {
+        auto pk = KeyUtils::fromStrKey<PublicKey>(node);
+        for (auto const& h : hashes[node])
+        {
+            res.noteQsetHash(pk, hexToBin256(h.asString()));
+        }
+    }
+    auto const& nodes = root["nodes"];
+    for (auto const& node : nodes.getMemberNames())
+    {
+        res.mPubKeys[KeyUtils::fromStrKey<PublicKey>(node)] =
+            nodes[node].asUInt64();
+    }
+    *this = std::move(res);
+    return true;
 }
 
-static bool isQuorum(std::bitset<64> const& q, InferredQuorum const& iq,
-                     std::unordered_map<PublicKey, size_t> const& nodeNumbers,
-                     std::vector<PublicKey> const& revNodeNumbers)
+void
+InferredQuorum::save(std::string const& filename) const
 {
-    for (size_t i = 0; i < q.size(); ++i)
+    Json::Value root;
+    root["last_checkpoint"] = mLastCheckpoint;
+    auto& qsets = root["qsets"] = Json::Value(Json::arrayValue);
+    for (auto const& q : mQsets)
     {
-        if (q.test(i))
+        qsets.append(decoder::encode_b64(xdr::xdr_to_opaque(q.second)));
+    }
+    auto& hashes = root["qset_hashes"] = Json::Value(Json::objectValue);
+    for (auto const& h : mQsetHashes)
+    {
+        hashes[KeyUtils::toStrKey(h.first)].append(binToHex(h.second));
+    }
+    auto& nodes = root["nodes"] = Json::Value(Json::objectValue);
+    for (auto const& pk : mPubKeys)
+    {
+        nodes[KeyUtils::toStrKey(pk.first)] = Json::UInt64(pk.second);
+    }
+
+    // replace the file only once the new one is complete
+    auto tmp = filename + ".tmp";
+    {
+        std::ofstream out(tmp);
+        out << root;
+        if (!out)
         {
-            auto e = makeSliceEnumerator(iq, revNodeNumbers.at(i), nodeNumbers);
-            if (!e)
-            {
-                return false;
-            }
-            bool containsSliceForE = false;
-            while (*e)
-            {
-                // If we find _any_ slice in e's slices that
-                // is covered by q, we're good.
-                if ((q | **e) == q)
-                {
-                    containsSliceForE = true;
-                    break;
-                }
-                ++(*e);
-            }
-            if (!containsSliceForE)
-            {
-                return false;
-            }
+            throw std::runtime_error("could not write " + tmp);
         }
     }
-    return true;
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        throw std::runtime_error("could not rename " + tmp + " to " +
+                                 filename);
+    }
 }
 
 bool
@@ -167,118 +190,58 @@ InferredQuorum::checkQuorumIntersection(Config const& cfg) const
     // iff any two of its quorums share a node—i.e., for all quorums U1 and
     // U2, U1 ∩ U2 =/= ∅.
 
-    // Assign a bit-number to each node
-    std::unordered_map<PublicKey, size_t> nodeNumbers;
-    std::vector<PublicKey> revNodeNumbers;
+    // We can't really tell how nodes we don't have qsets for will behave
+    // in a network; they are excluded from quorums.
+    QuorumIntersectionChecker::QuorumMap qmap;
     for (auto const& n : mPubKeys)
     {
-        nodeNumbers.insert(std::make_pair(n.first, nodeNumbers.size()));
-        revNodeNumbers.push_back(n.first);
-    }
-
-    // We're (only) going to scan the powerset of the nodes we _have_ qsets
-    // for, which might be significantly fewer than the total set of nodes;
-    // we can't really tell how nodes we don't have qsets for will behave
-    // in a network; we exclude them.
-    std::unordered_set<size_t> nodesWithQsets;
-    std::vector<std::shared_ptr<BitsetEnumerator>> nodeEnumerators;
-    for (auto const& n : mQsetHashes)
-    {
-        assert(mQsets.find(n.second) != mQsets.end());
-        auto i = nodeNumbers.find(n.first);
-        assert(i != nodeNumbers.end());
-        nodesWithQsets.insert(i->second);
-    }
-    for (auto nwq : nodesWithQsets)
-    {
-        nodeEnumerators.push_back(ConstantEnumerator::bitNumber(nwq));
-    }
-
-    // Build an enumerator for the powerset of the nodes we have qsets for;
-    // this will thus return _candidate_ quorums, each of which we'll check
-    // for quorum-ness.
-    SelectionEnumerator quorumCandidateEnumerator(
-        std::make_shared<PowersetEnumerator>(nodeEnumerators.size()),
-        nodeEnumerators);
-
-    assert(nodeEnumerators.size() < 64);
-    uint64_t lim = 1ULL << nodeEnumerators.size();
-    CLOG(INFO, "History") << "Scanning: " << lim
-                          << " possible node subsets (of "
-                          << nodeEnumerators.size() << " nodes with qsets)";
-
-    // Enumerate all the quorums, de-duplicating into a hashset
-    std::unordered_set<uint64_t> allQuorums;
-    while (quorumCandidateEnumerator)
-    {
-        auto bv = *quorumCandidateEnumerator;
-        if (isQuorum(bv, *this, nodeNumbers, revNodeNumbers))
-        {
-            CLOG(INFO, "History") << "Quorum: " << bv;
-            allQuorums.insert(bv.to_ullong());
-        }
-        ++quorumCandidateEnumerator;
-    }
-
-    // Report what we found.
-    for (auto const& pk : mPubKeys)
-    {
-        if (mQsetHashes.find(pk.first) == mQsetHashes.end())
+        auto qsh = mQsetHashes.find(n.first);
+        if (qsh == mQsetHashes.end())
         {
             CLOG(WARNING, "History")
-                << "Node without qset: " << cfg.toShortString(pk.first);
+                << "Node without qset: " << cfg.toShortString(n.first);
+            qmap[n.first] = nullptr;
+            continue;
         }
+        auto qs = mQsets.find(qsh->second);
+        assert(qs != mQsets.end());
+        qmap[n.first] = std::make_shared<SCPQuorumSet>(qs->second);
     }
-    CLOG(INFO, "History") << "Found " << nodeNumbers.size() << " nodes total";
-    CLOG(INFO, "History") << "Found " << nodeEnumerators.size()
+
+    QuorumIntersectionChecker checker(qmap);
+    CLOG(INFO, "History") << "Found " << mPubKeys.size() << " nodes total";
+    CLOG(INFO, "History") << "Found " << checker.getNodeCount()
                           << " nodes with qsets";
-    CLOG(INFO, "History") << "Found " << allQuorums.size() << " quorums";
 
-    bool allOk = true;
-    for (auto const& q : allQuorums)
-    {
-        for (auto const& v : allQuorums)
+    bool allOk = checker.networkEnjoysQuorumIntersection();
+    CLOG(INFO, "History") << "Explored " << checker.getSearchSteps()
+                          << " branches in a component of "
+                          << checker.getMainComponentSize() << " nodes";
+
+    auto logNodes = [&](std::vector<NodeID> const& nodes) {
+        for (auto const& n : nodes)
         {
-            if (q != v)
-            {
-                if (!(q & v))
-                {
-                    allOk = false;
-                    CLOG(WARNING, "History")
-                        << "Warning: found pair of non-intersecting quorums";
-                    CLOG(WARNING, "History") << std::bitset<64>(q);
-                    CLOG(WARNING, "History") << "vs.";
-                    CLOG(WARNING, "History") << std::bitset<64>(v);
-                }
-            }
+            auto isAlias = false;
+            auto name = cfg.toStrKey(n, isAlias);
+            CLOG(WARNING, "History")
+                << "  \"" << (isAlias ? "$" : "") << name << '"';
         }
-    }
+    };
 
     if (allOk)
     {
-        CLOG(INFO, "History") << "Network of " << nodeEnumerators.size()
-                              << " nodes enjoys quorum intersection: ";
+        CLOG(INFO, "History") << "Network of " << checker.getNodeCount()
+                              << " nodes enjoys quorum intersection";
     }
     else
     {
         CLOG(WARNING, "History")
-            << "Network of " << nodeEnumerators.size()
-            << " nodes DOES NOT enjoy quorum intersection: ";
-    }
-    for (auto n : nodesWithQsets)
-    {
-        auto isAlias = false;
-        auto name = cfg.toStrKey(revNodeNumbers.at(n), isAlias);
-        if (allOk)
-        {
-            CLOG(INFO, "History")
-                << "  \"" << (isAlias ? "$" : "") << name << '"';
-        }
-        else
-        {
-            CLOG(WARNING, "History")
-                << "  \"" << (isAlias ? "$" : "") << name << '"';
-        }
+            << "Network of " << checker.getNodeCount()
+            << " nodes DOES NOT enjoy quorum intersection, "
+            << "found pair of non-intersecting quorums:";
+        logNodes(checker.getPotentialSplit().first);
+        CLOG(WARNING, "History") << "vs.";
+        logNodes(checker.getPotentialSplit().second);
     }
     return allOk;
 }
@@ -19,10 +19,19 @@ struct InferredQuorum
     std::unordered_map<Hash, SCPQuorumSet> mQsets;
     std::unordered_multimap<PublicKey, Hash> mQsetHashes;
     std::unordered_map<PublicKey, size_t> mPubKeys;
+    // the last checkpoint whose SCP messages were noted, 0 if none
+    uint32_t mLastCheckpoint{0};
     void noteSCPHistory(SCPHistoryEntry const& hist);
     void noteQset(SCPQuorumSet const& qset);
     void noteQsetHash(PublicKey const& pk, Hash const& hash);
     void notePubKey(PublicKey const& pk);
+    // adds what another InferredQuorum noted, over other checkpoints
+    void merge(InferredQuorum const& other);
+    // An inferred quorum kept in a file (as JSON), to be extended with the
+    // checkpoints published since rather than inferred again; load returns
+    // false if there is no such file.
+    bool load(std::string const& filename);
+    void save(std::string const& filename) const;
     std::string toString(Config const& cfg) const;
     void writeQuorumGraph(Config const& cfg, std::ostream& out) const;
     bool checkQuorumIntersection(Config const& cfg) const;
@@ -9,6 +9,7 @@
 #include "main/Config.h"
 #include "test/test.h"
 #include "util/Logging.h"
+#include "util/TmpDir.h"
 #include "xdrpp/marshal.h"
 #include <xdrpp/autocheck.h>
 
@@ -291,3 +292,47 @@ TEST_CASE("InferredQuorum non-intersection w/ subquorums",
     Config cfg(getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE));
     CHECK(!iq.checkQuorumIntersection(cfg));
 }
+
+TEST_CASE("InferredQuorum merge, save and load", "[history][inferredquorum]")
+{
+    PublicKey pkA = SecretKey::random().getPublicKey();
+    PublicKey pkB = SecretKey::random().getPublicKey();
+    xdr::xvector<SCPQuorumSet> emptySet;
+    SCPQuorumSet qsA(1, xdr::xvector<PublicKey>({pkB}), emptySet);
+    SCPQuorumSet qsB(1, xdr::xvector<PublicKey>({pkA}), emptySet);
+    Hash qshA = sha256(xdr::xdr_to_opaque(qsA));
+    Hash qshB = sha256(xdr::xdr_to_opaque(qsB));
+
+    // two scans of different checkpoints
+    InferredQuorum a, b;
+    a.noteQset(qsA);
+    a.noteQsetHash(pkA, qshA);
+    a.notePubKey(pkA);
+    a.notePubKey(pkB);
+    a.mLastCheckpoint = 63;
+    b.noteQset(qsB);
+    b.noteQsetHash(pkA, qshA);
+    b.noteQsetHash(pkB, qshB);
+    b.notePubKey(pkA);
+    b.mLastCheckpoint = 127;
+
+    InferredQuorum iq;
+    iq.merge(a);
+    iq.merge(b);
+    REQUIRE(iq.mQsets.size() == 2);
+    REQUIRE(iq.mQsetHashes.size() == 2);
+    REQUIRE(iq.mPubKeys[pkA] == 2);
+    REQUIRE(iq.mPubKeys[pkB] == 1);
+    REQUIRE(iq.mLastCheckpoint == 127);
+
+    TmpDir dir("inferredquorum");
+    auto filename = dir.getName() + "/quorum.json";
+    InferredQuorum loaded;
+    REQUIRE(!loaded.load(filename));
+    iq.save(filename);
+    REQUIRE(loaded.load(filename));
+    REQUIRE(loaded.mQsets == iq.mQsets);
+    REQUIRE(loaded.mQsetHashes.size() == iq.mQsetHashes.size());
+    REQUIRE(loaded.mPubKeys == iq.mPubKeys);
+    REQUIRE(loaded.mLastCheckpoint == 127);
+}
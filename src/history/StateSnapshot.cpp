@@ -24,6 +24,9 @@
 
 #include <soci.h>
 
+#include <functional>
+#include <future>
+
 namespace stellar
 {
 
@@ -56,7 +59,9 @@ StateSnapshot::makeLive()
         auto& hb = mLocalState.currentBuckets[i];
         if (hb.next.hasHashes() && !hb.next.isLive())
         {
-            hb.next.makeLive(mApp, BucketList::keepDeadEntries(i));
+            hb.next.makeLive(
+                mApp, BucketList::keepDeadEntries(i),
+                BucketList::mergePriority(mLocalState.currentLedger, i));
         }
     }
 }
@@ -64,58 +69,87 @@ StateSnapshot::makeLive()
 bool
 StateSnapshot::writeHistoryBlocks() const
 {
-    std::unique_ptr<soci::session> snapSess(
-        mApp.getDatabase().canUsePool()
-            ? std::make_unique<soci::session>(mApp.getDatabase().getPool())
-            : nullptr);
-    soci::session& sess(snapSess ? *snapSess : mApp.getDatabase().getSession());
-    soci::transaction tx(sess);
-
     // The current "history block" is stored in _four_ files, one just ledger
     // headers, one TransactionHistoryEntry (which contain txSets),
     // one TransactionHistoryResultEntry containing transaction set results and
     // one (optional) SCPHistoryEntry containing the SCP messages used to close.
     // All files are streamed out of the database, entry-by-entry.
-    size_t nbSCPMessages;
-    uint32_t begin, count;
-    size_t nHeaders;
-    {
-        XDROutputFileStream ledgerOut, txOut, txResultOut, scpHistory;
+    auto& db = mApp.getDatabase();
+
+    // 'mLocalState' describes the LCL, so its currentLedger will usually be
+    // 63,
+    // 127, 191, etc. We want to start our snapshot at 64-before the _next_
+    // ledger: 0, 64, 128, etc. In cases where we're forcibly checkpointed
+    // early, we still want to round-down to the previous checkpoint ledger.
+    uint32_t begin =
+        mApp.getHistoryManager().prevCheckpointLedger(mLocalState.currentLedger);
+
+    uint32_t count = (mLocalState.currentLedger - begin) + 1;
+    CLOG(DEBUG, "History") << "Streaming " << count
+                           << " ledgers worth of history, from " << begin;
+
+    auto writeHeaders = [&](soci::session& sess) {
+        XDROutputFileStream ledgerOut;
         ledgerOut.open(mLedgerSnapFile->localPath_nogz());
+        auto n = LedgerHeaderFrame::copyLedgerHeadersToStream(
+            db, sess, begin, count, ledgerOut);
+        CLOG(DEBUG, "History") << "Wrote " << n << " ledger headers to "
+                               << mLedgerSnapFile->localPath_nogz();
+        return n;
+    };
+    auto writeTransactions = [&](soci::session& sess) {
+        XDROutputFileStream txOut, txResultOut;
         txOut.open(mTransactionSnapFile->localPath_nogz());
         txResultOut.open(mTransactionResultSnapFile->localPath_nogz());
-        scpHistory.open(mSCPHistorySnapFile->localPath_nogz());
-
-        // 'mLocalState' describes the LCL, so its currentLedger will usually be
-        // 63,
-        // 127, 191, etc. We want to start our snapshot at 64-before the _next_
-        // ledger: 0, 64, 128, etc. In cases where we're forcibly checkpointed
-        // early, we still want to round-down to the previous checkpoint ledger.
-        begin = mApp.getHistoryManager().prevCheckpointLedger(
-            mLocalState.currentLedger);
-
-        count = (mLocalState.currentLedger - begin) + 1;
-        CLOG(DEBUG, "History") << "Streaming " << count
-                               << " ledgers worth of history, from " << begin;
-
-        nHeaders = LedgerHeaderFrame::copyLedgerHeadersToStream(
-            mApp.getDatabase(), sess, begin, count, ledgerOut);
-        size_t nTxs = TransactionFrame::copyTransactionsToStream(
-            mApp.getNetworkID(), mApp.getDatabase(), sess, begin, count, txOut,
-            txResultOut);
-        CLOG(DEBUG, "History") << "Wrote " << nHeaders << " ledger headers to "
-                               << mLedgerSnapFile->localPath_nogz();
+        auto n = TransactionFrame::copyTransactionsToStream(
+            mApp.getNetworkID(), db, sess, begin, count, txOut, txResultOut);
         CLOG(DEBUG, "History")
-            << "Wrote " << nTxs << " transactions to "
+            << "Wrote " << n << " transactions to "
             << mTransactionSnapFile->localPath_nogz() << " and "
             << mTransactionResultSnapFile->localPath_nogz();
+        return n;
+    };
+    auto writeSCPHistory = [&](soci::session& sess) {
+        XDROutputFileStream scpHistory;
+        scpHistory.open(mSCPHistorySnapFile->localPath_nogz());
+        auto n = HerderPersistence::copySCPHistoryToStream(db, sess, begin,
+                                                           count, scpHistory);
+        CLOG(DEBUG, "History") << "Wrote " << n << " SCP messages to "
+                               << mSCPHistorySnapFile->localPath_nogz();
+        return n;
+    };
 
-        nbSCPMessages = HerderPersistence::copySCPHistoryToStream(
-            mApp.getDatabase(), sess, begin, count, scpHistory);
-
-        CLOG(DEBUG, "History")
-            << "Wrote " << nbSCPMessages << " SCP messages to "
-            << mSCPHistorySnapFile->localPath_nogz();
+    size_t nHeaders;
+    size_t nbSCPMessages;
+    if (db.canUsePool())
+    {
+        // The files are written concurrently, each from its own pooled
+        // session. These rows are not modified anymore once the checkpoint
+        // ledger is committed, so separate read transactions see the same
+        // data (except for the transient case handled below). Sessions are
+        // only held by the tasks, so this works with any size of pool.
+        auto& pool = db.getPool();
+        auto write = [&pool](std::function<size_t(soci::session&)> f) {
+            return std::async(std::launch::async, [&pool, f]() {
+                soci::session sess(pool);
+                soci::transaction tx(sess);
+                return f(sess);
+            });
+        };
+        auto headers = write(writeHeaders);
+        auto transactions = write(writeTransactions);
+        auto scp = write(writeSCPHistory);
+        nHeaders = headers.get();
+        transactions.get();
+        nbSCPMessages = scp.get();
+    }
+    else
+    {
+        soci::session& sess(db.getSession());
+        soci::transaction tx(sess);
+        nHeaders = writeHeaders(sess);
+        writeTransactions(sess);
+        nbSCPMessages = writeSCPHistory(sess);
     }
 
     if (nbSCPMessages == 0)
@@ -140,6 +140,9 @@ BatchDownloadWork::notify(std::string const& child)
         mRunning.erase(checkpoint);
         addNextDownloadWorker();
     }
+    auto done = (mNext - mRange.first()) / mRange.frequency() - mRunning.size();
+    mApp.getCatchupManager().reportProgress("download-" + mFileType, done,
+                                            mRange.count());
     mApp.getCatchupManager().logAndUpdateCatchupStatus(true);
     advance();
 }
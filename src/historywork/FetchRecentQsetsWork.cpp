@@ -7,9 +7,11 @@
 #include "history/HistoryManager.h"
 #include "historywork/BatchDownloadWork.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
+#include "historywork/ScanSCPHistoryWork.h"
 #include "main/Application.h"
 #include "util/TmpDir.h"
-#include "util/XDRStream.h"
+
+#include <thread>
 
 namespace stellar
 {
@@ -30,6 +32,7 @@ FetchRecentQsetsWork::onReset()
 {
     clearChildren();
     mDownloadSCPMessagesWork.reset();
+    mScanWorks.clear();
     mDownloadDir = std::make_unique<TmpDir>(
         mApp.getTmpDirManager().tmpDir(getUniqueName()));
 }
@@ -53,6 +56,16 @@ FetchRecentQsetsWork::onSuccess()
     uint32_t window = numCheckpoints * step;
     uint32_t lastSeq = mRemoteState.currentLedger;
     uint32_t firstSeq = lastSeq < window ? (step - 1) : (lastSeq - window);
+    if (mInferredQuorum.mLastCheckpoint != 0)
+    {
+        firstSeq = std::max(firstSeq, mInferredQuorum.mLastCheckpoint + step);
+    }
+    if (firstSeq > lastSeq)
+    {
+        CLOG(INFO, "History") << "No SCP messages since checkpoint "
+                              << mInferredQuorum.mLastCheckpoint;
+        return WORK_SUCCESS;
+    }
 
     if (!mDownloadSCPMessagesWork)
     {
@@ -64,20 +77,34 @@ FetchRecentQsetsWork::onSuccess()
         return WORK_PENDING;
     }
 
-    // Phase 3: extract the qsets.
-    for (uint32_t i = firstSeq; i <= lastSeq; i += step)
+    // Phase 3: extract the qsets, a share of the checkpoints per thread.
+    if (mScanWorks.empty())
     {
-        CLOG(INFO, "History") << "Scanning for QSets in checkpoint: " << i;
-        XDRInputFileStream in;
-        FileTransferInfo fi(*mDownloadDir, HISTORY_FILE_TYPE_SCP, i);
-        in.open(fi.localPath_nogz());
-        SCPHistoryEntry tmp;
-        while (in && in.readOne(tmp))
+        CLOG(INFO, "History") << "Scanning for QSets in checkpoints: ["
+                              << firstSeq << ", " << lastSeq << "]";
+        size_t checkpoints = (lastSeq - firstSeq) / step + 1;
+        size_t shares = std::min<size_t>(
+            checkpoints, std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<std::vector<std::string>> files(shares);
+        for (uint32_t i = firstSeq, n = 0; i <= lastSeq; i += step, n++)
         {
-            mInferredQuorum.noteSCPHistory(tmp);
+            FileTransferInfo fi(*mDownloadDir, HISTORY_FILE_TYPE_SCP, i);
+            files[n * shares / checkpoints].emplace_back(fi.localPath_nogz());
         }
+        for (size_t i = 0; i < shares; i++)
+        {
+            mScanWorks.emplace_back(addWork<ScanSCPHistoryWork>(
+                "scan-scp-history-" + std::to_string(i), files[i]));
+        }
+        return WORK_PENDING;
     }
 
+    // Phase 4: merge what each thread found.
+    for (auto const& w : mScanWorks)
+    {
+        mInferredQuorum.merge(w->getInferredQuorum());
+    }
+    mInferredQuorum.mLastCheckpoint = lastSeq;
     return WORK_SUCCESS;
 }
 }
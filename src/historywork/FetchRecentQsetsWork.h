@@ -12,7 +12,13 @@ namespace stellar
 
 class TmpDir;
 struct InferredQuorum;
+class ScanSCPHistoryWork;
 
+// Adds the SCP messages of recent checkpoints to an InferredQuorum: those of
+// the last 100 checkpoints, or of the checkpoints since
+// InferredQuorum::mLastCheckpoint if it is later. The files are downloaded
+// concurrently, and scanned in parallel into partial InferredQuorums that are
+// then merged.
 class FetchRecentQsetsWork : public Work
 {
     std::unique_ptr<TmpDir> mDownloadDir;
@@ -20,6 +26,7 @@ class FetchRecentQsetsWork : public Work
     HistoryArchiveState mRemoteState;
     std::shared_ptr<Work> mGetHistoryArchiveStateWork;
     std::shared_ptr<Work> mDownloadSCPMessagesWork;
+    std::vector<std::shared_ptr<ScanSCPHistoryWork>> mScanWorks;
 
   public:
     FetchRecentQsetsWork(Application& app, WorkParent& parent,
@@ -4,6 +4,8 @@
 
 #include "historywork/GetAndUnzipRemoteFileWork.h"
 #include "history/FileTransferInfo.h"
+#include "history/HistoryCache.h"
+#include "history/HistoryManager.h"
 #include "historywork/GetRemoteFileWork.h"
 #include "historywork/GunzipFileWork.h"
 #include "util/Logging.h"
@@ -51,6 +53,13 @@ GetAndUnzipRemoteFileWork::onReset()
     mGetRemoteFileWork.reset();
     mGunzipFileWork.reset();
 
+    mFromCache = mApp.getHistoryManager().getCache().fetch(
+        mFt.baseName_nogz(), mFt.localPath_nogz());
+    if (mFromCache)
+    {
+        return;
+    }
+
     CLOG(DEBUG, "History") << "Downloading and unzipping " << mFt.remoteName()
                            << ": downloading";
     mGetRemoteFileWork = addWork<GetRemoteFileWork>(
@@ -60,6 +69,11 @@ GetAndUnzipRemoteFileWork::onReset()
 Work::State
 GetAndUnzipRemoteFileWork::onSuccess()
 {
+    if (mFromCache)
+    {
+        return WORK_SUCCESS;
+    }
+
     if (mGunzipFileWork)
     {
         if (!fs::exists(mFt.localPath_nogz()))
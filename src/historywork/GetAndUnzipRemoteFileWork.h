@@ -17,6 +17,8 @@ class GetAndUnzipRemoteFileWork : public Work
 {
     std::shared_ptr<Work> mGetRemoteFileWork;
     std::shared_ptr<Work> mGunzipFileWork;
+    // the file was found in the history cache, nothing to download
+    bool mFromCache{false};
 
     FileTransferInfo mFt;
     std::shared_ptr<HistoryArchive> mArchive;
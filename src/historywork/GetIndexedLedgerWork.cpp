@@ -0,0 +1,102 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "historywork/GetIndexedLedgerWork.h"
+#include "history/HistoryArchive.h"
+#include "history/HistoryArchiveManager.h"
+#include "history/HistoryManager.h"
+#include "historywork/GetRemoteFileWork.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+#include "util/TmpDir.h"
+
+namespace stellar
+{
+
+GetIndexedLedgerWork::GetIndexedLedgerWork(
+    Application& app, WorkParent& parent, std::string const& type,
+    uint32_t ledgerSeq, std::shared_ptr<HistoryArchive> archive)
+    : Work(app, parent,
+           "get-indexed-ledger-" + type + "-" + std::to_string(ledgerSeq))
+    , mType(type)
+    , mLedgerSeq(ledgerSeq)
+    , mArchive(archive)
+{
+}
+
+GetIndexedLedgerWork::~GetIndexedLedgerWork()
+{
+    clearChildren();
+}
+
+void
+GetIndexedLedgerWork::onReset()
+{
+    clearChildren();
+    mGetIndexWork.reset();
+    mGetDataWork.reset();
+    mEntry = nullptr;
+    // both files from the same archive, another one on retries
+    auto previous = mCurrentArchive;
+    mCurrentArchive = mArchive;
+    if (!mCurrentArchive)
+    {
+        mCurrentArchive = mApp.getHistoryArchiveManager()
+                              .selectRandomReadableHistoryArchive(previous);
+    }
+    mDownloadDir = std::make_unique<TmpDir>(
+        mApp.getTmpDirManager().tmpDir(getUniqueName()));
+    mFile = std::make_unique<FileTransferInfo>(
+        *mDownloadDir, mType,
+        mApp.getHistoryManager().checkpointContainingLedger(mLedgerSeq));
+}
+
+Work::State
+GetIndexedLedgerWork::onSuccess()
+{
+    // Phase 1: download the index
+    if (!mGetIndexWork)
+    {
+        mGetIndexWork = addWork<GetRemoteFileWork>(
+            mFile->remoteName_idx(), mFile->localPath_idx(), mCurrentArchive,
+            RETRY_NEVER);
+        return WORK_PENDING;
+    }
+
+    // Phase 2: download the members holding the entry
+    if (!mGetDataWork)
+    {
+        try
+        {
+            mIndex.load(mFile->localPath_idx());
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "History") << e.what();
+            return WORK_FAILURE_RETRY;
+        }
+        mEntry = mIndex.find(mLedgerSeq);
+        if (!mEntry)
+        {
+            return WORK_SUCCESS;
+        }
+        auto get = addWork<GetRemoteFileWork>(mFile->remoteName_bgz(),
+                                              mFile->localPath_bgz(),
+                                              mCurrentArchive, RETRY_NEVER);
+        if (mCurrentArchive->getClient())
+        {
+            mRange = mIndex.getRange(*mEntry);
+            get->setRange(mRange.mFileOffset, mRange.mFileSize);
+        }
+        else
+        {
+            mRange = CheckpointIndex::Range{0, 0, 0};
+        }
+        mGetDataWork = get;
+        return WORK_PENDING;
+    }
+
+    return WORK_SUCCESS;
+}
+}
@@ -0,0 +1,64 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#pragma once
+
+#include "history/CheckpointIndex.h"
+#include "history/FileTransferInfo.h"
+#include "work/Work.h"
+
+namespace stellar
+{
+
+class HistoryArchive;
+class TmpDir;
+
+/**
+ * Reads the entry of one ledger from a checkpoint file of an archive that
+ * publishes checkpoint indexes (see CheckpointIndex): downloads the index of
+ * the file, then only the members of its block compressed variant holding
+ * the entry, with a range request for archives with a url (the whole variant
+ * for archives with a get command).
+ *
+ * Passing `nullptr` for the archive selects a readable archive at random,
+ * another one on every retry.
+ */
+class GetIndexedLedgerWork : public Work
+{
+    std::string const mType;
+    uint32_t const mLedgerSeq;
+    std::shared_ptr<HistoryArchive> const mArchive;
+    std::shared_ptr<HistoryArchive> mCurrentArchive;
+    std::unique_ptr<TmpDir> mDownloadDir;
+    std::unique_ptr<FileTransferInfo> mFile;
+    CheckpointIndex mIndex;
+    CheckpointIndex::Entry const* mEntry{nullptr};
+    CheckpointIndex::Range mRange{0, 0, 0};
+    std::shared_ptr<Work> mGetIndexWork;
+    std::shared_ptr<Work> mGetDataWork;
+
+  public:
+    GetIndexedLedgerWork(Application& app, WorkParent& parent,
+                         std::string const& type, uint32_t ledgerSeq,
+                         std::shared_ptr<HistoryArchive> archive = nullptr);
+    ~GetIndexedLedgerWork();
+    void onReset() override;
+    Work::State onSuccess() override;
+
+    // Once the work succeeded, reads the entry of the ledger to @p out;
+    // returns false if the file has none. Throws std::runtime_error.
+    template <typename T>
+    bool
+    getEntry(T& out) const
+    {
+        if (!mEntry)
+        {
+            return false;
+        }
+        CheckpointIndex::readEntry(mFile->localPath_bgz(), mRange.mStart,
+                                   *mEntry, out);
+        return true;
+    }
+};
+}
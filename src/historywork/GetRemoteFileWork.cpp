@@ -4,10 +4,13 @@
 
 #include "historywork/GetRemoteFileWork.h"
 #include "history/HistoryArchive.h"
+#include "history/HistoryArchiveClient.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManager.h"
 #include "main/Application.h"
 
+#include <fstream>
+
 namespace stellar
 {
 
@@ -30,19 +33,56 @@ GetRemoteFileWork::~GetRemoteFileWork()
 }
 
 void
-GetRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+GetRemoteFileWork::setRange(uint64_t offset, uint64_t size)
 {
+    mRangeOffset = offset;
+    mRangeSize = size;
+}
+
+void
+GetRemoteFileWork::onStart()
+{
+    // on retries, try another archive than the one that just failed
+    auto previous = mCurrentArchive;
     mCurrentArchive = mArchive;
     if (!mCurrentArchive)
     {
         mCurrentArchive = mApp.getHistoryArchiveManager()
-                              .selectRandomReadableHistoryArchive();
+                              .selectRandomReadableHistoryArchive(previous);
     }
+    mStartTime = mApp.getClock().now();
     assert(mCurrentArchive);
     assert(mCurrentArchive->hasGetCmd());
+    auto const& client = mCurrentArchive->getClient();
+    if (client && mRangeSize != 0)
+    {
+        client->getFileRange(mRemote, mRangeOffset, mRangeSize, mLocal,
+                             callComplete());
+    }
+    else if (client)
+    {
+        client->getFile(mRemote, mLocal, callComplete());
+    }
+    else
+    {
+        assert(mRangeSize == 0);
+        RunCommandWork::onStart();
+    }
+}
+
+void
+GetRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+{
+    assert(mCurrentArchive);
     cmdLine = mCurrentArchive->getFileCmd(mRemote, mLocal);
 }
 
+ProcessClass
+GetRemoteFileWork::getProcessClass() const
+{
+    return PROCESS_CLASS_TRANSFER;
+}
+
 void
 GetRemoteFileWork::onReset()
 {
@@ -53,14 +93,28 @@ Work::State
 GetRemoteFileWork::onSuccess()
 {
     assert(mCurrentArchive);
+    std::ifstream in(mLocal, std::ios::binary | std::ios::ate);
+    auto bytes = in ? static_cast<uint64_t>(in.tellg()) : 0;
+    mCurrentArchive->markDownloaded(
+        bytes, std::chrono::duration_cast<std::chrono::microseconds>(
+                   mApp.getClock().now() - mStartTime));
     mCurrentArchive->markSuccess();
     return RunCommandWork::onSuccess();
 }
 
+void
+GetRemoteFileWork::onFailureRetry()
+{
+    assert(mCurrentArchive);
+    mCurrentArchive->markDownloadFailed();
+    RunCommandWork::onFailureRetry();
+}
+
 void
 GetRemoteFileWork::onFailureRaise()
 {
     assert(mCurrentArchive);
+    mCurrentArchive->markDownloadFailed();
     mCurrentArchive->markFailure();
     RunCommandWork::onFailureRaise();
 }
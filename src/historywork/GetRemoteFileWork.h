@@ -17,20 +17,32 @@ class GetRemoteFileWork : public RunCommandWork
     std::string mLocal;
     std::shared_ptr<HistoryArchive> mArchive;
     std::shared_ptr<HistoryArchive> mCurrentArchive;
+    uint64_t mRangeOffset{0};
+    uint64_t mRangeSize{0};
+    VirtualClock::time_point mStartTime;
     void getCommand(std::string& cmdLine, std::string& outFile) override;
+    ProcessClass getProcessClass() const override;
 
   public:
     // Passing `nullptr` for the archive argument will cause the work to
     // select a new readable history archive at random each time it runs /
-    // retries.
+    // retries (see HistoryArchiveManager::selectRandomReadableHistoryArchive).
+    // Every attempt feeds the throughput estimate of its archive.
     GetRemoteFileWork(Application& app, WorkParent& parent,
                       std::string const& remote, std::string const& local,
                       std::shared_ptr<HistoryArchive> archive = nullptr,
                       size_t maxRetries = Work::RETRY_A_LOT);
     ~GetRemoteFileWork();
+
+    // Only downloads the @p size bytes at @p offset of the file, which takes
+    // an archive with a url (see HistoryArchiveClient::getFileRange).
+    void setRange(uint64_t offset, uint64_t size);
+
     void onReset() override;
+    void onStart() override;
 
     Work::State onSuccess() override;
+    void onFailureRetry() override;
     void onFailureRaise() override;
 };
 }
@@ -3,7 +3,10 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/GunzipFileWork.h"
+#include "main/Application.h"
 #include "util/Fs.h"
+#include "util/Gzip.h"
+#include "util/Logging.h"
 
 namespace stellar
 {
@@ -11,8 +14,8 @@ namespace stellar
 GunzipFileWork::GunzipFileWork(Application& app, WorkParent& parent,
                                std::string const& filenameGz, bool keepExisting,
                                size_t maxRetries)
-    : RunCommandWork(app, parent, std::string("gunzip-file ") + filenameGz,
-                     maxRetries)
+    : BackgroundWork(app, parent, std::string("gunzip-file ") + filenameGz,
+                     Application::WORKER_POOL_HISTORY_IO, maxRetries)
     , mFilenameGz(filenameGz)
     , mKeepExisting(keepExisting)
 {
@@ -24,22 +27,37 @@ GunzipFileWork::~GunzipFileWork()
     clearChildren();
 }
 
-void
-GunzipFileWork::getCommand(std::string& cmdLine, std::string& outFile)
-{
-    cmdLine = "gzip -d ";
-    if (mKeepExisting)
-    {
-        cmdLine += "-c ";
-        outFile = mFilenameGz.substr(0, mFilenameGz.size() - 3);
-    }
-    cmdLine += mFilenameGz;
-}
-
 void
 GunzipFileWork::onReset()
 {
+    BackgroundWork::onReset();
     std::string filenameNoGz = mFilenameGz.substr(0, mFilenameGz.size() - 3);
     std::remove(filenameNoGz.c_str());
 }
+
+BackgroundWork::Task
+GunzipFileWork::getBackgroundTask()
+{
+    std::string filenameGz = mFilenameGz;
+    bool keepExisting = mKeepExisting;
+    return [filenameGz, keepExisting]() {
+        std::string filenameNoGz = filenameGz.substr(0, filenameGz.size() - 3);
+        try
+        {
+            gz::decompressFile(filenameGz, filenameNoGz);
+            if (!keepExisting)
+            {
+                std::remove(filenameGz.c_str());
+            }
+            return WORK_COMPLETE_OK;
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "History")
+                << "FAILED decompressing " << filenameGz << ": " << e.what();
+            std::remove(filenameNoGz.c_str());
+            return WORK_COMPLETE_FAILURE;
+        }
+    };
+}
 }
@@ -4,16 +4,19 @@
 
 #pragma once
 
-#include "historywork/RunCommandWork.h"
+#include "work/BackgroundWork.h"
 
 namespace stellar
 {
 
-class GunzipFileWork : public RunCommandWork
+/**
+ * Decompresses a <file>.gz to <file> in process (see gz::decompressFile), on
+ * a worker thread, removing the .gz unless @p keepExisting.
+ */
+class GunzipFileWork : public BackgroundWork
 {
     std::string mFilenameGz;
     bool mKeepExisting;
-    void getCommand(std::string& cmdLine, std::string& outFile) override;
 
   public:
     GunzipFileWork(Application& app, WorkParent& parent,
@@ -21,5 +24,8 @@ class GunzipFileWork : public RunCommandWork
                    size_t maxRetries = Work::RETRY_NEVER);
     ~GunzipFileWork();
     void onReset() override;
+
+  protected:
+    Task getBackgroundTask() override;
 };
 }
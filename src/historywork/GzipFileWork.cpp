@@ -3,14 +3,20 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/GzipFileWork.h"
+#include "main/Application.h"
 #include "util/Fs.h"
+#include "util/Gzip.h"
+#include "util/Logging.h"
+
+#include <thread>
 
 namespace stellar
 {
 
 GzipFileWork::GzipFileWork(Application& app, WorkParent& parent,
                            std::string const& filenameNoGz, bool keepExisting)
-    : RunCommandWork(app, parent, std::string("gzip-file ") + filenameNoGz)
+    : BackgroundWork(app, parent, std::string("gzip-file ") + filenameNoGz,
+                     Application::WORKER_POOL_HISTORY_IO)
     , mFilenameNoGz(filenameNoGz)
     , mKeepExisting(keepExisting)
 {
@@ -25,19 +31,44 @@ GzipFileWork::~GzipFileWork()
 void
 GzipFileWork::onReset()
 {
+    BackgroundWork::onReset();
     std::string filenameGz = mFilenameNoGz + ".gz";
     std::remove(filenameGz.c_str());
 }
 
-void
-GzipFileWork::getCommand(std::string& cmdLine, std::string& outFile)
+BackgroundWork::Task
+GzipFileWork::getBackgroundTask()
 {
-    cmdLine = "gzip ";
-    if (mKeepExisting)
-    {
-        cmdLine += "-c ";
-        outFile = mFilenameNoGz + ".gz";
-    }
-    cmdLine += mFilenameNoGz;
+    std::string filenameNoGz = mFilenameNoGz;
+    bool keepExisting = mKeepExisting;
+    return [filenameNoGz, keepExisting]() {
+        std::string filenameGz = filenameNoGz + ".gz";
+        try
+        {
+            // bucket files stored compressed only need their members
+            // joined
+            if (gz::isBlockFile(filenameNoGz))
+            {
+                gz::transcodeBlockFile(filenameNoGz, filenameGz);
+            }
+            else
+            {
+                gz::compressFile(filenameNoGz, filenameGz,
+                                 std::thread::hardware_concurrency());
+            }
+            if (!keepExisting)
+            {
+                std::remove(filenameNoGz.c_str());
+            }
+            return WORK_COMPLETE_OK;
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "History")
+                << "FAILED compressing " << filenameNoGz << ": " << e.what();
+            std::remove(filenameGz.c_str());
+            return WORK_COMPLETE_FAILURE;
+        }
+    };
 }
 }
@@ -4,21 +4,27 @@
 
 #pragma once
 
-#include "historywork/RunCommandWork.h"
+#include "work/BackgroundWork.h"
 
 namespace stellar
 {
 
-class GzipFileWork : public RunCommandWork
+/**
+ * Compresses a file to <file>.gz in process (see gz::compressFile), on a
+ * worker thread, removing the original unless @p keepExisting.
+ */
+class GzipFileWork : public BackgroundWork
 {
     std::string mFilenameNoGz;
     bool mKeepExisting;
-    void getCommand(std::string& cmdLine, std::string& outFile) override;
 
   public:
     GzipFileWork(Application& app, WorkParent& parent,
                  std::string const& filenameNoGz, bool keepExisting = false);
     ~GzipFileWork();
     void onReset() override;
+
+  protected:
+    Task getBackgroundTask() override;
 };
 }
@@ -0,0 +1,66 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "historywork/IndexCheckpointFileWork.h"
+#include "history/CheckpointIndex.h"
+#include "history/FileTransferInfo.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+
+namespace stellar
+{
+
+IndexCheckpointFileWork::IndexCheckpointFileWork(Application& app,
+                                                 WorkParent& parent,
+                                                 FileTransferInfo const& file)
+    : BackgroundWork(app, parent,
+                     std::string("index-checkpoint-file ") +
+                         file.localPath_nogz(),
+                     Application::WORKER_POOL_HISTORY_IO)
+    , mType(file.getType())
+    , mFilename(file.localPath_nogz())
+    , mBgzFilename(file.localPath_bgz())
+    , mIndexFilename(file.localPath_idx())
+{
+}
+
+IndexCheckpointFileWork::~IndexCheckpointFileWork()
+{
+    clearChildren();
+}
+
+void
+IndexCheckpointFileWork::onReset()
+{
+    BackgroundWork::onReset();
+    std::remove(mBgzFilename.c_str());
+    std::remove(mIndexFilename.c_str());
+}
+
+BackgroundWork::Task
+IndexCheckpointFileWork::getBackgroundTask()
+{
+    auto type = mType;
+    auto filename = mFilename;
+    auto bgzFilename = mBgzFilename;
+    auto indexFilename = mIndexFilename;
+    return [type, filename, bgzFilename, indexFilename]() {
+        try
+        {
+            CheckpointIndex::build(type, filename, bgzFilename)
+                .save(indexFilename);
+            return WORK_COMPLETE_OK;
+        }
+        catch (std::exception& e)
+        {
+            // the file is then published without index
+            CLOG(WARNING, "History")
+                << "FAILED indexing " << filename << ": " << e.what();
+            std::remove(bgzFilename.c_str());
+            std::remove(indexFilename.c_str());
+            return WORK_COMPLETE_OK;
+        }
+    };
+}
+}
@@ -0,0 +1,35 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#pragma once
+
+#include "work/BackgroundWork.h"
+
+namespace stellar
+{
+
+class FileTransferInfo;
+
+/**
+ * Writes the block compressed variant and the index of a checkpoint file
+ * (see CheckpointIndex), next to it, on a worker thread. A file that can't
+ * be indexed is only logged: it is then published without index.
+ */
+class IndexCheckpointFileWork : public BackgroundWork
+{
+    std::string mType;
+    std::string mFilename;
+    std::string mBgzFilename;
+    std::string mIndexFilename;
+
+  public:
+    IndexCheckpointFileWork(Application& app, WorkParent& parent,
+                            FileTransferInfo const& file);
+    ~IndexCheckpointFileWork();
+    void onReset() override;
+
+  protected:
+    Task getBackgroundTask() override;
+};
+}
@@ -3,16 +3,26 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/PublishWork.h"
+#include "bucket/BucketManager.h"
+#include "crypto/Hex.h"
+#include "history/FileTransferInfo.h"
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManager.h"
 #include "history/StateSnapshot.h"
+#include "historywork/GetHistoryArchiveStateWork.h"
+#include "historywork/GzipFileWork.h"
+#include "historywork/IndexCheckpointFileWork.h"
 #include "historywork/PutSnapshotFilesWork.h"
 #include "historywork/ResolveSnapshotWork.h"
 #include "historywork/WriteSnapshotWork.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "main/Config.h"
+#include "util/Fs.h"
 #include "util/Logging.h"
 
+#include <set>
+
 namespace stellar
 {
 
@@ -43,9 +53,23 @@ PublishWork::getStatus() const
         {
             return mWriteSnapshotWork->getStatus();
         }
+        else if (mGetArchiveStatesWork)
+        {
+            return mGetArchiveStatesWork->getStatus();
+        }
+        else if (mCompressFilesWork)
+        {
+            return mCompressFilesWork->getStatus();
+        }
         else if (mUpdateArchivesWork)
         {
-            return mUpdateArchivesWork->getStatus();
+            // the progress of every archive
+            std::string status;
+            for (auto const& w : mPutSnapshotFilesWorks)
+            {
+                status += (status.empty() ? "" : "; ") + w->getStatus();
+            }
+            return status;
         }
     }
     return Work::getStatus();
@@ -58,7 +82,38 @@ PublishWork::onReset()
 
     mResolveSnapshotWork.reset();
     mWriteSnapshotWork.reset();
+    mGetArchiveStatesWork.reset();
+    mCompressFilesWork.reset();
     mUpdateArchivesWork.reset();
+    mPutSnapshotFilesWorks.clear();
+    mArchives.clear();
+    mRemoteStates.clear();
+}
+
+std::vector<std::shared_ptr<FileTransferInfo>>
+PublishWork::filesToSend(HistoryArchiveState const& remoteState) const
+{
+    std::vector<std::shared_ptr<FileTransferInfo>> files = {
+        mSnapshot->mLedgerSnapFile, mSnapshot->mTransactionSnapFile,
+        mSnapshot->mTransactionResultSnapFile, mSnapshot->mSCPHistorySnapFile};
+
+    auto buckets = mSnapshot->mLocalState.differingBuckets(remoteState);
+    for (auto const& hash : buckets)
+    {
+        auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
+        assert(b);
+        files.push_back(std::make_shared<FileTransferInfo>(*b));
+    }
+
+    std::vector<std::shared_ptr<FileTransferInfo>> res;
+    for (auto const& f : files)
+    {
+        if (f && fs::exists(f->localPath_nogz()))
+        {
+            res.push_back(f);
+        }
+    }
+    return res;
 }
 
 Work::State
@@ -78,15 +133,61 @@ PublishWork::onSuccess()
         return WORK_PENDING;
     }
 
-    // Phase 3: update archives
+    // Phase 3: fetch the history archive states of all archives
+    if (!mGetArchiveStatesWork)
+    {
+        mArchives =
+            mApp.getHistoryArchiveManager().getWritableHistoryArchives();
+        // the works keep references to the states: sized before they start
+        mRemoteStates.assign(mArchives.size(), HistoryArchiveState());
+        mGetArchiveStatesWork = addWork<Work>("get-archive-states");
+        for (size_t i = 0; i < mArchives.size(); ++i)
+        {
+            mGetArchiveStatesWork->addWork<GetHistoryArchiveStateWork>(
+                "get-history-archive-state-" + mArchives[i]->getName(),
+                mRemoteStates[i], 0, mArchives[i]);
+        }
+        return WORK_PENDING;
+    }
+
+    // Phase 4: compress, once, every file some archive is missing, and
+    // index the checkpoint files
+    if (!mCompressFilesWork)
+    {
+        mCompressFilesWork = addWork<Work>("compress-snapshot-files");
+        std::set<std::string> compressed;
+        for (auto const& remoteState : mRemoteStates)
+        {
+            for (auto const& f : filesToSend(remoteState))
+            {
+                if (compressed.insert(f->localPath_nogz()).second)
+                {
+                    mCompressFilesWork->addWork<GzipFileWork>(
+                        f->localPath_nogz(), true);
+                    if (mApp.getConfig().PUBLISH_CHECKPOINT_INDEXES &&
+                        f->getType() != HISTORY_FILE_TYPE_BUCKET)
+                    {
+                        mCompressFilesWork->addWork<IndexCheckpointFileWork>(
+                            *f);
+                    }
+                }
+            }
+        }
+        return WORK_PENDING;
+    }
+
+    // Phase 5: update all archives at once
     if (!mUpdateArchivesWork)
     {
         mUpdateArchivesWork = addWork<Work>("update-archives");
-        for (auto& writableArchive :
-             mApp.getHistoryArchiveManager().getWritableHistoryArchives())
+        auto maxRunning = mApp.getConfig().MAX_CONCURRENT_SUBPROCESSES /
+                          std::max<size_t>(mArchives.size(), 1);
+        for (size_t i = 0; i < mArchives.size(); ++i)
         {
-            mUpdateArchivesWork->addWork<PutSnapshotFilesWork>(writableArchive,
-                                                               mSnapshot);
+            mPutSnapshotFilesWorks.push_back(
+                mUpdateArchivesWork->addWork<PutSnapshotFilesWork>(
+                    mArchives[i], mSnapshot, filesToSend(mRemoteStates[i]),
+                    maxRunning));
         }
         return WORK_PENDING;
     }
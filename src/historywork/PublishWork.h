@@ -4,21 +4,37 @@
 
 #pragma once
 
+#include "history/HistoryArchive.h"
 #include "work/Work.h"
 
 namespace stellar
 {
 
+class FileTransferInfo;
 struct StateSnapshot;
 
+// Writes a snapshot, then publishes it to all the writable archives at once:
+// the states of the archives are fetched, the files any of them misses are
+// compressed once, and each archive uploads its files with a share of the
+// subprocess slots (see PutSnapshotFilesWork).
 class PublishWork : public Work
 {
     std::shared_ptr<StateSnapshot> mSnapshot;
     std::vector<std::string> mOriginalBuckets;
 
+    std::vector<std::shared_ptr<HistoryArchive>> mArchives;
+    std::vector<HistoryArchiveState> mRemoteStates;
+
     std::shared_ptr<Work> mResolveSnapshotWork;
     std::shared_ptr<Work> mWriteSnapshotWork;
+    std::shared_ptr<Work> mGetArchiveStatesWork;
+    std::shared_ptr<Work> mCompressFilesWork;
     std::shared_ptr<Work> mUpdateArchivesWork;
+    std::vector<std::shared_ptr<Work>> mPutSnapshotFilesWorks;
+
+    // files of the snapshot (buckets included) missing from the archive
+    std::vector<std::shared_ptr<FileTransferInfo>>
+    filesToSend(HistoryArchiveState const& remoteState) const;
 
   public:
     PublishWork(Application& app, WorkParent& parent,
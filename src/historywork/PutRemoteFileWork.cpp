@@ -33,6 +33,12 @@ PutRemoteFileWork::getCommand(std::string& cmdLine, std::string& outFile)
     cmdLine = mArchive->putFileCmd(mLocal, mRemote);
 }
 
+ProcessClass
+PutRemoteFileWork::getProcessClass() const
+{
+    return PROCESS_CLASS_TRANSFER;
+}
+
 Work::State
 PutRemoteFileWork::onSuccess()
 {
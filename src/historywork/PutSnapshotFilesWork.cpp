@@ -3,15 +3,15 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/PutSnapshotFilesWork.h"
-#include "bucket/BucketManager.h"
 #include "history/FileTransferInfo.h"
 #include "history/StateSnapshot.h"
-#include "historywork/GetHistoryArchiveStateWork.h"
-#include "historywork/GzipFileWork.h"
 #include "historywork/MakeRemoteDirWork.h"
 #include "historywork/PutHistoryArchiveStateWork.h"
 #include "historywork/PutRemoteFileWork.h"
+#include "lib/util/format.h"
 #include "main/Application.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
 
 namespace stellar
 {
@@ -19,10 +19,13 @@ namespace stellar
 PutSnapshotFilesWork::PutSnapshotFilesWork(
     Application& app, WorkParent& parent,
     std::shared_ptr<HistoryArchive> archive,
-    std::shared_ptr<StateSnapshot> snapshot)
+    std::shared_ptr<StateSnapshot> snapshot,
+    std::vector<std::shared_ptr<FileTransferInfo>> files, size_t maxRunning)
     : Work(app, parent, "put-snapshot-files-" + archive->getName())
     , mArchive(archive)
     , mSnapshot(snapshot)
+    , mFiles(std::move(files))
+    , mMaxRunning(std::max<size_t>(maxRunning, 1))
 {
 }
 
@@ -31,63 +34,93 @@ PutSnapshotFilesWork::~PutSnapshotFilesWork()
     clearChildren();
 }
 
+std::string
+PutSnapshotFilesWork::getStatus() const
+{
+    if (mState == WORK_PENDING)
+    {
+        if (mPutHistoryArchiveStateWork)
+        {
+            return fmt::format(
+                "Publishing to {:s}: updating history archive state",
+                mArchive->getName());
+        }
+        return fmt::format("Publishing to {:s}: {:d}/{:d} files uploaded",
+                           mArchive->getName(), mDone, mFiles.size());
+    }
+    return Work::getStatus();
+}
+
+void
+PutSnapshotFilesWork::addNextPut()
+{
+    auto const& f = mFiles[mNext++];
+    std::shared_ptr<Work> put = addWork<PutRemoteFileWork>(
+        f->localPath_gz(), f->remoteName(), mArchive);
+    if (fs::exists(f->localPath_idx()))
+    {
+        // the block compressed variant before the index pointing into it
+        put = put->addWork<PutRemoteFileWork>(
+            f->localPath_idx(), f->remoteName_idx(), mArchive);
+        put = put->addWork<PutRemoteFileWork>(
+            f->localPath_bgz(), f->remoteName_bgz(), mArchive);
+    }
+    put->addWork<MakeRemoteDirWork>(f->remoteDir(), mArchive);
+}
+
 void
 PutSnapshotFilesWork::onReset()
 {
     clearChildren();
-
-    mGetHistoryArchiveStateWork.reset();
-    mPutFilesWork.reset();
+    mNext = 0;
+    mDone = 0;
     mPutHistoryArchiveStateWork.reset();
+    while (mChildren.size() < mMaxRunning && mNext < mFiles.size())
+    {
+        addNextPut();
+    }
 }
 
-Work::State
-PutSnapshotFilesWork::onSuccess()
+void
+PutSnapshotFilesWork::notify(std::string const& child)
 {
-    // Phase 1: fetch remote history archive state
-    if (!mGetHistoryArchiveStateWork)
+    if (mChildren.find(child) == mChildren.end())
     {
-        mGetHistoryArchiveStateWork = addWork<GetHistoryArchiveStateWork>(
-            "get-history-archive-state", mRemoteState, 0, mArchive);
-        return WORK_PENDING;
+        CLOG(WARNING, "Work")
+            << "PutSnapshotFilesWork notified by unknown child " << child;
+        return;
     }
 
-    // Phase 2: put all requisite data files
-    if (!mPutFilesWork)
+    if (!mPutHistoryArchiveStateWork)
     {
-        mPutFilesWork = addWork<Work>("put-files");
-
-        std::vector<std::shared_ptr<FileTransferInfo>> files = {
-            mSnapshot->mLedgerSnapFile, mSnapshot->mTransactionSnapFile,
-            mSnapshot->mTransactionResultSnapFile,
-            mSnapshot->mSCPHistorySnapFile};
-
-        std::vector<std::string> bucketsToSend =
-            mSnapshot->mLocalState.differingBuckets(mRemoteState);
-
-        for (auto const& hash : bucketsToSend)
+        std::vector<std::string> done;
+        for (auto const& c : mChildren)
         {
-            auto b = mApp.getBucketManager().getBucketByHash(hexToBin256(hash));
-            assert(b);
-            files.push_back(std::make_shared<FileTransferInfo>(*b));
+            if (c.second->getState() == WORK_SUCCESS)
+            {
+                done.push_back(c.first);
+            }
         }
-        for (auto f : files)
+        for (auto const& d : done)
         {
-            if (f && fs::exists(f->localPath_nogz()))
+            mChildren.erase(d);
+            ++mDone;
+            if (mNext < mFiles.size())
             {
-                auto put = mPutFilesWork->addWork<PutRemoteFileWork>(
-                    f->localPath_gz(), f->remoteName(), mArchive);
-                auto mkdir =
-                    put->addWork<MakeRemoteDirWork>(f->remoteDir(), mArchive);
-                mkdir->addWork<GzipFileWork>(f->localPath_nogz(), true);
+                addNextPut();
             }
         }
-        return WORK_PENDING;
     }
+    advance();
+}
 
-    // Phase 3: update remote history archive state
+Work::State
+PutSnapshotFilesWork::onSuccess()
+{
+    // all the files are uploaded: update remote history archive state
     if (!mPutHistoryArchiveStateWork)
     {
+        assert(mDone == mFiles.size());
         mPutHistoryArchiveStateWork = addWork<PutHistoryArchiveStateWork>(
             mSnapshot->mLocalState, mArchive);
         return WORK_PENDING;
@@ -10,24 +10,37 @@
 namespace stellar
 {
 
+class FileTransferInfo;
 struct StateSnapshot;
 
+// Uploads the files of a snapshot missing from an archive, compressed
+// already (see PublishWork), then its history archive state. At most
+// maxRunning files are uploaded at once, so that the archives published to
+// together share the subprocess slots instead of the first one queueing
+// all its files ahead of the others.
 class PutSnapshotFilesWork : public Work
 {
     std::shared_ptr<HistoryArchive> mArchive;
     std::shared_ptr<StateSnapshot> mSnapshot;
-    HistoryArchiveState mRemoteState;
+    std::vector<std::shared_ptr<FileTransferInfo>> mFiles;
+    size_t const mMaxRunning;
+    size_t mNext{0};
+    size_t mDone{0};
 
-    std::shared_ptr<Work> mGetHistoryArchiveStateWork;
-    std::shared_ptr<Work> mPutFilesWork;
     std::shared_ptr<Work> mPutHistoryArchiveStateWork;
 
+    void addNextPut();
+
   public:
     PutSnapshotFilesWork(Application& app, WorkParent& parent,
                          std::shared_ptr<HistoryArchive> archive,
-                         std::shared_ptr<StateSnapshot> snapshot);
+                         std::shared_ptr<StateSnapshot> snapshot,
+                         std::vector<std::shared_ptr<FileTransferInfo>> files,
+                         size_t maxRunning);
     ~PutSnapshotFilesWork();
+    std::string getStatus() const override;
     void onReset() override;
+    void notify(std::string const& child) override;
     Work::State onSuccess() override;
 };
 }
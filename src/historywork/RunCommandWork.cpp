@@ -20,6 +20,12 @@ RunCommandWork::~RunCommandWork()
     clearChildren();
 }
 
+ProcessClass
+RunCommandWork::getProcessClass() const
+{
+    return PROCESS_CLASS_OTHER;
+}
+
 void
 RunCommandWork::onStart()
 {
@@ -27,7 +33,8 @@ RunCommandWork::onStart()
     getCommand(cmd, outfile);
     if (!cmd.empty())
     {
-        auto exit = mApp.getProcessManager().runProcess(cmd, outfile);
+        auto exit = mApp.getProcessManager().runProcess(cmd, outfile,
+                                                        getProcessClass());
         exit.async_wait(callComplete());
     }
     else
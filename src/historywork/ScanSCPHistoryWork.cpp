@@ -0,0 +1,55 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "historywork/ScanSCPHistoryWork.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+
+namespace stellar
+{
+
+ScanSCPHistoryWork::ScanSCPHistoryWork(Application& app, WorkParent& parent,
+                                       std::string const& uniqueName,
+                                       std::vector<std::string> const& files)
+    : BackgroundWork(app, parent, uniqueName,
+                     Application::WORKER_POOL_HISTORY_IO)
+    , mFiles(files)
+    , mInferredQuorum(std::make_shared<InferredQuorum>())
+{
+}
+
+ScanSCPHistoryWork::~ScanSCPHistoryWork()
+{
+    clearChildren();
+}
+
+InferredQuorum const&
+ScanSCPHistoryWork::getInferredQuorum() const
+{
+    return *mInferredQuorum;
+}
+
+BackgroundWork::Task
+ScanSCPHistoryWork::getBackgroundTask()
+{
+    // each run starts over, in a quorum of its own
+    auto iq = std::make_shared<InferredQuorum>();
+    mInferredQuorum = iq;
+    auto files = mFiles;
+    return [files, iq]() {
+        for (auto const& f : files)
+        {
+            CLOG(DEBUG, "History") << "Scanning for QSets in " << f;
+            XDRInputFileStream in;
+            in.open(f);
+            SCPHistoryEntry tmp;
+            while (in && in.readOne(tmp))
+            {
+                iq->noteSCPHistory(tmp);
+            }
+        }
+        return WORK_COMPLETE_OK;
+    };
+}
+}
@@ -0,0 +1,34 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#pragma once
+
+#include "history/InferredQuorum.h"
+#include "work/BackgroundWork.h"
+
+namespace stellar
+{
+
+/**
+ * Notes the SCP messages of some downloaded scp history files in an
+ * InferredQuorum of its own, on a worker thread, for the caller to merge
+ * with the others once the work succeeds.
+ */
+class ScanSCPHistoryWork : public BackgroundWork
+{
+    std::vector<std::string> mFiles;
+    std::shared_ptr<InferredQuorum> mInferredQuorum;
+
+  public:
+    ScanSCPHistoryWork(Application& app, WorkParent& parent,
+                       std::string const& uniqueName,
+                       std::vector<std::string> const& files);
+    ~ScanSCPHistoryWork();
+
+    InferredQuorum const& getInferredQuorum() const;
+
+  protected:
+    Task getBackgroundTask() override;
+};
+}
@@ -3,17 +3,21 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "historywork/VerifyBucketWork.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketIndex.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "history/FileTransferInfo.h"
+#include "history/HistoryCache.h"
+#include "history/HistoryManager.h"
 #include "main/Application.h"
+#include "util/BloomFilter.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
 #include <medida/meter.h>
 #include <medida/metrics_registry.h>
 
-#include <fstream>
-
 namespace stellar
 {
 
@@ -21,8 +25,9 @@ VerifyBucketWork::VerifyBucketWork(
     Application& app, WorkParent& parent,
     std::map<std::string, std::shared_ptr<Bucket>>& buckets,
     std::string const& bucketFile, uint256 const& hash)
-    : Work(app, parent, std::string("verify-bucket-hash ") + bucketFile,
-           RETRY_NEVER)
+    : BackgroundWork(app, parent,
+                     std::string("verify-bucket-hash ") + bucketFile,
+                     Application::WORKER_POOL_HISTORY_IO, RETRY_NEVER)
     , mBuckets(buckets)
     , mBucketFile(bucketFile)
     , mHash(hash)
@@ -39,31 +44,34 @@ VerifyBucketWork::~VerifyBucketWork()
     clearChildren();
 }
 
-void
-VerifyBucketWork::onStart()
+std::string
+VerifyBucketWork::cacheName() const
+{
+    return fs::baseName(HISTORY_FILE_TYPE_BUCKET, binToHex(mHash), "xdr");
+}
+
+BackgroundWork::Task
+VerifyBucketWork::getBackgroundTask()
 {
     std::string filename = mBucketFile;
     uint256 hash = mHash;
-    Application& app = this->mApp;
-    auto handler = callComplete();
-    app.getWorkerIOService().post([&app, filename, handler, hash]() {
+    auto verified = std::make_shared<VerifiedIndex>();
+    mVerified = verified;
+    return [filename, hash, verified]() {
         auto hasher = SHA256::create();
-        asio::error_code ec;
-        char buf[4096];
+        try
         {
-            // ensure that the stream gets its own scope to avoid race with
-            // main thread
-            std::ifstream in(filename, std::ifstream::binary);
-            while (in)
-            {
-                in.read(buf, sizeof(buf));
-                hasher->add(ByteSlice(buf, in.gcount()));
-            }
+            std::vector<uint64_t> keyHashes;
+            auto index = BucketIndex::build(filename, &keyHashes, hasher.get());
             uint256 vHash = hasher->finish();
             if (vHash == hash)
             {
                 CLOG(DEBUG, "History") << "Verified hash (" << hexAbbrev(hash)
                                        << ") for " << filename;
+                verified->mIndex = std::move(index);
+                verified->mKeyFilter =
+                    std::make_unique<BloomFilter>(keyHashes);
+                return WORK_COMPLETE_OK;
             }
             else
             {
@@ -72,24 +80,31 @@ VerifyBucketWork::onStart()
                 CLOG(WARNING, "History") << "expected hash: " << binToHex(hash);
                 CLOG(WARNING, "History")
                     << "computed hash: " << binToHex(vHash);
-                ec = std::make_error_code(std::errc::io_error);
+                return WORK_COMPLETE_FAILURE;
             }
         }
-        app.getClock().getIOService().post([ec, handler]() { handler(ec); });
-    });
-}
-
-void
-VerifyBucketWork::onRun()
-{
-    // Do nothing: we spawned the verifier in onStart().
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "History")
+                << "FAILED reading " << filename << ": " << e.what();
+            return WORK_COMPLETE_FAILURE;
+        }
+    };
 }
 
 Work::State
 VerifyBucketWork::onSuccess()
 {
     auto b = mApp.getBucketManager().adoptFileAsBucket(mBucketFile, mHash);
+    if (mVerified && mVerified->mIndex)
+    {
+        mVerified->mIndex->save(b->getFilename());
+        b->setIndex(std::move(mVerified->mIndex));
+        b->setKeyFilter(std::move(mVerified->mKeyFilter));
+    }
+    mVerified.reset();
     mBuckets[binToHex(mHash)] = b;
+    mApp.getHistoryManager().getCache().add(cacheName(), b->getFilename());
     mVerifyBucketSuccess.Mark();
     return WORK_SUCCESS;
 }
@@ -98,6 +113,8 @@ void
 VerifyBucketWork::onFailureRetry()
 {
     mVerifyBucketFailure.Mark();
+    // in case the file came from there
+    mApp.getHistoryManager().getCache().remove(cacheName());
     Work::onFailureRetry();
 }
 
@@ -105,6 +122,7 @@ void
 VerifyBucketWork::onFailureRaise()
 {
     mVerifyBucketFailure.Mark();
+    mApp.getHistoryManager().getCache().remove(cacheName());
     Work::onFailureRaise();
 }
 }
@@ -4,7 +4,7 @@
 
 #pragma once
 
-#include "work/Work.h"
+#include "work/BackgroundWork.h"
 #include "xdr/Stellar-types.h"
 
 namespace medida
@@ -16,25 +16,44 @@ namespace stellar
 {
 
 class Bucket;
-
-class VerifyBucketWork : public Work
+class BucketIndex;
+class BloomFilter;
+
+/**
+ * Checks the hash of a downloaded bucket file and adopts it. The same pass
+ * over the file builds the bucket's index and key filter, so the adopted
+ * bucket is ready for point lookups without being read again.
+ */
+class VerifyBucketWork : public BackgroundWork
 {
+    struct VerifiedIndex
+    {
+        std::unique_ptr<BucketIndex> mIndex;
+        std::unique_ptr<BloomFilter> mKeyFilter;
+    };
+
     std::map<std::string, std::shared_ptr<Bucket>>& mBuckets;
     std::string mBucketFile;
     uint256 mHash;
+    // filled on a worker thread before the work completes
+    std::shared_ptr<VerifiedIndex> mVerified;
 
     medida::Meter& mVerifyBucketSuccess;
     medida::Meter& mVerifyBucketFailure;
 
+    // name of the bucket in the HistoryCache
+    std::string cacheName() const;
+
   public:
     VerifyBucketWork(Application& app, WorkParent& parent,
                      std::map<std::string, std::shared_ptr<Bucket>>& buckets,
                      std::string const& bucketFile, uint256 const& hash);
     ~VerifyBucketWork();
-    void onRun() override;
-    void onStart() override;
     Work::State onSuccess() override;
     void onFailureRetry() override;
     void onFailureRaise() override;
+
+  protected:
+    Task getBackgroundTask() override;
 };
 }
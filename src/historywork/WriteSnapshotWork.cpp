@@ -15,7 +15,8 @@ namespace stellar
 
 WriteSnapshotWork::WriteSnapshotWork(Application& app, WorkParent& parent,
                                      std::shared_ptr<StateSnapshot> snapshot)
-    : Work(app, parent, "write-snapshot", Work::RETRY_A_LOT)
+    : BackgroundWork(app, parent, "write-snapshot",
+                     Application::WORKER_POOL_HISTORY_IO, Work::RETRY_A_LOT)
     , mSnapshot(snapshot)
 {
 }
@@ -25,36 +26,21 @@ WriteSnapshotWork::~WriteSnapshotWork()
     clearChildren();
 }
 
-void
-WriteSnapshotWork::onStart()
+BackgroundWork::Task
+WriteSnapshotWork::getBackgroundTask()
 {
-    auto handler = callComplete();
     auto snap = mSnapshot;
-    auto work = [handler, snap]() {
-        asio::error_code ec;
-        if (!snap->writeHistoryBlocks())
-        {
-            ec = std::make_error_code(std::errc::io_error);
-        }
-        snap->mApp.getClock().getIOService().post(
-            [handler, ec]() { handler(ec); });
+    return [snap]() {
+        return snap->writeHistoryBlocks() ? WORK_COMPLETE_OK
+                                          : WORK_COMPLETE_FAILURE;
     };
-
-    // Throw the work over to a worker thread if we can use DB pools,
-    // otherwise run on main thread.
-    if (mApp.getDatabase().canUsePool())
-    {
-        mApp.getWorkerIOService().post(work);
-    }
-    else
-    {
-        work();
-    }
 }
 
-void
-WriteSnapshotWork::onRun()
+bool
+WriteSnapshotWork::canRunInBackground() const
 {
-    // Do nothing: we spawned the writer in onStart().
+    // the snapshot is read from the database, which worker threads can
+    // only do through the session pool
+    return mApp.getDatabase().canUsePool();
 }
 }
@@ -4,14 +4,14 @@
 
 #pragma once
 
-#include "work/Work.h"
+#include "work/BackgroundWork.h"
 
 namespace stellar
 {
 
 struct StateSnapshot;
 
-class WriteSnapshotWork : public Work
+class WriteSnapshotWork : public BackgroundWork
 {
     std::shared_ptr<StateSnapshot> mSnapshot;
 
@@ -19,7 +19,9 @@ class WriteSnapshotWork : public Work
     WriteSnapshotWork(Application& app, WorkParent& parent,
                       std::shared_ptr<StateSnapshot> snapshot);
     ~WriteSnapshotWork();
-    void onStart() override;
-    void onRun() override;
+
+  protected:
+    Task getBackgroundTask() override;
+    bool canRunInBackground() const override;
 };
 }
@@ -40,6 +40,24 @@ BucketListIsConsistentWithDatabase::getName() const
     return "BucketListIsConsistentWithDatabase";
 }
 
+std::string
+BucketListIsConsistentWithDatabase::checkEntry(BucketEntry const& entry,
+                                               Database& db)
+{
+    if (entry.type() == LIVEENTRY)
+    {
+        return EntryFrame::checkAgainstDatabase(entry.liveEntry(), db);
+    }
+    if (EntryFrame::exists(db, entry.deadEntry()))
+    {
+        auto fromDb = EntryFrame::storeLoad(entry.deadEntry(), db);
+        std::string s = "Entry with type DEADENTRY found in database ";
+        s += xdr::xdr_to_string(fromDb->mEntry, "db");
+        return s;
+    }
+    return {};
+}
+
 std::string
 BucketListIsConsistentWithDatabase::checkOnBucketApply(
     std::shared_ptr<Bucket const> bucket, uint32_t oldestLedger,
@@ -99,21 +117,11 @@ BucketListIsConsistentWithDatabase::checkOnBucketApply(
             default:
                 abort();
             }
-            auto s = EntryFrame::checkAgainstDatabase(e.liveEntry(), mDb);
-            if (!s.empty())
-            {
-                return s;
-            }
         }
-        else if (e.type() == DEADENTRY)
+        auto s = checkEntry(e, mDb);
+        if (!s.empty())
         {
-            if (EntryFrame::exists(mDb, e.deadEntry()))
-            {
-                auto fromDb = EntryFrame::storeLoad(e.deadEntry(), mDb);
-                std::string s = "Entry with type DEADENTRY found in database ";
-                s += xdr::xdr_to_string(fromDb->mEntry, "db");
-                return s;
-            }
+            return s;
         }
     }
 
@@ -10,6 +10,7 @@ namespace stellar
 {
 
 class Application;
+struct BucketEntry;
 class Database;
 class LedgerDelta;
 
@@ -33,6 +34,11 @@ class BucketListIsConsistentWithDatabase : public Invariant
 
     explicit BucketListIsConsistentWithDatabase(Database& db);
 
+    // Compare a single bucket entry to the database: a LIVEENTRY must be
+    // stored identically, a DEADENTRY must not be stored at all. Returns a
+    // description of the mismatch, empty if there is none.
+    static std::string checkEntry(BucketEntry const& entry, Database& db);
+
     virtual std::string getName() const override;
 
     virtual std::string checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
@@ -12,6 +12,7 @@
 #include "catchup/ApplyBucketsWork.h"
 #include "database/Database.h"
 #include "invariant/Invariant.h"
+#include "invariant/IncrementalBucketListChecker.h"
 #include "invariant/InvariantDoesNotHold.h"
 #include "invariant/InvariantManager.h"
 #include "ledger/AccountFrame.h"
@@ -841,3 +842,56 @@ TEST_CASE("BucketListIsConsistentWithDatabase merged LIVEENTRY and DEADENTRY",
         }
     }
 }
+
+TEST_CASE("BucketListIsConsistentWithDatabase incremental check",
+          "[invariant][bucketlistconsistent]")
+{
+    std::default_random_engine gen;
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig(0));
+    generateLedgers(
+        app, 2, 100, 5, generateValidEntryFrames, 2,
+        std::bind(deleteRandomLedgerEntries, _1, _2, std::ref(gen)));
+
+    IncrementalBucketListChecker checker(*app);
+    auto runPass = [&]() {
+        std::string res;
+        auto passes = checker.getCompletedPasses();
+        size_t slices = 0;
+        while (checker.getCompletedPasses() == passes)
+        {
+            auto s = checker.checkSlice(7);
+            if (res.empty())
+            {
+                res = s;
+            }
+            REQUIRE(checker.getProgressPercent() <= 100);
+            ++slices;
+        }
+        // 500 live entries and some dead ones, in slices of 7
+        REQUIRE(slices > 500 / 7);
+        return res;
+    };
+
+    SECTION("consistent")
+    {
+        REQUIRE(runPass().empty());
+        REQUIRE(runPass().empty());
+    }
+
+    SECTION("entry missing from the database")
+    {
+        auto& bl = app->getBucketManager().getBucketList();
+        BucketInputIterator iter(bl.getLevel(0).getCurr());
+        while (iter && (*iter).type() != LIVEENTRY)
+        {
+            ++iter;
+        }
+        REQUIRE(iter);
+        LedgerHeader lh;
+        LedgerDelta ld(lh, app->getDatabase(), false);
+        EntryFrame::storeDelete(ld, app->getDatabase(),
+                                LedgerEntryKey((*iter).liveEntry()));
+        REQUIRE(!runPass().empty());
+    }
+}
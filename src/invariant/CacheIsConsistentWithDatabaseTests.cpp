@@ -149,8 +149,8 @@ TEST_CASE("Check cache is consistent", "[invariant][cacheisconsistent]")
             {
                 generateLedger(*app, ld, liveEntries, 2 + j, 10, gen);
                 REQUIRE_NOTHROW(
-                    app->getInvariantManager().checkOnOperationApply({}, res,
-                                                                     ld));
+                    app->getInvariantManager().checkOnOperationApply(
+                        {}, res, ld, {}));
             }
             else
             {
@@ -161,8 +161,8 @@ TEST_CASE("Check cache is consistent", "[invariant][cacheisconsistent]")
                 }
                 OperationResult res2;
                 REQUIRE_THROWS_AS(
-                    app->getInvariantManager().checkOnOperationApply({}, res2,
-                                                                     ld),
+                    app->getInvariantManager().checkOnOperationApply(
+                        {}, res2, ld, {}),
                     InvariantDoesNotHold);
             }
         }
@@ -42,6 +42,12 @@ ConservationOfLumens::calculateDeltaBalance(LedgerEntry const* current,
     return 0;
 }
 
+bool
+ConservationOfLumens::canCheckInBackground() const
+{
+    return true;
+}
+
 std::string
 ConservationOfLumens::checkOnOperationApply(Operation const& operation,
                                             OperationResult const& result,
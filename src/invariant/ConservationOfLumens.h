@@ -32,6 +32,8 @@ class ConservationOfLumens : public Invariant
                           OperationResult const& result,
                           LedgerDelta const& delta) override;
 
+    virtual bool canCheckInBackground() const override;
+
   private:
     int64_t calculateDeltaBalance(LedgerEntry const* current,
                                   LedgerEntry const* previous) const;
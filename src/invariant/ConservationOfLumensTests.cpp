@@ -113,7 +113,7 @@ TEST_CASE("Total coins change without inflation",
     ld.getHeader().totalCoins = dist(gen);
     OperationResult res;
     REQUIRE_THROWS_AS(
-        app->getInvariantManager().checkOnOperationApply({}, res, ld),
+        app->getInvariantManager().checkOnOperationApply({}, res, ld, {}),
         InvariantDoesNotHold);
 }
 
@@ -134,7 +134,7 @@ TEST_CASE("Fee pool change without inflation",
     ld.getHeader().feePool = dist(gen);
     OperationResult res;
     REQUIRE_THROWS_AS(
-        app->getInvariantManager().checkOnOperationApply({}, res, ld),
+        app->getInvariantManager().checkOnOperationApply({}, res, ld, {}),
         InvariantDoesNotHold);
 }
 
@@ -272,12 +272,12 @@ TEST_CASE("Inflation changes are consistent",
         LedgerDelta ld(lh, app->getDatabase(), false);
         ld.getHeader().feePool += deltaFeePool;
         REQUIRE_THROWS_AS(
-            app->getInvariantManager().checkOnOperationApply({}, opRes, ld),
+            app->getInvariantManager().checkOnOperationApply({}, opRes, ld, {}),
             InvariantDoesNotHold);
 
         ld.getHeader().totalCoins += deltaFeePool + inflationAmount;
         REQUIRE_THROWS_AS(
-            app->getInvariantManager().checkOnOperationApply({}, opRes, ld),
+            app->getInvariantManager().checkOnOperationApply({}, opRes, ld, {}),
             InvariantDoesNotHold);
 
         auto entries2 = updateBalances(entries1, *app, gen, inflationAmount);
@@ -0,0 +1,223 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "invariant/IncrementalBucketListChecker.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketInputIterator.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
+#include "bucket/LedgerCmp.h"
+#include "database/Database.h"
+#include "invariant/BucketListIsConsistentWithDatabase.h"
+#include "ledger/EntryFrame.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace stellar
+{
+
+namespace
+{
+LedgerKey
+keyOf(BucketEntry const& entry)
+{
+    return entry.type() == LIVEENTRY ? LedgerEntryKey(entry.liveEntry())
+                                     : entry.deadEntry();
+}
+}
+
+IncrementalBucketListChecker::IncrementalBucketListChecker(Application& app)
+    : mApp{app}
+    , mTimer{app}
+    , mLastQueryTime{app.getDatabase().totalQueryTime()}
+    , mLastCheckTime{app.getClock().now()}
+    , mEntriesChecked{app.getMetrics().NewMeter(
+          {"bucket", "checkdb-incremental", "entries"}, "entry")}
+    , mSlicesSkipped{app.getMetrics().NewMeter(
+          {"bucket", "checkdb-incremental", "skipped"}, "slice")}
+    , mPasses{app.getMetrics().NewMeter(
+          {"bucket", "checkdb-incremental", "passes"}, "pass")}
+    , mFailures{app.getMetrics().NewMeter(
+          {"bucket", "checkdb-incremental", "failures"}, "entry")}
+    , mProgress{app.getMetrics().NewCounter(
+          {"bucket", "checkdb-incremental", "progress-percent"})}
+{
+}
+
+void
+IncrementalBucketListChecker::start()
+{
+    if (mApp.getConfig().INCREMENTAL_CHECKDB_PERIOD.count() > 0)
+    {
+        scheduleCheck();
+    }
+}
+
+void
+IncrementalBucketListChecker::scheduleCheck()
+{
+    mTimer.expires_from_now(mApp.getConfig().INCREMENTAL_CHECKDB_PERIOD);
+    mTimer.async_wait([this]() { tick(); }, VirtualTimer::onFailureNoop);
+}
+
+void
+IncrementalBucketListChecker::tick()
+{
+    auto& cfg = mApp.getConfig();
+    auto idle = mApp.getDatabase().idleDbPercentSince(mLastQueryTime,
+                                                      mLastCheckTime);
+    if (!mApp.getLedgerManager().isSynced() ||
+        idle < cfg.INCREMENTAL_CHECKDB_MIN_IDLE_PERCENT)
+    {
+        mSlicesSkipped.Mark();
+    }
+    else
+    {
+        // the queries of the check do not count as load for load shedding
+        DBTimeExcluder qtExclude(mApp);
+        checkSlice(cfg.INCREMENTAL_CHECKDB_SLICE_SIZE);
+    }
+    mLastQueryTime = mApp.getDatabase().totalQueryTime();
+    mLastCheckTime = mApp.getClock().now();
+    scheduleCheck();
+}
+
+std::string
+IncrementalBucketListChecker::checkSlice(size_t count)
+{
+    // newest buckets first, so that the first iterator holding a key has the
+    // live state of that key
+    auto& bl = mApp.getBucketManager().getBucketList();
+    std::vector<std::unique_ptr<BucketInputIterator>> iters;
+    uint64_t totalSize = 0;
+    for (uint32_t i = 0; i < BucketList::kNumLevels; ++i)
+    {
+        auto const& level = bl.getLevel(i);
+        for (auto const& b : {level.getCurr(), level.getSnap()})
+        {
+            uint64_t size;
+            int64_t mtime;
+            if (b->isInMemory())
+            {
+                // no file offset to make progress with, and small anyway
+                size = 0;
+            }
+            else if (b->getFilename().empty() ||
+                     !fs::fileInfo(b->getFilename(), size, mtime))
+            {
+                continue;
+            }
+            totalSize += size;
+            iters.emplace_back(std::make_unique<BucketInputIterator>(b));
+            if (mNextKey)
+            {
+                iters.back()->seek(*mNextKey);
+            }
+        }
+    }
+
+    // iterator on the smallest key remaining, nullptr once they are all done
+    LedgerEntryIdCmp cmp;
+    auto nextIter = [&]() -> BucketInputIterator* {
+        BucketInputIterator* res = nullptr;
+        LedgerKey resKey;
+        for (auto& it : iters)
+        {
+            if (*it)
+            {
+                auto k = keyOf(**it);
+                if (!res || cmp(k, resKey))
+                {
+                    res = it.get();
+                    resKey = k;
+                }
+            }
+        }
+        return res;
+    };
+
+    std::string res;
+    auto& db = mApp.getDatabase();
+    for (size_t n = 0; n < count; ++n)
+    {
+        auto it = nextIter();
+        if (!it)
+        {
+            break;
+        }
+        auto entry = **it;
+        auto key = keyOf(entry);
+        for (auto& other : iters)
+        {
+            // keys of a bucket are unique, so at most one entry to skip
+            if (*other && !cmp(key, keyOf(**other)))
+            {
+                ++(*other);
+            }
+        }
+
+        auto s = BucketListIsConsistentWithDatabase::checkEntry(entry, db);
+        mEntriesChecked.Mark();
+        if (!s.empty())
+        {
+            CLOG(ERROR, "Invariant")
+                << "Incremental check of the bucket list found: " << s;
+            mFailures.Mark();
+            if (res.empty())
+            {
+                res = s;
+            }
+        }
+    }
+
+    auto it = nextIter();
+    if (it)
+    {
+        mNextKey = std::make_unique<LedgerKey>(keyOf(**it));
+        uint64_t done = 0;
+        for (auto& i : iters)
+        {
+            done += i->pos();
+        }
+        // offsets are in the uncompressed contents of compressed files (see
+        // COMPRESS_BUCKET_FILES), which are larger than the files
+        mProgressPercent = static_cast<uint32_t>(
+            totalSize == 0 ? 0
+                           : std::min<uint64_t>(100 * done / totalSize, 99));
+    }
+    else
+    {
+        CLOG(INFO, "Invariant") << "Incremental check of the bucket list "
+                                   "completed a pass";
+        mNextKey.reset();
+        mProgressPercent = 0;
+        ++mCompletedPasses;
+        mPasses.Mark();
+    }
+    mProgress.set_count(mProgressPercent);
+    return res;
+}
+
+uint32_t
+IncrementalBucketListChecker::getProgressPercent() const
+{
+    return mProgressPercent;
+}
+
+uint64_t
+IncrementalBucketListChecker::getCompletedPasses() const
+{
+    return mCompletedPasses;
+}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/Timer.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace medida
+{
+class Counter;
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Compares the bucket list to the database a slice at a time, as
+ * BucketListIsConsistentWithDatabase does for a whole bucket: every
+ * INCREMENTAL_CHECKDB_PERIOD, the next INCREMENTAL_CHECKDB_SLICE_SIZE keys
+ * of the bucket list (in key order, newest entry of each key) are checked,
+ * resuming after the keys of the previous slice and starting over once the
+ * last key is reached. Slices are skipped while the node is not synced or
+ * the database was busy since the previous slice.
+ *
+ * Entries are read from the current buckets, which hold the state of the
+ * last closed ledger like the database does, so each slice is consistent
+ * even if the bucket list changed since the previous one. Unlike checkdb,
+ * rows of the database missing from the bucket list are not detected, as
+ * that needs counting rows over the whole key space.
+ */
+class IncrementalBucketListChecker
+{
+  public:
+    explicit IncrementalBucketListChecker(Application& app);
+
+    // start checking according to app.getConfig()
+    void start();
+
+    // Check the next `count` keys of the bucket list against the database,
+    // returns a description of the first mismatch found, empty if none.
+    std::string checkSlice(size_t count);
+
+    // Percentage of the bucket list (in bytes) checked in this pass.
+    uint32_t getProgressPercent() const;
+
+    // Number of passes over the whole bucket list completed.
+    uint64_t getCompletedPasses() const;
+
+  private:
+    Application& mApp;
+    VirtualTimer mTimer;
+
+    // first key of the next slice, null at the start of a pass
+    std::unique_ptr<LedgerKey> mNextKey;
+    uint32_t mProgressPercent{0};
+    uint64_t mCompletedPasses{0};
+
+    // database usage at the end of the previous slice
+    std::chrono::nanoseconds mLastQueryTime;
+    VirtualClock::time_point mLastCheckTime;
+
+    medida::Meter& mEntriesChecked;
+    medida::Meter& mSlicesSkipped;
+    medida::Meter& mPasses;
+    medida::Meter& mFailures;
+    medida::Counter& mProgress;
+
+    void scheduleCheck();
+    void tick();
+};
+}
@@ -0,0 +1,83 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "invariant/InflationVoteTallyMatchesDatabase.h"
+#include "crypto/KeyUtils.h"
+#include "database/Database.h"
+#include "invariant/InvariantManager.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/InflationVoteTally.h"
+#include "ledger/LedgerDelta.h"
+#include "lib/util/format.h"
+#include "main/Application.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace stellar
+{
+
+std::shared_ptr<Invariant>
+InflationVoteTallyMatchesDatabase::registerInvariant(Application& app)
+{
+    return app.getInvariantManager()
+        .registerInvariant<InflationVoteTallyMatchesDatabase>(
+            app.getDatabase());
+}
+
+InflationVoteTallyMatchesDatabase::InflationVoteTallyMatchesDatabase(
+    Database& db)
+    : Invariant(false), mDb{db}
+{
+}
+
+std::string
+InflationVoteTallyMatchesDatabase::getName() const
+{
+    return "InflationVoteTallyMatchesDatabase";
+}
+
+std::string
+InflationVoteTallyMatchesDatabase::checkOnOperationApply(
+    Operation const& operation, OperationResult const& result,
+    LedgerDelta const& delta)
+{
+    auto tally = mDb.getInflationVoteTally();
+    if (!tally || operation.body.type() != INFLATION)
+    {
+        return {};
+    }
+
+    std::vector<AccountFrame::InflationVotes> expected;
+    AccountFrame::processForInflation(
+        [&](AccountFrame::InflationVotes const& votes) {
+            expected.emplace_back(votes);
+            return true;
+        },
+        std::numeric_limits<int>::max(), mDb);
+    auto actual = tally->getVotes(mDb, delta);
+
+    for (size_t i = 0; i < std::max(expected.size(), actual.size()); i++)
+    {
+        if (i >= expected.size() || i >= actual.size() ||
+            expected[i].mVotes != actual[i].mVotes ||
+            !(expected[i].mInflationDest == actual[i].mInflationDest))
+        {
+            auto describe = [](std::vector<AccountFrame::InflationVotes> const&
+                                   votes,
+                               size_t i) {
+                return i < votes.size()
+                           ? fmt::format(
+                                 "{} votes for {}", votes[i].mVotes,
+                                 KeyUtils::toStrKey(votes[i].mInflationDest))
+                           : std::string("nothing");
+            };
+            return fmt::format("Inflation vote tally has {} at rank {}, the "
+                               "database has {}",
+                               describe(actual, i), i, describe(expected, i));
+        }
+    }
+    return {};
+}
+}
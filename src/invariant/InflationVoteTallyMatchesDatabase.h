@@ -0,0 +1,37 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "invariant/Invariant.h"
+#include <memory>
+
+namespace stellar
+{
+
+class Application;
+class Database;
+
+// This Invariant is used to validate that the resident tally of inflation
+// votes (with INFLATION_VOTE_TALLY), on which inflation computes its winners,
+// matches the votes aggregated from the accounts table. It is only checked
+// after an inflation operation, comparing the votes of every destination.
+class InflationVoteTallyMatchesDatabase : public Invariant
+{
+  public:
+    static std::shared_ptr<Invariant> registerInvariant(Application& app);
+
+    explicit InflationVoteTallyMatchesDatabase(Database& db);
+
+    virtual std::string getName() const override;
+
+    virtual std::string
+    checkOnOperationApply(Operation const& operation,
+                          OperationResult const& result,
+                          LedgerDelta const& delta) override;
+
+  private:
+    Database& mDb;
+};
+}
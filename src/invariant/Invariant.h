@@ -39,6 +39,16 @@ class Invariant
         return mStrict;
     }
 
+    // whether checkOnOperationApply only depends on its arguments and keeps
+    // no state, so that it may run on a snapshot of the delta, on other
+    // threads, while the next operations are applied (see
+    // INVARIANT_CHECKS_IN_BACKGROUND in Config)
+    virtual bool
+    canCheckInBackground() const
+    {
+        return false;
+    }
+
     virtual std::string
     checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
                        uint32_t oldestLedger, uint32_t newestLedger)
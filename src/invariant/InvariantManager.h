@@ -40,12 +40,23 @@ class InvariantManager
                                     uint32_t ledger, uint32_t level,
                                     bool isCurr) = 0;
 
+    // @p txHash is the hash of the transaction of @p operation; with the
+    // ledger, it selects the operations checked by sampled invariants
     virtual void checkOnOperationApply(Operation const& operation,
                                        OperationResult const& opres,
-                                       LedgerDelta const& delta) = 0;
+                                       LedgerDelta const& delta,
+                                       Hash const& txHash) = 0;
+
+    // handles the failures found since the last call by the invariants
+    // checked in the background (see INVARIANT_CHECKS_IN_BACKGROUND), as
+    // checkOnOperationApply would have: may throw InvariantDoesNotHold
+    virtual void reportBackgroundFailures() = 0;
 
     virtual void registerInvariant(std::shared_ptr<Invariant> invariant) = 0;
 
+    // enables the invariants matching the regex @p name, which may end
+    // with @<percent> to only check them on that percentage of the
+    // transactions (on all of them by default)
     virtual void enableInvariant(std::string const& name) = 0;
 
     template <typename T, typename... Args>
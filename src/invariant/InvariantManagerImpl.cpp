@@ -12,12 +12,16 @@
 #include "ledger/LedgerDelta.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "main/Config.h"
 #include "util/Logging.h"
 #include "xdrpp/printer.h"
 
 #include "medida/counter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <numeric>
 #include <regex>
@@ -25,17 +29,94 @@
 namespace stellar
 {
 
+namespace
+{
+std::string
+formatOperationFailure(Invariant const& invariant, std::string const& result,
+                       Operation const& operation)
+{
+    return fmt::format(R"(Invariant "{}" does not hold on operation: {}{}{})",
+                       invariant.getName(), result, "\n",
+                       xdr::xdr_to_string(operation));
+}
+
+// percentage at the end of an INVARIANT_CHECKS entry, out of SAMPLE_SCALE
+uint32_t
+parseSampleRate(std::string const& rate, std::string const& invPattern)
+{
+    double percent = 0;
+    size_t used = 0;
+    try
+    {
+        percent = std::stod(rate, &used);
+    }
+    catch (std::exception&)
+    {
+    }
+    if (used != rate.size() || !(percent > 0 && percent <= 100))
+    {
+        throw std::invalid_argument(fmt::format(
+            "Invalid sampling rate in '{}': must be a percentage in (0, 100]",
+            invPattern));
+    }
+    auto scale = InvariantManagerImpl::SAMPLE_SCALE;
+    return std::max<uint32_t>(
+        1, static_cast<uint32_t>(std::lround(percent * scale / 100)));
+}
+
+// FNV-1a, as std::hash may differ between builds
+uint64_t
+getSampleSeed(std::string const& name)
+{
+    uint64_t res = 14695981039346656037ULL;
+    for (auto c : name)
+    {
+        res = (res ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    return res;
+}
+}
+
+uint32_t const InvariantManagerImpl::SAMPLE_SCALE;
+
 std::unique_ptr<InvariantManager>
 InvariantManager::create(Application& app)
 {
-    return std::make_unique<InvariantManagerImpl>(app.getMetrics());
+    auto res = std::make_unique<InvariantManagerImpl>(app.getMetrics());
+    auto const& cfg = app.getConfig();
+    if (cfg.INVARIANT_CHECKS_IN_BACKGROUND)
+    {
+        res->startBackgroundChecks(
+            app.getWorkerIOService(Application::WORKER_POOL_MISC),
+            cfg.INVARIANT_CHECKS_MAX_LAG, cfg.INVARIANT_CHECKS_HALT_ON_FAILURE);
+    }
+    return std::move(res);
 }
 
 InvariantManagerImpl::InvariantManagerImpl(medida::MetricsRegistry& registry)
     : mMetricsRegistry(registry)
+    , mPendingBackgroundChecksCounter(
+          registry.NewCounter({"invariant", "background", "pending"}))
 {
 }
 
+InvariantManagerImpl::~InvariantManagerImpl()
+{
+    // the checks in flight refer to this
+    std::unique_lock<std::mutex> lock(mBackgroundMutex);
+    mBackgroundCond.wait(lock,
+                         [this]() { return mPendingBackgroundChecks == 0; });
+}
+
+void
+InvariantManagerImpl::startBackgroundChecks(asio::io_service& workers,
+                                            size_t maxLag, bool haltOnFailure)
+{
+    mBackgroundService = &workers;
+    mMaxBackgroundLag = std::max<size_t>(1, maxLag);
+    mHaltOnBackgroundFailure = haltOnFailure;
+}
+
 Json::Value
 InvariantManagerImpl::getJsonInfo()
 {
@@ -63,11 +144,31 @@ InvariantManagerImpl::getEnabledInvariants() const
     std::vector<std::string> res;
     for (auto const& p : mEnabled)
     {
-        res.emplace_back(p->getName());
+        res.emplace_back(p.mInvariant->getName());
     }
     return res;
 }
 
+bool
+InvariantManagerImpl::isSampled(EnabledInvariant const& invariant,
+                                uint32_t ledger, Hash const& txHash)
+{
+    if (invariant.mSampleRate >= SAMPLE_SCALE)
+    {
+        return true;
+    }
+    uint64_t x = invariant.mSampleSeed ^ (static_cast<uint64_t>(ledger) << 32);
+    for (size_t i = 0; i < 8; ++i)
+    {
+        x ^= static_cast<uint64_t>(txHash[i]) << (8 * i);
+    }
+    // splitmix64 finalizer, so that every bit of x affects the sample
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x % SAMPLE_SCALE < invariant.mSampleRate;
+}
+
 void
 InvariantManagerImpl::checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
                                          uint32_t ledger, uint32_t level,
@@ -79,10 +180,15 @@ InvariantManagerImpl::checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
     uint32_t newestLedger = oldestLedger - 1 +
                             (isCurr ? BucketList::sizeOfCurr(ledger, level)
                                     : BucketList::sizeOfSnap(ledger, level));
-    for (auto invariant : mEnabled)
+    for (auto const& enabled : mEnabled)
     {
-        auto result =
-            invariant->checkOnBucketApply(bucket, oldestLedger, newestLedger);
+        auto const& invariant = enabled.mInvariant;
+        std::string result;
+        {
+            auto timer = enabled.mTimer->TimeScope();
+            result = invariant->checkOnBucketApply(bucket, oldestLedger,
+                                                   newestLedger);
+        }
         if (result.empty())
         {
             continue;
@@ -99,25 +205,126 @@ InvariantManagerImpl::checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
 void
 InvariantManagerImpl::checkOnOperationApply(Operation const& operation,
                                             OperationResult const& opres,
-                                            LedgerDelta const& delta)
+                                            LedgerDelta const& delta,
+                                            Hash const& txHash)
 {
     if (delta.getHeader().ledgerVersion < 8)
     {
         return;
     }
 
-    for (auto invariant : mEnabled)
+    auto ledger = delta.getHeader().ledgerSeq;
+    std::vector<EnabledInvariant> background;
+    for (auto const& enabled : mEnabled)
     {
-        auto result = invariant->checkOnOperationApply(operation, opres, delta);
+        auto const& invariant = enabled.mInvariant;
+        if (!isSampled(enabled, ledger, txHash))
+        {
+            continue;
+        }
+        if (mBackgroundService && invariant->canCheckInBackground())
+        {
+            background.push_back(enabled);
+            continue;
+        }
+
+        std::string result;
+        {
+            auto timer = enabled.mTimer->TimeScope();
+            result = invariant->checkOnOperationApply(operation, opres, delta);
+        }
         if (result.empty())
         {
             continue;
         }
 
-        auto message = fmt::format(
-            R"(Invariant "{}" does not hold on operation: {}{}{})",
-            invariant->getName(), result, "\n", xdr::xdr_to_string(operation));
-        onInvariantFailure(invariant, message, delta.getHeader().ledgerSeq);
+        auto message = formatOperationFailure(*invariant, result, operation);
+        onInvariantFailure(invariant, message, ledger);
+    }
+
+    if (!background.empty())
+    {
+        checkInBackground(background, operation, opres, delta);
+    }
+}
+
+void
+InvariantManagerImpl::checkInBackground(
+    std::vector<EnabledInvariant> const& invariants,
+    Operation const& operation, OperationResult const& opres,
+    LedgerDelta const& delta)
+{
+    {
+        std::unique_lock<std::mutex> lock(mBackgroundMutex);
+        mBackgroundCond.wait(lock, [this]() {
+            return mPendingBackgroundChecks < mMaxBackgroundLag;
+        });
+        mPendingBackgroundChecks++;
+    }
+    mPendingBackgroundChecksCounter.inc();
+
+    std::shared_ptr<LedgerDelta const> snapshot = delta.snapshot();
+    mBackgroundService->post([this, invariants, operation, opres, snapshot]() {
+        std::vector<BackgroundFailure> failures;
+        auto ledger = snapshot->getHeader().ledgerSeq;
+        for (auto const& enabled : invariants)
+        {
+            auto const& invariant = enabled.mInvariant;
+            std::string result;
+            try
+            {
+                auto timer = enabled.mTimer->TimeScope();
+                result = invariant->checkOnOperationApply(operation, opres,
+                                                          *snapshot);
+            }
+            catch (std::exception const& e)
+            {
+                result = fmt::format("check threw {}", e.what());
+            }
+            if (!result.empty())
+            {
+                failures.push_back(BackgroundFailure{
+                    invariant,
+                    formatOperationFailure(*invariant, result, operation),
+                    ledger});
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mBackgroundMutex);
+        for (auto& f : failures)
+        {
+            mBackgroundFailures.emplace_back(std::move(f));
+        }
+        mPendingBackgroundChecksCounter.dec();
+        mPendingBackgroundChecks--;
+        mBackgroundCond.notify_all();
+    });
+}
+
+void
+InvariantManagerImpl::reportBackgroundFailures()
+{
+    if (!mBackgroundService)
+    {
+        return;
+    }
+
+    std::vector<BackgroundFailure> failures;
+    {
+        std::lock_guard<std::mutex> lock(mBackgroundMutex);
+        failures.swap(mBackgroundFailures);
+    }
+    for (auto const& f : failures)
+    {
+        if (mHaltOnBackgroundFailure)
+        {
+            onInvariantFailure(f.mInvariant, f.mMessage, f.mLedger);
+        }
+        else
+        {
+            recordInvariantFailure(f.mInvariant, f.mMessage, f.mLedger);
+            CLOG(ERROR, "Invariant") << f.mMessage;
+        }
     }
 }
 
@@ -131,6 +338,7 @@ InvariantManagerImpl::registerInvariant(std::shared_ptr<Invariant> invariant)
         mInvariants[name] = invariant;
         mMetricsRegistry.NewCounter(
             {"invariant", "does-not-hold", "count", invariant->getName()});
+        mMetricsRegistry.NewTimer({"invariant", "check", invariant->getName()});
     }
     else
     {
@@ -142,7 +350,15 @@ InvariantManagerImpl::registerInvariant(std::shared_ptr<Invariant> invariant)
 void
 InvariantManagerImpl::enableInvariant(std::string const& invPattern)
 {
-    if (invPattern.empty())
+    auto pattern = invPattern;
+    uint32_t sampleRate = SAMPLE_SCALE;
+    auto at = invPattern.rfind('@');
+    if (at != std::string::npos)
+    {
+        pattern = invPattern.substr(0, at);
+        sampleRate = parseSampleRate(invPattern.substr(at + 1), invPattern);
+    }
+    if (pattern.empty())
     {
         throw std::invalid_argument("Invariant pattern must be non empty");
     }
@@ -150,7 +366,7 @@ InvariantManagerImpl::enableInvariant(std::string const& invPattern)
     std::regex r;
     try
     {
-        r = std::regex(invPattern, std::regex::ECMAScript | std::regex::icase);
+        r = std::regex(pattern, std::regex::ECMAScript | std::regex::icase);
     }
     catch (std::regex_error& e)
     {
@@ -164,12 +380,23 @@ InvariantManagerImpl::enableInvariant(std::string const& invPattern)
         auto const& name = inv.first;
         if (std::regex_match(name, r, std::regex_constants::match_not_null))
         {
-            auto iter = std::find(mEnabled.begin(), mEnabled.end(), inv.second);
+            auto iter = std::find_if(mEnabled.begin(), mEnabled.end(),
+                                     [&](EnabledInvariant const& e) {
+                                         return e.mInvariant == inv.second;
+                                     });
             if (iter == mEnabled.end())
             {
                 enabledSome = true;
-                mEnabled.push_back(inv.second);
-                CLOG(INFO, "Invariant") << "Enabled invariant '" << name << "'";
+                auto& timer =
+                    mMetricsRegistry.NewTimer({"invariant", "check", name});
+                mEnabled.push_back(EnabledInvariant{
+                    inv.second, sampleRate, getSampleSeed(name), &timer});
+                CLOG(INFO, "Invariant")
+                    << "Enabled invariant '" << name << "'"
+                    << (sampleRate < SAMPLE_SCALE
+                            ? fmt::format(" on {}% of the transactions",
+                                          100.0 * sampleRate / SAMPLE_SCALE)
+                            : "");
             }
             else
             {
@@ -205,6 +432,15 @@ void
 InvariantManagerImpl::onInvariantFailure(std::shared_ptr<Invariant> invariant,
                                          std::string const& message,
                                          uint32_t ledger)
+{
+    recordInvariantFailure(invariant, message, ledger);
+    handleInvariantFailure(invariant, message);
+}
+
+void
+InvariantManagerImpl::recordInvariantFailure(
+    std::shared_ptr<Invariant> invariant, std::string const& message,
+    uint32_t ledger)
 {
     mMetricsRegistry
         .NewCounter(
@@ -212,7 +448,6 @@ InvariantManagerImpl::onInvariantFailure(std::shared_ptr<Invariant> invariant,
         .inc();
     mFailureInformation[invariant->getName()].lastFailedOnLedger = ledger;
     mFailureInformation[invariant->getName()].lastFailedWithMessage = message;
-    handleInvariantFailure(invariant, message);
 }
 
 void
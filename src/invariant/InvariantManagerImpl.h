@@ -5,12 +5,17 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "invariant/InvariantManager.h"
+#include "util/asio.h"
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <vector>
 
 namespace medida
 {
+class Counter;
 class MetricsRegistry;
+class Timer;
 }
 
 namespace stellar
@@ -19,7 +24,19 @@ namespace stellar
 class InvariantManagerImpl : public InvariantManager
 {
     std::map<std::string, std::shared_ptr<Invariant>> mInvariants;
-    std::vector<std::shared_ptr<Invariant>> mEnabled;
+
+    struct EnabledInvariant
+    {
+        std::shared_ptr<Invariant> mInvariant;
+        // operations are checked when their sample, out of SAMPLE_SCALE,
+        // is below mSampleRate
+        uint32_t mSampleRate;
+        // mixed into the samples, so that invariants sampled at the same
+        // rate do not all check the same transactions
+        uint64_t mSampleSeed;
+        medida::Timer* mTimer;
+    };
+    std::vector<EnabledInvariant> mEnabled;
     medida::MetricsRegistry& mMetricsRegistry;
 
     struct InvariantFailureInformation
@@ -29,8 +46,34 @@ class InvariantManagerImpl : public InvariantManager
     };
     std::map<std::string, InvariantFailureInformation> mFailureInformation;
 
+    // checks run on worker threads when mBackgroundService is set (see
+    // startBackgroundChecks); the fields after the mutex are guarded by it
+    asio::io_service* mBackgroundService{nullptr};
+    size_t mMaxBackgroundLag{0};
+    bool mHaltOnBackgroundFailure{true};
+    medida::Counter& mPendingBackgroundChecksCounter;
+    std::mutex mBackgroundMutex;
+    std::condition_variable mBackgroundCond;
+    size_t mPendingBackgroundChecks{0};
+    struct BackgroundFailure
+    {
+        std::shared_ptr<Invariant> mInvariant;
+        std::string mMessage;
+        uint32_t mLedger;
+    };
+    std::vector<BackgroundFailure> mBackgroundFailures;
+
   public:
+    static uint32_t const SAMPLE_SCALE = 1000000;
+
     InvariantManagerImpl(medida::MetricsRegistry& registry);
+    ~InvariantManagerImpl();
+
+    // from now on, checks the invariants that allow it on @p workers, at
+    // most @p maxLag operations behind; failures are handled by
+    // reportBackgroundFailures, only logged unless @p haltOnFailure
+    void startBackgroundChecks(asio::io_service& workers, size_t maxLag,
+                               bool haltOnFailure);
 
     virtual Json::Value getJsonInfo() override;
 
@@ -38,7 +81,10 @@ class InvariantManagerImpl : public InvariantManager
 
     virtual void checkOnOperationApply(Operation const& operation,
                                        OperationResult const& opres,
-                                       LedgerDelta const& delta) override;
+                                       LedgerDelta const& delta,
+                                       Hash const& txHash) override;
+
+    virtual void reportBackgroundFailures() override;
 
     virtual void checkOnBucketApply(std::shared_ptr<Bucket const> bucket,
                                     uint32_t ledger, uint32_t level,
@@ -50,8 +96,20 @@ class InvariantManagerImpl : public InvariantManager
     virtual void enableInvariant(std::string const& name) override;
 
   private:
+    // true if the operations of transaction @p txHash in @p ledger are
+    // checked by @p invariant
+    static bool isSampled(EnabledInvariant const& invariant, uint32_t ledger,
+                          Hash const& txHash);
+
+    void checkInBackground(
+        std::vector<EnabledInvariant> const& invariants,
+        Operation const& operation, OperationResult const& opres,
+        LedgerDelta const& delta);
+
     void onInvariantFailure(std::shared_ptr<Invariant> invariant,
                             std::string const& message, uint32_t ledger);
+    void recordInvariantFailure(std::shared_ptr<Invariant> invariant,
+                                std::string const& message, uint32_t ledger);
 
     virtual void handleInvariantFailure(std::shared_ptr<Invariant> invariant,
                                         std::string const& message) const;
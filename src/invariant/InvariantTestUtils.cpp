@@ -74,7 +74,8 @@ store(Application& app, UpdateList const& apply, LedgerDelta* ldPtr,
 
     try
     {
-        app.getInvariantManager().checkOnOperationApply({}, *resPtr, *ldPtr);
+        app.getInvariantManager().checkOnOperationApply({}, *resPtr, *ldPtr,
+                                                          {});
     }
     catch (InvariantDoesNotHold&)
     {
@@ -5,18 +5,23 @@
 #include "util/asio.h"
 
 #include "bucket/Bucket.h"
+#include "crypto/SHA.h"
 #include "database/Database.h"
 #include "herder/TxSetFrame.h"
 #include "invariant/Invariant.h"
 #include "invariant/InvariantDoesNotHold.h"
-#include "invariant/InvariantManager.h"
+#include "invariant/InvariantManagerImpl.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerTestUtils.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
 
+#include <thread>
 #include <util/format.h>
 
 using namespace stellar;
@@ -72,6 +77,18 @@ class TestInvariant : public Invariant
     int mInvariantID;
     bool mShouldFail;
 };
+
+class BackgroundTestInvariant : public TestInvariant
+{
+  public:
+    using TestInvariant::TestInvariant;
+
+    virtual bool
+    canCheckInBackground() const override
+    {
+        return true;
+    }
+};
 }
 
 using namespace InvariantTests;
@@ -201,7 +218,7 @@ TEST_CASE("onOperationApply fail/succeed", "[invariant]")
         app->getInvariantManager().enableInvariant(
             TestInvariant::toString(0, true));
         REQUIRE_THROWS_AS(
-            app->getInvariantManager().checkOnOperationApply({}, res, ld),
+            app->getInvariantManager().checkOnOperationApply({}, res, ld, {}),
             InvariantDoesNotHold);
     }
     SECTION("Succeed")
@@ -210,6 +227,103 @@ TEST_CASE("onOperationApply fail/succeed", "[invariant]")
         app->getInvariantManager().enableInvariant(
             TestInvariant::toString(0, false));
         REQUIRE_NOTHROW(
-            app->getInvariantManager().checkOnOperationApply({}, res, ld));
+            app->getInvariantManager().checkOnOperationApply({}, res, ld, {}));
+    }
+}
+
+TEST_CASE("onOperationApply in the background", "[invariant]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& im = dynamic_cast<InvariantManagerImpl&>(app->getInvariantManager());
+    auto& pending =
+        app->getMetrics().NewCounter({"invariant", "background", "pending"});
+    auto waitForChecks = [&]() {
+        while (pending.count() != 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+
+    OperationResult res;
+    LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+    LedgerDelta ld(lh, app->getDatabase());
+
+    im.registerInvariant<BackgroundTestInvariant>(0, true);
+    im.enableInvariant(TestInvariant::toString(0, true));
+
+    SECTION("halt")
+    {
+        im.startBackgroundChecks(
+            app->getWorkerIOService(Application::WORKER_POOL_MISC), 1, true);
+        REQUIRE_NOTHROW(im.checkOnOperationApply({}, res, ld, {}));
+        REQUIRE_NOTHROW(im.checkOnOperationApply({}, res, ld, {}));
+        waitForChecks();
+        REQUIRE_THROWS_AS(im.reportBackgroundFailures(), InvariantDoesNotHold);
+    }
+    SECTION("alert")
+    {
+        im.startBackgroundChecks(
+            app->getWorkerIOService(Application::WORKER_POOL_MISC), 1, false);
+        REQUIRE_NOTHROW(im.checkOnOperationApply({}, res, ld, {}));
+        waitForChecks();
+        REQUIRE_NOTHROW(im.reportBackgroundFailures());
+        auto info = im.getJsonInfo();
+        REQUIRE(info[TestInvariant::toString(0, true)]["count"].asInt() == 1);
+    }
+}
+
+TEST_CASE("onOperationApply sampled", "[invariant]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.INVARIANT_CHECKS = {};
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& im = app->getInvariantManager();
+    im.registerInvariant<TestInvariant>(0, true);
+    auto name = TestInvariant::toString(0, true);
+
+    SECTION("invalid rates")
+    {
+        REQUIRE_THROWS_AS(im.enableInvariant(name + "@0"),
+                          std::invalid_argument);
+        REQUIRE_THROWS_AS(im.enableInvariant(name + "@101"),
+                          std::invalid_argument);
+        REQUIRE_THROWS_AS(im.enableInvariant(name + "@1%"),
+                          std::invalid_argument);
+        REQUIRE_THROWS_AS(im.enableInvariant("@50"), std::invalid_argument);
+    }
+    SECTION("checks a deterministic share of the transactions")
+    {
+        im.enableInvariant(name + "@25");
+        OperationResult res;
+        LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+        LedgerDelta ld(lh, app->getDatabase());
+        auto isChecked = [&](Hash const& txHash) {
+            try
+            {
+                im.checkOnOperationApply({}, res, ld, txHash);
+                return false;
+            }
+            catch (InvariantDoesNotHold&)
+            {
+                return true;
+            }
+        };
+
+        int checked = 0;
+        for (int i = 0; i < 1000; i++)
+        {
+            auto txHash = sha256(std::to_string(i));
+            auto first = isChecked(txHash);
+            REQUIRE(isChecked(txHash) == first);
+            checked += first ? 1 : 0;
+        }
+        REQUIRE(checked > 150);
+        REQUIRE(checked < 350);
+        REQUIRE(app->getMetrics()
+                    .NewTimer({"invariant", "check", name})
+                    .count() == 2 * checked);
     }
 }
@@ -32,6 +32,8 @@ class LedgerEntryIsValid : public Invariant
                           OperationResult const& result,
                           LedgerDelta const& delta) override;
 
+    virtual bool canCheckInBackground() const override;
+
   private:
     template <typename IterType>
     std::string check(IterType iter, IterType const& end,
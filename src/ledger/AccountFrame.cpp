@@ -9,13 +9,20 @@
 #include "crypto/SecretKey.h"
 #include "crypto/SignerKey.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
+#include "database/PostgresBinaryQuery.h"
+#include "database/PostgresCopyWriter.h"
+#include "ledger/InflationVoteTally.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerRange.h"
 #include "lib/util/format.h"
 #include "util/Decoder.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
+#include "xdrpp/marshal.h"
 #include <algorithm>
+#include <set>
 
 using namespace soci;
 using namespace std;
@@ -52,6 +59,35 @@ const char* AccountFrame::kSQLCreateStatement4 = "CREATE INDEX accountbalances "
                                                  "ON accounts (balance) WHERE "
                                                  "balance >= 1000000000";
 
+// The value of the ledgerentry column of an account: the base64 XDR of its
+// entry if ACCOUNT_ENTRY_XDR is set, NULL otherwise (so that a value in the
+// column is never older than the other columns).
+static soci::indicator
+getEntryXDR(Database& db, LedgerEntry const& entry, std::string& entryXDR)
+{
+    if (!db.storesAccountXDR())
+    {
+        entryXDR.clear();
+        return soci::i_null;
+    }
+    entryXDR = decoder::encode_b64(xdr::xdr_to_opaque(entry));
+    return soci::i_ok;
+}
+
+static LedgerEntry
+decodeEntryXDR(std::string const& entryXDR)
+{
+    std::vector<uint8_t> opaque;
+    decoder::decode_b64(entryXDR, opaque);
+    LedgerEntry res;
+    xdr::xdr_from_opaque(opaque, res);
+    if (res.data.type() != ACCOUNT)
+    {
+        throw std::runtime_error("Unexpected entry type in accounts table");
+    }
+    return res;
+}
+
 AccountFrame::AccountFrame()
     : EntryFrame(ACCOUNT), mAccountEntry(mEntry.data.account())
 {
@@ -339,50 +375,103 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     LedgerKey key;
     key.type(ACCOUNT);
     key.account().accountID = accountID;
-    if (cachedEntryExists(key, db))
+    auto cacheKey = makeLedgerEntryCacheKey(key);
+    if (cachedEntryExists(key, cacheKey, db))
     {
-        auto p = getCachedEntry(key, db);
+        auto p = getCachedEntry(key, cacheKey, db);
         return p ? std::make_shared<AccountFrame>(*p) : nullptr;
     }
 
     std::string actIDStrKey = KeyUtils::toStrKey(accountID);
 
     std::string publicKey, inflationDest, creditAuthKey;
-    std::string homeDomain, thresholds;
+    std::string homeDomain, thresholds, entryXDR;
     Liabilities liabilities;
-    soci::indicator inflationDestInd;
+    soci::indicator inflationDestInd, entryXDRInd;
     soci::indicator buyingLiabilitiesInd, sellingLiabilitiesInd;
 
     AccountFrame::pointer res = make_shared<AccountFrame>(accountID);
     AccountEntry& account = res->getAccount();
 
-    auto prep =
-        db.getPreparedStatement("SELECT balance, seqnum, numsubentries, "
-                                "inflationdest, homedomain, thresholds, "
-                                "flags, lastmodified, buyingliabilities, "
-                                "sellingliabilities "
-                                "FROM accounts WHERE accountid=:v1");
-    auto& st = prep.statement();
-    st.exchange(into(account.balance));
-    st.exchange(into(account.seqNum));
-    st.exchange(into(account.numSubEntries));
-    st.exchange(into(inflationDest, inflationDestInd));
-    st.exchange(into(homeDomain));
-    st.exchange(into(thresholds));
-    st.exchange(into(account.flags));
-    st.exchange(into(res->getLastModified()));
-    st.exchange(into(liabilities.buying, buyingLiabilitiesInd));
-    st.exchange(into(liabilities.selling, sellingLiabilitiesInd));
-    st.exchange(use(actIDStrKey));
-    st.define_and_bind();
+    std::string const sql = "SELECT balance, seqnum, numsubentries, "
+                            "inflationdest, homedomain, thresholds, "
+                            "flags, lastmodified, buyingliabilities, "
+                            "sellingliabilities, ledgerentry "
+                            "FROM accounts WHERE accountid=:v1";
+    if (!db.isSqlite())
     {
+        // binary results, decoded straight into the entry
         auto timer = db.getSelectTimer("account");
-        st.execute(true);
+        PostgresBinaryQuery q(db, sql, {actIDStrKey});
+        if (q.rows() == 0)
+        {
+            putCachedEntry(key, cacheKey, nullptr, db);
+            return nullptr;
+        }
+        account.balance = q.getInt(0, 0);
+        account.seqNum = q.getInt(0, 1);
+        account.numSubEntries = static_cast<uint32>(q.getInt(0, 2));
+        inflationDestInd = q.isNull(0, 3) ? soci::i_null : soci::i_ok;
+        if (inflationDestInd == soci::i_ok)
+        {
+            inflationDest = q.getString(0, 3);
+        }
+        homeDomain = q.getString(0, 4);
+        thresholds = q.getString(0, 5);
+        account.flags = static_cast<uint32>(q.getInt(0, 6));
+        res->getLastModified() = static_cast<uint32>(q.getInt(0, 7));
+        buyingLiabilitiesInd = q.isNull(0, 8) ? soci::i_null : soci::i_ok;
+        sellingLiabilitiesInd = q.isNull(0, 9) ? soci::i_null : soci::i_ok;
+        if (buyingLiabilitiesInd == soci::i_ok)
+        {
+            liabilities.buying = q.getInt(0, 8);
+        }
+        if (sellingLiabilitiesInd == soci::i_ok)
+        {
+            liabilities.selling = q.getInt(0, 9);
+        }
+        entryXDRInd = q.isNull(0, 10) ? soci::i_null : soci::i_ok;
+        if (entryXDRInd == soci::i_ok)
+        {
+            entryXDR = q.getString(0, 10);
+        }
     }
-    if (!st.got_data())
+    else
     {
-        putCachedEntry(key, nullptr, db);
-        return nullptr;
+        auto prep = db.getPreparedStatement(sql);
+        auto& st = prep.statement();
+        st.exchange(into(account.balance));
+        st.exchange(into(account.seqNum));
+        st.exchange(into(account.numSubEntries));
+        st.exchange(into(inflationDest, inflationDestInd));
+        st.exchange(into(homeDomain));
+        st.exchange(into(thresholds));
+        st.exchange(into(account.flags));
+        st.exchange(into(res->getLastModified()));
+        st.exchange(into(liabilities.buying, buyingLiabilitiesInd));
+        st.exchange(into(liabilities.selling, sellingLiabilitiesInd));
+        st.exchange(into(entryXDR, entryXDRInd));
+        st.exchange(use(actIDStrKey));
+        st.define_and_bind();
+        {
+            auto timer = db.getSelectTimer("account");
+            st.execute(true);
+        }
+        if (!st.got_data())
+        {
+            putCachedEntry(key, cacheKey, nullptr, db);
+            return nullptr;
+        }
+    }
+
+    if (entryXDRInd == soci::i_ok)
+    {
+        res = make_shared<AccountFrame>(decodeEntryXDR(entryXDR));
+        res->normalize();
+        res->mUpdateSigners = false;
+        putCachedEntry(key, cacheKey,
+                       std::make_shared<LedgerEntry const>(res->mEntry), db);
+        return res;
     }
 
     account.homeDomain = homeDomain;
@@ -415,10 +504,176 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     res->normalize();
     res->mUpdateSigners = false;
     res->mKeyCalculated = false;
-    res->putCachedEntry(db);
+    putCachedEntry(key, cacheKey,
+                   std::make_shared<LedgerEntry const>(res->mEntry), db);
     return res;
 }
 
+void
+AccountFrame::prefetchAccounts(std::vector<AccountID> const& accountIDs,
+                               Database& db)
+{
+    std::vector<std::string> strKeys;
+    strKeys.reserve(accountIDs.size());
+    for (auto const& id : accountIDs)
+    {
+        LedgerKey key;
+        key.type(ACCOUNT);
+        key.account().accountID = id;
+        if (!cachedEntryExists(key, db))
+        {
+            strKeys.emplace_back(KeyUtils::toStrKey(id));
+        }
+    }
+    if (strKeys.empty())
+    {
+        return;
+    }
+
+    auto inClause = DatabaseUtils::makeInClause(DatabaseUtils::BATCH_LOAD_SIZE);
+    std::string const accountQuery =
+        "SELECT accountid, balance, seqnum, numsubentries, inflationdest, "
+        "homedomain, thresholds, flags, lastmodified, buyingliabilities, "
+        "sellingliabilities, ledgerentry FROM accounts WHERE accountid IN " +
+        inClause;
+    std::string const signerQuery =
+        "SELECT accountid, publickey, weight FROM signers WHERE accountid "
+        "IN " +
+        inClause;
+
+    std::map<AccountID, AccountFrame::pointer> loaded;
+    DatabaseUtils::forEachKeyBatch(
+        strKeys, [&](std::vector<std::string>& batch) {
+            std::string actIDStrKey, inflationDest, homeDomain, thresholds;
+            std::string entryXDR;
+            Liabilities liabilities;
+            soci::indicator inflationDestInd, entryXDRInd;
+            soci::indicator buyingLiabilitiesInd, sellingLiabilitiesInd;
+            LedgerEntry le;
+            le.data.type(ACCOUNT);
+            AccountEntry& account = le.data.account();
+
+            auto prep = db.getPreparedStatement(accountQuery);
+            auto& st = prep.statement();
+            st.exchange(into(actIDStrKey));
+            st.exchange(into(account.balance));
+            st.exchange(into(account.seqNum));
+            st.exchange(into(account.numSubEntries));
+            st.exchange(into(inflationDest, inflationDestInd));
+            st.exchange(into(homeDomain));
+            st.exchange(into(thresholds));
+            st.exchange(into(account.flags));
+            st.exchange(into(le.lastModifiedLedgerSeq));
+            st.exchange(into(liabilities.buying, buyingLiabilitiesInd));
+            st.exchange(into(liabilities.selling, sellingLiabilitiesInd));
+            st.exchange(into(entryXDR, entryXDRInd));
+            for (auto& k : batch)
+            {
+                st.exchange(use(k));
+            }
+            st.define_and_bind();
+            {
+                auto timer = db.getSelectTimer("account-batch");
+                st.execute(true);
+            }
+            // the signers of the accounts decoded from their columns are in
+            // the signers table, the others have theirs already
+            size_t withoutXDR = 0;
+            std::set<AccountID> fromXDR;
+            while (st.got_data())
+            {
+                if (entryXDRInd == soci::i_ok)
+                {
+                    auto frame =
+                        make_shared<AccountFrame>(decodeEntryXDR(entryXDR));
+                    fromXDR.insert(frame->getID());
+                    loaded[frame->getID()] = frame;
+                    st.fetch();
+                    continue;
+                }
+                withoutXDR++;
+                account.accountID =
+                    KeyUtils::fromStrKey<PublicKey>(actIDStrKey);
+                account.homeDomain = homeDomain;
+                decoder::decode_b64(thresholds.begin(), thresholds.end(),
+                                    account.thresholds.begin());
+                if (inflationDestInd == soci::i_ok)
+                {
+                    account.inflationDest.activate() =
+                        KeyUtils::fromStrKey<PublicKey>(inflationDest);
+                }
+                else
+                {
+                    account.inflationDest.reset();
+                }
+                assert(buyingLiabilitiesInd == sellingLiabilitiesInd);
+                if (buyingLiabilitiesInd == soci::i_ok)
+                {
+                    account.ext.v(1);
+                    account.ext.v1().liabilities = liabilities;
+                }
+                else
+                {
+                    account.ext.v(0);
+                }
+                loaded[account.accountID] = make_shared<AccountFrame>(le);
+                st.fetch();
+            }
+            if (withoutXDR == 0)
+            {
+                return;
+            }
+
+            std::string pubKey;
+            Signer signer;
+            auto prep2 = db.getPreparedStatement(signerQuery);
+            auto& st2 = prep2.statement();
+            st2.exchange(into(actIDStrKey));
+            st2.exchange(into(pubKey));
+            st2.exchange(into(signer.weight));
+            for (auto& k : batch)
+            {
+                st2.exchange(use(k));
+            }
+            st2.define_and_bind();
+            {
+                auto timer = db.getSelectTimer("signer-batch");
+                st2.execute(true);
+            }
+            while (st2.got_data())
+            {
+                auto id = KeyUtils::fromStrKey<PublicKey>(actIDStrKey);
+                auto it = loaded.find(id);
+                if (it != loaded.end() && fromXDR.count(id) == 0)
+                {
+                    signer.key = KeyUtils::fromStrKey<SignerKey>(pubKey);
+                    it->second->mAccountEntry.signers.push_back(signer);
+                }
+                st2.fetch();
+            }
+        });
+
+    for (auto const& id : accountIDs)
+    {
+        auto it = loaded.find(id);
+        if (it == loaded.end())
+        {
+            LedgerKey key;
+            key.type(ACCOUNT);
+            key.account().accountID = id;
+            if (!cachedEntryExists(key, db))
+            {
+                putCachedEntry(key, nullptr, db);
+            }
+        }
+        else
+        {
+            it->second->normalize();
+            it->second->putCachedEntry(db);
+        }
+    }
+}
+
 std::vector<Signer>
 AccountFrame::loadSigners(Database& db, std::string const& actIDStrKey)
 {
@@ -452,7 +707,9 @@ AccountFrame::loadSigners(Database& db, std::string const& actIDStrKey)
 bool
 AccountFrame::exists(Database& db, LedgerKey const& key)
 {
-    if (cachedEntryExists(key, db) && getCachedEntry(key, db) != nullptr)
+    auto cacheKey = makeLedgerEntryCacheKey(key);
+    if (cachedEntryExists(key, cacheKey, db) &&
+        getCachedEntry(key, cacheKey, db) != nullptr)
     {
         return true;
     }
@@ -496,10 +753,13 @@ AccountFrame::deleteAccountsModifiedOnOrAfterLedger(Database& db,
                                                     uint32_t oldestLedger)
 {
     db.getEntryCache().erase_if(
-        [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
-            return le && le->data.type() == ACCOUNT &&
-                   le->lastModifiedLedgerSeq >= oldestLedger;
+        ACCOUNT, [oldestLedger](std::shared_ptr<LedgerEntry const> const& le) {
+            return le && le->lastModifiedLedgerSeq >= oldestLedger;
         });
+    if (auto tally = db.getInflationVoteTally())
+    {
+        tally->clear();
+    }
 
     {
         auto prep = db.getPreparedStatement(
@@ -554,6 +814,218 @@ AccountFrame::storeDelete(LedgerDelta& delta, Database& db,
     delta.deleteEntry(key);
 }
 
+void
+AccountFrame::storeBalancesBatch(Database& db,
+                                 std::vector<pointer> const& accounts)
+{
+    if (accounts.empty())
+    {
+        return;
+    }
+
+    // UPDATE accounts SET balance = CASE accountid WHEN :k0 THEN :b0 ...
+    // END, ... WHERE accountid IN (...); the casts let postgres type the
+    // CASE expressions
+    auto n = DatabaseUtils::BATCH_LOAD_SIZE;
+    auto makeCase = [n](std::string const& column, std::string const& v) {
+        std::string res = column + " = CASE accountid";
+        for (size_t i = 0; i < n; i++)
+        {
+            auto k = std::to_string(i);
+            res += " WHEN :" + v + "k" + k + " THEN CAST(:" + v + k +
+                   " AS BIGINT)";
+        }
+        return res + " END";
+    };
+    auto storeXDR = db.storesAccountXDR();
+    std::string entryXDRCase = "ledgerentry = NULL";
+    if (storeXDR)
+    {
+        entryXDRCase = "ledgerentry = CASE accountid";
+        for (size_t i = 0; i < n; i++)
+        {
+            auto k = std::to_string(i);
+            entryXDRCase +=
+                " WHEN :xk" + k + " THEN CAST(:x" + k + " AS TEXT)";
+        }
+        entryXDRCase += " END";
+    }
+    std::string const sql = "UPDATE accounts SET " + makeCase("balance", "b") +
+                            ", " + makeCase("seqnum", "s") + ", " +
+                            makeCase("lastmodified", "l") + ", " +
+                            entryXDRCase + " WHERE accountid IN " +
+                            DatabaseUtils::makeInClause(n);
+
+    std::vector<std::string> strKeys, entryXDRs;
+    std::vector<int64_t> balances, seqNums, lastModified;
+    std::vector<size_t> indexes;
+    for (auto const& account : accounts)
+    {
+        auto const& entry = account->mAccountEntry;
+        indexes.emplace_back(strKeys.size());
+        strKeys.emplace_back(KeyUtils::toStrKey(entry.accountID));
+        balances.emplace_back(entry.balance);
+        seqNums.emplace_back(entry.seqNum);
+        lastModified.emplace_back(account->getLastModified());
+        entryXDRs.emplace_back();
+        getEntryXDR(db, account->mEntry, entryXDRs.back());
+    }
+
+    DatabaseUtils::forEachKeyBatch(indexes, [&](std::vector<size_t>& batch) {
+        auto prep = db.getPreparedStatement(sql);
+        auto& st = prep.statement();
+        for (auto values : {&balances, &seqNums, &lastModified})
+        {
+            for (auto i : batch)
+            {
+                st.exchange(use(strKeys[i]));
+                st.exchange(use((*values)[i]));
+            }
+        }
+        if (storeXDR)
+        {
+            for (auto i : batch)
+            {
+                st.exchange(use(strKeys[i]));
+                st.exchange(use(entryXDRs[i]));
+            }
+        }
+        for (auto i : batch)
+        {
+            st.exchange(use(strKeys[i]));
+        }
+        st.define_and_bind();
+        {
+            auto timer = db.getUpdateTimer("account-batch");
+            st.execute(true);
+        }
+
+        // the last batch is padded with its last account
+        auto stored = std::min(n, indexes.size() - batch.front());
+        if (st.get_affected_rows() != static_cast<long long>(stored))
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+    });
+
+    for (auto const& account : accounts)
+    {
+        account->putCachedEntry(db);
+    }
+}
+
+void
+AccountFrame::storeDeleteBatch(Database& db,
+                               std::vector<LedgerKey> const& keys)
+{
+    std::vector<std::string> strKeys;
+    strKeys.reserve(keys.size());
+    auto tally = db.getInflationVoteTally();
+    for (auto const& key : keys)
+    {
+        flushCachedEntry(key, db);
+        if (tally)
+        {
+            tally->update(key.account().accountID, nullptr);
+        }
+        strKeys.emplace_back(KeyUtils::toStrKey(key.account().accountID));
+    }
+
+    auto inClause = DatabaseUtils::makeInClause(DatabaseUtils::BATCH_LOAD_SIZE);
+    std::string const accountSql =
+        "DELETE FROM accounts WHERE accountid IN " + inClause;
+    std::string const signerSql =
+        "DELETE FROM signers WHERE accountid IN " + inClause;
+    DatabaseUtils::forEachKeyBatch(
+        strKeys, [&](std::vector<std::string>& batch) {
+            {
+                auto timer = db.getDeleteTimer("account-batch");
+                auto prep = db.getPreparedStatement(accountSql);
+                auto& st = prep.statement();
+                for (auto& k : batch)
+                {
+                    st.exchange(use(k));
+                }
+                st.define_and_bind();
+                st.execute(true);
+            }
+            {
+                auto timer = db.getDeleteTimer("signer-batch");
+                auto prep = db.getPreparedStatement(signerSql);
+                auto& st = prep.statement();
+                for (auto& k : batch)
+                {
+                    st.exchange(use(k));
+                }
+                st.define_and_bind();
+                st.execute(true);
+            }
+        });
+}
+
+const char* AccountFrame::kSQLCopyColumns =
+    "accountid, balance, seqnum, numsubentries, inflationdest, homedomain, "
+    "thresholds, flags, lastmodified, buyingliabilities, sellingliabilities, "
+    "ledgerentry";
+
+const char* AccountFrame::kSQLSignerCopyColumns =
+    "accountid, publickey, weight";
+
+void
+AccountFrame::copyTo(PostgresCopyWriter& writer, Database& db) const
+{
+    writer.addString(KeyUtils::toStrKey(mAccountEntry.accountID));
+    writer.addInt(mAccountEntry.balance);
+    writer.addInt(mAccountEntry.seqNum);
+    writer.addUInt(mAccountEntry.numSubEntries);
+    if (mAccountEntry.inflationDest)
+    {
+        writer.addString(KeyUtils::toStrKey(*mAccountEntry.inflationDest));
+    }
+    else
+    {
+        writer.addNull();
+    }
+    writer.addString(mAccountEntry.homeDomain);
+    writer.addString(decoder::encode_b64(mAccountEntry.thresholds));
+    writer.addUInt(mAccountEntry.flags);
+    writer.addUInt(getLastModified());
+    if (mAccountEntry.ext.v() == 1)
+    {
+        auto const& liabilities = mAccountEntry.ext.v1().liabilities;
+        writer.addInt(liabilities.buying);
+        writer.addInt(liabilities.selling);
+    }
+    else
+    {
+        writer.addNull();
+        writer.addNull();
+    }
+    std::string entryXDR;
+    if (getEntryXDR(db, mEntry, entryXDR) == soci::i_ok)
+    {
+        writer.addString(entryXDR);
+    }
+    else
+    {
+        writer.addNull();
+    }
+    writer.endRow();
+}
+
+void
+AccountFrame::copySignersTo(PostgresCopyWriter& writer) const
+{
+    std::string actIDStrKey = KeyUtils::toStrKey(mAccountEntry.accountID);
+    for (auto const& signer : mAccountEntry.signers)
+    {
+        writer.addString(actIDStrKey);
+        writer.addString(KeyUtils::toStrKey(signer.key));
+        writer.addUInt(signer.weight);
+        writer.endRow();
+    }
+}
+
 void
 AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
 {
@@ -569,9 +1041,10 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
         sql = std::string(
             "INSERT INTO accounts ( accountid, balance, seqnum, "
             "numsubentries, inflationdest, homedomain, thresholds, flags, "
-            "lastmodified, buyingliabilities, sellingliabilities ) "
-            "VALUES ( :id, :v1, :v2, :v3, :v4, :v5, :v6, :v7, :v8, :v9, :v10 "
-            ")");
+            "lastmodified, buyingliabilities, sellingliabilities, "
+            "ledgerentry ) "
+            "VALUES ( :id, :v1, :v2, :v3, :v4, :v5, :v6, :v7, :v8, :v9, :v10, "
+            ":v11 )");
     }
     else
     {
@@ -580,7 +1053,8 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
             "numsubentries = :v3, "
             "inflationdest = :v4, homedomain = :v5, thresholds = :v6, "
             "flags = :v7, lastmodified = :v8, buyingliabilities = :v9, "
-            "sellingliabilities = :v10 WHERE accountid = :id");
+            "sellingliabilities = :v10, ledgerentry = :v11 "
+            "WHERE accountid = :id");
     }
 
     auto prep = db.getPreparedStatement(sql);
@@ -603,6 +1077,8 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
     }
 
     string thresholds(decoder::encode_b64(mAccountEntry.thresholds));
+    string entryXDR;
+    auto entryXDRInd = getEntryXDR(db, mEntry, entryXDR);
 
     {
         soci::statement& st = prep.statement();
@@ -618,6 +1094,7 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
         st.exchange(use(getLastModified(), "v8"));
         st.exchange(use(liabilities.buying, liabilitiesInd, "v9"));
         st.exchange(use(liabilities.selling, liabilitiesInd, "v10"));
+        st.exchange(use(entryXDR, entryXDRInd, "v11"));
         st.define_and_bind();
         {
             auto timer = insert ? db.getInsertTimer("account")
@@ -808,6 +1285,24 @@ AccountFrame::processForInflation(
     }
 }
 
+std::vector<AccountID>
+AccountFrame::loadRecentlyModified(Database& db, uint32_t count)
+{
+    std::vector<AccountID> res;
+    std::string id;
+    soci::statement st =
+        (db.getSession().prepare << "SELECT accountid FROM accounts"
+                                    " ORDER BY lastmodified DESC LIMIT :n",
+         into(id), use(count));
+    st.execute(true);
+    while (st.got_data())
+    {
+        res.emplace_back(KeyUtils::fromStrKey<PublicKey>(id));
+        st.fetch();
+    }
+    return res;
+}
+
 std::unordered_map<AccountID, AccountFrame::pointer>
 AccountFrame::checkDB(Database& db)
 {
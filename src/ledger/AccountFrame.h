@@ -129,6 +129,26 @@ class AccountFrame : public EntryFrame
     // Static helper that don't assume an instance.
     static void storeDelete(LedgerDelta& delta, Database& db,
                             LedgerKey const& key);
+    // Delete every account (and its signers) in `keys` with multi-key
+    // statements. Does not record anything in a LedgerDelta: only meant for
+    // bulk writers such as BucketApplicator.
+    static void storeDeleteBatch(Database& db,
+                                 std::vector<LedgerKey> const& keys);
+    // Store the balance, sequence number and last modified ledger of every
+    // account in `accounts` (which must exist) with multi-key statements,
+    // and keep the stored entries in the entry cache. Other fields are not
+    // written and nothing is recorded in a LedgerDelta: only meant for the
+    // fee processing of a ledger.
+    static void storeBalancesBatch(Database& db,
+                                   std::vector<pointer> const& accounts);
+
+    // Bulk loading support (see BucketApplicator): write this entry as rows
+    // of the accounts and signers tables, laid out as kSQLCopyColumns and
+    // kSQLSignerCopyColumns.
+    void copyTo(PostgresCopyWriter& writer, Database& db) const;
+    void copySignersTo(PostgresCopyWriter& writer) const;
+    static const char* kSQLCopyColumns;
+    static const char* kSQLSignerCopyColumns;
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
     static uint64_t countObjects(soci::session& sess,
@@ -142,6 +162,16 @@ class AccountFrame : public EntryFrame
     static AccountFrame::pointer loadAccount(AccountID const& accountID,
                                              Database& db);
 
+    // Load every account in `accountIDs` that is not already in the entry
+    // cache with a few multi-key queries, and store the results in the entry
+    // cache (including negative results for missing accounts).
+    static void prefetchAccounts(std::vector<AccountID> const& accountIDs,
+                                 Database& db);
+
+    // The `count` accounts modified in the most recent ledgers
+    static std::vector<AccountID> loadRecentlyModified(Database& db,
+                                                       uint32_t count);
+
     // compare signers, ignores weight
     static bool signerCompare(Signer const& s1, Signer const& s2);
 
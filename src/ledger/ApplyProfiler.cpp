@@ -0,0 +1,153 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/ApplyProfiler.h"
+#include "database/Database.h"
+#include "main/Application.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <cctype>
+
+namespace stellar
+{
+
+namespace
+{
+// "PATH_PAYMENT" -> "path-payment", "txBAD_SEQ" -> "bad-seq"
+std::string
+toMetricName(char const* enumName)
+{
+    std::string res;
+    auto c = enumName;
+    while (*c && std::islower(*c))
+    {
+        ++c;
+    }
+    for (; *c; ++c)
+    {
+        res += *c == '_' ? '-' : static_cast<char>(std::tolower(*c));
+    }
+    return res;
+}
+
+template <typename T>
+std::string
+toMetricName(T v)
+{
+    auto name = xdr::xdr_traits<T>::enum_name(v);
+    return name ? toMetricName(name) : std::to_string(static_cast<int>(v));
+}
+}
+
+ApplyProfiler::ApplyProfiler(Application& app) : mApp(app)
+{
+}
+
+uint64_t
+ApplyProfiler::getQueryCount() const
+{
+    return mApp.getDatabase().getQueryMeter().count();
+}
+
+void
+ApplyProfiler::startLedger(uint32_t ledgerSeq)
+{
+    mCurrent = Profile{};
+    mCurrent.mLedgerSeq = ledgerSeq;
+}
+
+void
+ApplyProfiler::finishLedger()
+{
+    mLast = std::move(mCurrent);
+    mCurrent = Profile{};
+}
+
+void
+ApplyProfiler::recordOperation(OperationType type,
+                               std::chrono::nanoseconds time,
+                               uint64_t queriesBefore)
+{
+    auto queries = getQueryCount() - queriesBefore;
+    auto& stats = mCurrent.mOperations[type];
+    stats.mCount++;
+    stats.mTime += time;
+    stats.mQueries += queries;
+
+    auto timer = mOperationTimers.find(type);
+    if (timer == mOperationTimers.end())
+    {
+        auto name = toMetricName(type);
+        auto& metrics = mApp.getMetrics();
+        timer = mOperationTimers
+                    .emplace(type, &metrics.NewTimer(
+                                       {"ledger", "operation-apply", name}))
+                    .first;
+        mOperationQueries.emplace(
+            type,
+            &metrics.NewMeter({"ledger", "operation-query", name}, "query"));
+    }
+    timer->second->Update(time);
+    mOperationQueries[type]->Mark(queries);
+}
+
+void
+ApplyProfiler::recordTransaction(TransactionResultCode code,
+                                 std::chrono::nanoseconds time,
+                                 uint64_t queriesBefore)
+{
+    auto queries = getQueryCount() - queriesBefore;
+    auto& stats = mCurrent.mTransactions[code];
+    stats.mCount++;
+    stats.mTime += time;
+    stats.mQueries += queries;
+
+    auto meter = mTransactionQueries.find(code);
+    if (meter == mTransactionQueries.end())
+    {
+        meter = mTransactionQueries
+                    .emplace(code, &mApp.getMetrics().NewMeter(
+                                       {"ledger", "transaction-query",
+                                        toMetricName(code)},
+                                       "query"))
+                    .first;
+    }
+    meter->second->Mark(queries);
+}
+
+Json::Value
+ApplyProfiler::getJsonInfo() const
+{
+    Json::Value res;
+    if (mLast.mLedgerSeq == 0)
+    {
+        return res;
+    }
+
+    auto toJson = [](Stats const& stats) {
+        Json::Value s;
+        s["count"] = static_cast<Json::UInt64>(stats.mCount);
+        s["time_ms"] =
+            std::chrono::duration<double, std::milli>(stats.mTime).count();
+        s["queries"] = static_cast<Json::UInt64>(stats.mQueries);
+        return s;
+    };
+
+    res["ledger"] = mLast.mLedgerSeq;
+    res["operations"] = Json::objectValue;
+    for (auto const& op : mLast.mOperations)
+    {
+        res["operations"][toMetricName(op.first)] = toJson(op.second);
+    }
+    res["transactions"] = Json::objectValue;
+    for (auto const& tx : mLast.mTransactions)
+    {
+        res["transactions"][toMetricName(tx.first)] = toJson(tx.second);
+    }
+    return res;
+}
+}
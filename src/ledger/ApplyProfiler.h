@@ -0,0 +1,81 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <map>
+
+namespace medida
+{
+class Meter;
+class Timer;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Breaks down where transaction application spends its time, to tell apart
+ * ledgers that are slow because of a few costly operations (path payments,
+ * offers crossing deep books) from ledgers that are simply large.
+ *
+ * For every operation type, it counts the operations applied, the time they
+ * took and the SQL statements they ran; for every transaction result code,
+ * the transactions and the SQL statements they ran (fees and sequence
+ * numbers excluded). These are reported both as cumulative metrics
+ * ("ledger.operation-apply.<type>", "ledger.operation-query.<type>",
+ * "ledger.transaction-query.<code>") and per ledger, for the last ledger
+ * closed, by getJsonInfo.
+ */
+class ApplyProfiler : NonMovableOrCopyable
+{
+    struct Stats
+    {
+        uint64_t mCount{0};
+        std::chrono::nanoseconds mTime{0};
+        uint64_t mQueries{0};
+    };
+
+    struct Profile
+    {
+        uint32_t mLedgerSeq{0};
+        std::map<OperationType, Stats> mOperations;
+        std::map<TransactionResultCode, Stats> mTransactions;
+    };
+
+    Application& mApp;
+    Profile mCurrent;
+    Profile mLast;
+
+    std::map<OperationType, medida::Timer*> mOperationTimers;
+    std::map<OperationType, medida::Meter*> mOperationQueries;
+    std::map<TransactionResultCode, medida::Meter*> mTransactionQueries;
+
+  public:
+    explicit ApplyProfiler(Application& app);
+
+    // the SQL statements run so far, to be given back to the record*
+    // methods
+    uint64_t getQueryCount() const;
+
+    void startLedger(uint32_t ledgerSeq);
+    void finishLedger();
+
+    void recordOperation(OperationType type, std::chrono::nanoseconds time,
+                         uint64_t queriesBefore);
+    void recordTransaction(TransactionResultCode code,
+                           std::chrono::nanoseconds time,
+                           uint64_t queriesBefore);
+
+    // profile of the last ledger closed, null before the first one
+    Json::Value getJsonInfo() const;
+};
+}
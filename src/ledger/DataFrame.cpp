@@ -8,6 +8,8 @@
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "database/PostgresCopyWriter.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerRange.h"
 #include "transactions/ManageDataOpFrame.h"
 #include "util/Decoder.h"
@@ -192,9 +194,8 @@ DataFrame::deleteDataModifiedOnOrAfterLedger(Database& db,
                                              uint32_t oldestLedger)
 {
     db.getEntryCache().erase_if(
-        [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
-            return le && le->data.type() == DATA &&
-                   le->lastModifiedLedgerSeq >= oldestLedger;
+        DATA, [oldestLedger](std::shared_ptr<LedgerEntry const> const& le) {
+            return le && le->lastModifiedLedgerSeq >= oldestLedger;
         });
 
     {
@@ -235,6 +236,19 @@ DataFrame::storeChange(LedgerDelta& delta, Database& db)
     storeUpdateHelper(delta, db, false);
 }
 
+const char* DataFrame::kSQLCopyColumns =
+    "accountid, dataname, datavalue, lastmodified";
+
+void
+DataFrame::copyTo(PostgresCopyWriter& writer) const
+{
+    writer.addString(KeyUtils::toStrKey(mData.accountID));
+    writer.addString(mData.dataName);
+    writer.addString(decoder::encode_b64(mData.dataValue));
+    writer.addUInt(getLastModified());
+    writer.endRow();
+}
+
 void
 DataFrame::storeAdd(LedgerDelta& delta, Database& db)
 {
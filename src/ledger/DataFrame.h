@@ -67,6 +67,11 @@ class DataFrame : public EntryFrame
     // Static helpers that don't assume an instance.
     static void storeDelete(LedgerDelta& delta, Database& db,
                             LedgerKey const& key);
+
+    // Bulk loading support (see BucketApplicator): write this entry as a row
+    // of the accountdata table, laid out as kSQLCopyColumns.
+    void copyTo(PostgresCopyWriter& writer) const;
+    static const char* kSQLCopyColumns;
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
     static uint64_t countObjects(soci::session& sess,
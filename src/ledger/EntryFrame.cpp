@@ -4,11 +4,11 @@
 
 #include "ledger/EntryFrame.h"
 #include "LedgerManager.h"
-#include "crypto/Hex.h"
 #include "database/Database.h"
 #include "ledger/AccountFrame.h"
 #include "ledger/DataFrame.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/OfferFrame.h"
 #include "ledger/TrustFrame.h"
 #include "util/XDROperators.h"
@@ -108,30 +108,48 @@ EntryFrame::touch(LedgerDelta const& delta)
 void
 EntryFrame::flushCachedEntry(LedgerKey const& key, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    db.getEntryCache().erase_if_exists(s);
+    db.getEntryCache().erase_if_exists(key);
 }
 
 bool
 EntryFrame::cachedEntryExists(LedgerKey const& key, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    return db.getEntryCache().exists(s);
+    return db.getEntryCache().exists(key);
+}
+
+bool
+EntryFrame::cachedEntryExists(LedgerKey const& key,
+                              LedgerEntryCacheKey const& cacheKey, Database& db)
+{
+    return db.getEntryCache().exists(key, cacheKey);
 }
 
 std::shared_ptr<LedgerEntry const>
 EntryFrame::getCachedEntry(LedgerKey const& key, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    return db.getEntryCache().get(s);
+    return db.getEntryCache().get(key);
+}
+
+std::shared_ptr<LedgerEntry const>
+EntryFrame::getCachedEntry(LedgerKey const& key,
+                           LedgerEntryCacheKey const& cacheKey, Database& db)
+{
+    return db.getEntryCache().get(key, cacheKey);
+}
+
+void
+EntryFrame::putCachedEntry(LedgerKey const& key,
+                           std::shared_ptr<LedgerEntry const> p, Database& db)
+{
+    db.getEntryCache().put(key, p);
 }
 
 void
 EntryFrame::putCachedEntry(LedgerKey const& key,
+                           LedgerEntryCacheKey const& cacheKey,
                            std::shared_ptr<LedgerEntry const> p, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    db.getEntryCache().put(s, p);
+    db.getEntryCache().put(key, cacheKey, p);
 }
 
 void
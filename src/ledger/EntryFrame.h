@@ -19,6 +19,8 @@ namespace stellar
 {
 class Database;
 class LedgerDelta;
+class PostgresCopyWriter;
+struct LedgerEntryCacheKey;
 
 class EntryFrame : public NonMovableOrCopyable
 {
@@ -43,12 +45,24 @@ class EntryFrame : public NonMovableOrCopyable
     static pointer FromXDR(LedgerEntry const& from);
     static pointer storeLoad(LedgerKey const& key, Database& db);
 
-    // Static helpers for working with the DB LedgerEntry cache.
+    // Static helpers for working with the DB LedgerEntry cache. A lookup
+    // that calls several of them passes each the same `cacheKey`, see
+    // makeLedgerEntryCacheKey.
     static void flushCachedEntry(LedgerKey const& key, Database& db);
     static bool cachedEntryExists(LedgerKey const& key, Database& db);
+    static bool cachedEntryExists(LedgerKey const& key,
+                                  LedgerEntryCacheKey const& cacheKey,
+                                  Database& db);
     static std::shared_ptr<LedgerEntry const>
     getCachedEntry(LedgerKey const& key, Database& db);
+    static std::shared_ptr<LedgerEntry const>
+    getCachedEntry(LedgerKey const& key, LedgerEntryCacheKey const& cacheKey,
+                   Database& db);
+    static void putCachedEntry(LedgerKey const& key,
+                               std::shared_ptr<LedgerEntry const> p,
+                               Database& db);
     static void putCachedEntry(LedgerKey const& key,
+                               LedgerEntryCacheKey const& cacheKey,
                                std::shared_ptr<LedgerEntry const> p,
                                Database& db);
 
@@ -0,0 +1,176 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/InflationVoteTally.h"
+#include "crypto/KeyUtils.h"
+#include "database/Database.h"
+#include "ledger/LedgerDelta.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <string>
+
+namespace stellar
+{
+
+// as in the query of AccountFrame::processForInflation
+int64_t const InflationVoteTally::MIN_VOTER_BALANCE = 1000000000;
+
+void
+InflationVoteTally::load(Database& db)
+{
+    mVoters.clear();
+    mVotes.clear();
+
+    std::string id, dest;
+    int64_t balance;
+    int64_t minBalance = MIN_VOTER_BALANCE;
+    soci::statement st =
+        (db.getSession().prepare
+             << "SELECT accountid, balance, inflationdest FROM accounts"
+                " WHERE inflationdest IS NOT NULL AND balance >= :min",
+         soci::into(id), soci::into(balance), soci::into(dest),
+         soci::use(minBalance));
+    st.execute(true);
+    while (st.got_data())
+    {
+        auto vote = Vote{KeyUtils::fromStrKey<PublicKey>(dest), balance};
+        addVote(mVotes, vote.mDest, vote.mBalance);
+        mVoters.emplace(KeyUtils::fromStrKey<PublicKey>(id), vote);
+        st.fetch();
+    }
+    mLoaded = true;
+    CLOG(DEBUG, "Ledger") << "Loaded the inflation votes of " << mVoters.size()
+                          << " accounts for " << mVotes.size()
+                          << " destinations";
+}
+
+void
+InflationVoteTally::addVote(std::unordered_map<AccountID, int64_t>& votes,
+                            AccountID const& dest, int64_t balance)
+{
+    auto it = votes.emplace(dest, 0).first;
+    it->second += balance;
+    if (it->second == 0)
+    {
+        votes.erase(it);
+    }
+}
+
+void
+InflationVoteTally::update(AccountID const& id, AccountEntry const* account)
+{
+    if (!mLoaded)
+    {
+        return;
+    }
+    auto it = mVoters.find(id);
+    if (it != mVoters.end())
+    {
+        addVote(mVotes, it->second.mDest, -it->second.mBalance);
+        mVoters.erase(it);
+    }
+    if (account && account->inflationDest &&
+        account->balance >= MIN_VOTER_BALANCE)
+    {
+        addVote(mVotes, *account->inflationDest, account->balance);
+        mVoters.emplace(id, Vote{*account->inflationDest, account->balance});
+    }
+}
+
+void
+InflationVoteTally::clear()
+{
+    mLoaded = false;
+    mVoters.clear();
+    mVotes.clear();
+}
+
+std::vector<AccountFrame::InflationVotes>
+InflationVoteTally::getVotes(Database& db, LedgerDelta const& delta)
+{
+    if (!mLoaded)
+    {
+        load(db);
+    }
+
+    // the changes not committed yet, as differences to the tally
+    std::unordered_map<AccountID, int64_t> pending;
+    delta.forEachPendingEntry(
+        ACCOUNT, [&](LedgerKey const& k, LedgerEntry const* e) {
+            auto const& id = k.account().accountID;
+            auto it = mVoters.find(id);
+            if (it != mVoters.end())
+            {
+                pending[it->second.mDest] -= it->second.mBalance;
+            }
+            if (e)
+            {
+                auto const& account = e->data.account();
+                if (account.inflationDest &&
+                    account.balance >= MIN_VOTER_BALANCE)
+                {
+                    pending[*account.inflationDest] += account.balance;
+                }
+            }
+        });
+
+    // sorted as "ORDER BY votes DESC, inflationdest DESC", on the strkeys
+    typedef std::pair<AccountFrame::InflationVotes, std::string> Ranked;
+    std::vector<Ranked> sorted;
+    sorted.reserve(mVotes.size() + pending.size());
+    auto add = [&](AccountID const& dest, int64_t votes) {
+        if (votes != 0)
+        {
+            sorted.emplace_back(AccountFrame::InflationVotes{votes, dest},
+                                KeyUtils::toStrKey(dest));
+        }
+    };
+    for (auto const& kv : mVotes)
+    {
+        auto it = pending.find(kv.first);
+        add(kv.first, kv.second + (it == pending.end() ? 0 : it->second));
+    }
+    for (auto const& kv : pending)
+    {
+        if (mVotes.find(kv.first) == mVotes.end())
+        {
+            add(kv.first, kv.second);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](Ranked const& a, Ranked const& b) {
+                  if (a.first.mVotes != b.first.mVotes)
+                  {
+                      return a.first.mVotes > b.first.mVotes;
+                  }
+                  return a.second > b.second;
+              });
+
+    std::vector<AccountFrame::InflationVotes> res;
+    res.reserve(sorted.size());
+    for (auto const& v : sorted)
+    {
+        res.emplace_back(v.first);
+    }
+    return res;
+}
+
+void
+InflationVoteTally::processForInflation(
+    std::function<bool(AccountFrame::InflationVotes const&)> inflationProcessor,
+    int maxWinners, Database& db, LedgerDelta const& delta)
+{
+    auto votes = getVotes(db, delta);
+    for (size_t i = 0;
+         i < votes.size() && i < static_cast<size_t>(std::max(maxWinners, 0));
+         i++)
+    {
+        if (!inflationProcessor(votes[i]))
+        {
+            break;
+        }
+    }
+}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/AccountFrame.h"
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace stellar
+{
+class Database;
+class LedgerDelta;
+
+/**
+ * Optional resident tally of the inflation votes (for INFLATION_VOTE_TALLY),
+ * so that applying an inflation operation does not aggregate the whole
+ * accounts table as AccountFrame::processForInflation does.
+ *
+ * It holds the accounts that vote (an inflation destination and a balance of
+ * at least MIN_VOTER_BALANCE) and the votes of each destination, as committed
+ * by the top level LedgerDeltas: the changes of the deltas still open when
+ * winners are computed are counted on top. The tally is loaded from SQL on
+ * first use, and dropped by the writes that bypass LedgerDelta (until loaded
+ * again).
+ *
+ * Only used from the main thread.
+ */
+class InflationVoteTally : NonMovableOrCopyable
+{
+    struct Vote
+    {
+        AccountID mDest;
+        int64_t mBalance;
+    };
+
+    bool mLoaded{false};
+    std::unordered_map<AccountID, Vote> mVoters;
+    std::unordered_map<AccountID, int64_t> mVotes;
+
+    void load(Database& db);
+    void addVote(std::unordered_map<AccountID, int64_t>& votes,
+                 AccountID const& dest, int64_t balance);
+
+  public:
+    // balance from which an account's vote counts
+    static int64_t const MIN_VOTER_BALANCE;
+
+    // An account committed to the database, null when deleted.
+    void update(AccountID const& id, AccountEntry const* account);
+
+    // Forget everything; the tally is loaded again on next use.
+    void clear();
+
+    // Every destination and its votes, with the changes of `delta` and of
+    // the deltas it is nested in, ordered as AccountFrame::processForInflation
+    // reports them (by votes, then by destination, descending).
+    std::vector<AccountFrame::InflationVotes>
+    getVotes(Database& db, LedgerDelta const& delta);
+
+    // Same contract as AccountFrame::processForInflation.
+    void processForInflation(
+        std::function<bool(AccountFrame::InflationVotes const&)>
+            inflationProcessor,
+        int maxWinners, Database& db, LedgerDelta const& delta);
+};
+}
@@ -0,0 +1,160 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerCloseMetaStream.h"
+#include "util/Logging.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace stellar
+{
+
+size_t const LedgerCloseMetaStream::MAX_QUEUED_LEDGERS = 16;
+
+LedgerCloseMetaStream::LedgerCloseMetaStream(std::string const& target)
+{
+    openTarget(target);
+    mWriter = std::thread([this]() { write(); });
+}
+
+LedgerCloseMetaStream::~LedgerCloseMetaStream()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mQueueChanged.notify_all();
+    mWriter.join();
+}
+
+void
+LedgerCloseMetaStream::openTarget(std::string const& target)
+{
+    std::string const fdPrefix = "fd:";
+    if (target.compare(0, fdPrefix.size(), fdPrefix) == 0)
+    {
+        mOut.fdopen(std::stoi(target.substr(fdPrefix.size())));
+        return;
+    }
+#ifndef _WIN32
+    struct stat st;
+    if (stat(target.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        struct sockaddr_un addr;
+        if (target.size() >= sizeof(addr.sun_path))
+        {
+            throw std::invalid_argument("Socket path too long: " + target);
+        }
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, target.c_str(), sizeof(addr.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 ||
+            connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                    sizeof(addr)) != 0)
+        {
+            auto err = errno;
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            throw std::runtime_error("Could not connect to " + target +
+                                     ": " + std::strerror(err));
+        }
+        mOut.fdopen(fd);
+        return;
+    }
+#endif
+    // a FIFO blocks here until its reader opens it
+    mOut.open(target);
+}
+
+void
+LedgerCloseMetaStream::startLedger()
+{
+    mFeeChanges.clear();
+    mMetas.clear();
+}
+
+void
+LedgerCloseMetaStream::addFeeChanges(LedgerEntryChanges const& changes)
+{
+    XDROutputFileStream::serialize(changes, mFeeChanges);
+}
+
+void
+LedgerCloseMetaStream::addTransactionMeta(TransactionMeta const& meta)
+{
+    XDROutputFileStream::serialize(meta, mMetas);
+}
+
+void
+LedgerCloseMetaStream::finishLedger(
+    LedgerHeaderHistoryEntry const& header,
+    TransactionHistoryEntry const& txSet,
+    TransactionHistoryResultEntry const& results)
+{
+    std::vector<char> buf;
+    XDROutputFileStream::serialize(header, buf);
+    XDROutputFileStream::serialize(txSet, buf);
+    XDROutputFileStream::serialize(results, buf);
+    buf.insert(buf.end(), mFeeChanges.begin(), mFeeChanges.end());
+    buf.insert(buf.end(), mMetas.begin(), mMetas.end());
+    startLedger();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mQueueChanged.wait(lock, [this]() {
+        return mFailed || mQueue.size() < MAX_QUEUED_LEDGERS;
+    });
+    if (mFailed)
+    {
+        throw std::runtime_error("Could not write to the metadata stream");
+    }
+    mQueue.emplace_back(std::move(buf));
+    lock.unlock();
+    mQueueChanged.notify_all();
+}
+
+void
+LedgerCloseMetaStream::write()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        mQueueChanged.wait(
+            lock, [this]() { return mStopping || !mQueue.empty(); });
+        if (mQueue.empty())
+        {
+            // stopping, everything queued was written
+            return;
+        }
+        auto buf = std::move(mQueue.front());
+        mQueue.pop_front();
+        lock.unlock();
+        mQueueChanged.notify_all();
+
+        bool written = mOut.writeBytes(buf.data(), buf.size()) && mOut.flush();
+
+        lock.lock();
+        if (!written)
+        {
+            CLOG(ERROR, "Ledger") << "Could not write to the metadata stream: "
+                                  << std::strerror(errno);
+            mFailed = true;
+            mQueue.clear();
+            mQueueChanged.notify_all();
+            return;
+        }
+    }
+}
+}
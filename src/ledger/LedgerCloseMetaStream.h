@@ -0,0 +1,73 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+#include "util/XDRStream.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Streams what each ledger closed, for downstream consumers to ingest it
+ * without polling the history tables (see METADATA_OUTPUT_STREAM).
+ *
+ * Each ledger is written as a sequence of framed XDR objects, as
+ * XDROutputFileStream writes them:
+ *
+ *     LedgerHeaderHistoryEntry
+ *     TransactionHistoryEntry         (the transaction set)
+ *     TransactionHistoryResultEntry   (N results, in apply order)
+ *     N x LedgerEntryChanges          (fees and sequence numbers charged)
+ *     N x TransactionMeta
+ *
+ * Ledgers are written by a thread of their own, so that a slow consumer
+ * does not slow down ledger close until MAX_QUEUED_LEDGERS are waiting to
+ * be written: finishLedger then blocks until it catches up. A write that
+ * fails makes the next finishLedger throw, as a consumer cannot make up
+ * for the ledgers it missed.
+ */
+class LedgerCloseMetaStream : NonMovableOrCopyable
+{
+  public:
+    static size_t const MAX_QUEUED_LEDGERS;
+
+    // @p target is either "fd:N", to write to the inherited descriptor N,
+    // or the path of a file, FIFO or Unix socket
+    explicit LedgerCloseMetaStream(std::string const& target);
+    ~LedgerCloseMetaStream();
+
+    void startLedger();
+    // in apply order
+    void addFeeChanges(LedgerEntryChanges const& changes);
+    void addTransactionMeta(TransactionMeta const& meta);
+    void finishLedger(LedgerHeaderHistoryEntry const& header,
+                      TransactionHistoryEntry const& txSet,
+                      TransactionHistoryResultEntry const& results);
+
+  private:
+    XDROutputFileStream mOut;
+    std::vector<char> mFeeChanges;
+    std::vector<char> mMetas;
+
+    std::mutex mMutex;
+    std::condition_variable mQueueChanged;
+    std::deque<std::vector<char>> mQueue;
+    bool mStopping{false};
+    bool mFailed{false};
+    std::thread mWriter;
+
+    void openTarget(std::string const& target);
+    void write();
+};
+}
@@ -0,0 +1,242 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerCloseTracer.h"
+#include "database/Database.h"
+#include "main/Application.h"
+
+#include "medida/meter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace stellar
+{
+
+size_t const LedgerCloseTracer::KEPT_LEDGERS = 64;
+size_t const LedgerCloseTracer::MAX_EVENTS = 10000;
+
+namespace
+{
+double
+toMs(std::chrono::nanoseconds d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+double
+toUs(std::chrono::nanoseconds d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+}
+
+LedgerCloseTracer::Span::Span(LedgerCloseTracer* tracer) : mTracer(tracer)
+{
+}
+
+LedgerCloseTracer::Span::Span(Span&& other) : mTracer(other.mTracer)
+{
+    other.mTracer = nullptr;
+}
+
+LedgerCloseTracer::Span::~Span()
+{
+    finish();
+}
+
+void
+LedgerCloseTracer::Span::finish()
+{
+    if (mTracer)
+    {
+        mTracer->close();
+        mTracer = nullptr;
+    }
+}
+
+LedgerCloseTracer::LedgerCloseTracer(Application& app)
+    : mApp(app), mEpoch(std::chrono::steady_clock::now())
+{
+}
+
+void
+LedgerCloseTracer::open(char const* name)
+{
+    auto& nodes = mCurrent.mNodes;
+    size_t node = nodes.size();
+    if (!mOpen.empty())
+    {
+        auto& siblings = nodes[mOpen.back().mNode].mChildren;
+        auto it = std::find_if(siblings.begin(), siblings.end(),
+                               [&](size_t i) {
+                                   return std::strcmp(nodes[i].mName, name) ==
+                                          0;
+                               });
+        if (it != siblings.end())
+        {
+            node = *it;
+        }
+        else
+        {
+            siblings.emplace_back(node);
+        }
+    }
+    if (node == nodes.size())
+    {
+        nodes.emplace_back();
+        nodes.back().mName = name;
+    }
+    mOpen.emplace_back(
+        OpenSpan{node, std::chrono::steady_clock::now(),
+                 mApp.getDatabase().getQueryMeter().count()});
+}
+
+void
+LedgerCloseTracer::close()
+{
+    assert(!mOpen.empty());
+    auto const& span = mOpen.back();
+    auto duration = std::chrono::steady_clock::now() - span.mStart;
+    auto queries = mApp.getDatabase().getQueryMeter().count() - span.mQueries;
+
+    auto& node = mCurrent.mNodes[span.mNode];
+    node.mCount++;
+    node.mTime += duration;
+    node.mQueries += queries;
+    if (mCurrent.mEvents.size() < MAX_EVENTS)
+    {
+        mCurrent.mEvents.emplace_back(
+            Event{span.mNode, span.mStart - mEpoch, duration, queries});
+    }
+    else
+    {
+        mCurrent.mDroppedEvents++;
+    }
+    mOpen.pop_back();
+}
+
+void
+LedgerCloseTracer::startLedger(uint32_t ledgerSeq)
+{
+    // whatever an interrupted close left
+    mOpen.clear();
+    mCurrent = Trace{};
+    mCurrent.mLedgerSeq = ledgerSeq;
+    mTracing = true;
+    open("close");
+}
+
+void
+LedgerCloseTracer::finishLedger()
+{
+    if (!mTracing)
+    {
+        return;
+    }
+    // spans still open are cut short, the root last
+    while (!mOpen.empty())
+    {
+        close();
+    }
+    mTracing = false;
+    mTraces.emplace_back(std::move(mCurrent));
+    mCurrent = Trace{};
+    if (mTraces.size() > KEPT_LEDGERS)
+    {
+        mTraces.pop_front();
+    }
+}
+
+LedgerCloseTracer::Span
+LedgerCloseTracer::span(char const* name)
+{
+    if (!mTracing)
+    {
+        return Span(nullptr);
+    }
+    open(name);
+    return Span(this);
+}
+
+std::vector<LedgerCloseTracer::Trace const*>
+LedgerCloseTracer::getLast(size_t ledgers) const
+{
+    auto n = ledgers == 0 ? mTraces.size() : std::min(ledgers, mTraces.size());
+    std::vector<Trace const*> res;
+    for (auto it = mTraces.end() - n; it != mTraces.end(); ++it)
+    {
+        res.emplace_back(&*it);
+    }
+    return res;
+}
+
+Json::Value
+LedgerCloseTracer::toJson(Trace const& trace, size_t node) const
+{
+    auto const& n = trace.mNodes[node];
+    Json::Value res;
+    res["count"] = static_cast<Json::UInt64>(n.mCount);
+    res["time_ms"] = toMs(n.mTime);
+    res["queries"] = static_cast<Json::UInt64>(n.mQueries);
+    if (!n.mChildren.empty())
+    {
+        auto& phases = res["phases"];
+        for (auto child : n.mChildren)
+        {
+            phases[trace.mNodes[child].mName] = toJson(trace, child);
+        }
+    }
+    return res;
+}
+
+Json::Value
+LedgerCloseTracer::getJsonInfo(size_t ledgers) const
+{
+    Json::Value res;
+    auto& traces = res["ledgers"];
+    traces = Json::arrayValue;
+    for (auto trace : getLast(ledgers))
+    {
+        auto t = toJson(*trace, 0);
+        t["ledger"] = trace->mLedgerSeq;
+        if (trace->mDroppedEvents != 0)
+        {
+            t["dropped_events"] =
+                static_cast<Json::UInt64>(trace->mDroppedEvents);
+        }
+        traces.append(t);
+    }
+    return res;
+}
+
+Json::Value
+LedgerCloseTracer::getChromeTrace(size_t ledgers) const
+{
+    Json::Value res;
+    res["displayTimeUnit"] = "ms";
+    auto& events = res["traceEvents"];
+    events = Json::arrayValue;
+    for (auto trace : getLast(ledgers))
+    {
+        for (auto const& e : trace->mEvents)
+        {
+            Json::Value event;
+            event["name"] = trace->mNodes[e.mNode].mName;
+            event["cat"] = "ledger";
+            // a complete event, timestamps in us
+            event["ph"] = "X";
+            event["ts"] = toUs(e.mStart);
+            event["dur"] = toUs(e.mDuration);
+            event["pid"] = 1;
+            event["tid"] = 1;
+            event["args"]["ledger"] = trace->mLedgerSeq;
+            event["args"]["queries"] = static_cast<Json::UInt64>(e.mQueries);
+            events.append(event);
+        }
+    }
+    return res;
+}
+}
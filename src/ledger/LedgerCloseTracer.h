@@ -0,0 +1,120 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Records where the time of each ledger close goes, to tell which phase of
+ * a slow ledger (fees, apply, invariants, bucket list, SQL commit, history
+ * ...) made it slow, which the cumulative "ledger.close.*" timers can't.
+ *
+ * A ledger close is a tree of nested spans, opened with span() and closed
+ * when the returned Span goes out of scope: for every node of the tree
+ * (spans of the same name under the same parent are merged), the number of
+ * spans, their time and the SQL statements they ran. The individual spans
+ * are also kept, up to MAX_EVENTS per ledger, as a timeline. The traces of
+ * the last KEPT_LEDGERS ledgers closed are reported by getJsonInfo, or as
+ * Chrome trace events (chrome://tracing, Perfetto) by getChromeTrace.
+ *
+ * Spans opened outside of a ledger close are not recorded.
+ */
+class LedgerCloseTracer : NonMovableOrCopyable
+{
+  public:
+    static size_t const KEPT_LEDGERS;
+    static size_t const MAX_EVENTS;
+
+    class Span : NonCopyable
+    {
+        LedgerCloseTracer* mTracer;
+
+      public:
+        Span(LedgerCloseTracer* tracer);
+        Span(Span&& other);
+        ~Span();
+
+        // closes the span before the end of its scope
+        void finish();
+    };
+
+  private:
+    struct Node
+    {
+        char const* mName;
+        std::vector<size_t> mChildren;
+        uint64_t mCount{0};
+        std::chrono::nanoseconds mTime{0};
+        uint64_t mQueries{0};
+    };
+
+    struct Event
+    {
+        size_t mNode;
+        // since the tracer was created
+        std::chrono::nanoseconds mStart;
+        std::chrono::nanoseconds mDuration;
+        uint64_t mQueries;
+    };
+
+    struct Trace
+    {
+        uint32_t mLedgerSeq{0};
+        // the root, the whole close, is the first one
+        std::vector<Node> mNodes;
+        std::vector<Event> mEvents;
+        uint64_t mDroppedEvents{0};
+    };
+
+    struct OpenSpan
+    {
+        size_t mNode;
+        std::chrono::steady_clock::time_point mStart;
+        uint64_t mQueries;
+    };
+
+    Application& mApp;
+    std::chrono::steady_clock::time_point const mEpoch;
+    bool mTracing{false};
+    Trace mCurrent;
+    std::vector<OpenSpan> mOpen;
+    // oldest first
+    std::deque<Trace> mTraces;
+
+    void open(char const* name);
+    void close();
+
+    std::vector<Trace const*> getLast(size_t ledgers) const;
+    Json::Value toJson(Trace const& trace, size_t node) const;
+
+  public:
+    explicit LedgerCloseTracer(Application& app);
+
+    // the root span of the close of @p ledgerSeq
+    void startLedger(uint32_t ledgerSeq);
+    // closes the root span, keeping the trace
+    void finishLedger();
+
+    // a span named @p name (a literal: it is kept as is) nested in the
+    // innermost one open
+    Span span(char const* name);
+
+    // the trees of the last @p ledgers ledgers closed (all the kept ones if
+    // 0), oldest first
+    Json::Value getJsonInfo(size_t ledgers = 0) const;
+    // the timelines of the same, in Chrome trace event format
+    Json::Value getChromeTrace(size_t ledgers = 0) const;
+};
+}
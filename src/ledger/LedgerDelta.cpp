@@ -3,6 +3,10 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "ledger/LedgerDelta.h"
+#include "database/Database.h"
+#include "ledger/InflationVoteTally.h"
+#include "ledger/LedgerEntryCache.h"
+#include "ledger/OrderBook.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "medida/meter.h"
@@ -19,21 +23,51 @@ LedgerDelta::LedgerDelta(LedgerDelta& outerDelta)
     , mCurrentHeader(outerDelta.getHeader())
     , mPreviousHeaderValue(outerDelta.getHeader())
     , mDb(outerDelta.mDb)
+    , mOrderBookMark(mDb.getOrderBook() ? mDb.getOrderBook()->getUndoMark() : 0)
     , mUpdateLastModified(outerDelta.mUpdateLastModified)
+    , mKeepPrevious(outerDelta.mKeepPrevious)
 {
 }
 
 LedgerDelta::LedgerDelta(LedgerHeader& header, Database& db,
-                         bool updateLastModified)
+                         bool updateLastModified, bool keepPrevious)
     : mOuterDelta(nullptr)
     , mHeader(&header)
     , mCurrentHeader(header)
     , mPreviousHeaderValue(header)
     , mDb(db)
+    , mOrderBookMark(mDb.getOrderBook() ? mDb.getOrderBook()->getUndoMark() : 0)
     , mUpdateLastModified(updateLastModified)
+    , mKeepPrevious(keepPrevious)
 {
 }
 
+LedgerDelta::LedgerDelta(LedgerDelta const& other, SnapshotTag)
+    : mOuterDelta(nullptr)
+    , mHeader(nullptr)
+    , mCurrentHeader(other.mCurrentHeader)
+    , mPreviousHeaderValue(other.mPreviousHeaderValue)
+    , mDelete(other.mDelete)
+    , mDb(other.mDb)
+    , mOrderBookMark(0)
+    , mUpdateLastModified(other.mUpdateLastModified)
+    , mKeepPrevious(other.mKeepPrevious)
+{
+    // the frames of a delta are changed in place (see modEntry)
+    for (auto const& e : other.mNew)
+    {
+        mNew.emplace(e.first, e.second->copy());
+    }
+    for (auto const& e : other.mMod)
+    {
+        mMod.emplace(e.first, e.second->copy());
+    }
+    for (auto const& e : other.mPrevious)
+    {
+        mPrevious.emplace(e.first, e.second->copy());
+    }
+}
+
 LedgerDelta::~LedgerDelta()
 {
     if (mHeader)
@@ -85,19 +119,37 @@ LedgerDelta::addEntry(EntryFrame const& entry)
 void
 LedgerDelta::deleteEntry(EntryFrame const& entry)
 {
-    deleteEntry(entry.copy());
+    deleteEntry(entry.getKey());
 }
 
 void
 LedgerDelta::modEntry(EntryFrame const& entry)
 {
-    modEntry(entry.copy());
+    checkState();
+    // an entry changed again is updated in the frame this delta already
+    // owns, instead of copying a new frame
+    auto const& k = entry.getKey();
+    auto it = mMod.find(k);
+    if (it == mMod.end())
+    {
+        it = mNew.find(k);
+        if (it == mNew.end())
+        {
+            modEntry(entry.copy());
+            return;
+        }
+    }
+    it->second->mEntry = entry.mEntry;
 }
 
 void
 LedgerDelta::recordEntry(EntryFrame const& entry)
 {
-    recordEntry(entry.copy());
+    // only the first value recorded is kept, no need to copy the others
+    if (mKeepPrevious && mPrevious.find(entry.getKey()) == mPrevious.end())
+    {
+        recordEntry(entry.copy());
+    }
 }
 
 void
@@ -180,6 +232,10 @@ void
 LedgerDelta::recordEntry(EntryFrame::pointer entry)
 {
     checkState();
+    if (!mKeepPrevious)
+    {
+        return;
+    }
     // keeps the old one around
     mPrevious.insert(std::make_pair(entry->getKey(), entry));
 }
@@ -189,6 +245,32 @@ LedgerDelta::mergeEntries(LedgerDelta& other)
 {
     checkState();
 
+    if (mNew.empty() && mMod.empty() && mDelete.empty() && mPrevious.empty())
+    {
+        // common case of a transaction or operation delta committing into a
+        // delta that has not seen any change yet: take over the entries
+        mNew.swap(other.mNew);
+        mMod.swap(other.mMod);
+        mDelete.swap(other.mDelete);
+        // only the previous values of deleted & modified entries propagate
+        mPrevious.swap(other.mPrevious);
+        for (auto it = mPrevious.begin(); it != mPrevious.end();)
+        {
+            if (mMod.find(it->first) == mMod.end() &&
+                mDelete.find(it->first) == mDelete.end())
+            {
+                it = mPrevious.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        return;
+    }
+
+    // "other" is discarded after this call: entries are moved over rather
+    // than copied
     // propagates mPrevious for deleted & modified entries
     for (auto& d : other.mDelete)
     {
@@ -196,20 +278,20 @@ LedgerDelta::mergeEntries(LedgerDelta& other)
         auto it = other.mPrevious.find(d);
         if (it != other.mPrevious.end())
         {
-            recordEntry(*it->second);
+            recordEntry(std::move(it->second));
         }
     }
     for (auto& n : other.mNew)
     {
-        addEntry(n.second);
+        addEntry(std::move(n.second));
     }
     for (auto& m : other.mMod)
     {
-        modEntry(m.second);
+        modEntry(std::move(m.second));
         auto it = other.mPrevious.find(m.first);
         if (it != other.mPrevious.end())
         {
-            recordEntry(*it->second);
+            recordEntry(std::move(it->second));
         }
     }
 }
@@ -230,6 +312,42 @@ LedgerDelta::commit()
         mOuterDelta->mergeEntries(*this);
         mOuterDelta = nullptr;
     }
+    else
+    {
+        if (auto orderBook = mDb.getOrderBook())
+        {
+            // nothing left that could roll these changes back
+            orderBook->commitTo(mOrderBookMark);
+        }
+        if (auto tally = mDb.getInflationVoteTally())
+        {
+            forEachPendingEntry(ACCOUNT, [tally](LedgerKey const& k,
+                                                 LedgerEntry const* e) {
+                tally->update(k.account().accountID,
+                              e ? &e->data.account() : nullptr);
+            });
+        }
+        // the stores flushed the entries changed, a resident cache gets
+        // them back instead of loading them again
+        auto& cache = mDb.getEntryCache();
+        if (cache.isResident())
+        {
+            for (auto const& kv : mNew)
+            {
+                cache.put(kv.first, std::make_shared<LedgerEntry const>(
+                                        kv.second->mEntry));
+            }
+            for (auto const& kv : mMod)
+            {
+                cache.put(kv.first, std::make_shared<LedgerEntry const>(
+                                        kv.second->mEntry));
+            }
+            for (auto const& k : mDelete)
+            {
+                cache.put(k, nullptr);
+            }
+        }
+    }
     *mHeader = mCurrentHeader.mHeader;
     mHeader = nullptr;
 }
@@ -252,6 +370,10 @@ LedgerDelta::rollback()
     {
         EntryFrame::flushCachedEntry(m.first, mDb);
     }
+    if (auto orderBook = mDb.getOrderBook())
+    {
+        orderBook->rollbackTo(mOrderBookMark);
+    }
 }
 
 void
@@ -267,6 +389,13 @@ LedgerDelta::addCurrentMeta(LedgerEntryChanges& changes,
     }
 }
 
+std::unique_ptr<LedgerDelta const>
+LedgerDelta::snapshot() const
+{
+    return std::unique_ptr<LedgerDelta const>(
+        new LedgerDelta(*this, SnapshotTag{}));
+}
+
 LedgerEntryChanges
 LedgerDelta::getChanges() const
 {
@@ -327,12 +456,82 @@ LedgerDelta::getDeadEntries() const
     return dead;
 }
 
+std::vector<LedgerEntry>
+LedgerDelta::takeLiveEntries()
+{
+    if (mHeader)
+    {
+        throw std::runtime_error("Invalid operation: delta is not committed");
+    }
+    std::vector<LedgerEntry> live;
+    live.reserve(mNew.size() + mMod.size());
+    for (auto* entries : {&mNew, &mMod})
+    {
+        for (auto& k : *entries)
+        {
+            live.emplace_back(std::move(k.second->mEntry));
+        }
+        entries->clear();
+    }
+    mPrevious.clear();
+    return live;
+}
+
+std::vector<LedgerKey>
+LedgerDelta::takeDeadEntries()
+{
+    if (mHeader)
+    {
+        throw std::runtime_error("Invalid operation: delta is not committed");
+    }
+    // the keys of a set can only be copied out, they are small
+    std::vector<LedgerKey> dead(mDelete.begin(), mDelete.end());
+    mDelete.clear();
+    mPrevious.clear();
+    return dead;
+}
+
+void
+LedgerDelta::forEachPendingEntry(
+    LedgerEntryType t,
+    std::function<void(LedgerKey const&, LedgerEntry const*)> f) const
+{
+    // the innermost delta has the latest state of a key
+    std::set<LedgerKey, LedgerEntryIdCmp> seen;
+    for (auto d = this; d; d = d->mOuterDelta)
+    {
+        for (auto const* entries : {&d->mNew, &d->mMod})
+        {
+            for (auto const& kv : *entries)
+            {
+                if (kv.first.type() == t && seen.insert(kv.first).second)
+                {
+                    f(kv.first, &kv.second->mEntry);
+                }
+            }
+        }
+        for (auto const& k : d->mDelete)
+        {
+            if (k.type() == t && seen.insert(k).second)
+            {
+                f(k, nullptr);
+            }
+        }
+    }
+}
+
 bool
 LedgerDelta::updateLastModified() const
 {
     return mUpdateLastModified;
 }
 
+bool
+LedgerDelta::keepPrevious() const
+{
+    return mKeepPrevious;
+}
+
 void
 LedgerDelta::markMeters(Application& app) const
 {
@@ -8,6 +8,7 @@
 #include "ledger/EntryFrame.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "xdrpp/marshal.h"
+#include <functional>
 #include <iterator>
 #include <map>
 #include <memory>
@@ -38,8 +39,12 @@ class LedgerDelta
     KeyEntryMap mPrevious;
 
     Database& mDb; // Used strictly for rollback of db entry cache.
+    size_t mOrderBookMark; // undo log position of the resident order book
 
     bool mUpdateLastModified;
+    // false when nothing needs the previous values of the entries (see
+    // recordEntry): nothing is kept then
+    bool mKeepPrevious;
 
     void checkState();
     void addEntry(EntryFrame::pointer entry);
@@ -55,6 +60,11 @@ class LedgerDelta
     void addCurrentMeta(LedgerEntryChanges& changes,
                         LedgerKey const& key) const;
 
+    struct SnapshotTag
+    {
+    };
+    LedgerDelta(LedgerDelta const& other, SnapshotTag);
+
   public:
     // keeps an internal reference to the outerDelta,
     // will apply changes to the outer scope on commit
@@ -64,8 +74,10 @@ class LedgerDelta
     // will apply changes to ledgerHeader on commit,
     // will clear db entry cache on rollback.
     // updateLastModified: if true, revs the lastModified field
+    // keepPrevious: if false, recordEntry does nothing, so that getChanges
+    // has no LEDGER_ENTRY_STATE and modified() and deleted() can't be used
     LedgerDelta(LedgerHeader& ledgerHeader, Database& db,
-                bool updateLastModified = true);
+                bool updateLastModified = true, bool keepPrevious = true);
 
     ~LedgerDelta();
 
@@ -88,6 +100,7 @@ class LedgerDelta
     void rollback();
 
     bool updateLastModified() const;
+    bool keepPrevious() const;
 
     void markMeters(Application& app) const;
 
@@ -95,8 +108,25 @@ class LedgerDelta
     std::vector<LedgerEntry> getLiveEntries() const;
     std::vector<LedgerKey> getDeadEntries() const;
 
+    // same, moving the entries out of a committed delta instead of copying
+    // them: it has no change left afterwards, call markMeters before
+    std::vector<LedgerEntry> takeLiveEntries();
+    std::vector<LedgerKey> takeDeadEntries();
+
     LedgerEntryChanges getChanges() const;
 
+    // calls `f` with the latest state (null when deleted) of every entry of
+    // type `t` changed by this delta or by the ones it is nested in, that is,
+    // not committed to the database by a top level delta yet
+    void forEachPendingEntry(
+        LedgerEntryType t,
+        std::function<void(LedgerKey const&, LedgerEntry const*)> f) const;
+
+    // copy of the changes (and headers) of this delta that shares no frame
+    // with it and is attached to nothing, so that it can be read on another
+    // thread while this one goes on; it cannot be changed or committed
+    std::unique_ptr<LedgerDelta const> snapshot() const;
+
     template <typename IterType, typename ValueType>
     class Iterator : public std::iterator<std::input_iterator_tag, ValueType>
     {
@@ -12,6 +12,7 @@
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Timer.h"
+#include "util/XDROperators.h"
 
 using namespace stellar;
 
@@ -332,3 +333,88 @@ TEST_CASE("Ledger delta", "[ledger][ledgerdelta]")
         }
     }
 }
+
+TEST_CASE("Ledger delta merge into empty delta", "[ledger][ledgerdelta]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    LedgerHeader& curHeader = app->getLedgerManager().getCurrentLedgerHeader();
+
+    LedgerDelta delta(curHeader, app->getDatabase());
+    auto aEntries = LedgerTestUtils::generateValidAccountEntries(6);
+    std::vector<AccountFrame::pointer> accounts;
+    for (auto const& a : aEntries)
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = a;
+        accounts.emplace_back(std::make_shared<AccountFrame>(le));
+    }
+
+    LedgerEntryChanges expected;
+    {
+        LedgerDelta inner(delta);
+        // previous value recorded for an entry that does not change
+        inner.recordEntry(*accounts[0]);
+        inner.addEntry(*accounts[1]);
+        inner.recordEntry(*accounts[2]);
+        auto mod = std::make_shared<AccountFrame>(accounts[2]->mEntry);
+        mod->setSeqNum(mod->getSeqNum() + 1);
+        inner.modEntry(*mod);
+        inner.recordEntry(*accounts[3]);
+        inner.deleteEntry(accounts[3]->getKey());
+        expected = inner.getChanges();
+        inner.commit();
+    }
+    REQUIRE(delta.getChanges() == expected);
+
+    SECTION("following merges are not affected by unchanged entries")
+    {
+        auto mod = std::make_shared<AccountFrame>(accounts[0]->mEntry);
+        mod->setSeqNum(mod->getSeqNum() + 1);
+        {
+            LedgerDelta inner(delta);
+            inner.modEntry(*mod);
+            inner.commit();
+        }
+        auto changes = delta.getChanges();
+        // the previous value of accounts[0] was not propagated, so no
+        // LEDGER_ENTRY_STATE precedes the update
+        REQUIRE(changes.size() == expected.size() + 1);
+    }
+}
+
+TEST_CASE("Ledger delta entries taken once committed", "[ledger][ledgerdelta]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    LedgerHeader& curHeader = app->getLedgerManager().getCurrentLedgerHeader();
+
+    LedgerDelta delta(curHeader, app->getDatabase());
+    auto aEntries = LedgerTestUtils::generateValidAccountEntries(3);
+    std::vector<AccountFrame::pointer> accounts;
+    for (auto const& a : aEntries)
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = a;
+        accounts.emplace_back(std::make_shared<AccountFrame>(le));
+    }
+    delta.addEntry(*accounts[0]);
+    delta.addEntry(*accounts[1]);
+    delta.deleteEntry(accounts[2]->getKey());
+
+    REQUIRE_THROWS_AS(delta.takeLiveEntries(), std::runtime_error);
+    auto live = delta.getLiveEntries();
+    auto dead = delta.getDeadEntries();
+    delta.commit();
+
+    REQUIRE(delta.takeLiveEntries() == live);
+    REQUIRE(delta.takeDeadEntries() == dead);
+    REQUIRE(delta.getLiveEntries().empty());
+    REQUIRE(delta.getDeadEntries().empty());
+}
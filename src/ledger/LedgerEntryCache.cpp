@@ -0,0 +1,361 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerEntryCache.h"
+#include "crypto/SHA.h"
+#include "crypto/XDRHasher.h"
+#include "ledger/EntryFrame.h"
+#include "xdrpp/marshal.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace std
+{
+size_t
+hash<stellar::LedgerEntryCacheKey>::
+operator()(stellar::LedgerEntryCacheKey const& k) const noexcept
+{
+    size_t res;
+    static_assert(sizeof(res) <= sizeof(k.mDigest), "digest too small");
+    std::memcpy(&res, k.mDigest.data(), sizeof(res));
+    return res;
+}
+}
+
+namespace stellar
+{
+
+LedgerEntryCacheKey
+makeLedgerEntryCacheKey(LedgerKey const& key)
+{
+    return LedgerEntryCacheKey{xdrSha256(key)};
+}
+
+static std::string
+partitionName(LedgerEntryType t)
+{
+    switch (t)
+    {
+    case ACCOUNT:
+        return "account";
+    case TRUSTLINE:
+        return "trustline";
+    case OFFER:
+        return "offer";
+    case DATA:
+        return "data";
+    default:
+        abort();
+    }
+}
+
+LedgerEntryCache::LedgerEntryCache(medida::MetricsRegistry& metrics,
+                                   size_t partitionSize)
+{
+    for (auto t : {ACCOUNT, TRUSTLINE, OFFER, DATA})
+    {
+        auto name = partitionName(t);
+        assert(static_cast<size_t>(t) < NUM_PARTITIONS);
+        mPartitions[t] = std::make_unique<TypedPartition>(
+            partitionSize,
+            metrics.NewMeter({"ledger", "entry-cache", name + "-hit"},
+                             "entry"),
+            metrics.NewMeter({"ledger", "entry-cache", name + "-miss"},
+                             "entry"));
+    }
+}
+
+LedgerEntryCache::TypedPartition&
+LedgerEntryCache::getPartition(LedgerEntryType t)
+{
+    auto i = static_cast<size_t>(t);
+    if (i >= NUM_PARTITIONS || !mPartitions[i])
+    {
+        throw std::runtime_error("unknown LedgerEntryType in entry cache");
+    }
+    return *mPartitions[i];
+}
+
+LedgerEntryCache::TypedPartition const&
+LedgerEntryCache::getPartition(LedgerEntryType t) const
+{
+    return const_cast<LedgerEntryCache*>(this)->getPartition(t);
+}
+
+void
+LedgerEntryCache::pruneHits(TypedPartition& p)
+{
+    for (auto it = p.mHits.begin(); it != p.mHits.end();)
+    {
+        if (p.mCache.exists(it->first))
+        {
+            ++it;
+        }
+        else
+        {
+            it = p.mHits.erase(it);
+        }
+    }
+}
+
+bool
+LedgerEntryCache::exists(LedgerKey const& key)
+{
+    return exists(key, makeLedgerEntryCacheKey(key));
+}
+
+bool
+LedgerEntryCache::exists(LedgerKey const& key, LedgerEntryCacheKey const& k)
+{
+    auto& p = getPartition(key.type());
+    if (p.mResident)
+    {
+        if (p.mStale.count(k) == 0)
+        {
+            p.mHit.Mark();
+            return true;
+        }
+    }
+    else if (p.mCache.exists(k))
+    {
+        p.mHit.Mark();
+        ++p.mHits[k];
+        if (p.mHits.size() > 2 * p.mCapacity)
+        {
+            pruneHits(p);
+        }
+        return true;
+    }
+    p.mMiss.Mark();
+    return false;
+}
+
+LedgerEntryCache::EntryPtr
+LedgerEntryCache::get(LedgerKey const& key)
+{
+    return get(key, makeLedgerEntryCacheKey(key));
+}
+
+LedgerEntryCache::EntryPtr
+LedgerEntryCache::get(LedgerKey const& key, LedgerEntryCacheKey const& k)
+{
+    auto& p = getPartition(key.type());
+    if (p.mResident)
+    {
+        if (p.mStale.count(k) != 0)
+        {
+            throw std::range_error("There is no such key in cache");
+        }
+        auto it = p.mEntries.find(k);
+        return it == p.mEntries.end() ? nullptr : it->second;
+    }
+    return p.mCache.get(k);
+}
+
+void
+LedgerEntryCache::put(LedgerKey const& key, EntryPtr p)
+{
+    put(key, makeLedgerEntryCacheKey(key), p);
+}
+
+void
+LedgerEntryCache::put(LedgerKey const& key, LedgerEntryCacheKey const& k,
+                      EntryPtr p)
+{
+    auto& part = getPartition(key.type());
+    if (part.mResident)
+    {
+        part.mStale.erase(k);
+        if (p)
+        {
+            part.mEntries[k] = p;
+        }
+        else
+        {
+            part.mEntries.erase(k);
+        }
+        return;
+    }
+    part.mCache.put(k, p);
+}
+
+void
+LedgerEntryCache::erase_if_exists(LedgerKey const& key)
+{
+    auto& p = getPartition(key.type());
+    auto k = makeLedgerEntryCacheKey(key);
+    if (p.mResident)
+    {
+        p.mEntries.erase(k);
+        p.mStale.insert(k);
+        return;
+    }
+    p.mCache.erase_if_exists(k);
+}
+
+void
+LedgerEntryCache::erase_if(LedgerEntryType t,
+                           std::function<bool(EntryPtr const&)> f)
+{
+    auto& p = getPartition(t);
+    if (p.mResident)
+    {
+        for (auto it = p.mEntries.begin(); it != p.mEntries.end();)
+        {
+            if (f(it->second))
+            {
+                p.mStale.insert(it->first);
+                it = p.mEntries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        return;
+    }
+    p.mCache.erase_if(f);
+}
+
+void
+LedgerEntryCache::clear()
+{
+    for (auto& p : mPartitions)
+    {
+        p->mCache.clear();
+        p->mHits.clear();
+        p->mResident = false;
+        p->mEntries.clear();
+        p->mStale.clear();
+    }
+}
+
+void
+LedgerEntryCache::beginResident()
+{
+    clear();
+    for (auto& p : mPartitions)
+    {
+        p->mResident = true;
+    }
+}
+
+bool
+LedgerEntryCache::isResident(LedgerEntryType t) const
+{
+    return getPartition(t).mResident;
+}
+
+bool
+LedgerEntryCache::isResident() const
+{
+    for (auto const& p : mPartitions)
+    {
+        if (!p->mResident)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t
+LedgerEntryCache::size() const
+{
+    size_t res = 0;
+    for (auto const& p : mPartitions)
+    {
+        res += p->mResident ? p->mEntries.size() : p->mCache.size();
+    }
+    return res;
+}
+
+size_t
+LedgerEntryCache::size(LedgerEntryType t) const
+{
+    auto const& p = getPartition(t);
+    return p.mResident ? p.mEntries.size() : p.mCache.size();
+}
+
+std::vector<LedgerKey>
+LedgerEntryCache::getHotKeys(size_t count)
+{
+    std::vector<std::pair<uint32_t, LedgerKey>> ranked;
+    for (auto& p : mPartitions)
+    {
+        if (p->mResident)
+        {
+            continue;
+        }
+        pruneHits(*p);
+        p->mCache.for_each(
+            [&](LedgerEntryCacheKey const& k, EntryPtr const& entry) {
+                // negative lookups are null
+                if (entry)
+                {
+                    auto it = p->mHits.find(k);
+                    ranked.emplace_back(it == p->mHits.end() ? 0 : it->second,
+                                        LedgerEntryKey(*entry));
+                }
+            });
+    }
+
+    // among entries of a type hit as often, the most recently used first,
+    // as listed by the LRU
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](std::pair<uint32_t, LedgerKey> const& a,
+                        std::pair<uint32_t, LedgerKey> const& b) {
+                         return a.first > b.first;
+                     });
+    auto end = ranked.begin() + std::min(count, ranked.size());
+    std::vector<LedgerKey> res;
+    for (auto it = ranked.begin(); it != end; ++it)
+    {
+        res.emplace_back(std::move(it->second));
+    }
+    return res;
+}
+
+MemoryUsage
+LedgerEntryCache::getMemoryUsage() const
+{
+    // an entry is in the list of the LRU and, by key, in its map
+    size_t const perEntry = 2 * MemoryUsage::NODE_OVERHEAD +
+                            2 * sizeof(LedgerEntryCacheKey) + sizeof(EntryPtr) +
+                            sizeof(Partition::list_iterator_t);
+    // a resident entry is a node of its map, which has a bucket pointer
+    size_t const perResidentEntry = MemoryUsage::NODE_OVERHEAD +
+                                    sizeof(void*) +
+                                    sizeof(LedgerEntryCacheKey) +
+                                    sizeof(EntryPtr);
+    // a hit count is a node of its map as well
+    size_t const perHit = MemoryUsage::NODE_OVERHEAD + sizeof(void*) +
+                          sizeof(LedgerEntryCacheKey) + sizeof(uint32_t);
+    MemoryUsage res;
+    for (auto const& p : mPartitions)
+    {
+        res.mBytes += p->mHits.size() * perHit;
+        if (p->mResident)
+        {
+            for (auto const& kv : p->mEntries)
+            {
+                res.add(perResidentEntry + xdrMemoryUsage(*kv.second));
+            }
+            continue;
+        }
+        p->mCache.for_each(
+            [&](LedgerEntryCacheKey const&, EntryPtr const& entry) {
+                // negative lookups are null
+                res.add(perEntry + (entry ? xdrMemoryUsage(*entry) : 0));
+            });
+    }
+    return res;
+}
+}
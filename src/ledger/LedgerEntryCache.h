@@ -0,0 +1,161 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/MemoryUsage.h"
+#include "util/NonCopyable.h"
+#include "util/lrucache.hpp"
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace medida
+{
+class MetricsRegistry;
+class Meter;
+}
+
+namespace stellar
+{
+
+// Fixed-size binary digest of a LedgerKey, used as the lookup key of the
+// LedgerEntryCache instead of a hex-encoded string: the SHA-256 of the XDR of
+// the key. Computing it is the bulk of the cost of a cache call, so a lookup
+// that goes through several of them (exists, then get, then put on a miss)
+// computes it once and passes it to each.
+struct LedgerEntryCacheKey
+{
+    uint256 mDigest;
+
+    bool
+    operator==(LedgerEntryCacheKey const& other) const
+    {
+        return mDigest == other.mDigest;
+    }
+};
+
+LedgerEntryCacheKey makeLedgerEntryCacheKey(LedgerKey const& key);
+}
+
+namespace std
+{
+// The digest is already uniformly distributed, so the hasher simply reads
+// the first word of it rather than mixing the whole thing again.
+template <> struct hash<stellar::LedgerEntryCacheKey>
+{
+    size_t operator()(stellar::LedgerEntryCacheKey const& k) const noexcept;
+};
+}
+
+namespace stellar
+{
+
+/**
+ * Cache of LedgerEntries loaded from (or known to be absent from) the
+ * database. A null entry records a negative lookup.
+ *
+ * The cache is partitioned by LedgerEntryType: each type has its own LRU with
+ * its own capacity, so that a burst of one kind of entry (typically offers,
+ * during order book crossing) cannot evict the accounts and trustlines that
+ * every transaction needs. Each partition reports hit and miss meters under
+ * "ledger.entry-cache.<type>-{hit,miss}".
+ *
+ * Clients are responsible for invalidating entries as they perform
+ * statements against the database.
+ *
+ * With IN_MEMORY_LEDGER_STATE, the partitions become resident once loaded
+ * with every entry of the ledger (see beginResident): they are no longer
+ * bounded, and a key they do not have is known to be absent, so that point
+ * lookups stop reaching the database. The keys invalidated are remembered
+ * as stale until put again, and clear() returns to the LRUs, the next load
+ * having to start over.
+ *
+ * The hits of the entries in the LRUs are counted, to rank them by how
+ * often they are used (see getHotKeys).
+ */
+class LedgerEntryCache : NonMovableOrCopyable
+{
+  public:
+    typedef std::shared_ptr<LedgerEntry const> EntryPtr;
+    typedef cache::lru_cache<LedgerEntryCacheKey, EntryPtr> Partition;
+
+  private:
+    struct TypedPartition
+    {
+        Partition mCache;
+        size_t mCapacity;
+        medida::Meter& mHit;
+        medida::Meter& mMiss;
+
+        // hits of the keys in mCache, and of some evicted since (dropped
+        // once there are twice as many as it holds)
+        std::unordered_map<LedgerEntryCacheKey, uint32_t> mHits;
+
+        bool mResident{false};
+        // when resident, the entries that exist (absent ones are not kept)
+        std::unordered_map<LedgerEntryCacheKey, EntryPtr> mEntries;
+        std::unordered_set<LedgerEntryCacheKey> mStale;
+
+        TypedPartition(size_t size, medida::Meter& hit, medida::Meter& miss)
+            : mCache(size), mCapacity(size), mHit(hit), mMiss(miss)
+        {
+        }
+    };
+
+    static size_t const NUM_PARTITIONS = 4;
+    std::array<std::unique_ptr<TypedPartition>, NUM_PARTITIONS> mPartitions;
+
+    TypedPartition& getPartition(LedgerEntryType t);
+    TypedPartition const& getPartition(LedgerEntryType t) const;
+    static void pruneHits(TypedPartition& p);
+
+  public:
+    LedgerEntryCache(medida::MetricsRegistry& metrics, size_t partitionSize);
+
+    // The overloads taking `cacheKey`, which must be
+    // makeLedgerEntryCacheKey(key), do not compute it again.
+
+    // Return true if an entry (possibly a null one, recording absence) is
+    // cached for `key`. Marks the hit or miss meter of the partition.
+    bool exists(LedgerKey const& key);
+    bool exists(LedgerKey const& key, LedgerEntryCacheKey const& cacheKey);
+
+    // Return the cached entry for `key`; throws if there is none, so
+    // callers should check `exists` first. Does not mark the meters, the
+    // lookup was counted by `exists`.
+    EntryPtr get(LedgerKey const& key);
+    EntryPtr get(LedgerKey const& key, LedgerEntryCacheKey const& cacheKey);
+
+    void put(LedgerKey const& key, EntryPtr p);
+    void put(LedgerKey const& key, LedgerEntryCacheKey const& cacheKey,
+             EntryPtr p);
+    void erase_if_exists(LedgerKey const& key);
+
+    // Erase every entry of type `t` for which `f` returns true.
+    void erase_if(LedgerEntryType t, std::function<bool(EntryPtr const&)> f);
+
+    void clear();
+
+    // Empty every partition and make it resident: the caller must then put
+    // every entry of the ledger.
+    void beginResident();
+    bool isResident(LedgerEntryType t) const;
+    bool isResident() const;
+
+    size_t size() const;
+    size_t size(LedgerEntryType t) const;
+
+    // The keys of the (at most `count`) existing entries of the LRUs hit the
+    // most since they were loaded, most hit first.
+    std::vector<LedgerKey> getHotKeys(size_t count);
+
+    MemoryUsage getMemoryUsage() const;
+};
+}
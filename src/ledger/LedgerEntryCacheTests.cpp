@@ -0,0 +1,233 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/EntryFrame.h"
+#include "ledger/LedgerEntryCache.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+using namespace stellar;
+
+static LedgerEntry
+makeEntry(LedgerEntryType t)
+{
+    LedgerEntry le;
+    le.data.type(t);
+    switch (t)
+    {
+    case ACCOUNT:
+        le.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+        break;
+    case TRUSTLINE:
+        le.data.trustLine() = LedgerTestUtils::generateValidTrustLineEntry(5);
+        break;
+    case OFFER:
+        le.data.offer() = LedgerTestUtils::generateValidOfferEntry(5);
+        break;
+    case DATA:
+        le.data.data() = LedgerTestUtils::generateValidDataEntry(5);
+        break;
+    }
+    return le;
+}
+
+TEST_CASE("entry cache basics", "[ledger][entrycache]")
+{
+    medida::MetricsRegistry metrics;
+    LedgerEntryCache cache(metrics, 16);
+
+    auto le = makeEntry(ACCOUNT);
+    auto key = LedgerEntryKey(le);
+
+    REQUIRE(!cache.exists(key));
+    cache.put(key, std::make_shared<LedgerEntry const>(le));
+    REQUIRE(cache.exists(key));
+    REQUIRE(*cache.get(key) == le);
+    REQUIRE(cache.size(ACCOUNT) == 1);
+
+    SECTION("negative entries")
+    {
+        cache.put(key, nullptr);
+        REQUIRE(cache.exists(key));
+        REQUIRE(cache.get(key) == nullptr);
+    }
+
+    SECTION("erase")
+    {
+        cache.erase_if_exists(key);
+        REQUIRE(!cache.exists(key));
+        REQUIRE(cache.size() == 0);
+    }
+
+    SECTION("precomputed keys")
+    {
+        auto other = makeEntry(ACCOUNT);
+        auto otherKey = LedgerEntryKey(other);
+        auto cacheKey = makeLedgerEntryCacheKey(otherKey);
+        REQUIRE(!cache.exists(otherKey, cacheKey));
+        cache.put(otherKey, cacheKey,
+                  std::make_shared<LedgerEntry const>(other));
+        REQUIRE(cache.exists(otherKey));
+        REQUIRE(*cache.get(otherKey, cacheKey) == other);
+        REQUIRE(*cache.get(key, makeLedgerEntryCacheKey(key)) == le);
+    }
+
+    SECTION("hit and miss meters")
+    {
+        auto& hit = metrics.NewMeter(
+            {"ledger", "entry-cache", "account-hit"}, "entry");
+        auto& miss = metrics.NewMeter(
+            {"ledger", "entry-cache", "account-miss"}, "entry");
+        // get does not count, only exists does
+        REQUIRE(hit.count() == 1);
+        REQUIRE(miss.count() == 1);
+    }
+}
+
+TEST_CASE("entry cache partitions do not evict each other",
+          "[ledger][entrycache]")
+{
+    medida::MetricsRegistry metrics;
+    size_t const partitionSize = 8;
+    LedgerEntryCache cache(metrics, partitionSize);
+
+    auto account = makeEntry(ACCOUNT);
+    auto accountKey = LedgerEntryKey(account);
+    cache.put(accountKey, std::make_shared<LedgerEntry const>(account));
+
+    std::vector<LedgerKey> offerKeys;
+    for (size_t i = 0; i < partitionSize * 4; i++)
+    {
+        auto offer = makeEntry(OFFER);
+        offer.data.offer().offerID = i + 1;
+        offerKeys.emplace_back(LedgerEntryKey(offer));
+        cache.put(offerKeys.back(), std::make_shared<LedgerEntry const>(offer));
+    }
+
+    REQUIRE(cache.size(OFFER) == partitionSize);
+    REQUIRE(cache.size(ACCOUNT) == 1);
+    REQUIRE(cache.exists(accountKey));
+    REQUIRE(cache.exists(offerKeys.back()));
+    REQUIRE(!cache.exists(offerKeys.front()));
+
+    SECTION("typed erase_if only touches its partition")
+    {
+        cache.erase_if(OFFER, [](LedgerEntryCache::EntryPtr const&) {
+            return true;
+        });
+        REQUIRE(cache.size(OFFER) == 0);
+        REQUIRE(cache.exists(accountKey));
+    }
+
+    SECTION("clear empties every partition")
+    {
+        cache.clear();
+        REQUIRE(cache.size() == 0);
+    }
+}
+
+TEST_CASE("resident entry cache", "[ledger][entrycache]")
+{
+    medida::MetricsRegistry metrics;
+    size_t const partitionSize = 4;
+    LedgerEntryCache cache(metrics, partitionSize);
+
+    std::vector<LedgerEntry> accounts;
+    cache.beginResident();
+    REQUIRE(cache.isResident());
+    for (size_t i = 0; i < partitionSize * 4; i++)
+    {
+        accounts.emplace_back(makeEntry(ACCOUNT));
+        cache.put(LedgerEntryKey(accounts.back()),
+                  std::make_shared<LedgerEntry const>(accounts.back()));
+    }
+
+    // nothing is evicted
+    REQUIRE(cache.size(ACCOUNT) == accounts.size());
+    for (auto const& le : accounts)
+    {
+        REQUIRE(*cache.get(LedgerEntryKey(le)) == le);
+    }
+
+    // what is not there is absent
+    auto missing = LedgerEntryKey(makeEntry(TRUSTLINE));
+    REQUIRE(cache.exists(missing));
+    REQUIRE(cache.get(missing) == nullptr);
+
+    auto key = LedgerEntryKey(accounts.front());
+    SECTION("invalidated keys are stale until put again")
+    {
+        cache.erase_if_exists(key);
+        REQUIRE(!cache.exists(key));
+        REQUIRE_THROWS_AS(cache.get(key), std::range_error);
+        cache.put(key, nullptr);
+        REQUIRE(cache.exists(key));
+        REQUIRE(cache.get(key) == nullptr);
+        REQUIRE(cache.size(ACCOUNT) == accounts.size() - 1);
+    }
+
+    SECTION("erase_if makes keys stale")
+    {
+        cache.erase_if(ACCOUNT, [](LedgerEntryCache::EntryPtr const&) {
+            return true;
+        });
+        REQUIRE(cache.size(ACCOUNT) == 0);
+        REQUIRE(!cache.exists(key));
+        REQUIRE(cache.exists(missing));
+    }
+
+    SECTION("clear leaves resident mode")
+    {
+        cache.clear();
+        REQUIRE(!cache.isResident());
+        REQUIRE(!cache.exists(key));
+        REQUIRE(!cache.exists(missing));
+    }
+}
+
+TEST_CASE("entry cache hot keys", "[ledger][entrycache]")
+{
+    medida::MetricsRegistry metrics;
+    size_t const partitionSize = 8;
+    LedgerEntryCache cache(metrics, partitionSize);
+
+    std::vector<LedgerKey> keys;
+    for (auto t : {ACCOUNT, TRUSTLINE, OFFER})
+    {
+        auto le = makeEntry(t);
+        keys.emplace_back(LedgerEntryKey(le));
+        cache.put(keys.back(), std::make_shared<LedgerEntry const>(le));
+    }
+    // negative lookups are not worth loading
+    auto absent = LedgerEntryKey(makeEntry(ACCOUNT));
+    cache.put(absent, nullptr);
+    for (int i = 0; i < 5; i++)
+    {
+        REQUIRE(cache.exists(absent));
+        REQUIRE(cache.exists(keys[2]));
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        REQUIRE(cache.exists(keys[0]));
+    }
+
+    REQUIRE(cache.getHotKeys(2) == std::vector<LedgerKey>{keys[2], keys[0]});
+    REQUIRE(cache.getHotKeys(10) ==
+            std::vector<LedgerKey>{keys[2], keys[0], keys[1]});
+
+    // evicted entries are no longer ranked
+    for (size_t i = 0; i < partitionSize; i++)
+    {
+        auto offer = makeEntry(OFFER);
+        offer.data.offer().offerID = i + 1;
+        cache.put(LedgerEntryKey(offer),
+                  std::make_shared<LedgerEntry const>(offer));
+    }
+    auto hot = cache.getHotKeys(2);
+    REQUIRE(hot.size() == 2);
+    REQUIRE(hot[0] == keys[0]);
+}
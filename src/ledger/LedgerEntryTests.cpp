@@ -8,6 +8,7 @@
 #include "TrustFrame.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerTestUtils.h"
 #include "lib/catch.hpp"
@@ -18,7 +19,9 @@
 #include "util/Timer.h"
 #include "xdrpp/autocheck.h"
 #include "xdrpp/marshal.h"
+#include <map>
 #include <memory>
+#include <set>
 #include <unordered_map>
 #include <utility>
 
@@ -274,4 +277,215 @@ TEST_CASE("Ledger Entry tests", "[ledgerentry]")
         app->getLedgerManager().checkDbState();
     }
 }
+
+TEST_CASE("Ledger Entry batched prefetch", "[ledgerentry][prefetch]")
+{
+    Config cfg(getTestConfig(0));
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+
+    LedgerHeader lh;
+    LedgerDelta delta(lh, db, false);
+
+    // more than one batch worth of accounts, some of them with signers
+    std::vector<AccountFrame::pointer> stored;
+    std::vector<LedgerKey> trustKeys;
+    for (int i = 0; i < 100; i++)
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+        auto af = std::make_shared<AccountFrame>(le);
+        af->storeAdd(delta, db);
+        stored.emplace_back(af);
+
+        if (i % 10 == 0)
+        {
+            LedgerEntry tle;
+            tle.data.type(TRUSTLINE);
+            tle.data.trustLine() =
+                LedgerTestUtils::generateValidTrustLineEntry(5);
+            tle.data.trustLine().accountID = af->getID();
+            TrustFrame tf(tle);
+            tf.storeAdd(delta, db);
+            trustKeys.emplace_back(tf.getKey());
+        }
+    }
+
+    std::vector<AccountID> ids;
+    for (auto const& af : stored)
+    {
+        ids.emplace_back(af->getID());
+    }
+    auto missing = LedgerTestUtils::generateValidAccountEntry(5).accountID;
+    ids.emplace_back(missing);
+
+    db.getEntryCache().clear();
+    AccountFrame::prefetchAccounts(ids, db);
+    TrustFrame::prefetchTrustLines(trustKeys, db);
+
+    for (auto const& af : stored)
+    {
+        REQUIRE(EntryFrame::cachedEntryExists(af->getKey(), db));
+        auto cached = EntryFrame::getCachedEntry(af->getKey(), db);
+        REQUIRE(cached);
+        REQUIRE(cached->data.account() == af->getAccount());
+    }
+
+    LedgerKey missingKey;
+    missingKey.type(ACCOUNT);
+    missingKey.account().accountID = missing;
+    REQUIRE(EntryFrame::cachedEntryExists(missingKey, db));
+    REQUIRE(EntryFrame::getCachedEntry(missingKey, db) == nullptr);
+
+    for (auto const& k : trustKeys)
+    {
+        REQUIRE(EntryFrame::cachedEntryExists(k, db));
+        REQUIRE(EntryFrame::getCachedEntry(k, db) != nullptr);
+    }
+
+    // the cached values must match what a regular load returns
+    db.getEntryCache().clear();
+    for (auto const& af : stored)
+    {
+        auto fromDb = AccountFrame::loadAccount(af->getID(), db);
+        REQUIRE(fromDb->getAccount() == af->getAccount());
+    }
+}
+
+TEST_CASE("Ledger Entry offers loaded by seller", "[ledgerentry]")
+{
+    Config cfg(getTestConfig(0));
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+
+    LedgerHeader lh;
+    LedgerDelta delta(lh, db, false);
+
+    std::vector<AccountID> sellers;
+    for (int i = 0; i < 3; i++)
+    {
+        sellers.emplace_back(
+            LedgerTestUtils::generateValidAccountEntry(5).accountID);
+    }
+    // the offers of a seller spread over several batches
+    std::map<AccountID, std::set<uint64_t>> expected;
+    for (uint64_t offerID = 1; offerID <= 40; offerID++)
+    {
+        LedgerEntry le;
+        le.data.type(OFFER);
+        le.data.offer() = LedgerTestUtils::generateValidOfferEntry(5);
+        le.data.offer().offerID = offerID;
+        le.data.offer().sellerID = sellers[(offerID * offerID) % 3];
+        OfferFrame(le).storeAdd(delta, db);
+        expected[le.data.offer().sellerID].insert(offerID);
+    }
+
+    for (size_t batchSize : {1, 3, 7, 40, 1000})
+    {
+        SECTION("batches of " + std::to_string(batchSize))
+        {
+            std::map<AccountID, std::set<uint64_t>> loaded;
+            OfferFrame::loadOffersBySeller(
+                batchSize,
+                [&](AccountID const& seller,
+                    std::vector<OfferFrame::pointer> const& offers) {
+                    REQUIRE(loaded.find(seller) == loaded.end());
+                    uint64_t previous = 0;
+                    for (auto const& of : offers)
+                    {
+                        REQUIRE(of->getSellerID() == seller);
+                        REQUIRE(of->getOfferID() > previous);
+                        previous = of->getOfferID();
+                        loaded[seller].insert(of->getOfferID());
+                        // changing the offers given does not disturb the
+                        // ones to come
+                        of->storeDelete(delta, db);
+                    }
+                },
+                db);
+            REQUIRE(loaded == expected);
+            REQUIRE(OfferFrame::loadAllOffers(db).empty());
+        }
+    }
+}
+
+TEST_CASE("Ledger Entry accounts stored as XDR", "[ledgerentry]")
+{
+    Config cfg(getTestConfig(0));
+    cfg.ACCOUNT_ENTRY_XDR = true;
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+
+    LedgerHeader lh;
+    LedgerDelta delta(lh, db, false);
+
+    std::vector<AccountFrame::pointer> stored;
+    std::vector<AccountID> ids;
+    for (int i = 0; i < 100; i++)
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+        auto af = std::make_shared<AccountFrame>(le);
+        af->storeAdd(delta, db);
+        stored.emplace_back(af);
+        ids.emplace_back(af->getID());
+    }
+    int withXDR = 0;
+    db.getSession() << "SELECT COUNT(*) FROM accounts "
+                       "WHERE ledgerentry IS NOT NULL",
+        soci::into(withXDR);
+    REQUIRE(withXDR == 100);
+
+    // rows written without ACCOUNT_ENTRY_XDR are read from their columns
+    db.getSession() << "UPDATE accounts SET ledgerentry = NULL "
+                       "WHERE accountid IN (SELECT accountid FROM accounts "
+                       "ORDER BY accountid LIMIT 30)";
+
+    auto checkLoads = [&]() {
+        db.getEntryCache().clear();
+        for (auto const& af : stored)
+        {
+            auto fromDb = AccountFrame::loadAccount(af->getID(), db);
+            REQUIRE(fromDb);
+            REQUIRE(fromDb->getAccount() == af->getAccount());
+            REQUIRE(fromDb->getLastModified() == af->getLastModified());
+        }
+        db.getEntryCache().clear();
+        AccountFrame::prefetchAccounts(ids, db);
+        for (auto const& af : stored)
+        {
+            auto cached = EntryFrame::getCachedEntry(af->getKey(), db);
+            REQUIRE(cached);
+            REQUIRE(cached->data.account() == af->getAccount());
+        }
+    };
+    checkLoads();
+
+    SECTION("batched balance updates")
+    {
+        for (auto& af : stored)
+        {
+            af->getAccount().balance += 10;
+            af->getAccount().seqNum++;
+            af->getLastModified()++;
+        }
+        AccountFrame::storeBalancesBatch(db, stored);
+        db.getSession() << "SELECT COUNT(*) FROM accounts "
+                           "WHERE ledgerentry IS NOT NULL",
+            soci::into(withXDR);
+        REQUIRE(withXDR == 100);
+        checkLoads();
+    }
+}
 }
@@ -0,0 +1,78 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerHeaderCache.h"
+
+namespace stellar
+{
+
+LedgerHeaderCache::LedgerHeaderCache(size_t capacity) : mCapacity(capacity)
+{
+}
+
+void
+LedgerHeaderCache::add(LedgerHeaderHistoryEntry const& header)
+{
+    if (mCapacity == 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mHeaders.empty() &&
+        mHeaders.back().header.ledgerSeq + 1 != header.header.ledgerSeq)
+    {
+        mHeaders.clear();
+    }
+    mHeaders.emplace_back(header);
+    if (mHeaders.size() > mCapacity)
+    {
+        mHeaders.pop_front();
+    }
+}
+
+bool
+LedgerHeaderCache::getBySequence(uint32_t seq,
+                                 LedgerHeaderHistoryEntry& header) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mHeaders.empty() || seq < mHeaders.front().header.ledgerSeq ||
+        seq > mHeaders.back().header.ledgerSeq)
+    {
+        return false;
+    }
+    header = mHeaders[seq - mHeaders.front().header.ledgerSeq];
+    return true;
+}
+
+bool
+LedgerHeaderCache::getByHash(Hash const& hash,
+                             LedgerHeaderHistoryEntry& header) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    // most lookups are for the latest ledgers
+    for (auto it = mHeaders.rbegin(); it != mHeaders.rend(); ++it)
+    {
+        if (it->hash == hash)
+        {
+            header = *it;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+LedgerHeaderCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHeaders.clear();
+}
+
+size_t
+LedgerHeaderCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHeaders.size();
+}
+}
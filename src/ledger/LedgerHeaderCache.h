@@ -0,0 +1,46 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <deque>
+#include <mutex>
+
+namespace stellar
+{
+
+/**
+ * The last closed ledger headers (LEDGER_HEADER_CACHE_SIZE of them), added by
+ * LedgerManagerImpl::ledgerClosed once stored, so that the lookups of
+ * LedgerHeaderFrame::loadBySequence and loadByHash for recent ledgers do not
+ * query the ledgerheaders table.
+ *
+ * The headers are kept as a run of consecutive ledgers: adding one that does
+ * not follow the last (after catchup or a new LCL) starts the run again.
+ * Usable from any thread.
+ */
+class LedgerHeaderCache : NonMovableOrCopyable
+{
+    size_t const mCapacity;
+    mutable std::mutex mMutex;
+    std::deque<LedgerHeaderHistoryEntry> mHeaders;
+
+  public:
+    explicit LedgerHeaderCache(size_t capacity);
+
+    // Adds the header of a ledger just closed, evicting the oldest.
+    void add(LedgerHeaderHistoryEntry const& header);
+
+    // Look up a kept header, returning false if it is not kept.
+    bool getBySequence(uint32_t seq, LedgerHeaderHistoryEntry& header) const;
+    bool getByHash(Hash const& hash, LedgerHeaderHistoryEntry& header) const;
+
+    void clear();
+
+    size_t size() const;
+};
+}
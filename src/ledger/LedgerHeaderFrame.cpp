@@ -9,6 +9,7 @@
 #include "crypto/SHA.h"
 #include "database/Database.h"
 #include "database/DatabaseUtils.h"
+#include "ledger/LedgerHeaderCache.h"
 #include "util/Decoder.h"
 #include "util/Logging.h"
 #include "util/XDRStream.h"
@@ -149,9 +150,23 @@ LedgerHeaderFrame::decodeFromData(std::string const& data)
     return make_shared<LedgerHeaderFrame>(lh);
 }
 
+LedgerHeaderFrame::pointer
+LedgerHeaderFrame::fromCached(LedgerHeaderHistoryEntry const& entry)
+{
+    auto lhf = make_shared<LedgerHeaderFrame>(entry.header);
+    lhf->mHash = entry.hash;
+    return lhf;
+}
+
 LedgerHeaderFrame::pointer
 LedgerHeaderFrame::loadByHash(Hash const& hash, Database& db)
 {
+    LedgerHeaderHistoryEntry cached;
+    if (db.getLedgerHeaderCache().getByHash(hash, cached))
+    {
+        return fromCached(cached);
+    }
+
     LedgerHeaderFrame::pointer lhf;
 
     string hash_s(binToHex(hash));
@@ -184,6 +199,12 @@ LedgerHeaderFrame::pointer
 LedgerHeaderFrame::loadBySequence(uint32_t seq, Database& db,
                                   soci::session& sess)
 {
+    LedgerHeaderHistoryEntry cached;
+    if (db.getLedgerHeaderCache().getBySequence(seq, cached))
+    {
+        return fromCached(cached);
+    }
+
     LedgerHeaderFrame::pointer lhf;
 
     string headerEncoded;
@@ -246,17 +267,18 @@ LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
     return n;
 }
 
-void
-LedgerHeaderFrame::deleteOldEntries(Database& db, uint32_t ledgerSeq,
+bool
+LedgerHeaderFrame::deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
                                     uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "ledgerheaders", "ledgerseq");
+    return DatabaseUtils::deleteOldEntriesHelper(sess, ledgerSeq, count,
+                                                 "ledgerheaders", "ledgerseq");
 }
 
 void
 LedgerHeaderFrame::dropAll(Database& db)
 {
+    db.getLedgerHeaderCache().clear();
     db.getSession() << "DROP TABLE IF EXISTS ledgerheaders;";
 
     db.getSession() << "CREATE TABLE ledgerheaders ("
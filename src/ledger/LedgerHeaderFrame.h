@@ -45,6 +45,7 @@ class LedgerHeaderFrame
 
     void storeInsert(LedgerManager& ledgerManager) const;
 
+    // recent headers are served from the LedgerHeaderCache of `db`
     static LedgerHeaderFrame::pointer loadByHash(Hash const& hash,
                                                  Database& db);
     static LedgerHeaderFrame::pointer loadBySequence(uint32_t seq, Database& db,
@@ -55,7 +56,7 @@ class LedgerHeaderFrame
                                             uint32_t ledgerCount,
                                             XDROutputFileStream& headersOut);
 
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
+    static bool deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
                                  uint32_t count);
 
     static void dropAll(Database& db);
@@ -63,6 +64,8 @@ class LedgerHeaderFrame
   private:
     static bool isValid(LedgerHeader const& lh);
     static LedgerHeaderFrame::pointer decodeFromData(std::string const& data);
+    static LedgerHeaderFrame::pointer
+    fromCached(LedgerHeaderHistoryEntry const& entry);
 
     static const char* kSQLCreateStatement;
 };
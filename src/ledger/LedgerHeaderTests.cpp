@@ -4,7 +4,10 @@
 
 #include "util/asio.h"
 #include "crypto/Hex.h"
+#include "database/Database.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/LedgerHeaderCache.h"
+#include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
@@ -12,6 +15,7 @@
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 
 #include "main/Config.h"
@@ -112,3 +116,62 @@ TEST_CASE("base reserve", "[ledger]")
         REQUIRE(app->getLedgerManager().getMinBalance(n) == expectedReserve);
     });
 }
+
+TEST_CASE("ledger header cache", "[ledger]")
+{
+    auto cfg = getTestConfig(0);
+    cfg.LEDGER_HEADER_CACHE_SIZE = 4;
+
+    VirtualClock clock;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& lm = app->getLedgerManager();
+    auto& db = app->getDatabase();
+    auto& cache = db.getLedgerHeaderCache();
+
+    std::vector<LedgerHeaderHistoryEntry> closed;
+    for (int i = 0; i < 6; i++)
+    {
+        auto const& lcl = lm.getLastClosedLedgerHeader();
+        auto txSet = make_shared<TxSetFrame>(lcl.hash);
+        StellarValue sv(txSet->getContentsHash(), 1, emptyUpgradeSteps, 0);
+        lm.closeLedger(LedgerCloseData(lcl.header.ledgerSeq + 1, txSet, sv));
+        closed.emplace_back(lm.getLastClosedLedgerHeader());
+    }
+    REQUIRE(cache.size() == 4);
+
+    LedgerHeaderHistoryEntry found;
+    REQUIRE(!cache.getBySequence(closed[1].header.ledgerSeq, found));
+    REQUIRE(!cache.getByHash(closed[1].hash, found));
+    for (size_t i = 2; i < closed.size(); i++)
+    {
+        REQUIRE(cache.getBySequence(closed[i].header.ledgerSeq, found));
+        REQUIRE(found.hash == closed[i].hash);
+        REQUIRE(cache.getByHash(closed[i].hash, found));
+        REQUIRE(found.header == closed[i].header);
+    }
+
+    SECTION("recent headers are loaded without the database")
+    {
+        db.getSession() << "DELETE FROM ledgerheaders";
+        auto lhf = LedgerHeaderFrame::loadBySequence(
+            closed.back().header.ledgerSeq, db, db.getSession());
+        REQUIRE(lhf);
+        REQUIRE(lhf->getHash() == closed.back().hash);
+        lhf = LedgerHeaderFrame::loadByHash(closed[2].hash, db);
+        REQUIRE(lhf);
+        REQUIRE(lhf->mHeader == closed[2].header);
+        REQUIRE(!LedgerHeaderFrame::loadBySequence(
+            closed[1].header.ledgerSeq, db, db.getSession()));
+    }
+
+    SECTION("a header that does not follow starts again")
+    {
+        auto next = closed.back();
+        next.header.ledgerSeq += 2;
+        cache.add(next);
+        REQUIRE(cache.size() == 1);
+        REQUIRE(!cache.getBySequence(closed.back().header.ledgerSeq, found));
+    }
+}
@@ -8,11 +8,20 @@
 #include "history/HistoryManager.h"
 #include <memory>
 
+namespace soci
+{
+class session;
+}
+
 namespace stellar
 {
 
+class ApplyProfiler;
+class LedgerCloseTracer;
 class LedgerHeaderFrame;
 class LedgerCloseData;
+class LedgerStateSnapshot;
+class TxSetFrame;
 class Database;
 
 /**
@@ -110,6 +119,12 @@ class LedgerManager
     virtual LedgerHeaderHistoryEntry const&
     getLastClosedLedgerHeader() const = 0;
 
+    // Return the state of the LCL, which any thread can read (and keep) while
+    // the next ledgers close; null until the bucket list has the state of
+    // the LCL (while booting or catching up).
+    virtual std::shared_ptr<LedgerStateSnapshot const>
+    getLastClosedSnapshot() const = 0;
+
     // Return the sequence number of the current ledger.
     virtual uint32_t getLedgerNum() const = 0;
 
@@ -145,9 +160,21 @@ class LedgerManager
 
     virtual Database& getDatabase() = 0;
 
+    // Breakdown of the time spent applying transactions, by operation type
+    // and by result.
+    virtual ApplyProfiler& getApplyProfiler() = 0;
+
+    // Breakdown of each of the last ledger closes by phase.
+    virtual LedgerCloseTracer& getCloseTracer() = 0;
+
     // Called by application lifecycle events, system startup.
     virtual void startNewLedger() = 0;
 
+    // Make @p lastClosed the LCL, once the database holds its state (that is,
+    // once its buckets were applied).
+    virtual void
+    setLastClosedLedger(LedgerHeaderHistoryEntry const& lastClosed) = 0;
+
     // loads the last ledger information from the database
     // if handler is set, also loads bucket information and invokes handler.
     virtual void loadLastKnownLedger(
@@ -189,9 +216,29 @@ class LedgerManager
     // permit testing.
     virtual void closeLedger(LedgerCloseData const& ledgerData) = 0;
 
-    // deletes old entries stored in the database
-    virtual void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                  uint32_t count) = 0;
+    // Close the current ledger without transactions, adding `entries` to the
+    // ledger state (database and buckets); the balances of the accounts
+    // among them are taken from the root account. This is a shortcut to a
+    // large ledger state for benchmarks, which transactions would take many
+    // ledgers to build.
+    virtual void
+    closeLedgerWithEntries(std::vector<LedgerEntry> const& entries) = 0;
+
+    // Whether the ledgers closed are replayed from history outside of
+    // catchup (see replayLedgers): with CATCHUP_REPLAY_ONLY, they then skip
+    // storing their transactions, as during catchup.
+    virtual void setReplayingHistory(bool replaying) = 0;
+
+    // Called while `txSet` is likely to be the next one applied, before its
+    // ledger is externalized: loads in the caches what closing it needs.
+    // Closing another set instead is correct, only not faster.
+    virtual void prepareLedgerClose(TxSetFrame const& txSet) = 0;
+
+    // deletes, using `sess`, the history stored in the database of the
+    // `count` oldest ledgers of each table, not after `ledgerSeq`; returns
+    // true if nothing up to `ledgerSeq` is left
+    static bool deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                                 uint32_t count);
 
     // checks the database for inconsistencies between objects
     virtual void checkDbState() = 0;
@@ -6,11 +6,15 @@
 #include "DataFrame.h"
 #include "OfferFrame.h"
 #include "TrustFrame.h"
+#include "bucket/BucketInputIterator.h"
+#include "bucket/BucketList.h"
 #include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
+#include "crypto/XDRHasher.h"
+#include "database/BatchInserter.h"
 #include "database/Database.h"
 #include "herder/Herder.h"
 #include "herder/HerderPersistence.h"
@@ -20,13 +24,23 @@
 #include "history/HistoryManager.h"
 #include "invariant/InvariantDoesNotHold.h"
 #include "invariant/InvariantManager.h"
+#include "ledger/AccountFrame.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerHeaderFrame.h"
+#include "ledger/LedgerStateSnapshot.h"
+#include "ledger/OrderBook.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
+#include "simulation/LoadGenerator.h"
+#include "util/Allocator.h"
+#include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/SamplingProfiler.h"
+#include "util/Tracing.h"
 #include "util/XDROperators.h"
+#include "util/XDRStream.h"
 #include "util/format.h"
 
 #include "medida/counter.h"
@@ -36,8 +50,12 @@
 #include "xdrpp/printer.h"
 #include "xdrpp/types.h"
 
+#include <algorithm>
 #include <chrono>
+#include <map>
 #include <sstream>
+#include <thread>
+#include <unordered_set>
 
 /*
 The ledger module:
@@ -111,9 +129,22 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     : mApp(app)
     , mTransactionApply(
           app.getMetrics().NewTimer({"ledger", "transaction", "apply"}))
+    , mTransactionPrefetch(
+          app.getMetrics().NewTimer({"ledger", "transaction", "prefetch"}))
+    , mTransactionSignatureWait(app.getMetrics().NewTimer(
+          {"ledger", "transaction", "signature-wait"}))
+    , mLedgerClosePrepared(app.getMetrics().NewMeter(
+          {"ledger", "ledger", "close-prepared"}, "ledger"))
     , mTransactionCount(
           app.getMetrics().NewHistogram({"ledger", "transaction", "count"}))
     , mLedgerClose(app.getMetrics().NewTimer({"ledger", "ledger", "close"}))
+    , mLedgerCloseFees(app.getMetrics().NewTimer({"ledger", "close", "fees"}))
+    , mLedgerCloseApply(
+          app.getMetrics().NewTimer({"ledger", "close", "apply"}))
+    , mLedgerCloseCommit(
+          app.getMetrics().NewTimer({"ledger", "close", "commit"}))
+    , mLedgerCloseHistory(
+          app.getMetrics().NewTimer({"ledger", "close", "history"}))
     , mLedgerAgeClosed(app.getMetrics().NewTimer({"ledger", "age", "closed"}))
     , mLedgerAge(
           app.getMetrics().NewCounter({"ledger", "age", "current-seconds"}))
@@ -125,6 +156,8 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     , mLastStateChange(mApp.getClock().now())
     , mSyncingLedgersSize(
           app.getMetrics().NewCounter({"ledger", "memory", "syncing-ledgers"}))
+    , mApplyProfiler(app)
+    , mCloseTracer(app)
     , mState(LM_BOOTING_STATE)
 
 {
@@ -216,7 +249,7 @@ LedgerManagerImpl::startNewLedger(LedgerHeader genesisLedger)
     mCurrentLedger = make_shared<LedgerHeaderFrame>(genesisLedger);
     CLOG(INFO, "Ledger") << "Established genesis ledger, closing";
     CLOG(INFO, "Ledger") << "Root account seed: " << skey.getStrKeySeed().value;
-    ledgerClosed(delta);
+    ledgerClosed(startBucketBatch(delta));
 }
 
 void
@@ -235,6 +268,19 @@ LedgerManagerImpl::startNewLedger()
     startNewLedger(std::move(ledger));
 }
 
+void
+LedgerManagerImpl::setLastClosedLedger(
+    LedgerHeaderHistoryEntry const& lastClosed)
+{
+    getDatabase().ensureHistoryPartitions(lastClosed.header.ledgerSeq);
+    mCurrentLedger = make_shared<LedgerHeaderFrame>(lastClosed.header);
+    storeCurrentLedger();
+
+    mLastClosedLedger = lastClosed;
+    mCurrentLedger = make_shared<LedgerHeaderFrame>(lastClosed);
+    publishLastClosedSnapshot();
+}
+
 void
 LedgerManagerImpl::loadLastKnownLedger(
     function<void(asio::error_code const& ec)> handler)
@@ -261,12 +307,36 @@ LedgerManagerImpl::loadLastKnownLedger(
             throw std::runtime_error("Could not load ledger from database");
         }
 
+        // the bucket files are checked on worker threads while the order
+        // book is rebuilt from the database
+        HistoryArchiveState has;
+        std::future<std::vector<std::string>> corrupt;
+        if (handler)
+        {
+            has.fromString(mApp.getPersistentState().getState(
+                PersistentState::kHistoryArchiveState));
+            if (mApp.getConfig().STARTUP_VERIFY_BUCKETS)
+            {
+                corrupt = mApp.getBucketManager().verifyBucketFiles(has);
+            }
+        }
+
+        auto orderBook = getDatabase().getOrderBook();
+        if (orderBook && !orderBook->keepsPrefixesOnly())
+        {
+            orderBook->rebuild();
+        }
+
         if (handler)
         {
-            string hasString = mApp.getPersistentState().getState(
-                PersistentState::kHistoryArchiveState);
-            HistoryArchiveState has;
-            has.fromString(hasString);
+            if (corrupt.valid())
+            {
+                for (auto const& h : corrupt.get())
+                {
+                    CLOG(WARNING, "Ledger")
+                        << "Bucket " << h << " is corrupt and was removed";
+                }
+            }
 
             auto continuation = [this, handler,
                                  has](asio::error_code const& ec) {
@@ -277,11 +347,21 @@ LedgerManagerImpl::loadLastKnownLedger(
                 else
                 {
                     mApp.getBucketManager().assumeState(has);
+                    if (mApp.getConfig().IN_MEMORY_LEDGER_STATE)
+                    {
+                        loadResidentLedgerState();
+                    }
 
                     CLOG(INFO, "Ledger") << "Loaded last known ledger: "
                                          << ledgerAbbrev(mCurrentLedger);
 
                     advanceLedgerPointers();
+                    // before the herder and the overlay start
+                    if (mApp.getConfig().ENTRY_CACHE_WARM_KEYS != 0 &&
+                        !getDatabase().getEntryCache().isResident())
+                    {
+                        warmEntryCache();
+                    }
                     handler(ec);
                 }
             };
@@ -313,12 +393,123 @@ LedgerManagerImpl::loadLastKnownLedger(
     }
 }
 
+std::string
+LedgerManagerImpl::hotKeysFilename()
+{
+    return mApp.getBucketManager().getBucketDir() + "/hot-keys.xdr";
+}
+
+void
+LedgerManagerImpl::warmEntryCache()
+{
+    auto& db = getDatabase();
+    auto count = mApp.getConfig().ENTRY_CACHE_WARM_KEYS;
+    std::vector<AccountID> accounts;
+    std::vector<LedgerKey> trustLines;
+    std::vector<LedgerKey> others;
+    auto filename = hotKeysFilename();
+    if (fs::exists(filename))
+    {
+        try
+        {
+            XDRInputFileStream in;
+            in.open(filename);
+            LedgerKey key;
+            while (accounts.size() + trustLines.size() + others.size() <
+                       count &&
+                   in.readOne(key))
+            {
+                switch (key.type())
+                {
+                case ACCOUNT:
+                    accounts.emplace_back(key.account().accountID);
+                    break;
+                case TRUSTLINE:
+                    trustLines.emplace_back(key);
+                    break;
+                default:
+                    others.emplace_back(key);
+                    break;
+                }
+            }
+        }
+        catch (std::exception& e)
+        {
+            CLOG(WARNING, "Ledger")
+                << "Failed reading " << filename << ": " << e.what();
+        }
+    }
+    else
+    {
+        accounts = AccountFrame::loadRecentlyModified(db, count);
+    }
+
+    AccountFrame::prefetchAccounts(accounts, db);
+    TrustFrame::prefetchTrustLines(trustLines, db);
+    // offers and data entries have no batched load
+    for (auto const& key : others)
+    {
+        if (key.type() == OFFER)
+        {
+            OfferFrame::loadOffer(key.offer().sellerID, key.offer().offerID,
+                                  db);
+        }
+        else if (key.type() == DATA)
+        {
+            DataFrame::loadData(key.data().accountID, key.data().dataName,
+                                db);
+        }
+    }
+    CLOG(INFO, "Ledger") << "Loaded "
+                         << accounts.size() + trustLines.size() + others.size()
+                         << " entries in the entry cache";
+}
+
+void
+LedgerManagerImpl::saveHotKeys()
+{
+    auto keys = getDatabase().getEntryCache().getHotKeys(
+        mApp.getConfig().ENTRY_CACHE_WARM_KEYS);
+    if (keys.empty())
+    {
+        return;
+    }
+    // replaced at once, so that an interrupted write leaves the previous one
+    auto filename = hotKeysFilename();
+    auto tmp = filename + ".tmp";
+    {
+        XDROutputFileStream out;
+        out.open(tmp);
+        for (auto const& k : keys)
+        {
+            out.writeOne(k);
+        }
+    }
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        CLOG(WARNING, "Ledger") << "Failed to save " << filename;
+        std::remove(tmp.c_str());
+    }
+}
+
 Database&
 LedgerManagerImpl::getDatabase()
 {
     return mApp.getDatabase();
 }
 
+ApplyProfiler&
+LedgerManagerImpl::getApplyProfiler()
+{
+    return mApplyProfiler;
+}
+
+LedgerCloseTracer&
+LedgerManagerImpl::getCloseTracer()
+{
+    return mCloseTracer;
+}
+
 uint32_t
 LedgerManagerImpl::getTxFee() const
 {
@@ -377,6 +568,12 @@ LedgerManagerImpl::getLastClosedLedgerHeader() const
     return mLastClosedLedger;
 }
 
+std::shared_ptr<LedgerStateSnapshot const>
+LedgerManagerImpl::getLastClosedSnapshot() const
+{
+    return std::atomic_load(&mLastClosedSnapshot);
+}
+
 uint32_t
 LedgerManagerImpl::getLastClosedLedgerNum() const
 {
@@ -502,6 +699,22 @@ LedgerManagerImpl::initializeCatchup(LedgerCloseData const& ledgerData)
                                 ledgerData.getLedgerSeq()) +
                             1;
     setCatchupState(CatchupState::WAITING_FOR_TRIGGER_LEDGER);
+    mMissedLedgers.clear();
+
+    // past CATCHUP_BUFFER_MEMORY_MB, ledgers buffered are spilled to disk
+    auto maxBytes =
+        static_cast<size_t>(mApp.getConfig().CATCHUP_BUFFER_MEMORY_MB) *
+        1024 * 1024;
+    if (maxBytes != 0 && !mSyncingLedgersDir)
+    {
+        mSyncingLedgersDir = std::make_unique<TmpDir>(
+            mApp.getTmpDirManager().tmpDir("syncing"));
+    }
+    mSyncingLedgers.setSpill(
+        maxBytes,
+        mSyncingLedgersDir ? mSyncingLedgersDir->getName() + "/ledgers.xdr"
+                           : "",
+        mApp.getNetworkID());
     addToSyncingLedgers(ledgerData);
     startCatchupIf(ledgerData.getLedgerSeq());
 }
@@ -511,8 +724,57 @@ LedgerManagerImpl::continueCatchup(LedgerCloseData const& ledgerData)
 {
     assert(mState == LM_CATCHING_UP_STATE);
 
+    auto seq = ledgerData.getLedgerSeq();
+    if (mCatchupState == CatchupState::WAITING_FOR_TRIGGER_LEDGER &&
+        !mSyncingLedgers.empty() &&
+        seq < mSyncingLedgers.front().getLedgerSeq())
+    {
+        // a ledger the network closed before the buffered ones, the herder
+        // got it from peers (see HerderImpl::missedValueExternalized)
+        if (seq > getLastClosedLedgerNum())
+        {
+            mMissedLedgers.emplace(seq, ledgerData);
+            closeMissedLedgersIf();
+        }
+        return;
+    }
+
     addToSyncingLedgers(ledgerData);
-    startCatchupIf(ledgerData.getLedgerSeq());
+    startCatchupIf(seq);
+}
+
+void
+LedgerManagerImpl::closeMissedLedgersIf()
+{
+    auto first = getLastClosedLedgerNum() + 1;
+    auto last = mSyncingLedgers.front().getLedgerSeq();
+    for (auto seq = first; seq < last; seq++)
+    {
+        if (mMissedLedgers.find(seq) == mMissedLedgers.end())
+        {
+            return;
+        }
+    }
+
+    CLOG(INFO, "Ledger") << "Closing ledgers " << first << " to "
+                         << mSyncingLedgers.back().getLedgerSeq()
+                         << " externalized by peers, skipping catchup";
+    for (auto const& kv : mMissedLedgers)
+    {
+        closeLedgerIf(kv.second);
+    }
+    mSyncingLedgers.forEach(
+        [this](LedgerCloseData const& lcd) { closeLedgerIf(lcd); });
+    mMissedLedgers.clear();
+    mSyncingLedgers.clear();
+    mSyncingLedgersSize.set_count(mSyncingLedgers.size());
+
+    // as after a catchup from history, the next ledger closed brings the
+    // node back in sync
+    CLOG(INFO, "Ledger") << "Caught up to LCL from peers: "
+                         << ledgerAbbrev(mLastClosedLedger)
+                         << "; waiting for closing ledger";
+    setCatchupState(CatchupState::WAITING_FOR_CLOSING_LEDGER);
 }
 
 void
@@ -690,11 +952,7 @@ LedgerManagerImpl::historyCaughtup(asio::error_code const& ec,
         {
         case CatchupWork::ProgressState::APPLIED_BUCKETS:
         {
-            mCurrentLedger = make_shared<LedgerHeaderFrame>(lastClosed.header);
-            storeCurrentLedger();
-
-            mLastClosedLedger = lastClosed;
-            mCurrentLedger = make_shared<LedgerHeaderFrame>(lastClosed);
+            setLastClosedLedger(lastClosed);
             return;
         }
         case CatchupWork::ProgressState::APPLIED_TRANSACTIONS:
@@ -721,8 +979,7 @@ LedgerManagerImpl::historyCaughtup(asio::error_code const& ec,
         mApp.getCatchupManager().historyCaughtup();
 
         // Now replay remaining txs from buffered local network history.
-        for (auto const& lcd : mSyncingLedgers)
-        {
+        mSyncingLedgers.forEach([this](LedgerCloseData const& lcd) {
             assert(lcd.getLedgerSeq() ==
                    mLastClosedLedger.header.ledgerSeq + 1);
             CLOG(INFO, "Ledger")
@@ -732,7 +989,7 @@ LedgerManagerImpl::historyCaughtup(asio::error_code const& ec,
                 << ", tx_count=" << lcd.getTxSet()->size()
                 << ", sv: " << stellarValueToString(lcd.getValue()) << "]";
             closeLedger(lcd);
-        }
+        });
 
         CLOG(INFO, "Ledger")
             << "Caught up to LCL including recent network activity: "
@@ -742,8 +999,11 @@ LedgerManagerImpl::historyCaughtup(asio::error_code const& ec,
     }
 
     // Either way, we're done processing the ledgers backlog
-    mSyncingLedgers = {};
+    mSyncingLedgers.clear();
     mSyncingLedgersSize.set_count(mSyncingLedgers.size());
+
+    // the heap grew for the downloads and applies of the catchup
+    allocator::purge();
 }
 
 uint64_t
@@ -779,6 +1039,8 @@ during replays.
 void
 LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
 {
+    TRACE_ZONE("LedgerManagerImpl::closeLedger");
+    PROFILE_PHASE("ledger-close");
     DBTimeExcluder qtExclude(mApp);
     CLOG(DEBUG, "Ledger") << "starting closeLedger() on ledgerSeq="
                           << mCurrentLedger->mHeader.ledgerSeq;
@@ -788,6 +1050,10 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     mLastClose = now;
     mLedgerAge.set_count(0);
 
+    // failures of the invariants checked while the previous ledgers were
+    // applied
+    mApp.getInvariantManager().reportBackgroundFailures();
+
     // If we do not support ledger version, we can't apply that ledger, fail!
     if (mCurrentLedger->mHeader.ledgerVersion >
         Config::CURRENT_LEDGER_PROTOCOL_VERSION)
@@ -820,35 +1086,100 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
         throw std::runtime_error("corrupt transaction set");
     }
 
+    getDatabase().ensureHistoryPartitions(ledgerData.getLedgerSeq());
+    // with DATABASE_DURABILITY=RELAXED, only the ledgers ending a checkpoint
+    // (the ones maybeQueueHistoryCheckpoint queues) wait for the disk
+    auto nextLedger = ledgerData.getLedgerSeq() + 1;
+    getDatabase().setRelaxedCommits(
+        mApp.getHistoryManager().nextCheckpointLedger(nextLedger) !=
+        nextLedger);
     soci::transaction txscope(getDatabase().getSession());
 
     auto ledgerTime = mLedgerClose.TimeScope();
+    mApplyProfiler.startLedger(ledgerData.getLedgerSeq());
+    if (!mMetaStream && !mApp.getConfig().METADATA_OUTPUT_STREAM.empty())
+    {
+        mMetaStream = std::make_unique<LedgerCloseMetaStream>(
+            mApp.getConfig().METADATA_OUTPUT_STREAM);
+    }
+    if (mMetaStream)
+    {
+        mMetaStream->startLedger();
+    }
+    mCloseTracer.startLedger(ledgerData.getLedgerSeq());
 
     auto const& sv = ledgerData.getValue();
     mCurrentLedger->mHeader.scpValue = sv;
 
-    LedgerDelta ledgerDelta(mCurrentLedger->mHeader, getDatabase());
+    // the previous values of the entries are only needed for full metadata
+    // and by invariants
+    auto const& cfg = mApp.getConfig();
+    bool keepPrevious = cfg.TRANSACTION_META == Config::TX_META_FULL ||
+                        !cfg.INVARIANT_CHECKS.empty();
+    LedgerDelta ledgerDelta(mCurrentLedger->mHeader, getDatabase(), true,
+                            keepPrevious);
 
     // the transaction set that was agreed upon by consensus
     // was sorted by hash; we reorder it so that transactions are
     // sorted such that sequence numbers are respected
     vector<TransactionFramePtr> txs = ledgerData.getTxSet()->sortForApply();
+    if (cfg.ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING)
+    {
+        // the end of the latency of the transactions it submitted
+        mApp.getLoadGenerator().recordExternalized(ledgerData.getLedgerSeq(),
+                                                   txs);
+    }
+
+    // checking signatures does not depend on the ledger state, it is done
+    // in parallel with the database work of the next two steps
+    auto signatureChecks = startSignatureChecks(txs);
+
+    // warm the entry cache with everything the transactions are going to
+    // load, so that apply does not pay one database round trip per entry
+    {
+        auto span = mCloseTracer.span("prefetch");
+        prefetchTransactionData(txs);
+    }
+
+    // the transaction history is only read back once the ledger is
+    // committed: it is buffered and written at once, at the end
+    auto txHistory = TransactionFrame::makeTxHistoryInserter(getDatabase());
+    auto txFeeHistory =
+        TransactionFrame::makeTxFeeHistoryInserter(getDatabase());
 
     // first, charge fees
-    processFeesSeqNums(txs, ledgerDelta);
+    {
+        auto feesTime = mLedgerCloseFees.TimeScope();
+        auto span = mCloseTracer.span("fees");
+        processFeesSeqNums(txs, ledgerDelta, txFeeHistory);
+    }
+
+    {
+        auto waitTime = mTransactionSignatureWait.TimeScope();
+        auto span = mCloseTracer.span("signatures");
+        for (auto& check : signatureChecks)
+        {
+            check.get();
+        }
+    }
 
     TransactionResultSet txResultSet;
     txResultSet.results.reserve(txs.size());
 
-    applyTransactions(txs, ledgerDelta, txResultSet);
+    {
+        auto applyTime = mLedgerCloseApply.TimeScope();
+        auto span = mCloseTracer.span("apply");
+        applyTransactions(txs, ledgerDelta, txResultSet, txHistory);
+    }
 
     ledgerDelta.getHeader().txSetResultHash =
-        sha256(xdr::xdr_to_opaque(txResultSet));
+        xdrSha256(txResultSet);
 
     // apply any upgrades that were decided during consensus
     // this must be done after applying transactions as the txset
     // was validated before upgrades
     LedgerHeader headerBeforeUpgrades = getCurrentLedgerHeader();
+    auto upgradesSpan = mCloseTracer.span("upgrades");
     for (size_t i = 0; i < sv.upgrades.size(); i++)
     {
         LedgerUpgrade lupgrade;
@@ -890,9 +1221,61 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     // It is required to rollback the current LedgerHeader in order to satisfy
     // the consistency checks enforced by LedgerDelta::commit.
     getCurrentLedgerHeader() = headerBeforeUpgrades;
+    upgradesSpan.finish();
 
-    ledgerDelta.commit();
-    ledgerClosed(ledgerDelta);
+    // pending transactions of the other accounts stay valid on top of this
+    // ledger, the herder only checks the ones of these accounts again
+    std::unordered_set<AccountID> touched;
+    auto touch = [&touched](LedgerKey const& k, LedgerEntry const*) {
+        switch (k.type())
+        {
+        case ACCOUNT:
+            touched.insert(k.account().accountID);
+            break;
+        case TRUSTLINE:
+            touched.insert(k.trustLine().accountID);
+            break;
+        case OFFER:
+            touched.insert(k.offer().sellerID);
+            break;
+        case DATA:
+            touched.insert(k.data().accountID);
+            break;
+        }
+    };
+    for (auto t : {ACCOUNT, TRUSTLINE, OFFER, DATA})
+    {
+        ledgerDelta.forEachPendingEntry(t, touch);
+    }
+
+    {
+        auto span = mCloseTracer.span("delta");
+        ledgerDelta.commit();
+    }
+
+    // the changes of the ledger are final: the level 0 bucket is built while
+    // the transaction history is written
+    auto fresh = startBucketBatch(ledgerDelta);
+    {
+        auto span = mCloseTracer.span("tx-history");
+        txFeeHistory.flush();
+        txHistory.flush();
+    }
+    ledgerClosed(fresh);
+    mApp.getHerder().getTxValidityMemo().ledgerClosed(
+        headerBeforeUpgrades, mLastClosedLedger, touched);
+
+    if (mMetaStream)
+    {
+        auto span = mCloseTracer.span("meta-stream");
+        TransactionHistoryEntry txSetEntry;
+        txSetEntry.ledgerSeq = mLastClosedLedger.header.ledgerSeq;
+        ledgerData.getTxSet()->toXDR(txSetEntry.txSet);
+        TransactionHistoryResultEntry resultEntry;
+        resultEntry.ledgerSeq = mLastClosedLedger.header.ledgerSeq;
+        resultEntry.txResultSet = txResultSet;
+        mMetaStream->finishLedger(mLastClosedLedger, txSetEntry, resultEntry);
+    }
 
     // The next 4 steps happen in a relatively non-obvious, subtle order.
     // This is unfortunate and it would be nice if we could make it not
@@ -910,35 +1293,129 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     //    bucket refcounts are incremented for the duration of the publish).
     //
     // 4. GC unreferenced buckets. Only do this once publishes are in progress.
+    //
+    // Steps 3 and 4 are not needed for the next ledger: they run in a handler
+    // of their own (see scheduleCloseTail), after the main thread got through
+    // the messages that arrived during the close, SCP messages of the next
+    // slot among them.
 
     // step 1
     auto& hm = mApp.getHistoryManager();
-    hm.maybeQueueHistoryCheckpoint();
+    {
+        auto historyTime = mLedgerCloseHistory.TimeScope();
+        auto span = mCloseTracer.span("queue-checkpoint");
+        hm.maybeQueueHistoryCheckpoint();
+    }
 
     // step 2
     mApp.getDatabase().clearPreparedStatementCache();
-    txscope.commit();
+    {
+        auto commitTime = mLedgerCloseCommit.TimeScope();
+        auto span = mCloseTracer.span("sql-commit");
+        txscope.commit();
+    }
+    mApp.getDatabase().setRelaxedCommits(false);
+    mApplyProfiler.finishLedger();
+    // applying buckets or upgrades cleared it
+    if (mApp.getConfig().IN_MEMORY_LEDGER_STATE &&
+        !mApp.getDatabase().getEntryCache().isResident())
+    {
+        loadResidentLedgerState();
+    }
+    // the cached prefixes of the order book only live for a ledger
+    auto orderBook = mApp.getDatabase().getOrderBook();
+    if (orderBook && orderBook->keepsPrefixesOnly())
+    {
+        orderBook->clear();
+    }
+
+    scheduleCloseTail();
+    mCloseTracer.finishLedger();
+}
+
+void
+LedgerManagerImpl::scheduleCloseTail()
+{
+    // ledgers closed in a row (replaying history) share one
+    if (mCloseTailPending)
+    {
+        return;
+    }
+    mCloseTailPending = true;
+    mApp.getClock().postToMain([this]() { runCloseTail(); },
+                               "ledger-close-tail");
+}
+
+void
+LedgerManagerImpl::runCloseTail()
+{
+    mCloseTailPending = false;
 
     // step 3
-    hm.publishQueuedHistory();
-    hm.logAndUpdatePublishStatus();
+    auto& hm = mApp.getHistoryManager();
+    {
+        auto historyTime = mLedgerCloseHistory.TimeScope();
+        hm.publishQueuedHistory();
+        hm.logAndUpdatePublishStatus();
+    }
 
     // step 4
     mApp.getBucketManager().forgetUnreferencedBuckets();
 }
 
 void
-LedgerManagerImpl::deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                                    uint32_t count)
+LedgerManagerImpl::closeLedgerWithEntries(
+    std::vector<LedgerEntry> const& entries)
 {
+    auto& db = getDatabase();
+    db.ensureHistoryPartitions(getLedgerNum());
     soci::transaction txscope(db.getSession());
-    db.clearPreparedStatementCache();
-    LedgerHeaderFrame::deleteOldEntries(db, ledgerSeq, count);
-    TransactionFrame::deleteOldEntries(db, ledgerSeq, count);
-    HerderPersistence::deleteOldEntries(db, ledgerSeq, count);
-    Upgrades::deleteOldEntries(db, ledgerSeq, count);
-    db.clearPreparedStatementCache();
+    auto ledgerTime = mLedgerClose.TimeScope();
+
+    LedgerDelta delta(mCurrentLedger->mHeader, db);
+    int64_t funded = 0;
+    for (auto const& entry : entries)
+    {
+        if (entry.data.type() == ACCOUNT)
+        {
+            funded += entry.data.account().balance;
+        }
+        else if (entry.data.type() == OFFER)
+        {
+            auto& idPool = delta.getHeader().idPool;
+            idPool = std::max(idPool, entry.data.offer().offerID);
+        }
+        EntryFrame::FromXDR(entry)->storeAdd(delta, db);
+    }
+
+    auto rootID = SecretKey::fromSeed(mApp.getNetworkID()).getPublicKey();
+    auto root = AccountFrame::loadAccount(delta, rootID, db);
+    if (!root || !root->addBalance(-funded, *this) ||
+        root->getBalance() < root->getMinimumBalance(*this))
+    {
+        throw std::runtime_error("The root account cannot fund the entries");
+    }
+    root->storeChange(delta, db);
+
+    delta.commit();
+    ledgerClosed(startBucketBatch(delta));
+
+    auto& hm = mApp.getHistoryManager();
+    hm.maybeQueueHistoryCheckpoint();
     txscope.commit();
+    hm.publishQueuedHistory();
+    mApp.getBucketManager().forgetUnreferencedBuckets();
+}
+
+bool
+LedgerManager::deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
+                                uint32_t count)
+{
+    bool done = LedgerHeaderFrame::deleteOldEntries(sess, ledgerSeq, count);
+    done &= TransactionFrame::deleteOldEntries(sess, ledgerSeq, count);
+    done &= HerderPersistence::deleteOldEntries(sess, ledgerSeq, count);
+    done &= Upgrades::deleteOldEntries(sess, ledgerSeq, count);
+    return done;
 }
 
 void
@@ -1018,24 +1495,79 @@ LedgerManagerImpl::advanceLedgerPointers()
     mCurrentLedger = make_shared<LedgerHeaderFrame>(mLastClosedLedger);
     CLOG(DEBUG, "Ledger") << "New current ledger: seq="
                           << mCurrentLedger->mHeader.ledgerSeq;
+    publishLastClosedSnapshot();
+}
+
+void
+LedgerManagerImpl::publishLastClosedSnapshot()
+{
+    std::shared_ptr<LedgerStateSnapshot const> snapshot;
+    auto const& bl = mApp.getBucketManager().getBucketList();
+    if (bl.getHash() == mLastClosedLedger.header.bucketListHash)
+    {
+        snapshot =
+            std::make_shared<LedgerStateSnapshot>(mLastClosedLedger, bl);
+    }
+    std::atomic_store(&mLastClosedSnapshot, snapshot);
 }
 
 void
 LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
-                                      LedgerDelta& delta)
+                                      LedgerDelta& delta,
+                                      BatchInserter& txFeeHistory)
 {
     CLOG(DEBUG, "Ledger") << "processing fees and sequence numbers";
     int index = 0;
+    bool store = storesTransactionHistory();
+    bool withMeta = computesTransactionMeta();
+    auto& db = mApp.getDatabase();
     try
     {
-        soci::transaction sqlTx(mApp.getDatabase().getSession());
+        soci::transaction sqlTx(db.getSession());
+        // every source account is loaded once (from the entry cache warmed
+        // by prefetchTransactionData) and charged by all its transactions
+        // before being stored, once, with the others
+        std::map<AccountID, AccountFrame::pointer> accounts;
         for (auto tx : txs)
         {
+            auto& account = accounts[tx->getSourceID()];
+            if (!account)
+            {
+                account = AccountFrame::loadAccount(tx->getSourceID(), db);
+                if (!account)
+                {
+                    throw std::runtime_error("Unexpected database state");
+                }
+            }
             LedgerDelta thisTxDelta(delta);
-            tx->processFeeSeqNum(thisTxDelta, *this);
-            tx->storeTransactionFee(*this, thisTxDelta.getChanges(), ++index);
+            tx->processFeeSeqNum(account, thisTxDelta, *this);
+            ++index;
+            LedgerEntryChanges changes;
+            if (withMeta || mMetaStream)
+            {
+                changes = thisTxDelta.getChanges();
+            }
+            if (store)
+            {
+                tx->storeTransactionFee(
+                    *this, withMeta ? changes : LedgerEntryChanges{}, index,
+                    txFeeHistory);
+            }
+            if (mMetaStream)
+            {
+                mMetaStream->addFeeChanges(changes);
+            }
             thisTxDelta.commit();
         }
+
+        // stored entries are kept in the entry cache, for apply to find
+        std::vector<AccountFrame::pointer> toStore;
+        toStore.reserve(accounts.size());
+        for (auto const& account : accounts)
+        {
+            toStore.emplace_back(account.second);
+        }
+        AccountFrame::storeBalancesBatch(db, toStore);
         sqlTx.commit();
     }
     catch (std::exception& e)
@@ -1046,15 +1578,94 @@ LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
     }
 }
 
+void
+LedgerManagerImpl::prefetchTransactionData(
+    std::vector<TransactionFramePtr> const& txs)
+{
+    auto prefetchTime = mTransactionPrefetch.TimeScope();
+
+    std::set<LedgerKey, LedgerEntryIdCmp> keys;
+    for (auto const& tx : txs)
+    {
+        tx->insertLedgerKeysToPrefetch(keys);
+    }
+
+    std::vector<AccountID> accounts;
+    std::vector<LedgerKey> trustLines;
+    for (auto const& k : keys)
+    {
+        if (k.type() == ACCOUNT)
+        {
+            accounts.emplace_back(k.account().accountID);
+        }
+        else if (k.type() == TRUSTLINE)
+        {
+            trustLines.emplace_back(k);
+        }
+    }
+
+    auto& db = getDatabase();
+    AccountFrame::prefetchAccounts(accounts, db);
+    TrustFrame::prefetchTrustLines(trustLines, db);
+}
+
+void
+LedgerManagerImpl::prepareLedgerClose(TxSetFrame const& txSet)
+{
+    mLedgerClosePrepared.Mark();
+    // the apply order is cached by the set, and the entries in the entry
+    // cache stay valid until a ledger is closed
+    prefetchTransactionData(txSet.sortForApply());
+}
+
+std::vector<std::future<void>>
+LedgerManagerImpl::startSignatureChecks(
+    std::vector<TransactionFramePtr> const& txs)
+{
+    std::vector<std::future<void>> checks;
+    if (txs.size() < 2)
+    {
+        return checks;
+    }
+
+    // hashes are computed lazily, do it before sharing the transactions
+    for (auto const& tx : txs)
+    {
+        tx->getContentsHash();
+    }
+
+    // only signatures from the source accounts' own keys are checked ahead,
+    // other signers are known once the accounts are loaded
+    size_t nbBatches = std::min<size_t>(
+        txs.size(), std::max(1u, std::thread::hardware_concurrency()));
+    for (size_t i = 0; i < nbBatches; i++)
+    {
+        checks.emplace_back(
+            std::async(std::launch::async, [&txs, i, nbBatches]() {
+                for (size_t j = i; j < txs.size(); j += nbBatches)
+                {
+                    txs[j]->preverifySignatures();
+                }
+            }));
+    }
+    return checks;
+}
+
 void
 LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
                                      LedgerDelta& ledgerDelta,
-                                     TransactionResultSet& txResultSet)
+                                     TransactionResultSet& txResultSet,
+                                     BatchInserter& txHistory)
 {
     CLOG(DEBUG, "Tx") << "applyTransactions: ledger = "
                       << mCurrentLedger->mHeader.ledgerSeq;
     int index = 0;
 
+    bool store = storesTransactionHistory();
+    bool withMeta = computesTransactionMeta();
+    // the metadata stream needs it even when it is not stored
+    bool computeMeta = withMeta || mMetaStream;
+
     // Record tx count
     auto numTxs = txs.size();
     if (numTxs > 0)
@@ -1065,6 +1676,7 @@ LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
     for (auto tx : txs)
     {
         auto txTime = mTransactionApply.TimeScope();
+        auto queries = mApplyProfiler.getQueryCount();
         TransactionMeta tm(1);
         try
         {
@@ -1072,7 +1684,14 @@ LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
                 << " tx#" << index << " = " << hexAbbrev(tx->getFullHash())
                 << " txseq=" << tx->getSeqNum() << " (@ "
                 << mApp.getConfig().toShortString(tx->getSourceID()) << ")";
-            tx->apply(ledgerDelta, tm.v1(), mApp);
+            if (computeMeta)
+            {
+                tx->apply(ledgerDelta, tm.v1(), mApp);
+            }
+            else
+            {
+                tx->apply(ledgerDelta, mApp);
+            }
         }
         catch (InvariantDoesNotHold& e)
         {
@@ -1088,10 +1707,47 @@ LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
             CLOG(ERROR, "Ledger") << "Unknown exception during tx->apply";
             tx->getResult().result.code(txINTERNAL_ERROR);
         }
-        tx->storeTransaction(*this, tm, ++index, txResultSet);
+        ++index;
+        if (store)
+        {
+            TransactionMeta noMeta(1);
+            tx->storeTransaction(*this, withMeta ? tm : noMeta, index,
+                                 txResultSet, txHistory);
+        }
+        else
+        {
+            txResultSet.results.emplace_back(tx->getResultPair());
+        }
+        if (mMetaStream)
+        {
+            mMetaStream->addTransactionMeta(tm);
+        }
+        mApplyProfiler.recordTransaction(tx->getResultCode(), txTime.Stop(),
+                                         queries);
     }
 }
 
+bool
+LedgerManagerImpl::storesTransactionHistory() const
+{
+    return !mApp.getConfig().CATCHUP_REPLAY_ONLY ||
+           (mCatchupState != CatchupState::APPLYING_HISTORY &&
+            !mReplayingHistory);
+}
+
+void
+LedgerManagerImpl::setReplayingHistory(bool replaying)
+{
+    mReplayingHistory = replaying;
+}
+
+bool
+LedgerManagerImpl::computesTransactionMeta() const
+{
+    return storesTransactionHistory() &&
+           mApp.getConfig().TRANSACTION_META != Config::TX_META_NONE;
+}
+
 void
 LedgerManagerImpl::storeCurrentLedger()
 {
@@ -1117,18 +1773,90 @@ LedgerManagerImpl::storeCurrentLedger()
 
     mApp.getPersistentState().setState(PersistentState::kHistoryArchiveState,
                                        has.toString());
+
+    // and along with the buckets, to rebuild the database from them if need
+    // be
+    LedgerHeaderHistoryEntry lcl;
+    lcl.header = mCurrentLedger->mHeader;
+    lcl.hash = mCurrentLedger->getHash();
+    mApp.getBucketManager().storeLocalState(has, lcl);
 }
 
 void
-LedgerManagerImpl::ledgerClosed(LedgerDelta const& delta)
+LedgerManagerImpl::loadResidentLedgerState()
+{
+    auto start = mApp.getClock().now();
+    auto& cache = mApp.getDatabase().getEntryCache();
+    cache.beginResident();
+
+    // newest buckets first: the first entry of a key is its current state
+    std::unordered_set<LedgerEntryCacheKey> seen;
+    auto& bl = mApp.getBucketManager().getBucketList();
+    for (uint32_t i = 0; i < BucketList::kNumLevels; i++)
+    {
+        auto const& level = bl.getLevel(i);
+        for (auto const& b : {level.getCurr(), level.getSnap()})
+        {
+            for (BucketInputIterator in(b); in; ++in)
+            {
+                auto const& e = *in;
+                bool live = e.type() == LIVEENTRY;
+                auto key = live ? LedgerEntryKey(e.liveEntry()) : e.deadEntry();
+                if (seen.insert(makeLedgerEntryCacheKey(key)).second && live)
+                {
+                    cache.put(key, std::make_shared<LedgerEntry const>(
+                                       e.liveEntry()));
+                }
+            }
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        mApp.getClock().now() - start);
+    CLOG(INFO, "Ledger") << "Loaded " << cache.size()
+                         << " ledger entries in memory in " << elapsed.count()
+                         << "ms";
+}
+
+std::shared_future<std::shared_ptr<Bucket>>
+LedgerManagerImpl::startBucketBatch(LedgerDelta& delta)
 {
     delta.markMeters(mApp);
-    mApp.getBucketManager().addBatch(mApp, mCurrentLedger->mHeader.ledgerSeq,
-                                     delta.getLiveEntries(),
-                                     delta.getDeadEntries());
+    return mApp.getBucketManager().startFreshBucket(delta.takeLiveEntries(),
+                                                    delta.takeDeadEntries());
+}
 
-    mApp.getBucketManager().snapshotLedger(mCurrentLedger->mHeader);
-    storeCurrentLedger();
+void
+LedgerManagerImpl::ledgerClosed(
+    std::shared_future<std::shared_ptr<Bucket>> fresh)
+{
+    {
+        auto span = mCloseTracer.span("buckets");
+        auto& bm = mApp.getBucketManager();
+        bm.addBatch(mApp, mCurrentLedger->mHeader.ledgerSeq, fresh);
+        bm.snapshotLedger(mCurrentLedger->mHeader);
+    }
+    {
+        auto span = mCloseTracer.span("store-header");
+        storeCurrentLedger();
+    }
     advanceLedgerPointers();
+    getDatabase().getLedgerHeaderCache().add(mLastClosedLedger);
+
+    // the ledger is still being committed at this point: checkpoint once it
+    // is, before the next ledger starts (if it is to be on disk by then)
+    if (!getDatabase().commitsRelaxed())
+    {
+        auto& app = mApp;
+        mApp.getClock().getIOService().post(
+            [&app]() { app.getDatabase().checkpoint(); });
+    }
+
+    if (mApp.getConfig().ENTRY_CACHE_WARM_KEYS != 0 &&
+        mCurrentLedger->mHeader.ledgerSeq % HOT_KEYS_INTERVAL == 0 &&
+        !getDatabase().getEntryCache().isResident())
+    {
+        saveHotKeys();
+    }
 }
 }
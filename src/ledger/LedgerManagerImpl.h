@@ -5,15 +5,23 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 #include "util/asio.h"
 
+#include "herder/LedgerCloseData.h"
 #include "history/HistoryManager.h"
+#include "ledger/ApplyProfiler.h"
+#include "ledger/LedgerCloseMetaStream.h"
+#include "ledger/LedgerCloseTracer.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/SyncingLedgerChain.h"
 #include "main/PersistentState.h"
 #include "transactions/TransactionFrame.h"
 #include "util/Timer.h"
+#include "util/TmpDir.h"
 #include "xdr/Stellar-ledger.h"
+#include <future>
+#include <map>
 #include <string>
+#include <vector>
 
 /*
 Holds the current ledger
@@ -25,12 +33,15 @@ namespace medida
 {
 class Timer;
 class Counter;
+class Meter;
 class Histogram;
 }
 
 namespace stellar
 {
 class Application;
+class BatchInserter;
+class Bucket;
 class Database;
 class LedgerDelta;
 
@@ -41,8 +52,16 @@ class LedgerManagerImpl : public LedgerManager
 
     Application& mApp;
     medida::Timer& mTransactionApply;
+    medida::Timer& mTransactionPrefetch;
+    medida::Timer& mTransactionSignatureWait;
+    medida::Meter& mLedgerClosePrepared;
     medida::Histogram& mTransactionCount;
     medida::Timer& mLedgerClose;
+    // the phases of closeLedger
+    medida::Timer& mLedgerCloseFees;
+    medida::Timer& mLedgerCloseApply;
+    medida::Timer& mLedgerCloseCommit;
+    medida::Timer& mLedgerCloseHistory;
     medida::Timer& mLedgerAgeClosed;
     medida::Counter& mLedgerAge;
     medida::Counter& mLedgerStateCurrent;
@@ -52,10 +71,25 @@ class LedgerManagerImpl : public LedgerManager
 
     medida::Counter& mSyncingLedgersSize;
 
+    ApplyProfiler mApplyProfiler;
+    LedgerCloseTracer mCloseTracer;
+    // opened by the first ledger closed, with METADATA_OUTPUT_STREAM
+    std::unique_ptr<LedgerCloseMetaStream> mMetaStream;
+
+    // only accessed with std::atomic_load and std::atomic_store
+    std::shared_ptr<LedgerStateSnapshot const> mLastClosedSnapshot;
+
+    // holds the spill file of mSyncingLedgers
+    std::unique_ptr<TmpDir> mSyncingLedgersDir;
     SyncingLedgerChain mSyncingLedgers;
+    // ledgers older than the first of mSyncingLedgers, that may fill the gap
+    // from the last closed ledger to it
+    std::map<uint32_t, LedgerCloseData> mMissedLedgers;
     uint32_t mCatchupTriggerLedger{0};
 
     CatchupState mCatchupState{CatchupState::NONE};
+    bool mReplayingHistory{false};
+    bool mCloseTailPending{false};
 
     void initializeCatchup(LedgerCloseData const& ledgerData);
     void continueCatchup(LedgerCloseData const& ledgerData);
@@ -63,20 +97,56 @@ class LedgerManagerImpl : public LedgerManager
 
     void addToSyncingLedgers(LedgerCloseData const& ledgerData);
     void startCatchupIf(uint32_t lastReceivedLedgerSeq);
+    // closes mMissedLedgers then mSyncingLedgers if they leave no gap from
+    // the last closed ledger, in place of catching up from the archives
+    void closeMissedLedgersIf();
 
     void historyCaughtup(asio::error_code const& ec,
                          CatchupWork::ProgressState progressState,
                          LedgerHeaderHistoryEntry const& lastClosed);
 
+    void prefetchTransactionData(std::vector<TransactionFramePtr> const& txs);
+    // checks the signatures of @p txs on other threads, filling the
+    // signature cache; wait on the futures before applying @p txs
+    std::vector<std::future<void>>
+    startSignatureChecks(std::vector<TransactionFramePtr> const& txs);
     void processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
-                            LedgerDelta& delta);
+                            LedgerDelta& delta, BatchInserter& txFeeHistory);
     void applyTransactions(std::vector<TransactionFramePtr>& txs,
                            LedgerDelta& ledgerDelta,
-                           TransactionResultSet& txResultSet);
-
-    void ledgerClosed(LedgerDelta const& delta);
+                           TransactionResultSet& txResultSet,
+                           BatchInserter& txHistory);
+    // false while replaying ledgers in a CATCHUP_REPLAY_ONLY catchup (or
+    // replayLedgers run)
+    bool storesTransactionHistory() const;
+    // false as well with TRANSACTION_META=NONE: the metadata stored is empty
+    bool computesTransactionMeta() const;
+
+    // starts building the bucket of the changes of the committed @p delta
+    // (see BucketManager::startFreshBucket), which are moved out of it
+    std::shared_future<std::shared_ptr<Bucket>>
+    startBucketBatch(LedgerDelta& delta);
+    // adds the bucket @p fresh of the changes of the ledger to the bucket
+    // list, and stores the ledger
+    void ledgerClosed(std::shared_future<std::shared_ptr<Bucket>> fresh);
+    // posts runCloseTail, unless it is already pending
+    void scheduleCloseTail();
+    // publishes the checkpoints queued by the ledgers closed since the last
+    // time, then forgets the buckets no longer referenced
+    void runCloseTail();
+    // with IN_MEMORY_LEDGER_STATE, makes the entry cache resident with every
+    // entry of the bucket list, which has the state of the last ledger
+    void loadResidentLedgerState();
+    // with ENTRY_CACHE_WARM_KEYS, saves the keys of the entries of the entry
+    // cache hit the most, every HOT_KEYS_INTERVAL ledgers, and loads them
+    // back at startup
+    static uint32_t const HOT_KEYS_INTERVAL = 64;
+    std::string hotKeysFilename();
+    void warmEntryCache();
+    void saveHotKeys();
     void storeCurrentLedger();
     void advanceLedgerPointers();
+    void publishLastClosedSnapshot();
 
     enum class CloseLedgerIfResult
     {
@@ -111,15 +181,21 @@ class LedgerManagerImpl : public LedgerManager
 
     void startNewLedger(LedgerHeader genesisLedger);
     void startNewLedger() override;
+    void
+    setLastClosedLedger(LedgerHeaderHistoryEntry const& lastClosed) override;
     void loadLastKnownLedger(
         std::function<void(asio::error_code const& ec)> handler) override;
 
     LedgerHeaderHistoryEntry const& getLastClosedLedgerHeader() const override;
+    std::shared_ptr<LedgerStateSnapshot const>
+    getLastClosedSnapshot() const override;
     LedgerHeader const& getCurrentLedgerHeader() const override;
     LedgerHeader& getCurrentLedgerHeader() override;
     uint32_t getCurrentLedgerVersion() const override;
 
     Database& getDatabase() override;
+    ApplyProfiler& getApplyProfiler() override;
+    LedgerCloseTracer& getCloseTracer() override;
 
     void startCatchup(CatchupConfiguration configuration,
                       bool manualCatchup) override;
@@ -128,8 +204,10 @@ class LedgerManagerImpl : public LedgerManager
     verifyCatchupCandidate(LedgerHeaderHistoryEntry const&,
                            bool manualCatchup) const override;
     void closeLedger(LedgerCloseData const& ledgerData) override;
-    void deleteOldEntries(Database& db, uint32_t ledgerSeq,
-                          uint32_t count) override;
+    void
+    closeLedgerWithEntries(std::vector<LedgerEntry> const& entries) override;
+    void setReplayingHistory(bool replaying) override;
+    void prepareLedgerClose(TxSetFrame const& txSet) override;
     void checkDbState() override;
 };
 }
@@ -0,0 +1,42 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerStateSnapshot.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketList.h"
+
+namespace stellar
+{
+
+LedgerStateSnapshot::LedgerStateSnapshot(LedgerHeaderHistoryEntry const& header,
+                                         BucketList const& bucketList)
+    : mHeader(header)
+{
+    mBuckets.reserve(2 * BucketList::kNumLevels);
+    for (uint32_t i = 0; i < BucketList::kNumLevels; i++)
+    {
+        auto const& level = bucketList.getLevel(i);
+        mBuckets.emplace_back(level.getCurr());
+        mBuckets.emplace_back(level.getSnap());
+    }
+}
+
+std::shared_ptr<LedgerEntry const>
+LedgerStateSnapshot::load(LedgerKey const& key) const
+{
+    for (auto const& b : mBuckets)
+    {
+        auto e = b->getBucketEntry(key);
+        if (e)
+        {
+            if (e->type() == DEADENTRY)
+            {
+                return nullptr;
+            }
+            return std::make_shared<LedgerEntry const>(e->liveEntry());
+        }
+    }
+    return nullptr;
+}
+}
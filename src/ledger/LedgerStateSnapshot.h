@@ -0,0 +1,48 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <memory>
+#include <vector>
+
+namespace stellar
+{
+
+class Bucket;
+class BucketList;
+
+/**
+ * The state of the ledger as of a closed ledger, which any thread can read
+ * while the main thread closes the next ones.
+ *
+ * Buckets are immutable files, so a snapshot only holds (shares) the
+ * buckets the bucket list had once the ledger closed, and loads entries
+ * from them like BucketList::getBucketEntry does; nothing is copied, and
+ * the buckets a snapshot holds are only forgotten once it is released.
+ * LedgerManager::getLastClosedSnapshot returns the one of the LCL.
+ */
+class LedgerStateSnapshot : NonMovableOrCopyable
+{
+    LedgerHeaderHistoryEntry const mHeader;
+    // newest first
+    std::vector<std::shared_ptr<Bucket const>> mBuckets;
+
+  public:
+    LedgerStateSnapshot(LedgerHeaderHistoryEntry const& header,
+                        BucketList const& bucketList);
+
+    LedgerHeaderHistoryEntry const&
+    getHeader() const
+    {
+        return mHeader;
+    }
+
+    // the entry of @p key as of this ledger, null if there was none
+    std::shared_ptr<LedgerEntry const> load(LedgerKey const& key) const;
+};
+}
@@ -3,21 +3,37 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "LedgerTestUtils.h"
+#include "crypto/SecretKey.h"
+#include "crypto/XDRHasher.h"
 #include "database/Database.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/ApplyProfiler.h"
 #include "ledger/AccountFrame.h"
+#include "ledger/LedgerCloseTracer.h"
 #include "ledger/EntryFrame.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/LedgerStateSnapshot.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "test/TestAccount.h"
 #include "test/TestUtils.h"
+#include "test/TxTests.h"
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
 #include "util/types.h"
+#include <algorithm>
+#include <thread>
 #include <xdrpp/autocheck.h>
+#include <xdrpp/marshal.h>
 
 using namespace stellar;
 
@@ -140,6 +156,164 @@ TEST_CASE("DB cache interaction with transactions", "[ledger][dbcache]")
     CHECK(balance0 == acc->getAccount().balance);
 }
 
+TEST_CASE("in memory ledger state", "[ledger][dbcache]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig(0);
+    cfg.IN_MEMORY_LEDGER_STATE = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    auto& db = app->getDatabase();
+    auto& cache = db.getEntryCache();
+
+    auto root = TestAccount::createRoot(*app);
+    auto dest = txtest::getAccount("dest");
+    auto create = root.tx({txtest::createAccount(
+        dest.getPublicKey(), app->getLedgerManager().getMinBalance(0))});
+    txtest::closeLedgerOn(*app, 2, 1, 1, 2018, {create});
+    REQUIRE(create->getResultCode() == txSUCCESS);
+    // loaded from the buckets once the ledger closed
+    REQUIRE(cache.isResident());
+    REQUIRE(cache.size(ACCOUNT) == 2);
+
+    LedgerKey key;
+    key.type(ACCOUNT);
+    key.account().accountID = dest.getPublicKey();
+    REQUIRE(EntryFrame::cachedEntryExists(key, db));
+
+    auto pay = root.tx({txtest::payment(dest.getPublicKey(), 7)});
+    txtest::closeLedgerOn(*app, 3, 2, 1, 2018, {pay});
+    REQUIRE(pay->getResultCode() == txSUCCESS);
+    REQUIRE(cache.isResident());
+
+    // what the cache has after the close is what the database has
+    REQUIRE(EntryFrame::cachedEntryExists(key, db));
+    auto cached = AccountFrame::loadAccount(dest.getPublicKey(), db);
+    cache.clear();
+    auto stored = AccountFrame::loadAccount(dest.getPublicKey(), db);
+    REQUIRE(cached->getBalance() == stored->getBalance());
+    REQUIRE(cached->getSeqNum() == stored->getSeqNum());
+
+    auto missing = txtest::getAccount("missing");
+    key.account().accountID = missing.getPublicKey();
+    txtest::closeLedgerOn(*app, 4, 3, 1, 2018);
+    REQUIRE(cache.isResident());
+    REQUIRE(EntryFrame::cachedEntryExists(key, db));
+    REQUIRE(!AccountFrame::loadAccount(missing.getPublicKey(), db));
+}
+
+TEST_CASE("ledger state snapshots", "[ledger]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig(0));
+    app->start();
+    auto& lm = app->getLedgerManager();
+
+    auto root = TestAccount::createRoot(*app);
+    LedgerKey key;
+    key.type(ACCOUNT);
+    key.account().accountID = root.getPublicKey();
+
+    auto before = lm.getLastClosedSnapshot();
+    REQUIRE(before);
+    REQUIRE(before->getHeader().header.ledgerSeq ==
+            lm.getLastClosedLedgerNum());
+    auto balance = before->load(key)->data.account().balance;
+
+    auto dest = txtest::getAccount("dest");
+    auto create = root.tx({txtest::createAccount(
+        dest.getPublicKey(), lm.getMinBalance(0))});
+    txtest::closeLedgerOn(*app, 2, 1, 1, 2018, {create});
+    REQUIRE(create->getResultCode() == txSUCCESS);
+
+    auto after = lm.getLastClosedSnapshot();
+    REQUIRE(after->getHeader().header.ledgerSeq == 2);
+    LedgerKey destKey;
+    destKey.type(ACCOUNT);
+    destKey.account().accountID = dest.getPublicKey();
+
+    // a snapshot still held keeps the state of its ledger
+    REQUIRE(before->load(key)->data.account().balance == balance);
+    REQUIRE(!before->load(destKey));
+
+    // the next one can be read from other threads
+    std::shared_ptr<LedgerEntry const> loaded;
+    std::thread reader([&]() { loaded = after->load(destKey); });
+    reader.join();
+    REQUIRE(loaded);
+    REQUIRE(loaded->data.account().balance == lm.getMinBalance(0));
+    REQUIRE(after->load(key)->data.account().balance <
+            balance - lm.getMinBalance(0));
+}
+
+TEST_CASE("ledger close metadata stream", "[ledger]")
+{
+    TmpDir dir("meta");
+    auto path = dir.getName() + "/meta.xdr";
+    auto cfg = getTestConfig(0);
+    cfg.METADATA_OUTPUT_STREAM = path;
+    SECTION("full metadata")
+    {
+    }
+    SECTION("metadata only streamed")
+    {
+        cfg.TRANSACTION_META = Config::TX_META_NONE;
+    }
+
+    Hash lastHash;
+    {
+        VirtualClock clock;
+        Application::pointer app = createTestApplication(clock, cfg);
+        app->start();
+
+        auto root = TestAccount::createRoot(*app);
+        auto dest = txtest::getAccount("dest");
+        auto create = root.tx({txtest::createAccount(
+            dest.getPublicKey(), app->getLedgerManager().getMinBalance(0))});
+        txtest::closeLedgerOn(*app, 2, 1, 1, 2018, {create});
+        txtest::closeLedgerOn(*app, 3, 2, 1, 2018);
+        lastHash = app->getLedgerManager().getLastClosedLedgerHeader().hash;
+    }
+
+    XDRInputFileStream in;
+    in.open(path);
+    for (uint32_t seq = 2; seq <= 3; seq++)
+    {
+        LedgerHeaderHistoryEntry header;
+        TransactionHistoryEntry txSet;
+        TransactionHistoryResultEntry results;
+        REQUIRE(in.readOne(header));
+        REQUIRE(in.readOne(txSet));
+        REQUIRE(in.readOne(results));
+        REQUIRE(header.header.ledgerSeq == seq);
+        REQUIRE(txSet.ledgerSeq == seq);
+        REQUIRE(results.ledgerSeq == seq);
+        REQUIRE(txSet.txSet.txs.size() == results.txResultSet.results.size());
+        REQUIRE(xdrSha256(results.txResultSet) ==
+                header.header.txSetResultHash);
+        for (size_t i = 0; i < results.txResultSet.results.size(); i++)
+        {
+            LedgerEntryChanges fees;
+            REQUIRE(in.readOne(fees));
+            REQUIRE(!fees.empty());
+        }
+        for (size_t i = 0; i < results.txResultSet.results.size(); i++)
+        {
+            TransactionMeta meta;
+            REQUIRE(in.readOne(meta));
+            // the account created, with or without stored metadata
+            REQUIRE(meta.v1().operations.size() == 1);
+            REQUIRE(!meta.v1().operations[0].changes.empty());
+        }
+        if (seq == 3)
+        {
+            REQUIRE(header.hash == lastHash);
+        }
+    }
+    LedgerHeaderHistoryEntry header;
+    REQUIRE(!in.readOne(header));
+}
+
 TEST_CASE("cannot close ledger with unsupported ledger version", "[ledger]")
 {
     VirtualClock clock;
@@ -163,3 +337,301 @@ TEST_CASE("cannot close ledger with unsupported ledger version", "[ledger]")
         app->getLedgerManager(), Config::CURRENT_LEDGER_PROTOCOL_VERSION + 1);
     REQUIRE_THROWS_AS(applyEmptyLedger(), std::runtime_error);
 }
+
+TEST_CASE("ledger close checks signatures ahead of apply", "[ledger]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig(0));
+    app->start();
+
+    auto& lm = app->getLedgerManager();
+    auto root = TestAccount::createRoot(*app);
+    auto txSet = std::make_shared<TxSetFrame>(
+        lm.getLastClosedLedgerHeader().hash);
+    size_t const nbTxs = 10;
+    for (size_t i = 0; i < nbTxs; i++)
+    {
+        auto dest = txtest::getAccount(("dest" + std::to_string(i)).c_str());
+        txSet->add(root.tx({txtest::createAccount(dest.getPublicKey(),
+                                                  lm.getMinBalance(0))}));
+    }
+    txSet->sortForHash();
+
+    PubKeyUtils::clearVerifySigCache();
+    auto& metrics = app->getMetrics();
+    auto& hits = metrics.NewMeter({"crypto", "verify", "hit"}, "signature");
+    auto& misses = metrics.NewMeter({"crypto", "verify", "miss"}, "signature");
+    auto& wait = metrics.NewTimer({"ledger", "transaction", "signature-wait"});
+    auto hitsBefore = hits.count();
+    auto missesBefore = misses.count();
+
+    StellarValue sv(txSet->getContentsHash(), 1, emptyUpgradeSteps, 0);
+    LedgerCloseData ledgerData(lm.getLedgerNum(), txSet, sv);
+    lm.closeLedger(ledgerData);
+
+    // checked once ahead, apply then finds every result in the cache
+    REQUIRE(wait.count() == 1);
+    REQUIRE(misses.count() - missesBefore == nbTxs);
+    REQUIRE(hits.count() - hitsBefore >= nbTxs);
+    for (auto const& tx : txSet->mTransactions)
+    {
+        REQUIRE(tx->getResultCode() == txSUCCESS);
+    }
+}
+
+TEST_CASE("transaction meta modes", "[ledger][txmeta]")
+{
+    auto cfg = getTestConfig(0);
+    // invariants need the previous values of the entries
+    cfg.INVARIANT_CHECKS.clear();
+    SECTION("full")
+    {
+        cfg.TRANSACTION_META = Config::TX_META_FULL;
+    }
+    SECTION("full, compressed")
+    {
+        cfg.TRANSACTION_META = Config::TX_META_FULL;
+        cfg.COMPRESS_TX_HISTORY = true;
+    }
+    SECTION("changes")
+    {
+        cfg.TRANSACTION_META = Config::TX_META_CHANGES;
+    }
+    SECTION("none")
+    {
+        cfg.TRANSACTION_META = Config::TX_META_NONE;
+    }
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto dest = txtest::getAccount("dest");
+    auto tx = root.tx({txtest::createAccount(
+        dest.getPublicKey(), app->getLedgerManager().getMinBalance(0))});
+    txtest::closeLedgerOn(*app, 2, 1, 1, 2018, {tx});
+    REQUIRE(tx->getResultCode() == txSUCCESS);
+
+    std::string meta64;
+    app->getDatabase().getSession()
+        << "SELECT txmeta FROM txhistory WHERE ledgerseq = 2",
+        soci::into(meta64);
+    REQUIRE((meta64[0] == '~') == cfg.COMPRESS_TX_HISTORY);
+    REQUIRE(TransactionFrame::getTransactionHistoryResults(app->getDatabase(), 2)
+                .results.size() == 1);
+    std::vector<uint8_t> metaBytes;
+    TransactionFrame::decodeHistoryValue(meta64, metaBytes);
+    TransactionMeta tm;
+    xdr::xdr_from_opaque(metaBytes, tm);
+
+    auto hasStates = [](LedgerEntryChanges const& changes) {
+        return std::any_of(changes.begin(), changes.end(),
+                           [](LedgerEntryChange const& c) {
+                               return c.type() == LEDGER_ENTRY_STATE;
+                           });
+    };
+    switch (cfg.TRANSACTION_META)
+    {
+    case Config::TX_META_FULL:
+        REQUIRE(tm.v1().operations.size() == 1);
+        REQUIRE(hasStates(tm.v1().operations[0].changes));
+        break;
+    case Config::TX_META_CHANGES:
+        REQUIRE(tm.v1().operations.size() == 1);
+        REQUIRE(!tm.v1().operations[0].changes.empty());
+        REQUIRE(!hasStates(tm.v1().txChanges));
+        REQUIRE(!hasStates(tm.v1().operations[0].changes));
+        break;
+    case Config::TX_META_NONE:
+        REQUIRE(tm.v1().txChanges.empty());
+        REQUIRE(tm.v1().operations.empty());
+        break;
+    }
+}
+
+TEST_CASE("apply profile of the last ledger", "[ledger][profile]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig(0));
+    app->start();
+
+    auto& profiler = app->getLedgerManager().getApplyProfiler();
+    REQUIRE(profiler.getJsonInfo().isNull());
+
+    auto root = TestAccount::createRoot(*app);
+    auto dest = txtest::getAccount("dest");
+    auto create = root.tx({txtest::createAccount(
+        dest.getPublicKey(), app->getLedgerManager().getMinBalance(0))});
+    auto pay = root.tx({txtest::payment(dest.getPublicKey(), 1),
+                        txtest::payment(dest.getPublicKey(), 2)});
+    txtest::closeLedgerOn(*app, 2, 1, 1, 2018, {create, pay});
+    REQUIRE(create->getResultCode() == txSUCCESS);
+    REQUIRE(pay->getResultCode() == txSUCCESS);
+
+    auto info = profiler.getJsonInfo();
+    REQUIRE(info["ledger"].asUInt() == 2);
+    REQUIRE(info["operations"]["create-account"]["count"].asUInt64() == 1);
+    REQUIRE(info["operations"]["payment"]["count"].asUInt64() == 2);
+    REQUIRE(info["operations"]["payment"]["queries"].asUInt64() > 0);
+    REQUIRE(info["transactions"]["success"]["count"].asUInt64() == 2);
+
+    // an empty ledger then replaces the profile
+    txtest::closeLedgerOn(*app, 3, 2, 1, 2018);
+    info = profiler.getJsonInfo();
+    REQUIRE(info["ledger"].asUInt() == 3);
+    REQUIRE(info["operations"].empty());
+}
+
+TEST_CASE("ledger close traces", "[ledger][profile]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig(0));
+    app->start();
+
+    auto& tracer = app->getLedgerManager().getCloseTracer();
+    REQUIRE(tracer.getJsonInfo()["ledgers"].empty());
+
+    auto root = TestAccount::createRoot(*app);
+    auto dest = txtest::getAccount("dest");
+    auto create = root.tx({txtest::createAccount(
+        dest.getPublicKey(), app->getLedgerManager().getMinBalance(0))});
+    auto pay = root.tx({txtest::payment(dest.getPublicKey(), 1),
+                        txtest::payment(dest.getPublicKey(), 2)});
+    txtest::closeLedgerOn(*app, 2, 1, 1, 2018, {create, pay});
+    txtest::closeLedgerOn(*app, 3, 2, 1, 2018);
+
+    auto ledgers = tracer.getJsonInfo()["ledgers"];
+    REQUIRE(ledgers.size() == 2);
+    auto const& first = ledgers[0];
+    REQUIRE(first["ledger"].asUInt() == 2);
+    REQUIRE(first["count"].asUInt64() == 1);
+    REQUIRE(first["queries"].asUInt64() > 0);
+    auto const& phases = first["phases"];
+    for (auto phase : {"prefetch", "fees", "signatures", "apply", "upgrades",
+                       "delta", "buckets", "store-header", "tx-history",
+                       "queue-checkpoint", "sql-commit"})
+    {
+        REQUIRE(phases.isMember(phase));
+        REQUIRE(phases[phase]["time_ms"].asDouble() <=
+                first["time_ms"].asDouble());
+    }
+    // one check per operation applied
+    auto const& invariants = phases["apply"]["phases"]["invariants"];
+    REQUIRE(invariants["count"].asUInt64() == 3);
+    REQUIRE(ledgers[1]["ledger"].asUInt() == 3);
+    REQUIRE(!ledgers[1]["phases"]["apply"].isMember("phases"));
+
+    SECTION("last ledgers")
+    {
+        ledgers = tracer.getJsonInfo(1)["ledgers"];
+        REQUIRE(ledgers.size() == 1);
+        REQUIRE(ledgers[0]["ledger"].asUInt() == 3);
+    }
+    SECTION("chrome trace")
+    {
+        auto events = tracer.getChromeTrace(1)["traceEvents"];
+        // the close span and its phases
+        REQUIRE(events.size() == 12);
+        for (auto const& e : events)
+        {
+            REQUIRE(e["ph"].asString() == "X");
+            REQUIRE(e["args"]["ledger"].asUInt() == 3);
+        }
+    }
+    SECTION("spans outside of a close are not recorded")
+    {
+        tracer.span("apply");
+        REQUIRE(tracer.getJsonInfo()["ledgers"].size() == 2);
+    }
+}
+
+TEST_CASE("fees of a ledger are stored once per account", "[ledger][fee]")
+{
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, getTestConfig(0));
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a1 =
+        root.create("a1", app->getLedgerManager().getMinBalance(0) * 100);
+    std::vector<TransactionFramePtr> txs;
+    for (int i = 0; i < 3; i++)
+    {
+        txs.emplace_back(root.tx({txtest::payment(a1.getPublicKey(), 10)}));
+    }
+    txs.emplace_back(a1.tx({txtest::payment(root.getPublicKey(), 1)}));
+    auto rootBalance = root.getBalance();
+    auto a1Balance = a1.getBalance();
+
+    auto& batches = app->getMetrics().NewTimer(
+        {"database", "update", "account-batch"});
+    auto batchesBefore = batches.count();
+    txtest::closeLedgerOn(*app, 2, 1, 1, 2018, txs);
+    REQUIRE(batches.count() - batchesBefore == 1);
+
+    int64_t rootFees = 0;
+    for (auto const& tx : txs)
+    {
+        REQUIRE(tx->getResultCode() == txSUCCESS);
+        if (tx->getSourceID() == root.getPublicKey())
+        {
+            rootFees += tx->getResult().feeCharged;
+        }
+    }
+    auto a1Fee = txs.back()->getResult().feeCharged;
+
+    // what is in the database, not only in the entry cache
+    app->getDatabase().getEntryCache().clear();
+    REQUIRE(root.getBalance() == rootBalance - rootFees - 30 + 1);
+    REQUIRE(a1.getBalance() == a1Balance - a1Fee + 30 - 1);
+    REQUIRE(root.loadSequenceNumber() == txs[2]->getSeqNum());
+}
+
+TEST_CASE("close ledgers externalized before the buffered ones",
+          "[ledger][catchup]")
+{
+    VirtualClock clock;
+    auto source = createTestApplication(clock, getTestConfig(0));
+    auto target = createTestApplication(clock, getTestConfig(1));
+    source->start();
+    target->start();
+
+    // ledgers 2 to 5, as the network externalized them
+    auto& lm = source->getLedgerManager();
+    std::vector<LedgerCloseData> ledgers;
+    for (int i = 0; i < 4; i++)
+    {
+        auto lcl = lm.getLastClosedLedgerHeader();
+        auto txSet = std::make_shared<TxSetFrame>(lcl.hash);
+        StellarValue sv(txSet->getContentsHash(), lcl.header.ledgerSeq + 1,
+                        emptyUpgradeSteps, 0);
+        ledgers.emplace_back(lcl.header.ledgerSeq + 1, txSet, sv);
+        lm.valueExternalized(ledgers.back());
+    }
+
+    auto& targetLm = target->getLedgerManager();
+    REQUIRE(targetLm.getLastClosedLedgerHeader().hash ==
+            ledgers[0].getTxSet()->previousLedgerHash());
+
+    // the target missed ledgers 2 and 3
+    targetLm.valueExternalized(ledgers[2]);
+    REQUIRE(targetLm.getState() == LedgerManager::LM_CATCHING_UP_STATE);
+    REQUIRE(targetLm.getCatchupState() ==
+            LedgerManager::CatchupState::WAITING_FOR_TRIGGER_LEDGER);
+    targetLm.valueExternalized(ledgers[1]);
+    REQUIRE(targetLm.getLastClosedLedgerNum() == 1);
+
+    // once they all arrived, no catchup from the archives is needed
+    targetLm.valueExternalized(ledgers[0]);
+    REQUIRE(targetLm.getLastClosedLedgerNum() == 4);
+    REQUIRE(targetLm.getLastClosedLedgerHeader().hash ==
+            ledgers[3].getTxSet()->previousLedgerHash());
+    REQUIRE(targetLm.getCatchupState() ==
+            LedgerManager::CatchupState::WAITING_FOR_CLOSING_LEDGER);
+
+    targetLm.valueExternalized(ledgers[3]);
+    REQUIRE(targetLm.getState() == LedgerManager::LM_SYNCED_STATE);
+    REQUIRE(targetLm.getLastClosedLedgerHeader().hash ==
+            lm.getLastClosedLedgerHeader().hash);
+}
@@ -8,7 +8,12 @@
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
+#include "database/PostgresBinaryQuery.h"
+#include "database/PostgresCopyWriter.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerRange.h"
+#include "ledger/OrderBook.h"
 #include "ledger/TrustFrame.h"
 #include "transactions/ManageOfferOpFrame.h"
 #include "transactions/OfferExchange.h"
@@ -158,15 +163,24 @@ OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID, Database& db,
 
     std::string sql = offerColumnSelector;
     sql += " WHERE sellerid = :id AND offerid = :offerid";
-    auto prep = db.getPreparedStatement(sql);
-    auto& st = prep.statement();
-    st.exchange(use(actIDStrKey));
-    st.exchange(use(offerID));
-
-    auto timer = db.getSelectTimer("offer");
-    loadOffers(prep, [&retOffer](LedgerEntry const& offer) {
+    auto processor = [&retOffer](LedgerEntry const& offer) {
         retOffer = make_shared<OfferFrame>(offer);
-    });
+    };
+    auto timer = db.getSelectTimer("offer");
+    if (!db.isSqlite())
+    {
+        loadOffers(
+            PostgresBinaryQuery(db, sql, {actIDStrKey, std::to_string(offerID)}),
+            processor);
+    }
+    else
+    {
+        auto prep = db.getPreparedStatement(sql);
+        auto& st = prep.statement();
+        st.exchange(use(actIDStrKey));
+        st.exchange(use(offerID));
+        loadOffers(prep, processor);
+    }
 
     if (delta && retOffer)
     {
@@ -176,6 +190,73 @@ OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID, Database& db,
     return retOffer;
 }
 
+// `hasCode` is false if the code or the issuer of the asset is NULL
+static void
+setAsset(Asset& asset, unsigned int assetType, bool hasCode,
+         std::string const& assetCode, std::string const& issuerStrKey)
+{
+    if (assetType > ASSET_TYPE_CREDIT_ALPHANUM12)
+    {
+        throw std::runtime_error("bad database state");
+    }
+
+    asset.type((AssetType)assetType);
+    if (assetType != ASSET_TYPE_NATIVE)
+    {
+        if (!hasCode)
+        {
+            throw std::runtime_error("bad database state");
+        }
+
+        if (assetType == ASSET_TYPE_CREDIT_ALPHANUM12)
+        {
+            asset.alphaNum12().issuer =
+                KeyUtils::fromStrKey<PublicKey>(issuerStrKey);
+            strToAssetCode(asset.alphaNum12().assetCode, assetCode);
+        }
+        else if (assetType == ASSET_TYPE_CREDIT_ALPHANUM4)
+        {
+            asset.alphaNum4().issuer =
+                KeyUtils::fromStrKey<PublicKey>(issuerStrKey);
+            strToAssetCode(asset.alphaNum4().assetCode, assetCode);
+        }
+    }
+}
+
+// sets `asset` from the binary columns type, code, issuer from `col`
+static void
+setAsset(Asset& asset, PostgresBinaryQuery const& q, int row, int col)
+{
+    bool hasCode = !q.isNull(row, col + 1) && !q.isNull(row, col + 2);
+    setAsset(asset, static_cast<unsigned int>(q.getInt(row, col)), hasCode,
+             hasCode ? q.getString(row, col + 1) : std::string(),
+             hasCode ? q.getString(row, col + 2) : std::string());
+}
+
+void
+OfferFrame::loadOffers(PostgresBinaryQuery const& q,
+                       std::function<void(LedgerEntry const&)> offerProcessor)
+{
+    LedgerEntry le;
+    le.data.type(OFFER);
+    OfferEntry& oe = le.data.offer();
+
+    for (int row = 0; row < q.rows(); ++row)
+    {
+        oe.sellerID = KeyUtils::fromStrKey<PublicKey>(q.getString(row, 0));
+        oe.offerID = static_cast<uint64>(q.getInt(row, 1));
+        setAsset(oe.selling, q, row, 2);
+        setAsset(oe.buying, q, row, 5);
+        oe.amount = q.getInt(row, 8);
+        oe.price.n = static_cast<int32>(q.getInt(row, 9));
+        oe.price.d = static_cast<int32>(q.getInt(row, 10));
+        oe.flags = static_cast<uint32>(q.getInt(row, 11));
+        le.lastModifiedLedgerSeq = static_cast<uint32>(q.getInt(row, 12));
+
+        offerProcessor(le);
+    }
+}
+
 void
 OfferFrame::loadOffers(StatementContext& prep,
                        std::function<void(LedgerEntry const&)> offerProcessor)
@@ -211,59 +292,14 @@ OfferFrame::loadOffers(StatementContext& prep,
     while (st.got_data())
     {
         oe.sellerID = KeyUtils::fromStrKey<PublicKey>(actIDStrKey);
-        if ((buyingAssetType > ASSET_TYPE_CREDIT_ALPHANUM12) ||
-            (sellingAssetType > ASSET_TYPE_CREDIT_ALPHANUM12))
-            throw std::runtime_error("bad database state");
-
-        oe.buying.type((AssetType)buyingAssetType);
-        oe.selling.type((AssetType)sellingAssetType);
-        if (sellingAssetType != ASSET_TYPE_NATIVE)
-        {
-            if ((sellingAssetCodeIndicator != soci::i_ok) ||
-                (sellingIssuerIndicator != soci::i_ok))
-            {
-                throw std::runtime_error("bad database state");
-            }
-
-            if (sellingAssetType == ASSET_TYPE_CREDIT_ALPHANUM12)
-            {
-                oe.selling.alphaNum12().issuer =
-                    KeyUtils::fromStrKey<PublicKey>(sellingIssuerStrKey);
-                strToAssetCode(oe.selling.alphaNum12().assetCode,
-                               sellingAssetCode);
-            }
-            else if (sellingAssetType == ASSET_TYPE_CREDIT_ALPHANUM4)
-            {
-                oe.selling.alphaNum4().issuer =
-                    KeyUtils::fromStrKey<PublicKey>(sellingIssuerStrKey);
-                strToAssetCode(oe.selling.alphaNum4().assetCode,
-                               sellingAssetCode);
-            }
-        }
-
-        if (buyingAssetType != ASSET_TYPE_NATIVE)
-        {
-            if ((buyingAssetCodeIndicator != soci::i_ok) ||
-                (buyingIssuerIndicator != soci::i_ok))
-            {
-                throw std::runtime_error("bad database state");
-            }
-
-            if (buyingAssetType == ASSET_TYPE_CREDIT_ALPHANUM12)
-            {
-                oe.buying.alphaNum12().issuer =
-                    KeyUtils::fromStrKey<PublicKey>(buyingIssuerStrKey);
-                strToAssetCode(oe.buying.alphaNum12().assetCode,
-                               buyingAssetCode);
-            }
-            else if (buyingAssetType == ASSET_TYPE_CREDIT_ALPHANUM4)
-            {
-                oe.buying.alphaNum4().issuer =
-                    KeyUtils::fromStrKey<PublicKey>(buyingIssuerStrKey);
-                strToAssetCode(oe.buying.alphaNum4().assetCode,
-                               buyingAssetCode);
-            }
-        }
+        setAsset(oe.selling, sellingAssetType,
+                 sellingAssetCodeIndicator == soci::i_ok &&
+                     sellingIssuerIndicator == soci::i_ok,
+                 sellingAssetCode, sellingIssuerStrKey);
+        setAsset(oe.buying, buyingAssetType,
+                 buyingAssetCodeIndicator == soci::i_ok &&
+                     buyingIssuerIndicator == soci::i_ok,
+                 buyingAssetCode, buyingIssuerStrKey);
 
         offerProcessor(le);
         st.fetch();
@@ -274,6 +310,44 @@ void
 OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
                            Asset const& selling, Asset const& buying,
                            vector<OfferFrame::pointer>& retOffers, Database& db)
+{
+    if (auto orderBook = db.getOrderBook())
+    {
+        orderBook->loadBestOffers(numOffers, offset, selling, buying,
+                                  retOffers);
+        return;
+    }
+
+    loadOffersForAssetPair(
+        selling, buying, true, numOffers, offset,
+        [&retOffers](LedgerEntry const& of) {
+            retOffers.emplace_back(make_shared<OfferFrame>(of));
+        },
+        db);
+}
+
+void
+OfferFrame::loadAllOffersForAssetPair(
+    Asset const& selling, Asset const& buying,
+    std::function<void(LedgerEntry const&)> offerProcessor, Database& db)
+{
+    loadOffersForAssetPair(selling, buying, false, 0, 0, offerProcessor, db);
+}
+
+void
+OfferFrame::loadBestOffersForAssetPair(
+    Asset const& selling, Asset const& buying, size_t numOffers,
+    std::function<void(LedgerEntry const&)> offerProcessor, Database& db)
+{
+    loadOffersForAssetPair(selling, buying, true, numOffers, 0, offerProcessor,
+                           db);
+}
+
+void
+OfferFrame::loadOffersForAssetPair(
+    Asset const& selling, Asset const& buying, bool limited, size_t numOffers,
+    size_t offset, std::function<void(LedgerEntry const&)> offerProcessor,
+    Database& db)
 {
     std::string sql = offerColumnSelector;
 
@@ -337,7 +411,34 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
 
     // price is an approximation of the actual n/d (truncated math, 15 digits)
     // ordering by offerid gives precendence to older offers for fairness
-    sql += " ORDER BY price, offerid LIMIT :n OFFSET :o";
+    sql += " ORDER BY price, offerid";
+    if (limited)
+    {
+        sql += " LIMIT :n OFFSET :o";
+    }
+
+    auto timer = db.getSelectTimer("offer");
+    if (!db.isSqlite())
+    {
+        std::vector<std::string> params;
+        if (useSellingAsset)
+        {
+            params.emplace_back(sellingAssetCode);
+            params.emplace_back(sellingIssuerStrKey);
+        }
+        if (useBuyingAsset)
+        {
+            params.emplace_back(buyingAssetCode);
+            params.emplace_back(buyingIssuerStrKey);
+        }
+        if (limited)
+        {
+            params.emplace_back(std::to_string(numOffers));
+            params.emplace_back(std::to_string(offset));
+        }
+        loadOffers(PostgresBinaryQuery(db, sql, params), offerProcessor);
+        return;
+    }
 
     auto prep = db.getPreparedStatement(sql);
     auto& st = prep.statement();
@@ -354,13 +455,13 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
         st.exchange(use(buyingIssuerStrKey));
     }
 
-    st.exchange(use(numOffers));
-    st.exchange(use(offset));
+    if (limited)
+    {
+        st.exchange(use(numOffers));
+        st.exchange(use(offset));
+    }
 
-    auto timer = db.getSelectTimer("offer");
-    loadOffers(prep, [&retOffers](LedgerEntry const& of) {
-        retOffers.emplace_back(make_shared<OfferFrame>(of));
-    });
+    loadOffers(prep, offerProcessor);
 }
 
 std::unordered_map<AccountID, std::vector<OfferFrame::pointer>>
@@ -379,6 +480,66 @@ OfferFrame::loadAllOffers(Database& db)
     return retOffers;
 }
 
+void
+OfferFrame::loadOffersBySeller(
+    size_t batchSize,
+    std::function<void(AccountID const&,
+                       std::vector<OfferFrame::pointer> const&)>
+        sellerProcessor,
+    Database& db)
+{
+    assert(batchSize > 0);
+    std::string sql = offerColumnSelector;
+    // keyset pagination: the offers of the sellers already processed may have
+    // changed, the ones after have not
+    sql += " WHERE sellerid > :s OR (sellerid = :s AND offerid > :o)"
+           " ORDER BY sellerid, offerid LIMIT :n";
+
+    std::string lastSeller;
+    uint64_t lastOfferID = 0;
+    // the offers of the last seller of a batch may go on in the next one
+    std::vector<OfferFrame::pointer> sellerOffers;
+    for (;;)
+    {
+        std::vector<OfferFrame::pointer> batch;
+        {
+            auto prep = db.getPreparedStatement(sql);
+            auto& st = prep.statement();
+            st.exchange(use(lastSeller, "s"));
+            st.exchange(use(lastOfferID, "o"));
+            st.exchange(use(batchSize, "n"));
+
+            auto timer = db.getSelectTimer("offer");
+            loadOffers(prep, [&batch](LedgerEntry const& of) {
+                batch.emplace_back(make_shared<OfferFrame>(of));
+            });
+        }
+
+        for (auto& offer : batch)
+        {
+            if (!sellerOffers.empty() &&
+                !(sellerOffers.front()->getSellerID() == offer->getSellerID()))
+            {
+                sellerProcessor(sellerOffers.front()->getSellerID(),
+                                sellerOffers);
+                sellerOffers.clear();
+            }
+            sellerOffers.emplace_back(std::move(offer));
+        }
+        if (batch.size() < batchSize)
+        {
+            break;
+        }
+        auto const& last = sellerOffers.back()->getOffer();
+        lastSeller = KeyUtils::toStrKey(last.sellerID);
+        lastOfferID = last.offerID;
+    }
+    if (!sellerOffers.empty())
+    {
+        sellerProcessor(sellerOffers.front()->getSellerID(), sellerOffers);
+    }
+}
+
 // Note: This function is currently only used in AllowTrustOpFrame, which means
 // the asset parameter will never satisfy asset.type() == ASSET_TYPE_NATIVE. As
 // a consequence, I have not implemented that possibility so this function
@@ -466,10 +627,13 @@ OfferFrame::deleteOffersModifiedOnOrAfterLedger(Database& db,
                                                 uint32_t oldestLedger)
 {
     db.getEntryCache().erase_if(
-        [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
-            return le && le->data.type() == OFFER &&
-                   le->lastModifiedLedgerSeq >= oldestLedger;
+        OFFER, [oldestLedger](std::shared_ptr<LedgerEntry const> const& le) {
+            return le && le->lastModifiedLedgerSeq >= oldestLedger;
         });
+    if (auto orderBook = db.getOrderBook())
+    {
+        orderBook->clear();
+    }
 
     {
         auto prep = db.getPreparedStatement(
@@ -496,9 +660,90 @@ OfferFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
     st.exchange(use(key.offer().offerID));
     st.define_and_bind();
     st.execute(true);
+    if (auto orderBook = db.getOrderBook())
+    {
+        orderBook->removeOffer(key.offer().offerID);
+    }
     delta.deleteEntry(key);
 }
 
+void
+OfferFrame::storeDeleteBatch(Database& db, std::vector<LedgerKey> const& keys)
+{
+    std::vector<uint64_t> offerIDs;
+    offerIDs.reserve(keys.size());
+    for (auto const& key : keys)
+    {
+        offerIDs.emplace_back(key.offer().offerID);
+    }
+
+    std::string const sql = "DELETE FROM offers WHERE offerid IN " +
+                            DatabaseUtils::makeInClause(
+                                DatabaseUtils::BATCH_LOAD_SIZE);
+    DatabaseUtils::forEachKeyBatch(offerIDs, [&](std::vector<uint64_t>& batch) {
+        auto timer = db.getDeleteTimer("offer-batch");
+        auto prep = db.getPreparedStatement(sql);
+        auto& st = prep.statement();
+        for (auto& id : batch)
+        {
+            st.exchange(use(id));
+        }
+        st.define_and_bind();
+        st.execute(true);
+    });
+    if (auto orderBook = db.getOrderBook())
+    {
+        for (auto id : offerIDs)
+        {
+            orderBook->removeOffer(id);
+        }
+    }
+}
+
+const char* OfferFrame::kSQLCopyColumns =
+    "sellerid, offerid, sellingassettype, sellingassetcode, sellingissuer, "
+    "buyingassettype, buyingassetcode, buyingissuer, amount, pricen, priced, "
+    "price, flags, lastmodified";
+
+static void
+copyAsset(PostgresCopyWriter& writer, Asset const& asset)
+{
+    writer.addUInt(asset.type());
+    std::string assetCode;
+    switch (asset.type())
+    {
+    case ASSET_TYPE_CREDIT_ALPHANUM4:
+        assetCodeToStr(asset.alphaNum4().assetCode, assetCode);
+        writer.addString(assetCode);
+        writer.addString(KeyUtils::toStrKey(asset.alphaNum4().issuer));
+        break;
+    case ASSET_TYPE_CREDIT_ALPHANUM12:
+        assetCodeToStr(asset.alphaNum12().assetCode, assetCode);
+        writer.addString(assetCode);
+        writer.addString(KeyUtils::toStrKey(asset.alphaNum12().issuer));
+        break;
+    default:
+        writer.addNull();
+        writer.addNull();
+    }
+}
+
+void
+OfferFrame::copyTo(PostgresCopyWriter& writer) const
+{
+    writer.addString(KeyUtils::toStrKey(mOffer.sellerID));
+    writer.addUInt(mOffer.offerID);
+    copyAsset(writer, mOffer.selling);
+    copyAsset(writer, mOffer.buying);
+    writer.addInt(mOffer.amount);
+    writer.addInt(mOffer.price.n);
+    writer.addInt(mOffer.price.d);
+    writer.addDouble(computePrice());
+    writer.addUInt(mOffer.flags);
+    writer.addUInt(getLastModified());
+    writer.endRow();
+}
+
 double
 OfferFrame::computePrice() const
 {
@@ -611,6 +856,11 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
         throw std::runtime_error("could not update SQL");
     }
 
+    if (auto orderBook = db.getOrderBook())
+    {
+        orderBook->addOrUpdateOffer(mEntry);
+    }
+
     if (insert)
     {
         delta.addEntry(*this);
@@ -624,6 +874,10 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
 void
 OfferFrame::dropAll(Database& db)
 {
+    if (auto orderBook = db.getOrderBook())
+    {
+        orderBook->clear();
+    }
     db.getSession() << "DROP TABLE IF EXISTS offers;";
     db.getSession() << kSQLCreateStatement1;
     db.getSession() << kSQLCreateStatement2;
@@ -18,6 +18,7 @@ namespace stellar
 {
 class LedgerRange;
 class ManageOfferOpFrame;
+class PostgresBinaryQuery;
 class StatementContext;
 
 int64_t getSellingLiabilities(OfferEntry const& oe);
@@ -28,6 +29,14 @@ class OfferFrame : public EntryFrame
     static void
     loadOffers(StatementContext& prep,
                std::function<void(LedgerEntry const&)> offerProcessor);
+    static void
+    loadOffers(PostgresBinaryQuery const& q,
+               std::function<void(LedgerEntry const&)> offerProcessor);
+
+    static void loadOffersForAssetPair(
+        Asset const& selling, Asset const& buying, bool limited,
+        size_t numOffers, size_t offset,
+        std::function<void(LedgerEntry const&)> offerProcessor, Database& db);
 
     double computePrice() const;
 
@@ -85,6 +94,16 @@ class OfferFrame : public EntryFrame
     // Static helpers that don't assume an instance.
     static void storeDelete(LedgerDelta& delta, Database& db,
                             LedgerKey const& key);
+    // Delete every offer in `keys` with multi-key statements. Does not record
+    // anything in a LedgerDelta: only meant for bulk writers such as
+    // BucketApplicator.
+    static void storeDeleteBatch(Database& db,
+                                 std::vector<LedgerKey> const& keys);
+
+    // Bulk loading support (see BucketApplicator): write this entry as a row
+    // of the offers table, laid out as kSQLCopyColumns.
+    void copyTo(PostgresCopyWriter& writer) const;
+    static const char* kSQLCopyColumns;
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
     static uint64_t countObjects(soci::session& sess,
@@ -101,10 +120,31 @@ class OfferFrame : public EntryFrame
                                std::vector<OfferFrame::pointer>& retOffers,
                                Database& db);
 
+    // loads all the offers selling `selling` for `buying`, best first, from
+    // the database (bypassing the resident order book if there is one)
+    static void loadAllOffersForAssetPair(
+        Asset const& selling, Asset const& buying,
+        std::function<void(LedgerEntry const&)> offerProcessor, Database& db);
+    // same, for the @p numOffers best offers only
+    static void loadBestOffersForAssetPair(
+        Asset const& selling, Asset const& buying, size_t numOffers,
+        std::function<void(LedgerEntry const&)> offerProcessor, Database& db);
+
     // load all offers from the database (very slow)
     static std::unordered_map<AccountID, std::vector<OfferFrame::pointer>>
     loadAllOffers(Database& db);
 
+    // calls `sellerProcessor` with the offers of each seller in turn, by
+    // seller then by offerID, loading them @p batchSize at a time: only a
+    // batch and the offers of one seller are in memory at once.
+    // `sellerProcessor` may change the offers of the seller it is given.
+    static void loadOffersBySeller(
+        size_t batchSize,
+        std::function<void(AccountID const&,
+                           std::vector<OfferFrame::pointer> const&)>
+            sellerProcessor,
+        Database& db);
+
     static std::vector<OfferFrame::pointer>
     loadOffersByAccountAndAsset(AccountID const& accountID, Asset const& asset,
                                 Database& db);
@@ -0,0 +1,262 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/OrderBook.h"
+#include "database/Database.h"
+#include "util/GlobalChecks.h"
+#include "util/Logging.h"
+#include "util/XDROperators.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace stellar
+{
+
+size_t const OrderBook::MIN_PREFIX_SIZE = 64;
+
+OrderBook::OrderBook(Database& db, bool prefixesOnly, medida::Meter& pairLoads,
+                     medida::Counter& residentOffers)
+    : mDb(db)
+    , mPrefixesOnly(prefixesOnly)
+    , mComplete(false)
+    , mPairLoads(pairLoads)
+    , mResidentOffers(residentOffers)
+{
+}
+
+OrderBook::OfferOrder
+OrderBook::getOrder(OfferEntry const& oe)
+{
+    // must be computed exactly like OfferFrame::computePrice, as that is the
+    // value the SQL query sorts on
+    return std::make_pair(double(oe.price.n) / double(oe.price.d), oe.offerID);
+}
+
+OrderBook::Book&
+OrderBook::getBook(AssetPair const& pair, size_t needed)
+{
+    auto stale = mStale.find(pair);
+    if (stale != mStale.end())
+    {
+        dropBook(pair);
+        mStale.erase(stale);
+    }
+    else
+    {
+        auto it = mBooks.find(pair);
+        if (it != mBooks.end())
+        {
+            if (it->second.size() >= needed ||
+                mLimits.find(pair) == mLimits.end())
+            {
+                return it->second;
+            }
+            needed = std::max(needed, it->second.size() * 2);
+            dropBook(pair);
+        }
+        else if (mComplete)
+        {
+            return mBooks[pair];
+        }
+    }
+
+    mPairLoads.Mark();
+    auto& book = mBooks[pair];
+    auto addOffer = [&](LedgerEntry const& le) {
+        auto order = getOrder(le.data.offer());
+        book.emplace(order, le);
+        mOfferIndex[le.data.offer().offerID] = OfferLocation{pair, order};
+    };
+    if (mPrefixesOnly)
+    {
+        auto numOffers = std::max(needed, MIN_PREFIX_SIZE);
+        OfferFrame::loadBestOffersForAssetPair(pair.first, pair.second,
+                                               numOffers, addOffer, mDb);
+        // a pair with fewer offers than that is resident as a whole
+        if (book.size() == numOffers)
+        {
+            mLimits[pair] = book.rbegin()->first;
+        }
+    }
+    else
+    {
+        OfferFrame::loadAllOffersForAssetPair(pair.first, pair.second,
+                                              addOffer, mDb);
+    }
+    mResidentOffers.set_count(mOfferIndex.size());
+    return book;
+}
+
+void
+OrderBook::loadBestOffers(size_t numOffers, size_t offset,
+                          Asset const& selling, Asset const& buying,
+                          std::vector<OfferFrame::pointer>& retOffers)
+{
+    assertThreadIsMain();
+    auto const& book = getBook(std::make_pair(selling, buying),
+                               offset + numOffers);
+    auto it = book.begin();
+    for (; it != book.end() && offset > 0; ++it, --offset)
+        ;
+    for (; it != book.end() && numOffers > 0; ++it, --numOffers)
+    {
+        retOffers.emplace_back(std::make_shared<OfferFrame>(it->second));
+    }
+}
+
+void
+OrderBook::eraseOffer(uint64_t offerID)
+{
+    auto loc = mOfferIndex.find(offerID);
+    if (loc == mOfferIndex.end())
+    {
+        return;
+    }
+    mUndoLog.emplace_back(loc->second.mPair);
+    auto book = mBooks.find(loc->second.mPair);
+    if (book != mBooks.end())
+    {
+        book->second.erase(loc->second.mOrder);
+        if (mComplete && book->second.empty())
+        {
+            mBooks.erase(book);
+        }
+    }
+    mOfferIndex.erase(loc);
+}
+
+void
+OrderBook::dropBook(AssetPair const& pair)
+{
+    auto book = mBooks.find(pair);
+    if (book == mBooks.end())
+    {
+        return;
+    }
+    for (auto const& o : book->second)
+    {
+        mOfferIndex.erase(o.first.second);
+    }
+    mBooks.erase(book);
+    mLimits.erase(pair);
+    mResidentOffers.set_count(mOfferIndex.size());
+}
+
+void
+OrderBook::addOrUpdateOffer(LedgerEntry const& offer)
+{
+    assertThreadIsMain();
+    auto const& oe = offer.data.offer();
+    eraseOffer(oe.offerID);
+
+    auto pair = std::make_pair(oe.selling, oe.buying);
+    mUndoLog.emplace_back(pair);
+
+    // a pair that is not resident yet (and not known to be empty) will pick
+    // this offer up from SQL when it gets loaded
+    auto book = mBooks.find(pair);
+    if (book == mBooks.end())
+    {
+        if (!mComplete || mStale.find(pair) != mStale.end())
+        {
+            mResidentOffers.set_count(mOfferIndex.size());
+            return;
+        }
+        book = mBooks.emplace(pair, Book{}).first;
+    }
+    auto order = getOrder(oe);
+    auto limit = mLimits.find(pair);
+    if (limit != mLimits.end() && limit->second < order)
+    {
+        // past the resident prefix
+        mResidentOffers.set_count(mOfferIndex.size());
+        return;
+    }
+    book->second[order] = offer;
+    mOfferIndex[oe.offerID] = OfferLocation{pair, order};
+    mResidentOffers.set_count(mOfferIndex.size());
+}
+
+void
+OrderBook::removeOffer(uint64_t offerID)
+{
+    assertThreadIsMain();
+    eraseOffer(offerID);
+    mResidentOffers.set_count(mOfferIndex.size());
+}
+
+size_t
+OrderBook::getUndoMark() const
+{
+    return mUndoLog.size();
+}
+
+void
+OrderBook::rollbackTo(size_t mark)
+{
+    for (size_t i = mark; i < mUndoLog.size(); i++)
+    {
+        // cannot reload right away: the SQL transaction matching the delta
+        // being rolled back is still open at this point
+        dropBook(mUndoLog[i]);
+        mStale.insert(mUndoLog[i]);
+    }
+    commitTo(mark);
+}
+
+void
+OrderBook::commitTo(size_t mark)
+{
+    if (mark < mUndoLog.size())
+    {
+        mUndoLog.resize(mark);
+    }
+}
+
+void
+OrderBook::clear()
+{
+    mBooks.clear();
+    mOfferIndex.clear();
+    mStale.clear();
+    mUndoLog.clear();
+    mLimits.clear();
+    mComplete = false;
+    mResidentOffers.set_count(0);
+}
+
+void
+OrderBook::rebuild()
+{
+    assert(!mPrefixesOnly);
+    clear();
+    auto offers = OfferFrame::loadAllOffers(mDb);
+    for (auto const& accountOffers : offers)
+    {
+        for (auto const& of : accountOffers.second)
+        {
+            auto const& oe = of->getOffer();
+            auto pair = std::make_pair(oe.selling, oe.buying);
+            auto order = getOrder(oe);
+            mBooks[pair].emplace(order, of->mEntry);
+            mOfferIndex[oe.offerID] = OfferLocation{pair, order};
+        }
+    }
+    mComplete = true;
+    mResidentOffers.set_count(mOfferIndex.size());
+    CLOG(INFO, "Ledger") << "Loaded " << mOfferIndex.size()
+                         << " offers in resident order book ("
+                         << mBooks.size() << " asset pairs)";
+}
+
+size_t
+OrderBook::size() const
+{
+    return mOfferIndex.size();
+}
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/OfferFrame.h"
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace medida
+{
+class Counter;
+class Meter;
+}
+
+namespace stellar
+{
+class Database;
+
+/**
+ * Optional resident copy of the offers table, indexed by (selling, buying)
+ * asset pair and sorted the same way as the SQL query backing
+ * OfferFrame::loadBestOffers (by price, then offerid), so that offer crossing
+ * does not issue repeated ORDER BY ... LIMIT ... OFFSET scans.
+ *
+ * The book is a write-through cache of the offers table: OfferFrame updates
+ * it after every successful SQL write. Books for an asset pair are loaded
+ * from SQL on first use, or all at once by `rebuild` (in which case pairs
+ * that are absent are known to be empty).
+ *
+ * Rollback follows the entry cache model: every write appends the touched
+ * pairs to an undo log, each LedgerDelta remembers the log position it
+ * started at, and rolling the delta back marks every pair touched since then
+ * as stale, to be reloaded from SQL (after the SQL transaction has been
+ * rolled back) on next use.
+ *
+ * A book can also keep only a prefix of each pair (for ORDER_BOOK_CACHE):
+ * the best offers up to a limit, past which writes are ignored as they are
+ * in SQL anyway. A prefix that turns out too short is loaded again with
+ * twice as many offers. Such a book is cleared after every ledger close, to
+ * only hold the pairs crossed recently.
+ *
+ * Only used from the main thread.
+ */
+class OrderBook : NonMovableOrCopyable
+{
+  public:
+    typedef std::pair<Asset, Asset> AssetPair; // (selling, buying)
+
+  private:
+    // (price, offerid): matches "ORDER BY price, offerid", where price is the
+    // same double stored in the offers table.
+    typedef std::pair<double, uint64_t> OfferOrder;
+    typedef std::map<OfferOrder, LedgerEntry> Book;
+
+    struct OfferLocation
+    {
+        AssetPair mPair;
+        OfferOrder mOrder;
+    };
+
+    Database& mDb;
+    std::map<AssetPair, Book> mBooks;
+    std::unordered_map<uint64_t, OfferLocation> mOfferIndex;
+    std::set<AssetPair> mStale;
+    std::vector<AssetPair> mUndoLog;
+
+    bool const mPrefixesOnly;
+    // for the books that are a prefix of their pair: the order of the last
+    // offer loaded (offers past it are not resident)
+    std::map<AssetPair, OfferOrder> mLimits;
+
+    // when true, every asset pair is resident and a missing pair is empty
+    bool mComplete;
+
+    medida::Meter& mPairLoads;
+    medida::Counter& mResidentOffers;
+
+    static OfferOrder getOrder(OfferEntry const& oe);
+
+    // @p needed is the number of offers the caller is going to look at
+    Book& getBook(AssetPair const& pair, size_t needed);
+    void eraseOffer(uint64_t offerID);
+    void dropBook(AssetPair const& pair);
+
+  public:
+    // offers loaded at least when loading the prefix of a pair
+    static size_t const MIN_PREFIX_SIZE;
+
+    OrderBook(Database& db, bool prefixesOnly, medida::Meter& pairLoads,
+              medida::Counter& residentOffers);
+
+    bool
+    keepsPrefixesOnly() const
+    {
+        return mPrefixesOnly;
+    }
+
+    // Same contract as OfferFrame::loadBestOffers.
+    void loadBestOffers(size_t numOffers, size_t offset, Asset const& selling,
+                        Asset const& buying,
+                        std::vector<OfferFrame::pointer>& retOffers);
+
+    // Write-through notifications from OfferFrame, called once the matching
+    // SQL statement has succeeded.
+    void addOrUpdateOffer(LedgerEntry const& offer);
+    void removeOffer(uint64_t offerID);
+
+    // Undo log management, see above.
+    size_t getUndoMark() const;
+    void rollbackTo(size_t mark);
+    void commitTo(size_t mark);
+
+    // Forget everything; books are reloaded lazily.
+    void clear();
+
+    // Load every offer from the database (not for a book of prefixes).
+    void rebuild();
+
+    size_t size() const;
+};
+}
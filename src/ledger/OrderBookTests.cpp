@@ -0,0 +1,220 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "database/Database.h"
+#include "ledger/LedgerDelta.h"
+#include "ledger/LedgerManager.h"
+#include "ledger/LedgerTestUtils.h"
+#include "ledger/OfferFrame.h"
+#include "ledger/OrderBook.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/Timer.h"
+#include "util/types.h"
+
+using namespace stellar;
+
+namespace
+{
+std::vector<LedgerEntry>
+loadBestFromSQL(Asset const& selling, Asset const& buying, Database& db)
+{
+    std::vector<LedgerEntry> res;
+    OfferFrame::loadAllOffersForAssetPair(
+        selling, buying, [&res](LedgerEntry const& le) { res.push_back(le); },
+        db);
+    return res;
+}
+
+std::vector<LedgerEntry>
+loadBestFromBook(Asset const& selling, Asset const& buying, Database& db)
+{
+    std::vector<LedgerEntry> res;
+    size_t offset = 0;
+    for (;;)
+    {
+        std::vector<OfferFrame::pointer> batch;
+        OfferFrame::loadBestOffers(5, offset, selling, buying, batch, db);
+        if (batch.empty())
+        {
+            break;
+        }
+        for (auto const& of : batch)
+        {
+            res.push_back(of->mEntry);
+        }
+        offset += batch.size();
+    }
+    return res;
+}
+}
+
+TEST_CASE("resident order book", "[ledger][orderbook]")
+{
+    Config cfg(getTestConfig(0));
+    cfg.IN_MEMORY_ORDER_BOOK = true;
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+    REQUIRE(db.getOrderBook());
+
+    auto issuer = LedgerTestUtils::generateValidAccountEntry(5).accountID;
+    Asset selling = txtest::makeNativeAsset();
+    Asset buying;
+    buying.type(ASSET_TYPE_CREDIT_ALPHANUM4);
+    strToAssetCode(buying.alphaNum4().assetCode, "USD");
+    buying.alphaNum4().issuer = issuer;
+
+    LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+    LedgerDelta delta(lh, db, false);
+
+    uint64_t nextOfferID = 1;
+    auto addOffer = [&](LedgerDelta& d, int32_t n, int32_t dd) {
+        LedgerEntry le;
+        le.data.type(OFFER);
+        auto& oe = le.data.offer();
+        oe = LedgerTestUtils::generateValidOfferEntry(5);
+        oe.offerID = nextOfferID++;
+        oe.selling = selling;
+        oe.buying = buying;
+        oe.price = Price{n, dd};
+        OfferFrame of(le);
+        of.storeAdd(d, db);
+        return oe.offerID;
+    };
+
+    auto checkBook = [&]() {
+        REQUIRE(loadBestFromBook(selling, buying, db) ==
+                loadBestFromSQL(selling, buying, db));
+        REQUIRE(loadBestFromBook(buying, selling, db) ==
+                loadBestFromSQL(buying, selling, db));
+    };
+
+    // several offers with identical prices, to check the offerid tie break
+    for (int32_t i = 0; i < 40; i++)
+    {
+        addOffer(delta, 1 + (i % 7), 3);
+    }
+    checkBook();
+
+    SECTION("updates and deletes are written through")
+    {
+        std::vector<OfferFrame::pointer> best;
+        OfferFrame::loadBestOffers(3, 0, selling, buying, best, db);
+        REQUIRE(best.size() == 3);
+        best[0]->getOffer().price = Price{100, 1};
+        best[0]->storeChange(delta, db);
+        best[1]->storeDelete(delta, db);
+        best[2]->getOffer().buying = selling;
+        best[2]->getOffer().selling = buying;
+        best[2]->storeChange(delta, db);
+        checkBook();
+    }
+
+    SECTION("rollback invalidates touched pairs")
+    {
+        {
+            soci::transaction sqlTx(db.getSession());
+            LedgerDelta inner(delta);
+            addOffer(inner, 1, 100);
+            std::vector<OfferFrame::pointer> best;
+            OfferFrame::loadBestOffers(1, 0, selling, buying, best, db);
+            REQUIRE(best.size() == 1);
+            REQUIRE(best[0]->getPrice() == Price(1, 100));
+            best[0]->storeDelete(inner, db);
+        }
+        checkBook();
+    }
+
+    SECTION("rebuild")
+    {
+        db.getOrderBook()->rebuild();
+        REQUIRE(db.getOrderBook()->size() == 40);
+        checkBook();
+        addOffer(delta, 2, 1);
+        checkBook();
+    }
+}
+
+TEST_CASE("order book cache", "[ledger][orderbook]")
+{
+    Config cfg(getTestConfig(0));
+    cfg.ORDER_BOOK_CACHE = true;
+
+    VirtualClock clock;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+    Database& db = app->getDatabase();
+    auto orderBook = db.getOrderBook();
+    REQUIRE(orderBook);
+    REQUIRE(orderBook->keepsPrefixesOnly());
+
+    auto issuer = LedgerTestUtils::generateValidAccountEntry(5).accountID;
+    Asset selling = txtest::makeNativeAsset();
+    Asset buying;
+    buying.type(ASSET_TYPE_CREDIT_ALPHANUM4);
+    strToAssetCode(buying.alphaNum4().assetCode, "USD");
+    buying.alphaNum4().issuer = issuer;
+
+    LedgerHeader lh(app->getLedgerManager().getCurrentLedgerHeader());
+    LedgerDelta delta(lh, db, false);
+
+    uint64_t nextOfferID = 1;
+    auto addOffer = [&](int32_t n, int32_t d) {
+        LedgerEntry le;
+        le.data.type(OFFER);
+        auto& oe = le.data.offer();
+        oe = LedgerTestUtils::generateValidOfferEntry(5);
+        oe.offerID = nextOfferID++;
+        oe.selling = selling;
+        oe.buying = buying;
+        oe.price = Price{n, d};
+        OfferFrame of(le);
+        of.storeAdd(delta, db);
+    };
+    auto best = [&](size_t numOffers) {
+        std::vector<OfferFrame::pointer> res;
+        OfferFrame::loadBestOffers(numOffers, 0, selling, buying, res, db);
+        return res;
+    };
+
+    auto const nbOffers = OrderBook::MIN_PREFIX_SIZE * 3;
+    for (size_t i = 0; i < nbOffers; i++)
+    {
+        addOffer(1 + (i % 13), 7);
+    }
+    // only the pairs that are crossed are loaded, and only their best offers
+    REQUIRE(orderBook->size() == 0);
+    REQUIRE(best(5).size() == 5);
+    REQUIRE(orderBook->size() == OrderBook::MIN_PREFIX_SIZE);
+
+    SECTION("offers past the prefix are not kept")
+    {
+        addOffer(100, 1);
+        REQUIRE(orderBook->size() == OrderBook::MIN_PREFIX_SIZE);
+        addOffer(1, 100);
+        REQUIRE(orderBook->size() == OrderBook::MIN_PREFIX_SIZE + 1);
+        REQUIRE(best(1)[0]->getPrice() == Price(1, 100));
+        REQUIRE(loadBestFromBook(selling, buying, db) ==
+                loadBestFromSQL(selling, buying, db));
+    }
+
+    SECTION("crossing past the prefix loads more offers")
+    {
+        for (auto const& of : best(OrderBook::MIN_PREFIX_SIZE - 1))
+        {
+            of->storeDelete(delta, db);
+        }
+        REQUIRE(orderBook->size() == 1);
+        REQUIRE(best(5).size() == 5);
+        REQUIRE(orderBook->size() == OrderBook::MIN_PREFIX_SIZE);
+        REQUIRE(loadBestFromBook(selling, buying, db) ==
+                loadBestFromSQL(selling, buying, db));
+    }
+}
@@ -4,30 +4,86 @@
 
 #include "ledger/SyncingLedgerChain.h"
 #include "herder/LedgerCloseData.h"
+#include "util/XDRStream.h"
+
+#include <cstdio>
+#include <xdrpp/marshal.h>
 
 namespace stellar
 {
 
+namespace
+{
+size_t
+envelopesSize(TxSetFrame const& txSet)
+{
+    size_t res = 0;
+    for (auto const& tx : txSet.mTransactions)
+    {
+        res += xdr::xdr_size(tx->getEnvelope());
+    }
+    return res;
+}
+}
+
 SyncingLedgerChain::SyncingLedgerChain() = default;
-SyncingLedgerChain::SyncingLedgerChain(SyncingLedgerChain const&) = default;
-SyncingLedgerChain::~SyncingLedgerChain() = default;
+SyncingLedgerChain::SyncingLedgerChain(SyncingLedgerChain&&) = default;
+
+SyncingLedgerChain::~SyncingLedgerChain()
+{
+    clear();
+}
+
+void
+SyncingLedgerChain::setSpill(size_t maxMemoryBytes,
+                             std::string const& spillFile,
+                             Hash const& networkID)
+{
+    mMaxMemoryBytes = maxMemoryBytes;
+    mSpillFile = spillFile;
+    mNetworkID = networkID;
+}
 
 SyncingLedgerChainAddResult
 SyncingLedgerChain::add(LedgerCloseData lcd)
 {
-    if (mChain.empty() ||
-        mChain.back().getLedgerSeq() + 1 == lcd.getLedgerSeq())
+    if (!empty() && back().getLedgerSeq() + 1 != lcd.getLedgerSeq())
+    {
+        if (lcd.getLedgerSeq() <= back().getLedgerSeq())
+        {
+            return SyncingLedgerChainAddResult::TOO_OLD;
+        }
+        return SyncingLedgerChainAddResult::TOO_NEW;
+    }
+
+    auto bytes = envelopesSize(*lcd.getTxSet());
+    // once ledgers are spilled, the next ones are as well to keep the order
+    bool inMemory = mSpilled == 0 && (mMaxMemoryBytes == 0 ||
+                                      mMemoryBytes < mMaxMemoryBytes);
+    if (mChain.empty() || inMemory)
     {
+        mMemoryBytes += bytes;
         mChain.emplace_back(std::move(lcd));
+        mBack.reset();
         return SyncingLedgerChainAddResult::CONTIGUOUS;
     }
 
-    if (lcd.getLedgerSeq() <= mChain.back().getLedgerSeq())
+    if (!mSpillOut)
     {
-        return SyncingLedgerChainAddResult::TOO_OLD;
+        mSpillOut = std::make_unique<XDROutputFileStream>();
+        mSpillOut->open(mSpillFile);
     }
-
-    return SyncingLedgerChainAddResult::TOO_NEW;
+    TransactionHistoryEntry entry;
+    entry.ledgerSeq = lcd.getLedgerSeq();
+    lcd.getTxSet()->toXDR(entry.txSet);
+    if (!mSpillOut->writeOne(entry) || !mSpillOut->writeOne(lcd.getValue()))
+    {
+        throw std::runtime_error("Could not write buffered ledgers to " +
+                                 mSpillFile);
+    }
+    mSpilled++;
+    mBack = std::make_unique<LedgerCloseData>(std::move(lcd));
+    return SyncingLedgerChainAddResult::CONTIGUOUS;
 }
 
 LedgerCloseData const&
@@ -39,7 +95,7 @@ SyncingLedgerChain::front() const
 LedgerCloseData const&
 SyncingLedgerChain::back() const
 {
-    return mChain.back();
+    return mBack ? *mBack : mChain.back();
 }
 
 bool
@@ -48,21 +104,60 @@ SyncingLedgerChain::empty() const
     return mChain.empty();
 }
 
-SyncingLedgerChain::size_type
+size_t
 SyncingLedgerChain::size() const
 {
-    return mChain.size();
+    return mChain.size() + mSpilled;
 }
 
-SyncingLedgerChain::const_iterator
-SyncingLedgerChain::begin() const
+size_t
+SyncingLedgerChain::spilled() const
 {
-    return std::begin(mChain);
+    return mSpilled;
+}
+
+void
+SyncingLedgerChain::forEach(
+    std::function<void(LedgerCloseData const&)> f) const
+{
+    for (auto const& lcd : mChain)
+    {
+        f(lcd);
+    }
+    if (mSpilled == 0)
+    {
+        return;
+    }
+
+    mSpillOut->flush();
+    XDRInputFileStream in;
+    in.open(mSpillFile);
+    TransactionHistoryEntry entry;
+    StellarValue sv;
+    for (size_t i = 0; i < mSpilled; i++)
+    {
+        if (!in.readOne(entry) || !in.readOne(sv))
+        {
+            throw std::runtime_error("Could not read buffered ledgers from " +
+                                     mSpillFile);
+        }
+        auto txSet = std::make_shared<TxSetFrame>(mNetworkID, entry.txSet);
+        f(LedgerCloseData{entry.ledgerSeq, txSet, sv});
+    }
 }
 
-SyncingLedgerChain::const_iterator
-SyncingLedgerChain::end() const
+void
+SyncingLedgerChain::clear()
 {
-    return std::end(mChain);
+    mChain.clear();
+    mBack.reset();
+    mMemoryBytes = 0;
+    mSpilled = 0;
+    if (mSpillOut)
+    {
+        mSpillOut->close();
+        mSpillOut.reset();
+        std::remove(mSpillFile.c_str());
+    }
 }
 }
@@ -4,12 +4,18 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "overlay/StellarXDR.h"
+
+#include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace stellar
 {
 
 class LedgerCloseData;
+class XDROutputFileStream;
 
 enum class SyncingLedgerChainAddResult
 {
@@ -18,27 +24,51 @@ enum class SyncingLedgerChainAddResult
     TOO_NEW
 };
 
+/**
+ * Ledgers closed by the network during a catchup, replayed once it is done.
+ *
+ * Without a limit (see setSpill) they are all kept in memory. Past the
+ * limit, counted in bytes of transaction envelopes, the ones added next are
+ * appended to a spill file instead, and read back by forEach: only the first
+ * ledgers and the last one stay in memory.
+ */
 class SyncingLedgerChain final
 {
   public:
-    using storage = std::vector<LedgerCloseData>;
-    using const_iterator = storage::const_iterator;
-    using size_type = storage::size_type;
-
     SyncingLedgerChain();
-    SyncingLedgerChain(SyncingLedgerChain const&);
+    SyncingLedgerChain(SyncingLedgerChain&&);
     ~SyncingLedgerChain();
 
+    // Spill to @p spillFile (created when needed, removed by clear) once
+    // @p maxMemoryBytes are buffered; transaction sets read back are built
+    // for @p networkID. 0 keeps every ledger in memory.
+    void setSpill(size_t maxMemoryBytes, std::string const& spillFile,
+                  Hash const& networkID);
+
     SyncingLedgerChainAddResult add(LedgerCloseData lcd);
 
     LedgerCloseData const& front() const;
     LedgerCloseData const& back() const;
     bool empty() const;
-    size_type size() const;
-    const_iterator begin() const;
-    const_iterator end() const;
+    size_t size() const;
+    // number of ledgers in the spill file
+    size_t spilled() const;
+
+    // calls @p f with every ledger, in order
+    void forEach(std::function<void(LedgerCloseData const&)> f) const;
+
+    // forgets every ledger
+    void clear();
 
   private:
-    storage mChain;
+    std::vector<LedgerCloseData> mChain;
+    std::unique_ptr<LedgerCloseData> mBack;
+    size_t mMemoryBytes{0};
+
+    size_t mMaxMemoryBytes{0};
+    std::string mSpillFile;
+    Hash mNetworkID;
+    std::unique_ptr<XDROutputFileStream> mSpillOut;
+    size_t mSpilled{0};
 };
 }
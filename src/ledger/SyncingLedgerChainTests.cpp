@@ -6,6 +6,9 @@
 #include "herder/LedgerCloseData.h"
 #include "ledger/SyncingLedgerChain.h"
 #include "lib/catch.hpp"
+#include "transactions/TransactionFrame.h"
+#include "util/Fs.h"
+#include "util/TmpDir.h"
 
 #include <memory>
 
@@ -22,6 +25,18 @@ makeLedgerCloseData(uint32_t ledgerSeq)
     sv.txSetHash = txSet->getContentsHash();
     return LedgerCloseData{ledgerSeq, txSet, sv};
 }
+
+LedgerCloseData
+makeLedgerCloseDataWithTx(uint32_t ledgerSeq)
+{
+    auto txSet = std::make_shared<TxSetFrame>(sha256("a"));
+    TransactionEnvelope env;
+    env.tx.seqNum = ledgerSeq;
+    txSet->add(TransactionFrame::makeTransactionFromWire(sha256("a"), env));
+    auto sv = StellarValue{};
+    sv.txSetHash = txSet->getContentsHash();
+    return LedgerCloseData{ledgerSeq, txSet, sv};
+}
 }
 
 TEST_CASE("empty syncing ledger chain accepts anything",
@@ -89,3 +104,42 @@ TEST_CASE("not empty syncing ledger chain accepts next ledger after failure",
     REQUIRE(ledgerChain.size() == 2);
     REQUIRE(ledgerChain.back().getLedgerSeq() == 2);
 }
+
+TEST_CASE("syncing ledger chain spills ledgers past its memory limit",
+          "[ledger][ledgerchain]")
+{
+    TmpDir dir("spill");
+    auto spillFile = dir.getName() + "/ledgers.xdr";
+    auto ledgerChain = SyncingLedgerChain{};
+    ledgerChain.setSpill(1, spillFile, sha256("a"));
+
+    std::vector<Hash> hashes;
+    for (uint32_t i = 1; i <= 5; i++)
+    {
+        auto lcd = makeLedgerCloseDataWithTx(i);
+        hashes.emplace_back(lcd.getTxSet()->getContentsHash());
+        REQUIRE(ledgerChain.add(lcd) ==
+                SyncingLedgerChainAddResult::CONTIGUOUS);
+    }
+    REQUIRE(ledgerChain.add(makeLedgerCloseDataWithTx(5)) ==
+            SyncingLedgerChainAddResult::TOO_OLD);
+
+    // only the first one fits
+    REQUIRE(ledgerChain.size() == 5);
+    REQUIRE(ledgerChain.spilled() == 4);
+    REQUIRE(ledgerChain.front().getLedgerSeq() == 1);
+    REQUIRE(ledgerChain.back().getLedgerSeq() == 5);
+
+    uint32_t seq = 1;
+    ledgerChain.forEach([&](LedgerCloseData const& lcd) {
+        REQUIRE(lcd.getLedgerSeq() == seq);
+        REQUIRE(lcd.getTxSet()->getContentsHash() == hashes[seq - 1]);
+        REQUIRE(lcd.getValue().txSetHash == hashes[seq - 1]);
+        seq++;
+    });
+    REQUIRE(seq == 6);
+
+    ledgerChain.clear();
+    REQUIRE(ledgerChain.empty());
+    REQUIRE(!fs::exists(spillFile));
+}
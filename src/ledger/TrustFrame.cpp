@@ -8,10 +8,15 @@
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
+#include "database/DatabaseUtils.h"
+#include "database/PostgresBinaryQuery.h"
+#include "database/PostgresCopyWriter.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerRange.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
+#include <set>
 
 using namespace std;
 using namespace soci;
@@ -274,7 +279,9 @@ TrustFrame::getMaxAmountReceive(LedgerManager& lm) const
 bool
 TrustFrame::exists(Database& db, LedgerKey const& key)
 {
-    if (cachedEntryExists(key, db) && getCachedEntry(key, db) != nullptr)
+    auto cacheKey = makeLedgerEntryCacheKey(key);
+    if (cachedEntryExists(key, cacheKey, db) &&
+        getCachedEntry(key, cacheKey, db) != nullptr)
     {
         return true;
     }
@@ -319,9 +326,8 @@ TrustFrame::deleteTrustLinesModifiedOnOrAfterLedger(Database& db,
                                                     uint32_t oldestLedger)
 {
     db.getEntryCache().erase_if(
-        [oldestLedger](std::shared_ptr<LedgerEntry const> le) -> bool {
-            return le && le->data.type() == TRUSTLINE &&
-                   le->lastModifiedLedgerSeq >= oldestLedger;
+        TRUSTLINE, [oldestLedger](std::shared_ptr<LedgerEntry const> const& le) {
+            return le && le->lastModifiedLedgerSeq >= oldestLedger;
         });
 
     {
@@ -406,6 +412,38 @@ TrustFrame::storeChange(LedgerDelta& delta, Database& db)
     delta.modEntry(*this);
 }
 
+const char* TrustFrame::kSQLCopyColumns =
+    "accountid, assettype, issuer, assetcode, balance, tlimit, flags, "
+    "lastmodified, buyingliabilities, sellingliabilities";
+
+void
+TrustFrame::copyTo(PostgresCopyWriter& writer) const
+{
+    std::string actIDStrKey, issuerStrKey, assetCode;
+    getKeyFields(getKey(), actIDStrKey, issuerStrKey, assetCode);
+
+    writer.addString(actIDStrKey);
+    writer.addUInt(mTrustLine.asset.type());
+    writer.addString(issuerStrKey);
+    writer.addString(assetCode);
+    writer.addInt(mTrustLine.balance);
+    writer.addInt(mTrustLine.limit);
+    writer.addUInt(mTrustLine.flags);
+    writer.addUInt(getLastModified());
+    if (mTrustLine.ext.v() == 1)
+    {
+        auto const& liabilities = mTrustLine.ext.v1().liabilities;
+        writer.addInt(liabilities.buying);
+        writer.addInt(liabilities.selling);
+    }
+    else
+    {
+        writer.addNull();
+        writer.addNull();
+    }
+    writer.endRow();
+}
+
 void
 TrustFrame::storeAdd(LedgerDelta& delta, Database& db)
 {
@@ -501,9 +539,10 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
     key.type(TRUSTLINE);
     key.trustLine().accountID = accountID;
     key.trustLine().asset = asset;
-    if (cachedEntryExists(key, db))
+    auto cacheKey = makeLedgerEntryCacheKey(key);
+    if (cachedEntryExists(key, cacheKey, db))
     {
-        auto p = getCachedEntry(key, db);
+        auto p = getCachedEntry(key, cacheKey, db);
         if (p)
         {
             pointer ret = std::make_shared<TrustFrame>(*p);
@@ -513,6 +552,10 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
             }
             return ret;
         }
+        if (db.getEntryCache().isResident(TRUSTLINE))
+        {
+            return nullptr;
+        }
     }
 
     std::string accStr, issuerStr, assetStr;
@@ -533,25 +576,36 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
     query += (" WHERE accountid = :id "
               " AND issuer = :issuer "
               " AND assetcode = :asset");
-    auto prep = db.getPreparedStatement(query);
-    auto& st = prep.statement();
-    st.exchange(use(accStr));
-    st.exchange(use(issuerStr));
-    st.exchange(use(assetStr));
 
     pointer retLine;
-    auto timer = db.getSelectTimer("trust");
-    loadLines(prep, [&retLine](LedgerEntry const& trust) {
+    auto processor = [&retLine](LedgerEntry const& trust) {
         retLine = make_shared<TrustFrame>(trust);
-    });
+    };
+    auto timer = db.getSelectTimer("trust");
+    if (!db.isSqlite())
+    {
+        loadLines(PostgresBinaryQuery(db, query, {accStr, issuerStr, assetStr}),
+                  processor);
+    }
+    else
+    {
+        auto prep = db.getPreparedStatement(query);
+        auto& st = prep.statement();
+        st.exchange(use(accStr));
+        st.exchange(use(issuerStr));
+        st.exchange(use(assetStr));
+        loadLines(prep, processor);
+    }
 
     if (retLine)
     {
-        retLine->putCachedEntry(db);
+        putCachedEntry(key, cacheKey,
+                       std::make_shared<LedgerEntry const>(retLine->mEntry),
+                       db);
     }
     else
     {
-        putCachedEntry(key, nullptr, db);
+        putCachedEntry(key, cacheKey, nullptr, db);
     }
 
     if (delta && retLine)
@@ -572,6 +626,58 @@ TrustFrame::loadTrustLineIssuer(AccountID const& accountID, Asset const& asset,
     return res;
 }
 
+static void
+setAsset(Asset& asset, unsigned int assetType, std::string const& issuerStrKey,
+         std::string const& assetCode)
+{
+    asset.type((AssetType)assetType);
+    if (assetType == ASSET_TYPE_CREDIT_ALPHANUM4)
+    {
+        asset.alphaNum4().issuer = KeyUtils::fromStrKey<PublicKey>(issuerStrKey);
+        strToAssetCode(asset.alphaNum4().assetCode, assetCode);
+    }
+    else if (assetType == ASSET_TYPE_CREDIT_ALPHANUM12)
+    {
+        asset.alphaNum12().issuer =
+            KeyUtils::fromStrKey<PublicKey>(issuerStrKey);
+        strToAssetCode(asset.alphaNum12().assetCode, assetCode);
+    }
+}
+
+void
+TrustFrame::loadLines(PostgresBinaryQuery const& q,
+                      std::function<void(LedgerEntry const&)> trustProcessor)
+{
+    LedgerEntry le;
+    le.data.type(TRUSTLINE);
+    TrustLineEntry& tl = le.data.trustLine();
+
+    for (int row = 0; row < q.rows(); ++row)
+    {
+        tl.accountID = KeyUtils::fromStrKey<PublicKey>(q.getString(row, 0));
+        setAsset(tl.asset, static_cast<unsigned int>(q.getInt(row, 1)),
+                 q.getString(row, 2), q.getString(row, 3));
+        tl.limit = q.getInt(row, 4);
+        tl.balance = q.getInt(row, 5);
+        tl.flags = static_cast<uint32>(q.getInt(row, 6));
+        le.lastModifiedLedgerSeq = static_cast<uint32>(q.getInt(row, 7));
+
+        assert(q.isNull(row, 8) == q.isNull(row, 9));
+        if (!q.isNull(row, 8))
+        {
+            tl.ext.v(1);
+            tl.ext.v1().liabilities.buying = q.getInt(row, 8);
+            tl.ext.v1().liabilities.selling = q.getInt(row, 9);
+        }
+        else
+        {
+            tl.ext.v(0);
+        }
+
+        trustProcessor(le);
+    }
+}
+
 void
 TrustFrame::loadLines(StatementContext& prep,
                       std::function<void(LedgerEntry const&)> trustProcessor)
@@ -606,19 +712,7 @@ TrustFrame::loadLines(StatementContext& prep,
     while (st.got_data())
     {
         tl.accountID = KeyUtils::fromStrKey<PublicKey>(actIDStrKey);
-        tl.asset.type((AssetType)assetType);
-        if (assetType == ASSET_TYPE_CREDIT_ALPHANUM4)
-        {
-            tl.asset.alphaNum4().issuer =
-                KeyUtils::fromStrKey<PublicKey>(issuerStrKey);
-            strToAssetCode(tl.asset.alphaNum4().assetCode, assetCode);
-        }
-        else if (assetType == ASSET_TYPE_CREDIT_ALPHANUM12)
-        {
-            tl.asset.alphaNum12().issuer =
-                KeyUtils::fromStrKey<PublicKey>(issuerStrKey);
-            strToAssetCode(tl.asset.alphaNum12().assetCode, assetCode);
-        }
+        setAsset(tl.asset, assetType, issuerStrKey, assetCode);
 
         assert(buyingLiabilitiesInd == sellingLiabilitiesInd);
         if (buyingLiabilitiesInd == soci::i_ok)
@@ -652,6 +746,68 @@ TrustFrame::loadLines(AccountID const& accountID,
     });
 }
 
+void
+TrustFrame::prefetchTrustLines(std::vector<LedgerKey> const& keys,
+                               Database& db)
+{
+    std::set<LedgerKey, LedgerEntryIdCmp> wanted;
+    std::set<AccountID> accounts;
+    for (auto const& key : keys)
+    {
+        assert(key.type() == TRUSTLINE);
+        auto const& tl = key.trustLine();
+        if (tl.asset.type() == ASSET_TYPE_NATIVE ||
+            tl.accountID == getIssuer(tl.asset))
+        {
+            continue;
+        }
+        // a null entry only tells absence when the cache is resident
+        auto cacheKey = makeLedgerEntryCacheKey(key);
+        if (cachedEntryExists(key, cacheKey, db) &&
+            (getCachedEntry(key, cacheKey, db) ||
+             db.getEntryCache().isResident(TRUSTLINE)))
+        {
+            continue;
+        }
+        wanted.insert(key);
+        accounts.insert(tl.accountID);
+    }
+    if (wanted.empty())
+    {
+        return;
+    }
+
+    std::vector<std::string> strKeys;
+    strKeys.reserve(accounts.size());
+    for (auto const& id : accounts)
+    {
+        strKeys.emplace_back(KeyUtils::toStrKey(id));
+    }
+
+    auto query = std::string(trustLineColumnSelector);
+    query += " WHERE accountid IN ";
+    query += DatabaseUtils::makeInClause(DatabaseUtils::BATCH_LOAD_SIZE);
+
+    DatabaseUtils::forEachKeyBatch(
+        strKeys, [&](std::vector<std::string>& batch) {
+            auto prep = db.getPreparedStatement(query);
+            auto& st = prep.statement();
+            for (auto& k : batch)
+            {
+                st.exchange(use(k));
+            }
+
+            auto timer = db.getSelectTimer("trust-batch");
+            loadLines(prep, [&](LedgerEntry const& trust) {
+                auto key = LedgerEntryKey(trust);
+                if (wanted.find(key) != wanted.end())
+                {
+                    TrustFrame(trust).putCachedEntry(db);
+                }
+            });
+        });
+}
+
 std::unordered_map<AccountID, std::vector<TrustFrame::pointer>>
 TrustFrame::loadAllLines(Database& db)
 {
@@ -22,6 +22,7 @@ namespace stellar
 {
 
 class LedgerRange;
+class PostgresBinaryQuery;
 class TrustSetTx;
 class StatementContext;
 
@@ -41,6 +42,9 @@ class TrustFrame : public EntryFrame
     static void
     loadLines(StatementContext& prep,
               std::function<void(LedgerEntry const&)> trustProcessor);
+    static void
+    loadLines(PostgresBinaryQuery const& q,
+              std::function<void(LedgerEntry const&)> trustProcessor);
 
     TrustLineEntry& mTrustLine;
 
@@ -68,6 +72,11 @@ class TrustFrame : public EntryFrame
     // Static helper that don't assume an instance.
     static void storeDelete(LedgerDelta& delta, Database& db,
                             LedgerKey const& key);
+
+    // Bulk loading support (see BucketApplicator): write this entry as a row
+    // of the trustlines table, laid out as kSQLCopyColumns.
+    void copyTo(PostgresCopyWriter& writer) const;
+    static const char* kSQLCopyColumns;
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
     static uint64_t countObjects(soci::session& sess,
@@ -89,6 +98,12 @@ class TrustFrame : public EntryFrame
                           std::vector<TrustFrame::pointer>& retLines,
                           Database& db);
 
+    // Load the trust lines identified by `keys` (all of type TRUSTLINE) that
+    // are not already in the entry cache, grouping the queries by account,
+    // and store the ones found in the entry cache.
+    static void prefetchTrustLines(std::vector<LedgerKey> const& keys,
+                                   Database& db);
+
     // loads ALL trust lines from the database (very slow!)
     static std::unordered_map<AccountID, std::vector<TrustFrame::pointer>>
     loadAllLines(Database& db);
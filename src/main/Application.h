@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "main/Config.h"
+#include "util/MemoryUsage.h"
 #include "xdr/Stellar-types.h"
 #include <lib/json/json.h>
 #include <memory>
@@ -23,6 +24,7 @@ namespace stellar
 
 class VirtualClock;
 class TmpDirManager;
+class ShardedMetrics;
 class LedgerManager;
 class BucketManager;
 class CatchupManager;
@@ -37,6 +39,7 @@ class OverlayManager;
 class Database;
 class PersistentState;
 class LoadGenerator;
+enum class LoadGenMode;
 class CommandHandler;
 class WorkManager;
 class BanManager;
@@ -153,6 +156,23 @@ class Application
         APP_NUM_STATE
     };
 
+    // Pools of worker threads, so that a burst of work of one kind (say,
+    // merging large buckets) does not hold up the others or take every core
+    // (see the *_WORKER_THREADS and *_WORKER_CPUS settings of Config).
+    enum WorkerPool
+    {
+        WORKER_POOL_BUCKET_MERGE,
+        // signatures of transactions, SCP messages and ledger chains
+        WORKER_POOL_CRYPTO_VERIFY,
+        // compressing, hashing and writing history files
+        WORKER_POOL_HISTORY_IO,
+        // name resolution, NTP, quorum intersection checks, invariants
+        // checked in the background
+        WORKER_POOL_MISC,
+
+        WORKER_POOL_COUNT
+    };
+
     virtual ~Application(){};
 
     virtual void initialize() = 0;
@@ -178,6 +198,10 @@ class Application
     // reported through the administrative HTTP interface, see CommandHandler.
     virtual medida::MetricsRegistry& getMetrics() = 0;
 
+    // Handles on metrics of getMetrics() for the code updating them from
+    // several threads, added to them by syncAllMetrics.
+    virtual ShardedMetrics& getShardedMetrics() = 0;
+
     // Ensure any App-local metrics that are "current state" gauge-like counters
     // reflect the current reality as best as possible.
     virtual void syncOwnMetrics() = 0;
@@ -185,6 +209,11 @@ class Application
     // Call syncOwnMetrics on self and syncMetrics all objects owned by App.
     virtual void syncAllMetrics() = 0;
 
+    // Estimates of the memory held by each subsystem, which syncAllMetrics
+    // reports as memory.<subsystem>.{bytes,objects} when MEMORY_ACCOUNTING
+    // is set.
+    virtual MemoryUsageReport getMemoryUsage() = 0;
+
     // Clear all metrics
     virtual void clearMetrics(std::string const& domain) = 0;
 
@@ -208,10 +237,10 @@ class Application
     virtual BanManager& getBanManager() = 0;
     virtual StatusManager& getStatusManager() = 0;
 
-    // Get the worker IO service, served by background threads. Work posted to
-    // this io_service will execute in parallel with the calling thread, so use
-    // with caution.
-    virtual asio::io_service& getWorkerIOService() = 0;
+    // Get the IO service of a worker pool, served by background threads. Work
+    // posted to this io_service will execute in parallel with the calling
+    // thread, so use with caution.
+    virtual asio::io_service& getWorkerIOService(WorkerPool pool) = 0;
 
     // Perform actions necessary to transition from BOOTING_STATE to other
     // states. In particular: either reload or reinitialize the database, and
@@ -235,7 +264,7 @@ class Application
 
     // If config.ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING=true, generate some load
     // against the current application.
-    virtual void generateLoad(bool isCreate, uint32_t nAccounts,
+    virtual void generateLoad(LoadGenMode mode, uint32_t nAccounts,
                               uint32_t offset, uint32_t nTxs, uint32_t txRate,
                               uint32_t batchSize, bool autoRate) = 0;
 
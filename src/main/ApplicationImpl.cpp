@@ -11,6 +11,8 @@
 #include "util/asio.h"
 #include "bucket/Bucket.h"
 #include "bucket/BucketManager.h"
+#include "bucket/BucketScrubber.h"
+#include "catchup/CatchupManager.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
@@ -22,9 +24,12 @@
 #include "invariant/BucketListIsConsistentWithDatabase.h"
 #include "invariant/CacheIsConsistentWithDatabase.h"
 #include "invariant/ConservationOfLumens.h"
+#include "invariant/IncrementalBucketListChecker.h"
+#include "invariant/InflationVoteTallyMatchesDatabase.h"
 #include "invariant/InvariantManager.h"
 #include "invariant/LedgerEntryIsValid.h"
 #include "invariant/LiabilitiesMatchOffers.h"
+#include "ledger/LedgerEntryCache.h"
 #include "ledger/LedgerManager.h"
 #include "main/CommandHandler.h"
 #include "main/ExternalQueue.h"
@@ -42,12 +47,16 @@
 #include "scp/LocalNode.h"
 #include "scp/QuorumSetUtils.h"
 #include "simulation/LoadGenerator.h"
+#include "util/Math.h"
+#include "util/ShardedMetrics.h"
 #include "util/StatusManager.h"
+#include "util/Thread.h"
 #include "work/WorkManager.h"
 
 #include "util/Logging.h"
 #include "util/TmpDir.h"
 
+#include <algorithm>
 #include <set>
 #include <string>
 
@@ -56,20 +65,62 @@ static const int SHUTDOWN_DELAY_SECONDS = 1;
 namespace stellar
 {
 
+namespace
+{
+WorkerPoolConfiguration const&
+getWorkerPoolConfiguration(Config const& cfg, Application::WorkerPool pool)
+{
+    switch (pool)
+    {
+    case Application::WORKER_POOL_BUCKET_MERGE:
+        return cfg.BUCKET_MERGE_WORKERS;
+    case Application::WORKER_POOL_CRYPTO_VERIFY:
+        return cfg.CRYPTO_VERIFY_WORKERS;
+    case Application::WORKER_POOL_HISTORY_IO:
+        return cfg.HISTORY_IO_WORKERS;
+    default:
+        return cfg.MISC_WORKERS;
+    }
+}
+
+// number of threads of @p pool when it is not configured: verification
+// gets half of the cores, merges and history a quarter each, and the rest
+// (mostly waiting on the network) a couple of threads
+unsigned
+getDefaultWorkerThreads(Application::WorkerPool pool, unsigned cores)
+{
+    switch (pool)
+    {
+    case Application::WORKER_POOL_BUCKET_MERGE:
+    case Application::WORKER_POOL_HISTORY_IO:
+        return std::max(1u, cores / 4);
+    case Application::WORKER_POOL_CRYPTO_VERIFY:
+        return std::max(1u, cores / 2);
+    default:
+        return 2;
+    }
+}
+}
+
 ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     : mVirtualClock(clock)
     , mConfig(cfg)
-    , mWorkerIOService(std::thread::hardware_concurrency())
-    , mWork(std::make_unique<asio::io_service::work>(mWorkerIOService))
+    , mWorkerPools()
     , mWorkerThreads()
     , mStopSignals(clock.getIOService(), SIGINT)
     , mStopping(false)
     , mStoppingTimer(*this)
     , mMetrics(std::make_unique<medida::MetricsRegistry>())
+    , mShardedMetrics(std::make_unique<ShardedMetrics>(*mMetrics))
     , mAppStateCurrent(mMetrics->NewCounter({"app", "state", "current"}))
     , mAppStateChanges(mMetrics->NewTimer({"app", "state", "changes"}))
     , mLastStateChange(clock.now())
     , mStartedOn(clock.now())
+    , mVerifySigCacheMeters(PubKeyUtils::VerifySigCacheMeters{
+          mShardedMetrics->NewMeter({"crypto", "verify", "hit"}, "signature"),
+          mShardedMetrics->NewMeter({"crypto", "verify", "miss"}, "signature"),
+          mShardedMetrics->NewMeter({"crypto", "verify", "total"},
+                                    "signature")})
 {
 #ifdef SIGQUIT
     mStopSignals.add(SIGQUIT);
@@ -79,12 +130,69 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
 #endif
 
     std::srand(static_cast<uint32>(clock.now().time_since_epoch().count()));
+    if (mConfig.RANDOM_SEED_FOR_TESTING != 0)
+    {
+        reseedRandomEngines(mConfig.RANDOM_SEED_FOR_TESTING);
+    }
 
     mNetworkID = sha256(mConfig.NETWORK_PASSPHRASE);
 
-    unsigned t = std::thread::hardware_concurrency();
+    PubKeyUtils::setVerifySigCacheSize(mConfig.VERIFY_SIG_CACHE_SIZE);
+    PubKeyUtils::setVerifySigCacheMeters(&mVerifySigCacheMeters);
+    if (mConfig.MEMORY_ACCOUNTING)
+    {
+        MemoryCounter::gEnabled = true;
+    }
+    // of the last application created on the clock, if several share it
+    mVirtualClock.getLoopMonitor().setMetrics(mMetrics.get());
+
+    // the CPUs that the worker threads not pinned elsewhere run on: all of
+    // them but the one of the main thread, if it has one
+    std::vector<uint32_t> sharedCPUs;
+    if (mConfig.MAIN_THREAD_CPU >= 0)
+    {
+        auto mainCPU = static_cast<uint32_t>(mConfig.MAIN_THREAD_CPU);
+        for (auto cpu : getCurrentThreadCPUs())
+        {
+            if (cpu != mainCPU)
+            {
+                sharedCPUs.push_back(cpu);
+            }
+        }
+        if (!runCurrentThreadOn({mainCPU}))
+        {
+            LOG(WARNING) << "Could not run the main thread on CPU "
+                         << mainCPU;
+        }
+    }
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threads;
+    for (size_t i = 0; i < WORKER_POOL_COUNT; i++)
+    {
+        auto pool = static_cast<WorkerPool>(i);
+        auto const& poolCfg = getWorkerPoolConfiguration(mConfig, pool);
+        threads.push_back(poolCfg.mThreads != 0
+                              ? poolCfg.mThreads
+                              : getDefaultWorkerThreads(pool, cores));
+        if (pool == WORKER_POOL_CRYPTO_VERIFY &&
+            mConfig.VERIFY_SIGNATURES_ON_MAIN_THREAD_FOR_TESTING)
+        {
+            // see getWorkerIOService
+            threads.back() = 0;
+        }
+        auto& state = mWorkerPools[i];
+        state.mIOService = std::make_unique<asio::io_service>(threads[i]);
+        state.mWork =
+            std::make_unique<asio::io_service::work>(*state.mIOService);
+        state.mCPUs = poolCfg.mCPUs.empty() ? sharedCPUs : poolCfg.mCPUs;
+    }
+
     LOG(DEBUG) << "Application constructing "
-               << "(worker threads: " << t << ")";
+               << "(worker threads: " << threads[WORKER_POOL_BUCKET_MERGE]
+               << " merge, " << threads[WORKER_POOL_CRYPTO_VERIFY]
+               << " verify, " << threads[WORKER_POOL_HISTORY_IO]
+               << " history, " << threads[WORKER_POOL_MISC] << " misc)";
     mStopSignals.async_wait([this](asio::error_code const& ec, int sig) {
         if (!ec)
         {
@@ -93,9 +201,14 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
         }
     });
 
-    while (t--)
+    for (size_t i = 0; i < WORKER_POOL_COUNT; i++)
     {
-        mWorkerThreads.emplace_back([this, t]() { this->runWorkerThread(t); });
+        auto pool = static_cast<WorkerPool>(i);
+        for (unsigned t = 0; t < threads[i]; t++)
+        {
+            mWorkerThreads.emplace_back(
+                [this, pool]() { this->runWorkerThread(pool); });
+        }
     }
 }
 
@@ -116,6 +229,9 @@ ApplicationImpl::initialize()
     mHistoryManager = HistoryManager::create(*this);
     mInvariantManager = createInvariantManager();
     mMaintainer = std::make_unique<Maintainer>(*this);
+    mIncrementalBucketListChecker =
+        std::make_unique<IncrementalBucketListChecker>(*this);
+    mBucketScrubber = std::make_unique<BucketScrubber>(*this);
     mProcessManager = ProcessManager::create(*this);
     mCommandHandler = std::make_unique<CommandHandler>(*this);
     mWorkManager = WorkManager::create(*this);
@@ -126,6 +242,7 @@ ApplicationImpl::initialize()
     AccountSubEntriesCountIsValid::registerInvariant(*this);
     CacheIsConsistentWithDatabase::registerInvariant(*this);
     ConservationOfLumens::registerInvariant(*this);
+    InflationVoteTallyMatchesDatabase::registerInvariant(*this);
     LedgerEntryIsValid::registerInvariant(*this);
     LiabilitiesMatchOffers::registerInvariant(*this);
     enableInvariantsFromConfig();
@@ -270,6 +387,14 @@ ApplicationImpl::getJsonInfo()
         info["history"] = historyArchiveInfo;
     }
 
+    auto catchupInfo = getCatchupManager().getJsonInfo();
+    if (!catchupInfo.empty())
+    {
+        info["catchup"] = catchupInfo;
+    }
+
+    info["main_loop"] = getClock().getLoopMonitor().getJsonInfo();
+
     return root;
 }
 
@@ -297,9 +422,19 @@ ApplicationImpl::~ApplicationImpl()
     {
         mProcessManager->shutdown();
     }
+    if (mHerder)
+    {
+        mHerder->shutdown();
+    }
     reportCfgMetrics();
     shutdownMainIOService();
     joinAllThreads();
+    PubKeyUtils::clearVerifySigCacheMeters(&mVerifySigCacheMeters);
+    auto& loopMonitor = mVirtualClock.getLoopMonitor();
+    if (loopMonitor.getMetricsRegistry() == mMetrics.get())
+    {
+        loopMonitor.setMetrics(nullptr);
+    }
     LOG(INFO) << "Application destroyed";
 }
 
@@ -354,13 +489,16 @@ ApplicationImpl::start()
                     "Unable to restore last-known ledger state");
             }
 
-            // restores Herder's state before starting overlay
+            // restores Herder's state before starting overlay, which then
+            // connects to peers while the rest starts
             mHerder->restoreState();
+            mOverlayManager->start();
             // set known cursors before starting maintenance job
             ExternalQueue ps(*this);
             ps.setInitialCursors(mConfig.KNOWN_CURSORS);
             mMaintainer->start();
-            mOverlayManager->start();
+            mIncrementalBucketListChecker->start();
+            mBucketScrubber->start();
             auto npub = mHistoryManager->publishQueuedHistory();
             if (npub != 0)
             {
@@ -398,9 +536,14 @@ ApplicationImpl::start()
 }
 
 void
-ApplicationImpl::runWorkerThread(unsigned i)
+ApplicationImpl::runWorkerThread(WorkerPool pool)
 {
-    mWorkerIOService.run();
+    auto& state = mWorkerPools[pool];
+    if (!state.mCPUs.empty() && !runCurrentThreadOn(state.mCPUs))
+    {
+        LOG(WARNING) << "Could not restrict the CPUs of a worker thread";
+    }
+    state.mIOService->run();
 }
 
 void
@@ -423,10 +566,18 @@ ApplicationImpl::gracefulStop()
     {
         mProcessManager->shutdown();
     }
+    if (mHerder)
+    {
+        mHerder->shutdown();
+    }
     if (mBucketManager)
     {
         mBucketManager->shutdown();
     }
+    if (mHerderPersistence)
+    {
+        mHerderPersistence->flush();
+    }
 
     mStoppingTimer.expires_from_now(
         std::chrono::seconds(SHUTDOWN_DELAY_SECONDS));
@@ -451,12 +602,12 @@ ApplicationImpl::shutdownMainIOService()
 void
 ApplicationImpl::joinAllThreads()
 {
-    // We never strictly stop the worker IO service, just release the work-lock
-    // that keeps the worker threads alive. This gives them the chance to finish
-    // any work that the main thread queued.
-    if (mWork)
+    // We never strictly stop the worker IO services, just release the
+    // work-locks that keep the worker threads alive. This gives them the
+    // chance to finish any work that the main thread queued.
+    for (auto& pool : mWorkerPools)
     {
-        mWork.reset();
+        pool.mWork.reset();
     }
     LOG(DEBUG) << "Joining " << mWorkerThreads.size() << " worker threads";
     for (auto& w : mWorkerThreads)
@@ -479,12 +630,12 @@ ApplicationImpl::manualClose()
 }
 
 void
-ApplicationImpl::generateLoad(bool isCreate, uint32_t nAccounts,
+ApplicationImpl::generateLoad(LoadGenMode mode, uint32_t nAccounts,
                               uint32_t offset, uint32_t nTxs, uint32_t txRate,
                               uint32_t batchSize, bool autoRate)
 {
     getMetrics().NewMeter({"loadgen", "run", "start"}, "run").Mark();
-    getLoadGenerator().generateLoad(isCreate, nAccounts, offset, nTxs, txRate,
+    getLoadGenerator().generateLoad(mode, nAccounts, offset, nTxs, txRate,
                                     batchSize, autoRate);
 }
 
@@ -582,6 +733,12 @@ ApplicationImpl::getMetrics()
     return *mMetrics;
 }
 
+ShardedMetrics&
+ApplicationImpl::getShardedMetrics()
+{
+    return *mShardedMetrics;
+}
+
 void
 ApplicationImpl::syncOwnMetrics()
 {
@@ -595,27 +752,42 @@ ApplicationImpl::syncOwnMetrics()
         mLastStateChange = now;
     }
 
-    // Flush crypto pure-global-cache stats. They don't belong
-    // to a single app instance but first one to flush will claim
-    // them.
-    uint64_t vhit = 0, vmiss = 0;
-    PubKeyUtils::flushVerifySigCacheCounts(vhit, vmiss);
-    mMetrics->NewMeter({"crypto", "verify", "hit"}, "signature").Mark(vhit);
-    mMetrics->NewMeter({"crypto", "verify", "miss"}, "signature").Mark(vmiss);
-    mMetrics->NewMeter({"crypto", "verify", "total"}, "signature")
-        .Mark(vhit + vmiss);
-
-    // Similarly, flush global process-table stats.
+    // Flush global process-table stats.
     mMetrics->NewCounter({"process", "memory", "handles"})
         .set_count(mProcessManager->getNumRunningProcesses());
 }
 
+MemoryUsageReport
+ApplicationImpl::getMemoryUsage()
+{
+    MemoryUsageReport res;
+    getOverlayManager().addMemoryUsage(res);
+    getHerder().addMemoryUsage(res);
+    res["ledger.entry-cache"] = getDatabase().getEntryCache().getMemoryUsage();
+    res["crypto.verify-sig-cache"] =
+        PubKeyUtils::getVerifySigCacheMemoryUsage();
+    res["bucket.merge-buffers"] = Bucket::getMergeBufferMemoryUsage();
+    return res;
+}
+
 void
 ApplicationImpl::syncAllMetrics()
 {
+    mShardedMetrics->sync();
     mHerder->syncMetrics();
     mLedgerManager->syncMetrics();
     syncOwnMetrics();
+
+    if (mConfig.MEMORY_ACCOUNTING)
+    {
+        for (auto const& kv : getMemoryUsage())
+        {
+            mMetrics->NewCounter({"memory", kv.first, "bytes"})
+                .set_count(kv.second.mBytes);
+            mMetrics->NewCounter({"memory", kv.first, "objects"})
+                .set_count(kv.second.mObjects);
+        }
+    }
 }
 
 void
@@ -741,9 +913,14 @@ ApplicationImpl::getStatusManager()
 }
 
 asio::io_service&
-ApplicationImpl::getWorkerIOService()
+ApplicationImpl::getWorkerIOService(WorkerPool pool)
 {
-    return mWorkerIOService;
+    if (pool == WORKER_POOL_CRYPTO_VERIFY &&
+        mConfig.VERIFY_SIGNATURES_ON_MAIN_THREAD_FOR_TESTING)
+    {
+        return mVirtualClock.getIOService();
+    }
+    return *mWorkerPools[pool].mIOService;
 }
 
 void
@@ -30,6 +30,8 @@ class ProcessManager;
 class CommandHandler;
 class Database;
 class LoadGenerator;
+class IncrementalBucketListChecker;
+class BucketScrubber;
 class NtpSynchronizationChecker;
 
 class ApplicationImpl : public Application
@@ -49,8 +51,10 @@ class ApplicationImpl : public Application
     virtual bool isStopping() const override;
     virtual VirtualClock& getClock() override;
     virtual medida::MetricsRegistry& getMetrics() override;
+    virtual ShardedMetrics& getShardedMetrics() override;
     virtual void syncOwnMetrics() override;
     virtual void syncAllMetrics() override;
+    virtual MemoryUsageReport getMemoryUsage() override;
     virtual void clearMetrics(std::string const& domain) override;
     virtual TmpDirManager& getTmpDirManager() override;
     virtual LedgerManager& getLedgerManager() override;
@@ -71,7 +75,7 @@ class ApplicationImpl : public Application
     virtual BanManager& getBanManager() override;
     virtual StatusManager& getStatusManager() override;
 
-    virtual asio::io_service& getWorkerIOService() override;
+    virtual asio::io_service& getWorkerIOService(WorkerPool pool) override;
 
     void newDB() override;
     virtual void start() override;
@@ -89,7 +93,7 @@ class ApplicationImpl : public Application
 
     virtual bool manualClose() override;
 
-    virtual void generateLoad(bool isCreate, uint32_t nAccounts,
+    virtual void generateLoad(LoadGenMode mode, uint32_t nAccounts,
                               uint32_t offset, uint32_t nTxs, uint32_t txRate,
                               uint32_t batchSize, bool autoRate) override;
 
@@ -127,8 +131,13 @@ class ApplicationImpl : public Application
     // threads must be joined and destroyed before we start tearing down
     // subsystems.
 
-    asio::io_service mWorkerIOService;
-    std::unique_ptr<asio::io_service::work> mWork;
+    struct WorkerPoolState
+    {
+        std::unique_ptr<asio::io_service> mIOService;
+        std::unique_ptr<asio::io_service::work> mWork;
+        std::vector<uint32_t> mCPUs;
+    };
+    WorkerPoolState mWorkerPools[WORKER_POOL_COUNT];
 
     std::unique_ptr<Database> mDatabase;
     std::unique_ptr<TmpDirManager> mTmpDirManager;
@@ -140,6 +149,8 @@ class ApplicationImpl : public Application
     std::unique_ptr<HistoryManager> mHistoryManager;
     std::unique_ptr<InvariantManager> mInvariantManager;
     std::unique_ptr<Maintainer> mMaintainer;
+    std::unique_ptr<IncrementalBucketListChecker> mIncrementalBucketListChecker;
+    std::unique_ptr<BucketScrubber> mBucketScrubber;
     std::shared_ptr<ProcessManager> mProcessManager;
     std::unique_ptr<CommandHandler> mCommandHandler;
     std::shared_ptr<WorkManager> mWorkManager;
@@ -158,15 +169,17 @@ class ApplicationImpl : public Application
     VirtualTimer mStoppingTimer;
 
     std::unique_ptr<medida::MetricsRegistry> mMetrics;
+    std::unique_ptr<ShardedMetrics> mShardedMetrics;
     medida::Counter& mAppStateCurrent;
     medida::Timer& mAppStateChanges;
     VirtualClock::time_point mLastStateChange;
     VirtualClock::time_point mStartedOn;
+    PubKeyUtils::VerifySigCacheMeters mVerifySigCacheMeters;
 
     Hash mNetworkID;
 
     void shutdownMainIOService();
-    void runWorkerThread(unsigned i);
+    void runWorkerThread(WorkerPool pool);
 
     void enableInvariantsFromConfig();
 
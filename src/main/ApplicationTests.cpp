@@ -0,0 +1,62 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/Application.h"
+#include "herder/Herder.h"
+#include "ledger/LedgerManager.h"
+#include "lib/catch.hpp"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+
+#include "medida/counter.h"
+#include "medida/metrics_registry.h"
+
+using namespace stellar;
+
+TEST_CASE("memory usage of subsystems", "[metrics]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.MEMORY_ACCOUNTING = true;
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto minBalance = app->getLedgerManager().getMinBalance(0);
+    auto before = app->getMemoryUsage();
+    for (int i = 0; i < 3; i++)
+    {
+        auto name = "dest" + std::to_string(i);
+        auto tx = root.tx({txtest::createAccount(
+            txtest::getAccount(name.c_str()).getPublicKey(), minBalance)});
+        REQUIRE(app->getHerder().recvTransaction(tx) ==
+                Herder::TX_STATUS_PENDING);
+    }
+
+    auto usage = app->getMemoryUsage();
+    for (auto const& name :
+         {"overlay.floodgate", "herder.pending-transactions",
+          "herder.pending-envelopes", "herder.fetch-caches", "scp.slots",
+          "ledger.entry-cache", "crypto.verify-sig-cache",
+          "bucket.merge-buffers"})
+    {
+        REQUIRE(usage.find(name) != usage.end());
+    }
+    auto const& txs = usage["herder.pending-transactions"];
+    REQUIRE(txs.mObjects == 3);
+    REQUIRE(txs.mBytes > before["herder.pending-transactions"].mBytes);
+    // the accounts the transactions were checked against
+    REQUIRE(usage["ledger.entry-cache"].mObjects != 0);
+
+    app->syncAllMetrics();
+    auto& metrics = app->getMetrics();
+    REQUIRE(metrics.NewCounter({"memory", "herder.pending-transactions",
+                                "objects"})
+                .count() == 3);
+    REQUIRE(metrics.NewCounter({"memory", "herder.pending-transactions",
+                                "bytes"})
+                .count() == static_cast<int64_t>(txs.mBytes));
+}
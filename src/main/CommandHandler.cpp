@@ -6,7 +6,10 @@
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
 #include "herder/Herder.h"
+#include "ledger/ApplyProfiler.h"
+#include "ledger/LedgerCloseTracer.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/LedgerStateSnapshot.h"
 #include "lib/http/server.hpp"
 #include "lib/json/json.h"
 #include "lib/util/format.h"
@@ -15,8 +18,14 @@
 #include "main/Maintainer.h"
 #include "overlay/BanManager.h"
 #include "overlay/OverlayManager.h"
+#include "simulation/LoadGenerator.h"
+#include "util/Allocator.h"
+#include "util/GlobalChecks.h"
 #include "util/Logging.h"
+#include "util/SamplingProfiler.h"
 #include "util/StatusManager.h"
+#include "util/Timer.h"
+#include "util/Tracing.h"
 
 #include "medida/reporting/json_reporter.h"
 #include "util/Decoder.h"
@@ -28,6 +37,8 @@
 
 #include "test/TestAccount.h"
 #include "test/TxTests.h"
+#include <fstream>
+#include <future>
 #include <regex>
 
 using namespace stellar::txtest;
@@ -37,7 +48,23 @@ using std::placeholders::_2;
 
 namespace stellar
 {
-CommandHandler::CommandHandler(Application& app) : mApp(app)
+
+std::set<std::string> const CommandHandler::SNAPSHOT_ROUTES = {
+    "info", "metrics", "peers", "quorum"};
+std::chrono::milliseconds const CommandHandler::SNAPSHOT_REFRESH_PERIOD{1000};
+size_t const CommandHandler::MAX_TX_BATCH = 10000;
+uint32_t const CommandHandler::MAX_PROFILE_SECONDS = 600;
+
+namespace
+{
+// transactions of a txbatch request verified by each worker task
+size_t const TX_BATCH_VERIFY_CHUNK = 64;
+}
+
+CommandHandler::CommandHandler(Application& app)
+    : mApp(app)
+    , mStopping(std::make_shared<std::atomic<bool>>(false))
+    , mPrometheusExporter(app)
 {
     if (mApp.getConfig().HTTP_PORT)
     {
@@ -56,8 +83,8 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
         int httpMaxClient = mApp.getConfig().HTTP_MAX_CLIENT;
 
         mServer = std::make_unique<http::server::server>(
-            app.getClock().getIOService(), ipStr, mApp.getConfig().HTTP_PORT,
-            httpMaxClient);
+            mHttpIOService, ipStr, mApp.getConfig().HTTP_PORT, httpMaxClient);
+        mHttpWork = std::make_unique<asio::io_service::work>(mHttpIOService);
     }
     else
     {
@@ -67,37 +94,179 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
 
     mServer->add404(std::bind(&CommandHandler::fileNotFound, this, _1, _2));
 
+    addRoute("allocator", &CommandHandler::allocator);
     addRoute("bans", &CommandHandler::bans);
     addRoute("catchup", &CommandHandler::catchup);
     addRoute("checkdb", &CommandHandler::checkdb);
+    addRoute("closetrace", &CommandHandler::closeTrace);
     addRoute("connect", &CommandHandler::connect);
     addRoute("dropcursor", &CommandHandler::dropcursor);
     addRoute("droppeer", &CommandHandler::dropPeer);
     addRoute("generateload", &CommandHandler::generateLoad);
     addRoute("getcursor", &CommandHandler::getcursor);
+    addRoute("hottrace", &CommandHandler::hotTrace);
     addRoute("info", &CommandHandler::info);
+    mServer->addRoute("ledgerentry", [this](std::string const& params,
+                                            std::string& retStr) {
+        safeRouter(&CommandHandler::ledgerEntry, params, retStr);
+    });
     addRoute("ll", &CommandHandler::ll);
     addRoute("logrotate", &CommandHandler::logRotate);
     addRoute("maintenance", &CommandHandler::maintenance);
     addRoute("manualclose", &CommandHandler::manualClose);
     addRoute("metrics", &CommandHandler::metrics);
+    addRoute("metrics/prometheus", &CommandHandler::prometheusMetrics);
+    mServer->setContentType("metrics/prometheus",
+                            "text/plain; version=0.0.4");
     addRoute("clearmetrics", &CommandHandler::clearMetrics);
     addRoute("peers", &CommandHandler::peers);
+    addRoute("profile", &CommandHandler::profile);
     addRoute("quorum", &CommandHandler::quorum);
     addRoute("setcursor", &CommandHandler::setcursor);
     addRoute("scp", &CommandHandler::scpInfo);
     addRoute("testacc", &CommandHandler::testAcc);
     addRoute("testtx", &CommandHandler::testTx);
     addRoute("tx", &CommandHandler::tx);
+    mServer->addBodyRoute("txbatch", [this](std::string const& params,
+                                            std::string const& body,
+                                            std::string& retStr) {
+        try
+        {
+            txBatch(params, body, retStr);
+        }
+        catch (std::exception& e)
+        {
+            retStr = (fmt::MemoryWriter()
+                      << "{\"exception\": \"" << e.what() << "\"}")
+                         .str();
+        }
+    });
     addRoute("upgrades", &CommandHandler::upgrades);
     addRoute("unban", &CommandHandler::unban);
+
+    if (mHttpWork)
+    {
+        mHttpThread = std::thread([this]() { mHttpIOService.run(); });
+    }
+}
+
+CommandHandler::~CommandHandler()
+{
+    *mStopping = true;
+    if (mHttpThread.joinable())
+    {
+        mHttpWork.reset();
+        mHttpIOService.stop();
+        mHttpThread.join();
+    }
+    if (mProfileTimer)
+    {
+        // the capture is dropped
+        size_t samples, dropped;
+        profiler::stop(samples, dropped);
+    }
 }
 
 void
 CommandHandler::addRoute(std::string const& name, HandlerRoute route)
 {
     mServer->addRoute(
-        name, std::bind(&CommandHandler::safeRouter, this, route, _1, _2));
+        name, std::bind(&CommandHandler::serve, this, name, route, _1, _2));
+}
+
+void
+CommandHandler::serve(std::string const& name, HandlerRoute route,
+                      std::string const& params, std::string& retStr)
+{
+    // manualCmd
+    if (threadIsMain())
+    {
+        safeRouter(route, params, retStr);
+        return;
+    }
+    if (!params.empty() || SNAPSHOT_ROUTES.find(name) == SNAPSHOT_ROUTES.end())
+    {
+        runOnMainThread(route, params, retStr);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mSnapshotsMutex);
+        auto it = mSnapshots.find(name);
+        if (it != mSnapshots.end())
+        {
+            auto& snapshot = it->second;
+            retStr = snapshot.mReply;
+            if (!snapshot.mRefreshing &&
+                std::chrono::steady_clock::now() - snapshot.mPublished >=
+                    SNAPSHOT_REFRESH_PERIOD)
+            {
+                snapshot.mRefreshing = true;
+                refreshSnapshot(name, route);
+            }
+            return;
+        }
+    }
+
+    // the first request of the route waits for its snapshot
+    runOnMainThread(route, params, retStr);
+    std::lock_guard<std::mutex> lock(mSnapshotsMutex);
+    auto& snapshot = mSnapshots[name];
+    snapshot.mReply = retStr;
+    snapshot.mPublished = std::chrono::steady_clock::now();
+}
+
+void
+CommandHandler::runOnMainThread(HandlerRoute route, std::string const& params,
+                                std::string& retStr)
+{
+    auto reply = std::make_shared<std::promise<std::string>>();
+    auto future = reply->get_future();
+    auto stopping = mStopping;
+    mApp.getClock().postToMain(
+        [this, stopping, route, params, reply]() {
+            if (*stopping)
+            {
+                return;
+            }
+            std::string res;
+            safeRouter(route, params, res);
+            reply->set_value(res);
+        },
+        "http");
+
+    // the main thread may never get to it if it is shutting down
+    while (future.wait_for(std::chrono::milliseconds(100)) !=
+           std::future_status::ready)
+    {
+        if (*mStopping)
+        {
+            retStr = "{\"exception\": \"shutting down\"}";
+            return;
+        }
+    }
+    retStr = future.get();
+}
+
+void
+CommandHandler::refreshSnapshot(std::string const& name, HandlerRoute route)
+{
+    auto stopping = mStopping;
+    mApp.getClock().postToMain(
+        [this, stopping, name, route]() {
+            if (*stopping)
+            {
+                return;
+            }
+            std::string res;
+            safeRouter(route, "", res);
+            std::lock_guard<std::mutex> lock(mSnapshotsMutex);
+            auto& snapshot = mSnapshots[name];
+            snapshot.mReply = std::move(res);
+            snapshot.mPublished = std::chrono::steady_clock::now();
+            snapshot.mRefreshing = false;
+        },
+        "http");
 }
 
 void
@@ -257,16 +426,30 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "/droppeer?node=NODE_ID[&ban=D]</h1>"
         "drops peer identified by PEER_ID, when D is 1 the peer is also banned"
         "</p><p><h1> "
-        "/generateload[?mode=(create|pay)&accounts=N&offset=K&txs=M&txrate=(R|"
-        "auto)&"
-        "batchsize=L]</h1>"
+        "/generateload[?mode=(create|pay|setup|offers|pathpay|mixed)&"
+        "accounts=N&offset=K&txs=M&txrate=(R|auto)&batchsize=L&assets=A&"
+        "signers=S&hops=H&offerpct=O&pathpct=P]</h1>"
         "artificially generate load for testing; must be used with "
         "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING set to true. "
         "Depending on the mode, either creates new accounts or generates "
         "payments on accounts specified"
         " (where number of accounts can be offset)."
         " Additionally, allows batching up to 100 account creations per "
-        "transaction via 'batchsize'."
+        "transaction via 'batchsize'.<br>"
+        "setup gives the accounts trust lines to A assets (default 3) issued "
+        "by the root account, funded by it, and S extra signers (default 0) "
+        "that all their later transactions are signed with. offers then "
+        "creates offers along a price ladder on the asset pairs (native, "
+        "LG0), (LG0, LG1)..., pathpay sends path payments through H of these "
+        "pairs (default 2), and mixed submits O% offers (default 30), P% "
+        "path payments (default 30) and native payments. The shape "
+        "parameters are kept for the next calls.<br>"
+        "With arrival=(uniform|poisson), the transactions of the modes "
+        "other than create and setup are submitted open loop, at txrate "
+        "whatever the node absorbs and without retries; their latency to "
+        "externalization is in the loadgen.txn.latency timer of /metrics, "
+        "and the ones rejected or dropped in loadgen.txn.rejected and "
+        "loadgen.txn.dropped."
         "</p><p><h1> /help</h1>"
         "give a list of currently supported commands"
         "</p><p><h1> /info</h1>"
@@ -280,9 +463,11 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "rotate log files"
         "</p><p><h1> /manualclose</h1>"
         "close the current ledger; must be used with MANUAL_CLOSE set to true"
-        "</p><p><h1> /metrics</h1>"
+        "</p><p><h1> /metrics?[profile=true]</h1>"
         "returns a snapshot of the metrics registry (for monitoring and "
-        "debugging purpose)"
+        "debugging purpose). If profile is set, returns instead the time "
+        "and SQL statements spent applying the last ledger closed, broken "
+        "down by operation type and transaction result"
         "</p><p><h1> /clearmetrics?[domain=DOMAIN]</h1>"
         "clear metrics for a specified domain. If no domain specified, "
         "clear all metrics (for testing purposes)"
@@ -292,7 +477,10 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "returns information about the quorum for node NODE_ID (this node by"
         " default). NODE_ID is either a full key (`GABCD...`), an alias "
         "(`$name`) or an abbreviated ID(`@GABCD`)."
-        "If compact is set, only returns a summary version."
+        "If compact is set, only returns a summary version. When "
+        "QUORUM_INTERSECTION_CHECKER is set, the information about the local "
+        "node includes the result of the last quorum intersection check of "
+        "its transitive quorum."
         "</p><p><h1> /scp?[limit=n]</h1>"
         "returns a JSON object with the internal state of the SCP engine for "
         "the last n (default 2) ledgers."
@@ -422,20 +610,61 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
         std::map<std::string, std::string> map;
         http::server::server::parseParams(params, map);
 
-        bool isCreate;
+        LoadGenMode loadMode;
         maybeParseParam<std::string>(map, "mode", mode);
         if (mode == std::string("create"))
         {
-            isCreate = true;
+            loadMode = LoadGenMode::CREATE;
         }
         else if (mode == std::string("pay"))
         {
-            isCreate = false;
+            loadMode = LoadGenMode::PAY;
+        }
+        else if (mode == std::string("setup"))
+        {
+            loadMode = LoadGenMode::SETUP;
+        }
+        else if (mode == std::string("offers"))
+        {
+            loadMode = LoadGenMode::OFFERS;
+        }
+        else if (mode == std::string("pathpay"))
+        {
+            loadMode = LoadGenMode::PATH_PAY;
+        }
+        else if (mode == std::string("mixed"))
+        {
+            loadMode = LoadGenMode::MIXED;
         }
         else
         {
             throw std::runtime_error("Unknown mode.");
         }
+        bool isCreate = LoadGenerator::countsAccounts(loadMode);
+
+        auto shape = mApp.getLoadGenerator().getShape();
+        maybeParseParam(map, "assets", shape.mAssets);
+        maybeParseParam(map, "signers", shape.mSigners);
+        maybeParseParam(map, "hops", shape.mHops);
+        maybeParseParam(map, "offerpct", shape.mOfferPercent);
+        maybeParseParam(map, "pathpct", shape.mPathPercent);
+        mApp.getLoadGenerator().setShape(shape);
+
+        auto arrival = LoadGenerator::Arrival::NONE;
+        std::string arrivalName;
+        maybeParseParam<std::string>(map, "arrival", arrivalName);
+        if (arrivalName == "uniform")
+        {
+            arrival = LoadGenerator::Arrival::UNIFORM;
+        }
+        else if (arrivalName == "poisson")
+        {
+            arrival = LoadGenerator::Arrival::POISSON;
+        }
+        else if (!arrivalName.empty())
+        {
+            throw std::runtime_error("Unknown arrival.");
+        }
 
         maybeParseParam(map, "accounts", nAccounts);
         maybeParseParam(map, "txs", nTxs);
@@ -462,7 +691,12 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
             batchSize = 100;
             retStr = "Setting batch size to its limit of 100.";
         }
-        mApp.generateLoad(isCreate, nAccounts, offset, nTxs, txRate, batchSize,
+        if (arrival != LoadGenerator::Arrival::NONE && autoRate)
+        {
+            throw std::runtime_error("An open loop needs a fixed txrate.");
+        }
+        mApp.getLoadGenerator().setArrival(arrival);
+        mApp.generateLoad(loadMode, nAccounts, offset, nTxs, txRate, batchSize,
                           autoRate);
         retStr +=
             fmt::format(" Generating load: {:d} {:s}, {:d} tx/s = {:f} hours",
@@ -476,8 +710,13 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
 }
 
 void
-CommandHandler::peers(std::string const&, std::string& retStr)
+CommandHandler::peers(std::string const& params, std::string& retStr)
 {
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+    bool fullKeys = retMap["fullkeys"] == "true";
+    bool stats = retMap["stats"] == "true";
+
     Json::Value root;
 
     root["pending_peers"];
@@ -500,7 +739,13 @@ CommandHandler::peers(std::string const&, std::string& retStr)
         root["authenticated_peers"][counter]["olver"] =
             (int)peer.second->getRemoteOverlayVersion();
         root["authenticated_peers"][counter]["id"] =
-            mApp.getConfig().toStrKey(peer.first);
+            fullKeys ? KeyUtils::toStrKey(peer.first)
+                     : mApp.getConfig().toStrKey(peer.first);
+        if (stats)
+        {
+            root["authenticated_peers"][counter]["stats"] =
+                peer.second->getJsonStats();
+        }
 
         counter++;
     }
@@ -517,11 +762,147 @@ CommandHandler::info(std::string const&, std::string& retStr)
 void
 CommandHandler::metrics(std::string const& params, std::string& retStr)
 {
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+    if (retMap["profile"] == "true")
+    {
+        retStr = mApp.getLedgerManager()
+                     .getApplyProfiler()
+                     .getJsonInfo()
+                     .toStyledString();
+        return;
+    }
+
     mApp.syncAllMetrics();
     medida::reporting::JsonReporter jr(mApp.getMetrics());
     retStr = jr.Report();
 }
 
+void
+CommandHandler::closeTrace(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    size_t ledgers = 0;
+    maybeParseParam(retMap, "ledgers", ledgers);
+
+    auto& tracer = mApp.getLedgerManager().getCloseTracer();
+    if (retMap["format"] == "chrome")
+    {
+        retStr = tracer.getChromeTrace(ledgers).toStyledString();
+    }
+    else
+    {
+        retStr = tracer.getJsonInfo(ledgers).toStyledString();
+    }
+}
+
+void
+CommandHandler::hotTrace(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    if (!tracing::isEnabled())
+    {
+        throw std::invalid_argument(
+            "Tracing zones are not compiled in, see --enable-tracing");
+    }
+    retStr = tracing::getChromeTrace().toStyledString();
+    if (retMap["clear"] == "true")
+    {
+        tracing::clear();
+    }
+}
+
+void
+CommandHandler::allocator(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    Json::Value root;
+    root["allocator"] = allocator::name();
+    if (retMap["purge"] == "true")
+    {
+        root["before_purge"] = allocator::getStats();
+        allocator::purge();
+    }
+    root["stats"] = allocator::getStats();
+    retStr = root.toStyledString();
+}
+
+void
+CommandHandler::profile(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    uint32_t seconds = 30;
+    unsigned frequency = 99;
+    maybeParseParam(retMap, "seconds", seconds);
+    maybeParseParam(retMap, "frequency", frequency);
+    if (seconds == 0 || seconds > MAX_PROFILE_SECONDS)
+    {
+        throw std::invalid_argument(fmt::format(
+            "seconds must be between 1 and {}", MAX_PROFILE_SECONDS));
+    }
+    if (mProfileTimer)
+    {
+        throw std::invalid_argument("A profile is already being captured");
+    }
+
+    // next to the log files
+    auto const& logPath = mApp.getConfig().LOG_FILE_PATH;
+    auto slash = logPath.rfind('/');
+    auto path = fmt::format(
+        "{}/stellar-core-profile.{}.folded",
+        slash == std::string::npos ? "." : logPath.substr(0, slash),
+        VirtualClock::to_time_t(mApp.getClock().now()));
+
+    profiler::start(frequency);
+    mProfileTimer = std::make_unique<VirtualTimer>(mApp);
+    mProfileTimer->expires_from_now(std::chrono::seconds(seconds));
+    mProfileTimer->async_wait([this, path]() { finishProfile(path); },
+                              &VirtualTimer::onFailureNoop);
+    LOG(INFO) << "Profiling for " << seconds << "s at " << frequency
+              << " samples per second";
+
+    Json::Value root;
+    root["status"] = "started";
+    root["seconds"] = seconds;
+    root["frequency"] = frequency;
+    root["file"] = path;
+    retStr = root.toStyledString();
+}
+
+void
+CommandHandler::finishProfile(std::string const& path)
+{
+    size_t samples, dropped;
+    auto collapsed = profiler::stop(samples, dropped);
+    mProfileTimer.reset();
+
+    std::ofstream out(path);
+    out << collapsed;
+    if (!out)
+    {
+        LOG(ERROR) << "Could not write the profile to " << path;
+        return;
+    }
+    LOG(INFO) << "Profile of " << samples << " samples written to " << path
+              << (dropped != 0
+                      ? fmt::format(" ({} more were dropped)", dropped)
+                      : std::string());
+}
+
+void
+CommandHandler::prometheusMetrics(std::string const&, std::string& retStr)
+{
+    retStr = mPrometheusExporter.scrape();
+}
+
 void
 CommandHandler::logRotate(std::string const& params, std::string& retStr)
 {
@@ -905,6 +1286,117 @@ CommandHandler::tx(std::string const& params, std::string& retStr)
     retStr = output.str();
 }
 
+void
+CommandHandler::txBatch(std::string const& params, std::string const& body,
+                        std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    xdr::xvector<TransactionEnvelope> envelopes;
+    if (retMap["format"] == "binary")
+    {
+        xdr::xdr_from_opaque(body, envelopes);
+    }
+    else
+    {
+        std::istringstream lines(body);
+        std::string blob;
+        while (std::getline(lines, blob))
+        {
+            if (blob.empty())
+            {
+                continue;
+            }
+            std::vector<uint8_t> binBlob;
+            decoder::decode_b64(blob, binBlob);
+            envelopes.emplace_back();
+            xdr::xdr_from_opaque(binBlob, envelopes.back());
+        }
+    }
+    if (envelopes.size() > MAX_TX_BATCH)
+    {
+        throw std::invalid_argument("Too many transactions in the batch");
+    }
+
+    std::vector<TransactionFramePtr> txs;
+    txs.reserve(envelopes.size());
+    for (auto const& envelope : envelopes)
+    {
+        auto tx = TransactionFrame::makeTransactionFromWire(mApp.getNetworkID(),
+                                                           envelope);
+        if (!tx)
+        {
+            throw std::invalid_argument("Invalid transaction envelope");
+        }
+        // the hashes are cached lazily: computed here, before the workers
+        // read them
+        tx->getFullHash();
+        tx->getContentsHash();
+        txs.emplace_back(tx);
+    }
+
+    // the signatures are verified in parallel, their results cached for
+    // the herder's checks
+    std::vector<std::future<void>> verified;
+    auto& workers =
+        mApp.getWorkerIOService(Application::WORKER_POOL_CRYPTO_VERIFY);
+    for (size_t i = 0; i < txs.size(); i += TX_BATCH_VERIFY_CHUNK)
+    {
+        auto task = std::make_shared<std::packaged_task<void()>>(
+            [&txs, i]() {
+                auto end = std::min(i + TX_BATCH_VERIFY_CHUNK, txs.size());
+                for (auto j = i; j < end; j++)
+                {
+                    txs[j]->preverifySignatures();
+                }
+            });
+        verified.emplace_back(task->get_future());
+        workers.post([task]() { (*task)(); });
+    }
+    for (auto& v : verified)
+    {
+        v.get();
+    }
+
+    // the whole batch is handed to the main thread at once
+    HandlerRoute submit = [&txs, &envelopes](CommandHandler* self,
+                                             std::string const&,
+                                             std::string& ret) {
+        auto& app = self->mApp;
+        auto statuses = app.getHerder().recvTransactions(txs);
+
+        Json::Value res(Json::arrayValue);
+        for (size_t i = 0; i < txs.size(); i++)
+        {
+            Json::Value s;
+            s["status"] = Herder::TX_STATUS_STRING[statuses[i]];
+            if (statuses[i] == Herder::TX_STATUS_PENDING)
+            {
+                StellarMessage msg;
+                msg.type(TRANSACTION);
+                msg.transaction() = envelopes[i];
+                app.getOverlayManager().broadcastMessage(msg);
+            }
+            else if (statuses[i] == Herder::TX_STATUS_ERROR)
+            {
+                s["error"] = decoder::encode_b64(
+                    xdr::xdr_to_opaque(txs[i]->getResult()));
+            }
+            res.append(s);
+        }
+        ret = res.toStyledString();
+    };
+    if (threadIsMain())
+    {
+        safeRouter(submit, "", retStr);
+    }
+    else
+    {
+        runOnMainThread(submit, "", retStr);
+    }
+}
+
 void
 CommandHandler::dropcursor(std::string const& params, std::string& retStr)
 {
@@ -973,6 +1465,41 @@ CommandHandler::getcursor(std::string const& params, std::string& retStr)
     retStr = root.toStyledString();
 }
 
+void
+CommandHandler::ledgerEntry(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+    auto it = retMap.find("key");
+    if (it == retMap.end())
+    {
+        throw std::invalid_argument("Must specify a key: ledgerentry?key=");
+    }
+    std::vector<uint8_t> binKey;
+    decoder::decode_b64(it->second, binKey);
+    LedgerKey key;
+    xdr::xdr_from_opaque(binKey, key);
+
+    auto snapshot = mApp.getLedgerManager().getLastClosedSnapshot();
+    if (!snapshot)
+    {
+        throw std::runtime_error("The state of the last closed ledger is not "
+                                 "available yet");
+    }
+    Json::Value root;
+    root["ledger"] = snapshot->getHeader().header.ledgerSeq;
+    auto entry = snapshot->load(key);
+    if (entry)
+    {
+        root["entry"] = decoder::encode_b64(xdr::xdr_to_opaque(*entry));
+    }
+    else
+    {
+        root["entry"] = Json::nullValue;
+    }
+    retStr = root.toStyledString();
+}
+
 void
 CommandHandler::maintenance(std::string const& params, std::string& retStr)
 {
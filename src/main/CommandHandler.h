@@ -5,7 +5,16 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "lib/http/server.hpp"
+#include "main/PrometheusExporter.h"
+#include "util/asio.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 
 /*
 handler functions for the http commands this server supports
@@ -14,40 +23,91 @@ handler functions for the http commands this server supports
 namespace stellar
 {
 class Application;
+class VirtualTimer;
 
+// When listening, the server runs on a thread of its own, so that clients
+// (slow ones included) don't hold the main thread. Routes still run on the
+// main thread, which requests are handed to through VirtualClock::postToMain,
+// except for the read-only ones of SNAPSHOT_ROUTES requested without
+// parameters: these are served from the last reply the main thread
+// published, which is refreshed in the background once older than
+// SNAPSHOT_REFRESH_PERIOD.
 class CommandHandler
 {
     typedef std::function<void(CommandHandler*, std::string const&,
                                std::string&)>
         HandlerRoute;
 
+    struct Snapshot
+    {
+        std::string mReply;
+        std::chrono::steady_clock::time_point mPublished;
+        bool mRefreshing{false};
+    };
+
     Application& mApp;
+    // set on destruction, for the requests still waiting for the main thread
+    std::shared_ptr<std::atomic<bool>> mStopping;
+    asio::io_service mHttpIOService;
+    std::unique_ptr<asio::io_service::work> mHttpWork;
     std::unique_ptr<http::server::server> mServer;
+    std::thread mHttpThread;
+    PrometheusExporter mPrometheusExporter;
+
+    std::mutex mSnapshotsMutex;
+    std::map<std::string, Snapshot> mSnapshots;
+
+    // ends the capture started by the profile route
+    std::unique_ptr<VirtualTimer> mProfileTimer;
+    void finishProfile(std::string const& path);
 
     void addRoute(std::string const& name, HandlerRoute route);
     void safeRouter(HandlerRoute route, std::string const& params,
                     std::string& retStr);
+    // called on the HTTP thread
+    void serve(std::string const& name, HandlerRoute route,
+               std::string const& params, std::string& retStr);
+    // runs @p route on the main thread, waiting for its reply
+    void runOnMainThread(HandlerRoute route, std::string const& params,
+                         std::string& retStr);
+    // refreshes the snapshot of route @p name on the main thread
+    void refreshSnapshot(std::string const& name, HandlerRoute route);
 
   public:
+    static std::set<std::string> const SNAPSHOT_ROUTES;
+    static std::chrono::milliseconds const SNAPSHOT_REFRESH_PERIOD;
+    // transactions per txbatch request, at most
+    static size_t const MAX_TX_BATCH;
+    // seconds a capture of the profile route lasts, at most
+    static uint32_t const MAX_PROFILE_SECONDS;
+
     CommandHandler(Application& app);
+    ~CommandHandler();
 
     void manualCmd(std::string const& cmd);
 
     void fileNotFound(std::string const& params, std::string& retStr);
 
+    void allocator(std::string const& params, std::string& retStr);
     void bans(std::string const& params, std::string& retStr);
     void catchup(std::string const& params, std::string& retStr);
     void checkdb(std::string const& params, std::string& retStr);
+    void closeTrace(std::string const& params, std::string& retStr);
     void connect(std::string const& params, std::string& retStr);
     void dropcursor(std::string const& params, std::string& retStr);
     void dropPeer(std::string const& params, std::string& retStr);
     void generateLoad(std::string const& params, std::string& retStr);
+    void hotTrace(std::string const& params, std::string& retStr);
     void info(std::string const& params, std::string& retStr);
+    // served on the thread of the request, from the snapshot of the LCL
+    void ledgerEntry(std::string const& params, std::string& retStr);
     void ll(std::string const& params, std::string& retStr);
     void logRotate(std::string const& params, std::string& retStr);
     void maintenance(std::string const& params, std::string& retStr);
     void manualClose(std::string const& params, std::string& retStr);
     void metrics(std::string const& params, std::string& retStr);
+    void profile(std::string const& params, std::string& retStr);
+    void prometheusMetrics(std::string const& params, std::string& retStr);
     void clearMetrics(std::string const& params, std::string& retStr);
     void peers(std::string const& params, std::string& retStr);
     void quorum(std::string const& params, std::string& retStr);
@@ -55,6 +115,8 @@ class CommandHandler
     void getcursor(std::string const& params, std::string& retStr);
     void scpInfo(std::string const& params, std::string& retStr);
     void tx(std::string const& params, std::string& retStr);
+    void txBatch(std::string const& params, std::string const& body,
+                 std::string& retStr);
     void testAcc(std::string const& params, std::string& retStr);
     void testTx(std::string const& params, std::string& retStr);
     void unban(std::string const& params, std::string& retStr);
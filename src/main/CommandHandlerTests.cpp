@@ -0,0 +1,174 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/CommandHandler.h"
+#include "lib/catch.hpp"
+#include "lib/http/HttpClient.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "transactions/TransactionFrame.h"
+#include "util/Decoder.h"
+#include "util/Fs.h"
+#include "util/SamplingProfiler.h"
+#include "util/TmpDir.h"
+#include "xdrpp/marshal.h"
+
+#include <future>
+#include <thread>
+
+using namespace stellar;
+
+TEST_CASE("http requests are served off the main thread", "[commandhandler]")
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    auto cfg = getTestConfig();
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto request = [&](std::string const& path) {
+        return std::async(std::launch::async, [&cfg, path]() {
+            std::string ret;
+            if (http_request("127.0.0.1", path, cfg.HTTP_PORT, ret) != 200)
+            {
+                return std::string("request failed");
+            }
+            return ret;
+        });
+    };
+    auto wait = [&](std::future<std::string>& reply) {
+        while (reply.wait_for(std::chrono::milliseconds(0)) !=
+               std::future_status::ready)
+        {
+            clock.crank(false);
+        }
+        return reply.get();
+    };
+
+    SECTION("routes run on the main thread")
+    {
+        auto reply = request("/ll?level=info&partition=Ledger");
+        // nothing is served until the main thread cranks
+        REQUIRE(reply.wait_for(std::chrono::milliseconds(200)) ==
+                std::future_status::timeout);
+        REQUIRE(wait(reply).find("Ledger") != std::string::npos);
+    }
+
+    SECTION("snapshot routes are served without the main thread")
+    {
+        auto first = request("/info");
+        REQUIRE(wait(first).find("\"info\"") != std::string::npos);
+        // the snapshot, while the main thread is not cranked
+        auto second = request("/info");
+        REQUIRE(second.get().find("\"info\"") != std::string::npos);
+    }
+}
+
+TEST_CASE("submit a batch of transactions", "[commandhandler][herder]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto minBalance = app->getLedgerManager().getMinBalance(0);
+    std::vector<TransactionEnvelope> envelopes;
+    for (int i = 0; i < 3; i++)
+    {
+        auto name = "dest" + std::to_string(i);
+        auto dest = txtest::getAccount(name.c_str());
+        envelopes.emplace_back(
+            root.tx({txtest::createAccount(dest.getPublicKey(), minBalance)})
+                ->getEnvelope());
+    }
+    // a duplicate, and a transaction with a bad sequence number
+    envelopes.emplace_back(envelopes[0]);
+    envelopes.emplace_back(envelopes[1]);
+    envelopes.back().tx.seqNum += 10;
+    envelopes.back().signatures.clear();
+
+    auto submit = [&](std::string const& params, std::string const& body) {
+        std::string reply;
+        app->getCommandHandler().txBatch(params, body, reply);
+        Json::Value res;
+        Json::Reader().parse(reply, res);
+        return res;
+    };
+    auto check = [&](Json::Value const& res) {
+        REQUIRE(res.size() == 5);
+        for (int i = 0; i < 3; i++)
+        {
+            REQUIRE(res[i]["status"].asString() == "PENDING");
+        }
+        REQUIRE(res[3]["status"].asString() == "DUPLICATE");
+        REQUIRE(res[4]["status"].asString() == "ERROR");
+        REQUIRE(!res[4]["error"].asString().empty());
+    };
+
+    SECTION("base64 lines")
+    {
+        std::string body;
+        for (auto const& e : envelopes)
+        {
+            body += decoder::encode_b64(xdr::xdr_to_opaque(e)) + "\n";
+        }
+        check(submit("", body));
+    }
+    SECTION("binary")
+    {
+        xdr::xvector<TransactionEnvelope> batch(envelopes.begin(),
+                                                envelopes.end());
+        auto bin = xdr::xdr_to_opaque(batch);
+        check(submit("?format=binary", std::string(bin.begin(), bin.end())));
+    }
+    SECTION("malformed")
+    {
+        REQUIRE_THROWS(submit("", "not base64\n"));
+    }
+}
+
+TEST_CASE("capture a profile", "[commandhandler][profiler]")
+{
+    TmpDir dir("profile");
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.LOG_FILE_PATH = dir.getName() + "/stellar-core.log";
+    auto app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto profile = [&](std::string const& params) {
+        std::string reply;
+        app->getCommandHandler().profile(params, reply);
+        Json::Value res;
+        Json::Reader().parse(reply, res);
+        return res;
+    };
+
+    if (!profiler::isSupported())
+    {
+        REQUIRE_THROWS(profile("?seconds=1"));
+        return;
+    }
+
+    REQUIRE_THROWS(profile("?seconds=0"));
+    REQUIRE_THROWS(profile("?seconds=100000"));
+
+    auto res = profile("?seconds=1&frequency=1000");
+    REQUIRE(res["status"].asString() == "started");
+    auto path = res["file"].asString();
+    REQUIRE(path.compare(0, dir.getName().size(), dir.getName()) == 0);
+    REQUIRE(profiler::isRunning());
+    REQUIRE_THROWS(profile("?seconds=1"));
+
+    auto end = clock.now() + std::chrono::seconds(2);
+    while (clock.now() < end && profiler::isRunning())
+    {
+        clock.crank(false);
+    }
+    REQUIRE(!profiler::isRunning());
+    REQUIRE(fs::exists(path));
+}
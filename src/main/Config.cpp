@@ -34,7 +34,7 @@ static const std::unordered_set<std::string> TESTING_ONLY_OPTIONS = {
 
 // Options that should only be used for testing
 static const std::unordered_set<std::string> TESTING_SUGGESTED_OPTIONS = {
-    "ALLOW_LOCALHOST_FOR_TESTING"};
+    "ALLOW_LOCALHOST_FOR_TESTING", "RANDOM_SEED_FOR_TESTING"};
 
 Config::Config() : NODE_SEED(SecretKey::random())
 {
@@ -45,7 +45,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
     LEDGER_PROTOCOL_VERSION = CURRENT_LEDGER_PROTOCOL_VERSION;
 
     OVERLAY_PROTOCOL_MIN_VERSION = 6;
-    OVERLAY_PROTOCOL_VERSION = 7;
+    OVERLAY_PROTOCOL_VERSION = 11;
 
     VERSION_STR = STELLAR_CORE_VERSION;
 
@@ -54,19 +54,39 @@ Config::Config() : NODE_SEED(SecretKey::random())
     MANUAL_CLOSE = false;
     CATCHUP_COMPLETE = false;
     CATCHUP_RECENT = 0;
+    CATCHUP_REPLAY_ONLY = false;
+    CATCHUP_BUFFER_MEMORY_MB = 256;
+    TRANSACTION_META = TX_META_FULL;
+    METADATA_OUTPUT_STREAM = "";
+    RESTORE_FROM_BUCKETS_ON_START = false;
+    STARTUP_VERIFY_BUCKETS = false;
+    ENTRY_CACHE_WARM_KEYS = 0;
     AUTOMATIC_MAINTENANCE_PERIOD = std::chrono::seconds{14400};
     AUTOMATIC_MAINTENANCE_COUNT = 50000;
+    HISTORY_PARTITION_CHECKPOINTS = 0;
+    INCREMENTAL_CHECKDB_PERIOD = std::chrono::seconds{0};
+    INCREMENTAL_CHECKDB_SLICE_SIZE = 1000;
+    INCREMENTAL_CHECKDB_MIN_IDLE_PERCENT = 50;
     ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = false;
     ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = false;
+    RANDOM_SEED_FOR_TESTING = 0;
     ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING = 0;
     ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING = false;
     ALLOW_LOCALHOST_FOR_TESTING = false;
     USE_CONFIG_FOR_GENESIS = false;
+    VERIFY_SIGNATURES_ON_MAIN_THREAD_FOR_TESTING = false;
     FAILURE_SAFETY = -1;
     UNSAFE_QUORUM = false;
 
     LOG_FILE_PATH = "stellar-core.%datetime{%Y.%M.%d-%H:%m:%s}.log";
     BUCKET_DIR_PATH = "buckets";
+    SHARED_BUCKET_DIR_PATH = "";
+    IN_MEMORY_SHALLOW_BUCKETS = false;
+    COMPRESS_BUCKET_FILES = false;
+    BUCKET_SCRUB_BYTES_PER_SECOND = 0;
+    HISTORY_CACHE_DIR_PATH = "";
+    HISTORY_CACHE_SIZE_MB = 10240;
+    PUBLISH_CHECKPOINT_INDEXES = false;
 
     TESTING_UPGRADE_DESIRED_FEE = LedgerManager::GENESIS_LEDGER_BASE_FEE;
     TESTING_UPGRADE_RESERVE = LedgerManager::GENESIS_LEDGER_BASE_RESERVE;
@@ -82,11 +102,48 @@ Config::Config() : NODE_SEED(SecretKey::random())
     MAX_PENDING_CONNECTIONS = 500;
     PEER_AUTHENTICATION_TIMEOUT = 2;
     PEER_TIMEOUT = 30;
+    PEER_SOCKET_SEND_BUFFER_SIZE = 0;
+    PEER_SOCKET_RECEIVE_BUFFER_SIZE = 0;
+    PEER_TCP_NODELAY = true;
+    PEER_TCP_KEEPALIVE = false;
+    PEER_ACCEPT_THREAD = false;
+    PEER_OUTBOUND_TX_QUEUE_BYTES = 4 * 1024 * 1024;
+    PULL_MODE_TX_FLOODING = false;
+    COMPACT_TX_SET_RELAY = false;
+    OVERLAY_COMPRESSION = false;
+    IN_MEMORY_PEER_TABLE = false;
     PREFERRED_PEERS_ONLY = false;
 
     MINIMUM_IDLE_PERCENT = 0;
+    PEER_TRANSACTION_RATE_LIMIT = 1000;
+    PEER_REQUEST_RATE_LIMIT = 100;
+    IN_MEMORY_ORDER_BOOK = false;
+    ORDER_BOOK_CACHE = false;
+    IN_MEMORY_LEDGER_STATE = false;
+    INFLATION_VOTE_TALLY = false;
+    ACCOUNT_ENTRY_XDR = false;
+    COMPRESS_TX_HISTORY = false;
+    BACKGROUND_TX_SIG_VERIFICATION = false;
+    VERIFY_SIG_CACHE_SIZE = PubKeyUtils::DEFAULT_VERIFY_SIG_CACHE_SIZE;
+    LEDGER_HEADER_CACHE_SIZE = 64;
+    QUORUM_INTERSECTION_CHECKER = false;
+    MANAGED_SQLITE = false;
+    DATABASE_DURABILITY = DB_DURABILITY_FULL;
+    MEMORY_ACCOUNTING = false;
+    MAX_CONCURRENT_DEEP_BUCKET_MERGES = 1;
+    DEEP_BUCKET_MERGE_WRITE_RATE_MB = 0;
 
     MAX_CONCURRENT_SUBPROCESSES = 16;
+    TRANSFER_SUBPROCESSES = SubprocessConfiguration{0, 0, false};
+    OTHER_SUBPROCESSES = SubprocessConfiguration{0, 0, false};
+    BUCKET_MERGE_WORKERS = WorkerPoolConfiguration{0, {}};
+    CRYPTO_VERIFY_WORKERS = WorkerPoolConfiguration{0, {}};
+    HISTORY_IO_WORKERS = WorkerPoolConfiguration{0, {}};
+    MISC_WORKERS = WorkerPoolConfiguration{0, {}};
+    MAIN_THREAD_CPU = -1;
+    INVARIANT_CHECKS_IN_BACKGROUND = false;
+    INVARIANT_CHECKS_MAX_LAG = 10000;
+    INVARIANT_CHECKS_HALT_ON_FAILURE = true;
     NODE_IS_VALIDATOR = false;
 
     DATABASE = SecretValue{"sqlite3://:memory:"};
@@ -118,6 +175,30 @@ readString(ConfigItem const& item)
     return item.second->as<std::string>()->value();
 }
 
+template <typename T>
+std::vector<T>
+readIntArray(ConfigItem const& item, T min = std::numeric_limits<T>::min(),
+             T max = std::numeric_limits<T>::max())
+{
+    auto result = std::vector<T>{};
+    if (!item.second->is_array())
+    {
+        throw std::invalid_argument(
+            fmt::format("{} must be an array", item.first));
+    }
+    for (auto v : item.second->as_array()->array())
+    {
+        if (!v->as<int64_t>() || v->as<int64_t>()->value() < min ||
+            v->as<int64_t>()->value() > max)
+        {
+            throw std::invalid_argument(
+                fmt::format("invalid element of {}", item.first));
+        }
+        result.push_back(static_cast<T>(v->as<int64_t>()->value()));
+    }
+    return result;
+}
+
 std::vector<std::string>
 readStringArray(ConfigItem const& item)
 {
@@ -318,10 +399,60 @@ Config::load(std::string const& filename)
             {
                 CATCHUP_RECENT = readInt<uint32_t>(item, 0, UINT32_MAX - 1);
             }
+            else if (item.first == "CATCHUP_REPLAY_ONLY")
+            {
+                CATCHUP_REPLAY_ONLY = readBool(item);
+            }
+            else if (item.first == "CATCHUP_BUFFER_MEMORY_MB")
+            {
+                CATCHUP_BUFFER_MEMORY_MB = readInt<uint32_t>(item);
+            }
+            else if (item.first == "TRANSACTION_META")
+            {
+                auto mode = readString(item);
+                if (mode == "FULL")
+                {
+                    TRANSACTION_META = TX_META_FULL;
+                }
+                else if (mode == "CHANGES")
+                {
+                    TRANSACTION_META = TX_META_CHANGES;
+                }
+                else if (mode == "NONE")
+                {
+                    TRANSACTION_META = TX_META_NONE;
+                }
+                else
+                {
+                    throw std::invalid_argument(
+                        "TRANSACTION_META must be FULL, CHANGES or NONE");
+                }
+            }
+            else if (item.first == "METADATA_OUTPUT_STREAM")
+            {
+                METADATA_OUTPUT_STREAM = readString(item);
+            }
+            else if (item.first == "RESTORE_FROM_BUCKETS_ON_START")
+            {
+                RESTORE_FROM_BUCKETS_ON_START = readBool(item);
+            }
+            else if (item.first == "STARTUP_VERIFY_BUCKETS")
+            {
+                STARTUP_VERIFY_BUCKETS = readBool(item);
+            }
+            else if (item.first == "ENTRY_CACHE_WARM_KEYS")
+            {
+                ENTRY_CACHE_WARM_KEYS = readInt<uint32_t>(item);
+            }
             else if (item.first == "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING")
             {
                 ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = readBool(item);
             }
+            else if (item.first == "RANDOM_SEED_FOR_TESTING")
+            {
+                RANDOM_SEED_FOR_TESTING =
+                    static_cast<uint64_t>(readInt<int64_t>(item, 0));
+            }
             else if (item.first == "ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING")
             {
                 ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = readBool(item);
@@ -344,6 +475,24 @@ Config::load(std::string const& filename)
             {
                 AUTOMATIC_MAINTENANCE_COUNT = readInt<uint32_t>(item);
             }
+            else if (item.first == "HISTORY_PARTITION_CHECKPOINTS")
+            {
+                HISTORY_PARTITION_CHECKPOINTS = readInt<uint32_t>(item);
+            }
+            else if (item.first == "INCREMENTAL_CHECKDB_PERIOD")
+            {
+                INCREMENTAL_CHECKDB_PERIOD =
+                    std::chrono::seconds{readInt<uint32_t>(item)};
+            }
+            else if (item.first == "INCREMENTAL_CHECKDB_SLICE_SIZE")
+            {
+                INCREMENTAL_CHECKDB_SLICE_SIZE = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "INCREMENTAL_CHECKDB_MIN_IDLE_PERCENT")
+            {
+                INCREMENTAL_CHECKDB_MIN_IDLE_PERCENT =
+                    readInt<uint32_t>(item, 0, 100);
+            }
             else if (item.first == "MANUAL_CLOSE")
             {
                 MANUAL_CLOSE = readBool(item);
@@ -362,6 +511,34 @@ Config::load(std::string const& filename)
             {
                 BUCKET_DIR_PATH = readString(item);
             }
+            else if (item.first == "SHARED_BUCKET_DIR_PATH")
+            {
+                SHARED_BUCKET_DIR_PATH = readString(item);
+            }
+            else if (item.first == "IN_MEMORY_SHALLOW_BUCKETS")
+            {
+                IN_MEMORY_SHALLOW_BUCKETS = readBool(item);
+            }
+            else if (item.first == "COMPRESS_BUCKET_FILES")
+            {
+                COMPRESS_BUCKET_FILES = readBool(item);
+            }
+            else if (item.first == "BUCKET_SCRUB_BYTES_PER_SECOND")
+            {
+                BUCKET_SCRUB_BYTES_PER_SECOND = readInt<uint32_t>(item);
+            }
+            else if (item.first == "HISTORY_CACHE_DIR_PATH")
+            {
+                HISTORY_CACHE_DIR_PATH = readString(item);
+            }
+            else if (item.first == "HISTORY_CACHE_SIZE_MB")
+            {
+                HISTORY_CACHE_SIZE_MB = readInt<uint32_t>(item);
+            }
+            else if (item.first == "PUBLISH_CHECKPOINT_INDEXES")
+            {
+                PUBLISH_CHECKPOINT_INDEXES = readBool(item);
+            }
             else if (item.first == "NODE_NAMES")
             {
                 auto names = readStringArray(item);
@@ -407,6 +584,48 @@ Config::load(std::string const& filename)
             {
                 PEER_TIMEOUT = readInt<unsigned short>(item, 1, UINT16_MAX);
             }
+            else if (item.first == "PEER_SOCKET_SEND_BUFFER_SIZE")
+            {
+                PEER_SOCKET_SEND_BUFFER_SIZE =
+                    readInt<uint32_t>(item, 0, INT32_MAX);
+            }
+            else if (item.first == "PEER_SOCKET_RECEIVE_BUFFER_SIZE")
+            {
+                PEER_SOCKET_RECEIVE_BUFFER_SIZE =
+                    readInt<uint32_t>(item, 0, INT32_MAX);
+            }
+            else if (item.first == "PEER_TCP_NODELAY")
+            {
+                PEER_TCP_NODELAY = readBool(item);
+            }
+            else if (item.first == "PEER_TCP_KEEPALIVE")
+            {
+                PEER_TCP_KEEPALIVE = readBool(item);
+            }
+            else if (item.first == "PEER_ACCEPT_THREAD")
+            {
+                PEER_ACCEPT_THREAD = readBool(item);
+            }
+            else if (item.first == "PEER_OUTBOUND_TX_QUEUE_BYTES")
+            {
+                PEER_OUTBOUND_TX_QUEUE_BYTES = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "PULL_MODE_TX_FLOODING")
+            {
+                PULL_MODE_TX_FLOODING = readBool(item);
+            }
+            else if (item.first == "COMPACT_TX_SET_RELAY")
+            {
+                COMPACT_TX_SET_RELAY = readBool(item);
+            }
+            else if (item.first == "OVERLAY_COMPRESSION")
+            {
+                OVERLAY_COMPRESSION = readBool(item);
+            }
+            else if (item.first == "IN_MEMORY_PEER_TABLE")
+            {
+                IN_MEMORY_PEER_TABLE = readBool(item);
+            }
             else if (item.first == "PREFERRED_PEERS")
             {
                 PREFERRED_PEERS = readStringArray(item);
@@ -436,10 +655,157 @@ Config::load(std::string const& filename)
                 MAX_CONCURRENT_SUBPROCESSES =
                     static_cast<size_t>(readInt<int>(item, 1));
             }
+            else if (item.first == "MAX_CONCURRENT_TRANSFER_SUBPROCESSES")
+            {
+                TRANSFER_SUBPROCESSES.mMaxProcesses =
+                    static_cast<size_t>(readInt<int>(item, 0));
+            }
+            else if (item.first == "MAX_CONCURRENT_OTHER_SUBPROCESSES")
+            {
+                OTHER_SUBPROCESSES.mMaxProcesses =
+                    static_cast<size_t>(readInt<int>(item, 0));
+            }
+            else if (item.first == "TRANSFER_SUBPROCESS_NICE")
+            {
+                TRANSFER_SUBPROCESSES.mNice = readInt<int>(item, -20, 19);
+            }
+            else if (item.first == "OTHER_SUBPROCESS_NICE")
+            {
+                OTHER_SUBPROCESSES.mNice = readInt<int>(item, -20, 19);
+            }
+            else if (item.first == "TRANSFER_SUBPROCESS_IDLE_IO")
+            {
+                TRANSFER_SUBPROCESSES.mIdleIO = readBool(item);
+            }
+            else if (item.first == "OTHER_SUBPROCESS_IDLE_IO")
+            {
+                OTHER_SUBPROCESSES.mIdleIO = readBool(item);
+            }
+            else if (item.first == "BUCKET_MERGE_WORKER_THREADS")
+            {
+                BUCKET_MERGE_WORKERS.mThreads = readInt<uint32_t>(item, 0, 256);
+            }
+            else if (item.first == "BUCKET_MERGE_WORKER_CPUS")
+            {
+                BUCKET_MERGE_WORKERS.mCPUs =
+                    readIntArray<uint32_t>(item, 0, 1023);
+            }
+            else if (item.first == "CRYPTO_VERIFY_WORKER_THREADS")
+            {
+                CRYPTO_VERIFY_WORKERS.mThreads =
+                    readInt<uint32_t>(item, 0, 256);
+            }
+            else if (item.first == "CRYPTO_VERIFY_WORKER_CPUS")
+            {
+                CRYPTO_VERIFY_WORKERS.mCPUs =
+                    readIntArray<uint32_t>(item, 0, 1023);
+            }
+            else if (item.first == "HISTORY_IO_WORKER_THREADS")
+            {
+                HISTORY_IO_WORKERS.mThreads = readInt<uint32_t>(item, 0, 256);
+            }
+            else if (item.first == "HISTORY_IO_WORKER_CPUS")
+            {
+                HISTORY_IO_WORKERS.mCPUs =
+                    readIntArray<uint32_t>(item, 0, 1023);
+            }
+            else if (item.first == "MISC_WORKER_THREADS")
+            {
+                MISC_WORKERS.mThreads = readInt<uint32_t>(item, 0, 256);
+            }
+            else if (item.first == "MISC_WORKER_CPUS")
+            {
+                MISC_WORKERS.mCPUs = readIntArray<uint32_t>(item, 0, 1023);
+            }
+            else if (item.first == "MAIN_THREAD_CPU")
+            {
+                MAIN_THREAD_CPU = readInt<int>(item, -1, 1023);
+            }
             else if (item.first == "MINIMUM_IDLE_PERCENT")
             {
                 MINIMUM_IDLE_PERCENT = readInt<uint32_t>(item, 0, 100);
             }
+            else if (item.first == "PEER_TRANSACTION_RATE_LIMIT")
+            {
+                PEER_TRANSACTION_RATE_LIMIT = readInt<uint32_t>(item, 0);
+            }
+            else if (item.first == "PEER_REQUEST_RATE_LIMIT")
+            {
+                PEER_REQUEST_RATE_LIMIT = readInt<uint32_t>(item, 0);
+            }
+            else if (item.first == "IN_MEMORY_ORDER_BOOK")
+            {
+                IN_MEMORY_ORDER_BOOK = readBool(item);
+            }
+            else if (item.first == "ORDER_BOOK_CACHE")
+            {
+                ORDER_BOOK_CACHE = readBool(item);
+            }
+            else if (item.first == "IN_MEMORY_LEDGER_STATE")
+            {
+                IN_MEMORY_LEDGER_STATE = readBool(item);
+            }
+            else if (item.first == "INFLATION_VOTE_TALLY")
+            {
+                INFLATION_VOTE_TALLY = readBool(item);
+            }
+            else if (item.first == "ACCOUNT_ENTRY_XDR")
+            {
+                ACCOUNT_ENTRY_XDR = readBool(item);
+            }
+            else if (item.first == "COMPRESS_TX_HISTORY")
+            {
+                COMPRESS_TX_HISTORY = readBool(item);
+            }
+            else if (item.first == "BACKGROUND_TX_SIG_VERIFICATION")
+            {
+                BACKGROUND_TX_SIG_VERIFICATION = readBool(item);
+            }
+            else if (item.first == "VERIFY_SIG_CACHE_SIZE")
+            {
+                VERIFY_SIG_CACHE_SIZE = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "LEDGER_HEADER_CACHE_SIZE")
+            {
+                LEDGER_HEADER_CACHE_SIZE = readInt<uint32_t>(item);
+            }
+            else if (item.first == "QUORUM_INTERSECTION_CHECKER")
+            {
+                QUORUM_INTERSECTION_CHECKER = readBool(item);
+            }
+            else if (item.first == "MANAGED_SQLITE")
+            {
+                MANAGED_SQLITE = readBool(item);
+            }
+            else if (item.first == "DATABASE_DURABILITY")
+            {
+                auto durability = readString(item);
+                if (durability == "FULL")
+                {
+                    DATABASE_DURABILITY = DB_DURABILITY_FULL;
+                }
+                else if (durability == "RELAXED")
+                {
+                    DATABASE_DURABILITY = DB_DURABILITY_RELAXED;
+                }
+                else
+                {
+                    throw std::invalid_argument(
+                        "DATABASE_DURABILITY must be FULL or RELAXED");
+                }
+            }
+            else if (item.first == "MEMORY_ACCOUNTING")
+            {
+                MEMORY_ACCOUNTING = readBool(item);
+            }
+            else if (item.first == "MAX_CONCURRENT_DEEP_BUCKET_MERGES")
+            {
+                MAX_CONCURRENT_DEEP_BUCKET_MERGES = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "DEEP_BUCKET_MERGE_WRITE_RATE_MB")
+            {
+                DEEP_BUCKET_MERGE_WRITE_RATE_MB = readInt<uint32_t>(item);
+            }
             else if (item.first == "HISTORY")
             {
                 auto hist = item.second->as_group();
@@ -454,7 +820,8 @@ Config::load(std::string const& filename)
                             throw std::invalid_argument(
                                 "malformed HISTORY config block");
                         }
-                        std::string get, put, mkdir;
+                        std::string get, put, mkdir, url;
+                        int64_t connections = 4;
                         for (auto const& c : *tab)
                         {
                             if (c.first == "get")
@@ -469,6 +836,23 @@ Config::load(std::string const& filename)
                             {
                                 mkdir = c.second->as<std::string>()->value();
                             }
+                            else if (c.first == "url")
+                            {
+                                url = c.second->as<std::string>()->value();
+                            }
+                            else if (c.first == "connections")
+                            {
+                                auto v = c.second->as<int64_t>();
+                                if (!v || v->value() <= 0 ||
+                                    v->value() > UINT16_MAX)
+                                {
+                                    throw std::invalid_argument(
+                                        "invalid 'connections' within "
+                                        "[HISTORY." +
+                                        archive.first + "]");
+                                }
+                                connections = v->value();
+                            }
                             else
                             {
                                 std::string err(
@@ -479,8 +863,29 @@ Config::load(std::string const& filename)
                                 throw std::invalid_argument(err);
                             }
                         }
+                        if (!url.empty())
+                        {
+                            if (!get.empty())
+                            {
+                                throw std::invalid_argument(
+                                    "both 'get' and 'url' within [HISTORY." +
+                                    archive.first + "]");
+                            }
+                            if (url.compare(0, 7, "http://") != 0)
+                            {
+                                throw std::invalid_argument(
+                                    "'url' within [HISTORY." + archive.first +
+                                    "] must start with http:// (use a 'get' "
+                                    "command for other protocols)");
+                            }
+                        }
                         HISTORY[archive.first] = HistoryArchiveConfiguration{
-                            archive.first, get, put, mkdir};
+                            archive.first,
+                            get,
+                            put,
+                            mkdir,
+                            url,
+                            static_cast<uint32_t>(connections)};
                     }
                 }
                 else
@@ -492,6 +897,10 @@ Config::load(std::string const& filename)
             {
                 DATABASE = SecretValue{readString(item)};
             }
+            else if (item.first == "DATABASE_READONLY")
+            {
+                DATABASE_READONLY = SecretValue{readString(item)};
+            }
             else if (item.first == "NETWORK_PASSPHRASE")
             {
                 NETWORK_PASSPHRASE = readString(item);
@@ -504,6 +913,18 @@ Config::load(std::string const& filename)
             {
                 INVARIANT_CHECKS = readStringArray(item);
             }
+            else if (item.first == "INVARIANT_CHECKS_IN_BACKGROUND")
+            {
+                INVARIANT_CHECKS_IN_BACKGROUND = readBool(item);
+            }
+            else if (item.first == "INVARIANT_CHECKS_MAX_LAG")
+            {
+                INVARIANT_CHECKS_MAX_LAG = readInt<uint32_t>(item, 1);
+            }
+            else if (item.first == "INVARIANT_CHECKS_HALT_ON_FAILURE")
+            {
+                INVARIANT_CHECKS_HALT_ON_FAILURE = readBool(item);
+            }
             else
             {
                 std::string err("Unknown configuration entry: '");
@@ -24,6 +24,29 @@ struct HistoryArchiveConfiguration
     std::string mGetCmd;
     std::string mPutCmd;
     std::string mMkdirCmd;
+    // http:// url to download files from with the built-in client, instead
+    // of a get command, and how many connections it may open
+    std::string mURL;
+    uint32_t mConnections;
+};
+
+struct WorkerPoolConfiguration
+{
+    // number of threads, 0 for a default derived from the number of cores
+    uint32_t mThreads;
+    // CPUs the threads may run on, any if empty
+    std::vector<uint32_t> mCPUs;
+};
+
+struct SubprocessConfiguration
+{
+    // number of processes that may run at once, 0 for no limit other than
+    // MAX_CONCURRENT_SUBPROCESSES
+    size_t mMaxProcesses;
+    // niceness the processes run at
+    int mNice;
+    // whether the processes only get disk time nobody else wants (Linux only)
+    bool mIdleIO;
 };
 
 class Config : public std::enable_shared_from_this<Config>
@@ -85,6 +108,52 @@ class Config : public std::enable_shared_from_this<Config>
     // If you want, say, a week of history, set this to 120000.
     uint32_t CATCHUP_RECENT;
 
+    // Whether ledgers replayed during catchup skip storing their
+    // transactions (txhistory and txfeehistory tables) and computing their
+    // metadata, which only matters to nodes serving history. Default is
+    // false; it can't be set on nodes publishing to history archives.
+    bool CATCHUP_REPLAY_ONLY;
+
+    // Memory the ledgers closed by the network during a catchup are
+    // buffered in before being spilled to a file (see SyncingLedgerChain),
+    // 0 for no limit. Defaults to 256.
+    uint32_t CATCHUP_BUFFER_MEMORY_MB;
+
+    // How much metadata (the ledger entries changed by each transaction,
+    // stored with it in the txhistory and txfeehistory tables) is computed:
+    // TX_META_FULL includes the state of every entry before its change,
+    // TX_META_CHANGES only the entries created, updated and removed and
+    // TX_META_NONE nothing. Default is TX_META_FULL. Entry states are kept
+    // anyway when INVARIANT_CHECKS are enabled, as invariants need them.
+    enum TransactionMetaMode
+    {
+        TX_META_NONE,
+        TX_META_CHANGES,
+        TX_META_FULL
+    };
+    TransactionMetaMode TRANSACTION_META;
+
+    // Where to stream the header, transactions, results and metadata of
+    // each ledger closed (see LedgerCloseMetaStream): "fd:N" or the path of
+    // a file, FIFO or Unix socket. Empty (the default) to not stream them.
+    std::string METADATA_OUTPUT_STREAM;
+
+    // With an in-memory DATABASE, rebuild it at startup from the ledger
+    // state saved in the bucket directory by the previous run (as
+    // --restore-from-buckets does) instead of starting from genesis.
+    bool RESTORE_FROM_BUCKETS_ON_START;
+
+    // Check the hashes of the bucket files at startup, in parallel with
+    // loading the last known ledger; the ones that do not match are
+    // downloaded again from history.
+    bool STARTUP_VERIFY_BUCKETS;
+
+    // Number of the entries of the entry cache hit the most whose keys are
+    // saved in the bucket directory every 64 ledgers, and
+    // loaded back in the cache at startup (the most recently modified
+    // accounts instead, the first time).
+    uint32_t ENTRY_CACHE_WARM_KEYS;
+
     // Interval between automatic maintenance executions
     std::chrono::seconds AUTOMATIC_MAINTENANCE_PERIOD;
 
@@ -92,6 +161,22 @@ class Config : public std::enable_shared_from_this<Config>
     // maintenance run
     uint32_t AUTOMATIC_MAINTENANCE_COUNT;
 
+    // With PostgreSQL, number of checkpoints of history held by each
+    // partition of the history tables, 0 to leave them unpartitioned
+    uint32_t HISTORY_PARTITION_CHECKPOINTS;
+
+    // Interval between the incremental checks of the bucket list against
+    // the database, 0 to disable them
+    std::chrono::seconds INCREMENTAL_CHECKDB_PERIOD;
+
+    // Number of bucket list entries compared to the database in each
+    // incremental check
+    uint32_t INCREMENTAL_CHECKDB_SLICE_SIZE;
+
+    // An incremental check is skipped unless the database was idle for at
+    // least this percentage of the time since the previous one
+    uint32_t INCREMENTAL_CHECKDB_MIN_IDLE_PERCENT;
+
     // A config parameter that enables synthetic load generation on demand,
     // using the `generateload` runtime command (see CommandHandler.cpp). This
     // option only exists for stress-testing and should not be enabled in
@@ -107,6 +192,10 @@ class Config : public std::enable_shared_from_this<Config>
     // in production as it may render the network unstable.
     uint32 ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING;
 
+    // Seed of the non-cryptographic random numbers (see util/Math.h), to make
+    // them repeatable; 0 for a random seed.
+    uint64_t RANDOM_SEED_FOR_TESTING;
+
     // A config parameter that avoids resolving FutureBuckets before writing
     // them to the database's persistent state; this option exists only
     // for stress-testing the ability to resume from an interrupted merge,
@@ -121,6 +210,12 @@ class Config : public std::enable_shared_from_this<Config>
     // not setable in config file - only tests are allowed to do this
     bool USE_CONFIG_FOR_GENESIS;
 
+    // Verify signatures on the main thread instead of the crypto worker
+    // pool, in the order they were queued, so that virtual-time simulations
+    // of many nodes crank deterministically without a thread pool per node.
+    // not setable in config file - only tests are allowed to do this
+    bool VERIFY_SIGNATURES_ON_MAIN_THREAD_FOR_TESTING;
+
     // This is the number of failures you want to be able to tolerate.
     // You will need at least 3f+1 nodes in your quorum set.
     // If you don't have enough in your quorum set to tolerate the level you
@@ -146,6 +241,24 @@ class Config : public std::enable_shared_from_this<Config>
     std::string VERSION_STR;
     std::string LOG_FILE_PATH;
     std::string BUCKET_DIR_PATH;
+    // content-addressed bucket store shared by several instances, buckets
+    // are hard linked between it and BUCKET_DIR_PATH; empty to disable
+    std::string SHARED_BUCKET_DIR_PATH;
+    // keep the buckets of the first BucketList::kInMemoryLevels levels in
+    // memory, written to BUCKET_DIR_PATH only when published or on shutdown
+    bool IN_MEMORY_SHALLOW_BUCKETS;
+    // store bucket files block compressed (see gz::compressBlockFile)
+    bool COMPRESS_BUCKET_FILES;
+    // rate at which the bucket files are read to check their hashes (see
+    // BucketScrubber), 0 to disable it
+    uint32_t BUCKET_SCRUB_BYTES_PER_SECOND;
+    // persistent cache of verified history files (see HistoryCache), empty
+    // to disable
+    std::string HISTORY_CACHE_DIR_PATH;
+    uint32_t HISTORY_CACHE_SIZE_MB;
+    // publish the checkpoint files with a block compressed variant and an
+    // index of their ledgers (see CheckpointIndex)
+    bool PUBLISH_CHECKPOINT_INDEXES;
     uint32_t TESTING_UPGRADE_DESIRED_FEE; // in stroops
     uint32_t TESTING_UPGRADE_RESERVE;     // in stroops
     uint32_t TESTING_UPGRADE_MAX_TX_PER_LEDGER;
@@ -162,6 +275,30 @@ class Config : public std::enable_shared_from_this<Config>
     unsigned short MAX_PENDING_CONNECTIONS;
     unsigned short PEER_AUTHENTICATION_TIMEOUT;
     unsigned short PEER_TIMEOUT;
+    // socket settings of the peer connections, 0 buffer sizes leave them to
+    // the OS
+    uint32_t PEER_SOCKET_SEND_BUFFER_SIZE;
+    uint32_t PEER_SOCKET_RECEIVE_BUFFER_SIZE;
+    bool PEER_TCP_NODELAY;
+    bool PEER_TCP_KEEPALIVE;
+    // accept connections on a thread of their own
+    bool PEER_ACCEPT_THREAD;
+    // transactions are not sent to a peer that has at least that many bytes
+    // waiting to be written to it
+    uint32_t PEER_OUTBOUND_TX_QUEUE_BYTES;
+    // advertise transaction hashes to peers that support it, instead of
+    // sending them every transaction
+    bool PULL_MODE_TX_FLOODING;
+
+    // answer requests for transaction sets with the short ids of their
+    // transactions to peers that support it, instead of every transaction
+    bool COMPACT_TX_SET_RELAY;
+
+    // compress the large messages sent to peers that support it
+    bool OVERLAY_COMPRESSION;
+
+    // keep the peers table in memory, written to the database in batches
+    bool IN_MEMORY_PEER_TABLE;
 
     // Peers we will always try to stay connected to
     std::vector<std::string> PREFERRED_PEERS;
@@ -181,8 +318,96 @@ class Config : public std::enable_shared_from_this<Config>
     // totally insensitive to overloading.
     uint32_t MINIMUM_IDLE_PERCENT;
 
+    // Messages per second accepted from each peer (0 for no limit), for
+    // transactions (and transaction adverts) and for requests (GET_* and
+    // transaction demands). Excess messages are dropped, and an overloaded
+    // system cuts the transaction rate before it disconnects peers.
+    uint32_t PEER_TRANSACTION_RATE_LIMIT;
+    uint32_t PEER_REQUEST_RATE_LIMIT;
+
+    // Keep every offer in memory, sorted by asset pair and price, and serve
+    // offer crossing from there instead of ORDER BY ... OFFSET queries.
+    bool IN_MEMORY_ORDER_BOOK;
+    // Without IN_MEMORY_ORDER_BOOK: keep the best offers of the asset pairs
+    // crossed during a ledger in memory until it closes.
+    bool ORDER_BOOK_CACHE;
+    // Keep every account, trustline, offer and data entry in the entry
+    // cache, loaded from the bucket list, so that loading one by its key no
+    // longer queries the database.
+    bool IN_MEMORY_LEDGER_STATE;
+
+    // Keep a tally of the inflation votes up to date as ledgers close, so
+    // that inflation does not aggregate the accounts table.
+    bool INFLATION_VOTE_TALLY;
+
+    // Also store each account as the XDR of its LedgerEntry, which loading
+    // it decodes instead of its columns and signers rows.
+    bool ACCOUNT_ENTRY_XDR;
+
+    // Store the XDR values of txhistory and txfeehistory compressed.
+    bool COMPRESS_TX_HISTORY;
+
+    // Verify the signatures of transactions, transaction sets and SCP
+    // envelopes received from peers on worker threads before validating them
+    // on the main thread.
+    bool BACKGROUND_TX_SIG_VERIFICATION;
+
+    // Number of signature verification results kept in the process-wide
+    // cache (see PubKeyUtils::verifySig).
+    size_t VERIFY_SIG_CACHE_SIZE;
+
+    // Number of the last closed ledger headers kept in memory, for the
+    // lookups of recent headers; 0 to always query the database.
+    uint32_t LEDGER_HEADER_CACHE_SIZE;
+
+    // Check that the transitive quorum of this node enjoys quorum
+    // intersection on a worker thread whenever it changes, and report the
+    // result in the `quorum` command.
+    bool QUORUM_INTERSECTION_CHECKER;
+
+    // Tune SQLite for stellar-core (synchronous=NORMAL, larger page cache,
+    // memory mapped I/O) and checkpoint its write-ahead log between ledger
+    // closes instead of whenever SQLite decides to. Ignored on PostgreSQL.
+    bool MANAGED_SQLITE;
+
+    // Whether ledger close commits wait for the disk: DB_DURABILITY_FULL
+    // (the default) always, DB_DURABILITY_RELAXED only for the ledgers
+    // ending a checkpoint. A crash of the machine (or of PostgreSQL) may
+    // then lose the last ledgers committed, which are recovered at startup
+    // from the bucket directory (see recoverLostLedgers). SQLite databases
+    // relax commits only with MANAGED_SQLITE.
+    enum DatabaseDurability
+    {
+        DB_DURABILITY_FULL,
+        DB_DURABILITY_RELAXED
+    };
+    DatabaseDurability DATABASE_DURABILITY;
+
+    // Estimate the memory held by the main structures of each subsystem
+    // whenever metrics are reported, as the memory.* metrics (see
+    // Application::getMemoryUsage).
+    bool MEMORY_ACCOUNTING;
+
+    // Number of bucket merges on level BucketMergeScheduler::DEEP_MERGE_LEVEL
+    // or deeper that may run at the same time, and the rate (in MB per
+    // second, 0 for no limit) at which they may write.
+    uint32_t MAX_CONCURRENT_DEEP_BUCKET_MERGES;
+    uint32_t DEEP_BUCKET_MERGE_WRITE_RATE_MB;
+
     // process-management config
     size_t MAX_CONCURRENT_SUBPROCESSES;
+    // Pools of subprocesses (see ProcessClass), within the limit above.
+    SubprocessConfiguration TRANSFER_SUBPROCESSES;
+    SubprocessConfiguration OTHER_SUBPROCESSES;
+
+    // Threads of the worker pools (see Application::WorkerPool).
+    WorkerPoolConfiguration BUCKET_MERGE_WORKERS;
+    WorkerPoolConfiguration CRYPTO_VERIFY_WORKERS;
+    WorkerPoolConfiguration HISTORY_IO_WORKERS;
+    WorkerPoolConfiguration MISC_WORKERS;
+    // CPU the main thread runs on, which unpinned worker threads then keep
+    // away from; -1 for any
+    int MAIN_THREAD_CPU;
 
     // SCP config
     SecretKey NODE_SEED;
@@ -191,6 +416,15 @@ class Config : public std::enable_shared_from_this<Config>
 
     // Invariants
     std::vector<std::string> INVARIANT_CHECKS;
+    // Check the invariants that allow it (see
+    // Invariant::canCheckInBackground) on worker threads, on snapshots of
+    // the changes of each operation, at most INVARIANT_CHECKS_MAX_LAG
+    // operations behind; failures are reported at the start of the next
+    // ledger close, which fails on strict invariants unless
+    // INVARIANT_CHECKS_HALT_ON_FAILURE is false (then they are only logged).
+    bool INVARIANT_CHECKS_IN_BACKGROUND;
+    uint32_t INVARIANT_CHECKS_MAX_LAG;
+    bool INVARIANT_CHECKS_HALT_ON_FAILURE;
 
     std::map<std::string, std::string> VALIDATOR_NAMES;
 
@@ -199,6 +433,8 @@ class Config : public std::enable_shared_from_this<Config>
 
     // Database config
     SecretValue DATABASE;
+    // replica of DATABASE that read-only diagnostics read from, if not empty
+    SecretValue DATABASE_READONLY;
 
     std::vector<std::string> COMMANDS;
     std::vector<std::string> REPORT_METRICS;
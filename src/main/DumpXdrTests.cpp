@@ -0,0 +1,106 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/KeyUtils.h"
+#include "ledger/EntryFrame.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "main/dumpxdr.h"
+#include "util/Gzip.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
+
+#include <sstream>
+
+using namespace stellar;
+
+TEST_CASE("dumpxdr of a bucket file", "[dumpxdr]")
+{
+    TmpDir dir("dumpxdr");
+    auto filename = dir.getName() + "/bucket-0123456789abcdef.xdr";
+
+    auto accounts = LedgerTestUtils::generateValidAccountEntries(20);
+    auto offers = LedgerTestUtils::generateValidOfferEntries(10);
+    // the first account sells 3 offers, one of which is dead
+    for (size_t i = 0; i < 3; ++i)
+    {
+        offers[i].sellerID = accounts[0].accountID;
+    }
+    {
+        XDROutputFileStream out;
+        out.open(filename);
+        BucketEntry be(LIVEENTRY);
+        for (auto const& a : accounts)
+        {
+            be.liveEntry().data.type(ACCOUNT);
+            be.liveEntry().data.account() = a;
+            out.writeOne(be);
+        }
+        for (size_t i = 1; i < offers.size(); ++i)
+        {
+            be.liveEntry().data.type(OFFER);
+            be.liveEntry().data.offer() = offers[i];
+            out.writeOne(be);
+        }
+        BucketEntry dead(DEADENTRY);
+        be.liveEntry().data.offer() = offers[0];
+        dead.deadEntry() = LedgerEntryKey(be.liveEntry());
+        out.writeOne(dead);
+    }
+
+    auto stats = [&](std::string const& params) {
+        std::ostringstream out;
+        dumpXdrStream(filename, DumpXdrOptions::parse(params), out);
+        Json::Value res;
+        REQUIRE(Json::Reader().parse(out.str(), res));
+        return res;
+    };
+
+    SECTION("stats")
+    {
+        for (auto threads : {"1", "4"})
+        {
+            auto res = stats(std::string("stats=true&threads=") + threads);
+            REQUIRE(res["count"].asUInt64() == 30);
+            REQUIRE(res["types"]["LIVEENTRY ACCOUNT"]["count"].asUInt64() ==
+                    20);
+            REQUIRE(res["types"]["LIVEENTRY OFFER"]["count"].asUInt64() == 9);
+            REQUIRE(res["types"]["DEADENTRY OFFER"]["count"].asUInt64() == 1);
+        }
+    }
+
+    SECTION("filters")
+    {
+        auto id = KeyUtils::toStrKey(accounts[0].accountID);
+        auto res = stats("stats=true&type=offer&account=" + id);
+        REQUIRE(res["count"].asUInt64() == 3);
+        REQUIRE(res["types"]["DEADENTRY OFFER"]["count"].asUInt64() == 1);
+
+        res = stats("stats=true&type=account,data");
+        REQUIRE(res["count"].asUInt64() == 20);
+    }
+
+    SECTION("block compressed file")
+    {
+        auto compressed = dir.getName() + "/bucket-fedcba9876543210.xdr";
+        gz::compressBlockFile(filename, compressed);
+        std::ostringstream a, b;
+        dumpXdrStream(filename, DumpXdrOptions(), a);
+        dumpXdrStream(compressed, DumpXdrOptions(), b);
+        REQUIRE(!a.str().empty());
+        REQUIRE(a.str() == b.str());
+    }
+
+    SECTION("filters of other files")
+    {
+        auto ledgers = dir.getName() + "/ledger-0000003f.xdr";
+        XDROutputFileStream out;
+        out.open(ledgers);
+        out.close();
+        REQUIRE_THROWS_AS(
+            dumpXdrStream(ledgers, DumpXdrOptions::parse("type=offer")),
+            std::runtime_error);
+    }
+}
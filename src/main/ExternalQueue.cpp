@@ -6,6 +6,7 @@
 
 #include "Application.h"
 #include "database/Database.h"
+#include "database/HistoryPartitions.h"
 #include "ledger/LedgerManager.h"
 #include "util/Logging.h"
 #include <limits>
@@ -101,13 +102,21 @@ void
 ExternalQueue::getCursorForResource(std::string const& resid,
                                     std::map<std::string, uint32>& curMap)
 {
+    auto& db = mApp.getDatabase();
+    if (db.hasReadOnlyReplica())
+    {
+        // cursors are only reported, slightly stale ones do
+        soci::session sess(db.getReadOnlyPool());
+        loadCursors(sess, resid, curMap);
+        return;
+    }
+
     // no resid set, get all cursors
     if (resid.empty())
     {
         std::string n;
         uint32_t v;
 
-        auto& db = mApp.getDatabase();
         auto prep =
             db.getPreparedStatement("SELECT resid, lastread FROM pubsub;");
         auto& st = prep.statement();
@@ -153,6 +162,40 @@ ExternalQueue::deleteCursor(std::string const& resid)
 
 void
 ExternalQueue::deleteOldEntries(uint32 count)
+{
+    auto cmin = getMaxLedgerToDelete();
+    auto& db = mApp.getDatabase();
+    dropOldPartitions(cmin);
+    soci::transaction txscope(db.getSession());
+    db.clearPreparedStatementCache();
+    LedgerManager::deleteOldEntries(db.getSession(), cmin, count);
+    db.clearPreparedStatementCache();
+    txscope.commit();
+}
+
+size_t
+ExternalQueue::dropOldPartitions(uint32 maxLedger)
+{
+    auto& db = mApp.getDatabase();
+    auto partitions = db.getHistoryPartitions();
+    if (!partitions)
+    {
+        return 0;
+    }
+    // cached statements may refer to the partitions
+    db.clearPreparedStatementCache();
+    auto dropped = partitions->dropPartitionsUpTo(maxLedger);
+    if (dropped != 0)
+    {
+        CLOG(INFO, "History") << "Dropped " << dropped
+                              << " history partitions up to ledger "
+                              << maxLedger;
+    }
+    return dropped;
+}
+
+uint32
+ExternalQueue::getMaxLedgerToDelete()
 {
     auto& db = mApp.getDatabase();
     int m;
@@ -194,8 +237,7 @@ ExternalQueue::deleteOldEntries(uint32 count)
     CLOG(INFO, "History") << "Trimming history <= ledger " << cmin
                           << " (rmin=" << rmin << ", qmin=" << qmin
                           << ", lmin=" << lmin << ")";
-
-    mApp.getLedgerManager().deleteOldEntries(mApp.getDatabase(), cmin, count);
+    return cmin;
 }
 
 void
@@ -207,6 +249,37 @@ ExternalQueue::checkID(std::string const& resid)
     }
 }
 
+void
+ExternalQueue::loadCursors(soci::session& sess, std::string const& resid,
+                           std::map<std::string, uint32>& curMap)
+{
+    std::string sql = "SELECT resid, lastread FROM pubsub";
+    if (!resid.empty())
+    {
+        checkID(resid);
+        sql += " WHERE resid = :n";
+    }
+
+    std::string n;
+    uint32_t v;
+    soci::statement st(sess);
+    st.alloc();
+    st.prepare(sql);
+    st.exchange(soci::into(n));
+    st.exchange(soci::into(v));
+    if (!resid.empty())
+    {
+        st.exchange(soci::use(resid));
+    }
+    st.define_and_bind();
+    st.execute(true);
+    while (st.got_data())
+    {
+        curMap[n] = v;
+        st.fetch();
+    }
+}
+
 std::string
 ExternalQueue::getCursor(std::string const& resid)
 {
@@ -8,6 +8,11 @@
 #include "xdr/Stellar-types.h"
 #include <string>
 
+namespace soci
+{
+class session;
+}
+
 namespace stellar
 {
 
@@ -33,11 +38,22 @@ class ExternalQueue
     // deletes the subscription for the resource
     void deleteCursor(std::string const& resid);
 
+    // last ledger whose history can be deleted, keeping what is needed to
+    // publish history and what the subscribers have not read yet
+    uint32 getMaxLedgerToDelete();
+
     // safely delete data, maximum count entries from each table
     void deleteOldEntries(uint32 count);
 
+    // with partitioned history tables, drop the partitions only holding
+    // ledgers up to maxLedger (see getMaxLedgerToDelete), returns how many
+    // were dropped
+    size_t dropOldPartitions(uint32 maxLedger);
+
   private:
     void checkID(std::string const& resid);
+    void loadCursors(soci::session& sess, std::string const& resid,
+                     std::map<std::string, uint32>& curMap);
     std::string getCursor(std::string const& resid);
 
     static std::string kSQLCreateStatement;
@@ -2,15 +2,21 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "database/Database.h"
+#include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/CommandHandler.h"
 #include "main/Config.h"
 #include "main/ExternalQueue.h"
+#include "main/Maintainer.h"
 #include "simulation/Simulation.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
 
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
 using namespace stellar;
 
 TEST_CASE("cursors", "[externalqueue]")
@@ -44,3 +50,71 @@ TEST_CASE("cursors", "[externalqueue]")
         REQUIRE(curMap.size() == 2);
     }
 }
+
+TEST_CASE("cursors from a read-only replica", "[externalqueue]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    // the database itself stands in for its replica
+    cfg.DATABASE_READONLY = cfg.DATABASE;
+    Application::pointer app = createTestApplication(clock, cfg);
+
+    app->start();
+
+    ExternalQueue ps(*app);
+    std::map<std::string, uint32> curMap;
+    app->getCommandHandler().manualCmd("setcursor?id=FOO&cursor=123");
+    app->getCommandHandler().manualCmd("setcursor?id=BAR&cursor=456");
+    REQUIRE(app->getDatabase().hasReadOnlyReplica());
+
+    ps.getCursorForResource("NONEXISTENT", curMap);
+    REQUIRE(curMap.empty());
+    ps.getCursorForResource("FOO", curMap);
+    REQUIRE(curMap == (std::map<std::string, uint32>{{"FOO", 123}}));
+    ps.getCursorForResource("", curMap);
+    REQUIRE(curMap ==
+            (std::map<std::string, uint32>{{"BAR", 456}, {"FOO", 123}}));
+    REQUIRE_THROWS_AS(ps.getCursorForResource("not valid", curMap),
+                      std::invalid_argument);
+}
+
+TEST_CASE("automatic maintenance", "[externalqueue][maintenance]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
+    cfg.AUTOMATIC_MAINTENANCE_PERIOD = std::chrono::seconds{30};
+    cfg.AUTOMATIC_MAINTENANCE_COUNT = 1000;
+    Application::pointer app = createTestApplication(clock, cfg);
+    app->start();
+
+    auto& sess = app->getDatabase().getSession();
+    auto getMinLedger = [&]() {
+        uint32_t res;
+        sess << "SELECT MIN(ledgerseq) FROM ledgerheaders", soci::into(res);
+        return res;
+    };
+    // checkpoints are 8 ledgers long with accelerated time
+    while (app->getLedgerManager().getLastClosedLedgerNum() < 40 ||
+           app->getMaintainer().isRunning())
+    {
+        clock.crank(true);
+    }
+    while (getMinLedger() == 1)
+    {
+        clock.crank(true);
+    }
+    while (app->getMaintainer().isRunning())
+    {
+        clock.crank(true);
+    }
+
+    // the history of the last checkpoint is kept
+    ExternalQueue ps(*app);
+    auto maxLedger = ps.getMaxLedgerToDelete();
+    REQUIRE(getMinLedger() > 1);
+    REQUIRE(getMinLedger() <= maxLedger + 1);
+    REQUIRE(app->getMetrics()
+                .NewTimer({"maintenance", "chunk", "delete"})
+                .count() > 0);
+}
@@ -0,0 +1,60 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/AccountFrame.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "main/fuzz.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
+
+using namespace stellar;
+
+TEST_CASE("transaction fuzzer rolls back each input", "[fuzz]")
+{
+    VirtualClock clock;
+    TxFuzzer fuzzer(clock, getTestConfig(0));
+    auto& db = fuzzer.getApp().getDatabase();
+    auto const& accounts = fuzzer.getAccounts();
+
+    auto balances = [&]() {
+        std::vector<int64_t> res;
+        for (auto const& a : accounts)
+        {
+            res.emplace_back(
+                AccountFrame::loadAccount(a.getPublicKey(), db)->getBalance());
+        }
+        return res;
+    };
+    auto before = balances();
+
+    TmpDir dir("fuzz");
+    auto input = dir.getName() + "/input.xdr";
+
+    SECTION("payments")
+    {
+        {
+            XDROutputFileStream out;
+            out.open(input);
+            // to whichever accounts the destinations map to, a random key
+            // included
+            out.writeOne(txtest::payment(accounts[1].getPublicKey(), 1000));
+            out.writeOne(
+                txtest::payment(SecretKey::random().getPublicKey(), 1000));
+        }
+        REQUIRE(fuzzer.inject(input) == 2);
+        REQUIRE(balances() == before);
+        REQUIRE(fuzzer.inject(input) == 2);
+    }
+
+    SECTION("generated input")
+    {
+        genfuzzTransactions(input);
+        auto applied = fuzzer.inject(input);
+        REQUIRE(balances() == before);
+        REQUIRE(fuzzer.inject(input) == applied);
+    }
+}
@@ -5,6 +5,8 @@
 #include "lib/catch.hpp"
 #include "lib/util/lrucache.hpp"
 
+#include <vector>
+
 namespace stellar
 {
 
@@ -129,4 +131,19 @@ TEST_CASE("erase_if removes all nodes", "[lru_cache]")
     REQUIRE(!c.exists(3));
     REQUIRE(!c.exists(4));
 }
+
+TEST_CASE("for_each visits the most recently used first", "[lru_cache]")
+{
+    auto c = IntCache{3};
+    c.put(0, 10);
+    c.put(1, 11);
+    c.put(2, 12);
+    c.get(0);
+    c.put(3, 13);
+
+    std::vector<std::pair<int, int>> visited;
+    c.for_each([&](int k, int v) { visited.emplace_back(k, v); });
+    REQUIRE(visited ==
+            std::vector<std::pair<int, int>>{{3, 13}, {0, 10}, {2, 12}});
+}
 }
@@ -3,14 +3,47 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "main/Maintainer.h"
+#include "database/Database.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
 #include "main/Config.h"
 #include "main/ExternalQueue.h"
 #include "util/Logging.h"
 
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+
 namespace stellar
 {
 
-Maintainer::Maintainer(Application& app) : mApp{app}, mTimer{mApp}
+namespace
+{
+// ledgers deleted by the first chunk, and the most a chunk may delete
+uint32_t const INITIAL_CHUNK_SIZE = 64;
+uint32_t const MAX_CHUNK_SIZE = 8192;
+// the chunk size is halved when a chunk takes longer than this, and
+// doubled when it takes less than half of it
+std::chrono::milliseconds const CHUNK_TARGET_TIME(100);
+// chunks wait while the database is busier than this
+uint32_t const MIN_IDLE_PERCENT = 50;
+std::chrono::seconds const BUSY_RETRY_DELAY(1);
+}
+
+Maintainer::Maintainer(Application& app)
+    : mApp{app}
+    , mTimer{mApp}
+    , mChunkSize{INITIAL_CHUNK_SIZE}
+    , mLastQueryTime{app.getDatabase().totalQueryTime()}
+    , mLastChunkTime{app.getClock().now()}
+    , mChunkTimer{app.getMetrics().NewTimer({"maintenance", "chunk", "delete"})}
+    , mChunkSizeCounter{
+          app.getMetrics().NewCounter({"maintenance", "chunk", "size"})}
+    , mSkipped{
+          app.getMetrics().NewMeter({"maintenance", "run", "skipped"}, "run")}
 {
 }
 
@@ -25,6 +58,12 @@ Maintainer::start()
     }
 }
 
+bool
+Maintainer::isRunning() const
+{
+    return mRun != nullptr;
+}
+
 void
 Maintainer::scheduleMaintenance()
 {
@@ -35,7 +74,130 @@ Maintainer::scheduleMaintenance()
 void
 Maintainer::tick()
 {
-    performMaintenance(mApp.getConfig().AUTOMATIC_MAINTENANCE_COUNT);
+    if (mApp.getLedgerManager().getState() ==
+        LedgerManager::LM_CATCHING_UP_STATE)
+    {
+        LOG(INFO) << "Skipping maintenance while catching up";
+        mSkipped.Mark();
+        scheduleMaintenance();
+        return;
+    }
+
+    LOG(INFO) << "Performing maintenance";
+    ExternalQueue ps{mApp};
+    auto maxLedger = ps.getMaxLedgerToDelete();
+    // whole partitions go at once, the chunks only trim the rest
+    ps.dropOldPartitions(maxLedger);
+    mRun = std::make_shared<Run>(
+        Run{maxLedger, mApp.getConfig().AUTOMATIC_MAINTENANCE_COUNT});
+    mLastQueryTime = mApp.getDatabase().totalQueryTime();
+    mLastChunkTime = mApp.getClock().now();
+    runNextChunk();
+}
+
+void
+Maintainer::runNextChunk()
+{
+    auto& db = mApp.getDatabase();
+    if (mApp.getLedgerManager().getState() ==
+        LedgerManager::LM_CATCHING_UP_STATE)
+    {
+        LOG(INFO) << "Interrupting maintenance while catching up";
+        mSkipped.Mark();
+        finishRun();
+        return;
+    }
+    if (db.idleDbPercentSince(mLastQueryTime, mLastChunkTime) <
+        MIN_IDLE_PERCENT)
+    {
+        mChunkSize = std::max<uint32_t>(1, mChunkSize / 2);
+        mChunkSizeCounter.set_count(mChunkSize);
+        mLastQueryTime = db.totalQueryTime();
+        mLastChunkTime = mApp.getClock().now();
+        mTimer.expires_from_now(BUSY_RETRY_DELAY);
+        mTimer.async_wait([this]() { runNextChunk(); },
+                          VirtualTimer::onFailureNoop);
+        return;
+    }
+
+    auto chunk = std::min(mChunkSize, mRun->mRemaining);
+    auto maxLedger = mRun->mMaxLedger;
+    std::weak_ptr<Run> weak = mRun;
+    auto& clock = mApp.getClock();
+    auto deleteChunk = [this, &clock, weak, maxLedger,
+                        chunk](soci::session& sess) {
+        auto start = std::chrono::steady_clock::now();
+        bool done = true;
+        try
+        {
+            soci::transaction tx(sess);
+            done = LedgerManager::deleteOldEntries(sess, maxLedger, chunk);
+            tx.commit();
+        }
+        catch (std::exception const& e)
+        {
+            LOG(ERROR) << "Maintenance failed: " << e.what();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        clock.postToMain(
+            [this, weak, chunk, done, elapsed]() {
+                if (weak.lock())
+                {
+                    onChunkDone(chunk, done, elapsed);
+                }
+            },
+            "maintenance");
+    };
+
+    if (db.canUsePool() && !db.isSqlite())
+    {
+        auto& workers =
+            mApp.getWorkerIOService(Application::WORKER_POOL_MISC);
+        auto& pool = db.getPool();
+        workers.post([deleteChunk, &pool]() {
+            soci::session sess(pool);
+            deleteChunk(sess);
+        });
+    }
+    else
+    {
+        db.clearPreparedStatementCache();
+        deleteChunk(db.getSession());
+        db.clearPreparedStatementCache();
+    }
+}
+
+void
+Maintainer::onChunkDone(uint32_t chunk, bool done,
+                        std::chrono::nanoseconds elapsed)
+{
+    mChunkTimer.Update(elapsed);
+    if (elapsed > CHUNK_TARGET_TIME)
+    {
+        mChunkSize = std::max<uint32_t>(1, chunk / 2);
+    }
+    else if (elapsed < CHUNK_TARGET_TIME / 2 && chunk == mChunkSize)
+    {
+        mChunkSize = std::min(MAX_CHUNK_SIZE, mChunkSize * 2);
+    }
+    mChunkSizeCounter.set_count(mChunkSize);
+
+    mRun->mRemaining -= chunk;
+    if (done || mRun->mRemaining == 0)
+    {
+        LOG(INFO) << "Maintenance done";
+        finishRun();
+        return;
+    }
+    mLastQueryTime = mApp.getDatabase().totalQueryTime();
+    mLastChunkTime = mApp.getClock().now();
+    runNextChunk();
+}
+
+void
+Maintainer::finishRun()
+{
+    mRun.reset();
     scheduleMaintenance();
 }
 
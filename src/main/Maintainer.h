@@ -6,13 +6,32 @@
 
 #include "util/Timer.h"
 
+#include <chrono>
 #include <cstdint>
+#include <memory>
+
+namespace medida
+{
+class Counter;
+class Meter;
+class Timer;
+}
 
 namespace stellar
 {
 
 class Application;
 
+/**
+ * Deletes the history that is no longer needed (see
+ * ExternalQueue::getMaxLedgerToDelete) every AUTOMATIC_MAINTENANCE_PERIOD.
+ *
+ * Automatic maintenance deletes a chunk of ledgers at a time, each in its
+ * own transaction, on a pooled connection off the main thread when the
+ * database allows it, so that it never holds up ledger close for long. The
+ * chunk size adapts to the time chunks take, and chunks wait while the
+ * database is busy. Maintenance is skipped while catching up.
+ */
 class Maintainer
 {
   public:
@@ -24,11 +43,36 @@ class Maintainer
     // removes maximum count entries from tables like txhistory or scphistory
     void performMaintenance(uint32_t count);
 
+    // true while an automatic maintenance run is deleting chunks
+    bool isRunning() const;
+
   private:
     Application& mApp;
     VirtualTimer mTimer;
 
+    // the automatic maintenance run in progress, if any; chunks running on
+    // a worker thread only hold a weak reference to it
+    struct Run
+    {
+        uint32_t mMaxLedger;
+        uint32_t mRemaining;
+    };
+    std::shared_ptr<Run> mRun;
+    uint32_t mChunkSize;
+
+    // database usage at the end of the previous chunk
+    std::chrono::nanoseconds mLastQueryTime;
+    VirtualClock::time_point mLastChunkTime;
+
+    medida::Timer& mChunkTimer;
+    medida::Counter& mChunkSizeCounter;
+    medida::Meter& mSkipped;
+
     void scheduleMaintenance();
     void tick();
+    void runNextChunk();
+    void onChunkDone(uint32_t chunk, bool done,
+                     std::chrono::nanoseconds elapsed);
+    void finishRun();
 };
 }
@@ -46,8 +46,25 @@ PersistentState::getStoreStateName(PersistentState::Entry n)
     return mapping[n];
 }
 
+void
+PersistentState::clearCache()
+{
+    mCache.clear();
+}
+
 string
 PersistentState::getState(PersistentState::Entry entry)
+{
+    auto it = mCache.find(entry);
+    if (it == mCache.end())
+    {
+        it = mCache.emplace(entry, loadState(entry)).first;
+    }
+    return it->second;
+}
+
+string
+PersistentState::loadState(PersistentState::Entry entry)
 {
     string res;
 
@@ -76,6 +93,12 @@ PersistentState::getState(PersistentState::Entry entry)
 void
 PersistentState::setState(PersistentState::Entry entry, string const& value)
 {
+    auto current = getState(entry);
+    if (current == value)
+    {
+        return;
+    }
+
     string sn(getStoreStateName(entry));
     auto prep = mApp.getDatabase().getPreparedStatement(
         "UPDATE storestate SET state = :v WHERE statename = :n;");
@@ -89,7 +112,7 @@ PersistentState::setState(PersistentState::Entry entry, string const& value)
         st.execute(true);
     }
 
-    if (st.get_affected_rows() != 1 && getState(entry).empty())
+    if (st.get_affected_rows() != 1 && current.empty())
     {
         auto timer = mApp.getDatabase().getInsertTimer("state");
         auto prep2 = mApp.getDatabase().getPreparedStatement(
@@ -104,5 +127,6 @@ PersistentState::setState(PersistentState::Entry entry, string const& value)
             throw std::runtime_error("Could not insert data in SQL");
         }
     }
+    mCache[entry] = value;
 }
 }
@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "main/Application.h"
+#include <map>
 #include <string>
 
 namespace stellar
@@ -31,14 +32,24 @@ class PersistentState
 
     std::string getStoreStateName(Entry n);
 
+    // Entries are read from the database once and then kept in memory;
+    // writes go through to the database (in whatever transaction is open)
+    // unless the value did not change.
     std::string getState(Entry stateName);
 
     void setState(Entry stateName, std::string const& value);
 
+    // Forgets the values kept in memory, for when the table was changed
+    // behind our back (see Database::initialize).
+    void clearCache();
+
   private:
     static std::string kSQLCreateStatement;
     static std::string mapping[kLastEntry];
 
     Application& mApp;
+    std::map<Entry, std::string> mCache;
+
+    std::string loadState(Entry stateName);
 };
 }
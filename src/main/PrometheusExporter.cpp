@@ -0,0 +1,178 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/PrometheusExporter.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+
+#include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/stats/snapshot.h"
+#include "medida/timer.h"
+
+#include <cctype>
+#include <sstream>
+
+namespace stellar
+{
+
+std::chrono::milliseconds const PrometheusExporter::REFRESH_PERIOD{1000};
+
+namespace
+{
+double const QUANTILES[] = {0.5, 0.75, 0.95, 0.99};
+
+// "ledger.ledger.close" -> "stellar_core_ledger_ledger_close"
+std::string
+toPrometheusName(medida::MetricName const& name)
+{
+    std::string res = "stellar_core";
+    for (auto const& part : {name.domain(), name.type(), name.name()})
+    {
+        res += '_';
+        for (auto c : part)
+        {
+            res += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+        }
+    }
+    return res;
+}
+
+class PrometheusRenderer : public medida::MetricProcessor
+{
+    std::ostringstream mOut;
+    std::string mName;
+
+    void
+    writeSummary(medida::stats::Snapshot const& snapshot, uint64_t count,
+                 double sum, double scale)
+    {
+        mOut << "# TYPE " << mName << " summary\n";
+        for (auto q : QUANTILES)
+        {
+            mOut << mName << "{quantile=\"" << q << "\"} "
+                 << snapshot.getValue(q) * scale << "\n";
+        }
+        mOut << mName << "_sum " << sum * scale << "\n";
+        mOut << mName << "_count " << count << "\n";
+    }
+
+  public:
+    PrometheusRenderer()
+    {
+        mOut.precision(12);
+    }
+
+    void
+    render(medida::MetricName const& name, medida::MetricInterface& metric)
+    {
+        mName = toPrometheusName(name);
+        metric.Process(*this);
+    }
+
+    std::string
+    str() const
+    {
+        return mOut.str();
+    }
+
+    void
+    Process(medida::Counter& counter) override
+    {
+        mOut << "# TYPE " << mName << " gauge\n";
+        mOut << mName << " " << counter.count() << "\n";
+    }
+
+    void
+    Process(medida::Meter& meter) override
+    {
+        mName += "_total";
+        mOut << "# TYPE " << mName << " counter\n";
+        mOut << mName << " " << meter.count() << "\n";
+    }
+
+    void
+    Process(medida::Histogram& histogram) override
+    {
+        writeSummary(histogram.GetSnapshot(), histogram.count(),
+                     histogram.sum(), 1.0);
+    }
+
+    void
+    Process(medida::Timer& timer) override
+    {
+        mName += "_seconds";
+        // from the unit of the timer
+        auto scale = static_cast<double>(timer.duration_unit().count()) / 1e9;
+        writeSummary(timer.GetSnapshot(), timer.count(), timer.sum(), scale);
+    }
+};
+}
+
+PrometheusExporter::PrometheusExporter(Application& app)
+    : mApp(app), mState(std::make_shared<State>())
+{
+}
+
+std::string
+PrometheusExporter::render(medida::MetricsRegistry& registry)
+{
+    PrometheusRenderer renderer;
+    for (auto const& kv : registry.GetAllMetrics())
+    {
+        renderer.render(kv.first, *kv.second);
+    }
+    return renderer.str();
+}
+
+std::string
+PrometheusExporter::scrape()
+{
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mState->mMutex);
+        if (!mState->mText.empty() &&
+            (mState->mRendering || now - mState->mRendered < REFRESH_PERIOD))
+        {
+            return mState->mText;
+        }
+    }
+
+    // the values some subsystems only set on demand
+    mApp.syncAllMetrics();
+    auto& registry = mApp.getMetrics();
+
+    std::unique_lock<std::mutex> lock(mState->mMutex);
+    if (mState->mText.empty())
+    {
+        lock.unlock();
+        auto text = render(registry);
+        lock.lock();
+        mState->mText = text;
+        mState->mRendered = now;
+        return mState->mText;
+    }
+
+    mState->mRendering = true;
+    auto text = mState->mText;
+    lock.unlock();
+    std::weak_ptr<State> weak = mState;
+    mApp.getWorkerIOService(Application::WORKER_POOL_MISC)
+        .post([weak, &registry]() {
+            auto state = weak.lock();
+            if (!state)
+            {
+                return;
+            }
+            auto rendered = render(registry);
+            std::lock_guard<std::mutex> lock(state->mMutex);
+            state->mText = std::move(rendered);
+            state->mRendered = std::chrono::steady_clock::now();
+            state->mRendering = false;
+        });
+    return text;
+}
+}
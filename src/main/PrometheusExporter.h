@@ -0,0 +1,65 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace medida
+{
+class MetricsRegistry;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Serves the metrics registry in the Prometheus text exposition format, for
+ * the metrics/prometheus route, without making scrapes cost the main thread
+ * the rendering of the whole registry.
+ *
+ * Metric "domain.type.name" is exposed as stellar_core_domain_type_name:
+ * counters as gauges, meters as counters (_total), histograms as summaries
+ * (the quantiles of their sample, with _sum and _count) and timers as
+ * summaries in seconds (_seconds).
+ *
+ * The text is rendered on a worker thread, from the registry the metrics
+ * of which medida lets be read concurrently. A scrape returns the last text
+ * rendered, and has it rendered again in the background once it is older
+ * than REFRESH_PERIOD: what a scrape gets is at most one scrape interval
+ * old. Only the first scrape renders on the main thread.
+ */
+class PrometheusExporter : NonMovableOrCopyable
+{
+    struct State
+    {
+        std::mutex mMutex;
+        std::string mText;
+        std::chrono::steady_clock::time_point mRendered;
+        bool mRendering{false};
+    };
+
+    Application& mApp;
+    // shared with the rendering in progress, which can outlive this
+    std::shared_ptr<State> mState;
+
+  public:
+    static std::chrono::milliseconds const REFRESH_PERIOD;
+
+    explicit PrometheusExporter(Application& app);
+
+    // the metrics of @p registry in text exposition format
+    static std::string render(medida::MetricsRegistry& registry);
+
+    // called on the main thread
+    std::string scrape();
+};
+}
@@ -0,0 +1,71 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/PrometheusExporter.h"
+#include "lib/catch.hpp"
+#include "main/Application.h"
+#include "test/TestUtils.h"
+#include "test/test.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <thread>
+
+using namespace stellar;
+
+TEST_CASE("prometheus exposition", "[metrics]")
+{
+    medida::MetricsRegistry registry;
+    registry.NewCounter({"test", "queue", "size"}).set_count(7);
+    registry.NewMeter({"test", "byte", "sent"}, "byte").Mark(3);
+    auto& timer = registry.NewTimer({"test", "close-ledger", "time"});
+    timer.Update(std::chrono::milliseconds(500));
+    timer.Update(std::chrono::milliseconds(1500));
+
+    auto text = PrometheusExporter::render(registry);
+    auto has = [&](std::string const& line) {
+        return text.find(line + "\n") != std::string::npos;
+    };
+    REQUIRE(has("# TYPE stellar_core_test_queue_size gauge"));
+    REQUIRE(has("stellar_core_test_queue_size 7"));
+    REQUIRE(has("# TYPE stellar_core_test_byte_sent_total counter"));
+    REQUIRE(has("stellar_core_test_byte_sent_total 3"));
+    REQUIRE(has("# TYPE stellar_core_test_close_ledger_time_seconds summary"));
+    REQUIRE(has("stellar_core_test_close_ledger_time_seconds_sum 2"));
+    REQUIRE(has("stellar_core_test_close_ledger_time_seconds_count 2"));
+    REQUIRE(has("stellar_core_test_close_ledger_time_seconds"
+                "{quantile=\"0.99\"} 1.5"));
+}
+
+TEST_CASE("prometheus scrapes render in the background", "[metrics]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    PrometheusExporter exporter(*app);
+
+    auto& counter = app->getMetrics().NewCounter({"test", "scrape", "value"});
+    counter.set_count(1);
+    // the first scrape renders right away
+    REQUIRE(exporter.scrape().find("stellar_core_test_scrape_value 1\n") !=
+            std::string::npos);
+
+    counter.set_count(2);
+    // then the last rendering is served until it's refreshed
+    REQUIRE(exporter.scrape().find("stellar_core_test_scrape_value 1\n") !=
+            std::string::npos);
+
+    auto refreshed = [&]() {
+        return exporter.scrape().find("stellar_core_test_scrape_value 2\n") !=
+               std::string::npos;
+    };
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!refreshed() && std::chrono::steady_clock::now() < end)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    REQUIRE(refreshed());
+}
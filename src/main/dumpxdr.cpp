@@ -1,13 +1,27 @@
 #include "main/dumpxdr.h"
+#include "crypto/KeyUtils.h"
 #include "crypto/SecretKey.h"
+#include "ledger/EntryFrame.h"
+#include "lib/http/server.hpp"
+#include "lib/json/json.h"
 #include "transactions/SignatureUtils.h"
 #include "util/Decoder.h"
 #include "util/Fs.h"
+#include "util/Gzip.h"
+#include "util/NonCopyable.h"
 #include "util/XDROperators.h"
 #include "util/XDRStream.h"
 #include "util/format.h"
+#include <algorithm>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <regex>
+#include <sstream>
+#include <thread>
+#include <xdrpp/marshal.h>
 #include <xdrpp/printer.h>
 
 #if !defined(USE_TERMIOS) && !MSVC
@@ -16,6 +30,7 @@
 #if HAVE_TERMIOS
 extern "C" {
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
@@ -38,57 +53,402 @@ const char* signtxn_network_id;
 std::string
 xdr_printer(const PublicKey& pk)
 {
-    return KeyUtils::toStrKey<PublicKey>(pk);
+    return KeyUtils::toStrKey(pk);
 }
 
+namespace
+{
+
+// bytes of the file decoded by each task of dumpXdrStream
+size_t const DUMP_CHUNK_SIZE = 16 * 1024 * 1024;
+
+// A file mapped in memory, or read in memory where mmap is not available.
+class MappedFile : NonMovableOrCopyable
+{
+    uint8_t const* mData{nullptr};
+    size_t mSize{0};
+#if HAVE_TERMIOS
+    void* mMap{nullptr};
+#else
+    std::vector<uint8_t> mBuffer;
+#endif
+
+  public:
+    explicit MappedFile(std::string const& filename)
+    {
+#if HAVE_TERMIOS
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd == -1 || fstat(fd, &st) != 0)
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+            throw std::runtime_error("could not open " + filename);
+        }
+        mSize = static_cast<size_t>(st.st_size);
+        if (mSize != 0)
+        {
+            mMap = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (mMap == MAP_FAILED)
+        {
+            throw std::runtime_error("could not map " + filename);
+        }
+        // read once, front to back, by the chunking then by the tasks
+        if (mSize != 0)
+        {
+            madvise(mMap, mSize, MADV_SEQUENTIAL);
+        }
+        mData = static_cast<uint8_t const*>(mMap);
+#else
+        std::ifstream in(filename, std::ifstream::binary);
+        if (!in)
+        {
+            throw std::runtime_error("could not open " + filename);
+        }
+        mBuffer.assign(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+        mData = mBuffer.data();
+        mSize = mBuffer.size();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#if HAVE_TERMIOS
+        if (mMap != nullptr && mMap != MAP_FAILED)
+        {
+            munmap(mMap, mSize);
+        }
+#endif
+    }
+
+    uint8_t const*
+    data() const
+    {
+        return mData;
+    }
+
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+};
+
+// size prefix of an entry (as written by XDROutputFileStream)
+uint32_t
+readEntrySize(uint8_t const* p)
+{
+    return (static_cast<uint32_t>(p[0] & 0x7f) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+struct DumpStats
+{
+    uint64_t mCount{0};
+    uint64_t mBytes{0};
+};
+
+// what a task found in its chunk: stats by type, and the printed entries
+struct DumpResult
+{
+    std::map<std::string, DumpStats> mStats;
+    std::string mText;
+
+    void
+    add(DumpResult const& other)
+    {
+        for (auto const& s : other.mStats)
+        {
+            mStats[s.first].mCount += s.second.mCount;
+            mStats[s.first].mBytes += s.second.mBytes;
+        }
+    }
+};
+
 template <typename T>
-void
-dumpstream(XDRInputFileStream& in)
+std::string
+entryType(T const&, std::string const& kind)
 {
-    T tmp;
-    while (in && in.readOne(tmp))
+    return kind;
+}
+
+std::string
+entryType(BucketEntry const& entry, std::string const&)
+{
+    auto type = entry.type() == LIVEENTRY ? entry.liveEntry().data.type()
+                                          : entry.deadEntry().type();
+    return std::string(xdr::xdr_traits<BucketEntryType>::enum_name(
+               entry.type())) +
+           " " + xdr::xdr_traits<LedgerEntryType>::enum_name(type);
+}
+
+template <typename T>
+bool
+matches(T const&, DumpXdrOptions const&)
+{
+    return true;
+}
+
+bool
+matches(BucketEntry const& entry, DumpXdrOptions const& options)
+{
+    if (options.mTypes.empty() && !options.mAccount)
+    {
+        return true;
+    }
+    auto key = entry.type() == LIVEENTRY ? LedgerEntryKey(entry.liveEntry())
+                                         : entry.deadEntry();
+    if (!options.mTypes.empty() && options.mTypes.count(key.type()) == 0)
+    {
+        return false;
+    }
+    if (!options.mAccount)
+    {
+        return true;
+    }
+    switch (key.type())
     {
-        std::cout << xdr::xdr_to_string(tmp) << std::endl;
+    case ACCOUNT:
+        return key.account().accountID == *options.mAccount;
+    case TRUSTLINE:
+        return key.trustLine().accountID == *options.mAccount;
+    case OFFER:
+        return key.offer().sellerID == *options.mAccount;
+    case DATA:
+        return key.data().accountID == *options.mAccount;
+    default:
+        return false;
     }
 }
 
+template <typename T>
 void
-dumpXdrStream(std::string const& filename)
+addEntry(T const& entry, size_t size, std::string const& kind,
+         DumpXdrOptions const& options, DumpResult& res)
 {
-    std::regex rx(
-        ".*(ledger|bucket|transactions|results|scp)-[[:xdigit:]]+\\.xdr");
-    std::smatch sm;
-    if (std::regex_match(filename, sm, rx))
+    if (!matches(entry, options))
+    {
+        return;
+    }
+    auto& stats = res.mStats[entryType(entry, kind)];
+    ++stats.mCount;
+    stats.mBytes += size;
+    if (!options.mStats)
+    {
+        res.mText += xdr::xdr_to_string(entry);
+        res.mText += '\n';
+    }
+}
+
+// decodes the entries from `begin` to `end`, which are whole entries
+template <typename T>
+DumpResult
+dumpChunk(uint8_t const* begin, uint8_t const* end, std::string const& kind,
+          DumpXdrOptions const& options)
+{
+    DumpResult res;
+    T entry;
+    while (begin != end)
+    {
+        auto size = readEntrySize(begin);
+        begin += 4;
+        xdr::xdr_get g(begin, begin + size);
+        xdr::xdr_argpack_archive(g, entry);
+        addEntry(entry, size, kind, options, res);
+        begin += size;
+    }
+    return res;
+}
+
+template <typename T>
+DumpResult
+dumpStream(std::string const& filename, std::string const& kind,
+           DumpXdrOptions const& options, std::ostream& out)
+{
+    DumpResult total;
+    if (gz::isBlockFile(filename))
     {
         XDRInputFileStream in;
         in.open(filename);
+        T entry;
+        while (in && in.readOne(entry))
+        {
+            DumpResult res;
+            addEntry(entry, xdr::xdr_size(entry), kind, options, res);
+            out << res.mText;
+            total.add(res);
+        }
+        return total;
+    }
 
-        if (sm[1] == "ledger")
+    MappedFile file(filename);
+    auto data = file.data();
+
+    // entries are only walked over here, from their size prefixes
+    std::vector<std::pair<size_t, size_t>> chunks;
+    size_t pos = 0, start = 0;
+    while (pos != file.size())
+    {
+        if (file.size() - pos < 4 ||
+            readEntrySize(data + pos) > file.size() - pos - 4)
         {
-            dumpstream<LedgerHeaderHistoryEntry>(in);
+            throw std::runtime_error("malformed XDR file");
         }
-        else if (sm[1] == "bucket")
+        pos += 4 + readEntrySize(data + pos);
+        if (pos - start >= DUMP_CHUNK_SIZE)
         {
-            dumpstream<BucketEntry>(in);
+            chunks.emplace_back(start, pos);
+            start = pos;
         }
-        else if (sm[1] == "transactions")
+    }
+    if (start != pos)
+    {
+        chunks.emplace_back(start, pos);
+    }
+
+    size_t threads = options.mThreads != 0
+                         ? options.mThreads
+                         : std::max(1u, std::thread::hardware_concurrency());
+    // the chunks of a batch are decoded in parallel, then printed in order
+    for (size_t i = 0; i < chunks.size(); i += threads)
+    {
+        std::vector<std::future<DumpResult>> batch;
+        for (size_t j = i; j < std::min(i + threads, chunks.size()); ++j)
         {
-            dumpstream<TransactionHistoryEntry>(in);
+            batch.emplace_back(std::async(
+                std::launch::async, dumpChunk<T>, data + chunks[j].first,
+                data + chunks[j].second, kind, std::cref(options)));
         }
-        else if (sm[1] == "results")
+        for (auto& f : batch)
         {
-            dumpstream<TransactionHistoryResultEntry>(in);
+            auto res = f.get();
+            out << res.mText;
+            total.add(res);
         }
-        else
+    }
+    return total;
+}
+}
+
+DumpXdrOptions
+DumpXdrOptions::parse(std::string const& params)
+{
+    std::map<std::string, std::string> map;
+    http::server::server::parseParams(params, map);
+
+    DumpXdrOptions res;
+    auto types = map.find("type");
+    if (types != map.end())
+    {
+        std::istringstream in(types->second);
+        std::string type;
+        while (std::getline(in, type, ','))
         {
-            assert(sm[1] == "scp");
-            dumpstream<SCPHistoryEntry>(in);
+            if (type == "account")
+            {
+                res.mTypes.insert(ACCOUNT);
+            }
+            else if (type == "trustline")
+            {
+                res.mTypes.insert(TRUSTLINE);
+            }
+            else if (type == "offer")
+            {
+                res.mTypes.insert(OFFER);
+            }
+            else if (type == "data")
+            {
+                res.mTypes.insert(DATA);
+            }
+            else
+            {
+                throw std::invalid_argument("unknown entry type " + type);
+            }
         }
     }
-    else
+    auto account = map.find("account");
+    if (account != map.end())
+    {
+        res.mAccount = std::make_unique<AccountID>(
+            KeyUtils::fromStrKey<PublicKey>(account->second));
+    }
+    auto stats = map.find("stats");
+    res.mStats = stats != map.end() && stats->second == "true";
+    auto threads = map.find("threads");
+    if (threads != map.end())
+    {
+        res.mThreads = std::stoul(threads->second);
+    }
+    return res;
+}
+
+void
+dumpXdrStream(std::string const& filename, DumpXdrOptions const& options,
+              std::ostream& out)
+{
+    std::regex rx(
+        ".*(ledger|bucket|transactions|results|scp)-[[:xdigit:]]+\\.xdr");
+    std::smatch sm;
+    if (!std::regex_match(filename, sm, rx))
     {
         throw std::runtime_error("unrecognized XDR filename");
     }
+
+    std::string kind = sm[1];
+    if (kind != "bucket" && (!options.mTypes.empty() || options.mAccount))
+    {
+        throw std::runtime_error("entry filters only apply to bucket files");
+    }
+
+    DumpResult total;
+    if (kind == "ledger")
+    {
+        total = dumpStream<LedgerHeaderHistoryEntry>(filename, kind, options,
+                                                     out);
+    }
+    else if (kind == "bucket")
+    {
+        total = dumpStream<BucketEntry>(filename, kind, options, out);
+    }
+    else if (kind == "transactions")
+    {
+        total = dumpStream<TransactionHistoryEntry>(filename, kind, options,
+                                                    out);
+    }
+    else if (kind == "results")
+    {
+        total = dumpStream<TransactionHistoryResultEntry>(filename, kind,
+                                                          options, out);
+    }
+    else
+    {
+        assert(kind == "scp");
+        total = dumpStream<SCPHistoryEntry>(filename, kind, options, out);
+    }
+
+    if (options.mStats)
+    {
+        Json::Value res;
+        DumpStats all;
+        for (auto const& s : total.mStats)
+        {
+            res["types"][s.first]["count"] =
+                static_cast<Json::UInt64>(s.second.mCount);
+            res["types"][s.first]["bytes"] =
+                static_cast<Json::UInt64>(s.second.mBytes);
+            all.mCount += s.second.mCount;
+            all.mBytes += s.second.mBytes;
+        }
+        res["count"] = static_cast<Json::UInt64>(all.mCount);
+        res["bytes"] = static_cast<Json::UInt64>(all.mBytes);
+        out << res.toStyledString();
+    }
 }
 
 #define throw_perror(msg) \
@@ -129,6 +489,26 @@ printOneXdr(xdr::opaque_vec<> const& o, std::string const& desc)
     std::cout << xdr::xdr_to_string(tmp, desc.c_str()) << std::endl;
 }
 
+void
+printHistoryEntry(LedgerHeaderHistoryEntry const& entry, std::ostream& out)
+{
+    out << xdr::xdr_to_string(entry, "LedgerHeaderHistoryEntry") << std::endl;
+}
+
+void
+printHistoryEntry(TransactionHistoryEntry const& entry, std::ostream& out)
+{
+    out << xdr::xdr_to_string(entry, "TransactionHistoryEntry") << std::endl;
+}
+
+void
+printHistoryEntry(TransactionHistoryResultEntry const& entry,
+                  std::ostream& out)
+{
+    out << xdr::xdr_to_string(entry, "TransactionHistoryResultEntry")
+        << std::endl;
+}
+
 void
 printXdr(std::string const& filename, std::string const& filetype, bool base64)
 {
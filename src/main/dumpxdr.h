@@ -6,13 +6,48 @@
 
 #include "overlay/StellarXDR.h"
 
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+
 namespace stellar
 {
 
 extern const char* signtxn_network_id;
-void dumpXdrStream(std::string const& filename);
+
+// Options of dumpXdrStream, parsed from PARAMS like
+// 'type=offer,trustline&account=ID&stats=true&threads=N'.
+struct DumpXdrOptions
+{
+    // only the bucket entries (live or dead) of these types, all if empty
+    std::set<LedgerEntryType> mTypes;
+    // only the bucket entries of this account (or offers it sells)
+    std::unique_ptr<AccountID> mAccount;
+    // only the number and size of the entries, by type
+    bool mStats{false};
+    // threads decoding the file, 0 for one per core
+    size_t mThreads{0};
+
+    static DumpXdrOptions parse(std::string const& params);
+};
+
+// Prints the entries of a bucket or history XDR file to `out`. The file is
+// mapped in memory and cut into chunks, at entry boundaries found from the
+// size prefixes, that are decoded in parallel then printed in order (block
+// compressed buckets are read sequentially).
+void dumpXdrStream(std::string const& filename,
+                   DumpXdrOptions const& options = DumpXdrOptions(),
+                   std::ostream& out = std::cout);
 void printXdr(std::string const& filename, std::string const& filetype,
               bool base64);
+// Prints one entry of a history file, as printXdr does.
+void printHistoryEntry(LedgerHeaderHistoryEntry const& entry,
+                       std::ostream& out = std::cout);
+void printHistoryEntry(TransactionHistoryEntry const& entry,
+                       std::ostream& out = std::cout);
+void printHistoryEntry(TransactionHistoryResultEntry const& entry,
+                       std::ostream& out = std::cout);
 void signtxn(std::string const& filename, bool base64);
 void priv2pub();
 }
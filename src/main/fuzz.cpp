@@ -5,15 +5,22 @@
 #include "util/asio.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "database/Database.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/LedgerDelta.h"
+#include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "main/StellarCoreVersion.h"
 #include "overlay/LoopbackPeer.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/TCPPeer.h"
+#include "test/TxTests.h"
 #include "test/test.h"
+#include "transactions/TransactionFrame.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/Math.h"
 #include "util/Timer.h"
 #include "util/XDRStream.h"
 
@@ -38,6 +45,9 @@
  *     receiving the messages one by one. It exits when it's read the input.
  *     This is the mode the external fuzzer will run its mutant inputs through.
  *
+ * --genfuzz-tx and --fuzz-tx are the same for the operations of
+ * transactions, applied by a TxFuzzer, which is fast enough to run thousands
+ * of inputs per second in persistent mode.
  */
 
 namespace stellar
@@ -191,4 +201,366 @@ genfuzz(std::string const& filename)
         }
     }
 }
+
+size_t const TxFuzzer::NUM_ACCOUNTS = 8;
+size_t const TxFuzzer::MAX_OPERATIONS = 16;
+
+static SecretKey
+fuzzAccount(size_t i)
+{
+    return txtest::getAccount(("fuzz" + std::to_string(i)).c_str());
+}
+
+// the asset issued by every fuzzer account
+static Asset
+fuzzAsset(SecretKey const& issuer)
+{
+    return txtest::makeAsset(issuer, "FUZ");
+}
+
+TxFuzzer::TxFuzzer(VirtualClock& clock, Config const& cfg)
+    : mApp(Application::create(clock, cfg))
+{
+    mApp->start();
+    for (size_t i = 0; i < NUM_ACCOUNTS; ++i)
+    {
+        mAccounts.emplace_back(fuzzAccount(i));
+    }
+    setup();
+}
+
+TxFuzzer::~TxFuzzer()
+{
+}
+
+Application&
+TxFuzzer::getApp()
+{
+    return *mApp;
+}
+
+std::vector<SecretKey> const&
+TxFuzzer::getAccounts() const
+{
+    return mAccounts;
+}
+
+SecretKey const&
+TxFuzzer::pick(PublicKey const& key) const
+{
+    return mAccounts[key.ed25519()[0] % mAccounts.size()];
+}
+
+void
+TxFuzzer::remap(Asset& asset) const
+{
+    switch (asset.type())
+    {
+    case ASSET_TYPE_CREDIT_ALPHANUM4:
+        asset.alphaNum4().issuer = pick(asset.alphaNum4().issuer).getPublicKey();
+        break;
+    case ASSET_TYPE_CREDIT_ALPHANUM12:
+        asset.alphaNum12().issuer =
+            pick(asset.alphaNum12().issuer).getPublicKey();
+        break;
+    default:
+        break;
+    }
+}
+
+void
+TxFuzzer::remap(Operation& op) const
+{
+    if (op.sourceAccount)
+    {
+        *op.sourceAccount = pick(*op.sourceAccount).getPublicKey();
+    }
+    auto& body = op.body;
+    switch (body.type())
+    {
+    // the destination of a new account is left alone, as the fuzzer's
+    // accounts already exist
+    case PAYMENT:
+        body.paymentOp().destination =
+            pick(body.paymentOp().destination).getPublicKey();
+        remap(body.paymentOp().asset);
+        break;
+    case PATH_PAYMENT:
+        body.pathPaymentOp().destination =
+            pick(body.pathPaymentOp().destination).getPublicKey();
+        remap(body.pathPaymentOp().sendAsset);
+        remap(body.pathPaymentOp().destAsset);
+        for (auto& asset : body.pathPaymentOp().path)
+        {
+            remap(asset);
+        }
+        break;
+    case MANAGE_OFFER:
+        remap(body.manageOfferOp().selling);
+        remap(body.manageOfferOp().buying);
+        break;
+    case CREATE_PASSIVE_OFFER:
+        remap(body.createPassiveOfferOp().selling);
+        remap(body.createPassiveOfferOp().buying);
+        break;
+    case SET_OPTIONS:
+    {
+        auto& options = body.setOptionsOp();
+        if (options.inflationDest)
+        {
+            *options.inflationDest = pick(*options.inflationDest).getPublicKey();
+        }
+        if (options.signer &&
+            options.signer->key.type() == SIGNER_KEY_TYPE_ED25519)
+        {
+            PublicKey key;
+            key.ed25519() = options.signer->key.ed25519();
+            options.signer->key.ed25519() = pick(key).getPublicKey().ed25519();
+        }
+        break;
+    }
+    case CHANGE_TRUST:
+        remap(body.changeTrustOp().line);
+        break;
+    case ALLOW_TRUST:
+        body.allowTrustOp().trustor =
+            pick(body.allowTrustOp().trustor).getPublicKey();
+        break;
+    case ACCOUNT_MERGE:
+        body.destination() = pick(body.destination()).getPublicKey();
+        break;
+    default:
+        break;
+    }
+}
+
+bool
+TxFuzzer::apply(SecretKey const& from, Operation op, LedgerDelta& delta)
+{
+    auto account =
+        AccountFrame::loadAccount(from.getPublicKey(), mApp->getDatabase());
+    if (!account)
+    {
+        return false;
+    }
+
+    TransactionEnvelope env;
+    env.tx.sourceAccount = from.getPublicKey();
+    env.tx.fee = mApp->getLedgerManager().getTxFee();
+    env.tx.seqNum = account->getSeqNum() + 1;
+    env.tx.operations.emplace_back(op);
+    auto tx =
+        TransactionFrame::makeTransactionFromWire(mApp->getNetworkID(), env);
+    tx->addSignature(from);
+    if (op.sourceAccount)
+    {
+        tx->addSignature(pick(*op.sourceAccount));
+    }
+
+    // as a ledger close does, except that exceptions are not caught: they
+    // are what the fuzzer looks for
+    tx->processFeeSeqNum(delta, mApp->getLedgerManager());
+    return tx->apply(delta, *mApp);
+}
+
+void
+TxFuzzer::setup()
+{
+    auto& db = mApp->getDatabase();
+    mHeader = mApp->getLedgerManager().getCurrentLedgerHeader();
+    soci::transaction sqlTx(db.getSession());
+    LedgerDelta delta(mHeader, db);
+
+    auto root = txtest::getRoot(mApp->getNetworkID());
+    auto native = txtest::makeNativeAsset();
+    int64_t const amount = 1000000000;
+    bool ok = true;
+    for (auto const& a : mAccounts)
+    {
+        ok = ok && apply(root, txtest::createAccount(a.getPublicKey(),
+                                                     1000 * amount),
+                         delta);
+    }
+    for (auto const& a : mAccounts)
+    {
+        for (auto const& issuer : mAccounts)
+        {
+            if (&a != &issuer)
+            {
+                ok = ok && apply(a,
+                                 txtest::changeTrust(fuzzAsset(issuer),
+                                                     INT64_MAX),
+                                 delta);
+                ok = ok && apply(issuer,
+                                 txtest::payment(a.getPublicKey(),
+                                                 fuzzAsset(issuer), amount),
+                                 delta);
+            }
+        }
+    }
+    // an order book between every asset and the native one
+    for (size_t i = 0; i < mAccounts.size(); ++i)
+    {
+        auto other = fuzzAsset(mAccounts[(i + 1) % mAccounts.size()]);
+        ok = ok && apply(mAccounts[i],
+                         txtest::manageOffer(0, other, native, Price{1, 1},
+                                             amount / 10),
+                         delta);
+        ok = ok && apply(mAccounts[i],
+                         txtest::manageOffer(0, native, other, Price{1, 2},
+                                             amount / 10),
+                         delta);
+    }
+    if (!ok)
+    {
+        throw std::runtime_error("could not set up the fuzzer's ledger");
+    }
+    delta.commit();
+    sqlTx.commit();
+}
+
+size_t
+TxFuzzer::inject(std::string const& filename)
+{
+    auto& db = mApp->getDatabase();
+    XDRInputFileStream in(MAX_MESSAGE_SIZE);
+    in.open(filename);
+
+    // a top level delta with an SQL transaction, both rolled back at the end
+    LedgerHeader header = mHeader;
+    soci::transaction sqlTx(db.getSession());
+    LedgerDelta delta(header, db);
+
+    size_t applied = 0;
+    Operation op;
+    try
+    {
+        for (size_t i = 0; i < MAX_OPERATIONS && in.readOne(op); ++i)
+        {
+            remap(op);
+            if (apply(mAccounts[i % mAccounts.size()], op, delta))
+            {
+                ++applied;
+            }
+        }
+    }
+    catch (xdr::xdr_runtime_error& e)
+    {
+        LOG(INFO) << "Caught XDR error '" << e.what()
+                  << "' on input, stopping there";
+    }
+    delta.rollback();
+    sqlTx.rollback();
+    return applied;
+}
+
+void
+fuzzTransactions(std::string const& filename, el::Level logLevel)
+{
+    Logging::setFmt("<fuzz>", false);
+    Logging::setLogLevel(logLevel, nullptr);
+    LOG(INFO) << "Fuzzing transactions of stellar-core "
+              << STELLAR_CORE_VERSION;
+
+    Config cfg = getTestConfig(0);
+    cfg.HTTP_PORT = 0;
+    cfg.PUBLIC_HTTP_PORT = false;
+    cfg.LOG_FILE_PATH = "fuzz-tx.log";
+    cfg.BUCKET_DIR_PATH = "fuzz-tx-buckets";
+    CfgDirGuard g(cfg);
+
+    VirtualClock clock;
+    TxFuzzer fuzzer(clock, cfg);
+    for (;;)
+    {
+        LOG(INFO) << "Fuzz input is in " << filename;
+        auto applied = fuzzer.inject(filename);
+        LOG(INFO) << applied << " operations applied";
+
+        if (!getenv("AFL_PERSISTENT") || persist_cnt++ >= PERSIST_MAX)
+        {
+            break;
+        }
+#ifndef _WIN32
+        raise(SIGSTOP);
+#endif
+    }
+}
+
+void
+genfuzzTransactions(std::string const& filename)
+{
+    Logging::setFmt("<fuzz>");
+    size_t n = 8;
+    LOG(INFO) << "Writing " << n << "-operation random fuzz file " << filename;
+
+    std::vector<SecretKey> accounts;
+    for (size_t i = 0; i < TxFuzzer::NUM_ACCOUNTS; ++i)
+    {
+        accounts.emplace_back(fuzzAccount(i));
+    }
+    auto account = [&]() { return rand_element(accounts); };
+    auto asset = [&]() {
+        return rand_uniform(0, 3) == 0 ? txtest::makeNativeAsset()
+                                       : fuzzAsset(account());
+    };
+    auto amount = [&]() { return rand_uniform<int64_t>(1, 100000000); };
+    auto price = [&]() {
+        return Price{rand_uniform(1, 10), rand_uniform(1, 10)};
+    };
+
+    XDROutputFileStream out;
+    out.open(filename);
+    for (size_t i = 0; i < n; ++i)
+    {
+        Operation op;
+        switch (rand_uniform(0, 8))
+        {
+        case 0:
+            op = txtest::payment(account().getPublicKey(), asset(), amount());
+            break;
+        case 1:
+            op = txtest::pathPayment(account().getPublicKey(), asset(),
+                                     amount(), asset(), amount(), {asset()});
+            break;
+        case 2:
+            op = txtest::manageOffer(0, asset(), asset(), price(), amount());
+            break;
+        case 3:
+            op = txtest::createPassiveOffer(asset(), asset(), price(),
+                                            amount());
+            break;
+        case 4:
+            op = txtest::changeTrust(fuzzAsset(account()), amount());
+            break;
+        case 5:
+        {
+            Signer signer;
+            signer.key.type(SIGNER_KEY_TYPE_ED25519);
+            signer.key.ed25519() = account().getPublicKey().ed25519();
+            signer.weight = rand_uniform(0, 255);
+            op = txtest::setOptions(txtest::setSigner(signer));
+            break;
+        }
+        case 6:
+            op = txtest::accountMerge(account().getPublicKey());
+            break;
+        case 7:
+        {
+            DataValue value(4, static_cast<uint8_t>(i));
+            op = txtest::manageData("fuzz" + std::to_string(i), &value);
+            break;
+        }
+        default:
+            op = txtest::inflation();
+            break;
+        }
+        if (rand_uniform(0, 3) == 0)
+        {
+            op.sourceAccount.activate() = account().getPublicKey();
+        }
+        out.writeOne(op);
+        LOG(INFO) << "Operation " << i << ": " << xdr::xdr_to_string(op);
+    }
+}
 }
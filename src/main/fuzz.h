@@ -4,12 +4,74 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "crypto/SecretKey.h"
+#include "overlay/StellarXDR.h"
 #include "util/Logging.h"
+#include "util/NonCopyable.h"
+
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace stellar
 {
+class Application;
+class Config;
+class LedgerDelta;
+class VirtualClock;
 
 void fuzz(std::string const& filename, el::Level logLevel,
           std::vector<std::string> const& metrics);
 void genfuzz(std::string const& filename);
+
+/**
+ * Persistent transaction fuzzer: a single application, set up once with
+ * NUM_ACCOUNTS accounts that trust each other's asset and have offers,
+ * applies the operations of each input (a stream of Operations, see
+ * genfuzzTransactions) as transactions of these accounts, straight to the
+ * ledger like a ledger close does, then rolls the ledger state back for the
+ * next input. There is no overlay, herder or application startup per input.
+ *
+ * The accounts of the operations (destinations, sources, issuers, signers)
+ * are mapped to the fuzzer's accounts by their first byte, so that mutated
+ * inputs still reach existing entries, and transactions are signed by the
+ * accounts involved.
+ */
+class TxFuzzer : NonMovableOrCopyable
+{
+    std::shared_ptr<Application> mApp;
+    std::vector<SecretKey> mAccounts;
+    // the last closed ledger, with the setup applied
+    LedgerHeader mHeader;
+
+    SecretKey const& pick(PublicKey const& key) const;
+    void remap(Asset& asset) const;
+    void remap(Operation& op) const;
+
+    // applies `op` as a transaction of `from` on the ledger `delta` is on;
+    // returns whether it succeeded
+    bool apply(SecretKey const& from, Operation op, LedgerDelta& delta);
+    void setup();
+
+  public:
+    static size_t const NUM_ACCOUNTS;
+    // the most operations applied per input
+    static size_t const MAX_OPERATIONS;
+
+    TxFuzzer(VirtualClock& clock, Config const& cfg);
+    ~TxFuzzer();
+
+    // Applies the operations of the input `filename` then rolls them back;
+    // returns how many succeeded.
+    size_t inject(std::string const& filename);
+
+    Application& getApp();
+    std::vector<SecretKey> const& getAccounts() const;
+};
+
+// Runs the input `filename` through a TxFuzzer, repeatedly when
+// AFL_PERSISTENT is set (stopping itself between inputs).
+void fuzzTransactions(std::string const& filename, el::Level logLevel);
+// Writes an input of a few operations between the TxFuzzer accounts.
+void genfuzzTransactions(std::string const& filename);
 }
@@ -7,6 +7,8 @@
 #include "catchup/CatchupConfiguration.h"
 #include "catchup/CatchupManager.h"
 #include "catchup/CatchupWork.h"
+#include "catchup/ReplayLedgers.h"
+#include "catchup/RestoreFromBuckets.h"
 #include "catchup/VerifyLedgerChainWork.h"
 #include "crypto/Hex.h"
 #include "crypto/KeyUtils.h"
@@ -15,6 +17,7 @@
 #include "history/HistoryArchiveManager.h"
 #include "history/HistoryManager.h"
 #include "historywork/GetHistoryArchiveStateWork.h"
+#include "historywork/GetIndexedLedgerWork.h"
 #include "ledger/LedgerManager.h"
 #include "lib/http/HttpClient.h"
 #include "lib/util/getopt.h"
@@ -26,6 +29,9 @@
 #include "main/StellarCoreVersion.h"
 #include "main/dumpxdr.h"
 #include "main/fuzz.h"
+#include "simulation/LedgerCloseBench.h"
+#include "simulation/LedgerStateGenerator.h"
+#include "test/PerfResults.h"
 #include "test/test.h"
 #include "util/Fs.h"
 #include "util/Logging.h"
@@ -46,6 +52,7 @@ using namespace std;
 
 enum opttag
 {
+    OPT_BENCH,
     OPT_CATCHUP_AT,
     OPT_CATCHUP_COMPLETE,
     OPT_CATCHUP_RECENT,
@@ -54,24 +61,33 @@ enum opttag
     OPT_CONF,
     OPT_CONVERTID,
     OPT_CHECKQUORUM,
+    OPT_COMPARE_PERF,
     OPT_BASE64,
     OPT_DUMPXDR,
+    OPT_DUMPXDR_PARAMS,
     OPT_LOADXDR,
     OPT_FORCESCP,
     OPT_FUZZ,
+    OPT_FUZZ_TX,
+    OPT_GENERATE_STATE,
     OPT_GENFUZZ,
+    OPT_GENFUZZ_TX,
     OPT_GENSEED,
     OPT_GRAPHQUORUM,
     OPT_HELP,
     OPT_INFERQUORUM,
+    OPT_INFERQUORUM_STATE,
     OPT_OFFLINEINFO,
     OPT_OUTPUT_FILE,
     OPT_REPORT_LAST_HISTORY_CHECKPOINT,
+    OPT_RESTORE_FROM_BUCKETS,
     OPT_LOGLEVEL,
     OPT_METRIC,
     OPT_NEWDB,
     OPT_NEWHIST,
     OPT_PRINTXDR,
+    OPT_PRINT_ARCHIVED_LEDGER,
+    OPT_REPLAY,
     OPT_SEC2PUB,
     OPT_SIGNTXN,
     OPT_NETID,
@@ -81,6 +97,7 @@ enum opttag
 };
 
 static const struct option stellar_core_options[] = {
+    {"bench", required_argument, nullptr, OPT_BENCH},
     {"catchup-at", required_argument, nullptr, OPT_CATCHUP_AT},
     {"catchup-complete", no_argument, nullptr, OPT_CATCHUP_COMPLETE},
     {"catchup-recent", required_argument, nullptr, OPT_CATCHUP_RECENT},
@@ -89,24 +106,34 @@ static const struct option stellar_core_options[] = {
     {"conf", required_argument, nullptr, OPT_CONF},
     {"convertid", required_argument, nullptr, OPT_CONVERTID},
     {"checkquorum", optional_argument, nullptr, OPT_CHECKQUORUM},
+    {"compare-perf", required_argument, nullptr, OPT_COMPARE_PERF},
     {"base64", no_argument, nullptr, OPT_BASE64},
     {"dumpxdr", required_argument, nullptr, OPT_DUMPXDR},
+    {"dumpxdr-params", required_argument, nullptr, OPT_DUMPXDR_PARAMS},
     {"printxdr", required_argument, nullptr, OPT_PRINTXDR},
+    {"print-archived-ledger", required_argument, nullptr,
+     OPT_PRINT_ARCHIVED_LEDGER},
     {"filetype", required_argument, nullptr, OPT_FILETYPE},
     {"signtxn", required_argument, nullptr, OPT_SIGNTXN},
     {"netid", required_argument, nullptr, OPT_NETID},
     {"loadxdr", required_argument, nullptr, OPT_LOADXDR},
     {"forcescp", optional_argument, nullptr, OPT_FORCESCP},
     {"fuzz", required_argument, nullptr, OPT_FUZZ},
+    {"fuzz-tx", required_argument, nullptr, OPT_FUZZ_TX},
+    {"generate-state", required_argument, nullptr, OPT_GENERATE_STATE},
     {"genfuzz", required_argument, nullptr, OPT_GENFUZZ},
+    {"genfuzz-tx", required_argument, nullptr, OPT_GENFUZZ_TX},
     {"genseed", no_argument, nullptr, OPT_GENSEED},
     {"graphquorum", optional_argument, nullptr, OPT_GRAPHQUORUM},
     {"help", no_argument, nullptr, OPT_HELP},
     {"inferquorum", optional_argument, nullptr, OPT_INFERQUORUM},
+    {"inferquorum-state", required_argument, nullptr, OPT_INFERQUORUM_STATE},
     {"offlineinfo", no_argument, nullptr, OPT_OFFLINEINFO},
     {"output-file", required_argument, nullptr, OPT_OUTPUT_FILE},
     {"report-last-history-checkpoint", no_argument, nullptr,
      OPT_REPORT_LAST_HISTORY_CHECKPOINT},
+    {"replay", required_argument, nullptr, OPT_REPLAY},
+    {"restore-from-buckets", no_argument, nullptr, OPT_RESTORE_FROM_BUCKETS},
     {"sec2pub", no_argument, nullptr, OPT_SEC2PUB},
     {"ll", required_argument, nullptr, OPT_LOGLEVEL},
     {"metric", required_argument, nullptr, OPT_METRIC},
@@ -123,6 +150,12 @@ usage(int err = 1)
     os << "usage: stellar-core [OPTIONS]\n"
           "where OPTIONS can be any of:\n"
           "      --base64             Use base64 for --printtxn and --signtxn\n"
+          "      --bench PARAMS       Benchmark ledger close on a fresh "
+          "database (erasing the\n"
+          "                           configured one), report to "
+          "--output-file as JSON,\n"
+          "                           then quit; PARAMS like "
+          "'accounts=N&ledgers=N&txs=N&mode=M'\n"
           "      --catchup-at SEQ     Do a catchup at ledger SEQ, then quit\n"
           "                           Use current as SEQ to catchup to "
           "'current' history checkpoint\n"
@@ -136,22 +169,48 @@ usage(int err = 1)
           "try '--c help' for more information\n"
           "      --conf FILE          Specify a config file ('-' for STDIN, "
           "default 'stellar-core.cfg')\n"
+          "      --compare-perf BASE CURRENT\n"
+          "                           Compare two results files of the [perf] "
+          "tests, flag the\n"
+          "                           significant regressions (exit code 1 if "
+          "any), then quit\n"
           "      --convertid ID       Displays ID in all known forms\n"
           "      --dumpxdr FILE       Dump an XDR file, for debugging\n"
+          "      --dumpxdr-params PARAMS\n"
+          "                           Options of --dumpxdr, given before it, "
+          "like\n"
+          "                           'type=offer,trustline&account=ID&"
+          "stats=true&threads=N'\n"
+          "                           (stats: count and size of the entries "
+          "by type only)\n"
           "      --loadxdr FILE       Load an XDR bucket file, for testing\n"
           "      --forcescp           Next time stellar-core is run, SCP will "
           "start with the local ledger rather than waiting to hear from the "
           "network.\n"
           "      --fuzz FILE          Run a single fuzz input and exit\n"
+          "      --fuzz-tx FILE       Apply the operations of a fuzz input "
+          "to a test ledger and exit\n"
+          "      --generate-state PARAMS\n"
+          "                           Write a synthetic ledger state to the "
+          "bucket directory,\n"
+          "                           restore the DB from it, report to "
+          "--output-file as JSON,\n"
+          "                           then quit; PARAMS like "
+          "'accounts=N&offers=N&dist=D'\n"
           "      --genfuzz FILE       Generate a random fuzzer input file\n"
+          "      --genfuzz-tx FILE    Generate a random --fuzz-tx input file\n"
           "      --genseed            Generate and print a random node seed\n"
           "      --help               Display this string\n"
           "      --inferquorum        Print a quorum set inferred from "
           "history\n"
           "      --checkquorum        Check quorum intersection from history\n"
           "      --graphquorum        Print a quorum set graph from history\n"
-          "      --output-file        Output file for --graphquorum and "
-          "--report-last-history-checkpoint commands\n"
+          "      --inferquorum-state FILE Extend, and save back, the quorum "
+          "inferred\n"
+          "                           in FILE by --inferquorum, --checkquorum "
+          "and --graphquorum\n"
+          "      --output-file        Output file for --graphquorum, --bench, "
+          "--replay and --report-last-history-checkpoint commands\n"
           "      --offlineinfo        Return information for an offline "
           "instance\n"
           "      --ll LEVEL           Set the log level. (redundant with --c "
@@ -168,9 +227,21 @@ usage(int err = 1)
           "      --filetype "
           "[auto|ledgerheader|meta|result|resultpair|tx|txfee] toggle for type "
           "used for printxdr\n"
+          "      --print-archived-ledger SEQ Print the header, transactions "
+          "and results\n"
+          "                           of ledger SEQ from the history "
+          "archive indexes\n"
+          "      --replay DIR         Replay the ledgers after the LCL found "
+          "in the unzipped\n"
+          "                           checkpoint files of DIR, report their "
+          "timings to\n"
+          "                           --output-file as JSON, then quit\n"
           "      --report-last-history-checkpoint\n"
           "                           Report information about last checkpoint "
           "available in history archives\n"
+          "      --restore-from-buckets\n"
+          "                           Recreate the DB with the ledger state "
+          "saved in the bucket directory, then quit\n"
           "      --signtxn FILE       Add signature to transaction envelope,"
           " then quit\n"
           "                           (Key is read from stdin or terminal, as"
@@ -261,6 +332,19 @@ checkInitialized(Application::pointer app)
     return true;
 }
 
+// The configuration of the offline tools that only read the database: with
+// DATABASE_READONLY set, they read from the replica.
+static Config
+readOnlyConfig(Config const& cfg)
+{
+    Config res(cfg);
+    if (!cfg.DATABASE_READONLY.value.empty())
+    {
+        res.DATABASE = cfg.DATABASE_READONLY;
+    }
+    return res;
+}
+
 static int
 catchup(Application::pointer app, uint32_t to, uint32_t count,
         Json::Value& catchupInfo)
@@ -415,7 +499,8 @@ static int
 reportLastHistoryCheckpoint(Config const& cfg, std::string const& outputFile)
 {
     VirtualClock clock(VirtualClock::REAL_TIME);
-    Application::pointer app = Application::create(clock, cfg, false);
+    Application::pointer app =
+        Application::create(clock, readOnlyConfig(cfg), false);
 
     if (!checkInitialized(app))
     {
@@ -461,6 +546,160 @@ reportLastHistoryCheckpoint(Config const& cfg, std::string const& outputFile)
     return ok ? 0 : 1;
 }
 
+// Prints the entries of ledger @p ledgerSeq in the checkpoint files of the
+// history archives, read through their indexes (see CheckpointIndex).
+static int
+printArchivedLedger(Config const& cfg, uint32_t ledgerSeq)
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Application::pointer app =
+        Application::create(clock, readOnlyConfig(cfg), false);
+    auto& wm = app->getWorkManager();
+
+    bool ok = true;
+    auto print = [&](char const* type, auto entry) {
+        auto work = wm.executeWork<GetIndexedLedgerWork>(type, ledgerSeq);
+        if (work->getState() != Work::WORK_SUCCESS)
+        {
+            LOG(ERROR) << "Fetching the indexed " << type << " file failed";
+            ok = false;
+        }
+        else if (work->getEntry(entry))
+        {
+            printHistoryEntry(entry);
+        }
+    };
+    print(HISTORY_FILE_TYPE_LEDGER, LedgerHeaderHistoryEntry{});
+    print(HISTORY_FILE_TYPE_TRANSACTIONS, TransactionHistoryEntry{});
+    print(HISTORY_FILE_TYPE_RESULTS, TransactionHistoryResultEntry{});
+
+    app->gracefulStop();
+    while (clock.crank(true))
+        ;
+
+    return ok ? 0 : 1;
+}
+
+// Runs the ledger close benchmark, see LedgerCloseBench for @p params.
+static int
+benchmarkLedgerClose(Config cfg, std::string const& params,
+                     std::string const& outputFile)
+{
+    auto options = LedgerCloseBench::parseOptions(params);
+    // a genesis ledger of the configured protocol, with room for the load
+    cfg.USE_CONFIG_FOR_GENESIS = true;
+    cfg.TESTING_UPGRADE_MAX_TX_PER_LEDGER = options.mTxs;
+
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Application::pointer app = Application::create(clock, cfg, true);
+    LedgerCloseBench bench(*app, options);
+    bench.populate();
+    auto report = bench.run().toStyledString();
+
+    if (outputFile.empty() || outputFile == "-")
+    {
+        std::cout << report;
+    }
+    else
+    {
+        std::ofstream out(outputFile);
+        out << report;
+        LOG(INFO) << "*";
+        LOG(INFO) << "* Wrote benchmark report to " << outputFile;
+        LOG(INFO) << "*";
+    }
+
+    app->gracefulStop();
+    while (clock.crank(true))
+        ;
+    return 0;
+}
+
+// Writes a synthetic ledger state to the bucket directory, see
+// LedgerStateGenerator for @p params.
+static int
+generateLedgerState(Config cfg, std::string const& params,
+                    std::string const& outputFile)
+{
+    auto options = LedgerStateGenerator::parseOptions(params);
+    // a genesis ledger of the configured protocol
+    cfg.USE_CONFIG_FOR_GENESIS = true;
+
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Application::pointer app = Application::create(clock, cfg, true);
+    auto report = LedgerStateGenerator(*app, options).run().toStyledString();
+
+    if (outputFile.empty() || outputFile == "-")
+    {
+        std::cout << report;
+    }
+    else
+    {
+        std::ofstream out(outputFile);
+        out << report;
+        LOG(INFO) << "*";
+        LOG(INFO) << "* Wrote ledger state report to " << outputFile;
+        LOG(INFO) << "*";
+    }
+    return 0;
+}
+
+// Replays the ledgers of the checkpoint files of @p dir, see replayLedgers.
+static int
+replayHistory(Config const& cfg, std::string const& dir,
+              std::string const& outputFile)
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Application::pointer app = Application::create(clock, cfg, false);
+    if (!checkInitialized(app))
+    {
+        return 1;
+    }
+    // with the bucket list, which the ledger hashes depend on
+    auto done = false;
+    app->getLedgerManager().loadLastKnownLedger(
+        [&done](asio::error_code const& ec) {
+            if (ec)
+            {
+                throw std::runtime_error(
+                    "Unable to restore last-known ledger state");
+            }
+
+            done = true;
+        });
+    while (!done && clock.crank(true))
+        ;
+
+    std::string report;
+    try
+    {
+        report = replayLedgers(*app, dir).toStyledString();
+    }
+    catch (std::runtime_error& e)
+    {
+        LOG(ERROR) << "* Replay failed: " << e.what();
+        return 1;
+    }
+
+    if (outputFile.empty() || outputFile == "-")
+    {
+        std::cout << report;
+    }
+    else
+    {
+        std::ofstream out(outputFile);
+        out << report;
+        LOG(INFO) << "*";
+        LOG(INFO) << "* Wrote replay report to " << outputFile;
+        LOG(INFO) << "*";
+    }
+
+    app->gracefulStop();
+    while (clock.crank(true))
+        ;
+    return 0;
+}
+
 static uint32_t
 parseLedger(std::string const& str)
 {
@@ -531,7 +770,8 @@ showOfflineInfo(Config const& cfg)
 {
     // needs real time to display proper stats
     VirtualClock clock(VirtualClock::REAL_TIME);
-    Application::pointer app = Application::create(clock, cfg, false);
+    Application::pointer app =
+        Application::create(clock, readOnlyConfig(cfg), false);
     if (checkInitialized(app))
     {
         app->reportInfo();
@@ -560,35 +800,36 @@ loadXdr(Config const& cfg, std::string const& bucketFile)
 }
 
 static void
-inferQuorumAndWrite(Config const& cfg)
+inferQuorumAndWrite(Config const& cfg, std::string const& stateFile)
 {
     InferredQuorum iq;
     {
         VirtualClock clock;
         Application::pointer app = Application::create(clock, cfg, false);
-        iq = app->getHistoryManager().inferQuorum();
+        iq = app->getHistoryManager().inferQuorum(stateFile);
     }
     LOG(INFO) << "Inferred quorum";
     std::cout << iq.toString(cfg) << std::endl;
 }
 
 static void
-checkQuorumIntersection(Config const& cfg)
+checkQuorumIntersection(Config const& cfg, std::string const& stateFile)
 {
     VirtualClock clock;
     Application::pointer app = Application::create(clock, cfg, false);
-    InferredQuorum iq = app->getHistoryManager().inferQuorum();
+    InferredQuorum iq = app->getHistoryManager().inferQuorum(stateFile);
     iq.checkQuorumIntersection(cfg);
 }
 
 static void
-writeQuorumGraph(Config const& cfg, std::string const& outputFile)
+writeQuorumGraph(Config const& cfg, std::string const& stateFile,
+                 std::string const& outputFile)
 {
     InferredQuorum iq;
     {
         VirtualClock clock;
         Application::pointer app = Application::create(clock, cfg, false);
-        iq = app->getHistoryManager().inferQuorum();
+        iq = app->getHistoryManager().inferQuorum(stateFile);
     }
     std::string filename = outputFile.empty() ? "-" : outputFile;
     if (filename == "-")
@@ -620,6 +861,21 @@ initializeDatabase(Config& cfg)
     LOG(INFO) << "*";
 }
 
+static int
+restoreDatabaseFromBuckets(Config const& cfg)
+{
+    VirtualClock clock;
+    if (!restoreFromBuckets(clock, cfg))
+    {
+        return 1;
+    }
+
+    LOG(INFO) << "*";
+    LOG(INFO) << "* The next launch will catchup from the restored ledger.";
+    LOG(INFO) << "*";
+    return 0;
+}
+
 static int
 initializeHistories(Config& cfg, vector<string> newHistories)
 {
@@ -643,7 +899,7 @@ startApp(string cfgFile, Config& cfg)
     Application::pointer app;
     try
     {
-        app = Application::create(clock, cfg, false);
+        app = createApplicationOnStart(clock, cfg);
 
         if (!checkInitialized(app))
         {
@@ -661,6 +917,11 @@ startApp(string cfgFile, Config& cfg)
                              << "(for testing only)";
             }
 
+            if (cfg.DATABASE_DURABILITY == Config::DB_DURABILITY_RELAXED)
+            {
+                recoverLostLedgers(*app);
+            }
+
             app->applyCfgCommands();
 
             app->start();
@@ -701,6 +962,10 @@ main(int argc, char* const* argv)
 
     optional<bool> forceSCP = nullptr;
     bool base64 = false;
+    bool doBench = false;
+    std::string generateStateParams;
+    std::string replayDir;
+    std::string benchParams;
     bool doCatchupAt = false;
     uint32_t catchupAtTarget = 0;
     bool doCatchupComplete = false;
@@ -711,14 +976,18 @@ main(int argc, char* const* argv)
     bool inferQuorum = false;
     bool checkQuorum = false;
     bool graphQuorum = false;
+    std::string inferQuorumState;
     bool newDB = false;
     bool getOfflineInfo = false;
     auto doReportLastHistoryCheckpoint = false;
+    uint32_t printArchivedLedgerSeq = 0;
+    bool doRestoreFromBuckets = false;
     std::string outputFile;
     std::string loadXdrBucket;
     std::vector<std::string> newHistories;
     std::vector<std::string> metrics;
     string filetype = "auto";
+    DumpXdrOptions dumpXdrOptions;
 
     int opt;
     while ((opt = getopt_long_only(argc, argv, "c:", stellar_core_options,
@@ -729,6 +998,10 @@ main(int argc, char* const* argv)
         case OPT_BASE64:
             base64 = true;
             break;
+        case OPT_BENCH:
+            doBench = true;
+            benchParams = optarg;
+            break;
         case OPT_CATCHUP_AT:
             doCatchupAt = true;
             catchupAtTarget = parseLedger(optarg);
@@ -756,15 +1029,31 @@ main(int argc, char* const* argv)
         case OPT_CONVERTID:
             StrKeyUtils::logKey(std::cout, std::string(optarg));
             return 0;
+        case OPT_COMPARE_PERF:
+            if (optind >= argc)
+            {
+                usage();
+            }
+            return comparePerfResults(std::string(optarg),
+                                      std::string(argv[optind]),
+                                      std::cout) == 0
+                       ? 0
+                       : 1;
         case OPT_DUMPXDR:
-            dumpXdrStream(std::string(optarg));
+            dumpXdrStream(std::string(optarg), dumpXdrOptions);
             return 0;
+        case OPT_DUMPXDR_PARAMS:
+            dumpXdrOptions = DumpXdrOptions::parse(std::string(optarg));
+            break;
         case OPT_PRINTXDR:
             printXdr(std::string(optarg), filetype, base64);
             return 0;
         case OPT_FILETYPE:
             filetype = std::string(optarg);
             break;
+        case OPT_PRINT_ARCHIVED_LEDGER:
+            printArchivedLedgerSeq = parseLedger(optarg);
+            break;
         case OPT_SIGNTXN:
             signtxn(std::string(optarg), base64);
             return 0;
@@ -784,9 +1073,18 @@ main(int argc, char* const* argv)
         case OPT_FUZZ:
             fuzz(std::string(optarg), logLevel, metrics);
             return 0;
+        case OPT_FUZZ_TX:
+            fuzzTransactions(std::string(optarg), logLevel);
+            return 0;
+        case OPT_GENERATE_STATE:
+            generateStateParams = optarg;
+            break;
         case OPT_GENFUZZ:
             genfuzz(std::string(optarg));
             return 0;
+        case OPT_GENFUZZ_TX:
+            genfuzzTransactions(std::string(optarg));
+            return 0;
         case OPT_GENSEED:
         {
             SecretKey key = SecretKey::random();
@@ -798,6 +1096,9 @@ main(int argc, char* const* argv)
         case OPT_INFERQUORUM:
             inferQuorum = true;
             break;
+        case OPT_INFERQUORUM_STATE:
+            inferQuorumState = optarg;
+            break;
         case OPT_CHECKQUORUM:
             checkQuorum = true;
             break;
@@ -825,6 +1126,12 @@ main(int argc, char* const* argv)
         case OPT_REPORT_LAST_HISTORY_CHECKPOINT:
             doReportLastHistoryCheckpoint = true;
             break;
+        case OPT_REPLAY:
+            replayDir = optarg;
+            break;
+        case OPT_RESTORE_FROM_BUCKETS:
+            doRestoreFromBuckets = true;
+            break;
         case OPT_TEST:
         {
             rest.push_back(*argv);
@@ -877,12 +1184,21 @@ main(int argc, char* const* argv)
         if (forceSCP || newDB || getOfflineInfo || !loadXdrBucket.empty() ||
             inferQuorum || graphQuorum || checkQuorum || doCatchupAt ||
             doCatchupComplete || doCatchupRecent || doCatchupTo ||
-            doReportLastHistoryCheckpoint)
+            doReportLastHistoryCheckpoint || doRestoreFromBuckets || doBench ||
+            !replayDir.empty() || !generateStateParams.empty() ||
+            printArchivedLedgerSeq != 0)
         {
             auto result = 0;
             setNoListen(cfg);
             if (newDB)
                 initializeDatabase(cfg);
+            if (!generateStateParams.empty())
+                result =
+                    generateLedgerState(cfg, generateStateParams, outputFile);
+            // the generated state is only usable from the restored database
+            if ((result == 0) &&
+                (doRestoreFromBuckets || !generateStateParams.empty()))
+                result = restoreDatabaseFromBuckets(cfg);
             if ((result == 0) && (doCatchupAt || doCatchupComplete ||
                                   doCatchupRecent || doCatchupTo))
             {
@@ -914,14 +1230,20 @@ main(int argc, char* const* argv)
                 showOfflineInfo(cfg);
             if ((result == 0) && doReportLastHistoryCheckpoint)
                 result = reportLastHistoryCheckpoint(cfg, outputFile);
+            if ((result == 0) && printArchivedLedgerSeq != 0)
+                result = printArchivedLedger(cfg, printArchivedLedgerSeq);
             if ((result == 0) && !loadXdrBucket.empty())
                 loadXdr(cfg, loadXdrBucket);
             if ((result == 0) && inferQuorum)
-                inferQuorumAndWrite(cfg);
+                inferQuorumAndWrite(cfg, inferQuorumState);
             if ((result == 0) && checkQuorum)
-                checkQuorumIntersection(cfg);
+                checkQuorumIntersection(cfg, inferQuorumState);
             if ((result == 0) && graphQuorum)
-                writeQuorumGraph(cfg, outputFile);
+                writeQuorumGraph(cfg, inferQuorumState, outputFile);
+            if ((result == 0) && doBench)
+                result = benchmarkLedgerClose(cfg, benchParams, outputFile);
+            if ((result == 0) && !replayDir.empty())
+                result = replayHistory(cfg, replayDir, outputFile);
             return result;
         }
         else if (!newHistories.empty())
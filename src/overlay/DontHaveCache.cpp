@@ -0,0 +1,72 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/DontHaveCache.h"
+
+namespace stellar
+{
+
+DontHaveCache::DontHaveCache(VirtualClock& clock, size_t maxEntries,
+                             std::chrono::milliseconds timeToLive)
+    : mClock(clock), mMaxEntries(maxEntries), mTimeToLive(timeToLive)
+{
+}
+
+void
+DontHaveCache::eraseFront()
+{
+    auto const& front = mEntries.front();
+    auto it = mExpiries.find(front.mKey);
+    // the key may have been added again since
+    if (it != mExpiries.end() && it->second == front.mExpiry)
+    {
+        mExpiries.erase(it);
+    }
+    mEntries.pop_front();
+}
+
+void
+DontHaveCache::expire()
+{
+    auto now = mClock.now();
+    while (!mEntries.empty() && mEntries.front().mExpiry <= now)
+    {
+        eraseFront();
+    }
+}
+
+void
+DontHaveCache::add(NodeID const& peer, Hash const& item)
+{
+    expire();
+    auto key = std::make_pair(peer, item);
+    auto expiry = mClock.now() + mTimeToLive;
+    mExpiries[key] = expiry;
+    mEntries.push_back(Entry{expiry, std::move(key)});
+    while (mEntries.size() > mMaxEntries)
+    {
+        eraseFront();
+    }
+}
+
+bool
+DontHaveCache::contains(NodeID const& peer, Hash const& item)
+{
+    expire();
+    return mExpiries.find(std::make_pair(peer, item)) != mExpiries.end();
+}
+
+MemoryUsage
+DontHaveCache::getMemoryUsage() const
+{
+    MemoryUsage res;
+    res.mBytes += mEntries.size() * sizeof(Entry);
+    for (size_t i = 0; i < mExpiries.size(); i++)
+    {
+        res.add(sizeof(std::pair<NodeID, Hash>) +
+                sizeof(VirtualClock::time_point) + MemoryUsage::NODE_OVERHEAD);
+    }
+    return res;
+}
+}
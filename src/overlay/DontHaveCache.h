@@ -0,0 +1,69 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/MemoryUsage.h"
+#include "util/Timer.h"
+#include "util/XDROperators.h"
+#include "xdr/Stellar-types.h"
+
+#include <deque>
+#include <map>
+#include <utility>
+
+namespace stellar
+{
+
+/**
+ * @class DontHaveCache
+ *
+ * Remembers for a little while the peers that answered a fetch request with
+ * DONT_HAVE, so that they are not asked for the same item again by the
+ * trackers of an ItemFetcher: each envelope referencing an item that is
+ * being fetched otherwise starts asking again the peers that just said they
+ * do not have it.
+ *
+ * Entries expire after a fixed time, the peer may have fetched the item
+ * since, and the oldest ones are forgotten beyond a maximum number (counting
+ * the ones added again).
+ */
+class DontHaveCache
+{
+    struct Entry
+    {
+        VirtualClock::time_point mExpiry;
+        std::pair<NodeID, Hash> mKey;
+    };
+
+    VirtualClock& mClock;
+    size_t const mMaxEntries;
+    std::chrono::milliseconds const mTimeToLive;
+
+    // by expiry, with older expiries of keys added again
+    std::deque<Entry> mEntries;
+    std::map<std::pair<NodeID, Hash>, VirtualClock::time_point> mExpiries;
+
+    void eraseFront();
+    void expire();
+
+  public:
+    DontHaveCache(VirtualClock& clock, size_t maxEntries,
+                  std::chrono::milliseconds timeToLive);
+
+    // @p peer does not have @p item
+    void add(NodeID const& peer, Hash const& item);
+
+    // true if @p peer said recently that it does not have @p item
+    bool contains(NodeID const& peer, Hash const& item);
+
+    size_t
+    size() const
+    {
+        return mExpiries.size();
+    }
+
+    MemoryUsage getMemoryUsage() const;
+};
+}
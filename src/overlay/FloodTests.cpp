@@ -29,10 +29,13 @@ TEST_CASE("Flooding", "[flood][overlay]")
     Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
     Simulation::pointer simulation;
 
+    bool pullMode = false;
+
     // make closing very slow
-    auto cfgGen = [](int cfgNum) {
+    auto cfgGen = [&pullMode](int cfgNum) {
         Config cfg = getTestConfig(cfgNum);
         cfg.ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING = 10000;
+        cfg.PULL_MODE_TX_FLOODING = pullMode;
         return cfg;
     };
 
@@ -197,6 +200,23 @@ TEST_CASE("Flooding", "[flood][overlay]")
                 test(injectTransaction, ackedTransactions);
             }
         }
+
+        SECTION("pull mode")
+        {
+            pullMode = true;
+            SECTION("loopback")
+            {
+                simulation = Topologies::hierarchicalQuorumSimplified(
+                    5, 10, Simulation::OVER_LOOPBACK, networkID, cfgGen);
+                test(injectTransaction, ackedTransactions);
+            }
+            SECTION("tcp")
+            {
+                simulation = Topologies::core(4, .666f, Simulation::OVER_TCP,
+                                              networkID, cfgGen);
+                test(injectTransaction, ackedTransactions);
+            }
+        }
     }
 
     SECTION("scp messages flooding")
@@ -5,6 +5,7 @@
 #include "overlay/Floodgate.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "crypto/XDRHasher.h"
 #include "herder/Herder.h"
 #include "main/Application.h"
 #include "medida/counter.h"
@@ -14,15 +15,21 @@
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+#include <cstdint>
+
 namespace stellar
 {
-Floodgate::FloodRecord::FloodRecord(StellarMessage const& msg, uint32_t ledger,
-                                    Peer::pointer peer)
-    : mLedgerSeq(ledger), mMessage(msg)
-{
-    if (peer)
-        mPeersTold.insert(peer);
-}
+
+// records are purged that many ledgers after the one they were created in
+static uint32_t const FLOOD_RECORD_LEDGERS = 10;
+
+// number of clearBelow calls the hashes of purged records are remembered for
+static size_t const SEEN_FILTER_COUNT = 10;
+// bits per hash in these filters, for ~0.02% of false positives
+static size_t const SEEN_FILTER_BITS_PER_ELEMENT = 20;
+
+static size_t const NO_SLOT = SIZE_MAX;
 
 Floodgate::Floodgate(Application& app)
     : mApp(app)
@@ -38,19 +45,90 @@ Floodgate::Floodgate(Application& app)
 void
 Floodgate::clearBelow(uint32_t currentLedger)
 {
-    for (auto it = mFloodMap.cbegin(); it != mFloodMap.cend();)
-    {
+    std::vector<uint64_t> purged;
+    mFloodMap.eraseIf([&](std::pair<Hash, FloodRecord> const& record) {
         // give one ledger of leeway
-        if (it->second->mLedgerSeq + 10 < currentLedger)
+        if (record.second.mLedgerSeq + FLOOD_RECORD_LEDGERS < currentLedger)
         {
-            mFloodMap.erase(it++);
+            purged.emplace_back(BloomFilter::hash(record.first));
+            return true;
         }
-        else
+        return false;
+    });
+    mFloodMapSize.set_count(mFloodMap.size());
+    mLastClearedLedger = currentLedger;
+
+    if (!purged.empty())
+    {
+        mSeenFilters.emplace_back(purged, SEEN_FILTER_BITS_PER_ELEMENT);
+        if (mSeenFilters.size() > SEEN_FILTER_COUNT)
         {
-            ++it;
+            mSeenFilters.pop_front();
         }
     }
-    mFloodMapSize.set_count(mFloodMap.size());
+}
+
+size_t
+Floodgate::getSlot(Peer::pointer const& peer)
+{
+    if (!peer || !peer->isConnected())
+    {
+        return NO_SLOT;
+    }
+    auto it = mPeerSlots.find(peer.get());
+    if (it != mPeerSlots.end())
+    {
+        return it->second;
+    }
+
+    size_t slot = mSlotPeers.size();
+    // a record refers to slots freed before (or in) its ledger only
+    if (!mFreeSlots.empty() &&
+        mFreeSlots.front().second + FLOOD_RECORD_LEDGERS < mLastClearedLedger)
+    {
+        slot = mFreeSlots.front().first;
+        mFreeSlots.pop_front();
+        mSlotPeers[slot] = peer;
+    }
+    else
+    {
+        mSlotPeers.emplace_back(peer);
+    }
+    mPeerSlots[peer.get()] = slot;
+    return slot;
+}
+
+void
+Floodgate::forgetPeer(Peer* peer)
+{
+    auto it = mPeerSlots.find(peer);
+    if (it == mPeerSlots.end())
+    {
+        return;
+    }
+    mSlotPeers[it->second].reset();
+    mFreeSlots.emplace_back(it->second, mApp.getHerder().getCurrentLedgerSeq());
+    mPeerSlots.erase(it);
+}
+
+void
+Floodgate::setTold(FloodRecord& record, size_t slot)
+{
+    if (slot == NO_SLOT)
+    {
+        return;
+    }
+    if (record.mPeersTold.size() <= slot)
+    {
+        record.mPeersTold.resize(slot + 1);
+    }
+    record.mPeersTold[slot] = true;
+}
+
+bool
+Floodgate::isTold(FloodRecord const& record, size_t slot)
+{
+    return slot < record.mPeersTold.size() && record.mPeersTold[slot];
 }
 
 bool
@@ -60,43 +138,52 @@ Floodgate::addRecord(StellarMessage const& msg, Peer::pointer peer)
     {
         return false;
     }
-    Hash index = sha256(xdr::xdr_to_opaque(msg));
+    Hash index = xdrSha256(msg);
     auto result = mFloodMap.find(index);
     if (result == mFloodMap.end())
     { // we have never seen this message
-        mFloodMap[index] = std::make_shared<FloodRecord>(
-            msg, mApp.getHerder().getCurrentLedgerSeq(), peer);
+        auto& record = mFloodMap[index];
+        record.mLedgerSeq = mApp.getHerder().getCurrentLedgerSeq();
+        setTold(record, getSlot(peer));
         mFloodMapSize.set_count(mFloodMap.size());
         return true;
     }
     else
     {
-        result->second->mPeersTold.insert(peer);
+        setTold(result->second, getSlot(peer));
         return false;
     }
 }
 
 // send message to anyone you haven't gotten it from
 void
-Floodgate::broadcast(StellarMessage const& msg, bool force)
+Floodgate::broadcast(StellarMessage const& msg, bool force,
+                     std::function<bool(Peer::pointer const&)> const& resendTo)
 {
     if (mShuttingDown)
     {
         return;
     }
-    Hash index = sha256(xdr::xdr_to_opaque(msg));
+    // serialized once, for the index and for every peer
+    auto xdrMsg =
+        std::make_shared<xdr::opaque_vec<> const>(xdr::xdr_to_opaque(msg));
+    Hash index = sha256(*xdrMsg);
     CLOG(TRACE, "Overlay") << "broadcast " << hexAbbrev(index);
 
     auto result = mFloodMap.find(index);
     if (result == mFloodMap.end() || force)
     { // no one has sent us this message
-        FloodRecord::pointer record = std::make_shared<FloodRecord>(
-            msg, mApp.getHerder().getCurrentLedgerSeq(), Peer::pointer());
-        result = mFloodMap.insert(std::make_pair(index, record)).first;
+        auto inserted = mFloodMap.emplace(index, FloodRecord{});
+        if (inserted.second)
+        {
+            inserted.first->second.mLedgerSeq =
+                mApp.getHerder().getCurrentLedgerSeq();
+        }
+        result = inserted.first;
         mFloodMapSize.set_count(mFloodMap.size());
     }
     // send it to people that haven't sent it to us
-    std::set<Peer::pointer>& peersTold = result->second->mPeersTold;
+    auto& record = result->second;
 
     // make a copy, in case peers gets modified
     auto peers = mApp.getOverlayManager().getAuthenticatedPeers();
@@ -104,15 +191,79 @@ Floodgate::broadcast(StellarMessage const& msg, bool force)
     for (auto peer : peers)
     {
         assert(peer.second->isAuthenticated());
-        if (peersTold.find(peer.second) == peersTold.end())
+        auto slot = getSlot(peer.second);
+        if (!isTold(record, slot) || (resendTo && resendTo(peer.second)))
         {
             mSendFromBroadcast.Mark();
-            peer.second->sendMessage(msg);
-            peersTold.insert(peer.second);
+            if (msg.type() == TRANSACTION && peer.second->isPullModeEnabled())
+            {
+                if (!record.mMessage)
+                {
+                    // needed to answer the demands
+                    record.mMessage = std::make_shared<StellarMessage>(msg);
+                }
+                peer.second->advertiseTransaction(index);
+            }
+            else
+            {
+                peer.second->sendMessage(msg, xdrMsg);
+            }
+            setTold(record, slot);
+        }
+    }
+    CLOG(TRACE, "Overlay")
+        << "broadcast " << hexAbbrev(index) << " told "
+        << std::count(record.mPeersTold.begin(), record.mPeersTold.end(), true);
+}
+
+StellarMessage const*
+Floodgate::getMessage(Hash const& h) const
+{
+    auto record = mFloodMap.find(h);
+    return record == mFloodMap.end() ? nullptr : record->second.mMessage.get();
+}
+
+bool
+Floodgate::isSeen(Hash const& h) const
+{
+    if (mFloodMap.find(h) != mFloodMap.end())
+    {
+        return true;
+    }
+    if (mSeenFilters.empty())
+    {
+        return false;
+    }
+    auto bloomHash = BloomFilter::hash(h);
+    return std::any_of(mSeenFilters.begin(), mSeenFilters.end(),
+                       [bloomHash](BloomFilter const& filter) {
+                           return filter.mayContain(bloomHash);
+                       });
+}
+
+MemoryUsage
+Floodgate::getMemoryUsage() const
+{
+    MemoryUsage res;
+    // the slots of the table, used or not, with the hash each keeps
+    res.mBytes += mFloodMap.capacity() *
+                  (sizeof(std::pair<Hash, FloodRecord>) + sizeof(size_t));
+    for (auto const& kv : mFloodMap)
+    {
+        auto const& record = kv.second;
+        size_t bytes = record.mPeersTold.capacity() / 8;
+        if (record.mMessage)
+        {
+            // with the control block of the shared_ptr
+            bytes += xdrMemoryUsage(*record.mMessage) + 2 * sizeof(void*);
         }
+        res.add(bytes);
     }
-    CLOG(TRACE, "Overlay") << "broadcast " << hexAbbrev(index) << " told "
-                           << peersTold.size();
+    for (auto const& filter : mSeenFilters)
+    {
+        res.mBytes += filter.getByteSize();
+    }
+    return res;
 }
 
 std::set<Peer::pointer>
@@ -122,7 +273,17 @@ Floodgate::getPeersKnows(Hash const& h)
     auto record = mFloodMap.find(h);
     if (record != mFloodMap.end())
     {
-        res = record->second->mPeersTold;
+        auto const& told = record->second.mPeersTold;
+        for (size_t slot = 0; slot < told.size(); slot++)
+        {
+            if (told[slot])
+            {
+                if (auto peer = mSlotPeers[slot].lock())
+                {
+                    res.insert(peer);
+                }
+            }
+        }
     }
     return res;
 }
@@ -132,5 +293,6 @@ Floodgate::shutdown()
 {
     mShuttingDown = true;
     mFloodMap.clear();
+    mSeenFilters.clear();
 }
 }
@@ -6,7 +6,14 @@
 
 #include "overlay/Peer.h"
 #include "overlay/StellarXDR.h"
-#include <map>
+#include "util/BloomFilter.h"
+#include "util/FlatHashMap.h"
+#include "util/HashOfHash.h"
+#include "util/MemoryUsage.h"
+#include <deque>
+#include <functional>
+#include <set>
+#include <unordered_map>
 
 /**
  * FloodGate keeps track of which peers have sent us which broadcast messages,
@@ -14,11 +21,20 @@
  * either send M to P once (and only once), or receive M _from_ P (thereby
  * inhibit sending M to P at all).
  *
- * The broadcast message types are TRANSACTION and SCP_MESSAGE.
+ * The broadcast message types are TRANSACTION and SCP_MESSAGE. Peers in pull
+ * mode only get the hash of a TRANSACTION message (its index here), and
+ * demand the message if needed, see TxDemandsManager.
  *
  * All messages are marked with the ledger sequence number to which they
  * relate, and all flood-management information for a given ledger number
  * is purged from the FloodGate when the ledger closes.
+ *
+ * Records are kept small, as there is one per message flooded in the last
+ * few ledgers: message bodies are not kept past broadcasting (except for
+ * transactions that pull mode peers may still demand), and peers are
+ * tracked as bits, indexed by a slot assigned to each peer. Once purged,
+ * the hashes of the messages are still remembered by a bloom filter for a
+ * few more ledgers, see isSeen.
  */
 
 namespace medida
@@ -31,25 +47,37 @@ namespace stellar
 
 class Floodgate
 {
-    class FloodRecord
+    struct FloodRecord
     {
-      public:
-        typedef std::shared_ptr<FloodRecord> pointer;
-
         uint32_t mLedgerSeq;
-        StellarMessage mMessage;
-        std::set<Peer::pointer> mPeersTold;
-
-        FloodRecord(StellarMessage const& msg, uint32_t ledger,
-                    Peer::pointer peer);
+        // slots of the peers that sent us the message or were sent it
+        std::vector<bool> mPeersTold;
+        // only kept for transactions advertised to a peer
+        std::shared_ptr<StellarMessage const> mMessage;
     };
 
-    std::map<uint256, FloodRecord::pointer> mFloodMap;
+    FlatHashMap<Hash, FloodRecord> mFloodMap;
+
+    // the peer using each slot, slots of dropped peers can be reused once
+    // every record that may refer to them is gone
+    std::vector<std::weak_ptr<Peer>> mSlotPeers;
+    std::unordered_map<Peer*, size_t> mPeerSlots;
+    std::deque<std::pair<size_t, uint32_t>> mFreeSlots; // (slot, ledger)
+    uint32_t mLastClearedLedger{0};
+
+    // hashes of the messages purged by the last calls to clearBelow
+    std::deque<BloomFilter> mSeenFilters;
+
     Application& mApp;
     medida::Counter& mFloodMapSize;
     medida::Meter& mSendFromBroadcast;
     bool mShuttingDown;
 
+    // returns the slot of the peer, SIZE_MAX for no (or a dropped) peer
+    size_t getSlot(Peer::pointer const& peer);
+    static void setTold(FloodRecord& record, size_t slot);
+    static bool isTold(FloodRecord const& record, size_t slot);
+
   public:
     Floodgate(Application& app);
     // Floodgate will be cleared after every ledger close
@@ -57,7 +85,25 @@ class Floodgate
     // returns true if this is a new record
     bool addRecord(StellarMessage const& msg, Peer::pointer fromPeer);
 
-    void broadcast(StellarMessage const& msg, bool force);
+    // sends the message to the peers that were not told it yet, and again
+    // to the ones that were if `resendTo` returns true for them
+    void broadcast(StellarMessage const& msg, bool force,
+                   std::function<bool(Peer::pointer const&)> const& resendTo =
+                       nullptr);
+
+    // returns the transaction with hash `h` if it was advertised to a peer
+    // and is still around, nullptr otherwise
+    StellarMessage const* getMessage(Hash const& h) const;
+
+    // returns true if the message with hash `h` went through the Floodgate
+    // recently (may rarely return true for an unknown message)
+    bool isSeen(Hash const& h) const;
+
+    // the peer is gone, its slot can eventually be reused
+    void forgetPeer(Peer* peer);
+
+    // the records, the seen filters and the messages kept
+    MemoryUsage getMemoryUsage() const;
 
     // returns the list of peers that sent us the item with hash `h`
     std::set<Peer::pointer> getPeersKnows(Hash const& h);
@@ -18,8 +18,13 @@
 namespace stellar
 {
 
+// DONT_HAVE replies remembered, and for how long
+static size_t const MAX_DONT_HAVE_ENTRIES = 10000;
+static std::chrono::milliseconds const DONT_HAVE_TIME_TO_LIVE{3000};
+
 ItemFetcher::ItemFetcher(Application& app, AskPeer askPeer)
     : mApp(app)
+    , mDontHave(app.getClock(), MAX_DONT_HAVE_ENTRIES, DONT_HAVE_TIME_TO_LIVE)
     , mItemMapSize(
           app.getMetrics().NewCounter({"overlay", "memory", "item-fetch-map"}))
     , mAskPeer(askPeer)
@@ -34,7 +39,7 @@ ItemFetcher::fetch(Hash itemHash, const SCPEnvelope& envelope)
     if (entryIt == mTrackers.end())
     { // not being tracked
         TrackerPtr tracker =
-            std::make_shared<Tracker>(mApp, itemHash, mAskPeer);
+            std::make_shared<Tracker>(mApp, itemHash, mAskPeer, &mDontHave);
         mTrackers[itemHash] = tracker;
         mItemMapSize.inc();
 
@@ -109,23 +114,17 @@ ItemFetcher::stopFetchingBelow(uint64 slotIndex)
 void
 ItemFetcher::stopFetchingBelowInternal(uint64 slotIndex)
 {
-    for (auto iter = mTrackers.begin(); iter != mTrackers.end();)
-    {
-        if (!iter->second->clearEnvelopesBelow(slotIndex))
-        {
-            iter = mTrackers.erase(iter);
-            mItemMapSize.dec();
-        }
-        else
-        {
-            iter++;
-        }
-    }
+    auto erased = mTrackers.eraseIf(
+        [slotIndex](std::pair<Hash, std::shared_ptr<Tracker>> const& entry) {
+            return !entry.second->clearEnvelopesBelow(slotIndex);
+        });
+    mItemMapSize.dec(erased);
 }
 
 void
 ItemFetcher::doesntHave(Hash const& itemHash, Peer::pointer peer)
 {
+    mDontHave.add(peer->getPeerID(), itemHash);
     const auto& iter = mTrackers.find(itemHash);
     if (iter != mTrackers.end())
     {
@@ -133,6 +132,27 @@ ItemFetcher::doesntHave(Hash const& itemHash, Peer::pointer peer)
     }
 }
 
+MemoryUsage
+ItemFetcher::getMemoryUsage() const
+{
+    MemoryUsage res;
+    res.mBytes += mTrackers.capacity() *
+                  (sizeof(std::pair<Hash, TrackerPtr>) + sizeof(size_t));
+    for (auto const& kv : mTrackers)
+    {
+        auto const& tracker = *kv.second;
+        // with the control block of the shared_ptr
+        size_t bytes = sizeof(Tracker) + 2 * sizeof(void*);
+        for (auto const& e : tracker.waitingEnvelopes())
+        {
+            bytes += sizeof(Hash) + xdrMemoryUsage(e.second);
+        }
+        res.add(bytes);
+    }
+    res += mDontHave.getMemoryUsage();
+    return res;
+}
+
 void
 ItemFetcher::recv(Hash itemHash)
 {
@@ -142,8 +162,10 @@ ItemFetcher::recv(Hash itemHash)
     if (iter != mTrackers.end())
     {
         // this code can safely be called even if recvSCPEnvelope ends up
-        // calling recv on the same itemHash
-        auto& tracker = iter->second;
+        // calling recv on the same itemHash; the tracker is held as
+        // recvSCPEnvelope may also start fetching other items, which moves
+        // the entries of mTrackers
+        auto tracker = iter->second;
 
         CLOG(TRACE, "Overlay")
             << "Recv " << hexAbbrev(itemHash) << " : " << tracker->size();
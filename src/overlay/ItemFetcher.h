@@ -4,8 +4,11 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "overlay/DontHaveCache.h"
 #include "overlay/Peer.h"
+#include "util/FlatHashMap.h"
 #include "util/HashOfHash.h"
+#include "util/MemoryUsage.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
 #include <deque>
@@ -80,7 +83,8 @@ class ItemFetcher : private NonMovableOrCopyable
 
     /**
      * Called when given @p peer informs that it does not have data identified
-     * by @p itemHash.
+     * by @p itemHash. It is not asked for it again for a little while, even
+     * by a new tracker.
      */
     void doesntHave(Hash const& itemHash, Peer::pointer peer);
 
@@ -91,11 +95,16 @@ class ItemFetcher : private NonMovableOrCopyable
      */
     void recv(Hash itemHash);
 
+    // the trackers and the envelopes waiting for their items
+    MemoryUsage getMemoryUsage() const;
+
   protected:
     void stopFetchingBelowInternal(uint64 slotIndex);
 
     Application& mApp;
-    std::map<Hash, std::shared_ptr<Tracker>> mTrackers;
+    FlatHashMap<Hash, std::shared_ptr<Tracker>> mTrackers;
+    // the peers that recently did not have an item, shared by the trackers
+    DontHaveCache mDontHave;
 
     // NB: There are many ItemFetchers in the system at once, but we are sharing
     // a single counter for all the items being fetched by all of them. Be
@@ -5,6 +5,7 @@
 #include "util/asio.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "herder/HerderImpl.h"
 #include "lib/catch.hpp"
 #include "main/ApplicationImpl.h"
@@ -15,6 +16,9 @@
 #include "test/test.h"
 #include "xdr/Stellar-types.h"
 
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
 namespace stellar
 {
 
@@ -248,6 +252,49 @@ TEST_CASE("ItemFetcher fetches", "[overlay][ItemFetcher]")
             REQUIRE(std::count(asked.begin(), asked.end(), peer2) == 2);
         }
 
+        SECTION("asks peers at once for the current slot only")
+        {
+            auto other1 = createTestApplication(clock, getTestConfig(1));
+            auto other2 = createTestApplication(clock, getTestConfig(2));
+            LoopbackPeerConnection connection1(*app, *other1);
+            LoopbackPeerConnection connection2(*app, *other2);
+
+            auto zeroEnvelope = makeEnvelope(0);
+            size_t expectedAsked = 0;
+            SECTION("current slot")
+            {
+                zeroEnvelope.statement.slotIndex =
+                    app->getHerder().getCurrentLedgerSeq();
+                expectedAsked = 2;
+            }
+            SECTION("next slot")
+            {
+                zeroEnvelope.statement.slotIndex =
+                    app->getHerder().getCurrentLedgerSeq() + 1;
+                expectedAsked = 2;
+            }
+            SECTION("older slot")
+            {
+                zeroEnvelope.statement.slotIndex =
+                    app->getHerder().getCurrentLedgerSeq() - 1;
+                expectedAsked = 1;
+            }
+            SECTION("later slot, fetched ahead")
+            {
+                zeroEnvelope.statement.slotIndex =
+                    app->getHerder().getCurrentLedgerSeq() + 3;
+                expectedAsked = 1;
+            }
+            itemFetcher.fetch(zero, zeroEnvelope);
+
+            while (asked.empty())
+            {
+                clock.crank(true);
+            }
+            REQUIRE(asked.size() == expectedAsked);
+            REQUIRE(std::count(asked.begin(), asked.end(), asked[0]) == 1);
+        }
+
         SECTION("ignore not asked items")
         {
             itemFetcher.recv(zero);
@@ -256,4 +303,92 @@ TEST_CASE("ItemFetcher fetches", "[overlay][ItemFetcher]")
         }
     }
 }
+
+TEST_CASE("DontHaveCache", "[overlay][ItemFetcher]")
+{
+    VirtualClock clock;
+    DontHaveCache cache(clock, 3, std::chrono::milliseconds(1000));
+    auto peer1 = SecretKey::random().getPublicKey();
+    auto peer2 = SecretKey::random().getPublicKey();
+    auto item1 = sha256(ByteSlice("item1"));
+    auto item2 = sha256(ByteSlice("item2"));
+
+    cache.add(peer1, item1);
+    REQUIRE(cache.contains(peer1, item1));
+    REQUIRE(!cache.contains(peer2, item1));
+    REQUIRE(!cache.contains(peer1, item2));
+
+    SECTION("entries expire")
+    {
+        clock.setCurrentTime(clock.now() + std::chrono::milliseconds(500));
+        cache.add(peer2, item1);
+        clock.setCurrentTime(clock.now() + std::chrono::milliseconds(500));
+        REQUIRE(!cache.contains(peer1, item1));
+        REQUIRE(cache.contains(peer2, item1));
+        REQUIRE(cache.size() == 1);
+    }
+
+    SECTION("adding again extends the entry")
+    {
+        clock.setCurrentTime(clock.now() + std::chrono::milliseconds(500));
+        cache.add(peer1, item1);
+        clock.setCurrentTime(clock.now() + std::chrono::milliseconds(500));
+        REQUIRE(cache.contains(peer1, item1));
+        REQUIRE(cache.size() == 1);
+    }
+
+    SECTION("the oldest entries are dropped")
+    {
+        cache.add(peer1, item2);
+        cache.add(peer2, item1);
+        cache.add(peer2, item2);
+        REQUIRE(cache.size() == 3);
+        REQUIRE(!cache.contains(peer1, item1));
+        REQUIRE(cache.contains(peer2, item2));
+    }
+}
+
+TEST_CASE("ItemFetcher skips peers that do not have the item",
+          "[overlay][ItemFetcher]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig(0));
+    auto other1 = createTestApplication(clock, getTestConfig(1));
+    auto other2 = createTestApplication(clock, getTestConfig(2));
+    LoopbackPeerConnection connection1(*app, *other1);
+    LoopbackPeerConnection connection2(*app, *other2);
+    testutil::crankSome(clock);
+    auto peer1 = connection1.getInitiator();
+    auto peer2 = connection2.getInitiator();
+
+    std::vector<Peer::pointer> asked;
+    ItemFetcher itemFetcher(
+        *app, [&](Peer::pointer peer, Hash) { asked.push_back(peer); });
+
+    auto zero = sha256(ByteSlice("zero"));
+    auto envelope1 = makeEnvelope(0);
+    envelope1.statement.slotIndex = app->getHerder().getCurrentLedgerSeq() - 1;
+    itemFetcher.fetch(zero, envelope1);
+    REQUIRE(asked.size() == 1);
+    auto first = asked[0];
+    itemFetcher.doesntHave(zero, first);
+    REQUIRE(asked.size() == 2);
+    REQUIRE(asked[1] != first);
+
+    // a new tracker for the same item does not ask the first peer again
+    itemFetcher.stopFetch(zero, envelope1);
+    itemFetcher.stopFetchingBelow(envelope1.statement.slotIndex + 1);
+    testutil::crankSome(clock);
+    auto envelope2 = makeEnvelope(0);
+    envelope2.statement.slotIndex = envelope1.statement.slotIndex;
+    asked.clear();
+    itemFetcher.fetch(zero, envelope2);
+    REQUIRE(asked.size() == 1);
+    REQUIRE(asked[0] != first);
+    REQUIRE(app->getMetrics()
+                .NewMeter({"overlay", "item-fetcher", "dont-have-skip"},
+                          "item-fetcher")
+                .count() != 0);
+    REQUIRE((peer1 == first || peer2 == first));
+}
 }
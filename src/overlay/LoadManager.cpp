@@ -12,10 +12,15 @@
 #include "util/XDROperators.h"
 #include "util/types.h"
 
+#include <algorithm>
 #include <chrono>
 
 namespace stellar
 {
+
+// while shedding load, transaction rate limits are divided by this
+static uint32_t const SHED_TRANSACTION_RATE_DIVISOR = 4;
+
 LoadManager::LoadManager() : mPeerCosts(128)
 {
 }
@@ -88,6 +93,9 @@ LoadManager::maybeShedExcessLoad(Application& app)
     uint32_t idleClock = app.getClock().recentIdleCrankPercent();
     uint32_t idleDb = app.getDatabase().recentIdleDbPercent();
 
+    auto recentTransactions = mRecentTransactions;
+    mRecentTransactions = 0;
+
     if ((idleClock < minIdle) || (idleDb < minIdle))
     {
         CLOG(WARNING, "Overlay") << "";
@@ -100,6 +108,19 @@ LoadManager::maybeShedExcessLoad(Application& app)
         auto peers = app.getOverlayManager().getAuthenticatedPeers();
         reportLoads(peers, app);
 
+        if (!mShedTransactions && recentTransactions != 0)
+        {
+            // excess transactions go first, peers only get disconnected if
+            // that is not enough
+            CLOG(WARNING, "Overlay") << "Shedding transactions";
+            app.getMetrics()
+                .NewMeter({"overlay", "load-shed", "transactions"}, "event")
+                .Mark();
+            mShedTransactions = true;
+            app.getClock().resetIdleCrankPercent();
+            return;
+        }
+
         // Look for the worst-behaved of the current peers and kick them out.
         std::shared_ptr<Peer> victim;
         std::shared_ptr<LoadManager::PeerCosts> victimCost;
@@ -128,6 +149,87 @@ LoadManager::maybeShedExcessLoad(Application& app)
             app.getClock().resetIdleCrankPercent();
         }
     }
+    else if (mShedTransactions)
+    {
+        CLOG(INFO, "Overlay") << "No longer shedding transactions";
+        mShedTransactions = false;
+    }
+}
+
+bool
+LoadManager::TokenBucket::tryTake(double rate, VirtualClock::time_point now)
+{
+    if (!mStarted)
+    {
+        mStarted = true;
+        mTokens = rate;
+    }
+    else
+    {
+        auto elapsed = std::chrono::duration<double>(now - mLastRefill);
+        mTokens = std::min(rate, mTokens + elapsed.count() * rate);
+    }
+    mLastRefill = now;
+    if (mTokens < 1)
+    {
+        return false;
+    }
+    mTokens -= 1;
+    return true;
+}
+
+bool
+LoadManager::admitMessage(Application& app, NodeID const& peer,
+                          MessageType type)
+{
+    auto const& cfg = app.getConfig();
+    switch (type)
+    {
+    case TRANSACTION:
+    case FLOOD_ADVERT:
+    {
+        double rate = cfg.PEER_TRANSACTION_RATE_LIMIT;
+        if (mShedTransactions)
+        {
+            if (rate == 0)
+            {
+                rate = 0.5; // not even one per second
+            }
+            rate /= SHED_TRANSACTION_RATE_DIVISOR;
+        }
+        if (rate != 0 && !getPeerCosts(peer)->mTransactionTokens.tryTake(
+                             rate, app.getClock().now()))
+        {
+            app.getMetrics()
+                .NewMeter({"overlay", "rate-limit", "transaction"}, "message")
+                .Mark();
+            return false;
+        }
+        mRecentTransactions++;
+        return true;
+    }
+    case GET_PEERS:
+    case GET_TX_SET:
+    case GET_SCP_QUORUMSET:
+    case GET_SCP_STATE:
+    case FLOOD_DEMAND:
+    case GET_TX_SET_TXS:
+    case GET_SCP_STATE_DIFF:
+    {
+        double rate = cfg.PEER_REQUEST_RATE_LIMIT;
+        if (rate != 0 && !getPeerCosts(peer)->mRequestTokens.tryTake(
+                             rate, app.getClock().now()))
+        {
+            app.getMetrics()
+                .NewMeter({"overlay", "rate-limit", "request"}, "message")
+                .Mark();
+            return false;
+        }
+        return true;
+    }
+    default:
+        return true;
+    }
 }
 
 LoadManager::PeerCosts::PeerCosts()
@@ -36,6 +36,18 @@ class LoadManager
     // work, or to do more harm than good, it ought to be disabled/removed.
 
   public:
+    // Token bucket: tokens accumulate at `rate` per second, up to `rate` (a
+    // one second burst), and every admitted message takes one. Starts full.
+    class TokenBucket
+    {
+        double mTokens{0};
+        bool mStarted{false};
+        VirtualClock::time_point mLastRefill;
+
+      public:
+        bool tryTake(double rate, VirtualClock::time_point now);
+    };
+
     LoadManager();
     ~LoadManager();
     void reportLoads(std::map<NodeID, Peer::pointer> const& peers,
@@ -52,6 +64,8 @@ class LoadManager
         medida::Meter mBytesSend;
         medida::Meter mBytesRecv;
         medida::Meter mSQLQueries;
+        TokenBucket mTransactionTokens;
+        TokenBucket mRequestTokens;
     };
 
     std::shared_ptr<PeerCosts> getPeerCosts(NodeID const& peer);
@@ -59,12 +73,29 @@ class LoadManager
   private:
     cache::lru_cache<NodeID, std::shared_ptr<PeerCosts>> mPeerCosts;
 
+    // set while the system is overloaded and transactions are shed
+    bool mShedTransactions{false};
+    // transactions admitted since the last maybeShedExcessLoad
+    uint64_t mRecentTransactions{0};
+
   public:
     // Measure recent load on the system and, if the system appears
     // overloaded, shed one or more of the worst-behaved peers,
     // according to our local per-peer accounting.
+    // When peers send transactions, the first response to overload is to
+    // cut their transaction rate limit instead.
     void maybeShedExcessLoad(Application& app);
 
+    // Per peer rate limits, checked before handling a message from an
+    // authenticated peer: returns false if the message should be dropped.
+    bool admitMessage(Application& app, NodeID const& peer, MessageType type);
+
+    bool
+    isSheddingTransactions() const
+    {
+        return mShedTransactions;
+    }
+
     // Context manager for doing work on behalf of a node, we push
     // one of these on the stack. When destroyed it will debit the
     // peer in question with the cost.
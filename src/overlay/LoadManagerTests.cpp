@@ -2,6 +2,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "overlay/LoadManager.h"
 #include "overlay/LoopbackPeer.h"
 #include "overlay/OverlayManager.h"
 #include "test/TestUtils.h"
@@ -54,3 +55,31 @@ TEST_CASE("disconnect peer when overloaded", "[overlay][LoadManager]")
                 .NewMeter({"overlay", "drop", "load-shed"}, "drop")
                 .count() != 0);
 }
+
+TEST_CASE("token bucket", "[overlay][LoadManager]")
+{
+    VirtualClock clock;
+    auto now = clock.now();
+    LoadManager::TokenBucket bucket;
+
+    // starts with a one second burst
+    for (int i = 0; i < 10; i++)
+    {
+        REQUIRE(bucket.tryTake(10, now));
+    }
+    REQUIRE(!bucket.tryTake(10, now));
+
+    // refills at the given rate
+    now += std::chrono::milliseconds(250);
+    REQUIRE(bucket.tryTake(10, now));
+    REQUIRE(bucket.tryTake(10, now));
+    REQUIRE(!bucket.tryTake(10, now));
+
+    // up to the burst size
+    now += std::chrono::seconds(10);
+    for (int i = 0; i < 10; i++)
+    {
+        REQUIRE(bucket.tryTake(10, now));
+    }
+    REQUIRE(!bucket.tryTake(10, now));
+}
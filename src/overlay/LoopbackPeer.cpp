@@ -13,6 +13,7 @@
 #include "overlay/StellarXDR.h"
 #include "util/Logging.h"
 #include "xdrpp/marshal.h"
+#include <cmath>
 
 namespace stellar
 {
@@ -23,7 +24,8 @@ using namespace std;
 // LoopbackPeer
 ///////////////////////////////////////////////////////////////////////
 
-LoopbackPeer::LoopbackPeer(Application& app, PeerRole role) : Peer(app, role)
+LoopbackPeer::LoopbackPeer(Application& app, PeerRole role)
+    : Peer(app, role), mArrivalTimer(app)
 {
 }
 
@@ -86,6 +88,8 @@ LoopbackPeer::drop(bool)
     }
     mState = CLOSING;
     mIdleTimer.cancel();
+    mArrivalTimer.cancel();
+    mInFlight.clear();
     getApp().getOverlayManager().dropPeer(this);
 
     auto remote = mRemote.lock();
@@ -198,16 +202,13 @@ LoopbackPeer::deliverOne()
         size_t nBytes = msg->raw_size();
         mStats.bytesDelivered += nBytes;
 
-        // Pass ownership of a serialized XDR message buffer to a recvMesage
-        // callback event against the remote Peer, posted on the remote
-        // Peer's io_service.
-        auto remote = mRemote.lock();
-        if (remote)
+        if (hasLinkModel())
         {
-            // move msg to remote's in queue
-            remote->mInQueue.emplace(std::move(msg));
-            remote->getApp().getClock().getIOService().post(
-                [remote]() { remote->processInQueue(); });
+            transmit(std::move(msg));
+        }
+        else
+        {
+            deliverToRemote(std::move(msg));
         }
         LoadManager::PeerContext loadCtx(mApp, mPeerID);
         mLastWrite = mApp.getClock().now();
@@ -218,6 +219,102 @@ LoopbackPeer::deliverOne()
     }
 }
 
+void
+LoopbackPeer::deliverToRemote(xdr::msg_ptr&& msg)
+{
+    // Pass ownership of a serialized XDR message buffer to a recvMesage
+    // callback event against the remote Peer, posted on the remote
+    // Peer's io_service.
+    auto remote = mRemote.lock();
+    if (remote)
+    {
+        // move msg to remote's in queue
+        remote->mInQueue.emplace(std::move(msg));
+        remote->getApp().getClock().getIOService().post(
+            [remote]() { remote->processInQueue(); });
+    }
+}
+
+bool
+LoopbackPeer::hasLinkModel() const
+{
+    return mLatency.count() != 0 || mJitter.count() != 0 ||
+           mBytesPerSecond != 0 || mLossProb.p() != 0.0;
+}
+
+void
+LoopbackPeer::transmit(xdr::msg_ptr&& msg)
+{
+    auto now = mApp.getClock().now();
+    auto sent = std::max(now, mLinkFreeAt);
+    mStats.queueingDelay += sent - now;
+    if (mBytesPerSecond != 0)
+    {
+        sent += std::chrono::duration_cast<VirtualClock::duration>(
+            std::chrono::duration<double>(static_cast<double>(msg->raw_size()) /
+                                          mBytesPerSecond));
+    }
+    // the retransmission timeout of TCP, at least 200ms
+    auto rto = std::max<VirtualClock::duration>(std::chrono::milliseconds(200),
+                                                2 * mLatency);
+    while (mLossProb(mGenerator))
+    {
+        mStats.messagesRetransmitted++;
+        sent += rto;
+    }
+    mLinkFreeAt = sent;
+
+    auto arrival = sent + mLatency;
+    if (mJitter.count() != 0)
+    {
+        std::normal_distribution<double> jitter(
+            0.0, static_cast<double>(mJitter.count()));
+        arrival += std::chrono::microseconds(
+            std::llround(std::abs(jitter(mGenerator))));
+    }
+    if (!mInFlight.empty())
+    {
+        arrival = std::max(arrival, mInFlight.back().first);
+    }
+    mInFlight.emplace_back(arrival, std::move(msg));
+    if (mInFlight.size() == 1)
+    {
+        scheduleArrival();
+    }
+}
+
+void
+LoopbackPeer::scheduleArrival()
+{
+    std::weak_ptr<LoopbackPeer> weak =
+        static_pointer_cast<LoopbackPeer>(shared_from_this());
+    mArrivalTimer.expires_at(mInFlight.front().first);
+    mArrivalTimer.async_wait(
+        [weak]() {
+            auto self = weak.lock();
+            if (self)
+            {
+                self->arrive();
+            }
+        },
+        &VirtualTimer::onFailureNoop);
+}
+
+void
+LoopbackPeer::arrive()
+{
+    auto now = mApp.getClock().now();
+    while (!mInFlight.empty() && mInFlight.front().first <= now)
+    {
+        deliverToRemote(std::move(mInFlight.front().second));
+        mInFlight.pop_front();
+    }
+    if (!mInFlight.empty())
+    {
+        scheduleArrival();
+    }
+}
+
 void
 LoopbackPeer::deliverAll()
 {
@@ -250,6 +347,12 @@ LoopbackPeer::getMessagesQueued() const
     return mOutQueue.size();
 }
 
+size_t
+LoopbackPeer::getMessagesInFlight() const
+{
+    return mInFlight.size();
+}
+
 LoopbackPeer::Stats const&
 LoopbackPeer::getStats() const
 {
@@ -365,6 +468,60 @@ LoopbackPeer::setReorderProbability(double d)
     mReorderProb = bernoulli_distribution(d);
 }
 
+std::chrono::microseconds
+LoopbackPeer::getLatency() const
+{
+    return mLatency;
+}
+
+void
+LoopbackPeer::setLatency(std::chrono::microseconds latency)
+{
+    mLatency = latency;
+}
+
+std::chrono::microseconds
+LoopbackPeer::getJitter() const
+{
+    return mJitter;
+}
+
+void
+LoopbackPeer::setJitter(std::chrono::microseconds jitter)
+{
+    mJitter = jitter;
+}
+
+uint64_t
+LoopbackPeer::getBandwidth() const
+{
+    return mBytesPerSecond;
+}
+
+void
+LoopbackPeer::setBandwidth(uint64_t bytesPerSecond)
+{
+    mBytesPerSecond = bytesPerSecond;
+}
+
+double
+LoopbackPeer::getLossProbability() const
+{
+    return mLossProb.p();
+}
+
+void
+LoopbackPeer::setLossProbability(double d)
+{
+    checkProbRange(d);
+    if (d == 1.0)
+    {
+        // every retransmission would be lost too
+        throw std::runtime_error("loss probability must be below 1");
+    }
+    mLossProb = bernoulli_distribution(d);
+}
+
 LoopbackPeerConnection::LoopbackPeerConnection(Application& initiator,
                                                Application& acceptor)
     : mInitiator(make_shared<LoopbackPeer>(initiator, Peer::WE_CALLED_REMOTE))
@@ -5,6 +5,8 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "overlay/Peer.h"
+#include "util/Timer.h"
+#include <chrono>
 #include <deque>
 #include <random>
 
@@ -39,12 +41,30 @@ class LoopbackPeer : public Peer
     std::bernoulli_distribution mDamageProb{0.0};
     std::bernoulli_distribution mDropProb{0.0};
 
+    // Link model: a message arrives mLatency, plus a random jitter of
+    // half-normal distribution of scale mJitter, after the link has
+    // transmitted it, and the link transmits mBytesPerSecond (unlimited if 0)
+    // one message at a time, queueing the others. Messages in flight arrive
+    // in order: like TCP, a lost packet (mLossProb) is retransmitted after a
+    // timeout, holding back the messages behind it, rather than dropped (see
+    // mDropProb).
+    std::chrono::microseconds mLatency{0};
+    std::chrono::microseconds mJitter{0};
+    uint64_t mBytesPerSecond{0};
+    std::bernoulli_distribution mLossProb{0.0};
+    VirtualClock::time_point mLinkFreeAt;
+    std::deque<std::pair<VirtualClock::time_point, xdr::msg_ptr>> mInFlight;
+    VirtualTimer mArrivalTimer;
+
     struct Stats
     {
         size_t messagesDuplicated{0};
         size_t messagesReordered{0};
         size_t messagesDamaged{0};
         size_t messagesDropped{0};
+        size_t messagesRetransmitted{0};
+        // time messages waited for the link to transmit the previous ones
+        std::chrono::nanoseconds queueingDelay{0};
 
         size_t bytesDelivered{0};
         size_t messagesDelivered{0};
@@ -57,6 +77,11 @@ class LoopbackPeer : public Peer
     AuthCert getAuthCert() override;
 
     void processInQueue();
+    bool hasLinkModel() const;
+    void transmit(xdr::msg_ptr&& msg);
+    void scheduleArrival();
+    void arrive();
+    void deliverToRemote(xdr::msg_ptr&& msg);
 
   public:
     virtual ~LoopbackPeer()
@@ -70,6 +95,7 @@ class LoopbackPeer : public Peer
     void dropAll();
     size_t getBytesQueued() const;
     size_t getMessagesQueued() const;
+    size_t getMessagesInFlight() const;
 
     Stats const& getStats() const;
     std::deque<xdr::msg_ptr>& getQueue();
@@ -99,6 +125,18 @@ class LoopbackPeer : public Peer
     double getReorderProbability() const;
     void setReorderProbability(double d);
 
+    std::chrono::microseconds getLatency() const;
+    void setLatency(std::chrono::microseconds latency);
+
+    std::chrono::microseconds getJitter() const;
+    void setJitter(std::chrono::microseconds jitter);
+
+    uint64_t getBandwidth() const;
+    void setBandwidth(uint64_t bytesPerSecond);
+
+    double getLossProbability() const;
+    void setLossProbability(double d);
+
     using Peer::sendAuth;
 
     friend class LoopbackPeerConnection;
@@ -0,0 +1,119 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/MessageCompression.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace stellar
+{
+
+namespace
+{
+size_t const CHUNK_SIZE = 64 * 1024;
+}
+
+MessageDeflater::MessageDeflater() : mStream(new z_stream{})
+{
+    // fast compression, the window is what matters for these streams
+    if (deflateInit2(mStream.get(), 1, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+}
+
+MessageDeflater::~MessageDeflater()
+{
+    deflateEnd(mStream.get());
+}
+
+void
+MessageDeflater::deflate(uint8_t const* data, size_t size,
+                         xdr::opaque_vec<>& out)
+{
+    mStream->next_in = const_cast<Bytef*>(data);
+    mStream->avail_in = static_cast<uInt>(size);
+    // a sync flush outputs all of the message, ending on a byte boundary,
+    // and keeps the window for the next ones
+    out.resize(deflateBound(mStream.get(), mStream->avail_in) + 16);
+    size_t written = 0;
+    int ret;
+    do
+    {
+        if (written == out.size())
+        {
+            out.resize(out.size() + CHUNK_SIZE);
+        }
+        mStream->next_out = out.data() + written;
+        mStream->avail_out = static_cast<uInt>(out.size() - written);
+        ret = ::deflate(mStream.get(), Z_SYNC_FLUSH);
+        written = out.size() - mStream->avail_out;
+    } while (ret == Z_OK && mStream->avail_out == 0);
+    // Z_BUF_ERROR: called again with nothing left to output
+    if (mStream->avail_in != 0 || (ret != Z_OK && ret != Z_BUF_ERROR))
+    {
+        throw std::runtime_error("deflate failed");
+    }
+    out.resize(written);
+}
+
+MessageInflater::MessageInflater() : mStream(new z_stream{})
+{
+    if (inflateInit2(mStream.get(), -MAX_WBITS) != Z_OK)
+    {
+        throw std::runtime_error("inflateInit2 failed");
+    }
+}
+
+MessageInflater::~MessageInflater()
+{
+    inflateEnd(mStream.get());
+}
+
+bool
+MessageInflater::inflate(xdr::opaque_vec<> const& in,
+                         std::vector<uint8_t>& out)
+{
+    mStream->next_in = const_cast<Bytef*>(in.data());
+    mStream->avail_in = static_cast<uInt>(in.size());
+    out.resize(std::min(MAX_DECOMPRESSED_MESSAGE_SIZE,
+                        std::max(CHUNK_SIZE, 4 * in.size())));
+    size_t written = 0;
+    while (true)
+    {
+        if (written == out.size())
+        {
+            if (out.size() == MAX_DECOMPRESSED_MESSAGE_SIZE)
+            {
+                return false;
+            }
+            out.resize(std::min(MAX_DECOMPRESSED_MESSAGE_SIZE, 2 * out.size()));
+        }
+        mStream->next_out = out.data() + written;
+        mStream->avail_out = static_cast<uInt>(out.size() - written);
+        int ret = ::inflate(mStream.get(), Z_SYNC_FLUSH);
+        written = out.size() - mStream->avail_out;
+        // the stream is never finished: Z_STREAM_END is corrupt data too
+        if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            return false;
+        }
+        if (mStream->avail_out != 0)
+        {
+            // with room left, all of the input must have been used
+            if (mStream->avail_in != 0)
+            {
+                return false;
+            }
+            break;
+        }
+    }
+    out.resize(written);
+    return true;
+}
+}
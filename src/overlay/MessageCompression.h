@@ -0,0 +1,58 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "xdrpp/types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct z_stream_s;
+
+namespace stellar
+{
+
+// Compression of the messages of a connection (AuthenticatedMessage v1):
+// each direction is a single raw deflate stream, flushed at the end of every
+// message, so that a message is compressed with the ones sent before it as
+// dictionary (consecutive transaction sets or floods share most of their
+// accounts and assets). Both ends must handle the compressed messages in
+// the order they were sent.
+
+// smaller messages (most SCP messages) are sent as they are
+size_t const MIN_COMPRESSED_MESSAGE_SIZE = 1024;
+// the most a compressed message may inflate to
+size_t const MAX_DECOMPRESSED_MESSAGE_SIZE = 0x1000000;
+
+class MessageDeflater : NonMovableOrCopyable
+{
+    std::unique_ptr<z_stream_s> mStream;
+
+  public:
+    MessageDeflater();
+    ~MessageDeflater();
+
+    // compresses the @p size bytes at @p data to @p out; throws
+    // std::runtime_error
+    void deflate(uint8_t const* data, size_t size, xdr::opaque_vec<>& out);
+};
+
+class MessageInflater : NonMovableOrCopyable
+{
+    std::unique_ptr<z_stream_s> mStream;
+
+  public:
+    MessageInflater();
+    ~MessageInflater();
+
+    // decompresses a message compressed by MessageDeflater to @p out;
+    // returns false if it is corrupt or inflates to more than
+    // MAX_DECOMPRESSED_MESSAGE_SIZE, after which the stream is unusable
+    bool inflate(xdr::opaque_vec<> const& in, std::vector<uint8_t>& out);
+};
+}
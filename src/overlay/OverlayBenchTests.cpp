@@ -0,0 +1,411 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Throughput benchmarks of the overlay: 2 to 8 nodes, fully connected by
+// TCPPeers over localhost, flood synthetic transactions (pushed or pulled)
+// or SCP messages. They are hidden; run them with
+// `stellar-core --test [overlaybench]`. Each run appends one row per
+// network and message kind to a nodes-vs-...csv file in the current
+// directory, see ScaleReporter. The [perf] one records its measurements to
+// the perf results, see PerfResults.
+//
+// The nodes run with MANUAL_CLOSE, so that the herder drops the SCP
+// messages as soon as they are received, and no ledger closes: what is
+// measured is the overlay, and for transactions the validation needed to
+// flood them. All the nodes run in this process, the CPU time reported is
+// that of the process (all the nodes and their worker threads) per message
+// flooded.
+
+#include "crypto/SHA.h"
+#include "crypto/XDRHasher.h"
+#include "herder/Herder.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/LedgerDelta.h"
+#include "lib/catch.hpp"
+#include "main/Config.h"
+#include "overlay/OverlayManagerImpl.h"
+#include "overlay/PeerBareAddress.h"
+#include "test/PerfResults.h"
+#include "test/ScaleReporter.h"
+#include "test/TestAccount.h"
+#include "test/TestUtils.h"
+#include "test/TxTests.h"
+#include "test/test.h"
+#include "util/HashOfHash.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+#include "xdrpp/marshal.h"
+
+#include "medida/meter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+// messages flooded by each run, spread over the nodes
+size_t const MESSAGES = 2000;
+// messages broadcast at once, and at most in flight (not yet received by
+// all the other nodes)
+size_t const BATCH = 50;
+size_t const WINDOW = 200;
+
+enum class Kind
+{
+    TX_PUSH,
+    TX_PULL,
+    SCP
+};
+
+class BenchOverlayManager;
+
+// the first broadcast of each message, and the latency of each of its
+// receptions, shared by the nodes of a run
+struct FloodTimes
+{
+    struct Broadcast
+    {
+        Clock::time_point mTime;
+        BenchOverlayManager const* mOrigin;
+    };
+    std::unordered_map<Hash, Broadcast> mBroadcasts;
+    // microseconds
+    std::vector<double> mLatencies;
+};
+
+// notes when each message broadcast by the bench reaches recvFloodedMsg
+class BenchOverlayManager : public OverlayManagerImpl
+{
+    FloodTimes* mTimes{nullptr};
+    std::unordered_set<Hash> mReceived;
+
+  public:
+    BenchOverlayManager(Application& app) : OverlayManagerImpl(app)
+    {
+    }
+
+    void
+    setFloodTimes(FloodTimes& times)
+    {
+        mTimes = &times;
+    }
+
+    bool
+    recvFloodedMsg(StellarMessage const& msg, Peer::pointer peer) override
+    {
+        auto res = OverlayManagerImpl::recvFloodedMsg(msg, peer);
+        auto now = Clock::now();
+        auto it = mTimes->mBroadcasts.find(xdrSha256(msg));
+        if (it != mTimes->mBroadcasts.end() && it->second.mOrigin != this &&
+            mReceived.insert(it->first).second)
+        {
+            mTimes->mLatencies.emplace_back(
+                std::chrono::duration<double, std::micro>(now -
+                                                          it->second.mTime)
+                    .count());
+        }
+        return res;
+    }
+
+    // broadcasts @p msg as its origin
+    void
+    originate(StellarMessage const& msg)
+    {
+        mTimes->mBroadcasts[xdrSha256(msg)] = {Clock::now(), this};
+        broadcastMessage(msg, true);
+    }
+};
+
+class BenchApplication : public TestApplication
+{
+  public:
+    BenchApplication(VirtualClock& clock, Config const& cfg)
+        : TestApplication(clock, cfg)
+    {
+    }
+
+    virtual BenchOverlayManager&
+    getOverlayManager() override
+    {
+        auto& overlay = ApplicationImpl::getOverlayManager();
+        return static_cast<BenchOverlayManager&>(overlay);
+    }
+
+  private:
+    virtual std::unique_ptr<OverlayManager>
+    createOverlayManager() override
+    {
+        return std::make_unique<BenchOverlayManager>(*this);
+    }
+};
+
+double
+percentile(std::vector<double> sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1,
+                           static_cast<size_t>(p * sorted.size()))];
+}
+
+class OverlayBench
+{
+    // declared before the nodes, to outlive them
+    FloodTimes mTimes;
+    std::vector<std::unique_ptr<VirtualClock>> mClocks;
+    std::vector<std::shared_ptr<BenchApplication>> mNodes;
+    // the messages of each node to flood
+    std::vector<std::vector<StellarMessage>> mMessages;
+
+  public:
+    OverlayBench(size_t nNodes, Kind kind)
+    {
+        for (size_t i = 0; i < nNodes; i++)
+        {
+            auto cfg = getTestConfig(static_cast<int>(i));
+            cfg.RUN_STANDALONE = false;
+            cfg.MANUAL_CLOSE = true;
+            cfg.PULL_MODE_TX_FLOODING = kind == Kind::TX_PULL;
+            mClocks.emplace_back(
+                std::make_unique<VirtualClock>(VirtualClock::REAL_TIME));
+            mNodes.emplace_back(
+                createTestApplication<BenchApplication>(*mClocks.back(), cfg));
+            mNodes.back()->getOverlayManager().setFloodTimes(mTimes);
+        }
+        mMessages.resize(nNodes);
+        if (kind == Kind::SCP)
+        {
+            makeEnvelopes();
+        }
+        else
+        {
+            makeTransactions();
+        }
+
+        for (auto& node : mNodes)
+        {
+            node->start();
+        }
+        for (size_t i = 0; i < nNodes; i++)
+        {
+            for (size_t j = i + 1; j < nNodes; j++)
+            {
+                mNodes[i]->getOverlayManager().connectTo(PeerBareAddress{
+                    "127.0.0.1", mNodes[j]->getConfig().PEER_PORT});
+            }
+        }
+        crankUntil([&]() {
+            return std::all_of(mNodes.begin(), mNodes.end(), [&](auto& n) {
+                return n->getOverlayManager().getAuthenticatedPeersCount() ==
+                       static_cast<int>(nNodes - 1);
+            });
+        });
+    }
+
+    ~OverlayBench()
+    {
+        for (auto& node : mNodes)
+        {
+            node->gracefulStop();
+        }
+        while (crank() > 0)
+            ;
+    }
+
+    // floods the messages of all the nodes and returns: messages per
+    // second, bytes written per second, CPU microseconds per message, and
+    // latency to the other nodes (median, 99th percentile and max) in
+    // microseconds
+    std::vector<double>
+    run()
+    {
+        size_t nNodes = mNodes.size();
+        size_t total = 0;
+        for (auto const& msgs : mMessages)
+        {
+            total += msgs.size();
+        }
+
+        auto bytesWritten = [&]() {
+            uint64_t bytes = 0;
+            for (auto& node : mNodes)
+            {
+                bytes += Peer::getByteWriteMeter(*node).count();
+            }
+            return bytes;
+        };
+        auto bytesBefore = bytesWritten();
+        auto cpuBefore = std::clock();
+        auto start = Clock::now();
+
+        // tops up the messages in flight, true once all were received
+        size_t sent = 0;
+        auto done = [&]() {
+            auto expected = sent * (nNodes - 1);
+            if (expected < mTimes.mLatencies.size() + WINDOW * (nNodes - 1) &&
+                sent < total)
+            {
+                for (size_t i = 0; i < BATCH && sent < total; i++, sent++)
+                {
+                    auto& node = mNodes[sent % nNodes];
+                    auto const& msgs = mMessages[sent % nNodes];
+                    node->getOverlayManager().originate(msgs[sent / nNodes]);
+                }
+            }
+            return mTimes.mLatencies.size() == total * (nNodes - 1);
+        };
+        crankUntil(done);
+
+        auto elapsed =
+            std::chrono::duration<double>(Clock::now() - start).count();
+        auto cpu = static_cast<double>(std::clock() - cpuBefore) /
+                   CLOCKS_PER_SEC;
+        auto bytes = bytesWritten() - bytesBefore;
+
+        auto latencies = mTimes.mLatencies;
+        std::sort(latencies.begin(), latencies.end());
+        return {total / elapsed, bytes / elapsed, cpu * 1e6 / total,
+                percentile(latencies, 0.5), percentile(latencies, 0.99),
+                latencies.back()};
+    }
+
+  private:
+    size_t
+    crank()
+    {
+        size_t count = 0;
+        for (auto& clock : mClocks)
+        {
+            count += clock->crank(false);
+        }
+        return count;
+    }
+
+    template <typename F>
+    void
+    crankUntil(F const& done)
+    {
+        auto timeout = Clock::now() + std::chrono::seconds(120);
+        while (!done())
+        {
+            REQUIRE(Clock::now() < timeout);
+            if (crank() == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    }
+
+    // nominations of distinct values from each node, for the next slot
+    void
+    makeEnvelopes()
+    {
+        for (size_t i = 0; i < MESSAGES; i++)
+        {
+            auto& node = *mNodes[i % mNodes.size()];
+            auto const& key = node.getConfig().NODE_SEED;
+            StellarMessage msg;
+            msg.type(SCP_MESSAGE);
+            auto& envelope = msg.envelope();
+            envelope.statement.nodeID = key.getPublicKey();
+            envelope.statement.slotIndex = 2;
+            envelope.statement.pledges.type(SCP_ST_NOMINATE);
+            auto& nom = envelope.statement.pledges.nominate();
+            nom.quorumSetHash =
+                sha256(xdr::xdr_to_opaque(node.getConfig().QUORUM_SET));
+            nom.votes.emplace_back(xdr::xdr_to_opaque(
+                sha256("OVERLAY_BENCH_VALUE_" + std::to_string(i))));
+            envelope.signature = key.sign(xdr::xdr_to_opaque(
+                node.getNetworkID(), ENVELOPE_TYPE_SCP, envelope.statement));
+            mMessages[i % mNodes.size()].emplace_back(msg);
+        }
+    }
+
+    // payments from one account per transaction, the accounts (clones of
+    // the root account) being created directly on all the nodes
+    void
+    makeTransactions()
+    {
+        auto& app0 = *mNodes[0];
+        auto root = TestAccount::createRoot(app0);
+        auto rootA =
+            AccountFrame::loadAccount(root.getPublicKey(), app0.getDatabase());
+        LedgerEntry gen(rootA->mEntry);
+        auto seq = gen.data.account().seqNum + 1;
+        for (size_t i = 0; i < MESSAGES; i++)
+        {
+            auto key = SecretKey::fromSeed(
+                sha256("OVERLAY_BENCH_ACCOUNT_" + std::to_string(i)));
+            gen.data.account().accountID = key.getPublicKey();
+            auto account = EntryFrame::FromXDR(gen);
+            for (auto& node : mNodes)
+            {
+                LedgerHeader lh;
+                auto& db = node->getDatabase();
+                LedgerDelta delta(lh, db, false);
+                account->storeAdd(delta, db);
+            }
+
+            auto& origin = *mNodes[i % mNodes.size()];
+            auto tx = TestAccount{origin, key}.tx(
+                {payment(root.getPublicKey(), 1)}, seq);
+            REQUIRE(origin.getHerder().recvTransaction(tx) ==
+                    Herder::TX_STATUS_PENDING);
+            mMessages[i % mNodes.size()].emplace_back(tx->toStellarMessage());
+        }
+    }
+};
+}
+
+TEST_CASE("overlay flooding bench", "[overlaybench][!hide]")
+{
+    ScaleReporter r({"nodes", "kind", "msgpersec", "bytespersec",
+                     "cpuuspermsg", "latencyp50us", "latencyp99us",
+                     "latencymaxus"});
+    // kind: 0 for pushed transactions, 1 for pulled ones, 2 for SCP
+    for (size_t nodes : {2, 4, 8})
+    {
+        for (auto kind : {Kind::TX_PUSH, Kind::TX_PULL, Kind::SCP})
+        {
+            CLOG(INFO, "Overlay") << "Benchmarking " << nodes << " nodes, kind "
+                                  << static_cast<int>(kind);
+            std::vector<double> row{static_cast<double>(nodes),
+                                    static_cast<double>(kind)};
+            auto res = OverlayBench(nodes, kind).run();
+            row.insert(row.end(), res.begin(), res.end());
+            r.write(row);
+        }
+    }
+}
+
+TEST_CASE("overlay flooding perf", "[overlaybench][perf][!hide]")
+{
+    for (auto kind : {Kind::TX_PUSH, Kind::SCP})
+    {
+        auto name = std::string("overlay.") +
+                    (kind == Kind::SCP ? "scp" : "transaction");
+        for (int i = 0; i < getPerfRuns(); i++)
+        {
+            auto res = OverlayBench(4, kind).run();
+            recordPerfSample(name, "messages/s",
+                             PerfDirection::HIGHER_IS_BETTER, res[0]);
+            recordPerfSample(name + ".cpu", "us/message",
+                             PerfDirection::LOWER_IS_BETTER, res[2]);
+            recordPerfSample(name + ".latency.p50", "us",
+                             PerfDirection::LOWER_IS_BETTER, res[3]);
+        }
+    }
+}
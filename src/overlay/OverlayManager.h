@@ -6,6 +6,7 @@
 
 #include "overlay/Peer.h"
 #include "overlay/StellarXDR.h"
+#include "util/MemoryUsage.h"
 
 /**
  * OverlayManager maintains a virtual broadcast network, consisting of a set of
@@ -50,6 +51,7 @@ class PeerAuth;
 class PeerBareAddress;
 class PeerRecord;
 class LoadManager;
+class TxDemandsManager;
 
 class OverlayManager
 {
@@ -69,11 +71,18 @@ class OverlayManager
     virtual void broadcastMessage(StellarMessage const& msg,
                                   bool force = false) = 0;
 
+    // Same, sending the message again to the peers that were already sent it
+    // (or sent it to us) when `resendTo` returns true for them.
+    virtual void
+    rebroadcastMessage(StellarMessage const& msg,
+                       std::function<bool(Peer::pointer const&)> resendTo) = 0;
+
     // Make a note in the FloodGate that a given peer has provided us with a
     // given broadcast message, so that it is inhibited from being resent to
     // that peer. This does _not_ cause the message to be broadcast anew; to do
-    // that, call broadcastMessage, above.
-    virtual void recvFloodedMsg(StellarMessage const& msg,
+    // that, call broadcastMessage, above. Returns true if the message was not
+    // known yet.
+    virtual bool recvFloodedMsg(StellarMessage const& msg,
                                 Peer::pointer peer) = 0;
 
     // Return a list of random peers from the set of authenticated peers.
@@ -128,12 +137,18 @@ class OverlayManager
     // returns the list of peers that sent us the item with hash `h`
     virtual std::set<Peer::pointer> getPeersKnows(Hash const& h) = 0;
 
+    // adds the memory held by the overlay to @p report
+    virtual void addMemoryUsage(MemoryUsageReport& report) const = 0;
+
     // Return the persistent p2p authentication-key cache.
     virtual PeerAuth& getPeerAuth() = 0;
 
     // Return the persistent peer-load-accounting cache.
     virtual LoadManager& getLoadManager() = 0;
 
+    // Return the tracker of transactions demanded by pull mode flooding.
+    virtual TxDemandsManager& getTxDemandsManager() = 0;
+
     // start up all background tasks for overlay
     virtual void start() = 0;
     // drops all connections
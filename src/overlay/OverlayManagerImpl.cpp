@@ -10,8 +10,10 @@
 #include "main/Config.h"
 #include "overlay/PeerBareAddress.h"
 #include "overlay/PeerRecord.h"
+#include "overlay/PeerTable.h"
 #include "overlay/TCPPeer.h"
 #include "util/Logging.h"
+#include "util/Math.h"
 #include "util/XDROperators.h"
 
 #include "medida/counter.h"
@@ -50,6 +52,9 @@ namespace stellar
 using namespace soci;
 using namespace std;
 
+// how many peers from the database compete for each connection to open
+static size_t const CANDIDATE_PEERS_PER_CONNECTION = 2;
+
 std::unique_ptr<OverlayManager>
 OverlayManager::create(Application& app)
 {
@@ -73,12 +78,15 @@ OverlayManagerImpl::OverlayManagerImpl(Application& app)
           {"overlay", "connection", "drop"}, "connection"))
     , mConnectionsRejected(app.getMetrics().NewMeter(
           {"overlay", "connection", "reject"}, "connection"))
+    , mPeersFlushed(app.getMetrics().NewMeter({"overlay", "peers", "flush"},
+                                              "peer"))
     , mPendingPeersSize(
           app.getMetrics().NewCounter({"overlay", "memory", "pending-peers"}))
     , mAuthenticatedPeersSize(app.getMetrics().NewCounter(
           {"overlay", "memory", "authenticated-peers"}))
     , mTimer(app)
     , mFloodGate(app)
+    , mTxDemands(app, mFloodGate)
 {
 }
 
@@ -235,6 +243,11 @@ OverlayManagerImpl::getPeersToConnectTo(int maxNum)
     // batch is how many peers to load from the database every time
     const int batchSize = std::max(50, maxNum);
 
+    // peers are picked among more candidates than needed, the ones expected
+    // to be the fastest win
+    const size_t candidates =
+        static_cast<size_t>(maxNum) * CANDIDATE_PEERS_PER_CONNECTION;
+
     std::vector<PeerRecord> peers;
 
     PeerRecord::loadPeerRecords(
@@ -246,8 +259,18 @@ OverlayManagerImpl::getPeersToConnectTo(int maxNum)
             {
                 peers.emplace_back(pr);
             }
-            return peers.size() < static_cast<size_t>(maxNum);
+            return peers.size() < candidates;
         });
+
+    std::stable_sort(peers.begin(), peers.end(),
+                     [](PeerRecord const& x, PeerRecord const& y) {
+                         return x.getExpectedFetchTime() <
+                                y.getExpectedFetchTime();
+                     });
+    if (peers.size() > static_cast<size_t>(maxNum))
+    {
+        peers.erase(peers.begin() + maxNum, peers.end());
+    }
     return peers;
 }
 
@@ -306,6 +329,8 @@ OverlayManagerImpl::tick()
         connectToMorePeers(peers);
     }
 
+    flushPeerTable();
+
     mTimer.expires_from_now(
         std::chrono::seconds(mApp.getConfig().PEER_AUTHENTICATION_TIMEOUT + 1));
     mTimer.async_wait([this]() { this->tick(); }, VirtualTimer::onFailureNoop);
@@ -370,6 +395,8 @@ void
 OverlayManagerImpl::dropPeer(Peer* peer)
 {
     mConnectionsDropped.Mark();
+    mFloodGate.forgetPeer(peer);
+    peer->storeNetworkEstimatesInPeerRecord();
     CLOG(INFO, "Overlay") << "Dropping peer "
                           << mApp.getConfig().toShortString(peer->getPeerID())
                           << "@" << peer->toString();
@@ -520,16 +547,16 @@ OverlayManagerImpl::getRandomAuthenticatedPeers()
                    [](std::pair<NodeID, Peer::pointer> const& peer) {
                        return peer.second;
                    });
-    std::random_shuffle(goodPeers.begin(), goodPeers.end());
+    rand_shuffle(goodPeers.begin(), goodPeers.end());
     return goodPeers;
 }
 
-void
+bool
 OverlayManagerImpl::recvFloodedMsg(StellarMessage const& msg,
                                    Peer::pointer peer)
 {
     mMessagesReceived.Mark();
-    mFloodGate.addRecord(msg, peer);
+    return mFloodGate.addRecord(msg, peer);
 }
 
 void
@@ -539,6 +566,15 @@ OverlayManagerImpl::broadcastMessage(StellarMessage const& msg, bool force)
     mFloodGate.broadcast(msg, force);
 }
 
+void
+OverlayManagerImpl::rebroadcastMessage(
+    StellarMessage const& msg,
+    std::function<bool(Peer::pointer const&)> resendTo)
+{
+    mMessagesBroadcast.Mark();
+    mFloodGate.broadcast(msg, true, resendTo);
+}
+
 void
 OverlayManager::dropAll(Database& db)
 {
@@ -551,6 +587,12 @@ OverlayManagerImpl::getPeersKnows(Hash const& h)
     return mFloodGate.getPeersKnows(h);
 }
 
+void
+OverlayManagerImpl::addMemoryUsage(MemoryUsageReport& report) const
+{
+    report["overlay.floodgate"] += mFloodGate.getMemoryUsage();
+}
+
 PeerAuth&
 OverlayManagerImpl::getPeerAuth()
 {
@@ -563,6 +605,12 @@ OverlayManagerImpl::getLoadManager()
     return mLoad;
 }
 
+TxDemandsManager&
+OverlayManagerImpl::getTxDemandsManager()
+{
+    return mTxDemands;
+}
+
 void
 OverlayManagerImpl::shutdown()
 {
@@ -573,6 +621,7 @@ OverlayManagerImpl::shutdown()
     mShuttingDown = true;
     mDoor.close();
     mFloodGate.shutdown();
+    mTxDemands.shutdown();
     auto pendingPeersToStop = mPendingPeers;
     for (auto& p : pendingPeersToStop)
     {
@@ -583,6 +632,17 @@ OverlayManagerImpl::shutdown()
     {
         p.second->drop(ERR_MISC, "peer shutdown");
     }
+    flushPeerTable();
+}
+
+void
+OverlayManagerImpl::flushPeerTable()
+{
+    if (auto table = mApp.getDatabase().getPeerTable())
+    {
+        auto n = table->flush(mApp.getDatabase());
+        mPeersFlushed.Mark(n);
+    }
 }
 
 bool
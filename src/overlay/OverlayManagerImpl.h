@@ -14,6 +14,7 @@
 #include "overlay/ItemFetcher.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/StellarXDR.h"
+#include "overlay/TxDemandsManager.h"
 #include "util/Timer.h"
 #include <set>
 #include <vector>
@@ -51,12 +52,16 @@ class OverlayManagerImpl : public OverlayManager
     medida::Meter& mConnectionsEstablished;
     medida::Meter& mConnectionsDropped;
     medida::Meter& mConnectionsRejected;
+    medida::Meter& mPeersFlushed;
     medida::Counter& mPendingPeersSize;
     medida::Counter& mAuthenticatedPeersSize;
 
     void tick();
     VirtualTimer mTimer;
 
+    // writes the changes of the resident peers table, if any
+    void flushPeerTable();
+
     void storePeerList(std::vector<std::string> const& list, bool resetBackOff,
                        bool preferred);
     void storeConfigPeers();
@@ -64,15 +69,19 @@ class OverlayManagerImpl : public OverlayManager
     friend class OverlayManagerTests;
 
     Floodgate mFloodGate;
+    TxDemandsManager mTxDemands;
 
   public:
     OverlayManagerImpl(Application& app);
     ~OverlayManagerImpl();
 
     void ledgerClosed(uint32_t lastClosedledgerSeq) override;
-    void recvFloodedMsg(StellarMessage const& msg, Peer::pointer peer) override;
+    bool recvFloodedMsg(StellarMessage const& msg, Peer::pointer peer) override;
     void broadcastMessage(StellarMessage const& msg,
                           bool force = false) override;
+    void rebroadcastMessage(
+        StellarMessage const& msg,
+        std::function<bool(Peer::pointer const&)> resendTo) override;
     void connectTo(std::string const& addr) override;
     void connectTo(PeerRecord& pr) override;
     void connectTo(PeerBareAddress const& address) override;
@@ -94,11 +103,14 @@ class OverlayManagerImpl : public OverlayManager
     std::vector<Peer::pointer> getRandomAuthenticatedPeers() override;
 
     std::set<Peer::pointer> getPeersKnows(Hash const& h) override;
+    void addMemoryUsage(MemoryUsageReport& report) const override;
 
     PeerAuth& getPeerAuth() override;
 
     LoadManager& getLoadManager() override;
 
+    TxDemandsManager& getTxDemandsManager() override;
+
     void start() override;
     void shutdown() override;
 
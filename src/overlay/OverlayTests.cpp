@@ -4,8 +4,10 @@
 
 #include "BanManager.h"
 #include "crypto/KeyUtils.h"
+#include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/LoopbackPeer.h"
@@ -17,11 +19,13 @@
 #include "test/test.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "util/XDRBuffer.h"
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 #include "util/format.h"
+#include "xdrpp/marshal.h"
 #include <numeric>
 
 using namespace stellar;
@@ -74,6 +78,68 @@ TEST_CASE("loopback peer send auth before hello", "[overlay]")
     REQUIRE(!conn.getAcceptor()->isAuthenticated());
 }
 
+TEST_CASE("loopback peer link model", "[overlay]")
+{
+    VirtualClock clock;
+    auto cfg1 = getTestConfig(0);
+    auto cfg2 = getTestConfig(1);
+    // the slow links must not time out the handshake
+    cfg1.PEER_AUTHENTICATION_TIMEOUT = 60;
+    cfg2.PEER_AUTHENTICATION_TIMEOUT = 60;
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, cfg2);
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    auto initiator = conn.getInitiator();
+    auto acceptor = conn.getAcceptor();
+    for (auto const& peer : {initiator, acceptor})
+    {
+        peer->setLatency(std::chrono::milliseconds(300));
+    }
+
+    auto authenticate = [&]() {
+        auto start = clock.now();
+        while ((!initiator->isAuthenticated() ||
+                !acceptor->isAuthenticated()) &&
+               clock.crank(false) > 0)
+            ;
+        REQUIRE(initiator->isAuthenticated());
+        REQUIRE(acceptor->isAuthenticated());
+        return clock.now() - start;
+    };
+
+    SECTION("latency")
+    {
+        // hello, hello, auth, auth
+        REQUIRE(authenticate() >= std::chrono::milliseconds(1200));
+    }
+    SECTION("jitter and bandwidth")
+    {
+        for (auto const& peer : {initiator, acceptor})
+        {
+            peer->setJitter(std::chrono::milliseconds(100));
+            peer->setBandwidth(1000);
+        }
+        // messages still arrive in order, or authentication would fail
+        REQUIRE(authenticate() >= std::chrono::milliseconds(1200));
+        REQUIRE(initiator->getMessagesInFlight() == 0);
+    }
+    SECTION("loss")
+    {
+        for (auto const& peer : {initiator, acceptor})
+        {
+            peer->setLossProbability(0.75);
+        }
+        authenticate();
+        REQUIRE(initiator->getStats().messagesRetransmitted +
+                    acceptor->getStats().messagesRetransmitted >
+                0);
+        REQUIRE(initiator->getStats().messagesDropped == 0);
+        REQUIRE_THROWS_AS(initiator->setLossProbability(1.0),
+                          std::runtime_error);
+    }
+}
+
 TEST_CASE("failed auth", "[overlay]")
 {
     VirtualClock clock;
@@ -507,3 +573,175 @@ TEST_CASE("preferred peers always connect", "[overlay]")
     REQUIRE(numberOfAppConnections(*simulation->getNode(vNode2NodeID)) == 1);
     REQUIRE(numberOfAppConnections(*simulation->getNode(vNode3NodeID)) == 1);
 }
+
+TEST_CASE("message MAC covers the received sequence and message",
+          "[overlay]")
+{
+    AuthenticatedMessage am;
+    am.v(0);
+    am.v0().sequence = 7;
+    am.v0().message.type(GET_TX_SET);
+    am.v0().message.txSetHash() = sha256("tx set");
+    am.v0().mac.mac = sha256("mac");
+
+    auto bytes = xdr::xdr_to_msg(am);
+    auto authenticated = Peer::getAuthenticatedBytes(
+        reinterpret_cast<uint8_t const*>(bytes->data()), bytes->size());
+    XDRBuffer expected(am.v0().sequence, am.v0().message);
+    REQUIRE(std::vector<uint8_t>(authenticated.begin(), authenticated.end()) ==
+            expected.getBytes());
+}
+
+TEST_CASE("peer traffic stats", "[overlay]")
+{
+    VirtualClock clock;
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+
+    StellarMessage msg;
+    msg.type(SCP_MESSAGE);
+    msg.envelope().statement.nodeID =
+        app1->getConfig().NODE_SEED.getPublicKey();
+    msg.envelope().statement.slotIndex = 1;
+    msg.envelope().statement.pledges.type(SCP_ST_NOMINATE);
+    conn.getInitiator()->sendMessage(msg);
+    conn.getInitiator()->sendMessage(msg);
+    // nobody has it: answered with DONT_HAVE
+    conn.getInitiator()->sendGetQuorumSet(sha256("unknown quorum set"));
+    testutil::crankSome(clock);
+
+    auto sent = conn.getInitiator()->getJsonStats();
+    auto received = conn.getAcceptor()->getJsonStats();
+    auto size = xdr::xdr_size(msg);
+    REQUIRE(sent["send"]["SCP_MESSAGE"]["messages"].asUInt64() == 2);
+    REQUIRE(sent["send"]["SCP_MESSAGE"]["bytes"].asUInt64() == 2 * size);
+    REQUIRE(received["recv"]["SCP_MESSAGE"]["messages"].asUInt64() == 2);
+    REQUIRE(received["recv"]["SCP_MESSAGE"]["bytes"].asUInt64() == 2 * size);
+    REQUIRE(received["flood"]["received"].asUInt64() == 2);
+    REQUIRE(received["flood"]["duplicates"].asUInt64() == 1);
+    REQUIRE(received["flood"]["duplicate_ratio"].asDouble() == 0.5);
+
+    REQUIRE(sent["recv"]["DONT_HAVE"]["messages"].asUInt64() == 1);
+    REQUIRE(sent["fetch"]["replies"].asUInt64() == 1);
+    REQUIRE(sent["fetch"]["pending"].asUInt64() == 0);
+    REQUIRE(sent["fetch"]["max_ms"].asDouble() > 0);
+}
+
+TEST_CASE("compressed messages", "[overlay]")
+{
+    VirtualClock clock;
+    auto cfg1 = getTestConfig(0);
+    cfg1.OVERLAY_COMPRESSION = true;
+    auto app1 = createTestApplication(clock, cfg1);
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+    // each side decides for what it sends
+    REQUIRE(conn.getInitiator()->isCompressionEnabled());
+    REQUIRE(!conn.getAcceptor()->isCompressionEnabled());
+
+    auto scpMessage = [&](uint64 slotIndex, size_t valueSize) {
+        StellarMessage msg;
+        msg.type(SCP_MESSAGE);
+        msg.envelope().statement.nodeID =
+            app1->getConfig().NODE_SEED.getPublicKey();
+        msg.envelope().statement.slotIndex = slotIndex;
+        msg.envelope().statement.pledges.type(SCP_ST_NOMINATE);
+        Value v;
+        for (size_t i = 0; i < valueSize; i++)
+        {
+            v.push_back(static_cast<uint8_t>(i % 7));
+        }
+        msg.envelope().statement.pledges.nominate().votes.push_back(v);
+        return msg;
+    };
+
+    auto& input = app1->getMetrics().NewMeter(
+        {"overlay", "compression", "input"}, "byte");
+    auto small = scpMessage(1, 16);
+    conn.getInitiator()->sendMessage(small);
+    testutil::crankSome(clock);
+    REQUIRE(input.count() == 0);
+
+    auto large = scpMessage(2, 4096);
+    auto size = xdr::xdr_size(large);
+    for (int i = 0; i < 3; i++)
+    {
+        conn.getInitiator()->sendMessage(large);
+        conn.getAcceptor()->sendMessage(large);
+    }
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+    REQUIRE(input.count() == static_cast<int64_t>(3 * size));
+
+    auto received = conn.getAcceptor()->getJsonStats();
+    REQUIRE(received["recv"]["SCP_MESSAGE"]["messages"].asUInt64() == 4);
+    REQUIRE(received["recv"]["SCP_MESSAGE"]["bytes"].asUInt64() < 2 * size);
+    REQUIRE(received["flood"]["duplicates"].asUInt64() == 2);
+    received = conn.getInitiator()->getJsonStats();
+    REQUIRE(received["recv"]["SCP_MESSAGE"]["messages"].asUInt64() == 3);
+    REQUIRE(received["recv"]["SCP_MESSAGE"]["bytes"].asUInt64() == 3 * size);
+}
+
+TEST_CASE("rebroadcast to peers behind", "[overlay]")
+{
+    VirtualClock clock;
+    auto app1 = createTestApplication(clock, getTestConfig(0));
+    auto app2 = createTestApplication(clock, getTestConfig(1));
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+
+    auto scpMessage = [&](Application& app, uint64 slotIndex) {
+        StellarMessage msg;
+        msg.type(SCP_MESSAGE);
+        msg.envelope().statement.nodeID =
+            app.getConfig().NODE_SEED.getPublicKey();
+        msg.envelope().statement.slotIndex = slotIndex;
+        msg.envelope().statement.pledges.type(SCP_ST_NOMINATE);
+        return msg;
+    };
+    auto received = [&]() {
+        return conn.getAcceptor()
+            ->getJsonStats()["recv"]["SCP_MESSAGE"]["messages"]
+            .asUInt64();
+    };
+    auto resendBehind = [](uint64 slotIndex) {
+        return [slotIndex](Peer::pointer const& peer) {
+            return peer->getLatestSCPSlot() < slotIndex;
+        };
+    };
+
+    auto& om = app1->getOverlayManager();
+    auto msg = scpMessage(*app1, 2);
+    om.broadcastMessage(msg, true);
+    testutil::crankSome(clock);
+    REQUIRE(received() == 1);
+
+    // already told
+    om.broadcastMessage(msg, true);
+    testutil::crankSome(clock);
+    REQUIRE(received() == 1);
+
+    // told, but sent us nothing for the slot
+    REQUIRE(conn.getInitiator()->getLatestSCPSlot() == 0);
+    om.rebroadcastMessage(msg, resendBehind(2));
+    testutil::crankSome(clock);
+    REQUIRE(received() == 2);
+
+    // caught up
+    conn.getAcceptor()->sendMessage(scpMessage(*app2, 2));
+    testutil::crankSome(clock);
+    REQUIRE(conn.getInitiator()->getLatestSCPSlot() == 2);
+    om.rebroadcastMessage(msg, resendBehind(2));
+    testutil::crankSome(clock);
+    REQUIRE(received() == 2);
+}
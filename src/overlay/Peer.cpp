@@ -9,9 +9,11 @@
 #include "crypto/Random.h"
 #include "crypto/SHA.h"
 #include "database/Database.h"
+#include "herder/CompactTxSet.h"
 #include "herder/Herder.h"
 #include "herder/TxSetFrame.h"
 #include "ledger/LedgerManager.h"
+#include "lib/json/json.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/LoadManager.h"
@@ -20,6 +22,9 @@
 #include "overlay/PeerRecord.h"
 #include "overlay/StellarXDR.h"
 #include "util/Logging.h"
+#include "util/Math.h"
+#include "util/Tracing.h"
+#include "util/XDRBuffer.h"
 #include "util/XDROperators.h"
 
 #include "medida/meter.h"
@@ -28,6 +33,7 @@
 
 #include "xdrpp/marshal.h"
 
+#include <limits>
 #include <soci.h>
 #include <time.h>
 
@@ -40,6 +46,39 @@ namespace stellar
 using namespace std;
 using namespace soci;
 
+// first overlay version that understands FLOOD_ADVERT and FLOOD_DEMAND
+static uint32_t const FIRST_OVERLAY_VERSION_WITH_PULL_MODE = 8;
+
+// first overlay version that understands COMPACT_TX_SET, GET_TX_SET_TXS and
+// TX_SET_TXS
+static uint32_t const FIRST_OVERLAY_VERSION_WITH_COMPACT_TX_SETS = 9;
+
+// first overlay version that understands compressed AuthenticatedMessages
+static uint32_t const FIRST_OVERLAY_VERSION_WITH_COMPRESSION = 10;
+
+// first overlay version that understands GET_SCP_STATE_DIFF
+static uint32_t const FIRST_OVERLAY_VERSION_WITH_SCP_STATE_DIFF = 11;
+
+// hashes of the envelopes we have sent with GET_SCP_STATE_DIFF
+static size_t const MAX_KNOWN_SCP_ENVELOPES = 1000;
+// a peer gets our SCP state at most that often, other requests are ignored
+static std::chrono::seconds const SCP_STATE_REPLY_INTERVAL(1);
+
+// compact tx sets from a peer waiting for their missing transactions
+static size_t const MAX_TX_SET_RECONSTRUCTIONS = 8;
+
+// how long a transaction hash may wait before being advertised
+static std::chrono::milliseconds const TX_ADVERT_PERIOD(100);
+
+// fetch requests tracked for the network estimates, and for how long
+static size_t const MAX_PENDING_FETCHES = 64;
+static std::chrono::seconds const PENDING_FETCH_TIMEOUT(30);
+// replies smaller than this are too dominated by the latency to estimate
+// the throughput
+static size_t const MIN_THROUGHPUT_SAMPLE_BYTES = 4096;
+// weight of a new sample in the smoothed estimates
+static double const ESTIMATE_GAIN = 0.125;
+
 medida::Meter&
 Peer::getByteReadMeter(Application& app)
 {
@@ -58,6 +97,7 @@ Peer::Peer(Application& app, PeerRole role)
     , mState(role == WE_CALLED_REMOTE ? CONNECTING : CONNECTED)
     , mRemoteOverlayVersion(0)
     , mIdleTimer(app)
+    , mTxAdvertTimer(app)
     , mLastRead(app.getClock().now())
     , mLastWrite(app.getClock().now())
 
@@ -95,6 +135,18 @@ Peer::Peer(Application& app, PeerRole role)
           app.getMetrics().NewTimer({"overlay", "recv", "scp-message"}))
     , mRecvGetSCPStateTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "get-scp-state"}))
+    , mRecvFloodAdvertTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "flood-advert"}))
+    , mRecvFloodDemandTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "flood-demand"}))
+    , mRecvCompactTxSetTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "compact-txset"}))
+    , mRecvGetTxSetTxsTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "get-txset-txs"}))
+    , mRecvTxSetTxsTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "txset-txs"}))
+    , mRecvGetSCPStateDiffTimer(
+          app.getMetrics().NewTimer({"overlay", "recv", "get-scp-state-diff"}))
 
     , mRecvSCPPrepareTimer(
           app.getMetrics().NewTimer({"overlay", "recv", "scp-prepare"}))
@@ -121,6 +173,8 @@ Peer::Peer(Application& app, PeerRole role)
           {"overlay", "send", "get-txset"}, "message"))
     , mSendTransactionMeter(app.getMetrics().NewMeter(
           {"overlay", "send", "transaction"}, "message"))
+    , mSendTransactionDropMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "transaction-drop"}, "message"))
     , mSendTxSetMeter(
           app.getMetrics().NewMeter({"overlay", "send", "txset"}, "message"))
     , mSendGetSCPQuorumSetMeter(app.getMetrics().NewMeter(
@@ -131,6 +185,26 @@ Peer::Peer(Application& app, PeerRole role)
           {"overlay", "send", "scp-message"}, "message"))
     , mSendGetSCPStateMeter(app.getMetrics().NewMeter(
           {"overlay", "send", "get-scp-state"}, "message"))
+    , mSendFloodAdvertMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "flood-advert"}, "message"))
+    , mSendFloodDemandMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "flood-demand"}, "message"))
+    , mSendCompactTxSetMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "compact-txset"}, "message"))
+    , mSendGetTxSetTxsMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "get-txset-txs"}, "message"))
+    , mSendTxSetTxsMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "txset-txs"}, "message"))
+    , mSendGetSCPStateDiffMeter(app.getMetrics().NewMeter(
+          {"overlay", "send", "get-scp-state-diff"}, "message"))
+    , mSCPStateRateLimitMeter(app.getMetrics().NewMeter(
+          {"overlay", "rate-limit", "scp-state"}, "message"))
+    , mCompactTxSetMissMeter(app.getMetrics().NewMeter(
+          {"overlay", "compact-txset", "missing-tx"}, "transaction"))
+    , mCompressionInputMeter(app.getMetrics().NewMeter(
+          {"overlay", "compression", "input"}, "byte"))
+    , mCompressionOutputMeter(app.getMetrics().NewMeter(
+          {"overlay", "compression", "output"}, "byte"))
     , mDropInConnectHandlerMeter(app.getMetrics().NewMeter(
           {"overlay", "drop", "connect-handler"}, "drop"))
     , mDropInRecvMessageDecodeMeter(app.getMetrics().NewMeter(
@@ -337,6 +411,7 @@ Peer::sendGetTxSet(uint256 const& setID)
     newMsg.type(GET_TX_SET);
     newMsg.txSetHash() = setID;
 
+    noteFetchRequest(setID);
     sendMessage(newMsg);
 }
 void
@@ -349,9 +424,149 @@ Peer::sendGetQuorumSet(uint256 const& setID)
     newMsg.type(GET_SCP_QUORUMSET);
     newMsg.qSetHash() = setID;
 
+    noteFetchRequest(setID);
     sendMessage(newMsg);
 }
 
+void
+Peer::noteFetchRequest(Hash const& hash)
+{
+    auto now = mApp.getClock().now();
+    if (mPendingFetches.size() >= MAX_PENDING_FETCHES)
+    {
+        for (auto it = mPendingFetches.begin(); it != mPendingFetches.end();)
+        {
+            if (it->second + PENDING_FETCH_TIMEOUT < now)
+            {
+                it = mPendingFetches.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        if (mPendingFetches.size() >= MAX_PENDING_FETCHES)
+        {
+            return;
+        }
+    }
+    // a request sent again is timed from the first one
+    mPendingFetches.emplace(hash, now);
+}
+
+void
+Peer::noteFetchReply(Hash const& hash, size_t bytes)
+{
+    auto it = mPendingFetches.find(hash);
+    if (it == mPendingFetches.end())
+    {
+        return;
+    }
+    auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+        mApp.getClock().now() - it->second);
+    mPendingFetches.erase(it);
+    // a round trip takes some time, even in virtual time
+    rtt = std::max(rtt, std::chrono::microseconds(1));
+
+    mFetchReplies++;
+    mFetchLatencyTotal += rtt;
+    mFetchLatencyMax = std::max(mFetchLatencyMax, rtt);
+
+    if (mLatencyEstimate.count() == 0)
+    {
+        mLatencyEstimate = rtt;
+    }
+    else
+    {
+        mLatencyEstimate += std::chrono::microseconds(static_cast<int64_t>(
+            ESTIMATE_GAIN * (rtt - mLatencyEstimate).count()));
+    }
+
+    if (bytes >= MIN_THROUGHPUT_SAMPLE_BYTES)
+    {
+        double throughput = bytes * 1e6 / rtt.count();
+        if (mThroughputEstimate == 0)
+        {
+            mThroughputEstimate = throughput;
+        }
+        else
+        {
+            mThroughputEstimate +=
+                ESTIMATE_GAIN * (throughput - mThroughputEstimate);
+        }
+    }
+}
+
+void
+Peer::noteFloodReceived(bool isNew)
+{
+    mFloodsReceived++;
+    if (!isNew)
+    {
+        mDuplicateFloods++;
+    }
+}
+
+Json::Value
+Peer::getJsonStats() const
+{
+    auto traffic = [](std::map<MessageType, TrafficCount> const& counts) {
+        Json::Value res(Json::objectValue);
+        for (auto const& kv : counts)
+        {
+            auto& t = res[xdr::xdr_traits<MessageType>::enum_name(kv.first)];
+            t["messages"] = static_cast<Json::UInt64>(kv.second.mMessages);
+            t["bytes"] = static_cast<Json::UInt64>(kv.second.mBytes);
+        }
+        return res;
+    };
+
+    Json::Value res;
+    res["send"] = traffic(mSendTraffic);
+    res["recv"] = traffic(mRecvTraffic);
+
+    auto& flood = res["flood"];
+    flood["received"] = static_cast<Json::UInt64>(mFloodsReceived);
+    flood["duplicates"] = static_cast<Json::UInt64>(mDuplicateFloods);
+    flood["duplicate_ratio"] =
+        mFloodsReceived == 0
+            ? 0.0
+            : static_cast<double>(mDuplicateFloods) / mFloodsReceived;
+
+    auto& fetch = res["fetch"];
+    fetch["replies"] = static_cast<Json::UInt64>(mFetchReplies);
+    fetch["pending"] = static_cast<Json::UInt64>(mPendingFetches.size());
+    fetch["mean_ms"] = mFetchReplies == 0
+                           ? 0.0
+                           : mFetchLatencyTotal.count() / 1000.0 /
+                                 mFetchReplies;
+    fetch["max_ms"] = mFetchLatencyMax.count() / 1000.0;
+    fetch["estimate_ms"] = mLatencyEstimate.count() / 1000.0;
+    return res;
+}
+
+void
+Peer::storeNetworkEstimatesInPeerRecord()
+{
+    if (mLatencyEstimate.count() == 0 || getAddress().isEmpty())
+    {
+        return;
+    }
+    auto pr = PeerRecord::loadPeerRecord(mApp.getDatabase(), getAddress());
+    if (!pr)
+    {
+        return;
+    }
+    auto latencyMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         mLatencyEstimate)
+                         .count();
+    pr->mLatencyMs = static_cast<uint32_t>(std::max<int64_t>(latencyMs, 1));
+    pr->mThroughput = static_cast<uint32_t>(
+        std::min<double>(mThroughputEstimate,
+                         std::numeric_limits<int32_t>::max()));
+    pr->storePeerRecord(mApp.getDatabase());
+}
+
 void
 Peer::sendGetPeers()
 {
@@ -369,8 +584,21 @@ Peer::sendGetScpState(uint32 ledgerSeq)
     CLOG(TRACE, "Overlay") << "Get SCP State for " << ledgerSeq;
 
     StellarMessage newMsg;
-    newMsg.type(GET_SCP_STATE);
-    newMsg.getSCPLedgerSeq() = ledgerSeq;
+    if (mRemoteOverlayVersion >= FIRST_OVERLAY_VERSION_WITH_SCP_STATE_DIFF)
+    {
+        // what we already have is not sent back
+        newMsg.type(GET_SCP_STATE_DIFF);
+        newMsg.getSCPStateDiff().ledgerSeq = ledgerSeq;
+        auto known = mApp.getHerder().getSCPStateHashes(
+            ledgerSeq, MAX_KNOWN_SCP_ENVELOPES);
+        newMsg.getSCPStateDiff().knownEnvelopes.assign(known.begin(),
+                                                       known.end());
+    }
+    else
+    {
+        newMsg.type(GET_SCP_STATE);
+        newMsg.getSCPLedgerSeq() = ledgerSeq;
+    }
 
     sendMessage(newMsg);
 }
@@ -451,13 +679,71 @@ msgSummary(StellarMessage const& msg)
         }
     case GET_SCP_STATE:
         return "GET_SCP_STATE";
+
+    case FLOOD_ADVERT:
+        return "FLOODADVERT";
+    case FLOOD_DEMAND:
+        return "FLOODDEMAND";
+
+    case COMPACT_TX_SET:
+        return "COMPACTTXSET";
+    case GET_TX_SET_TXS:
+        return "GETTXSETTXS";
+    case TX_SET_TXS:
+        return "TXSETTXS";
+    case GET_SCP_STATE_DIFF:
+        return "GET_SCP_STATE_DIFF";
     }
     return "UNKNOWN";
 }
 
+Peer::MessagePriority
+Peer::getMessagePriority(MessageType type)
+{
+    switch (type)
+    {
+    case TX_SET:
+    case GET_TX_SET:
+    case DONT_HAVE:
+    case COMPACT_TX_SET:
+    case GET_TX_SET_TXS:
+    case TX_SET_TXS:
+        return PRIORITY_FETCH;
+    case TRANSACTION:
+    case FLOOD_ADVERT:
+    case FLOOD_DEMAND:
+        return PRIORITY_TRANSACTION;
+    case PEERS:
+    case GET_PEERS:
+        return PRIORITY_PEERS;
+    default:
+        // SCP traffic, and the handshake and errors
+        return PRIORITY_CONSENSUS;
+    }
+}
+
 void
 Peer::sendMessage(StellarMessage const& msg)
 {
+    auto xdrMsg =
+        std::make_shared<xdr::opaque_vec<> const>(xdr::xdr_to_opaque(msg));
+    sendMessage(msg, xdrMsg);
+}
+
+void
+Peer::sendMessage(StellarMessage const& msg,
+                  std::shared_ptr<xdr::opaque_vec<> const> const& xdrMsg)
+{
+    // transactions are flooded on a best effort basis: when the peer does
+    // not keep up, they give way to consensus traffic
+    if (msg.type() == TRANSACTION &&
+        getOutboundQueueBytes() >=
+            mApp.getConfig().PEER_OUTBOUND_TX_QUEUE_BYTES)
+    {
+        mSendTransactionDropMeter.Mark();
+        return;
+    }
+
     if (Logging::logTrace("Overlay"))
         CLOG(TRACE, "Overlay")
             << "("
@@ -507,19 +793,89 @@ Peer::sendMessage(StellarMessage const& msg)
     case GET_SCP_STATE:
         mSendGetSCPStateMeter.Mark();
         break;
+    case FLOOD_ADVERT:
+        mSendFloodAdvertMeter.Mark();
+        break;
+    case FLOOD_DEMAND:
+        mSendFloodDemandMeter.Mark();
+        break;
+    case COMPACT_TX_SET:
+        mSendCompactTxSetMeter.Mark();
+        break;
+    case GET_TX_SET_TXS:
+        mSendGetTxSetTxsMeter.Mark();
+        break;
+    case TX_SET_TXS:
+        mSendTxSetTxsMeter.Mark();
+        break;
+    case GET_SCP_STATE_DIFF:
+        mSendGetSCPStateDiffMeter.Mark();
+        break;
     };
 
-    AuthenticatedMessage amsg;
-    amsg.v0().message = msg;
-    if (msg.type() != HELLO && msg.type() != ERROR_MSG)
+    auto& traffic = mSendTraffic[msg.type()];
+    traffic.mMessages++;
+    traffic.mBytes += xdrMsg->size();
+
+    queueMessage(msg.type(), xdrMsg);
+}
+
+void
+Peer::queueMessage(MessageType type,
+                   std::shared_ptr<xdr::opaque_vec<> const> xdrMsg)
+{
+    this->sendMessage(authenticateMessage(type, *xdrMsg));
+}
+
+xdr::msg_ptr
+Peer::authenticateMessage(MessageType type, xdr::opaque_vec<> const& xdrMsg)
+{
+    uint32_t version = 0;
+    uint64 sequence = 0;
+    HmacSha256Mac mac;
+    if (mDeflater && type != HELLO && type != ERROR_MSG &&
+        xdrMsg.size() >= MIN_COMPRESSED_MESSAGE_SIZE)
     {
-        amsg.v0().sequence = mSendMacSeq;
-        amsg.v0().mac =
-            hmacSha256(mSendMacKey, xdr::xdr_to_opaque(mSendMacSeq, msg));
+        // v1: sequence, compressed message, mac
+        version = 1;
+        xdr::opaque_vec<> compressed;
+        mDeflater->deflate(xdrMsg.data(), xdrMsg.size(), compressed);
+        mCompressionInputMeter.Mark(xdrMsg.size());
+        mCompressionOutputMeter.Mark(compressed.size());
+        sequence = mSendMacSeq;
+        XDRBuffer authenticated(sequence, compressed);
+        mac = hmacSha256(mSendMacKey, authenticated.getBytes());
         ++mSendMacSeq;
+
+        xdr::msg_ptr xdrBytes(xdr::message_t::alloc(
+            xdr::xdr_size(version) + authenticated.getBytes().size() +
+            xdr::xdr_size(mac)));
+        xdr::xdr_put p(xdrBytes);
+        p(version);
+        p.put_bytes(authenticated.getBytes().data(),
+                    authenticated.getBytes().size());
+        p(mac);
+        return xdrBytes;
     }
-    xdr::msg_ptr xdrBytes(xdr::xdr_to_msg(amsg));
-    this->sendMessage(std::move(xdrBytes));
+
+    if (type != HELLO && type != ERROR_MSG)
+    {
+        sequence = mSendMacSeq;
+        mac = hmacSha256(mSendMacKey, XDRBuffer(sequence).getBytes(), xdrMsg);
+        ++mSendMacSeq;
+    }
+
+    // writes the AuthenticatedMessage (v0: sequence, message, mac) around
+    // the already serialized message
+    xdr::msg_ptr xdrBytes(xdr::message_t::alloc(
+        xdr::xdr_size(version) + xdr::xdr_size(sequence) + xdrMsg.size() +
+        xdr::xdr_size(mac)));
+    xdr::xdr_put p(xdrBytes);
+    p(version);
+    p(sequence);
+    p.put_bytes(xdrMsg.data(), xdrMsg.size());
+    p(mac);
+    return xdrBytes;
 }
 
 void
@@ -537,7 +893,7 @@ Peer::recvMessage(xdr::msg_ptr const& msg)
     {
         AuthenticatedMessage am;
         xdr::xdr_from_msg(msg, am);
-        recvMessage(am);
+        recvMessage(am, getAuthenticatedBytes(msg->data(), msg->size()));
     }
     catch (xdr::xdr_runtime_error& e)
     {
@@ -566,43 +922,142 @@ Peer::shouldAbort() const
     return (mState == CLOSING) || mApp.getOverlayManager().isShuttingDown();
 }
 
+ByteSlice
+Peer::getAuthenticatedBytes(uint8_t const* body, size_t length)
+{
+    // version, sequence, message (v0) or compressed message (v1), mac
+    auto prefix = xdr::xdr_size(uint32_t{0});
+    auto suffix = xdr::xdr_size(HmacSha256Mac{});
+    assert(length >= prefix + suffix);
+    return ByteSlice(body + prefix, length - prefix - suffix);
+}
+
 void
-Peer::recvMessage(AuthenticatedMessage const& msg)
+Peer::recvMessage(AuthenticatedMessage const& msg,
+                  ByteSlice const& authenticated)
 {
     if (shouldAbort())
     {
         return;
     }
 
-    if (mState >= GOT_HELLO && msg.v0().message.type() != ERROR_MSG)
+    if (!checkMessageAuth(msg, authenticated))
+    {
+        return;
+    }
+    if (msg.v() == 0)
     {
-        if (msg.v0().sequence != mRecvMacSeq)
+        recvMessage(msg.v0().message);
+        return;
+    }
+    auto decompressed = msg;
+    if (decompressMessage(decompressed))
+    {
+        recvMessage(decompressed.v0().message);
+    }
+}
+
+bool
+Peer::checkMessageAuth(AuthenticatedMessage const& msg,
+                       ByteSlice const& authenticated)
+{
+    // ERROR_MSG, that may be sent before the keys are known, is never
+    // compressed
+    bool compressed = msg.v() == 1;
+    if (mState >= GOT_HELLO &&
+        (compressed || msg.v0().message.type() != ERROR_MSG))
+    {
+        auto sequence = compressed ? msg.v1().sequence : msg.v0().sequence;
+        auto const& mac = compressed ? msg.v1().mac : msg.v0().mac;
+        if (sequence != mRecvMacSeq)
         {
             CLOG(ERROR, "Overlay") << "Unexpected message-auth sequence";
             mDropInRecvMessageSeqMeter.Mark();
             ++mRecvMacSeq;
             drop(ERR_AUTH, "unexpected auth sequence");
-            return;
+            return false;
         }
 
-        if (!hmacSha256Verify(
-                msg.v0().mac, mRecvMacKey,
-                xdr::xdr_to_opaque(msg.v0().sequence, msg.v0().message)))
+        if (!hmacSha256Verify(mac, mRecvMacKey, authenticated))
         {
             CLOG(ERROR, "Overlay") << "Message-auth check failed";
             mDropInRecvMessageMacMeter.Mark();
             ++mRecvMacSeq;
             drop(ERR_AUTH, "unexpected MAC");
-            return;
+            return false;
         }
         ++mRecvMacSeq;
     }
-    recvMessage(msg.v0().message);
+
+    // the authenticated bytes are the sequence and the message, compressed
+    // ones are counted once their type is known
+    if (!compressed)
+    {
+        auto& traffic = mRecvTraffic[msg.v0().message.type()];
+        traffic.mMessages++;
+        traffic.mBytes +=
+            authenticated.size() - xdr::xdr_size(msg.v0().sequence);
+    }
+    return true;
+}
+
+bool
+Peer::decompressMessage(AuthenticatedMessage& msg)
+{
+    if (msg.v() == 0)
+    {
+        return true;
+    }
+    if (mRemoteOverlayVersion < FIRST_OVERLAY_VERSION_WITH_COMPRESSION)
+    {
+        mDropInRecvMessageDecodeMeter.Mark();
+        drop(ERR_DATA, "unexpected compressed message");
+        return false;
+    }
+
+    if (!mInflater)
+    {
+        mInflater = std::make_unique<MessageInflater>();
+    }
+    StellarMessage message;
+    bool decoded = false;
+    if (mInflater->inflate(msg.v1().compressedMessage, mInflateBuffer))
+    {
+        try
+        {
+            xdr::xdr_from_opaque(mInflateBuffer, message);
+            decoded = true;
+        }
+        catch (xdr::xdr_runtime_error& e)
+        {
+            CLOG(ERROR, "Overlay")
+                << "received corrupt compressed message " << e.what();
+        }
+    }
+    if (!decoded)
+    {
+        mDropInRecvMessageDecodeMeter.Mark();
+        drop(ERR_DATA, "received corrupt compressed message");
+        return false;
+    }
+
+    auto& traffic = mRecvTraffic[message.type()];
+    traffic.mMessages++;
+    traffic.mBytes += xdr::xdr_size(msg.v1().compressedMessage);
+
+    auto sequence = msg.v1().sequence;
+    auto mac = msg.v1().mac;
+    msg.v(0);
+    msg.v0().sequence = sequence;
+    msg.v0().message = std::move(message);
+    msg.v0().mac = mac;
+    return true;
 }
 
 void
 Peer::recvMessage(StellarMessage const& stellarMsg)
 {
+    TRACE_ZONE("Peer::recvMessage");
     if (shouldAbort())
     {
         return;
@@ -629,6 +1084,14 @@ Peer::recvMessage(StellarMessage const& stellarMsg)
     assert(isAuthenticated() || stellarMsg.type() == HELLO ||
            stellarMsg.type() == AUTH || stellarMsg.type() == ERROR_MSG);
 
+    // excess messages are dropped before any expensive handling
+    if (isAuthenticated() &&
+        !mApp.getOverlayManager().getLoadManager().admitMessage(
+            mApp, mPeerID, stellarMsg.type()))
+    {
+        return;
+    }
+
     switch (stellarMsg.type())
     {
     case ERROR_MSG:
@@ -721,12 +1184,65 @@ Peer::recvMessage(StellarMessage const& stellarMsg)
         recvGetSCPState(stellarMsg);
     }
     break;
+
+    case FLOOD_ADVERT:
+    {
+        auto t = mRecvFloodAdvertTimer.TimeScope();
+        recvFloodAdvert(stellarMsg);
+    }
+    break;
+
+    case FLOOD_DEMAND:
+    {
+        auto t = mRecvFloodDemandTimer.TimeScope();
+        recvFloodDemand(stellarMsg);
+    }
+    break;
+
+    case COMPACT_TX_SET:
+    {
+        auto t = mRecvCompactTxSetTimer.TimeScope();
+        recvCompactTxSet(stellarMsg);
+    }
+    break;
+
+    case GET_TX_SET_TXS:
+    {
+        auto t = mRecvGetTxSetTxsTimer.TimeScope();
+        recvGetTxSetTxs(stellarMsg);
+    }
+    break;
+
+    case TX_SET_TXS:
+    {
+        auto t = mRecvTxSetTxsTimer.TimeScope();
+        recvTxSetTxs(stellarMsg);
+    }
+    break;
+
+    case GET_SCP_STATE_DIFF:
+    {
+        auto t = mRecvGetSCPStateDiffTimer.TimeScope();
+        recvGetSCPStateDiff(stellarMsg);
+    }
+    break;
     }
 }
 
 void
 Peer::recvDontHave(StellarMessage const& msg)
 {
+    noteFetchReply(msg.dontHave().reqHash, 0);
+    if (msg.dontHave().type == TRANSACTION)
+    {
+        mApp.getOverlayManager().getTxDemandsManager().doesntHave(
+            msg.dontHave().reqHash, shared_from_this());
+        return;
+    }
+    if (msg.dontHave().type == TX_SET)
+    {
+        mTxSetReconstructions.erase(msg.dontHave().reqHash);
+    }
     mApp.getHerder().peerDoesntHave(msg.dontHave().type, msg.dontHave().reqHash,
                                     shared_from_this());
 }
@@ -738,8 +1254,16 @@ Peer::recvGetTxSet(StellarMessage const& msg)
     if (auto txSet = mApp.getHerder().getTxSet(msg.txSetHash()))
     {
         StellarMessage newMsg;
-        newMsg.type(TX_SET);
-        txSet->toXDR(newMsg.txSet());
+        if (mCompactTxSets && txSet->size() != 0)
+        {
+            newMsg.type(COMPACT_TX_SET);
+            toCompactXDR(*txSet, newMsg.compactTxSet());
+        }
+        else
+        {
+            newMsg.type(TX_SET);
+            txSet->toXDR(newMsg.txSet());
+        }
 
         self->sendMessage(newMsg);
     }
@@ -753,35 +1277,227 @@ void
 Peer::recvTxSet(StellarMessage const& msg)
 {
     TxSetFrame frame(mApp.getNetworkID(), msg.txSet());
+    noteFetchReply(frame.getContentsHash(), xdr::xdr_size(msg.txSet()));
     mApp.getHerder().recvTxSet(frame.getContentsHash(), frame);
 }
 
+void
+Peer::recvCompactTxSet(StellarMessage const& msg)
+{
+    auto const& compact = msg.compactTxSet();
+    auto& herder = mApp.getHerder();
+    if (!herder.isTxSetWanted(compact.txSetHash) ||
+        mTxSetReconstructions.find(compact.txSetHash) !=
+            mTxSetReconstructions.end())
+    {
+        return;
+    }
+    noteFetchReply(compact.txSetHash, xdr::xdr_size(compact));
+    if (mTxSetReconstructions.size() >= MAX_TX_SET_RECONSTRUCTIONS)
+    {
+        mTxSetReconstructions.erase(mTxSetReconstructions.begin());
+    }
+
+    auto reconstruction = std::make_shared<TxSetReconstruction>(
+        compact, herder.getPendingTransactions());
+    mTxSetReconstructions[compact.txSetHash] = reconstruction;
+    continueTxSetReconstruction(reconstruction);
+}
+
+void
+Peer::continueTxSetReconstruction(
+    std::shared_ptr<TxSetReconstruction> const& reconstruction)
+{
+    auto const& hash = reconstruction->getHash();
+    auto missing = reconstruction->getMissing();
+    if (missing.empty())
+    {
+        mTxSetReconstructions.erase(hash);
+        auto txSet = reconstruction->getTxSet();
+        if (txSet)
+        {
+            mApp.getHerder().recvTxSet(hash, *txSet);
+        }
+        else if (reconstruction->retry())
+        {
+            // a transaction known locally had the short id of another one
+            mTxSetReconstructions[hash] = reconstruction;
+            continueTxSetReconstruction(reconstruction);
+        }
+        else
+        {
+            mApp.getHerder().peerDoesntHave(TX_SET, hash, shared_from_this());
+        }
+        return;
+    }
+
+    mCompactTxSetMissMeter.Mark(missing.size());
+    StellarMessage newMsg;
+    newMsg.type(GET_TX_SET_TXS);
+    newMsg.getTxSetTxs().txSetHash = hash;
+    newMsg.getTxSetTxs().indexes.assign(missing.begin(), missing.end());
+    sendMessage(newMsg);
+}
+
+void
+Peer::recvGetTxSetTxs(StellarMessage const& msg)
+{
+    auto const& request = msg.getTxSetTxs();
+    auto txSet = mApp.getHerder().getTxSet(request.txSetHash);
+    if (!txSet)
+    {
+        sendDontHave(TX_SET, request.txSetHash);
+        return;
+    }
+
+    auto txs = getCompactOrder(*txSet);
+    StellarMessage newMsg;
+    newMsg.type(TX_SET_TXS);
+    newMsg.txSetTxs().txSetHash = request.txSetHash;
+    for (auto i : request.indexes)
+    {
+        if (i >= txs.size())
+        {
+            drop(ERR_DATA, "bad transaction index");
+            return;
+        }
+        newMsg.txSetTxs().txs.emplace_back(txs[i]->getEnvelope());
+    }
+    sendMessage(newMsg);
+}
+
+void
+Peer::recvTxSetTxs(StellarMessage const& msg)
+{
+    auto const& reply = msg.txSetTxs();
+    auto it = mTxSetReconstructions.find(reply.txSetHash);
+    if (it == mTxSetReconstructions.end())
+    {
+        return;
+    }
+    auto reconstruction = it->second;
+    auto txs = TransactionFrame::makeTransactionsFromWire(mApp.getNetworkID(),
+                                                          reply.txs);
+    if (!reconstruction->addMissing(txs))
+    {
+        mTxSetReconstructions.erase(it);
+        mApp.getHerder().peerDoesntHave(TX_SET, reply.txSetHash,
+                                        shared_from_this());
+        return;
+    }
+    continueTxSetReconstruction(reconstruction);
+}
+
 void
 Peer::recvTransaction(StellarMessage const& msg)
 {
+    mApp.getOverlayManager().getTxDemandsManager().recvTransaction(msg);
+
     TransactionFramePtr transaction = TransactionFrame::makeTransactionFromWire(
         mApp.getNetworkID(), msg.transaction());
     if (transaction)
     {
         // add it to our current set
         // and make sure it is valid
-        auto recvRes = mApp.getHerder().recvTransaction(transaction);
-
-        if (recvRes == Herder::TX_STATUS_PENDING ||
-            recvRes == Herder::TX_STATUS_DUPLICATE)
-        {
-            // record that this peer sent us this transaction
-            mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this());
-
-            if (recvRes == Herder::TX_STATUS_PENDING)
+        std::weak_ptr<Peer> weak = shared_from_this();
+        Application& app = mApp;
+        auto onResult = [&app, weak,
+                         msg](Herder::TransactionSubmitStatus recvRes) {
+            if (recvRes == Herder::TX_STATUS_PENDING ||
+                recvRes == Herder::TX_STATUS_DUPLICATE)
             {
-                // if it's a new transaction, broadcast it
-                mApp.getOverlayManager().broadcastMessage(msg);
+                // record that this peer sent us this transaction
+                if (auto peer = weak.lock())
+                {
+                    peer->noteFloodReceived(
+                        app.getOverlayManager().recvFloodedMsg(msg, peer));
+                }
+
+                if (recvRes == Herder::TX_STATUS_PENDING)
+                {
+                    // if it's a new transaction, broadcast it
+                    app.getOverlayManager().broadcastMessage(msg);
+                }
             }
+        };
+        mApp.getHerder().recvTransactionAsync(transaction, onResult);
+    }
+}
+
+void
+Peer::recvFloodAdvert(StellarMessage const& msg)
+{
+    mApp.getOverlayManager().getTxDemandsManager().recvTxAdvert(
+        shared_from_this(), msg.floodAdvert());
+}
+
+void
+Peer::recvFloodDemand(StellarMessage const& msg)
+{
+    auto& demands = mApp.getOverlayManager().getTxDemandsManager();
+    for (auto const& hash : msg.floodDemand().txHashes)
+    {
+        if (auto tx = demands.getAdvertisedTransaction(hash))
+        {
+            sendMessage(*tx);
+        }
+        else
+        {
+            sendDontHave(TRANSACTION, hash);
         }
     }
 }
 
+bool
+Peer::isPullModeEnabled() const
+{
+    return mPullMode;
+}
+
+bool
+Peer::isCompressionEnabled() const
+{
+    return mDeflater != nullptr;
+}
+
+void
+Peer::advertiseTransaction(Hash const& hash)
+{
+    mTxAdvertQueue.emplace_back(hash);
+    if (mTxAdvertQueue.size() == TX_ADVERT_VECTOR_MAX_SIZE)
+    {
+        flushTxAdverts();
+    }
+    else if (mTxAdvertQueue.size() == 1)
+    {
+        std::weak_ptr<Peer> weak = shared_from_this();
+        mTxAdvertTimer.expires_from_now(TX_ADVERT_PERIOD);
+        mTxAdvertTimer.async_wait(
+            [weak]() {
+                if (auto self = weak.lock())
+                {
+                    self->flushTxAdverts();
+                }
+            },
+            VirtualTimer::onFailureNoop);
+    }
+}
+
+void
+Peer::flushTxAdverts()
+{
+    mTxAdvertTimer.cancel();
+    if (mTxAdvertQueue.empty() || shouldAbort())
+    {
+        return;
+    }
+    StellarMessage msg;
+    msg.type(FLOOD_ADVERT);
+    msg.floodAdvert().txHashes = std::move(mTxAdvertQueue);
+    mTxAdvertQueue.clear();
+    sendMessage(msg);
+}
+
 void
 Peer::recvGetSCPQuorumSet(StellarMessage const& msg)
 {
@@ -803,7 +1519,9 @@ Peer::recvGetSCPQuorumSet(StellarMessage const& msg)
 void
 Peer::recvSCPQuorumSet(StellarMessage const& msg)
 {
-    Hash hash = sha256(xdr::xdr_to_opaque(msg.qSet()));
+    auto xdrQSet = xdr::xdr_to_opaque(msg.qSet());
+    Hash hash = sha256(xdrQSet);
+    noteFetchReply(hash, xdrQSet.size());
     mApp.getHerder().recvSCPQuorumSet(hash, msg.qSet());
 }
 
@@ -816,7 +1534,9 @@ Peer::recvSCPMessage(StellarMessage const& msg)
             << "recvSCPMessage node: "
             << mApp.getConfig().toShortString(msg.envelope().statement.nodeID);
 
-    mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this());
+    noteFloodReceived(
+        mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this()));
+    mLatestSCPSlot = std::max(mLatestSCPSlot, envelope.statement.slotIndex);
 
     auto type = msg.envelope().statement.pledges.type();
     auto t = (type == SCP_ST_PREPARE
@@ -827,7 +1547,7 @@ Peer::recvSCPMessage(StellarMessage const& msg)
                                 ? mRecvSCPExternalizeTimer.TimeScope()
                                 : (mRecvSCPNominateTimer.TimeScope()))));
 
-    mApp.getHerder().recvSCPEnvelope(envelope);
+    mApp.getHerder().recvSCPEnvelopeAsync(envelope);
 }
 
 void
@@ -835,7 +1555,38 @@ Peer::recvGetSCPState(StellarMessage const& msg)
 {
     uint32 seq = msg.getSCPLedgerSeq();
     CLOG(TRACE, "Overlay") << "get SCP State " << seq;
-    mApp.getHerder().sendSCPStateToPeer(seq, shared_from_this());
+    if (canReplySCPState())
+    {
+        mApp.getHerder().sendSCPStateToPeer(seq, shared_from_this(), {});
+    }
+}
+
+void
+Peer::recvGetSCPStateDiff(StellarMessage const& msg)
+{
+    auto const& req = msg.getSCPStateDiff();
+    CLOG(TRACE, "Overlay") << "get SCP State " << req.ledgerSeq << " without "
+                           << req.knownEnvelopes.size() << " envelopes";
+    if (canReplySCPState())
+    {
+        std::unordered_set<Hash> known(req.knownEnvelopes.begin(),
+                                       req.knownEnvelopes.end());
+        mApp.getHerder().sendSCPStateToPeer(req.ledgerSeq, shared_from_this(),
+                                            known);
+    }
+}
+
+bool
+Peer::canReplySCPState()
+{
+    auto now = mApp.getClock().now();
+    if (now < mLastSCPStateReply + SCP_STATE_REPLY_INTERVAL)
+    {
+        mSCPStateRateLimitMeter.Mark();
+        return false;
+    }
+    mLastSCPStateReply = now;
+    return true;
 }
 
 void
@@ -963,6 +1714,19 @@ Peer::recvHello(Hello const& elo)
         return;
     }
 
+    // every version we handle can receive adverts, whether we send them is
+    // up to our configuration
+    mPullMode = mApp.getConfig().PULL_MODE_TX_FLOODING &&
+                mRemoteOverlayVersion >= FIRST_OVERLAY_VERSION_WITH_PULL_MODE;
+    mCompactTxSets =
+        mApp.getConfig().COMPACT_TX_SET_RELAY &&
+        mRemoteOverlayVersion >= FIRST_OVERLAY_VERSION_WITH_COMPACT_TX_SETS;
+    if (mApp.getConfig().OVERLAY_COMPRESSION &&
+        mRemoteOverlayVersion >= FIRST_OVERLAY_VERSION_WITH_COMPRESSION)
+    {
+        mDeflater = std::make_unique<MessageDeflater>();
+    }
+
     if (elo.peerID == mApp.getConfig().NODE_SEED.getPublicKey())
     {
         CLOG(WARNING, "Overlay") << "connecting to self";
@@ -1071,9 +1835,12 @@ Peer::recvAuth(StellarMessage const& msg)
 
     noteHandshakeSuccessInPeerRecord();
 
-    // send SCP State
+    // send SCP State to peers that may not ask for it
     // remove when all known peers implements the next line
-    mApp.getHerder().sendSCPStateToPeer(0, self);
+    if (mRemoteOverlayVersion < FIRST_OVERLAY_VERSION_WITH_SCP_STATE_DIFF)
+    {
+        mApp.getHerder().sendSCPStateToPeer(0, self, {});
+    }
     // ask for SCP state if not synced
     sendGetScpState(mApp.getLedgerManager().getLastClosedLedgerNum() + 1);
 }
@@ -1107,7 +1874,8 @@ Peer::recvPeers(StellarMessage const& msg)
         // know it
         auto defaultNextAttempt =
             mApp.getClock().now() +
-            std::chrono::seconds(std::rand() % NEW_PEER_WINDOW_SECONDS);
+            std::chrono::seconds(
+                rand_uniform<uint32_t>(0, NEW_PEER_WINDOW_SECONDS - 1));
 
         assert(peer.ip.type() == IPv4);
         auto address = PeerBareAddress{peer};
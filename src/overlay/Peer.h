@@ -5,13 +5,18 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "util/asio.h"
+#include "crypto/ByteSlice.h"
 #include "database/Database.h"
+#include "lib/json/json-forwards.h"
+#include "overlay/MessageCompression.h"
 #include "overlay/PeerBareAddress.h"
 #include "overlay/StellarXDR.h"
 #include "util/NonCopyable.h"
 #include "util/Timer.h"
 #include "xdrpp/message.h"
 
+#include <map>
+
 namespace medida
 {
 class Timer;
@@ -25,6 +30,7 @@ typedef std::shared_ptr<SCPQuorumSet> SCPQuorumSetPtr;
 
 class Application;
 class LoopbackPeer;
+class TxSetReconstruction;
 
 /*
  * Another peer out there that we are connected to
@@ -51,9 +57,29 @@ class Peer : public std::enable_shared_from_this<Peer>,
         WE_CALLED_REMOTE
     };
 
+    // Traffic classes, from the most to the least urgent. A transport may
+    // reorder messages of different classes, never messages of the same one.
+    enum MessagePriority
+    {
+        PRIORITY_CONSENSUS = 0, // SCP messages and quorum sets
+        PRIORITY_FETCH = 1,     // transaction sets
+        PRIORITY_TRANSACTION = 2,
+        PRIORITY_PEERS = 3,
+        PRIORITY_COUNT = 4
+    };
+
+    static MessagePriority getMessagePriority(MessageType type);
+
     static medida::Meter& getByteReadMeter(Application& app);
     static medida::Meter& getByteWriteMeter(Application& app);
 
+    // the part of the @p length bytes of a v0 AuthenticatedMessage at
+    // @p body that its MAC covers, so that it is checked against the bytes
+    // received instead of serializing the message again; the message must
+    // have been decoded from exactly these bytes
+    static ByteSlice getAuthenticatedBytes(uint8_t const* body,
+                                           size_t length);
+
   protected:
     Application& mApp;
 
@@ -74,9 +100,59 @@ class Peer : public std::enable_shared_from_this<Peer>,
     PeerBareAddress mAddress;
 
     VirtualTimer mIdleTimer;
+
+    // pull mode transaction flooding: hashes to advertise to the peer,
+    // sent when the batch is full or the timer expires
+    bool mPullMode{false};
+    TxAdvertVector mTxAdvertQueue;
+    VirtualTimer mTxAdvertTimer;
+
+    // compact tx sets: whether GET_TX_SET is answered with COMPACT_TX_SET
+    // (decided in recvHello), and the sets from the peer waiting for their
+    // missing transactions
+    bool mCompactTxSets{false};
+    std::map<Hash, std::shared_ptr<TxSetReconstruction>> mTxSetReconstructions;
+
+    // compression: the stream of the messages sent, only when they are
+    // compressed (decided in recvHello), and the one of the messages
+    // received, created with the first compressed one
+    std::unique_ptr<MessageDeflater> mDeflater;
+    std::unique_ptr<MessageInflater> mInflater;
+    std::vector<uint8_t> mInflateBuffer;
+
+    // highest slot of the SCP messages the peer sent us
+    uint64 mLatestSCPSlot{0};
+    // when the peer last got our SCP state it asked for
+    VirtualClock::time_point mLastSCPStateReply{
+        VirtualClock::time_point::min()};
     VirtualClock::time_point mLastRead;
     VirtualClock::time_point mLastWrite;
 
+    // network estimates, from the fetch requests (GET_TX_SET and
+    // GET_SCP_QUORUMSET) sent to the peer waiting for a reply
+    std::map<Hash, VirtualClock::time_point> mPendingFetches;
+    std::chrono::microseconds mLatencyEstimate{0};
+    double mThroughputEstimate{0}; // bytes per second
+
+    // traffic of this peer, for the peers route: by message type, the
+    // messages sent (as queued for the transport) and received (once
+    // authenticated), and their XDR bytes
+    struct TrafficCount
+    {
+        uint64_t mMessages{0};
+        uint64_t mBytes{0};
+    };
+    std::map<MessageType, TrafficCount> mSendTraffic;
+    std::map<MessageType, TrafficCount> mRecvTraffic;
+    // flooded messages (transactions and SCP messages) received from this
+    // peer, and those of them the Floodgate already had
+    uint64_t mFloodsReceived{0};
+    uint64_t mDuplicateFloods{0};
+    // fetch replies received, and their round trip times
+    uint64_t mFetchReplies{0};
+    std::chrono::microseconds mFetchLatencyTotal{0};
+    std::chrono::microseconds mFetchLatencyMax{0};
+
     medida::Meter& mMessageRead;
     medida::Meter& mMessageWrite;
     medida::Meter& mByteRead;
@@ -98,6 +174,12 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Timer& mRecvSCPQuorumSetTimer;
     medida::Timer& mRecvSCPMessageTimer;
     medida::Timer& mRecvGetSCPStateTimer;
+    medida::Timer& mRecvFloodAdvertTimer;
+    medida::Timer& mRecvFloodDemandTimer;
+    medida::Timer& mRecvCompactTxSetTimer;
+    medida::Timer& mRecvGetTxSetTxsTimer;
+    medida::Timer& mRecvTxSetTxsTimer;
+    medida::Timer& mRecvGetSCPStateDiffTimer;
 
     medida::Timer& mRecvSCPPrepareTimer;
     medida::Timer& mRecvSCPConfirmTimer;
@@ -112,11 +194,22 @@ class Peer : public std::enable_shared_from_this<Peer>,
     medida::Meter& mSendPeersMeter;
     medida::Meter& mSendGetTxSetMeter;
     medida::Meter& mSendTransactionMeter;
+    medida::Meter& mSendTransactionDropMeter;
     medida::Meter& mSendTxSetMeter;
     medida::Meter& mSendGetSCPQuorumSetMeter;
     medida::Meter& mSendSCPQuorumSetMeter;
     medida::Meter& mSendSCPMessageSetMeter;
     medida::Meter& mSendGetSCPStateMeter;
+    medida::Meter& mSendFloodAdvertMeter;
+    medida::Meter& mSendFloodDemandMeter;
+    medida::Meter& mSendCompactTxSetMeter;
+    medida::Meter& mSendGetTxSetTxsMeter;
+    medida::Meter& mSendTxSetTxsMeter;
+    medida::Meter& mSendGetSCPStateDiffMeter;
+    medida::Meter& mSCPStateRateLimitMeter;
+    medida::Meter& mCompactTxSetMissMeter;
+    medida::Meter& mCompressionInputMeter;
+    medida::Meter& mCompressionOutputMeter;
 
     medida::Meter& mDropInConnectHandlerMeter;
     medida::Meter& mDropInRecvMessageDecodeMeter;
@@ -138,7 +231,18 @@ class Peer : public std::enable_shared_from_this<Peer>,
 
     bool shouldAbort() const;
     void recvMessage(StellarMessage const& msg);
-    void recvMessage(AuthenticatedMessage const& msg);
+    // @p authenticated are the serialized sequence and message of @p msg,
+    // as received (see getAuthenticatedBytes)
+    void recvMessage(AuthenticatedMessage const& msg,
+                     ByteSlice const& authenticated);
+    // checks the MAC and sequence number of msg (to be called in the order
+    // messages were received), drops the peer and returns false on failure
+    bool checkMessageAuth(AuthenticatedMessage const& msg,
+                          ByteSlice const& authenticated);
+    // turns a compressed (v1) msg, once authenticated, into the v0 message
+    // it carries (to be called in the order messages were received), drops
+    // the peer and returns false on failure
+    bool decompressMessage(AuthenticatedMessage& msg);
     void recvMessage(xdr::msg_ptr const& xdrBytes);
 
     virtual void recvError(StellarMessage const& msg);
@@ -156,7 +260,31 @@ class Peer : public std::enable_shared_from_this<Peer>,
     void recvGetSCPQuorumSet(StellarMessage const& msg);
     void recvSCPQuorumSet(StellarMessage const& msg);
     void recvSCPMessage(StellarMessage const& msg);
+    void recvFloodAdvert(StellarMessage const& msg);
+    void recvFloodDemand(StellarMessage const& msg);
+    void recvCompactTxSet(StellarMessage const& msg);
+    void recvGetTxSetTxs(StellarMessage const& msg);
+    void recvTxSetTxs(StellarMessage const& msg);
+
+    // asks for the missing transactions of `reconstruction`, or hands the
+    // set to the herder when none is
+    void continueTxSetReconstruction(
+        std::shared_ptr<TxSetReconstruction> const& reconstruction);
+
+    void flushTxAdverts();
+
+    // @p isNew tells if OverlayManager::recvFloodedMsg saw the message for
+    // the first time
+    void noteFloodReceived(bool isNew);
+
+    void noteFetchRequest(Hash const& hash);
+    // the peer answered a fetch request with bytes of data (DONT_HAVE
+    // replies only count for the latency)
+    void noteFetchReply(Hash const& hash, size_t bytes);
     void recvGetSCPState(StellarMessage const& msg);
+    void recvGetSCPStateDiff(StellarMessage const& msg);
+    // false if the peer got our SCP state too recently to get it again
+    bool canReplySCPState();
 
     void sendHello();
     void sendAuth();
@@ -172,6 +300,25 @@ class Peer : public std::enable_shared_from_this<Peer>,
     // messages somewhere else. The async write request will point _into_
     // this owned buffer. This is really the best we can do.
     virtual void sendMessage(xdr::msg_ptr&& xdrBytes) = 0;
+
+    // Frames a serialized message as an AuthenticatedMessage, which uses up
+    // the next MAC sequence number.
+    xdr::msg_ptr authenticateMessage(MessageType type,
+                                     xdr::opaque_vec<> const& xdrMsg);
+
+    // Hands a serialized message over to the transport. By default it is
+    // framed and sent right away; a transport that queues messages must
+    // frame them in the order they are written out.
+    virtual void queueMessage(MessageType type,
+                              std::shared_ptr<xdr::opaque_vec<> const> xdrMsg);
+
+    // bytes queued for sending not written out yet
+    virtual size_t
+    getOutboundQueueBytes() const
+    {
+        return 0;
+    }
+
     virtual void
     connected()
     {
@@ -203,6 +350,48 @@ class Peer : public std::enable_shared_from_this<Peer>,
 
     void sendMessage(StellarMessage const& msg);
 
+    // smoothed round trip time of the fetch requests sent to the peer, 0 if
+    // none was answered yet
+    std::chrono::microseconds
+    getLatencyEstimate() const
+    {
+        return mLatencyEstimate;
+    }
+
+    // bytes per second the peer sent its larger replies at, 0 if unknown
+    double
+    getThroughputEstimate() const
+    {
+        return mThroughputEstimate;
+    }
+
+    // the traffic, duplicate floods and fetch latencies of the peer
+    Json::Value getJsonStats() const;
+
+    // saves the network estimates to the PeerRecord of the peer, for
+    // OverlayManager to favor fast peers when opening connections
+    void storeNetworkEstimatesInPeerRecord();
+
+    // true if new transactions are only advertised to this peer (decided in
+    // recvHello, based on the versions of both sides)
+    bool isPullModeEnabled() const;
+    // true if the large messages sent to this peer are compressed (decided
+    // in recvHello, based on the versions of both sides)
+    bool isCompressionEnabled() const;
+    // highest slot of the SCP messages received from this peer, 0 if none:
+    // a peer sending none for the current slot is behind
+    uint64
+    getLatestSCPSlot() const
+    {
+        return mLatestSCPSlot;
+    }
+    // queues the flood hash of a transaction to advertise to this peer
+    void advertiseTransaction(Hash const& hash);
+    // same as above, with the XDR encoding of msg already at hand (a message
+    // broadcast to every peer is only serialized once)
+    void sendMessage(StellarMessage const& msg,
+                     std::shared_ptr<xdr::opaque_vec<> const> const& xdrMsg);
+
     PeerRole
     getRole() const
     {
@@ -18,10 +18,20 @@ using asio::ip::tcp;
 using namespace std;
 
 PeerDoor::PeerDoor(Application& app)
-    : mApp(app), mAcceptor(mApp.getClock().getIOService())
+    : mApp(app)
+    , mAcceptService(app.getConfig().PEER_ACCEPT_THREAD
+                         ? std::make_unique<asio::io_service>()
+                         : nullptr)
+    , mAcceptor(mAcceptService ? *mAcceptService
+                               : mApp.getClock().getIOService())
 {
 }
 
+PeerDoor::~PeerDoor()
+{
+    close();
+}
+
 void
 PeerDoor::start()
 {
@@ -31,15 +41,40 @@ PeerDoor::start()
         CLOG(DEBUG, "Overlay") << "PeerDoor binding to endpoint " << endpoint;
         mAcceptor.open(endpoint.protocol());
         mAcceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+        asio::error_code ec;
+        TCPPeer::setBufferSizes(mApp.getConfig(), mAcceptor, ec);
+        if (ec)
+        {
+            CLOG(WARNING, "Overlay")
+                << "PeerDoor could not size the socket buffers: "
+                << ec.message();
+        }
         mAcceptor.bind(endpoint);
         mAcceptor.listen();
         acceptNextPeer();
+        if (mAcceptService)
+        {
+            mAcceptThread = std::thread([this]() { mAcceptService->run(); });
+        }
     }
 }
 
 void
 PeerDoor::close()
 {
+    if (mAcceptService)
+    {
+        // the acceptor is only used from its thread
+        mClosing = true;
+        if (mAcceptThread.joinable())
+        {
+            mAcceptService->post([this]() {
+                asio::error_code ec;
+                mAcceptor.close(ec);
+            });
+            mAcceptThread.join();
+        }
+    }
     if (mAcceptor.is_open())
     {
         asio::error_code ec;
@@ -51,7 +86,9 @@ PeerDoor::close()
 void
 PeerDoor::acceptNextPeer()
 {
-    if (mApp.getOverlayManager().isShuttingDown())
+    // the overlay is only looked at from the main thread
+    if (mAcceptService ? mClosing.load()
+                       : mApp.getOverlayManager().isShuttingDown())
     {
         return;
     }
@@ -59,13 +96,26 @@ PeerDoor::acceptNextPeer()
     CLOG(DEBUG, "Overlay") << "PeerDoor acceptNextPeer()";
     auto sock =
         make_shared<TCPPeer::SocketType>(mApp.getClock().getIOService());
-    mAcceptor.async_accept(sock->next_layer(),
-                           [this, sock](asio::error_code const& ec) {
-                               if (ec)
-                                   this->acceptNextPeer();
-                               else
-                                   this->handleKnock(sock);
-                           });
+    mAcceptor.async_accept(
+        sock->next_layer(), [this, sock](asio::error_code const& ec) {
+            if (!ec)
+            {
+                if (mAcceptService)
+                {
+                    mApp.getClock().getIOService().post([this, sock]() {
+                        if (!mApp.getOverlayManager().isShuttingDown())
+                        {
+                            this->handleKnock(sock);
+                        }
+                    });
+                }
+                else
+                {
+                    this->handleKnock(sock);
+                }
+            }
+            this->acceptNextPeer();
+        });
 }
 
 void
@@ -78,6 +128,5 @@ PeerDoor::handleKnock(shared_ptr<TCPPeer::SocketType> socket)
     {
         mApp.getOverlayManager().addPendingPeer(peer);
     }
-    acceptNextPeer();
 }
 }
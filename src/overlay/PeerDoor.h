@@ -6,11 +6,18 @@
 
 #include "util/asio.h"
 #include "TCPPeer.h"
+#include <atomic>
 #include <memory>
+#include <thread>
 
 /*
 listens for peer connections.
 When found passes them to the OverlayManagerImpl
+
+With PEER_ACCEPT_THREAD, connections are accepted by a thread of its own,
+running the acceptor's service, so that a busy main thread does not leave
+them waiting in the listen backlog: accepted sockets belong to the main
+service and are handed to it.
 */
 
 namespace stellar
@@ -22,6 +29,9 @@ class PeerDoor
 {
   protected:
     Application& mApp;
+    std::unique_ptr<asio::io_service> mAcceptService;
+    std::thread mAcceptThread;
+    std::atomic<bool> mClosing{false};
     asio::ip::tcp::acceptor mAcceptor;
 
     virtual void acceptNextPeer();
@@ -33,6 +43,7 @@ class PeerDoor
     typedef std::shared_ptr<PeerDoor> pointer;
 
     PeerDoor(Application&);
+    virtual ~PeerDoor();
 
     void start();
     void close();
@@ -5,8 +5,10 @@
 #include "overlay/PeerRecord.h"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "overlay/PeerTable.h"
 #include "overlay/StellarXDR.h"
 #include "util/Logging.h"
+#include "util/Math.h"
 #include "util/must_use.h"
 #include <algorithm>
 #include <cmath>
@@ -17,6 +19,11 @@
 #define SECONDS_PER_BACKOFF 10
 #define MAX_BACKOFF_EXPONENT 10
 
+// used by getExpectedFetchTime
+#define FETCH_ITEM_BYTES 32768
+#define UNKNOWN_LATENCY_MS 250
+#define UNKNOWN_THROUGHPUT 262144
+
 namespace stellar
 {
 
@@ -26,7 +33,8 @@ enum PeerRecordFlags
 };
 
 static const char* loadPeerRecordSelector =
-    "SELECT ip, port, nextattempt, numfailures, flags FROM peers ";
+    "SELECT ip, port, nextattempt, numfailures, flags, latency, throughput "
+    "FROM peers ";
 
 using namespace std;
 using namespace soci;
@@ -68,6 +76,10 @@ PeerRecord::loadPeerRecords(
     st.exchange(into(numFailures));
     int flags;
     st.exchange(into(flags));
+    int latency;
+    st.exchange(into(latency));
+    int throughput;
+    st.exchange(into(throughput));
 
     st.define_and_bind();
     {
@@ -83,6 +95,8 @@ PeerRecord::loadPeerRecords(
             auto pr = PeerRecord{address, VirtualClock::tmToPoint(nextAttempt),
                                  numFailures};
             pr.setPreferred((flags & PEER_RECORD_FLAGS_PREFERRED) != 0);
+            pr.mLatencyMs = static_cast<uint32_t>(latency);
+            pr.mThroughput = static_cast<uint32_t>(throughput);
 
             if (!peerRecordProcessor(pr))
             {
@@ -95,6 +109,17 @@ PeerRecord::loadPeerRecords(
 
 optional<PeerRecord>
 PeerRecord::loadPeerRecord(Database& db, PeerBareAddress const& address)
+{
+    if (auto table = db.getPeerTable())
+    {
+        return table->find(db, address);
+    }
+    return loadPeerRecordFromDatabase(db, address);
+}
+
+optional<PeerRecord>
+PeerRecord::loadPeerRecordFromDatabase(Database& db,
+                                       PeerBareAddress const& address)
 {
     std::string sql = loadPeerRecordSelector;
     sql += "WHERE ip = :v1 AND port = :v2";
@@ -117,11 +142,24 @@ PeerRecord::loadPeerRecord(Database& db, PeerBareAddress const& address)
     return r;
 }
 
+void
+PeerRecord::loadAllPeerRecords(Database& db,
+                               std::function<bool(PeerRecord const&)> pred)
+{
+    auto prep = db.getPreparedStatement(loadPeerRecordSelector);
+    loadPeerRecords(db, prep, pred);
+}
+
 void
 PeerRecord::loadPeerRecords(Database& db, int batchSize,
                             VirtualClock::time_point nextAttemptCutoff,
                             std::function<bool(PeerRecord const& pr)> pred)
 {
+    if (auto table = db.getPeerTable())
+    {
+        table->forEach(db, nextAttemptCutoff, pred);
+        return;
+    }
     try
     {
         int offset = 0;
@@ -170,10 +208,20 @@ PeerRecord::setPreferred(bool p)
 
 bool
 PeerRecord::insertIfNew(Database& db)
+{
+    if (auto table = db.getPeerTable())
+    {
+        return table->insertIfNew(db, *this);
+    }
+    return insertIfNewInDatabase(db);
+}
+
+bool
+PeerRecord::insertIfNewInDatabase(Database& db)
 {
     auto tm = VirtualClock::pointToTm(mNextAttempt);
 
-    auto other = loadPeerRecord(db, mAddress);
+    auto other = loadPeerRecordFromDatabase(db, mAddress);
 
     if (other)
     {
@@ -183,8 +231,9 @@ PeerRecord::insertIfNew(Database& db)
     {
         auto prep = db.getPreparedStatement(
             "INSERT INTO peers "
-            "( ip,  port, nextattempt, numfailures, flags) VALUES "
-            "(:v1, :v2,  :v3,         :v4,          :v5)");
+            "( ip,  port, nextattempt, numfailures, flags, latency, "
+            "throughput) VALUES "
+            "(:v1, :v2,  :v3,         :v4,          :v5,   :v6,     :v7)");
         auto& st = prep.statement();
         auto ip = mAddress.getIP();
         st.exchange(use(ip));
@@ -194,6 +243,10 @@ PeerRecord::insertIfNew(Database& db)
         st.exchange(use(mNumFailures));
         int flags = (mIsPreferred ? PEER_RECORD_FLAGS_PREFERRED : 0);
         st.exchange(use(flags));
+        int latency = static_cast<int>(mLatencyMs);
+        st.exchange(use(latency));
+        int throughput = static_cast<int>(mThroughput);
+        st.exchange(use(throughput));
 
         st.define_and_bind();
         {
@@ -207,19 +260,36 @@ PeerRecord::insertIfNew(Database& db)
 void
 PeerRecord::storePeerRecord(Database& db)
 {
-    if (!insertIfNew(db))
+    if (auto table = db.getPeerTable())
+    {
+        table->store(db, *this);
+        return;
+    }
+    storeInDatabase(db);
+}
+
+void
+PeerRecord::storeInDatabase(Database& db)
+{
+    if (!insertIfNewInDatabase(db))
     {
         auto tm = VirtualClock::pointToTm(mNextAttempt);
         auto prep = db.getPreparedStatement("UPDATE peers SET "
                                             "nextattempt = :v1, "
                                             "numfailures = :v2, "
-                                            "flags = :v3 "
-                                            "WHERE ip = :v4 AND port = :v5");
+                                            "flags = :v3, "
+                                            "latency = :v4, "
+                                            "throughput = :v5 "
+                                            "WHERE ip = :v6 AND port = :v7");
         auto& st = prep.statement();
         st.exchange(use(tm));
         st.exchange(use(mNumFailures));
         int flags = (mIsPreferred ? PEER_RECORD_FLAGS_PREFERRED : 0);
         st.exchange(use(flags));
+        int latency = static_cast<int>(mLatencyMs);
+        st.exchange(use(latency));
+        int throughput = static_cast<int>(mThroughput);
+        st.exchange(use(throughput));
         auto ip = mAddress.getIP();
         st.exchange(use(ip));
         int port = mAddress.getPort();
@@ -237,6 +307,15 @@ PeerRecord::storePeerRecord(Database& db)
     }
 }
 
+std::chrono::milliseconds
+PeerRecord::getExpectedFetchTime() const
+{
+    uint64_t latency = mLatencyMs != 0 ? mLatencyMs : UNKNOWN_LATENCY_MS;
+    uint64_t throughput = mThroughput != 0 ? mThroughput : UNKNOWN_THROUGHPUT;
+    return std::chrono::milliseconds(latency +
+                                     FETCH_ITEM_BYTES * 1000 / throughput);
+}
+
 void
 PeerRecord::resetBackOff(VirtualClock& clock)
 {
@@ -262,8 +341,8 @@ PeerRecord::computeBackoff(VirtualClock& clock)
 {
     int32 backoffCount = std::min<int32>(MAX_BACKOFF_EXPONENT, mNumFailures);
 
-    auto nsecs = std::chrono::seconds(
-        std::rand() % int(std::pow(2, backoffCount) * SECONDS_PER_BACKOFF) + 1);
+    auto nsecs = std::chrono::seconds(rand_uniform<int32>(
+        1, int32(std::pow(2, backoffCount) * SECONDS_PER_BACKOFF)));
     mNextAttempt = clock.now() + nsecs;
     return nsecs;
 }
@@ -277,6 +356,10 @@ PeerRecord::toString() const
 void
 PeerRecord::dropAll(Database& db)
 {
+    if (auto table = db.getPeerTable())
+    {
+        table->clear();
+    }
     db.getSession() << "DROP TABLE IF EXISTS peers;";
     db.getSession() << kSQLCreateStatement;
 }
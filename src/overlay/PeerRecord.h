@@ -25,6 +25,12 @@ class PeerRecord
     VirtualClock::time_point mNextAttempt;
     int mNumFailures;
 
+    // network estimates from the last connection to the peer, 0 if unknown:
+    // smoothed round trip time of its replies to our fetch requests, and
+    // the rate it sent us the larger of these replies at
+    uint32_t mLatencyMs{0};
+    uint32_t mThroughput{0}; // bytes per second
+
     /**
      * Create new PeerRecord object. If preconditions are not met - exception
      * is thrown.
@@ -40,7 +46,9 @@ class PeerRecord
     {
         return mAddress == other.mAddress &&
                mNextAttempt == other.mNextAttempt &&
-               mNumFailures == other.mNumFailures;
+               mNumFailures == other.mNumFailures &&
+               mLatencyMs == other.mLatencyMs &&
+               mThroughput == other.mThroughput;
     }
 
     /**
@@ -73,6 +81,11 @@ class PeerRecord
     // insert or update record from database
     void storePeerRecord(Database& db);
 
+    // expected time to fetch a typical item from the peer, based on the
+    // network estimates (unknown ones are given an average value, so that
+    // new peers are tried before the slow ones)
+    std::chrono::milliseconds getExpectedFetchTime() const;
+
     void resetBackOff(VirtualClock& clock);
     void backOff(VirtualClock& clock);
 
@@ -82,6 +95,17 @@ class PeerRecord
     std::string toString() const;
 
   private:
+    friend class PeerTable;
+
+    // the SQL behind the functions above, used directly without a PeerTable
+    static optional<PeerRecord>
+    loadPeerRecordFromDatabase(Database& db, PeerBareAddress const& address);
+    static void
+    loadAllPeerRecords(Database& db,
+                       std::function<bool(PeerRecord const&)> pred);
+    bool insertIfNewInDatabase(Database& db);
+    void storeInDatabase(Database& db);
+
     // peerRecordProcessor returns false if we should stop processing entries
     static void
     loadPeerRecords(Database& db, StatementContext& prep,
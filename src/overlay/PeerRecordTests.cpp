@@ -7,6 +7,7 @@
 #include "lib/catch.hpp"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "overlay/PeerTable.h"
 #include "overlay/StellarXDR.h"
 #include "test/TestUtils.h"
 #include "test/test.h"
@@ -59,6 +60,8 @@ TEST_CASE("toXdr", "[overlay][PeerRecord]")
         other.storePeerRecord(app->getDatabase());
 
         pr.mNextAttempt = pr.mNextAttempt + chrono::seconds(12);
+        pr.mLatencyMs = 42;
+        pr.mThroughput = 1000000;
         pr.storePeerRecord(app->getDatabase());
         auto actual1 =
             PeerRecord::loadPeerRecord(app->getDatabase(), pr.getAddress());
@@ -70,6 +73,92 @@ TEST_CASE("toXdr", "[overlay][PeerRecord]")
     }
 }
 
+TEST_CASE("in memory peer table", "[overlay][PeerRecord]")
+{
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.IN_MEMORY_PEER_TABLE = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& db = app->getDatabase();
+    auto table = db.getPeerTable();
+    REQUIRE(table);
+    table->flush(db);
+
+    auto countRows = [&]() {
+        int n = 0;
+        db.getSession() << "SELECT COUNT(*) FROM peers", soci::into(n);
+        return n;
+    };
+    auto rowsBefore = countRows();
+
+    auto now = clock.now();
+    PeerRecord late(PeerBareAddress{"1.2.3.4", 15}, now + chrono::seconds(5));
+    PeerRecord early(PeerBareAddress{"1.2.3.5", 15}, now, 3);
+    PeerRecord ready(PeerBareAddress{"1.2.3.6", 15}, now, 1);
+    REQUIRE(late.insertIfNew(db));
+    REQUIRE(early.insertIfNew(db));
+    REQUIRE(!early.insertIfNew(db));
+    ready.storePeerRecord(db);
+    REQUIRE(table->getDirtyCount() == 3);
+
+    // nothing written yet
+    REQUIRE(countRows() == rowsBefore);
+    REQUIRE(*PeerRecord::loadPeerRecord(db, early.getAddress()) == early);
+
+    // by next attempt, then failures
+    auto loadReady = [&]() {
+        std::vector<PeerBareAddress> res;
+        PeerRecord::loadPeerRecords(db, 10, now, [&](PeerRecord const& pr) {
+            if (pr.getAddress().getIP().compare(0, 6, "1.2.3.") == 0)
+            {
+                res.push_back(pr.getAddress());
+            }
+            return true;
+        });
+        return res;
+    };
+    auto loaded = loadReady();
+    REQUIRE(loaded.size() == 2);
+    REQUIRE(loaded[0] == ready.getAddress());
+    REQUIRE(loaded[1] == early.getAddress());
+
+    // a change moves the record in the index
+    ready.backOff(clock);
+    ready.storePeerRecord(db);
+    loaded = loadReady();
+    REQUIRE(loaded.size() == 1);
+    REQUIRE(loaded[0] == early.getAddress());
+
+    REQUIRE(table->flush(db) == 3);
+    REQUIRE(table->getDirtyCount() == 0);
+    REQUIRE(countRows() == rowsBefore + 3);
+    REQUIRE(table->flush(db) == 0);
+
+    // loaded again from the database
+    table->clear();
+    REQUIRE(*PeerRecord::loadPeerRecord(db, ready.getAddress()) == ready);
+    REQUIRE(*PeerRecord::loadPeerRecord(db, late.getAddress()) == late);
+    REQUIRE(loadReady().size() == 1);
+}
+
+TEST_CASE("expected fetch time", "[overlay][PeerRecord]")
+{
+    VirtualClock clock;
+    PeerRecord unknown(PeerBareAddress{"1.2.3.4", 15}, clock.now());
+    PeerRecord fast(unknown);
+    fast.mLatencyMs = 20;
+    fast.mThroughput = 10000000;
+    PeerRecord slow(unknown);
+    slow.mLatencyMs = 800;
+    slow.mThroughput = 50000;
+    PeerRecord narrow(fast);
+    narrow.mThroughput = 10000;
+
+    REQUIRE(fast.getExpectedFetchTime() < unknown.getExpectedFetchTime());
+    REQUIRE(unknown.getExpectedFetchTime() < slow.getExpectedFetchTime());
+    REQUIRE(unknown.getExpectedFetchTime() < narrow.getExpectedFetchTime());
+}
+
 TEST_CASE("private addresses", "[overlay][PeerRecord]")
 {
     PeerBareAddress pa("1.2.3.4", 15);
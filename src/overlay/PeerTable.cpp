@@ -0,0 +1,140 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerTable.h"
+#include "database/Database.h"
+#include "util/Logging.h"
+
+#include <soci.h>
+
+namespace stellar
+{
+
+void
+PeerTable::load(Database& db)
+{
+    mRecords.clear();
+    mByNextAttempt.clear();
+    mDirty.clear();
+    PeerRecord::loadAllPeerRecords(db, [this](PeerRecord const& pr) {
+        put(pr);
+        return true;
+    });
+    mLoaded = true;
+    CLOG(DEBUG, "Overlay") << "Loaded " << mRecords.size() << " peers";
+}
+
+void
+PeerTable::put(PeerRecord const& pr)
+{
+    auto key = pr.toString();
+    auto it = mRecords.find(key);
+    if (it != mRecords.end())
+    {
+        mByNextAttempt.erase(AttemptKey{it->second.mNextAttempt,
+                                        it->second.mNumFailures, key});
+        it->second = pr;
+    }
+    else
+    {
+        mRecords.emplace(key, pr);
+    }
+    mByNextAttempt.emplace(pr.mNextAttempt, pr.mNumFailures, key);
+}
+
+optional<PeerRecord>
+PeerTable::find(Database& db, PeerBareAddress const& address)
+{
+    if (!mLoaded)
+    {
+        load(db);
+    }
+    auto it = mRecords.find(address.toString());
+    if (it == mRecords.end())
+    {
+        return nullopt<PeerRecord>();
+    }
+    return make_optional<PeerRecord>(it->second);
+}
+
+bool
+PeerTable::insertIfNew(Database& db, PeerRecord const& pr)
+{
+    if (!mLoaded)
+    {
+        load(db);
+    }
+    auto key = pr.toString();
+    if (mRecords.find(key) != mRecords.end())
+    {
+        return false;
+    }
+    put(pr);
+    mDirty.insert(key);
+    return true;
+}
+
+void
+PeerTable::store(Database& db, PeerRecord const& pr)
+{
+    if (!mLoaded)
+    {
+        load(db);
+    }
+    put(pr);
+    mDirty.insert(pr.toString());
+}
+
+void
+PeerTable::forEach(Database& db, VirtualClock::time_point nextAttemptCutoff,
+                   std::function<bool(PeerRecord const&)> pred)
+{
+    if (!mLoaded)
+    {
+        load(db);
+    }
+    for (auto const& k : mByNextAttempt)
+    {
+        if (std::get<0>(k) > nextAttemptCutoff)
+        {
+            break;
+        }
+        if (!pred(mRecords.at(std::get<2>(k))))
+        {
+            break;
+        }
+    }
+}
+
+size_t
+PeerTable::flush(Database& db)
+{
+    if (mDirty.empty())
+    {
+        return 0;
+    }
+    size_t res = 0;
+    {
+        soci::transaction tx(db.getSession());
+        for (auto const& key : mDirty)
+        {
+            mRecords.at(key).storeInDatabase(db);
+            res++;
+        }
+        tx.commit();
+    }
+    mDirty.clear();
+    CLOG(TRACE, "Overlay") << "Flushed " << res << " peers";
+    return res;
+}
+
+void
+PeerTable::clear()
+{
+    mLoaded = false;
+    mRecords.clear();
+    mByNextAttempt.clear();
+    mDirty.clear();
+}
+}
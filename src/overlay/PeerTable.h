@@ -0,0 +1,75 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerRecord.h"
+#include "util/NonCopyable.h"
+#include "util/Timer.h"
+#include "util/optional.h"
+
+#include <functional>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace stellar
+{
+class Database;
+
+/**
+ * Optional resident copy of the peers table (for IN_MEMORY_PEER_TABLE), so
+ * that the peer addresses learned from PEERS messages and the back offs of
+ * every connection attempt do not each issue statements on the main session.
+ *
+ * Records are indexed by address and by next attempt, then number of
+ * failures, the order PeerRecord::loadPeerRecords walks them in; preferred
+ * peers, reset to the epoch, come first. Changes are only made in memory and
+ * marked dirty: flush writes them to the peers table in one transaction (the
+ * overlay does it on every tick, and on shutdown). The table is loaded from
+ * SQL on first use.
+ *
+ * Only used from the main thread.
+ */
+class PeerTable : NonMovableOrCopyable
+{
+    typedef std::tuple<VirtualClock::time_point, int, std::string> AttemptKey;
+
+    bool mLoaded{false};
+    std::unordered_map<std::string, PeerRecord> mRecords;
+    std::set<AttemptKey> mByNextAttempt;
+    std::unordered_set<std::string> mDirty;
+
+    void load(Database& db);
+    void put(PeerRecord const& pr);
+
+  public:
+    optional<PeerRecord> find(Database& db, PeerBareAddress const& address);
+
+    // returns true if inserted
+    bool insertIfNew(Database& db, PeerRecord const& pr);
+    void store(Database& db, PeerRecord const& pr);
+
+    // Records with a next attempt up to @p nextAttemptCutoff, in the order of
+    // the index, until @p pred returns false; @p pred must not change the
+    // table.
+    void forEach(Database& db, VirtualClock::time_point nextAttemptCutoff,
+                 std::function<bool(PeerRecord const&)> pred);
+
+    // Writes the records changed since the last flush, returns how many.
+    size_t flush(Database& db);
+
+    size_t
+    getDirtyCount() const
+    {
+        return mDirty.size();
+    }
+
+    // Forget everything, changes not flushed included; the table is loaded
+    // again on next use.
+    void clear();
+};
+}
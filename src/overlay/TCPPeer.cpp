@@ -16,6 +16,9 @@
 #include "util/Logging.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace soci;
 
 namespace stellar
@@ -23,6 +26,16 @@ namespace stellar
 
 using namespace std;
 
+// upper bound on the bytes handed to a single vectored write (a larger
+// message is still written, on its own)
+static size_t const MAX_WRITE_BATCH_BYTES = 256 * 1024;
+
+// messages each priority lane gets to send per round, when all are busy
+static int const LANE_WEIGHTS[Peer::PRIORITY_COUNT] = {8, 4, 2, 1};
+
+// size of the buffer a peer reads into, grown as needed for larger frames
+static size_t const READ_BUFFER_SIZE = 64 * 1024;
+
 ///////////////////////////////////////////////////////////////////////
 // TCPPeer
 ///////////////////////////////////////////////////////////////////////
@@ -31,6 +44,8 @@ TCPPeer::TCPPeer(Application& app, Peer::PeerRole role,
                  std::shared_ptr<TCPPeer::SocketType> socket)
     : Peer(app, role), mSocket(socket)
 {
+    std::copy(std::begin(LANE_WEIGHTS), std::end(LANE_WEIGHTS),
+              std::begin(mOutboundCredits));
 }
 
 TCPPeer::pointer
@@ -47,13 +62,24 @@ TCPPeer::initiate(Application& app, PeerBareAddress const& address)
     result->startIdleTimer();
     asio::ip::tcp::endpoint endpoint(
         asio::ip::address::from_string(address.getIP()), address.getPort());
+    // the buffers are sized before connecting, the window scale is
+    // negotiated with the connection
+    asio::error_code openError;
+    socket->next_layer().open(endpoint.protocol(), openError);
+    if (!openError)
+    {
+        setBufferSizes(app.getConfig(), socket->next_layer(), openError);
+    }
     socket->next_layer().async_connect(
-        endpoint, [result](asio::error_code const& error) {
+        endpoint, [result, openError](asio::error_code const& error) {
             asio::error_code ec;
-            if (!error)
+            if (openError)
+            {
+                ec = openError;
+            }
+            else if (!error)
             {
-                asio::ip::tcp::no_delay nodelay(true);
-                result->mSocket->next_layer().set_option(nodelay, ec);
+                setSocketOptions(result->getApp(), *result->mSocket, ec);
             }
             else
             {
@@ -72,8 +98,7 @@ TCPPeer::accept(Application& app, shared_ptr<TCPPeer::SocketType> socket)
     shared_ptr<TCPPeer> result;
     asio::error_code ec;
 
-    asio::ip::tcp::no_delay nodelay(true);
-    socket->next_layer().set_option(nodelay, ec);
+    setSocketOptions(app, *socket, ec);
 
     if (!ec)
     {
@@ -93,6 +118,19 @@ TCPPeer::accept(Application& app, shared_ptr<TCPPeer::SocketType> socket)
     return result;
 }
 
+void
+TCPPeer::setSocketOptions(Application& app, SocketType& socket,
+                          asio::error_code& ec)
+{
+    auto const& cfg = app.getConfig();
+    auto& s = socket.next_layer();
+    s.set_option(asio::ip::tcp::no_delay(cfg.PEER_TCP_NODELAY), ec);
+    if (!ec && cfg.PEER_TCP_KEEPALIVE)
+    {
+        s.set_option(asio::socket_base::keep_alive(true), ec);
+    }
+}
+
 TCPPeer::~TCPPeer()
 {
     assertThreadIsMain();
@@ -145,16 +183,93 @@ TCPPeer::sendMessage(xdr::msg_ptr&& xdrBytes)
 
     // places the buffer to write into the write queue
     auto buf = std::make_shared<xdr::msg_ptr>(std::move(xdrBytes));
+    mOutboundQueueBytes += (*buf)->raw_size();
+    mWriteQueue.emplace(buf);
+    startWriting();
+}
 
-    auto self = static_pointer_cast<TCPPeer>(shared_from_this());
+void
+TCPPeer::queueMessage(MessageType type,
+                      std::shared_ptr<xdr::opaque_vec<> const> xdrMsg)
+{
+    if (mState == CLOSING)
+    {
+        CLOG(ERROR, "Overlay")
+            << "Trying to send message to " << toString() << " after drop";
+        return;
+    }
+    assertThreadIsMain();
 
-    self->mWriteQueue.emplace(buf);
+    mOutboundQueueBytes += xdrMsg->size();
+    mOutboundLanes[getMessagePriority(type)].emplace(
+        QueuedMessage{type, std::move(xdrMsg)});
+    startWriting();
+}
 
-    if (!self->mWriting)
+size_t
+TCPPeer::getOutboundQueueBytes() const
+{
+    return mOutboundQueueBytes;
+}
+
+int
+TCPPeer::nextOutboundLane()
+{
+    // weighted round robin: within a round, every lane sends up to its
+    // weight in messages, higher priorities first. A round ends when no
+    // lane with messages has credits left.
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < PRIORITY_COUNT; i++)
+        {
+            if (!mOutboundLanes[i].empty() && mOutboundCredits[i] > 0)
+            {
+                return i;
+            }
+        }
+        std::copy(std::begin(LANE_WEIGHTS), std::end(LANE_WEIGHTS),
+                  std::begin(mOutboundCredits));
+    }
+    return -1;
+}
+
+bool
+TCPPeer::frameNextMessage()
+{
+    auto lane = nextOutboundLane();
+    if (lane < 0)
     {
-        self->mWriting = true;
+        return false;
+    }
+    --mOutboundCredits[lane];
+    auto& queued = mOutboundLanes[lane].front();
+    auto buf = std::make_shared<xdr::msg_ptr>(
+        authenticateMessage(queued.mType, *queued.mXdr));
+    mOutboundQueueBytes += (*buf)->raw_size();
+    mOutboundQueueBytes -= queued.mXdr->size();
+    mWriteQueue.emplace(buf);
+    mOutboundLanes[lane].pop();
+    return true;
+}
+
+bool
+TCPPeer::hasPendingWrites() const
+{
+    return !mWriteQueue.empty() ||
+           std::any_of(std::begin(mOutboundLanes), std::end(mOutboundLanes),
+                       [](std::queue<QueuedMessage> const& lane) {
+                           return !lane.empty();
+                       });
+}
+
+void
+TCPPeer::startWriting()
+{
+    if (!mWriting)
+    {
+        mWriting = true;
         // kick off the async write chain if we're the first one
-        self->messageSender();
+        messageSender();
     }
 }
 
@@ -224,13 +339,13 @@ TCPPeer::messageSender()
     auto self = static_pointer_cast<TCPPeer>(shared_from_this());
 
     // if nothing to do, flush and return
-    if (mWriteQueue.empty())
+    if (!hasPendingWrites())
     {
         mSocket->async_flush([self](asio::error_code const& ec, std::size_t) {
             self->writeHandler(ec, 0);
             if (!ec)
             {
-                if (!self->mWriteQueue.empty())
+                if (self->hasPendingWrites())
                 {
                     self->messageSender();
                 }
@@ -249,23 +364,44 @@ TCPPeer::messageSender()
         return;
     }
 
-    // peek the buffer from the queue
-    // do not remove it yet as we need the buffer for the duration of the
-    // write operation
-    auto buf = mWriteQueue.front();
-
-    asio::async_write(*(mSocket.get()),
-                      asio::buffer((*buf)->raw_data(), (*buf)->raw_size()),
-                      [self](asio::error_code const& ec, std::size_t length) {
-                          self->writeHandler(ec, length);
-                          self->mWriteQueue.pop(); // done with front element
-
-                          // continue processing the queue/flush
-                          if (!ec)
-                          {
-                              self->messageSender();
-                          }
-                      });
+    // move as many messages as the budget allows to the batch, which keeps
+    // the buffers alive for the duration of the write operation
+    assert(mWriteBatch.empty());
+    mWriteBuffers.clear();
+    size_t batchBytes = 0;
+    while ((!mWriteQueue.empty() || frameNextMessage()) &&
+           (mWriteBatch.empty() ||
+            batchBytes + (*mWriteQueue.front())->raw_size() <=
+                MAX_WRITE_BATCH_BYTES))
+    {
+        auto const& buf = mWriteQueue.front();
+        batchBytes += (*buf)->raw_size();
+        mWriteBuffers.emplace_back(
+            asio::buffer((*buf)->raw_data(), (*buf)->raw_size()));
+        mWriteBatch.emplace_back(buf);
+        mWriteQueue.pop();
+    }
+
+    // one gathering write on the socket itself: going through the buffered
+    // stream would copy the messages into its (small) buffer first. All
+    // writes are issued from here, so nothing is ever left in that buffer.
+    asio::async_write(
+        mSocket->next_layer(), mWriteBuffers,
+        [self, batchBytes](asio::error_code const& ec, std::size_t length) {
+            self->writeHandler(ec, length);
+            if (!ec)
+            {
+                self->mMessageWrite.Mark(self->mWriteBatch.size());
+            }
+            self->mOutboundQueueBytes -= batchBytes;
+            self->mWriteBatch.clear(); // done with the batch
+
+            // continue processing the queue/flush
+            if (!ec)
+            {
+                self->messageSender();
+            }
+        });
 }
 
 void
@@ -299,7 +435,6 @@ TCPPeer::writeHandler(asio::error_code const& error,
     else if (bytes_transferred != 0)
     {
         LoadManager::PeerContext loadCtx(mApp, mPeerID);
-        mMessageWrite.Mark();
         mByteWrite.Mark(bytes_transferred);
     }
 }
@@ -315,35 +450,63 @@ TCPPeer::startRead()
 
     auto self = static_pointer_cast<TCPPeer>(shared_from_this());
 
-    assert(self->mIncomingHeader.size() == 0);
+    // move the unparsed bytes to the front, and make room for the rest of
+    // the frame they start (if known)
+    size_t pending = mReadEnd - mReadStart;
+    if (mReadStart != 0)
+    {
+        std::memmove(mReadBuffer.data(), mReadBuffer.data() + mReadStart,
+                     pending);
+        mReadStart = 0;
+        mReadEnd = pending;
+    }
+    size_t needed = READ_BUFFER_SIZE;
+    if (pending >= 4)
+    {
+        needed = std::max(needed, 4 + getIncomingMsgLength(mReadBuffer.data()));
+    }
+    if (mReadBuffer.size() != needed)
+    {
+        // grows for large frames, shrinks back afterwards
+        mReadBuffer.resize(needed);
+        mReadBuffer.shrink_to_fit();
+    }
 
     if (Logging::logTrace("Overlay"))
         CLOG(TRACE, "Overlay") << "TCPPeer::startRead to " << self->toString();
 
-    self->mIncomingHeader.resize(4);
-    asio::async_read(*(self->mSocket.get()),
-                     asio::buffer(self->mIncomingHeader),
-                     [self](asio::error_code ec, std::size_t length) {
-                         if (Logging::logTrace("Overlay"))
-                             CLOG(TRACE, "Overlay")
-                                 << "TCPPeer::startRead calledback " << ec
-                                 << " length:" << length;
-                         self->readHeaderHandler(ec, length);
-                     });
+    // reads from the socket itself: the buffered stream would cap every
+    // read to the size of its own buffer. All reads are issued from here, so
+    // nothing is ever left in that buffer.
+    mSocket->next_layer().async_read_some(
+        asio::buffer(mReadBuffer.data() + mReadEnd,
+                     mReadBuffer.size() - mReadEnd),
+        [self](asio::error_code ec, std::size_t length) {
+            if (Logging::logTrace("Overlay"))
+                CLOG(TRACE, "Overlay") << "TCPPeer::startRead calledback "
+                                       << ec << " length:" << length;
+            self->readHandler(ec, length);
+        });
 }
 
-int
-TCPPeer::getIncomingMsgLength()
+size_t
+TCPPeer::getIncomingMsgLength(uint8_t const* header) const
 {
-    int length = mIncomingHeader[0];
+    size_t length = header[0];
     length &= 0x7f; // clear the XDR 'continuation' bit
     length <<= 8;
-    length |= mIncomingHeader[1];
+    length |= header[1];
     length <<= 8;
-    length |= mIncomingHeader[2];
+    length |= header[2];
     length <<= 8;
-    length |= mIncomingHeader[3];
-    if (length <= 0 ||
+    length |= header[3];
+    return length;
+}
+
+bool
+TCPPeer::isIncomingMsgLengthAcceptable(size_t length)
+{
+    if (length == 0 ||
         (!isAuthenticated() && (length > MAX_UNAUTH_MESSAGE_SIZE)) ||
         length > MAX_MESSAGE_SIZE)
     {
@@ -352,9 +515,9 @@ TCPPeer::getIncomingMsgLength()
             << "TCP: message size unacceptable: " << length
             << (isAuthenticated() ? "" : " while not authenticated");
         drop();
-        length = 0;
+        return false;
     }
-    return (length);
+    return true;
 }
 
 void
@@ -364,92 +527,103 @@ TCPPeer::connected()
 }
 
 void
-TCPPeer::readHeaderHandler(asio::error_code const& error,
-                           std::size_t bytes_transferred)
+TCPPeer::readHandler(asio::error_code const& error,
+                     std::size_t bytes_transferred)
 {
     assertThreadIsMain();
-    // LOG(DEBUG) << "TCPPeer::readHeaderHandler "
-    //     << "@" << mApp.getConfig().PEER_PORT
-    //     << " to " << mRemoteListeningPort
-    //     << (error ? "error " : "") << " bytes:" << bytes_transferred;
 
-    if (!error)
-    {
-        receivedBytes(bytes_transferred, false);
-        int length = getIncomingMsgLength();
-        if (length != 0)
-        {
-            mIncomingBody.resize(length);
-            auto self = static_pointer_cast<TCPPeer>(shared_from_this());
-            asio::async_read(*mSocket.get(), asio::buffer(mIncomingBody),
-                             [self](asio::error_code ec, std::size_t length) {
-                                 self->readBodyHandler(ec, length);
-                             });
-        }
-    }
-    else
+    if (error)
     {
         if (isConnected())
         {
             // Only emit a warning if we have an error while connected;
             // errors during shutdown or connection are common/expected.
             mErrorRead.Mark();
-            CLOG(ERROR, "Overlay")
-                << "readHeaderHandler error: " << error.message() << " :"
-                << toString();
+            CLOG(ERROR, "Overlay") << "readHandler error: " << error.message()
+                                   << " :" << toString();
         }
         drop();
+        return;
     }
-}
 
-void
-TCPPeer::readBodyHandler(asio::error_code const& error,
-                         std::size_t bytes_transferred)
-{
-    assertThreadIsMain();
-    // LOG(DEBUG) << "TCPPeer::readBodyHandler "
-    //     << "@" << mApp.getConfig().PEER_PORT
-    //     << " to " << mRemoteListeningPort
-    //     << (error ? "error " : "") << " bytes:" << bytes_transferred;
+    receivedBytes(bytes_transferred, false);
+    mReadEnd += bytes_transferred;
 
-    if (!error)
+    // process every complete frame received so far. Once the peer is
+    // authenticated, messages received together are handled by priority:
+    // each of them is still authenticated and decompressed right away, as
+    // the MAC sequence numbers must be checked, and the compressed stream
+    // read, in order.
+    std::vector<AuthenticatedMessage> received[PRIORITY_COUNT];
+    while (mReadEnd - mReadStart >= 4)
     {
-        receivedBytes(bytes_transferred, true);
-        recvMessage();
-        mIncomingHeader.clear();
-        startRead();
+        auto frame = mReadBuffer.data() + mReadStart;
+        auto length = getIncomingMsgLength(frame);
+        if (!isIncomingMsgLengthAcceptable(length))
+        {
+            return;
+        }
+        if (mReadEnd - mReadStart < 4 + length)
+        {
+            break;
+        }
+        mReadStart += 4 + length;
+        receivedBytes(0, true);
+
+        AuthenticatedMessage am;
+        if (!decodeMessage(frame + 4, length, am))
+        {
+            return;
+        }
+        auto authenticated = getAuthenticatedBytes(frame + 4, length);
+        if (!isAuthenticated())
+        {
+            Peer::recvMessage(am, authenticated);
+        }
+        else if (checkMessageAuth(am, authenticated) &&
+                 decompressMessage(am))
+        {
+            auto priority = getMessagePriority(am.v0().message.type());
+            received[priority].emplace_back(std::move(am));
+        }
+        if (shouldAbort())
+        {
+            return;
+        }
     }
-    else
+
+    for (auto const& lane : received)
     {
-        if (isConnected())
+        for (auto const& am : lane)
         {
-            // Only emit a warning if we have an error while connected;
-            // errors during shutdown or connection are common/expected.
-            mErrorRead.Mark();
-            CLOG(ERROR, "Overlay")
-                << "readBodyHandler error: " << error.message() << " :"
-                << toString();
+            Peer::recvMessage(am.v0().message);
+            if (shouldAbort())
+            {
+                return;
+            }
         }
-        drop();
     }
+    startRead();
 }
 
-void
-TCPPeer::recvMessage()
+bool
+TCPPeer::decodeMessage(uint8_t const* body, size_t length,
+                       AuthenticatedMessage& msg)
 {
     assertThreadIsMain();
     try
     {
-        xdr::xdr_get g(mIncomingBody.data(),
-                       mIncomingBody.data() + mIncomingBody.size());
-        AuthenticatedMessage am;
-        xdr::xdr_argpack_archive(g, am);
-        Peer::recvMessage(am);
+        xdr::xdr_get g(body, body + length);
+        xdr::xdr_argpack_archive(g, msg);
+        // the MAC is checked against these bytes
+        g.done();
+        return true;
     }
     catch (xdr::xdr_runtime_error& e)
     {
         CLOG(ERROR, "Overlay") << "recvMessage got a corrupt xdr: " << e.what();
         Peer::drop(ERR_DATA, "received corrupt XDR");
+        return false;
     }
 }
 
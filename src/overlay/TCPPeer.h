@@ -27,31 +27,64 @@ class TCPPeer : public Peer
 
   private:
     std::shared_ptr<SocketType> mSocket;
-    std::vector<uint8_t> mIncomingHeader;
-    std::vector<uint8_t> mIncomingBody;
-
+    // bytes read from the socket, [mReadStart, mReadEnd) are not parsed yet
+    std::vector<uint8_t> mReadBuffer;
+    size_t mReadStart{0};
+    size_t mReadEnd{0};
+
+    struct QueuedMessage
+    {
+        MessageType mType;
+        std::shared_ptr<xdr::opaque_vec<> const> mXdr;
+    };
+
+    // messages not framed yet, one lane per priority; they are framed (and
+    // moved to mWriteQueue) as the writes go, see nextOutboundLane
+    std::queue<QueuedMessage> mOutboundLanes[PRIORITY_COUNT];
+    // messages each lane may still send in the current round
+    int mOutboundCredits[PRIORITY_COUNT];
+
+    // framed messages, in MAC sequence order
     std::queue<std::shared_ptr<xdr::msg_ptr>> mWriteQueue;
+    // messages being written by the current vectored write, and their
+    // buffers
+    std::vector<std::shared_ptr<xdr::msg_ptr>> mWriteBatch;
+    std::vector<asio::const_buffer> mWriteBuffers;
+    // bytes in the lanes, mWriteQueue and mWriteBatch
+    size_t mOutboundQueueBytes{0};
     bool mWriting{false};
     bool mDelayedShutdown{false};
     bool mShutdownScheduled{false};
 
     PeerBareAddress makeAddress(int remoteListeningPort) const override;
 
-    void recvMessage();
-    void sendMessage(xdr::msg_ptr&& xdrBytes) override;
+    // applies the PEER_TCP_* and PEER_SOCKET_* settings to a connected
+    // socket
+    static void setSocketOptions(Application& app, SocketType& socket,
+                                 asio::error_code& ec);
 
+    bool decodeMessage(uint8_t const* body, size_t length,
+                       AuthenticatedMessage& msg);
+    void sendMessage(xdr::msg_ptr&& xdrBytes) override;
+    void queueMessage(MessageType type,
+                      std::shared_ptr<xdr::opaque_vec<> const> xdrMsg) override;
+    size_t getOutboundQueueBytes() const override;
+
+    int nextOutboundLane();
+    bool frameNextMessage();
+    bool hasPendingWrites() const;
+    void startWriting();
     void messageSender();
 
-    int getIncomingMsgLength();
+    size_t getIncomingMsgLength(uint8_t const* header) const;
+    bool isIncomingMsgLengthAcceptable(size_t length);
     virtual void connected() override;
     void startRead();
 
     void writeHandler(asio::error_code const& error,
                       std::size_t bytes_transferred) override;
-    void readHeaderHandler(asio::error_code const& error,
-                           std::size_t bytes_transferred) override;
-    void readBodyHandler(asio::error_code const& error,
-                         std::size_t bytes_transferred) override;
+    void readHandler(asio::error_code const& error,
+                     std::size_t bytes_transferred);
     void shutdown();
 
   public:
@@ -66,6 +99,29 @@ class TCPPeer : public Peer
     static pointer initiate(Application& app, PeerBareAddress const& address);
     static pointer accept(Application& app, std::shared_ptr<SocketType> socket);
 
+    // Applies PEER_SOCKET_SEND_BUFFER_SIZE and PEER_SOCKET_RECEIVE_BUFFER_SIZE
+    // to an open socket before it connects, or to an acceptor before it
+    // listens (accepted sockets inherit them): 0 leaves the size, and its
+    // auto tuning, to the OS.
+    template <typename S>
+    static void
+    setBufferSizes(Config const& cfg, S& s, asio::error_code& ec)
+    {
+        if (!ec && cfg.PEER_SOCKET_SEND_BUFFER_SIZE != 0)
+        {
+            s.set_option(asio::socket_base::send_buffer_size(static_cast<int>(
+                             cfg.PEER_SOCKET_SEND_BUFFER_SIZE)),
+                         ec);
+        }
+        if (!ec && cfg.PEER_SOCKET_RECEIVE_BUFFER_SIZE != 0)
+        {
+            s.set_option(asio::socket_base::receive_buffer_size(
+                             static_cast<int>(
+                                 cfg.PEER_SOCKET_RECEIVE_BUFFER_SIZE)),
+                         ec);
+        }
+    }
+
     virtual ~TCPPeer();
 
     virtual void drop(bool force = true) override;
@@ -47,6 +47,69 @@ TEST_CASE("TCPPeer can communicate", "[overlay]")
     auto p1 = n1->getOverlayManager().getConnectedPeer(
         PeerBareAddress{"127.0.0.1", n0->getConfig().PEER_PORT});
 
+    REQUIRE(p0);
+    REQUIRE(p1);
+    REQUIRE(p0->isAuthenticated());
+    REQUIRE(p1->isAuthenticated());
+
+    // messages of different priorities sent in a burst get reordered, the
+    // MAC sequence numbers must still match on the other side
+    StellarMessage getPeers;
+    getPeers.type(GET_PEERS);
+    StellarMessage getState;
+    getState.type(GET_SCP_STATE);
+    getState.getSCPLedgerSeq() = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        p0->sendMessage(getPeers);
+        p0->sendMessage(getState);
+    }
+    s->crankForAtLeast(std::chrono::seconds(1), false);
+    REQUIRE(p0->isAuthenticated());
+    REQUIRE(p1->isAuthenticated());
+    s->stopAllNodes();
+}
+
+TEST_CASE("TCPPeer with socket settings and an accept thread", "[overlay]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer s =
+        std::make_shared<Simulation>(Simulation::OVER_TCP, networkID);
+
+    auto makeConfig = [&]() {
+        auto cfg = s->newConfig();
+        cfg.PEER_SOCKET_SEND_BUFFER_SIZE = 1024 * 1024;
+        cfg.PEER_SOCKET_RECEIVE_BUFFER_SIZE = 1024 * 1024;
+        cfg.PEER_TCP_KEEPALIVE = true;
+        cfg.PEER_ACCEPT_THREAD = true;
+        return cfg;
+    };
+
+    auto v10SecretKey = SecretKey::fromSeed(sha256("v10"));
+    auto v11SecretKey = SecretKey::fromSeed(sha256("v11"));
+
+    SCPQuorumSet n0_qset;
+    n0_qset.threshold = 1;
+    n0_qset.validators.push_back(v10SecretKey.getPublicKey());
+    auto cfg0 = makeConfig();
+    auto n0 = s->addNode(v10SecretKey, n0_qset, &cfg0);
+
+    SCPQuorumSet n1_qset;
+    n1_qset.threshold = 1;
+    n1_qset.validators.push_back(v11SecretKey.getPublicKey());
+    auto cfg1 = makeConfig();
+    auto n1 = s->addNode(v11SecretKey, n1_qset, &cfg1);
+
+    s->addPendingConnection(v10SecretKey.getPublicKey(),
+                            v11SecretKey.getPublicKey());
+    s->startAllNodes();
+    s->crankForAtLeast(std::chrono::seconds(1), false);
+
+    auto p0 = n0->getOverlayManager().getConnectedPeer(
+        PeerBareAddress{"127.0.0.1", n1->getConfig().PEER_PORT});
+    auto p1 = n1->getOverlayManager().getConnectedPeer(
+        PeerBareAddress{"127.0.0.1", n0->getConfig().PEER_PORT});
+
     REQUIRE(p0);
     REQUIRE(p1);
     REQUIRE(p0->isAuthenticated());
@@ -6,6 +6,7 @@
 
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "crypto/XDRHasher.h"
 #include "herder/Herder.h"
 #include "main/Application.h"
 #include "medida/medida.h"
@@ -14,15 +15,27 @@
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+
 namespace stellar
 {
 
 static std::chrono::milliseconds const MS_TO_WAIT_FOR_FETCH_REPLY{1500};
 static int const MAX_REBUILD_FETCH_LIST = 1000;
 
-Tracker::Tracker(Application& app, Hash const& hash, AskPeer& askPeer)
+// the reply timeout of a peer is a few times its round trip time, within
+// these bounds (the upper one is for peers we know nothing about)
+static std::chrono::milliseconds const MIN_WAIT_FOR_FETCH_REPLY{250};
+static int const FETCH_REPLY_RTT_FACTOR = 4;
+
+// peers asked at once for data needed by the current slot
+static size_t const HEDGED_FETCH_REQUESTS = 2;
+
+Tracker::Tracker(Application& app, Hash const& hash, AskPeer& askPeer,
+                 DontHaveCache* dontHave)
     : mAskPeer(askPeer)
     , mApp(app)
+    , mDontHave(dontHave)
     , mNumListRebuild(0)
     , mTimer(app)
     , mItemHash(hash)
@@ -30,6 +43,10 @@ Tracker::Tracker(Application& app, Hash const& hash, AskPeer& askPeer)
           {"overlay", "item-fetcher", "reset-fetcher"}, "item-fetcher"))
     , mTryNextPeer(app.getMetrics().NewMeter(
           {"overlay", "item-fetcher", "next-peer"}, "item-fetcher"))
+    , mHedgedRequest(app.getMetrics().NewMeter(
+          {"overlay", "item-fetcher", "hedged-request"}, "item-fetcher"))
+    , mDontHaveSkip(app.getMetrics().NewMeter(
+          {"overlay", "item-fetcher", "dont-have-skip"}, "item-fetcher"))
 {
     assert(mAskPeer);
 }
@@ -69,7 +86,7 @@ Tracker::clearEnvelopesBelow(uint64 slotIndex)
     }
 
     mTimer.cancel();
-    mLastAskedPeer = nullptr;
+    mAskedPeers.clear();
 
     return false;
 }
@@ -77,11 +94,83 @@ Tracker::clearEnvelopesBelow(uint64 slotIndex)
 void
 Tracker::doesntHave(Peer::pointer peer)
 {
-    if (mLastAskedPeer == peer)
+    auto it = std::find(mAskedPeers.begin(), mAskedPeers.end(), peer);
+    if (it != mAskedPeers.end())
     {
         CLOG(TRACE, "Overlay") << "Does not have " << hexAbbrev(mItemHash);
-        tryNextPeer();
+        if (mAskedPeers.size() > 1)
+        {
+            // keep waiting for the other replies
+            mAskedPeers.erase(it);
+        }
+        else
+        {
+            tryNextPeer();
+        }
+    }
+}
+
+size_t
+Tracker::getParallelRequests() const
+{
+    // data for older slots (or for envelopes not yet waiting on anything)
+    // is not worth the extra traffic, neither is the data fetched ahead for
+    // the slots after the next one
+    auto current = mApp.getHerder().getCurrentLedgerSeq();
+    if (mWaitingEnvelopes.empty() || mLastSeenSlotIndex < current ||
+        mLastSeenSlotIndex > current + 1)
+    {
+        return 1;
     }
+    return HEDGED_FETCH_REQUESTS;
+}
+
+std::chrono::milliseconds
+Tracker::getReplyTimeout(Peer::pointer peer)
+{
+    auto rtt = peer->getLatencyEstimate();
+    if (rtt.count() == 0)
+    {
+        return MS_TO_WAIT_FOR_FETCH_REPLY;
+    }
+    auto timeout =
+        std::chrono::duration_cast<std::chrono::milliseconds>(rtt) *
+        FETCH_REPLY_RTT_FACTOR;
+    return std::min(std::max(timeout, MIN_WAIT_FOR_FETCH_REPLY),
+                    MS_TO_WAIT_FOR_FETCH_REPLY);
+}
+
+void
+Tracker::rebuildPeersToAsk()
+{
+    std::set<std::shared_ptr<Peer>> peersWithEnvelope;
+    for (auto const& e : mWaitingEnvelopes)
+    {
+        auto const& s = mApp.getOverlayManager().getPeersKnows(e.first);
+        peersWithEnvelope.insert(s.begin(), s.end());
+    }
+
+    // the peers that have the envelope are asked first, then the fastest
+    // peers (peers we know nothing about come last, in random order)
+    auto peers = mApp.getOverlayManager().getRandomAuthenticatedPeers();
+    auto rank = [&peersWithEnvelope](Peer::pointer const& p) {
+        auto rtt = p->getLatencyEstimate();
+        return std::make_pair(
+            peersWithEnvelope.find(p) == peersWithEnvelope.end(),
+            rtt.count() == 0 ? std::chrono::microseconds::max() : rtt);
+    };
+    std::stable_sort(peers.begin(), peers.end(),
+                     [&rank](Peer::pointer const& x, Peer::pointer const& y) {
+                         return rank(x) < rank(y);
+                     });
+    mPeersToAsk.assign(peers.begin(), peers.end());
+
+    mNumListRebuild++;
+
+    CLOG(TRACE, "Overlay") << "tryNextPeer " << hexAbbrev(mItemHash)
+                           << " attempt " << mNumListRebuild << " reset to #"
+                           << mPeersToAsk.size();
+    mTryNextPeerReset.Mark();
 }
 
 void
@@ -89,62 +178,41 @@ Tracker::tryNextPeer()
 {
     // will be called by some timer or when we get a
     // response saying they don't have it
-    Peer::pointer peer;
-
     CLOG(TRACE, "Overlay") << "tryNextPeer " << hexAbbrev(mItemHash)
                            << " last: "
-                           << (mLastAskedPeer ? mLastAskedPeer->toString()
-                                              : "<none>");
+                           << (mAskedPeers.empty()
+                                   ? "<none>"
+                                   : mAskedPeers.front()->toString());
 
     // if we don't have a list of peers to ask and we're not
     // currently asking peers, build a new list
-    if (mPeersToAsk.empty() && !mLastAskedPeer)
+    if (mPeersToAsk.empty() && mAskedPeers.empty())
     {
-        std::set<std::shared_ptr<Peer>> peersWithEnvelope;
-        for (auto const& e : mWaitingEnvelopes)
-        {
-            auto const& s = mApp.getOverlayManager().getPeersKnows(e.first);
-            peersWithEnvelope.insert(s.begin(), s.end());
-        }
-
-        // move the peers that have the envelope to the back,
-        // to be processed first
-        for (auto const& p :
-             mApp.getOverlayManager().getRandomAuthenticatedPeers())
-        {
-            if (peersWithEnvelope.find(p) != peersWithEnvelope.end())
-            {
-                mPeersToAsk.emplace_back(p);
-            }
-            else
-            {
-                mPeersToAsk.emplace_front(p);
-            }
-        }
-
-        mNumListRebuild++;
-
-        CLOG(TRACE, "Overlay")
-            << "tryNextPeer " << hexAbbrev(mItemHash) << " attempt "
-            << mNumListRebuild << " reset to #" << mPeersToAsk.size();
-        mTryNextPeerReset.Mark();
+        rebuildPeersToAsk();
     }
+    mAskedPeers.clear();
 
-    while (!peer && !mPeersToAsk.empty())
+    auto parallelRequests = getParallelRequests();
+    while (mAskedPeers.size() < parallelRequests && !mPeersToAsk.empty())
     {
-        peer = mPeersToAsk.back();
+        auto peer = mPeersToAsk.front();
+        mPeersToAsk.pop_front();
         if (!peer->isAuthenticated())
         {
-            peer.reset();
+            continue;
+        }
+        if (mDontHave && mDontHave->contains(peer->getPeerID(), mItemHash))
+        {
+            mDontHaveSkip.Mark();
+            continue;
         }
-        mPeersToAsk.pop_back();
+        mAskedPeers.emplace_back(peer);
     }
 
-    std::chrono::milliseconds nextTry;
-    if (!peer)
+    std::chrono::milliseconds nextTry{0};
+    if (mAskedPeers.empty())
     { // we have asked all our peers
-        // clear mLastAskedPeer so that we rebuild a new list
-        mLastAskedPeer.reset();
+        // leave mAskedPeers empty so that we rebuild a new list
         if (mNumListRebuild > MAX_REBUILD_FETCH_LIST)
         {
             nextTry = MS_TO_WAIT_FOR_FETCH_REPLY * MAX_REBUILD_FETCH_LIST;
@@ -156,12 +224,18 @@ Tracker::tryNextPeer()
     }
     else
     {
-        mLastAskedPeer = peer;
-        CLOG(TRACE, "Overlay") << "Asking for " << hexAbbrev(mItemHash)
-                               << " to " << peer->toString();
-        mTryNextPeer.Mark();
-        mAskPeer(peer, mItemHash);
-        nextTry = MS_TO_WAIT_FOR_FETCH_REPLY;
+        if (mAskedPeers.size() > 1)
+        {
+            mHedgedRequest.Mark(mAskedPeers.size() - 1);
+        }
+        for (auto const& peer : mAskedPeers)
+        {
+            CLOG(TRACE, "Overlay") << "Asking for " << hexAbbrev(mItemHash)
+                                   << " to " << peer->toString();
+            mTryNextPeer.Mark();
+            mAskPeer(peer, mItemHash);
+            nextTry = std::max(nextTry, getReplyTimeout(peer));
+        }
     }
 
     mTimer.expires_from_now(nextTry);
@@ -178,7 +252,7 @@ Tracker::listen(const SCPEnvelope& env)
     m.type(SCP_MESSAGE);
     m.envelope() = env;
     mWaitingEnvelopes.push_back(
-        std::make_pair(sha256(xdr::xdr_to_opaque(m)), env));
+        std::make_pair(xdrSha256(m), env));
 }
 
 void
@@ -197,6 +271,7 @@ void
 Tracker::cancel()
 {
     mTimer.cancel();
+    mAskedPeers.clear();
     mLastSeenSlotIndex = 0;
 }
 }
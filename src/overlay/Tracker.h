@@ -14,12 +14,19 @@
  *
  * For asking a AskPeer delegate is used.
  *
+ * Peers are asked fastest first (see Peer::getLatencyEstimate), the ones
+ * that sent an envelope needing the data before the others, and each is
+ * given a timeout based on its round trip time. Data needed by the current
+ * slot (or the next one) is asked to a few peers at once, the first reply
+ * wins; data for later slots, fetched ahead, to one peer at a time.
+ *
  * Tracker keeps list of envelopes that requires given data set to be
  * fully resolved. When data is received each envelope is resend to Herder
  * so it can check if it has all required data and then process envelope.
  * @see listen(Peer::pointer) is used to add envelopes to that list.
  */
 
+#include "overlay/DontHaveCache.h"
 #include "overlay/Peer.h"
 #include "util/Timer.h"
 #include "xdr/Stellar-types.h"
@@ -40,7 +47,10 @@ class Tracker
   private:
     AskPeer mAskPeer;
     Application& mApp;
-    Peer::pointer mLastAskedPeer;
+    // peers not asked as they recently did not have the item, if set
+    DontHaveCache* mDontHave;
+    // peers asked last, waiting for their reply
+    std::vector<Peer::pointer> mAskedPeers;
     int mNumListRebuild;
     std::deque<Peer::pointer> mPeersToAsk;
     VirtualTimer mTimer;
@@ -48,14 +58,24 @@ class Tracker
     Hash mItemHash;
     medida::Meter& mTryNextPeerReset;
     medida::Meter& mTryNextPeer;
+    medida::Meter& mHedgedRequest;
+    medida::Meter& mDontHaveSkip;
     uint64 mLastSeenSlotIndex{0};
 
+    // how many peers to ask at once
+    size_t getParallelRequests() const;
+    // how long to wait for a reply of @p peer
+    static std::chrono::milliseconds getReplyTimeout(Peer::pointer peer);
+    void rebuildPeersToAsk();
+
   public:
     /**
      * Create Tracker that tracks data identified by @p hash. @p askPeer
-     * delegate is used to fetch the data.
+     * delegate is used to fetch the data, not from the peers in
+     * @p dontHave.
      */
-    explicit Tracker(Application& app, Hash const& hash, AskPeer& askPeer);
+    explicit Tracker(Application& app, Hash const& hash, AskPeer& askPeer,
+                     DontHaveCache* dontHave = nullptr);
     virtual ~Tracker();
 
     /**
@@ -110,13 +130,15 @@ class Tracker
     void discard(const SCPEnvelope& env);
 
     /**
-     * Stop the timer, stop requesting the item as we have it.
+     * Stop the timer, stop requesting the item as we have it. Replies to
+     * requests still in flight are ignored.
      */
     void cancel();
 
     /**
      * Called when given @p peer informs that it does not have given data.
-     * Next peer will be tried if available.
+     * Next peer will be tried if available, and if no other request is in
+     * flight.
      */
     void doesntHave(Peer::pointer peer);
 
@@ -0,0 +1,199 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/TxDemandsManager.h"
+#include "crypto/SHA.h"
+#include "crypto/XDRHasher.h"
+#include "main/Application.h"
+#include "overlay/Floodgate.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+namespace stellar
+{
+
+// how long to wait for a demanded transaction before asking another peer
+static std::chrono::milliseconds const DEMAND_TIMEOUT(500);
+
+// bounds on the memory used for demands
+static size_t const MAX_PENDING_DEMANDS = 100000;
+static size_t const MAX_ADVERTISERS_PER_DEMAND = 8;
+
+TxDemandsManager::TxDemandsManager(Application& app, Floodgate& floodgate)
+    : mApp(app)
+    , mFloodgate(floodgate)
+    , mRetryTimer(app)
+    , mDemandsSent(app.getMetrics().NewMeter(
+          {"overlay", "flood", "demand-sent"}, "transaction"))
+    , mDemandsRetried(app.getMetrics().NewMeter(
+          {"overlay", "flood", "demand-retried"}, "transaction"))
+    , mDemandsAbandoned(app.getMetrics().NewMeter(
+          {"overlay", "flood", "demand-abandoned"}, "transaction"))
+    , mPendingDemands(
+          app.getMetrics().NewCounter({"overlay", "memory", "flood-demands"}))
+{
+}
+
+void
+TxDemandsManager::recvTxAdvert(Peer::pointer peer, FloodAdvert const& advert)
+{
+    auto now = mApp.getClock().now();
+    std::map<Peer::pointer, TxDemandVector> demands;
+    for (auto const& hash : advert.txHashes)
+    {
+        if (mFloodgate.isSeen(hash))
+        {
+            continue;
+        }
+
+        auto it = mDemands.find(hash);
+        if (it != mDemands.end())
+        {
+            // already demanded from another peer, this one is a fallback
+            auto& advertisers = it->second.mAdvertisers;
+            if (advertisers.size() < MAX_ADVERTISERS_PER_DEMAND)
+            {
+                advertisers.emplace_back(peer);
+            }
+            continue;
+        }
+
+        if (mDemands.size() >= MAX_PENDING_DEMANDS)
+        {
+            mDemandsAbandoned.Mark();
+            continue;
+        }
+        auto& demand = mDemands[hash];
+        demand.mAsked = peer;
+        demand.mDeadline = now + DEMAND_TIMEOUT;
+        demands[peer].emplace_back(hash);
+    }
+
+    sendDemands(demands);
+    startRetryTimer();
+}
+
+void
+TxDemandsManager::sendDemands(std::map<Peer::pointer, TxDemandVector>& demands)
+{
+    for (auto& d : demands)
+    {
+        mDemandsSent.Mark(d.second.size());
+        StellarMessage msg;
+        msg.type(FLOOD_DEMAND);
+        msg.floodDemand().txHashes = std::move(d.second);
+        d.first->sendMessage(msg);
+    }
+    mPendingDemands.set_count(mDemands.size());
+}
+
+void
+TxDemandsManager::startRetryTimer()
+{
+    if (mRetrying || mDemands.empty())
+    {
+        return;
+    }
+    mRetrying = true;
+    mRetryTimer.expires_from_now(DEMAND_TIMEOUT);
+    mRetryTimer.async_wait([this]() { retryDemands(); },
+                           VirtualTimer::onFailureNoop);
+}
+
+void
+TxDemandsManager::retryDemands()
+{
+    mRetrying = false;
+    auto now = mApp.getClock().now();
+    std::map<Peer::pointer, TxDemandVector> demands;
+    for (auto it = mDemands.begin(); it != mDemands.end();)
+    {
+        auto& demand = it->second;
+        if (demand.mDeadline > now)
+        {
+            ++it;
+            continue;
+        }
+
+        Peer::pointer next;
+        while (!next && !demand.mAdvertisers.empty())
+        {
+            next = demand.mAdvertisers.front().lock();
+            demand.mAdvertisers.pop_front();
+            if (next && !next->isAuthenticated())
+            {
+                next.reset();
+            }
+        }
+
+        if (!next)
+        {
+            // nobody else to ask (for now), another advert starts over
+            mDemandsAbandoned.Mark();
+            it = mDemands.erase(it);
+            continue;
+        }
+
+        auto& toPeer = demands[next];
+        if (toPeer.size() == TX_DEMAND_VECTOR_MAX_SIZE)
+        {
+            // enough for this peer, it is asked for the rest next time
+            demand.mAdvertisers.emplace_front(next);
+            ++it;
+            continue;
+        }
+        mDemandsRetried.Mark();
+        demand.mAsked = next;
+        demand.mDeadline = now + DEMAND_TIMEOUT;
+        toPeer.emplace_back(it->first);
+        ++it;
+    }
+
+    sendDemands(demands);
+    startRetryTimer();
+}
+
+StellarMessage const*
+TxDemandsManager::getAdvertisedTransaction(Hash const& hash) const
+{
+    auto msg = mFloodgate.getMessage(hash);
+    return msg && msg->type() == TRANSACTION ? msg : nullptr;
+}
+
+void
+TxDemandsManager::recvTransaction(StellarMessage const& msg)
+{
+    if (mDemands.empty())
+    {
+        return;
+    }
+    if (mDemands.erase(xdrSha256(msg)) != 0)
+    {
+        mPendingDemands.set_count(mDemands.size());
+    }
+}
+
+void
+TxDemandsManager::doesntHave(Hash const& hash, Peer::pointer peer)
+{
+    auto it = mDemands.find(hash);
+    if (it != mDemands.end() && it->second.mAsked.lock() == peer)
+    {
+        // ask the next peer on the next retry
+        it->second.mDeadline = mApp.getClock().now();
+    }
+}
+
+void
+TxDemandsManager::shutdown()
+{
+    mRetryTimer.cancel();
+    mDemands.clear();
+    mPendingDemands.set_count(0);
+}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/Peer.h"
+#include "overlay/StellarXDR.h"
+#include "util/HashOfHash.h"
+#include "util/NonCopyable.h"
+#include "util/Timer.h"
+
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+namespace medida
+{
+class Counter;
+class Meter;
+}
+
+namespace stellar
+{
+
+class Floodgate;
+
+/**
+ * Receiving side of pull mode transaction flooding.
+ *
+ * Peers in pull mode (see Peer::isPullModeEnabled) do not send us new
+ * transactions, they advertise their flood hashes (FLOOD_ADVERT) instead.
+ * Every advertised hash the Floodgate does not know about is demanded
+ * (FLOOD_DEMAND) from the first peer that advertised it. Like a Tracker, a
+ * demand that is not fulfilled in time (or that gets a DONT_HAVE) moves on
+ * to the next peer that advertised the same hash, and is given up once
+ * every such peer was asked; another advert starts it again.
+ */
+class TxDemandsManager : NonMovableOrCopyable
+{
+    struct Demand
+    {
+        // peers that advertised the transaction and were not asked yet
+        std::deque<std::weak_ptr<Peer>> mAdvertisers;
+        // peer the transaction was last demanded from
+        std::weak_ptr<Peer> mAsked;
+        // when to move on to the next peer
+        VirtualClock::time_point mDeadline;
+    };
+
+    Application& mApp;
+    Floodgate& mFloodgate;
+    std::unordered_map<Hash, Demand> mDemands;
+    VirtualTimer mRetryTimer;
+    bool mRetrying{false};
+
+    medida::Meter& mDemandsSent;
+    medida::Meter& mDemandsRetried;
+    medida::Meter& mDemandsAbandoned;
+    medida::Counter& mPendingDemands;
+
+    void sendDemands(std::map<Peer::pointer, TxDemandVector>& demands);
+    void startRetryTimer();
+    void retryDemands();
+
+  public:
+    TxDemandsManager(Application& app, Floodgate& floodgate);
+
+    // a peer advertised some transactions
+    void recvTxAdvert(Peer::pointer peer, FloodAdvert const& advert);
+
+    // the transaction behind a hash we advertised (nullptr if it is unknown
+    // or no longer around)
+    StellarMessage const* getAdvertisedTransaction(Hash const& hash) const;
+
+    // a transaction was received, from any peer
+    void recvTransaction(StellarMessage const& msg);
+
+    // the peer asked for a transaction told us it doesn't have it
+    void doesntHave(Hash const& hash, Peer::pointer peer);
+
+    size_t
+    getPendingDemandsCount() const
+    {
+        return mDemands.size();
+    }
+
+    void shutdown();
+};
+}
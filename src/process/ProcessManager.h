@@ -15,6 +15,19 @@ namespace stellar
 
 class RealTimer;
 
+// Subprocesses are run in pools by what they do, each with its own limit on
+// concurrency and its own scheduling priority (see
+// Config::TRANSFER_SUBPROCESSES), so that, say, uploads of a publish cannot
+// hold up the downloads of a catchup.
+enum ProcessClass
+{
+    // get and put commands of history archives
+    PROCESS_CLASS_TRANSFER,
+    // everything else (mkdir commands, ...)
+    PROCESS_CLASS_OTHER,
+    PROCESS_CLASS_COUNT
+};
+
 /**
  * This module exists because asio doesn't know much about subprocesses,
  * so we provide a little machinery for running subprocesses and waiting
@@ -49,8 +62,9 @@ class ProcessManager : public std::enable_shared_from_this<ProcessManager>,
 {
   public:
     static std::shared_ptr<ProcessManager> create(Application& app);
-    virtual ProcessExitEvent runProcess(std::string const& cmdLine,
-                                        std::string outputFile = "") = 0;
+    virtual ProcessExitEvent
+    runProcess(std::string const& cmdLine, std::string outputFile = "",
+               ProcessClass processClass = PROCESS_CLASS_OTHER) = 0;
     virtual size_t getNumRunningProcesses() = 0;
     virtual bool isShutdown() const = 0;
     virtual void shutdown() = 0;
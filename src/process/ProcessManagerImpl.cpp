@@ -58,6 +58,8 @@ class ProcessExitEvent::Impl
     std::shared_ptr<asio::error_code> mOuterEc;
     std::string mCmdLine;
     std::string mOutFile;
+    ProcessClass mClass;
+    SubprocessConfiguration mConfig;
     bool mRunning{false};
 #ifdef _WIN32
     asio::windows::object_handle mProcessHandle;
@@ -68,11 +70,14 @@ class ProcessExitEvent::Impl
     Impl(std::shared_ptr<RealTimer> const& outerTimer,
          std::shared_ptr<asio::error_code> const& outerEc,
          std::string const& cmdLine, std::string const& outFile,
+         ProcessClass processClass, SubprocessConfiguration const& config,
          std::weak_ptr<ProcessManagerImpl> pm)
         : mOuterTimer(outerTimer)
         , mOuterEc(outerEc)
         , mCmdLine(cmdLine)
         , mOutFile(outFile)
+        , mClass(processClass)
+        , mConfig(config)
 #ifdef _WIN32
         , mProcessHandle(outerTimer->get_io_service())
 #endif
@@ -102,6 +107,7 @@ ProcessManagerImpl::getNumRunningProcesses()
 
 ProcessManagerImpl::~ProcessManagerImpl()
 {
+    stopReaper();
     const auto killProcess = [&](ProcessExitEvent::Impl& impl) {
         impl.cancel(ABORT_ERROR_CODE);
         forceShutdown(impl);
@@ -132,6 +138,7 @@ ProcessManagerImpl::shutdown()
     if (!mIsShutdown)
     {
         mIsShutdown = true;
+        stopReaper();
         auto ec = ABORT_ERROR_CODE;
 
         // Cancel all pending.
@@ -153,6 +160,7 @@ ProcessManagerImpl::shutdown()
         }
         mImpls.clear();
         gNumProcessesActive = 0;
+        mClassRunning.fill(0);
 #ifndef _WIN32
         mSigChild.cancel(ec);
 #endif
@@ -166,8 +174,17 @@ ProcessManagerImpl::shutdown()
 ProcessManagerImpl::ProcessManagerImpl(Application& app)
     : mMaxProcesses(app.getConfig().MAX_CONCURRENT_SUBPROCESSES)
     , mIOService(app.getClock().getIOService())
-    , mSigChild(mIOService)
+    , mClassConfigs{{app.getConfig().TRANSFER_SUBPROCESSES,
+                     app.getConfig().OTHER_SUBPROCESSES}}
+    , mSigChild(mReaperService)
 {
+    mClassRunning.fill(0);
+}
+
+void
+ProcessManagerImpl::stopReaper()
+{
+    // No-op on windows, uses waitable object handles
 }
 
 void
@@ -260,7 +277,7 @@ ProcessExitEvent::Impl::run()
             return;
         }
 
-        --ProcessManagerImpl::gNumProcessesActive;
+        manager->releaseSlot(*sf);
 
         // Fire off any new processes we've made room for before we
         // trigger the callback.
@@ -322,15 +339,40 @@ ProcessManagerImpl::forceShutdown(ProcessExitEvent::Impl& impl)
 #else
 
 #include <spawn.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 ProcessManagerImpl::ProcessManagerImpl(Application& app)
     : mMaxProcesses(app.getConfig().MAX_CONCURRENT_SUBPROCESSES)
     , mIOService(app.getClock().getIOService())
-    , mSigChild(mIOService, SIGCHLD)
+    , mClassConfigs{{app.getConfig().TRANSFER_SUBPROCESSES,
+                     app.getConfig().OTHER_SUBPROCESSES}}
+    , mReaperWork(std::make_unique<asio::io_service::work>(mReaperService))
+    , mSigChild(mReaperService, SIGCHLD)
 {
-    std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
-    startSignalWait();
+    mClassRunning.fill(0);
+    {
+        std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
+        startSignalWait();
+    }
+    mReaperThread = std::thread([this]() { mReaperService.run(); });
+}
+
+void
+ProcessManagerImpl::stopReaper()
+{
+    // Must not be called with mImplsMutex held: the reaper may be waiting
+    // for it.
+    if (mReaperThread.joinable())
+    {
+        mReaperWork.reset();
+        mReaperService.stop();
+        mReaperThread.join();
+    }
 }
 
 void
@@ -442,14 +484,14 @@ ProcessManagerImpl::handleProcessTermination(int pid, int status)
         ec = asio::error_code(1, asio::system_category());
     }
 
-    --gNumProcessesActive;
+    releaseSlot(*impl);
     mImpls.erase(pair);
 
     // Fire off any new processes we've made room for before we
     // trigger the callback.
     maybeRunPendingProcesses();
 
-    impl->cancel(ec);
+    notifyExit(impl, ec);
 }
 
 void
@@ -488,7 +530,7 @@ void
 ProcessExitEvent::Impl::run()
 {
     auto manager = mProcManagerImpl.lock();
-    assert(!manager->isShutdown());
+    assert(manager && !manager->isShutdown());
     if (mRunning)
     {
         CLOG(ERROR, "Process") << "ProcessExitEvent::Impl already running";
@@ -528,13 +570,37 @@ ProcessExitEvent::Impl::run()
         throw std::runtime_error("posix_spawn() failed");
     }
 
+    // posix_spawn cannot set priorities, so they are set on the child once
+    // it runs; anything it starts from then on inherits them.
+    if (mConfig.mNice != 0 &&
+        setpriority(PRIO_PROCESS, mProcessId, mConfig.mNice) != 0)
+    {
+        CLOG(WARNING, "Process") << "setpriority(" << mConfig.mNice
+                                 << ") failed for pid " << mProcessId
+                                 << ", errno " << errno;
+    }
+    if (mConfig.mIdleIO)
+    {
+#if defined(__linux__) && defined(SYS_ioprio_set)
+        // IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT
+        if (syscall(SYS_ioprio_set, 1, mProcessId, 3 << 13) != 0)
+        {
+            CLOG(WARNING, "Process") << "ioprio_set failed for pid "
+                                     << mProcessId << ", errno " << errno;
+        }
+#else
+        CLOG(WARNING, "Process") << "idle I/O priority is not supported";
+#endif
+    }
+
     mRunning = true;
 }
 
 #endif
 
 ProcessExitEvent
-ProcessManagerImpl::runProcess(std::string const& cmdLine, std::string outFile)
+ProcessManagerImpl::runProcess(std::string const& cmdLine, std::string outFile,
+                               ProcessClass processClass)
 {
     std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
     ProcessExitEvent pe(mIOService);
@@ -542,13 +608,22 @@ ProcessManagerImpl::runProcess(std::string const& cmdLine, std::string outFile)
         std::static_pointer_cast<ProcessManagerImpl>(shared_from_this());
     std::weak_ptr<ProcessManagerImpl> weakSelf(self);
     pe.mImpl = std::make_shared<ProcessExitEvent::Impl>(
-        pe.mTimer, pe.mEc, cmdLine, outFile, weakSelf);
+        pe.mTimer, pe.mEc, cmdLine, outFile, processClass,
+        mClassConfigs[processClass], weakSelf);
     mPendingImpls.push_back(pe.mImpl);
 
     maybeRunPendingProcesses();
     return pe;
 }
 
+bool
+ProcessManagerImpl::canRun(ProcessClass processClass) const
+{
+    auto classMax = mClassConfigs[processClass].mMaxProcesses;
+    return gNumProcessesActive < mMaxProcesses &&
+           (classMax == 0 || mClassRunning[processClass] < classMax);
+}
+
 void
 ProcessManagerImpl::maybeRunPendingProcesses()
 {
@@ -557,10 +632,18 @@ ProcessManagerImpl::maybeRunPendingProcesses()
         return;
     }
     std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
-    while (!mPendingImpls.empty() && gNumProcessesActive < mMaxProcesses)
+    // Processes start in the order they were asked for, except that those
+    // of a class at its limit let the others go first.
+    auto it = mPendingImpls.begin();
+    while (it != mPendingImpls.end() && gNumProcessesActive < mMaxProcesses)
     {
-        auto i = mPendingImpls.front();
-        mPendingImpls.pop_front();
+        auto i = *it;
+        if (!canRun(i->mClass))
+        {
+            ++it;
+            continue;
+        }
+        it = mPendingImpls.erase(it);
         try
         {
             CLOG(DEBUG, "Process") << "Running: " << i->mCmdLine;
@@ -568,16 +651,35 @@ ProcessManagerImpl::maybeRunPendingProcesses()
             i->run();
             mImpls[i->getProcessId()] = i;
             ++gNumProcessesActive;
+            ++mClassRunning[i->mClass];
         }
         catch (std::runtime_error& e)
         {
-            i->cancel(std::make_error_code(std::errc::io_error));
+            notifyExit(i, std::make_error_code(std::errc::io_error));
             CLOG(ERROR, "Process") << "Error starting process: " << e.what();
             CLOG(ERROR, "Process") << "When running: " << i->mCmdLine;
         }
     }
 }
 
+void
+ProcessManagerImpl::releaseSlot(ProcessExitEvent::Impl const& impl)
+{
+    std::lock_guard<std::recursive_mutex> guard(mImplsMutex);
+    --gNumProcessesActive;
+    --mClassRunning[impl.mClass];
+}
+
+void
+ProcessManagerImpl::notifyExit(
+    std::shared_ptr<ProcessExitEvent::Impl> const& impl,
+    asio::error_code const& ec)
+{
+    // This may run on the reaper thread, and the timer behind the
+    // ProcessExitEvent belongs to the main thread.
+    mIOService.post([impl, ec]() { impl->cancel(ec); });
+}
+
 ProcessExitEvent::ProcessExitEvent(asio::io_service& io_service)
     : mTimer(std::make_shared<RealTimer>(io_service))
     , mImpl(nullptr)
@@ -4,10 +4,13 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "main/Config.h"
 #include "process/ProcessManager.h"
+#include <array>
 #include <atomic>
 #include <deque>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 namespace medida
@@ -29,19 +32,35 @@ class ProcessManagerImpl : public ProcessManager
     std::recursive_mutex mImplsMutex;
     std::map<int, std::shared_ptr<ProcessExitEvent::Impl>> mImpls;
 
-    bool mIsShutdown{false};
+    std::atomic<bool> mIsShutdown{false};
     size_t mMaxProcesses;
     asio::io_service& mIOService;
 
+    // Limits and priorities of each ProcessClass, and the number of its
+    // processes running (guarded by mImplsMutex).
+    std::array<SubprocessConfiguration, PROCESS_CLASS_COUNT> mClassConfigs;
+    std::array<size_t, PROCESS_CLASS_COUNT> mClassRunning;
+
     std::deque<std::shared_ptr<ProcessExitEvent::Impl>> mPendingImpls;
     std::deque<std::shared_ptr<ProcessExitEvent::Impl>> mKillableImpls;
+    bool canRun(ProcessClass processClass) const;
     void maybeRunPendingProcesses();
+    void releaseSlot(ProcessExitEvent::Impl const& impl);
+    void notifyExit(std::shared_ptr<ProcessExitEvent::Impl> const& impl,
+                    asio::error_code const& ec);
 
-    // These are only used on POSIX, but they're harmless here.
+    // These are only used on POSIX, but they're harmless here. Children are
+    // reaped on a thread of their own, so that an exited process makes room
+    // for the next pending one however busy the main thread is; only the
+    // exit notifications are posted to mIOService.
+    asio::io_service mReaperService;
+    std::unique_ptr<asio::io_service::work> mReaperWork;
+    std::thread mReaperThread;
     asio::signal_set mSigChild;
     void startSignalWait();
     void handleSignalWait();
     void handleProcessTermination(int pid, int status);
+    void stopReaper();
     void cleanShutdown(ProcessExitEvent::Impl& impl);
     void forceShutdown(ProcessExitEvent::Impl& impl);
 
@@ -49,8 +68,9 @@ class ProcessManagerImpl : public ProcessManager
 
   public:
     ProcessManagerImpl(Application& app);
-    ProcessExitEvent runProcess(std::string const& cmdLine,
-                                std::string outFile = "") override;
+    ProcessExitEvent
+    runProcess(std::string const& cmdLine, std::string outFile = "",
+               ProcessClass processClass = PROCESS_CLASS_OTHER) override;
     size_t getNumRunningProcesses() override;
 
     bool isShutdown() const override;
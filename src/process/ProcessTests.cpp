@@ -159,6 +159,46 @@ TEST_CASE("subprocess storm", "[process]")
     }
 }
 
+#ifndef _WIN32
+TEST_CASE("subprocess classes", "[process]")
+{
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.MAX_CONCURRENT_SUBPROCESSES = 3;
+    cfg.TRANSFER_SUBPROCESSES.mMaxProcesses = 1;
+    cfg.TRANSFER_SUBPROCESSES.mNice = 5;
+    cfg.TRANSFER_SUBPROCESSES.mIdleIO = true;
+    Application::pointer app = createTestApplication(clock, cfg);
+    auto& pm = app->getProcessManager();
+
+    size_t completed = 0;
+    std::vector<ProcessExitEvent> events;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        events.emplace_back(
+            pm.runProcess("sleep 1", "", PROCESS_CLASS_TRANSFER));
+    }
+    events.emplace_back(pm.runProcess("sleep 1"));
+    events.emplace_back(pm.runProcess("sleep 1"));
+    // one transfer, and the other processes past the transfers waiting
+    REQUIRE(pm.getNumRunningProcesses() == 3);
+
+    for (auto& event : events)
+    {
+        event.async_wait([&](asio::error_code ec) {
+            REQUIRE(!ec);
+            ++completed;
+        });
+    }
+    while (completed < events.size() && !clock.getIOService().stopped())
+    {
+        clock.crank(true);
+        REQUIRE(pm.getNumRunningProcesses() <= 3);
+    }
+    REQUIRE(completed == events.size());
+}
+#endif
+
 TEST_CASE("shutdown while process running", "[process]")
 {
     VirtualClock clock;
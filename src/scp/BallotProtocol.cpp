@@ -24,6 +24,8 @@ using namespace std::placeholders;
 // max number of transitions that can occur from processing one message
 static const int MAX_ADVANCE_SLOT_RECURSION = 50;
 
+size_t const BallotProtocol::MAX_TRACKED_PREPARE_BALLOTS = 100;
+
 BallotProtocol::BallotProtocol(Slot& slot)
     : mSlot(slot)
     , mHeardFromQuorum(false)
@@ -144,9 +146,55 @@ BallotProtocol::recordEnvelope(SCPEnvelope const& env)
     {
         oldp->second = env;
     }
+    for (auto& v : mPrepareVotes)
+    {
+        updatePrepareVotes(v.first, st, v.second);
+    }
     mSlot.recordStatement(env.statement);
 }
 
+BallotProtocol::PrepareVotes const&
+BallotProtocol::getPrepareVotes(SCPBallot const& ballot)
+{
+    auto it = mPrepareVotes.find(ballot);
+    if (it == mPrepareVotes.end())
+    {
+        // every tracked ballot costs a little on each recordEnvelope
+        if (mPrepareVotes.size() >= MAX_TRACKED_PREPARE_BALLOTS)
+        {
+            mPrepareVotes.clear();
+        }
+        it = mPrepareVotes.emplace(ballot, PrepareVotes()).first;
+        for (auto const& e : mLatestEnvelopes)
+        {
+            updatePrepareVotes(ballot, e.second.statement, it->second);
+        }
+    }
+    return it->second;
+}
+
+void
+BallotProtocol::updatePrepareVotes(SCPBallot const& ballot,
+                                   SCPStatement const& st, PrepareVotes& votes)
+{
+    if (votesForPrepare(ballot, st))
+    {
+        votes.mVoted.insert(st.nodeID);
+    }
+    else
+    {
+        votes.mVoted.erase(st.nodeID);
+    }
+    if (hasPreparedBallot(ballot, st))
+    {
+        votes.mAccepted.insert(st.nodeID);
+    }
+    else
+    {
+        votes.mAccepted.erase(st.nodeID);
+    }
+}
+
 SCP::EnvelopeState
 BallotProtocol::processEnvelope(SCPEnvelope const& envelope, bool self)
 {
@@ -823,39 +871,16 @@ BallotProtocol::attemptPreparedAccept(SCPStatement const& hint)
             // otherwise, there is a chance it increases p'
         }
 
+        auto const& votes = getPrepareVotes(ballot);
         bool accepted = federatedAccept(
             // checks if any node is voting for this ballot
-            [&ballot](SCPStatement const& st) {
-                bool res;
-
-                switch (st.pledges.type())
-                {
-                case SCP_ST_PREPARE:
-                {
-                    auto const& p = st.pledges.prepare();
-                    res = areBallotsLessAndCompatible(ballot, p.ballot);
-                }
-                break;
-                case SCP_ST_CONFIRM:
-                {
-                    auto const& c = st.pledges.confirm();
-                    res = areBallotsCompatible(ballot, c.ballot);
-                }
-                break;
-                case SCP_ST_EXTERNALIZE:
-                {
-                    auto const& e = st.pledges.externalize();
-                    res = areBallotsCompatible(ballot, e.commit);
-                }
-                break;
-                default:
-                    res = false;
-                    dbgAbort();
-                }
-
-                return res;
+            [&votes](SCPStatement const& st) {
+                return votes.mVoted.find(st.nodeID) != votes.mVoted.end();
             },
-            std::bind(&BallotProtocol::hasPreparedBallot, ballot, _1));
+            [&votes](SCPStatement const& st) {
+                return votes.mAccepted.find(st.nodeID) !=
+                       votes.mAccepted.end();
+            });
         if (accepted)
         {
             return setPreparedAccept(ballot);
@@ -930,8 +955,12 @@ BallotProtocol::attemptPreparedConfirmed(SCPStatement const& hint)
             break;
         }
 
-        bool ratified = federatedRatify(
-            std::bind(&BallotProtocol::hasPreparedBallot, ballot, _1));
+        auto const& votes = getPrepareVotes(ballot);
+        bool ratified =
+            federatedRatify([&votes](SCPStatement const& st) {
+                return votes.mAccepted.find(st.nodeID) !=
+                       votes.mAccepted.end();
+            });
         if (ratified)
         {
             newH = ballot;
@@ -961,8 +990,12 @@ BallotProtocol::attemptPreparedConfirmed(SCPStatement const& hint)
                 {
                     break;
                 }
-                bool ratified = federatedRatify(
-                    std::bind(&BallotProtocol::hasPreparedBallot, ballot, _1));
+                auto const& votes = getPrepareVotes(ballot);
+                bool ratified =
+                    federatedRatify([&votes](SCPStatement const& st) {
+                        return votes.mAccepted.find(st.nodeID) !=
+                               votes.mAccepted.end();
+                    });
                 if (ratified)
                 {
                     newC = ballot;
@@ -1352,9 +1385,8 @@ BallotProtocol::attemptBump()
                 break;
             }
 
-            bool vBlocking = LocalNode::isVBlocking(
-                getLocalNode()->getQuorumSet(), mLatestEnvelopes,
-                [&](SCPStatement const& st) {
+            bool vBlocking = getLocalNode()->isVBlocking(
+                mLatestEnvelopes, [&](SCPStatement const& st) {
                     bool res;
                     auto const& pl = st.pledges;
                     if (pl.type() == SCP_ST_PREPARE)
@@ -1487,6 +1519,40 @@ BallotProtocol::setConfirmCommit(SCPBallot const& c, SCPBallot const& h)
     return true;
 }
 
+bool
+BallotProtocol::votesForPrepare(SCPBallot const& ballot,
+                                SCPStatement const& st)
+{
+    bool res;
+
+    switch (st.pledges.type())
+    {
+    case SCP_ST_PREPARE:
+    {
+        auto const& p = st.pledges.prepare();
+        res = areBallotsLessAndCompatible(ballot, p.ballot);
+    }
+    break;
+    case SCP_ST_CONFIRM:
+    {
+        auto const& c = st.pledges.confirm();
+        res = areBallotsCompatible(ballot, c.ballot);
+    }
+    break;
+    case SCP_ST_EXTERNALIZE:
+    {
+        auto const& e = st.pledges.externalize();
+        res = areBallotsCompatible(ballot, e.commit);
+    }
+    break;
+    default:
+        res = false;
+        dbgAbort();
+    }
+
+    return res;
+}
+
 bool
 BallotProtocol::hasPreparedBallot(SCPBallot const& ballot,
                                   SCPStatement const& st)
@@ -1916,6 +1982,40 @@ BallotProtocol::sendLatestEnvelope()
 const char* BallotProtocol::phaseNames[SCP_PHASE_NUM] = {"PREPARE", "FINISH",
                                                          "EXTERNALIZE"};
 
+size_t
+BallotProtocol::getHeapMemoryUsage() const
+{
+    size_t res = 0;
+    for (auto const* b : {&mCurrentBallot, &mPrepared, &mPreparedPrime,
+                          &mHighBallot, &mCommit})
+    {
+        if (*b)
+        {
+            res += xdrMemoryUsage(**b);
+        }
+    }
+    for (auto const& kv : mLatestEnvelopes)
+    {
+        res += MemoryUsage::NODE_OVERHEAD + sizeof(kv.first) +
+               xdrMemoryUsage(kv.second);
+    }
+    for (auto const* e : {&mLastEnvelope, &mLastEnvelopeEmit})
+    {
+        if (*e)
+        {
+            res += xdrMemoryUsage(**e) + 2 * sizeof(void*);
+        }
+    }
+    for (auto const& kv : mPrepareVotes)
+    {
+        res += MemoryUsage::NODE_OVERHEAD + sizeof(kv) +
+               xdr::xdr_size(kv.first) +
+               (kv.second.mVoted.size() + kv.second.mAccepted.size()) *
+                   (MemoryUsage::NODE_OVERHEAD + sizeof(NodeID));
+    }
+    return res;
+}
+
 Json::Value
 BallotProtocol::getJsonInfo()
 {
@@ -2084,8 +2184,8 @@ BallotProtocol::checkHeardFromQuorum()
     // for a given counter on the local node
     if (mCurrentBallot)
     {
-        if (LocalNode::isQuorum(
-                getLocalNode()->getQuorumSet(), mLatestEnvelopes,
+        if (getLocalNode()->isQuorum(
+                mLatestEnvelopes,
                 std::bind(&Slot::getQuorumSetFromStatement, &mSlot, _1),
                 [&](SCPStatement const& st) {
                     bool res;
@@ -57,6 +57,20 @@ class BallotProtocol
     std::shared_ptr<SCPEnvelope>
         mLastEnvelopeEmit; // last envelope emitted by this node
 
+    // nodes of M whose statement votes for (votesForPrepare) or accepts
+    // (hasPreparedBallot) "prepare(ballot)", for the ballots considered by
+    // attemptPreparedAccept and attemptPreparedConfirmed.
+    // Kept up to date by recordEnvelope, so that checking a candidate does
+    // not evaluate the predicates over all of M again.
+    struct PrepareVotes
+    {
+        std::set<NodeID> mVoted;
+        std::set<NodeID> mAccepted;
+    };
+    std::map<SCPBallot, PrepareVotes> mPrepareVotes;
+    // max number of ballots in mPrepareVotes
+    static size_t const MAX_TRACKED_PREPARE_BALLOTS;
+
   public:
     BallotProtocol(Slot& slot);
 
@@ -86,6 +100,9 @@ class BallotProtocol
     // including historical statements if available
     Json::Value getJsonInfo();
 
+    // estimate of the memory the state holds outside of the object
+    size_t getHeapMemoryUsage() const;
+
     // returns information about the quorum for a given node
     Json::Value getJsonQuorumInfo(NodeID const& id, bool summary);
 
@@ -187,6 +204,10 @@ class BallotProtocol
     static bool hasPreparedBallot(SCPBallot const& ballot,
                                   SCPStatement const& st);
 
+    // is st voting for "prepare(ballot)"
+    static bool votesForPrepare(SCPBallot const& ballot,
+                                SCPStatement const& st);
+
     // returns true if the statement commits the ballot in the range 'check'
     static bool commitPredicate(SCPBallot const& ballot, Interval const& check,
                                 SCPStatement const& st);
@@ -227,6 +248,12 @@ class BallotProtocol
     // records the statement in the state machine
     void recordEnvelope(SCPEnvelope const& env);
 
+    // returns the votes for "prepare(ballot)", tracking them from now on
+    PrepareVotes const& getPrepareVotes(SCPBallot const& ballot);
+    static void updatePrepareVotes(SCPBallot const& ballot,
+                                   SCPStatement const& st,
+                                   PrepareVotes& votes);
+
     // ** State related methods
 
     // helper function that updates the current ballot
@@ -262,5 +289,7 @@ class BallotProtocol
     void startBallotProtocolTimer();
     void stopBallotProtocolTimer();
     void checkHeardFromQuorum();
+
+    friend class TestSCP;
 };
 }
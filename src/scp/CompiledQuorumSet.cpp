@@ -0,0 +1,138 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "scp/CompiledQuorumSet.h"
+#include "scp/LocalNode.h"
+#include "util/XDROperators.h"
+
+#include <algorithm>
+#include <bitset>
+
+namespace stellar
+{
+
+CompiledQuorumSet::CompiledQuorumSet(SCPQuorumSet const& qSet)
+{
+    LocalNode::forAllNodes(qSet,
+                           [&](NodeID const& n) { mNodes.emplace_back(n); });
+    std::sort(mNodes.begin(), mNodes.end());
+    mWords = (mNodes.size() + 63) / 64;
+    compile(qSet);
+}
+
+std::vector<NodeID> const&
+CompiledQuorumSet::getNodes() const
+{
+    return mNodes;
+}
+
+size_t
+CompiledQuorumSet::compile(SCPQuorumSet const& qSet)
+{
+    Entry e;
+    e.mThreshold = qSet.threshold;
+    e.mSize = qSet.validators.size() + qSet.innerSets.size();
+    e.mValidators.resize(mWords, 0);
+    for (auto const& v : qSet.validators)
+    {
+        auto i = static_cast<size_t>(
+            std::lower_bound(mNodes.begin(), mNodes.end(), v) -
+            mNodes.begin());
+        auto& word = e.mValidators[i / 64];
+        auto bit = uint64_t(1) << (i % 64);
+        if (word & bit)
+        {
+            e.mRepeated.emplace_back(i);
+        }
+        word |= bit;
+    }
+
+    // reserve the slot first so that the top level set ends up at index 0
+    auto res = mEntries.size();
+    mEntries.emplace_back();
+    for (auto const& inner : qSet.innerSets)
+    {
+        e.mInner.emplace_back(compile(inner));
+    }
+    mEntries[res] = std::move(e);
+    return res;
+}
+
+size_t
+CompiledQuorumSet::countValidators(Entry const& e, NodeBits const& nodes) const
+{
+    size_t res = 0;
+    for (size_t w = 0; w < mWords; w++)
+    {
+        res += std::bitset<64>(e.mValidators[w] & nodes[w]).count();
+    }
+    for (auto i : e.mRepeated)
+    {
+        if (nodes[i / 64] & (uint64_t(1) << (i % 64)))
+        {
+            res++;
+        }
+    }
+    return res;
+}
+
+bool
+CompiledQuorumSet::isQuorumSliceInternal(size_t entry,
+                                         NodeBits const& nodes) const
+{
+    auto const& e = mEntries[entry];
+    // a threshold of 0 is never met, see LocalNode::isQuorumSliceInternal
+    if (e.mThreshold == 0)
+    {
+        return false;
+    }
+    auto count = countValidators(e, nodes);
+    for (auto it = e.mInner.begin();
+         it != e.mInner.end() && count < e.mThreshold; ++it)
+    {
+        if (isQuorumSliceInternal(*it, nodes))
+        {
+            count++;
+        }
+    }
+    return count >= e.mThreshold;
+}
+
+bool
+CompiledQuorumSet::isVBlockingInternal(size_t entry,
+                                       NodeBits const& nodes) const
+{
+    auto const& e = mEntries[entry];
+    // There is no v-blocking set for {\empty}
+    if (e.mThreshold == 0)
+    {
+        return false;
+    }
+    auto leftTillBlock = static_cast<int>((1 + e.mSize) - e.mThreshold);
+    auto count = static_cast<int>(countValidators(e, nodes));
+    // blocking needs at least one member, even when leftTillBlock <= 0
+    auto needed = std::max(leftTillBlock, 1);
+    for (auto it = e.mInner.begin(); it != e.mInner.end() && count < needed;
+         ++it)
+    {
+        if (isVBlockingInternal(*it, nodes))
+        {
+            count++;
+        }
+    }
+    return count >= needed;
+}
+
+bool
+CompiledQuorumSet::isQuorumSlice(NodeBits const& nodes) const
+{
+    return isQuorumSliceInternal(0, nodes);
+}
+
+bool
+CompiledQuorumSet::isVBlocking(NodeBits const& nodes) const
+{
+    return isVBlockingInternal(0, nodes);
+}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "xdr/Stellar-SCP.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace stellar
+{
+/**
+ * Flattened form of an SCPQuorumSet, for evaluating the same quorum set
+ * against many node sets.
+ *
+ * The distinct nodes of the quorum set are numbered densely (in NodeID
+ * order) and the tree of inner sets becomes an array of entries, each with
+ * its threshold, a bitmask of its direct validators and the indices of its
+ * inner entries. A node set is given as a bitmask over the same numbering
+ * (see `select`), which turns every membership test of
+ * LocalNode::isQuorumSlice / LocalNode::isVBlocking into a popcount.
+ *
+ * Results are identical to the LocalNode versions, including for quorum
+ * sets that are not sane (duplicate validators, threshold 0).
+ */
+class CompiledQuorumSet
+{
+  public:
+    typedef std::vector<uint64_t> NodeBits;
+
+    explicit CompiledQuorumSet(SCPQuorumSet const& qSet);
+
+    // distinct nodes of the quorum set, bit i of a NodeBits is getNodes()[i]
+    std::vector<NodeID> const& getNodes() const;
+
+    // bits of the nodes for which contains(nodeID) returns true
+    template <typename F>
+    NodeBits
+    select(F const& contains) const
+    {
+        return selectIndices([&](size_t i) { return contains(mNodes[i]); });
+    }
+
+    // bits of the nodes for which contains(i) returns true, where i is the
+    // position of the node in getNodes()
+    template <typename F>
+    NodeBits
+    selectIndices(F const& contains) const
+    {
+        NodeBits res(mWords, 0);
+        for (size_t i = 0; i < mNodes.size(); i++)
+        {
+            if (contains(i))
+            {
+                res[i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+        return res;
+    }
+
+    bool isQuorumSlice(NodeBits const& nodes) const;
+    bool isVBlocking(NodeBits const& nodes) const;
+
+  private:
+    struct Entry
+    {
+        uint32 mThreshold;
+        // validators + inner sets, as listed in the quorum set
+        size_t mSize;
+        NodeBits mValidators;
+        // extra occurrences of validators listed more than once
+        std::vector<size_t> mRepeated;
+        std::vector<size_t> mInner;
+    };
+
+    std::vector<NodeID> mNodes;
+    size_t mWords;
+    // mEntries[0] is the top level quorum set
+    std::vector<Entry> mEntries;
+
+    size_t compile(SCPQuorumSet const& qSet);
+    size_t countValidators(Entry const& e, NodeBits const& nodes) const;
+    bool isQuorumSliceInternal(size_t entry, NodeBits const& nodes) const;
+    bool isVBlockingInternal(size_t entry, NodeBits const& nodes) const;
+};
+}
@@ -18,12 +18,20 @@
 
 namespace stellar
 {
+// enough for the quorum sets of every node of a large network
+static size_t const COMPILED_QSET_CACHE_SIZE = 1000;
+
 LocalNode::LocalNode(NodeID const& nodeID, bool isValidator,
                      SCPQuorumSet const& qSet, SCP* scp)
-    : mNodeID(nodeID), mIsValidator(isValidator), mQSet(qSet), mSCP(scp)
+    : mNodeID(nodeID)
+    , mIsValidator(isValidator)
+    , mQSet(qSet)
+    , mSCP(scp)
+    , mCompiledQSets(COMPILED_QSET_CACHE_SIZE)
 {
     normalizeQSet(mQSet);
     mQSetHash = sha256(xdr::xdr_to_opaque(mQSet));
+    mCompiledQSet = std::make_shared<CompiledQuorumSet const>(mQSet);
 
     CLOG(INFO, "SCP") << "LocalNode::LocalNode"
                       << "@" << KeyUtils::toShortString(mNodeID)
@@ -47,6 +55,8 @@ LocalNode::updateQuorumSet(SCPQuorumSet const& qSet)
 {
     mQSetHash = sha256(xdr::xdr_to_opaque(qSet));
     mQSet = qSet;
+    mCompiledQSet = std::make_shared<CompiledQuorumSet const>(mQSet);
+    mNominationWeightsReady = false;
 }
 
 SCPQuorumSet const&
@@ -95,6 +105,22 @@ LocalNode::forAllNodes(SCPQuorumSet const& qset,
     });
 }
 
+std::vector<std::pair<NodeID, uint64>> const&
+LocalNode::getNominationWeights()
+{
+    if (!mNominationWeightsReady)
+    {
+        SCPQuorumSet qSet = mQSet;
+        normalizeQSet(qSet, &mNodeID);
+        mNominationWeights.clear();
+        forAllNodes(qSet, [&](NodeID const& n) {
+            mNominationWeights.emplace_back(n, getNodeWeight(n, qSet));
+        });
+        mNominationWeightsReady = true;
+    }
+    return mNominationWeights;
+}
+
 // if a validator is repeated multiple times its weight is only the
 // weight of the first occurrence
 uint64
@@ -277,6 +303,91 @@ LocalNode::isQuorum(
     return isQuorumSlice(qSet, pNodes);
 }
 
+std::shared_ptr<CompiledQuorumSet const>
+LocalNode::getCompiledQuorumSet(SCPQuorumSetPtr const& qSet)
+{
+    // singletons (used for EXTERNALIZE statements) are built on the fly by
+    // getSingletonQSet and are trivial to compile
+    if (qSet->validators.size() == 1 && qSet->innerSets.empty())
+    {
+        return std::make_shared<CompiledQuorumSet const>(*qSet);
+    }
+
+    if (mCompiledQSets.exists(qSet.get()))
+    {
+        auto const& e = mCompiledQSets.get(qSet.get());
+        if (e.mQSet.lock() == qSet)
+        {
+            return e.mCompiled;
+        }
+    }
+    auto res = std::make_shared<CompiledQuorumSet const>(*qSet);
+    mCompiledQSets.put(qSet.get(), CompiledQSetCacheEntry{qSet, res});
+    return res;
+}
+
+bool
+LocalNode::isVBlocking(std::map<NodeID, SCPEnvelope> const& map,
+                       std::function<bool(SCPStatement const&)> const& filter)
+{
+    auto nodes = mCompiledQSet->select([&](NodeID const& n) {
+        auto it = map.find(n);
+        return it != map.end() && filter(it->second.statement);
+    });
+    return mCompiledQSet->isVBlocking(nodes);
+}
+
+bool
+LocalNode::isQuorum(
+    std::map<NodeID, SCPEnvelope> const& map,
+    std::function<SCPQuorumSetPtr(SCPStatement const&)> const& qfun,
+    std::function<bool(SCPStatement const&)> const& filter)
+{
+    // candidates, in NodeID order, with their compiled quorum set
+    std::vector<NodeID const*> pNodes;
+    std::vector<std::shared_ptr<CompiledQuorumSet const>> qSets;
+    for (auto const& it : map)
+    {
+        if (filter(it.second.statement))
+        {
+            auto qSetPtr = qfun(it.second.statement);
+            pNodes.emplace_back(&it.first);
+            qSets.emplace_back(qSetPtr ? getCompiledQuorumSet(qSetPtr)
+                                       : nullptr);
+        }
+    }
+
+    std::vector<bool> in(pNodes.size(), true);
+    auto contains = [&](NodeID const& n) {
+        auto it = std::lower_bound(
+            pNodes.begin(), pNodes.end(), n,
+            [](NodeID const* a, NodeID const& b) { return *a < b; });
+        return it != pNodes.end() && **it == n && in[it - pNodes.begin()];
+    };
+
+    // drop the nodes whose quorum set is not satisfied by the candidates,
+    // until there are none left to drop
+    bool changed;
+    do
+    {
+        changed = false;
+        auto next = in;
+        for (size_t i = 0; i < pNodes.size(); i++)
+        {
+            if (in[i] &&
+                (!qSets[i] ||
+                 !qSets[i]->isQuorumSlice(qSets[i]->select(contains))))
+            {
+                next[i] = false;
+                changed = true;
+            }
+        }
+        in.swap(next);
+    } while (changed);
+
+    return mCompiledQSet->isQuorumSlice(mCompiledQSet->select(contains));
+}
+
 std::vector<NodeID>
 LocalNode::findClosestVBlocking(
     SCPQuorumSet const& qset, std::map<NodeID, SCPEnvelope> const& map,
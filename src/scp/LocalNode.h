@@ -8,6 +8,8 @@
 #include <set>
 #include <vector>
 
+#include "lib/util/lrucache.hpp"
+#include "scp/CompiledQuorumSet.h"
 #include "scp/SCP.h"
 #include "util/HashOfHash.h"
 
@@ -30,6 +32,27 @@ class LocalNode
 
     SCP* mSCP;
 
+    // compiled form of mQSet
+    std::shared_ptr<CompiledQuorumSet const> mCompiledQSet;
+
+    // compiled quorum sets of other nodes, keyed by the SCPQuorumSet they
+    // were built from: quorum sets handed out by the driver are shared and
+    // immutable, mQSet keeps the key from being reused by another set
+    struct CompiledQSetCacheEntry
+    {
+        std::weak_ptr<SCPQuorumSet const> mQSet;
+        std::shared_ptr<CompiledQuorumSet const> mCompiled;
+    };
+    cache::lru_cache<SCPQuorumSet const*, CompiledQSetCacheEntry>
+        mCompiledQSets;
+
+    std::shared_ptr<CompiledQuorumSet const>
+    getCompiledQuorumSet(SCPQuorumSetPtr const& qSet);
+
+    // see getNominationWeights, built on first use for mQSet
+    std::vector<std::pair<NodeID, uint64>> mNominationWeights;
+    bool mNominationWeightsReady{false};
+
   public:
     LocalNode(NodeID const& nodeID, bool isValidator, SCPQuorumSet const& qSet,
               SCP* scp);
@@ -59,6 +82,11 @@ class LocalNode
     // normalized between 0-UINT64_MAX
     static uint64 getNodeWeight(NodeID const& nodeID, SCPQuorumSet const& qset);
 
+    // the other nodes of the quorum set of this node, each once, with their
+    // weight in it once normalized without this node, as the nomination
+    // protocol weighs them; they only change with the quorum set
+    std::vector<std::pair<NodeID, uint64>> const& getNominationWeights();
+
     // Tests this node against nodeSet for the specified qSethash.
     static bool isQuorumSlice(SCPQuorumSet const& qSet,
                               std::vector<NodeID> const& nodeSet);
@@ -86,6 +114,18 @@ class LocalNode
              std::function<bool(SCPStatement const&)> const& filter =
                  [](SCPStatement const&) { return true; });
 
+    // Same as the static `isVBlocking` and `isQuorum` above, for the quorum
+    // set of this node, but evaluated on compiled quorum sets (see
+    // CompiledQuorumSet), which is much cheaper for large quorum sets.
+    bool isVBlocking(std::map<NodeID, SCPEnvelope> const& map,
+                     std::function<bool(SCPStatement const&)> const& filter =
+                         [](SCPStatement const&) { return true; });
+    bool
+    isQuorum(std::map<NodeID, SCPEnvelope> const& map,
+             std::function<SCPQuorumSetPtr(SCPStatement const&)> const& qfun,
+             std::function<bool(SCPStatement const&)> const& filter =
+                 [](SCPStatement const&) { return true; });
+
     // computes the distance to the set of v-blocking sets given
     // a set of nodes that agree (but can fail)
     // excluded, if set will be skipped altogether
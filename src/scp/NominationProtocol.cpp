@@ -10,7 +10,6 @@
 #include "lib/json/json.h"
 #include "main/Config.h"
 #include "scp/LocalNode.h"
-#include "scp/QuorumSetUtils.h"
 #include "util/GlobalChecks.h"
 #include "util/Logging.h"
 #include "util/XDROperators.h"
@@ -210,18 +209,22 @@ NominationProtocol::applyAll(SCPNomination const& nom,
 void
 NominationProtocol::updateRoundLeaders()
 {
-    SCPQuorumSet myQSet = mSlot.getLocalNode()->getQuorumSet();
+    auto localNode = mSlot.getLocalNode();
 
     // initialize priority with value derived from self
     mRoundLeaders.clear();
-    auto localID = mSlot.getLocalNode()->getNodeID();
-    normalizeQSet(myQSet, &localID);
+    auto const& localID = localNode->getNodeID();
 
     mRoundLeaders.insert(localID);
-    uint64 topPriority = getNodePriority(localID, myQSet);
+    // local node is in all quorum sets
+    uint64 topPriority = getNodePriority(localID, UINT64_MAX);
 
-    LocalNode::forAllNodes(myQSet, [&](NodeID const& cur) {
-        uint64 w = getNodePriority(cur, myQSet);
+    // the weights only depend on the quorum set, only the hashes are
+    // computed every round
+    for (auto const& nw : localNode->getNominationWeights())
+    {
+        auto const& cur = nw.first;
+        uint64 w = getNodePriority(cur, nw.second);
         if (w > topPriority)
         {
             topPriority = w;
@@ -231,7 +234,7 @@ NominationProtocol::updateRoundLeaders()
         {
             mRoundLeaders.insert(cur);
         }
-    });
+    }
     CLOG(DEBUG, "SCP") << "updateRoundLeaders: " << mRoundLeaders.size();
     if (Logging::logDebug("SCP"))
         for (auto const& rl : mRoundLeaders)
@@ -253,28 +256,24 @@ uint64
 NominationProtocol::hashValue(Value const& value)
 {
     dbgAssert(!mPreviousValue.empty());
-    return mSlot.getSCPDriver().computeValueHash(
-        mSlot.getSlotIndex(), mPreviousValue, mRoundNumber, value);
+    auto it = mValueHashes.find(value);
+    if (it == mValueHashes.end())
+    {
+        it = mValueHashes
+                 .emplace(value, mSlot.getSCPDriver().computeValueHash(
+                                     mSlot.getSlotIndex(), mPreviousValue,
+                                     mRoundNumber, value))
+                 .first;
+    }
+    return it->second;
 }
 
 uint64
-NominationProtocol::getNodePriority(NodeID const& nodeID,
-                                    SCPQuorumSet const& qset)
+NominationProtocol::getNodePriority(NodeID const& nodeID, uint64 weight)
 {
     uint64 res;
-    uint64 w;
 
-    if (nodeID == mSlot.getLocalNode()->getNodeID())
-    {
-        // local node is in all quorum sets
-        w = UINT64_MAX;
-    }
-    else
-    {
-        w = LocalNode::getNodeWeight(nodeID, qset);
-    }
-
-    if (hashNode(false, nodeID) < w)
+    if (hashNode(false, nodeID) < weight)
     {
         res = hashNode(true, nodeID);
     }
@@ -475,6 +474,7 @@ NominationProtocol::nominate(Value const& value, Value const& previousValue,
     mPreviousValue = previousValue;
 
     mRoundNumber++;
+    mValueHashes.clear();
     updateRoundLeaders();
 
     Value nominatingValue;
@@ -537,6 +537,36 @@ NominationProtocol::stopNomination()
     mNominationStarted = false;
 }
 
+size_t
+NominationProtocol::getHeapMemoryUsage() const
+{
+    size_t res = 0;
+    for (auto const* values : {&mVotes, &mAccepted, &mCandidates})
+    {
+        for (auto const& v : *values)
+        {
+            res += MemoryUsage::NODE_OVERHEAD + xdrMemoryUsage(v);
+        }
+    }
+    for (auto const& kv : mLatestNominations)
+    {
+        res += MemoryUsage::NODE_OVERHEAD + sizeof(kv.first) +
+               xdrMemoryUsage(kv.second);
+    }
+    if (mLastEnvelope)
+    {
+        res += xdrMemoryUsage(*mLastEnvelope);
+    }
+    res += mRoundLeaders.size() * (MemoryUsage::NODE_OVERHEAD + sizeof(NodeID));
+    for (auto const& kv : mValueHashes)
+    {
+        res += MemoryUsage::NODE_OVERHEAD + kv.first.capacity() +
+               sizeof(kv.second);
+    }
+    res += mLatestCompositeCandidate.capacity() + mPreviousValue.capacity();
+    return res;
+}
+
 Json::Value
 NominationProtocol::getJsonInfo()
 {
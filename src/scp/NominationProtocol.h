@@ -39,6 +39,10 @@ class NominationProtocol
     // the value from the previous slot
     Value mPreviousValue;
 
+    // hashValue of the values seen this round: leaders send their votes
+    // again with every new nomination
+    std::map<Value, uint64> mValueHashes;
+
     bool isNewerStatement(NodeID const& nodeID, SCPNomination const& st);
     static bool isNewerStatement(SCPNomination const& oldst,
                                  SCPNomination const& st);
@@ -75,7 +79,8 @@ class NominationProtocol
     // computes Gi(K, prevValue, mRoundNumber, value)
     uint64 hashValue(Value const& value);
 
-    uint64 getNodePriority(NodeID const& nodeID, SCPQuorumSet const& qset);
+    // priority of a node of weight `weight` this round
+    uint64 getNodePriority(NodeID const& nodeID, uint64 weight);
 
     // returns the highest value that we don't have yet, that we should
     // vote for, extracted from a nomination.
@@ -104,6 +109,9 @@ class NominationProtocol
 
     Json::Value getJsonInfo();
 
+    // estimate of the memory the state holds outside of the object
+    size_t getHeapMemoryUsage() const;
+
     SCPEnvelope*
     getLastMessageSend() const
     {
@@ -9,6 +9,7 @@
 #include "scp/Slot.h"
 #include "util/GlobalChecks.h"
 #include "util/Logging.h"
+#include "util/Tracing.h"
 #include "util/XDROperators.h"
 #include "xdrpp/marshal.h"
 
@@ -29,6 +30,7 @@ SCP::SCP(SCPDriver& driver, NodeID const& nodeID, bool isValidator,
 SCP::EnvelopeState
 SCP::receiveEnvelope(SCPEnvelope const& envelope)
 {
+    TRACE_ZONE("SCP::receiveEnvelope");
     // If the envelope is not correctly signed, we ignore it.
     if (!mDriver.verifyEnvelope(envelope))
     {
@@ -180,6 +182,24 @@ SCP::getCumulativeStatemtCount() const
     return c;
 }
 
+MemoryUsage
+SCP::getMemoryUsage(size_t* largestSlot) const
+{
+    MemoryUsage res;
+    for (auto const& s : mKnownSlots)
+    {
+        // with the node of the map and the control block of the shared_ptr
+        auto bytes = MemoryUsage::NODE_OVERHEAD + sizeof(s) +
+                     2 * sizeof(void*) + s.second->getMemoryUsage();
+        res.add(bytes);
+        if (largestSlot)
+        {
+            *largestSlot = std::max(*largestSlot, bytes);
+        }
+    }
+    return res;
+}
+
 std::vector<SCPEnvelope>
 SCP::getLatestMessagesSend(uint64 slotIndex)
 {
@@ -13,6 +13,7 @@
 #include "crypto/SecretKey.h"
 #include "lib/json/json-forwards.h"
 #include "scp/SCPDriver.h"
+#include "util/MemoryUsage.h"
 
 namespace stellar
 {
@@ -94,6 +95,8 @@ class SCP
     // protocol to system metric reporters.
     size_t getKnownSlotsCount() const;
     size_t getCumulativeStatemtCount() const;
+    // the known slots
+    MemoryUsage getMemoryUsage(size_t* largestSlot = nullptr) const;
 
     // returns the latest messages sent for the given slot
     std::vector<SCPEnvelope> getLatestMessagesSend(uint64 slotIndex);
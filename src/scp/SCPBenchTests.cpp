@@ -0,0 +1,343 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Throughput benchmarks of SCP message processing, driven by synthetic
+// envelopes for quorum sets of 4 to 100 nodes nested 1 to 3 levels deep.
+// They are hidden; run them with `stellar-core --test [scpbench]`. Each run
+// appends one row per quorum set to a nodes-vs-...csv file in the current
+// directory, see ScaleReporter. The [perf] one records its measurements to
+// the perf results, see PerfResults.
+
+#include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
+#include "lib/catch.hpp"
+#include "scp/LocalNode.h"
+#include "scp/SCP.h"
+#include "scp/SCPDriver.h"
+#include "scp/Slot.h"
+#include "test/PerfResults.h"
+#include "test/ScaleReporter.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
+
+#include <chrono>
+#include <cmath>
+
+using namespace stellar;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+// calls of each quorum function measured
+size_t const QUORUM_CALLS = 2000;
+// slots run through each protocol
+uint64 const SLOTS = 50;
+
+class BenchSCP : public SCPDriver
+{
+  public:
+    std::map<Hash, SCPQuorumSetPtr> mQuorumSets;
+    std::set<uint64> mExternalized;
+
+    void
+    signEnvelope(SCPEnvelope&) override
+    {
+    }
+
+    bool
+    verifyEnvelope(SCPEnvelope const&) override
+    {
+        return true;
+    }
+
+    SCPQuorumSetPtr
+    getQSet(Hash const& qSetHash) override
+    {
+        auto it = mQuorumSets.find(qSetHash);
+        return it == mQuorumSets.end() ? nullptr : it->second;
+    }
+
+    void
+    emitEnvelope(SCPEnvelope const&) override
+    {
+    }
+
+    ValidationLevel
+    validateValue(uint64, Value const&, bool) override
+    {
+        return kFullyValidatedValue;
+    }
+
+    Value
+    combineCandidates(uint64, std::set<Value> const& candidates) override
+    {
+        return *candidates.begin();
+    }
+
+    void
+    setupTimer(uint64, int, std::chrono::milliseconds,
+               std::function<void()>) override
+    {
+    }
+
+    void
+    valueExternalized(uint64 slotIndex, Value const&) override
+    {
+        mExternalized.insert(slotIndex);
+    }
+};
+
+// Quorum set of nodes [begin, end) with @p depth levels: the nodes are split
+// in about n^(1/depth) groups at each level, and every set has a threshold
+// of 2f+1 out of 3f+1.
+SCPQuorumSet
+makeQSet(std::vector<NodeID> const& nodes, size_t begin, size_t end,
+         int depth)
+{
+    SCPQuorumSet qSet;
+    auto n = end - begin;
+    size_t size;
+    if (depth <= 1 || n < 4)
+    {
+        qSet.validators.assign(nodes.begin() + begin, nodes.begin() + end);
+        size = n;
+    }
+    else
+    {
+        auto groups = std::max<size_t>(
+            2, std::lround(std::pow(static_cast<double>(n), 1.0 / depth)));
+        for (size_t g = 0; g < groups; g++)
+        {
+            qSet.innerSets.emplace_back(makeQSet(nodes, begin + g * n / groups,
+                                                 begin + (g + 1) * n / groups,
+                                                 depth - 1));
+        }
+        size = groups;
+    }
+    qSet.threshold = static_cast<uint32>(size - (size - 1) / 3);
+    return qSet;
+}
+
+SCPEnvelope
+makeEnvelope(NodeID const& nodeID, uint64 slotIndex, SCPStatement statement)
+{
+    SCPEnvelope envelope;
+    envelope.statement = std::move(statement);
+    envelope.statement.nodeID = nodeID;
+    envelope.statement.slotIndex = slotIndex;
+    return envelope;
+}
+
+double
+perSecond(size_t count, Clock::duration d)
+{
+    return count / std::chrono::duration<double>(d).count();
+}
+
+template <typename F>
+double
+microsPerCall(F const& f)
+{
+    auto start = Clock::now();
+    for (size_t i = 0; i < QUORUM_CALLS; i++)
+    {
+        f();
+    }
+    return std::chrono::duration<double, std::micro>(Clock::now() - start)
+               .count() /
+           QUORUM_CALLS;
+}
+
+class QuorumBench
+{
+    std::vector<NodeID> mNodes;
+    SCPQuorumSetPtr mQSet;
+    Hash mQSetHash;
+    Value mValue;
+
+  public:
+    QuorumBench(size_t nNodes, int depth)
+    {
+        for (size_t i = 0; i < nNodes; i++)
+        {
+            mNodes.emplace_back(
+                SecretKey::fromSeed(sha256("SCP_BENCH_NODE_" +
+                                           std::to_string(i)))
+                    .getPublicKey());
+        }
+        mQSet = std::make_shared<SCPQuorumSet>(
+            makeQSet(mNodes, 0, nNodes, depth));
+        mQSetHash = sha256(xdr::xdr_to_opaque(*mQSet));
+        mValue = xdr::xdr_to_opaque(sha256("SCP_BENCH_VALUE"));
+    }
+
+    // the local node is the first one, the envelopes come from the others
+    BenchSCP
+    makeDriver() const
+    {
+        BenchSCP driver;
+        driver.mQuorumSets[mQSetHash] = mQSet;
+        return driver;
+    }
+
+    // envelopes per second processed by nominating slots, where all
+    // the other nodes vote for and accept the same value
+    double
+    nominationRate() const
+    {
+        auto driver = makeDriver();
+        SCP scp(driver, mNodes[0], true, *mQSet);
+        SCPStatement st;
+        st.pledges.type(SCP_ST_NOMINATE);
+        st.pledges.nominate().quorumSetHash = mQSetHash;
+        st.pledges.nominate().votes.emplace_back(mValue);
+        st.pledges.nominate().accepted.emplace_back(mValue);
+        return processRate(scp, {st}, [&](uint64 slot) {
+            scp.nominate(slot, mValue, mValue);
+        });
+    }
+
+    // envelopes per second processed by slots going through the ballot
+    // protocol, where all the other nodes prepare, confirm then
+    // externalize the same ballot
+    double
+    ballotRate() const
+    {
+        auto driver = makeDriver();
+        SCP scp(driver, mNodes[0], true, *mQSet);
+        SCPBallot b(1, mValue);
+
+        SCPStatement prep;
+        prep.pledges.type(SCP_ST_PREPARE);
+        prep.pledges.prepare().ballot = b;
+        prep.pledges.prepare().quorumSetHash = mQSetHash;
+        SCPStatement conf;
+        conf.pledges.type(SCP_ST_CONFIRM);
+        auto& c = conf.pledges.confirm();
+        c.ballot = b;
+        c.nPrepared = 1;
+        c.nCommit = 1;
+        c.nH = 1;
+        c.quorumSetHash = mQSetHash;
+        SCPStatement ext;
+        ext.pledges.type(SCP_ST_EXTERNALIZE);
+        ext.pledges.externalize().commit = b;
+        ext.pledges.externalize().nH = 1;
+        ext.pledges.externalize().commitQuorumSetHash = mQSetHash;
+
+        auto rate = processRate(scp, {prep, conf, ext}, [](uint64) {});
+        REQUIRE(driver.mExternalized.size() == SLOTS);
+        return rate;
+    }
+
+    // microseconds per call of the quorum functions, on the PREPARE
+    // statements of all nodes
+    std::vector<double>
+    quorumCosts() const
+    {
+        auto driver = makeDriver();
+        SCP scp(driver, mNodes[0], true, *mQSet);
+        Slot slot(1, scp);
+        std::map<NodeID, SCPEnvelope> envs;
+        for (auto const& n : mNodes)
+        {
+            SCPStatement st;
+            st.pledges.type(SCP_ST_PREPARE);
+            st.pledges.prepare().ballot = SCPBallot(1, mValue);
+            st.pledges.prepare().quorumSetHash = mQSetHash;
+            envs[n] = makeEnvelope(n, 1, st);
+        }
+        auto qfun = [&](SCPStatement const&) { return mQSet; };
+        auto local = scp.getLocalNode();
+        auto voted = [](SCPStatement const&) { return true; };
+        auto accepted = [](SCPStatement const&) { return false; };
+
+        return {microsPerCall([&]() {
+                    REQUIRE(LocalNode::isQuorum(*mQSet, envs, qfun));
+                }),
+                microsPerCall([&]() { REQUIRE(local->isQuorum(envs, qfun)); }),
+                microsPerCall([&]() {
+                    REQUIRE(LocalNode::isVBlocking(*mQSet, envs));
+                }),
+                microsPerCall([&]() { REQUIRE(local->isVBlocking(envs)); }),
+                microsPerCall([&]() {
+                    REQUIRE(slot.federatedAccept(voted, accepted, envs));
+                })};
+    }
+
+  private:
+    // feeds SLOTS slots with the envelopes of @p statements from all the
+    // other nodes, statement by statement, after calling start(slot)
+    template <typename F>
+    double
+    processRate(SCP& scp, std::vector<SCPStatement> const& statements,
+                F const& start) const
+    {
+        Clock::duration elapsed{0};
+        size_t count = 0;
+        for (uint64 slot = 1; slot <= SLOTS; slot++)
+        {
+            std::vector<std::vector<SCPEnvelope>> envs;
+            for (auto const& st : statements)
+            {
+                envs.emplace_back();
+                for (size_t i = 1; i < mNodes.size(); i++)
+                {
+                    envs.back().emplace_back(makeEnvelope(mNodes[i], slot, st));
+                }
+            }
+
+            auto begin = Clock::now();
+            start(slot);
+            for (auto const& step : envs)
+            {
+                for (auto const& e : step)
+                {
+                    scp.receiveEnvelope(e);
+                }
+                count += step.size();
+            }
+            elapsed += Clock::now() - begin;
+        }
+        return perSecond(count, elapsed);
+    }
+};
+}
+
+TEST_CASE("scp envelope processing bench", "[scpbench][!hide]")
+{
+    ScaleReporter r({"nodes", "depth", "nominaterate", "ballotrate",
+                     "isquorumus", "compiledisquorumus", "isvblockingus",
+                     "compiledisvblockingus", "federatedacceptus"});
+    for (size_t nodes : {4, 10, 25, 50, 100})
+    {
+        for (int depth = 1; depth <= 3; depth++)
+        {
+            CLOG(INFO, "SCP") << "Benchmarking " << nodes << " nodes, depth "
+                              << depth;
+            QuorumBench bench(nodes, depth);
+            std::vector<double> row{static_cast<double>(nodes),
+                                    static_cast<double>(depth),
+                                    bench.nominationRate(),
+                                    bench.ballotRate()};
+            auto costs = bench.quorumCosts();
+            row.insert(row.end(), costs.begin(), costs.end());
+            r.write(row);
+        }
+    }
+}
+
+TEST_CASE("scp envelope processing perf", "[scpbench][perf][!hide]")
+{
+    QuorumBench bench(25, 2);
+    measurePerf("scp.nominate", "envelopes/s", PerfDirection::HIGHER_IS_BETTER,
+                [&]() { return bench.nominationRate(); });
+    measurePerf("scp.ballot", "envelopes/s", PerfDirection::HIGHER_IS_BETTER,
+                [&]() { return bench.ballotRate(); });
+    measurePerf("scp.federatedaccept", "us/call",
+                PerfDirection::LOWER_IS_BETTER,
+                [&]() { return bench.quorumCosts().back(); });
+}
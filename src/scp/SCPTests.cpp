@@ -6,11 +6,14 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "scp/CompiledQuorumSet.h"
 #include "scp/LocalNode.h"
 #include "scp/SCP.h"
 #include "scp/Slot.h"
 #include "simulation/Simulation.h"
 #include "util/Logging.h"
+#include "util/Math.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
 #include "xdrpp/marshal.h"
@@ -227,6 +230,57 @@ class TestSCP : public SCPDriver
     receiveEnvelope(SCPEnvelope const& envelope)
     {
         mSCP.receiveEnvelope(envelope);
+        checkPrepareVotes();
+    }
+
+    // checks the votes for "prepare(ballot)" that the ballot protocol of
+    // each slot keeps up to date against the predicates evaluated over its
+    // latest envelopes
+    void
+    checkPrepareVotes()
+    {
+        for (auto const& slot : mSCP.mKnownSlots)
+        {
+            auto const& bp = slot.second->getBallotProtocol();
+            REQUIRE(bp.mPrepareVotes.size() <=
+                    BallotProtocol::MAX_TRACKED_PREPARE_BALLOTS);
+            for (auto const& v : bp.mPrepareVotes)
+            {
+                std::set<NodeID> voted, accepted;
+                for (auto const& e : bp.mLatestEnvelopes)
+                {
+                    if (BallotProtocol::votesForPrepare(v.first,
+                                                        e.second.statement))
+                    {
+                        voted.insert(e.first);
+                    }
+                    if (BallotProtocol::hasPreparedBallot(v.first,
+                                                          e.second.statement))
+                    {
+                        accepted.insert(e.first);
+                    }
+                }
+                bool sameVoted = v.second.mVoted == voted;
+                bool sameAccepted = v.second.mAccepted == accepted;
+                REQUIRE(sameVoted);
+                REQUIRE(sameAccepted);
+            }
+        }
+    }
+
+    // the votes for "prepare(ballot)", tracked from now on
+    std::pair<std::set<NodeID>, std::set<NodeID>>
+    getPrepareVotes(uint64 slotIndex, SCPBallot const& ballot)
+    {
+        auto const& votes =
+            getSlot(slotIndex).getBallotProtocol().getPrepareVotes(ballot);
+        return std::make_pair(votes.mVoted, votes.mAccepted);
+    }
+
+    size_t
+    getTrackedPrepareBallots(uint64 slotIndex)
+    {
+        return getSlot(slotIndex).getBallotProtocol().mPrepareVotes.size();
     }
 
     Slot&
@@ -422,6 +476,101 @@ TEST_CASE("vblocking and quorum", "[scp]")
     REQUIRE(LocalNode::isVBlocking(qSet, nodeSet) == true);
 }
 
+TEST_CASE("compiled quorum sets", "[scp]")
+{
+    std::vector<NodeID> nodes;
+    for (int i = 0; i < 80; i++)
+    {
+        nodes.emplace_back(SecretKey::random().getPublicKey());
+    }
+
+    // random quorum sets, with repeated validators and odd thresholds
+    std::function<SCPQuorumSet(int)> randomQSet = [&](int depth) {
+        SCPQuorumSet q;
+        auto nValidators = rand_uniform<size_t>(0, 6);
+        for (size_t i = 0; i < nValidators; i++)
+        {
+            q.validators.emplace_back(
+                nodes[rand_uniform<size_t>(0, nodes.size() - 1)]);
+        }
+        if (depth > 0)
+        {
+            auto nInner = rand_uniform<size_t>(0, 3);
+            for (size_t i = 0; i < nInner; i++)
+            {
+                q.innerSets.emplace_back(randomQSet(depth - 1));
+            }
+        }
+        auto size =
+            static_cast<uint32>(q.validators.size() + q.innerSets.size());
+        q.threshold = rand_uniform<uint32>(0, size + 1);
+        return q;
+    };
+
+    for (int i = 0; i < 200; i++)
+    {
+        auto qSet = randomQSet(2);
+        CompiledQuorumSet compiled(qSet);
+
+        std::vector<NodeID> nodeSet;
+        for (auto const& n : nodes)
+        {
+            if (rand_flip())
+            {
+                nodeSet.emplace_back(n);
+            }
+        }
+        auto bits = compiled.select([&](NodeID const& n) {
+            return std::find(nodeSet.begin(), nodeSet.end(), n) !=
+                   nodeSet.end();
+        });
+
+        REQUIRE(compiled.isQuorumSlice(bits) ==
+                LocalNode::isQuorumSlice(qSet, nodeSet));
+        REQUIRE(compiled.isVBlocking(bits) ==
+                LocalNode::isVBlocking(qSet, nodeSet));
+    }
+
+    SECTION("local node")
+    {
+        // every node uses one of a few quorum sets
+        std::vector<SCPQuorumSetPtr> qSets;
+        for (int i = 0; i < 4; i++)
+        {
+            qSets.emplace_back(std::make_shared<SCPQuorumSet>(randomQSet(1)));
+        }
+        std::map<NodeID, SCPEnvelope> envs;
+        std::map<NodeID, SCPQuorumSetPtr> nodeQSets;
+        for (auto const& n : nodes)
+        {
+            if (rand_flip())
+            {
+                envs[n].statement.nodeID = n;
+                nodeQSets[n] = rand_flip() ? qSets[rand_uniform(0, 3)]
+                                           : nullptr;
+            }
+        }
+        auto qfun = [&](SCPStatement const& st) {
+            return nodeQSets[st.nodeID];
+        };
+
+        for (int i = 0; i < 50; i++)
+        {
+            LocalNode localNode(nodes[0], true, randomQSet(2), nullptr);
+            auto filter = [](SCPStatement const& st) {
+                return st.nodeID.ed25519()[0] % 4 != 0;
+            };
+            auto const& qSet = localNode.getQuorumSet();
+            REQUIRE(localNode.isVBlocking(envs, filter) ==
+                    LocalNode::isVBlocking(qSet, envs, filter));
+            REQUIRE(localNode.isQuorum(envs, qfun, filter) ==
+                    LocalNode::isQuorum(qSet, envs, qfun, filter));
+            REQUIRE(localNode.isQuorum(envs, qfun) ==
+                    LocalNode::isQuorum(qSet, envs, qfun));
+        }
+    }
+}
+
 TEST_CASE("v-blocking distance", "[scp]")
 {
     SIMULATION_CREATE_NODE(0);
@@ -541,6 +690,96 @@ makeExternalizeGen(Hash const& qSetHash, SCPBallot const& commitBallot,
                      std::cref(commitBallot), nH);
 }
 
+TEST_CASE("ballot protocol prepare votes", "[scp][ballotprotocol]")
+{
+    SIMULATION_CREATE_NODE(0);
+    SIMULATION_CREATE_NODE(1);
+    SIMULATION_CREATE_NODE(2);
+    SIMULATION_CREATE_NODE(3);
+    SIMULATION_CREATE_NODE(4);
+
+    SCPQuorumSet qSet;
+    qSet.threshold = 4;
+    qSet.validators.push_back(v0NodeID);
+    qSet.validators.push_back(v1NodeID);
+    qSet.validators.push_back(v2NodeID);
+    qSet.validators.push_back(v3NodeID);
+    qSet.validators.push_back(v4NodeID);
+
+    uint256 qSetHash = sha256(xdr::xdr_to_opaque(qSet));
+
+    TestSCP scp(v0SecretKey.getPublicKey(), qSet);
+    scp.storeQuorumSet(std::make_shared<SCPQuorumSet>(qSet));
+
+    SCPBallot A1(1, xValue), A2(2, xValue), B1(1, yValue), B2(2, yValue);
+
+    // every received envelope also checks the tracked votes against M
+    REQUIRE(scp.bumpState(0, xValue));
+    scp.receiveEnvelope(makePrepare(v1SecretKey, qSetHash, 0, A1));
+    scp.receiveEnvelope(makePrepare(v2SecretKey, qSetHash, 0, A1, &A1));
+    REQUIRE(scp.getTrackedPrepareBallots(0) != 0);
+
+    auto has = [](std::set<NodeID> const& nodes, NodeID const& n) {
+        return nodes.find(n) != nodes.end();
+    };
+
+    auto votes = scp.getPrepareVotes(0, A1);
+    REQUIRE(has(votes.first, v1NodeID));
+    REQUIRE(!has(votes.second, v1NodeID));
+    REQUIRE(has(votes.first, v2NodeID));
+    REQUIRE(has(votes.second, v2NodeID));
+
+    // a newer statement replaces the vote of its node
+    scp.receiveEnvelope(makePrepare(v1SecretKey, qSetHash, 0, B2));
+    votes = scp.getPrepareVotes(0, A1);
+    REQUIRE(!has(votes.first, v1NodeID));
+    REQUIRE(has(scp.getPrepareVotes(0, B1).first, v1NodeID));
+
+    // confirm and externalize statements vote for and accept the compatible
+    // ballots
+    scp.receiveEnvelope(makeConfirm(v3SecretKey, qSetHash, 0, 2, A2, 1, 2));
+    scp.receiveEnvelope(makeExternalize(v4SecretKey, qSetHash, 0, A1, 2));
+    votes = scp.getPrepareVotes(0, A1);
+    for (auto const& n : {v3NodeID, v4NodeID})
+    {
+        REQUIRE(has(votes.first, n));
+        REQUIRE(has(votes.second, n));
+    }
+    votes = scp.getPrepareVotes(0, B1);
+    for (auto const& n : {v3NodeID, v4NodeID})
+    {
+        REQUIRE(!has(votes.first, n));
+        REQUIRE(!has(votes.second, n));
+    }
+    scp.checkPrepareVotes();
+
+    SECTION("votes are rebuilt past the cap on tracked ballots")
+    {
+        auto cap = BallotProtocol::MAX_TRACKED_PREPARE_BALLOTS;
+        for (uint32 i = 0; i < cap + 10; i++)
+        {
+            scp.getPrepareVotes(0, SCPBallot(10 + i, yValue));
+            REQUIRE(scp.getTrackedPrepareBallots(0) <= cap);
+        }
+        scp.checkPrepareVotes();
+
+        // dropped, then built again from M
+        votes = scp.getPrepareVotes(0, A1);
+        REQUIRE(!has(votes.first, v1NodeID));
+        for (auto const& n : {v2NodeID, v3NodeID, v4NodeID})
+        {
+            REQUIRE(has(votes.first, n));
+            REQUIRE(has(votes.second, n));
+        }
+
+        // and kept up to date again
+        scp.receiveEnvelope(makePrepare(v1SecretKey, qSetHash, 0,
+                                        SCPBallot(3, xValue)));
+        REQUIRE(has(scp.getPrepareVotes(0, A1).first, v1NodeID));
+        scp.checkPrepareVotes();
+    }
+}
+
 TEST_CASE("ballot protocol core5", "[scp][ballotprotocol]")
 {
     SIMULATION_CREATE_NODE(0);
@@ -2527,4 +2766,45 @@ TEST_CASE("nomination tests core5", "[scp][nominationprotocol]")
         }
     }
 }
+TEST_CASE("statements history is compacted", "[scp]")
+{
+    SIMULATION_CREATE_NODE(0);
+    SIMULATION_CREATE_NODE(1);
+    SIMULATION_CREATE_NODE(2);
+
+    SCPQuorumSet qSet;
+    qSet.threshold = 2;
+    qSet.validators.push_back(v0NodeID);
+    qSet.validators.push_back(v1NodeID);
+    qSet.validators.push_back(v2NodeID);
+
+    TestSCP scp(v0SecretKey.getPublicKey(), qSet);
+    auto slot = scp.mSCP.getSlot(1, true);
+
+    auto statement = [](NodeID const& id, SCPStatementType type) {
+        SCPStatement st;
+        st.nodeID = id;
+        st.slotIndex = 1;
+        st.pledges.type(type);
+        return st;
+    };
+    // the first statements of v1 and v2, superseded afterwards
+    slot->recordStatement(statement(v1NodeID, SCP_ST_NOMINATE));
+    slot->recordStatement(statement(v2NodeID, SCP_ST_PREPARE));
+    slot->recordStatement(statement(v2NodeID, SCP_ST_NOMINATE));
+    auto n = 2 * Slot::MAX_STATEMENTS_HISTORY;
+    for (size_t i = 3; i < n - 1; i++)
+    {
+        slot->recordStatement(statement(v1NodeID, SCP_ST_PREPARE));
+    }
+    REQUIRE(slot->getStatementCount() == n - 1);
+
+    slot->recordStatement(statement(v1NodeID, SCP_ST_PREPARE));
+    // the recent ones, and the latest of each node and protocol
+    REQUIRE(slot->getStatementCount() == Slot::MAX_STATEMENTS_HISTORY + 3);
+    auto info = slot->getJsonInfo();
+    REQUIRE(info["statements_dropped"].asUInt64() ==
+            n - Slot::MAX_STATEMENTS_HISTORY - 3);
+    REQUIRE(info["statements"].size() == Slot::MAX_STATEMENTS_HISTORY + 3);
+}
 }
@@ -1,5 +1,6 @@
 #include "lib/catch.hpp"
 #include "scp/LocalNode.h"
+#include "scp/QuorumSetUtils.h"
 #include "simulation/Simulation.h"
 
 namespace stellar
@@ -44,4 +45,48 @@ TEST_CASE("nomination weight", "[scp]")
 
     REQUIRE(isNear(result, .6 * .5));
 }
+
+TEST_CASE("nomination weights of the local node", "[scp]")
+{
+    SIMULATION_CREATE_NODE(0);
+    SIMULATION_CREATE_NODE(1);
+    SIMULATION_CREATE_NODE(2);
+    SIMULATION_CREATE_NODE(3);
+    SIMULATION_CREATE_NODE(4);
+    SIMULATION_CREATE_NODE(5);
+
+    SCPQuorumSet qSet;
+    qSet.threshold = 3;
+    qSet.validators.push_back(v0NodeID);
+    qSet.validators.push_back(v1NodeID);
+    qSet.validators.push_back(v2NodeID);
+    qSet.validators.push_back(v3NodeID);
+    SCPQuorumSet iQSet;
+    iQSet.threshold = 1;
+    iQSet.validators.push_back(v1NodeID);
+    iQSet.validators.push_back(v4NodeID);
+    iQSet.validators.push_back(v5NodeID);
+    qSet.innerSets.push_back(iQSet);
+
+    LocalNode node(v0NodeID, true, qSet, nullptr);
+    auto normalized = qSet;
+    normalizeQSet(normalized, &v0NodeID);
+
+    // each other node once, weighed as by getNodeWeight
+    auto const& weights = node.getNominationWeights();
+    REQUIRE(weights.size() == 5);
+    for (auto const& nw : weights)
+    {
+        REQUIRE(nw.first != v0NodeID);
+        REQUIRE(nw.second == LocalNode::getNodeWeight(nw.first, normalized));
+    }
+
+    SCPQuorumSet other;
+    other.threshold = 1;
+    other.validators.push_back(v0NodeID);
+    other.validators.push_back(v1NodeID);
+    node.updateQuorumSet(other);
+    REQUIRE(node.getNominationWeights().size() == 1);
+    REQUIRE(node.getNominationWeights()[0].first == v1NodeID);
+}
 }
\ No newline at end of file
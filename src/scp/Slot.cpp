@@ -10,6 +10,7 @@
 #include "scp/LocalNode.h"
 #include "util/GlobalChecks.h"
 #include "util/Logging.h"
+#include "util/Tracing.h"
 #include "util/XDROperators.h"
 #include "util/types.h"
 #include "xdrpp/marshal.h"
@@ -20,12 +21,15 @@ namespace stellar
 {
 using namespace std::placeholders;
 
+size_t const Slot::MAX_STATEMENTS_HISTORY = 256;
+
 Slot::Slot(uint64 slotIndex, SCP& scp)
     : mSlotIndex(slotIndex)
     , mSCP(scp)
     , mBallotProtocol(*this)
     , mNominationProtocol(*this)
     , mFullyValidated(scp.getLocalNode()->isValidator())
+    , mCompactHistoryAt(2 * MAX_STATEMENTS_HISTORY)
 {
 }
 
@@ -101,11 +105,53 @@ Slot::recordStatement(SCPStatement const& st)
 {
     mStatementsHistory.emplace_back(
         HistoricalStatement{std::time(nullptr), st, mFullyValidated});
+    if (mStatementsHistory.size() >= mCompactHistoryAt)
+    {
+        compactStatementsHistory();
+    }
+}
+
+void
+Slot::compactStatementsHistory()
+{
+    // the latest statements of each node are what isNodeInQuorum needs
+    std::set<std::pair<NodeID, bool>> seen;
+    auto size = mStatementsHistory.size();
+    auto recent = size - std::min(size, MAX_STATEMENTS_HISTORY);
+    std::vector<bool> keep(size);
+    for (size_t i = size; i-- > 0;)
+    {
+        auto const& st = mStatementsHistory[i].mStatement;
+        bool latest =
+            seen.emplace(st.nodeID, st.pledges.type() == SCP_ST_NOMINATE)
+                .second;
+        keep[i] = latest || i >= recent;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (keep[i])
+        {
+            if (kept != i)
+            {
+                mStatementsHistory[kept] = std::move(mStatementsHistory[i]);
+            }
+            kept++;
+        }
+    }
+    mStatementsHistory.erase(mStatementsHistory.begin() + kept,
+                             mStatementsHistory.end());
+    mStatementsHistory.shrink_to_fit();
+    mStatementsDropped += size - kept;
+    // with many nodes, most statements may be the latest of theirs
+    mCompactHistoryAt = std::max(2 * MAX_STATEMENTS_HISTORY, 2 * kept);
 }
 
 SCP::EnvelopeState
 Slot::processEnvelope(SCPEnvelope const& envelope, bool self)
 {
+    TRACE_ZONE("Slot::processEnvelope");
     dbgAssert(envelope.statement.slotIndex == mSlotIndex);
 
     if (Logging::logDebug("SCP"))
@@ -289,6 +335,20 @@ Slot::getQuorumSetFromStatement(SCPStatement const& st)
     return res;
 }
 
+size_t
+Slot::getMemoryUsage() const
+{
+    size_t res = sizeof(*this) + mBallotProtocol.getHeapMemoryUsage() +
+                 mNominationProtocol.getHeapMemoryUsage();
+    res += (mStatementsHistory.capacity() - mStatementsHistory.size()) *
+           sizeof(HistoricalStatement);
+    for (auto const& s : mStatementsHistory)
+    {
+        res += sizeof(s) + xdr::xdr_size(s.mStatement);
+    }
+    return res;
+}
+
 Json::Value
 Slot::getJsonInfo()
 {
@@ -318,6 +378,11 @@ Slot::getJsonInfo()
         qSets[hexAbbrev(q.first)] = getLocalNode()->toJson(*q.second);
     }
 
+    if (mStatementsDropped != 0)
+    {
+        ret["statements_dropped"] =
+            static_cast<Json::UInt64>(mStatementsDropped);
+    }
     ret["validated"] = mFullyValidated;
     ret["nomination"] = mNominationProtocol.getJsonInfo();
     ret["ballotProtocol"] = mBallotProtocol.getJsonInfo();
@@ -337,7 +402,7 @@ Slot::federatedAccept(StatementPredicate voted, StatementPredicate accepted,
 {
     // Checks if the nodes that claimed to accept the statement form a
     // v-blocking set
-    if (LocalNode::isVBlocking(getLocalNode()->getQuorumSet(), envs, accepted))
+    if (getLocalNode()->isVBlocking(envs, accepted))
     {
         return true;
     }
@@ -350,9 +415,8 @@ Slot::federatedAccept(StatementPredicate voted, StatementPredicate accepted,
         return res;
     };
 
-    if (LocalNode::isQuorum(
-            getLocalNode()->getQuorumSet(), envs,
-            std::bind(&Slot::getQuorumSetFromStatement, this, _1),
+    if (getLocalNode()->isQuorum(
+            envs, std::bind(&Slot::getQuorumSetFromStatement, this, _1),
             ratifyFilter))
     {
         return true;
@@ -365,9 +429,8 @@ bool
 Slot::federatedRatify(StatementPredicate voted,
                       std::map<NodeID, SCPEnvelope> const& envs)
 {
-    return LocalNode::isQuorum(
-        getLocalNode()->getQuorumSet(), envs,
-        std::bind(&Slot::getQuorumSetFromStatement, this, _1), voted);
+    return getLocalNode()->isQuorum(
+        envs, std::bind(&Slot::getQuorumSetFromStatement, this, _1), voted);
 }
 
 std::shared_ptr<LocalNode>
@@ -41,11 +41,23 @@ class Slot : public std::enable_shared_from_this<Slot>
     };
 
     std::vector<HistoricalStatement> mStatementsHistory;
+    // statements dropped from mStatementsHistory, and its size at which the
+    // next compaction happens (see compactStatementsHistory)
+    size_t mStatementsDropped{0};
+    size_t mCompactHistoryAt;
+
+    // drops the statements superseded by a later one of the same node (for
+    // the same protocol), but the last MAX_STATEMENTS_HISTORY recorded
+    void compactStatementsHistory();
 
     // true if the Slot was fully validated
     bool mFullyValidated;
 
   public:
+    // recent statements always kept in the history, whether superseded or
+    // not; the history is compacted once twice as large
+    static size_t const MAX_STATEMENTS_HISTORY;
+
     Slot(uint64 slotIndex, SCP& SCP);
 
     uint64
@@ -125,6 +137,7 @@ class Slot : public std::enable_shared_from_this<Slot>
 
     // ** status methods
 
+    // statements kept in the history
     size_t
     getStatementCount() const
     {
@@ -135,6 +148,9 @@ class Slot : public std::enable_shared_from_this<Slot>
     // including historical statements if available
     Json::Value getJsonInfo();
 
+    // estimate of the memory held by the slot, see MemoryUsage
+    size_t getMemoryUsage() const;
+
     // returns information about the quorum for a given node
     Json::Value getJsonQuorumInfo(NodeID const& id, bool summary);
 
@@ -7,7 +7,10 @@
 #include "bucket/BucketManager.h"
 #include "bucket/BucketManagerImpl.h"
 #include "bucket/LedgerCmp.h"
+#include "catchup/RestoreFromBuckets.h"
+#include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "database/Database.h"
 #include "herder/Herder.h"
 #include "herder/LedgerCloseData.h"
 #include "ledger/LedgerManager.h"
@@ -15,9 +18,16 @@
 #include "lib/catch.hpp"
 #include "lib/util/format.h"
 #include "main/Application.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "medida/stats/snapshot.h"
 #include "overlay/StellarXDR.h"
+#include "simulation/LedgerCloseBench.h"
+#include "simulation/LedgerStateGenerator.h"
 #include "simulation/Topologies.h"
+#include "test/PerfResults.h"
+#include "test/ScaleReporter.h"
+#include "test/TestUtils.h"
 #include "test/test.h"
 #include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
@@ -323,6 +333,70 @@ TEST_CASE("core-nodes with outer nodes", "[simulation]")
     }
 }
 
+static void
+watchersTest(int nLedgers, int nbCore, int nbWatchers, int nRegions,
+             Simulation::LinkModel const& local,
+             Simulation::LinkModel const& remote, Hash const& networkID)
+{
+    LOG(DEBUG) << "starting watchers test " << nbCore << " : " << nbWatchers;
+    auto tBegin = std::chrono::system_clock::now();
+
+    Simulation::pointer sim = Topologies::coreWithWatchers(
+        nbCore, nbWatchers, Simulation::OVER_LOOPBACK, networkID,
+        Simulation::lightweightConfigs());
+    sim->setLinkModel(
+        Topologies::regions(sim->getNodeIDs(), nRegions, local, remote));
+    sim->startAllNodes();
+
+    sim->crankUntil(
+        [&sim, nLedgers]() {
+            return sim->haveAllExternalized(nLedgers + 1, 3);
+        },
+        20 * nLedgers * Herder::EXP_LEDGER_TIMESPAN_SECONDS, true);
+
+    REQUIRE(sim->haveAllExternalized(nLedgers + 1, 3));
+
+    printStats(nLedgers, tBegin, sim);
+}
+
+TEST_CASE("core-nodes with watchers over a modeled network", "[simulation]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::LinkModel local;
+    local.mLatency = std::chrono::milliseconds(5);
+    local.mJitter = std::chrono::milliseconds(1);
+    Simulation::LinkModel remote;
+    remote.mLatency = std::chrono::milliseconds(50);
+    remote.mJitter = std::chrono::milliseconds(10);
+    remote.mBytesPerSecond = 1000000;
+    remote.mLossProbability = 0.01;
+    SECTION("one region")
+    {
+        watchersTest(4, 4, 12, 1, remote, remote, networkID);
+    }
+    SECTION("three regions")
+    {
+        watchersTest(4, 4, 12, 3, local, remote, networkID);
+    }
+}
+
+TEST_CASE("core-nodes with hundreds of watchers",
+          "[simulation][scalability][!hide]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::LinkModel local;
+    local.mLatency = std::chrono::milliseconds(2);
+    Simulation::LinkModel remote;
+    remote.mLatency = std::chrono::milliseconds(80);
+    remote.mJitter = std::chrono::milliseconds(20);
+    remote.mBytesPerSecond = 10000000;
+    remote.mLossProbability = 0.001;
+    for (int nbWatchers : {200, 500})
+    {
+        watchersTest(4, 20, nbWatchers, 4, local, remote, networkID);
+    }
+}
+
 TEST_CASE("cycle4 topology", "[simulation]")
 {
     const int nLedgers = 10;
@@ -354,7 +428,8 @@ TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
     auto nodes = simulation->getNodes();
     auto& app = *nodes[0]; // pick a node to generate load
 
-    app.getLoadGenerator().generateLoad(true, 3, 0, 0, 10, 100, false);
+    app.getLoadGenerator().generateLoad(LoadGenMode::CREATE, 3, 0, 0, 10, 100,
+                                        false);
     try
     {
         simulation->crankUntil(
@@ -367,7 +442,8 @@ TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
             },
             3 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
 
-        app.getLoadGenerator().generateLoad(false, 3, 0, 10, 10, 100, false);
+        app.getLoadGenerator().generateLoad(LoadGenMode::PAY, 3, 0, 10, 10,
+                                            100, false);
         simulation->crankUntil(
             [&]() {
                 return simulation->haveAllExternalized(8, 2) &&
@@ -384,6 +460,84 @@ TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
     LOG(INFO) << simulation->metricsSummary("database");
 }
 
+TEST_CASE("Load generator transaction shapes", "[simulation][loadgen]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation = Topologies::pair(
+        Simulation::OVER_LOOPBACK, networkID, [](int i) {
+            auto cfg = getTestConfig(i);
+            cfg.ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = true;
+            return cfg;
+        });
+
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto& app = *simulation->getNodes()[0];
+    auto& lg = app.getLoadGenerator();
+    auto& complete =
+        app.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
+    auto& rejected =
+        app.getMetrics().NewMeter({"loadgen", "txn", "rejected"}, "txn");
+    auto run = [&](LoadGenMode mode, uint32_t nTxs) {
+        auto done = complete.count();
+        lg.generateLoad(mode, 10, 0, nTxs, 20, 10, false);
+        simulation->crankUntil(
+            [&]() {
+                return complete.count() == done + 1 &&
+                       simulation->accountsOutOfSyncWithDb(app).empty();
+            },
+            10 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+        REQUIRE(complete.count() == done + 1);
+    };
+
+    LoadGenerator::Shape shape;
+    shape.mAssets = 3;
+    shape.mSigners = 2;
+    shape.mHops = 3;
+    REQUIRE_THROWS_AS(lg.setShape(LoadGenerator::Shape{3, 0, 4, 30, 30}),
+                      std::invalid_argument);
+    lg.setShape(shape);
+
+    run(LoadGenMode::CREATE, 0);
+    run(LoadGenMode::SETUP, 0);
+    run(LoadGenMode::OFFERS, 30);
+    run(LoadGenMode::PATH_PAY, 10);
+    run(LoadGenMode::MIXED, 20);
+
+    // every transaction of the multisig accounts was accepted
+    REQUIRE(rejected.count() == 0);
+    auto& sess = app.getDatabase().getSession();
+    int trustLines = 0, signers = 0, offers = 0;
+    sess << "SELECT COUNT(*) FROM trustlines", soci::into(trustLines);
+    sess << "SELECT COUNT(*) FROM signers", soci::into(signers);
+    sess << "SELECT COUNT(*) FROM offers", soci::into(offers);
+    REQUIRE(trustLines == 30);
+    REQUIRE(signers == 20);
+    REQUIRE(offers > 0);
+    REQUIRE(app.getMetrics()
+                .NewMeter({"loadgen", "payment", "path"}, "payment")
+                .count() >= 10);
+
+    SECTION("open loop")
+    {
+        auto& latency =
+            app.getMetrics().NewTimer({"loadgen", "txn", "latency"});
+        auto& dropped =
+            app.getMetrics().NewMeter({"loadgen", "txn", "dropped"}, "txn");
+        auto rejectedBefore = rejected.count();
+        lg.setArrival(LoadGenerator::Arrival::POISSON);
+        run(LoadGenMode::PAY, 50);
+        // each transaction is accepted, rejected or dropped once
+        REQUIRE(latency.count() + (rejected.count() - rejectedBefore) +
+                    dropped.count() ==
+                50);
+        REQUIRE(latency.count() > 0);
+    }
+}
+
 Application::pointer
 newLoadTestApp(VirtualClock& clock)
 {
@@ -408,7 +562,7 @@ TEST_CASE("Auto-calibrated single node load test", "[autoload][!hide]")
     VirtualClock clock(VirtualClock::REAL_TIME);
     auto appPtr = newLoadTestApp(clock);
     // Create accounts
-    appPtr->generateLoad(true, 100000, 0, 0, 10, 3, true);
+    appPtr->generateLoad(LoadGenMode::CREATE, 100000, 0, 0, 10, 3, true);
     auto& io = clock.getIOService();
     asio::io_service::work mainWork(io);
     auto& complete =
@@ -418,76 +572,13 @@ TEST_CASE("Auto-calibrated single node load test", "[autoload][!hide]")
         clock.crank();
     }
     // Generate payments
-    appPtr->generateLoad(false, 100000, 0, 100000, 10, 100, true);
+    appPtr->generateLoad(LoadGenMode::PAY, 100000, 0, 100000, 10, 100, true);
     while (!io.stopped() && complete.count() == 1)
     {
         clock.crank();
     }
 }
 
-class ScaleReporter
-{
-    std::vector<std::string> mColumns;
-    std::string mFilename;
-    std::ofstream mOut;
-    size_t mNumWritten{0};
-    static std::string
-    join(std::vector<std::string> const& parts, std::string const& sep)
-    {
-        std::string sum;
-        bool first = true;
-        for (auto const& s : parts)
-        {
-            if (first)
-            {
-                first = false;
-            }
-            else
-            {
-                sum += sep;
-            }
-            sum += s;
-        }
-        return sum;
-    }
-
-  public:
-    ScaleReporter(std::vector<std::string> const& columns)
-        : mColumns(columns)
-        , mFilename(fmt::format("{:s}-{:d}.csv", join(columns, "-vs-"),
-                                std::time(nullptr)))
-        , mOut(mFilename)
-    {
-        LOG(INFO) << "Opened " << mFilename << " for writing";
-        mOut << join(columns, ",") << std::endl;
-    }
-
-    ~ScaleReporter()
-    {
-        LOG(INFO) << "Wrote " << mNumWritten << " rows to " << mFilename;
-    }
-
-    void
-    write(std::vector<double> const& vals)
-    {
-        assert(vals.size() == mColumns.size());
-        std::ostringstream oss;
-        for (size_t i = 0; i < vals.size(); ++i)
-        {
-            if (i != 0)
-            {
-                oss << ", ";
-                mOut << ",";
-            }
-            oss << mColumns.at(i) << "=" << std::fixed << vals.at(i);
-            mOut << std::fixed << vals.at(i);
-        }
-        LOG(INFO) << std::fixed << "Writing " << oss.str();
-        mOut << std::endl;
-        ++mNumWritten;
-    }
-};
-
 TEST_CASE("Accounts vs. latency", "[scalability][!hide]")
 {
     ScaleReporter r({"accounts", "txcount", "latencymin", "latencymax",
@@ -502,7 +593,7 @@ TEST_CASE("Accounts vs. latency", "[scalability][!hide]")
     uint32_t numItems = 500000;
 
     // Create accounts
-    lg.generateLoad(true, numItems, 0, 0, 10, 100, true);
+    lg.generateLoad(LoadGenMode::CREATE, numItems, 0, 0, 10, 100, true);
 
     auto& complete =
         appPtr->getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
@@ -517,7 +608,8 @@ TEST_CASE("Accounts vs. latency", "[scalability][!hide]")
     txtime.Clear();
 
     // Generate payment txs
-    lg.generateLoad(false, numItems, 0, numItems / 10, 10, 100, true);
+    lg.generateLoad(LoadGenMode::PAY, numItems, 0, numItems / 10, 10, 100,
+                    true);
     while (!io.stopped() && complete.count() == 1)
     {
         clock.crank();
@@ -531,6 +623,100 @@ TEST_CASE("Accounts vs. latency", "[scalability][!hide]")
              txtime.GetSnapshot().get99thPercentile()});
 }
 
+TEST_CASE("Ledger close benchmark", "[simulation][bench]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    auto& lm = app->getLedgerManager();
+
+    auto check = [&](std::string const& mode) {
+        auto options = LedgerCloseBench::parseOptions(
+            "accounts=300&offers=2&ledgers=3&txs=100&mode=" + mode);
+        LedgerCloseBench bench(*app, options);
+        bench.populate();
+        auto lcl = lm.getLastClosedLedgerNum();
+        REQUIRE(lm.getCurrentLedgerHeader().idPool >= 600);
+        auto report = bench.run();
+        REQUIRE(lm.getLastClosedLedgerNum() == lcl + 3);
+        REQUIRE(report["transactions"].asUInt64() == 300);
+        REQUIRE(report["phases"]["apply"]["ledgers_ms"].size() == 3);
+        REQUIRE(report["phases"]["close"]["total_ms"].asDouble() > 0);
+        return report;
+    };
+
+    SECTION("payments")
+    {
+        REQUIRE(check("pay")["failed"].asUInt64() == 0);
+    }
+    SECTION("mixed")
+    {
+        check("mixed");
+    }
+}
+
+TEST_CASE("generate ledger state", "[simulation][bench]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+
+    Json::Value report;
+    {
+        auto app = createTestApplication(clock, cfg);
+        auto options = LedgerStateGenerator::parseOptions(
+            "accounts=100&assets=2&offers=2&dist=pareto");
+        report = LedgerStateGenerator(*app, options).run();
+    }
+    REQUIRE(report["accounts"].asUInt() == 100);
+    REQUIRE(report["trustlines"].asUInt64() == 200);
+    // the accounts, their trust lines and offers, and the root account
+    REQUIRE(report["entries"].asUInt64() ==
+            301 + report["offers"].asUInt64());
+
+    auto app = restoreFromBuckets(clock, cfg);
+    REQUIRE(app);
+    auto const& lcl = app->getLedgerManager().getLastClosedLedgerHeader();
+    REQUIRE(lcl.header.ledgerSeq == report["ledger"].asUInt());
+    REQUIRE(binToHex(lcl.hash) == report["hash"].asString());
+
+    auto& sess = app->getDatabase().getSession();
+    int accounts = 0;
+    int offers = 0;
+    sess << "SELECT COUNT(*) FROM accounts", soci::into(accounts);
+    sess << "SELECT COUNT(*) FROM offers", soci::into(offers);
+    REQUIRE(accounts == 101);
+    REQUIRE(offers == report["offers"].asInt());
+
+    REQUIRE_THROWS_AS(LedgerStateGenerator::parseOptions("dist=normal"),
+                      std::invalid_argument);
+}
+
+TEST_CASE("Ledger close perf", "[simulation][bench][perf][!hide]")
+{
+    auto options = LedgerCloseBench::parseOptions(
+        "accounts=5000&offers=1&ledgers=5&txs=500&mode=mixed");
+    VirtualClock clock;
+    auto cfg = getTestConfig();
+    cfg.INVARIANT_CHECKS = {};
+    cfg.TESTING_UPGRADE_MAX_TX_PER_LEDGER = options.mTxs;
+    auto app = createTestApplication(clock, cfg);
+
+    LedgerCloseBench bench(*app, options);
+    bench.populate();
+    for (int i = 0; i < getPerfRuns(); i++)
+    {
+        auto report = bench.run();
+        recordPerfSample("ledger.close", "transactions/s",
+                         PerfDirection::HIGHER_IS_BETTER,
+                         report["tx_per_second"].asDouble());
+        recordPerfSample("ledger.close.apply", "ms/ledger",
+                         PerfDirection::LOWER_IS_BETTER,
+                         report["phases"]["apply"]["mean_ms"].asDouble());
+        recordPerfSample("ledger.close.commit", "ms/ledger",
+                         PerfDirection::LOWER_IS_BETTER,
+                         report["phases"]["commit"]["mean_ms"].asDouble());
+    }
+}
+
 static void
 netTopologyTest(std::string const& name,
                 std::function<Simulation::pointer(int numNodes)> mkSim)
@@ -550,7 +736,8 @@ netTopologyTest(std::string const& name,
         assert(!nodes.empty());
         auto& app = *nodes[0];
 
-        app.getLoadGenerator().generateLoad(true, 50, 0, 0, 10, 100, false);
+        app.getLoadGenerator().generateLoad(LoadGenMode::CREATE, 50, 0, 0, 10,
+                                            100, false);
         auto& complete =
             app.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
 
@@ -667,3 +854,86 @@ TEST_CASE("Bucket-list entries vs. write throughput", "[scalability][!hide]")
         }
     }
 }
+
+TEST_CASE("compact tx set relay", "[simulation][compacttxset]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation = Topologies::pair(
+        Simulation::OVER_LOOPBACK, networkID, [](int i) {
+            auto cfg = getTestConfig(i);
+            cfg.COMPACT_TX_SET_RELAY = true;
+            return cfg;
+        });
+
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto nodes = simulation->getNodes();
+    auto& app = *nodes[0];
+    app.getLoadGenerator().generateLoad(LoadGenMode::CREATE, 10, 0, 0, 10, 100,
+                                        false);
+    simulation->crankUntil(
+        [&]() {
+            return simulation->haveAllExternalized(6, 2) &&
+                   simulation->accountsOutOfSyncWithDb(app).empty();
+        },
+        4 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    int64_t compactSets = 0;
+    for (auto const& node : nodes)
+    {
+        compactSets += node->getMetrics()
+                           .NewMeter({"overlay", "send", "compact-txset"},
+                                     "message")
+                           .count();
+    }
+    REQUIRE(compactSets != 0);
+}
+
+TEST_CASE("SCP state diff on reconnect", "[simulation][herder]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer simulation =
+        Topologies::pair(Simulation::OVER_LOOPBACK, networkID);
+
+    simulation->startAllNodes();
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(3, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    auto nodes = simulation->getNodes();
+    auto key0 = nodes[0]->getConfig().NODE_SEED.getPublicKey();
+    auto key1 = nodes[1]->getConfig().NODE_SEED.getPublicKey();
+    auto lcl = nodes[1]->getLedgerManager().getLastClosedLedgerNum();
+    REQUIRE(!nodes[1]->getHerder().getSCPStateHashes(lcl, 1000).empty());
+    REQUIRE(nodes[1]->getHerder().getSCPStateHashes(lcl, 1).size() == 1);
+
+    auto skipped = [&]() {
+        int64_t res = 0;
+        for (auto const& node : nodes)
+        {
+            res += node->getMetrics()
+                       .NewMeter({"scp", "state", "skipped"}, "envelope")
+                       .count();
+        }
+        return res;
+    };
+    REQUIRE(skipped() == 0);
+
+    // both nodes have the same state: reconnecting, they do not send it
+    // again to each other
+    simulation->dropConnection(key0, key1);
+    simulation->addConnection(key0, key1);
+    simulation->crankForAtLeast(std::chrono::seconds(1), false);
+    REQUIRE(skipped() != 0);
+    REQUIRE(nodes[0]
+                ->getMetrics()
+                .NewMeter({"overlay", "send", "get-scp-state-diff"}, "message")
+                .count() != 0);
+
+    simulation->crankUntil(
+        [&]() { return simulation->haveAllExternalized(lcl + 2, 1); },
+        2 * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+}
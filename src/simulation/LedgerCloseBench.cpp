@@ -0,0 +1,219 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/LedgerCloseBench.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
+#include "ledger/LedgerManager.h"
+#include "lib/http/server.hpp"
+#include "main/Application.h"
+#include "simulation/ParamUtils.h"
+#include "transactions/TransactionFrame.h"
+#include "util/Logging.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace stellar
+{
+
+namespace
+{
+// accounts written by each ledger of populate()
+uint32_t const POPULATE_BATCH = 10000;
+
+// the phases reported, and the timers measuring them
+std::vector<std::pair<std::string, medida::MetricName>> const PHASES = {
+    {"close", {"ledger", "ledger", "close"}},
+    {"prefetch", {"ledger", "transaction", "prefetch"}},
+    {"fees", {"ledger", "close", "fees"}},
+    {"signature-wait", {"ledger", "transaction", "signature-wait"}},
+    {"apply", {"ledger", "close", "apply"}},
+    {"bucket-add", {"bucket", "batch", "add"}},
+    {"history", {"ledger", "close", "history"}},
+    {"commit", {"ledger", "close", "commit"}}};
+}
+
+LedgerCloseBench::Options
+LedgerCloseBench::parseOptions(std::string const& params)
+{
+    std::map<std::string, std::string> map;
+    http::server::server::parseParams(params, map);
+
+    Options res;
+    parseUintParam(map, "accounts", res.mAccounts);
+    parseUintParam(map, "offers", res.mOffers);
+    parseUintParam(map, "ledgers", res.mLedgers);
+    parseUintParam(map, "txs", res.mTxs);
+    parseUintParam(map, "assets", res.mShape.mAssets);
+    parseUintParam(map, "hops", res.mShape.mHops);
+    parseUintParam(map, "offerpct", res.mShape.mOfferPercent);
+    parseUintParam(map, "pathpct", res.mShape.mPathPercent);
+
+    auto mode = map.find("mode");
+    if (mode == map.end() || mode->second == "pay")
+    {
+        res.mMode = LoadGenMode::PAY;
+    }
+    else if (mode->second == "offers")
+    {
+        res.mMode = LoadGenMode::OFFERS;
+    }
+    else if (mode->second == "pathpay")
+    {
+        res.mMode = LoadGenMode::PATH_PAY;
+    }
+    else if (mode->second == "mixed")
+    {
+        res.mMode = LoadGenMode::MIXED;
+    }
+    else
+    {
+        throw std::invalid_argument("Unknown mode " + mode->second);
+    }
+
+    if (res.mAccounts < 2 || res.mTxs == 0)
+    {
+        throw std::invalid_argument("Need 2 accounts and 1 tx per ledger");
+    }
+    res.mTxs = std::min(res.mTxs, res.mAccounts);
+    return res;
+}
+
+LedgerCloseBench::LedgerCloseBench(Application& app, Options const& options)
+    : mApp(app), mOptions(options)
+{
+    mApp.getLoadGenerator().setShape(mOptions.mShape);
+}
+
+void
+LedgerCloseBench::populate()
+{
+    auto& lg = mApp.getLoadGenerator();
+    auto offerID = mApp.getLedgerManager().getCurrentLedgerHeader().idPool + 1;
+    for (uint32_t first = 0; first < mOptions.mAccounts;
+         first += POPULATE_BATCH)
+    {
+        auto end = std::min(first + POPULATE_BATCH, mOptions.mAccounts);
+        std::vector<LedgerEntry> entries;
+        for (uint32_t i = first; i < end; i++)
+        {
+            auto account = lg.makeAccountEntries(i, mOptions.mOffers, offerID);
+            entries.insert(entries.end(), account.begin(), account.end());
+        }
+        mApp.getLedgerManager().closeLedgerWithEntries(entries);
+        while (mApp.getClock().crank(false) > 0)
+            ;
+        LOG(INFO) << "Bench: wrote " << end << " accounts";
+    }
+}
+
+void
+LedgerCloseBench::closeLedger(std::vector<TransactionFramePtr> const& txs)
+{
+    auto& lm = mApp.getLedgerManager();
+    auto const& lcl = lm.getLastClosedLedgerHeader();
+    auto txSet = std::make_shared<TxSetFrame>(lcl.hash);
+    for (auto const& tx : txs)
+    {
+        txSet->add(tx);
+    }
+    txSet->sortForHash();
+
+    StellarValue sv(txSet->getContentsHash(),
+                    lcl.header.scpValue.closeTime + 5, emptyUpgradeSteps, 0);
+    lm.closeLedger(LedgerCloseData(lm.getLedgerNum(), txSet, sv));
+    // the work posted by the close, such as the database checkpoint
+    while (mApp.getClock().crank(false) > 0)
+        ;
+}
+
+Json::Value
+LedgerCloseBench::run()
+{
+    auto& lg = mApp.getLoadGenerator();
+    auto& metrics = mApp.getMetrics();
+    std::vector<medida::Timer*> timers;
+    std::vector<Json::Value> phases(PHASES.size());
+    for (auto const& phase : PHASES)
+    {
+        timers.emplace_back(&metrics.NewTimer(phase.second));
+    }
+
+    uint64_t nTxs = 0;
+    uint64_t nOps = 0;
+    uint64_t nFailed = 0;
+    uint32_t source = 0;
+    for (uint32_t l = 0; l < mOptions.mLedgers; l++)
+    {
+        auto ledgerNum = mApp.getLedgerManager().getLedgerNum();
+        std::vector<TransactionFramePtr> txs;
+        for (uint32_t i = 0; i < mOptions.mTxs; i++)
+        {
+            auto tx = lg.makeTransaction(mOptions.mMode, mOptions.mAccounts, 0,
+                                         ledgerNum, source);
+            txs.emplace_back(tx.toTransactionFrame(mApp));
+            source = (source + 1) % mOptions.mAccounts;
+        }
+
+        std::vector<double> before;
+        for (auto timer : timers)
+        {
+            before.emplace_back(timer->sum());
+        }
+        closeLedger(txs);
+        for (size_t i = 0; i < timers.size(); i++)
+        {
+            phases[i].append(timers[i]->sum() - before[i]);
+        }
+
+        for (auto const& tx : txs)
+        {
+            nOps += tx->getOperations().size();
+            if (tx->getResultCode() != txSUCCESS)
+            {
+                nFailed++;
+            }
+        }
+        nTxs += txs.size();
+    }
+
+    Json::Value res;
+    auto& params = res["parameters"];
+    params["accounts"] = mOptions.mAccounts;
+    params["offers"] = mOptions.mOffers;
+    params["ledgers"] = mOptions.mLedgers;
+    params["txs"] = mOptions.mTxs;
+    params["assets"] = mOptions.mShape.mAssets;
+    params["hops"] = mOptions.mShape.mHops;
+    res["transactions"] = static_cast<Json::UInt64>(nTxs);
+    res["operations"] = static_cast<Json::UInt64>(nOps);
+    res["failed"] = static_cast<Json::UInt64>(nFailed);
+
+    // per phase, the total, mean and max over the ledgers in ms, and the
+    // time of each ledger
+    for (size_t i = 0; i < PHASES.size(); i++)
+    {
+        double total = 0;
+        double max = 0;
+        for (auto const& v : phases[i])
+        {
+            total += v.asDouble();
+            max = std::max(max, v.asDouble());
+        }
+        auto& phase = res["phases"][PHASES[i].first];
+        phase["total_ms"] = total;
+        phase["mean_ms"] = mOptions.mLedgers ? total / mOptions.mLedgers : 0;
+        phase["max_ms"] = max;
+        phase["ledgers_ms"] = phases[i];
+    }
+    auto closeTime = res["phases"]["close"]["total_ms"].asDouble();
+    res["tx_per_second"] = closeTime > 0 ? nTxs * 1000.0 / closeTime : 0;
+    return res;
+}
+}
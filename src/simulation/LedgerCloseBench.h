@@ -0,0 +1,64 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+#include "simulation/LoadGenerator.h"
+
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * End-to-end benchmark of ledger close, to compare branches on the same
+ * workload. On a standalone node with a fresh database, it writes a ledger
+ * state of accounts, trust lines and offers directly (see
+ * LedgerManager::closeLedgerWithEntries), then closes ledgers of
+ * transactions shaped by the load generator, and reports the time spent in
+ * each phase of closing them: fee processing, transaction apply, SQL
+ * commit, bucket list update and history queueing.
+ */
+class LedgerCloseBench
+{
+  public:
+    struct Options
+    {
+        uint32_t mAccounts{10000};
+        // resting offers written with each account
+        uint32_t mOffers{1};
+        uint32_t mLedgers{10};
+        // transactions of each ledger, at most one per account
+        uint32_t mTxs{1000};
+        // PAY, OFFERS, PATH_PAY or MIXED
+        LoadGenMode mMode{LoadGenMode::PAY};
+        // with no extra signers
+        LoadGenerator::Shape mShape;
+    };
+
+    // Parses the parameters of --bench, in the form of the generateload
+    // command's: accounts, offers, ledgers, txs, mode (pay, offers,
+    // pathpay or mixed), assets, hops, offerpct and pathpct. Throws
+    // std::invalid_argument on bad parameters.
+    static Options parseOptions(std::string const& params);
+
+    LedgerCloseBench(Application& app, Options const& options);
+
+    // writes the initial ledger state
+    void populate();
+
+    // closes the ledgers and returns the report
+    Json::Value run();
+
+  private:
+    Application& mApp;
+    Options const mOptions;
+
+    void closeLedger(std::vector<TransactionFramePtr> const& txs);
+};
+}
@@ -0,0 +1,224 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/LedgerStateGenerator.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
+#include "crypto/Hex.h"
+#include "crypto/SHA.h"
+#include "history/HistoryArchive.h"
+#include "history/HistoryManager.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/LedgerManager.h"
+#include "lib/http/server.hpp"
+#include "main/Application.h"
+#include "simulation/LoadGenerator.h"
+#include "simulation/ParamUtils.h"
+#include "util/Logging.h"
+#include "util/Math.h"
+#include "xdrpp/marshal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+namespace stellar
+{
+
+uint32_t const LedgerStateGenerator::MAX_OFFERS = 1000;
+
+namespace
+{
+// entries written to each fresh bucket
+size_t const BATCH_SIZE = 100000;
+}
+
+LedgerStateGenerator::Options
+LedgerStateGenerator::parseOptions(std::string const& params)
+{
+    std::map<std::string, std::string> map;
+    http::server::server::parseParams(params, map);
+
+    Options res;
+    parseUintParam(map, "accounts", res.mAccounts);
+    parseUintParam(map, "assets", res.mAssets);
+    parseUintParam(map, "offers", res.mOffers);
+    parseUintParam(map, "ledger", res.mLedger);
+
+    auto dist = map.find("dist");
+    if (dist == map.end() || dist->second == "fixed")
+    {
+        res.mDistribution = Distribution::FIXED;
+    }
+    else if (dist->second == "uniform")
+    {
+        res.mDistribution = Distribution::UNIFORM;
+    }
+    else if (dist->second == "pareto")
+    {
+        res.mDistribution = Distribution::PARETO;
+    }
+    else
+    {
+        throw std::invalid_argument("Unknown distribution " + dist->second);
+    }
+
+    if (res.mAccounts == 0)
+    {
+        throw std::invalid_argument("Need at least 1 account");
+    }
+    if (res.mOffers > MAX_OFFERS)
+    {
+        throw std::invalid_argument("Too many offers per account");
+    }
+    return res;
+}
+
+LedgerStateGenerator::LedgerStateGenerator(Application& app,
+                                           Options const& options)
+    : mApp(app), mOptions(options)
+{
+    auto shape = mApp.getLoadGenerator().getShape();
+    shape.mAssets = mOptions.mAssets;
+    shape.mHops = std::min(shape.mHops, mOptions.mAssets);
+    mApp.getLoadGenerator().setShape(shape);
+}
+
+uint32_t
+LedgerStateGenerator::drawOffers() const
+{
+    auto mean = mOptions.mOffers;
+    double res = mean;
+    switch (mOptions.mDistribution)
+    {
+    case Distribution::FIXED:
+        break;
+    case Distribution::UNIFORM:
+        res = rand_uniform<uint32_t>(0, 2 * mean);
+        break;
+    case Distribution::PARETO:
+    {
+        // the mean of a Pareto distribution of shape alpha and scale x is
+        // alpha * x / (alpha - 1)
+        double const alpha = 1.5;
+        auto scale = mean * (alpha - 1) / alpha;
+        res = scale / std::pow(1 - rand_fraction(), 1 / alpha);
+        break;
+    }
+    }
+    return static_cast<uint32_t>(
+        std::min<double>(std::floor(res), MAX_OFFERS));
+}
+
+Json::Value
+LedgerStateGenerator::run()
+{
+    auto& lm = mApp.getLedgerManager();
+    auto& bm = mApp.getBucketManager();
+    auto& lg = mApp.getLoadGenerator();
+    auto genesis = lm.getLastClosedLedgerHeader();
+    auto ledger = mOptions.mLedger != 0
+                      ? mOptions.mLedger
+                      : mApp.getHistoryManager().getCheckpointFrequency() - 1;
+    if (ledger <= genesis.header.ledgerSeq)
+    {
+        throw std::invalid_argument("The ledger must follow genesis");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<Bucket>> buckets;
+    std::vector<LedgerEntry> entries;
+    std::vector<LedgerKey> noDead;
+    auto flush = [&]() {
+        // newest first, for mergeAll
+        buckets.insert(buckets.begin(), Bucket::fresh(bm, entries, noDead));
+        entries.clear();
+    };
+
+    auto offerID = genesis.header.idPool + 1;
+    uint64_t nTrustLines = 0;
+    uint64_t nOffers = 0;
+    int64_t funded = 0;
+    for (uint32_t i = 0; i < mOptions.mAccounts; i++)
+    {
+        auto account = lg.makeAccountEntries(i, drawOffers(), offerID);
+        for (auto const& e : account)
+        {
+            switch (e.data.type())
+            {
+            case ACCOUNT:
+                funded += e.data.account().balance;
+                break;
+            case TRUSTLINE:
+                nTrustLines++;
+                break;
+            case OFFER:
+                nOffers++;
+                break;
+            default:
+                break;
+            }
+        }
+        entries.insert(entries.end(), account.begin(), account.end());
+        if (entries.size() >= BATCH_SIZE)
+        {
+            flush();
+            if (buckets.size() % 10 == 0)
+            {
+                LOG(INFO) << "Generated " << (i + 1) << " accounts";
+            }
+        }
+    }
+
+    auto rootID = SecretKey::fromSeed(mApp.getNetworkID()).getPublicKey();
+    auto root = AccountFrame::loadAccount(rootID, mApp.getDatabase());
+    if (!root || !root->addBalance(-funded, lm) ||
+        root->getBalance() < root->getMinimumBalance(lm))
+    {
+        throw std::runtime_error("The root account cannot fund the entries");
+    }
+    entries.emplace_back(root->mEntry);
+    flush();
+
+    LOG(INFO) << "Merging " << buckets.size() << " buckets";
+    auto state = Bucket::mergeAll(bm, buckets);
+    buckets.clear();
+
+    // the whole state at the deepest level, no merge in progress
+    HistoryArchiveState has;
+    has.currentLedger = ledger;
+    has.currentBuckets.back().curr = binToHex(state->getHash());
+    bm.assumeState(has);
+    bm.forgetUnreferencedBuckets();
+
+    LedgerHeaderHistoryEntry lcl;
+    lcl.header = genesis.header;
+    lcl.header.ledgerSeq = ledger;
+    lcl.header.previousLedgerHash = genesis.hash;
+    lcl.header.idPool = offerID - 1;
+    lcl.header.bucketListHash = bm.getBucketList().getHash();
+    lcl.hash = sha256(xdr::xdr_to_opaque(lcl.header));
+    bm.storeLocalState(has, lcl);
+
+    auto elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    auto counts = state->countLiveAndDeadEntries();
+    Json::Value res;
+    res["ledger"] = ledger;
+    res["hash"] = binToHex(lcl.hash);
+    res["bucket"] = state->getFilename();
+    res["accounts"] = mOptions.mAccounts;
+    res["trustlines"] = static_cast<Json::UInt64>(nTrustLines);
+    res["offers"] = static_cast<Json::UInt64>(nOffers);
+    res["entries"] = static_cast<Json::UInt64>(counts.first);
+    res["seconds"] = elapsed;
+    LOG(INFO) << "Wrote " << counts.first << " entries for ledger " << ledger
+              << " in " << elapsed << " s";
+    return res;
+}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+
+#include <cstdint>
+#include <string>
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Writes a large synthetic ledger state directly as buckets, to test how
+ * the node scales with the size of the ledger without building that state
+ * through transactions. The accounts are load generator ones (see
+ * LoadGenerator::makeAccountEntries): each has a trust line to every load
+ * asset and a number of resting offers drawn from a distribution.
+ *
+ * From the genesis ledger of a fresh database, all the entries (and the
+ * root account, left with the remaining lumens) are written to fresh
+ * buckets and merged into the curr bucket of the deepest level of the
+ * bucket list, every other bucket being empty: a valid bucket list, which
+ * later ledgers merge into as usual. The header of the ledger it is the
+ * state of, and the matching history archive state, are saved as the
+ * local state of the bucket directory (see BucketManager::storeLocalState),
+ * so that the database can then be built from them by restoreFromBuckets.
+ */
+class LedgerStateGenerator
+{
+  public:
+    // of the number of offers of each account
+    enum class Distribution
+    {
+        // always mOffers
+        FIXED,
+        // uniform in [0, 2 * mOffers]
+        UNIFORM,
+        // heavy-tailed (Pareto, alpha 1.5) with about mOffers on average:
+        // most accounts have few offers, a few market makers have many
+        PARETO
+    };
+
+    struct Options
+    {
+        uint32_t mAccounts{1000000};
+        // trust lines of each account, at most LoadGenerator::MAX_ASSETS
+        uint32_t mAssets{3};
+        // mean resting offers of each account
+        uint32_t mOffers{1};
+        Distribution mDistribution{Distribution::FIXED};
+        // ledger of the state, 0 for the last one of the first checkpoint
+        uint32_t mLedger{0};
+    };
+
+    // at most, per account
+    static uint32_t const MAX_OFFERS;
+
+    // Parses the parameters of --generate-state, in the form of the
+    // generateload command's: accounts, assets, offers, dist (fixed,
+    // uniform or pareto) and ledger. Throws std::invalid_argument on bad
+    // parameters.
+    static Options parseOptions(std::string const& params);
+
+    LedgerStateGenerator(Application& app, Options const& options);
+
+    // writes the state to the bucket directory and returns a summary of it
+    Json::Value run();
+
+  private:
+    Application& mApp;
+    Options const mOptions;
+
+    // offers of the next account
+    uint32_t drawOffers() const;
+};
+}
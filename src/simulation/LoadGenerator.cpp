@@ -3,9 +3,13 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "simulation/LoadGenerator.h"
+#include "crypto/KeyUtils.h"
+#include "crypto/SignerKey.h"
 #include "herder/Herder.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/OfferFrame.h"
+#include "ledger/TrustFrame.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
 #include "test/TestAccount.h"
@@ -30,6 +34,8 @@
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
+#include "medida/stats/snapshot.h"
+#include "medida/timer.h"
 
 #include <cmath>
 #include <iomanip>
@@ -45,6 +51,23 @@ using namespace txtest;
 const uint32_t LoadGenerator::STEP_MSECS = 100;
 //
 const uint32_t LoadGenerator::TX_SUBMIT_MAX_TRIES = 1000;
+// a SETUP transaction has two operations per asset and one per signer, plus
+// one for the thresholds
+const uint32_t LoadGenerator::MAX_ASSETS = 30;
+const uint32_t LoadGenerator::MAX_SIGNERS = 19;
+const uint32_t LoadGenerator::DROP_AFTER_LEDGERS = 10;
+
+// Amounts of credit SETUP gives each account, offers sell and path payments
+// deliver.
+static const int64_t SETUP_CREDIT = 1000000000000;
+static const int64_t OFFER_AMOUNT = 10000000;
+static const int64_t PATH_PAYMENT_AMOUNT = 100000;
+// Offers are priced on a ladder of PRICE_LEVELS levels, PRICE_STEP apart
+// from 1 (in 1/PRICE_DENOMINATOR units); both sides of a pair are above 1,
+// so only the offers at the first level cross.
+static const int32_t PRICE_LEVELS = 10;
+static const int32_t PRICE_STEP = 1;
+static const int32_t PRICE_DENOMINATOR = 100;
 
 LoadGenerator::LoadGenerator(Application& app)
     : mMinBalance(0), mLastSecond(0), mApp(app)
@@ -57,6 +80,111 @@ LoadGenerator::~LoadGenerator()
     clear();
 }
 
+void
+LoadGenerator::setShape(Shape const& shape)
+{
+    if (shape.mAssets == 0 || shape.mAssets > MAX_ASSETS)
+    {
+        throw std::invalid_argument(
+            fmt::format("assets must be between 1 and {}", MAX_ASSETS));
+    }
+    if (shape.mSigners > MAX_SIGNERS)
+    {
+        throw std::invalid_argument(
+            fmt::format("signers must be at most {}", MAX_SIGNERS));
+    }
+    if (shape.mHops == 0 || shape.mHops > shape.mAssets)
+    {
+        throw std::invalid_argument("hops must be between 1 and assets");
+    }
+    if (shape.mOfferPercent + shape.mPathPercent > 100)
+    {
+        throw std::invalid_argument("offer and path percentages exceed 100");
+    }
+    mShape = shape;
+}
+
+LoadGenerator::Shape const&
+LoadGenerator::getShape() const
+{
+    return mShape;
+}
+
+void
+LoadGenerator::setArrival(Arrival arrival)
+{
+    mArrival = arrival;
+    mArrivalsStarted = false;
+}
+
+uint32_t
+LoadGenerator::getArrivalsDue(uint32_t txRate)
+{
+    auto now = mApp.getClock().now();
+    if (!mArrivalsStarted)
+    {
+        mNextArrival = now;
+        mArrivalsStarted = true;
+    }
+    // arrivals do not wait for the node: the ones missed while it was busy
+    // are all due now
+    uint32_t res = 0;
+    while (mNextArrival <= now)
+    {
+        double seconds = 1.0 / txRate;
+        if (mArrival == Arrival::POISSON)
+        {
+            seconds = std::exponential_distribution<double>(txRate)(
+                gRandomEngine);
+        }
+        mNextArrival +=
+            std::chrono::duration_cast<VirtualClock::duration>(
+                std::chrono::duration<double>(seconds));
+        res++;
+    }
+    return res;
+}
+
+void
+LoadGenerator::recordExternalized(uint32_t ledgerSeq,
+                                  std::vector<TransactionFramePtr> const& txs)
+{
+    if (mPendingTxs.empty())
+    {
+        return;
+    }
+    auto now = mApp.getClock().now();
+    auto& latency = mApp.getMetrics().NewTimer({"loadgen", "txn", "latency"});
+    for (auto const& tx : txs)
+    {
+        auto it = mPendingTxs.find(tx->getFullHash());
+        if (it != mPendingTxs.end())
+        {
+            latency.Update(now - it->second.mSubmitted);
+            mPendingTxs.erase(it);
+        }
+    }
+    TxMetrics txm(mApp.getMetrics());
+    for (auto it = mPendingTxs.begin(); it != mPendingTxs.end();)
+    {
+        if (it->second.mLedger + DROP_AFTER_LEDGERS < ledgerSeq)
+        {
+            txm.mTxnDropped.Mark();
+            it = mPendingTxs.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+bool
+LoadGenerator::countsAccounts(LoadGenMode mode)
+{
+    return mode == LoadGenMode::CREATE || mode == LoadGenMode::SETUP;
+}
+
 void
 LoadGenerator::createRootAccount()
 {
@@ -143,12 +271,15 @@ void
 LoadGenerator::clear()
 {
     mAccounts.clear();
+    mSignerCounts.clear();
+    mPendingTxs.clear();
+    mArrivalsStarted = false;
     mRoot.reset();
 }
 
 // Schedule a callback to generateLoad() STEP_MSECS miliseconds from now.
 void
-LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
+LoadGenerator::scheduleLoadGeneration(LoadGenMode mode, uint32_t nAccounts,
                                       uint32_t offset, uint32_t nTxs,
                                       uint32_t txRate, uint32_t batchSize,
                                       bool autoRate)
@@ -162,11 +293,11 @@ LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
     {
         mLoadTimer->expires_from_now(std::chrono::milliseconds(STEP_MSECS));
         mLoadTimer->async_wait([this, nAccounts, offset, nTxs, txRate,
-                                batchSize, isCreate,
+                                batchSize, mode,
                                 autoRate](asio::error_code const& error) {
             if (!error)
             {
-                this->generateLoad(isCreate, nAccounts, offset, nTxs, txRate,
+                this->generateLoad(mode, nAccounts, offset, nTxs, txRate,
                                    batchSize, autoRate);
             }
         });
@@ -178,11 +309,11 @@ LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
             << mApp.getState();
         mLoadTimer->expires_from_now(std::chrono::seconds(10));
         mLoadTimer->async_wait([this, nAccounts, offset, nTxs, txRate,
-                                batchSize, isCreate,
+                                batchSize, mode,
                                 autoRate](asio::error_code const& error) {
             if (!error)
             {
-                this->scheduleLoadGeneration(isCreate, nAccounts, offset, nTxs,
+                this->scheduleLoadGeneration(mode, nAccounts, offset, nTxs,
                                              txRate, batchSize, autoRate);
             }
         });
@@ -194,15 +325,16 @@ LoadGenerator::scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
 // If work remains after the current step, call scheduleLoadGeneration()
 // with the remainder.
 void
-LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
-                            uint32_t nTxs, uint32_t txRate, uint32_t batchSize,
-                            bool autoRate)
+LoadGenerator::generateLoad(LoadGenMode mode, uint32_t nAccounts,
+                            uint32_t offset, uint32_t nTxs, uint32_t txRate,
+                            uint32_t batchSize, bool autoRate)
 {
     soci::transaction sqltx(mApp.getDatabase().getSession());
     mApp.getDatabase().setCurrentTransactionReadOnly();
     createRootAccount();
 
     // Finish if no more txs need to be created.
+    auto isCreate = countsAccounts(mode);
     if ((isCreate && nAccounts == 0) || (!isCreate && nTxs == 0))
     {
         // Done submitting the load, now ensure it propagates to the DB.
@@ -220,7 +352,9 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
         batchSize = 1;
     }
 
-    uint32_t txPerStep = getTxPerStep(txRate);
+    auto openLoop = mArrival != Arrival::NONE && !isCreate;
+    uint32_t txPerStep =
+        openLoop ? getArrivalsDue(txRate) : getTxPerStep(txRate);
     auto& submitTimer =
         mApp.getMetrics().NewTimer({"loadgen", "step", "submit"});
     auto submitScope = submitTimer.TimeScope();
@@ -229,15 +363,19 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
 
     for (uint32_t i = 0; i < txPerStep; ++i)
     {
-        if (isCreate)
+        if (mode == LoadGenMode::CREATE)
         {
             nAccounts =
                 submitCreationTx(nAccounts, offset, batchSize, ledgerNum);
         }
+        else if (mode == LoadGenMode::SETUP)
+        {
+            nAccounts = submitSetupTx(nAccounts, offset, ledgerNum);
+        }
         else
         {
-            nTxs =
-                submitPaymentTx(nAccounts, offset, batchSize, ledgerNum, nTxs);
+            nTxs = submitTx(mode, nAccounts, offset, batchSize, ledgerNum,
+                            nTxs);
         }
 
         if (nAccounts == 0 || (!isCreate && nTxs == 0))
@@ -253,7 +391,7 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
         static_cast<uint64_t>(VirtualClock::to_time_t(mApp.getClock().now()));
     bool secondBoundary = now != mLastSecond;
 
-    if (autoRate && secondBoundary)
+    if (autoRate && !openLoop && secondBoundary)
     {
         mLastSecond = now;
         inspectRate(ledgerNum, txRate);
@@ -262,10 +400,10 @@ LoadGenerator::generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
     // Emit a log message once per second.
     if (secondBoundary)
     {
-        logProgress(submit, isCreate, nAccounts, nTxs, batchSize, txRate);
+        logProgress(submit, mode, nAccounts, nTxs, batchSize, txRate);
     }
 
-    scheduleLoadGeneration(isCreate, nAccounts, offset, nTxs, txRate, batchSize,
+    scheduleLoadGeneration(mode, nAccounts, offset, nTxs, txRate, batchSize,
                            autoRate);
 }
 
@@ -281,7 +419,7 @@ LoadGenerator::submitCreationTx(uint32_t nAccounts, uint32_t offset,
     bool createDuplicate = false;
     int numTries = 0;
 
-    while ((status = tx.execute(mApp, true, code, batchSize)) !=
+    while ((status = tx.execute(mApp, code, batchSize)) !=
            Herder::TX_STATUS_PENDING)
     {
         handleFailedSubmission(tx.mFrom, status, code); // Update seq num
@@ -307,24 +445,74 @@ LoadGenerator::submitCreationTx(uint32_t nAccounts, uint32_t offset,
 }
 
 uint32_t
-LoadGenerator::submitPaymentTx(uint32_t nAccounts, uint32_t offset,
-                               uint32_t batchSize, uint32_t ledgerNum,
-                               uint32_t nTxs)
+LoadGenerator::submitSetupTx(uint32_t nAccounts, uint32_t offset,
+                             uint32_t ledgerNum)
+{
+    // accounts are set up from the last one down
+    uint64_t accountId = offset + nAccounts - 1;
+    TxInfo tx = setupTransaction(accountId, ledgerNum);
+    TransactionResultCode code;
+    Herder::TransactionSubmitStatus status;
+    int numTries = 0;
+
+    while ((status = tx.execute(mApp, code, 1)) != Herder::TX_STATUS_PENDING)
+    {
+        handleFailedSubmission(tx.mFrom, status, code); // Update seq num
+        if (status == Herder::TX_STATUS_DUPLICATE)
+        {
+            break;
+        }
+        tx = setupTransaction(accountId, ledgerNum);
+        if (++numTries >= TX_SUBMIT_MAX_TRIES)
+        {
+            CLOG(ERROR, "LoadGen") << "Error setting up account!";
+            clear();
+            return 0;
+        }
+    }
+
+    // the following transactions of the account need its new signers
+    mSignerCounts[tx.mFrom->getPublicKey()] = mShape.mSigners;
+    return nAccounts - 1;
+}
+
+uint32_t
+LoadGenerator::submitTx(LoadGenMode mode, uint32_t nAccounts, uint32_t offset,
+                        uint32_t batchSize, uint32_t ledgerNum, uint32_t nTxs)
 {
     auto sourceAccountId = rand_uniform<uint64_t>(0, nAccounts - 1) + offset;
     TxInfo tx =
-        paymentTransaction(nAccounts, offset, ledgerNum, sourceAccountId);
+        makeTransaction(mode, nAccounts, offset, ledgerNum, sourceAccountId);
 
     TransactionResultCode code;
     Herder::TransactionSubmitStatus status;
     int numTries = 0;
 
-    while ((status = tx.execute(mApp, false, code, batchSize)) !=
+    if (mArrival != Arrival::NONE)
+    {
+        // open loop: rejected transactions are not retried, and give their
+        // sequence number back
+        auto seqNum = tx.mFrom->getLastSequenceNumber();
+        status = tx.execute(mApp, code, batchSize);
+        if (status == Herder::TX_STATUS_PENDING)
+        {
+            mPendingTxs[tx.mHash] =
+                PendingTx{mApp.getClock().now(), ledgerNum};
+        }
+        else if (status != Herder::TX_STATUS_DUPLICATE)
+        {
+            tx.mFrom->setSequenceNumber(seqNum);
+            handleFailedSubmission(tx.mFrom, status, code);
+        }
+        return nTxs - 1;
+    }
+
+    while ((status = tx.execute(mApp, code, batchSize)) !=
            Herder::TX_STATUS_PENDING)
     {
         handleFailedSubmission(tx.mFrom, status, code); // Update seq num
-        tx = paymentTransaction(nAccounts, offset, ledgerNum,
-                                sourceAccountId); // re-generate the tx
+        tx = makeTransaction(mode, nAccounts, offset, ledgerNum,
+                             sourceAccountId); // re-generate the tx
         if (++numTries >= TX_SUBMIT_MAX_TRIES)
         {
             CLOG(ERROR, "LoadGen") << "Error submitting tx: did you specify "
@@ -407,8 +595,8 @@ LoadGenerator::inspectRate(uint32_t ledgerNum, uint32_t& txRate)
 }
 
 void
-LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
-                           uint32_t nAccounts, uint32_t nTxs,
+LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer,
+                           LoadGenMode mode, uint32_t nAccounts, uint32_t nTxs,
                            uint32_t batchSize, uint32_t txRate)
 {
     using namespace std::chrono;
@@ -419,7 +607,10 @@ LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
 
     auto submitSteps = duration_cast<milliseconds>(submitTimer).count();
 
-    auto remainingTxCount = isCreate ? nAccounts / batchSize : nTxs;
+    auto remainingTxCount =
+        mode == LoadGenMode::CREATE
+            ? nAccounts / batchSize
+            : (mode == LoadGenMode::SETUP ? nAccounts : nTxs);
     auto etaSecs =
         (uint32_t)(((double)remainingTxCount) / applyTx.one_minute_rate());
 
@@ -435,6 +626,20 @@ LoadGenerator::logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
 
     CLOG(DEBUG, "LoadGen") << "Step timing: " << submitSteps << "ms submit.";
 
+    if (mArrival != Arrival::NONE)
+    {
+        auto latency =
+            m.NewTimer({"loadgen", "txn", "latency"}).GetSnapshot();
+        TxMetrics txm(m);
+        CLOG(INFO, "LoadGen")
+            << "Open loop latency: p50 " << latency.getMedian() << "ms, p99 "
+            << latency.get99thPercentile() << "ms, p999 "
+            << latency.getValue(0.999) << "ms; "
+            << txm.mTxnRejected.count() << " rejected, "
+            << txm.mTxnDropped.count() << " dropped, " << mPendingTxs.size()
+            << " pending";
+    }
+
     TxMetrics txm(mApp.getMetrics());
     txm.report();
 }
@@ -445,7 +650,7 @@ LoadGenerator::creationTransaction(uint64_t startAccount, uint64_t numItems,
 {
     vector<Operation> creationOps =
         createAccounts(startAccount, numItems, ledgerNum);
-    TxInfo newTx = TxInfo{mRoot, creationOps};
+    TxInfo newTx = TxInfo{mRoot, creationOps, LoadGenMode::CREATE, {}};
     return newTx;
 }
 
@@ -489,6 +694,8 @@ LoadGenerator::loadAccount(TestAccount& account, Database& database)
         return false;
     }
     account.setSequenceNumber(ret->getSeqNum());
+    mSignerCounts[account.getPublicKey()] =
+        static_cast<uint32_t>(ret->getAccount().signers.size());
 
     return true;
 }
@@ -563,11 +770,246 @@ LoadGenerator::paymentTransaction(uint32_t numAccounts, uint32_t offset,
         pickAccountPair(numAccounts, offset, ledgerNum, sourceAccount);
     vector<Operation> paymentOps = {
         txtest::payment(to->getPublicKey(), amount)};
-    TxInfo tx = TxInfo{from, paymentOps};
+    TxInfo tx =
+        TxInfo{from, paymentOps, LoadGenMode::PAY, getExtraSigners(*from)};
 
     return tx;
 }
 
+Asset
+LoadGenerator::getRingAsset(uint32_t i) const
+{
+    if (i == 0)
+    {
+        return txtest::makeNativeAsset();
+    }
+    return txtest::makeAsset(mRoot->getSecretKey(), "LG" + to_string(i - 1));
+}
+
+SecretKey
+LoadGenerator::getSignerKey(PublicKey const& account, uint32_t i)
+{
+    auto name = KeyUtils::toStrKey(account) + "-signer-" + to_string(i);
+    return txtest::getAccount(name.c_str());
+}
+
+std::vector<SecretKey>
+LoadGenerator::getExtraSigners(TestAccount const& account) const
+{
+    std::vector<SecretKey> res;
+    auto it = mSignerCounts.find(account.getPublicKey());
+    if (it != mSignerCounts.end())
+    {
+        for (uint32_t i = 0; i < it->second; i++)
+        {
+            res.emplace_back(getSignerKey(account.getPublicKey(), i));
+        }
+    }
+    return res;
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::setupTransaction(uint64_t accountId, uint32_t ledgerNum)
+{
+    auto account = findAccount(accountId, ledgerNum);
+    // signed with the signers the account has so far, and by the root
+    // account, the source of the credit payments
+    auto signers = getExtraSigners(*account);
+    signers.emplace_back(mRoot->getSecretKey());
+
+    vector<Operation> ops;
+    for (uint32_t i = 1; i <= mShape.mAssets; i++)
+    {
+        auto asset = getRingAsset(i);
+        ops.emplace_back(txtest::changeTrust(asset, INT64_MAX));
+        ops.emplace_back(
+            txtest::payment(account->getPublicKey(), asset, SETUP_CREDIT));
+        ops.back().sourceAccount.activate() = mRoot->getPublicKey();
+    }
+    if (mShape.mSigners != 0)
+    {
+        for (uint32_t i = 0; i < mShape.mSigners; i++)
+        {
+            auto key = getSignerKey(account->getPublicKey(), i);
+            ops.emplace_back(txtest::setOptions(txtest::setSigner(Signer{
+                KeyUtils::convertKey<SignerKey>(key.getPublicKey()), 1})));
+        }
+        // every signer is needed, the master key included
+        auto weight = static_cast<int>(mShape.mSigners + 1);
+        ops.emplace_back(txtest::setOptions(
+            txtest::setLowThreshold(weight) | txtest::setMedThreshold(weight) |
+            txtest::setHighThreshold(weight)));
+    }
+    return TxInfo{account, ops, LoadGenMode::SETUP, signers};
+}
+
+std::vector<LedgerEntry>
+LoadGenerator::makeAccountEntries(uint64_t accountId, uint32_t nOffers,
+                                  uint64_t& offerID)
+{
+    if (nOffers != 0 && mShape.mAssets == 0)
+    {
+        throw std::invalid_argument("offers need load assets");
+    }
+    createRootAccount();
+    updateMinBalance();
+    auto& lm = mApp.getLedgerManager();
+    auto subEntries = mShape.mAssets + nOffers;
+    auto name = "TestAccount-" + to_string(accountId);
+    auto key = txtest::getAccount(name.c_str());
+
+    AccountFrame account(key.getPublicKey());
+    account.getAccount().seqNum = static_cast<SequenceNumber>(lm.getLedgerNum())
+                                  << 32;
+    account.getAccount().balance = lm.getMinBalance(subEntries) +
+                                   mMinBalance * 100 + nOffers * OFFER_AMOUNT;
+    account.getAccount().numSubEntries = subEntries;
+
+    std::vector<TrustFrame> lines;
+    for (uint32_t i = 1; i <= mShape.mAssets; i++)
+    {
+        TrustFrame line;
+        auto& tl = line.getTrustLine();
+        tl.accountID = key.getPublicKey();
+        tl.asset = getRingAsset(i);
+        tl.balance = SETUP_CREDIT;
+        tl.limit = INT64_MAX;
+        tl.flags = AUTHORIZED_FLAG;
+        lines.emplace_back(line);
+    }
+
+    // the offers' liabilities, from protocol 10 on
+    auto addLiabilities = [&](uint32_t asset, int64_t selling, int64_t buying) {
+        bool ok = asset == 0
+                      ? account.addSellingLiabilities(selling, lm) &&
+                            account.addBuyingLiabilities(buying, lm)
+                      : lines[asset - 1].addSellingLiabilities(selling, lm) &&
+                            lines[asset - 1].addBuyingLiabilities(buying, lm);
+        if (!ok)
+        {
+            throw std::runtime_error("Offers exceed the account's funds");
+        }
+    };
+
+    std::vector<LedgerEntry> offers;
+    for (uint32_t i = 0; i < nOffers; i++)
+    {
+        auto selling = rand_uniform<uint32_t>(0, mShape.mAssets - 1);
+        auto buying = selling + 1;
+        if (rand_flip())
+        {
+            std::swap(selling, buying);
+        }
+        // above the first level of the ladder, so that no two offers cross
+        auto level = rand_uniform<int32_t>(1, PRICE_LEVELS - 1);
+        OfferFrame offer;
+        auto& oe = offer.getOffer();
+        oe.sellerID = key.getPublicKey();
+        oe.offerID = offerID++;
+        oe.selling = getRingAsset(selling);
+        oe.buying = getRingAsset(buying);
+        oe.amount = OFFER_AMOUNT;
+        oe.price =
+            Price{PRICE_DENOMINATOR + level * PRICE_STEP, PRICE_DENOMINATOR};
+        if (lm.getCurrentLedgerVersion() >= 10)
+        {
+            addLiabilities(selling, offer.getSellingLiabilities(), 0);
+            addLiabilities(buying, 0, offer.getBuyingLiabilities());
+        }
+        offers.emplace_back(offer.mEntry);
+    }
+
+    std::vector<LedgerEntry> res{account.mEntry};
+    for (auto const& line : lines)
+    {
+        res.emplace_back(line.mEntry);
+    }
+    res.insert(res.end(), offers.begin(), offers.end());
+    return res;
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::offerTransaction(uint64_t sourceAccount, uint32_t ledgerNum)
+{
+    auto from = findAccount(sourceAccount, ledgerNum);
+    auto pair = rand_uniform<uint32_t>(1, mShape.mAssets);
+    auto selling = getRingAsset(pair - 1);
+    auto buying = getRingAsset(pair);
+    if (rand_flip())
+    {
+        std::swap(selling, buying);
+    }
+    auto level = rand_uniform<int32_t>(0, PRICE_LEVELS - 1);
+    Price price{PRICE_DENOMINATOR + level * PRICE_STEP, PRICE_DENOMINATOR};
+    vector<Operation> ops = {
+        txtest::manageOffer(0, selling, buying, price, OFFER_AMOUNT)};
+    return TxInfo{from, ops, LoadGenMode::OFFERS, getExtraSigners(*from)};
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::pathPaymentTransaction(uint32_t numAccounts, uint32_t offset,
+                                      uint32_t ledgerNum,
+                                      uint64_t sourceAccount)
+{
+    TestAccountPtr to, from;
+    std::tie(from, to) =
+        pickAccountPair(numAccounts, offset, ledgerNum, sourceAccount);
+    // native -> LG0 -> ... -> LG<hops - 1>, through the offers of OFFERS;
+    // each hop costs at most the top of the price ladder
+    std::vector<Asset> path;
+    for (uint32_t i = 1; i < mShape.mHops; i++)
+    {
+        path.emplace_back(getRingAsset(i));
+    }
+    auto sendMax = PATH_PAYMENT_AMOUNT;
+    for (uint32_t i = 0; i < mShape.mHops; i++)
+    {
+        sendMax = sendMax *
+                  (PRICE_DENOMINATOR + PRICE_LEVELS * PRICE_STEP) /
+                  PRICE_DENOMINATOR;
+    }
+    vector<Operation> ops = {txtest::pathPayment(
+        to->getPublicKey(), getRingAsset(0), sendMax,
+        getRingAsset(mShape.mHops), PATH_PAYMENT_AMOUNT, path)};
+    return TxInfo{from, ops, LoadGenMode::PATH_PAY, getExtraSigners(*from)};
+}
+
+LoadGenerator::TxInfo
+LoadGenerator::makeTransaction(LoadGenMode mode, uint32_t numAccounts,
+                               uint32_t offset, uint32_t ledgerNum,
+                               uint64_t sourceAccount)
+{
+    if (mode == LoadGenMode::MIXED)
+    {
+        auto roll = rand_uniform<uint32_t>(0, 99);
+        if (roll < mShape.mOfferPercent)
+        {
+            mode = LoadGenMode::OFFERS;
+        }
+        else if (roll < mShape.mOfferPercent + mShape.mPathPercent)
+        {
+            mode = LoadGenMode::PATH_PAY;
+        }
+        else
+        {
+            mode = LoadGenMode::PAY;
+        }
+    }
+    switch (mode)
+    {
+    case LoadGenMode::OFFERS:
+        return offerTransaction(sourceAccount, ledgerNum);
+    case LoadGenMode::PATH_PAY:
+        return pathPaymentTransaction(numAccounts, offset, ledgerNum,
+                                      sourceAccount);
+    case LoadGenMode::PAY:
+        return paymentTransaction(numAccounts, offset, ledgerNum,
+                                  sourceAccount);
+    default:
+        throw std::invalid_argument("Not a transaction mode");
+    }
+}
+
 void
 LoadGenerator::handleFailedSubmission(TestAccountPtr sourceAccount,
                                       Herder::TransactionSubmitStatus status,
@@ -647,6 +1089,10 @@ LoadGenerator::TxMetrics::TxMetrics(medida::MetricsRegistry& m)
     : mAccountCreated(m.NewMeter({"loadgen", "account", "created"}, "account"))
     , mPayment(m.NewMeter({"loadgen", "payment", "any"}, "payment"))
     , mNativePayment(m.NewMeter({"loadgen", "payment", "native"}, "payment"))
+    , mPathPayment(m.NewMeter({"loadgen", "payment", "path"}, "payment"))
+    , mOffer(m.NewMeter({"loadgen", "offer", "submitted"}, "offer"))
+    , mAccountSetup(m.NewMeter({"loadgen", "account", "setup"}, "account"))
+    , mTxnDropped(m.NewMeter({"loadgen", "txn", "dropped"}, "txn"))
     , mTxnAttempted(m.NewMeter({"loadgen", "txn", "attempted"}, "txn"))
     , mTxnRejected(m.NewMeter({"loadgen", "txn", "rejected"}, "txn"))
     , mTxnBytes(m.NewMeter({"loadgen", "txn", "bytes"}, "txn"))
@@ -661,7 +1107,10 @@ LoadGenerator::TxMetrics::report()
                            << mTxnBytes.count() << " by, "
                            << mAccountCreated.count() << " ac ("
                            << mPayment.count() << " pa ("
-                           << mNativePayment.count() << " na, ";
+                           << mNativePayment.count() << " na, "
+                           << mPathPayment.count() << " pp), "
+                           << mOffer.count() << " of, " << mAccountSetup.count()
+                           << " as";
 
     CLOG(DEBUG, "LoadGen") << "Rates/sec (1m EWMA): " << std::setprecision(3)
                            << mTxnAttempted.one_minute_rate() << " tx, "
@@ -669,32 +1118,58 @@ LoadGenerator::TxMetrics::report()
                            << mTxnBytes.one_minute_rate() << " by, "
                            << mAccountCreated.one_minute_rate() << " ac, "
                            << mPayment.one_minute_rate() << " pa ("
-                           << mNativePayment.one_minute_rate() << " na, ";
+                           << mNativePayment.one_minute_rate() << " na, "
+                           << mPathPayment.one_minute_rate() << " pp), "
+                           << mOffer.one_minute_rate() << " of, "
+                           << mAccountSetup.one_minute_rate() << " as";
 }
 
-Herder::TransactionSubmitStatus
-LoadGenerator::TxInfo::execute(Application& app, bool isCreate,
-                               TransactionResultCode& code, int32_t batchSize)
+TransactionFramePtr
+LoadGenerator::TxInfo::toTransactionFrame(Application& app)
 {
     auto seqNum = mFrom->getLastSequenceNumber();
     mFrom->setSequenceNumber(seqNum + 1);
 
     TransactionFramePtr txf =
         transactionFromOperations(app, mFrom->getSecretKey(), seqNum + 1, mOps);
+    for (auto const& signer : mSigners)
+    {
+        txf->addSignature(signer);
+    }
+    mHash = txf->getFullHash();
+    return txf;
+}
+
+Herder::TransactionSubmitStatus
+LoadGenerator::TxInfo::execute(Application& app, TransactionResultCode& code,
+                               int32_t batchSize)
+{
+    auto txf = toTransactionFrame(app);
     TxMetrics txm(app.getMetrics());
 
     // Record tx metrics.
-    if (isCreate)
+    switch (mMode)
     {
+    case LoadGenMode::CREATE:
         while (batchSize--)
         {
             txm.mAccountCreated.Mark();
         }
-    }
-    else
-    {
+        break;
+    case LoadGenMode::SETUP:
+        txm.mAccountSetup.Mark();
+        break;
+    case LoadGenMode::OFFERS:
+        txm.mOffer.Mark();
+        break;
+    case LoadGenMode::PATH_PAY:
+        txm.mPayment.Mark();
+        txm.mPathPayment.Mark();
+        break;
+    default:
         txm.mPayment.Mark();
         txm.mNativePayment.Mark();
+        break;
     }
     txm.mTxnAttempted.Mark();
 
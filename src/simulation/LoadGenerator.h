@@ -9,7 +9,10 @@
 #include "main/Application.h"
 #include "test/TestAccount.h"
 #include "test/TxTests.h"
+#include "util/HashOfHash.h"
+#include "util/Timer.h"
 #include "xdr/Stellar-types.h"
+#include <unordered_map>
 #include <util/format.h>
 #include <vector>
 
@@ -26,12 +29,79 @@ namespace stellar
 
 class VirtualTimer;
 
+// The kinds of load generateLoad() produces (see the generateload command).
+enum class LoadGenMode
+{
+    // create accounts
+    CREATE,
+    // native payments between accounts
+    PAY,
+    // give accounts trust lines to the load assets, funded by the root
+    // account, and the extra signers of the shape
+    SETUP,
+    // manage offers along a price ladder, on the asset pairs of the shape
+    OFFERS,
+    // path payments through the asset pairs of the shape
+    PATH_PAY,
+    // offers, path payments and native payments, in the shape's proportions
+    MIXED
+};
+
 class LoadGenerator
 {
   public:
     LoadGenerator(Application& app);
     ~LoadGenerator();
     void clear();
+
+    // Parameters of the SETUP, OFFERS, PATH_PAY and MIXED modes. The load
+    // assets LG0 ... LG<mAssets - 1> are issued by the root account and form
+    // the asset pairs (native, LG0), (LG0, LG1) ...
+    struct Shape
+    {
+        uint32_t mAssets{3};
+        // extra signers SETUP gives each account, which all of its
+        // transactions then need (thresholds are set to the total weight)
+        uint32_t mSigners{0};
+        // asset pairs each path payment goes through, at most mAssets
+        uint32_t mHops{2};
+        // percentages of offers and path payments in MIXED, the rest being
+        // native payments
+        uint32_t mOfferPercent{30};
+        uint32_t mPathPercent{30};
+    };
+    static const uint32_t MAX_ASSETS;
+    static const uint32_t MAX_SIGNERS;
+
+    // Throws std::invalid_argument if @p shape is out of bounds.
+    void setShape(Shape const& shape);
+    Shape const& getShape() const;
+
+    // How the transactions of the PAY, OFFERS, PATH_PAY and MIXED modes are
+    // submitted. With NONE, each step submits its share of the target rate
+    // and retries rejected transactions, so the rate follows what the node
+    // absorbs (and can adapt to it, with autoRate). UNIFORM and POISSON are
+    // open loop: transactions arrive at the target rate, evenly spaced or
+    // as a Poisson process, and each is submitted once whatever happens to
+    // the previous ones. Their time from submission to externalization is
+    // recorded in the loadgen.txn.latency timer, and the ones rejected or
+    // never externalized are counted in loadgen.txn.rejected and
+    // loadgen.txn.dropped.
+    enum class Arrival
+    {
+        NONE,
+        UNIFORM,
+        POISSON
+    };
+    void setArrival(Arrival arrival);
+    // submitted transactions not externalized after this many ledgers are
+    // counted as dropped
+    static const uint32_t DROP_AFTER_LEDGERS;
+
+    // Called by LedgerManager with the transactions of each ledger it
+    // closes, to match them with the open loop submissions.
+    void recordExternalized(uint32_t ledgerSeq,
+                            std::vector<TransactionFramePtr> const& txs);
     bool maybeAdjustRate(double target, double actual, uint32_t& rate,
                          bool increaseOk);
     void inspectRate(uint32_t ledgerNum, uint32_t& txRate);
@@ -48,19 +118,23 @@ class LoadGenerator
 
     void createRootAccount();
     uint32_t getTxPerStep(uint32_t txRate);
+    // open loop: the number of arrivals due by now
+    uint32_t getArrivalsDue(uint32_t txRate);
 
     // Schedule a callback to generateLoad() STEP_MSECS miliseconds from now.
-    void scheduleLoadGeneration(bool isCreate, uint32_t nAccounts,
+    void scheduleLoadGeneration(LoadGenMode mode, uint32_t nAccounts,
                                 uint32_t offset, uint32_t nTxs, uint32_t txRate,
                                 uint32_t batchSize, bool autoRate);
 
     // Generate one "step" worth of load (assuming 1 step per STEP_MSECS) at a
     // given target number of accounts and txs, and a given target tx/s rate.
     // If work remains after the current step, call scheduleLoadGeneration()
-    // with the remainder.
-    void generateLoad(bool isCreate, uint32_t nAccounts, uint32_t offset,
+    // with the remainder. CREATE and SETUP work through nAccounts accounts,
+    // the other modes submit nTxs transactions from them.
+    void generateLoad(LoadGenMode mode, uint32_t nAccounts, uint32_t offset,
                       uint32_t nTxs, uint32_t txRate, uint32_t batchSize,
                       bool autoRate);
+    static bool countsAccounts(LoadGenMode mode);
 
     std::vector<Operation> createAccounts(uint64_t i, uint64_t batchSize,
                                           uint32_t ledgerNum);
@@ -75,21 +149,46 @@ class LoadGenerator
                                              uint32_t offset,
                                              uint32_t ledgerNum,
                                              uint64_t sourceAccount);
+    TxInfo setupTransaction(uint64_t accountId, uint32_t ledgerNum);
+    TxInfo offerTransaction(uint64_t sourceAccount, uint32_t ledgerNum);
+    TxInfo pathPaymentTransaction(uint32_t numAccounts, uint32_t offset,
+                                  uint32_t ledgerNum, uint64_t sourceAccount);
+    // a transaction of @p mode (one of PAY, OFFERS, PATH_PAY, MIXED)
+    TxInfo makeTransaction(LoadGenMode mode, uint32_t numAccounts,
+                           uint32_t offset, uint32_t ledgerNum,
+                           uint64_t sourceAccount);
+
+    // The ledger entries of account @p accountId as CREATE then SETUP leave
+    // it (extra signers aside), with @p nOffers resting offers like the ones
+    // of OFFERS, numbered from @p offerID on (which is advanced): a large
+    // state can then be written directly, without applying transactions
+    // (see LedgerManager::closeLedgerWithEntries).
+    std::vector<LedgerEntry> makeAccountEntries(uint64_t accountId,
+                                                uint32_t nOffers,
+                                                uint64_t& offerID);
+
+    // asset number @p i of the ring native, LG0, LG1 ...
+    Asset getRingAsset(uint32_t i) const;
+    // the extra signers an account needs on its transactions, as far as this
+    // generator knows
+    std::vector<SecretKey> getExtraSigners(TestAccount const& account) const;
+    static SecretKey getSignerKey(PublicKey const& account, uint32_t i);
     void handleFailedSubmission(TestAccountPtr sourceAccount,
                                 Herder::TransactionSubmitStatus status,
                                 TransactionResultCode code);
     TxInfo creationTransaction(uint64_t startAccount, uint64_t numItems,
                                uint32_t ledgerNum);
     std::vector<TestAccountPtr> checkAccountSynced(Database& database);
-    void logProgress(std::chrono::nanoseconds submitTimer, bool isCreate,
+    void logProgress(std::chrono::nanoseconds submitTimer, LoadGenMode mode,
                      uint32_t nAccounts, uint32_t nTxs, uint32_t batchSize,
                      uint32_t txRate);
 
     uint32_t submitCreationTx(uint32_t nAccounts, uint32_t offset,
                               uint32_t batchSize, uint32_t ledgerNum);
-    uint32_t submitPaymentTx(uint32_t nAccounts, uint32_t offset,
-                             uint32_t batchSize, uint32_t ledgerNum,
-                             uint32_t nTxs);
+    uint32_t submitSetupTx(uint32_t nAccounts, uint32_t offset,
+                           uint32_t ledgerNum);
+    uint32_t submitTx(LoadGenMode mode, uint32_t nAccounts, uint32_t offset,
+                      uint32_t batchSize, uint32_t ledgerNum, uint32_t nTxs);
 
     void updateMinBalance();
     void waitTillComplete();
@@ -99,6 +198,10 @@ class LoadGenerator
         medida::Meter& mAccountCreated;
         medida::Meter& mPayment;
         medida::Meter& mNativePayment;
+        medida::Meter& mPathPayment;
+        medida::Meter& mOffer;
+        medida::Meter& mAccountSetup;
+        medida::Meter& mTxnDropped;
         medida::Meter& mTxnAttempted;
         medida::Meter& mTxnRejected;
         medida::Meter& mTxnBytes;
@@ -111,7 +214,15 @@ class LoadGenerator
     {
         TestAccountPtr mFrom;
         std::vector<Operation> mOps;
-        Herder::TransactionSubmitStatus execute(Application& app, bool isCreate,
+        // the kind of transaction, for metrics: no MIXED
+        LoadGenMode mMode;
+        // signers needed besides mFrom
+        std::vector<SecretKey> mSigners;
+        // set by toTransactionFrame()
+        Hash mHash;
+        // the signed transaction, taking the next sequence number of mFrom
+        TransactionFramePtr toTransactionFrame(Application& app);
+        Herder::TransactionSubmitStatus execute(Application& app,
                                                 TransactionResultCode& code,
                                                 int32_t batchSize);
     };
@@ -121,5 +232,20 @@ class LoadGenerator
     TestAccountPtr mRoot;
     // Accounts cache
     std::map<uint64_t, TestAccountPtr> mAccounts;
+    Shape mShape;
+    // number of signers of each account besides its master key, as last
+    // loaded or set up
+    std::unordered_map<AccountID, uint32_t> mSignerCounts;
+
+    Arrival mArrival{Arrival::NONE};
+    // open loop: the time of the next arrival, none before the first step
+    VirtualClock::time_point mNextArrival;
+    bool mArrivalsStarted{false};
+    struct PendingTx
+    {
+        VirtualClock::time_point mSubmitted;
+        uint32_t mLedger;
+    };
+    std::unordered_map<Hash, PendingTx> mPendingTxs;
 };
 }
@@ -0,0 +1,28 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "simulation/ParamUtils.h"
+
+#include <stdexcept>
+
+namespace stellar
+{
+
+void
+parseUintParam(std::map<std::string, std::string> const& params,
+               std::string const& name, uint32_t& value)
+{
+    auto it = params.find(name);
+    if (it != params.end())
+    {
+        size_t pos = 0;
+        auto res = std::stoul(it->second, &pos);
+        if (pos != it->second.size() || res > UINT32_MAX)
+        {
+            throw std::invalid_argument("Bad value for " + name);
+        }
+        value = static_cast<uint32_t>(res);
+    }
+}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace stellar
+{
+
+// Sets `value` to the parameter `name` of `params` (as parsed by
+// http::server::server::parseParams) if there is one, leaving it as it is
+// otherwise. Throws std::invalid_argument if the parameter is not an
+// unsigned 32-bit integer.
+void parseUintParam(std::map<std::string, std::string> const& params,
+                    std::string const& name, uint32_t& value);
+}
@@ -202,10 +202,34 @@ Simulation::addLoopbackConnection(NodeID initiator, NodeID acceptor)
     {
         auto conn = std::make_shared<LoopbackPeerConnection>(
             *getNode(initiator), *getNode(acceptor));
+        if (mLinkModelGen)
+        {
+            auto link = mLinkModelGen(initiator, acceptor);
+            for (auto const& peer :
+                 {conn->getInitiator(), conn->getAcceptor()})
+            {
+                peer->setLatency(link.mLatency);
+                peer->setJitter(link.mJitter);
+                peer->setBandwidth(link.mBytesPerSecond);
+                peer->setLossProbability(link.mLossProbability);
+            }
+        }
         mLoopbackConnections.push_back(conn);
     }
 }
 
+void
+Simulation::setLinkModel(LinkModel const& model)
+{
+    setLinkModel([model](NodeID const&, NodeID const&) { return model; });
+}
+
+void
+Simulation::setLinkModel(LinkModelGen const& modelGen)
+{
+    mLinkModelGen = modelGen;
+}
+
 void
 Simulation::dropLoopbackConnection(NodeID initiator, NodeID acceptor)
 {
@@ -616,6 +640,31 @@ Simulation::newConfig()
     }
 }
 
+Simulation::ConfigGen
+Simulation::lightweightConfigs(ConfigGen confGen)
+{
+    return [confGen](int i) {
+        Config res;
+        if (confGen)
+        {
+            res = confGen(i);
+        }
+        else
+        {
+            res = getTestConfig(i);
+            res.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
+        }
+        res.BUCKET_MERGE_WORKERS.mThreads = 1;
+        res.HISTORY_IO_WORKERS.mThreads = 1;
+        res.MISC_WORKERS.mThreads = 1;
+        res.VERIFY_SIGNATURES_ON_MAIN_THREAD_FOR_TESTING = true;
+        res.INVARIANT_CHECKS.clear();
+        // core nodes may have a connection from each of many nodes
+        res.MAX_PEER_CONNECTIONS = 1000;
+        return res;
+    };
+}
+
 class ConsoleReporterWithSum : public medida::reporting::ConsoleReporter
 {
     std::ostream& out_;
@@ -37,6 +37,28 @@ class Simulation
     using ConfigGen = std::function<Config(int i)>;
     using QuorumSetAdjuster = std::function<SCPQuorumSet(SCPQuorumSet const&)>;
 
+    // network conditions of the loopback connections, see LoopbackPeer
+    struct LinkModel
+    {
+        std::chrono::microseconds mLatency{0};
+        // scale of the random extra latency
+        std::chrono::microseconds mJitter{0};
+        // 0 for unlimited
+        uint64_t mBytesPerSecond{0};
+        // of packets, which are retransmitted
+        double mLossProbability{0.0};
+    };
+    // the link model of each connection
+    using LinkModelGen = std::function<LinkModel(NodeID const& initiator,
+                                                 NodeID const& acceptor)>;
+
+    // [testing] configs for simulations of hundreds of nodes, made by
+    // @p confGen (or the default) and lightened: one thread per worker
+    // pool, signatures verified on the main thread (which also makes
+    // virtual-time cranking deterministic), no invariant checks and no
+    // limit on connections.
+    static ConfigGen lightweightConfigs(ConfigGen confGen = nullptr);
+
     Simulation(Mode mode, Hash const& networkID, ConfigGen = nullptr,
                QuorumSetAdjuster = nullptr);
     ~Simulation();
@@ -75,6 +97,10 @@ class Simulation
 
     void addConnection(NodeID initiator, NodeID acceptor);
     void dropConnection(NodeID initiator, NodeID acceptor);
+    // applies to the loopback connections added afterwards, including the
+    // pending ones added by startAllNodes
+    void setLinkModel(LinkModel const& model);
+    void setLinkModel(LinkModelGen const& modelGen);
     Config newConfig(); // generates a new config
 
   private:
@@ -103,6 +129,7 @@ class Simulation
     std::map<NodeID, Node> mNodes;
     std::vector<std::pair<NodeID, NodeID>> mPendingConnections;
     std::vector<std::shared_ptr<LoopbackPeerConnection>> mLoopbackConnections;
+    LinkModelGen mLinkModelGen;
 
     ConfigGen mConfigGen; // config generator
 
@@ -289,6 +289,74 @@ Topologies::hierarchicalQuorumSimplified(
     return sim;
 }
 
+Simulation::pointer
+Topologies::coreWithWatchers(int coreSize, int nbWatchers,
+                             Simulation::Mode mode, Hash const& networkID,
+                             Simulation::ConfigGen confGen,
+                             int connectionsToCore, int connectionsToWatchers,
+                             Simulation::QuorumSetAdjuster qSetAdjust)
+{
+    auto sim =
+        Topologies::core(coreSize, 0.75, mode, networkID, confGen, qSetAdjust);
+    auto coreNodeIDs = sim->getNodeIDs();
+
+    SCPQuorumSet qSet;
+    qSet.threshold = static_cast<uint32>(ceil(coreSize * 0.75));
+    qSet.validators = coreNodeIDs;
+
+    vector<PublicKey> watchers;
+    for (int i = 0; i < nbWatchers; i++)
+    {
+        SecretKey sk =
+            SecretKey::fromSeed(sha256("WATCHER_NODE_SEED_" + to_string(i)));
+        auto cfg = sim->newConfig();
+        cfg.NODE_IS_VALIDATOR = false;
+        sim->addNode(sk, qSet, &cfg);
+        watchers.emplace_back(sk.getPublicKey());
+
+        for (int j = 0; j < connectionsToCore; j++)
+        {
+            sim->addPendingConnection(watchers.back(),
+                                      coreNodeIDs[(i + j) % coreSize]);
+        }
+    }
+    // 2 * j < nbWatchers: no two connections between the same watchers
+    for (int i = 0; i < nbWatchers; i++)
+    {
+        for (int j = 1; j <= connectionsToWatchers && 2 * j < nbWatchers; j++)
+        {
+            sim->addPendingConnection(watchers[i],
+                                      watchers[(i + j) % nbWatchers]);
+        }
+    }
+
+    return sim;
+}
+
+Simulation::LinkModelGen
+Topologies::regions(std::vector<NodeID> const& nodes, int nRegions,
+                    Simulation::LinkModel const& local,
+                    Simulation::LinkModel const& remote)
+{
+    if (nRegions <= 0)
+    {
+        throw std::invalid_argument("need at least one region");
+    }
+    auto regionOf = make_shared<map<NodeID, int>>();
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        (*regionOf)[nodes[i]] = static_cast<int>(i % nRegions);
+    }
+    return [regionOf, local, remote](NodeID const& initiator,
+                                     NodeID const& acceptor) {
+        auto i = regionOf->find(initiator);
+        auto a = regionOf->find(acceptor);
+        bool sameRegion = i != regionOf->end() && a != regionOf->end() &&
+                          i->second == a->second;
+        return sameRegion ? local : remote;
+    };
+}
+
 Simulation::pointer
 Topologies::customA(Simulation::Mode mode, Hash const& networkID,
                     Simulation::ConfigGen confGen, int connections,
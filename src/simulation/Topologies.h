@@ -64,6 +64,27 @@ class Topologies
         int connectionsToCore = 1,
         Simulation::QuorumSetAdjuster qSetAdjust = nullptr);
 
+    // a core of validators (with 0.75 threshold) and nbWatchers
+    // non-validating nodes that track the core: the shape of a public
+    // network, to look at SCP and flooding with hundreds of nodes (see
+    // Simulation::lightweightConfigs and Simulation::setLinkModel).
+    // Watchers have connectionsToCore connections to core nodes
+    // (round-robin) and connectionsToWatchers to the next watchers.
+    static Simulation::pointer
+    coreWithWatchers(int coreSize, int nbWatchers, Simulation::Mode mode,
+                     Hash const& networkID,
+                     Simulation::ConfigGen confGen = nullptr,
+                     int connectionsToCore = 1, int connectionsToWatchers = 2,
+                     Simulation::QuorumSetAdjuster qSetAdjust = nullptr);
+
+    // WAN scenario for setLinkModel: @p nodes are spread round-robin over
+    // nRegions regions, links within a region follow @p local and links
+    // between regions @p remote
+    static Simulation::LinkModelGen
+    regions(std::vector<NodeID> const& nodes, int nRegions,
+            Simulation::LinkModel const& local,
+            Simulation::LinkModel const& remote);
+
     // custom-A
     static Simulation::pointer
     customA(Simulation::Mode mode, Hash const& networkID,
@@ -0,0 +1,258 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "test/PerfResults.h"
+#include "lib/util/format.h"
+#include "main/StellarCoreVersion.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace stellar
+{
+
+namespace
+{
+struct Measurement
+{
+    std::string mUnit;
+    PerfDirection mDirection;
+    std::vector<double> mSamples;
+};
+
+int gPerfRuns{5};
+std::string gPerfResultsFile;
+std::map<std::string, Measurement> gMeasurements;
+
+// two-sided 95% critical values of Student's t distribution, by degrees of
+// freedom, the normal one past the end
+double const T_CRITICAL[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447,
+                             2.365,  2.306, 2.262, 2.228, 2.201, 2.179,
+                             2.160,  2.145, 2.131, 2.120, 2.110, 2.101,
+                             2.093,  2.086, 2.080, 2.074, 2.069, 2.064,
+                             2.060,  2.056, 2.052, 2.048, 2.045, 2.042};
+
+double
+tCritical(double df)
+{
+    auto n = sizeof(T_CRITICAL) / sizeof(T_CRITICAL[0]);
+    // rounding down is conservative
+    auto i = static_cast<size_t>(std::max(1.0, std::floor(df)));
+    return i <= n ? T_CRITICAL[i - 1] : 1.96;
+}
+
+Json::Value
+statistics(Measurement const& m)
+{
+    auto sorted = m.mSamples;
+    std::sort(sorted.begin(), sorted.end());
+    auto n = sorted.size();
+    auto mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / n;
+    double variance = 0;
+    for (auto v : sorted)
+    {
+        variance += (v - mean) * (v - mean);
+    }
+    variance = n > 1 ? variance / (n - 1) : 0;
+
+    Json::Value res;
+    res["unit"] = m.mUnit;
+    res["higher_is_better"] = m.mDirection == PerfDirection::HIGHER_IS_BETTER;
+    res["runs"] = static_cast<Json::UInt64>(n);
+    res["median"] = n % 2 ? sorted[n / 2]
+                          : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    res["mean"] = mean;
+    res["variance"] = variance;
+    res["stddev"] = std::sqrt(variance);
+    auto& samples = res["samples"];
+    for (auto v : m.mSamples)
+    {
+        samples.append(v);
+    }
+    return res;
+}
+
+Json::Value
+readResults(std::string const& file)
+{
+    std::ifstream in(file);
+    if (!in)
+    {
+        throw std::runtime_error("Can't open " + file);
+    }
+    Json::Value res;
+    Json::Reader reader;
+    if (!reader.parse(in, res))
+    {
+        throw std::runtime_error("Can't parse " + file + ": " +
+                                 reader.getFormattedErrorMessages());
+    }
+    return res;
+}
+}
+
+int
+getPerfRuns()
+{
+    return gPerfRuns;
+}
+
+void
+recordPerfSample(std::string const& name, std::string const& unit,
+                 PerfDirection direction, double value)
+{
+    auto& m = gMeasurements[name];
+    m.mUnit = unit;
+    m.mDirection = direction;
+    m.mSamples.emplace_back(value);
+    LOG(INFO) << "Perf " << name << " run " << m.mSamples.size() << ": "
+              << value << " " << unit;
+}
+
+void
+measurePerf(std::string const& name, std::string const& unit,
+            PerfDirection direction, std::function<double()> const& run)
+{
+    for (int i = 0; i < gPerfRuns; i++)
+    {
+        recordPerfSample(name, unit, direction, run());
+    }
+}
+
+namespace perftest
+{
+void
+setPerfOptions(int runs, std::string const& resultsFile)
+{
+    gPerfRuns = std::max(runs, 1);
+    gPerfResultsFile = resultsFile;
+}
+
+Json::Value
+getPerfResults()
+{
+    Json::Value res;
+    res["version"] = STELLAR_CORE_VERSION;
+    res["time"] = static_cast<Json::UInt64>(std::time(nullptr));
+    auto& results = res["results"];
+    results = Json::objectValue;
+    for (auto const& m : gMeasurements)
+    {
+        results[m.first] = statistics(m.second);
+    }
+    return res;
+}
+
+void
+writePerfResults()
+{
+    if (gMeasurements.empty())
+    {
+        return;
+    }
+    auto file = gPerfResultsFile.empty()
+                    ? fmt::format("perf-results-{:d}.json", std::time(nullptr))
+                    : gPerfResultsFile;
+    std::ofstream out(file);
+    out << getPerfResults().toStyledString();
+    LOG(INFO) << "Wrote " << gMeasurements.size() << " perf results to "
+              << file;
+    gMeasurements.clear();
+}
+}
+
+int
+comparePerfResults(Json::Value const& base, Json::Value const& current,
+                   std::ostream& out, double tolerance)
+{
+    auto const& baseResults = base["results"];
+    auto const& currentResults = current["results"];
+    int regressions = 0;
+    out << fmt::format("{:<40s} {:>14s} {:>14s} {:>8s}", "measurement",
+                       "base", "current", "change")
+        << std::endl;
+    for (auto const& name : currentResults.getMemberNames())
+    {
+        auto const& c = currentResults[name];
+        if (!baseResults.isMember(name))
+        {
+            out << fmt::format("{:<40s} {:>14s} {:>14.2f}          new", name,
+                               "-", c["median"].asDouble())
+                << std::endl;
+            continue;
+        }
+        auto const& b = baseResults[name];
+        auto bMedian = b["median"].asDouble();
+        auto cMedian = c["median"].asDouble();
+        auto change = bMedian != 0 ? (cMedian - bMedian) / std::fabs(bMedian)
+                                   : 0.0;
+        auto worse = c["higher_is_better"].asBool() ? -change : change;
+
+        // Welch's t-test on the means
+        auto bn = b["runs"].asDouble();
+        auto cn = c["runs"].asDouble();
+        auto bv = b["variance"].asDouble() / bn;
+        auto cv = c["variance"].asDouble() / cn;
+        auto diff = c["mean"].asDouble() - b["mean"].asDouble();
+        std::string status;
+        if (bn < 2 || cn < 2)
+        {
+            status = "(too few runs)";
+        }
+        else
+        {
+            bool significant;
+            if (bv + cv == 0)
+            {
+                significant = diff != 0;
+            }
+            else
+            {
+                auto t = diff / std::sqrt(bv + cv);
+                auto df = (bv + cv) * (bv + cv) /
+                          (bv * bv / (bn - 1) + cv * cv / (cn - 1));
+                significant = std::fabs(t) > tCritical(df);
+            }
+            if (significant && worse > tolerance)
+            {
+                status = "REGRESSION";
+                regressions++;
+            }
+            else if (significant && -worse > tolerance)
+            {
+                status = "improved";
+            }
+        }
+        out << fmt::format("{:<40s} {:>14.2f} {:>14.2f} {:>+7.1f}%  {:s}",
+                           name, bMedian, cMedian, change * 100, status)
+            << std::endl;
+    }
+    for (auto const& name : baseResults.getMemberNames())
+    {
+        if (!currentResults.isMember(name))
+        {
+            out << fmt::format("{:<40s} {:>14.2f} {:>14s}          gone", name,
+                               baseResults[name]["median"].asDouble(), "-")
+                << std::endl;
+        }
+    }
+    out << regressions << " regression(s)" << std::endl;
+    return regressions;
+}
+
+int
+comparePerfResults(std::string const& baseFile,
+                   std::string const& currentFile, std::ostream& out)
+{
+    return comparePerfResults(readResults(baseFile), readResults(currentFile),
+                              out);
+}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace stellar
+{
+
+// Results of the performance regression tests, tagged [perf]: each of them
+// records samples of named measurements, taken over getPerfRuns() repeated
+// runs. Once the tests are done, the median, mean and variance of each
+// measurement are written as JSON to the results file (see the
+// --perf-runs and --perf-results options of --test), so that the results
+// of two builds can be compared with comparePerfResults.
+
+enum class PerfDirection
+{
+    HIGHER_IS_BETTER,
+    LOWER_IS_BETTER
+};
+
+// runs to do of each measurement
+int getPerfRuns();
+
+// adds @p value to the samples of measurement @p name, in @p unit
+void recordPerfSample(std::string const& name, std::string const& unit,
+                      PerfDirection direction, double value);
+
+// records the values returned by getPerfRuns() calls of @p run
+void measurePerf(std::string const& name, std::string const& unit,
+                 PerfDirection direction, std::function<double()> const& run);
+
+namespace perftest
+{
+// called by test() around the tests
+void setPerfOptions(int runs, std::string const& resultsFile);
+void writePerfResults();
+
+// the statistics of the samples recorded so far, as written to the file
+Json::Value getPerfResults();
+}
+
+// Compares the measurements of @p current to those of @p base (results
+// files, or their contents), writing one line per measurement to @p out.
+// A measurement regressed if it got worse by more than @p tolerance
+// (relative change of the median) and the difference of the means is
+// significant (Welch's t-test, 95% two-sided). Returns the number of
+// regressions.
+int comparePerfResults(Json::Value const& base, Json::Value const& current,
+                       std::ostream& out, double tolerance = 0.05);
+int comparePerfResults(std::string const& baseFile,
+                       std::string const& currentFile, std::ostream& out);
+}
@@ -0,0 +1,79 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "test/PerfResults.h"
+
+#include <sstream>
+
+using namespace stellar;
+
+namespace
+{
+Json::Value
+measurement(bool higherIsBetter, std::vector<double> const& samples)
+{
+    double mean = 0;
+    for (auto v : samples)
+    {
+        mean += v;
+    }
+    mean /= samples.size();
+    double variance = 0;
+    for (auto v : samples)
+    {
+        variance += (v - mean) * (v - mean);
+    }
+
+    Json::Value res;
+    res["higher_is_better"] = higherIsBetter;
+    res["runs"] = static_cast<Json::UInt64>(samples.size());
+    res["median"] = mean;
+    res["mean"] = mean;
+    res["variance"] = variance / (samples.size() - 1);
+    return res;
+}
+}
+
+TEST_CASE("perf results comparison", "[perf-results]")
+{
+    Json::Value base;
+    base["results"]["rate"] = measurement(true, {100, 101, 99, 100, 100});
+    base["results"]["time"] = measurement(false, {10, 11, 9, 10, 10});
+    base["results"]["noisy"] = measurement(true, {100, 60, 140, 80, 120});
+    base["results"]["gone"] = measurement(true, {1, 2});
+    std::ostringstream out;
+
+    SECTION("same results")
+    {
+        REQUIRE(comparePerfResults(base, base, out) == 0);
+    }
+    SECTION("significant regressions")
+    {
+        auto current = base;
+        current["results"]["rate"] = measurement(true, {80, 81, 79, 80, 80});
+        current["results"]["time"] = measurement(false, {15, 16, 14, 15, 15});
+        REQUIRE(comparePerfResults(base, current, out) == 2);
+        REQUIRE(out.str().find("REGRESSION") != std::string::npos);
+    }
+    SECTION("improvements and noise")
+    {
+        auto current = base;
+        current["results"]["rate"] =
+            measurement(true, {120, 121, 119, 120, 120});
+        current["results"]["time"] = measurement(false, {5, 6, 4, 5, 5});
+        current["results"]["noisy"] = measurement(true, {90, 50, 130, 70, 110});
+        current["results"].removeMember("gone");
+        current["results"]["new"] = measurement(true, {1, 2});
+        REQUIRE(comparePerfResults(base, current, out) == 0);
+        REQUIRE(out.str().find("improved") != std::string::npos);
+    }
+    SECTION("small changes are tolerated")
+    {
+        auto current = base;
+        current["results"]["rate"] = measurement(true, {97, 98, 96, 97, 97});
+        REQUIRE(comparePerfResults(base, current, out) == 0);
+        REQUIRE(comparePerfResults(base, current, out, 0.01) == 1);
+    }
+}
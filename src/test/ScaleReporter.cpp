@@ -0,0 +1,71 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "test/ScaleReporter.h"
+#include "lib/util/format.h"
+#include "util/Logging.h"
+
+#include <cassert>
+#include <ctime>
+#include <sstream>
+
+namespace stellar
+{
+
+std::string
+ScaleReporter::join(std::vector<std::string> const& parts,
+                    std::string const& sep)
+{
+    std::string sum;
+    bool first = true;
+    for (auto const& s : parts)
+    {
+        if (first)
+        {
+            first = false;
+        }
+        else
+        {
+            sum += sep;
+        }
+        sum += s;
+    }
+    return sum;
+}
+
+ScaleReporter::ScaleReporter(std::vector<std::string> const& columns)
+    : mColumns(columns)
+    , mFilename(fmt::format("{:s}-{:d}.csv", join(columns, "-vs-"),
+                            std::time(nullptr)))
+    , mOut(mFilename)
+{
+    LOG(INFO) << "Opened " << mFilename << " for writing";
+    mOut << join(columns, ",") << std::endl;
+}
+
+ScaleReporter::~ScaleReporter()
+{
+    LOG(INFO) << "Wrote " << mNumWritten << " rows to " << mFilename;
+}
+
+void
+ScaleReporter::write(std::vector<double> const& vals)
+{
+    assert(vals.size() == mColumns.size());
+    std::ostringstream oss;
+    for (size_t i = 0; i < vals.size(); ++i)
+    {
+        if (i != 0)
+        {
+            oss << ", ";
+            mOut << ",";
+        }
+        oss << mColumns.at(i) << "=" << std::fixed << vals.at(i);
+        mOut << std::fixed << vals.at(i);
+    }
+    LOG(INFO) << std::fixed << "Writing " << oss.str();
+    mOut << std::endl;
+    ++mNumWritten;
+}
+}
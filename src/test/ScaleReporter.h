@@ -0,0 +1,32 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+
+// Writes rows of measurements from scalability and benchmark tests to a
+// <col1>-vs-<col2>-vs-...-<timestamp>.csv file in the current directory,
+// and logs them as they are written.
+class ScaleReporter
+{
+    std::vector<std::string> mColumns;
+    std::string mFilename;
+    std::ofstream mOut;
+    size_t mNumWritten{0};
+    static std::string join(std::vector<std::string> const& parts,
+                            std::string const& sep);
+
+  public:
+    ScaleReporter(std::vector<std::string> const& columns);
+    ~ScaleReporter();
+
+    void write(std::vector<double> const& vals);
+};
+}
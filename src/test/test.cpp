@@ -9,6 +9,7 @@
 #include "main/Config.h"
 #include "main/StellarCoreVersion.h"
 #include "test.h"
+#include "test/PerfResults.h"
 #include "test/TestUtils.h"
 #include "util/Logging.h"
 #include "util/TmpDir.h"
@@ -45,6 +46,8 @@ static std::vector<TmpDir> gTestRoots;
 static bool gTestAllVersions{false};
 static std::vector<uint32> gVersionsToTest;
 static int gBaseInstance{0};
+static int gPerfRuns{5};
+static std::string gPerfResultsFile;
 
 bool force_sqlite = (std::getenv("STELLAR_FORCE_SQLITE") != nullptr);
 
@@ -173,6 +176,11 @@ test(int argc, char* const* argv, el::Level ll,
     cli |= clara::Opt(gBaseInstance, "offset")["--base-instance"](
         "Instance number offset so multiple instances of "
         "stellar-core can run tests concurrently");
+    cli |= clara::Opt(gPerfRuns, "runs")["--perf-runs"](
+        "Runs of each measurement of the [perf] tests (default 5)");
+    cli |= clara::Opt(gPerfResultsFile, "file")["--perf-results"](
+        "Results file of the [perf] tests (default "
+        "perf-results-<timestamp>.json)");
     session.cli(cli);
 
     auto r = session.applyCommandLine(argc, argv);
@@ -183,7 +191,9 @@ test(int argc, char* const* argv, el::Level ll,
     {
         gVersionsToTest.emplace_back(Config::CURRENT_LEDGER_PROTOCOL_VERSION);
     }
+    perftest::setPerfOptions(gPerfRuns, gPerfResultsFile);
     r = session.run();
+    perftest::writePerfResults();
     gTestRoots.clear();
     gTestCfg->clear();
     return r;
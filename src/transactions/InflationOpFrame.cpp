@@ -3,7 +3,9 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "transactions/InflationOpFrame.h"
+#include "database/Database.h"
 #include "ledger/AccountFrame.h"
+#include "ledger/InflationVoteTally.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
@@ -64,16 +66,24 @@ InflationOpFrame::doApply(Application& app, LedgerDelta& delta,
     std::vector<AccountFrame::InflationVotes> winners;
     auto& db = ledgerManager.getDatabase();
 
-    AccountFrame::processForInflation(
-        [&](AccountFrame::InflationVotes const& votes) {
-            if (votes.mVotes >= minBalance)
-            {
-                winners.push_back(votes);
-                return true;
-            }
-            return false;
-        },
-        INFLATION_NUM_WINNERS, db);
+    auto processor = [&](AccountFrame::InflationVotes const& votes) {
+        if (votes.mVotes >= minBalance)
+        {
+            winners.push_back(votes);
+            return true;
+        }
+        return false;
+    };
+    if (auto tally = db.getInflationVoteTally())
+    {
+        tally->processForInflation(processor, INFLATION_NUM_WINNERS, db,
+                                   delta);
+    }
+    else
+    {
+        AccountFrame::processForInflation(processor, INFLATION_NUM_WINNERS,
+                                          db);
+    }
 
     auto inflationAmount = bigDivide(lcl.totalCoins, INFLATION_RATE_TRILLIONTHS,
                                      TRILLION, ROUND_DOWN);
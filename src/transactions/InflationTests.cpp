@@ -2,7 +2,9 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "database/Database.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/InflationVoteTally.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
@@ -18,6 +20,7 @@
 #include "util/Logging.h"
 #include "util/Timer.h"
 #include "util/XDROperators.h"
+#include <climits>
 #include <functional>
 
 using namespace stellar;
@@ -632,3 +635,81 @@ TEST_CASE("inflation", "[tx][inflation]")
         }
     }
 }
+
+TEST_CASE("inflation vote tally", "[tx][inflation]")
+{
+    Config cfg = getTestConfig(0);
+    cfg.INFLATION_VOTE_TALLY = true;
+
+    VirtualClock clock;
+    clock.setCurrentTime(VirtualClock::from_time_t(getTestDate(1, 7, 2014)));
+
+    auto app = createTestApplication(clock, cfg);
+    auto root = TestAccount::createRoot(*app);
+    app->start();
+
+    auto& db = app->getDatabase();
+    auto tally = db.getInflationVoteTally();
+    REQUIRE(tally);
+
+    auto requireMatchesDatabase = [&]() {
+        std::vector<AccountFrame::InflationVotes> expected;
+        AccountFrame::processForInflation(
+            [&](AccountFrame::InflationVotes const& votes) {
+                expected.emplace_back(votes);
+                return true;
+            },
+            INT_MAX, db);
+        LedgerDelta delta(app->getLedgerManager().getCurrentLedgerHeader(),
+                          db);
+        auto votes = tally->getVotes(db, delta);
+        REQUIRE(votes.size() == expected.size());
+        for (size_t i = 0; i < votes.size(); i++)
+        {
+            REQUIRE(votes[i].mInflationDest == expected[i].mInflationDest);
+            REQUIRE(votes[i].mVotes == expected[i].mVotes);
+        }
+    };
+
+    const int64 minVote = 1000000000LL;
+    const int64 winnerVote =
+        bigDivide(app->getLedgerManager().getCurrentLedgerHeader().totalCoins,
+                  5, 10000, ROUND_DOWN);
+
+    // two destinations, half of the accounts each
+    int nbAccounts = 12;
+    const int midPoint = nbAccounts / 2;
+    const int64 each =
+        bigDivide(winnerVote, 2, nbAccounts, ROUND_DOWN) + minVote;
+    auto voteFunc = [&](int n) { return (n < midPoint) ? 0 : 1; };
+    auto balanceFunc = [&](int n) { return each; };
+
+    createTestAccounts(*app, nbAccounts, balanceFunc, voteFunc);
+    closeLedgerOn(*app, 2, 21, 7, 2014);
+
+    // loads the tally
+    doInflation(*app, app->getLedgerManager().getCurrentLedgerVersion(),
+                nbAccounts, balanceFunc, voteFunc, 2);
+    requireMatchesDatabase();
+
+    // votes moved and a voter merged away in the ledger of the next
+    // inflation: whichever order they are applied in, the invariant checks
+    // the tally counted them
+    std::vector<TransactionFramePtr> txs;
+    for (int i = midPoint; i < midPoint + 3; i++)
+    {
+        auto voter = TestAccount(*app, getTestAccount(i));
+        txs.emplace_back(voter.tx({setOptions(setInflationDestination(
+            getTestAccount(2).getPublicKey()))}));
+    }
+    auto merged = TestAccount(*app, getTestAccount(1));
+    txs.emplace_back(
+        merged.tx({accountMerge(getTestAccount(3).getPublicKey())}));
+    txs.emplace_back(root.tx({inflation()}));
+    auto results = closeLedgerOn(*app, 3, 28, 7, 2014, txs);
+    for (auto const& r : results)
+    {
+        REQUIRE(r.first.result.result.code() == txSUCCESS);
+    }
+    requireMatchesDatabase();
+}
@@ -565,9 +565,16 @@ applyPriceErrorThresholds(Price price, int64_t wheatReceive, int64_t sheepSend,
     return res;
 }
 
+size_t const LoadBestOfferContext::FIRST_BATCH_SIZE = 5;
+size_t const LoadBestOfferContext::MAX_BATCH_SIZE = 320;
+
 LoadBestOfferContext::LoadBestOfferContext(Database& db, Asset const& selling,
                                            Asset const& buying)
-    : mSelling(selling), mBuying(buying), mDb(db), mBatchIterator(mBatch.end())
+    : mSelling(selling)
+    , mBuying(buying)
+    , mDb(db)
+    , mBatchSize(0)
+    , mBatchIterator(mBatch.end())
 {
     loadBatchIfNecessary();
 }
@@ -577,8 +584,14 @@ LoadBestOfferContext::loadBatchIfNecessary()
 {
     if (mBatchIterator == mBatch.end())
     {
+        // the offers of the previous batch have all been crossed (and so
+        // deleted): the next ones are again the best
+        mBatchSize = mBatchSize == 0
+                         ? FIRST_BATCH_SIZE
+                         : std::min(mBatchSize * 2, MAX_BATCH_SIZE);
         mBatch.clear();
-        OfferFrame::loadBestOffers(5, 0, mSelling, mBuying, mBatch, mDb);
+        OfferFrame::loadBestOffers(mBatchSize, 0, mSelling, mBuying, mBatch,
+                                   mDb);
         mBatchIterator = mBatch.begin();
     }
 }
@@ -82,6 +82,10 @@ int64_t adjustOffer(Price const& price, int64_t maxWheatSend,
 bool checkPriceErrorBound(Price price, int64_t wheatReceive, int64_t sheepSend,
                           bool canFavorWheat);
 
+// Iterates over the best offers of an asset pair, loading them by batches.
+// As crossing many offers makes it likely that many more are needed, every
+// batch is twice as large as the previous one (up to MAX_BATCH_SIZE), so
+// that a large exchange takes a logarithmic number of queries.
 class LoadBestOfferContext
 {
     Asset const mSelling;
@@ -89,12 +93,16 @@ class LoadBestOfferContext
 
     Database& mDb;
 
+    size_t mBatchSize;
     std::vector<OfferFrame::pointer> mBatch;
     std::vector<OfferFrame::pointer>::iterator mBatchIterator;
 
     void loadBatchIfNecessary();
 
   public:
+    static size_t const FIRST_BATCH_SIZE;
+    static size_t const MAX_BATCH_SIZE;
+
     LoadBestOfferContext(Database& db, Asset const& selling,
                          Asset const& buying);
 
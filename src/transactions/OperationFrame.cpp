@@ -21,6 +21,7 @@
 #include "transactions/SetOptionsOpFrame.h"
 #include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
+#include "util/Tracing.h"
 #include "xdrpp/marshal.h"
 #include <string>
 
@@ -99,6 +100,7 @@ bool
 OperationFrame::apply(SignatureChecker& signatureChecker, LedgerDelta& delta,
                       Application& app)
 {
+    TRACE_ZONE("OperationFrame::apply");
     bool res;
     res = checkValid(signatureChecker, app, &delta);
     if (res)
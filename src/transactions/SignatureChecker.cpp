@@ -15,12 +15,25 @@
 namespace stellar
 {
 
+namespace
+{
+SignatureHint
+getSignerHint(SignerKey const& key)
+{
+    return SignatureUtils::getHint(key.type() == SIGNER_KEY_TYPE_HASH_X
+                                       ? key.hashX()
+                                       : key.ed25519());
+}
+}
+
 SignatureChecker::SignatureChecker(
     uint32_t protocolVersion, Hash const& contentsHash,
-    xdr::xvector<DecoratedSignature, 20> const& signatures)
+    xdr::xvector<DecoratedSignature, 20> const& signatures,
+    SignatureVerifications* verifications)
     : mProtocolVersion{protocolVersion}
     , mContentsHash{contentsHash}
     , mSignatures{signatures}
+    , mVerifications{verifications}
 {
     mUsedSignatures.resize(mSignatures.size());
 }
@@ -60,21 +73,31 @@ SignatureChecker::checkSignature(AccountID const& accountID,
     using VerifyT =
         std::function<bool(DecoratedSignature const&, Signer const&)>;
     auto verifyAll = [&](std::vector<Signer>& signers, VerifyT verify) {
+        // a signature is only verified against the signers with the same
+        // hint, compared here rather than after converting every key
+        std::vector<SignatureHint> hints;
+        hints.reserve(signers.size());
+        for (auto const& signerKey : signers)
+        {
+            hints.emplace_back(getSignerHint(signerKey.key));
+        }
+
         for (size_t i = 0; i < mSignatures.size(); i++)
         {
             auto const& sig = mSignatures[i];
 
-            for (auto it = signers.begin(); it != signers.end(); ++it)
+            for (size_t j = 0; j < signers.size(); j++)
             {
-                auto& signerKey = *it;
-                if (verify(sig, signerKey))
+                auto& signerKey = signers[j];
+                if (hints[j] == sig.hint && verify(sig, signerKey))
                 {
                     mUsedSignatures[i] = true;
                     totalWeight += signerKey.weight;
                     if (totalWeight >= neededWeight)
                         return true;
 
-                    signers.erase(it);
+                    signers.erase(signers.begin() + j);
+                    hints.erase(hints.begin() + j);
                     break;
                 }
             }
@@ -96,7 +119,20 @@ SignatureChecker::checkSignature(AccountID const& accountID,
     verified = verifyAll(
         signers[SIGNER_KEY_TYPE_ED25519],
         [&](DecoratedSignature const& sig, Signer const& signerKey) {
-            return SignatureUtils::verify(sig, signerKey.key, mContentsHash);
+            if (!mVerifications)
+            {
+                return SignatureUtils::verify(sig, signerKey.key,
+                                              mContentsHash);
+            }
+            auto key = std::make_pair(signerKey.key.ed25519(), sig.signature);
+            auto it = mVerifications->find(key);
+            if (it == mVerifications->end())
+            {
+                auto valid =
+                    SignatureUtils::verify(sig, signerKey.key, mContentsHash);
+                it = mVerifications->emplace(key, valid).first;
+            }
+            return it->second;
         });
     if (verified)
     {
@@ -129,4 +165,10 @@ SignatureChecker::usedOneTimeSignerKeys() const
 {
     return mUsedOneTimeSignerKeys;
 }
+
+std::vector<bool> const&
+SignatureChecker::usedSignatures() const
+{
+    return mUsedSignatures;
+}
 };
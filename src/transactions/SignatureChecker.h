@@ -18,12 +18,18 @@ namespace stellar
 
 using UsedOneTimeSignerKeys = std::map<AccountID, std::set<SignerKey>>;
 
+// results of the ed25519 signature checks done for a transaction, by signer
+// key and signature, so that validating it again does not verify them again
+using SignatureVerifications = std::map<std::pair<uint256, Signature>, bool>;
+
 class SignatureChecker
 {
   public:
+    // @p verifications, if set, must only hold results for @p contentsHash
     explicit SignatureChecker(
         uint32_t protocolVersion, Hash const& contentsHash,
-        xdr::xvector<DecoratedSignature, 20> const& signatures);
+        xdr::xvector<DecoratedSignature, 20> const& signatures,
+        SignatureVerifications* verifications = nullptr);
 
     bool checkSignature(AccountID const& accountID,
                         std::vector<Signer> const& signersV,
@@ -31,11 +37,14 @@ class SignatureChecker
     bool checkAllSignaturesUsed() const;
 
     const UsedOneTimeSignerKeys& usedOneTimeSignerKeys() const;
+    // for each of the signatures, whether it added the weight of a signer
+    std::vector<bool> const& usedSignatures() const;
 
   private:
     uint32_t mProtocolVersion;
     Hash const& mContentsHash;
     xdr::xvector<DecoratedSignature, 20> const& mSignatures;
+    SignatureVerifications* mVerifications;
 
     std::vector<bool> mUsedSignatures;
     UsedOneTimeSignerKeys mUsedOneTimeSignerKeys;
@@ -7,18 +7,27 @@
 #include "OperationFrame.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
 #include "crypto/SignerKey.h"
+#include "crypto/XDRHasher.h"
+#include "database/BatchInserter.h"
 #include "database/Database.h"
 #include "database/DatabaseUtils.h"
 #include "herder/TxSetFrame.h"
 #include "invariant/InvariantManager.h"
+#include "ledger/ApplyProfiler.h"
+#include "ledger/LedgerCloseTracer.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "transactions/SignatureChecker.h"
 #include "transactions/SignatureUtils.h"
 #include "util/Algoritm.h"
 #include "util/Decoder.h"
+#include "util/Gzip.h"
 #include "util/Logging.h"
+#include "util/MemoryUsage.h"
+#include "util/Tracing.h"
 #include "util/XDROperators.h"
 #include "util/XDRStream.h"
 #include "xdrpp/marshal.h"
@@ -40,6 +49,34 @@ TransactionFrame::makeTransactionFromWire(Hash const& networkID,
                                           TransactionEnvelope const& msg)
 {
     TransactionFramePtr res = make_shared<TransactionFrame>(networkID, msg);
+    res->getContentsHash();
+    res->getFullHash();
+    return res;
+}
+
+std::vector<TransactionFramePtr>
+TransactionFrame::makeTransactionsFromWire(
+    Hash const& networkID, xdr::xvector<TransactionEnvelope> const& msgs)
+{
+    std::vector<TransactionFramePtr> res;
+    std::vector<xdr::opaque_vec<>> bodies;
+    res.reserve(msgs.size());
+    bodies.reserve(2 * msgs.size());
+    for (auto const& msg : msgs)
+    {
+        res.emplace_back(make_shared<TransactionFrame>(networkID, msg));
+        bodies.emplace_back(
+            xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_TX, msg.tx));
+        bodies.emplace_back(xdr::xdr_to_opaque(msg));
+    }
+
+    auto hashes =
+        sha256Multi(std::vector<ByteSlice>(bodies.begin(), bodies.end()));
+    for (size_t i = 0; i < res.size(); i++)
+    {
+        res[i]->mContentsHash = hashes[2 * i];
+        res[i]->mFullHash = hashes[2 * i + 1];
+    }
     return res;
 }
 
@@ -54,7 +91,7 @@ TransactionFrame::getFullHash() const
 {
     if (isZero(mFullHash))
     {
-        mFullHash = sha256(xdr::xdr_to_opaque(mEnvelope));
+        mFullHash = xdrSha256(mEnvelope);
     }
     return (mFullHash);
 }
@@ -64,8 +101,7 @@ TransactionFrame::getContentsHash() const
 {
     if (isZero(mContentsHash))
     {
-        mContentsHash = sha256(
-            xdr::xdr_to_opaque(mNetworkID, ENVELOPE_TYPE_TX, mEnvelope.tx));
+        mContentsHash = xdrSha256(mNetworkID, ENVELOPE_TYPE_TX, mEnvelope.tx);
     }
     return (mContentsHash);
 }
@@ -76,6 +112,7 @@ TransactionFrame::clearCached()
     Hash zero;
     mContentsHash = zero;
     mFullHash = zero;
+    mSignatureVerifications.clear();
 }
 
 TransactionResultPair
@@ -93,6 +130,14 @@ TransactionFrame::getEnvelope() const
     return mEnvelope;
 }
 
+size_t
+TransactionFrame::getMemoryUsage() const
+{
+    // the operation frames, with their shared_ptr control blocks
+    return sizeof(*this) + xdr::xdr_size(mEnvelope) + xdr::xdr_size(mResult) +
+           mOperations.size() * (sizeof(OperationFrame) + 4 * sizeof(void*));
+}
+
 TransactionEnvelope&
 TransactionFrame::getEnvelope()
 {
@@ -114,7 +159,9 @@ TransactionFrame::getFee() const
 int64_t
 TransactionFrame::getMinFee(LedgerManager const& lm) const
 {
-    size_t count = mOperations.size();
+    // from the envelope, so that it does not depend on the operations having
+    // been built yet
+    size_t count = mEnvelope.tx.operations.size();
 
     if (count == 0)
     {
@@ -136,6 +183,8 @@ void
 TransactionFrame::addSignature(DecoratedSignature const& signature)
 {
     mEnvelope.signatures.push_back(signature);
+    // the full hash covers the signatures
+    mFullHash = Hash{};
 }
 
 bool
@@ -397,20 +446,69 @@ TransactionFrame::commonValid(SignatureChecker& signatureChecker,
     return ValidationType::kFullyValid;
 }
 
+void
+TransactionFrame::preverifySignatures() const
+{
+    std::vector<PubKeyUtils::SigToVerify> sigs;
+    getSignaturesToVerify(sigs);
+    PubKeyUtils::verifySigBatch(sigs);
+}
+
+void
+TransactionFrame::getSignaturesToVerify(
+    std::vector<PubKeyUtils::SigToVerify>& sigs) const
+{
+    assert(!isZero(mContentsHash));
+
+    // keys are referred to by the result: point into the envelope
+    std::vector<AccountID const*> keys{&mEnvelope.tx.sourceAccount};
+    for (auto const& op : mEnvelope.tx.operations)
+    {
+        if (op.sourceAccount &&
+            std::find_if(keys.begin(), keys.end(), [&](AccountID const* k) {
+                return *k == *op.sourceAccount;
+            }) == keys.end())
+        {
+            keys.emplace_back(op.sourceAccount.get());
+        }
+    }
+
+    for (auto const& sig : mEnvelope.signatures)
+    {
+        for (auto key : keys)
+        {
+            if (SignatureUtils::doesHintMatch(key->ed25519(), sig.hint))
+            {
+                sigs.emplace_back(PubKeyUtils::SigToVerify{
+                    *key, sig.signature, ByteSlice(mContentsHash)});
+            }
+        }
+    }
+}
+
 void
 TransactionFrame::processFeeSeqNum(LedgerDelta& delta,
                                    LedgerManager& ledgerManager)
 {
-    resetSigningAccount();
-    resetResults();
-
-    if (!loadAccount(ledgerManager.getCurrentLedgerVersion(), &delta,
-                     ledgerManager.getDatabase()))
+    auto account = AccountFrame::loadAccount(getSourceID(),
+                                             ledgerManager.getDatabase());
+    if (!account)
     {
         throw std::runtime_error("Unexpected database state");
     }
+    processFeeSeqNum(account, delta, ledgerManager);
+    account->storeChange(delta, ledgerManager.getDatabase());
+}
+
+void
+TransactionFrame::processFeeSeqNum(AccountFrame::pointer account,
+                                   LedgerDelta& delta,
+                                   LedgerManager& ledgerManager)
+{
+    resetResults();
+    delta.recordEntry(*account);
+    mSigningAccount = account;
 
-    Database& db = ledgerManager.getDatabase();
     int64_t& fee = getResult().feeCharged;
 
     if (fee > 0)
@@ -433,7 +531,8 @@ TransactionFrame::processFeeSeqNum(LedgerDelta& delta,
         }
         mSigningAccount->setSeqNum(mEnvelope.tx.seqNum);
     }
-    mSigningAccount->storeChange(delta, db);
+    mSigningAccount->touch(delta);
+    delta.modEntry(*mSigningAccount);
 }
 
 void
@@ -502,11 +601,12 @@ TransactionFrame::removeAccountSigner(const AccountFrame::pointer& account,
 bool
 TransactionFrame::checkValid(Application& app, SequenceNumber current)
 {
+    TRACE_ZONE("TransactionFrame::checkValid");
     resetSigningAccount();
     resetResults();
     SignatureChecker signatureChecker{
         app.getLedgerManager().getCurrentLedgerVersion(), getContentsHash(),
-        mEnvelope.signatures};
+        mEnvelope.signatures, &mSignatureVerifications};
     bool res = commonValid(signatureChecker, app, nullptr, current) ==
                ValidationType::kFullyValid;
     if (res)
@@ -565,13 +665,12 @@ TransactionFrame::markResultFailed()
 bool
 TransactionFrame::apply(LedgerDelta& delta, Application& app)
 {
-    TransactionMeta tm(1);
-    return apply(delta, tm.v1(), app);
+    return apply(delta, nullptr, app);
 }
 
 bool
 TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
-                                  LedgerDelta& delta, TransactionMetaV1& meta,
+                                  LedgerDelta& delta, TransactionMetaV1* meta,
                                   Application& app)
 {
     bool errorEncountered = false;
@@ -584,10 +683,12 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
 
         auto& opTimer =
             app.getMetrics().NewTimer({"transaction", "op", "apply"});
+        auto& profiler = app.getLedgerManager().getApplyProfiler();
 
         for (auto& op : mOperations)
         {
             auto time = opTimer.TimeScope();
+            auto queries = profiler.getQueryCount();
             LedgerDelta opDelta(thisTxOpsDelta);
             bool txRes = op->apply(signatureChecker, opDelta, app);
 
@@ -597,11 +698,19 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
             }
             if (!errorEncountered)
             {
+                auto span =
+                    app.getLedgerManager().getCloseTracer().span("invariants");
                 app.getInvariantManager().checkOnOperationApply(
-                    op->getOperation(), op->getResult(), opDelta);
+                    op->getOperation(), op->getResult(), opDelta,
+                    getContentsHash());
+            }
+            if (meta)
+            {
+                meta->operations.emplace_back(opDelta.getChanges());
             }
-            meta.operations.emplace_back(opDelta.getChanges());
             opDelta.commit();
+            profiler.recordOperation(op->getOperation().body.type(),
+                                     time.Stop(), queries);
         }
 
         if (!errorEncountered)
@@ -629,7 +738,10 @@ TransactionFrame::applyOperations(SignatureChecker& signatureChecker,
 
     if (errorEncountered)
     {
-        meta.operations.clear();
+        if (meta)
+        {
+            meta->operations.clear();
+        }
         markResultFailed();
     }
 
@@ -640,10 +752,18 @@ bool
 TransactionFrame::apply(LedgerDelta& delta, TransactionMetaV1& meta,
                         Application& app)
 {
+    return apply(delta, &meta, app);
+}
+
+bool
+TransactionFrame::apply(LedgerDelta& delta, TransactionMetaV1* meta,
+                        Application& app)
+{
+    TRACE_ZONE("TransactionFrame::apply");
     resetSigningAccount();
     SignatureChecker signatureChecker{
         app.getLedgerManager().getCurrentLedgerVersion(), getContentsHash(),
-        mEnvelope.signatures};
+        mEnvelope.signatures, &mSignatureVerifications};
 
     bool valid;
     {
@@ -659,13 +779,119 @@ TransactionFrame::apply(LedgerDelta& delta, TransactionMetaV1& meta,
         auto signaturesValid =
             cv >= (ValidationType::kInvalidPostAuth) &&
             processSignatures(signatureChecker, app, txDelta);
-        meta.txChanges = txDelta.getChanges();
+        if (meta)
+        {
+            meta->txChanges = txDelta.getChanges();
+        }
         txDelta.commit();
         valid = signaturesValid && (cv == ValidationType::kFullyValid);
     }
     return valid && applyOperations(signatureChecker, delta, meta, app);
 }
 
+namespace
+{
+void
+insertAccountKey(std::set<LedgerKey, LedgerEntryIdCmp>& keys,
+                 AccountID const& id)
+{
+    LedgerKey k;
+    k.type(ACCOUNT);
+    k.account().accountID = id;
+    keys.insert(k);
+}
+
+void
+insertTrustLineKey(std::set<LedgerKey, LedgerEntryIdCmp>& keys,
+                   AccountID const& id, Asset const& asset)
+{
+    if (asset.type() == ASSET_TYPE_NATIVE || id == getIssuer(asset))
+    {
+        return;
+    }
+    LedgerKey k;
+    k.type(TRUSTLINE);
+    k.trustLine().accountID = id;
+    k.trustLine().asset = asset;
+    keys.insert(k);
+}
+}
+
+void
+TransactionFrame::insertLedgerKeysToPrefetch(
+    std::set<LedgerKey, LedgerEntryIdCmp>& keys) const
+{
+    insertAccountKey(keys, getSourceID());
+    for (auto const& op : mEnvelope.tx.operations)
+    {
+        auto const& source =
+            op.sourceAccount ? *op.sourceAccount : getSourceID();
+        insertAccountKey(keys, source);
+
+        auto const& body = op.body;
+        switch (body.type())
+        {
+        case CREATE_ACCOUNT:
+            insertAccountKey(keys, body.createAccountOp().destination);
+            break;
+        case PAYMENT:
+        {
+            auto const& pay = body.paymentOp();
+            insertAccountKey(keys, pay.destination);
+            insertTrustLineKey(keys, source, pay.asset);
+            insertTrustLineKey(keys, pay.destination, pay.asset);
+            break;
+        }
+        case PATH_PAYMENT:
+        {
+            auto const& pp = body.pathPaymentOp();
+            insertAccountKey(keys, pp.destination);
+            insertTrustLineKey(keys, source, pp.sendAsset);
+            insertTrustLineKey(keys, pp.destination, pp.destAsset);
+            break;
+        }
+        case MANAGE_OFFER:
+            insertTrustLineKey(keys, source, body.manageOfferOp().selling);
+            insertTrustLineKey(keys, source, body.manageOfferOp().buying);
+            break;
+        case CREATE_PASSIVE_OFFER:
+            insertTrustLineKey(keys, source,
+                               body.createPassiveOfferOp().selling);
+            insertTrustLineKey(keys, source,
+                               body.createPassiveOfferOp().buying);
+            break;
+        case CHANGE_TRUST:
+            insertTrustLineKey(keys, source, body.changeTrustOp().line);
+            break;
+        case ALLOW_TRUST:
+        {
+            auto const& at = body.allowTrustOp();
+            insertAccountKey(keys, at.trustor);
+            Asset asset;
+            if (at.asset.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
+            {
+                asset.type(ASSET_TYPE_CREDIT_ALPHANUM4);
+                asset.alphaNum4().assetCode = at.asset.assetCode4();
+                asset.alphaNum4().issuer = source;
+            }
+            else
+            {
+                asset.type(ASSET_TYPE_CREDIT_ALPHANUM12);
+                asset.alphaNum12().assetCode = at.asset.assetCode12();
+                asset.alphaNum12().issuer = source;
+            }
+            insertTrustLineKey(keys, at.trustor, asset);
+            break;
+        }
+        case ACCOUNT_MERGE:
+            insertAccountKey(keys, body.destination());
+            break;
+        default:
+            break;
+        }
+    }
+}
+
 StellarMessage
 TransactionFrame::toStellarMessage() const
 {
@@ -678,84 +904,91 @@ TransactionFrame::toStellarMessage() const
 void
 TransactionFrame::storeTransaction(LedgerManager& ledgerManager,
                                    TransactionMeta& tm, int txindex,
-                                   TransactionResultSet& resultSet) const
+                                   TransactionResultSet& resultSet,
+                                   BatchInserter& txHistory) const
 {
     auto txBytes(xdr::xdr_to_opaque(mEnvelope));
 
     resultSet.results.emplace_back(getResultPair());
     auto txResultBytes(xdr::xdr_to_opaque(resultSet.results.back()));
 
-    std::string txBody;
-    txBody = decoder::encode_b64(txBytes);
-
-    std::string txResult;
-    txResult = decoder::encode_b64(txResultBytes);
+    auto& db = ledgerManager.getDatabase();
+    std::string txBody = encodeHistoryValue(db, txBytes);
+    std::string txResult = encodeHistoryValue(db, txResultBytes);
 
     xdr::opaque_vec<> txMeta(xdr::xdr_to_opaque(tm));
-
-    std::string meta;
-    meta = decoder::encode_b64(txMeta);
+    std::string meta = encodeHistoryValue(db, txMeta);
 
     string txIDString(binToHex(getContentsHash()));
 
-    auto& db = ledgerManager.getDatabase();
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txhistory "
-        "( txid, ledgerseq, txindex,  txbody, txresult, txmeta) VALUES "
-        "(:id,  :seq,      :txindex, :txb,   :txres,   :meta)");
-
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerManager.getCurrentLedgerHeader().ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txBody));
-    st.exchange(soci::use(txResult));
-    st.exchange(soci::use(meta));
-    st.define_and_bind();
-    {
-        auto timer = db.getInsertTimer("txhistory");
-        st.execute(true);
-    }
-
-    if (st.get_affected_rows() != 1)
-    {
-        throw std::runtime_error("Could not update data in SQL");
-    }
+    txHistory.addRow(
+        {txIDString,
+         std::to_string(ledgerManager.getCurrentLedgerHeader().ledgerSeq),
+         std::to_string(txindex), txBody, txResult, meta});
 }
 
 void
 TransactionFrame::storeTransactionFee(LedgerManager& ledgerManager,
                                       LedgerEntryChanges const& changes,
-                                      int txindex) const
+                                      int txindex,
+                                      BatchInserter& txFeeHistory) const
 {
     xdr::opaque_vec<> txChanges(xdr::xdr_to_opaque(changes));
 
-    std::string txChanges64;
-    txChanges64 = decoder::encode_b64(txChanges);
+    std::string txChanges64 =
+        encodeHistoryValue(ledgerManager.getDatabase(), txChanges);
 
     string txIDString(binToHex(getContentsHash()));
 
-    auto& db = ledgerManager.getDatabase();
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO txfeehistory "
-        "( txid, ledgerseq, txindex,  txchanges) VALUES "
-        "(:id,  :seq,      :txindex, :txchanges)");
+    txFeeHistory.addRow(
+        {txIDString,
+         std::to_string(ledgerManager.getCurrentLedgerHeader().ledgerSeq),
+         std::to_string(txindex), txChanges64});
+}
 
-    auto& st = prep.statement();
-    st.exchange(soci::use(txIDString));
-    st.exchange(soci::use(ledgerManager.getCurrentLedgerHeader().ledgerSeq));
-    st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txChanges64));
-    st.define_and_bind();
+BatchInserter
+TransactionFrame::makeTxHistoryInserter(Database& db)
+{
+    return BatchInserter(
+        db, "txhistory",
+        {"txid", "ledgerseq", "txindex", "txbody", "txresult", "txmeta"});
+}
+
+BatchInserter
+TransactionFrame::makeTxFeeHistoryInserter(Database& db)
+{
+    return BatchInserter(db, "txfeehistory",
+                         {"txid", "ledgerseq", "txindex", "txchanges"});
+}
+
+static char const COMPRESSED_HISTORY_MARK = '~';
+
+std::string
+TransactionFrame::encodeHistoryValue(Database& db,
+                                     xdr::opaque_vec<> const& bytes)
+{
+    if (!db.compressesTxHistory())
     {
-        auto timer = db.getInsertTimer("txfeehistory");
-        st.execute(true);
+        return decoder::encode_b64(bytes);
     }
+    std::vector<uint8_t> compressed;
+    gz::compressBytes(bytes.data(), bytes.size(), compressed);
+    return COMPRESSED_HISTORY_MARK + decoder::encode_b64(compressed);
+}
 
-    if (st.get_affected_rows() != 1)
+void
+TransactionFrame::decodeHistoryValue(std::string const& value,
+                                     std::vector<uint8_t>& bytes)
+{
+    if (value.empty() || value[0] != COMPRESSED_HISTORY_MARK)
     {
-        throw std::runtime_error("Could not update data in SQL");
+        decoder::decode_b64(value, bytes);
+        return;
     }
+    std::vector<uint8_t> compressed;
+    decoder::decode_b64(value.begin() + 1, value.end(),
+                        std::back_inserter(compressed));
+    gz::decompressBytes(compressed.data(), compressed.size(), bytes);
 }
 
 static void
@@ -798,7 +1031,7 @@ TransactionFrame::getTransactionHistoryResults(Database& db, uint32 ledgerSeq)
     while (st.got_data())
     {
         std::vector<uint8_t> result;
-        decoder::decode_b64(txresult64, result);
+        decodeHistoryValue(txresult64, result);
 
         res.results.emplace_back();
         TransactionResultPair& p = res.results.back();
@@ -828,7 +1061,7 @@ TransactionFrame::getTransactionFeeMeta(Database& db, uint32 ledgerSeq)
     while (st.got_data())
     {
         std::vector<uint8_t> changesRaw;
-        decoder::decode_b64(changes64, changesRaw);
+        decodeHistoryValue(changes64, changesRaw);
 
         xdr::xdr_get g1(&changesRaw.front(), &changesRaw.back() + 1);
         res.emplace_back();
@@ -886,10 +1119,10 @@ TransactionFrame::copyTransactionsToStream(Hash const& networkID, Database& db,
         }
 
         std::vector<uint8_t> body;
-        decoder::decode_b64(txBody, body);
+        decodeHistoryValue(txBody, body);
 
         std::vector<uint8_t> result;
-        decoder::decode_b64(txResult, result);
+        decodeHistoryValue(txResult, result);
 
         xdr::xdr_get g1(&body.front(), &body.back() + 1);
         xdr_argpack_archive(g1, tx);
@@ -948,13 +1181,14 @@ TransactionFrame::dropAll(Database& db)
     db.getSession() << "CREATE INDEX histfeebyseq ON txfeehistory (ledgerseq);";
 }
 
-void
-TransactionFrame::deleteOldEntries(Database& db, uint32_t ledgerSeq,
+bool
+TransactionFrame::deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
                                    uint32_t count)
 {
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "txhistory", "ledgerseq");
-    DatabaseUtils::deleteOldEntriesHelper(db.getSession(), ledgerSeq, count,
-                                          "txfeehistory", "ledgerseq");
+    bool done = DatabaseUtils::deleteOldEntriesHelper(sess, ledgerSeq, count,
+                                                      "txhistory", "ledgerseq");
+    done &= DatabaseUtils::deleteOldEntriesHelper(sess, ledgerSeq, count,
+                                                  "txfeehistory", "ledgerseq");
+    return done;
 }
 }
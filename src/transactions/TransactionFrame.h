@@ -4,8 +4,10 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "crypto/SecretKey.h"
 #include "ledger/AccountFrame.h"
 #include "overlay/StellarXDR.h"
+#include "transactions/SignatureChecker.h"
 #include "util/types.h"
 
 #include <memory>
@@ -23,10 +25,10 @@ We can get it in from the DB or from the wire
 namespace stellar
 {
 class Application;
+class BatchInserter;
 class OperationFrame;
 class LedgerDelta;
 class SecretKey;
-class SignatureChecker;
 class XDROutputFileStream;
 class SHA256;
 
@@ -45,6 +47,10 @@ class TransactionFrame
     Hash const& mNetworkID;     // used to change the way we compute signatures
     mutable Hash mContentsHash; // the hash of the contents
     mutable Hash mFullHash;     // the hash of the contents and the sig.
+    // signature checks already done against mContentsHash, kept as the
+    // transaction is validated several times (when received, nominated and
+    // applied)
+    SignatureVerifications mSignatureVerifications;
 
     std::vector<std::shared_ptr<OperationFrame>> mOperations;
 
@@ -81,7 +87,9 @@ class TransactionFrame
     void markResultFailed();
 
     bool applyOperations(SignatureChecker& checker, LedgerDelta& delta,
-                         TransactionMetaV1& meta, Application& app);
+                         TransactionMetaV1* meta, Application& app);
+    // meta is only computed if not null
+    bool apply(LedgerDelta& delta, TransactionMetaV1* meta, Application& app);
 
     void processSeqNum(LedgerManager& lm, LedgerDelta& delta);
     bool processSignatures(SignatureChecker& signatureChecker, Application& app,
@@ -93,9 +101,14 @@ class TransactionFrame
     TransactionFrame(TransactionFrame const&) = delete;
     TransactionFrame() = delete;
 
+    // also computes the hashes, so that they can be used from other threads
     static TransactionFramePtr
     makeTransactionFromWire(Hash const& networkID,
                             TransactionEnvelope const& msg);
+    // same for several envelopes, hashed together (see sha256Multi)
+    static std::vector<TransactionFramePtr>
+    makeTransactionsFromWire(Hash const& networkID,
+                             xdr::xvector<TransactionEnvelope> const& msgs);
 
     Hash const& getFullHash() const;
     Hash const& getContentsHash() const;
@@ -128,6 +141,9 @@ class TransactionFrame
     TransactionEnvelope const& getEnvelope() const;
     TransactionEnvelope& getEnvelope();
 
+    // estimate of the memory held by the frame, see MemoryUsage
+    size_t getMemoryUsage() const;
+
     SequenceNumber
     getSeqNum() const
     {
@@ -161,30 +177,67 @@ class TransactionFrame
 
     bool checkValid(Application& app, SequenceNumber current);
 
+    // verify the signatures made by the master keys of the source accounts
+    // of this transaction and of its operations, so that checkValid finds
+    // the results in the process-wide signature cache. Only reads the
+    // envelope, so it can run on a worker thread as long as
+    // getContentsHash() was called beforehand.
+    void preverifySignatures() const;
+    // the signature checks done by preverifySignatures, to batch them with
+    // those of other transactions
+    void getSignaturesToVerify(
+        std::vector<PubKeyUtils::SigToVerify>& sigs) const;
+
     // collect fee, consume sequence number
     void processFeeSeqNum(LedgerDelta& delta, LedgerManager& ledgerManager);
 
+    // same, on @p account, the source account as left by the transactions
+    // processed before this one: the change is recorded in @p delta but
+    // storing @p account is left to the caller
+    void processFeeSeqNum(AccountFrame::pointer account, LedgerDelta& delta,
+                          LedgerManager& ledgerManager);
+
     // apply this transaction to the current ledger
     // returns true if successfully applied
     bool apply(LedgerDelta& delta, TransactionMetaV1& meta, Application& app);
 
-    // version without meta
+    // version without meta (which is then not computed at all)
     bool apply(LedgerDelta& delta, Application& app);
 
     StellarMessage toStellarMessage() const;
 
+    // insert the keys of the ledger entries this transaction is expected to
+    // load when applied (source accounts, destinations and trust lines) so
+    // that they can be loaded from the database in bulk ahead of time
+    void insertLedgerKeysToPrefetch(
+        std::set<LedgerKey, LedgerEntryIdCmp>& keys) const;
+
     AccountFrame::pointer loadAccount(int ledgerProtocolVersion,
                                       LedgerDelta* delta, Database& app,
                                       AccountID const& accountID);
 
-    // transaction history
+    // transaction history, added to `txHistory` (see makeTxHistoryInserter)
     void storeTransaction(LedgerManager& ledgerManager, TransactionMeta& tm,
-                          int txindex, TransactionResultSet& resultSet) const;
+                          int txindex, TransactionResultSet& resultSet,
+                          BatchInserter& txHistory) const;
 
-    // fee history
+    // fee history, added to `txFeeHistory` (see makeTxFeeHistoryInserter)
     void storeTransactionFee(LedgerManager& ledgerManager,
-                             LedgerEntryChanges const& changes,
-                             int txindex) const;
+                             LedgerEntryChanges const& changes, int txindex,
+                             BatchInserter& txFeeHistory) const;
+
+    // the inserters the history of the transactions of a ledger is
+    // buffered into, and written from when the ledger is closed
+    static BatchInserter makeTxHistoryInserter(Database& db);
+    static BatchInserter makeTxFeeHistoryInserter(Database& db);
+
+    // XDR values of the history tables: base64, of the compressed XDR with
+    // COMPRESS_TX_HISTORY (marked by a leading '~', so that both kinds of
+    // rows are read)
+    static std::string encodeHistoryValue(Database& db,
+                                          xdr::opaque_vec<> const& bytes);
+    static void decodeHistoryValue(std::string const& value,
+                                   std::vector<uint8_t>& bytes);
 
     // access to history tables
     static TransactionResultSet getTransactionHistoryResults(Database& db,
@@ -204,7 +257,7 @@ class TransactionFrame
                                            XDROutputFileStream& txResultOut);
     static void dropAll(Database& db);
 
-    static void deleteOldEntries(Database& db, uint32_t ledgerSeq,
+    static bool deleteOldEntries(soci::session& sess, uint32_t ledgerSeq,
                                  uint32_t count);
 };
 }
@@ -2,14 +2,18 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "crypto/ByteSlice.h"
 #include "crypto/Hex.h"
 #include "crypto/Random.h"
+#include "crypto/SHA.h"
 #include "crypto/SignerKey.h"
 #include "crypto/SignerKeyUtils.h"
 #include "ledger/LedgerManager.h"
 #include "lib/catch.hpp"
 #include "lib/json/json.h"
 #include "main/Application.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "test/TestAccount.h"
 #include "test/TestExceptions.h"
 #include "test/TestUtils.h"
@@ -20,6 +24,7 @@
 #include "transactions/MergeOpFrame.h"
 #include "transactions/PaymentOpFrame.h"
 #include "transactions/SetOptionsOpFrame.h"
+#include "transactions/SignatureChecker.h"
 #include "transactions/SignatureUtils.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
@@ -1365,3 +1370,120 @@ TEST_CASE("txenvelope", "[tx][envelope]")
         }
     }
 }
+
+TEST_CASE("signature checks are kept by the transaction", "[tx][envelope]")
+{
+    VirtualClock clock;
+    auto app = createTestApplication(clock, getTestConfig());
+    app->start();
+
+    auto root = TestAccount::createRoot(*app);
+    auto a1 = TestAccount{*app, getAccount("A")};
+    auto b1 = TestAccount{*app, getAccount("B")};
+    auto& total =
+        app->getMetrics().NewMeter({"crypto", "verify", "total"}, "signature");
+
+    auto tx = root.tx({createAccount(a1.getPublicKey(), 1000000000)});
+    tx->addSignature(b1);
+    auto before = total.count();
+    REQUIRE(!tx->checkValid(*app, 0));
+    REQUIRE(tx->getResultCode() == txBAD_AUTH_EXTRA);
+    auto checked = total.count() - before;
+    REQUIRE(checked > 0);
+
+    // validating again finds the results in the transaction
+    before = total.count();
+    REQUIRE(!tx->checkValid(*app, 0));
+    REQUIRE(tx->getResultCode() == txBAD_AUTH_EXTRA);
+    REQUIRE(total.count() == before);
+
+    // nor when changing another signature
+    tx->getEnvelope().signatures.pop_back();
+    tx->addSignature(
+        SignatureUtils::sign(getAccount("C"), tx->getContentsHash()));
+    REQUIRE(!tx->checkValid(*app, 0));
+    REQUIRE(tx->getResultCode() == txBAD_AUTH_EXTRA);
+    REQUIRE(total.count() == before);
+}
+
+TEST_CASE("signature checker matches signatures to signers by hint",
+          "[tx][envelope]")
+{
+    auto contentsHash = sha256("contents");
+    auto a = getAccount("A");
+    auto b = getAccount("B");
+    auto c = getAccount("C");
+    auto d = getAccount("D");
+    auto sigA = SignatureUtils::sign(a, contentsHash);
+    auto sigB = SignatureUtils::sign(b, contentsHash);
+
+    xdr::xvector<DecoratedSignature, 20> signatures;
+    std::vector<Signer> signers;
+
+    // whether the signatures reach the weight, and which of them were used,
+    // the same whether verifications are kept or not
+    auto check = [&](int32_t neededWeight, std::vector<bool>& used) {
+        auto version = Config::CURRENT_LEDGER_PROTOCOL_VERSION;
+        SignatureChecker checker{version, contentsHash, signatures};
+        auto res =
+            checker.checkSignature(a.getPublicKey(), signers, neededWeight);
+        used = checker.usedSignatures();
+
+        SignatureVerifications verifications;
+        SignatureChecker keeping{version, contentsHash, signatures,
+                                 &verifications};
+        REQUIRE(keeping.checkSignature(a.getPublicKey(), signers,
+                                       neededWeight) == res);
+        bool sameUsed = keeping.usedSignatures() == used;
+        REQUIRE(sameUsed);
+        return res;
+    };
+    std::vector<bool> used;
+
+    SECTION("signers sharing a hint")
+    {
+        // not a key of anybody, only its hint is that of A
+        Signer twin;
+        twin.key.type(SIGNER_KEY_TYPE_ED25519);
+        twin.key.ed25519() = a.getPublicKey().ed25519();
+        twin.key.ed25519()[0] ^= 1;
+        twin.weight = 1;
+        signers = {twin, makeSigner(a, 2)};
+
+        // signed by B with the hint of A, verifies against neither
+        auto forged = sigB;
+        forged.hint = sigA.hint;
+        signatures.push_back(forged);
+        signatures.push_back(sigA);
+
+        REQUIRE(check(2, used));
+        REQUIRE(!check(3, used));
+        REQUIRE(used.size() == 2);
+        REQUIRE(!used[0]);
+        REQUIRE(used[1]);
+    }
+
+    SECTION("hash-x, ed25519 and unknown signatures")
+    {
+        auto x = std::string("preimage");
+        Signer hashX;
+        hashX.key = SignerKeyUtils::hashXKey(x);
+        hashX.weight = 1;
+        signers = {hashX, makeSigner(a, 2), makeSigner(b, 4),
+                   makeSigner(c, 8)};
+
+        signatures.push_back(sigA);
+        signatures.push_back(SignatureUtils::signHashX(x));
+        // D is not a signer, nor has the hint of one
+        signatures.push_back(SignatureUtils::sign(d, contentsHash));
+        signatures.push_back(sigB);
+
+        REQUIRE(check(7, used));
+        REQUIRE(!check(8, used));
+        REQUIRE(used.size() == 4);
+        REQUIRE(used[0]);
+        REQUIRE(used[1]);
+        REQUIRE(!used[2]);
+        REQUIRE(used[3]);
+    }
+}
@@ -0,0 +1,141 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Allocator.h"
+#include "lib/util/format.h"
+#include "util/Logging.h"
+
+#ifdef USE_JEMALLOC
+#include <jemalloc/jemalloc.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace stellar
+{
+
+namespace allocator
+{
+
+#ifdef USE_JEMALLOC
+
+namespace
+{
+template <typename T>
+bool
+readCtl(std::string const& name, T& value)
+{
+    size_t size = sizeof(T);
+    return mallctl(name.c_str(), &value, &size, nullptr, 0) == 0;
+}
+}
+
+char const*
+name()
+{
+    return "jemalloc";
+}
+
+Json::Value
+getStats()
+{
+    Json::Value res;
+
+    // the statistics are a snapshot taken when the epoch changes
+    uint64_t epoch = 1;
+    size_t size = sizeof(epoch);
+    mallctl("epoch", &epoch, &size, &epoch, size);
+
+    for (auto const& stat : {"allocated", "active", "metadata", "resident",
+                             "mapped", "retained"})
+    {
+        size_t bytes = 0;
+        if (readCtl(fmt::format("stats.{}", stat), bytes))
+        {
+            res["bytes"][stat] = static_cast<Json::UInt64>(bytes);
+        }
+    }
+
+    unsigned narenas = 0;
+    size_t pageSize = 0;
+    readCtl("arenas.narenas", narenas);
+    readCtl("arenas.page", pageSize);
+    res["page_size"] = static_cast<Json::UInt64>(pageSize);
+    for (unsigned i = 0; i < narenas; ++i)
+    {
+        size_t active = 0;
+        size_t dirty = 0;
+        if (!readCtl(fmt::format("stats.arenas.{}.pactive", i), active) ||
+            !readCtl(fmt::format("stats.arenas.{}.pdirty", i), dirty))
+        {
+            continue;
+        }
+        Json::Value arena;
+        arena["index"] = i;
+        arena["active_pages"] = static_cast<Json::UInt64>(active);
+        arena["dirty_pages"] = static_cast<Json::UInt64>(dirty);
+        res["arenas"].append(arena);
+    }
+    return res;
+}
+
+void
+purge()
+{
+#ifdef MALLCTL_ARENAS_ALL
+    auto ctl = fmt::format("arena.{}.purge", MALLCTL_ARENAS_ALL);
+#else
+    unsigned narenas = 0;
+    readCtl("arenas.narenas", narenas);
+    auto ctl = fmt::format("arena.{}.purge", narenas);
+#endif
+    if (mallctl(ctl.c_str(), nullptr, nullptr, nullptr, 0) != 0)
+    {
+        CLOG(WARNING, "Process") << "Could not purge the jemalloc arenas";
+    }
+}
+
+#else
+
+char const*
+name()
+{
+    return "system";
+}
+
+Json::Value
+getStats()
+{
+    Json::Value res;
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    auto mi = mallinfo2();
+#else
+    // the counters of mallinfo wrap around at 2GB
+    auto mi = mallinfo();
+#endif
+    res["bytes"]["arena"] = static_cast<Json::UInt64>(mi.arena);
+    res["bytes"]["mmapped"] = static_cast<Json::UInt64>(mi.hblkhd);
+    res["bytes"]["allocated"] = static_cast<Json::UInt64>(mi.uordblks);
+    res["bytes"]["free"] = static_cast<Json::UInt64>(mi.fordblks);
+    res["bytes"]["releasable"] = static_cast<Json::UInt64>(mi.keepcost);
+#endif
+    return res;
+}
+
+void
+purge()
+{
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+#endif
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+
+// The heap allocator the process runs on: the system malloc, or jemalloc in
+// builds configured with --enable-jemalloc (USE_JEMALLOC), whose per-thread
+// caches and arenas keep the merges of the worker threads from fragmenting
+// the heap of the main thread.
+//
+// The allocator route exports the statistics of either allocator and can
+// give the free pages back to the system, which purge also does after a
+// catchup, so that the resident size does not stay at its peak.
+
+namespace stellar
+{
+
+namespace allocator
+{
+
+// "jemalloc" or "system"
+char const* name();
+
+// Bytes allocated, resident... as the allocator counts them, and for
+// jemalloc the active and dirty pages of every arena; empty when the
+// system allocator has no statistics.
+Json::Value getStats();
+
+// Gives the pages freed but still mapped back to the system.
+void purge();
+}
+}
@@ -0,0 +1,36 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Allocator.h"
+
+#include "lib/catch.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace stellar;
+
+TEST_CASE("allocator stats and purge", "[allocator]")
+{
+    auto before = allocator::getStats();
+    {
+        std::vector<std::unique_ptr<char[]>> blocks;
+        for (int i = 0; i < 1000; i++)
+        {
+            blocks.emplace_back(new char[4096]);
+        }
+        auto during = allocator::getStats();
+        if (during.isMember("bytes"))
+        {
+            REQUIRE(during["bytes"]["allocated"].asUInt64() >=
+                    1000 * 4096);
+        }
+    }
+    allocator::purge();
+    auto after = allocator::getStats();
+    REQUIRE(before.isMember("bytes") == after.isMember("bytes"));
+    REQUIRE((std::string(allocator::name()) == "jemalloc" ||
+             std::string(allocator::name()) == "system"));
+}
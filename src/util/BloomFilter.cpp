@@ -0,0 +1,73 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/BloomFilter.h"
+
+#include <sodium.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace stellar
+{
+
+namespace
+{
+struct ShortHashKey
+{
+    unsigned char mKey[crypto_shorthash_KEYBYTES];
+
+    ShortHashKey()
+    {
+        randombytes_buf(mKey, sizeof(mKey));
+    }
+};
+}
+
+uint64_t
+BloomFilter::hash(ByteSlice const& bin)
+{
+    static ShortHashKey const key;
+    unsigned char out[crypto_shorthash_BYTES];
+    crypto_shorthash(out, bin.data(), bin.size(), key.mKey);
+    uint64_t res;
+    static_assert(sizeof(res) == sizeof(out), "unexpected shorthash size");
+    std::memcpy(&res, out, sizeof(res));
+    return res;
+}
+
+BloomFilter::BloomFilter(std::vector<uint64_t> const& hashes,
+                         size_t bitsPerElement)
+    : mBits((std::max<size_t>(hashes.size(), 1) * bitsPerElement + 63) / 64)
+    , mNumBits(mBits.size() * 64)
+{
+    for (auto h : hashes)
+    {
+        // double hashing: probe i is h1 + i * h2
+        uint64_t h1 = h & 0xFFFFFFFF;
+        uint64_t h2 = (h >> 32) | 1;
+        for (size_t i = 0; i < NUM_PROBES; i++)
+        {
+            auto bit = (h1 + i * h2) % mNumBits;
+            mBits[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+    }
+}
+
+bool
+BloomFilter::mayContain(uint64_t h) const
+{
+    uint64_t h1 = h & 0xFFFFFFFF;
+    uint64_t h2 = (h >> 32) | 1;
+    for (size_t i = 0; i < NUM_PROBES; i++)
+    {
+        auto bit = (h1 + i * h2) % mNumBits;
+        if ((mBits[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+}
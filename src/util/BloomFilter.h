@@ -0,0 +1,46 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/ByteSlice.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Immutable bloom filter over a set of 64-bit element hashes, as produced by
+ * `BloomFilter::hash`. Uses ~BITS_PER_ELEMENT bits per element by default,
+ * for a false positive rate just under 1% (about 0.02% with 20 bits).
+ *
+ * Element hashes are keyed with a random per-process key, so filters must not
+ * be persisted or shared between processes.
+ */
+class BloomFilter
+{
+    std::vector<uint64_t> mBits;
+    uint64_t mNumBits;
+
+  public:
+    static size_t const BITS_PER_ELEMENT = 10;
+    static size_t const NUM_PROBES = 7;
+
+    static uint64_t hash(ByteSlice const& bin);
+
+    explicit BloomFilter(std::vector<uint64_t> const& hashes,
+                         size_t bitsPerElement = BITS_PER_ELEMENT);
+
+    // False means the element is definitely absent.
+    bool mayContain(uint64_t hash) const;
+
+    size_t
+    getByteSize() const
+    {
+        return sizeof(*this) + mBits.capacity() * sizeof(uint64_t);
+    }
+};
+}
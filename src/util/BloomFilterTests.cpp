@@ -0,0 +1,59 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/BloomFilter.h"
+
+#include <string>
+
+using namespace stellar;
+
+TEST_CASE("bloom filter", "[bloom]")
+{
+    size_t const n = 10000;
+    std::vector<uint64_t> hashes;
+    for (size_t i = 0; i < n; i++)
+    {
+        hashes.push_back(BloomFilter::hash("in-" + std::to_string(i)));
+    }
+    BloomFilter filter(hashes);
+
+    for (auto h : hashes)
+    {
+        REQUIRE(filter.mayContain(h));
+    }
+
+    size_t falsePositives = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (filter.mayContain(BloomFilter::hash("out-" + std::to_string(i))))
+        {
+            falsePositives++;
+        }
+    }
+    // ~0.8% expected
+    REQUIRE(falsePositives < n / 50);
+
+    SECTION("more bits per element")
+    {
+        BloomFilter large(hashes, 20);
+        size_t largeFalsePositives = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            auto h = BloomFilter::hash("out-" + std::to_string(i));
+            REQUIRE(large.mayContain(hashes[i]));
+            if (large.mayContain(h))
+            {
+                largeFalsePositives++;
+            }
+        }
+        REQUIRE(largeFalsePositives < n / 500);
+    }
+
+    SECTION("empty filter")
+    {
+        BloomFilter empty(std::vector<uint64_t>{});
+        REQUIRE(!empty.mayContain(hashes[0]));
+    }
+}
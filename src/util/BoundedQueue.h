@@ -0,0 +1,82 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace stellar
+{
+
+/**
+ * Blocking single-producer / single-consumer hand-off queue holding at most
+ * `capacity` items, for connecting the stages of a pipeline running on
+ * separate threads.
+ *
+ * Either side may `close` the queue: the producer once it is done, so that
+ * the consumer drains what is left and then stops; the consumer to abandon
+ * the pipeline early, which makes any further `push` fail.
+ */
+template <typename T> class BoundedQueue : NonMovableOrCopyable
+{
+    std::mutex mMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+    std::deque<T> mItems;
+    size_t const mCapacity;
+    bool mClosed{false};
+
+  public:
+    explicit BoundedQueue(size_t capacity) : mCapacity(capacity)
+    {
+    }
+
+    // Blocks while the queue is full. Returns false, dropping `item`, if the
+    // queue has been closed.
+    bool
+    push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotFull.wait(lock,
+                      [&] { return mClosed || mItems.size() < mCapacity; });
+        if (mClosed)
+        {
+            return false;
+        }
+        mItems.emplace_back(std::move(item));
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty. Returns false once the queue is closed
+    // and drained.
+    bool
+    pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotEmpty.wait(lock, [&] { return mClosed || !mItems.empty(); });
+        if (mItems.empty())
+        {
+            return false;
+        }
+        item = std::move(mItems.front());
+        mItems.pop_front();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    void
+    close()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = true;
+        mNotEmpty.notify_all();
+        mNotFull.notify_all();
+    }
+};
+}
@@ -0,0 +1,426 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Hash map with open addressing: the entries live in one array, probed
+ * linearly, instead of one allocation per node as with std::map and
+ * std::unordered_map. Meant for the tables keyed by hashes (uint256) that
+ * the overlay and the herder hit on every message.
+ *
+ * Every slot keeps the hash of its key, with its high bit set (0 marks an
+ * empty slot), in an array of its own: probing mostly reads that array,
+ * and keys are only compared when the hashes match. Erasing shifts the
+ * entries that follow back, so there are no tombstones.
+ *
+ * Differences with std::unordered_map: keys and values must be default
+ * constructible, any insertion or erasure invalidates iterators and
+ * references, and erasing while iterating is done with eraseIf.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>>
+class FlatHashMap
+{
+  public:
+    typedef std::pair<K, V> value_type;
+
+    template <typename Map, typename Value> class Iterator
+    {
+        friend class FlatHashMap;
+        Map* mMap;
+        size_t mIndex;
+
+        void
+        skipEmpty()
+        {
+            while (mIndex < mMap->mHashes.size() && mMap->mHashes[mIndex] == 0)
+            {
+                mIndex++;
+            }
+        }
+
+      public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Value value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Value* pointer;
+        typedef Value& reference;
+
+        Iterator(Map* map, size_t index) : mMap(map), mIndex(index)
+        {
+        }
+
+        // iterator to const_iterator
+        template <typename OtherMap, typename OtherValue>
+        Iterator(Iterator<OtherMap, OtherValue> const& other)
+            : mMap(other.mMap), mIndex(other.mIndex)
+        {
+        }
+
+        Value& operator*() const
+        {
+            return mMap->mSlots[mIndex];
+        }
+        Value* operator->() const
+        {
+            return &mMap->mSlots[mIndex];
+        }
+        Iterator& operator++()
+        {
+            mIndex++;
+            skipEmpty();
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            auto res = *this;
+            ++*this;
+            return res;
+        }
+        bool
+        operator==(Iterator const& other) const
+        {
+            return mIndex == other.mIndex;
+        }
+        bool
+        operator!=(Iterator const& other) const
+        {
+            return mIndex != other.mIndex;
+        }
+
+        template <typename, typename> friend class Iterator;
+    };
+
+    typedef Iterator<FlatHashMap, value_type> iterator;
+    typedef Iterator<FlatHashMap const, value_type const> const_iterator;
+
+    static size_t const MIN_CAPACITY = 16;
+
+    FlatHashMap() = default;
+    explicit FlatHashMap(size_t size)
+    {
+        reserve(size);
+    }
+
+    size_t
+    size() const
+    {
+        return mSize;
+    }
+    bool
+    empty() const
+    {
+        return mSize == 0;
+    }
+    // number of slots, used or not
+    size_t
+    capacity() const
+    {
+        return mSlots.size();
+    }
+
+    iterator
+    begin()
+    {
+        iterator res(this, 0);
+        res.skipEmpty();
+        return res;
+    }
+    iterator
+    end()
+    {
+        return iterator(this, mHashes.size());
+    }
+    const_iterator
+    begin() const
+    {
+        const_iterator res(this, 0);
+        res.skipEmpty();
+        return res;
+    }
+    const_iterator
+    end() const
+    {
+        return const_iterator(this, mHashes.size());
+    }
+    const_iterator
+    cbegin() const
+    {
+        return begin();
+    }
+    const_iterator
+    cend() const
+    {
+        return end();
+    }
+
+    iterator
+    find(K const& key)
+    {
+        return iterator(this, findIndex(key));
+    }
+    const_iterator
+    find(K const& key) const
+    {
+        return const_iterator(this, findIndex(key));
+    }
+    size_t
+    count(K const& key) const
+    {
+        return findIndex(key) == mHashes.size() ? 0 : 1;
+    }
+
+    // inserts (key, value) if key is not in the map yet, returns the entry
+    // of key and whether it was inserted
+    std::pair<iterator, bool>
+    emplace(K const& key, V value)
+    {
+        auto hash = hashOf(key);
+        if (mSize != 0)
+        {
+            auto i = probe(key, hash);
+            if (mHashes[i] != 0)
+            {
+                return std::make_pair(iterator(this, i), false);
+            }
+        }
+        reserve(mSize + 1);
+        auto i = probe(key, hash);
+        mHashes[i] = hash;
+        mSlots[i].first = key;
+        mSlots[i].second = std::move(value);
+        mSize++;
+        return std::make_pair(iterator(this, i), true);
+    }
+
+    V& operator[](K const& key)
+    {
+        return emplace(key, V{}).first->second;
+    }
+
+    size_t
+    erase(K const& key)
+    {
+        auto i = findIndex(key);
+        if (i == mHashes.size())
+        {
+            return 0;
+        }
+        eraseAt(i);
+        return 1;
+    }
+
+    // erases the entries for which @p pred (called once on each of them)
+    // returns true, returns how many were erased
+    template <typename F>
+    size_t
+    eraseIf(F pred)
+    {
+        std::vector<size_t> hashes(mHashes.size(), 0);
+        std::vector<value_type> slots(mSlots.size());
+        hashes.swap(mHashes);
+        slots.swap(mSlots);
+        auto before = mSize;
+        mSize = 0;
+        for (size_t i = 0; i < hashes.size(); i++)
+        {
+            if (hashes[i] != 0 && !pred(slots[i]))
+            {
+                place(hashes[i], std::move(slots[i]));
+            }
+        }
+        return before - mSize;
+    }
+
+    void
+    clear()
+    {
+        mHashes.clear();
+        mSlots.clear();
+        mSize = 0;
+    }
+
+    // makes room for @p size entries without further allocation
+    void
+    reserve(size_t size)
+    {
+        if (fits(size, mHashes.size()))
+        {
+            return;
+        }
+        auto capacity = std::max(MIN_CAPACITY, mHashes.size());
+        while (!fits(size, capacity))
+        {
+            capacity *= 2;
+        }
+        rehash(capacity);
+    }
+
+  private:
+    static size_t const USED = size_t(1) << (sizeof(size_t) * 8 - 1);
+
+    std::vector<size_t> mHashes;
+    std::vector<value_type> mSlots;
+    size_t mSize{0};
+    Hash mHash;
+
+    // at most 3/4 of the slots are used
+    static bool
+    fits(size_t size, size_t capacity)
+    {
+        return size * 4 <= capacity * 3;
+    }
+
+    size_t
+    hashOf(K const& key) const
+    {
+        return mHash(key) | USED;
+    }
+
+    size_t
+    getMask() const
+    {
+        return mHashes.size() - 1;
+    }
+
+    // slot of key, or the empty slot where it would go; there must be at
+    // least one empty slot
+    size_t
+    probe(K const& key, size_t hash) const
+    {
+        auto mask = getMask();
+        for (auto i = hash & mask;; i = (i + 1) & mask)
+        {
+            if (mHashes[i] == 0 ||
+                (mHashes[i] == hash && mSlots[i].first == key))
+            {
+                return i;
+            }
+        }
+    }
+
+    // slot of key, mHashes.size() if it is not in the map
+    size_t
+    findIndex(K const& key) const
+    {
+        if (mSize == 0)
+        {
+            return mHashes.size();
+        }
+        auto i = probe(key, hashOf(key));
+        return mHashes[i] == 0 ? mHashes.size() : i;
+    }
+
+    // puts an entry whose key is not in the map yet
+    void
+    place(size_t hash, value_type&& value)
+    {
+        auto mask = getMask();
+        auto i = hash & mask;
+        while (mHashes[i] != 0)
+        {
+            i = (i + 1) & mask;
+        }
+        mHashes[i] = hash;
+        mSlots[i] = std::move(value);
+        mSize++;
+    }
+
+    void
+    rehash(size_t capacity)
+    {
+        std::vector<size_t> hashes(capacity, 0);
+        std::vector<value_type> slots(capacity);
+        hashes.swap(mHashes);
+        slots.swap(mSlots);
+        mSize = 0;
+        for (size_t i = 0; i < hashes.size(); i++)
+        {
+            if (hashes[i] != 0)
+            {
+                place(hashes[i], std::move(slots[i]));
+            }
+        }
+    }
+
+    void
+    eraseAt(size_t i)
+    {
+        auto mask = getMask();
+        auto hole = i;
+        for (auto j = (i + 1) & mask; mHashes[j] != 0; j = (j + 1) & mask)
+        {
+            // the entry at j can fill the hole unless its home slot is
+            // between the hole and j
+            auto home = mHashes[j] & mask;
+            if (((j - home) & mask) >= ((j - hole) & mask))
+            {
+                mHashes[hole] = mHashes[j];
+                mSlots[hole] = std::move(mSlots[j]);
+                hole = j;
+            }
+        }
+        mHashes[hole] = 0;
+        mSlots[hole] = value_type{};
+        mSize--;
+    }
+};
+
+template <typename K, typename V, typename Hash>
+size_t const FlatHashMap<K, V, Hash>::MIN_CAPACITY;
+
+/**
+ * Set counterpart of FlatHashMap, without iteration.
+ */
+template <typename K, typename Hash = std::hash<K>> class FlatHashSet
+{
+    struct Empty
+    {
+    };
+    FlatHashMap<K, Empty, Hash> mMap;
+
+  public:
+    size_t
+    size() const
+    {
+        return mMap.size();
+    }
+    bool
+    empty() const
+    {
+        return mMap.empty();
+    }
+    size_t
+    count(K const& key) const
+    {
+        return mMap.count(key);
+    }
+    // returns false if @p key was already in the set
+    bool
+    insert(K const& key)
+    {
+        return mMap.emplace(key, Empty{}).second;
+    }
+    size_t
+    erase(K const& key)
+    {
+        return mMap.erase(key);
+    }
+    void
+    clear()
+    {
+        mMap.clear();
+    }
+};
+}
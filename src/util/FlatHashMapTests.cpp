@@ -0,0 +1,165 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SHA.h"
+#include "lib/catch.hpp"
+#include "util/FlatHashMap.h"
+#include "util/HashOfHash.h"
+#include "util/Logging.h"
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <unordered_map>
+
+using namespace stellar;
+
+namespace
+{
+// puts all keys in a few home slots, to exercise probing and erasure
+struct CollidingHash
+{
+    size_t
+    operator()(int x) const
+    {
+        return static_cast<size_t>(x % 5);
+    }
+};
+
+template <typename Map>
+void
+checkAgainstStdMap()
+{
+    Map map;
+    std::map<int, int> expected;
+    std::mt19937 gen(42);
+    for (int i = 0; i < 100000; i++)
+    {
+        int key = gen() % 300;
+        switch (gen() % 4)
+        {
+        case 0:
+        {
+            auto res = map.emplace(key, i);
+            auto exp = expected.emplace(key, i);
+            REQUIRE(res.second == exp.second);
+            REQUIRE(res.first->second == exp.first->second);
+            break;
+        }
+        case 1:
+            REQUIRE(map.erase(key) == expected.erase(key));
+            break;
+        case 2:
+        {
+            auto it = map.find(key);
+            auto exp = expected.find(key);
+            REQUIRE((it == map.end()) == (exp == expected.end()));
+            if (exp != expected.end())
+            {
+                REQUIRE(it->second == exp->second);
+            }
+            break;
+        }
+        case 3:
+            map[key] = i;
+            expected[key] = i;
+            break;
+        }
+        REQUIRE(map.size() == expected.size());
+    }
+
+    auto limit = 150;
+    auto erased = map.eraseIf(
+        [limit](std::pair<int, int> const& e) { return e.first < limit; });
+    auto below = expected.lower_bound(limit);
+    REQUIRE(erased == static_cast<size_t>(
+                          std::distance(expected.begin(), below)));
+    expected.erase(expected.begin(), below);
+
+    size_t n = 0;
+    for (auto const& e : map)
+    {
+        REQUIRE(expected.at(e.first) == e.second);
+        n++;
+    }
+    REQUIRE(n == expected.size());
+}
+
+std::vector<uint256>
+makeKeys(size_t n)
+{
+    std::vector<uint256> res;
+    for (size_t i = 0; i < n; i++)
+    {
+        res.emplace_back(sha256(std::to_string(i)));
+    }
+    return res;
+}
+
+template <typename Map>
+void
+benchMap(std::string const& name, std::vector<uint256> const& keys)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (size_t r = 0; r < 10; r++)
+    {
+        Map map;
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            map[keys[i]] = i;
+        }
+        for (auto const& k : keys)
+        {
+            found += map.count(k);
+        }
+        for (size_t i = 0; i < keys.size(); i += 2)
+        {
+            map.erase(keys[i]);
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    REQUIRE(found == 10 * keys.size());
+    LOG(INFO) << name << ": " << elapsed << " ms";
+}
+}
+
+TEST_CASE("flat hash map", "[flathashmap]")
+{
+    SECTION("well distributed keys")
+    {
+        checkAgainstStdMap<FlatHashMap<int, int>>();
+    }
+    SECTION("colliding keys")
+    {
+        checkAgainstStdMap<FlatHashMap<int, int, CollidingHash>>();
+    }
+    SECTION("set")
+    {
+        FlatHashSet<uint256> set;
+        auto keys = makeKeys(1000);
+        for (auto const& k : keys)
+        {
+            REQUIRE(set.insert(k));
+        }
+        REQUIRE(!set.insert(keys[10]));
+        REQUIRE(set.size() == keys.size());
+        REQUIRE(set.erase(keys[10]) == 1);
+        REQUIRE(set.count(keys[10]) == 0);
+        REQUIRE(set.count(keys[11]) == 1);
+        set.clear();
+        REQUIRE(set.empty());
+    }
+}
+
+TEST_CASE("flat hash map benchmark", "[flathashmap][bench][!hide]")
+{
+    auto keys = makeKeys(100000);
+    benchMap<std::map<uint256, size_t>>("std::map", keys);
+    benchMap<std::unordered_map<uint256, size_t>>("std::unordered_map",
+                                                  keys);
+    benchMap<FlatHashMap<uint256, size_t>>("FlatHashMap", keys);
+}
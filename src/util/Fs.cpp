@@ -12,11 +12,17 @@
 
 #ifdef _WIN32
 #include <direct.h>
+#include <fcntl.h>
 #include <filesystem>
+#include <io.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
 #else
 #include <dirent.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
 #endif
 
 #include <cstdio>
@@ -105,6 +111,47 @@ mkdir(std::string const& name)
     return b;
 }
 
+bool
+hardLink(std::string const& from, std::string const& to)
+{
+    bool b = CreateHardLinkA(to.c_str(), from.c_str(), nullptr) != 0;
+    CLOG(DEBUG, "Fs") << (b ? "linked " : "failed to link ") << from << " to "
+                      << to;
+    return b;
+}
+
+bool
+fileInfo(std::string const& path, uint64_t& size, int64_t& mtime)
+{
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    size = static_cast<uint64_t>(st.st_size);
+    mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+bool
+touch(std::string const& path)
+{
+    return _utime(path.c_str(), nullptr) == 0;
+}
+
+bool
+truncate(std::string const& path, uint64_t size)
+{
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool res = _chsize_s(fd, static_cast<__int64>(size)) == 0;
+    _close(fd);
+    return res;
+}
+
 void
 deltree(std::string const& d)
 {
@@ -258,6 +305,40 @@ mkdir(std::string const& name)
     return b;
 }
 
+bool
+hardLink(std::string const& from, std::string const& to)
+{
+    bool b = ::link(from.c_str(), to.c_str()) == 0;
+    CLOG(DEBUG, "Fs") << (b ? "linked " : "failed to link ") << from << " to "
+                      << to;
+    return b;
+}
+
+bool
+fileInfo(std::string const& path, uint64_t& size, int64_t& mtime)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    size = static_cast<uint64_t>(st.st_size);
+    mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+bool
+touch(std::string const& path)
+{
+    return ::utime(path.c_str(), nullptr) == 0;
+}
+
+bool
+truncate(std::string const& path, uint64_t size)
+{
+    return ::truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+}
+
 namespace
 {
 
@@ -42,6 +42,20 @@ bool mkdir(std::string const& path);
 // Make a dir path like mkdir -p, i.e. recursive, uses '/' as dir separator
 bool mkpath(std::string const& path);
 
+// Create `to` as a hard link to the existing file `from`, returns false if
+// that is not possible (`to` exists, different filesystems...)
+bool hardLink(std::string const& from, std::string const& to);
+
+// Size and last modification time (in seconds since the epoch) of a file,
+// returns false if it can't be stat'ed
+bool fileInfo(std::string const& path, uint64_t& size, int64_t& mtime);
+
+// Sets the last modification time of a file to now
+bool touch(std::string const& path);
+
+// Cuts a file down to its first `size` bytes
+bool truncate(std::string const& path, uint64_t size);
+
 // Get list of all files with names matching predicate
 // Returned names are relative to path
 std::vector<std::string>
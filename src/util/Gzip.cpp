@@ -0,0 +1,694 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Gzip.h"
+#include "util/XDRStream.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+namespace stellar
+{
+namespace gz
+{
+
+namespace
+{
+
+// size of the deflate window, the most of a previous block that is used
+size_t const DICTIONARY_SIZE = 32 * 1024;
+size_t const CHUNK_SIZE = 64 * 1024;
+
+typedef std::vector<unsigned char> Bytes;
+
+struct Block
+{
+    Bytes mInput;
+    bool mLast{false};
+
+    Bytes mOutput;
+    uLong mCrc{0};
+};
+
+void
+deflateBlock(Block& block, unsigned char const* dict, size_t dictSize)
+{
+    z_stream strm{};
+    // raw deflate, header and trailer are written by compressFile
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    if (dictSize != 0 &&
+        deflateSetDictionary(&strm, dict, static_cast<uInt>(dictSize)) != Z_OK)
+    {
+        deflateEnd(&strm);
+        throw std::runtime_error("deflateSetDictionary failed");
+    }
+
+    // a sync flush ends non final blocks on a byte boundary, so that they
+    // can simply be concatenated
+    int flush = block.mLast ? Z_FINISH : Z_SYNC_FLUSH;
+    strm.next_in = block.mInput.data();
+    strm.avail_in = static_cast<uInt>(block.mInput.size());
+    block.mOutput.resize(deflateBound(&strm, strm.avail_in) + 16);
+    size_t written = 0;
+    int ret;
+    do
+    {
+        if (written == block.mOutput.size())
+        {
+            block.mOutput.resize(block.mOutput.size() + CHUNK_SIZE);
+        }
+        strm.next_out = block.mOutput.data() + written;
+        strm.avail_out = static_cast<uInt>(block.mOutput.size() - written);
+        ret = deflate(&strm, flush);
+        written = block.mOutput.size() - strm.avail_out;
+    } while (ret == Z_OK && (strm.avail_out == 0 || strm.avail_in != 0));
+    deflateEnd(&strm);
+    if (ret != (block.mLast ? Z_STREAM_END : Z_OK))
+    {
+        throw std::runtime_error("deflate failed");
+    }
+    block.mOutput.resize(written);
+
+    block.mCrc = crc32(0L, Z_NULL, 0);
+    block.mCrc = crc32(block.mCrc, block.mInput.data(),
+                       static_cast<uInt>(block.mInput.size()));
+}
+
+void
+putLE32(unsigned char* p, uLong v)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = static_cast<unsigned char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+uint32_t
+getLE32(unsigned char const* p)
+{
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+void
+writeLE32(std::ofstream& out, uLong v)
+{
+    unsigned char b[4];
+    putLE32(b, v);
+    out.write(reinterpret_cast<char const*>(b), sizeof(b));
+}
+
+// The members of block compressed files: magic, deflate, FEXTRA, no mtime,
+// no extra flags, unix, then an extra field of 12 bytes with one "SB"
+// subfield of 8, the sizes of the member and of its input.
+size_t const MEMBER_HEADER_SIZE = 24;
+size_t const MEMBER_TRAILER_SIZE = 8;
+unsigned char const MEMBER_HEADER_START[] = {0x1f, 0x8b, 8,   4,   0, 0,
+                                             0,    0,    0,   3,   12, 0,
+                                             'S',  'B',  8,   0};
+
+void
+putMemberHeader(unsigned char* h, uint32_t memberSize, uint32_t size)
+{
+    std::copy(std::begin(MEMBER_HEADER_START), std::end(MEMBER_HEADER_START),
+              h);
+    putLE32(h + 16, memberSize);
+    putLE32(h + 20, size);
+}
+
+bool
+parseMemberHeader(unsigned char const* h, uint32_t& memberSize,
+                  uint32_t& size)
+{
+    if (!std::equal(std::begin(MEMBER_HEADER_START),
+                    std::end(MEMBER_HEADER_START), h))
+    {
+        return false;
+    }
+    memberSize = getLE32(h + 16);
+    size = getLE32(h + 20);
+    return memberSize >= MEMBER_HEADER_SIZE + MEMBER_TRAILER_SIZE;
+}
+
+// raw deflate of @p size bytes, ended by a sync flush and an empty final
+// block
+void
+deflateMember(unsigned char const* input, size_t size, Bytes& output)
+{
+    z_stream strm{};
+    // fast, for files compressed as they are adopted
+    if (deflateInit2(&strm, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    strm.next_in = const_cast<unsigned char*>(input);
+    strm.avail_in = static_cast<uInt>(size);
+    output.resize(deflateBound(&strm, strm.avail_in) + 16);
+    size_t written = 0;
+    auto step = [&](int flush) {
+        if (written == output.size())
+        {
+            output.resize(output.size() + CHUNK_SIZE);
+        }
+        strm.next_out = output.data() + written;
+        strm.avail_out = static_cast<uInt>(output.size() - written);
+        int ret = deflate(&strm, flush);
+        written = output.size() - strm.avail_out;
+        return ret;
+    };
+    int ret;
+    do
+    {
+        ret = step(Z_SYNC_FLUSH);
+    } while (ret == Z_OK && strm.avail_out == 0);
+    if (ret == Z_OK || ret == Z_BUF_ERROR)
+    {
+        do
+        {
+            ret = step(Z_FINISH);
+        } while (ret == Z_OK);
+    }
+    deflateEnd(&strm);
+    if (ret != Z_STREAM_END)
+    {
+        throw std::runtime_error("deflate failed");
+    }
+    output.resize(written);
+}
+
+void
+seekFile(FILE* f, uint64_t offset)
+{
+#ifdef _WIN32
+    int res = _fseeki64(f, static_cast<int64_t>(offset), SEEK_SET);
+#else
+    int res = fseeko(f, static_cast<off_t>(offset), SEEK_SET);
+#endif
+    if (res != 0)
+    {
+        throw std::runtime_error("failed to seek in block compressed file");
+    }
+}
+}
+
+void
+compressFile(std::string const& in, std::string const& out, size_t threads)
+{
+    std::ifstream input(in, std::ifstream::binary);
+    if (!input)
+    {
+        throw std::runtime_error("can't open " + in);
+    }
+    std::ofstream output(out, std::ofstream::binary | std::ofstream::trunc);
+    if (!output)
+    {
+        throw std::runtime_error("can't open " + out);
+    }
+    threads = std::max<size_t>(threads, 1);
+
+    // magic, deflate, no flags, no mtime, no extra flags, unix
+    static unsigned char const header[] = {0x1f, 0x8b, 8, 0, 0,
+                                           0,    0,    0, 0, 3};
+    output.write(reinterpret_cast<char const*>(header), sizeof(header));
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uLong size = 0;
+    Bytes dict;
+    bool done = false;
+    while (!done)
+    {
+        std::vector<Block> batch;
+        while (batch.size() < threads && !done)
+        {
+            batch.emplace_back();
+            auto& block = batch.back();
+            block.mInput.resize(BLOCK_SIZE);
+            input.read(reinterpret_cast<char*>(block.mInput.data()),
+                       block.mInput.size());
+            if (input.bad())
+            {
+                throw std::runtime_error("can't read " + in);
+            }
+            block.mInput.resize(static_cast<size_t>(input.gcount()));
+            done = input.peek() == std::ifstream::traits_type::eof();
+            block.mLast = done;
+        }
+
+        // every block but the first uses the tail of the block before it
+        std::vector<std::future<void>> deflated;
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            Bytes const& prev = i == 0 ? dict : batch[i - 1].mInput;
+            size_t dictSize = std::min(prev.size(), DICTIONARY_SIZE);
+            auto dictStart = prev.data() + prev.size() - dictSize;
+            deflated.emplace_back(std::async(
+                batch.size() == 1 ? std::launch::deferred
+                                  : std::launch::async,
+                [&batch, i, dictStart, dictSize]() {
+                    deflateBlock(batch[i], dictStart, dictSize);
+                }));
+        }
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            deflated[i].get();
+            auto const& block = batch[i];
+            output.write(reinterpret_cast<char const*>(block.mOutput.data()),
+                         block.mOutput.size());
+            crc = crc32_combine(crc, block.mCrc,
+                                static_cast<z_off_t>(block.mInput.size()));
+            size += static_cast<uLong>(block.mInput.size());
+        }
+
+        auto const& last = batch.back().mInput;
+        dict.assign(last.end() - std::min(last.size(), DICTIONARY_SIZE),
+                    last.end());
+    }
+
+    writeLE32(output, crc);
+    writeLE32(output, size);
+    output.close();
+    if (!output)
+    {
+        throw std::runtime_error("can't write " + out);
+    }
+}
+
+void
+decompressFile(std::string const& in, std::string const& out)
+{
+    std::ifstream input(in, std::ifstream::binary);
+    if (!input)
+    {
+        throw std::runtime_error("can't open " + in);
+    }
+    std::ofstream output(out, std::ofstream::binary | std::ofstream::trunc);
+    if (!output)
+    {
+        throw std::runtime_error("can't open " + out);
+    }
+
+    z_stream strm{};
+    // gzip only, as `gzip -d`
+    if (inflateInit2(&strm, MAX_WBITS + 16) != Z_OK)
+    {
+        throw std::runtime_error("inflateInit2 failed");
+    }
+
+    Bytes inBuf(CHUNK_SIZE);
+    Bytes outBuf(CHUNK_SIZE);
+    int ret = Z_OK;
+    // inflate may have more output for us before needing input
+    bool outputFull = false;
+    while (true)
+    {
+        if (strm.avail_in == 0 && !outputFull)
+        {
+            input.read(reinterpret_cast<char*>(inBuf.data()), inBuf.size());
+            if (input.bad())
+            {
+                inflateEnd(&strm);
+                throw std::runtime_error("can't read " + in);
+            }
+            strm.next_in = inBuf.data();
+            strm.avail_in = static_cast<uInt>(input.gcount());
+            if (strm.avail_in == 0)
+            {
+                break;
+            }
+        }
+        if (ret == Z_STREAM_END)
+        {
+            // another member follows
+            inflateReset(&strm);
+        }
+
+        strm.next_out = outBuf.data();
+        strm.avail_out = static_cast<uInt>(outBuf.size());
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_BUF_ERROR)
+        {
+            // no progress without more input
+            ret = Z_OK;
+        }
+        if (ret != Z_OK && ret != Z_STREAM_END)
+        {
+            inflateEnd(&strm);
+            throw std::runtime_error("corrupt gzip file " + in);
+        }
+        output.write(reinterpret_cast<char const*>(outBuf.data()),
+                     outBuf.size() - strm.avail_out);
+        outputFull = ret != Z_STREAM_END && strm.avail_out == 0;
+    }
+    inflateEnd(&strm);
+
+    if (ret != Z_STREAM_END)
+    {
+        throw std::runtime_error("truncated gzip file " + in);
+    }
+    output.close();
+    if (!output)
+    {
+        throw std::runtime_error("can't write " + out);
+    }
+}
+
+void
+compressBytes(uint8_t const* data, size_t size, std::vector<uint8_t>& out)
+{
+    uLongf outSize = compressBound(static_cast<uLong>(size));
+    out.resize(outSize);
+    if (compress2(out.data(), &outSize, data, static_cast<uLong>(size),
+                  Z_DEFAULT_COMPRESSION) != Z_OK)
+    {
+        throw std::runtime_error("compress2 failed");
+    }
+    out.resize(outSize);
+}
+
+void
+decompressBytes(uint8_t const* data, size_t size, std::vector<uint8_t>& out)
+{
+    z_stream strm{};
+    if (inflateInit(&strm) != Z_OK)
+    {
+        throw std::runtime_error("inflateInit failed");
+    }
+    strm.next_in = const_cast<Bytef*>(data);
+    strm.avail_in = static_cast<uInt>(size);
+    out.resize(std::max<size_t>(size * 4, 256));
+    size_t written = 0;
+    int ret;
+    do
+    {
+        if (written == out.size())
+        {
+            out.resize(out.size() * 2);
+        }
+        strm.next_out = out.data() + written;
+        strm.avail_out = static_cast<uInt>(out.size() - written);
+        ret = inflate(&strm, Z_NO_FLUSH);
+        written = out.size() - strm.avail_out;
+    } while (ret == Z_OK);
+    inflateEnd(&strm);
+    if (ret != Z_STREAM_END)
+    {
+        throw std::runtime_error("corrupt compressed data");
+    }
+    out.resize(written);
+}
+
+std::vector<uint32_t>
+compressBlockFile(std::string const& in, std::string const& out)
+{
+    std::ifstream input(in, std::ifstream::binary);
+    if (!input)
+    {
+        throw std::runtime_error("can't open " + in);
+    }
+    XDROutputFileStream output(true);
+    output.open(out);
+
+    std::vector<uint32_t> memberSizes;
+    Bytes block(BLOCK_FILE_BLOCK_SIZE);
+    Bytes deflated;
+    unsigned char header[MEMBER_HEADER_SIZE];
+    unsigned char trailer[MEMBER_TRAILER_SIZE];
+    while (true)
+    {
+        input.read(reinterpret_cast<char*>(block.data()), block.size());
+        if (input.bad())
+        {
+            throw std::runtime_error("can't read " + in);
+        }
+        auto size = static_cast<size_t>(input.gcount());
+        if (size == 0)
+        {
+            break;
+        }
+        deflateMember(block.data(), size, deflated);
+        auto memberSize =
+            MEMBER_HEADER_SIZE + deflated.size() + MEMBER_TRAILER_SIZE;
+        putMemberHeader(header, static_cast<uint32_t>(memberSize),
+                        static_cast<uint32_t>(size));
+        putLE32(trailer,
+                crc32(crc32(0L, Z_NULL, 0), block.data(),
+                      static_cast<uInt>(size)));
+        putLE32(trailer + 4, size);
+        if (!output.writeBytes(reinterpret_cast<char*>(header),
+                               sizeof(header)) ||
+            !output.writeBytes(reinterpret_cast<char*>(deflated.data()),
+                               deflated.size()) ||
+            !output.writeBytes(reinterpret_cast<char*>(trailer),
+                               sizeof(trailer)))
+        {
+            throw std::runtime_error("can't write " + out);
+        }
+        memberSizes.emplace_back(static_cast<uint32_t>(memberSize));
+    }
+    output.close();
+    return memberSizes;
+}
+
+bool
+isBlockFile(std::string const& filename)
+{
+    std::ifstream input(filename, std::ifstream::binary);
+    unsigned char header[MEMBER_HEADER_SIZE];
+    input.read(reinterpret_cast<char*>(header), sizeof(header));
+    uint32_t memberSize, size;
+    return input.gcount() == sizeof(header) &&
+           parseMemberHeader(header, memberSize, size);
+}
+
+void
+transcodeBlockFile(std::string const& in, std::string const& out)
+{
+    std::ifstream input(in, std::ifstream::binary);
+    if (!input)
+    {
+        throw std::runtime_error("can't open " + in);
+    }
+    std::ofstream output(out, std::ofstream::binary | std::ofstream::trunc);
+    if (!output)
+    {
+        throw std::runtime_error("can't open " + out);
+    }
+
+    static unsigned char const header[] = {0x1f, 0x8b, 8, 0, 0,
+                                           0,    0,    0, 0, 3};
+    output.write(reinterpret_cast<char const*>(header), sizeof(header));
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uLong size = 0;
+    Bytes member;
+    while (true)
+    {
+        unsigned char h[MEMBER_HEADER_SIZE];
+        input.read(reinterpret_cast<char*>(h), sizeof(h));
+        if (input.gcount() == 0 && input.eof())
+        {
+            break;
+        }
+        uint32_t memberSize, blockSize;
+        if (input.gcount() != sizeof(h) ||
+            !parseMemberHeader(h, memberSize, blockSize))
+        {
+            throw std::runtime_error("corrupt block compressed file " + in);
+        }
+        member.resize(memberSize - MEMBER_HEADER_SIZE);
+        input.read(reinterpret_cast<char*>(member.data()), member.size());
+        if (static_cast<size_t>(input.gcount()) != member.size())
+        {
+            throw std::runtime_error("truncated block compressed file " + in);
+        }
+
+        // the deflate stream without its empty final block
+        auto dataSize = member.size() - MEMBER_TRAILER_SIZE;
+        auto const* trailer = member.data() + dataSize;
+        if (dataSize < 2 || member[dataSize - 2] != 3 ||
+            member[dataSize - 1] != 0 || getLE32(trailer + 4) != blockSize)
+        {
+            throw std::runtime_error("corrupt block compressed file " + in);
+        }
+        output.write(reinterpret_cast<char const*>(member.data()),
+                     dataSize - 2);
+        crc = crc32_combine(crc, getLE32(trailer),
+                            static_cast<z_off_t>(blockSize));
+        size += blockSize;
+    }
+
+    static unsigned char const finalBlock[] = {3, 0};
+    output.write(reinterpret_cast<char const*>(finalBlock),
+                 sizeof(finalBlock));
+    writeLE32(output, crc);
+    writeLE32(output, size);
+    output.close();
+    if (!output)
+    {
+        throw std::runtime_error("can't write " + out);
+    }
+}
+
+BlockFileReader::BlockFileReader(FILE* in) : mIn(in)
+{
+}
+
+bool
+BlockFileReader::readHeader(Block& block)
+{
+    unsigned char h[MEMBER_HEADER_SIZE];
+    auto n = std::fread(h, 1, sizeof(h), mIn);
+    if (n == 0 && std::feof(mIn))
+    {
+        return false;
+    }
+    if (n != sizeof(h) || !parseMemberHeader(h, block.mMemberSize, block.mSize))
+    {
+        throw std::runtime_error("corrupt block compressed file");
+    }
+    block.mFileOffset = mNextFileOffset;
+    return true;
+}
+
+bool
+BlockFileReader::loadNextBlock()
+{
+    auto knownFileEnd = mBlocks.empty() ? 0
+                                        : mBlocks.back().mFileOffset +
+                                              mBlocks.back().mMemberSize;
+    Block block;
+    if (!readHeader(block))
+    {
+        mAllFound = mAllFound || mNextFileOffset == knownFileEnd;
+        return false;
+    }
+    block.mStart = mDataStart + mData.size();
+    if (block.mFileOffset == knownFileEnd)
+    {
+        mBlocks.emplace_back(block);
+    }
+
+    mMember.resize(block.mMemberSize - MEMBER_HEADER_SIZE);
+    if (std::fread(mMember.data(), 1, mMember.size(), mIn) != mMember.size())
+    {
+        throw std::runtime_error("truncated block compressed file");
+    }
+    auto dataSize = mMember.size() - MEMBER_TRAILER_SIZE;
+    mData.resize(block.mSize);
+
+    z_stream strm{};
+    if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+    {
+        throw std::runtime_error("inflateInit2 failed");
+    }
+    strm.next_in = mMember.data();
+    strm.avail_in = static_cast<uInt>(dataSize);
+    strm.next_out = mData.data();
+    strm.avail_out = static_cast<uInt>(mData.size());
+    int ret = inflate(&strm, Z_FINISH);
+    inflateEnd(&strm);
+    auto const* trailer = mMember.data() + dataSize;
+    if (ret != Z_STREAM_END || strm.avail_out != 0 ||
+        getLE32(trailer + 4) != block.mSize ||
+        getLE32(trailer) != crc32(crc32(0L, Z_NULL, 0), mData.data(),
+                                  static_cast<uInt>(mData.size())))
+    {
+        throw std::runtime_error("corrupt block compressed file");
+    }
+
+    mDataStart = block.mStart;
+    mPos = 0;
+    mNextFileOffset += block.mMemberSize;
+    return true;
+}
+
+size_t
+BlockFileReader::read(char* data, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        if (mPos == mData.size() && !loadNextBlock())
+        {
+            mEof = true;
+            break;
+        }
+        auto n = std::min(size - done, mData.size() - mPos);
+        std::copy(mData.begin() + mPos, mData.begin() + mPos + n, data + done);
+        mPos += n;
+        done += n;
+    }
+    return done;
+}
+
+void
+BlockFileReader::seek(uint64_t offset)
+{
+    auto end = [this]() {
+        return mBlocks.empty() ? 0
+                               : mBlocks.back().mStart + mBlocks.back().mSize;
+    };
+    // find the blocks up to the one holding `offset`, from their headers
+    while (!mAllFound && end() <= offset)
+    {
+        mNextFileOffset = mBlocks.empty() ? 0
+                                          : mBlocks.back().mFileOffset +
+                                                mBlocks.back().mMemberSize;
+        seekFile(mIn, mNextFileOffset);
+        Block block;
+        if (!readHeader(block))
+        {
+            mAllFound = true;
+            break;
+        }
+        block.mStart = end();
+        mBlocks.emplace_back(block);
+    }
+
+    mData.clear();
+    mPos = 0;
+    mEof = false;
+    if (offset >= end())
+    {
+        if (offset > end())
+        {
+            throw std::runtime_error(
+                "seek past the end of a block compressed file");
+        }
+        // at the end of the contents
+        mNextFileOffset = mBlocks.empty() ? 0
+                                          : mBlocks.back().mFileOffset +
+                                                mBlocks.back().mMemberSize;
+        seekFile(mIn, mNextFileOffset);
+        mDataStart = offset;
+        return;
+    }
+
+    auto it = std::upper_bound(
+        mBlocks.begin(), mBlocks.end(), offset,
+        [](uint64_t o, Block const& b) { return o < b.mStart; });
+    auto block = *(--it);
+    mNextFileOffset = block.mFileOffset;
+    seekFile(mIn, mNextFileOffset);
+    mDataStart = block.mStart;
+    if (!loadNextBlock())
+    {
+        throw std::runtime_error("truncated block compressed file");
+    }
+    mPos = static_cast<size_t>(offset - block.mStart);
+}
+}
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+namespace gz
+{
+
+// size of the blocks of input compressed independently by gzipFile
+size_t const BLOCK_SIZE = 1 << 20;
+
+// Compresses the file @p in to the gzip file @p out. Like pigz, the input is
+// cut in BLOCK_SIZE blocks that are deflated on up to @p threads threads,
+// each one primed with the end of the previous block; the output is a single
+// gzip member that any gzip decompresses. Throws std::runtime_error.
+void compressFile(std::string const& in, std::string const& out,
+                  size_t threads);
+
+// Decompresses the gzip file @p in (that can be made of several members) to
+// @p out. Throws std::runtime_error, including when @p in is truncated.
+void decompressFile(std::string const& in, std::string const& out);
+
+// Compresses the @p size bytes at @p data to @p out as a zlib stream, for
+// small values kept in memory or in the database (see COMPRESS_TX_HISTORY).
+// Throws std::runtime_error.
+void compressBytes(uint8_t const* data, size_t size, std::vector<uint8_t>& out);
+
+// Decompresses a zlib stream written by compressBytes to @p out. Throws
+// std::runtime_error if it is corrupt or truncated.
+void decompressBytes(uint8_t const* data, size_t size,
+                     std::vector<uint8_t>& out);
+
+// Block compressed files (see COMPRESS_BUCKET_FILES) are gzip files made of
+// one member per BLOCK_FILE_BLOCK_SIZE bytes of input, deflated
+// independently, so that they can be read from any block. Like BGZF, the
+// header of every member has an extra field with the size of the member and
+// of its input: a reader finds the block holding an offset by reading the
+// headers of the ones before it, not inflating them.
+//
+// Every member ends its deflate stream with a sync flush then an empty
+// final block, so that transcodeBlockFile turns the file into a single
+// member gzip file by concatenating them.
+size_t const BLOCK_FILE_BLOCK_SIZE = 64 * 1024;
+
+// Compresses the file @p in to the block compressed file @p out, which is
+// synced to disk, and returns the sizes of its members: every member but the
+// last holds BLOCK_FILE_BLOCK_SIZE bytes of @p in. Throws std::runtime_error.
+std::vector<uint32_t> compressBlockFile(std::string const& in,
+                                        std::string const& out);
+
+// Whether @p filename exists and is a block compressed file.
+bool isBlockFile(std::string const& filename);
+
+// Writes the contents of the block compressed file @p in to the gzip file
+// @p out, as a single member, without inflating or deflating them (only the
+// CRCs of the members are combined). Throws std::runtime_error.
+void transcodeBlockFile(std::string const& in, std::string const& out);
+
+// Reads the contents of a block compressed file from @p in, an open file
+// positioned at its start that the reader then owns the position of.
+// Throws std::runtime_error on corrupt files.
+class BlockFileReader : NonMovableOrCopyable
+{
+    struct Block
+    {
+        uint64_t mStart;      // offset of its contents in the file contents
+        uint64_t mFileOffset; // offset of its member in the file
+        uint32_t mMemberSize;
+        uint32_t mSize;
+    };
+
+    FILE* mIn;
+    // the blocks found so far, in order
+    std::vector<Block> mBlocks;
+    bool mAllFound{false};
+    uint64_t mNextFileOffset{0};
+
+    // contents of the current block, from mDataStart, read up to mPos
+    std::vector<unsigned char> mData;
+    uint64_t mDataStart{0};
+    size_t mPos{0};
+    std::vector<unsigned char> mMember;
+    bool mEof{false};
+
+    bool readHeader(Block& block);
+    bool loadNextBlock();
+
+  public:
+    explicit BlockFileReader(FILE* in);
+
+    // Reads up to @p size bytes, returns how many; fewer only at the end.
+    size_t read(char* data, size_t size);
+
+    // Offset in the file contents of the next byte read.
+    uint64_t
+    pos() const
+    {
+        return mDataStart + mPos;
+    }
+
+    // Position the reader at @p offset, at most the size of the contents.
+    void seek(uint64_t offset);
+
+    // Whether a read stopped at the end of the contents.
+    bool
+    eof() const
+    {
+        return mEof;
+    }
+};
+}
+}
@@ -0,0 +1,133 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/Gzip.h"
+#include "util/TmpDir.h"
+
+#include <fstream>
+#include <random>
+
+using namespace stellar;
+
+namespace
+{
+
+void
+writeFile(std::string const& path, std::string const& content)
+{
+    std::ofstream out(path, std::ofstream::binary);
+    out.write(content.data(), content.size());
+}
+
+std::string
+readFile(std::string const& path)
+{
+    std::ifstream in(path, std::ifstream::binary);
+    return std::string(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+}
+}
+
+TEST_CASE("gzip round trip", "[gzip]")
+{
+    TmpDir dir("gzip");
+    auto plain = dir.getName() + "/file";
+    auto compressed = plain + ".gz";
+    auto restored = dir.getName() + "/restored";
+
+    // compressible text with some noise, spanning a few blocks
+    std::mt19937 gen(42);
+    std::string content;
+    while (content.size() < 3 * gz::BLOCK_SIZE + 1234)
+    {
+        content += "ledger " + std::to_string(gen() % 1000) + "\n";
+    }
+
+    for (size_t size : {size_t(0), size_t(1), gz::BLOCK_SIZE, content.size()})
+    {
+        for (size_t threads : {1, 2, 8})
+        {
+            writeFile(plain, content.substr(0, size));
+            gz::compressFile(plain, compressed, threads);
+            gz::decompressFile(compressed, restored);
+            REQUIRE(readFile(restored) == content.substr(0, size));
+            if (size > gz::BLOCK_SIZE)
+            {
+                REQUIRE(readFile(compressed).size() < size / 2);
+            }
+        }
+    }
+
+    SECTION("several members")
+    {
+        writeFile(plain, "hello ");
+        gz::compressFile(plain, compressed, 1);
+        auto first = readFile(compressed);
+        writeFile(plain, "there");
+        gz::compressFile(plain, compressed, 1);
+        writeFile(compressed, first + readFile(compressed));
+        gz::decompressFile(compressed, restored);
+        REQUIRE(readFile(restored) == "hello there");
+    }
+
+    SECTION("block compressed file")
+    {
+        auto blocks = plain + ".blocks";
+        writeFile(plain, content);
+        gz::compressBlockFile(plain, blocks);
+        REQUIRE(gz::isBlockFile(blocks));
+        REQUIRE(readFile(blocks).size() < content.size() / 2);
+
+        // a gzip file of its own (one member per block), and transcoded to
+        // a single member
+        gz::decompressFile(blocks, restored);
+        REQUIRE(readFile(restored) == content);
+        gz::transcodeBlockFile(blocks, compressed);
+        REQUIRE(!gz::isBlockFile(compressed));
+        gz::decompressFile(compressed, restored);
+        REQUIRE(readFile(restored) == content);
+
+        writeFile(plain, "");
+        gz::compressBlockFile(plain, blocks);
+        gz::transcodeBlockFile(blocks, compressed);
+        gz::decompressFile(compressed, restored);
+        REQUIRE(readFile(restored).empty());
+    }
+
+    SECTION("truncated file")
+    {
+        writeFile(plain, content);
+        gz::compressFile(plain, compressed, 4);
+        auto data = readFile(compressed);
+        writeFile(compressed, data.substr(0, data.size() / 2));
+        REQUIRE_THROWS_AS(gz::decompressFile(compressed, restored),
+                          std::runtime_error);
+    }
+}
+
+TEST_CASE("compressed bytes round trip", "[gzip]")
+{
+    std::mt19937 gen(42);
+    std::vector<uint8_t> data;
+    for (size_t size : {size_t(0), size_t(10), size_t(100000)})
+    {
+        while (data.size() < size)
+        {
+            data.push_back(static_cast<uint8_t>(gen() % 4));
+        }
+        std::vector<uint8_t> compressed, restored;
+        gz::compressBytes(data.data(), data.size(), compressed);
+        gz::decompressBytes(compressed.data(), compressed.size(), restored);
+        REQUIRE(restored == data);
+        if (size > 1000)
+        {
+            REQUIRE(compressed.size() < size / 2);
+            REQUIRE_THROWS_AS(gz::decompressBytes(compressed.data(),
+                                                  compressed.size() / 2,
+                                                  restored),
+                              std::runtime_error);
+        }
+    }
+}
@@ -1,15 +1,34 @@
 #include "HashOfHash.h"
+#include <array>
+#include <sodium.h>
 
 namespace std
 {
 
+namespace
+{
+// SipHash key, drawn once per process so that peers can't pick hashes that
+// collide in our tables
+std::array<unsigned char, crypto_shorthash_KEYBYTES> const&
+getKey()
+{
+    static auto const key = [] {
+        std::array<unsigned char, crypto_shorthash_KEYBYTES> k;
+        randombytes_buf(k.data(), k.size());
+        return k;
+    }();
+    return key;
+}
+}
+
 size_t
 hash<stellar::uint256>::operator()(stellar::uint256 const& x) const noexcept
 {
-    size_t res = x[0];
-    res = (res << 8) | x[1];
-    res = (res << 8) | x[2];
-    res = (res << 8) | x[3];
-    return res;
+    static_assert(crypto_shorthash_BYTES == sizeof(uint64_t),
+                  "unexpected SipHash output size");
+    uint64_t res;
+    crypto_shorthash(reinterpret_cast<unsigned char*>(&res), x.data(),
+                     x.size(), getKey().data());
+    return static_cast<size_t>(res);
 }
 }
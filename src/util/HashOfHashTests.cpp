@@ -0,0 +1,104 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/SHA.h"
+#include "lib/catch.hpp"
+#include "util/HashOfHash.h"
+#include "util/Logging.h"
+
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace stellar;
+
+namespace
+{
+// hashes that only differ in their last bytes, as anybody can make them
+std::vector<uint256>
+makeSimilarHashes(size_t n)
+{
+    std::vector<uint256> res(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        res[i][31] = static_cast<uint8_t>(i);
+        res[i][30] = static_cast<uint8_t>(i >> 8);
+        res[i][29] = static_cast<uint8_t>(i >> 16);
+    }
+    return res;
+}
+
+std::vector<uint256>
+makeRandomHashes(size_t n)
+{
+    std::vector<uint256> res;
+    for (size_t i = 0; i < n; i++)
+    {
+        res.emplace_back(sha256(std::to_string(i)));
+    }
+    return res;
+}
+
+// size of the largest bucket of a table filled with @p hashes
+size_t
+getLargestBucket(std::vector<uint256> const& hashes)
+{
+    std::unordered_set<uint256> set(hashes.begin(), hashes.end());
+    size_t res = 0;
+    for (size_t b = 0; b < set.bucket_count(); b++)
+    {
+        res = std::max(res, set.bucket_size(b));
+    }
+    return res;
+}
+}
+
+TEST_CASE("hash of hash distribution", "[hash]")
+{
+    size_t const n = 10000;
+    std::hash<uint256> h;
+    auto similar = makeSimilarHashes(n);
+
+    std::unordered_set<size_t> values;
+    for (auto const& x : similar)
+    {
+        values.insert(h(x));
+    }
+    REQUIRE(values.size() == n);
+
+    // a uniform hash puts at most a handful of elements in any bucket
+    REQUIRE(getLargestBucket(similar) < 16);
+    REQUIRE(getLargestBucket(makeRandomHashes(n)) < 16);
+}
+
+TEST_CASE("hash of hash lookups", "[hash][bench][!hide]")
+{
+    size_t const n = 100000;
+    auto bench = [&](std::string const& name,
+                     std::vector<uint256> const& hashes) {
+        std::unordered_map<uint256, size_t> map;
+        for (size_t i = 0; i < hashes.size(); i++)
+        {
+            map[hashes[i]] = i;
+        }
+        auto start = std::chrono::steady_clock::now();
+        size_t found = 0;
+        for (size_t r = 0; r < 10; r++)
+        {
+            for (auto const& x : hashes)
+            {
+                found += map.count(x);
+            }
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+        REQUIRE(found == 10 * hashes.size());
+        LOG(INFO) << name << ": " << elapsed / (10 * hashes.size())
+                  << " ns per lookup, largest bucket "
+                  << getLargestBucket(hashes);
+    };
+    bench("random hashes", makeRandomHashes(n));
+    bench("similar hashes", makeSimilarHashes(n));
+}
@@ -4,8 +4,17 @@
 
 #include "util/Logging.h"
 #include "main/Application.h"
+#include "util/MPSCQueue.h"
 #include "util/types.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
 /*
 Levels:
     TRACE
@@ -22,12 +31,280 @@ namespace stellar
 namespace
 {
 
-static const std::vector<std::string> kLoggers = {
+static char const* const kLoggers[] = {
     "Fs",      "SCP",    "Bucket", "Database", "History", "Process",  "Ledger",
     "Overlay", "Herder", "Tx",     "LoadGen",  "Work",    "Invariant"};
+static size_t const kLoggerCount = sizeof(kLoggers) / sizeof(kLoggers[0]);
+
+static const el::Level kLevels[] = {el::Level::Trace,   el::Level::Debug,
+                                    el::Level::Info,    el::Level::Warning,
+                                    el::Level::Error,   el::Level::Fatal};
+
+// levels enabled in each of kLoggers and in the default logger, once
+// known
+std::atomic<unsigned> gLoggerLevels[kLoggerCount];
+std::atomic<unsigned> gDefaultLoggerLevels{0};
+std::atomic<bool> gLoggerLevelsKnown{false};
+
+unsigned
+getEnabledLevels(el::Logger* logger)
+{
+    unsigned res = 0;
+    for (auto level : kLevels)
+    {
+        if (logger->typedConfigurations()->enabled(level))
+        {
+            res |= static_cast<el::base::type::EnumType>(level);
+        }
+    }
+    return res;
+}
+
+struct LogRecord
+{
+    std::string mLine;
+    bool mToFile{false};
+    bool mToStandardOutput{false};
+};
+
+class LogWriter
+{
+    static size_t const QUEUE_SIZE = 16384;
+
+    MPSCQueue<LogRecord> mQueue{QUEUE_SIZE};
+    std::atomic<uint64_t> mPushed{0};
+    std::atomic<uint64_t> mWritten{0};
+    std::atomic<uint64_t> mDropped{0};
+    uint64_t mDroppedReported{0};
+
+    std::mutex mMutex;
+    std::condition_variable mWakeUp;
+    std::condition_variable mFlushed;
+    std::atomic<bool> mSleeping{false};
+
+    // under mMutex
+    std::string mFilename;
+    bool mReopen{false};
+    // only used by the writer thread
+    std::ofstream mFile;
+
+    std::thread mThread;
+
+    void
+    openFile()
+    {
+        std::string filename;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mReopen)
+            {
+                return;
+            }
+            mReopen = false;
+            filename = mFilename;
+        }
+        if (mFile.is_open())
+        {
+            mFile.close();
+        }
+        if (!filename.empty())
+        {
+            mFile.open(filename, std::ios::out | std::ios::app);
+        }
+    }
+
+    void
+    write(LogRecord const& record)
+    {
+        if (record.mToFile && mFile.is_open())
+        {
+            mFile << record.mLine;
+        }
+        if (record.mToStandardOutput)
+        {
+            std::cout << record.mLine;
+        }
+    }
+
+    void
+    run()
+    {
+        for (;;)
+        {
+            openFile();
+            LogRecord record;
+            bool wrote = false;
+            while (mQueue.tryPop(record))
+            {
+                write(record);
+                mWritten.fetch_add(1, std::memory_order_release);
+                wrote = true;
+            }
+            auto dropped = mDropped.load(std::memory_order_relaxed);
+            if (dropped != mDroppedReported)
+            {
+                LogRecord note;
+                note.mLine = "[" + std::to_string(dropped - mDroppedReported) +
+                             " log messages dropped]\n";
+                note.mToFile = note.mToStandardOutput = true;
+                write(note);
+                mDroppedReported = dropped;
+                wrote = true;
+            }
+            if (wrote)
+            {
+                mFile.flush();
+                std::cout.flush();
+            }
+
+            std::unique_lock<std::mutex> lock(mMutex);
+            mFlushed.notify_all();
+            mSleeping = true;
+            mWakeUp.wait_for(lock, std::chrono::milliseconds(50));
+            mSleeping = false;
+        }
+    }
+
+  public:
+    LogWriter() : mThread([this]() { run(); })
+    {
+    }
+
+    void
+    push(LogRecord&& record, bool wait)
+    {
+        if (!mQueue.tryPush(std::move(record)))
+        {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        mPushed.fetch_add(1, std::memory_order_release);
+        if (wait)
+        {
+            flush();
+        }
+        else if (mSleeping.load(std::memory_order_relaxed))
+        {
+            mWakeUp.notify_one();
+        }
+    }
+
+    void
+    flush()
+    {
+        auto target = mPushed.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWakeUp.notify_one();
+        mFlushed.wait(lock, [&]() {
+            return mWritten.load(std::memory_order_acquire) >= target;
+        });
+    }
+
+    void
+    setFilename(std::string const& filename)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFilename = filename;
+        mReopen = true;
+        mWakeUp.notify_one();
+    }
+
+    void
+    reopen()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mReopen = true;
+        mWakeUp.notify_one();
+    }
+
+    uint64_t
+    getDroppedCount() const
+    {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+};
+
+// never destroyed: messages may be logged until the very end of the
+// process, it is flushed at exit instead
+LogWriter&
+getLogWriter()
+{
+    static auto writer = new LogWriter();
+    return *writer;
+}
+
+void
+flushAtExit()
+{
+    getLogWriter().flush();
+}
+
+// replaces the writes to the standard output and files of easylogging
+class QueueLogDispatchCallback : public el::LogDispatchCallback
+{
+  protected:
+    void
+    handle(el::LogDispatchData const* data) override
+    {
+        if (data->dispatchAction() != el::base::DispatchAction::NormalLog)
+        {
+            return;
+        }
+        auto msg = data->logMessage();
+        auto config = msg->logger()->typedConfigurations();
+        LogRecord record;
+        record.mLine = msg->logger()->logBuilder()->build(msg, true);
+        record.mToFile = config->toFile(msg->level());
+        record.mToStandardOutput = config->toStandardOutput(msg->level());
+        getLogWriter().push(std::move(record),
+                            msg->level() == el::Level::Fatal);
+    }
+};
 }
 
 el::Configurations Logging::gDefaultConf;
+std::atomic<unsigned> Logging::gEnabledLevels{~0u};
+
+bool
+Logging::isEnabledIn(el::Level level, char const* partition)
+{
+    if (!gLoggerLevelsKnown.load(std::memory_order_relaxed))
+    {
+        return true;
+    }
+    auto bit = static_cast<el::base::type::EnumType>(level);
+    for (size_t i = 0; i < kLoggerCount; i++)
+    {
+        if (std::strcmp(kLoggers[i], partition) == 0)
+        {
+            return (gLoggerLevels[i].load(std::memory_order_relaxed) & bit) !=
+                   0;
+        }
+    }
+    if (std::strcmp(el::base::consts::kDefaultLoggerId, partition) == 0)
+    {
+        return (gDefaultLoggerLevels.load(std::memory_order_relaxed) & bit) !=
+               0;
+    }
+    // other loggers are left to easylogging
+    return true;
+}
+
+void
+Logging::updateEnabledLevels()
+{
+    unsigned all = getEnabledLevels(
+        el::Loggers::getLogger(el::base::consts::kDefaultLoggerId));
+    gDefaultLoggerLevels.store(all, std::memory_order_relaxed);
+    for (size_t i = 0; i < kLoggerCount; i++)
+    {
+        auto levels = getEnabledLevels(el::Loggers::getLogger(kLoggers[i]));
+        gLoggerLevels[i].store(levels, std::memory_order_relaxed);
+        all |= levels;
+    }
+    gLoggerLevelsKnown.store(true, std::memory_order_relaxed);
+    gEnabledLevels.store(all, std::memory_order_relaxed);
+}
 
 void
 Logging::setFmt(std::string const& peerID, bool timestamps)
@@ -46,6 +323,7 @@ Logging::setFmt(std::string const& peerID, bool timestamps)
     gDefaultConf.set(el::Level::Trace, el::ConfigurationType::Format, longFmt);
     gDefaultConf.set(el::Level::Fatal, el::ConfigurationType::Format, longFmt);
     el::Loggers::reconfigureAllLoggers(gDefaultConf);
+    updateEnabledLevels();
 }
 
 void
@@ -59,6 +337,15 @@ Logging::init()
         el::Loggers::getLogger(logger);
     }
 
+    if (el::Helpers::installLogDispatchCallback<QueueLogDispatchCallback>(
+            "QueueLogDispatchCallback"))
+    {
+        el::Helpers::uninstallLogDispatchCallback<
+            el::base::DefaultLogDispatchCallback>("DefaultLogDispatchCallback");
+        getLogWriter();
+        std::atexit(flushAtExit);
+    }
+
     gDefaultConf.setToDefault();
     gDefaultConf.setGlobally(el::ConfigurationType::ToStandardOutput, "true");
     gDefaultConf.setGlobally(el::ConfigurationType::ToFile, "false");
@@ -71,6 +358,8 @@ Logging::setLoggingToFile(std::string const& filename)
     gDefaultConf.setGlobally(el::ConfigurationType::ToFile, "true");
     gDefaultConf.setGlobally(el::ConfigurationType::Filename, filename);
     el::Loggers::reconfigureAllLoggers(gDefaultConf);
+    updateEnabledLevels();
+    getLogWriter().setFilename(filename);
 }
 
 el::Level
@@ -154,6 +443,7 @@ Logging::setLogLevel(el::Level level, const char* partition)
         el::Loggers::reconfigureLogger(partition, config);
     else
         el::Loggers::reconfigureAllLoggers(config);
+    updateEnabledLevels();
 }
 
 std::string
@@ -228,5 +518,18 @@ Logging::rotate()
     {
         el::Loggers::getLogger(logger)->reconfigure();
     }
+    getLogWriter().reopen();
+}
+
+void
+Logging::flush()
+{
+    getLogWriter().flush();
+}
+
+uint64_t
+Logging::getDroppedCount()
+{
+    return getLogWriter().getDroppedCount();
 }
 }
@@ -17,13 +17,62 @@
 //  include this file instead
 #include "lib/util/easylogging++.h"
 
+#include <atomic>
+
+// CLOG (and LOG) first check the level of the message against the levels
+// enabled, so that disabled messages cost a couple of loads and compares,
+// and nothing of them is evaluated or formatted.
+#undef CLOG
+#define CLOG(LEVEL, ...)                                                       \
+    if (!stellar::Logging::isEnabled(el::Level::STELLAR_LOG_LEVEL_##LEVEL,     \
+                                     __VA_ARGS__))                             \
+    {                                                                          \
+    }                                                                          \
+    else                                                                       \
+        C##LEVEL(el::base::Writer, el::base::DispatchAction::NormalLog,        \
+                 __VA_ARGS__)
+#define STELLAR_LOG_LEVEL_TRACE Trace
+#define STELLAR_LOG_LEVEL_DEBUG Debug
+#define STELLAR_LOG_LEVEL_INFO Info
+#define STELLAR_LOG_LEVEL_WARNING Warning
+#define STELLAR_LOG_LEVEL_ERROR Error
+#define STELLAR_LOG_LEVEL_FATAL Fatal
+
 namespace stellar
 {
+/**
+ * Messages are formatted on the thread logging them, then queued for a
+ * writer thread, which writes them to the standard output and the log
+ * file: logging never waits for the disk, except for FATAL messages, which
+ * are written before returning. When the queue is full, messages are
+ * dropped, and the writer reports how many.
+ */
 class Logging
 {
     static el::Configurations gDefaultConf;
+    // bit l: some partition logs at level l
+    static std::atomic<unsigned> gEnabledLevels;
+
+    static bool isEnabledIn(el::Level level, char const* partition);
+    static void updateEnabledLevels();
 
   public:
+    static bool
+    isEnabled(el::Level level, char const* partition)
+    {
+        auto bit = static_cast<el::base::type::EnumType>(level);
+        if ((gEnabledLevels.load(std::memory_order_relaxed) & bit) == 0)
+        {
+            return false;
+        }
+        return isEnabledIn(level, partition);
+    }
+    static bool
+    isEnabled(el::Level level, std::string const& partition)
+    {
+        return isEnabled(level, partition.c_str());
+    }
+
     static void init();
     static void setFmt(std::string const& peerID, bool timestamps = true);
     static void setLoggingToFile(std::string const& filename);
@@ -34,5 +83,9 @@ class Logging
     static bool logDebug(std::string const& partition);
     static bool logTrace(std::string const& partition);
     static void rotate();
+    // waits until the messages logged so far are written
+    static void flush();
+    // number of messages dropped because the queue was full
+    static uint64_t getDroppedCount();
 };
 }
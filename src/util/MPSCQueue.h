@@ -0,0 +1,111 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace stellar
+{
+
+/**
+ * Bounded queue that any number of threads push to and one thread pops
+ * from, without locks: each slot carries a sequence number telling whether
+ * it is free for a producer or filled for the consumer (D. Vyukov's
+ * bounded queue). Producers only contend on one atomic counter, and
+ * pushing never allocates, so a full queue is reported to the producer
+ * (which may drop or fall back) instead of growing.
+ */
+template <typename T> class MPSCQueue : NonMovableOrCopyable
+{
+    struct Slot
+    {
+        std::atomic<size_t> mSeq;
+        T mValue;
+    };
+
+    std::unique_ptr<Slot[]> mSlots;
+    size_t const mMask;
+    // the producers' and the consumer's positions, apart so that they do
+    // not share a cache line
+    char mPad0[64];
+    std::atomic<size_t> mTail{0};
+    char mPad1[64];
+    size_t mHead{0};
+
+  public:
+    // @p capacity must be a power of 2
+    explicit MPSCQueue(size_t capacity)
+        : mSlots(new Slot[capacity]), mMask(capacity - 1)
+    {
+        assert(capacity != 0 && (capacity & mMask) == 0);
+        for (size_t i = 0; i < capacity; i++)
+        {
+            mSlots[i].mSeq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    size_t
+    capacity() const
+    {
+        return mMask + 1;
+    }
+
+    // called by any thread, returns false (leaving @p value alone) if the
+    // queue is full
+    bool
+    tryPush(T&& value)
+    {
+        auto pos = mTail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            auto& slot = mSlots[pos & mMask];
+            auto seq = slot.mSeq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0)
+            {
+                if (mTail.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed))
+                {
+                    slot.mValue = std::move(value);
+                    slot.mSeq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = mTail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // only called by the consumer thread, returns false if the queue is
+    // empty (or the next value is still being written)
+    bool
+    tryPop(T& value)
+    {
+        auto& slot = mSlots[mHead & mMask];
+        auto seq = slot.mSeq.load(std::memory_order_acquire);
+        if (static_cast<std::ptrdiff_t>(seq - (mHead + 1)) < 0)
+        {
+            return false;
+        }
+        value = std::move(slot.mValue);
+        slot.mValue = T{};
+        slot.mSeq.store(mHead + mMask + 1, std::memory_order_release);
+        mHead++;
+        return true;
+    }
+};
+}
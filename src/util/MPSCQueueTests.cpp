@@ -0,0 +1,74 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/MPSCQueue.h"
+
+#include <thread>
+#include <vector>
+
+using namespace stellar;
+
+TEST_CASE("mpsc queue", "[mpscqueue]")
+{
+    SECTION("full and empty")
+    {
+        MPSCQueue<int> queue(4);
+        int v;
+        REQUIRE(!queue.tryPop(v));
+        for (int i = 0; i < 4; i++)
+        {
+            REQUIRE(queue.tryPush(int{i}));
+        }
+        REQUIRE(!queue.tryPush(4));
+        for (int i = 0; i < 4; i++)
+        {
+            REQUIRE(queue.tryPop(v));
+            REQUIRE(v == i);
+        }
+        REQUIRE(!queue.tryPop(v));
+    }
+
+    SECTION("concurrent producers")
+    {
+        int const producers = 4;
+        int const perProducer = 100000;
+        MPSCQueue<std::pair<int, int>> queue(1024);
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; p++)
+        {
+            threads.emplace_back([&queue, p]() {
+                for (int i = 0; i < perProducer; i++)
+                {
+                    while (!queue.tryPush(std::make_pair(p, i)))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        // values of each producer come out in order
+        std::vector<int> next(producers, 0);
+        int popped = 0;
+        while (popped < producers * perProducer)
+        {
+            std::pair<int, int> v;
+            if (queue.tryPop(v))
+            {
+                REQUIRE(v.second == next[v.first]);
+                next[v.first]++;
+                popped++;
+            }
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        for (auto n : next)
+        {
+            REQUIRE(n == perProducer);
+        }
+    }
+}
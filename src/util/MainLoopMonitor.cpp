@@ -0,0 +1,169 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/MainLoopMonitor.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/stats/snapshot.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+std::chrono::milliseconds const MainLoopMonitor::DEFAULT_STALL_THRESHOLD{
+    1000};
+size_t const MainLoopMonitor::KEPT_STALLS = 16;
+
+MainLoopMonitor::Measure::Measure(MainLoopMonitor& monitor,
+                                  char const* category)
+    : mMonitor(monitor)
+    , mCategory(category)
+    , mStart(clock::now())
+    , mOuterNested(monitor.mNested)
+{
+    mMonitor.mNested = clock::duration::zero();
+}
+
+MainLoopMonitor::Measure::~Measure()
+{
+    auto elapsed = clock::now() - mStart;
+    if (!mDiscarded)
+    {
+        mMonitor.record(mCategory, elapsed - mMonitor.mNested);
+    }
+    mMonitor.mNested = mOuterNested + elapsed;
+}
+
+void
+MainLoopMonitor::Measure::discard()
+{
+    mDiscarded = true;
+}
+
+MainLoopMonitor::Metrics&
+MainLoopMonitor::getMetrics(char const* category)
+{
+    auto& res = mMetrics[category];
+    if (!res.mHandler)
+    {
+        res.mHandler = &mRegistry->NewTimer({"loop", "handler", category});
+        res.mLag = &mRegistry->NewTimer({"loop", "lag", category});
+    }
+    return res;
+}
+
+void
+MainLoopMonitor::record(char const* category, clock::duration duration)
+{
+    if (mRegistry)
+    {
+        getMetrics(category).mHandler->Update(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration));
+    }
+    if (duration < mStallThreshold)
+    {
+        return;
+    }
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+    LOG(WARNING) << "Main thread stalled by a '" << category
+                 << "' handler running for " << ms.count() << "ms";
+    mStallCount++;
+    mStalls.emplace_back(
+        Stall{category, ms, std::chrono::system_clock::now()});
+    if (mStalls.size() > KEPT_STALLS)
+    {
+        mStalls.pop_front();
+    }
+}
+
+void
+MainLoopMonitor::setMetrics(medida::MetricsRegistry* registry)
+{
+    mRegistry = registry;
+    mMetrics.clear();
+}
+
+medida::MetricsRegistry*
+MainLoopMonitor::getMetricsRegistry() const
+{
+    return mRegistry;
+}
+
+void
+MainLoopMonitor::setStallThreshold(std::chrono::milliseconds threshold)
+{
+    mStallThreshold = threshold;
+}
+
+void
+MainLoopMonitor::noteLag(char const* category, std::chrono::nanoseconds lag)
+{
+    if (mRegistry)
+    {
+        getMetrics(category).mLag->Update(
+            std::max(lag, std::chrono::nanoseconds::zero()));
+    }
+}
+
+void
+MainLoopMonitor::notePosted()
+{
+    mQueued.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+MainLoopMonitor::noteDequeued()
+{
+    mQueued.fetch_sub(1, std::memory_order_relaxed);
+}
+
+uint64_t
+MainLoopMonitor::getStallCount() const
+{
+    return mStallCount;
+}
+
+Json::Value
+MainLoopMonitor::getJsonInfo() const
+{
+    Json::Value res;
+    res["queued"] = static_cast<Json::Int64>(mQueued.load());
+    res["stall_threshold_ms"] =
+        static_cast<Json::Int64>(mStallThreshold.count());
+    res["stalls"] = static_cast<Json::UInt64>(mStallCount);
+    auto& recent = res["recent_stalls"];
+    recent = Json::arrayValue;
+    for (auto const& s : mStalls)
+    {
+        Json::Value stall;
+        stall["category"] = s.mCategory;
+        stall["ms"] = static_cast<Json::Int64>(s.mDuration.count());
+        stall["at"] = VirtualClock::pointToISOString(s.mAt);
+        recent.append(stall);
+    }
+
+    auto describe = [](medida::Timer& timer) {
+        Json::Value t;
+        t["count"] = static_cast<Json::UInt64>(timer.count());
+        t["mean_ms"] = timer.mean();
+        t["p99_ms"] = timer.GetSnapshot().get99thPercentile();
+        t["max_ms"] = timer.max();
+        return t;
+    };
+    for (auto const& kv : mMetrics)
+    {
+        res["handlers"][kv.first] = describe(*kv.second.mHandler);
+        if (kv.second.mLag->count() != 0)
+        {
+            res["lag"][kv.first] = describe(*kv.second.mLag);
+        }
+    }
+    return res;
+}
+}
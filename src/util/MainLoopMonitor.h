@@ -0,0 +1,116 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+#include "util/NonCopyable.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+
+namespace medida
+{
+class MetricsRegistry;
+class Timer;
+}
+
+namespace stellar
+{
+
+/**
+ * Measures the handlers run by the main thread in VirtualClock::crank, to
+ * tell what keeps the main loop busy when a node is slow.
+ *
+ * Every handler is timed, under its category: "timer" for VirtualTimer
+ * callbacks, "io" for the handlers of the io_service (network, and what is
+ * posted to it directly) and, for the handlers posted with postToMain, the
+ * category they were posted with. The time of a handler does not include
+ * the handlers it runs itself (the timers and completions that an io
+ * handler dispatches are their own). For timers and postToMain handlers,
+ * the scheduling lag, from when they were due or posted to when they ran,
+ * is measured too; the io_service does not tell when its handlers were
+ * posted.
+ *
+ * Times go to the timers "loop.handler.<category>" and "loop.lag.<category>"
+ * of the registry set with setMetrics. Handlers running longer than the
+ * stall threshold are logged, and the last KEPT_STALLS of them reported by
+ * getJsonInfo, with the number of postToMain handlers waiting.
+ */
+class MainLoopMonitor : NonMovableOrCopyable
+{
+  public:
+    typedef std::chrono::steady_clock clock;
+
+    static std::chrono::milliseconds const DEFAULT_STALL_THRESHOLD;
+    static size_t const KEPT_STALLS;
+
+    // times a handler of @p category, which must be a string literal, from
+    // construction to destruction
+    class Measure : NonMovableOrCopyable
+    {
+        MainLoopMonitor& mMonitor;
+        char const* const mCategory;
+        clock::time_point const mStart;
+        clock::duration const mOuterNested;
+        bool mDiscarded{false};
+
+      public:
+        Measure(MainLoopMonitor& monitor, char const* category);
+        ~Measure();
+
+        // no handler ran after all: nothing is recorded
+        void discard();
+    };
+
+  private:
+    struct Metrics
+    {
+        medida::Timer* mHandler{nullptr};
+        medida::Timer* mLag{nullptr};
+    };
+
+    struct Stall
+    {
+        std::string mCategory;
+        std::chrono::milliseconds mDuration;
+        std::chrono::system_clock::time_point mAt;
+    };
+
+    medida::MetricsRegistry* mRegistry{nullptr};
+    // by category; literals of the same text in different translation units
+    // have their own entries, for the same timers
+    std::map<char const*, Metrics> mMetrics;
+    std::chrono::milliseconds mStallThreshold{DEFAULT_STALL_THRESHOLD};
+    uint64_t mStallCount{0};
+    std::deque<Stall> mStalls;
+    // the time of the handlers run by the handler being measured
+    clock::duration mNested{0};
+    // postToMain handlers waiting, updated by any thread
+    std::atomic<int64_t> mQueued{0};
+
+    Metrics& getMetrics(char const* category);
+    void record(char const* category, clock::duration duration);
+
+  public:
+    // @p registry null stops the timers; it must outlive the monitor, or be
+    // unset before it is destroyed
+    void setMetrics(medida::MetricsRegistry* registry);
+    medida::MetricsRegistry* getMetricsRegistry() const;
+
+    void setStallThreshold(std::chrono::milliseconds threshold);
+
+    // the handler of @p category about to run has waited for @p lag
+    void noteLag(char const* category, std::chrono::nanoseconds lag);
+
+    void notePosted();
+    void noteDequeued();
+
+    uint64_t getStallCount() const;
+    Json::Value getJsonInfo() const;
+};
+}
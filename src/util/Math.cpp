@@ -3,19 +3,70 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "Math.h"
+#include <atomic>
 #include <cmath>
 
 namespace stellar
 {
 
-std::default_random_engine gRandomEngine;
-std::uniform_real_distribution<double> uniformFractionDistribution(0.0, 1.0);
-std::bernoulli_distribution bernoulliDistribution{0.5};
+namespace
+{
+
+uint64_t
+splitmix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+std::atomic<uint64_t>&
+baseSeed()
+{
+    static std::atomic<uint64_t> seed{
+        (static_cast<uint64_t>(std::random_device()()) << 32) ^
+        std::random_device()()};
+    return seed;
+}
+
+std::atomic<uint64_t> gThreadsSeeded{0};
+
+RandomEngine
+makeThreadEngine()
+{
+    return RandomEngine(baseSeed() + gThreadsSeeded++);
+}
+}
+
+thread_local RandomEngine gRandomEngine = makeThreadEngine();
+
+RandomEngine::RandomEngine(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+void
+RandomEngine::seed(uint64_t seed)
+{
+    for (auto& s : mState)
+    {
+        s = splitmix64(seed);
+    }
+}
+
+void
+reseedRandomEngines(uint64_t seed)
+{
+    baseSeed() = seed;
+    gThreadsSeeded = 1;
+    gRandomEngine.seed(seed);
+}
 
 double
 rand_fraction()
 {
-    return uniformFractionDistribution(gRandomEngine);
+    return std::uniform_real_distribution<double>(0.0, 1.0)(gRandomEngine);
 }
 
 size_t
@@ -32,6 +83,6 @@ rand_pareto(float alpha, size_t max)
 bool
 rand_flip()
 {
-    return bernoulliDistribution(gRandomEngine);
+    return (gRandomEngine() >> 63) != 0;
 }
 }
@@ -4,20 +4,79 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <random>
 #include <stdexcept>
+#include <vector>
 
 namespace stellar
 {
+
+// xoshiro256**: fast, with 256 bits of state, and usable with the <random>
+// distributions. Not for anything secret (see crypto/Random.h).
+class RandomEngine
+{
+    uint64_t mState[4];
+
+    static uint64_t
+    rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+  public:
+    typedef uint64_t result_type;
+
+    explicit RandomEngine(uint64_t seed = 0);
+
+    // the state is expanded from the seed with splitmix64
+    void seed(uint64_t seed);
+
+    result_type
+    operator()()
+    {
+        uint64_t result = rotl(mState[1] * 5, 7) * 9;
+        uint64_t t = mState[1] << 17;
+        mState[2] ^= mState[0];
+        mState[3] ^= mState[1];
+        mState[1] ^= mState[2];
+        mState[0] ^= mState[3];
+        mState[2] ^= t;
+        mState[3] = rotl(mState[3], 45);
+        return result;
+    }
+
+    static constexpr result_type
+    min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type
+    max()
+    {
+        return UINT64_MAX;
+    }
+};
+
+// Each thread has an engine of its own, so the functions below can be called
+// from any thread. An engine is seeded when its thread first uses it, from
+// the seed set by reseedRandomEngines (random by default) and the number of
+// threads seeded before it.
+extern thread_local RandomEngine gRandomEngine;
+
+// Sets the seed (Config::RANDOM_SEED_FOR_TESTING) and reseeds the engine of
+// the calling thread with it. Threads that already have an engine keep it.
+void reseedRandomEngines(uint64_t seed);
+
 double rand_fraction();
 
 size_t rand_pareto(float alpha, size_t max);
 
 bool rand_flip();
 
-extern std::default_random_engine gRandomEngine;
-
 template <typename T>
 T
 rand_uniform(T lo, T hi)
@@ -35,4 +94,11 @@ rand_element(std::vector<T> const& v)
     }
     return v.at(rand_uniform<size_t>(0, v.size() - 1));
 }
+
+template <typename It>
+void
+rand_shuffle(It begin, It end)
+{
+    std::shuffle(begin, end, gRandomEngine);
+}
 }
@@ -0,0 +1,68 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/Math.h"
+
+#include <thread>
+
+using namespace stellar;
+
+TEST_CASE("random engine", "[random]")
+{
+    auto draw = []() {
+        std::vector<uint64_t> res;
+        for (int i = 0; i < 16; i++)
+        {
+            res.emplace_back(rand_uniform<uint64_t>(0, UINT64_MAX));
+        }
+        return res;
+    };
+
+    SECTION("reseeding repeats the numbers")
+    {
+        reseedRandomEngines(42);
+        auto a = draw();
+        reseedRandomEngines(42);
+        REQUIRE(draw() == a);
+        reseedRandomEngines(43);
+        REQUIRE(draw() != a);
+    }
+
+    SECTION("threads draw different numbers")
+    {
+        reseedRandomEngines(42);
+        auto a = draw();
+        std::vector<uint64_t> b, c;
+        std::thread tb([&]() { b = draw(); });
+        std::thread tc([&]() { c = draw(); });
+        tb.join();
+        tc.join();
+        REQUIRE(a != b);
+        REQUIRE(a != c);
+        REQUIRE(b != c);
+    }
+
+    SECTION("ranges")
+    {
+        std::vector<size_t> counts(4, 0);
+        for (int i = 0; i < 4000; i++)
+        {
+            counts[rand_uniform<size_t>(0, 3)]++;
+            auto f = rand_fraction();
+            REQUIRE(f >= 0.0);
+            REQUIRE(f < 1.0);
+        }
+        for (auto c : counts)
+        {
+            REQUIRE(c > 800);
+        }
+
+        std::vector<int> v{1, 2, 3, 4, 5, 6, 7, 8};
+        auto sorted = v;
+        rand_shuffle(v.begin(), v.end());
+        std::sort(v.begin(), v.end());
+        REQUIRE(v == sorted);
+    }
+}
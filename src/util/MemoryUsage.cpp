@@ -0,0 +1,27 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/MemoryUsage.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+size_t const MemoryUsage::NODE_OVERHEAD;
+
+std::atomic<bool> MemoryCounter::gEnabled{false};
+
+MemoryUsage
+MemoryCounter::get() const
+{
+    // the holders may be updating it: the two may be a little apart
+    MemoryUsage res;
+    res.mBytes = static_cast<uint64_t>(
+        std::max<int64_t>(0, mBytes.load(std::memory_order_relaxed)));
+    res.mObjects = static_cast<uint64_t>(
+        std::max<int64_t>(0, mObjects.load(std::memory_order_relaxed)));
+    return res;
+}
+}
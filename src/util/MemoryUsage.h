@@ -0,0 +1,88 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "xdrpp/marshal.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace stellar
+{
+
+/**
+ * An estimate of the memory a structure holds, in bytes and objects
+ * (records, entries, envelopes...), for the memory.* metrics that
+ * Application::getMemoryUsage feeds when MEMORY_ACCOUNTING is set.
+ *
+ * Estimates add up the objects, what they own on the heap as far as it can
+ * be told cheaply (an XDR value counts for its XDR size, which is close to
+ * what its strings and vectors hold) and the nodes of the containers they
+ * are in; the overhead and fragmentation of the allocator are left out.
+ * Structures are walked to compute them, so they are only computed on
+ * demand.
+ */
+struct MemoryUsage
+{
+    // the heap overhead of each element of a node based container
+    // (std::list, std::map, std::set, the std::unordered ones)
+    static size_t const NODE_OVERHEAD = 4 * sizeof(void*);
+
+    uint64_t mBytes{0};
+    uint64_t mObjects{0};
+
+    // counts an object of @p bytes
+    void
+    add(size_t bytes)
+    {
+        mBytes += bytes;
+        mObjects++;
+    }
+
+    MemoryUsage&
+    operator+=(MemoryUsage const& other)
+    {
+        mBytes += other.mBytes;
+        mObjects += other.mObjects;
+        return *this;
+    }
+};
+
+// the memory of an XDR value
+template <typename T>
+size_t
+xdrMemoryUsage(T const& t)
+{
+    return sizeof(T) + xdr::xdr_size(t);
+}
+
+// by subsystem, the names of the memory.* metrics
+typedef std::map<std::string, MemoryUsage> MemoryUsageReport;
+
+/**
+ * For the memory held for a while by other threads, which can't be walked:
+ * kept up to date by its holders, as long as MEMORY_ACCOUNTING is set.
+ */
+class MemoryCounter
+{
+    std::atomic<int64_t> mBytes{0};
+    std::atomic<int64_t> mObjects{0};
+
+  public:
+    static std::atomic<bool> gEnabled;
+
+    void
+    add(int64_t bytes, int64_t objects)
+    {
+        mBytes.fetch_add(bytes, std::memory_order_relaxed);
+        mObjects.fetch_add(objects, std::memory_order_relaxed);
+    }
+
+    MemoryUsage get() const;
+};
+}
@@ -32,8 +32,9 @@ NtpWork::onRun()
 {
     std::weak_ptr<NtpWork> weak =
         std::static_pointer_cast<NtpWork>(shared_from_this());
+    auto& workers = app().getWorkerIOService(Application::WORKER_POOL_MISC);
     mNtpClient =
-        std::make_shared<NtpClient>(app().getWorkerIOService(), mNtpServer,
+        std::make_shared<NtpClient>(workers, mNtpServer,
                                     [weak](long time) {
                                         auto self = weak.lock();
                                         if (self)
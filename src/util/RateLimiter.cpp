@@ -0,0 +1,45 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/RateLimiter.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace stellar
+{
+
+std::chrono::milliseconds const RateLimiter::BURST(100);
+
+RateLimiter::RateLimiter(uint64_t unitsPerSecond)
+    : mUnitsPerSecond(unitsPerSecond)
+    , mPaidUntil(std::chrono::steady_clock::now())
+{
+}
+
+void
+RateLimiter::consume(uint64_t units)
+{
+    if (mUnitsPerSecond == 0)
+    {
+        return;
+    }
+
+    std::chrono::steady_clock::duration wait;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto now = std::chrono::steady_clock::now();
+        // time not used while idle is only credited up to BURST
+        mPaidUntil = std::max(mPaidUntil, now - BURST);
+        mPaidUntil += std::chrono::duration_cast<
+            std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+            static_cast<double>(units) / mUnitsPerSecond));
+        wait = mPaidUntil - now;
+    }
+    if (wait > std::chrono::steady_clock::duration::zero())
+    {
+        std::this_thread::sleep_for(wait);
+    }
+}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace stellar
+{
+
+/**
+ * Limits the rate at which some resource (bytes written, typically) is
+ * consumed by any number of threads, by making `consume` sleep whenever the
+ * callers get ahead of `unitsPerSecond`. Up to BURST worth of units can be
+ * consumed without sleeping after an idle period.
+ *
+ * A rate of 0 means no limit.
+ */
+class RateLimiter : NonMovableOrCopyable
+{
+    std::mutex mMutex;
+    uint64_t const mUnitsPerSecond;
+    // time at which everything consumed so far is paid for
+    std::chrono::steady_clock::time_point mPaidUntil;
+
+  public:
+    static std::chrono::milliseconds const BURST;
+
+    explicit RateLimiter(uint64_t unitsPerSecond);
+
+    void consume(uint64_t units);
+};
+}
@@ -0,0 +1,285 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/SamplingProfiler.h"
+#include "lib/util/format.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/time.h>
+#endif
+
+namespace stellar
+{
+namespace profiler
+{
+
+size_t const MAX_PHASES = 4;
+size_t const MAX_DEPTH = 48;
+size_t const MAX_SAMPLES = 1 << 14;
+
+namespace
+{
+thread_local Phase* tPhase = nullptr;
+}
+
+Phase::Phase(char const* name) : mName(name), mParent(tPhase)
+{
+    tPhase = this;
+}
+
+Phase::~Phase()
+{
+    tPhase = mParent;
+}
+
+#ifdef _WIN32
+
+bool
+isSupported()
+{
+    return false;
+}
+
+bool
+isRunning()
+{
+    return false;
+}
+
+void
+start(unsigned)
+{
+    throw std::runtime_error("The profiler is not supported on this platform");
+}
+
+std::string
+stop(size_t& samples, size_t& dropped)
+{
+    samples = 0;
+    dropped = 0;
+    return std::string();
+}
+
+#else
+
+namespace
+{
+// the signal handler and the signal frame, at the top of every stack
+size_t const SKIPPED_FRAMES = 2;
+
+struct Sample
+{
+    char const* mPhases[MAX_PHASES]; // innermost first
+    size_t mPhaseCount;
+    void* mFrames[MAX_DEPTH];
+    int mDepth;
+    std::atomic<bool> mReady;
+};
+
+// start and stop
+std::mutex gMutex;
+std::unique_ptr<Sample[]> gBuffer;
+struct sigaction gPreviousAction;
+
+// what the signal handler uses
+std::atomic<Sample*> gSamples{nullptr};
+std::atomic<size_t> gNext{0};
+std::atomic<size_t> gInFlight{0};
+
+void
+onSignal(int)
+{
+    int savedErrno = errno;
+    gInFlight++;
+    auto samples = gSamples.load();
+    if (samples)
+    {
+        auto i = gNext++;
+        if (i < MAX_SAMPLES)
+        {
+            auto& s = samples[i];
+            s.mDepth = backtrace(s.mFrames, static_cast<int>(MAX_DEPTH));
+            s.mPhaseCount = 0;
+            for (auto p = tPhase; p && s.mPhaseCount < MAX_PHASES;
+                 p = p->getParent())
+            {
+                s.mPhases[s.mPhaseCount++] = p->getName();
+            }
+            s.mReady.store(true, std::memory_order_release);
+        }
+    }
+    gInFlight--;
+    errno = savedErrno;
+}
+
+std::string
+frameName(void* address)
+{
+    Dl_info info;
+    if (!dladdr(address, &info))
+    {
+        return fmt::format("0x{:x}", reinterpret_cast<uintptr_t>(address));
+    }
+    if (info.dli_sname)
+    {
+        int status = 0;
+        char* demangled =
+            abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string res = status == 0 ? demangled : info.dli_sname;
+        std::free(demangled);
+        // ';' separates the frames of a collapsed stack
+        std::replace(res.begin(), res.end(), ';', ':');
+        return res;
+    }
+    std::string module = info.dli_fname ? info.dli_fname : "?";
+    module = module.substr(module.find_last_of('/') + 1);
+    return fmt::format("{}+0x{:x}", module,
+                       reinterpret_cast<uintptr_t>(address) -
+                           reinterpret_cast<uintptr_t>(info.dli_fbase));
+}
+}
+
+bool
+isSupported()
+{
+    return true;
+}
+
+bool
+isRunning()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    return gBuffer != nullptr;
+}
+
+void
+start(unsigned frequency)
+{
+    if (frequency == 0 || frequency > 1000)
+    {
+        throw std::invalid_argument(
+            "The frequency must be between 1 and 1000 samples per second");
+    }
+
+    std::lock_guard<std::mutex> lock(gMutex);
+    if (gBuffer)
+    {
+        throw std::runtime_error("The profiler is already running");
+    }
+
+    // the first call loads what backtrace needs, which may allocate: not
+    // from the signal handler
+    void* frame;
+    backtrace(&frame, 1);
+
+    gBuffer.reset(new Sample[MAX_SAMPLES]());
+    gNext = 0;
+    gSamples = gBuffer.get();
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &gPreviousAction);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / frequency;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0)
+    {
+        sigaction(SIGPROF, &gPreviousAction, nullptr);
+        gSamples = nullptr;
+        gBuffer.reset();
+        throw std::runtime_error("Could not arm the profiling timer");
+    }
+}
+
+std::string
+stop(size_t& samples, size_t& dropped)
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    samples = 0;
+    dropped = 0;
+    if (!gBuffer)
+    {
+        return std::string();
+    }
+
+    struct itimerval timer;
+    std::memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    // a signal already delivered finds no samples, then the ones being
+    // taken are waited for
+    gSamples = nullptr;
+    while (gInFlight != 0)
+    {
+        std::this_thread::yield();
+    }
+    sigaction(SIGPROF, &gPreviousAction, nullptr);
+
+    std::map<void*, std::string> names;
+    std::map<std::string, size_t> stacks;
+    auto taken = std::min<size_t>(gNext, MAX_SAMPLES);
+    for (size_t i = 0; i < taken; i++)
+    {
+        auto const& s = gBuffer[i];
+        if (!s.mReady.load(std::memory_order_acquire))
+        {
+            continue;
+        }
+        std::string stack;
+        for (size_t p = s.mPhaseCount; p-- > 0;)
+        {
+            stack.append(s.mPhases[p]).append(";");
+        }
+        for (auto f = static_cast<size_t>(s.mDepth); f-- > SKIPPED_FRAMES;)
+        {
+            auto it = names.find(s.mFrames[f]);
+            if (it == names.end())
+            {
+                it = names.emplace(s.mFrames[f], frameName(s.mFrames[f]))
+                         .first;
+            }
+            stack.append(it->second).append(";");
+        }
+        if (!stack.empty())
+        {
+            stack.pop_back();
+            stacks[stack]++;
+            samples++;
+        }
+    }
+    dropped = gNext - samples;
+    gBuffer.reset();
+
+    std::string res;
+    for (auto const& kv : stacks)
+    {
+        res.append(kv.first).append(" ").append(std::to_string(kv.second));
+        res.append("\n");
+    }
+    return res;
+}
+
+#endif
+}
+}
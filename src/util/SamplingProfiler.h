@@ -0,0 +1,88 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstddef>
+#include <string>
+
+// A sampling profiler, to capture on demand (see the profile route) where a
+// running node spends its CPU time: while it runs, the CPU time of the
+// process is sampled with SIGPROF, and the stack of the thread interrupted
+// is saved, with the phases it was in (ledger close, catchup apply, SCP
+// processing...):
+//
+//     void
+//     LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
+//     {
+//         PROFILE_PHASE("ledger-close");
+//         ...
+//
+// Stacks are reported in the collapsed format of flamegraph.pl and
+// speedscope, one line per distinct stack, from the phases to the innermost
+// frame, followed by the number of samples. Frames are named with dladdr,
+// so functions not exported by the executable (static ones, or all of them
+// when not linked with -rdynamic) show as their module and offset.
+//
+// When it is not running, no timer is armed and the samples are freed: all
+// that is left is the cost of maintaining the phases of each thread.
+
+namespace stellar
+{
+
+namespace profiler
+{
+
+// phases kept for a sample, innermost last
+extern size_t const MAX_PHASES;
+// frames kept for a sample, innermost first
+extern size_t const MAX_DEPTH;
+// samples kept by a capture, the ones after are counted as dropped
+extern size_t const MAX_SAMPLES;
+
+// whether the platform supports it
+bool isSupported();
+
+bool isRunning();
+
+// starts sampling at @p frequency samples per second of CPU time; throws
+// if already running or not supported
+void start(unsigned frequency);
+
+// stops sampling and returns the samples taken, collapsed; @p samples and
+// @p dropped get the number of samples kept and not
+std::string stop(size_t& samples, size_t& dropped);
+
+// the phase of the calling thread for its lifetime, @p name must be a
+// string literal
+class Phase
+{
+    char const* const mName;
+    Phase* const mParent;
+
+  public:
+    explicit Phase(char const* name);
+    ~Phase();
+    Phase(Phase const&) = delete;
+    Phase& operator=(Phase const&) = delete;
+
+    char const*
+    getName() const
+    {
+        return mName;
+    }
+    Phase*
+    getParent() const
+    {
+        return mParent;
+    }
+};
+}
+}
+
+#define PROFILE_PHASE_CONCAT2(a, b) a##b
+#define PROFILE_PHASE_CONCAT(a, b) PROFILE_PHASE_CONCAT2(a, b)
+#define PROFILE_PHASE(name)                                                    \
+    stellar::profiler::Phase PROFILE_PHASE_CONCAT(profilePhase,                \
+                                                  __LINE__)(name)
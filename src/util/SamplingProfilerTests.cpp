@@ -0,0 +1,81 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/SamplingProfiler.h"
+
+#include "lib/catch.hpp"
+#include <chrono>
+#include <sstream>
+#include <string>
+
+using namespace stellar;
+
+namespace
+{
+volatile uint64_t gSink;
+
+void
+spin(std::chrono::milliseconds duration)
+{
+    PROFILE_PHASE("spinning");
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            gSink = gSink * 31 + i;
+        }
+    }
+}
+}
+
+TEST_CASE("sampling profiler", "[profiler]")
+{
+    if (!profiler::isSupported())
+    {
+        REQUIRE_THROWS_AS(profiler::start(100), std::runtime_error);
+        return;
+    }
+
+    REQUIRE(!profiler::isRunning());
+    REQUIRE_THROWS_AS(profiler::start(0), std::invalid_argument);
+
+    profiler::start(1000);
+    REQUIRE(profiler::isRunning());
+    REQUIRE_THROWS_AS(profiler::start(1000), std::runtime_error);
+    {
+        PROFILE_PHASE("test");
+        spin(std::chrono::milliseconds(300));
+    }
+
+    size_t samples, dropped;
+    auto collapsed = profiler::stop(samples, dropped);
+    REQUIRE(!profiler::isRunning());
+    REQUIRE(samples != 0);
+    REQUIRE(dropped == 0);
+
+    // "<phases and frames, ';' separated> <count>" per line
+    std::istringstream lines(collapsed);
+    std::string line;
+    size_t total = 0;
+    size_t inPhases = 0;
+    while (std::getline(lines, line))
+    {
+        auto space = line.rfind(' ');
+        REQUIRE(space != std::string::npos);
+        auto count = std::stoul(line.substr(space + 1));
+        total += count;
+        if (line.compare(0, 14, "test;spinning;") == 0)
+        {
+            inPhases += count;
+        }
+    }
+    REQUIRE(total == samples);
+    // most of the CPU time went to spinning
+    REQUIRE(inPhases * 2 > samples);
+
+    // nothing is left to report
+    REQUIRE(profiler::stop(samples, dropped).empty());
+    REQUIRE(samples == 0);
+}
@@ -0,0 +1,241 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/ShardedMetrics.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+namespace stellar
+{
+
+size_t const ShardedMetrics::SHARDS;
+uint64_t const ShardedMetrics::FLUSH_THRESHOLD;
+
+namespace
+{
+// threads get their shard in turn, so that SHARDS threads never share one
+size_t
+shardIndex()
+{
+    static std::atomic<size_t> next{0};
+    thread_local size_t index = next++ % ShardedMetrics::SHARDS;
+    return index;
+}
+}
+
+ShardedCounter::ShardedCounter(medida::Counter& target) : mTarget(target)
+{
+}
+
+void
+ShardedCounter::inc(int64_t n)
+{
+    auto& pending = mShards[shardIndex()].mPending;
+    auto v = pending.fetch_add(n, std::memory_order_relaxed) + n;
+    auto const threshold =
+        static_cast<int64_t>(ShardedMetrics::FLUSH_THRESHOLD);
+    if (v >= threshold || v <= -threshold)
+    {
+        mTarget.inc(pending.exchange(0, std::memory_order_relaxed));
+    }
+}
+
+void
+ShardedCounter::dec(int64_t n)
+{
+    inc(-n);
+}
+
+int64_t
+ShardedCounter::count() const
+{
+    int64_t res = mTarget.count();
+    for (auto const& s : mShards)
+    {
+        res += s.mPending.load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+void
+ShardedCounter::sync()
+{
+    for (auto& s : mShards)
+    {
+        auto v = s.mPending.exchange(0, std::memory_order_relaxed);
+        if (v != 0)
+        {
+            mTarget.inc(v);
+        }
+    }
+}
+
+ShardedMeter::ShardedMeter(medida::Meter& target) : mTarget(target)
+{
+}
+
+void
+ShardedMeter::Mark(uint64_t n)
+{
+    auto& pending = mShards[shardIndex()].mPending;
+    if (pending.fetch_add(n, std::memory_order_relaxed) + n >=
+        ShardedMetrics::FLUSH_THRESHOLD)
+    {
+        auto v = pending.exchange(0, std::memory_order_relaxed);
+        if (v != 0)
+        {
+            mTarget.Mark(v);
+        }
+    }
+}
+
+uint64_t
+ShardedMeter::count() const
+{
+    uint64_t res = mTarget.count();
+    for (auto const& s : mShards)
+    {
+        res += s.mPending.load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+void
+ShardedMeter::sync()
+{
+    for (auto& s : mShards)
+    {
+        auto v = s.mPending.exchange(0, std::memory_order_relaxed);
+        if (v != 0)
+        {
+            mTarget.Mark(v);
+        }
+    }
+}
+
+ShardedTimer::ShardedTimer(medida::Timer& target) : mTarget(target)
+{
+}
+
+void
+ShardedTimer::flush(std::vector<std::chrono::nanoseconds> const& samples)
+{
+    for (auto const& d : samples)
+    {
+        mTarget.Update(d);
+    }
+}
+
+void
+ShardedTimer::Update(std::chrono::nanoseconds duration)
+{
+    auto& shard = mShards[shardIndex()];
+    std::vector<std::chrono::nanoseconds> full;
+    {
+        std::lock_guard<std::mutex> lock(shard.mMutex);
+        shard.mPending.emplace_back(duration);
+        if (shard.mPending.size() < ShardedMetrics::FLUSH_THRESHOLD)
+        {
+            return;
+        }
+        full.swap(shard.mPending);
+    }
+    flush(full);
+}
+
+uint64_t
+ShardedTimer::count() const
+{
+    uint64_t res = mTarget.count();
+    for (auto const& s : mShards)
+    {
+        std::lock_guard<std::mutex> lock(s.mMutex);
+        res += s.mPending.size();
+    }
+    return res;
+}
+
+void
+ShardedTimer::sync()
+{
+    for (auto& s : mShards)
+    {
+        std::vector<std::chrono::nanoseconds> pending;
+        {
+            std::lock_guard<std::mutex> lock(s.mMutex);
+            pending.swap(s.mPending);
+        }
+        flush(pending);
+    }
+}
+
+ShardedMetrics::ShardedMetrics(medida::MetricsRegistry& registry)
+    : mRegistry(registry)
+{
+}
+
+ShardedMetrics::~ShardedMetrics()
+{
+    sync();
+}
+
+ShardedCounter&
+ShardedMetrics::NewCounter(medida::MetricName const& name)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& res = mCounters[name];
+    if (!res)
+    {
+        res = std::make_unique<ShardedCounter>(mRegistry.NewCounter(name));
+    }
+    return *res;
+}
+
+ShardedMeter&
+ShardedMetrics::NewMeter(medida::MetricName const& name,
+                         std::string const& eventType)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& res = mMeters[name];
+    if (!res)
+    {
+        res = std::make_unique<ShardedMeter>(
+            mRegistry.NewMeter(name, eventType));
+    }
+    return *res;
+}
+
+ShardedTimer&
+ShardedMetrics::NewTimer(medida::MetricName const& name)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& res = mTimers[name];
+    if (!res)
+    {
+        res = std::make_unique<ShardedTimer>(mRegistry.NewTimer(name));
+    }
+    return *res;
+}
+
+void
+ShardedMetrics::sync()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& kv : mCounters)
+    {
+        kv.second->sync();
+    }
+    for (auto& kv : mMeters)
+    {
+        kv.second->sync();
+    }
+    for (auto& kv : mTimers)
+    {
+        kv.second->sync();
+    }
+}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include "medida/metric_name.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace medida
+{
+class MetricsRegistry;
+class Counter;
+class Meter;
+class Timer;
+}
+
+namespace stellar
+{
+
+class ShardedCounter;
+class ShardedMeter;
+class ShardedTimer;
+
+/**
+ * Handles on metrics of a medida::MetricsRegistry for code updating them from
+ * several threads at once (signature checks, merges...), where the locks and
+ * shared cache lines of the medida metrics would be contended.
+ *
+ * Each thread updates a shard of its own, and the shards are added to the
+ * medida metric every FLUSH_THRESHOLD events and by sync (see
+ * Application::syncAllMetrics): the registry, the metrics route and
+ * MetricResetter keep working on the medida metrics, which lag behind by
+ * what the shards did not flush yet, while count() adds it. Handles are
+ * registered once, up front, and live as long as the ShardedMetrics.
+ */
+class ShardedMetrics : NonMovableOrCopyable
+{
+  public:
+    static size_t const SHARDS = 16;
+    static uint64_t const FLUSH_THRESHOLD = 64;
+
+    explicit ShardedMetrics(medida::MetricsRegistry& registry);
+    ~ShardedMetrics();
+
+    // as the functions of medida::MetricsRegistry, a name always gets the
+    // same handle
+    ShardedCounter& NewCounter(medida::MetricName const& name);
+    ShardedMeter& NewMeter(medida::MetricName const& name,
+                           std::string const& eventType);
+    ShardedTimer& NewTimer(medida::MetricName const& name);
+
+    // adds what the shards of every handle have to their medida metrics
+    void sync();
+
+  private:
+    medida::MetricsRegistry& mRegistry;
+    std::mutex mMutex;
+    std::map<medida::MetricName, std::unique_ptr<ShardedCounter>> mCounters;
+    std::map<medida::MetricName, std::unique_ptr<ShardedMeter>> mMeters;
+    std::map<medida::MetricName, std::unique_ptr<ShardedTimer>> mTimers;
+};
+
+class ShardedCounter : NonMovableOrCopyable
+{
+    struct Shard
+    {
+        std::atomic<int64_t> mPending{0};
+        char mPad[64 - sizeof(std::atomic<int64_t>)];
+    };
+    medida::Counter& mTarget;
+    std::array<Shard, ShardedMetrics::SHARDS> mShards;
+
+  public:
+    explicit ShardedCounter(medida::Counter& target);
+    void inc(int64_t n = 1);
+    void dec(int64_t n = 1);
+    int64_t count() const;
+    void sync();
+};
+
+class ShardedMeter : NonMovableOrCopyable
+{
+    struct Shard
+    {
+        std::atomic<uint64_t> mPending{0};
+        char mPad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    medida::Meter& mTarget;
+    std::array<Shard, ShardedMetrics::SHARDS> mShards;
+
+  public:
+    explicit ShardedMeter(medida::Meter& target);
+    void Mark(uint64_t n = 1);
+    uint64_t count() const;
+    void sync();
+};
+
+class ShardedTimer : NonMovableOrCopyable
+{
+    struct Shard
+    {
+        mutable std::mutex mMutex;
+        std::vector<std::chrono::nanoseconds> mPending;
+    };
+    medida::Timer& mTarget;
+    std::array<Shard, ShardedMetrics::SHARDS> mShards;
+
+    void flush(std::vector<std::chrono::nanoseconds> const& samples);
+
+  public:
+    explicit ShardedTimer(medida::Timer& target);
+    void Update(std::chrono::nanoseconds duration);
+    uint64_t count() const;
+    void sync();
+};
+}
@@ -0,0 +1,102 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/ShardedMetrics.h"
+
+#include "lib/catch.hpp"
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <thread>
+#include <vector>
+
+using namespace stellar;
+
+TEST_CASE("sharded metrics", "[metrics]")
+{
+    medida::MetricsRegistry registry;
+    ShardedMetrics sharded(registry);
+
+    auto& counter = sharded.NewCounter({"test", "sharded", "counter"});
+    auto& meter = sharded.NewMeter({"test", "sharded", "meter"}, "event");
+    auto& timer = sharded.NewTimer({"test", "sharded", "timer"});
+
+    SECTION("a name always gets the same handle")
+    {
+        REQUIRE(&sharded.NewCounter({"test", "sharded", "counter"}) ==
+                &counter);
+        REQUIRE(&sharded.NewMeter({"test", "sharded", "meter"}, "event") ==
+                &meter);
+        REQUIRE(&sharded.NewTimer({"test", "sharded", "timer"}) == &timer);
+    }
+
+    SECTION("few events stay in the shards until sync")
+    {
+        counter.inc(3);
+        counter.dec();
+        meter.Mark(5);
+        timer.Update(std::chrono::milliseconds(1));
+
+        REQUIRE(counter.count() == 2);
+        REQUIRE(meter.count() == 5);
+        REQUIRE(timer.count() == 1);
+        REQUIRE(registry.NewCounter({"test", "sharded", "counter"}).count() ==
+                0);
+        REQUIRE(registry.NewMeter({"test", "sharded", "meter"}, "event")
+                    .count() == 0);
+        REQUIRE(registry.NewTimer({"test", "sharded", "timer"}).count() == 0);
+
+        sharded.sync();
+        REQUIRE(registry.NewCounter({"test", "sharded", "counter"}).count() ==
+                2);
+        REQUIRE(registry.NewMeter({"test", "sharded", "meter"}, "event")
+                    .count() == 5);
+        REQUIRE(registry.NewTimer({"test", "sharded", "timer"}).count() == 1);
+        REQUIRE(counter.count() == 2);
+        REQUIRE(meter.count() == 5);
+        REQUIRE(timer.count() == 1);
+    }
+
+    SECTION("updates from many threads are all counted")
+    {
+        size_t const nbThreads = 2 * ShardedMetrics::SHARDS;
+        size_t const nbEvents = 1000;
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < nbThreads; t++)
+        {
+            threads.emplace_back([&]() {
+                for (size_t i = 0; i < nbEvents; i++)
+                {
+                    counter.inc();
+                    meter.Mark();
+                    timer.Update(std::chrono::microseconds(i));
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+
+        auto const total = nbThreads * nbEvents;
+        REQUIRE(counter.count() == static_cast<int64_t>(total));
+        REQUIRE(meter.count() == total);
+        REQUIRE(timer.count() == total);
+        // all but the last events of every shard were flushed already
+        REQUIRE(registry.NewMeter({"test", "sharded", "meter"}, "event")
+                    .count() >
+                total - ShardedMetrics::SHARDS *
+                            ShardedMetrics::FLUSH_THRESHOLD);
+
+        sharded.sync();
+        REQUIRE(registry.NewCounter({"test", "sharded", "counter"}).count() ==
+                static_cast<int64_t>(total));
+        REQUIRE(registry.NewMeter({"test", "sharded", "meter"}, "event")
+                    .count() == total);
+        REQUIRE(registry.NewTimer({"test", "sharded", "timer"}).count() ==
+                total);
+    }
+}
@@ -0,0 +1,68 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Thread.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace stellar
+{
+
+#ifdef __linux__
+
+std::vector<uint32_t>
+getCurrentThreadCPUs()
+{
+    std::vector<uint32_t> res;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        return res;
+    }
+    for (uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &set))
+        {
+            res.push_back(cpu);
+        }
+    }
+    return res;
+}
+
+bool
+runCurrentThreadOn(std::vector<uint32_t> const& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+    {
+        if (cpu >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#else
+
+std::vector<uint32_t>
+getCurrentThreadCPUs()
+{
+    return {};
+}
+
+bool
+runCurrentThreadOn(std::vector<uint32_t> const&)
+{
+    return false;
+}
+
+#endif
+}
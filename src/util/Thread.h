@@ -0,0 +1,19 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstdint>
+#include <vector>
+
+namespace stellar
+{
+
+// CPUs the calling thread may run on, empty if the platform cannot tell
+std::vector<uint32_t> getCurrentThreadCPUs();
+
+// restricts the calling thread to @p cpus (which must not be empty),
+// returns false if the platform does not support it or refuses
+bool runCurrentThreadOn(std::vector<uint32_t> const& cpus);
+}
@@ -17,7 +17,12 @@ using namespace std;
 
 static const uint32_t RECENT_CRANK_WINDOW = 1024;
 
-VirtualClock::VirtualClock(Mode mode) : mRealTimer(mIOService), mMode(mode)
+size_t const VirtualClock::COMPLETION_QUEUE_SIZE = 4096;
+
+VirtualClock::VirtualClock(Mode mode)
+    : mRealTimer(mIOService)
+    , mMode(mode)
+    , mCompletions(COMPLETION_QUEUE_SIZE)
 {
     resetIdleCrankPercent();
     if (mMode == REAL_TIME)
@@ -59,26 +64,11 @@ VirtualClock::maybeSetRealtimer()
     }
 }
 
-bool
-VirtualClockEventCompare::operator()(shared_ptr<VirtualClockEvent> a,
-                                     shared_ptr<VirtualClockEvent> b)
-{
-    return *a < *b;
-}
-
 VirtualClock::time_point
 VirtualClock::next()
 {
     assertThreadIsMain();
-    VirtualClock::time_point least = time_point::max();
-    if (!mEvents.empty())
-    {
-        if (mEvents.top()->mWhen < least)
-        {
-            least = mEvents.top()->mWhen;
-        }
-    }
-    return least;
+    return mEvents.next();
 }
 
 VirtualClock::time_point
@@ -166,54 +156,30 @@ VirtualClock::pointToISOString(time_point point)
     return tmToISOString(pointToTm(point));
 }
 
-void
-VirtualClock::enqueue(shared_ptr<VirtualClockEvent> ve)
+VirtualClock::EventHandle
+VirtualClock::enqueue(time_point when, EventCallback callback)
 {
     if (mDestructing)
     {
-        return;
+        return 0;
     }
     assertThreadIsMain();
     // LOG(DEBUG) << "VirtualClock::enqueue";
-    mEvents.emplace(ve);
+    auto event = mEvents.insert(when, std::move(callback));
     maybeSetRealtimer();
+    return event;
 }
 
 void
-VirtualClock::flushCancelledEvents()
+VirtualClock::cancelEvent(EventHandle event)
 {
-    if (mDestructing)
-    {
-        return;
-    }
-    if (mFlushesIgnored <= mEvents.size())
-    {
-        // Flushing all the canceled events immediately can lead to
-        // a O(n^2) loop if many events in the queue are canceled one a time.
-        //
-        // By ignoring O(n) flushes, we batch the iterations together and
-        // restore O(n) performance.
-        mFlushesIgnored++;
-        return;
-    }
-    assertThreadIsMain();
-    // LOG(DEBUG) << "VirtualClock::cancelAllEventsFrom";
-
-    auto toKeep = vector<shared_ptr<VirtualClockEvent>>();
-    toKeep.reserve(mEvents.size());
-
-    while (!mEvents.empty())
+    // cancelled events leave the wheel right away; the real timer, if set
+    // for this one, fires for nothing and is set again
+    EventCallback callback;
+    if (mEvents.take(event, callback))
     {
-        auto const& e = mEvents.top();
-        if (!e->getTriggered())
-        {
-            toKeep.emplace_back(e);
-        }
-        mEvents.pop();
+        callback(asio::error::operation_aborted);
     }
-    mFlushesIgnored = 0;
-    mEvents = PrQueue(toKeep.begin(), toKeep.end());
-    maybeSetRealtimer();
 }
 
 bool
@@ -221,15 +187,12 @@ VirtualClock::cancelAllEvents()
 {
     assertThreadIsMain();
 
-    bool wasEmpty = mEvents.empty();
-    while (!mEvents.empty())
+    auto events = mEvents.getPending();
+    for (auto event : events)
     {
-        auto ev = mEvents.top();
-        mEvents.pop();
-        ev->cancel();
+        cancelEvent(event);
     }
-    mEvents = PrQueue();
-    return !wasEmpty;
+    return !events.empty();
 }
 
 void
@@ -266,6 +229,8 @@ VirtualClock::crank(bool block)
         nWorkDone += advanceToNow();
     }
 
+    nWorkDone += drainCompletions();
+
     // pick up some work off the IO queue
     // calling mIOService.poll() here may introduce unbounded delays
     // to trigger timers
@@ -274,8 +239,13 @@ VirtualClock::crank(bool block)
     size_t i = 0;
     do
     {
+        MainLoopMonitor::Measure measure(mLoopMonitor, "io");
         lastPoll = mIOService.poll_one();
         nWorkDone += lastPoll;
+        if (lastPoll == 0)
+        {
+            measure.discard();
+        }
     } while (lastPoll != 0 && ++i < WORK_BATCH_SIZE);
 
     nWorkDone -= nRealTimerCancelEvents;
@@ -289,6 +259,8 @@ VirtualClock::crank(bool block)
 
     if (block && nWorkDone == 0)
     {
+        // not measured, as it includes the wait: the timers and completions
+        // it runs are, the other io handlers are not
         nWorkDone += mIOService.run_one();
     }
 
@@ -359,6 +331,65 @@ VirtualClock::getIOService()
     return mIOService;
 }
 
+MainLoopMonitor&
+VirtualClock::getLoopMonitor()
+{
+    return mLoopMonitor;
+}
+
+void
+VirtualClock::postToMain(std::function<void()>&& handler,
+                         char const* category)
+{
+    mLoopMonitor.notePosted();
+    Completion completion{std::move(handler), category,
+                          MainLoopMonitor::clock::now()};
+    if (!mCompletions.tryPush(std::move(completion)))
+    {
+        auto c = std::make_shared<Completion>(std::move(completion));
+        mIOService.post([this, c]() { runCompletion(*c); });
+        return;
+    }
+    // the first handler queued since the last drain posts a drain, so that
+    // a main thread waiting for IO wakes up
+    if (!mCompletionsPending.exchange(true))
+    {
+        mIOService.post([this]() { drainCompletions(); });
+    }
+}
+
+size_t
+VirtualClock::drainCompletions()
+{
+    assertThreadIsMain();
+    // handlers queued from now on post another drain
+    mCompletionsPending.exchange(false);
+    size_t n = 0;
+    Completion completion;
+    while (n < COMPLETION_QUEUE_SIZE && mCompletions.tryPop(completion))
+    {
+        runCompletion(completion);
+        completion.mHandler = nullptr;
+        n++;
+    }
+    if (n == COMPLETION_QUEUE_SIZE && !mCompletionsPending.exchange(true))
+    {
+        // leaves the rest for later, after some IO
+        mIOService.post([this]() { drainCompletions(); });
+    }
+    return n;
+}
+
+void
+VirtualClock::runCompletion(Completion& completion)
+{
+    mLoopMonitor.noteDequeued();
+    mLoopMonitor.noteLag(completion.mCategory,
+                         MainLoopMonitor::clock::now() - completion.mPosted);
+    MainLoopMonitor::Measure measure(mLoopMonitor, completion.mCategory);
+    completion.mHandler();
+}
+
 VirtualClock::~VirtualClock()
 {
     mDestructing = true;
@@ -377,20 +408,24 @@ VirtualClock::advanceTo(time_point n)
     // LOG(DEBUG) << "VirtualClock::advanceTo("
     //            << n.time_since_epoch().count() << ")";
     mNow = n;
-    vector<shared_ptr<VirtualClockEvent>> toDispatch;
-    while (!mEvents.empty())
-    {
-        if (mEvents.top()->mWhen > mNow)
-            break;
-        toDispatch.push_back(mEvents.top());
-        mEvents.pop();
-    }
-    // Keep the dispatch loop separate from the pop()-ing loop
-    // so the triggered events can't mutate the priority queue
-    // from underneat us while we are looping.
-    for (auto ev : toDispatch)
+    // Events due are taken out of the wheel before any is dispatched, so
+    // that the ones they schedule wait for the next advance; they can still
+    // be cancelled by the ones before them.
+    auto toDispatch = mEvents.popDue(mNow);
+    for (auto event : toDispatch)
     {
-        ev->trigger();
+        EventCallback callback;
+        time_point when;
+        if (mEvents.take(event, callback, when))
+        {
+            if (mMode == REAL_TIME)
+            {
+                // virtual time is advanced to the events instead, when due
+                mLoopMonitor.noteLag("timer", mNow - when);
+            }
+            MainLoopMonitor::Measure measure(mLoopMonitor, "timer");
+            callback(asio::error_code());
+        }
     }
     // LOG(DEBUG) << "VirtualClock::advanceTo done";
     maybeSetRealtimer();
@@ -413,53 +448,6 @@ VirtualClock::advanceToNext()
     return advanceTo(next());
 }
 
-VirtualClockEvent::VirtualClockEvent(
-    VirtualClock::time_point when, size_t seq,
-    std::function<void(asio::error_code)> callback)
-    : mCallback(callback), mTriggered(false), mWhen(when), mSeq(seq)
-{
-}
-
-bool
-VirtualClockEvent::getTriggered()
-{
-    return mTriggered;
-}
-void
-VirtualClockEvent::trigger()
-{
-    if (!mTriggered)
-    {
-        mTriggered = true;
-        mCallback(asio::error_code());
-        mCallback = nullptr;
-    }
-}
-
-void
-VirtualClockEvent::cancel()
-{
-    if (!mTriggered)
-    {
-        mTriggered = true;
-        mCallback(asio::error::operation_aborted);
-        mCallback = nullptr;
-    }
-}
-
-bool
-VirtualClockEvent::operator<(VirtualClockEvent const& other) const
-{
-    // For purposes of priority queue, a timer is "less than"
-    // another timer if it occurs in the future (has a higher
-    // expiry time). The "greatest" timer is timer 0.
-    // To break time-based ties (but preserve the ordering in which
-    // events were enqueued) we add an event-sequence number as well,
-    // such that a higher sequence number makes an event "less than"
-    // another.
-    return mWhen > other.mWhen || (mWhen == other.mWhen && mSeq > other.mSeq);
-}
-
 VirtualTimer::VirtualTimer(Application& app) : VirtualTimer(app.getClock())
 {
 }
@@ -484,11 +472,10 @@ VirtualTimer::cancel()
     if (!mCancelled)
     {
         mCancelled = true;
-        for (auto ev : mEvents)
+        for (auto event : mEvents)
         {
-            ev->cancel();
+            mClock.cancelEvent(event);
         }
-        mClock.flushCancelledEvents();
         mEvents.clear();
     }
 }
@@ -502,7 +489,7 @@ VirtualTimer::expiry_time() const
 size_t
 VirtualTimer::seq() const
 {
-    return mEvents.empty() ? 0 : mEvents.back()->mSeq + 1;
+    return mEvents.size();
 }
 
 void
@@ -527,9 +514,7 @@ VirtualTimer::async_wait(function<void(asio::error_code)> const& fn)
     if (!mCancelled)
     {
         assert(!mDeleting);
-        auto ve = make_shared<VirtualClockEvent>(mExpiryTime, seq(), fn);
-        mClock.enqueue(ve);
-        mEvents.push_back(ve);
+        mEvents.push_back(mClock.enqueue(mExpiryTime, fn));
     }
 }
 
@@ -540,15 +525,13 @@ VirtualTimer::async_wait(std::function<void()> const& onSuccess,
     if (!mCancelled)
     {
         assert(!mDeleting);
-        auto ve = make_shared<VirtualClockEvent>(
-            mExpiryTime, seq(), [onSuccess, onFailure](asio::error_code error) {
+        mEvents.push_back(mClock.enqueue(
+            mExpiryTime, [onSuccess, onFailure](asio::error_code error) {
                 if (error)
                     onFailure(error);
                 else
                     onSuccess();
-            });
-        mClock.enqueue(ve);
-        mEvents.push_back(ve);
+            }));
     }
 }
 }
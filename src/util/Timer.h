@@ -8,8 +8,12 @@
 // first to include <windows.h> -- so we try to include it before everything
 // else.
 #include "util/asio.h"
+#include "util/MPSCQueue.h"
+#include "util/MainLoopMonitor.h"
 #include "util/NonCopyable.h"
+#include "util/TimerWheel.h"
 
+#include <atomic>
 #include <chrono>
 #include <ctime>
 #include <functional>
@@ -47,13 +51,6 @@ namespace stellar
 
 class VirtualTimer;
 class Application;
-class VirtualClockEvent;
-class VirtualClockEventCompare
-{
-  public:
-    bool operator()(std::shared_ptr<VirtualClockEvent> a,
-                    std::shared_ptr<VirtualClockEvent> b);
-};
 
 class VirtualClock
 {
@@ -102,6 +99,9 @@ class VirtualClock
         VIRTUAL_TIME
     };
 
+    typedef std::function<void(asio::error_code)> EventCallback;
+    typedef TimerWheel<EventCallback>::Handle EventHandle;
+
   private:
     asio::io_service mIOService;
     asio::basic_waitable_timer<std::chrono::system_clock> mRealTimer;
@@ -113,19 +113,30 @@ class VirtualClock
     size_t nRealTimerCancelEvents;
     time_point mNow;
 
-    using PrQueue =
-        std::priority_queue<std::shared_ptr<VirtualClockEvent>,
-                            std::vector<std::shared_ptr<VirtualClockEvent>>,
-                            VirtualClockEventCompare>;
-    PrQueue mEvents;
-    size_t mFlushesIgnored = 0;
+    TimerWheel<EventCallback> mEvents;
+
+    // handlers posted by other threads through postToMain
+    struct Completion
+    {
+        std::function<void()> mHandler;
+        char const* mCategory;
+        MainLoopMonitor::clock::time_point mPosted;
+    };
+    static size_t const COMPLETION_QUEUE_SIZE;
+    MPSCQueue<Completion> mCompletions;
+    // a drain of mCompletions is posted to mIOService
+    std::atomic<bool> mCompletionsPending{false};
 
     bool mDestructing{false};
 
+    MainLoopMonitor mLoopMonitor;
+
     void maybeSetRealtimer();
     size_t advanceTo(time_point n);
     size_t advanceToNext();
     size_t advanceToNow();
+    size_t drainCompletions();
+    void runCompletion(Completion& completion);
 
   public:
     // A VirtualClock is instantiated in either real or virtual mode. In real
@@ -141,13 +152,26 @@ class VirtualClock
     void resetIdleCrankPercent();
     asio::io_service& getIOService();
 
+    // Runs @p handler on the main thread, in a later crank; called by worker
+    // threads to hand their results back. Handlers are queued without locks
+    // and run in batches, instead of going one by one through the (locked)
+    // queue of the io_service. @p category, a string literal, is the one
+    // the handler is measured under, see MainLoopMonitor.
+    void postToMain(std::function<void()>&& handler,
+                    char const* category = "completion");
+
+    MainLoopMonitor& getLoopMonitor();
+
     // Note: this is not a static method, which means that VirtualClock is
     // not an implementation of the C++ `Clock` concept; there is no global
     // virtual time. Each virtual clock has its own time.
     time_point now() noexcept;
 
-    void enqueue(std::shared_ptr<VirtualClockEvent> ve);
-    void flushCancelledEvents();
+    // schedules @p callback at @p when; it is called once, with an error
+    // if the event is cancelled first
+    EventHandle enqueue(time_point when, EventCallback callback);
+    // does nothing if the event already happened
+    void cancelEvent(EventHandle event);
     bool cancelAllEvents();
 
     // only valid with VIRTUAL_TIME: sets the current value
@@ -158,22 +182,6 @@ class VirtualClock
     time_point next();
 };
 
-class VirtualClockEvent : public NonMovableOrCopyable
-{
-    std::function<void(asio::error_code)> mCallback;
-    bool mTriggered;
-
-  public:
-    VirtualClock::time_point mWhen;
-    size_t mSeq;
-    VirtualClockEvent(VirtualClock::time_point when, size_t seq,
-                      std::function<void(asio::error_code)> callback);
-    bool getTriggered();
-    void trigger();
-    void cancel();
-    bool operator<(VirtualClockEvent const& other) const;
-};
-
 /**
  * This is the class you probably want to use: it is coupled with a
  * VirtualClock, so advances with per-VirtualClock simulated time, and therefore
@@ -183,7 +191,7 @@ class VirtualTimer : private NonMovableOrCopyable
 {
     VirtualClock& mClock;
     VirtualClock::time_point mExpiryTime;
-    std::vector<std::shared_ptr<VirtualClockEvent>> mEvents;
+    std::vector<VirtualClock::EventHandle> mEvents;
     bool mCancelled;
     bool mDeleting;
 
@@ -11,7 +11,12 @@
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Logging.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
 #include <chrono>
+#include <thread>
 
 using namespace stellar;
 
@@ -221,3 +226,73 @@ TEST_CASE("timer cancels", "[timer]")
     REQUIRE(timerFired == 8);
     REQUIRE(timerCancelled == 2);
 }
+
+TEST_CASE("handlers posted to the main thread by other threads", "[timer]")
+{
+    VirtualClock clock;
+    int const threads = 4;
+    // more than the completion queue holds, so some are posted directly
+    int const perThread = 5000;
+    int run = 0;
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&clock, &run]() {
+            for (int i = 0; i < perThread; i++)
+            {
+                clock.postToMain([&run]() { ++run; });
+            }
+        });
+    }
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    while (clock.crank(false) > 0)
+        ;
+    REQUIRE(run == threads * perThread);
+}
+
+TEST_CASE("main loop handlers are measured", "[timer]")
+{
+    VirtualClock clock;
+    medida::MetricsRegistry registry;
+    auto& monitor = clock.getLoopMonitor();
+    monitor.setMetrics(&registry);
+    monitor.setStallThreshold(std::chrono::milliseconds(20));
+
+    bool fired = false;
+    VirtualTimer timer(clock);
+    timer.expires_from_now(std::chrono::seconds(1));
+    timer.async_wait([&fired]() { fired = true; },
+                     &VirtualTimer::onFailureNoop);
+    std::thread([&clock]() {
+        clock.postToMain(
+            []() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            },
+            "test");
+    }).join();
+    REQUIRE(monitor.getJsonInfo()["queued"].asInt() == 1);
+
+    while (clock.crank(false) > 0)
+        ;
+    REQUIRE(fired);
+    REQUIRE(registry.NewTimer({"loop", "handler", "test"}).count() == 1);
+    REQUIRE(registry.NewTimer({"loop", "lag", "test"}).count() == 1);
+    REQUIRE(registry.NewTimer({"loop", "handler", "timer"}).count() == 1);
+    // the drain of the completions, which does not count the handler
+    REQUIRE(registry.NewTimer({"loop", "handler", "io"}).count() == 1);
+    REQUIRE(registry.NewTimer({"loop", "handler", "io"}).max() < 20);
+
+    auto info = monitor.getJsonInfo();
+    REQUIRE(info["queued"].asInt() == 0);
+    REQUIRE(monitor.getStallCount() == 1);
+    REQUIRE(info["recent_stalls"].size() == 1);
+    REQUIRE(info["recent_stalls"][0]["category"].asString() == "test");
+    REQUIRE(info["recent_stalls"][0]["ms"].asInt() >= 50);
+    REQUIRE(info["handlers"]["test"]["count"].asUInt64() == 1);
+
+    monitor.setMetrics(nullptr);
+}
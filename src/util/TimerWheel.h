@@ -0,0 +1,423 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Hierarchical timing wheel holding the pending events of VirtualClock:
+ * inserting and removing an event are O(1), where a heap costs O(log n)
+ * and can only drop cancelled events by rebuilding itself.
+ *
+ * Event times are rounded down to ticks of 2^20 ns (about 1 ms). Each of
+ * the LEVELS levels has SLOTS slots, a slot of level L spanning SLOTS^L
+ * ticks: an event is kept in the lowest level where its tick differs from
+ * the current one (the cursor), and moves down a level when the cursor
+ * enters its slot. Events keep their exact time, which orders the events
+ * of a tick, and their insertion order breaks ties.
+ *
+ * Events live in one array reused through a free list, and are referred to
+ * by handles that stay safe to use once their event is gone.
+ */
+template <typename T> class TimerWheel
+{
+  public:
+    typedef std::chrono::system_clock::time_point time_point;
+    // 0 never refers to an event
+    typedef uint64_t Handle;
+
+    static size_t const SLOT_BITS = 6;
+    static size_t const SLOTS = size_t(1) << SLOT_BITS;
+    // enough for the 44 bits of a tick
+    static size_t const LEVELS = 8;
+
+    TimerWheel()
+    {
+        std::fill(std::begin(mHeads), std::end(mHeads), NIL);
+    }
+
+    Handle
+    insert(time_point when, T payload)
+    {
+        uint32_t index;
+        if (mFree != NIL)
+        {
+            index = mFree;
+            mFree = mNodes[index].mNext;
+        }
+        else
+        {
+            index = static_cast<uint32_t>(mNodes.size());
+            mNodes.emplace_back();
+        }
+        auto& node = mNodes[index];
+        node.mWhen = when;
+        node.mTick = toTick(when);
+        node.mSeq = mNextSeq++;
+        node.mPayload = std::move(payload);
+        node.mUsed = true;
+        link(index);
+        if (mNextValid && when < mNext)
+        {
+            mNext = when;
+        }
+        return (static_cast<Handle>(node.mGeneration) << 32) | index;
+    }
+
+    // removes the event of @p handle, pending or returned by popDue and
+    // not taken yet, and moves its payload to @p payload; returns false if
+    // there is no such event
+    bool
+    take(Handle handle, T& payload)
+    {
+        time_point when;
+        return take(handle, payload, when);
+    }
+
+    // same, also giving the time the event was due at
+    bool
+    take(Handle handle, T& payload, time_point& when)
+    {
+        auto index = static_cast<uint32_t>(handle);
+        auto generation = static_cast<uint32_t>(handle >> 32);
+        if (index >= mNodes.size() || !mNodes[index].mUsed ||
+            mNodes[index].mGeneration != generation)
+        {
+            return false;
+        }
+        auto& node = mNodes[index];
+        if (node.mSlot != NONE)
+        {
+            unlink(index);
+            if (mNextValid && node.mWhen == mNext)
+            {
+                mNextValid = false;
+            }
+        }
+        payload = std::move(node.mPayload);
+        when = node.mWhen;
+        node.mPayload = T{};
+        node.mUsed = false;
+        if (++node.mGeneration == 0)
+        {
+            node.mGeneration = 1;
+        }
+        node.mNext = mFree;
+        mFree = index;
+        return true;
+    }
+
+    // number of pending events
+    size_t
+    size() const
+    {
+        return mPending;
+    }
+    bool
+    empty() const
+    {
+        return mPending == 0;
+    }
+
+    // time of the earliest pending event, time_point::max() if none
+    time_point
+    next()
+    {
+        if (!mNextValid)
+        {
+            mNext = time_point::max();
+            size_t level, slot;
+            if (findFirstSlot(level, slot))
+            {
+                forEach(level, slot, [&](Node const& n) {
+                    mNext = std::min(mNext, n.mWhen);
+                });
+            }
+            mNextValid = true;
+        }
+        return mNext;
+    }
+
+    // removes the pending events due at @p now from the wheel and returns
+    // their handles, in the order they are due; they are dropped with
+    // take, as the caller dispatches them
+    std::vector<Handle>
+    popDue(time_point now)
+    {
+        std::vector<uint32_t> due;
+        // @p now may be before the cursor, when virtual time went back
+        auto target = std::max(toTick(now), mCursor);
+        for (;;)
+        {
+            size_t level, slot;
+            auto tick = target;
+            if (findFirstSlot(level, slot))
+            {
+                tick = std::max(mCursor, getFirstTick(level, slot));
+            }
+            if (tick >= target)
+            {
+                moveCursor(target);
+                collect(due, now);
+                break;
+            }
+            moveCursor(tick);
+            collect(due, now);
+        }
+
+        std::sort(due.begin(), due.end(), [this](uint32_t a, uint32_t b) {
+            auto const& x = mNodes[a];
+            auto const& y = mNodes[b];
+            return x.mWhen < y.mWhen || (x.mWhen == y.mWhen && x.mSeq < y.mSeq);
+        });
+        std::vector<Handle> res;
+        res.reserve(due.size());
+        for (auto i : due)
+        {
+            res.push_back((static_cast<Handle>(mNodes[i].mGeneration) << 32) |
+                          i);
+        }
+        return res;
+    }
+
+    // handles of all the pending events
+    std::vector<Handle>
+    getPending() const
+    {
+        std::vector<Handle> res;
+        res.reserve(mPending);
+        for (size_t i = 0; i < mNodes.size(); i++)
+        {
+            if (mNodes[i].mUsed && mNodes[i].mSlot != NONE)
+            {
+                res.push_back(
+                    (static_cast<Handle>(mNodes[i].mGeneration) << 32) | i);
+            }
+        }
+        return res;
+    }
+
+  private:
+    static uint32_t const NIL = UINT32_MAX;
+    static uint16_t const NONE = UINT16_MAX;
+    static size_t const TICK_BITS = 20;
+
+    struct Node
+    {
+        time_point mWhen;
+        uint64_t mTick{0};
+        uint64_t mSeq{0};
+        T mPayload{};
+        uint32_t mPrev{NIL};
+        uint32_t mNext{NIL};
+        uint32_t mGeneration{1};
+        // level * SLOTS + slot while in the wheel
+        uint16_t mSlot{NONE};
+        bool mUsed{false};
+    };
+
+    std::vector<Node> mNodes;
+    uint32_t mFree{NIL};
+    uint32_t mHeads[LEVELS * SLOTS];
+    // bit s of mOccupied[l]: slot s of level l is not empty
+    uint64_t mOccupied[LEVELS]{};
+    // every tick before the cursor is done
+    uint64_t mCursor{0};
+    uint64_t mNextSeq{0};
+    size_t mPending{0};
+    time_point mNext;
+    bool mNextValid{false};
+
+    static uint64_t
+    toTick(time_point t)
+    {
+        typedef std::chrono::nanoseconds ns;
+        typedef time_point::duration duration;
+        auto d = t.time_since_epoch();
+        // clamped, for clocks counting in coarser units than nanoseconds
+        d = std::min(d, std::chrono::duration_cast<duration>(ns::max()));
+        d = std::max(d, std::chrono::duration_cast<duration>(ns::min()));
+        auto count = std::chrono::duration_cast<ns>(d).count();
+        // biased so that ticks before the epoch are ordered too
+        return (static_cast<uint64_t>(count) ^ (uint64_t(1) << 63)) >>
+               TICK_BITS;
+    }
+
+    static size_t
+    lowestBit(uint64_t x)
+    {
+        size_t res = 0;
+        while (!(x & 1))
+        {
+            x >>= 1;
+            res++;
+        }
+        return res;
+    }
+
+    size_t
+    getSlotOf(size_t level, uint64_t tick) const
+    {
+        return (tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+    }
+
+    // first tick of @p slot of @p level, that starts after the cursor
+    uint64_t
+    getFirstTick(size_t level, size_t slot) const
+    {
+        auto shift = SLOT_BITS * level;
+        auto span = uint64_t(1) << shift;
+        auto block = (mCursor >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+        auto first = block + slot * span;
+        if (level == 0)
+        {
+            return first;
+        }
+        // a slot holds the events of its ticks, whose minimum may be later
+        // than the start of the slot
+        uint64_t res = UINT64_MAX;
+        forEach(level, slot,
+                [&](Node const& n) { res = std::min(res, n.mTick); });
+        return res;
+    }
+
+    // the slot holding the earliest pending events
+    bool
+    findFirstSlot(size_t& level, size_t& slot) const
+    {
+        for (level = 0; level < LEVELS; level++)
+        {
+            auto bits =
+                mOccupied[level] & (UINT64_MAX << getSlotOf(level, mCursor));
+            if (bits != 0)
+            {
+                slot = lowestBit(bits);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename F>
+    void
+    forEach(size_t level, size_t slot, F f) const
+    {
+        for (auto i = mHeads[level * SLOTS + slot]; i != NIL;
+             i = mNodes[i].mNext)
+        {
+            f(mNodes[i]);
+        }
+    }
+
+    void
+    link(uint32_t index)
+    {
+        auto& node = mNodes[index];
+        // late events go with the ones of the cursor
+        auto tick = std::max(node.mTick, mCursor);
+        auto diff = tick ^ mCursor;
+        size_t level = 0;
+        while ((diff >> (SLOT_BITS * (level + 1))) != 0)
+        {
+            level++;
+        }
+        auto slot = getSlotOf(level, tick);
+        auto s = level * SLOTS + slot;
+        node.mSlot = static_cast<uint16_t>(s);
+        node.mPrev = NIL;
+        node.mNext = mHeads[s];
+        if (node.mNext != NIL)
+        {
+            mNodes[node.mNext].mPrev = index;
+        }
+        mHeads[s] = index;
+        mOccupied[level] |= uint64_t(1) << slot;
+        mPending++;
+    }
+
+    void
+    unlink(uint32_t index)
+    {
+        auto& node = mNodes[index];
+        auto s = node.mSlot;
+        if (node.mPrev != NIL)
+        {
+            mNodes[node.mPrev].mNext = node.mNext;
+        }
+        else
+        {
+            mHeads[s] = node.mNext;
+        }
+        if (node.mNext != NIL)
+        {
+            mNodes[node.mNext].mPrev = node.mPrev;
+        }
+        if (mHeads[s] == NIL)
+        {
+            mOccupied[s / SLOTS] &= ~(uint64_t(1) << (s % SLOTS));
+        }
+        node.mSlot = NONE;
+        node.mPrev = NIL;
+        node.mNext = NIL;
+        mPending--;
+    }
+
+    // moves the cursor to @p tick, before which there must be no events,
+    // and moves down the events of the slots it enters
+    void
+    moveCursor(uint64_t tick)
+    {
+        assert(tick >= mCursor);
+        if (tick == mCursor)
+        {
+            return;
+        }
+        mCursor = tick;
+        for (size_t level = LEVELS - 1; level > 0; level--)
+        {
+            auto s = level * SLOTS + getSlotOf(level, mCursor);
+            while (mHeads[s] != NIL)
+            {
+                auto i = mHeads[s];
+                unlink(i);
+                link(i);
+            }
+        }
+    }
+
+    // takes the events of the cursor's tick due at @p now out of the wheel
+    void
+    collect(std::vector<uint32_t>& due, time_point now)
+    {
+        auto s = getSlotOf(0, mCursor);
+        for (auto i = mHeads[s]; i != NIL;)
+        {
+            auto next = mNodes[i].mNext;
+            if (mNodes[i].mWhen <= now)
+            {
+                unlink(i);
+                due.push_back(i);
+                mNextValid = false;
+            }
+            i = next;
+        }
+    }
+};
+
+template <typename T> size_t const TimerWheel<T>::SLOT_BITS;
+template <typename T> size_t const TimerWheel<T>::SLOTS;
+template <typename T> size_t const TimerWheel<T>::LEVELS;
+template <typename T> uint32_t const TimerWheel<T>::NIL;
+template <typename T> uint16_t const TimerWheel<T>::NONE;
+template <typename T> size_t const TimerWheel<T>::TICK_BITS;
+}
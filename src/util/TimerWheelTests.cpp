@@ -0,0 +1,104 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/catch.hpp"
+#include "util/TimerWheel.h"
+
+#include <map>
+#include <random>
+
+using namespace stellar;
+
+namespace
+{
+typedef TimerWheel<int> Wheel;
+typedef Wheel::time_point time_point;
+
+// a delay of a random scale: same tick, milliseconds, seconds, long past
+std::chrono::nanoseconds
+randomDelay(std::mt19937_64& gen)
+{
+    switch (gen() % 4)
+    {
+    case 0:
+        return std::chrono::nanoseconds(gen() % 1000000);
+    case 1:
+        return std::chrono::milliseconds(gen() % 100000);
+    case 2:
+        return std::chrono::seconds(gen() % 100000);
+    default:
+        return -std::chrono::milliseconds(gen() % 100);
+    }
+}
+}
+
+TEST_CASE("timer wheel", "[timer]")
+{
+    std::mt19937_64 gen(42);
+    Wheel wheel;
+    // what the wheel should hold, by (time, insertion order)
+    std::map<std::pair<time_point, int>, Wheel::Handle> expected;
+    std::vector<std::pair<Wheel::Handle, std::pair<time_point, int>>> handles;
+    auto now = time_point() + std::chrono::hours(24 * 365);
+
+    for (int i = 0; i < 100000; i++)
+    {
+        switch (gen() % 5)
+        {
+        case 0:
+        case 1:
+        {
+            auto when = now + randomDelay(gen);
+            auto h = wheel.insert(when, i);
+            expected.emplace(std::make_pair(when, i), h);
+            handles.emplace_back(h, std::make_pair(when, i));
+            break;
+        }
+        case 2:
+        {
+            if (handles.empty())
+            {
+                break;
+            }
+            auto k = gen() % handles.size();
+            auto it = expected.find(handles[k].second);
+            int payload;
+            REQUIRE(wheel.take(handles[k].first, payload) ==
+                    (it != expected.end()));
+            if (it != expected.end())
+            {
+                REQUIRE(payload == it->first.second);
+                expected.erase(it);
+            }
+            handles[k] = handles.back();
+            handles.pop_back();
+            break;
+        }
+        case 3:
+            REQUIRE(wheel.next() == (expected.empty()
+                                         ? time_point::max()
+                                         : expected.begin()->first.first));
+            break;
+        case 4:
+        {
+            now += std::chrono::milliseconds(gen() % 10000);
+            for (auto h : wheel.popDue(now))
+            {
+                REQUIRE(!expected.empty());
+                auto first = expected.begin();
+                REQUIRE(first->first.first <= now);
+                REQUIRE(first->second == h);
+                int payload;
+                REQUIRE(wheel.take(h, payload));
+                REQUIRE(payload == first->first.second);
+                expected.erase(first);
+            }
+            REQUIRE((expected.empty() || expected.begin()->first.first > now));
+            break;
+        }
+        }
+        REQUIRE(wheel.size() == expected.size());
+    }
+    REQUIRE(wheel.getPending().size() == expected.size());
+}
@@ -0,0 +1,201 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Tracing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define TRACING_RDTSC 1
+#endif
+
+namespace stellar
+{
+namespace tracing
+{
+
+size_t const RING_SIZE = 1 << 15;
+
+namespace
+{
+struct Event
+{
+    Zone const* mZone;
+    uint64_t mStart;
+    uint64_t mEnd;
+};
+
+// written by its thread only; the rings outlive their threads, so that the
+// trace keeps the zones of the threads that exited
+struct Ring
+{
+    uint32_t const mThread;
+    std::vector<Event> mEvents;
+    // events ever recorded, the next one goes at mHead % RING_SIZE
+    std::atomic<uint64_t> mHead{0};
+
+    explicit Ring(uint32_t thread) : mThread(thread), mEvents(RING_SIZE)
+    {
+    }
+};
+
+std::mutex gRingsMutex;
+std::vector<std::shared_ptr<Ring>> gRings;
+// zones starting before are dropped, see clear
+std::atomic<uint64_t> gClearedAt{0};
+
+// the counter at a known time, to convert it to time
+struct Calibration
+{
+    std::chrono::steady_clock::time_point mTime;
+    uint64_t mTicks;
+};
+
+Calibration
+calibrate()
+{
+    return Calibration{std::chrono::steady_clock::now(), now()};
+}
+
+Calibration const gStart = calibrate();
+
+#ifdef USE_TRACING
+Ring&
+getRing()
+{
+    thread_local std::shared_ptr<Ring> ring = [] {
+        std::lock_guard<std::mutex> lock(gRingsMutex);
+        auto res = std::make_shared<Ring>(static_cast<uint32_t>(gRings.size()));
+        gRings.emplace_back(res);
+        return res;
+    }();
+    return *ring;
+}
+#endif
+
+char const*
+baseName(char const* file)
+{
+    auto slash = std::strrchr(file, '/');
+    return slash ? slash + 1 : file;
+}
+}
+
+bool
+isEnabled()
+{
+#ifdef USE_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t
+now()
+{
+#ifdef TRACING_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+void
+record(Zone const& zone, uint64_t start, uint64_t end)
+{
+#ifdef USE_TRACING
+    auto& ring = getRing();
+    auto head = ring.mHead.load(std::memory_order_relaxed);
+    ring.mEvents[head % RING_SIZE] = Event{&zone, start, end};
+    ring.mHead.store(head + 1, std::memory_order_release);
+#endif
+}
+
+Json::Value
+getChromeTrace()
+{
+    Json::Value res;
+    res["displayTimeUnit"] = "ms";
+    auto& events = res["traceEvents"];
+    events = Json::arrayValue;
+
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(gRingsMutex);
+        rings = gRings;
+    }
+    if (rings.empty())
+    {
+        return res;
+    }
+
+    auto end = calibrate();
+    auto elapsed = std::chrono::duration<double, std::micro>(end.mTime -
+                                                             gStart.mTime)
+                       .count();
+    auto ticksPerUs =
+        elapsed > 0 ? (end.mTicks - gStart.mTicks) / elapsed : 1.0;
+    auto toUs = [&](uint64_t ticks) {
+        return (static_cast<double>(ticks) - gStart.mTicks) / ticksPerUs;
+    };
+    auto clearedAt = gClearedAt.load();
+
+    for (auto const& ring : rings)
+    {
+        // the owner thread keeps writing: the events copied that it may
+        // have overwritten meanwhile, and the one it may be writing, are
+        // dropped
+        auto head = ring->mHead.load(std::memory_order_acquire);
+        auto first = head > RING_SIZE ? head - RING_SIZE : 0;
+        std::vector<Event> copy;
+        copy.reserve(head - first);
+        for (auto i = first; i < head; i++)
+        {
+            copy.emplace_back(ring->mEvents[i % RING_SIZE]);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto newHead = ring->mHead.load(std::memory_order_relaxed);
+        auto valid = newHead >= RING_SIZE ? newHead - RING_SIZE + 1 : 0;
+
+        for (auto i = std::max(first, valid); i < head; i++)
+        {
+            auto const& e = copy[i - first];
+            if (e.mStart < clearedAt)
+            {
+                continue;
+            }
+            Json::Value event;
+            event["name"] = e.mZone->mName;
+            event["cat"] = "zone";
+            // a complete event, timestamps in us
+            event["ph"] = "X";
+            event["ts"] = toUs(e.mStart);
+            event["dur"] = (e.mEnd - e.mStart) / ticksPerUs;
+            event["pid"] = 1;
+            event["tid"] = ring->mThread;
+            event["args"]["file"] = baseName(e.mZone->mFile);
+            event["args"]["line"] = e.mZone->mLine;
+            events.append(event);
+        }
+    }
+    return res;
+}
+
+void
+clear()
+{
+    gClearedAt = now();
+}
+}
+}
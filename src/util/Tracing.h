@@ -0,0 +1,89 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "lib/json/json.h"
+
+#include <cstdint>
+
+// Tracing of hot paths (per message, per envelope, per transaction), where
+// the medida timers are too costly: a zone is a scope whose entry and exit
+// are recorded, as CPU timestamp counter values, in a ring buffer of the
+// calling thread, with no lookup, allocation or lock.
+//
+//     void
+//     Peer::recvMessage(StellarMessage const& stellarMsg)
+//     {
+//         TRACE_ZONE("Peer::recvMessage");
+//         ...
+//
+// Zones are only compiled in builds configured with --enable-tracing
+// (USE_TRACING): TRACE_ZONE expands to nothing otherwise, and the trace is
+// always empty. The last RING_SIZE zones of every thread are exported by
+// getChromeTrace in Chrome trace event format, for Perfetto or
+// chrome://tracing.
+
+namespace stellar
+{
+
+namespace tracing
+{
+
+// the static description of a zone, one per TRACE_ZONE
+struct Zone
+{
+    char const* mName;
+    char const* mFile;
+    uint32_t mLine;
+};
+
+// zones kept per thread
+extern size_t const RING_SIZE;
+
+// whether zones are compiled in
+bool isEnabled();
+
+// timestamp counter
+uint64_t now();
+
+// records a zone of the calling thread
+void record(Zone const& zone, uint64_t start, uint64_t end);
+
+class Scope
+{
+    Zone const& mZone;
+    uint64_t const mStart;
+
+  public:
+    explicit Scope(Zone const& zone) : mZone(zone), mStart(now())
+    {
+    }
+    ~Scope()
+    {
+        record(mZone, mStart, now());
+    }
+    Scope(Scope const&) = delete;
+    Scope& operator=(Scope const&) = delete;
+};
+
+// the zones recorded so far by all the threads, oldest first per thread
+Json::Value getChromeTrace();
+
+// drops the zones recorded so far
+void clear();
+}
+}
+
+#ifdef USE_TRACING
+#define TRACE_ZONE_CONCAT2(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT2(a, b)
+#define TRACE_ZONE(name)                                                       \
+    static stellar::tracing::Zone const TRACE_ZONE_CONCAT(                     \
+        traceZone, __LINE__){name, __FILE__, __LINE__};                        \
+    stellar::tracing::Scope TRACE_ZONE_CONCAT(traceScope, __LINE__)(           \
+        TRACE_ZONE_CONCAT(traceZone, __LINE__))
+#else
+#define TRACE_ZONE(name)
+#endif
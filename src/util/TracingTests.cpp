@@ -0,0 +1,82 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Tracing.h"
+
+#include "lib/catch.hpp"
+#include <map>
+#include <string>
+#include <thread>
+
+using namespace stellar;
+
+namespace
+{
+void
+traced(int depth)
+{
+    TRACE_ZONE("traced");
+    if (depth > 0)
+    {
+        traced(depth - 1);
+    }
+}
+
+// zones of the trace by name, then by thread
+std::map<std::string, std::map<uint32_t, int>>
+countZones()
+{
+    std::map<std::string, std::map<uint32_t, int>> res;
+    auto trace = tracing::getChromeTrace();
+    for (auto const& e : trace["traceEvents"])
+    {
+        REQUIRE(e["ph"].asString() == "X");
+        REQUIRE(e["dur"].asDouble() >= 0);
+        res[e["name"].asString()][e["tid"].asUInt()]++;
+    }
+    return res;
+}
+}
+
+TEST_CASE("tracing zones", "[tracing]")
+{
+    tracing::clear();
+    traced(2);
+    std::thread other([]() { traced(0); });
+    other.join();
+
+    auto zones = countZones();
+    if (!tracing::isEnabled())
+    {
+        REQUIRE(zones.empty());
+        return;
+    }
+
+    // the rings of threads that exited are kept
+    REQUIRE(zones.size() == 1);
+    auto const& threads = zones["traced"];
+    REQUIRE(threads.size() == 2);
+    REQUIRE(threads.begin()->second + threads.rbegin()->second == 4);
+
+    SECTION("clear")
+    {
+        tracing::clear();
+        REQUIRE(countZones().empty());
+        traced(0);
+        REQUIRE(countZones()["traced"].size() == 1);
+    }
+    SECTION("the ring keeps the last zones")
+    {
+        tracing::Zone const zone{"many", __FILE__, __LINE__};
+        for (size_t i = 0; i < tracing::RING_SIZE + 10; i++)
+        {
+            tracing::Scope scope(zone);
+        }
+        zones = countZones();
+        REQUIRE(zones["traced"].size() == 1);
+        // the oldest slot, which a write could be overwriting, is left out
+        auto many = static_cast<size_t>(zones["many"].begin()->second);
+        REQUIRE(many == tracing::RING_SIZE - 1);
+    }
+}
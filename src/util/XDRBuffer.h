@@ -0,0 +1,60 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "xdrpp/marshal.h"
+#include <cstdint>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * XDR of some objects, serialized into a buffer borrowed from a pool of
+ * the current thread and given back when the XDRBuffer is destroyed. Once
+ * the buffers of a thread have grown to the size of what it serializes,
+ * this does not allocate, unlike xdr::xdr_to_opaque. Several XDRBuffers can
+ * be alive at once, as in
+ *
+ *     hmacSha256(key, XDRBuffer(seq).getBytes(), XDRBuffer(msg).getBytes())
+ */
+class XDRBuffer : NonMovableOrCopyable
+{
+    std::vector<uint8_t> mBytes;
+
+    static std::vector<std::vector<uint8_t>>&
+    getPool()
+    {
+        static thread_local std::vector<std::vector<uint8_t>> pool;
+        return pool;
+    }
+
+  public:
+    template <typename... Args> explicit XDRBuffer(Args const&... args)
+    {
+        auto& pool = getPool();
+        if (!pool.empty())
+        {
+            mBytes.swap(pool.back());
+            pool.pop_back();
+        }
+        mBytes.resize(xdr::xdr_argpack_size(args...));
+        xdr::xdr_put put(mBytes.data(), mBytes.data() + mBytes.size());
+        xdr::xdr_argpack_archive(put, args...);
+    }
+
+    ~XDRBuffer()
+    {
+        getPool().emplace_back(std::move(mBytes));
+    }
+
+    std::vector<uint8_t> const&
+    getBytes() const
+    {
+        return mBytes;
+    }
+};
+}
@@ -6,40 +6,81 @@
 
 #include "crypto/ByteSlice.h"
 #include "crypto/SHA.h"
+#include "util/Gzip.h"
 #include "util/Logging.h"
+#include "util/NonCopyable.h"
 #include "xdrpp/marshal.h"
+#include <cassert>
+#include <cstdio>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace stellar
 {
 
 /**
  * Helper for loading a sequence of XDR objects from a file one at a time,
  * rather than all at once.
+ *
+ * Reads go through a stdio buffer of `bufferSize` bytes, and the kernel is
+ * told that the file will be read sequentially so that it reads ahead
+ * aggressively.
+ *
+ * Block compressed files (see gz::BlockFileReader) are read transparently:
+ * offsets are then the ones of the objects in the uncompressed contents.
  */
-class XDRInputFileStream
+class XDRInputFileStream : NonCopyable
 {
-    std::ifstream mIn;
+    FILE* mIn;
+    std::unique_ptr<gz::BlockFileReader> mBlocks;
+    std::vector<char> mIOBuf;
     std::vector<char> mBuf;
     unsigned int mSizeLimit;
 
+    size_t
+    readBytes(char* data, size_t size)
+    {
+        return mBlocks ? mBlocks->read(data, size)
+                       : std::fread(data, 1, size, mIn);
+    }
+
   public:
-    XDRInputFileStream(unsigned int sizeLimit = 0) : mSizeLimit{sizeLimit}
+    static size_t const DEFAULT_BUFFER_SIZE = 128 * 1024;
+
+    XDRInputFileStream(unsigned int sizeLimit = 0,
+                       size_t bufferSize = DEFAULT_BUFFER_SIZE)
+        : mIn(nullptr), mIOBuf(bufferSize), mSizeLimit{sizeLimit}
+    {
+    }
+
+    ~XDRInputFileStream()
     {
+        close();
     }
 
     void
     close()
     {
-        mIn.close();
+        mBlocks.reset();
+        if (mIn)
+        {
+            std::fclose(mIn);
+            mIn = nullptr;
+        }
     }
 
     void
     open(std::string const& filename)
     {
-        mIn.open(filename, std::ifstream::binary);
+        close();
+        mIn = std::fopen(filename.c_str(), "rb");
         if (!mIn)
         {
             std::string msg("failed to open XDR file: ");
@@ -49,22 +90,90 @@ class XDRInputFileStream
             CLOG(ERROR, "Fs") << msg;
             throw std::runtime_error(msg);
         }
+        std::setvbuf(mIn, mIOBuf.data(), _IOFBF, mIOBuf.size());
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fileno(mIn), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        // XDR files start with a record mark, which has its high bit set,
+        // gzip files with 0x1f
+        int c = std::fgetc(mIn);
+        if (c != EOF)
+        {
+            std::ungetc(c, mIn);
+        }
+        if (c == 0x1f)
+        {
+            mBlocks = std::make_unique<gz::BlockFileReader>(mIn);
+        }
     }
 
     operator bool() const
     {
-        return mIn.good();
+        if (mBlocks)
+        {
+            return !mBlocks->eof() && !std::ferror(mIn);
+        }
+        return mIn && !std::feof(mIn) && !std::ferror(mIn);
     }
 
+    // Offset of the next object in the file.
+    uint64_t
+    pos()
+    {
+        assert(mIn);
+        if (mBlocks)
+        {
+            return mBlocks->pos();
+        }
+#ifdef _WIN32
+        return static_cast<uint64_t>(_ftelli64(mIn));
+#else
+        return static_cast<uint64_t>(ftello(mIn));
+#endif
+    }
+
+    // Position the stream at an offset previously returned by `pos`.
+    void
+    seek(uint64_t offset)
+    {
+        assert(mIn);
+        if (mBlocks)
+        {
+            mBlocks->seek(offset);
+            return;
+        }
+#ifdef _WIN32
+        int res = _fseeki64(mIn, static_cast<int64_t>(offset), SEEK_SET);
+#else
+        int res = fseeko(mIn, static_cast<off_t>(offset), SEEK_SET);
+#endif
+        if (res != 0)
+        {
+            throw std::runtime_error("failed to seek in XDR file");
+        }
+    }
+
+    // Read the next object into `out`, returns false at the end of the file.
+    // When given a `hasher`, the raw bytes read are added to it, so that
+    // reading a whole file also computes the hash of its contents.
     template <typename T>
     bool
-    readOne(T& out)
+    readOne(T& out, SHA256* hasher = nullptr)
     {
         char szBuf[4];
-        if (!mIn.read(szBuf, 4))
+        if (!mIn)
         {
             return false;
         }
+        auto n = readBytes(szBuf, 4);
+        if (n != 4)
+        {
+            if (n != 0)
+            {
+                throw xdr::xdr_runtime_error("malformed XDR file");
+            }
+            return false;
+        }
 
         // Read 4 bytes of size, big-endian, with XDR 'continuation' bit cleared
         // (high bit of high byte).
@@ -85,32 +194,93 @@ class XDRInputFileStream
         {
             mBuf.resize(sz);
         }
-        if (!mIn.read(mBuf.data(), sz))
+        if (readBytes(mBuf.data(), sz) != sz)
         {
             throw xdr::xdr_runtime_error("malformed XDR file");
         }
+        if (hasher)
+        {
+            hasher->add(ByteSlice(szBuf, 4));
+            hasher->add(ByteSlice(mBuf.data(), sz));
+        }
         xdr::xdr_get g(mBuf.data(), mBuf.data() + sz);
         xdr::xdr_argpack_archive(g, out);
         return true;
     }
 };
 
-class XDROutputFileStream
+/**
+ * Helper for writing a sequence of XDR objects to a file, through a stdio
+ * buffer of `bufferSize` bytes.
+ *
+ * A durable stream flushes its data to stable storage on close. To avoid a
+ * long stall there on large files, it also does so every SYNC_INTERVAL bytes
+ * while writing, so the kernel never accumulates too many dirty pages.
+ */
+class XDROutputFileStream : NonCopyable
 {
-    std::ofstream mOut;
+    FILE* mOut;
+    std::vector<char> mIOBuf;
     std::vector<char> mBuf;
+    bool mDurable;
+    size_t mUnsyncedBytes;
+
+    bool
+    sync()
+    {
+        if (std::fflush(mOut) != 0)
+        {
+            return false;
+        }
+        mUnsyncedBytes = 0;
+#if defined(_WIN32)
+        return true;
+#elif defined(__APPLE__)
+        return fsync(fileno(mOut)) == 0;
+#else
+        return fdatasync(fileno(mOut)) == 0;
+#endif
+    }
 
   public:
+    static size_t const DEFAULT_BUFFER_SIZE = 128 * 1024;
+    static size_t const SYNC_INTERVAL = 32 * 1024 * 1024;
+
+    XDROutputFileStream(bool durable = false,
+                        size_t bufferSize = DEFAULT_BUFFER_SIZE)
+        : mOut(nullptr)
+        , mIOBuf(bufferSize)
+        , mDurable(durable)
+        , mUnsyncedBytes(0)
+    {
+    }
+
+    ~XDROutputFileStream()
+    {
+        close();
+    }
+
     void
     close()
     {
-        mOut.close();
+        if (mOut)
+        {
+            if (mDurable && !sync())
+            {
+                CLOG(ERROR, "Fs") << "failed to sync XDR file, reason: "
+                                  << std::to_string(errno);
+            }
+            std::fclose(mOut);
+            mOut = nullptr;
+        }
     }
 
+    // Write to `filename`, after what it already has when `append`.
     void
-    open(std::string const& filename)
+    open(std::string const& filename, bool append = false)
     {
-        mOut.open(filename, std::ofstream::binary | std::ofstream::trunc);
+        close();
+        mOut = std::fopen(filename.c_str(), append ? "ab" : "wb");
         if (!mOut)
         {
             std::string msg("failed to open XDR file: ");
@@ -120,46 +290,105 @@ class XDROutputFileStream
             CLOG(FATAL, "Fs") << msg;
             throw std::runtime_error(msg);
         }
+        std::setvbuf(mOut, mIOBuf.data(), _IOFBF, mIOBuf.size());
+        mUnsyncedBytes = 0;
+    }
+
+    // Write to the open descriptor `fd` (a pipe, a socket...), which the
+    // stream then owns.
+    void
+    fdopen(int fd)
+    {
+        close();
+#ifdef _WIN32
+        mOut = ::_fdopen(fd, "wb");
+#else
+        mOut = ::fdopen(fd, "wb");
+#endif
+        if (!mOut)
+        {
+            std::string msg("failed to open XDR descriptor: ");
+            msg += std::to_string(fd);
+            msg += ", reason: ";
+            msg += std::to_string(errno);
+            CLOG(FATAL, "Fs") << msg;
+            throw std::runtime_error(msg);
+        }
+        std::setvbuf(mOut, mIOBuf.data(), _IOFBF, mIOBuf.size());
+        mUnsyncedBytes = 0;
+    }
+
+    // Hand what is buffered to the file (or pipe), without syncing it.
+    bool
+    flush()
+    {
+        return mOut && std::fflush(mOut) == 0;
     }
 
     operator bool() const
     {
-        return mOut.good();
+        return mOut && !std::ferror(mOut);
     }
 
+    // Append `t` to `buf`, framed as writeOne writes it to the file.
     template <typename T>
-    bool
-    writeOne(T const& t, SHA256* hasher = nullptr, size_t* bytesPut = nullptr)
+    static void
+    serialize(T const& t, std::vector<char>& buf)
     {
         uint32_t sz = (uint32_t)xdr::xdr_size(t);
         assert(sz < 0x80000000);
 
-        if (mBuf.size() < sz + 4)
-        {
-            mBuf.resize(sz + 4);
-        }
+        auto start = buf.size();
+        buf.resize(start + sz + 4);
+        char* p = buf.data() + start;
 
         // Write 4 bytes of size, big-endian, with XDR 'continuation' bit set on
         // high bit of high byte.
-        mBuf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
-        mBuf[1] = static_cast<char>((sz >> 16) & 0xFF);
-        mBuf[2] = static_cast<char>((sz >> 8) & 0xFF);
-        mBuf[3] = static_cast<char>(sz & 0xFF);
+        p[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
+        p[1] = static_cast<char>((sz >> 16) & 0xFF);
+        p[2] = static_cast<char>((sz >> 8) & 0xFF);
+        p[3] = static_cast<char>(sz & 0xFF);
+
+        xdr::xdr_put put(p + 4, p + 4 + sz);
+        xdr_argpack_archive(put, t);
+    }
 
-        xdr::xdr_put p(mBuf.data() + 4, mBuf.data() + 4 + sz);
-        xdr_argpack_archive(p, t);
+    // Write already serialized objects, see `serialize`.
+    bool
+    writeBytes(char const* data, size_t size)
+    {
+        if (!mOut || std::fwrite(data, 1, size, mOut) != size)
+        {
+            return false;
+        }
+        if (mDurable)
+        {
+            mUnsyncedBytes += size;
+            if (mUnsyncedBytes >= SYNC_INTERVAL && !sync())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
 
-        if (!mOut.write(mBuf.data(), sz + 4))
+    template <typename T>
+    bool
+    writeOne(T const& t, SHA256* hasher = nullptr, size_t* bytesPut = nullptr)
+    {
+        mBuf.clear();
+        serialize(t, mBuf);
+        if (!writeBytes(mBuf.data(), mBuf.size()))
         {
             return false;
         }
         if (hasher)
         {
-            hasher->add(ByteSlice(mBuf.data(), sz + 4));
+            hasher->add(ByteSlice(mBuf.data(), mBuf.size()));
         }
         if (bytesPut)
         {
-            *bytesPut += (sz + 4);
+            *bytesPut += mBuf.size();
         }
         return true;
     }
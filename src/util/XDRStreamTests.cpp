@@ -0,0 +1,176 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/XDRHasher.h"
+#include "ledger/LedgerTestUtils.h"
+#include "lib/catch.hpp"
+#include "overlay/StellarXDR.h"
+#include "util/Gzip.h"
+#include "util/TmpDir.h"
+#include "util/XDRBuffer.h"
+#include "util/XDRStream.h"
+#include "util/XDROperators.h"
+#include "xdrpp/autocheck.h"
+
+#include <fstream>
+
+using namespace stellar;
+
+TEST_CASE("XDR file stream round trip", "[xdrstream]")
+{
+    TmpDir dir("xdrstream");
+    auto filename = dir.getName() + "/entries.xdr";
+
+    std::vector<LedgerEntry> entries;
+    for (int i = 0; i < 200; i++)
+    {
+        entries.emplace_back(LedgerTestUtils::generateValidLedgerEntry(10));
+    }
+
+    // buffers smaller than a single entry, so that entries straddle them
+    for (bool durable : {false, true})
+    {
+        size_t bytesPut = 0;
+        XDROutputFileStream out(durable, 16);
+        out.open(filename);
+        for (auto const& e : entries)
+        {
+            REQUIRE(out.writeOne(e, nullptr, &bytesPut));
+        }
+        out.close();
+        REQUIRE(!out);
+
+        XDRInputFileStream in(0, 16);
+        in.open(filename);
+        std::vector<LedgerEntry> read;
+        LedgerEntry e;
+        while (in && in.readOne(e))
+        {
+            read.emplace_back(e);
+        }
+        REQUIRE(read == entries);
+        REQUIRE(!in);
+    }
+
+    SECTION("size limit")
+    {
+        LedgerEntry e;
+        XDRInputFileStream limited(4);
+        limited.open(filename);
+        REQUIRE(!limited.readOne(e));
+    }
+
+    SECTION("reading hashes the raw file contents")
+    {
+        auto outHasher = SHA256::create();
+        XDROutputFileStream out;
+        out.open(filename);
+        for (auto const& e : entries)
+        {
+            out.writeOne(e, outHasher.get());
+        }
+        out.close();
+
+        auto inHasher = SHA256::create();
+        XDRInputFileStream in;
+        in.open(filename);
+        LedgerEntry e;
+        while (in.readOne(e, inHasher.get()))
+            ;
+        REQUIRE(inHasher->finish() == outHasher->finish());
+    }
+
+    SECTION("truncated size header")
+    {
+        {
+            std::ofstream trailer(filename, std::ios::binary | std::ios::app);
+            trailer.write("\0\0", 2);
+        }
+        XDRInputFileStream in;
+        in.open(filename);
+        LedgerEntry e;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            REQUIRE(in.readOne(e));
+        }
+        REQUIRE_THROWS_AS(in.readOne(e), xdr::xdr_runtime_error);
+    }
+}
+
+TEST_CASE("XDR file stream on block compressed files", "[xdrstream]")
+{
+    TmpDir dir("xdrstream");
+    auto plain = dir.getName() + "/entries.xdr";
+    auto compressed = plain + ".blocks";
+
+    // a few blocks worth of entries
+    std::vector<LedgerEntry> entries;
+    std::vector<uint64_t> offsets;
+    {
+        size_t bytesPut = 0;
+        XDROutputFileStream out;
+        out.open(plain);
+        while (bytesPut < 3 * gz::BLOCK_FILE_BLOCK_SIZE + 100)
+        {
+            entries.emplace_back(LedgerTestUtils::generateValidLedgerEntry(5));
+            offsets.emplace_back(bytesPut);
+            REQUIRE(out.writeOne(entries.back(), nullptr, &bytesPut));
+        }
+    }
+    gz::compressBlockFile(plain, compressed);
+    REQUIRE(gz::isBlockFile(compressed));
+    REQUIRE(!gz::isBlockFile(plain));
+
+    XDRInputFileStream in(0, 16);
+    in.open(compressed);
+    std::vector<LedgerEntry> read;
+    LedgerEntry e;
+    REQUIRE(in.pos() == 0);
+    while (in && in.readOne(e))
+    {
+        read.emplace_back(e);
+        REQUIRE(in.pos() ==
+                (read.size() < offsets.size() ? offsets[read.size()]
+                                              : offsets.back() +
+                                                    xdr::xdr_size(e) + 4));
+    }
+    REQUIRE(read == entries);
+    REQUIRE(!in);
+
+    // backwards, from the last entry, then the end
+    for (size_t i = entries.size(); i-- > 0;)
+    {
+        in.seek(offsets[i]);
+        REQUIRE(in.readOne(e));
+        REQUIRE(e == entries[i]);
+    }
+    in.seek(offsets.back() + xdr::xdr_size(entries.back()) + 4);
+    REQUIRE(!in.readOne(e));
+    REQUIRE_THROWS_AS(in.seek(offsets.back() + 1000000), std::runtime_error);
+}
+
+TEST_CASE("XDR buffers and hashing", "[xdrstream]")
+{
+    autocheck::generator<TransactionEnvelope> envelopes;
+    autocheck::generator<StellarMessage> messages;
+    for (size_t i = 0; i < 100; i++)
+    {
+        auto entry = LedgerTestUtils::generateValidLedgerEntry(10);
+        auto env = envelopes(i);
+        auto msg = messages(i);
+
+        // alive at the same time, so from different buffers of the pool
+        XDRBuffer entryBuf(entry);
+        XDRBuffer envBuf(env, msg);
+        REQUIRE(entryBuf.getBytes() == xdr::xdr_to_opaque(entry));
+        REQUIRE(envBuf.getBytes() == xdr::xdr_to_opaque(env, msg));
+
+        REQUIRE(xdrSha256(entry) == sha256(xdr::xdr_to_opaque(entry)));
+        REQUIRE(xdrSha256(env) == sha256(xdr::xdr_to_opaque(env)));
+        REQUIRE(xdrSha256(msg) == sha256(xdr::xdr_to_opaque(msg)));
+        auto n = static_cast<uint32_t>(i);
+        REQUIRE(xdrSha256(n, env, msg) ==
+                sha256(xdr::xdr_to_opaque(n, env, msg)));
+    }
+}
@@ -0,0 +1,68 @@
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "work/BackgroundWork.h"
+#include "util/Logging.h"
+
+namespace stellar
+{
+
+BackgroundWork::BackgroundWork(Application& app, WorkParent& parent,
+                               std::string uniqueName,
+                               Application::WorkerPool pool,
+                               size_t maxRetries)
+    : Work(app, parent, std::move(uniqueName), maxRetries), mPool(pool)
+{
+}
+
+void
+BackgroundWork::onReset()
+{
+    ++mRunGeneration;
+}
+
+void
+BackgroundWork::onRun()
+{
+    auto task = getBackgroundTask();
+    auto generation = ++mRunGeneration;
+    std::weak_ptr<BackgroundWork> weak(
+        std::static_pointer_cast<BackgroundWork>(shared_from_this()));
+    auto name = getUniqueName();
+    auto& clock = mApp.getClock();
+    auto runTask = [&clock, task, weak, generation, name]() {
+        CompleteResult result;
+        try
+        {
+            result = task();
+        }
+        catch (std::exception const& e)
+        {
+            CLOG(WARNING, "Work")
+                << "background task of " << name << " failed: " << e.what();
+            result = WORK_COMPLETE_FAILURE;
+        }
+        clock.postToMain(
+            [weak, generation, result]() {
+                auto self = weak.lock();
+                if (self && self->mRunGeneration == generation &&
+                    self->getState() == WORK_RUNNING)
+                {
+                    self->complete(result);
+                }
+            },
+            "work.background");
+    };
+
+    if (canRunInBackground())
+    {
+        CLOG(DEBUG, "Work") << "running " << name << " in the background";
+        mApp.getWorkerIOService(mPool).post(runTask);
+    }
+    else
+    {
+        runTask();
+    }
+}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// Copyright 2018 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/Application.h"
+#include "work/Work.h"
+
+#include <functional>
+
+namespace stellar
+{
+
+/**
+ * Work whose running part is CPU or disk bound, and runs on a thread of one
+ * of the worker pools of the Application instead of the main thread.
+ *
+ * Each time the work runs, getBackgroundTask is called on the main thread
+ * and returns the task to run; the work then completes, back on the main
+ * thread, with the result of the task (WORK_COMPLETE_FAILURE if it
+ * throws). The task must only use what it captures by value (or by
+ * shared_ptr): never the work itself nor the subsystems of the
+ * Application, as the work may be reset or destroyed while the task runs,
+ * in which case its result is dropped.
+ */
+class BackgroundWork : public Work
+{
+  public:
+    typedef std::function<CompleteResult()> Task;
+
+    BackgroundWork(Application& app, WorkParent& parent,
+                   std::string uniqueName, Application::WorkerPool pool,
+                   size_t maxRetries = RETRY_A_FEW);
+
+    void onRun() final;
+    // drops the result of the task running, if any; subclasses overriding
+    // it must call it
+    void onReset() override;
+
+  protected:
+    virtual Task getBackgroundTask() = 0;
+
+    // whether the task may run now on a worker thread, or must run on the
+    // main thread (say, because it needs a database connection of its own)
+    virtual bool
+    canRunInBackground() const
+    {
+        return true;
+    }
+
+  private:
+    Application::WorkerPool const mPool;
+    // identifies the latest run, whose result is the only one awaited (none
+    // after a reset)
+    uint64_t mRunGeneration{0};
+};
+}
@@ -9,11 +9,14 @@
 #include "test/TestUtils.h"
 #include "test/test.h"
 #include "util/Fs.h"
+#include "work/BackgroundWork.h"
 #include "work/WorkManager.h"
 
+#include <atomic>
 #include <cstdio>
 #include <fstream>
 #include <random>
+#include <thread>
 #include <xdrpp/autocheck.h>
 
 using namespace stellar;
@@ -254,3 +257,133 @@ TEST_CASE("sub-subwork items succed at the same time", "[work]")
 
     REQUIRE(!work1->mCalledSuccessWithPendingSubwork);
 }
+
+class ThreadRecordingWork : public BackgroundWork
+{
+  public:
+    // written by the task, read once the work is done
+    std::shared_ptr<std::thread::id> mTaskThread{
+        std::make_shared<std::thread::id>()};
+    bool mFail;
+
+    ThreadRecordingWork(Application& app, WorkParent& parent,
+                        std::string const& uniqueName, bool fail)
+        : BackgroundWork(app, parent, uniqueName,
+                         Application::WORKER_POOL_MISC, RETRY_NEVER)
+        , mFail(fail)
+    {
+    }
+
+  protected:
+    Task
+    getBackgroundTask() override
+    {
+        auto taskThread = mTaskThread;
+        bool fail = mFail;
+        return [taskThread, fail]() {
+            *taskThread = std::this_thread::get_id();
+            if (fail)
+            {
+                throw std::runtime_error("failing on purpose");
+            }
+            return WORK_COMPLETE_OK;
+        };
+    }
+};
+
+TEST_CASE("background work", "[work]")
+{
+    VirtualClock clock;
+    auto const& cfg = getTestConfig();
+    auto app = createTestApplication(clock, cfg);
+    auto& wm = app->getWorkManager();
+    auto ok = wm.addWork<ThreadRecordingWork>("background-ok", false);
+    auto failing = wm.addWork<ThreadRecordingWork>("background-failing", true);
+    wm.advanceChildren();
+    while (!wm.allChildrenDone())
+    {
+        clock.crank();
+    }
+
+    REQUIRE(ok->getState() == Work::WORK_SUCCESS);
+    REQUIRE(failing->getState() == Work::WORK_FAILURE_RAISE);
+    for (auto const& w : {ok, failing})
+    {
+        REQUIRE(*w->mTaskThread != std::thread::id());
+        REQUIRE(*w->mTaskThread != std::this_thread::get_id());
+    }
+}
+
+class BlockingWork : public BackgroundWork
+{
+  public:
+    // set by the test to let the task return
+    std::shared_ptr<std::atomic<bool>> mRelease{
+        std::make_shared<std::atomic<bool>>(false)};
+    std::shared_ptr<std::atomic<int>> mStarted{
+        std::make_shared<std::atomic<int>>(0)};
+    // expires once the task and its copies are gone, which is after its
+    // result was posted to the main thread
+    std::weak_ptr<int> mTaskAlive;
+
+    BlockingWork(Application& app, WorkParent& parent,
+                 std::string const& uniqueName)
+        : BackgroundWork(app, parent, uniqueName,
+                         Application::WORKER_POOL_MISC, RETRY_NEVER)
+    {
+    }
+
+  protected:
+    Task
+    getBackgroundTask() override
+    {
+        auto release = mRelease;
+        auto started = mStarted;
+        auto alive = std::make_shared<int>(0);
+        mTaskAlive = alive;
+        return [release, started, alive]() {
+            ++*started;
+            while (!*release)
+            {
+                std::this_thread::yield();
+            }
+            return WORK_COMPLETE_OK;
+        };
+    }
+};
+
+TEST_CASE("background work reset while its task runs", "[work]")
+{
+    VirtualClock clock;
+    auto const& cfg = getTestConfig();
+    auto app = createTestApplication(clock, cfg);
+    auto& wm = app->getWorkManager();
+    auto w = wm.addWork<BlockingWork>("background-blocking");
+    wm.advanceChildren();
+    while (*w->mStarted == 0)
+    {
+        clock.crank(false);
+    }
+    REQUIRE(w->getState() == Work::WORK_RUNNING);
+
+    w->reset();
+    *w->mRelease = true;
+    while (!w->mTaskAlive.expired())
+    {
+        std::this_thread::yield();
+    }
+    while (clock.crank(false) != 0)
+    {
+    }
+    // the late result was dropped
+    REQUIRE(w->getState() == Work::WORK_PENDING);
+
+    // and the next run completes with its own
+    w->advance();
+    while (!wm.allChildrenDone())
+    {
+        clock.crank();
+    }
+    REQUIRE(w->getState() == Work::WORK_SUCCESS);
+    REQUIRE(w->mStarted->load() == 2);
+}
@@ -90,7 +90,19 @@ enum MessageType
     GET_SCP_STATE = 12,
 
     // new messages
-    HELLO = 13
+    HELLO = 13,
+
+    // pull mode transaction flooding
+    FLOOD_ADVERT = 14,
+    FLOOD_DEMAND = 15,
+
+    // compact transaction sets
+    COMPACT_TX_SET = 16,
+    GET_TX_SET_TXS = 17,
+    TX_SET_TXS = 18,
+
+    // SCP state without what the requester has
+    GET_SCP_STATE_DIFF = 19
 };
 
 struct DontHave
@@ -99,6 +111,57 @@ struct DontHave
     uint256 reqHash;
 };
 
+const TX_ADVERT_VECTOR_MAX_SIZE = 1000;
+typedef Hash TxAdvertVector<TX_ADVERT_VECTOR_MAX_SIZE>;
+
+// hashes (as used by the flooding layer: of the whole StellarMessage) of
+// transactions the sender has, to be demanded by the receiver if it does
+// not have them yet
+struct FloodAdvert
+{
+    TxAdvertVector txHashes;
+};
+
+const TX_DEMAND_VECTOR_MAX_SIZE = 1000;
+typedef Hash TxDemandVector<TX_DEMAND_VECTOR_MAX_SIZE>;
+
+struct FloodDemand
+{
+    TxDemandVector txHashes;
+};
+
+// a transaction set as the short ids of its transactions, in the order of
+// their full hashes, sent instead of TX_SET to peers that most likely know
+// them already (see shortTxID in herder/CompactTxSet.h)
+struct CompactTxSet
+{
+    Hash txSetHash;
+    Hash previousLedgerHash;
+    uint64 shortTxIDs<>;
+};
+
+// asks for the transactions at the given indexes of a compact set
+struct GetTxSetTxs
+{
+    Hash txSetHash;
+    uint32 indexes<>;
+};
+
+// the transactions asked for, in the order of the indexes
+struct TxSetTxs
+{
+    Hash txSetHash;
+    TransactionEnvelope txs<>;
+};
+
+// asks for the SCP state from ledgerSeq (as GET_SCP_STATE), except the
+// envelopes with these hashes, that the requester already has
+struct GetSCPStateDiff
+{
+    uint32 ledgerSeq;
+    Hash knownEnvelopes<>;
+};
+
 union StellarMessage switch (MessageType type)
 {
 case ERROR_MSG:
@@ -131,6 +194,23 @@ case SCP_MESSAGE:
     SCPEnvelope envelope;
 case GET_SCP_STATE:
     uint32 getSCPLedgerSeq; // ledger seq requested ; if 0, requests the latest
+
+// pull mode transaction flooding
+case FLOOD_ADVERT:
+    FloodAdvert floodAdvert;
+case FLOOD_DEMAND:
+    FloodDemand floodDemand;
+
+// compact transaction sets
+case COMPACT_TX_SET:
+    CompactTxSet compactTxSet;
+case GET_TX_SET_TXS:
+    GetTxSetTxs getTxSetTxs;
+case TX_SET_TXS:
+    TxSetTxs txSetTxs;
+
+case GET_SCP_STATE_DIFF:
+    GetSCPStateDiff getSCPStateDiff;
 };
 
 union AuthenticatedMessage switch (uint32 v)
@@ -142,5 +222,14 @@ case 0:
    StellarMessage message;
    HmacSha256Mac mac;
     } v0;
+case 1:
+    // message deflated with the ones before it on the connection (overlay
+    // version 10), the MAC covers the compressed bytes
+    struct
+{
+   uint64 sequence;
+   opaque compressedMessage<>;
+   HmacSha256Mac mac;
+    } v1;
 };
 }